@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @brief Header file for AudioAnalyzer class (the peaks and loudness of the audio of a media file)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_AUDIO_ANALYZER_H
+#define OPENSHOT_AUDIO_ANALYZER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Json.h"
+
+/// The number of samples (of each channel) of each peak of the finest level of an audio analysis
+#define AUDIO_PEAK_BLOCK 256
+
+namespace openshot
+{
+	/**
+	 * @brief This class holds the audio analysis of a media file: a pyramid of peaks (for waveforms), and its
+	 * loudness (EBU R128, for normalization)
+	 *
+	 * Level 0 of the pyramid holds the minimum and maximum sample of each channel, for each block of
+	 * AUDIO_PEAK_BLOCK samples. Each next level combines 2 peaks of the previous level, until a single peak
+	 * is left, so a waveform of any zoom level reads no more than about twice as many peaks as it draws.
+	 * The loudness values are in LUFS (and -70, the absolute gate of EBU R128, when the file is silent).
+	 */
+	class AudioAnalysis
+	{
+	public:
+		std::string path; ///< The media file path
+		int64_t file_size; ///< The size of the media file (to detect a changed file)
+		int64_t modified; ///< The modification time of the media file (in milliseconds since the epoch)
+		int sample_rate;
+		int channels;
+		int64_t sample_count; ///< The number of samples of each channel
+		std::vector<std::vector<float> > peaks; ///< The levels of the pyramid (a minimum and maximum for each channel of each peak)
+
+		double integrated_loudness; ///< The gated loudness of the whole file
+		double loudness_range; ///< The loudness range (LRA, in LU)
+		double max_momentary_loudness; ///< The loudest 400 ms
+		double max_short_term_loudness; ///< The loudest 3 seconds
+		double sample_peak; ///< The largest sample (in dBFS)
+
+		/// Default constructor (an empty analysis)
+		AudioAnalysis();
+
+		/// Get the number of peaks of a level of the pyramid
+		int64_t PeakCount(int level);
+
+		/// @brief Get the peaks of a channel, for a number of columns of a waveform (i.e. the pixels of a clip)
+		/// @param start_sample The first sample of the waveform
+		/// @param end_sample The sample after the last sample of the waveform
+		/// @param columns The number of columns
+		/// @param channel The channel
+		/// @param minimums The minimum sample of each column
+		/// @param maximums The maximum sample of each column
+		void GetPeaks(int64_t start_sample, int64_t end_sample, int columns, int channel, std::vector<float>& minimums, std::vector<float>& maximums);
+
+		/// @brief Get the gain which normalizes the integrated loudness to a target loudness (1.0 for a silent file)
+		/// @param target_loudness The loudness to normalize to (in LUFS, i.e. -23 for EBU R128, or -16 for streaming)
+		/// @param max_peak The highest sample peak after the gain (in dBFS), so loud peaks don't clip
+		double NormalizationGain(double target_loudness = -23.0, double max_peak = -1.0);
+
+		/// Save the analysis to a file (returns false if it can't be written)
+		bool Save(std::string file_path);
+
+		/// Load the analysis from a file (returns false if it is missing, or invalid)
+		bool Load(std::string file_path);
+
+		/// Get the loudness values (without the peaks) as a Json::Value
+		Json::Value JsonValue();
+	};
+
+	/**
+	 * @brief This class analyzes the audio of media files (see openshot::AudioAnalysis)
+	 *
+	 * Only the audio stream is decoded. A long file is split into chunks of Settings::AUDIO_ANALYSIS_CHUNK
+	 * seconds, each scanned by its own openshot::FFmpegReader on the openshot::TaskPool, and the results of the
+	 * chunks are merged (the loudness is measured from blocks of 100 ms, which add up across chunks). With
+	 * Settings::AUDIO_ANALYSIS_PATH, each analysis is saved, and loaded again until the media file changes.
+	 *
+	 * @code
+	 * std::shared_ptr<openshot::AudioAnalysis> analysis = openshot::AudioAnalyzer::Get("music.mp3");
+	 * double gain = analysis->NormalizationGain(-16.0);
+	 * @endcode
+	 */
+	class AudioAnalyzer
+	{
+	public:
+		/// @brief Analyze the audio of a media file (without loading or saving the analysis)
+		/// @param path The media file path
+		static std::shared_ptr<openshot::AudioAnalysis> Analyze(std::string path);
+
+		/// @brief Get the file path of the saved analysis of a media file (an empty string, if analyses are not saved)
+		/// @param path The media file path
+		static std::string AnalysisPath(std::string path);
+
+		/// @brief Get the analysis of a media file: the saved analysis (if it is up to date), or a new analysis (which is saved)
+		/// @param path The media file path
+		static std::shared_ptr<openshot::AudioAnalysis> Get(std::string path);
+	};
+
+}
+
+#endif
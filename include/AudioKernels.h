@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Header file for AudioKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_AUDIO_KERNELS_H
+#define OPENSHOT_AUDIO_KERNELS_H
+
+#include <cstdint>
+
+namespace openshot {
+
+	/**
+	 * @brief The samples of a channel to mix (with a linear gain ramp across the samples)
+	 */
+	struct AudioMixSource
+	{
+		const float *samples; ///< The samples of the channel
+		int sample_count; ///< The number of samples
+		float initial_gain; ///< The gain of the first sample
+		float final_gain; ///< The gain after the last sample (like juce::AudioBuffer::applyGainRamp)
+	};
+
+	/**
+	 * @brief This class holds the inner loops which mix audio samples
+	 *
+	 * Each kernel has a scalar version and vectorized versions (AVX2 or SSE4.1 on x86, NEON on 64-bit ARM), which are
+	 * picked at runtime, like the openshot::PixelKernels (and Settings::SIMD_EFFECTS). All the sources of a channel are
+	 * mixed in a single pass, so each sample of the target is only loaded and stored once.
+	 */
+	class AudioKernels {
+	public:
+		/// @brief Mix the samples of each source (multiplied by its gain ramp) into the target samples
+		/// @param target The samples to mix into (modified in place)
+		/// @param sample_count The number of samples to mix (which each source must have)
+		/// @param sources The sources to mix
+		/// @param source_count The number of sources
+		static void MixGainRamps(float *target, int sample_count, const AudioMixSource *sources, int source_count);
+
+		/// @brief Filter the input samples at evenly spaced (fractional) positions, with a polyphase filter
+		///
+		/// Each target sample is the dot product of the input samples around its position (from floor(position) -
+		/// tap_count / 2 + 1 to floor(position) + tap_count / 2) with a filter, which is interpolated between the
+		/// 2 nearest phases of the filter bank.
+		/// @param target The filtered samples
+		/// @param sample_count The number of samples to filter
+		/// @param input The input samples (with all the input samples needed by the positions)
+		/// @param position The position of the first target sample (in input samples)
+		/// @param step The distance between the positions of the target samples (in input samples)
+		/// @param filters The filter bank (phase_count + 1 filters of tap_count taps each, for the fractions 0 to 1)
+		/// @param phase_count The number of phases of the filter bank
+		/// @param tap_count The number of taps of each filter (a multiple of 8)
+		static void PolyphaseFilter(float *target, int sample_count, const float *input, double position, double step,
+									const float *filters, int phase_count, int tap_count);
+	};
+
+}
+
+#endif
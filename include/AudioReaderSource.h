@@ -39,7 +39,13 @@
 	#define _NDEBUG
 #endif
 
+#include <atomic>
+#include <condition_variable>
 #include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AudioRingBuffer.h"
 #include "ReaderBase.h"
 #include "JuceHeader.h"
 
@@ -50,37 +56,67 @@ namespace openshot
 	/**
 	 * @brief This class is used to expose any ReaderBase derived class as an AudioSource in JUCE.
 	 *
-	 * This allows any reader to play audio through JUCE (our audio framework).
+	 * This allows any reader to play audio through JUCE (our audio framework). A background prefetch thread
+	 * gets the frames from the reader, and writes their samples into a lock-free ring buffer, so the audio
+	 * callback never allocates, or waits for a frame to be decoded (it plays silence if the ring buffer runs out).
+	 * Other speeds (-4 to 4, for shuttle playback) are resampled while prefetching (playing the samples of each frame
+	 * backwards and faster, which also raises the pitch), into buffers which are allocated once.
 	 */
 	class AudioReaderSource : public juce::PositionableAudioSource
 	{
 	private:
-		int position; /// The position of the audio source (index of buffer)
+		int64_t position; /// The number of samples played by this audio source
 		bool repeat; /// Repeat the audio source when finished
-		int size; /// The size of the internal buffer
-		juce::AudioSampleBuffer *buffer; /// The audio sample buffer
-		int speed; /// The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...)
+		int size; /// The size of the ring buffer
+		AudioRingBuffer ring; /// The samples prefetched from the reader (but not played yet)
+		std::atomic<int> speed; /// The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...)
+		int stream_speed; /// The speed of the samples being prefetched (the speed of the latest seek)
 
 		ReaderBase *reader; /// The reader to pull samples from
 		int64_t original_frame_number; /// The current frame to read from
-		int64_t frame_number; /// The current frame number
+		int64_t frame_number; /// The next frame number to prefetch
 		std::shared_ptr<Frame> frame; /// The current frame object that is being read
-		int64_t frame_position; /// The position of the current frame's buffer
-		double estimated_frame; /// The estimated frame position of the currently playing buffer
+		mutable std::mutex frame_mutex; /// Guards the current frame object (which is shared with other threads)
+		double stream_position; /// The position of the next resampled sample in the current frame (-1 to 0 is after the last frame)
+		std::vector<float> stream_history; /// The last sample of each channel of the previous frame (to resample across frames)
+		std::vector<std::vector<float> > stream_samples; /// The resampled samples of each channel (before they are written into the ring buffer)
+		std::vector<const float*> stream_pointers; /// The resampled samples of each channel (as pointers, for the ring buffer)
+		std::atomic<double> estimated_frame; /// The estimated frame position of the currently playing buffer
 		int estimated_samples_per_frame; /// The estimated samples per frame of video
-
-		/// Get more samples from the reader
+		int64_t estimated_position; /// The position (in samples) of the estimated frame
+		mutable std::mutex estimate_mutex; /// Guards the position, and the estimated frame at that position
+
+		std::thread prefetch_thread; /// Gets frames from the reader, and writes their samples into the ring buffer
+		std::mutex prefetch_mutex;
+		std::condition_variable prefetch_condition;
+		bool is_prefetching; /// Is the prefetch thread running
+		bool prefetch_stop; /// Ask the prefetch thread to exit
+
+		std::atomic<int64_t> seek_frame; /// The frame number of the latest seek
+		std::atomic<int64_t> seek_generation; /// The number of seeks requested
+		std::atomic<int64_t> flushed_generation; /// The number of seeks handled by the prefetch thread
+		std::atomic<int64_t> flush_position; /// The ring buffer position of the first sample after the latest seek
+		int64_t played_generation; /// The number of seeks handled by the audio callback
+		std::atomic<int64_t> underruns; /// The number of blocks which ran out of prefetched samples (and played silence)
+
+		/// Get more samples from the reader (until the ring buffer is full, or a seek is requested)
 		void GetMoreSamplesFromReader();
 
-		/// Reverse an audio buffer (for backwards audio)
-		juce::AudioSampleBuffer* reverse_buffer(juce::AudioSampleBuffer* buffer);
+		/// Start the prefetch thread (if not already running)
+		void StartPrefetch();
+
+		/// Stop the prefetch thread (waiting for the frame it is getting, if any)
+		void StopPrefetch();
+
+		/// The main loop of the prefetch thread
+		void prefetch_loop();
 
 	public:
 
 		/// @brief Constructor that reads samples from a reader
 		/// @param audio_reader This reader provides constant samples from a ReaderBase derived class
 		/// @param starting_frame_number This is the frame number to start reading samples from the reader.
-		/// @param buffer_size The max number of samples to keep in the buffer at one time.
+		/// @param buffer_size The max number of samples to prefetch (at least 1 second of audio is prefetched).
 		AudioReaderSource(ReaderBase *audio_reader, int64_t starting_frame_number, int buffer_size);
 
 		/// Destructor
@@ -113,29 +149,37 @@ namespace openshot
 		/// @param shouldLoop Determines if the audio source should repeat when it reaches the end
 		void setLooping (bool shouldLoop);
 
-		/// Update the internal buffer used by this source
-		void setBuffer (juce::AudioSampleBuffer *audio_buffer);
-
 	    const ReaderInfo & getReaderInfo() const { return reader->info; }
 
 	    /// Return the current frame object
-	    std::shared_ptr<Frame> getFrame() const { return frame; }
+	    std::shared_ptr<Frame> getFrame() const;
 
 	    /// Get the estimate frame that is playing at this moment
-	    int64_t getEstimatedFrame() const { return int64_t(estimated_frame); }
+	    int64_t getEstimatedFrame() const { return int64_t(estimated_frame.load()); }
+
+	    /// @brief Get the frame position of a sample of this source (with sub-frame precision)
+	    /// @param sample_position The position of the sample (the same as the read positions of this source)
+	    ///
+	    /// The frame is extrapolated (at the current speed) from the estimated frame of the latest block of samples,
+	    /// so a sample which was read earlier (and is being played by the audio device) has an earlier frame.
+	    double getFrameAtPosition(double sample_position) const;
+
+	    /// Get the number of blocks which ran out of prefetched samples (and were padded with silence)
+	    int64_t getUnderruns() const { return underruns; }
 
-	    /// Set Speed (The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...)
-	    void setSpeed(int new_speed) { speed = new_speed; }
+	    /// Set Speed (The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...),
+	    /// from -4 to 4. The prefetched samples are dropped, and playback continues from the estimated frame.
+	    void setSpeed(int new_speed);
 	    /// Get Speed (The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...)
 	    int getSpeed() const { return speed; }
 
-	    /// Set Reader
-	    void Reader(ReaderBase *audio_reader) { reader = audio_reader; }
+	    /// Set Reader (the prefetch thread is restarted)
+	    void Reader(ReaderBase *audio_reader);
 	    /// Get Reader
 	    ReaderBase* Reader() const { return reader; }
 
-	    /// Seek to a specific frame
-	    void Seek(int64_t new_position) { frame_number = new_position; estimated_frame = new_position; }
+	    /// Seek to a specific frame (the prefetched samples are dropped)
+	    void Seek(int64_t new_position);
 
 	};
 
@@ -41,7 +41,8 @@
 	#define _NDEBUG
 #endif
 
-#include "AudioBufferSource.h"
+#include <vector>
+#include "AudioKernels.h"
 #include "Exceptions.h"
 #include "JuceHeader.h"
 
@@ -50,22 +51,28 @@ namespace openshot {
 	/**
 	 * @brief This class is used to resample audio data for many sequential frames.
 	 *
-	 * It maintains some data from the last call to GetResampledBuffer(), so there
-	 * are no pops and clicks between frames.
+	 * It keeps the last samples of the previous call to GetResampledBuffer(), so there are no pops and clicks
+	 * between frames. All channels are resampled (in a single call per frame) with a windowed sinc polyphase filter
+	 * (see AudioKernels::PolyphaseFilter), which is also a low-pass filter when the samples are sped up. The
+	 * resampled samples are delayed by half of the longest filter (64 samples).
 	 */
 	class AudioResampler {
 	private:
-		juce::AudioSampleBuffer *buffer;
-		juce::AudioSampleBuffer *resampled_buffer;
-		openshot::AudioBufferSource *buffer_source;
-		juce::ResamplingAudioSource *resample_source;
-		juce::AudioSourceChannelInfo resample_callback_buffer;
+		juce::AudioSampleBuffer *buffer; ///< The buffer of samples to resample
+		juce::AudioSampleBuffer *resampled_buffer; ///< The resampled samples (reused by each call)
+		std::vector<std::vector<float> > input_samples; ///< The last samples of the previous buffers (and the current buffer) of each channel
+		std::vector<float> filters; ///< The filter bank (for filter_ratio)
+		int tap_count; ///< The number of taps of each filter
+		int phase_count; ///< The number of phases of the filter bank
+		double filter_ratio; ///< The ratio the filter bank is designed for
 
 		int num_of_samples;
 		int new_num_of_samples;
 		double dest_ratio;
 		double source_ratio;
-		bool isPrepared;
+
+		/// Design the filter bank for a resampling ratio (a narrower low-pass filter, with more taps, when speeding up)
+		void design_filters(double ratio);
 
 	public:
 		/// Default constructor
@@ -87,6 +94,9 @@ namespace openshot {
 
 		/// Get the resampled audio buffer
 		juce::AudioSampleBuffer* GetResampledBuffer();
+
+		/// Forget the samples of the previous buffers (i.e. when the next buffer does not follow the last one)
+		void Reset();
 	};
 
 }
@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @brief Header file for AudioRingBuffer class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_AUDIO_RING_BUFFER_H
+#define OPENSHOT_AUDIO_RING_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace openshot {
+
+	/**
+	 * @brief A lock-free ring buffer of audio samples, between a single producer thread and a single consumer thread
+	 *
+	 * The samples of all channels are allocated once (by the constructor), so writing and reading never allocates,
+	 * locks, or waits (which is needed by a real-time audio callback). Only one thread can call Write(), and only one
+	 * (other) thread can call Read() and Discard(). The positions count all the samples ever written and read.
+	 */
+	class AudioRingBuffer {
+	private:
+		std::vector<std::vector<float> > samples; ///< The samples of each channel
+		int capacity; ///< The max number of samples in the buffer
+		std::atomic<int64_t> write_position; ///< The number of samples written (only changed by the producer)
+		std::atomic<int64_t> read_position; ///< The number of samples read (only changed by the consumer)
+
+	public:
+		/// @brief Constructor
+		/// @param channels The number of channels
+		/// @param capacity The max number of samples (of each channel) in the buffer
+		AudioRingBuffer(int channels, int capacity);
+
+		/// Get the number of channels
+		int Channels() const { return samples.size(); }
+
+		/// Get the max number of samples in the buffer
+		int Capacity() const { return capacity; }
+
+		/// Get the number of samples which can be read
+		int Available() const;
+
+		/// Get the number of samples which can be written
+		int Space() const;
+
+		/// Get the number of samples written so far
+		int64_t WritePosition() const { return write_position.load(std::memory_order_acquire); }
+
+		/// @brief Write samples into the buffer (only called by the producer thread)
+		/// @returns The number of samples written (less than requested, when the buffer is full)
+		/// @param channel_samples The samples of each channel (missing channels are written as silence)
+		/// @param channel_count The number of channels of samples
+		/// @param offset The index of the first sample to write (of each channel)
+		/// @param sample_count The number of samples to write
+		int Write(const float* const* channel_samples, int channel_count, int offset, int sample_count);
+
+		/// @brief Read samples from the buffer (only called by the consumer thread)
+		/// @returns The number of samples read (less than requested, when the buffer runs out)
+		/// @param channel_samples The samples of each channel to copy into (extra channels are left as is)
+		/// @param channel_count The number of channels to copy into
+		/// @param offset The index of the first sample to copy into (of each channel)
+		/// @param sample_count The number of samples to read
+		int Read(float* const* channel_samples, int channel_count, int offset, int sample_count);
+
+		/// @brief Drop the samples before a write position (only called by the consumer thread)
+		/// @param position A previous WritePosition() of the producer
+		void Discard(int64_t position);
+	};
+
+}
+
+#endif
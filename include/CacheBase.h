@@ -31,11 +31,14 @@
 #ifndef OPENSHOT_CACHE_BASE_H
 #define OPENSHOT_CACHE_BASE_H
 
+#include <atomic>
 #include <memory>
 #include <cstdlib>
+#include "Enums.h"
 #include "Frame.h"
 #include "Exceptions.h"
 #include "Json.h"
+#include "Metrics.h"
 
 namespace openshot {
 
@@ -51,10 +54,22 @@ namespace openshot {
 	protected:
 		std::string cache_type; ///< This is a friendly type name of the derived cache instance
 		int64_t max_bytes; ///< This is the max number of bytes to cache (0 = no limit)
+		openshot::CacheEvictionType eviction_policy; ///< Which frames are evicted first
+		std::atomic<int64_t> playhead_position; ///< The current playhead frame (used by EVICT_FAR_FROM_PLAYHEAD, set by the player's thread)
+		std::atomic<int> playhead_direction; ///< The direction of playback (1 = forward, -1 = reverse)
 
 		/// Section lock for multiple threads
 	    juce::CriticalSection *cacheCriticalSection;
 
+		openshot::Counter hit_counter; ///< Lookups which found their frame
+		openshot::Counter miss_counter; ///< Lookups which didn't find their frame
+		openshot::Counter eviction_counter; ///< Frames removed to stay under the max bytes
+
+		openshot::MemoryGauge *memory_gauge; ///< The memory gauge of this kind of cache (see SetMemoryTag)
+		int64_t tracked_bytes; ///< The bytes of this cache which are added to its memory gauge
+
+		/// Update the memory gauge with the bytes this cache holds in memory now
+		void track_bytes(int64_t bytes) { memory_gauge->Add(bytes - tracked_bytes); tracked_bytes = bytes; };
 
 	public:
 		/// Default constructor, no max bytes
@@ -100,6 +115,18 @@ namespace openshot {
 		/// @param number_of_bytes The maximum bytes to allow in the cache. Once exceeded, the cache will purge the oldest frames.
 		void SetMaxBytes(int64_t number_of_bytes) { max_bytes = number_of_bytes; };
 
+		/// Get the eviction policy (which frames are evicted first)
+		openshot::CacheEvictionType GetEvictionPolicy() { return eviction_policy; };
+
+		/// @brief Set the eviction policy (which frames are evicted first)
+		/// @param policy Evict the least recently used frames, or the frames farthest from the playhead
+		void SetEvictionPolicy(openshot::CacheEvictionType policy) { eviction_policy = policy; };
+
+		/// @brief Set the current playhead (used by the EVICT_FAR_FROM_PLAYHEAD policy, from any thread)
+		/// @param frame_number The frame currently being displayed
+		/// @param direction The direction of playback (1 = forward, -1 = reverse)
+		void SetPlayhead(int64_t frame_number, int direction) { playhead_position = frame_number; playhead_direction = (direction < 0) ? -1 : 1; };
+
 		/// @brief Set maximum bytes to a different amount based on a ReaderInfo struct
 		/// @param number_of_frames The maximum number of frames to hold in cache
 		/// @param width The width of the frame's image
@@ -108,6 +135,16 @@ namespace openshot {
 		/// @param channels The number of audio channels in the frame
 		void SetMaxBytesFromInfo(int64_t number_of_frames, int width, int height, int sample_rate, int channels);
 
+		/// Get the hits, misses, and evictions of this cache (and its hit rate) as JSON
+		virtual Json::Value MetricsValue();
+
+		/// Reset the hits, misses, and evictions of this cache
+		virtual void ResetMetrics();
+
+		/// @brief Set which memory gauge of openshot::Metrics the frames of this cache count towards ("cache.other" by default)
+		/// @param tag The subsystem of this cache (such as "cache.timeline"). Set it before frames are added to the cache.
+		void SetMemoryTag(std::string tag);
+
 		/// Get and Set JSON methods
 		virtual std::string Json() = 0; ///< Generate JSON string of this object
 		virtual void SetJson(std::string value) = 0; ///< Load JSON string into this object
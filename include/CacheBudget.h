@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief Header file for CacheBudget class (memory limit shared by all caches)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_CACHE_BUDGET_H
+#define OPENSHOT_CACHE_BUDGET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace openshot {
+
+	class CacheMemory;
+
+	/**
+	 * @brief This class keeps all memory caches combined under one memory limit (Settings::CACHE_MEMORY_LIMIT)
+	 *
+	 * Each FFmpegReader, FrameMapper, and Timeline has its own caches, sized independently. Every CacheMemory
+	 * registers with this singleton, and each cached frame is stamped with a process-wide use counter. When the
+	 * combined size of all caches exceeds the limit, the least recently used frame of all caches is evicted,
+	 * no matter which cache holds it. Each cache still keeps its most recent 20 frames.
+	 */
+	class CacheBudget {
+	private:
+		std::recursive_mutex budget_mutex; ///< Protects the list of caches (re-entrant, since eviction can add frames to other caches)
+		std::vector<CacheMemory*> caches; ///< All registered memory caches
+		std::atomic<int64_t> use_counter; ///< Process-wide counter, used to compare frame recency across caches
+
+		/// Constructor (private, because this is a singleton)
+		CacheBudget() : use_counter(0) {};
+
+		/// Don't allow the user to copy or assign this instance
+		CacheBudget(CacheBudget const&) = delete;
+		CacheBudget & operator=(CacheBudget const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static CacheBudget * m_pInstance;
+
+	public:
+		/// Create or get an instance of this cache budget singleton (invoke the class with this method)
+		static CacheBudget * Instance();
+
+		/// Register a memory cache (called by the CacheMemory constructor)
+		void Register(CacheMemory* cache);
+
+		/// Unregister a memory cache (called by the CacheMemory destructor)
+		void Unregister(CacheMemory* cache);
+
+		/// Get the next value of the process-wide use counter (larger values are more recent)
+		int64_t NextUse() { return ++use_counter; };
+
+		/// Get the combined bytes of all registered memory caches
+		int64_t GetBytes();
+
+		/// Evict the least recently used frames (of all caches) until the combined size is under the limit
+		void Enforce();
+	};
+
+}
+
+#endif
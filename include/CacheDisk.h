@@ -32,8 +32,12 @@
 #define OPENSHOT_CACHE_DISK_H
 
 #include <map>
+#include <condition_variable>
+#include <cstring>
 #include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "CacheBase.h"
 #include "Frame.h"
 #include "Exceptions.h"
@@ -49,6 +53,15 @@ namespace openshot {
 	 * It is used by the Timeline class, if enabled, to cache video and audio frames to disk, to cut down on CPU
 	 * and memory utilization. This will thrash a user's disk, but save their memory and CPU. It's a trade off that
 	 * sometimes makes perfect sense. You can also set the max number of bytes to cache.
+	 *
+	 * Use the "raw" format to store each frame as a single uncompressed binary file (header, pixels, and
+	 * planar float audio), which is memory-mapped when read. This avoids image encoding and decoding, and
+	 * parsing text audio files, at the cost of more disk space.
+	 *
+	 * Frames can also be keyed by a hash of the inputs they were rendered from (see AddKeyed), instead of their
+	 * frame number. Keyed frames are kept until the cache is cleared (not only for this session), so a timeline
+	 * using the folder again (see Timeline::SetRenderCache), in another session or on another machine sharing the
+	 * folder, reuses the frames it would render the same.
 	 */
 	class CacheDisk : public CacheBase {
 	private:
@@ -66,6 +79,16 @@ namespace openshot {
 		std::map<int64_t, int64_t> frame_ranges;	///< This map holds the ranges of frames, useful for quickly displaying the contents of the cache
 		int64_t range_version; ///< The version of the JSON range data (incremented with each change)
 
+		bool write_behind; ///< Are frames written to disk by a background thread
+		bool writer_running; ///< Is the writer thread still accepting frames
+		bool writer_busy; ///< Is the writer thread currently writing a frame
+		size_t max_pending_frames; ///< The max number of staged frames (Add waits when the queue is full)
+		std::map<int64_t, std::shared_ptr<openshot::Frame> > pending_frames; ///< Staged frames which are not written to disk yet
+		std::deque<int64_t> pending_queue; ///< Order to write staged frames in
+		std::mutex pending_mutex; ///< Protects the staged frames and queue
+		std::condition_variable pending_condition; ///< Signals changes to the staged frames and queue
+		std::thread writer_thread; ///< Background thread which writes staged frames to disk
+
 		/// Clean up cached frames that exceed the max number of bytes
 		void CleanUp();
 
@@ -75,17 +98,41 @@ namespace openshot {
 		/// Calculate ranges of frames
 		void CalculateRanges();
 
+		/// Save a frame's image and audio data to disk
+		void write_frame(std::shared_ptr<openshot::Frame> frame);
+
+		/// Update the size of a cached frame on disk (from the first written frame)
+		void update_frame_size(int64_t frame_number);
+
+		/// Remove a frame's image and audio files (if they exist)
+		void remove_files(int64_t frame_number);
+
+		/// Write staged frames to disk (on the writer thread)
+		void writer_loop();
+
+		/// Is this cache using the binary frame format (instead of image files and text audio files)
+		bool is_binary_format();
+
+		/// Save a frame's pixels (scaled by a scale factor) and audio samples into a single binary file
+		void save_binary(std::shared_ptr<openshot::Frame> frame, QString frame_path, float scale);
+
+		/// Get the path of the file of a keyed frame (see AddKeyed)
+		QString keyed_frame_path(std::string key);
+
+		/// Load a frame from a binary file (which is memory-mapped while reading)
+		std::shared_ptr<openshot::Frame> load_binary(int64_t frame_number, QString frame_path);
+
 	public:
 		/// @brief Default constructor, no max bytes
 		/// @param cache_path The folder path of the cache directory (empty string = /tmp/preview-cache/)
-		/// @param format The image format for disk caching (ppm, jpg, png)
+		/// @param format The image format for disk caching (ppm, jpg, png, or raw for uncompressed binary frames)
 		/// @param quality The quality of the image (1.0=highest quality/slowest speed, 0.0=worst quality/fastest speed)
 		/// @param scale The scale factor for the preview images (1.0 = original size, 0.5=half size, 0.25=quarter size, etc...)
 		CacheDisk(std::string cache_path, std::string format, float quality, float scale);
 
 		/// @brief Constructor that sets the max bytes to cache
 		/// @param cache_path The folder path of the cache directory (empty string = /tmp/preview-cache/)
-		/// @param format The image format for disk caching (ppm, jpg, png)
+		/// @param format The image format for disk caching (ppm, jpg, png, or raw for uncompressed binary frames)
 		/// @param quality The quality of the image (1.0=highest quality/slowest speed, 0.0=worst quality/fastest speed)
 		/// @param scale The scale factor for the preview images (1.0 = original size, 0.5=half size, 0.25=quarter size, etc...)
 		/// @param max_bytes The maximum bytes to allow in the cache. Once exceeded, the cache will purge the oldest frames.
@@ -118,6 +165,29 @@ namespace openshot {
 		/// @param frame_number The frame number of the cached frame
 		void MoveToFront(int64_t frame_number);
 
+		/// @brief Enable or disable asynchronous writes. When enabled, Add() stages the frame in memory and returns,
+		/// and a background thread writes it to disk. Staged frames are still returned by GetFrame().
+		/// @param enabled Write frames on a background thread
+		/// @param max_pending The max number of staged frames (Add() waits when this many frames are not written yet)
+		void SetWriteBehind(bool enabled, int max_pending=30);
+
+		/// Wait until all staged frames have been written to disk
+		void Flush();
+
+		/// @brief Add a frame keyed by a hash of its inputs, which other sessions using this folder can get. Keyed
+		/// frames are always saved in the binary format at full size (so a reused frame matches a rendered one), and
+		/// are not counted against the max bytes. A frame is written to a temporary file, and then renamed, so
+		/// other sessions sharing the folder never read a partly written frame.
+		/// @param key The hash of the inputs of the frame (a file name, i.e. a hex string)
+		/// @param frame The openshot::Frame object needing to be cached.
+		void AddKeyed(std::string key, std::shared_ptr<openshot::Frame> frame);
+
+		/// @brief Get a keyed frame (see AddKeyed)
+		/// @param key The hash of the inputs of the frame
+		/// @param frame_number The frame number of the returned frame
+		/// @returns The frame, or NULL if no frame was added with this key
+		std::shared_ptr<openshot::Frame> GetKeyedFrame(std::string key, int64_t frame_number);
+
 		/// @brief Remove a specific frame
 		/// @param frame_number The frame number of the cached frame
 		void Remove(int64_t frame_number);
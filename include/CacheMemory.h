@@ -31,12 +31,17 @@
 #ifndef OPENSHOT_CACHE_MEMORY_H
 #define OPENSHOT_CACHE_MEMORY_H
 
+#include <functional>
 #include <map>
-#include <deque>
+#include <list>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 #include "CacheBase.h"
+#include "CacheBudget.h"
 #include "Frame.h"
 #include "Exceptions.h"
+#include <QByteArray>
 
 namespace openshot {
 
@@ -47,17 +52,43 @@ namespace openshot {
 	 * high cost of decoding streams, once a frame is decoded, converted to RGB, and a Frame object is created,
 	 * it critical to keep these Frames cached for performance reasons.  However, the larger the cache, the more memory
 	 * is required.  You can set the max number of bytes to cache.
+	 *
+	 * Lookups (GetFrame, Count, GetBytes) share a read lock, so cache hits from the player, video cache and
+	 * audio threads do not wait on each other, only on changes to the cache.
 	 */
 	class CacheMemory : public CacheBase {
 	private:
-		std::map<int64_t, std::shared_ptr<openshot::Frame> > frames;	///< This map holds the frame number and Frame objects
-		std::deque<int64_t> frame_numbers;	///< This queue holds a sequential list of cached Frame numbers
+		/// A cached frame, with its position in the recently used list and its size
+		struct CacheEntry {
+			std::shared_ptr<openshot::Frame> frame; ///< The cached Frame object
+			std::list<int64_t>::iterator recent; ///< Position of this frame number in the recently used list
+			int64_t bytes; ///< Size of the frame when it was added (not counting its image buffer, if tracked in image_buffers)
+			int64_t image_bytes; ///< Size of the image buffer (when it was added)
+			const unsigned char *image_data; ///< The image buffer (used to count buffers shared by several frames once)
+			int64_t last_used; ///< When this frame was last added or moved to front (from CacheBudget::NextUse)
+			QByteArray compressed_image; ///< The compressed image (if compression is enabled, the frame holds only audio)
+			int image_width; ///< Width of the compressed image
+			int image_height; ///< Height of the compressed image
+			int image_bytes_per_line; ///< Bytes per line of the compressed image
+			QImage::Format image_format; ///< Format of the compressed image
+			uint image_hash; ///< Hash of the image pixels (if deduplication is enabled, or 0)
+		};
+
+		std::unordered_map<int64_t, CacheEntry> frames;	///< This map holds the frame number and Frame objects
+		std::list<int64_t> frame_numbers;	///< This list holds the cached Frame numbers (most recently used first)
+		int64_t total_bytes; ///< The running total of bytes of all cached frames
+		std::unordered_map<const unsigned char*, int> image_buffers; ///< Number of cached frames sharing each image buffer
+		std::unordered_map<uint, int64_t> image_hashes; ///< A cached frame with each image hash (see SetDeduplicateImages)
+		juce::ReadWriteLock cacheReadWriteLock; ///< Shared lock for lookups, exclusive lock for changes to the cache
 
 		bool needs_range_processing; ///< Something has changed, and the range data needs to be re-calculated
-		std::string json_ranges; ///< JSON ranges of frame numbers
-		std::vector<int64_t> ordered_frame_numbers; ///< Ordered list of frame numbers used by cache
-		std::map<int64_t, int64_t> frame_ranges;	///< This map holds the ranges of frames, useful for quickly displaying the contents of the cache
+		Json::Value json_ranges; ///< JSON ranges of frame numbers
+		std::map<int64_t, int64_t> frame_ranges;	///< This map holds the ranges of frames (start -> end), updated as frames are added and removed
 		int64_t range_version; ///< The version of the JSON range data (incremented with each change)
+		std::function<void(std::shared_ptr<openshot::Frame>)> eviction_callback; ///< Called with each frame evicted by CleanUp (optional)
+		std::vector<std::shared_ptr<openshot::Frame> > evicted_frames; ///< Frames evicted by CleanUp, waiting for the eviction callback
+		bool compress_images; ///< Store frame images compressed (and decompress them in GetFrame)
+		bool deduplicate_images; ///< Share the image buffer of identical cached images
 
 		/// Clean up cached frames that exceed the max number of bytes
 		void CleanUp();
@@ -65,6 +96,27 @@ namespace openshot {
 		/// Calculate ranges of frames
 		void CalculateRanges();
 
+		/// Compress a frame's image into a cache entry (the entry keeps a copy of the frame with only its audio)
+		static void compress_entry(std::shared_ptr<openshot::Frame> frame, CacheEntry& entry);
+
+		/// Share the image buffer of a cached frame with an identical image (if any) with a frame being added
+		void deduplicate_entry(std::shared_ptr<openshot::Frame> frame, CacheEntry& entry);
+
+		/// Get the cached frame of an entry (decompressing its image, if needed)
+		static std::shared_ptr<openshot::Frame> restore_entry(const CacheEntry& entry);
+
+		/// Get the next frame number to evict (depending on the eviction policy)
+		int64_t next_eviction();
+
+		/// Remove a cached frame (and its size from the running total)
+		void remove_entry(std::unordered_map<int64_t, CacheEntry>::iterator entry);
+
+		/// Add a frame number to the ranges of frames (merging with neighboring ranges)
+		void add_range(int64_t frame_number);
+
+		/// Remove a range of frame numbers from the ranges of frames (splitting ranges if needed)
+		void remove_range(int64_t start_frame_number, int64_t end_frame_number);
+
 	public:
 		/// Default constructor, no max bytes
 		CacheMemory();
@@ -100,6 +152,36 @@ namespace openshot {
 		/// @param frame_number The frame number of the cached frame
 		void MoveToFront(int64_t frame_number);
 
+		/// Are frame images stored compressed
+		bool GetCompressImages() { return compress_images; };
+
+		/// @brief Store frame images compressed (zlib), and decompress them in GetFrame. This holds several times more
+		/// frames in the same memory (at the cost of compressing and decompressing each image). Audio is kept raw.
+		/// Only affects frames added after this is changed.
+		/// @param enabled Compress frame images
+		void SetCompressImages(bool enabled) { compress_images = enabled; };
+
+		/// Are identical frame images stored once
+		bool GetDeduplicateImages() { return deduplicate_images; };
+
+		/// @brief Share one image buffer between the cached frames with identical images (i.e. the frames of a still
+		/// image, or of a freeze frame), so it is only counted once. Each added image is hashed, and compared with the
+		/// cached image with the same hash. Frames with native planes or a deferred image are not hashed. Only affects
+		/// frames added after this is changed (the default is Settings::CACHE_DEDUPLICATION).
+		/// @param enabled Deduplicate frame images
+		void SetDeduplicateImages(bool enabled) { deduplicate_images = enabled; };
+
+		/// Get when the least recently used frame was last used (or -1 if the cache only holds its minimum frames)
+		int64_t OldestUse();
+
+		/// Evict the least recently used frame (unless the cache only holds its minimum frames), used by CacheBudget
+		bool EvictOldest();
+
+		/// @brief Set a function to call with each frame evicted (when the cache exceeds its max bytes). The
+		/// function is called after the cache lock is released, so it can safely add the frame to another cache.
+		/// @param callback The function to call with each evicted frame (or an empty function to disable)
+		void SetEvictionCallback(std::function<void(std::shared_ptr<openshot::Frame>)> callback);
+
 		/// @brief Remove a specific frame
 		/// @param frame_number The frame number of the cached frame
 		void Remove(int64_t frame_number);
@@ -109,6 +191,9 @@ namespace openshot {
 		/// @param end_frame_number The ending frame number of the cached frame
 		void Remove(int64_t start_frame_number, int64_t end_frame_number);
 
+		/// Get the version of the range data (incremented each time the cached ranges change)
+		int64_t RangeVersion();
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
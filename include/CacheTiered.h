@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @brief Header file for CacheTiered class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_CACHE_TIERED_H
+#define OPENSHOT_CACHE_TIERED_H
+
+#include <memory>
+#include "CacheBase.h"
+#include "CacheDisk.h"
+#include "CacheMemory.h"
+#include "Frame.h"
+#include "Exceptions.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class is a two-tier cache manager for Frame objects (memory in front of disk).
+	 *
+	 * Recently used frames are kept in a CacheMemory. When the memory cache exceeds its max bytes, the
+	 * evicted frames are demoted to a CacheDisk (instead of being dropped), and frames found on disk are
+	 * promoted back into memory. This gives a large cache history without unbounded memory usage.
+	 *
+	 * @code
+	 * // 500 MB of frames in memory, and 5 GB on disk
+	 * CacheTiered cache(500 * 1024 * 1024, "", "raw", 1.0, 1.0, 5000LL * 1024 * 1024);
+	 * timeline.SetCache(&cache);
+	 * @endcode
+	 */
+	class CacheTiered : public CacheBase {
+	private:
+		CacheMemory memory_cache; ///< The hot tier (frames in memory)
+		CacheDisk disk_cache; ///< The cold tier (frames demoted to disk)
+
+		/// Demote a frame evicted from memory to disk
+		void demote(std::shared_ptr<openshot::Frame> frame);
+
+	public:
+		/// @brief Constructor that sets the max bytes of each tier
+		/// @param memory_bytes The maximum bytes to keep in memory. Once exceeded, the oldest frames are moved to disk.
+		/// @param cache_path The folder path of the disk cache directory (empty string = /tmp/preview-cache/)
+		/// @param format The image format for disk caching (ppm, jpg, png, or raw for uncompressed binary frames)
+		/// @param quality The quality of the image (1.0=highest quality/slowest speed, 0.0=worst quality/fastest speed)
+		/// @param scale The scale factor for the disk images (1.0 = original size, 0.5=half size, 0.25=quarter size, etc...)
+		/// @param disk_bytes The maximum bytes to keep on disk. Once exceeded, the disk cache will purge the oldest frames.
+		CacheTiered(int64_t memory_bytes, std::string cache_path, std::string format, float quality, float scale, int64_t disk_bytes);
+
+		// Default destructor
+		virtual ~CacheTiered();
+
+		/// @brief Add a Frame to the cache (in memory)
+		/// @param frame The openshot::Frame object needing to be cached.
+		void Add(std::shared_ptr<openshot::Frame> frame);
+
+		/// Clear the cache of all frames (in both tiers)
+		void Clear();
+
+		/// Count the frames in both tiers
+		int64_t Count();
+
+		/// @brief Get a frame from the cache (frames found on disk are promoted back into memory)
+		/// @param frame_number The frame number of the cached frame
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t frame_number);
+
+		/// Gets the bytes used by both tiers
+		int64_t GetBytes();
+
+		/// Get the smallest frame number (in either tier)
+		std::shared_ptr<openshot::Frame> GetSmallestFrame();
+
+		/// Get the memory tier (i.e. to change its max bytes)
+		CacheMemory* GetMemoryCache() { return &memory_cache; };
+
+		/// Get the disk tier (i.e. to change its max bytes, or enable write-behind)
+		CacheDisk* GetDiskCache() { return &disk_cache; };
+
+		/// @brief Remove a specific frame (from both tiers)
+		/// @param frame_number The frame number of the cached frame
+		void Remove(int64_t frame_number);
+
+		/// @brief Remove a range of frames (from both tiers)
+		/// @param start_frame_number The starting frame number of the cached frame
+		/// @param end_frame_number The ending frame number of the cached frame
+		void Remove(int64_t start_frame_number, int64_t end_frame_number);
+
+		/// Get the hits, misses, and evictions of this cache, and of each tier (as JSON)
+		Json::Value MetricsValue();
+
+		/// Reset the hits, misses, and evictions of this cache (and both tiers)
+		void ResetMetrics();
+
+		/// Get and Set JSON methods
+		std::string Json(); ///< Generate JSON string of this object
+		void SetJson(std::string value); ///< Load JSON string into this object
+		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
+		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
+	};
+
+}
+
+#endif
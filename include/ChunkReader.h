@@ -40,10 +40,14 @@
 #include <QtCore/qdir.h>
 #include <stdio.h>
 #include <cstdlib>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <utility>
 #include "Json.h"
 #include "CacheMemory.h"
 #include "Exceptions.h"
+#include "TaskPool.h"
 
 namespace openshot
 {
@@ -87,6 +91,10 @@ namespace openshot
 	 * the frames it is looking for. For example, if you only need the end of a video,
 	 * only the last few chunks might be needed to successfully access those openshot::Frame objects.
 	 *
+	 * The readers of the most recent chunks are kept open (so scrubbing back and forth across a chunk boundary
+	 * doesn't reopen them), and once the playhead passes the middle of a chunk, the next chunk is opened (and
+	 * its first frame decoded) on the openshot::TaskPool, before the playhead reaches it.
+	 *
 	 * \code
 	 * // This example demonstrates how to read a chunk folder and access frame objects inside it.
 	 * ChunkReader r("/home/jonathan/apps/chunks/chunk1/", FINAL); // Load highest quality version of this chunk file
@@ -106,10 +114,27 @@ namespace openshot
 		std::string path;
 		bool is_open;
 		int64_t chunk_size;
-		openshot::ReaderBase *local_reader;
-		ChunkLocation previous_location;
+		std::mutex readers_mutex;
+		std::list<std::pair<int64_t, std::shared_ptr<openshot::ReaderBase> > > chunk_readers; ///< The open chunk readers (by chunk number, front is the most recently used)
+		int64_t prefetch_chunk; ///< The chunk being opened by prefetch_tasks (0 = none)
 		ChunkVersion version;
 		std::shared_ptr<openshot::Frame> last_frame;
+		openshot::TaskGroup prefetch_tasks; ///< Opens the next chunk in the background (destroyed first)
+
+		/// Add an open chunk reader (and close the least recently used ones, if too many are open)
+		void add_chunk_reader(int64_t chunk_number, std::shared_ptr<openshot::ReaderBase> reader);
+
+		/// Find an open chunk reader (or NULL), and mark it as the most recently used
+		std::shared_ptr<openshot::ReaderBase> find_chunk_reader(int64_t chunk_number);
+
+		/// Get the reader of a chunk (waiting for its prefetch, or opening it)
+		std::shared_ptr<openshot::ReaderBase> get_chunk_reader(int64_t chunk_number, int64_t requested_frame, int64_t chunk_frame);
+
+		/// Open the reader of a chunk (throws InvalidFile, if the chunk is not found)
+		std::shared_ptr<openshot::ReaderBase> open_chunk_reader(int64_t chunk_number);
+
+		/// Open the next chunk (and decode its first frame) in the background
+		void prefetch_chunk_reader(int64_t chunk_number);
 
 		/// Check if folder path existing
 		bool does_folder_exist(std::string path);
@@ -131,7 +156,10 @@ namespace openshot
 		/// @param chunk_version	Choose the video version / quality (THUMBNAIL, PREVIEW, or FINAL)
 		ChunkReader(std::string path, ChunkVersion chunk_version);
 
-		/// Close the reader
+		/// Destructor (waits for the prefetch, and closes the chunk readers)
+		virtual ~ChunkReader();
+
+		/// Close the reader (and the open chunk readers)
 		void Close();
 
 		/// @brief Get the chunk size (number of frames to write in each chunk)
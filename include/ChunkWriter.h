@@ -34,7 +34,9 @@
 #include "ReaderBase.h"
 #include "WriterBase.h"
 #include "FFmpegWriter.h"
+#include "RenditionWriter.h"
 
+#include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <iostream>
@@ -47,6 +49,7 @@
 #include "CacheMemory.h"
 #include "Exceptions.h"
 #include "Json.h"
+#include "TaskPool.h"
 
 
 namespace openshot
@@ -59,6 +62,10 @@ namespace openshot
 	 * computing environment, without needing to share the entire video file. They also allow a
 	 * chunk to be frame accurate, since seeking inaccuracies are removed.
 	 *
+	 * Each chunk is independent (it starts with the last frame of the previous chunk), so with
+	 * SetChunkConcurrency(), a block of frames is written by encoding several chunks at once (each
+	 * with its own writers, on the openshot::TaskPool).
+	 *
 	 * @code
 	 * // This example demonstrates how to feed a reader into a ChunkWriter
 	 * FFmpegReader *r = new FFmpegReader("MyAwesomeVideo.mp4"); // Get a reader
@@ -84,6 +91,7 @@ namespace openshot
 		std::string path;
 		int64_t chunk_count;
 		int64_t chunk_size;
+		int chunk_concurrency; ///< Number of chunks encoded at once (by WriteFrame with a block of frames)
 		int64_t frame_count;
 		bool is_open;
 		bool is_writing;
@@ -91,12 +99,22 @@ namespace openshot
 		openshot::FFmpegWriter *writer_thumb;
 		openshot::FFmpegWriter *writer_preview;
 		openshot::FFmpegWriter *writer_final;
+		openshot::RenditionWriter writer_renditions; ///< Writes each frame to the final, preview, and thumb writers
 	    std::shared_ptr<Frame> last_frame;
 	    bool last_frame_needed;
 	    std::string default_extension;
 	    std::string default_vcodec;
 	    std::string default_acodec;
 
+		/// Write the trailers, and close (and delete) the writers of the current chunk
+		void close_writers();
+
+		/// Create the writer of a rendition of a chunk (scaled from the final size)
+		openshot::FFmpegWriter *create_writer(int64_t chunk_number, std::string folder, double scale);
+
+		/// Encode a whole chunk with its own writers (previous is the last frame of the previous chunk, or NULL)
+		void write_chunk(openshot::ReaderBase* reader, int64_t chunk_number, int64_t start, int64_t end, std::shared_ptr<openshot::Frame> previous);
+
 		/// check for chunk folder
 		void create_folder(std::string path);
 
@@ -119,6 +137,9 @@ namespace openshot
 		/// Close the writer
 		void Close();
 
+		/// Get the number of chunks encoded at once
+		int GetChunkConcurrency() { return chunk_concurrency; };
+
 		/// Get the chunk size (number of frames to write in each chunk)
 		int64_t GetChunkSize() { return chunk_size; };
 
@@ -128,6 +149,10 @@ namespace openshot
 		/// Open writer
 		void Open();
 
+		/// @brief Set the number of chunks encoded at once, when writing a block of frames (each chunk has its own writers)
+		/// @param count The number of chunks (1 = encode one chunk at a time)
+		void SetChunkConcurrency(int count) { chunk_concurrency = std::max(1, count); };
+
 		/// @brief Set the chunk size (number of frames to write in each chunk)
 		/// @param new_size The number of frames to write in this chunk file
 		void SetChunkSize(int64_t new_size) { chunk_size = new_size; };
@@ -36,6 +36,8 @@
 	#define __JUCE_UNITTEST_JUCEHEADER__
 #endif
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <string>
 #include <QtGui/QImage>
@@ -64,6 +66,33 @@ namespace openshot {
 			return false;
 	}};
 
+	/// The values of a clip's keyframes at a single frame (see Clip::EvaluateProperties). These are evaluated
+	/// once per frame, so compositing and mixing the clip only reads plain fields.
+	struct ClipProperties {
+		float alpha; ///< The alpha (1 to 0)
+		float scale_x; ///< The horizontal scaling in percent (0 to 1)
+		float scale_y; ///< The vertical scaling in percent (0 to 1)
+		float location_x; ///< The relative X position in percent based on the gravity (-1 to 1)
+		float location_y; ///< The relative Y position in percent based on the gravity (-1 to 1)
+		float rotation; ///< The rotation (0 to 360)
+		float shear_x; ///< The X shear angle in degrees
+		float shear_y; ///< The Y shear angle in degrees
+		float crop_x; ///< The X offset of the crop in percent
+		float crop_y; ///< The Y offset of the crop in percent
+		float crop_width; ///< The width of the crop in percent
+		float crop_height; ///< The height of the crop in percent
+		float volume; ///< The volume (0 to 1)
+		float previous_volume; ///< The volume of the previous frame (the start of this frame's gain ramp)
+		int channel_filter; ///< The audio channel to filter (-1 = all channels)
+		int channel_mapping; ///< The audio channel to output the filtered channel to (-1 = the same channel)
+		int has_audio; ///< The has_audio override (-1=undefined, 0=no, 1=yes)
+		int has_video; ///< The has_video override (-1=undefined, 0=no, 1=yes)
+		int wave_red; ///< The red of the waveform color (only evaluated for waveform clips)
+		int wave_green; ///< The green of the waveform color (only evaluated for waveform clips)
+		int wave_blue; ///< The blue of the waveform color (only evaluated for waveform clips)
+		int wave_alpha; ///< The alpha of the waveform color (only evaluated for waveform clips)
+	};
+
 	/**
 	 * @brief This class represents a clip (used to arrange readers on the timeline)
 	 *
@@ -112,25 +141,72 @@ namespace openshot {
 
 		// File Reader object
 		openshot::ReaderBase* reader;
+		bool hinted_video; ///< The streams last hinted to the reader (see ReaderBase::EnableStreams)
+		bool hinted_audio;
 
 		/// If we allocated a reader, we store it here to free it later
 		/// (reader member variable itself may have been replaced)
 		openshot::ReaderBase* allocated_reader;
 
+		// Output of the effects on a still image (reused while the image, and the effect keys, are the same)
+		juce::CriticalSection effectsCacheSection;
+		std::shared_ptr<QImage> cached_effects_image;
+		qint64 cached_effects_input_key;
+		std::string cached_effects_key;
+
+		// Processed frames of this clip (see Settings::CLIP_CACHE_SIZE), which are only reused while their
+		// request (and the state version of the clip and its effects) is the same
+		struct CachedFrame {
+			int64_t number;
+			int width;
+			int height;
+			bool audio_only;
+			int64_t version;
+			std::shared_ptr<openshot::Frame> frame;
+		};
+		juce::CriticalSection frameCacheSection;
+		std::deque<CachedFrame> cached_frames;
+		int64_t cache_version;
+
+		/// Find a processed frame of this clip (a copy, so the caller can change it), or NULL
+		std::shared_ptr<openshot::Frame> get_cached_frame(int64_t number, int width, int height, bool audio_only);
+
+		/// Keep a processed frame of this clip (unless the clip has changed since it was requested)
+		void add_cached_frame(int64_t number, int width, int height, bool audio_only, int64_t version, std::shared_ptr<openshot::Frame> frame);
+
+		// The audio block effects process the frames in order (see EffectBase::IsAudioBlockEffect), and the processed
+		// samples of the recent frames are kept (for the frames requested again, or after a later frame)
+		juce::CriticalSection audioEffectsSection;
+		int64_t audio_effects_next_frame; ///< The frame the audio effects expect next (0 = they are reset first)
+		std::map<int64_t, std::vector<std::vector<float> > > processed_audio;
+
 		/// Adjust frame number minimum value
 		int64_t adjust_frame_number_minimum(int64_t frame_number);
 
 		/// Apply effects to the source frame (if any)
 		std::shared_ptr<openshot::Frame> apply_effects(std::shared_ptr<openshot::Frame> frame);
 
+		/// Collect the GPU kernels of every video effect (see EffectBase::GetGpuKernel), or return false (and no kernels)
+		/// if an effect has none, so the effects are applied on the CPU
+		bool get_gpu_kernels(std::shared_ptr<openshot::Frame> frame, std::vector<openshot::EffectBase::GpuKernel>& gpu_kernels);
+
+		/// Apply the audio block effects (if any) to the audio of a frame, processing any skipped frames first
+		void apply_audio_effects(std::shared_ptr<openshot::Frame> frame, int64_t requested_frame);
+
 		/// Get file extension
 		std::string get_file_extension(std::string path);
 
-		/// Get a frame object or create a blank one
-		std::shared_ptr<openshot::Frame> GetOrCreateFrame(int64_t number);
+		/// Get a frame object (at the size it will be drawn at, if any, or only for its audio) or create a blank one
+		std::shared_ptr<openshot::Frame> GetOrCreateFrame(int64_t number, int width, int height, bool audio_only);
+
+		/// Get a frame of this clip (with its image and effects, unless only its audio is needed). With gpu_kernels,
+		/// the effects are returned as GPU kernels instead, when all of them have one.
+		std::shared_ptr<openshot::Frame> get_frame(int64_t requested_frame, int width, int height, bool audio_only,
+			std::vector<openshot::EffectBase::GpuKernel>* gpu_kernels = NULL);
 
-		/// Adjust the audio and image of a time mapped frame
-		void get_time_mapped_frame(std::shared_ptr<openshot::Frame> frame, int64_t frame_number);
+		/// Adjust the audio of a time mapped frame (the original frame is the reader's frame it was created from,
+		/// and each other frame of the reader it needs is only requested once)
+		void get_time_mapped_frame(std::shared_ptr<openshot::Frame> frame, std::shared_ptr<openshot::Frame> original_frame, int64_t frame_number, bool audio_only);
 
 		/// Init default settings for a clip
 		void init_settings();
@@ -138,12 +214,15 @@ namespace openshot {
 		/// Update default rotation from reader
 		void init_reader_rotation();
 
+		/// Hint the streams this clip uses to its reader (when they change), so a disabled stream is not decoded
+		void update_stream_hints();
+
+		/// Bake the animated keyframes which are evaluated for every frame (see Keyframe::Bake())
+		void bake_keyframes();
+
 		/// Sort effects by order
 		void sort_effects();
 
-		/// Reverse an audio buffer
-		void reverse_buffer(juce::AudioSampleBuffer* buffer);
-
 	public:
 		openshot::GravityType gravity; ///< The gravity of a clip determines where it snaps to its parent
 		openshot::ScaleType scale; ///< The scale determines how a clip should be resized to fit its parent
@@ -169,18 +248,70 @@ namespace openshot {
 		/// @param effect Add an effect to the clip. An effect can modify the audio or video of an openshot::Frame.
 		void AddEffect(openshot::EffectBase* effect);
 
+		/// @brief Remove the processed frames kept by this clip (see Settings::CLIP_CACHE_SIZE).
+		///
+		/// Changes made through SetJsonValue(), Reader(), AddEffect() and RemoveEffect() do this automatically,
+		/// but changing a keyframe or an effect directly needs this to be called.
+		void ClearCache();
+
+		/// Get the version of the clip's state, which ClearCache() increments (when its reader or effects change)
+		int64_t CacheVersion();
+
 		/// Close the internal reader
 		void Close();
 
 		/// Return the list of effects on the timeline
 		std::list<openshot::EffectBase*> Effects() { return effects; };
 
+		/// Get the frame number of the reader which a frame of this clip is mapped from (by the time curve, if any)
+		int64_t MappedFrameNumber(int64_t frame_number);
+
+		/// Evaluate the keyframes which are read while compositing and mixing a frame of this clip
+		openshot::ClipProperties EvaluateProperties(int64_t frame_number);
+
+		/// Generate a JSON string of the timing counters of this clip's effects (see EffectTimingJsonValue)
+		std::string EffectTimingJson();
+
+		/// Generate a JSON object of the timing counters of this clip's effects ("id", and an "effects" array
+		/// of each effect's calls, total and average milliseconds, and pixels processed)
+		Json::Value EffectTimingJsonValue();
+
+		/// Reset the timing counters of this clip's effects
+		void ResetEffectTiming();
+
 		/// @brief Get an openshot::Frame object for a specific frame number of this timeline.
 		///
 		/// @returns The requested frame (containing the image)
 		/// @param requested_frame The frame number that is requested
 		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame);
 
+		/// @brief Get an openshot::Frame object for a specific frame number of this clip, with its image decoded
+		/// at the size it will be drawn at (when the reader supports it).
+		///
+		/// @returns The requested frame (containing the image)
+		/// @param requested_frame The frame number that is requested
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame, int width, int height);
+
+		/// @brief Get an openshot::Frame object for a specific frame number of this clip, at the size it will be
+		/// drawn at, for the openshot::GpuCompositor. When every effect has a GPU kernel (see EffectBase::GetGpuKernel),
+		/// the image is returned without its effects, and the kernels are returned instead (to run on the GPU).
+		///
+		/// @returns The requested frame (containing the image)
+		/// @param requested_frame The frame number that is requested
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		/// @param gpu_kernels The GPU kernels of the effects which were not applied (in order, empty if they were all applied)
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame, int width, int height, std::vector<openshot::EffectBase::GpuKernel>& gpu_kernels);
+
+		/// @brief Get an openshot::Frame object for a specific frame number of this clip, for its audio only.
+		/// The image is not shared with the frame, and only the audio block effects are applied.
+		///
+		/// @returns The requested frame (containing the audio, with a blank image)
+		/// @param requested_frame The frame number that is requested
+		std::shared_ptr<openshot::Frame> GetAudioFrame(int64_t requested_frame);
+
 		/// Open the internal reader
 		void Open();
 
@@ -193,7 +324,7 @@ namespace openshot {
 
 		/// Override End() method
 		float End(); ///< Get end position (in seconds) of clip (trim end of video), which can be affected by the time curve.
-		void End(float value) { end = value; } ///< Set end position (in seconds) of clip (trim end of video)
+		void End(float value) { ClipBase::End(value); } ///< Set end position (in seconds) of clip (trim end of video)
 
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
@@ -36,6 +36,8 @@
 	#define __JUCE_UNITTEST_JUCEHEADER__
 #endif
 
+#include <memory>
+#include <atomic>
 #include <memory>
 #include <sstream>
 #include "Exceptions.h"
@@ -59,6 +61,17 @@ namespace openshot {
 		float start; ///< The position in seconds to start playing (used to trim the beginning of a clip)
 		float end; ///< The position in seconds to end playing (used to trim the ending of a clip)
 		std::string previous_properties; ///< This string contains the previous JSON properties
+		openshot::Fraction frames_fps; ///< The frame rate of the timeline frames below (0/1 = not on a timeline yet)
+		int64_t position_frame; ///< The first timeline frame of this clip (at frames_fps)
+		int64_t end_position_frame; ///< The last timeline frame of this clip (at frames_fps)
+		int64_t start_frame; ///< The first frame of this clip's media, i.e. after trimming its start (at frames_fps)
+		std::shared_ptr<std::atomic<int64_t> > change_counter; ///< The change counter of the timeline this clip is on (see ChangeCounter), or NULL
+
+		/// Calculate the timeline frames of this clip (when its position, start, end, or frame rate change)
+		void update_frames();
+
+		/// Count a change to the position, layer, start, or end of this clip (on the timeline it is on, if any)
+		void changed() { if (change_counter) (*change_counter)++; }
 
 		/// Generate JSON for a property
 		Json::Value add_property_json(std::string name, float value, std::string type, std::string memo, Keyframe* keyframe, float min_value, float max_value, bool readonly, int64_t requested_frame);
@@ -69,7 +82,7 @@ namespace openshot {
 	public:
 
 		/// Constructor for the base clip
-		ClipBase() { };
+		ClipBase() : position(0.0), layer(0), start(0.0), end(0.0), frames_fps(0, 1), position_frame(1), end_position_frame(1), start_frame(1) { };
 
 		// Compare a clip using the Position() property
 		bool operator< ( ClipBase& a) { return (Position() < a.Position()); }
@@ -87,10 +100,29 @@ namespace openshot {
 
 		/// Set basic properties
 		void Id(std::string value) { id = value; } ///> Set the Id of this clip object
-		void Position(float value) { position = value; } ///< Set position on timeline (in seconds)
-		void Layer(int value) { layer = value; } ///< Set layer of clip on timeline (lower number is covered by higher numbers)
-		void Start(float value) { start = value; } ///< Set start position (in seconds) of clip (trim start of video)
-		void End(float value) { end = value; } ///< Set end position (in seconds) of clip (trim end of video)
+		void Position(float value) { if (value == position) return; position = value; update_frames(); changed(); } ///< Set position on timeline (in seconds)
+		void Layer(int value) { if (value == layer) return; layer = value; changed(); } ///< Set layer of clip on timeline (lower number is covered by higher numbers)
+		void Start(float value) { if (value == start) return; start = value; update_frames(); changed(); } ///< Set start position (in seconds) of clip (trim start of video)
+		void End(float value) { if (value == end) return; end = value; update_frames(); changed(); } ///< Set end position (in seconds) of clip (trim end of video)
+
+		/// @brief Set the change counter of the timeline this clip is on (called by the timeline, NULL when it is removed)
+		///
+		/// Each change to the position, layer, start, or end of the clip (which changes its value) increments the
+		/// counter, so the timeline only updates the frame ranges of its clips when one of its own clips moved. The
+		/// counter is shared, so a clip which outlives its timeline can still change.
+		void ChangeCounter(std::shared_ptr<std::atomic<int64_t> > counter) { change_counter = counter; }
+
+		/// Get the change counter of the timeline this clip is on (or NULL)
+		std::shared_ptr<std::atomic<int64_t> > ChangeCounter() { return change_counter; }
+
+		/// @brief Set the frame rate of the timeline this clip is on (called by the timeline), so the timeline
+		/// frames of the clip are calculated once, and kept up to date when the clip changes
+		void FrameRate(openshot::Fraction fps);
+
+		/// Get the timeline frames of this clip (as integers, at the frame rate set by FrameRate())
+		int64_t PositionFrame() { return position_frame; } ///< Get the first timeline frame of this clip
+		int64_t EndPositionFrame() { return end_position_frame; } ///< Get the last timeline frame of this clip
+		int64_t StartFrame() { return start_frame; } ///< Get the first frame of this clip's media (after trimming its start)
 
 		/// Get and Set JSON methods
 		virtual std::string Json() = 0; ///< Generate JSON string of this object
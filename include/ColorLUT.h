@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief Header file for ColorLUT class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_COLOR_LUT_H
+#define OPENSHOT_COLOR_LUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "EffectBase.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class bakes a chain of point-wise color effects into a 3D lookup table (LUT)
+	 *
+	 * The pixel kernels of the effects (see EffectBase::GetPixelKernel) are run once on a grid of colors, and the
+	 * LUT is then applied to each pixel with tetrahedral interpolation between the 4 nearest grid colors. This makes
+	 * a long chain of color effects cost about the same as a single one. Only kernels which change the RGB values
+	 * based on the RGB values alone (see EffectBase::IsColorKernel) can be baked.
+	 */
+	class ColorLUT {
+	private:
+		int size; ///< The number of grid points on each axis
+		std::vector<uint64_t> table; ///< The RGB output of each grid point, in 16-bit lanes (red is the fastest changing axis)
+		std::vector<int> grid_values; ///< The 8-bit color value of each grid point (on each axis)
+		int grid_index[256]; ///< The grid cell of each 8-bit color value
+		int grid_weight[256]; ///< The position of each 8-bit color value in its grid cell (0 to 256)
+
+	public:
+		/// @brief Constructor, which creates an identity LUT
+		/// @param lut_size The number of grid points on each axis (2 to 256, such as 17 or 33)
+		ColorLUT(int lut_size = 33);
+
+		/// @brief Bake pixel kernels (run in order) into this LUT
+		/// @param kernels The color kernels (see EffectBase::IsColorKernel)
+		void Bake(const std::vector<EffectBase::PixelKernel>& kernels);
+
+		/// @brief Apply this LUT to pixels (the alpha value is left alone)
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		void Apply(unsigned char *pixels, int64_t pixel_count) const;
+
+		/// Get the number of grid points on each axis
+		int Size() const { return size; }
+	};
+
+}
+
+#endif
@@ -56,30 +56,95 @@
 #ifndef OPENSHOT_DECKLINK_INPUT_H
 #define OPENSHOT_DECKLINK_INPUT_H
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <thread>
 #include <unistd.h>
 #include <fcntl.h>
+#include <vector>
 
 #include "DeckLinkAPI.h"
 #include "Frame.h"
 #include "CacheMemory.h"
+#include "ImageBufferPool.h"
 #include "OpenMPUtilities.h"
 
-/// Implementation of the Blackmagic Decklink API (used by the DecklinkReader)
+/**
+ * @brief A DeckLink video frame whose pixels are a (pooled) QImage
+ *
+ * The capture workers convert each captured frame straight into the image of an openshot::Frame, instead of
+ * into an intermediate frame of the DeckLink output (which would be copied again).
+ */
+class DeckLinkImageFrame : public IDeckLinkVideoFrame
+{
+public:
+	std::shared_ptr<QImage> image;
+
+	DeckLinkImageFrame(int width, int height);
+
+	// This object lives on the stack of a worker, so the reference count is ignored
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID *ppv) { return E_NOINTERFACE; }
+	virtual ULONG STDMETHODCALLTYPE AddRef(void) { return 1; }
+	virtual ULONG STDMETHODCALLTYPE Release(void) { return 1; }
+
+	virtual long STDMETHODCALLTYPE GetWidth(void) { return image->width(); }
+	virtual long STDMETHODCALLTYPE GetHeight(void) { return image->height(); }
+	virtual long STDMETHODCALLTYPE GetRowBytes(void) { return image->bytesPerLine(); }
+	virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void);
+	virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void) { return bmdFrameFlagDefault; }
+	virtual HRESULT STDMETHODCALLTYPE GetBytes(void **buffer);
+	virtual HRESULT STDMETHODCALLTYPE GetTimecode(BMDTimecodeFormat format, IDeckLinkTimecode **timecode) { return S_FALSE; }
+	virtual HRESULT STDMETHODCALLTYPE GetAncillaryData(IDeckLinkVideoFrameAncillary **ancillary) { return S_FALSE; }
+};
+
+/**
+ * @brief A lock-free queue of captured frames, from the capture callback to one capture worker
+ *
+ * There is exactly one producer and one consumer, so the head and tail are the only shared state.
+ */
+class DeckLinkCaptureQueue
+{
+public:
+	struct Entry {
+		IDeckLinkVideoInputFrame *frame;
+		unsigned long number;
+	};
+
+	DeckLinkCaptureQueue(size_t capacity) : entries(capacity + 1), head(0), tail(0) {};
+
+	/// Add a frame (returns false if the queue is full)
+	bool Push(const Entry& entry);
+
+	/// Remove the oldest frame (returns false if the queue is empty)
+	bool Pop(Entry& entry);
+
+private:
+	std::vector<Entry> entries;
+	std::atomic<size_t> head; ///< The next entry to pop (only written by the consumer)
+	std::atomic<size_t> tail; ///< The next entry to push (only written by the producer)
+};
+
+/**
+ * @brief Implementation of the Blackmagic Decklink API (used by the DecklinkReader)
+ *
+ * The capture callback doesn't copy or convert anything: it keeps a reference to the frame of the SDK, and
+ * queues it for one of a fixed pool of capture workers (round robin). Each worker converts its frames into
+ * pooled images, and adds them to the cache. Frames are published in order, once every earlier frame is
+ * done. If the workers fall behind (so the SDK would run out of buffers), new frames are dropped (and get
+ * no frame number).
+ */
 class DeckLinkInputDelegate : public IDeckLinkInputCallback
 {
 public:
 	pthread_cond_t*			sleepCond;
 	BMDTimecodeFormat		g_timecodeFormat;
 	unsigned long 			frameCount;
-	unsigned long 			final_frameCount;
 
-	// Queue of raw video frames
-	std::deque<IDeckLinkMutableVideoFrame*> raw_video_frames;
 	openshot::CacheMemory final_frames;
 
 	// Convert between YUV and RGB
@@ -102,6 +167,23 @@ public:
 private:
 	ULONG				m_refCount;
 	pthread_mutex_t		m_mutex;
+
+	// The capture workers (each one with its own queue)
+	std::vector<std::unique_ptr<DeckLinkCaptureQueue> > queues;
+	std::vector<std::thread> workers;
+	std::atomic<bool> stopping;
+	unsigned long max_in_flight; ///< Most frames queued or converting (the rest are dropped)
+
+	// The frames which are done (a ring of max_in_flight * 2 frame numbers + 1), and the number of frames published
+	std::unique_ptr<std::atomic<unsigned long>[]> done;
+	size_t done_size;
+	std::atomic<unsigned long> published;
+
+	/// Convert the frames of a queue (on a capture worker)
+	void worker_loop(DeckLinkCaptureQueue *queue);
+
+	/// Mark a frame as done, and publish the done frames which are next in order
+	void finish_frame(unsigned long number);
 };
 
 #endif
@@ -56,25 +56,39 @@
 #ifndef OPENSHOT_DECKLINK_OUTPUT_H
 #define OPENSHOT_DECKLINK_OUTPUT_H
 
+#include <condition_variable>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <thread>
+#include <vector>
 
 #include "DeckLinkAPI.h"
 #include "CacheMemory.h"
 #include "Frame.h"
 #include "OpenMPUtilities.h"
+#include "ReaderBase.h"
 
 enum OutputSignal {
 	kOutputSignalPip		= 0,
 	kOutputSignalDrop		= 1
 };
 
-/// Implementation of the Blackmagic Decklink API (used by the DecklinkWriter)
+/**
+ * @brief Implementation of the Blackmagic Decklink API (used by the DecklinkWriter)
+ *
+ * Frames are either written (and queued) with WriteFrame(), or pulled from a reader (i.e. a Timeline) in
+ * playout mode. In playout mode, a fixed pool of workers renders the frames ahead of the output, and converts
+ * them to UYVY (into a preallocated pool of DeckLink frames). Once the preroll frames are done, playback
+ * starts, and each completed frame schedules the next one. A frame which isn't done in time is late (the last
+ * frame is shown again), and is dropped when it is done.
+ */
 class DeckLinkOutputDelegate : public IDeckLinkVideoOutputCallback, public IDeckLinkAudioOutputCallback
 {
 protected:
@@ -130,9 +144,55 @@ public:
 	/// Custom method to write new frames
 	void WriteFrame(std::shared_ptr<openshot::Frame> frame);
 
+	/// @brief Start playing the frames of a reader (i.e. a Timeline, which is rendered as it plays)
+	/// @param reader The reader (which must be open, and is rendered at the size of the display mode)
+	/// @param start_frame The first frame to play
+	/// @param preroll_frames The number of frames rendered before playback starts (the latency of the output)
+	void StartPlayout(openshot::ReaderBase *reader, int64_t start_frame, int preroll_frames);
+
+	/// Stop playing the reader (and stop the output)
+	void StopPlayout();
+
+	/// Is a reader playing
+	bool IsPlayingOut() { return playout_reader != NULL; }
+
+	/// Get the number of frames which weren't done in time (since playout started)
+	unsigned long LateFrames();
+
+	/// Get the number of frames which were dropped (done too late, or dropped by the device)
+	unsigned long DroppedFrames();
+
 private:
 	ULONG				m_refCount;
 	pthread_mutex_t		m_mutex;
+
+	// Playout mode
+	openshot::ReaderBase *playout_reader;
+	int64_t playout_start; ///< The frame shown at stream time 0
+	int64_t next_render; ///< The next frame to render (claimed by a worker)
+	std::vector<IDeckLinkMutableVideoFrame*> playout_frames; ///< The pool of UYVY frames
+	std::vector<IDeckLinkMutableVideoFrame*> free_frames;
+	std::map<int64_t, IDeckLinkMutableVideoFrame*> ready_frames; ///< Done frames (by frame number)
+	std::map<IDeckLinkVideoFrame*, int> scheduled_counts; ///< Number of times each frame is scheduled
+	IDeckLinkMutableVideoFrame *last_frame; ///< The last scheduled frame (shown again when a frame is late)
+	unsigned long late_frames;
+	unsigned long dropped_frames;
+	bool playout_stopping;
+	std::vector<std::thread> playout_workers;
+	std::mutex playout_mutex;
+	std::condition_variable playout_condition;
+
+	/// Render and convert frames (on a playout worker)
+	void playout_loop();
+
+	/// Convert the image of a frame to a UYVY frame
+	void convert_frame(std::shared_ptr<openshot::Frame> frame, IDeckLinkMutableVideoFrame *output);
+
+	/// Schedule the frame of the next stream time (playout_mutex must be locked)
+	void schedule_playout_frame();
+
+	/// Return a frame to the pool, once it isn't scheduled anymore (playout_mutex must be locked)
+	void release_playout_frame(IDeckLinkVideoFrame *frame);
 };
 
 
@@ -105,6 +105,21 @@ namespace openshot
 		/// Open device and video stream - which is called by the constructor automatically
 		void Open();
 
+		/// @brief Play the frames of a reader (i.e. a Timeline), rendering them as they play (instead of writing frames)
+		/// @param reader The open reader (rendered at the size of the video mode)
+		/// @param start_frame The first frame to play
+		/// @param preroll_frames The frames rendered before the output starts (more frames add latency, but fewer late frames)
+		void StartPlayout(ReaderBase* reader, int64_t start_frame = 1, int preroll_frames = 3);
+
+		/// Stop playing the reader
+		void StopPlayout();
+
+		/// Get the number of frames of the playout which weren't rendered in time (the previous frame was shown again)
+		unsigned long LateFrames();
+
+		/// Get the number of frames of the playout which were dropped (rendered too late, or dropped by the device)
+		unsigned long DroppedFrames();
+
 		/// Determine if writer is open or closed
 		bool IsOpen() { return is_open; };
 
@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief Header file for RenderCoordinator and RenderWorker classes
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_DISTRIBUTED_RENDER_H
+#define OPENSHOT_DISTRIBUTED_RENDER_H
+
+#include <string>
+#include "Exceptions.h"
+#include "Json.h"
+#include "ParallelExporter.h"
+
+namespace openshot
+{
+	/**
+	 * @brief This class sends the segments of a openshot::ParallelExporter to render workers (over ZeroMQ), and
+	 * concatenates the encoded segments they return
+	 *
+	 * The coordinator binds a ROUTER socket, and each openshot::RenderWorker connects to it with a REQ socket.
+	 * A worker asks for work, and the coordinator answers with the JSON of the exporter (which contains the
+	 * timeline snapshot and the writer options) and the index of a segment. The worker renders the segment with
+	 * ParallelExporter::ExportSegment(), and sends the encoded segment file back with its next request. Once every
+	 * segment has been returned, the coordinator renders the audio (with ParallelExporter::ExportAudio(), since it is
+	 * encoded once for the whole range) and calls ParallelExporter::Concatenate().
+	 *
+	 * A segment which fails is sent to another worker (up to 3 times), and a segment whose worker does not answer
+	 * within the timeout is sent again, so a worker can leave (or crash) during an export. The file paths of the
+	 * media files on the timeline must be valid on each worker.
+	 *
+	 * @code
+	 * // Export a timeline as 32 segments, rendered by the workers which connect to port 5570
+	 * ParallelExporter e(&t, "video.mp4");
+	 * e.SetVideoOptions(true, "libx264", openshot::Fraction(30,1), 1280, 720, openshot::Fraction(1,1), false, false, 3000000);
+	 * e.SetSegmentCount(32);
+	 * RenderCoordinator c(&e, "tcp://0.0.0.0:5570");
+	 * c.Export();
+	 *
+	 * // On each render node
+	 * RenderWorker w("tcp://coordinator:5570", "/tmp");
+	 * w.Run();
+	 * @endcode
+	 */
+	class RenderCoordinator
+	{
+	private:
+		openshot::ParallelExporter *exporter;
+		std::string endpoint; ///< The ZeroMQ endpoint the coordinator binds to (i.e. tcp://\*:5570)
+		int timeout; ///< Seconds a worker has to return its segment, before it is sent to another worker
+		int segments_done; ///< The number of segments returned by the workers (during Export)
+
+	public:
+		/// @brief Constructor for RenderCoordinator
+		/// @param exporter The exporter of the segments (its JSON is sent to the workers)
+		/// @param endpoint The ZeroMQ endpoint to bind to (i.e. tcp://\*:5570)
+		RenderCoordinator(openshot::ParallelExporter *exporter, std::string endpoint);
+
+		/// Send each segment to a worker, wait for all segments to be returned, and concatenate them
+		void Export();
+
+		/// Get the number of segments returned by the workers (so far)
+		int SegmentsDone() { return segments_done; };
+
+		/// Get the seconds a worker has to return its segment
+		int Timeout() { return timeout; };
+
+		/// @brief Set the seconds a worker has to return its segment, before it is sent to another worker
+		/// @param seconds The timeout (longer than the time a worker takes to render one segment)
+		void Timeout(int seconds) { timeout = seconds; };
+	};
+
+	/**
+	 * @brief This class renders the segments sent by a openshot::RenderCoordinator (over ZeroMQ)
+	 *
+	 * Each segment is rendered into a file in the work folder, which is sent back to the coordinator (and deleted).
+	 */
+	class RenderWorker
+	{
+	private:
+		std::string endpoint; ///< The ZeroMQ endpoint of the coordinator (i.e. tcp://coordinator:5570)
+		std::string work_path; ///< The folder segments are rendered into
+		int timeout; ///< Seconds to wait for an answer of the coordinator, before giving up
+
+	public:
+		/// @brief Constructor for RenderWorker
+		/// @param endpoint The ZeroMQ endpoint of the coordinator (i.e. tcp://coordinator:5570)
+		/// @param work_path The folder segments are rendered into (before they are sent)
+		RenderWorker(std::string endpoint, std::string work_path);
+
+		/// Render segments until the coordinator has none left, or stops answering (returns the number of segments rendered)
+		int Run();
+
+		/// Get the seconds to wait for an answer of the coordinator
+		int Timeout() { return timeout; };
+
+		/// @brief Set the seconds to wait for an answer of the coordinator, before giving up
+		/// @param seconds The timeout
+		void Timeout(int seconds) { timeout = seconds; };
+	};
+
+}
+
+#endif
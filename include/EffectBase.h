@@ -31,9 +31,15 @@
 #ifndef OPENSHOT_EFFECT_BASE_H
 #define OPENSHOT_EFFECT_BASE_H
 
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <string>
+#include <vector>
+#include <QRect>
+#include <QSize>
 #include "ClipBase.h"
 #include "Json.h"
 #include "Frame.h"
@@ -57,6 +63,27 @@ namespace openshot
 		bool has_audio;	///< Determines if this effect manipulates the audio of a frame
 	};
 
+	/**
+	 * @brief This struct contains the timing counters of an effect (updated by each thread which applies it)
+	 *
+	 * Copying the counters copies their current values.
+	 */
+	struct EffectTimingStruct
+	{
+		std::atomic<int64_t> calls; ///< The number of times the effect was applied
+		std::atomic<int64_t> nanoseconds; ///< The total time spent applying the effect
+		std::atomic<int64_t> pixels; ///< The total number of pixels the effect processed
+
+		EffectTimingStruct() : calls(0), nanoseconds(0), pixels(0) {}
+		EffectTimingStruct(const EffectTimingStruct& other) : calls(other.calls.load()), nanoseconds(other.nanoseconds.load()), pixels(other.pixels.load()) {}
+		EffectTimingStruct& operator=(const EffectTimingStruct& other) {
+			calls = other.calls.load();
+			nanoseconds = other.nanoseconds.load();
+			pixels = other.pixels.load();
+			return *this;
+		}
+	};
+
 	/**
 	 * @brief This abstract class is the base class, used by all effects in libopenshot.
 	 *
@@ -70,9 +97,28 @@ namespace openshot
 		int order; ///< The order to evaluate this effect. Effects are processed in this order (when more than one overlap).
 	public:
 
+		/// @brief A point-wise color transform, applied in place to tightly packed RGBA8888 pixels
+		///
+		/// The pixel_count pixels passed in can be any part of the image (since each pixel only depends on itself).
+		typedef std::function<void(unsigned char *pixels, int64_t pixel_count)> PixelKernel;
+
+		/// @brief A point-wise color transform, as GLSL statements run by the openshot::GpuCompositor
+		///
+		/// The statements change the vec4 named color (the RGBA values of a pixel, from 0.0 to 255.0, whose color
+		/// is not premultiplied by its alpha), and read the parameters with P(index). clamp_color() truncates and
+		/// clamps values the same as the CPU kernels, so both give the same pixels.
+		struct GpuKernel {
+			std::string source; ///< The GLSL statements (empty, if the effect has no GPU kernel)
+			std::vector<float> parameters; ///< The parameters of the statements (the keyframe values at a frame)
+			QRect region; ///< The part of the image to apply the kernel to (set by the caller, see RegionOfInterest)
+		};
+
 		/// Information about the current effect
 		EffectInfoStruct info;
 
+		/// Timing counters of this effect (see AddTiming, and TimingJsonValue)
+		EffectTimingStruct timing;
+
 		/// Display effect information in the standard output stream (stdout)
 		void DisplayInfo();
 
@@ -90,6 +136,138 @@ namespace openshot
 		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
 		virtual std::shared_ptr<openshot::Frame> GetFrame(std::shared_ptr<openshot::Frame> frame, int64_t frame_number) = 0;
 
+		/// @brief Modify a batch of consecutive frames (the default calls GetFrame() for each frame)
+		///
+		/// Effects which are faster with several frames at once (such as temporal denoising, or motion blur) can
+		/// override this method, and IsBatched(), so the Timeline passes them every frame of a batch it renders.
+		///
+		/// @param frames The frames that need the effect applied to them (replaced with the modified frames)
+		/// @param first_frame_number The frame number (starting at 1) of the effect for the first frame (the
+		/// following frames have consecutive frame numbers)
+		virtual void GetFrames(std::vector<std::shared_ptr<openshot::Frame> >& frames, int64_t first_frame_number);
+
+		/// Get whether the Timeline should pass this effect batches of frames (see GetFrames), false by default
+		virtual bool IsBatched() { return false; }
+
+		/// @brief Get whether this is a block based audio effect (false by default)
+		///
+		/// The audio of a clip's block based effects is processed by ProcessAudioBlock(), separately from the
+		/// image (and its video effects), in the order of the clip's frames, so an effect (such as an EQ or a
+		/// compressor) can keep its state from one block to the next. Clip skips its video effect pass for them,
+		/// and a timeline effect is applied by its GetFrame() (which usually calls ProcessAudio()).
+		virtual bool IsAudioBlockEffect() { return false; }
+
+		/// @brief Process a block of planar audio samples in place (for block based audio effects)
+		///
+		/// Blocks follow each other (until ResetAudio() is called), but can be any size, including 0 samples.
+		///
+		/// @param channels A pointer to the samples of each channel
+		/// @param channel_count The number of channels
+		/// @param sample_count The number of samples in each channel
+		/// @param sample_rate The sample rate of the samples
+		/// @param frame_number The frame number (starting at 1) of the effect for the block (for its keyframes)
+		virtual void ProcessAudioBlock(float* const* channels, int channel_count, int sample_count, int sample_rate, int64_t frame_number) {}
+
+		/// Clear the state a block based audio effect keeps between blocks (the next block doesn't follow the last one, i.e. after a seek)
+		virtual void ResetAudio() {}
+
+		/// @brief Process the audio of a frame as a block (with ProcessAudioBlock), and time it
+		/// @param frame The frame whose audio samples are processed (in place)
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		void ProcessAudio(std::shared_ptr<openshot::Frame> frame, int64_t frame_number);
+
+		/// @brief Get the pixel kernel of this effect for a frame number, or an empty kernel (the default)
+		///
+		/// Effects whose output pixels only depend on the same input pixel (and the keyframe values) can return a
+		/// kernel matching their GetFrame() method, so consecutive point-wise effects are applied in a single pass
+		/// over the image (see ApplyPixelKernels).
+		///
+		/// @returns The pixel kernel, or an empty kernel (if this effect is not point-wise)
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		virtual PixelKernel GetPixelKernel(int64_t frame_number) { return PixelKernel(); }
+
+		/// @brief Get the GPU kernel of this effect for a frame number, or an empty kernel (the default)
+		///
+		/// Point-wise effects can return the same transform as their pixel kernel in GLSL, so a clip's effects run
+		/// on its uploaded image when the timeline is composited on the GPU (see Settings::GPU_COMPOSITING). A clip
+		/// whose effects don't all have a GPU kernel applies them on the CPU (before its image is uploaded).
+		///
+		/// @returns The GPU kernel, or an empty kernel (if this effect has none)
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		virtual GpuKernel GetGpuKernel(int64_t frame_number) { return GpuKernel(); }
+
+		/// @brief Get the region of the image this effect changes at a frame number (the whole image by default)
+		///
+		/// Effects which only change part of the image (such as Pixelate) return that part, so the engine can
+		/// skip the effect when the region is not visible, and only run pixel kernels inside their region.
+		///
+		/// @returns The region of the image (in pixels) which GetFrame() can change
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		/// @param image_size The size of the frame's image
+		virtual QRect RegionOfInterest(int64_t frame_number, QSize image_size) { return QRect(QPoint(0, 0), image_size); }
+
+		/// @brief Get a key of what this effect does to an image at a frame number
+		///
+		/// Two frame numbers with equal keys give the same output for the same input image, so the output of a
+		/// still image can be reused. The default key holds the class name and the values of all properties (from
+		/// PropertiesJSON()). Effects which also depend on the frame number itself (or on other frames) add it.
+		///
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		virtual std::string OutputKey(int64_t frame_number);
+
+		/// @brief Get whether the pixel kernel of this effect is a color kernel (false by default)
+		///
+		/// Color kernels change the RGB values of a pixel based on its RGB values alone (leaving the alpha value
+		/// alone), so a chain of them can be baked into a 3D LUT (see ColorLUT).
+		virtual bool IsColorKernel() { return false; }
+
+		/// @brief Apply pixel kernels (in order) to the image of a frame, in a single pass over its pixels
+		///
+		/// The image is converted to RGBA8888, and processed in small tiles, so each tile stays in the CPU cache
+		/// while all kernels run on it. When Settings::EFFECT_LUT_SIZE is set, each run of consecutive color
+		/// kernels is baked into a ColorLUT, and applied as a single kernel.
+		///
+		/// @param frame The frame object that needs the kernels applied to it
+		/// @param kernels The pixel kernels (nothing is done, if this is empty)
+		/// @param color_kernels Which of the kernels are color kernels (see IsColorKernel), or empty if none are
+		/// @param region The part of the image to apply the kernels to (a null rectangle is the whole image)
+		static void ApplyPixelKernels(const std::shared_ptr<openshot::Frame>& frame, const std::vector<PixelKernel>& kernels,
+									  const std::vector<bool>& color_kernels = std::vector<bool>(), QRect region = QRect());
+
+		/// @brief Apply the collected pixel kernels of some effects (see ApplyPixelKernels), and then clear them
+		///
+		/// The time of the pass is split evenly between the effects (since their kernels run together).
+		///
+		/// @param frame The frame object that needs the kernels applied to it
+		/// @param effects The effects the kernels belong to (one per kernel)
+		/// @param kernels The pixel kernels (nothing is done, if this is empty)
+		/// @param color_kernels Which of the kernels are color kernels (see IsColorKernel)
+		/// @param region The part of the image to apply the kernels to (a null rectangle is the whole image)
+		static void FlushPixelKernels(const std::shared_ptr<openshot::Frame>& frame, std::vector<EffectBase*>& effects, std::vector<PixelKernel>& kernels,
+									  std::vector<bool>& color_kernels, QRect region);
+
+		/// @brief Apply this effect to a frame (with GetFrame), and time it
+		/// @returns The modified openshot::Frame object
+		/// @param frame The frame object that needs the effect applied to it
+		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
+		std::shared_ptr<openshot::Frame> ProcessFrame(std::shared_ptr<openshot::Frame> frame, int64_t frame_number);
+
+		/// @brief Apply this effect to a batch of consecutive frames (with GetFrames), and time it
+		/// @param frames The frames that need the effect applied to them (replaced with the modified frames)
+		/// @param first_frame_number The frame number (starting at 1) of the effect for the first frame
+		void ProcessFrames(std::vector<std::shared_ptr<openshot::Frame> >& frames, int64_t first_frame_number);
+
+		/// @brief Add a call to the timing counters of this effect
+		/// @param nanoseconds The time the call took
+		/// @param pixels The number of pixels the call processed
+		void AddTiming(int64_t nanoseconds, int64_t pixels);
+
+		/// Reset the timing counters of this effect
+		void ResetTiming();
+
+		/// Generate a JSON object of the timing counters (calls, total and average milliseconds, and pixels)
+		Json::Value TimingJsonValue();
+
 		/// Initialize the values of the EffectInfo struct.  It is important for derived classes to call
 		/// this method, or the EffectInfo struct values will not be initialized.
 		void InitEffectInfo();
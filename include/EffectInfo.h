@@ -37,21 +37,46 @@
 namespace openshot
 {
 
+	/// A function which creates a new instance of an effect (see EffectInfo::RegisterEffect())
+	typedef EffectBase* (*EffectFactory)();
+
 	/**
 	 * @brief This class returns a listing of all effects supported by libopenshot
 	 *
 	 * Use this class to return a listing of all supported effects, and their
-	 * descriptions.
+	 * descriptions. The effects are kept in a registry (by their class name), which
+	 * holds the factory of each effect, and its info JSON (which is only generated once).
+	 * Effects which are not part of libopenshot can also be registered, and are then
+	 * loaded from the JSON of a Clip or Timeline like any other effect.
+	 *
+	 * @code
+	 * static openshot::EffectBase* CreateMyEffect() { return new MyEffect(); }
+	 * ...
+	 * openshot::EffectInfo::RegisterEffect("MyEffect", CreateMyEffect);
+	 * @endcode
 	 */
 	class EffectInfo
 	{
 	public:
-		// Create an instance of an effect (factory style)
-		EffectBase* CreateEffect(std::string effect_type);
+		/// @brief Create an instance of an effect (factory style)
+		/// @returns The new effect (or NULL, if no effect is registered with this class name)
+		/// @param effect_type The class name of the effect (i.e. "Blur", or "Color Shift")
+		static EffectBase* CreateEffect(std::string effect_type);
+
+		/// @brief Register an effect (or replace the factory of a registered effect)
+		/// @param class_name The class name of the effect (the "type" of the effect in JSON)
+		/// @param factory A function which returns a new instance of the effect
+		static void RegisterEffect(std::string class_name, EffectFactory factory);
+
+		/// Remove an effect from the registry (returns false if it wasn't registered)
+		static bool UnregisterEffect(std::string class_name);
+
+		/// Is an effect registered with this class name
+		static bool IsRegistered(std::string class_name);
 
 		/// JSON methods
 		static std::string Json(); ///< Generate JSON string of this object
-		static Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
+		static Json::Value JsonValue(); ///< Generate Json::JsonValue for this object (the info of each effect, by class name)
 
 	};
 
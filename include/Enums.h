@@ -80,5 +80,46 @@ namespace openshot
 		VOLUME_MIX_AVERAGE,	///< Evenly divide the overlapping clips volume keyframes, so that the sum does not exceed 100%
 		VOLUME_MIX_REDUCE 	///< Reduce volume by about %25, and then mix (louder, but could cause pops if the sum exceeds 100%)
 	};
+
+	/// This enumeration describes the order in which frames are being requested (used to size read-ahead batches)
+	enum AccessPatternType
+	{
+		ACCESS_RANDOM,     ///< Frames are requested out of order (seeking / scrubbing)
+		ACCESS_SEQUENTIAL, ///< Frames are requested in increasing order (playback / export)
+		ACCESS_REVERSE     ///< Frames are requested in decreasing order (reverse playback)
+	};
+
+	/// This enumeration determines which frames a cache evicts first (when it exceeds its max bytes)
+	enum CacheEvictionType
+	{
+		EVICT_LEAST_RECENTLY_USED, ///< Evict the least recently added (or freshened) frames
+		EVICT_FAR_FROM_PLAYHEAD    ///< Evict the frames farthest from the playhead (frames behind the playhead first)
+	};
+
+	/// This enumeration determines the order in which asynchronous frame requests are rendered (see ReaderBase::RequestFrame)
+	enum FrameRequestPriority
+	{
+		REQUEST_PREFETCH, ///< A frame cached ahead of playback (i.e. by the VideoCacheThread)
+		REQUEST_VISIBLE   ///< A frame which is displayed next (rendered before any prefetched frames)
+	};
+
+	/// This enumeration describes the result of getting a frame without exceptions (see ReaderBase::TryGetFrame)
+	enum FrameStatus
+	{
+		FRAME_OK,             ///< The frame was returned
+		FRAME_READER_CLOSED,  ///< The reader is closed (or has just been closed)
+		FRAME_OUT_OF_BOUNDS,  ///< The frame is outside the reader
+		FRAME_TOO_MANY_SEEKS, ///< The reader could not seek to the frame
+		FRAME_CANCELLED       ///< The frame request was cancelled (see FrameRequest::TryWait)
+	};
+
+	/// This enumeration describes the work of a node of a openshot::RenderGraph
+	enum RenderNodeType
+	{
+		RENDER_NODE_DECODE,   ///< Get a frame of a clip's reader (decoded, and converted to the timeline's frame rate)
+		RENDER_NODE_MAP,      ///< Map a reader's frame to a clip's frame (with the time curve, and the clip's effects)
+		RENDER_NODE_EFFECT,   ///< Apply the timeline effects (and waveform) of a layer to a clip's frame
+		RENDER_NODE_COMPOSITE ///< Composite the layers of a timeline frame (and mix their audio)
+	};
 }
 #endif
@@ -0,0 +1,143 @@
+/**
+ * @file
+ * @brief Header file for FFmpegDecoderPool class (warm decoders shared by FFmpegReader instances)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_FFMPEG_DECODER_POOL_H
+#define OPENSHOT_FFMPEG_DECODER_POOL_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include "FFmpegIO.h"
+#include "FFmpegUtilities.h"
+
+namespace openshot {
+
+	/**
+	 * @brief The open demuxer and decoder contexts of a media file, which can be parked in the openshot::FFmpegDecoderPool
+	 */
+	struct FFmpegDecoderContexts {
+		std::string path; ///< The media file path
+		int hardware_decoder; ///< Settings::HARDWARE_DECODER when the decoder was opened
+		int hardware_device; ///< The GPU of the hardware decoder (or -1, when decoding in software)
+		AVFormatContext *format_ctx; ///< The demuxer
+		FFmpegIO *io; ///< The custom I/O of the demuxer (or NULL, for FFmpeg's file I/O)
+		AVCodecContext *video_ctx; ///< The video decoder (or NULL)
+		AVCodecContext *audio_ctx; ///< The audio decoder (or NULL)
+		AVBufferRef *hw_device_ctx; ///< The hardware device used by the video decoder (or NULL)
+		int hw_de_supported; ///< Is the video decoder using hardware decoding
+		int video_stream; ///< Index of the video stream (or -1)
+		int audio_stream; ///< Index of the audio stream (or -1)
+
+		FFmpegDecoderContexts() : hardware_decoder(0), hardware_device(-1), format_ctx(NULL), io(NULL), video_ctx(NULL),
+			audio_ctx(NULL), hw_device_ctx(NULL), hw_de_supported(0), video_stream(-1), audio_stream(-1) {}
+	};
+
+	/**
+	 * @brief This class is a process-wide pool of warm (open) decoders, which closed FFmpegReader instances park
+	 *
+	 * Clips are opened and closed as the playhead moves across a timeline. Instead of freeing its
+	 * demuxer and decoders on Close(), an FFmpegReader releases them to this pool, and the next
+	 * Open() of the same file (with the same hardware decoder and device) acquires them again,
+	 * skipping avformat_find_stream_info() and avcodec_open2(). The pool holds up to
+	 * Settings::DECODER_POOL_SIZE entries, and frees the least recently released entry first.
+	 *
+	 * The pool also counts the hardware decoding sessions of each GPU (open and parked), so the
+	 * readers can be spread over Settings::HW_DE_DEVICE_COUNT GPUs (see AcquireDevice()).
+	 */
+	class FFmpegDecoderPool {
+	private:
+		std::mutex pool_mutex;
+		std::list<FFmpegDecoderContexts> entries; ///< Parked decoders (front is the most recently released)
+
+		std::mutex device_mutex;
+		std::map<int, int> device_sessions; ///< The hardware decoding sessions of each GPU
+		int next_device; ///< The next GPU to try (when spreading the sessions round-robin)
+
+		/// Constructor (private, because this is a singleton)
+		FFmpegDecoderPool() : next_device(0) {};
+
+		/// Don't allow the user to copy or assign this instance
+		FFmpegDecoderPool(FFmpegDecoderPool const&) = delete;
+		FFmpegDecoderPool & operator=(FFmpegDecoderPool const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static FFmpegDecoderPool * m_pInstance;
+
+		/// Remove the oldest entries until the pool holds no more than a number of entries (and return them)
+		std::list<FFmpegDecoderContexts> trim(size_t max_entries);
+
+		/// Pick the GPU for a new session (or -1, if every GPU has Settings::HW_DE_DEVICE_SESSIONS sessions)
+		int pick_device();
+
+		/// Is a GPU one of the GPUs to decode with (Settings::HW_DE_DEVICE_SET and the following GPUs)
+		static bool is_device_used(int device);
+
+	public:
+		/// Create or get an instance of this decoder pool singleton (invoke the class with this method)
+		static FFmpegDecoderPool * Instance();
+
+		/// @brief Take a parked decoder for a media file (returns false if none matches)
+		/// @param path The media file path
+		/// @param contexts The parked contexts (rewound to the start of the file, with flushed decoders)
+		bool Acquire(std::string path, FFmpegDecoderContexts& contexts);
+
+		/// @brief Park the decoder of a closed reader (or free it, if the pool is disabled)
+		/// @param contexts The open contexts (owned by the pool after this call)
+		void Release(FFmpegDecoderContexts contexts);
+
+		/// Free all parked decoders
+		void Clear();
+
+		/// Get the number of parked decoders
+		int Count();
+
+		/// @brief Start a hardware decoding session, on the GPU with the fewest sessions (or the next GPU, with
+		/// Settings::HW_DE_DEVICE_ROUND_ROBIN). When every GPU is at its session limit, parked hardware decoders
+		/// are freed to make room.
+		/// @returns The GPU of the session (or -1, if no GPU has room, so the video must be decoded in software)
+		int AcquireDevice();
+
+		/// @brief End a hardware decoding session (see AcquireDevice())
+		/// @param device The GPU of the session
+		void ReleaseDevice(int device);
+
+		/// Get the number of hardware decoding sessions of a GPU (open and parked)
+		int DeviceSessions(int device);
+
+		/// @brief Free the contexts of a decoder
+		/// @param contexts The contexts to free (which are set to NULL, and end their hardware decoding session)
+		static void Free(FFmpegDecoderContexts& contexts);
+	};
+
+}
+
+#endif
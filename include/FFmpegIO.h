@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief Header file for FFmpegIO class (the custom I/O layer of FFmpegReader, with read-ahead and shared blocks)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_FFMPEG_IO_H
+#define OPENSHOT_FFMPEG_IO_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "FFmpegUtilities.h"
+
+namespace openshot {
+
+	/// A block of a media file (shared by the readers of the file)
+	typedef std::shared_ptr<const std::vector<uint8_t> > FFmpegIOBlock;
+
+	/**
+	 * @brief This class is a process-wide cache of the blocks of media files, shared by every openshot::FFmpegIO
+	 *
+	 * Blocks are Settings::IO_BLOCK_SIZE bytes, and are found by the path, size, and modification time of their
+	 * file (so a changed file is read again). The cache holds up to Settings::IO_CACHE_SIZE megabytes, and drops
+	 * the least recently used block first.
+	 */
+	class FFmpegBlockCache {
+	private:
+		typedef std::pair<std::string, int64_t> BlockKey;
+		struct Entry {
+			BlockKey key;
+			FFmpegIOBlock block;
+		};
+
+		std::mutex cache_mutex;
+		std::list<Entry> entries; ///< Cached blocks (front is the most recently used)
+		std::map<BlockKey, std::list<Entry>::iterator> lookup;
+		int64_t total_bytes;
+
+		/// Constructor (private, because this is a singleton)
+		FFmpegBlockCache() : total_bytes(0) {};
+
+		/// Don't allow the user to copy or assign this instance
+		FFmpegBlockCache(FFmpegBlockCache const&) = delete;
+		FFmpegBlockCache & operator=(FFmpegBlockCache const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static FFmpegBlockCache * m_pInstance;
+
+	public:
+		/// Create or get an instance of this block cache singleton (invoke the class with this method)
+		static FFmpegBlockCache * Instance();
+
+		/// Get a block of a file (or NULL, if it isn't cached)
+		FFmpegIOBlock Get(const std::string& file_key, int64_t index);
+
+		/// Is a block of a file cached (without marking it as used)
+		bool Contains(const std::string& file_key, int64_t index);
+
+		/// Add a block of a file (and drop the least recently used blocks, over Settings::IO_CACHE_SIZE)
+		void Add(const std::string& file_key, int64_t index, FFmpegIOBlock block);
+
+		/// Remove all blocks
+		void Clear();
+
+		/// Get the bytes of all cached blocks
+		int64_t Bytes();
+	};
+
+	/**
+	 * @brief The custom I/O of an FFmpegReader demuxer, for media files on slow (i.e. network mounted) storage
+	 *
+	 * The file is read in blocks, through the openshot::FFmpegBlockCache, and a background thread reads the
+	 * next Settings::IO_READ_AHEAD blocks after each read, so the demuxer rarely waits for the storage. With
+	 * Settings::IO_MMAP, a file on a local file system is memory mapped instead (the system page cache is
+	 * shared by all readers, and the kernel is asked to read ahead).
+	 *
+	 * The AVIOContext is owned by this object, so it must be deleted after the format context is closed.
+	 *
+	 * @code
+	 * openshot::FFmpegIO *io = openshot::FFmpegIO::Create(path);
+	 * AVFormatContext *format_ctx = avformat_alloc_context();
+	 * format_ctx->pb = io->Context();
+	 * format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	 * avformat_open_input(&format_ctx, path.c_str(), NULL, NULL);
+	 * ...
+	 * avformat_close_input(&format_ctx);
+	 * delete io;
+	 * @endcode
+	 */
+	class FFmpegIO {
+	private:
+		std::string path;
+		std::string file_key; ///< The block cache key of the file (its path, size, and modification time)
+		int64_t file_size;
+		int64_t position; ///< The position of the next read
+		int64_t block_size;
+		int read_ahead; ///< Number of blocks read ahead
+		AVIOContext *avio_ctx;
+		FILE *file; ///< Reads the blocks requested by the demuxer
+
+		// Memory mapped file (NULL, when reading blocks)
+		const uint8_t *mapping;
+		int64_t page_size;
+
+		// Reads the next blocks (on a background thread)
+		std::thread read_ahead_thread;
+		std::mutex read_ahead_mutex;
+		std::condition_variable read_ahead_condition;
+		std::condition_variable loaded_condition;
+		int64_t read_ahead_next; ///< The next block to read ahead
+		int64_t read_ahead_end; ///< The block after the last block to read ahead
+		int64_t loading_block; ///< The block being read by the background thread (-1 = none)
+		bool read_ahead_stop;
+
+		/// Constructor (private, see Create())
+		FFmpegIO(std::string path, int64_t file_size, std::string file_key);
+
+		/// Don't allow the user to copy or assign this object
+		FFmpegIO(FFmpegIO const&) = delete;
+		FFmpegIO & operator=(FFmpegIO const&) = delete;
+
+		/// Memory map the file (returns false if it can't be mapped)
+		bool map_file();
+
+		/// Get a block from the cache (or read it, if it isn't cached), and read ahead of it
+		FFmpegIOBlock get_block(int64_t index);
+
+		/// Read a block from a file handle
+		FFmpegIOBlock read_block(FILE *handle, int64_t index);
+
+		/// Read the blocks after the last read (on the background thread)
+		void read_ahead_loop();
+
+		/// Copy the bytes at the current position (and advance it)
+		int read(uint8_t *buffer, int size);
+
+		/// Move the current position (or get the size of the file, with AVSEEK_SIZE)
+		int64_t seek(int64_t offset, int whence);
+
+		/// The callbacks of the AVIOContext
+		static int read_callback(void *opaque, uint8_t *buffer, int size);
+		static int64_t seek_callback(void *opaque, int64_t offset, int whence);
+
+	public:
+		/// @brief Create the custom I/O of a media file
+		/// @returns The I/O (or NULL, if it is disabled, or the path isn't a regular file, i.e. a URL or device)
+		/// @param path The media file path
+		static FFmpegIO *Create(std::string path);
+
+		/// Destructor (stops reading ahead, and frees the AVIOContext)
+		~FFmpegIO();
+
+		/// Get the AVIOContext to read the file with
+		AVIOContext *Context() { return avio_ctx; };
+
+		/// Is the file memory mapped
+		bool IsMapped() { return mapping != NULL; };
+	};
+
+}
+
+#endif
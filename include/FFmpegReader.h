@@ -37,18 +37,27 @@
 #include "ReaderBase.h"
 
 // Include FFmpeg headers and macros
+#include "FFmpegIO.h"
 #include "FFmpegUtilities.h"
 
 #include <cmath>
 #include <ctime>
 #include <iostream>
+#include <map>
 #include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "CacheMemory.h"
 #include "Clip.h"
 #include "Exceptions.h"
 #include "OpenMPUtilities.h"
 #include "Settings.h"
+#include "TaskPool.h"
 
 
 namespace openshot {
@@ -65,6 +74,45 @@ namespace openshot {
 		bool is_near(AudioLocation location, int samples_per_frame, int64_t amount);
 	};
 
+	/**
+	 * @brief This struct holds the decoding status of a frame (used by the FFmpegReader to finalize frames)
+	 */
+	struct FrameStatus {
+		int64_t number;                 ///< The frame number of this status (0 = unused)
+		int checked_count;              ///< # of times the frame was checked for being final
+		bool is_video_processed;        ///< The frame's image has been decoded (or copied)
+		bool is_audio_processed;        ///< The frame's audio has been decoded (or is silence)
+		bool is_missing_audio;          ///< No audio packet starts in this frame (so it is filled with silence)
+		int64_t missing_video_source;   ///< The frame whose image is copied to this frame, when no video packet has this frame (0 = not missing)
+		int missing_video_dependents;   ///< # of missing frames which copy their image from this frame
+		std::shared_ptr<openshot::Frame> source_frame;    ///< This frame, kept after it is final (while missing frames depend on it)
+	};
+
+	/**
+	 * @brief This class tracks the status of the frames around the decoding position, in a ring of fixed size.
+	 *
+	 * Each frame number maps to a slot (frame number modulo the size of the ring), so looking up a frame
+	 * takes constant time, and frames which are far behind the decoding position are forgotten (replaced
+	 * with newer frames) instead of growing a map during long reads.
+	 */
+	class FrameStatusRing {
+	private:
+		std::vector<FrameStatus> slots;
+
+	public:
+		/// Constructor for the ring, which tracks up to <b>size</b> consecutive frames
+		FrameStatusRing(size_t size);
+
+		/// Get the status of a frame (or NULL, if the frame is not tracked)
+		FrameStatus *Find(int64_t number);
+
+		/// Get the status of a frame, and start tracking it (if needed) in place of any older frame in its slot
+		FrameStatus &Track(int64_t number);
+
+		/// Forget all frames
+		void Clear();
+	};
+
 	/**
 	 * @brief This class uses the FFmpeg libraries, to open video files and audio files, and return
 	 * openshot::Frame objects for any frame in the file.
@@ -96,6 +144,7 @@ namespace openshot {
 		std::string path;
 
 		AVFormatContext *pFormatCtx;
+		FFmpegIO *io;    ///< The custom I/O of the demuxer (or NULL, for FFmpeg's file I/O)
 		int i, videoStream, audioStream;
 		AVCodecContext *pCodecCtx, *aCodecCtx;
 #if (LIBAVFORMAT_VERSION_MAJOR >= 57)
@@ -111,16 +160,10 @@ namespace openshot {
 		bool has_missing_frames;
 
 		CacheMemory working_cache;
-		CacheMemory missing_frames;
+		TaskGroup video_tasks; ///< Video packets being converted (on the shared task pool)
 		std::map<int64_t, int64_t> processing_video_frames;
 		std::multimap<int64_t, int64_t> processing_audio_frames;
-		std::map<int64_t, int64_t> processed_video_frames;
-		std::map<int64_t, int64_t> processed_audio_frames;
-		std::multimap<int64_t, int64_t> missing_video_frames;
-		std::multimap<int64_t, int64_t> missing_video_frames_source;
-		std::multimap<int64_t, int64_t> missing_audio_frames;
-		std::multimap<int64_t, int64_t> missing_audio_frames_source;
-		std::map<int64_t, int> checked_frames;
+		FrameStatusRing frame_status;    ///< Processed, checked and missing frames (the last 1024 frames near the decoding position)
 		AudioLocation previous_packet_location;
 
 		// DEBUG VARIABLES (FOR AUDIO ISSUES)
@@ -146,7 +189,48 @@ namespace openshot {
 		int64_t largest_frame_processed;
 		int64_t current_video_frame;    // can't reliably use PTS of video to determine this
 
+		std::vector<int64_t> keyframe_index;    ///< Sorted timestamps of every video keyframe (used for exact seeks)
+		bool is_keyframe_index_built;
+		bool is_probe_cached;    ///< The info struct was loaded from (or saved to) the probe cache
+		bool reuse_decoder;    ///< Park the decoder in the FFmpegDecoderPool on Close(), and reuse a parked one on Open()
+		FFmpegReader *proxy_reader;    ///< The open proxy of this file (see ProxyManager)
+		std::mutex proxy_mutex;
+		bool proxy_failed;    ///< The proxy of this file could not be opened (so the original is always read)
+
+		std::thread demux_thread;    ///< Reads packets ahead of the decoder (see Settings::PACKET_QUEUE_SIZE)
+		std::mutex demux_mutex;
+		std::condition_variable demux_condition;
+		std::deque<AVPacket *> packet_queue;    ///< Packets read by the demux thread (oldest first)
+		bool is_demuxing;    ///< Is the demux thread running
+		bool demux_stop;    ///< Ask the demux thread to exit
+		bool demux_finished;    ///< The demux thread reached the end of the file (or an error)
+		int demux_status;    ///< The av_read_frame() result which ended the demux thread
+		size_t max_queued_packets;
+
+		SWRCONTEXT *audio_resample_ctx;    ///< Converts decoded samples to planar floats (audio-only fast path)
+
+		// Reverse playback (see Settings::REVERSE_DECODE_FRAMES)
+		std::mutex reverse_mutex;
+		std::map<int64_t, std::shared_ptr<openshot::Frame> > reverse_frames;    ///< Decoded frames of the GOPs being played backwards
+		int64_t reverse_last_frame;    ///< The previous requested frame
+		int reverse_steps;    ///< Number of consecutive backward requests
+		int64_t reverse_start;    ///< The first frame decoded (or being decoded) for the reverse playback (0 = none)
+		int64_t reverse_generation;    ///< Incremented when a reverse playback ends (so its background decode is dropped)
+		bool is_reverse_prefetching;    ///< Is the earlier GOP being decoded on the reverse thread
+		std::thread reverse_thread;
+
+		std::atomic<int> decode_speed;    ///< The decoder speed options applied to the video decoder (see Settings::DECODE_SPEED)
+
+		bool video_enabled;    ///< The streams hinted by EnableStreams() (a disabled stream is discarded by the demuxer)
+		bool audio_enabled;
+
+		bool is_thumbnail_mode;    ///< Only decode keyframes (see ThumbnailMode())
+		int thumbnail_lowres;
+		int64_t thumbnail_keyframe_pts;    ///< The timestamp of the last decoded keyframe (-1 = none)
+		std::shared_ptr<QImage> thumbnail_image;    ///< The image of the last decoded keyframe
+
 		int hw_de_supported = 0;    // Is set by FFmpegReader
+		int hw_de_device = -1;    // The GPU of the hardware decoder (-1 = decoding in software)
 #if IS_FFMPEG_3_2
 		AVPixelFormat hw_de_av_pix_fmt = AV_PIX_FMT_NONE;
 		AVHWDeviceType hw_de_av_device_type = AV_HWDEVICE_TYPE_NONE;
@@ -154,9 +238,60 @@ namespace openshot {
 
 		int IsHardwareDecodeSupported(int codecid);
 
+		/// Build the keyframe index from the container's seek index (or by scanning the video packets)
+		void BuildKeyframeIndex();
+
 		/// Check for the correct frames per second value by scanning the 1st few seconds of video packets.
 		void CheckFPS();
 
+		/// Reuse a warm decoder parked by a closed reader of the same file (returns false if none is parked)
+		bool open_pooled_decoder();
+
+		/// Finish opening the reader, once the decoders are open (the keyframe index, metadata, and caches)
+		void finish_open();
+
+		/// Set the discard flag of the video and audio streams (from the stream hints)
+		void apply_stream_discard();
+
+		/// Use the decoder speed options of a render (the frames decoded faster are removed, when a more exact render starts)
+		void apply_decode_speed(int speed);
+
+		/// Set the speed options of the video decoder (from decode_speed)
+		void set_decoder_speed_options();
+
+		/// Is the video stream decoded (i.e. found, not overridden, and not disabled by EnableStreams())
+		bool decode_video() { return info.has_video && video_enabled; };
+
+		/// Is the audio stream decoded
+		bool decode_audio() { return info.has_audio && audio_enabled; };
+
+		/// @brief Get a frame from the cache, or by walking (or seeking) the stream (the caller is inside the ReadStream critical section)
+		/// @param requested_frame The frame number
+		/// @param width The size the frame is decoded at (0 = full size)
+		/// @param height The size the frame is decoded at (0 = full size)
+		std::shared_ptr<openshot::Frame> read_frame(int64_t requested_frame, int width, int height);
+
+		/// Get a frame of a reverse playback, which decodes each GOP once (or NULL, if the frames aren't requested backwards)
+		std::shared_ptr<openshot::Frame> GetReverseFrame(int64_t requested_frame, int width, int height);
+
+		/// Find a decoded frame of the reverse playback, which is at least the requested size (with reverse_mutex locked)
+		std::shared_ptr<openshot::Frame> find_reverse_frame(int64_t requested_frame, int width, int height);
+
+		/// The first frame of the range decoded for a reverse playback (the keyframe of the GOP, if it fits the window)
+		int64_t reverse_range_start(int64_t end_frame, int64_t window);
+
+		/// Decode a range of frames for the reverse playback (the caller is inside the ReadStream critical section)
+		void decode_reverse_range(int64_t start, int64_t end, int64_t generation, int width, int height);
+
+		/// Decode an earlier range of the reverse playback (on the reverse thread, with the render context and size of the playback)
+		void reverse_prefetch(int64_t start, int64_t end, int64_t generation, openshot::RenderContext context, int width, int height);
+
+		/// End the reverse playback
+		void reset_reverse_playback();
+
+		/// End the reverse playback, and wait for its background decode
+		void stop_reverse_playback();
+
 		/// Check the current seek position and determine if we need to seek again
 		bool CheckSeek(bool is_video);
 
@@ -187,6 +322,18 @@ namespace openshot {
 		/// Get the next packet (if any)
 		int GetNextPacket();
 
+		/// Start the demux thread (if not already running)
+		void StartDemux();
+
+		/// Stop the demux thread, and free any packets it has queued (before seeking or closing)
+		void StopDemux();
+
+		/// The main loop of the demux thread
+		void demux_loop();
+
+		/// Get the timestamp of the nearest keyframe at or before a video timestamp (or -1 if unknown)
+		int64_t GetKeyframePTS(int64_t pts);
+
 		/// Get the smallest video frame that is still being processed
 		int64_t GetSmallestVideoFrame();
 
@@ -199,14 +346,32 @@ namespace openshot {
 		/// Remove partial frames due to seek
 		bool IsPartialFrame(int64_t requested_frame);
 
-		/// Process a video packet
-		void ProcessVideoPacket(int64_t requested_frame);
+		/// Process a video packet (and convert its frame at the requested size, or full size if 0)
+		void ProcessVideoPacket(int64_t requested_frame, int width, int height);
 
 		/// Process an audio packet
 		void ProcessAudioPacket(int64_t requested_frame, int64_t target_frame, int starting_sample);
 
-		/// Read the stream until we find the requested Frame
-		std::shared_ptr<openshot::Frame> ReadStream(int64_t requested_frame);
+		/// Read the stream until we find the requested Frame (decoded at the requested size, or full size if 0)
+		std::shared_ptr<openshot::Frame> ReadStream(int64_t requested_frame, int width, int height);
+
+		/// Decode the nearest keyframe at or before the requested frame (thumbnail mode)
+		std::shared_ptr<openshot::Frame> ReadThumbnail(int64_t requested_frame);
+
+		/// Read an audio-only stream until we find the requested Frame (see Settings::AUDIO_FAST_PATH)
+		std::shared_ptr<openshot::Frame> ReadAudioStream(int64_t requested_frame);
+
+		/// Add the samples of a decoded audio frame to the frames starting at a location (and advance the location)
+		void AddAudioSamples(AVFrame *audio_frame, AudioLocation &location);
+
+		/// Move the audio frames before end_frame to the final cache (adding silent frames for gaps in the audio)
+		void FinishAudioFrames(int64_t requested_frame, int64_t end_frame);
+
+		/// Load a keyframe index saved beside the media file (if it matches the file's size and date)
+		bool LoadKeyframeIndex();
+
+		/// Load the info struct of this file from the probe cache (if it matches the file's size and date)
+		bool LoadProbeInfo();
 
 		/// Remove AVFrame from cache (and deallocate its memory)
 		void RemoveAVFrame(AVFrame *);
@@ -214,6 +379,21 @@ namespace openshot {
 		/// Remove AVPacket from cache (and deallocate its memory)
 		void RemoveAVPacket(AVPacket *);
 
+		/// Save the keyframe index beside the media file, so it can be reused the next time the file is opened
+		void SaveKeyframeIndex();
+
+		/// Save the info struct of this file to the probe cache, so reopening it skips inspection
+		void SaveProbeInfo();
+
+		/// Get the probe cache file used for this media file (or an empty string if the cache is disabled)
+		QString GetProbeInfoPath();
+
+		/// Get the proxy of this file, when it is read instead of the original (or NULL)
+		FFmpegReader *get_proxy();
+
+		/// Get a frame from the proxy of this file (or NULL, if the original is read)
+		std::shared_ptr<openshot::Frame> GetProxyFrame(int64_t requested_frame, int width, int height);
+
 		/// Seek to a specific Frame.  This is not always frame accurate, it's more of an estimation on many codecs.
 		void Seek(int64_t requested_frame);
 
@@ -234,13 +414,18 @@ namespace openshot {
 		/// codecs have trouble seeking, and can introduce artifacts or blank images into the video.
 		bool enable_seek;
 
+		/// Read the low resolution proxy of this file (if there is one) while the preview is no taller than
+		/// Settings::PROXY_HEIGHT, and queue its generation if there isn't (see ProxyManager)
+		bool enable_proxy;
+
 		/// Constructor for FFmpegReader.  This automatically opens the media file and loads
 		/// frame 1, or it throws one of the following exceptions.
 		FFmpegReader(std::string path);
 
 		/// Constructor for FFmpegReader.  This only opens the media file to inspect its properties
 		/// if inspect_reader=true. When not inspecting the media file, it's much faster, and useful
-		/// when you are inflating the object using JSON after instantiating it.
+		/// when you are inflating the object using JSON after instantiating it. Inspection is skipped
+		/// when the file is found in the probe cache (see Settings::PROBE_CACHE_PATH).
 		FFmpegReader(std::string path, bool inspect_reader);
 
 		/// Destructor
@@ -258,12 +443,56 @@ namespace openshot {
 		/// @param requested_frame	The frame number that is requested.
 		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame);
 
+		/// Get a frame, with its image scaled by libswscale (while converting it to RGB) to the size it will be drawn at
+		///
+		/// @returns The requested frame of video
+		/// @param requested_frame	The frame number that is requested.
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame, int width, int height);
+
+		/// Get a range of consecutive frames, decoded in a single pass of the stream (without giving up the stream
+		/// between the frames). A preview read from the proxy is read a frame at a time.
+		///
+		/// @returns The frames (in order)
+		/// @param start The first frame number
+		/// @param count The number of frames
+		std::vector<std::shared_ptr<openshot::Frame> > GetFrames(int64_t start, int64_t count);
+
+		/// Hint which streams are used. The packets of a disabled stream are discarded by the demuxer (and never
+		/// decoded), so its frames are silent or have no image. Enabling a stream again re-opens an open reader.
+		///
+		/// @param video Decode the video stream
+		/// @param audio Decode the audio stream
+		void EnableStreams(bool video, bool audio);
+
+		/// Enable or disable the thumbnail mode, which only decodes keyframes, and returns the image of the nearest
+		/// keyframe at or before any requested frame (for filmstrips and scrubbing previews). Keyframes are decoded
+		/// at 1/2^lowres of their size, when the codec supports it. An open reader is re-opened.
+		///
+		/// @param enabled Only decode keyframes
+		/// @param lowres The resolution reduction (0 = full size, 1 = half size, 2 = quarter size, ...)
+		void ThumbnailMode(bool enabled, int lowres = 2);
+
+		/// Is the thumbnail mode enabled (see ThumbnailMode())
+		bool IsThumbnailMode() { return is_thumbnail_mode; };
+
+		/// Get the GPU which decodes the video (or -1, when decoding in software). With Settings::HW_DE_DEVICE_COUNT
+		/// GPUs, each reader is given its own GPU (see FFmpegDecoderPool::AcquireDevice()).
+		int HardwareDevice() { return hw_de_device; };
+
+		/// Get the number of video keyframes found in the media file (0 if no keyframe index is available)
+		int64_t GetKeyframeCount() { return keyframe_index.size(); };
+
 		/// Determine if reader is open or closed
 		bool IsOpen() { return is_open; };
 
 		/// Return the type name of the class
 		std::string Name() { return "FFmpegReader"; };
 
+		/// Get the file path of the media file
+		std::string Path() { return path; };
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @brief Header file for FFmpegScaler class (pixel format conversion and scaling of large images, in parallel slices)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OPENSHOT_FFMPEG_SCALER_H
+#define OPENSHOT_FFMPEG_SCALER_H
+
+#include <cstdint>
+#include "FFmpegUtilities.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class converts (and resizes) images with libswscale, splitting large images over several threads
+	 *
+	 * A single sws_scale() call uses one core, which makes the conversion of an 8K frame the bottleneck when only
+	 * one or two frames are in flight (i.e. after a seek). With Settings::SCALE_THREADS, an image which isn't
+	 * resized is split into horizontal slices, which are converted in parallel on the openshot::TaskPool (each
+	 * worker with its own context). A resized image is converted by the slice threads of libswscale instead
+	 * (FFmpeg 5.0 or newer), since the scaling filters of a slice read the rows of its neighbours.
+	 *
+	 * The contexts are cached by each thread (a context can't be used by 2 threads at once, and sws_getContext()
+	 * is expensive).
+	 */
+	class FFmpegScaler {
+	public:
+		/// @brief Get a scaling context of the calling thread (created on first use)
+		/// @param threads The slice threads of the context (ignored before FFmpeg 5.0)
+		static SwsContext *Context(int src_width, int src_height, int src_format, int dst_width, int dst_height,
+								   int dst_format, int flags, int threads = 1);
+
+		/// @brief Get the number of slices an image is converted in (1 = a single sws_scale() call)
+		static int NumSlices(int src_width, int src_height, int src_format, int dst_width, int dst_height, int dst_format);
+
+		/// Convert (and resize) an image (in parallel slices, when it is large enough)
+		static void Scale(const uint8_t *const src_data[], const int src_linesize[], int src_width, int src_height, int src_format,
+						  uint8_t *const dst_data[], const int dst_linesize[], int dst_width, int dst_height, int dst_format, int flags);
+	};
+
+}
+
+#endif
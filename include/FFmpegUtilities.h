@@ -59,6 +59,7 @@
 		#include <libavresample/avresample.h>
 	#endif
 		#include <libavutil/mathematics.h>
+		#include <libavutil/audio_fifo.h>
 		#include <libavutil/pixfmt.h>
 		#include <libavutil/pixdesc.h>
 
@@ -115,6 +116,9 @@
 	#ifndef PIX_FMT_RGB24
 		#define PIX_FMT_RGB24 AV_PIX_FMT_RGB24
 	#endif
+	#ifndef PIX_FMT_RGB32
+		#define PIX_FMT_RGB32 AV_PIX_FMT_RGB32
+	#endif
 	#ifndef PIX_FMT_YUV420P
 		#define PIX_FMT_YUV420P AV_PIX_FMT_YUV420P
 	#endif
@@ -45,16 +45,26 @@
 // Include FFmpeg headers and macros
 #include "FFmpegUtilities.h"
 
+#include <atomic>
 #include <cmath>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <stdio.h>
 #include <unistd.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include "CacheMemory.h"
 #include "Exceptions.h"
+#include "FFmpegReader.h"
 #include "OpenMPUtilities.h"
 #include "ZmqLogger.h"
 #include "Settings.h"
+#include "TaskPool.h"
+#include "Timeline.h"
 
 
 namespace openshot {
@@ -65,6 +75,14 @@ namespace openshot {
 		AUDIO_STREAM     ///< An audio stream (used to determine which type of stream)
 	};
 
+	/// This enumeration designates how the output is split into segments (which can be played while writing)
+	enum SegmentFormat {
+		SEGMENT_NONE,               ///< A single (regular) file
+		SEGMENT_FRAGMENTED_MP4,     ///< A fragmented MP4 file (the path is the .mp4 file)
+		SEGMENT_HLS,                ///< HLS segments and a playlist (the path is the .m3u8 playlist)
+		SEGMENT_DASH                ///< DASH segments and a manifest (the path is the .mpd manifest)
+	};
+
 	/**
 	 * @brief This class uses the FFmpeg libraries, to write and encode video files and audio files.
 	 *
@@ -144,7 +162,7 @@ namespace openshot {
 	private:
 		std::string path;
 		int cache_size;
-		bool is_writing;
+		std::atomic<bool> is_writing; ///< Set by the encoder thread while it writes a batch (and read by WriteFrame)
 		bool is_open;
 		int64_t write_video_count;
 		int64_t write_audio_count;
@@ -153,6 +171,13 @@ namespace openshot {
 		bool write_header;
 		bool write_trailer;
 
+		openshot::SegmentFormat segment_format;    ///< How the output is split into segments (see SetSegmentOptions)
+		double segment_seconds;    ///< The target duration of each segment
+		int segment_playlist_size;    ///< The number of segments kept in the playlist (0 = all segments)
+
+		bool smart_render;    ///< Copy the packets of unchanged ranges of the source file (see SetSmartRender)
+		std::vector<std::pair<std::string, std::string> > video_options;    ///< Custom video options (also set on the writers of re-encoded smart render ranges)
+
 		AVOutputFormat *fmt;
 		AVFormatContext *oc;
 		AVStream *audio_st, *video_st;
@@ -160,7 +185,6 @@ namespace openshot {
 		AVCodecContext *audio_codec;
 		SwsContext *img_convert_ctx;
 		double audio_pts, video_pts;
-		int16_t *samples;
 		uint8_t *audio_outbuf;
 		uint8_t *audio_encoder_buffer;
 
@@ -173,8 +197,11 @@ namespace openshot {
 		int initial_audio_input_frame_size;
 		int audio_input_position;
 		int audio_encoder_buffer_size;
-		SWRCONTEXT *avr;
-		SWRCONTEXT *avr_planar;
+		SWRCONTEXT *avr;    ///< Resamples the frames' (planar float) audio straight to the encoder's sample format
+		AVAudioFifo *audio_fifo;    ///< Resampled samples waiting for a full encoder frame
+		uint8_t **audio_resample_data;    ///< Reusable resampling output buffer
+		int audio_resample_capacity;    ///< The number of samples audio_resample_data can hold
+		AVFrame *audio_encode_frame;    ///< Reusable frame of audio_input_frame_size samples (sent to the encoder)
 
 		/* Resample options */
 		int original_sample_rate;
@@ -188,12 +215,29 @@ namespace openshot {
 		std::deque<std::shared_ptr<openshot::Frame> > queued_video_frames;
 
 		std::deque<std::shared_ptr<openshot::Frame> > processed_frames;
-		std::deque<std::shared_ptr<openshot::Frame> > deallocate_frames;
-
-		std::map<std::shared_ptr<openshot::Frame>, AVFrame *> av_frames;
 
-		/// Add an AVFrame to the cache
-		void add_avframe(std::shared_ptr<openshot::Frame> frame, AVFrame *av_frame);
+		std::vector<AVFrame *> video_frame_ring;    ///< Preallocated converted frames (one for each position in a batch, and reused by every batch)
+		std::vector<AVFrame *> video_frame_slots;    ///< The frame to encode for each position of the current batch (a ring frame, a hardware surface, or NULL)
+		std::vector<int> video_frame_repeats;    ///< The earlier position of the current batch with the same image, for each position (or -1)
+		qint64 last_image_key;    ///< The cache key of the last converted image (the same key means the same pixels, 0 = none)
+		std::shared_ptr<openshot::FramePlanes> last_planes;    ///< The last native planes copied to a ring frame (kept, so the pointer is never reused)
+		int last_image_position;    ///< The ring frame which holds the last converted image (or -1)
+		bool is_last_image_in_batch;    ///< Was the last converted image converted by the current batch
+		TaskGroup encoding_tasks; ///< Video frames being converted (on the shared task pool)
+		TaskGroup audio_tasks; ///< Audio being resampled and encoded (in parallel with the video frames)
+		std::mutex mux_mutex; ///< Audio and video packets are written to the file from different threads
+
+		/// A batch of spooled frames (video frames, audio frames), waiting for the writer thread
+		typedef std::pair<std::deque<std::shared_ptr<openshot::Frame> >, std::deque<std::shared_ptr<openshot::Frame> > > FrameBatch;
+
+		std::thread writer_thread;    ///< Converts and encodes batches of frames (see Settings::WRITER_QUEUE_SIZE)
+		std::mutex writer_mutex;
+		std::condition_variable writer_condition;
+		std::deque<FrameBatch> writer_batches;    ///< Batches waiting for the writer thread (oldest first)
+		bool is_writer_running;    ///< Is the writer thread running
+		bool writer_stop;    ///< Ask the writer thread to exit (once all batches are written)
+		std::exception_ptr writer_error;    ///< The first error of the writer thread (thrown by the next WriteFrame call)
+		openshot::Counter spooled_bytes;    ///< The bytes of the frames waiting to be encoded (counted by the "writer.spool" memory gauge)
 
 		/// Add an audio output stream
 		AVStream *add_audio_stream();
@@ -219,6 +263,9 @@ namespace openshot {
 		/// initialize streams
 		void initialize_streams();
 
+		/// Get the image format the frame images are converted to, before scaling (RGBA, or RGBA64 for high bit depth images)
+		static QImage::Format scaler_image_format();
+
 		/// @brief Init a collection of software rescalers (thread safe)
 		/// @param source_width The source width of the image scalers (used to cache a bunch of scalers)
 		/// @param source_height The source height of the image scalers (used to cache a bunch of scalers)
@@ -230,24 +277,81 @@ namespace openshot {
 		/// open video codec
 		void open_video(AVFormatContext *oc, AVStream *st);
 
-		/// process video frame
-		void process_video_packet(std::shared_ptr<openshot::Frame> frame);
+		/// Allocate the ring of converted frames (if it has fewer frames than the batch size)
+		void allocate_video_frame_ring(int batch_size);
 
-		/// write all queued frames' audio to the video file
+		/// Deallocate the ring of converted frames
+		void free_video_frame_ring();
+
+		/// process video frame (converting it into the ring frame of its position in the batch)
+		void process_video_packet(std::shared_ptr<openshot::Frame> frame, int position);
+
+		/// @brief Reuse the last converted frame for a frame with the same image (i.e. a still title, or a repeated frame)
+		/// @returns True if the frame at this position needs no conversion
+		/// @param frame The frame to encode
+		/// @param position The position of the frame in the batch
+		/// @param use_planes Will the frame's native planes be copied (instead of converting its image)
+		bool reuse_video_frame(std::shared_ptr<openshot::Frame> frame, int position, bool use_planes);
+
+		/// Upload a converted (NV12) frame to a surface of the hardware encoder's pool (returns the surface, or NULL
+		/// if no surface could be uploaded)
+		AVFrame *upload_hw_frame(AVFrame *frame_final);
+
+		/// write all queued frames' audio to the video file (on its own task, which runs in parallel with the video)
 		void write_audio_packets(bool is_final);
 
+		/// resample a frame's audio into the audio FIFO (in the encoder's sample format)
+		void resample_audio_frame(std::shared_ptr<openshot::Frame> frame);
+
+		/// encode the full frames of samples in the audio FIFO (and the remaining samples, if final)
+		void encode_audio_fifo(bool is_final);
+
+		/// write an encoded audio packet to the audio file (rescaling its timestamps to the stream)
+		void write_encoded_audio_packet(AVPacket *pkt);
+
 		/// write video frame
 		bool write_video_packet(std::shared_ptr<openshot::Frame> frame, AVFrame *frame_final);
 
+		/// write an encoded video packet to the video file (rescaling its timestamps to the stream)
+		bool write_encoded_video_packet(AVPacket *pkt);
+
+		/// Find the file a block of frames can be copied from (the FFmpegReader of a timeline's single pass-through clip), or NULL
+		openshot::FFmpegReader *find_smart_render_source(openshot::ReaderBase *reader, int64_t start, int64_t end, int64_t &source_start);
+
+		/// Write a block of frames by copying the packets of the source file, and re-encoding only the frames before its
+		/// first keyframe and from its last keyframe (returns false if the frames can't be copied)
+		bool smart_render_frames(openshot::ReaderBase *reader, int64_t start, int64_t end);
+
+		/// Re-encode a range of frames into a temporary file (with the same video options as this file), and copy its packets into this file
+		void write_smart_render_range(openshot::ReaderBase *reader, int64_t start, int64_t end, int64_t frame_offset, int64_t &last_dts);
+
+		/// write a copied packet, moving its timestamps from a base timestamp of the input stream to a base timestamp of the output stream
+		void write_copied_packet(AVPacket *pkt, AVRational input_time_base, int64_t input_base, AVStream *output_stream, int64_t output_base, int64_t &last_dts);
+
 		/// write all queued frames
 		void write_queued_frames();
 
+		/// encode the frames moved to the queues (queued_video_frames and queued_audio_frames)
+		void encode_queued_frames();
+
+		/// Hand the spooled frames to the writer thread (waiting while too many batches are queued)
+		void queue_spooled_frames();
+
+		/// Wait for the writer thread to write all queued batches, and stop it (rethrowing any error)
+		void stop_writer();
+
+		/// The main loop of the writer thread
+		void writer_loop();
+
 	public:
 
 		/// @brief Constructor for FFmpegWriter. Throws one of the following exceptions.
 		/// @param path The file path of the video file you want to open and read
 		FFmpegWriter(std::string path);
 
+		/// Destructor
+		virtual ~FFmpegWriter();
+
 		/// Close the writer
 		void Close();
 
@@ -291,6 +395,21 @@ namespace openshot {
 		/// @param new_size The number of frames to queue before writing to the file
 		void SetCacheSize(int new_size) { cache_size = new_size; };
 
+		/// @brief Write the output as segments, which are flushed as soon as their frames are encoded (so they can be
+		/// played or packaged before the export finishes). This must be called before the PrepareStreams() method.
+		/// @param format The openshot::SegmentFormat (fragmented MP4, HLS, or DASH)
+		/// @param segment_seconds The target duration of each segment (in seconds), which is also the keyframe interval
+		/// @param playlist_size The number of segments kept in the rolling HLS playlist or DASH manifest (0 = all segments)
+		void SetSegmentOptions(openshot::SegmentFormat format, double segment_seconds, int playlist_size);
+
+		/// @brief Enable or disable smart rendering. When a block of frames is written from a timeline range which is a
+		/// single clip without effects or transforms (see Timeline::FindPassThroughClip), and the clip's file has the same
+		/// codecs, codec parameters, and container as this file, the compressed packets of the file are copied instead of
+		/// decoding and re-encoding them. Only the frames before the first keyframe of the range (and from the last keyframe
+		/// of the range) are re-encoded. This is used for the first block of frames written (i.e. a trim job).
+		/// @param enabled Copy the packets of unchanged ranges of the source file
+		void SetSmartRender(bool enabled) { smart_render = enabled; };
+
 		/// @brief Set video export options
 		/// @param has_video Does this file need a video stream
 		/// @param codec The codec used to encode the images in this video
@@ -306,7 +425,7 @@ namespace openshot {
 		/// @brief Set custom options (some codecs accept additional params). This must be called after the
 		/// PrepareStreams() method, otherwise the streams have not been initialized yet.
 		/// @param stream The stream (openshot::StreamType) this option should apply to
-		/// @param name The name of the option you want to set (i.e. qmin, qmax, etc...)
+		/// @param name The name of the option you want to set (i.e. qmin, qmax, pix_fmt, etc...)
 		/// @param value The new value of this option
 		void SetOption(openshot::StreamType stream, std::string name, std::string value);
 
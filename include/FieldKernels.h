@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief Header file for FieldKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_FIELD_KERNELS_H
+#define OPENSHOT_FIELD_KERNELS_H
+
+#include <cstdint>
+
+namespace openshot {
+
+	/**
+	 * @brief This class holds the row loops which merge and split the fields of interlaced images
+	 *
+	 * An interlaced image holds 2 fields (points in time): the even rows, and the odd rows. These kernels copy
+	 * whole rows with memcpy, and blend rows with a simple byte loop (which the compiler vectorizes). Large images
+	 * are split into bands of rows, which run in parallel on the openshot::TaskPool.
+	 */
+	class FieldKernels {
+	public:
+		/// @brief Copy the rows of one field from an image into another image (of the same height)
+		/// @param target The pixels of the image to copy the field into
+		/// @param target_bytes_per_line The bytes per line of the target image
+		/// @param source The pixels of the image to copy the field from
+		/// @param source_bytes_per_line The bytes per line of the source image
+		/// @param height The number of rows of both images
+		/// @param row_bytes The number of bytes to copy from each row
+		/// @param odd Copy the odd rows (or the even rows)
+		static void Weave(unsigned char *target, int target_bytes_per_line, const unsigned char *source, int source_bytes_per_line, int height, int row_bytes, bool odd);
+
+		/// @brief Rebuild the rows of the other field from one field of an image (in place)
+		///
+		/// Bob repeats each row of the field (like scaling it to full height without smoothing), and linear
+		/// interpolation averages the rows above and below, which keeps diagonal edges smoother.
+		///
+		/// @param pixels The pixels of the image (the rows of the other field are replaced)
+		/// @param bytes_per_line The bytes per line of the image
+		/// @param height The number of rows of the image
+		/// @param row_bytes The number of bytes in each row
+		/// @param odd Keep the odd rows (or the even rows)
+		/// @param interpolate Use linear interpolation (or bob)
+		static void Deinterlace(unsigned char *pixels, int bytes_per_line, int height, int row_bytes, bool odd, bool interpolate);
+	};
+
+}
+
+#endif
@@ -43,6 +43,8 @@
 #include <iomanip>
 #include <sstream>
 #include <queue>
+#include <utility>
+#include <vector>
 #include <QtWidgets/QApplication>
 #include <QtGui/QImage>
 #include <QtGui/QColor>
@@ -53,9 +55,12 @@
 #include <QtWidgets/QHBoxLayout>
 #include <QtWidgets/QWidget>
 #include <QtWidgets/QLabel>
+#include <functional>
 #include <memory>
 #include <unistd.h>
 #include "ZmqLogger.h"
+#include "AudioKernels.h"
+#include "ImageBufferPool.h"
 #include "ChannelLayouts.h"
 #include "AudioBufferSource.h"
 #include "AudioResampler.h"
@@ -65,8 +70,48 @@
 	#include "MagickUtilities.h"
 #endif
 
+// QImage supports 16 bits per channel images (RGBA64) since Qt 5.12
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	#define USE_RGBA64_IMAGES 1
+#endif
+
 namespace openshot
 {
+	/**
+	 * @brief The native image planes (i.e. YUV) a frame's image was decoded from
+	 *
+	 * Readers can attach the planes they decoded to a frame, so a writer which encodes the same pixel format
+	 * can use them directly, instead of converting the RGBA image back (i.e. YUV -> RGBA -> YUV).
+	 */
+	struct FramePlanes
+	{
+		int width; ///< The width of the planes (in pixels)
+		int height; ///< The height of the planes (in pixels)
+		int pixel_format; ///< The pixel format of the planes (an FFmpeg AVPixelFormat)
+		uint8_t *data[4]; ///< The data of each plane
+		int linesize[4]; ///< The size in bytes of each row of each plane
+		std::shared_ptr<void> owner; ///< Owns (and frees) the plane data
+	};
+
+	/**
+	 * @brief A read-only view of a frame's audio samples (which neither copies nor allocates)
+	 *
+	 * The samples of a frame are stored planar, in one pooled (and contiguous) block, with each
+	 * channel starting on a 64 byte boundary. The view is valid until the frame's audio is changed.
+	 */
+	struct AudioSamplesView
+	{
+		const float* const* channels; ///< A pointer to the samples of each channel
+		int channel_count; ///< The number of channels
+		int sample_count; ///< The number of samples in each channel
+
+		/// Get the samples of a channel
+		const float* Channel(int channel) const { return channels[channel]; }
+
+		/// Get a sample, indexed as if the channels were interleaved (i.e. sample * channel_count + channel)
+		float Interleaved(int64_t index) const { return channels[index % channel_count][index / channel_count]; }
+	};
+
 	/**
 	 * @brief This class represents a single frame of video (i.e. image & audio data)
 	 *
@@ -117,7 +162,18 @@ namespace openshot
 	private:
 		std::shared_ptr<QImage> image;
 		std::shared_ptr<QImage> wave_image;
+		std::shared_ptr<openshot::FramePlanes> planes;
+		qint64 planes_image_key; ///< The cache key of the image the planes match
 		std::shared_ptr<juce::AudioSampleBuffer> audio;
+		std::shared_ptr<uint8_t> audio_block; ///< The pooled buffer the audio samples are stored in (or NULL)
+		std::function<void(openshot::Frame*)> image_loader; ///< Adds the deferred image (until the image is first needed)
+		std::shared_ptr<openshot::FramePlanes> deferred_planes; ///< The native planes of the deferred image (if any)
+		QRect geometry_clip; ///< Pixels outside of this rectangle are transparent (until the geometry is applied)
+		std::vector<std::pair<QRect, QColor> > geometry_fills; ///< Rectangles replaced by a color (until the geometry is applied)
+		bool has_geometry; ///< The frame has geometry which is not applied to the image's pixels
+		std::shared_ptr<QImage> placed_image; ///< The only visible part of the deferred image (see AddPlacedImage())
+		QPoint placed_offset; ///< The position of the placed image in the frame
+		juce::CriticalSection loadingImageSection;
 		std::shared_ptr<QApplication> previewApp;
 		juce::CriticalSection addingImageSection;
         juce::CriticalSection addingAudioSection;
@@ -134,6 +190,27 @@ namespace openshot
 		/// Constrain a color value from 0 to 255
 		int constrain(int color_value);
 
+		/// Run the deferred image loader (if any), the first time the image is needed
+		void load_image();
+
+		/// Forget the deferred image loader (since a new image replaces it)
+		void cancel_image_loader();
+
+		/// Paint the image geometry (if any) into the image's pixels, the first time the pixels are needed
+		void apply_image_geometry();
+
+		/// Allocate pooled (contiguous and aligned) planar storage for the audio samples (silence, or the existing samples)
+		void allocate_audio(int new_channels, int new_samples, bool keep_existing);
+
+		/// Copy the samples of the audio (before they are changed), if they are shared with a clone (see ShallowClone())
+		void detach_audio();
+
+		/// Copy the data and pointers of another frame (sharing its audio samples, or copying them)
+		void copy_frame(const Frame& other, bool share_audio);
+
+		/// Take the data and pointers of another frame
+		void move_frame(Frame& other);
+
 	public:
 		int64_t number;	 ///< This is the frame number (starting at 1)
 		bool has_audio_data; ///< This frame has been loaded with audio data
@@ -155,15 +232,24 @@ namespace openshot
 		/// Copy constructor
 		Frame ( const Frame &other );
 
+		/// Move constructor (takes the image, audio, and planes of the other frame, without copying or sharing them)
+		Frame ( Frame &&other );
+
 		/// Assignment operator
 		Frame& operator= (const Frame& other);
 
+		/// Move assignment operator
+		Frame& operator= (Frame&& other);
+
 		/// Destructor
 		virtual ~Frame();
 
 		/// Add (or replace) pixel data to the frame (based on a solid color)
 		void AddColor(int new_width, int new_height, std::string new_color);
 
+		/// Add (or replace) pixel data to the frame (based on a packed RGBA color, i.e. 0xAARRGGBB, which needs no parsing)
+		void AddColor(int new_width, int new_height, QRgb new_color);
+
 		/// Add (or replace) pixel data to the frame
 		void AddImage(int new_width, int new_height, int bytes_per_pixel, QImage::Format type, const unsigned char *pixels_);
 
@@ -173,14 +259,99 @@ namespace openshot
 		/// Add (or replace) pixel data to the frame (for only the odd or even lines)
 		void AddImage(std::shared_ptr<QImage> new_image, bool only_odd_lines);
 
+		/// @brief Add the native image planes (i.e. YUV) the frame's current image was decoded from
+		///
+		/// The planes are only returned by GetPlanes() while the image is unchanged (i.e. until an effect or
+		/// compositing draws on it, or a new image is added).
+		void AddPlanes(std::shared_ptr<openshot::FramePlanes> new_planes);
+
+		/// @brief Share the image (and native planes) of another frame, without copying its pixels
+		///
+		/// Both frames read the same (copy-on-write) pixel buffer. The first write to either image (through
+		/// QImage::bits(), scanLine(), or a QPainter) detaches a private copy, so the other frame is never changed.
+		void ShareImage(const std::shared_ptr<openshot::Frame>& source_frame);
+
+		/// Is the frame's image buffer shared with another frame (i.e. not yet detached by a write)
+		bool IsImageShared();
+
+		/// @brief Defer the image of this frame, until it is first needed (i.e. by GetImage())
+		///
+		/// The loader is called once (on the first thread which needs the image), and adds the image to the frame.
+		/// Consumers which only need the audio (or the size, or the native planes) never pay for creating the image.
+		/// @param new_width The width of the deferred image
+		/// @param new_height The height of the deferred image
+		/// @param loader Adds the image (i.e. with AddImage()) to the frame it is passed
+		/// @param new_planes The native planes of the deferred image, returned by GetPlanes() until it is loaded (optional)
+		void SetImageLoader(int new_width, int new_height, std::function<void(openshot::Frame*)> loader,
+							std::shared_ptr<openshot::FramePlanes> new_planes = std::shared_ptr<openshot::FramePlanes>());
+
+		/// Is the image deferred (i.e. its loader has not been called yet)
+		bool IsImageDeferred();
+
+		/// @brief Add an image which covers only a part of the frame (the rest of the frame is transparent),
+		/// without creating an image of the frame's full size
+		///
+		/// A compositor can draw the placed image at its offset (see GetPlacedImage()). Any other consumer of the
+		/// image gets the full size image (with the placed image painted at its offset), once it first needs it.
+		/// @param new_width The width of the frame's image
+		/// @param new_height The height of the frame's image
+		/// @param new_image The visible part of the image
+		/// @param offset The position of the visible part in the frame's image
+		void AddPlacedImage(int new_width, int new_height, std::shared_ptr<QImage> new_image, QPoint offset);
+
+		/// @brief Get the placed image (see AddPlacedImage()), until the full size image is created
+		/// @returns True if the frame has a placed image
+		/// @param new_image Set to the placed image
+		/// @param offset Set to the position of the placed image in the frame's image
+		bool GetPlacedImage(std::shared_ptr<QImage> &new_image, QPoint &offset);
+
+		/// @brief Make the image transparent outside of a rectangle (without a pass over its pixels)
+		///
+		/// The geometry is kept with the frame, so a compositor can draw only the visible part of the image (see
+		/// TakeImageGeometry()). Any other consumer of the image gets the transparent pixels, the first time it needs them.
+		/// @param rect The visible rectangle of the image (in pixels)
+		void ClipImage(QRect rect);
+
+		/// @brief Replace a rectangle of the image by a color (without a pass over its pixels)
+		///
+		/// Like ClipImage(), the rectangle is only painted into the pixels if a consumer needs them.
+		/// @param rect The rectangle to fill (in pixels)
+		/// @param fill_color The color which replaces the pixels of the rectangle
+		void FillImageRect(QRect rect, QColor fill_color);
+
+		/// Does the frame have image geometry (see ClipImage() and FillImageRect()) which is not applied to its pixels
+		bool HasImageGeometry();
+
+		/// @brief Remove the image geometry from the frame, without painting it (so the caller must apply it)
+		///
+		/// The image (i.e. GetImage()) is drawn only inside the clip rectangle, and the fill rectangles replace it.
+		/// @returns True if the frame had image geometry
+		/// @param clip_rect The visible rectangle of the image (set to the full image, if there is no clip)
+		/// @param fills The rectangles (inside the clip rectangle) to fill, and their colors
+		bool TakeImageGeometry(QRect &clip_rect, std::vector<std::pair<QRect, QColor> > &fills);
+
 #ifdef USE_IMAGEMAGICK
 		/// Add (or replace) pixel data to the frame from an ImageMagick Image
 		void AddMagickImage(std::shared_ptr<Magick::Image> new_image);
+
+		/// @brief Get the pixels of an ImageMagick Image as a QImage in the frame image format (see ImageFormat())
+		///
+		/// The pixels are exported in the channel order and depth of the frame image format, so they are only
+		/// converted when the image has an alpha channel, and the frame image format is premultiplied. Readers of
+		/// a single image convert it once, and share the QImage between their frames.
+		static std::shared_ptr<QImage> MagickToImage(std::shared_ptr<Magick::Image> magick_image);
 #endif
 
 		/// Add audio samples to a specific channel
 		void AddAudio(bool replaceSamples, int destChannel, int destStartSample, const float* source, int numSamples, float gainToApplyToSource);
 
+		/// @brief Mix the samples of several sources (each with a gain ramp) into a channel, in a single pass
+		/// @param destChannel The channel to mix into
+		/// @param sources The sources to mix (each must have at least numSamples samples)
+		/// @param source_count The number of sources
+		/// @param numSamples The number of samples to mix
+		void MixAudio(int destChannel, const AudioMixSource* sources, int source_count, int numSamples);
+
 		/// Add audio silence
 		void AddAudioSilence(int numSamples);
 
@@ -197,12 +368,24 @@ namespace openshot
 		/// Clean up buffer after QImage is deleted
 		static void cleanUpBuffer(void *info);
 
+		/// @brief Convert the frame's image to a specific QImage format (if different)
+		///
+		/// Used by code which expects a specific pixel layout (i.e. effects and writers expect RGBA8888 pixels).
+		void ConvertImage(QImage::Format format);
+
 		/// Clear the waveform image (and deallocate its memory)
 		void ClearWaveform();
 
 		/// Copy data and pointers from another Frame instance
 		void DeepCopy(const Frame& other);
 
+		/// @brief Create a copy of this frame, which shares its image and its audio samples (until either frame changes them)
+		///
+		/// The copy constructor shares the image too, but copies the audio samples. A clone's samples are only
+		/// copied by the first method which changes them, or returns a writable pointer to them (GetAudioSamples()
+		/// and GetAudioSampleBuffer()), so code which only reads the samples of a clone should use GetAudioView().
+		std::shared_ptr<openshot::Frame> ShallowClone();
+
 		/// Display the frame image to the screen (primarily used for debugging reasons)
 		void Display();
 
@@ -221,6 +404,13 @@ namespace openshot
 		// Get a planar array of sample data, using any sample rate
 		float* GetPlanarAudioSamples(int new_sample_rate, openshot::AudioResampler* resampler, int* sample_count);
 
+		/// Get a read-only (planar) view of the audio samples, without copying them
+		openshot::AudioSamplesView GetAudioView();
+
+		/// @brief Copy the audio samples (all channels interleaved together) into a buffer owned by the caller
+		/// @param output The buffer to fill (which must hold GetAudioChannelsCount() * GetAudioSamplesCount() samples)
+		void InterleaveAudioSamples(float* output);
+
 		/// Get number of audio channels
 		int GetAudioChannelsCount();
 
@@ -229,14 +419,32 @@ namespace openshot
 
 	    juce::AudioSampleBuffer *GetAudioSampleBuffer();
 
-		/// Get the size in bytes of this frame (rough estimate)
+		/// Get the size in bytes of this frame (image, waveform image, and audio buffers)
 		int64_t GetBytes();
 
-		/// Get pointer to Qt QImage image object
+		/// Get the size in bytes of this frame's image buffer (including row padding)
+		int64_t GetImageBytes();
+
+		/// @brief Get pointer to Qt QImage image object
+		///
+		/// The pixels can be shared with other frames, so only write to them through QImage::bits(),
+		/// scanLine(), or a QPainter (which detach a private copy), and read them through constBits().
 		std::shared_ptr<QImage> GetImage();
 
+		/// Get the native image planes (or NULL, if there are none, or if the image has changed since they were added)
+		std::shared_ptr<openshot::FramePlanes> GetPlanes();
+
+		/// @brief Get the QImage format of frame images
+		///
+		/// RGBA8888, or premultiplied ARGB32 if Settings::PREMULTIPLIED_IMAGES is enabled (which composites faster),
+		/// or RGBA64 (16 bits per channel) if Settings::HIGH_BIT_DEPTH_IMAGES is enabled (and supported by Qt).
+		static QImage::Format ImageFormat();
+
 #ifdef USE_IMAGEMAGICK
-		/// Get pointer to ImageMagick image object
+		/// @brief Get pointer to ImageMagick image object
+		///
+		/// The pixels are read straight from the frame image, when ImageMagick can read its pixel layout (any format
+		/// except premultiplied images with transparent pixels, which are converted to RGBA8888 first).
 		std::shared_ptr<Magick::Image> GetMagickImage();
 #endif
 
@@ -261,6 +469,13 @@ namespace openshot
 		/// Calculate the # of samples per video frame (for a specific frame number and frame rate)
 		static int GetSamplesPerFrame(int64_t frame_number, openshot::Fraction fps, int sample_rate, int channels);
 
+		/// @brief Calculate the total # of samples before a video frame (i.e. the sum of the samples of the previous frames)
+		///
+		/// The total is calculated exactly (in integers, from the frame rate fraction), and rounded down to a multiple of
+		/// the channels, so the samples of every frame follow the same repeating cadence (i.e. 1600, 1602, 1602, 1602, 1602
+		/// stereo samples for 48000 Hz at 29.97 fps), and add up to the total of any range of frames.
+		static int64_t GetSamplesBeforeFrame(int64_t frame_number, openshot::Fraction fps, int sample_rate, int channels);
+
 		/// Get an audio waveform image
 		std::shared_ptr<QImage> GetWaveform(int width, int height, int Red, int Green, int Blue, int Alpha);
 
@@ -31,8 +31,10 @@
 #ifndef OPENSHOT_FRAMEMAPPER_H
 #define OPENSHOT_FRAMEMAPPER_H
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
+#include <map>
 #include <math.h>
 #include <vector>
 #include <memory>
@@ -42,6 +44,8 @@
 #include "Fraction.h"
 #include "Exceptions.h"
 #include "KeyFrame.h"
+#include "TaskPool.h"
+#include "InterpolationKernels.h"
 
 
 // Include FFmpeg headers and macros
@@ -62,6 +66,8 @@ namespace openshot
 		PULLDOWN_CLASSIC,	///< Classic 2:3:2:3 pull-down
 		PULLDOWN_ADVANCED,	///< Advanced 2:3:3:2 pull-down (minimal dirty frames)
 		PULLDOWN_NONE,		///< Do not apply pull-down techniques, just repeat or skip entire frames
+		PULLDOWN_BLEND,		///< Blend the 2 nearest original frames (by the point in time of each new frame)
+		PULLDOWN_MOTION,	///< Motion compensated interpolation between the 2 nearest original frames
 	};
 
 	/**
@@ -147,14 +153,67 @@ namespace openshot
 		CacheMemory final_cache; 		// Cache of actual Frame objects
 		bool is_dirty; 			// When this is true, the next call to GetFrame will re-init the mapping
 		SWRCONTEXT *avr;	// Audio resampling context object
+		int target_width;	// The image size requested by the current GetFrame() call (0 = full size)
+		int target_height;
+		int64_t last_requested_frame;	// The previous frame requested (so ordered requests can map a batch of frames)
+		std::map<int64_t, std::shared_ptr<Frame> > batch_frames;	// The source frames read by GetFrames() (used instead of the reader)
+		bool video_enabled;		// The streams hinted by EnableStreams (which are forwarded to the source reader)
+		bool audio_enabled;
+
+		// Streaming audio resampler (which consumes the source audio once, in order)
+		SWRCONTEXT *audio_stream;			// Resampling context of the stream (NULL = no stream)
+		int audio_stream_sample_rate;		// The sample rate and channels of the source audio fed to the stream
+		int audio_stream_channels;
+		int64_t audio_stream_frame;			// The next target frame the stream continues to
+		int64_t audio_stream_source_frame;	// The next source frame to feed to the stream
+		int audio_stream_source_sample;		// The first sample of the next source frame to feed to the stream
+		std::vector<std::vector<float> > audio_stream_samples;	// Resampled samples (of each channel) not yet added to a frame
+
+		// Compact description of the mapping (calculated by Init), which each frame is mapped from on demand
+		std::vector<Field> fields;			// Fields added by the field pattern (only used while calculating the mapping)
+		bool pattern_mapping;				// Map with the field pattern of 24, 25, and 30 fps (otherwise a linear mapping)
+		float pattern_difference;			// The difference (in frames) between the target and original frame rates
+		int pattern_field_interval;			// The interval of fields which are skipped or repeated
+		int pattern_frame_interval;			// The interval of frames (2 fields per frame)
+		std::vector<Field> pattern;			// The fields of the first period of the pattern (which repeats, shifted by pattern_frames)
+		int64_t pattern_frames;				// Number of original frames in each period of the pattern
+		int64_t pattern_periods;			// Number of periods before the tail of the mapping
+		std::vector<Field> tail;			// The fields of the end of the mapping (after the repeating periods)
+		bool first_field_toggle;			// The odd / even flag of the first field
+		double linear_increment;			// The original frames per target frame (for a linear mapping)
+		int64_t mapped_length;				// Number of target frames
 
 		// Internal methods used by init
 		void AddField(int64_t frame);
 		void AddField(Field field);
 
+		// Add the fields for a range of original fields (using the pull-down technique), and return the next original field
+		int64_t add_pattern_fields(int64_t first_field, int64_t last_field, int64_t &frame);
+
+		// The pull-down technique of the field pattern (interpolated frames are mapped to whole frames, like PULLDOWN_NONE)
+		PulldownType pattern_pulldown();
+
+		// Get a field of the mapping (0 = the first field of target frame 1)
+		Field mapped_field(int64_t index);
+
+		// Find the original frame (and the sample of that frame) which contains a sample
+		void find_original_sample(int64_t sample, int64_t &frame_number, int &sample_position);
+
 		// Get Frame or Generate Blank Frame
 		std::shared_ptr<Frame> GetOrCreateFrame(int64_t number);
 
+		// Feed the samples of a source frame (starting at a sample) to the audio stream
+		void feed_audio_stream(std::shared_ptr<Frame> source_frame, int start_sample);
+
+		// Add the exact number of resampled samples a target frame needs, from the audio stream
+		void stream_mapped_audio(std::shared_ptr<Frame> frame, const MappedFrame &mapped);
+
+		// Free the audio stream (so the next frame restarts it, i.e. after a seek)
+		void reset_audio_stream();
+
+		// Number of frames to map for a cache miss (more than 1 only when frames are requested in order)
+		int calculate_batch_size(int64_t requested_frame);
+
 		// Use the original and target frame rates and a pull-down technique to create
 		// a mapping between the original fields and frames or a video to a new frame rate.
 		// This might repeat or skip fields and frames of the original video, depending on
@@ -162,10 +221,6 @@ namespace openshot
 		void Init();
 
 	public:
-		// Init some containers
-		std::vector<Field> fields;		// List of all fields
-		std::vector<MappedFrame> frames;	// List of all frames
-
 		/// Default constructor for openshot::FrameMapper class
 		FrameMapper(ReaderBase *reader, Fraction target_fps, PulldownType target_pulldown, int target_sample_rate, int target_channels, ChannelLayout target_channel_layout);
 
@@ -184,6 +239,9 @@ namespace openshot
 		/// Get the cache object used by this reader
 		CacheMemory* GetCache() { return &final_cache; };
 
+		/// Get the metrics of this mapper's cache, and of the mapped reader (as JSON)
+		Json::Value MetricsValue();
+
 		/// @brief This method is required for all derived classes of ReaderBase, and return the
 		/// openshot::Frame object, which contains the image and audio information for that
 		/// frame of video.
@@ -192,6 +250,25 @@ namespace openshot
 		/// @param requested_frame The frame number that is requested.
 		std::shared_ptr<Frame> GetFrame(int64_t requested_frame);
 
+		/// Get a frame, with the original frames requested from the source reader at the size they will be drawn at
+		///
+		/// @returns The requested frame of video
+		/// @param requested_frame The frame number that is requested.
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		std::shared_ptr<Frame> GetFrame(int64_t requested_frame, int width, int height);
+
+		/// Get a range of consecutive frames, whose source frames are read from the source reader in a single call
+		/// (see ReaderBase::GetFrames)
+		///
+		/// @returns The frames (in order)
+		/// @param start The first frame number
+		/// @param count The number of frames
+		std::vector<std::shared_ptr<Frame> > GetFrames(int64_t start, int64_t count);
+
+		/// Hint which streams are used (which is forwarded to the source reader, and clears the mapped frames if it changes)
+		void EnableStreams(bool video, bool audio);
+
 		/// Determine if reader is open or closed
 		bool IsOpen();
 
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * @brief Header file for FrameServer class (publishes rendered frames in shared memory)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_FRAME_SERVER_H
+#define OPENSHOT_FRAME_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Exceptions.h"
+#include "Frame.h"
+#include "Json.h"
+#include "ReaderBase.h"
+
+namespace zmq {
+	class socket_t;
+}
+
+namespace openshot
+{
+	/// @brief The header at the start of the shared memory of a openshot::FrameServer (its slots follow it)
+	///
+	/// The slots start at FrameServer::HeaderSize, and each slot is slot_size bytes long.
+	struct FrameServerHeader
+	{
+		char magic[8]; ///< "OSFRAME1" (the version of this layout)
+		uint32_t slot_count; ///< The number of slots in the ring buffer
+		uint32_t width; ///< The width of the frames (in pixels)
+		uint32_t height; ///< The height of the frames (in pixels)
+		uint32_t bytes_per_line; ///< The bytes of each row of pixels (RGBA, 8 bits per channel, not premultiplied)
+		uint64_t slot_size; ///< The bytes of each slot (its header, and its pixels)
+		std::atomic<uint64_t> published; ///< The number of frames published (frame N of the ring is in slot N % slot_count)
+	};
+
+	/// @brief The header of a slot of a openshot::FrameServer (its pixels start at FrameServer::SlotHeaderSize)
+	///
+	/// The sequence is odd while the slot is written, and 2 * (N + 1) once frame N of the ring is in it.
+	struct FrameServerSlot
+	{
+		std::atomic<uint64_t> sequence; ///< The sequence of the slot (changed when the slot is written)
+		int64_t frame_number; ///< The number of the frame in the slot
+	};
+
+	/**
+	 * @brief This class renders the frames of a reader (i.e. a openshot::Timeline) into a ring buffer of shared
+	 * memory, so the processes on a host can read them without copies (and without rendering them again)
+	 *
+	 * The shared memory is a POSIX shared memory object (see shm_open), which starts with a FrameServerHeader and
+	 * is followed by the slots of the ring buffer. Each slot holds one frame (RGBA, scaled to the size of the
+	 * reader), and is overwritten once the ring buffer wraps around. A consumer reads the sequence of a slot,
+	 * reads its pixels (in place), and reads the sequence again: the frame is only valid if both sequences are
+	 * the same, and even.
+	 *
+	 * Serve() answers the JSON requests of a ZeroMQ REP socket (for control), and publishes a JSON notification
+	 * for each frame on a PUB socket:
+	 * - {"type": "info"} is answered with the name and the layout of the shared memory
+	 * - {"type": "frame", "frame": 10} renders a frame (unless it is still in the ring), and is answered with its slot
+	 * - {"type": "frames", "start": 10, "count": 8} renders a batch of frames, and is answered with their slots
+	 * - {"type": "stop"} stops serving
+	 *
+	 * @code
+	 * // Serve the frames of a timeline in "/openshot-frames" (and answer the consumers on port 5580)
+	 * FrameServer s(&t, "/openshot-frames", 16);
+	 * s.Open();
+	 * s.Serve("tcp://127.0.0.1:5580", "tcp://127.0.0.1:5581");
+	 * s.Close();
+	 * @endcode
+	 */
+	class FrameServer
+	{
+	private:
+		openshot::ReaderBase *reader;
+		std::string name; ///< The name of the shared memory object (i.e. /openshot-frames)
+		int slot_count; ///< The number of slots in the ring buffer
+		int width; ///< The width of the published frames
+		int height; ///< The height of the published frames
+		size_t memory_size; ///< The size of the shared memory (in bytes)
+		unsigned char *memory; ///< The mapped shared memory (or NULL, if closed)
+		std::map<int64_t, int> frame_slots; ///< The slot of each frame in the ring buffer
+		uint64_t published; ///< The number of frames published
+		zmq::socket_t *notifier; ///< The socket which publishes the notifications (while serving)
+		std::atomic<bool> stop_requested; ///< Stop serving (after the current request)
+
+		/// Get the header of the shared memory
+		openshot::FrameServerHeader* header() { return (openshot::FrameServerHeader*) memory; }
+
+		/// Get the header of a slot
+		openshot::FrameServerSlot* slot(int index);
+
+		/// Write a frame into the next slot (and notify the consumers)
+		int publish_frame(std::shared_ptr<openshot::Frame> frame);
+
+		/// Answer a request of a consumer
+		Json::Value answer(const Json::Value& request);
+
+	public:
+		/// The size of the header of the shared memory (the first slot starts after it)
+		static const size_t HeaderSize = 64;
+
+		/// The size of the header of a slot (the pixels of the slot start after it)
+		static const size_t SlotHeaderSize = 64;
+
+		/// @brief Constructor for FrameServer
+		/// @param reader The reader to render (the frames are scaled to the width and height of its info)
+		/// @param name The name of the shared memory object (i.e. /openshot-frames)
+		/// @param slot_count The number of frames the ring buffer holds
+		FrameServer(openshot::ReaderBase *reader, std::string name, int slot_count=8);
+
+		/// Destructor (closes the shared memory)
+		~FrameServer();
+
+		/// @brief Create the shared memory (and open the reader, if it is closed)
+		///
+		/// The shared memory object is created by this server (only readable and writable by its user), so
+		/// Open() throws an InvalidFile if an object with the same name already exists.
+		void Open();
+
+		/// Unmap and remove the shared memory (consumers which mapped it keep their mapping)
+		void Close();
+
+		/// Determine if the shared memory is open
+		bool IsOpen() { return memory != NULL; };
+
+		/// Get the name of the shared memory object
+		std::string Name() { return name; };
+
+		/// Get the number of frames the ring buffer holds
+		int SlotCount() { return slot_count; };
+
+		/// Get the number of frames published (so far)
+		uint64_t Published() { return published; };
+
+		/// @brief Publish a frame (returns its slot), unless it is still in the ring buffer
+		/// @param frame_number The number of the frame to render
+		int Publish(int64_t frame_number);
+
+		/// @brief Publish a batch of frames (rendered together, by readers which render batches, see ReaderBase::GetFrames)
+		/// @param start The number of the first frame
+		/// @param count The number of frames (at most the slot count, so the batch isn't overwritten by itself)
+		/// @returns The slot of each frame (or -1 for a frame which was in the oldest slots, and is overwritten by the batch)
+		std::vector<int> PublishFrames(int64_t start, int64_t count);
+
+		/// Get the name and the layout of the shared memory (as sent to consumers)
+		Json::Value InfoJson();
+
+		/// @brief Answer the requests of consumers, until a stop request (or Stop())
+		/// @param control_endpoint The ZeroMQ endpoint of the REP socket (i.e. tcp://127.0.0.1:5580)
+		/// @param notify_endpoint The ZeroMQ endpoint of the PUB socket, which notifies each published frame
+		void Serve(std::string control_endpoint, std::string notify_endpoint);
+
+		/// Stop serving (after the current request)
+		void Stop() { stop_requested = true; };
+	};
+
+}
+
+#endif
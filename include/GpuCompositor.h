@@ -0,0 +1,163 @@
+/**
+ * @file
+ * @brief Header file for GpuCompositor class (compositing of timeline layers, and their point-wise effects, on the GPU)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_GPU_COMPOSITOR_H
+#define OPENSHOT_GPU_COMPOSITOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <QtCore/QRect>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtGui/QTransform>
+#include "EffectBase.h"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+class QThread;
+
+namespace openshot {
+
+	class GpuThread;
+
+	/// A layer composited by the openshot::GpuCompositor (an image, drawn with a transform, after its GPU kernels)
+	struct GpuLayer {
+		std::shared_ptr<QImage> image; ///< The image of the layer (uploaded as RGBA8888)
+		QRect draw_rect; ///< The part of the image which is drawn (in image pixels)
+		QTransform transform; ///< The transform from image pixels to timeline pixels
+		float alpha; ///< The opacity of the layer (0.0 to 1.0)
+		std::vector<openshot::EffectBase::GpuKernel> kernels; ///< The kernels applied to the image (in order), before it is drawn
+	};
+
+	/**
+	 * @brief This class composites the layers of timeline frames with OpenGL compute shaders (see Settings::GPU_COMPOSITING)
+	 *
+	 * Each layer's image is uploaded once, its GPU kernels (the point-wise effects of its clip, see
+	 * EffectBase::GetGpuKernel) run on the uploaded image in a single pass, and it is drawn onto the composite
+	 * (which stays on the GPU) with its transform, interpolated bilinearly and blended with premultiplied alpha. The
+	 * composite is only downloaded once, after the last layer. Its edges are not antialiased (the same as the
+	 * scaling kernels of Timeline::add_layer).
+	 *
+	 * The OpenGL 4.3 context renders to an offscreen surface, so exports without a window (and without a
+	 * display, with the offscreen or EGL platforms of Qt) can use it too. Qt only creates offscreen surfaces
+	 * on the GUI thread of a QGuiApplication, so Initialize() is called there (by Timeline::Open), and the frames
+	 * are composited by a thread of this class, which owns the context. Without a QGuiApplication (or without
+	 * OpenGL 4.3), IsAvailable() is false, and timelines composite on the CPU.
+	 */
+	class GpuCompositor {
+	private:
+		friend class GpuThread;
+
+		std::mutex init_mutex; ///< Guards the creation of the context
+		bool initialized; ///< Was the context created (or did it fail)
+		bool available; ///< Can frames be composited (the context and the shaders work)
+		QOffscreenSurface *surface; ///< The surface of the context (created on the GUI thread)
+		QOpenGLContext *context; ///< The OpenGL 4.3 context (owned by the GPU thread)
+		GpuThread *thread; ///< The thread which runs the jobs with the context
+
+		std::mutex jobs_mutex;
+		std::condition_variable jobs_changed;
+		std::deque<std::function<void()> > jobs; ///< The jobs waiting for the GPU thread
+
+		// The state of the GPU thread (only used by its jobs)
+		std::map<std::string, QOpenGLShaderProgram*> programs; ///< The compiled programs (by source)
+		unsigned int canvas_texture; ///< The composite
+		QSize canvas_size;
+		unsigned int source_texture; ///< The image of the layer being composited
+		QSize source_size;
+		unsigned int read_framebuffer; ///< Reads the composite back
+
+		/// Constructor (private, because this is a singleton)
+		GpuCompositor();
+
+		/// Don't allow the user to copy or assign this instance
+		GpuCompositor(GpuCompositor const&) = delete;
+		GpuCompositor & operator=(GpuCompositor const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static GpuCompositor * m_pInstance;
+
+		/// Run the jobs (on the GPU thread, with the context current)
+		void run_jobs();
+
+		/// Run a job on the GPU thread, and wait for its result
+		bool run_job(std::function<bool()> job);
+
+		/// Get a compiled compute program (compiling it the first time), or NULL if it doesn't compile
+		QOpenGLShaderProgram* program(const std::string& source);
+
+		/// Get the program which runs a list of GPU kernels (in order, each inside its region)
+		QOpenGLShaderProgram* kernel_program(const std::vector<openshot::EffectBase::GpuKernel>& kernels);
+
+		/// Create a RGBA8 texture (replacing the texture, if it has a different size)
+		void resize_texture(unsigned int& texture, QSize& texture_size, QSize size);
+
+		/// Composite the layers (on the GPU thread)
+		bool composite(int width, int height, QColor background, const std::vector<GpuLayer>& layers, QImage& result);
+
+	public:
+		/// The most GPU kernels of a layer (the effects of a clip with more kernels are applied on the CPU)
+		static const int MaxKernels = 16;
+
+		/// The most parameters of all GPU kernels of a layer
+		static const int MaxParameters = 64;
+
+		/// Create or get an instance of this compositor singleton (invoke the class with this method)
+		static GpuCompositor * Instance();
+
+		/// @brief Create the OpenGL context (once), on the GUI thread of a QGuiApplication
+		/// @returns True if frames can be composited (see IsAvailable). A call from another thread (or without a
+		/// QGuiApplication) returns false, and the context can still be created by a later call.
+		bool Initialize();
+
+		/// Determine if frames can be composited (Initialize() created the context, and its shaders compile)
+		bool IsAvailable();
+
+		/// @brief Composite layers onto a background (lowest layer first), and download the composite
+		/// @returns The composite (in an image format used by frames, see Frame::ImageFormat), or NULL if the GPU
+		/// failed (or is not available)
+		/// @param width The width of the composite
+		/// @param height The height of the composite
+		/// @param background The (opaque) background color
+		/// @param layers The layers
+		/// @param format The image format of the composite (QImage::Format_RGBA8888 or QImage::Format_ARGB32_Premultiplied)
+		std::shared_ptr<QImage> Composite(int width, int height, QColor background, const std::vector<GpuLayer>& layers, QImage::Format format);
+	};
+
+}
+
+#endif
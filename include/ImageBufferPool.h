@@ -0,0 +1,113 @@
+/**
+ * @file
+ * @brief Header file for ImageBufferPool class (recycled image buffers)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_IMAGE_BUFFER_POOL_H
+#define OPENSHOT_IMAGE_BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <QtGui/QImage>
+
+namespace openshot {
+
+	/**
+	 * @brief This class is a process-wide pool of image (and audio sample) buffers, which are recycled by new frames of the same size
+	 *
+	 * Free buffers are kept in buckets (sizes rounded up to whole pages), so frames of a similar size share a bucket.
+	 * Images created by the pool return their buffer on destruction (through the CleanUp() QImage cleanup function),
+	 * and the pool keeps up to Settings::IMAGE_POOL_SIZE megabytes of free buffers (freeing the rest).
+	 *
+	 * The buffers in use are counted by the openshot::Metrics memory gauge of the subsystem which acquired them
+	 * (see openshot::ScopedMemoryTag), and the free buffers by the "images.pool_free" gauge. The buffers which could not
+	 * be recycled (and were allocated) are counted by the "images.allocations" counter.
+	 *
+	 * Each buffer remembers the NUMA node of the thread which allocated it (see TaskPool::PinThreadToNode()), and
+	 * is only recycled by threads pinned to the same node, so the frames of a timeline stay in the memory of its node.
+	 */
+	class ImageBufferPool {
+	private:
+		std::mutex pool_mutex;
+		std::map<std::pair<int, size_t>, std::vector<uint8_t*> > free_buffers; ///< Free buffers (by NUMA node and bucket size)
+		size_t free_bytes; ///< Total size of all free buffers
+
+		/// Constructor (private, because this is a singleton)
+		ImageBufferPool();
+
+		/// Don't allow the user to copy or assign this instance
+		ImageBufferPool(ImageBufferPool const&) = delete;
+		ImageBufferPool & operator=(ImageBufferPool const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static ImageBufferPool * m_pInstance;
+
+		/// Get the bucket size of a buffer (rounded up to a whole page)
+		static size_t bucket_size(size_t size);
+
+	public:
+		/// Size of the header before each buffer (holds the bucket size, memory gauge, and NUMA node of the buffer, and keeps the pixels aligned for sws_scale)
+		static const size_t header_size = 64;
+
+		/// @brief Create or get an instance of this pool singleton (invoke the class with this method)
+		///
+		/// The pool is never destroyed, since frames can be released after static objects are destroyed.
+		static ImageBufferPool * Instance();
+
+		/// @brief Get a buffer of at least this many bytes (recycled, if one of the same bucket and NUMA node is free), or NULL
+		/// @param size The number of bytes needed
+		uint8_t *Acquire(size_t size);
+
+		/// @brief Return a buffer to the pool (or free it, if the pool is full)
+		/// @param buffer A buffer from Acquire()
+		void Release(uint8_t *buffer);
+
+		/// Free all buffers waiting in the pool
+		void Clear();
+
+		/// Get the total size of all free buffers waiting in the pool
+		size_t FreeBytes();
+
+		/// @brief Create an (uninitialized) image, whose pixels are stored in a pooled buffer
+		/// @param width The width of the image
+		/// @param height The height of the image
+		/// @param format The format of the image
+		static std::shared_ptr<QImage> CreateImage(int width, int height, QImage::Format format);
+
+		/// QImage cleanup function, which returns the image's buffer to the pool
+		static void CleanUp(void *info);
+	};
+
+}
+
+#endif
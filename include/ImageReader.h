@@ -73,6 +73,7 @@ namespace openshot
 	private:
 		std::string path;
 		std::shared_ptr<Magick::Image> image;
+		std::shared_ptr<QImage> cached_image; ///< The pixels of the image (converted once, and shared by all frames)
 		bool is_open;
 
 	public:
@@ -86,6 +87,9 @@ namespace openshot
 		/// when you are inflating the object using JSON after instantiating it.
 		ImageReader(std::string path, bool inspect_reader);
 
+		/// Destructor (finishes the frame requests)
+		virtual ~ImageReader();
+
 		/// Close File
 		void Close();
 
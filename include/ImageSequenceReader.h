@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @brief Header file for ImageSequenceReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_IMAGE_SEQUENCE_READER_H
+#define OPENSHOT_IMAGE_SEQUENCE_READER_H
+
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CacheMemory.h"
+#include "Exceptions.h"
+#include "ReaderBase.h"
+
+namespace openshot
+{
+
+	/**
+	 * @brief This class uses the Qt library to read a sequence of image files (i.e. PNG, TIFF, or EXR and
+	 * DPX with a Qt image format plugin), and return openshot::Frame objects containing each image.
+	 *
+	 * The path is a directory (every image in it, sorted by name), a printf style pattern (i.e.
+	 * "render/frame_%04d.png"), or any file of the sequence (i.e. "render/frame_0001.png", which matches
+	 * the other numbered files with the same name). The directory is listed once, when the reader is first
+	 * opened. Each frame which isn't cached decodes the next images in parallel (one per thread of the
+	 * openshot::TaskPool), so the following frames are read ahead. Images are downscaled to the max size
+	 * of the timeline (the same as openshot::QtImageReader).
+	 *
+	 * @code
+	 * // Create a reader for an image sequence (at 24 frames per second)
+	 * ImageSequenceReader r("render/frame_%04d.png", Fraction(24, 1));
+	 * r.Open(); // Open the reader
+	 *
+	 * // Get frame number 1 (the first image of the sequence)
+	 * std::shared_ptr<Frame> f = r.GetFrame(1);
+	 *
+	 * // Close the reader
+	 * r.Close();
+	 * @endcode
+	 */
+	class ImageSequenceReader : public ReaderBase
+	{
+	private:
+		std::string path;
+		std::string indexed_path; ///< The path the files were listed for
+		std::vector<std::string> files; ///< The image files of the sequence (in frame order)
+		int64_t files_size; ///< The total bytes of the image files
+		CacheMemory final_cache; ///< Decoded (and read ahead) frames
+		int cached_width; ///< The max size of the cached frames
+		int cached_height;
+		bool is_open;
+
+		/// List the image files of the sequence (only once for each path)
+		void index_files();
+
+		/// Determine the max size of the images (based on the timeline's size, the scaling mode, and the scaling keyframes)
+		void max_size(int &max_width, int &max_height);
+
+		/// Decode the image of a frame, scaled to fit the max size (or NULL, if the image can't be read)
+		std::shared_ptr<openshot::Frame> read_frame(int64_t number, int max_width, int max_height);
+
+	public:
+
+		/// Constructor for ImageSequenceReader.  This automatically opens the sequence to get its
+		/// properties, or it throws one of the following exceptions.
+		ImageSequenceReader(std::string path, openshot::Fraction fps = openshot::Fraction(30, 1));
+
+		/// Constructor for ImageSequenceReader.  This only lists and inspects the sequence if
+		/// inspect_reader=true. When not inspecting the sequence, it's much faster, and useful
+		/// when you are inflating the object using JSON after instantiating it.
+		ImageSequenceReader(std::string path, openshot::Fraction fps, bool inspect_reader);
+
+		virtual ~ImageSequenceReader();
+
+		/// Close File
+		void Close();
+
+		/// Get the cache object used by this reader
+		CacheMemory* GetCache() { return &final_cache; };
+
+		/// Get an openshot::Frame object for a specific frame number of this reader (the image
+		/// with the same position in the sequence).
+		///
+		/// @returns The requested frame (containing the image)
+		/// @param requested_frame The frame number that is requested.
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame);
+
+		/// Get the image file of a frame number (or an empty string, if it is not in the sequence)
+		std::string FramePath(int64_t frame_number);
+
+		/// Determine if reader is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Return the type name of the class
+		std::string Name() { return "ImageSequenceReader"; };
+
+		/// Get and Set JSON methods
+		std::string Json(); ///< Generate JSON string of this object
+		void SetJson(std::string value); ///< Load JSON string into this object
+		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
+		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
+
+		/// Open File - which is called by the constructor automatically
+		void Open();
+	};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file
+ * @brief Header file for ImageSequenceWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_IMAGE_SEQUENCE_WRITER_H
+#define OPENSHOT_IMAGE_SEQUENCE_WRITER_H
+
+#include "ReaderBase.h"
+#include "WriterBase.h"
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Exceptions.h"
+#include "Frame.h"
+
+namespace openshot
+{
+
+	/**
+	 * @brief This class uses the Qt library to write each frame as its own image file (i.e. a PNG, TIFF, or
+	 * JPEG sequence), without ImageMagick.
+	 *
+	 * Images are encoded straight from the frame's QImage (there is no copy, unless the image is scaled to the
+	 * size of the writer), and the queued frames are encoded in parallel, on the openshot::TaskPool. The path is
+	 * a printf style pattern of the frame number (i.e. "render/frame_%04d.png"). A path without a pattern gets
+	 * a 4 digit frame number before its extension.
+	 *
+	 * @code
+	 * // Create a reader for a video
+	 * FFmpegReader r("MyAwesomeVideo.webm");
+	 * r.Open(); // Open the reader
+	 *
+	 * // Create a writer (which will create render/frame_0001.png, render/frame_0002.png, ...)
+	 * ImageSequenceWriter w("render/frame_%04d.png");
+	 *
+	 * // Set the image output settings (format, fps, width, height, quality)
+	 * w.SetVideoOptions("PNG", r.info.fps, r.info.width, r.info.height, -1);
+	 *
+	 * // Open the writer, and write the 1st 30 frames from the reader
+	 * w.Open();
+	 * w.WriteFrame(&r, 1, 30);
+	 *
+	 * // Close the reader & writer (which writes any queued frames)
+	 * w.Close();
+	 * r.Close();
+	 * @endcode
+	 */
+	class ImageSequenceWriter : public WriterBase
+	{
+	private:
+		std::string path;
+		int cache_size;
+		bool is_open;
+		int image_quality;
+		std::vector<std::shared_ptr<openshot::Frame> > queued_frames; ///< Frames waiting to be encoded
+
+		/// Encode the image of a frame, and write it to its file
+		void write_image(std::shared_ptr<openshot::Frame> frame);
+
+		/// Encode and write all queued frames (in parallel)
+		void write_queued_frames();
+
+	public:
+
+		/// @brief Constructor for ImageSequenceWriter.
+		/// @param path The pattern of the image files you want to create (i.e. "frame_%04d.png")
+		ImageSequenceWriter(std::string path);
+
+		/// Destructor (writes any queued frames)
+		virtual ~ImageSequenceWriter();
+
+		/// Close the writer (after writing any queued frames)
+		void Close();
+
+		/// Get the path of the image file of a frame number
+		std::string FramePath(int64_t frame_number);
+
+		/// @brief Get the cache size
+		int GetCacheSize() { return cache_size; };
+
+		/// Determine if writer is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Open writer
+		void Open();
+
+		/// @brief Set the cache size (number of frames to queue before writing them in parallel)
+		/// @param new_size Number of frames to queue before writing (0 = one per thread of the openshot::TaskPool)
+		void SetCacheSize(int new_size) { cache_size = new_size; };
+
+		/// @brief Set the video export options
+		/// @param format The image format (such as PNG, or an empty string for the extension of the path)
+		/// @param fps Frames per second of the sequence
+		/// @param width Width in pixels of each image
+		/// @param height Height in pixels of each image
+		/// @param quality Quality of each image (0 to 100, or -1 for the default of the format). Qt uses it as the compression level of PNG images.
+		void SetVideoOptions(std::string format, openshot::Fraction fps, int width, int height, int quality);
+
+		/// @brief Add a frame to the queue waiting to be encoded.
+		/// @param frame The openshot::Frame object to write to an image file
+		void WriteFrame(std::shared_ptr<openshot::Frame> frame);
+
+		/// @brief Write a block of frames from a reader
+		/// @param reader A openshot::ReaderBase object which will provide frames to be written
+		/// @param start The starting frame number of the reader
+		/// @param length The number of frames to write
+		void WriteFrame(openshot::ReaderBase* reader, int64_t start, int64_t length);
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file
+ * @brief Header file for InterpolationKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_INTERPOLATION_KERNELS_H
+#define OPENSHOT_INTERPOLATION_KERNELS_H
+
+#include <cstdint>
+
+namespace openshot {
+
+	/**
+	 * @brief This class holds the loops which create an image between 2 images (used to convert frame rates)
+	 *
+	 * Blending mixes the 2 images (with a simple byte loop, which the compiler vectorizes). Motion compensation
+	 * first estimates the motion of each block of the image (by matching blocks of a quarter size luma image,
+	 * symmetrically around the point in time of the new image), and then blends the pixels each image moves to
+	 * that point. Both work on 32 bit pixels, and large images are split into bands of rows, which run in
+	 * parallel on the openshot::TaskPool.
+	 */
+	class InterpolationKernels {
+	public:
+		/// @brief Blend 2 images (of the same size) into a target image
+		/// @param target The pixels of the image to write
+		/// @param target_bytes_per_line The bytes per line of the target image
+		/// @param first The pixels of the first image
+		/// @param first_bytes_per_line The bytes per line of the first image
+		/// @param second The pixels of the second image
+		/// @param second_bytes_per_line The bytes per line of the second image
+		/// @param width The number of pixels (of 4 bytes) in each row
+		/// @param height The number of rows
+		/// @param weight The point in time between the images (0 is the first image, 1 is the second image)
+		static void Blend(unsigned char *target, int target_bytes_per_line, const unsigned char *first, int first_bytes_per_line,
+						  const unsigned char *second, int second_bytes_per_line, int width, int height, float weight);
+
+		/// @brief Create the motion compensated image between 2 images (of the same size)
+		/// @param target The pixels of the image to write
+		/// @param target_bytes_per_line The bytes per line of the target image
+		/// @param first The pixels of the first image
+		/// @param first_bytes_per_line The bytes per line of the first image
+		/// @param second The pixels of the second image
+		/// @param second_bytes_per_line The bytes per line of the second image
+		/// @param width The number of pixels (of 4 bytes) in each row
+		/// @param height The number of rows
+		/// @param weight The point in time between the images (0 is the first image, 1 is the second image)
+		static void MotionBlend(unsigned char *target, int target_bytes_per_line, const unsigned char *first, int first_bytes_per_line,
+								const unsigned char *second, int second_bytes_per_line, int width, int height, float weight);
+	};
+
+}
+
+#endif
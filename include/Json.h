@@ -31,6 +31,27 @@
 #ifndef OPENSHOT_JSON_H
 #define OPENSHOT_JSON_H
 
+#include <string>
 #include "json/json.h"
 
+namespace openshot {
+
+	/// @brief Parse a JSON string (with a reader shared by each thread, instead of a new reader for every string)
+	/// @returns True if the string was parsed, false if it is invalid JSON
+	bool ParseJson(const std::string& value, Json::Value& root);
+
+	/// @brief Serialize a JSON value to a compact string (without the indentation and line breaks of
+	/// Json::Value::toStyledString, which are much slower to generate and parse for large projects)
+	std::string WriteJson(const Json::Value& root);
+
+	/// @brief Serialize a JSON value to a compact binary string, which loads much faster than JSON text (each object
+	/// key is only stored once, and the points of keyframes are packed)
+	std::string WriteBinaryJson(const Json::Value& root);
+
+	/// @brief Parse a binary string (see WriteBinaryJson)
+	/// @returns True if the data was parsed, false if it is invalid (or truncated)
+	bool ParseBinaryJson(const std::string& value, Json::Value& root);
+
+}
+
 #endif
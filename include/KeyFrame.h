@@ -63,10 +63,66 @@ namespace openshot {
 	 */
 	class Keyframe {
 	private:
+		/// The curve between two consecutive points, in the coefficients it is evaluated with
+		struct Segment {
+			InterpolationType interpolation; ///< The interpolation of the right point
+			double x[4]; ///< The power basis of X(t) of a bezier curve (x[0] is the X of the left point otherwise)
+			double y[4]; ///< The power basis of Y(t) of a bezier curve (the left Y and the slope of a linear one)
+		};
+
 		std::vector<Point> Points;			///< Vector of all Points
+		std::vector<double> point_x;		///< The X coordinates of the points (contiguous, for the searches)
+		std::vector<Segment> segments;		///< The segments between consecutive points (see index_points())
+		std::vector<double> baked_values;	///< The values of consecutive indexes (see Bake())
+		int64_t baked_start = 0;			///< The index of the first baked value
+		std::vector<Fraction> baked_repeats;	///< The repeat fractions of the baked indexes (see BakeTimeMap())
+		std::vector<double> baked_deltas;	///< The deltas of the baked indexes (see BakeTimeMap())
+		std::vector<bool> baked_increasing;	///< The directions of the baked indexes (see BakeTimeMap())
+
+		/// Interpolate the value at a specific index (without the baked values)
+		double interpolate_value(int64_t index) const;
+
+		/// Interpolate the value at a specific index, from the first point which is not before the index
+		double value_at(size_t candidate, int64_t index) const;
+
+		/// Interpolate the values of consecutive indexes which are all inside of a segment
+		void interpolate_segment(size_t segment, int64_t index, int64_t count, double *values) const;
+
+		/// Find the first point which is not before an index (in the X coordinates)
+		size_t find_point(double index) const;
+
+		/// Update the X coordinates and segments, and discard the baked values (after the points changed)
+		void index_points();
+
+		/// Discard the baked values (since the points changed)
+		void discard_baked_values();
 
 	public:
 
+		/**
+		 * @brief A cursor remembers the segment of the last index it evaluated, so evaluating increasing (or
+		 * decreasing) indexes only steps to the neighboring segments, instead of searching all points.
+		 *
+		 * A cursor reads the points of its keyframe (which must outlive it), and any number of cursors can read
+		 * the same keyframe. Like GetValue(), a cursor must not be used while the points change.
+		 */
+		class Cursor {
+		private:
+			const Keyframe *keyframe;
+			size_t segment; ///< The index of the first point which is not before the last index
+			bool positioned; ///< Has the cursor found the segment of an index (with a search)
+
+		public:
+			/// Create a cursor of a keyframe (the first index is searched, like Keyframe::GetValue())
+			Cursor(const Keyframe &keyframe) : keyframe(&keyframe), segment(0), positioned(false) { }
+
+			/// Get the value at a specific index (the same as Keyframe::GetValue())
+			double GetValue(int64_t index);
+
+			/// Get the rounded LONG value at a specific index
+			int64_t GetLong(int64_t index) { return long(round(GetValue(index))); }
+		};
+
 		/// Default constructor for the Keyframe class
 		Keyframe() = default;
 
@@ -100,6 +156,12 @@ namespace openshot {
 		/// Get the rounded LONG value at a specific index
 		int64_t GetLong(int64_t index) const;
 
+		/// @brief Get the values of consecutive indexes (with a single search of the points)
+		/// @param start The first index
+		/// @param count The number of values
+		/// @param values The array to fill with the values (of at least count values)
+		void GetValues(int64_t start, int64_t count, double *values) const;
+
 		/// Get the fraction that represents how many times this value is repeated in the curve
 		Fraction GetRepeatFraction(int64_t index) const;
 
@@ -131,6 +193,31 @@ namespace openshot {
 		/// Get the direction of the curve at a specific index (increasing or decreasing)
 		bool IsIncreasing(int index) const;
 
+		/// Get whether the value is the same at every index from start to stop (inclusive), so values (and
+		/// anything computed from them) can be reused over that range
+		bool IsConstant(int64_t start, int64_t stop) const;
+
+		/// @brief Evaluate the curve once for each index from start to stop (inclusive), so GetValue(), GetInt(),
+		/// and GetLong() of those indexes only look up the baked value
+		///
+		/// Adding, updating, or removing points discards the baked values. Like changing the points, baking must
+		/// not happen while other threads read the keyframe.
+		void Bake(int64_t start, int64_t stop);
+
+		/// @brief Bake the animated range of the curve (between its first and last points), if it has one
+		/// @returns False if the curve is not animated, or its range is too long to bake
+		bool Bake();
+
+		/// @brief Bake the animated range of a time curve, with its repeat fractions, deltas, and directions
+		///
+		/// Time mapping (see Clip::time) queries GetRepeatFraction(), GetDelta(), and IsIncreasing() for every frame,
+		/// which each search (and interpolate) the points. Once baked, they are lookups too.
+		/// @returns False if the curve is not animated, or its range is too long to bake
+		bool BakeTimeMap();
+
+		/// Get whether the value at an index is baked (see Bake())
+		bool IsBaked(int64_t index) const;
+
 		/// Get and Set JSON methods
 		std::string Json() const; ///< Generate JSON string of this object
 		Json::Value JsonValue() const; ///< Generate Json::JsonValue for this object
@@ -40,12 +40,14 @@
 	   #define NEW_MAGICK (MagickLibVersion >= 0x700)
 	#endif
 
-    // IM7: <Magick::Image>->alpha(bool)
-    // IM6: <Magick::Image>->matte(bool)
+    // IM7: <Magick::Image>->alpha(bool), <Magick::Image>->alpha()
+    // IM6: <Magick::Image>->matte(bool), <Magick::Image>->matte()
     #if NEW_MAGICK
         #define MAGICK_IMAGE_ALPHA(im, a) im->alpha((a))
+        #define MAGICK_IMAGE_HAS_ALPHA(im) im->alpha()
     #else
         #define MAGICK_IMAGE_ALPHA(im, a) im->matte((a))
+        #define MAGICK_IMAGE_HAS_ALPHA(im) im->matte()
     #endif
 
     // IM7: vector<Magick::Drawable>
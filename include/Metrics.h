@@ -0,0 +1,248 @@
+/**
+ * @file
+ * @brief Header file for Metrics class (counters, gauges, and histograms of the library at runtime)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_METRICS_H
+#define OPENSHOT_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include "Json.h"
+
+namespace openshot {
+
+	/**
+	 * @brief A counter which any thread can increment (without a lock)
+	 */
+	class Counter {
+	private:
+		std::atomic<int64_t> value;
+
+	public:
+		/// Default constructor (starts at 0)
+		Counter() : value(0) {};
+
+		/// Copy constructor (copies the current value)
+		Counter(const Counter& other) : value(other.Value()) {};
+
+		/// Assignment operator (copies the current value)
+		Counter & operator=(const Counter& other) { value = other.Value(); return *this; };
+
+		/// Add to the counter
+		void Increment(int64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); };
+
+		/// Get the current value
+		int64_t Value() const { return value.load(std::memory_order_relaxed); };
+
+		/// Set the counter back to 0
+		void Reset() { value = 0; };
+	};
+
+	/**
+	 * @brief A histogram of measurements (such as milliseconds), with their count, mean, minimum, maximum, and buckets
+	 *
+	 * The buckets double in size (0-1, 1-2, 2-4, 4-8, ... and more than 2^14), so they cover both fast and very slow measurements.
+	 */
+	class Histogram {
+	private:
+		std::mutex histogram_mutex;
+		int64_t count;
+		double sum;
+		double minimum;
+		double maximum;
+		int64_t buckets[16];
+
+	public:
+		/// Default constructor (with no measurements)
+		Histogram() { Reset(); };
+
+		/// Add a measurement
+		void Observe(double value);
+
+		/// Get the number of measurements
+		int64_t Count();
+
+		/// Get the mean of the measurements (or 0, without any measurements)
+		double Mean();
+
+		/// Remove all measurements
+		void Reset();
+
+		/// Get the count, sum, mean, minimum, maximum, and buckets as JSON
+		Json::Value JsonValue();
+	};
+
+	/**
+	 * @brief Adds the milliseconds from its construction to its destruction to a openshot::Histogram
+	 */
+	class ScopedTimer {
+	private:
+		Histogram &histogram;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		/// Start timing
+		ScopedTimer(Histogram &histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {};
+
+		/// Add the elapsed milliseconds to the histogram
+		~ScopedTimer() { histogram.Observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()); };
+	};
+
+	/**
+	 * @brief The current and peak number of bytes held by a subsystem (which any thread can update, without a lock)
+	 */
+	class MemoryGauge {
+	private:
+		std::atomic<int64_t> current;
+		std::atomic<int64_t> peak;
+
+	public:
+		/// Default constructor (starts at 0 bytes)
+		MemoryGauge() : current(0), peak(0) {};
+
+		/// Copy constructor (copies the current and peak bytes)
+		MemoryGauge(const MemoryGauge& other) : current(other.Current()), peak(other.Peak()) {};
+
+		/// Assignment operator (copies the current and peak bytes)
+		MemoryGauge & operator=(const MemoryGauge& other) { current = other.Current(); peak = other.Peak(); return *this; };
+
+		/// Add bytes (or remove them, with a negative number), and raise the peak
+		void Add(int64_t bytes);
+
+		/// Get the bytes held now
+		int64_t Current() const { return current.load(std::memory_order_relaxed); };
+
+		/// Get the most bytes held at once (since the last ResetPeak())
+		int64_t Peak() const { return peak.load(std::memory_order_relaxed); };
+
+		/// Lower the peak to the bytes held now
+		void ResetPeak() { peak = Current(); };
+	};
+
+	/**
+	 * @brief Charges the images created by this thread (with the openshot::ImageBufferPool) to a openshot::MemoryGauge, while it exists
+	 *
+	 * The bytes of each image are removed from the same gauge when the image is freed, even if another
+	 * subsystem frees it (i.e. a cache, which holds frames decoded by a reader).
+	 *
+	 * @code
+	 * static openshot::MemoryGauge& effect_memory = openshot::Metrics::Instance()->GetMemory("images.effects");
+	 * openshot::ScopedMemoryTag memory_tag(effect_memory);
+	 * @endcode
+	 */
+	class ScopedMemoryTag {
+	private:
+		MemoryGauge *previous;
+
+	public:
+		/// Charge the images of this thread to a gauge
+		ScopedMemoryTag(MemoryGauge &gauge);
+
+		/// Charge the images of this thread to the previous gauge again
+		~ScopedMemoryTag();
+
+		/// Get the gauge the images of this thread are charged to (or NULL, outside of any tag)
+		static MemoryGauge *Current();
+	};
+
+	/**
+	 * @brief This class is a process-wide registry of named counters, gauges, and histograms
+	 *
+	 * Counters and histograms live as long as the process, so hot code can look them up once, and keep a
+	 * reference (which costs a single atomic increment per event). Counters are reported with their rate
+	 * per second since the last Reset() (such as decoded or encoded frames per second). Caches and readers
+	 * keep their own counters, which Timeline::Metrics() reports along with this registry.
+	 *
+	 * The memory gauges track the bytes held by each subsystem: the frames in each kind of cache ("cache.*"),
+	 * the frames spooled by writers ("writer.spool"), and the pooled images, by the subsystem which created
+	 * them ("images.*", see openshot::ScopedMemoryTag).
+	 *
+	 * @code
+	 * static openshot::Counter& decoded_frames = openshot::Metrics::Instance()->GetCounter("decoder.frames");
+	 * decoded_frames.Increment();
+	 * @endcode
+	 */
+	class Metrics {
+	private:
+		std::mutex metrics_mutex;
+		std::map<std::string, Counter> counters;
+		std::map<std::string, double> gauges;
+		std::map<std::string, Histogram> histograms;
+		std::map<std::string, MemoryGauge> memory;
+		std::chrono::steady_clock::time_point reset_time;
+
+		/// Constructor (private, because this is a singleton)
+		Metrics() : reset_time(std::chrono::steady_clock::now()) {};
+
+		/// Don't allow the user to copy or assign this instance
+		Metrics(Metrics const&) = delete;
+		Metrics & operator=(Metrics const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static Metrics * m_pInstance;
+
+	public:
+		/// Create or get an instance of this metrics registry singleton (invoke the class with this method)
+		static Metrics * Instance();
+
+		/// Get (or create) a counter (the reference stays valid)
+		Counter & GetCounter(std::string name);
+
+		/// Get (or create) a histogram (the reference stays valid)
+		Histogram & GetHistogram(std::string name);
+
+		/// Set the current value of a gauge (such as a queue depth)
+		void SetGauge(std::string name, double value);
+
+		/// Get (or create) the memory gauge of a subsystem (the reference stays valid)
+		MemoryGauge & GetMemory(std::string name);
+
+		/// Get the current and peak bytes of each subsystem as JSON
+		Json::Value MemoryValue();
+
+		/// Reset all counters, gauges, and histograms (and lower the memory peaks to the current bytes)
+		void Reset();
+
+		/// Get all metrics as a JSON string
+		std::string Json();
+
+		/// Get all metrics as a JSON value
+		Json::Value JsonValue();
+
+		/// Send all metrics to the subscribers of the openshot::ZmqLogger (if logging is enabled)
+		void Publish();
+	};
+
+}
+
+#endif
@@ -37,9 +37,14 @@
 
 #include "Settings.h"
 
-// Calculate the # of OpenMP Threads to allow
-#define OPEN_MP_NUM_PROCESSORS (std::min(omp_get_num_procs(), std::max(2, openshot::Settings::Instance()->OMP_THREADS) ))
-#define FF_NUM_PROCESSORS (std::min(omp_get_num_procs(), std::max(2, openshot::Settings::Instance()->FF_THREADS) ))
+// Calculate the # of OpenMP Threads to allow (a fixed number, and a single FFmpeg thread, when rendering deterministically)
+#define OPEN_MP_NUM_PROCESSORS (openshot::Settings::Instance()->DETERMINISTIC_RENDER ? std::max(2, openshot::Settings::Instance()->OMP_THREADS) : \
+								std::min(omp_get_num_procs(), std::max(2, openshot::Settings::Instance()->OMP_THREADS) ))
+#define FF_NUM_PROCESSORS (openshot::Settings::Instance()->DETERMINISTIC_RENDER ? 1 : \
+						   std::min(omp_get_num_procs(), std::max(2, openshot::Settings::Instance()->FF_THREADS) ))
+#define FF_ENCODE_NUM_PROCESSORS (openshot::Settings::Instance()->DETERMINISTIC_RENDER ? 1 : \
+								  openshot::Settings::Instance()->ENCODE_THREADS > 0 ? \
+								  std::min(omp_get_num_procs(), openshot::Settings::Instance()->ENCODE_THREADS) : FF_NUM_PROCESSORS)
 
 
 #endif
@@ -99,15 +99,20 @@
 #include "OpenShotVersion.h"
 
 // Include all other classes
+#include "AudioAnalyzer.h"
 #include "AudioBufferSource.h"
 #include "AudioReaderSource.h"
+#include "AudioRingBuffer.h"
 #include "AudioResampler.h"
+#include "CacheBudget.h"
 #include "CacheDisk.h"
 #include "CacheMemory.h"
+#include "CacheTiered.h"
 #include "ChunkReader.h"
 #include "ChunkWriter.h"
 #include "Clip.h"
 #include "ClipBase.h"
+#include "ColorLUT.h"
 #include "Coordinate.h"
 #ifdef USE_BLACKMAGIC
 	#include "DecklinkReader.h"
@@ -121,24 +126,52 @@
 #include "Exceptions.h"
 #include "ReaderBase.h"
 #include "WriterBase.h"
+#include "FFmpegDecoderPool.h"
+#include "FFmpegIO.h"
 #include "FFmpegReader.h"
+#include "FFmpegScaler.h"
 #include "FFmpegWriter.h"
 #include "Fraction.h"
 #include "Frame.h"
 #include "FrameMapper.h"
+#include "ImageSequenceReader.h"
+#include "ImageSequenceWriter.h"
 #ifdef USE_IMAGEMAGICK
 	#include "ImageReader.h"
 	#include "ImageWriter.h"
 	#include "TextReader.h"
 #endif
 #include "KeyFrame.h"
+#include "Metrics.h"
 #include "PlayerBase.h"
 #include "Point.h"
 #include "Profiles.h"
 #include "QtHtmlReader.h"
 #include "QtImageReader.h"
 #include "QtTextReader.h"
+#include "RawPipeWriter.h"
+#include "RawVideoReader.h"
+#include "RenditionWriter.h"
 #include "Timeline.h"
+#include "ParallelExporter.h"
+#include "StreamExporter.h"
+#include "DistributedRender.h"
+#include "FrameServer.h"
+#include "ProxyManager.h"
 #include "Settings.h"
+#include "SharedReader.h"
+#include "RenderGraph.h"
+#include "TaskPool.h"
+#include "ThreadTuner.h"
+#include "ThumbnailGenerator.h"
+#include "Trace.h"
+#include "ImageBufferPool.h"
+#include "PixelLayout.h"
+#include "PixelKernels.h"
+#include "GpuCompositor.h"
+#include "PlaneCompositor.h"
+#include "AudioKernels.h"
+#include "FieldKernels.h"
+#include "InterpolationKernels.h"
 
 #endif
@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @brief Header file for ParallelExporter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_PARALLEL_EXPORTER_H
+#define OPENSHOT_PARALLEL_EXPORTER_H
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Exceptions.h"
+#include "FFmpegWriter.h"
+#include "Json.h"
+#include "TaskPool.h"
+#include "Timeline.h"
+
+
+namespace openshot
+{
+	/**
+	 * @brief This class exports a range of a timeline as independent segments (which can be rendered in
+	 * parallel, on this machine or on other machines), and stitches the segments into a single file without
+	 * re-encoding them.
+	 *
+	 * The frame range is split into segments of (nearly) equal length. Each segment is rendered by its own
+	 * openshot::Timeline (loaded from the timeline's JSON, so it has its own clips and readers) and its own
+	 * openshot::FFmpegWriter, into a segment file next to the output file. Every segment starts a new
+	 * encoder, so its first frame is a keyframe and none of its frames reference another segment (a closed GOP).
+	 * The segments only have video: the audio of the whole range is encoded once by ExportAudio() (in parallel with
+	 * the segments), since the last frame of an audio encoder is padded with silence, which would be heard at each
+	 * joint. Concatenate() then copies the compressed packets of the segments (in order) into the output file,
+	 * offsetting their timestamps by the start time of each segment, and interleaves the packets of the audio.
+	 *
+	 * To render segments on other machines, send the Json() of the exporter to each machine, call SetJson()
+	 * and ExportSegment() with the segment index there, and call ExportAudio() and Concatenate() once all segment
+	 * files have been copied back (the file paths of each media file on the timeline must be valid on each machine).
+	 *
+	 * @code
+	 * // Export a timeline as 8 segments (rendered in parallel), and stitch them into a single file
+	 * ParallelExporter e(&t, "video.mp4");
+	 * e.SetAudioOptions(true, "aac", 44100, 2, openshot::LAYOUT_STEREO, 128000);
+	 * e.SetVideoOptions(true, "libx264", openshot::Fraction(30,1), 1280, 720, openshot::Fraction(1,1), false, false, 3000000);
+	 * e.SetOption(openshot::VIDEO_STREAM, "crf", "23");
+	 * e.SetSegmentCount(8);
+	 * e.Export();
+	 * @endcode
+	 */
+	class ParallelExporter
+	{
+	private:
+		std::string path;
+		Json::Value timeline_root;    ///< The JSON of the timeline (each segment loads its own copy)
+		WriterInfo info;    ///< The audio and video options of each segment's writer
+		std::vector<std::pair<openshot::StreamType, std::pair<std::string, std::string> > > options;    ///< Custom codec options (see SetOption)
+		int64_t range_start;    ///< The first frame number to export
+		int64_t range_end;    ///< The last frame number to export
+		int segment_count;
+
+		/// Init the writer options (no audio or video)
+		void init_options();
+
+		/// Render with a copy of the timeline (loaded from its JSON, with its own clips and readers)
+		void render_copy(std::function<void(openshot::Timeline&)> render);
+
+	public:
+
+		/// Constructor for ParallelExporter, which is loaded from the JSON of another exporter (i.e. on a render node)
+		ParallelExporter();
+
+		/// @brief Constructor for ParallelExporter, which exports all frames of a timeline
+		/// @param timeline The openshot::Timeline to export (only its JSON is used, so it is not modified)
+		/// @param path The file path of the exported video file
+		ParallelExporter(openshot::Timeline* timeline, std::string path);
+
+		/// Render all segments and the audio in parallel (each on its own thread), and concatenate them
+		void Export();
+
+		/// @brief Render the video of a single segment (i.e. on a render node), into the file of GetSegmentPath()
+		/// @param index The index of the segment (between 0 and GetSegmentCount() - 1)
+		void ExportSegment(int index);
+
+		/// Render the audio of the whole frame range, into the file of GetAudioPath()
+		void ExportAudio();
+
+		/// @brief Concatenate the rendered segments and audio into the output file (without re-encoding them)
+		/// @param remove_segments Delete the segment files once they have been concatenated
+		void Concatenate(bool remove_segments = true);
+
+		/// Get the number of segments
+		int GetSegmentCount() { return segment_count; };
+
+		/// Get the first frame number of a segment
+		int64_t GetSegmentStart(int index);
+
+		/// Get the last frame number of a segment
+		int64_t GetSegmentEnd(int index);
+
+		/// Get the file path of a segment (next to the output file, with the same extension)
+		std::string GetSegmentPath(int index);
+
+		/// Get the file path of the rendered audio (next to the output file, with the same extension)
+		std::string GetAudioPath();
+
+		/// @brief Set audio export options (see FFmpegWriter::SetAudioOptions)
+		void SetAudioOptions(bool has_audio, std::string codec, int sample_rate, int channels, openshot::ChannelLayout channel_layout, int bit_rate);
+
+		/// @brief Set the range of frames to export
+		/// @param start The first frame number to export
+		/// @param end The last frame number to export
+		void SetFrameRange(int64_t start, int64_t end);
+
+		/// @brief Set a custom codec option of each segment's writer (see FFmpegWriter::SetOption)
+		void SetOption(openshot::StreamType stream, std::string name, std::string value);
+
+		/// @brief Set the number of segments to split the frame range into
+		/// @param count The number of segments (at most one segment per frame)
+		void SetSegmentCount(int count);
+
+		/// @brief Set video export options (see FFmpegWriter::SetVideoOptions)
+		void SetVideoOptions(bool has_video, std::string codec, openshot::Fraction fps, int width, int height, openshot::Fraction pixel_ratio, bool interlaced, bool top_field_first, int bit_rate);
+
+		/// Get and Set JSON methods
+		std::string Json(); ///< Generate JSON string of this object
+		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
+		void SetJson(std::string value); ///< Load JSON string into this object
+		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
+	};
+
+}
+
+#endif
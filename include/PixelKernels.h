@@ -0,0 +1,156 @@
+/**
+ * @file
+ * @brief Header file for PixelKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_PIXEL_KERNELS_H
+#define OPENSHOT_PIXEL_KERNELS_H
+
+#include <cstdint>
+#include <string>
+#include "PixelLayout.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class holds the inner pixel loops of the per-pixel effects (Brightness, Saturation, Hue, Negate, ChromaKey, and SoftChromaKey),
+	 * of the timeline's scaling compositor (LerpRows, ResampleRow, and BlendOver), and of the DeckLink playout (RGBAToUYVY)
+	 *
+	 * Each kernel works on tightly packed RGBA8888 pixels (as the effects receive them), and has a scalar version
+	 * and vectorized versions (AVX2 or SSE4.1 on x86, NEON on 64-bit ARM). The vectorized version is picked at runtime,
+	 * based on the features of the CPU (and Settings::SIMD_EFFECTS), and gives the same results as the scalar loop
+	 * (except Saturation, which can differ by 1, since it is calculated in single precision). Negate is a simple
+	 * loop, which the compiler vectorizes. ResampleRow (which reads scattered pixels) only has a scalar version, and
+	 * RGBAToUYVY (which adds pairs of neighbouring pixels) has a single SSE4.1 version for AVX2 CPUs too.
+	 *
+	 * The compositor kernels are also templates of an openshot::PixelLayout (i.e. LerpRows<RGBA64Pixels>), which are
+	 * compiled for each format, and use the vectorized kernels for the byte formats with the alpha last.
+	 */
+	class PixelKernels {
+	public:
+		/// Get the name of the instruction set the kernels currently use ("avx2", "sse4.1", "neon", or "scalar")
+		static std::string InstructionSet();
+
+		/// @brief Adjust the contrast, and then the brightness of each pixel
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		/// @param brightness The brightness to add (-1 to 1)
+		/// @param contrast The contrast (0 keeps the contrast)
+		static void Brightness(unsigned char *pixels, int64_t pixel_count, float brightness, float contrast);
+
+		/// @brief Adjust the saturation of each pixel
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		/// @param saturation The saturation multiplier (0 is greyscale, 1 keeps the saturation)
+		static void Saturation(unsigned char *pixels, int64_t pixel_count, float saturation);
+
+		/// @brief Multiply each pixel by a color rotation matrix
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		/// @param matrix The 3x3 color matrix (rows are the red, green, and blue outputs)
+		static void Hue(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3]);
+
+		/// @brief Invert the color of each pixel (the alpha value is left alone)
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		static void Negate(unsigned char *pixels, int64_t pixel_count);
+
+		/// @brief Make each pixel transparent, if its color is within the threshold distance of the mask color
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		/// @param red The red value of the mask color (0 to 255)
+		/// @param green The green value of the mask color (0 to 255)
+		/// @param blue The blue value of the mask color (0 to 255)
+		/// @param threshold The maximum distance (see Color::GetDistance) of a matched color
+		static void ChromaKey(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int threshold);
+
+		/// @brief Scale the alpha of each pixel by its distance from the mask color, and remove the mask color's spill (in a single pass)
+		/// @param pixels The RGBA8888 pixels (modified in place)
+		/// @param pixel_count The number of pixels
+		/// @param red The red value of the mask color (0 to 255)
+		/// @param green The green value of the mask color (0 to 255)
+		/// @param blue The blue value of the mask color (0 to 255)
+		/// @param chroma_distance Measure the distance in the CbCr plane (instead of the weighted RGB distance of Color::GetDistance)
+		/// @param threshold The maximum distance of a fully transparent color
+		/// @param softness The width of the soft edge, above the threshold (0 is a hard edge)
+		/// @param spill The amount of the mask chroma to remove from each pixel (0 to 1)
+		static void SoftChromaKey(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, bool chroma_distance, float threshold, float softness, float spill);
+
+		/// @brief Interpolate between 2 rows of pixels, premultiplying their colors by their alpha (used to scale images vertically)
+		/// @param target The interpolated, premultiplied pixels
+		/// @param row0 The pixels of the first row (RGBA8888 or ARGB32, the alpha is the 4th byte)
+		/// @param row1 The pixels of the second row
+		/// @param pixel_count The number of pixels
+		/// @param weight The weight of the second row (0 to 256)
+		/// @param premultiplied Are the colors of the rows already premultiplied by their alpha
+		static void LerpRows(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied);
+
+		/// @brief Resample a row of pixels, by interpolating 2 neighbouring pixels of the row for each target pixel (used to scale images horizontally)
+		/// @param target The resampled pixels
+		/// @param row The pixels of the row (with one more pixel after the last pixel any index points to)
+		/// @param indexes The index of the left pixel of each target pixel
+		/// @param weights The weight of the right pixel of each target pixel (0 to 256)
+		/// @param pixel_count The number of target pixels
+		static void ResampleRow(unsigned char *target, const unsigned char *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count);
+
+		/// @brief Composite premultiplied pixels over opaque pixels (like QPainter::CompositionMode_SourceOver), fading them by an opacity
+		/// @param target The opaque pixels (modified in place)
+		/// @param source The premultiplied pixels to composite (in the same channel order)
+		/// @param pixel_count The number of pixels
+		/// @param opacity The opacity of the source pixels (0 to 256)
+		static void BlendOver(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity);
+
+		/// @brief Interpolate between 2 rows of pixels of any openshot::PixelLayout (see LerpRows above)
+		/// @param target The interpolated, premultiplied pixels (in the channel order of the format)
+		/// @param row0 The pixels of the first row (premultiplied, if the format is)
+		/// @param row1 The pixels of the second row
+		/// @param pixel_count The number of pixels
+		/// @param weight The weight of the second row (0 to 256)
+		template<class Format>
+		static void LerpRows(typename Format::Channel *target, const typename Format::Channel *row0, const typename Format::Channel *row1, int64_t pixel_count, int weight);
+
+		/// Resample a row of pixels of any openshot::PixelLayout (see ResampleRow above)
+		template<class Format>
+		static void ResampleRow(typename Format::Channel *target, const typename Format::Channel *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count);
+
+		/// Composite premultiplied pixels over opaque pixels of any openshot::PixelLayout (see BlendOver above)
+		template<class Format>
+		static void BlendOver(typename Format::Channel *target, const typename Format::Channel *source, int64_t pixel_count, int opacity);
+
+		/// @brief Convert a row of pixels to 8-bit 4:2:2 UYVY (studio range, as the DeckLink cards output it)
+		/// @param target The UYVY pixels (2 bytes per pixel, rounded up to an even number of pixels)
+		/// @param source The RGBA8888 pixels (or BGRA, i.e. ARGB32 on little endian), the alpha is ignored
+		/// @param pixel_count The number of pixels (the last pixel of an odd row is repeated)
+		/// @param bgra Are the red and blue channels swapped (the 3rd and 1st bytes)
+		/// @param bt709 Use the BT.709 colors of HD video (instead of the BT.601 colors of SD video)
+		static void RGBAToUYVY(unsigned char *target, const unsigned char *source, int64_t pixel_count, bool bgra, bool bt709);
+	};
+
+}
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file
+ * @brief Header file for the PixelLayout templates (the pixel layouts of image formats, for the pixel loops of effects and the compositor)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_PIXEL_LAYOUT_H
+#define OPENSHOT_PIXEL_LAYOUT_H
+
+#include <cstdint>
+#include <QImage>
+#include "Frame.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This template describes the layout of the pixels of an image format, so a pixel loop can be written
+	 * once, and compiled for each format it supports
+	 *
+	 * Each pixel is 4 channels of the Channel type, and the positions of the channels (and whether the colors are
+	 * premultiplied by the alpha) are constants, so the compiler can unroll and vectorize the loop of each format.
+	 * Values are in the range of the format (0 to max), and are scaled from and to 8 bits with FromByte() and ToByte().
+	 * A loop is usually a template function (or a functor with a template operator()), which is picked once per
+	 * image by openshot::DispatchPixelFormat.
+	 *
+	 * @code
+	 * struct HalveAlpha {
+	 *     QImage *image;
+	 *     template<class Format> void operator()(Format) {
+	 *         typename Format::Channel *pixels = Format::Pixels(*image);
+	 *         for (int64_t index = 0; index < (int64_t) image->width() * image->height() * 4; index += 4)
+	 *             Format::SetAlpha(pixels + index, pixels[index + Format::alpha] / 2);
+	 *     }
+	 * };
+	 * HalveAlpha halve = {&image};
+	 * openshot::DispatchPixelFormat(image.format(), halve);
+	 * @endcode
+	 */
+	template<typename ChannelType, int Red, int Green, int Blue, int Alpha, bool Premultiplied>
+	struct PixelLayout {
+		typedef ChannelType Channel; ///< The type of each channel (uint8_t or uint16_t)
+
+		enum {
+			red = Red, ///< The position of the red channel in a pixel
+			green = Green, ///< The position of the green channel in a pixel
+			blue = Blue, ///< The position of the blue channel in a pixel
+			alpha = Alpha, ///< The position of the alpha channel in a pixel
+			channels = 4, ///< The number of channels of a pixel
+			premultiplied = Premultiplied, ///< Are the colors premultiplied by the alpha
+			bits = 8 * sizeof(ChannelType), ///< The bits of each channel
+			max = (1 << (8 * sizeof(ChannelType))) - 1 ///< The largest value of a channel (255 or 65535)
+		};
+
+		/// Does the alpha come last, and are the channels bytes (the layout of the vectorized openshot::PixelKernels)
+		static bool IsByteRGBA() { return bits == 8 && alpha == 3; }
+
+		/// Get the pixels of an image (which must be in this format)
+		static Channel *Pixels(QImage &image) { return (Channel *) image.bits(); }
+		static const Channel *Pixels(const QImage &image) { return (const Channel *) image.constBits(); }
+
+		/// Get the number of channels (not bytes) of each line of an image
+		static int64_t LineStride(const QImage &image) { return image.bytesPerLine() / sizeof(Channel); }
+
+		/// Scale an 8 bit value (0 to 255) to the range of this format
+		static inline Channel FromByte(int value) { return (Channel) (value * (max / 255)); }
+
+		/// Scale a value of this format to 8 bits (rounded)
+		static inline int ToByte(int value) { return bits == 8 ? value : (value * 255 + max / 2) / max; }
+
+		/// Divide a product of 2 values of this format by the largest value (rounded)
+		static inline uint32_t DivMax(uint32_t value) {
+			value += (max + 1) / 2;
+			return (value + (value >> bits)) >> bits;
+		}
+
+		/// Set the (straight) color of a pixel, premultiplying it by the alpha of the pixel if needed
+		static inline void SetColor(Channel *pixel, int r, int g, int b) {
+			if (premultiplied) {
+				uint32_t a = pixel[alpha];
+				r = DivMax(r * a);
+				g = DivMax(g * a);
+				b = DivMax(b * a);
+			}
+			pixel[red] = r;
+			pixel[green] = g;
+			pixel[blue] = b;
+		}
+
+		/// @brief Set the alpha of a pixel (and scale its colors to the new alpha, if they are premultiplied)
+		///
+		/// The alpha of a premultiplied pixel can only be lowered (the colors of a higher alpha are lost).
+		static inline void SetAlpha(Channel *pixel, int a) {
+			if (premultiplied) {
+				int previous = pixel[alpha];
+				if (previous == 0)
+					a = 0;
+				else if (a < previous) {
+					pixel[red] = (uint32_t) pixel[red] * a / previous;
+					pixel[green] = (uint32_t) pixel[green] * a / previous;
+					pixel[blue] = (uint32_t) pixel[blue] * a / previous;
+				}
+				else
+					a = previous;
+			}
+			pixel[alpha] = a;
+		}
+	};
+
+	/// QImage::Format_RGBA8888 (the default image format of frames, and the format the effects receive)
+	typedef PixelLayout<uint8_t, 0, 1, 2, 3, false> RGBA8888Pixels;
+	/// QImage::Format_RGBA8888_Premultiplied
+	typedef PixelLayout<uint8_t, 0, 1, 2, 3, true> RGBA8888PremultipliedPixels;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	/// QImage::Format_ARGB32 (a 32 bit integer, which is stored as BGRA bytes on little endian CPUs)
+	typedef PixelLayout<uint8_t, 2, 1, 0, 3, false> ARGB32Pixels;
+	/// QImage::Format_ARGB32_Premultiplied (the image format of frames with Settings::PREMULTIPLIED_IMAGES)
+	typedef PixelLayout<uint8_t, 2, 1, 0, 3, true> ARGB32PremultipliedPixels;
+#else
+	typedef PixelLayout<uint8_t, 1, 2, 3, 0, false> ARGB32Pixels;
+	typedef PixelLayout<uint8_t, 1, 2, 3, 0, true> ARGB32PremultipliedPixels;
+#endif
+#ifdef USE_RGBA64_IMAGES
+	/// QImage::Format_RGBA64 (the image format of frames, with Settings::HIGH_BIT_DEPTH_IMAGES)
+	typedef PixelLayout<uint16_t, 0, 1, 2, 3, false> RGBA64Pixels;
+	/// QImage::Format_RGBA64_Premultiplied
+	typedef PixelLayout<uint16_t, 0, 1, 2, 3, true> RGBA64PremultipliedPixels;
+#endif
+
+	/// Is an image format supported by openshot::DispatchPixelFormat
+	inline bool IsPixelFormat(QImage::Format format) {
+		switch (format) {
+			case QImage::Format_RGBA8888:
+			case QImage::Format_RGBA8888_Premultiplied:
+			case QImage::Format_ARGB32:
+			case QImage::Format_ARGB32_Premultiplied:
+#ifdef USE_RGBA64_IMAGES
+			case QImage::Format_RGBA64:
+			case QImage::Format_RGBA64_Premultiplied:
+#endif
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	/// Get the format with the same layout as an image format, but with straight (not premultiplied) colors
+	inline QImage::Format StraightPixelFormat(QImage::Format format) {
+		switch (format) {
+			case QImage::Format_RGBA8888_Premultiplied:
+				return QImage::Format_RGBA8888;
+			case QImage::Format_ARGB32_Premultiplied:
+				return QImage::Format_ARGB32;
+#ifdef USE_RGBA64_IMAGES
+			case QImage::Format_RGBA64_Premultiplied:
+				return QImage::Format_RGBA64;
+#endif
+			default:
+				return format;
+		}
+	}
+
+	/// @brief Call a functor with the openshot::PixelLayout of an image format (as an empty argument, i.e. functor(RGBA8888Pixels()))
+	/// @returns False if the format is not supported (and the functor was not called)
+	/// @param format The image format
+	/// @param functor A functor with a template operator(), which takes the pixel format
+	template<class Functor>
+	bool DispatchPixelFormat(QImage::Format format, Functor &functor) {
+		switch (format) {
+			case QImage::Format_RGBA8888:
+				functor(RGBA8888Pixels());
+				return true;
+			case QImage::Format_RGBA8888_Premultiplied:
+				functor(RGBA8888PremultipliedPixels());
+				return true;
+			case QImage::Format_ARGB32:
+				functor(ARGB32Pixels());
+				return true;
+			case QImage::Format_ARGB32_Premultiplied:
+				functor(ARGB32PremultipliedPixels());
+				return true;
+#ifdef USE_RGBA64_IMAGES
+			case QImage::Format_RGBA64:
+				functor(RGBA64Pixels());
+				return true;
+			case QImage::Format_RGBA64_Premultiplied:
+				functor(RGBA64PremultipliedPixels());
+				return true;
+#endif
+			default:
+				return false;
+		}
+	}
+
+}
+
+#endif
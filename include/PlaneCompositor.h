@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Header file for PlaneCompositor class (compositing of planar YUV images, in their native planes)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_PLANE_COMPOSITOR_H
+#define OPENSHOT_PLANE_COMPOSITOR_H
+
+#include <cstdint>
+#include <memory>
+#include <QtCore/QRectF>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include "Frame.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class composites the native planes of decoded frames (8-bit planar YUV, with or without an alpha
+	 * plane), for a timeline which only moves, scales, and fades its layers (see Settings::YUV_COMPOSITING)
+	 *
+	 * Each plane is composited at its own size (so a 4:2:2 layer blends half as many chroma samples as a RGBA
+	 * layer blends pixels), with bilinear sampling, and the alpha plane (if any) sampled at the position of each
+	 * chroma sample. The composited planes have no alpha plane, and are encoded by an openshot::FFmpegWriter
+	 * without a conversion, when the output has the same pixel format.
+	 *
+	 * Colors (i.e. of the background) are converted with the BT.601 studio range coefficients, the same as the
+	 * default conversion of libswscale.
+	 */
+	class PlaneCompositor {
+	public:
+		/// Can planes of a pixel format (an FFmpeg AVPixelFormat) be composited
+		static bool IsSupported(int pixel_format);
+
+		/// Get the pixel format of a composite of planes of a supported pixel format (the same format, without alpha)
+		static int CompositeFormat(int pixel_format);
+
+		/// Create planes of a supported pixel format, filled with an opaque color
+		static std::shared_ptr<openshot::FramePlanes> CreatePlanes(int width, int height, int pixel_format, QColor color);
+
+		/// @brief Composite planes onto the planes of a composite (scaled and moved, and faded by alpha)
+		/// @param target The planes of the composite (of a pixel format returned by CompositeFormat())
+		/// @param source The planes to composite (of any supported pixel format)
+		/// @param source_rect The part of the source to composite (in the pixels of its luma plane)
+		/// @param x The position of the left of source_rect on the target (in the pixels of its luma plane)
+		/// @param y The position of the top of source_rect on the target
+		/// @param width_scale The horizontal scale of the source
+		/// @param height_scale The vertical scale of the source
+		/// @param alpha The opacity of the source (0.0 to 1.0)
+		/// @param bands The number of bands of rows composited in parallel
+		static void Composite(std::shared_ptr<openshot::FramePlanes> target, std::shared_ptr<openshot::FramePlanes> source,
+							  QRectF source_rect, float x, float y, float width_scale, float height_scale, float alpha, int bands);
+
+		/// Convert planes to an image of a format used by frames (see Frame::ImageFormat), stored in a pooled buffer
+		static std::shared_ptr<QImage> ToImage(std::shared_ptr<openshot::FramePlanes> planes, QImage::Format format);
+	};
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief Header file for ProxyManager class (low resolution proxies of video files)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_PROXY_MANAGER_H
+#define OPENSHOT_PROXY_MANAGER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace openshot {
+
+	/**
+	 * @brief This class generates (and finds) the low resolution proxies of video files, which previews read instead of the originals
+	 *
+	 * A proxy is an intra-only (MJPEG) copy of a video file, Settings::PROXY_HEIGHT pixels tall, with the
+	 * same frame rate and audio, saved in Settings::PROXY_PATH. Proxies are generated one at a time on a
+	 * background thread. While the preview is no taller than the proxies (see Timeline::SetMaxSize), an
+	 * FFmpegReader reads the frames of its proxy instead of the original (and queues the proxy, if it
+	 * doesn't exist yet). Exports render at their full size, so they always read the originals.
+	 *
+	 * @code
+	 * openshot::Settings::Instance()->PROXY_PATH = "/home/user/.openshot/proxy";
+	 * openshot::ProxyManager::Instance()->Generate("/home/user/Videos/4k.mp4");
+	 * openshot::ProxyManager::Instance()->Wait();
+	 * @endcode
+	 */
+	class ProxyManager {
+	private:
+		std::mutex queue_mutex;
+		std::condition_variable queue_condition;
+		std::condition_variable idle_condition;
+		std::deque<std::string> queue; ///< Media files waiting for their proxy
+		std::set<std::string> queued; ///< Media files which are queued (or being generated)
+		std::set<std::string> failed; ///< Media files whose proxy could not be generated (which are not tried again)
+		std::thread generator_thread; ///< Generates the queued proxies (started with the first one)
+		bool is_generating; ///< Is the generator thread working on a proxy
+
+		/// Constructor (private, because this is a singleton)
+		ProxyManager() : is_generating(false) {};
+
+		/// Don't allow the user to copy or assign this instance
+		ProxyManager(ProxyManager const&) = delete;
+		ProxyManager & operator=(ProxyManager const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static ProxyManager * m_pInstance;
+
+		/// Generate the queued proxies (on the generator thread)
+		void generator_loop();
+
+		/// Write the proxy of a media file (to a temporary file, which is renamed once it is complete)
+		void write_proxy(std::string path, std::string proxy_path);
+
+	public:
+		/// Create or get an instance of this proxy manager singleton (invoke the class with this method)
+		static ProxyManager * Instance();
+
+		/// @brief Get the file path of the proxy of a media file (an empty string if proxies are disabled)
+		/// @param path The media file path
+		static std::string ProxyPath(std::string path);
+
+		/// @brief Is there a complete proxy of a media file (which is newer than the file)
+		/// @param path The media file path
+		bool HasProxy(std::string path);
+
+		/// @brief Is the proxy of a media file queued (or being generated)
+		/// @param path The media file path
+		bool IsGenerating(std::string path);
+
+		/// @brief Queue the generation of a media file's proxy (unless it exists, is queued, or failed)
+		/// @param path The media file path
+		void Generate(std::string path);
+
+		/// Wait until all queued proxies are generated
+		void Wait();
+	};
+
+}
+
+#endif
@@ -32,6 +32,8 @@
 #ifndef OPENSHOT_AUDIO_PLAYBACK_THREAD_H
 #define OPENSHOT_AUDIO_PLAYBACK_THREAD_H
 
+#include <atomic>
+#include <mutex>
 #include "../ReaderBase.h"
 #include "../RendererBase.h"
 #include "../AudioReaderSource.h"
@@ -81,6 +83,46 @@ namespace openshot
 		void CloseAudioDevice();
 	};
 
+	/**
+	 * @brief An audio source which plays another source, and records which of its samples the audio device
+	 * is playing (the master clock of the player, see AudioPlaybackThread::getPlaybackPosition)
+	 *
+	 * Each block is recorded when the audio device asks for it, with the time of the request. The position
+	 * being heard is interpolated from that time, which is precise to a fraction of a frame (unlike the
+	 * position of the blocks, which only changes once per block).
+	 */
+	class AudioClockSource : public juce::AudioSource
+	{
+	private:
+		juce::PositionableAudioSource *source; /// The source to play
+		std::mutex clock_mutex; /// Guards the latest block (never waited for by the audio device)
+		int64_t block_end; /// The read position of the source after the latest block (or -1 before the first block)
+		int block_size; /// The number of samples of the latest block
+		double block_time; /// When the latest block was requested (see juce::Time::getMillisecondCounterHiRes)
+		double device_rate; /// The sample rate of the audio device
+
+	public:
+		std::atomic<int> latency; /// The output latency of the audio device (in samples)
+
+		/// Constructor of a clock of a source (which must outlive it)
+		AudioClockSource(juce::PositionableAudioSource *played_source);
+
+		/// Prepare to play the source (and forget the blocks played before)
+		void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
+
+		/// Release the resources of the source
+		void releaseResources();
+
+		/// Get the next block of the source (and record its position)
+		void getNextAudioBlock(const juce::AudioSourceChannelInfo& info);
+
+		/// Get the read position of the source being heard at this moment (or a negative number before the first block)
+		double getHeardPosition();
+
+		/// Get the sample rate of the audio device (the rate of the read positions of the source)
+		double getDeviceRate() const { return device_rate; }
+	};
+
     /**
      *  @brief The audio playback thread
      */
@@ -88,6 +130,7 @@ namespace openshot
     {
 		AudioSourcePlayer player;
 		AudioTransportSource transport;
+		AudioClockSource clock;
 		MixerAudioSource mixer;
 		AudioReaderSource *source;
 		double sampleRate;
@@ -112,6 +155,13 @@ namespace openshot
 		/// Get the current frame number being played
 		int64_t getCurrentFramePosition();
 
+		/// Get the frame position being heard at this moment (with sub-frame precision), from the samples played by
+		/// the audio device, or a negative number if no samples have been played yet
+		double getPlaybackPosition();
+
+		/// Get the number of audio blocks which ran out of samples (since the audio source was created)
+		int64_t getUnderruns() { return source ? source->getUnderruns() : 0; }
+
 		/// Play the audio
 		void Play();
 
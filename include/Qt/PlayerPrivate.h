@@ -32,6 +32,8 @@
 #ifndef OPENSHOT_PLAYER_PRIVATE_H
 #define OPENSHOT_PLAYER_PRIVATE_H
 
+#include <mutex>
+#include "../Json.h"
 #include "../ReaderBase.h"
 #include "../RendererBase.h"
 #include "../AudioReaderSource.h"
@@ -57,6 +59,22 @@ namespace openshot
 	int speed; /// The speed and direction to playback a reader (1=normal, 2=fast, 3=faster, -1=rewind, etc...)
 	openshot::RendererBase *renderer;
 	int64_t last_video_position; /// The last frame actually displayed
+	double average_render_time; /// The moving average of the milliseconds a frame takes to render
+	double lag_time; /// The milliseconds the video is behind schedule (when there is no audio clock to follow)
+	int slow_frames; /// The number of consecutive frames which rendered slower than they play
+	int fast_frames; /// The number of consecutive frames which rendered in less than half their time
+	int quality_level; /// How far the adaptive preview has lowered the quality (0 = full quality)
+	int original_max_width; /// The max width (of the timeline, or Settings::MAX_WIDTH) restored at full quality
+	int original_max_height; /// The max height (of the timeline, or Settings::MAX_HEIGHT) restored at full quality
+	bool show_stats; /// Draw the playback statistics over the video (see QtPlayer::ShowStats)
+	std::mutex stats_mutex; /// Guards the statistics (which are read by QtPlayer)
+	Json::Value stats; /// The latest playback statistics
+	int64_t dropped_frames; /// The frames skipped to keep up with the audio (or the wall clock)
+	double stats_render_time; /// The moving average of the milliseconds a frame takes to render (for the statistics)
+	int64_t stats_frames; /// The frames presented since the stage times were sampled
+	double stats_sample_time; /// When the stage times were sampled (see juce::Time::getMillisecondCounterHiRes)
+	int64_t stats_decode_time; /// The microseconds of the decode stages, when they were sampled
+	int64_t stats_composite_time; /// The microseconds of the effects and composite stages, when they were sampled
 
 	/// Constructor
 	PlayerPrivate(openshot::RendererBase *rb);
@@ -75,6 +93,22 @@ namespace openshot
 	/// Get the next frame (based on speed and direction)
 	std::shared_ptr<openshot::Frame> getFrame();
 
+	/// @brief Wait until the audio clock reaches the current frame (see AudioPlaybackThread::getPlaybackPosition)
+	/// @returns The position of the audio clock, or a negative number if the audio device has not played any samples
+	double waitForAudioClock(double frame_time);
+
+	/// Show or hide the playback statistics (which sums the time of the pipeline stages while they are shown)
+	void showStats(bool visible);
+
+	/// Update the playback statistics, after presenting a frame (and the overlay of the video thread, if they are shown)
+	void updateStats(int64_t render_time);
+
+	/// Lower or raise the preview quality, based on how long frames take to render (see Settings::ADAPTIVE_PREVIEW)
+	void adaptQuality(double frame_time, int64_t render_time);
+
+	/// Set the preview quality (0 = full, 1 = 75% resolution, 2 = 50% resolution, 3 = 50% resolution without effects)
+	void setQuality(int level);
+
 	/// The parent class of PlayerPrivate
 	friend class QtPlayer;
     };
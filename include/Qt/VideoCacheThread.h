@@ -31,6 +31,7 @@
 #ifndef OPENSHOT_VIDEO_CACHE_THREAD_H
 #define OPENSHOT_VIDEO_CACHE_THREAD_H
 
+#include <atomic>
 #include "../OpenMPUtilities.h"
 #include "../ReaderBase.h"
 #include "../RendererBase.h"
@@ -52,6 +53,12 @@ namespace openshot
 	int64_t current_display_frame;
 	ReaderBase *reader;
 	int max_frames;
+	int min_frames; ///< The fewest frames to prefetch (max_frames adapts to the render time)
+	double render_time; ///< The average time to render a prefetched frame (in milliseconds)
+	std::atomic<int64_t> seek_position; ///< The frame number of a seek (0 = none), which makes the prefetched frames stale
+
+	/// Adapt the number of frames to prefetch to the render time (within the memory budget of the reader's cache)
+	void update_max_frames(double frame_time);
 
 	/// Constructor
 	VideoCacheThread();
@@ -32,6 +32,9 @@
 #ifndef OPENSHOT_VIDEO_PLAYBACK_THREAD_H
 #define OPENSHOT_VIDEO_PLAYBACK_THREAD_H
 
+#include <mutex>
+#include <string>
+#include <vector>
 #include "../ReaderBase.h"
 #include "../RendererBase.h"
 
@@ -50,6 +53,11 @@ namespace openshot
 	WaitableEvent render;
 	WaitableEvent rendered;
 	bool reset;
+	std::mutex overlay_mutex; ///< Guards the overlay (set by the player thread)
+	std::vector<std::string> overlay; ///< The lines of text drawn over each frame (none, unless the statistics are shown)
+
+	/// Set the lines of text drawn over each frame (empty to draw none)
+	void setOverlay(const std::vector<std::string> &lines);
 
 	/// Constructor
 	VideoPlaybackThread(RendererBase *rb);
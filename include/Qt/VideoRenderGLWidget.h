@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief Header file for VideoRenderGLWidget class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_VIDEO_RENDERER_GL_WIDGET_H
+#define OPENSHOT_VIDEO_RENDERER_GL_WIDGET_H
+
+#include <QtWidgets/QOpenGLWidget>
+#include <QtGui/QOpenGLFunctions>
+#include <QtGui/QOpenGLBuffer>
+#include <QtGui/QOpenGLShaderProgram>
+#include <QtGui/QImage>
+#include "../Fraction.h"
+#include "VideoRenderer.h"
+
+/**
+ * @brief A video widget which uploads each frame as an OpenGL texture, and scales it on the GPU
+ *
+ * This is a drop-in replacement for VideoRenderWidget (with the same renderer and aspect ratio
+ * methods). Frames are copied into one of two pixel buffer objects, so the texture upload of one
+ * frame overlaps with the drawing of the previous one, and no scaling happens on the UI thread.
+ */
+class VideoRenderGLWidget : public QOpenGLWidget, protected QOpenGLFunctions
+{
+    Q_OBJECT
+
+private:
+    VideoRenderer *renderer;
+    QImage image;
+    openshot::Fraction aspect_ratio;
+    openshot::Fraction pixel_ratio;
+
+    QOpenGLShaderProgram program;
+    QOpenGLBuffer upload_buffers[2];
+    int upload_index;
+    bool use_upload_buffers;
+    GLuint texture;
+    QSize texture_size;
+    bool texture_ready;
+    bool texture_premultiplied;
+
+    /// Copy the current image into the texture (through a pixel buffer object, when supported)
+    void upload();
+
+public:
+    VideoRenderGLWidget(QWidget *parent = 0);
+    ~VideoRenderGLWidget();
+
+    VideoRenderer *GetRenderer() const;
+    void SetAspectRatio(openshot::Fraction new_aspect_ratio, openshot::Fraction new_pixel_ratio);
+
+protected:
+    void initializeGL();
+    void paintGL();
+
+    QRect centeredViewport(int width, int height);
+
+private slots:
+    void present(const QImage &image);
+
+};
+
+#endif // OPENSHOT_VIDEO_RENDERER_GL_WIDGET_H
@@ -40,7 +40,11 @@
 #include <iostream>
 #include <omp.h>
 #include <stdio.h>
+#include <functional>
+#include <future>
+#include <list>
 #include <memory>
+#include <mutex>
 #include "CacheMemory.h"
 #include "Enums.h"
 #include "Exceptions.h"
@@ -56,6 +60,9 @@ namespace openshot
 	 *
 	 * Supports HTML/CSS subset available via Qt libraries, see: https://doc.qt.io/qt-5/richtext-html-subset.html
 	 *
+	 * The HTML is rendered on a background thread (of the openshot::TaskPool), at the size the compositor draws it
+	 * at (i.e. smaller for a preview), and the images of the last few sizes are kept.
+	 *
 	 * @code
 	 * // Any application using this class must instantiate either QGuiApplication or QApplication
 	 * QApplication a(argc, argv);
@@ -92,9 +99,27 @@ namespace openshot
 		std::string html;
 		std::string css;
 		std::string background_color;
-		std::shared_ptr<QImage> image;
 		bool is_open;
 		openshot::GravityType gravity;
+
+		/// An image of the HTML rendered at a size (on a background thread, until it is ready)
+		struct HtmlRender {
+			int width;
+			int height;
+			std::shared_future<std::shared_ptr<QImage> > image;
+			std::function<void()> start; ///< Render the image on the calling thread (if no thread has started rendering it)
+		};
+
+		std::mutex render_mutex;
+		std::list<HtmlRender> renders; ///< The rendered images of each size (most recently used first)
+
+		/// Determine the size to render the HTML at (the size the compositor needs, based on the timeline's size,
+		/// the scaling mode, and the scaling keyframes, and never larger than the width and height)
+		void render_size(int &render_width, int &render_height);
+
+		/// Get the image rendered at a size (or start rendering it, on a background thread)
+		HtmlRender render(int render_width, int render_height);
+
 	public:
 
 		/// Default constructor (blank text)
@@ -111,6 +136,9 @@ namespace openshot
 		/// @param background_color The background color of the frame image (valid values are a color string in \#RRGGBB or \#AARRGGBB notation, a CSS color name, or 'transparent')
 		QtHtmlReader(int width, int height, int x_offset, int y_offset, GravityType gravity, std::string html, std::string css, std::string background_color);
 
+		/// Destructor (finishes the frame requests)
+		virtual ~QtHtmlReader();
+
 		/// Close Reader
 		void Close();
 
@@ -136,7 +164,8 @@ namespace openshot
 		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
 		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
 
-		/// Open Reader - which is called by the constructor automatically
+		/// Open Reader - which is called by the constructor automatically, and starts rendering the HTML (on a
+		/// background thread) at the size of the current render context
 		void Open();
 	};
 
@@ -34,6 +34,7 @@
 #include <cmath>
 #include <ctime>
 #include <iostream>
+#include <list>
 #include <omp.h>
 #include <stdio.h>
 #include <memory>
@@ -66,10 +67,18 @@ namespace openshot
 	{
 	private:
 		QString path;
+		/// An image scaled for a max size (as calculated with Clip properties)
+		struct ScaledImage {
+			QSize max_size;
+			std::shared_ptr<QImage> image;
+		};
+
 		std::shared_ptr<QImage> image;			///> Original image (full quality)
-		std::shared_ptr<QImage> cached_image;	///> Scaled for performance
+		std::list<ScaledImage> scaled_images;	///> Scaled for performance (most recently used first)
 		bool is_open;	///> Is Reader opened
-		QSize max_size;	///> Current max_size as calculated with Clip properties
+
+		/// Get the image scaled to a max size (reusing a scaled image of the same max size, or scaling down a larger one)
+		std::shared_ptr<QImage> get_scaled_image(int max_width, int max_height);
 
 	public:
 
@@ -104,6 +104,18 @@ namespace openshot
 	/// Stop the video player and clear the cached frames
 	void Stop();
 
+	/// @brief Show or hide the playback statistics over the video (render time, decode and composite time,
+	/// prefetched frames, dropped frames, and audio underruns)
+	///
+	/// The time of each stage is only measured while the statistics are shown.
+	void ShowStats(bool visible);
+
+	/// Are the playback statistics shown
+	bool StatsVisible();
+
+	/// Get the latest playback statistics as a JSON string (updated twice per second, while they are shown)
+	std::string Stats();
+
 	/// Set the current reader
 	void Reader(openshot::ReaderBase *new_reader);
 
@@ -97,10 +97,18 @@ namespace openshot
 		std::string text_color;
 		std::string background_color;
 		std::string text_background_color;
-		std::shared_ptr<QImage> image;
+		std::shared_ptr<QImage> image; ///< The rendered text (only the part of the frame with text, if is_placed)
+		QPoint image_offset; ///< The position of the image in the frame
+		bool is_placed; ///< The image is placed in the frame (see Frame::AddPlacedImage), since the background is transparent
 		bool is_open;
 		openshot::GravityType gravity;
 
+		/// Get a key of all properties of the rendered text (for the cache of rendered titles)
+		std::string title_key();
+
+		/// Render the text into a new image (only the bounding box of the text, if the background is transparent)
+		void render_title();
+
 	public:
 
 		/// Default constructor (blank text)
@@ -118,6 +126,9 @@ namespace openshot
 		/// @param background_color The background color of the frame image (valid values are a color string in \#RRGGBB or \#AARRGGBB notation, a CSS color name, or 'transparent')
 		QtTextReader(int width, int height, int x_offset, int y_offset, GravityType gravity, std::string text, QFont font, std::string text_color, std::string background_color);
 
+		/// Destructor (finishes the frame requests)
+		virtual ~QtTextReader();
+
 		/// Draw a box under rendered text using the specified color.
 		/// @param color The background color behind the text (valid values are a color string in \#RRGGBB or \#AARRGGBB notation or a CSS color name)
 		void SetTextBackgroundColor(std::string color);
@@ -0,0 +1,186 @@
+/**
+ * @file
+ * @brief Header file for RawPipeWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_RAW_PIPE_WRITER_H
+#define OPENSHOT_RAW_PIPE_WRITER_H
+
+#include "ReaderBase.h"
+#include "WriterBase.h"
+
+// Include FFmpeg headers and macros (used to convert RGBA images to YUV)
+#include "FFmpegUtilities.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+#include "Exceptions.h"
+#include "Frame.h"
+
+
+namespace openshot
+{
+	/// This enumeration designates the pixel layout of the raw video frames
+	enum RawVideoFormat {
+		RAW_VIDEO_RGBA,       ///< Packed 8 bit RGBA pixels (one plane)
+		RAW_VIDEO_YUV420P     ///< Planar 8 bit YUV 4:2:0 (a Y plane, followed by U and V planes of half the width and height)
+	};
+
+	/// @brief The header written before each frame, when frame headers are enabled (all fields are in host byte order)
+	struct RawFrameHeader
+	{
+		char magic[4];            ///< Always "OSRF"
+		int32_t format;           ///< The openshot::RawVideoFormat of the video frame
+		int64_t number;           ///< The frame number
+		int32_t width;            ///< The width of the video frame (in pixels, 0 if there is no video)
+		int32_t height;           ///< The height of the video frame (in pixels, 0 if there is no video)
+		int32_t video_size;       ///< The number of bytes of video (which follow this header)
+		int32_t sample_rate;      ///< The sample rate of the audio
+		int32_t channels;         ///< The number of audio channels
+		int32_t samples;          ///< The number of audio samples of each channel
+		int32_t audio_size;       ///< The number of bytes of audio (which follow the video)
+	};
+
+	/**
+	 * @brief This class writes uncompressed frames (planar YUV or RGBA images, and float audio) to a file descriptor,
+	 * named pipe, or file, so other processes (i.e. external encoders) can consume them without any decoding.
+	 *
+	 * The image, the decoded YUV planes of unchanged frames (see Frame::GetPlanes), and the audio samples are
+	 * written straight from the frame's memory with vectored writes (no intermediate copies). RGBA frames are only
+	 * converted when the frame images use another format (see Settings::PREMULTIPLIED_IMAGES), and YUV frames are only
+	 * converted (by libswscale, into a reusable buffer) when the frame has no matching YUV planes. Images which are not
+	 * the size of the writer are scaled.
+	 *
+	 * Video and audio can be written to separate pipes (i.e. for <tt>ffmpeg -f rawvideo</tt> and <tt>-f f32le</tt>
+	 * inputs, with interleaved audio), or to a single pipe, where each frame is preceded by an openshot::RawFrameHeader.
+	 * Planar audio is written as all samples of the first channel, followed by all samples of the next channel, etc...
+	 * Audio is written at the frame's sample rate (it is not resampled). The process should ignore SIGPIPE, so a
+	 * consumer which exits throws an exception instead of ending the process.
+	 *
+	 * @code
+	 * // Write YUV frames to stdout, and interleaved audio to a named pipe
+	 * int audio_fd = open("/tmp/audio.fifo", O_WRONLY);
+	 * RawPipeWriter w(STDOUT_FILENO, audio_fd);
+	 * w.SetVideoOptions(true, openshot::RAW_VIDEO_YUV420P, r.info.fps, 1920, 1080);
+	 * w.SetAudioOptions(true, r.info.sample_rate, 2, true);
+	 * w.Open();
+	 * w.WriteFrame(&r, 1, r.info.video_length);
+	 * w.Close();
+	 * @endcode
+	 */
+	class RawPipeWriter : public WriterBase
+	{
+	private:
+		std::string video_path;
+		std::string audio_path;
+		int video_fd;    ///< The descriptor video frames (and frame headers) are written to
+		int audio_fd;    ///< The descriptor audio is written to (which can be the video descriptor)
+		bool is_fd_owned;    ///< The descriptors were opened by this writer (from paths), and are closed by Close()
+		bool is_open;
+		bool frame_headers;
+		bool interleaved_audio;
+		openshot::RawVideoFormat video_format;
+
+		SwsContext *img_convert_ctx;    ///< Converts RGBA images to YUV (if a frame has no YUV planes)
+		int convert_width;
+		int convert_height;
+		std::vector<uint8_t> yuv_buffer;    ///< Reusable converted YUV frame
+		std::vector<float> audio_buffer;    ///< Reusable interleaved (or silent) audio samples
+
+		/// Write all buffers to a descriptor (retrying partial writes)
+		void write_buffers(int fd, std::vector<struct iovec> &buffers);
+
+		/// Add the rows of an image plane to a list of buffers (a single buffer if the rows are contiguous)
+		void add_plane(std::vector<struct iovec> &buffers, const uint8_t *data, int linesize, int row_size, int rows);
+
+	public:
+
+		/// @brief Constructor for RawPipeWriter, which opens files or named pipes (created with <tt>mkfifo</tt>)
+		/// @param video_path The path video frames (and frame headers) are written to
+		/// @param audio_path The path audio is written to (empty = the video path)
+		RawPipeWriter(std::string video_path, std::string audio_path = "");
+
+		/// @brief Constructor for RawPipeWriter, which writes to open file descriptors (i.e. pipes, sockets, or
+		/// shared memory files), which are not closed by this writer
+		/// @param video_fd The descriptor video frames (and frame headers) are written to
+		/// @param audio_fd The descriptor audio is written to (-1 = the video descriptor)
+		RawPipeWriter(int video_fd, int audio_fd);
+
+		/// Destructor
+		virtual ~RawPipeWriter();
+
+		/// Close the writer (and any descriptors it opened)
+		void Close();
+
+		/// Determine if writer is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Open the writer (and the files or named pipes, which blocks until a named pipe is opened by a consumer)
+		void Open();
+
+		/// @brief Set audio options
+		/// @param has_audio Write the audio of each frame
+		/// @param sample_rate The sample rate of the audio (which should match the frames)
+		/// @param channels The number of channels to write (missing channels are silent)
+		/// @param interleaved Interleave the samples of each channel (instead of planar audio)
+		void SetAudioOptions(bool has_audio, int sample_rate, int channels, bool interleaved);
+
+		/// @brief Write an openshot::RawFrameHeader before each frame (which is always done when audio and video share
+		/// a descriptor)
+		void SetFrameHeaders(bool enabled) { frame_headers = enabled; };
+
+		/// @brief Set video options
+		/// @param has_video Write the image of each frame
+		/// @param format The openshot::RawVideoFormat of the images
+		/// @param fps The frame rate of the frames
+		/// @param width The width of each image (images are scaled to this size)
+		/// @param height The height of each image (must be even for YUV frames)
+		void SetVideoOptions(bool has_video, openshot::RawVideoFormat format, openshot::Fraction fps, int width, int height);
+
+		/// @brief Write a frame to the pipes
+		/// @param frame The openshot::Frame object to write
+		void WriteFrame(std::shared_ptr<openshot::Frame> frame);
+
+		/// @brief Write a block of frames from a reader
+		/// @param reader The reader containing the frames you need
+		/// @param start The starting frame number to write
+		/// @param length The number of frames to write
+		void WriteFrame(openshot::ReaderBase* reader, int64_t start, int64_t length);
+
+	};
+
+}
+
+#endif
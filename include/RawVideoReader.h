@@ -0,0 +1,167 @@
+/**
+ * @file
+ * @brief Header file for RawVideoReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_RAW_VIDEO_READER_H
+#define OPENSHOT_RAW_VIDEO_READER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "CacheMemory.h"
+#include "Exceptions.h"
+#include "RawPipeWriter.h"
+#include "ReaderBase.h"
+
+namespace openshot
+{
+
+	/**
+	 * @brief This class reads uncompressed video files by mapping them into memory, so a frame is read without
+	 * demuxing or decoding (i.e. the intermediate files of a multi-pass render)
+	 *
+	 * Three kinds of files are read: YUV4MPEG2 (<tt>.y4m</tt>, 8 or 10 bit 4:2:0, 4:2:2, 4:4:4, or mono), the frames
+	 * of an openshot::RawPipeWriter with frame headers (images and audio), and headerless frames of a
+	 * openshot::RawVideoFormat (whose size and frame rate are given to the constructor). The file is indexed when it
+	 * is opened (one jump per frame), so any frame is read at once (random access costs the same as playback).
+	 *
+	 * The planes of each frame point into the mapped file (see Frame::GetPlanes), and are only converted to an
+	 * image when the image is first needed, so an openshot::FFmpegWriter which encodes the same pixel format
+	 * copies the planes straight from the page cache. RGBA frames (of the same format as Frame::ImageFormat) are
+	 * used as the frame's image without a copy (a write to the image copies it first). The mapping is kept until
+	 * the last frame which points into it is freed (even after the reader is closed), and the file must not be
+	 * truncated while it is mapped. Audio is copied into the frames (planar, unless SetInterleavedAudio is used).
+	 *
+	 * @code
+	 * // Read the frames of a YUV4MPEG2 file
+	 * RawVideoReader r("pass1.y4m");
+	 * r.Open();
+	 * std::shared_ptr<Frame> f = r.GetFrame(100);
+	 * r.Close();
+	 *
+	 * // Read headerless YUV 4:2:0 frames (i.e. written by a RawPipeWriter without frame headers)
+	 * RawVideoReader raw("pass1.yuv", RAW_VIDEO_YUV420P, Fraction(24, 1), 1920, 1080);
+	 * @endcode
+	 */
+	class RawVideoReader : public ReaderBase
+	{
+	private:
+		/// The position (and layout) of a frame in the mapped file
+		struct FrameEntry
+		{
+			int64_t video_offset;    ///< The offset of the first plane (or -1, if the frame has no image)
+			int64_t audio_offset;    ///< The offset of the audio samples (or -1, if the frame has no audio)
+			int width;
+			int height;
+			int pixel_format;    ///< The AVPixelFormat of the planes
+			int sample_rate;
+			int channels;
+			int samples;    ///< The number of samples of each channel
+		};
+
+		std::string path;
+		bool is_headerless;    ///< Are the frames headerless (of raw_format, raw_width, and raw_height)
+		openshot::RawVideoFormat raw_format;
+		int raw_width;
+		int raw_height;
+		bool interleaved_audio;
+		std::shared_ptr<void> mapping;    ///< The mapped file (unmapped once no frame points into it)
+		const uint8_t *data;
+		int64_t data_size;
+		std::vector<FrameEntry> frames;    ///< The frames of the file (in frame order)
+		CacheMemory final_cache;    ///< Recent frames (with the images converted from their planes)
+		bool is_open;
+
+		/// Index the frames of a YUV4MPEG2 file
+		void index_y4m();
+
+		/// Index the frames of a file of openshot::RawFrameHeader frames
+		void index_frame_headers();
+
+		/// Index the frames of a headerless file
+		void index_headerless();
+
+		/// Create a frame pointing into the mapped file
+		std::shared_ptr<openshot::Frame> read_frame(int64_t number);
+
+		/// Ask the kernel to read ahead the pages of a frame
+		void read_ahead(int64_t number);
+
+	public:
+
+		/// @brief Constructor for RawVideoReader (a YUV4MPEG2 file, or a file of openshot::RawFrameHeader frames)
+		/// @param path The path of the file
+		/// @param inspect_reader Open and close the file, to populate its attributes (false when the reader is
+		/// inflated from JSON)
+		RawVideoReader(std::string path, bool inspect_reader = true);
+
+		/// @brief Constructor for RawVideoReader (a file of headerless frames)
+		/// @param path The path of the file
+		/// @param format The openshot::RawVideoFormat of the frames
+		/// @param fps The frame rate of the frames
+		/// @param width The width of each frame
+		/// @param height The height of each frame
+		RawVideoReader(std::string path, openshot::RawVideoFormat format, openshot::Fraction fps, int width, int height);
+
+		virtual ~RawVideoReader();
+
+		/// Close File (the frames which point into the mapped file keep it mapped)
+		void Close();
+
+		/// Get the cache object used by this reader
+		CacheMemory* GetCache() { return &final_cache; };
+
+		/// Get an openshot::Frame object for a specific frame number of this reader (pointing into the mapped file).
+		///
+		/// @returns The requested frame
+		/// @param requested_frame The frame number that is requested.
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame);
+
+		/// Determine if reader is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Return the type name of the class
+		std::string Name() { return "RawVideoReader"; };
+
+		/// Read the audio of openshot::RawFrameHeader frames as interleaved samples (set before opening the reader)
+		void SetInterleavedAudio(bool interleaved) { interleaved_audio = interleaved; };
+
+		/// Get and Set JSON methods
+		std::string Json(); ///< Generate JSON string of this object
+		void SetJson(std::string value); ///< Load JSON string into this object
+		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
+		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
+
+		/// Open File (maps and indexes the file)
+		void Open();
+	};
+
+}
+
+#endif
@@ -31,17 +31,25 @@
 #ifndef OPENSHOT_READER_BASE_H
 #define OPENSHOT_READER_BASE_H
 
+#include <atomic>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <cstdlib>
 #include <sstream>
+#include <vector>
 #include "CacheMemory.h"
 #include "ChannelLayouts.h"
 #include "ClipBase.h"
+#include "Enums.h"
 #include "Fraction.h"
 #include "Frame.h"
 #include "Json.h"
+#include "Metrics.h"
+#include "TaskPool.h"
 #include "ZmqLogger.h"
 #include <QtCore/qstring.h>
 #include <QGraphicsItem>
@@ -87,6 +95,47 @@ namespace openshot
 		std::map<std::string, std::string> metadata;	///< An optional map/dictionary of metadata for this reader
 	};
 
+	/**
+	 * @brief A frame requested asynchronously from a reader (see ReaderBase::RequestFrame)
+	 *
+	 * A request which is cancelled before it starts rendering is skipped, and its result is a NULL frame. A request
+	 * which has already started rendering can't be interrupted.
+	 */
+	class FrameRequest
+	{
+	private:
+		std::promise<std::shared_ptr<openshot::Frame> > promise;
+		std::shared_future<std::shared_ptr<openshot::Frame> > result;
+		std::atomic<bool> cancelled;
+		openshot::FrameStatus status; ///< The status of the rendered request (set before its result)
+
+		friend class ReaderBase;
+
+	public:
+		int64_t frame_number; ///< The requested frame number
+		openshot::FrameRequestPriority priority; ///< The priority of the request
+
+		/// Constructor
+		FrameRequest(int64_t frame_number, openshot::FrameRequestPriority priority);
+
+		/// Cancel the request (if it has not started rendering)
+		void Cancel() { cancelled = true; };
+
+		/// Has the request been cancelled
+		bool IsCancelled() { return cancelled; };
+
+		/// Get the future result of the request (the requested frame, or a NULL frame if cancelled)
+		std::shared_future<std::shared_ptr<openshot::Frame> > Result() { return result; };
+
+		/// Wait for the requested frame (and re-throw the exception of the reader, if any)
+		std::shared_ptr<openshot::Frame> Wait();
+
+		/// @brief Wait for the requested frame, without exceptions (for playback loops, which skip a missing frame)
+		/// @returns The status of the request (the frame is only set with FRAME_OK)
+		/// @param[out] frame The requested frame
+		openshot::FrameStatus TryWait(std::shared_ptr<openshot::Frame>& frame);
+	};
+
 	/**
 	 * @brief This abstract class is the base class, used by all readers in libopenshot.
 	 *
@@ -101,6 +150,25 @@ namespace openshot
 	  juce::CriticalSection getFrameCriticalSection;
 	  juce::CriticalSection processingCriticalSection;
 		openshot::ClipBase* parent;
+		openshot::Counter seek_counter; ///< Seeks in the media file
+		openshot::Counter seek_retry_counter; ///< Seeks which landed too far, and had to seek again (further back)
+
+		/// @brief Cancel the waiting frame requests, and wait for the request which is being rendered. A derived reader
+		/// calls this first in its destructor, before anything its GetFrame uses is released.
+		void FinishFrameRequests();
+
+	private:
+		std::mutex requests_mutex;
+		std::deque<std::shared_ptr<openshot::FrameRequest> > requests; ///< The frame requests waiting to be rendered
+		bool requests_running; ///< A task is rendering the waiting frame requests
+		std::atomic<int> visible_requests; ///< The number of waiting frame requests of REQUEST_VISIBLE priority
+		openshot::TaskGroup request_tasks; ///< The task rendering the waiting frame requests (destroyed first)
+
+		/// Render the waiting frame requests, one at a time (the highest priority, and then the oldest, first)
+		void run_frame_requests();
+
+		/// Get a frame, and catch the exceptions of a closed reader, an invalid frame, or a failed seek (see TryGetFrame)
+		openshot::FrameStatus try_get_frame(int64_t number, std::shared_ptr<openshot::Frame>& frame, int width, int height, bool audio_only);
 
 	public:
 
@@ -133,6 +201,74 @@ namespace openshot
 		/// @param[in] number The frame number that is requested.
 		virtual std::shared_ptr<openshot::Frame> GetFrame(int64_t number) = 0;
 
+		/// Get a frame, with its image scaled (while decoding) to the size it will be drawn at. Readers
+		/// which can't scale while decoding return the full size frame, and a cached frame can be larger.
+		///
+		/// @returns The requested frame of video
+		/// @param[in] number The frame number that is requested.
+		/// @param[in] width The width the image will be drawn at (0 = full size)
+		/// @param[in] height The height the image will be drawn at (0 = full size)
+		virtual std::shared_ptr<openshot::Frame> GetFrame(int64_t number, int width, int height);
+
+		/// @brief Get a frame without exceptions, for the loops which skip a missing frame (i.e. near the end of the
+		/// stream, while seeking, or while the reader closes). A closed reader is checked without throwing at all, and
+		/// the exceptions of a missing frame are returned as a status. Other errors are still thrown.
+		///
+		/// @returns The status (the frame is only set with FRAME_OK)
+		/// @param[in] number The frame number that is requested.
+		/// @param[out] frame The requested frame
+		/// @param[in] width The width the image will be drawn at (0 = full size)
+		/// @param[in] height The height the image will be drawn at (0 = full size)
+		openshot::FrameStatus TryGetFrame(int64_t number, std::shared_ptr<openshot::Frame>& frame, int width = 0, int height = 0);
+
+		/// @brief Get a frame for its audio only, without exceptions (see TryGetFrame and GetAudioFrame)
+		/// @returns The status (the frame is only set with FRAME_OK)
+		/// @param[in] number The frame number that is requested.
+		/// @param[out] frame The requested frame
+		openshot::FrameStatus TryGetAudioFrame(int64_t number, std::shared_ptr<openshot::Frame>& frame);
+
+		/// @brief Get a range of consecutive frames. Readers which can read a range faster than a frame at a time (i.e.
+		/// in a single pass of the stream, or in batches of frames) override this, the others call GetFrame().
+		///
+		/// @returns The frames (in order)
+		/// @param[in] start The first frame number
+		/// @param[in] count The number of frames
+		virtual std::vector<std::shared_ptr<openshot::Frame> > GetFrames(int64_t start, int64_t count);
+
+		/// Get a frame for its audio only (i.e. when exporting audio or playing audio). Readers which can skip
+		/// their video work (compositing, effects, etc...) override this, the others return the full frame.
+		///
+		/// @returns The requested frame (its image may be blank)
+		/// @param[in] number The frame number that is requested.
+		virtual std::shared_ptr<openshot::Frame> GetAudioFrame(int64_t number);
+
+		/// @brief Hint which streams the caller will use (i.e. a clip with its audio or video turned off). Readers
+		/// which can skip decoding a stream override this, the others ignore it. The frames of a disabled stream
+		/// may be silent or blank.
+		/// @param video Decode the video stream
+		/// @param audio Decode the audio stream
+		virtual void EnableStreams(bool video, bool audio) {};
+
+		/// @brief Request a frame asynchronously, which is rendered on the shared TaskPool (with GetFrame). The waiting
+		/// requests are rendered in order of priority, so a visible frame preempts the prefetched frames. All requests
+		/// must be finished (or cancelled) before the reader is closed, and the requests still waiting when the reader
+		/// is destroyed are cancelled (see FinishFrameRequests).
+		///
+		/// @returns The request (to wait for, or cancel)
+		/// @param[in] number The frame number that is requested.
+		/// @param[in] priority The priority of the request
+		std::shared_ptr<openshot::FrameRequest> RequestFrame(int64_t number, openshot::FrameRequestPriority priority);
+
+		/// @brief Cancel the waiting frame requests (i.e. the prefetched frames after a seek)
+		/// @param[in] max_priority Only cancel the requests up to this priority
+		void CancelFrameRequests(openshot::FrameRequestPriority max_priority = openshot::REQUEST_VISIBLE);
+
+		/// Are visible frame requests waiting (so a reader can skip work for the frames after the requested frame)
+		bool HasVisibleRequests() { return visible_requests > 0; };
+
+		/// Get the seeks of this reader, and the hits, misses, and evictions of its cache (as JSON)
+		virtual Json::Value MetricsValue();
+
 		/// Determine if reader is open or closed
 		virtual bool IsOpen() = 0;
 
@@ -0,0 +1,113 @@
+/**
+ * @file
+ * @brief Header file for RenderGraph class (the nodes of a batch of frames, run in dependency order)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_RENDER_GRAPH_H
+#define OPENSHOT_RENDER_GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "Enums.h"
+#include "Json.h"
+
+namespace openshot {
+
+	/**
+	 * @brief A directed acyclic graph of the work of rendering a batch of frames, which runs each node once all of
+	 * the nodes it depends on have finished (in parallel, on the openshot::TaskPool)
+	 *
+	 * Nodes with a key are only added once, so work needed by several nodes (i.e. the same clip frame, drawn on
+	 * two timeline frames) is shared. A node's result is kept by the caller (the work writes it), and read by the
+	 * nodes which depend on it. Dependencies must be added before Run(), and must not form a cycle.
+	 *
+	 * If a node throws an exception, the nodes which depend on it are not run, and Run() re-throws the first
+	 * exception once the other nodes finish. With Settings::DETERMINISTIC_RENDER, the nodes run on the calling thread.
+	 *
+	 * \code
+	 * RenderGraph graph;
+	 * bool added;
+	 * size_t decode = graph.AddNode(RENDER_NODE_DECODE, "clip 1, frame 5", [&]() { frame = clip.GetFrame(5); }, added);
+	 * size_t composite = graph.AddNode(RENDER_NODE_COMPOSITE, "", [&]() { Composite(frame); }, added);
+	 * graph.AddDependency(composite, decode);
+	 * graph.Run();
+	 * \endcode
+	 */
+	class RenderGraph {
+	private:
+		/// A single step of the render, and the nodes which wait for it
+		struct Node {
+			RenderNodeType type; ///< The kind of work
+			std::string key; ///< The key which identifies the same work (or empty, if it is never shared)
+			std::function<void()> work; ///< The work of this node
+			std::vector<size_t> dependents; ///< The nodes which depend on this node
+			int dependencies; ///< The number of nodes this node depends on
+		};
+
+		std::vector<Node> nodes; ///< All nodes (in the order they were added)
+		std::map<std::string, size_t> keyed_nodes; ///< The index of each node with a key
+		int64_t shared_nodes; ///< The number of times AddNode() returned an existing node
+		bool has_run; ///< Has Run() been called
+
+	public:
+		/// Default constructor
+		RenderGraph() : shared_nodes(0), has_run(false) {};
+
+		/// @brief Add a node (or get the node with the same key, without its work)
+		/// @returns The index of the node
+		/// @param type The kind of work
+		/// @param key The key which identifies the same work (empty nodes are always added)
+		/// @param work The work of the node
+		/// @param added Set to true if the node was added, or false if it already existed
+		size_t AddNode(RenderNodeType type, const std::string& key, std::function<void()> work, bool& added);
+
+		/// Make a node wait for another node (which must have been added before it)
+		void AddDependency(size_t node, size_t dependency);
+
+		/// Get the number of nodes (of any type)
+		size_t NumNodes() { return nodes.size(); };
+
+		/// Get the number of nodes of a type
+		size_t NumNodes(RenderNodeType type);
+
+		/// Get the number of times an existing node was returned by AddNode() (i.e. shared clip frames)
+		int64_t SharedNodes() { return shared_nodes; };
+
+		/// Run every node (in parallel, in dependency order), and wait for them to finish (can only be called once)
+		void Run();
+
+		/// Get a JSON value which describes the graph (the number of nodes of each type, and the shared nodes)
+		Json::Value JsonValue();
+	};
+
+}
+
+#endif
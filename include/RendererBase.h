@@ -34,6 +34,8 @@
 #include "Frame.h"
 #include <stdlib.h> // for realloc
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace openshot
 {
@@ -52,6 +54,9 @@ namespace openshot
 	/// Paint(render) a video Frame.
 	void paint(const std::shared_ptr<openshot::Frame> & frame);
 
+	/// Paint(render) a video Frame, with lines of text drawn over its top left corner (i.e. the playback statistics)
+	void paint(const std::shared_ptr<openshot::Frame> & frame, const std::vector<std::string> & overlay);
+
 	/// Allow manual override of the QWidget that is used to display
 	virtual void OverrideWidget(int64_t qwidget_address) = 0;
 
@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief Header file for RenditionWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_RENDITION_WRITER_H
+#define OPENSHOT_RENDITION_WRITER_H
+
+#include "ReaderBase.h"
+#include "WriterBase.h"
+
+#include <memory>
+#include <vector>
+#include "Exceptions.h"
+#include "Frame.h"
+#include "TaskPool.h"
+
+
+namespace openshot
+{
+	/**
+	 * @brief This class writes each frame to several writers at once (i.e. the renditions of an adaptive
+	 * bitrate ladder), without each writer scaling the images from full size.
+	 *
+	 * Renditions are sorted from the largest video size to the smallest. Each frame's image is scaled
+	 * once per rendition size, from the image of the next larger rendition (a cascade), so every writer
+	 * receives images which already match its size. The renditions then encode the frame in parallel
+	 * (on the shared openshot::TaskPool).
+	 *
+	 * @code
+	 * // Create a writer for each rendition
+	 * FFmpegWriter w1("video-720p.webm");
+	 * w1.SetVideoOptions(true, "libvpx", openshot::Fraction(30,1), 1280, 720, openshot::Fraction(1,1), false, false, 3000000);
+	 * FFmpegWriter w2("video-360p.webm");
+	 * w2.SetVideoOptions(true, "libvpx", openshot::Fraction(30,1), 640, 360, openshot::Fraction(1,1), false, false, 1000000);
+	 *
+	 * // Add the renditions (the RenditionWriter does not own them)
+	 * RenditionWriter w;
+	 * w.AddRendition(&w1);
+	 * w.AddRendition(&w2);
+	 *
+	 * // Open the writers, write all frames from a reader, and close the writers
+	 * w.Open();
+	 * w.WriteFrame(&r, 1, r.info.video_length);
+	 * w.Close();
+	 * @endcode
+	 */
+	class RenditionWriter : public WriterBase
+	{
+	private:
+		std::vector<openshot::WriterBase*> renditions; ///< The writers of each rendition (largest video size first)
+		bool is_open;
+
+	public:
+
+		/// Default constructor
+		RenditionWriter();
+
+		/// @brief Add a rendition (which must be closed, and have its options set)
+		/// @param writer The writer of this rendition (which is not deleted by this class)
+		void AddRendition(openshot::WriterBase* writer);
+
+		/// Remove all renditions (without closing them)
+		void ClearRenditions();
+
+		/// Close the writer (and the writers of all renditions)
+		void Close();
+
+		/// Get the number of renditions
+		int GetRenditionCount() { return renditions.size(); };
+
+		/// Determine if writer is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Open the writer (and the writers of all renditions)
+		void Open();
+
+		/// @brief Write a frame to every rendition
+		/// @param frame The openshot::Frame object to write
+		void WriteFrame(std::shared_ptr<openshot::Frame> frame);
+
+		/// @brief Write a block of frames from a reader
+		/// @param reader The reader containing the frames you need
+		/// @param start The starting frame number to write
+		/// @param length The number of frames to write
+		void WriteFrame(openshot::ReaderBase* reader, int64_t start, int64_t length);
+
+	};
+
+}
+
+#endif
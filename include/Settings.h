@@ -94,21 +94,172 @@ namespace openshot {
 		/// Scale mode used in FFmpeg decoding and encoding (used as an optimization for faster previews)
 		bool HIGH_QUALITY_SCALING = false;
 
-		/// Maximum width for image data (useful for optimzing for a smaller preview or render)
+		/// Maximum width for image data (useful for optimzing for a smaller preview or render). Readers rendered
+		/// by a timeline use the size of that timeline instead (see Timeline::SetMaxSize).
 		int MAX_WIDTH = 0;
 
-		/// Maximum height for image data (useful for optimzing for a smaller preview or render)
+		/// Maximum height for image data (useful for optimzing for a smaller preview or render). Readers rendered
+		/// by a timeline use the size of that timeline instead (see Timeline::SetMaxSize).
 		int MAX_HEIGHT = 0;
 
 		/// Wait for OpenMP task to finish before continuing (used to limit threads on slower systems)
 		bool WAIT_FOR_VIDEO_PROCESSING_TASK = false;
 
+		/// Composite each timeline frame in parallel horizontal bands (faster seeks and previews on large frames)
+		bool TILE_COMPOSITING = false;
+
+		/// Store frame images as premultiplied ARGB32, which QPainter composites fastest (effects and writers convert to RGBA at their boundary)
+		bool PREMULTIPLIED_IMAGES = false;
+
+		/// Skip decoding and compositing clips which are covered by an opaque, full frame clip on a higher layer
+		bool SKIP_OCCLUDED_LAYERS = true;
+
+		/// Adapt the number of timeline frames rendered per cache miss to the access pattern (sequential, reverse, or random)
+		bool ADAPTIVE_TIMELINE_BATCH = true;
+
+		/// Maximum number of timeline frames rendered per cache miss when frames are accessed in order (0 = 2x OpenMP threads)
+		int MAX_TIMELINE_BATCH = 0;
+
+		/// Maximum bytes of frames held by all memory caches combined, across every reader and timeline (0 = no limit)
+		int64_t CACHE_MEMORY_LIMIT = 0;
+
+		/// Share one image buffer between cached frames with identical images (i.e. a still image, or a freeze frame),
+		/// found by hashing the pixels of each cached frame (the default of new memory caches, see CacheMemory::SetDeduplicateImages)
+		bool CACHE_DEDUPLICATION = false;
+
+		/// Index the keyframes of each video file when it is first opened, so seeks land on the right keyframe in a single
+		/// attempt (off by default, since a file without a seek index in its container is scanned from start to end)
+		bool KEYFRAME_INDEX = false;
+
+		/// Save keyframe indexes which required a full scan of the file beside the media file (as <file>.keyframes)
+		bool PERSIST_KEYFRAME_INDEX = false;
+
+		/// Folder used to cache the properties of inspected media files, so reopening them is nearly instant (empty = disabled)
+		std::string PROBE_CACHE_PATH = "";
+
+		/// Folder of the low resolution proxies of video files, which previews read instead of the originals (empty = disabled, see ProxyManager)
+		std::string PROXY_PATH = "";
+
+		/// Height of the proxies, and the tallest preview (MAX_HEIGHT) which reads them
+		int PROXY_HEIGHT = 540;
+
+		/// Folder of the saved audio analyses of media files (peaks and loudness), so each file is only scanned once (empty = disabled, see AudioAnalyzer)
+		std::string AUDIO_ANALYSIS_PATH = "";
+
+		/// Length of the chunks (in seconds) of a media file, which AudioAnalyzer scans in parallel (each with its own reader)
+		int AUDIO_ANALYSIS_CHUNK = 60;
+
+		/// Number of closed decoders kept open, so reopening the same media file skips probing and codec setup (0 = disabled)
+		int DECODER_POOL_SIZE = 0;
+
+		/// Clips of the same media file share one FFmpegReader (and its cache), across all timelines of this process (see SharedReader)
+		bool SHARE_READERS = false;
+
+		/// Number of decoders each shared media file can use, so clips which read far apart parts of the same file
+		/// (i.e. both sides of a cross-fade between two parts of one recording) don't make one decoder seek back and forth
+		int SHARED_READER_STREAMS = 1;
+
+		/// Number of timelines which render frames at the same time (the others wait their turn, in the order they asked, 0 = no limit)
+		int MAX_CONCURRENT_RENDERS = 0;
+
+		/// Number of packets each FFmpegReader reads ahead on its own demux thread (0 = read packets on the decoding thread)
+		int PACKET_QUEUE_SIZE = 0;
+
+		/// Number of frames FFmpegReader keeps while a video is played backwards, so each GOP is decoded once, and the earlier GOP is decoded in the background (0 = disabled)
+		int REVERSE_DECODE_FRAMES = 0;
+
+		/// Number of blocks FFmpegReader reads ahead of the demuxer, on a background thread, through a block cache shared by all readers (0 = FFmpeg's file I/O, see FFmpegIO)
+		int IO_READ_AHEAD = 0;
+
+		/// Size (in bytes) of the blocks read by FFmpegIO
+		int IO_BLOCK_SIZE = 1048576;
+
+		/// Size (in megabytes) of the block cache shared by all FFmpegIO readers
+		int IO_CACHE_SIZE = 64;
+
+		/// Memory map media files on local file systems (instead of reading them in blocks), when FFmpegIO is used
+		bool IO_MMAP = false;
+
+		/// Decode clip images at the size they are drawn at on the timeline (when a clip is only scaled and moved), so compositing them is a plain copy
+		bool SCALE_ON_DECODE = false;
+
+		/// Decode audio-only files by slicing their samples directly into frames (skipping the video-oriented frame tracking)
+		bool AUDIO_FAST_PATH = false;
+
+		/// Number of batches of frames (see FFmpegWriter::SetCacheSize) queued for a background thread to convert and encode (0 = WriteFrame encodes each batch itself)
+		int WRITER_QUEUE_SIZE = 0;
+
+		/// Keep the native (i.e. YUV) planes of decoded video frames, so an FFmpegWriter can encode unchanged images without converting their RGBA pixels back
+		bool NATIVE_FRAME_PLANES = false;
+
+		/// Composite the timeline in the native planes of the clips (i.e. YUV 4:2:2), when every visible layer is only moved,
+		/// scaled, and faded (its image unchanged by effects), so the frames skip the conversion to RGBA and back
+		bool YUV_COMPOSITING = false;
+
+		/// Megabytes of free image buffers kept for reuse by new frames of the same size (0 = free each image buffer)
+		int IMAGE_POOL_SIZE = 512;
+
+		/// Defer converting decoded video frames to RGB until their image is first needed (so audio-only consumers, hidden layers, and native plane writers skip it)
+		bool LAZY_FRAME_IMAGES = false;
+
+		/// Store frame images as RGBA64 (16 bits per channel), so 10-bit (and higher) sources are decoded, composited, and encoded without truncation (needs Qt 5.12, effects still run on 8-bit RGBA)
+		bool HIGH_BIT_DEPTH_IMAGES = false;
+
+		/// Use the vectorized (SSE4.1, AVX2, or NEON) kernels of the per-pixel effects, when the CPU supports them (disable to run the plain scalar loops)
+		bool SIMD_EFFECTS = true;
+
+		/// Composite clips which are only scaled, moved, and cropped with the vectorized scaling kernels (instead of QPainter, which is still used for rotated and sheared clips)
+		bool SIMD_COMPOSITING = true;
+
+		/// Bake chains of consecutive point-wise color effects into a 3D LUT with this many points on each axis, such as 33 (0 disables, and applies each effect exactly)
+		int EFFECT_LUT_SIZE = 0;
+
+		/// Composite the timeline (and run the point-wise effects of its clips, see EffectBase::GetGpuKernel) with OpenGL 4.3
+		/// compute shaders, when a QGuiApplication opens the timeline (see GpuCompositor, frames fall back to the CPU without it)
+		bool GPU_COMPOSITING = false;
+
+		/// How timelines convert the frame rate of clips (0 = repeat or skip frames, 1 = blend the nearest frames, 2 = motion compensated interpolation)
+		int FRAME_RATE_INTERPOLATION = 0;
+
+		/// Number of processed frames (after time mapping and effects) each clip keeps, so a frame requested again (such as by the timeline's in-order pass and then its compositing) is not processed twice (0 = disabled)
+		int CLIP_CACHE_SIZE = 0;
+
+		/// Let the player lower the preview resolution and decode faster (and then skip effects) while frames render slower than they play, restoring full quality once it catches up or pauses
+		bool ADAPTIVE_PREVIEW = false;
+
+		/// Render clips and timelines without their effects (used by the adaptive preview, for the fastest possible playback)
+		bool SKIP_EFFECTS = false;
+
+		/// FFmpeg decoder speed options, which trade picture quality for decoding speed (0 = exact, 1 = skip the loop filter, 2 = also skip
+		/// the non-reference frames, and allow non-compliant speedups). Used by the adaptive preview for readers outside of a timeline (see
+		/// Timeline::DecodeSpeed), and exports should keep it at 0.
+		int DECODE_SPEED = 0;
+
+		/// Render deterministically, for comparing the performance of builds: tasks run one at a time (in order) on the thread which
+		/// submits them, work is split as if OMP_THREADS threads were available (on any machine), FFmpeg codecs use a single thread,
+		/// and readers and writers don't start their background threads (see Tracer::StageValue() for the time of each stage)
+		bool DETERMINISTIC_RENDER = false;
+
+		/// Milliseconds without a frame request before the regions of a timeline are rendered in the background (see Timeline::AddRenderRegion)
+		int REGION_RENDER_IDLE_MS = 500;
+
 		/// Number of threads of OpenMP
 		int OMP_THREADS = 12;
 
 		/// Number of threads that ffmpeg uses
 		int FF_THREADS = 8;
 
+		/// Number of threads of the encoders of an openshot::FFmpegWriter (0 = FF_THREADS)
+		int ENCODE_THREADS = 0;
+
+		/// Measure the fastest thread counts of decoding, compositing, and encoding before the task pool is created, and use
+		/// them for FF_THREADS, OMP_THREADS, and ENCODE_THREADS (see openshot::ThreadTuner)
+		bool AUTOTUNE_THREADS = false;
+
+		/// Number of threads to convert each large image with (to and from RGBA), for frames of 8K video when only one
+		/// or two frames are in flight (0 = a single thread per image)
+		int SCALE_THREADS = 0;
+
 		/// Maximum rows that hardware decode can handle
 		int DE_LIMIT_HEIGHT_MAX = 1100;
 
@@ -118,6 +269,18 @@ namespace openshot {
 		/// Which GPU to use to decode (0 is the first)
 		int HW_DE_DEVICE_SET = 0;
 
+		/// Number of GPUs to spread the hardware decoders over (HW_DE_DEVICE_SET and the following GPUs)
+		int HW_DE_DEVICE_COUNT = 1;
+
+		/// Maximum hardware decoding sessions of each GPU (0 = no limit). A reader decodes in software when every GPU is full.
+		int HW_DE_DEVICE_SESSIONS = 0;
+
+		/// Spread the hardware decoders over the GPUs in turn (instead of picking the GPU with the fewest sessions)
+		bool HW_DE_DEVICE_ROUND_ROBIN = false;
+
+		/// Convert hardware decoded frames directly from the mapped GPU surface (in its native format), instead of downloading and copying them
+		bool HW_DE_ZERO_COPY = false;
+
 		/// Which GPU to use to encode (0 is the first)
 		int HW_EN_DEVICE_SET = 0;
 
@@ -128,6 +291,43 @@ namespace openshot {
 		static Settings * Instance();
 	};
 
+	/**
+	 * @brief The image size and scaling quality of the frames being rendered (read by the readers, while they decode)
+	 *
+	 * Each timeline renders at its own size (see Timeline::SetMaxSize), so a preview and an export can render in the
+	 * same process. A timeline takes a snapshot of its context at the start of each frame, and binds it to the rendering
+	 * thread with openshot::ScopedRenderContext (tasks of a openshot::TaskGroup get the context of the thread which
+	 * submitted them). Outside of any render, the context is read from the global Settings.
+	 */
+	struct RenderContext {
+		int max_width; ///< Maximum width for image data (0 = full size)
+		int max_height; ///< Maximum height for image data (0 = full size)
+		bool high_quality_scaling; ///< Scale mode used in FFmpeg decoding
+		int decode_speed; ///< FFmpeg decoder speed options (see Settings::DECODE_SPEED)
+
+		/// Get the context of the calling thread (or of the global Settings, outside of any render)
+		static RenderContext Current();
+
+		/// Get the context of the global Settings (i.e. for readers shared by many timelines)
+		static RenderContext Global();
+	};
+
+	/**
+	 * @brief Binds a openshot::RenderContext to the calling thread, while it exists
+	 */
+	class ScopedRenderContext {
+	private:
+		RenderContext previous;
+		bool had_previous;
+
+	public:
+		/// Bind a context to the calling thread
+		ScopedRenderContext(const RenderContext &context);
+
+		/// Bind the previous context again
+		~ScopedRenderContext();
+	};
+
 }
 
 #endif
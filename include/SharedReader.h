@@ -0,0 +1,190 @@
+/**
+ * @file
+ * @brief Header file for SharedReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_SHARED_READER_H
+#define OPENSHOT_SHARED_READER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ReaderBase.h"
+#include "FFmpegReader.h"
+
+namespace openshot
+{
+	/**
+	 * @brief The decoders of a media file which is shared by SharedReader instances
+	 *
+	 * Each decoder is an access stream: the requests near the last frame it decoded (which it reaches by walking
+	 * forward, instead of seeking) are sent to it, and the other requests start another stream (up to
+	 * Settings::SHARED_READER_STREAMS, after which the least recently used stream seeks). Every stream's cache is
+	 * checked before decoding, so the frames decoded by any stream are shared.
+	 */
+	struct SharedStreams {
+		std::mutex streams_mutex; ///< Guards the decoders (it is never held while a decoder opens or decodes)
+		std::mutex open_mutex; ///< Serializes opening and closing the streams of this file (and guards open_count)
+		std::vector<std::shared_ptr<FFmpegReader> > readers; ///< The decoders (the first is the inspected reader, whose info and JSON are shared)
+		std::vector<int64_t> last_frames; ///< The last frame requested from each decoder
+		std::vector<int64_t> last_used; ///< The request count when each decoder was last used (to reuse the least recently used one)
+		int64_t requests; ///< The number of frame requests which were decoded
+		int opening; ///< The number of decoders being opened (without the lock)
+		int64_t generation; ///< The number of times the streams were closed (so a decoder opened meanwhile is not kept)
+		int open_count; ///< The number of SharedReader instances which opened the streams
+
+		SharedStreams() : requests(0), opening(0), generation(0), open_count(0) {}
+	};
+
+	/**
+	 * @brief This class is a process-wide registry of the FFmpegReader of each media file, shared by all timelines
+	 *
+	 * A process which runs many timelines (i.e. one per user session) would otherwise open, decode, and cache the
+	 * same media file once per clip. The registry keeps the streams of each path (while any SharedReader uses it),
+	 * and counts the SharedReader instances which opened them, so they are only closed when the last one closes.
+	 * Decoders are opened without the registry lock (or the lock of the streams), so opening a file never waits
+	 * for another file, and the streams of a file keep decoding while another stream opens.
+	 */
+	class ReaderRegistry {
+	private:
+		std::mutex registry_mutex;
+		std::map<std::string, std::weak_ptr<SharedStreams> > media; ///< The shared streams of each path
+
+		/// Constructor (private, because this is a singleton)
+		ReaderRegistry() {};
+
+		/// Don't allow the user to copy or assign this instance
+		ReaderRegistry(ReaderRegistry const&) = delete;
+		ReaderRegistry & operator=(ReaderRegistry const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static ReaderRegistry * m_pInstance;
+
+	public:
+		/// Create or get an instance of this registry singleton (invoke the class with this method)
+		static ReaderRegistry * Instance();
+
+		/// @brief Get the shared streams of a media file (creating them, if no SharedReader uses this path)
+		/// @param path The media file path
+		std::shared_ptr<SharedStreams> Acquire(std::string path);
+
+		/// Open the shared streams (unless another SharedReader already opened them)
+		void Open(std::shared_ptr<SharedStreams> streams);
+
+		/// Close the shared streams (once every SharedReader which opened them has closed them)
+		void Close(std::shared_ptr<SharedStreams> streams);
+
+		/// @brief Get the stream to decode a frame with (a stream which can walk to it, or a new stream, or the least
+		/// recently used stream). Call with the streams open.
+		/// @param streams The shared streams
+		/// @param requested_frame The frame number
+		std::shared_ptr<FFmpegReader> Stream(std::shared_ptr<SharedStreams> streams, int64_t requested_frame);
+
+		/// Get the number of media files with a shared reader
+		int Count();
+	};
+
+	/**
+	 * @brief This class reads a media file through the shared FFmpegReader of the openshot::ReaderRegistry
+	 *
+	 * Every SharedReader of the same path decodes with the same FFmpegReader (or, with Settings::SHARED_READER_STREAMS,
+	 * with one of a few readers which each decode a different part of the file, see openshot::SharedStreams), and
+	 * shares its cache, so clips and timelines which use the same media file decode each frame once. Clips create SharedReader instances (instead of
+	 * FFmpegReader instances) when Settings::SHARE_READERS is enabled, and its JSON is the JSON of the shared
+	 * FFmpegReader, so saved projects don't change.
+	 *
+	 * The shared reader has no parent clip, so it decodes full size frames (limited by Settings::MAX_WIDTH
+	 * and Settings::MAX_HEIGHT), which any timeline can draw at any size.
+	 *
+	 * @code
+	 * // Both readers decode with the same FFmpegReader
+	 * SharedReader r1("MyAwesomeVideo.webm");
+	 * SharedReader r2("MyAwesomeVideo.webm");
+	 * r1.Open();
+	 * r2.Open();
+	 * std::shared_ptr<Frame> f = r2.GetFrame(1);
+	 * @endcode
+	 */
+	class SharedReader : public ReaderBase
+	{
+	private:
+		std::string path;
+		std::shared_ptr<SharedStreams> streams; ///< The shared streams of the path
+		bool is_open;
+
+	public:
+		/// @brief Constructor for SharedReader
+		/// @param path The media file path
+		SharedReader(std::string path);
+
+		/// Destructor (closes the shared reader, if this reader opened it)
+		virtual ~SharedReader();
+
+		/// Close this reader (the shared reader stays open while other SharedReader instances use it)
+		void Close();
+
+		/// Get the cache of the shared reader (of its first stream)
+		CacheMemory* GetCache() { return streams->readers.front()->GetCache(); };
+
+		/// Get an openshot::Frame object for a specific frame number of the shared reader
+		///
+		/// @returns The requested frame of video
+		/// @param requested_frame The frame number that is requested.
+		std::shared_ptr<openshot::Frame> GetFrame(int64_t requested_frame);
+
+		/// Get the shared reader (the first stream, whose info and JSON are shared)
+		FFmpegReader* Reader() { return streams->readers.front().get(); };
+
+		/// Get the number of streams of the shared media file (see Settings::SHARED_READER_STREAMS)
+		int Streams();
+
+		/// Get the metrics of the shared reader (and the number of SharedReader instances using it, and its streams)
+		Json::Value MetricsValue();
+
+		/// Determine if reader is open or closed
+		bool IsOpen() { return is_open; };
+
+		/// Return the type name of the class
+		std::string Name() { return "SharedReader"; };
+
+		/// Get and Set JSON methods
+		std::string Json(); ///< Generate JSON string of this object (the JSON of the shared FFmpegReader)
+		void SetJson(std::string value); ///< Load JSON string into this object
+		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object (the JSON of the shared FFmpegReader)
+		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object (only a new path is used)
+
+		/// Open this reader (and the shared reader, unless it is already open)
+		void Open();
+	};
+
+}
+
+#endif
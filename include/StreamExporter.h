@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @brief Header file for StreamExporter class (renders a growing timeline into a writer, in real time)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_STREAM_EXPORTER_H
+#define OPENSHOT_STREAM_EXPORTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include "FFmpegWriter.h"
+#include "Json.h"
+#include "Metrics.h"
+#include "Timeline.h"
+#include "ZmqLogger.h"
+
+namespace openshot
+{
+	/**
+	 * @brief This class streams a timeline whose duration grows (i.e. live graphics, which are appended while it
+	 * streams) into an openshot::FFmpegWriter, rendering each frame just in time
+	 *
+	 * Stream() renders the frames of the timeline in order, and writes each one as soon as it is rendered, with
+	 * the writer's frame queue set to a single frame. Frames are rendered at most SetMaxLead() frames ahead of real
+	 * time (the timeline's frame rate, from the start of the stream), so an edit is written no later than the lead
+	 * (and the time to render a frame) after it is queued. Frames after the last clip are rendered too (as the
+	 * timeline's background), so the stream never ends on its own.
+	 *
+	 * Edits are queued with QueueJsonDiff() (from any thread), which returns right away, and the render loop
+	 * applies them between frames (with Timeline::ApplyJsonDiff), so an editor never waits for a render. An edit
+	 * which can't be applied is logged, and counted in the metrics, without stopping the stream.
+	 *
+	 * The writer is prepared and opened by the caller, so any output works, including segments (see
+	 * FFmpegWriter::SetSegmentOptions), which are flushed while the stream runs.
+	 *
+	 * @code
+	 * // Stream a timeline as a rolling HLS playlist (of 2 second segments), until Stop() is called
+	 * FFmpegWriter w("/var/www/live/stream.m3u8");
+	 * w.SetVideoOptions(true, "libx264", openshot::Fraction(30,1), 1280, 720, openshot::Fraction(1,1), false, false, 3000000);
+	 * w.SetSegmentOptions(openshot::SEGMENT_HLS, 2.0, 5);
+	 * w.PrepareStreams();
+	 * w.WriteHeader();
+	 * w.Open();
+	 *
+	 * StreamExporter e(&t, &w);
+	 * e.Stream();
+	 *
+	 * // ... and from another thread, append a clip
+	 * e.QueueJsonDiff(diff);
+	 * @endcode
+	 */
+	class StreamExporter
+	{
+	private:
+		openshot::Timeline *timeline;
+		openshot::FFmpegWriter *writer;
+		int max_lead; ///< The most frames rendered ahead of real time
+		bool real_time; ///< Pace the frames at the timeline's frame rate (otherwise they are rendered as fast as possible)
+
+		std::mutex edit_mutex;
+		std::deque<std::pair<std::string, std::chrono::steady_clock::time_point> > queued_edits; ///< The JSON diffs to apply (and when they were queued)
+		std::atomic<bool> stop_requested; ///< Stop streaming (after the current frame)
+		std::atomic<int64_t> frames_written; ///< The number of frames written by Stream()
+
+		openshot::Counter late_frames; ///< Frames written later than their time
+		openshot::Counter rejected_edits; ///< Queued edits which could not be applied
+		openshot::Histogram edit_latency; ///< Milliseconds from queuing an edit to writing the first frame rendered after it
+		openshot::Histogram render_times; ///< Milliseconds each frame took to render and write
+
+		/// Apply the queued edits (returns the number of edits, and sets oldest to the time the first one was queued)
+		size_t apply_edits(std::chrono::steady_clock::time_point &oldest);
+
+	public:
+		/// @brief Constructor for StreamExporter
+		/// @param timeline The timeline to stream (opened by Stream(), if it is closed)
+		/// @param writer The writer to write each frame to (which must be open)
+		StreamExporter(openshot::Timeline *timeline, openshot::FFmpegWriter *writer);
+
+		/// @brief Queue a JSON diff (see Timeline::ApplyJsonDiff), which is applied before the next frame is rendered
+		/// @param value A JSON string containing a key, value, and type of change
+		void QueueJsonDiff(std::string value);
+
+		/// Get the most frames rendered ahead of real time
+		int MaxLead() { return max_lead; };
+
+		/// @brief Set the most frames rendered ahead of real time (a larger lead absorbs slow frames, but delays edits)
+		/// @param frames The number of frames (0 renders each frame at its time)
+		void SetMaxLead(int frames) { max_lead = std::max(frames, 0); };
+
+		/// Determine if the frames are paced at the timeline's frame rate
+		bool RealTime() { return real_time; };
+
+		/// @brief Pace the frames at the timeline's frame rate (the default), or render them as fast as possible
+		void SetRealTime(bool enabled) { real_time = enabled; };
+
+		/// @brief Render and write the frames of the timeline in order, until Stop() is called (or a number of frames)
+		/// @param start The number of the first frame
+		/// @param count The number of frames to write (0 = until Stop() is called)
+		void Stream(int64_t start = 1, int64_t count = 0);
+
+		/// Stop streaming (after the current frame)
+		void Stop() { stop_requested = true; };
+
+		/// Get the number of frames written by Stream()
+		int64_t FramesWritten() { return frames_written; };
+
+		/// Get the runtime metrics of the stream (its late frames, rejected edits, edit latency, and render times)
+		Json::Value MetricsValue();
+	};
+}
+
+#endif
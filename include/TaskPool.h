@@ -0,0 +1,261 @@
+/**
+ * @file
+ * @brief Header file for TaskPool class (shared worker threads)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_TASK_POOL_H
+#define OPENSHOT_TASK_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openshot {
+
+	class TaskPool;
+
+	/**
+	 * @brief A group of tasks submitted to the openshot::TaskPool, which can be waited on together
+	 *
+	 * A thread waiting on a group runs the tasks of the group which haven't started yet, until every task in the
+	 * group has finished, so groups can be safely nested (i.e. a Timeline task which waits on FFmpegReader tasks)
+	 * without blocking a worker thread. The waiting thread never runs the tasks of other groups, since it can
+	 * hold locks (i.e. the ReadStream critical section of a FFmpegReader) which those tasks take too. The first
+	 * exception thrown by a task is re-thrown by Wait().
+	 */
+	class TaskGroup {
+	private:
+		/// The tasks of a group (shared with the pool tasks which run them, which can outlive the group)
+		struct GroupState {
+			std::mutex group_mutex;
+			std::condition_variable group_done;
+			std::deque<std::function<void()> > tasks; ///< Tasks which haven't started yet
+			int pending; ///< Number of unfinished tasks in this group
+			std::exception_ptr error; ///< The first exception thrown by a task in this group
+			GroupState() : pending(0) {};
+		};
+
+		std::shared_ptr<GroupState> state;
+		TaskPool *pool; ///< The pool the tasks are submitted to (TaskPool::Current() of the first task)
+
+		/// Run the next task of a group which hasn't started yet (returns false if none is waiting)
+		static bool run_next(std::shared_ptr<GroupState> state);
+
+	public:
+		/// Default constructor
+		TaskGroup();
+
+		/// Destructor (waits for any unfinished tasks)
+		~TaskGroup();
+
+		/// @brief Submit a task to the current TaskPool (see TaskPool::Current()), as part of this group
+		/// @param task The function to run on a worker thread
+		void Run(std::function<void()> task);
+
+		/// Run a task of this group which hasn't started yet on the calling thread (returns false if none is waiting)
+		bool RunPendingTask() { return run_next(state); };
+
+		/// Wait for all tasks in this group to finish (and re-throw the first exception, if any)
+		void Wait();
+	};
+
+	/**
+	 * @brief This class is a process-wide pool of worker threads, which libopenshot submits tasks to
+	 *
+	 * A single pool (sized from Settings::OMP_THREADS) is shared by all timelines, readers, and writers,
+	 * instead of each call spinning up its own (nested) OpenMP team. Each worker has its own queue of
+	 * tasks: tasks submitted from a worker are pushed to its own queue, and idle workers steal tasks
+	 * from the other queues.
+	 *
+	 * With Settings::DETERMINISTIC_RENDER, each task runs right away on the thread which submits it, in order.
+	 *
+	 * On machines with several NUMA nodes, ForNode() creates a pool whose workers are pinned to the CPUs of
+	 * one node, so the frames they create are allocated in the memory of that node (and stay there, since the
+	 * openshot::ImageBufferPool recycles buffers on the node they were released on). Timeline::NumaNode() renders
+	 * a timeline on such a pool, and any number of timelines can share a node.
+	 */
+	class TaskPool {
+	private:
+		/// A queue of tasks owned by a single worker thread
+		struct WorkerQueue {
+			std::mutex queue_mutex;
+			std::deque<std::function<void()> > tasks;
+		};
+
+		std::vector<std::thread> workers; ///< The worker threads
+		std::vector<std::unique_ptr<WorkerQueue> > queues; ///< One queue of tasks per worker thread
+		std::mutex wake_mutex;
+		std::condition_variable wake;
+		int64_t queued; ///< Number of tasks waiting in all queues
+		size_t next_queue; ///< The queue to push the next task submitted from outside the pool
+		bool stopping;
+		int node; ///< The NUMA node the workers are pinned to (-1 = not pinned)
+
+		/// Constructor (private, because the pools are created by Instance() and ForNode())
+		TaskPool(int num_threads, int node);
+
+		/// Get the index of the calling thread in this pool's workers (or -1, if it is not one of them)
+		int worker_index();
+
+		/// Don't allow the user to copy or assign this instance
+		TaskPool(TaskPool const&) = delete;
+		TaskPool & operator=(TaskPool const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static TaskPool * m_pInstance;
+
+		/// Take the next task (from a worker's own queue first, then from the other queues)
+		bool pop_task(int worker_index, std::function<void()>& task);
+
+		/// The main loop of each worker thread
+		void worker_loop(int worker_index);
+
+	public:
+		/// Create or get an instance of the shared task pool (with workers which are not pinned to a NUMA node)
+		static TaskPool * Instance();
+
+		/// Get the pool of the calling thread: the pool of a worker thread, or the pool bound by a ScopedTaskPool, or Instance()
+		static TaskPool * Current();
+
+		/// @brief Create or get the pool whose workers are pinned to the CPUs of a NUMA node
+		/// @param node The NUMA node (-1, or a node which does not exist, returns Instance())
+		static TaskPool * ForNode(int node);
+
+		/// Get the number of NUMA nodes of this machine (1 if unknown, or not supported on this platform)
+		static int NumNodes();
+
+		/// @brief Pin the calling thread to the CPUs of a NUMA node (returns false if it could not be pinned)
+		/// @param node The NUMA node
+		static bool PinThreadToNode(int node);
+
+		/// Get the NUMA node the calling thread is pinned to (or -1)
+		static int ThreadNode();
+
+		/// Get the NUMA node the workers of this pool are pinned to (or -1)
+		int Node() { return node; };
+
+		/// Destructor (stops and joins all worker threads)
+		~TaskPool();
+
+		/// Get the number of worker threads in the pool (or Settings::OMP_THREADS, when rendering deterministically)
+		int NumThreads();
+
+		/// @brief Submit a task to the pool (prefer TaskGroup::Run, which can be waited on)
+		/// @param task The function to run on a worker thread
+		void Submit(std::function<void()> task);
+
+		/// @brief Call a function for each index in a range, in parallel (returns once all calls are finished)
+		/// @param begin The first index
+		/// @param end One past the last index
+		/// @param body The function to call with each index
+		void ParallelFor(int64_t begin, int64_t end, std::function<void(int64_t)> body);
+	};
+
+	/**
+	 * @brief Submits the tasks of the calling thread to a openshot::TaskPool (instead of TaskPool::Instance()), while it exists
+	 */
+	class ScopedTaskPool {
+	private:
+		TaskPool *previous;
+
+	public:
+		/// Bind a pool to the calling thread
+		ScopedTaskPool(TaskPool *pool);
+
+		/// Bind the previous pool again
+		~ScopedTaskPool();
+	};
+
+	/**
+	 * @brief This class takes turns between the timelines of a process, so no more than Settings::MAX_CONCURRENT_RENDERS render at once
+	 *
+	 * Each render takes a ticket, and the tickets are served in the order they were taken, so a timeline which renders
+	 * constantly (i.e. an export) can't starve the others (i.e. previews). All renders share the TaskPool, which limits
+	 * the threads of the whole process. Renders started by a TaskPool worker (i.e. a nested timeline) or by a thread which
+	 * already holds a slot don't wait, since their parent render holds one. The time spent waiting is measured by the
+	 * "scheduler.wait_ms" histogram of openshot::Metrics.
+	 */
+	class RenderScheduler {
+	private:
+		std::mutex scheduler_mutex;
+		std::condition_variable turn;
+		uint64_t next_ticket; ///< The ticket of the next render which asks for a slot
+		uint64_t serving; ///< The ticket of the next render to get a slot
+		int active; ///< Number of renders holding a slot
+
+		/// Constructor (private, because this is a singleton)
+		RenderScheduler() : next_ticket(0), serving(0), active(0) {};
+
+		/// Don't allow the user to copy or assign this instance
+		RenderScheduler(RenderScheduler const&) = delete;
+		RenderScheduler & operator=(RenderScheduler const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static RenderScheduler * m_pInstance;
+
+	public:
+		/// Create or get an instance of this scheduler singleton (invoke the class with this method)
+		static RenderScheduler * Instance();
+
+		/// Wait for a render slot (returns false without waiting, if there is no limit or the calling thread needs no slot)
+		bool Acquire();
+
+		/// Release the slot of the calling thread (after Acquire() returned true)
+		void Release();
+
+		/// Get the number of renders holding a slot
+		int Active();
+
+		/// Get the number of renders waiting for a slot
+		int Waiting();
+	};
+
+	/**
+	 * @brief Holds a slot of the openshot::RenderScheduler (if the calling thread needs one), while it exists
+	 */
+	class ScopedRenderSlot {
+	private:
+		bool acquired;
+
+	public:
+		/// Wait for a render slot
+		ScopedRenderSlot() : acquired(RenderScheduler::Instance()->Acquire()) {};
+
+		/// Release the render slot
+		~ScopedRenderSlot() { if (acquired) RenderScheduler::Instance()->Release(); };
+	};
+
+}
+
+#endif
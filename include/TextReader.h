@@ -96,6 +96,7 @@ namespace openshot
 		std::string background_color;
 		std::string text_background_color;
 		std::shared_ptr<Magick::Image> image;
+		std::shared_ptr<QImage> cached_image; ///< The pixels of the drawn text (converted once, and shared by all frames)
 		MAGICK_DRAWABLE lines;
 		bool is_open;
 		openshot::GravityType gravity;
@@ -118,6 +119,9 @@ namespace openshot
 		/// @param background_color The background color of the text frame image (also supports Transparent)
 		TextReader(int width, int height, int x_offset, int y_offset, GravityType gravity, std::string text, std::string font, double size, std::string text_color, std::string background_color);
 
+		/// Destructor (finishes the frame requests)
+		virtual ~TextReader();
+
 		/// Draw a box under rendered text using the specified color.
 		/// @param text_background_color The background color behind the text
 		void SetTextBackgroundColor(std::string color);
@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief Header file for ThreadTuner class (measures the fastest thread counts of each stage)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_THREAD_TUNER_H
+#define OPENSHOT_THREAD_TUNER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "Json.h"
+
+namespace openshot {
+
+	/**
+	 * @brief This class measures the throughput of decoding, compositing, and encoding with different thread counts,
+	 * and sets the count of each stage (Settings::FF_THREADS, Settings::OMP_THREADS, and Settings::ENCODE_THREADS)
+	 *
+	 * Each stage is measured alone, with 1, 2, 4, ... threads (up to the number of cores): H.264 (or MPEG-4, without
+	 * libx264) encoding and decoding of synthetic 720p video in memory, and compositing 1080p images with QPainter on
+	 * separate threads (the way the openshot::TaskPool composites frames). The fewest threads within 5% of the best
+	 * throughput are chosen, so the spare cores are left to the other stages (which run at the same time).
+	 *
+	 * With Settings::AUTOTUNE_THREADS, the counts are measured (in about a second) before the task pool is created,
+	 * so the size of the pool follows the measured composite threads. The measurements don't use the task pool.
+	 *
+	 * @code
+	 * openshot::ThreadTuner::Instance()->Tune();
+	 * std::cout << openshot::ThreadTuner::Instance()->Json() << std::endl;
+	 * @endcode
+	 */
+	class ThreadTuner {
+	private:
+		std::mutex tune_mutex;
+		bool tuned;
+		Json::Value results; ///< The chosen counts, and the throughput of each candidate
+
+		/// Constructor (private, because this is a singleton)
+		ThreadTuner() : tuned(false) {};
+
+		/// Don't allow the user to copy or assign this instance
+		ThreadTuner(ThreadTuner const&) = delete;
+		ThreadTuner & operator=(ThreadTuner const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static ThreadTuner * m_pInstance;
+
+	public:
+		/// Create or get an instance of this tuner singleton (invoke the class with this method)
+		static ThreadTuner * Instance();
+
+		/// Measure each stage (only the first time), and set the thread counts of the settings
+		void Tune();
+
+		/// Have the thread counts been measured
+		bool IsTuned();
+
+		/// Get the chosen thread counts, and the measured frames per second of each candidate, as a JSON string
+		std::string Json();
+
+		/// Get the chosen thread counts, and the measured frames per second of each candidate, as a JSON value
+		Json::Value JsonValue();
+	};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file
+ * @brief Header file for ThumbnailGenerator class (batched thumbnails, filmstrips and sprite sheets of a reader)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_THUMBNAIL_GENERATOR_H
+#define OPENSHOT_THUMBNAIL_GENERATOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QtGui/QImage>
+#include "Frame.h"
+#include "ReaderBase.h"
+
+namespace openshot
+{
+	/**
+	 * @brief This class generates the thumbnails of many frames of a reader at once (i.e. the filmstrip of a clip)
+	 *
+	 * The thumbnails look like the ones of Frame::Thumbnail(), but the mask and overlay images are loaded (and
+	 * scaled) once, not for each thumbnail. An openshot::FFmpegReader is switched to its thumbnail mode while the
+	 * thumbnails are generated (see FFmpegReader::ThumbnailMode()), so only keyframes are decoded, at the smallest
+	 * size which is still larger than the thumbnails. The frames are read in order, and each one is scaled and
+	 * composited on the openshot::TaskPool while the next one is read.
+	 *
+	 * @code
+	 * // Save a filmstrip of 10 thumbnails (one per second)
+	 * ThumbnailGenerator g(160, 90);
+	 * g.SetOverlay("overlay.png");
+	 * std::vector<int64_t> frames;
+	 * for (int64_t number = 1; number <= 300; number += 30)
+	 *     frames.push_back(number);
+	 * g.SaveSpriteSheet(&r, frames, "filmstrip.png", 10);
+	 * @endcode
+	 */
+	class ThumbnailGenerator
+	{
+	private:
+		int width;
+		int height;
+		std::string mask_path;
+		std::string overlay_path;
+		std::string background_color;
+		bool ignore_aspect;
+		bool keyframes_only;
+		float rotate;
+
+		// The loaded mask (the gray value to subtract from the alpha of each pixel) and overlay (NULL if none)
+		std::shared_ptr<std::vector<unsigned char> > mask;
+		std::shared_ptr<QImage> overlay;
+		bool images_loaded;
+
+		/// Load and scale the mask and overlay images (once)
+		void load_images();
+
+		/// Render the thumbnail of a frame
+		std::shared_ptr<QImage> render(std::shared_ptr<openshot::Frame> frame);
+
+	public:
+		/// @brief Constructor for ThumbnailGenerator
+		/// @param width The width of each thumbnail
+		/// @param height The height of each thumbnail
+		ThumbnailGenerator(int width, int height);
+
+		/// Set the background color of the thumbnails (i.e. "#000000", the default, or "transparent")
+		void SetBackgroundColor(std::string color) { background_color = color; };
+
+		/// Stretch the frames to the size of the thumbnails (instead of keeping their aspect ratio)
+		void SetIgnoreAspect(bool ignore) { ignore_aspect = ignore; };
+
+		/// Only decode keyframes, when the reader is an openshot::FFmpegReader (enabled by default)
+		void SetKeyframesOnly(bool enabled) { keyframes_only = enabled; };
+
+		/// Set the image to mask the thumbnails with (the brighter the mask, the more transparent the thumbnail)
+		void SetMask(std::string path) { mask_path = path; images_loaded = false; };
+
+		/// Set the image to draw over the thumbnails
+		void SetOverlay(std::string path) { overlay_path = path; images_loaded = false; };
+
+		/// Set the rotation of the frames (in degrees, around their center)
+		void SetRotation(float degrees) { rotate = degrees; };
+
+		/// @brief Generate the thumbnails of a list of frames
+		/// @returns The thumbnails (in the same order as the frame numbers)
+		/// @param reader The open reader of the frames
+		/// @param frame_numbers The frame numbers (in any order, and repeated numbers are only read once)
+		std::vector<std::shared_ptr<QImage> > Generate(openshot::ReaderBase* reader, std::vector<int64_t> frame_numbers);
+
+		/// @brief Generate a sprite sheet of the thumbnails of a list of frames (in rows, from left to right)
+		/// @param reader The open reader of the frames
+		/// @param frame_numbers The frame numbers
+		/// @param columns The number of thumbnails of each row (0 puts all thumbnails in a single row)
+		std::shared_ptr<QImage> SpriteSheet(openshot::ReaderBase* reader, std::vector<int64_t> frame_numbers, int columns = 0);
+
+		/// @brief Save a sprite sheet of the thumbnails of a list of frames (see SpriteSheet())
+		/// @param reader The open reader of the frames
+		/// @param frame_numbers The frame numbers
+		/// @param path The image file path (the format is determined from the extension, unless it is set)
+		/// @param columns The number of thumbnails of each row (0 puts all thumbnails in a single row)
+		/// @param format The image format (i.e. "png" or "jpg", or "" to use the extension)
+		/// @param quality The image quality (0 to 100, or -1 for the default)
+		void SaveSpriteSheet(openshot::ReaderBase* reader, std::vector<int64_t> frame_numbers, std::string path, int columns = 0, std::string format = "", int quality = -1);
+
+		/// @brief Save the thumbnail of each frame as its own image file
+		/// @param reader The open reader of the frames
+		/// @param frame_numbers The frame numbers
+		/// @param path The image file path, with the frame number pattern (i.e. "thumbnail-%04d.png", see ImageSequenceWriter::FramePath())
+		/// @param format The image format (i.e. "png" or "jpg", or "" to use the extension)
+		/// @param quality The image quality (0 to 100, or -1 for the default)
+		void SaveThumbnails(openshot::ReaderBase* reader, std::vector<int64_t> frame_numbers, std::string path, std::string format = "", int quality = -1);
+	};
+
+}
+
+#endif
@@ -31,11 +31,24 @@
 #ifndef OPENSHOT_TIMELINE_H
 #define OPENSHOT_TIMELINE_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <QtCore/QByteArray>
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
+#include <QtGui/QRegion>
 #include "CacheBase.h"
 #include "CacheDisk.h"
 #include "CacheMemory.h"
@@ -52,7 +65,9 @@
 #include "KeyFrame.h"
 #include "OpenMPUtilities.h"
 #include "ReaderBase.h"
+#include "RenderGraph.h"
 #include "Settings.h"
+#include "TaskPool.h"
 
 namespace openshot {
 
@@ -77,6 +92,74 @@ namespace openshot {
 			return false;
 	}};
 
+	/// The range of timeline frames covered by a clip. These entries are kept sorted by start frame,
+	/// and form an implicit balanced search tree (the middle element of any range is the root of that
+	/// range), where each node also tracks the largest end frame in its subtree. This allows the
+	/// timeline to quickly find all clips which intersect a range of frames.
+	struct ClipInterval {
+		int64_t start; ///< The first timeline frame of the clip
+		int64_t end; ///< The last timeline frame of the clip
+		int64_t max_end; ///< The largest end frame of this node's subtree
+		size_t order; ///< The index of the clip in the sorted clip list (i.e. layer order)
+		Clip* clip; ///< The clip covering this range
+	};
+
+	/// Comparison method for sorting clip intervals (by starting frame)
+	struct CompareClipIntervals{
+		bool operator()( const ClipInterval& lhs, const ClipInterval& rhs){
+			return lhs.start < rhs.start;
+	}};
+
+	/// The range of timeline frames covered by a timeline effect. Each layer has its own index of these
+	/// entries, which forms the same kind of search tree as the clip intervals (see ClipInterval).
+	struct EffectInterval {
+		int64_t start; ///< The first timeline frame of the effect
+		int64_t end; ///< The last timeline frame of the effect
+		int64_t max_end; ///< The largest end frame of this node's subtree
+		size_t order; ///< The index of the effect in the sorted effect list (i.e. the order effects are applied)
+		EffectBase* effect; ///< The effect covering this range
+	};
+
+	/// A single clip layer which needs to be composited onto a timeline frame
+	struct LayerPlan {
+		Clip* clip; ///< The clip to composite
+		int64_t clip_frame_number; ///< The frame number of the clip (based on its position on the timeline)
+		bool is_top_clip; ///< Is this the top clip on its layer (only happens when multiple clips are overlapping)
+		bool is_hidden; ///< Is this clip covered by an opaque, full frame clip above it (only its audio is mixed)
+		int draw_width; ///< The width the clip's image is drawn at, if it is only scaled (0 = decode at full size)
+		int draw_height; ///< The height the clip's image is drawn at, if it is only scaled (0 = decode at full size)
+		ClipProperties properties; ///< The clip's keyframes at this frame (evaluated once, when the plan is built)
+	};
+
+	/// The size and position of a clip's image on a timeline frame, before it is rotated and sheared (see Timeline::add_layer)
+	struct LayerPlacement {
+		float x; ///< The left edge of the drawn image (in timeline pixels)
+		float y; ///< The top edge of the drawn image
+		float scaled_width; ///< The width of the full image on the timeline frame (the rotation is around its center)
+		float scaled_height; ///< The height of the full image on the timeline frame
+		float width_scale; ///< The number of timeline pixels of each image pixel (horizontally)
+		float height_scale; ///< The number of timeline pixels of each image pixel (vertically)
+		QRect source_rect; ///< The cropped part of the image (in image pixels)
+	};
+
+	/// The render plan for a single timeline frame (which clips to composite, and in which order)
+	struct FramePlan {
+		int64_t frame_number; ///< The timeline frame number
+		float max_volume; ///< The summed volume of all overlapping clips with audio
+		std::vector<LayerPlan> layers; ///< Ordered list of visible clips (lowest layer to top layer)
+		std::string render_key; ///< The hash of the inputs the frame is rendered from (see Timeline::SetRenderCache), or empty
+	};
+
+	/// The composite of the static layers at the bottom of a frame (still images with constant keyframes and no
+	/// effects), which is reused for the next frames with the same static layers
+	struct StaticComposite {
+		std::vector<LayerPlan> layers; ///< The static layers (and their keyframes)
+		std::vector<int64_t> versions; ///< The cache version of each layer's clip (see Clip::CacheVersion)
+		bool has_background; ///< Is the background color composited under the layers
+		QRgb background; ///< The background color
+		std::shared_ptr<QImage> image; ///< The composited background and layers
+	};
+
 	/**
 	 * @brief This class represents a timeline
 	 *
@@ -153,22 +236,267 @@ namespace openshot {
 		std::list<Clip*> closing_clips; ///<List of clips that need to be closed
 		std::map<Clip*, Clip*> open_clips; ///<List of 'opened' clips on this timeline
 		std::list<EffectBase*> effects; ///<List of clips on this timeline
+		std::vector<ClipInterval> clip_intervals; ///< Index of clip frame ranges (used to find intersecting clips)
+		std::map<int, std::vector<EffectInterval> > effect_intervals; ///< Index of timeline effect frame ranges, by layer
+		bool clip_intervals_dirty; ///< Clips have changed, and the clip interval index needs to be rebuilt
+		bool effect_intervals_dirty; ///< Timeline effects have changed, and their interval indexes need to be rebuilt
+		std::shared_ptr<std::atomic<int64_t> > clip_changes; ///< The number of changes to the position, layer, start, or end of the clips on this timeline (see ClipBase::ChangeCounter)
+		std::shared_ptr<std::atomic<int64_t> > effect_changes; ///< The number of changes to the position, layer, start, or end of the timeline effects
+		int64_t clip_intervals_changes; ///< The clip_changes the clip interval index is up to date with
+		int64_t effect_intervals_changes; ///< The effect_changes the effect interval indexes are up to date with
 		CacheBase *final_cache; ///<Final cache of timeline frames
+		CacheMemory audio_cache; ///< The mixed audio of frames (see GetAudioFrame), which only the changes to the audio remove
 		std::set<FrameMapper*> allocated_frame_mappers; ///< all the frame mappers we allocated and must free
 		bool managed_cache; ///< Does this timeline instance manage the cache object
+		CacheDisk *render_cache; ///< The frames rendered in any session, by the hash of their inputs (see SetRenderCache), or NULL
+		QByteArray timeline_input_hash; ///< The hash of the timeline's inputs (its format, background, and effects)
+		std::map<Clip*, std::pair<int64_t, QByteArray> > clip_input_hashes; ///< The hash of each clip's inputs (and its Clip::CacheVersion)
+		int64_t input_hash_generation; ///< The edit generation the input hashes were calculated in
+		int64_t last_requested_frame; ///< The last frame number requested from GetFrame()
+		AccessPatternType access_pattern; ///< The detected order in which frames are being requested
+		int access_streak; ///< Number of consecutive requests matching the access pattern
+		int last_batch_size; ///< The number of frames rendered by the last cache miss
+		bool pipeline_rendering; ///< Overlap the decode, effects, and composite stages of consecutive frames
+		bool graph_rendering; ///< Render each batch as a graph of decode, map, effect, and composite nodes (see RenderGraph)
+		int numa_node; ///< The NUMA node frames are rendered on (-1 = the shared TaskPool)
+		std::atomic<int> pending_edits; ///< Number of edits waiting for the frame lock (renders stop their read-ahead)
+		openshot::Histogram render_times; ///< Milliseconds each frame took to render (when it wasn't cached)
+		std::atomic<int64_t> last_request_ms; ///< When the last frame was requested by GetFrame() (steady clock milliseconds)
+
+		// Background render of regions (see AddRenderRegion)
+		CacheBase *region_cache; ///< The cache of the rendered region frames (not owned by the timeline)
+		std::vector<std::pair<int64_t, int64_t> > render_regions; ///< The regions to render (first and last frame numbers)
+		std::set<int64_t> region_frames; ///< The region frames which are in the region cache
+		int64_t region_generation; ///< Incremented when region frames are removed (a frame rendered before that is stale)
+		bool region_stop; ///< Stop the region render thread
+		std::mutex region_mutex; ///< Guards the regions, their rendered frames, and the region render thread state
+		std::condition_variable region_condition; ///< Wakes the region render thread (a region was added, or frames removed)
+		std::thread region_thread; ///< Renders the missing region frames while no frames are requested
+
+		// The max image size of this timeline's frames (see SetMaxSize), which its readers decode at
+		std::atomic<int> render_width; ///< Maximum width for image data (0 = full size)
+		std::atomic<int> render_height; ///< Maximum height for image data (0 = full size)
+		std::atomic<int> decode_speed; ///< The FFmpeg decoder speed options of this timeline's readers (see DecodeSpeed)
+
+		// Nested timelines (a timeline which is the reader of a clip, see GetFrame(int64_t, int, int))
+		int canvas_width; ///< The image width of the frames being rendered (0 = render_width), set under the frame lock
+		int canvas_height; ///< The image height of the frames being rendered (0 = render_height)
+		std::atomic<int64_t> edit_generation; ///< Incremented by each edit of this timeline (see EditGeneration)
+		std::map<int64_t, std::pair<int64_t, int64_t> > edit_ranges; ///< The frames changed by the recent edits (by edit generation)
+		std::mutex edits_mutex; ///< Guards the edit ranges
+		std::map<Clip*, std::pair<Timeline*, int64_t> > nested_timelines; ///< The nested timeline of each clip, and the edit generation of its cached frames
+		std::mutex nested_mutex; ///< Guards the nested timelines
+		StaticComposite static_composite; ///< The last composite of the static bottom layers (see count_static_layers)
+		std::mutex static_mutex; ///< Guards the static composite
+		openshot::Counter static_layer_hits; ///< Frames which reused the static composite
+		openshot::Counter graph_shared_nodes; ///< Reader frames of the render graphs which were shared by several clip frames
+		std::map<qint64, QRect> visible_rects; ///< The visible rectangle of the recently composited images (by QImage::cacheKey)
+		std::mutex visible_rects_mutex; ///< Guards the visible rectangles
+		std::map<std::pair<int, int>, std::shared_ptr<CacheMemory> > size_caches; ///< The frames of the other render sizes (by image size), see SetMaxSize
+		std::list<std::pair<int, int> > size_cache_order; ///< The image sizes of the size caches (most recently used first)
+		std::mutex size_caches_mutex; ///< Guards the size caches (not the frames in them)
+
+		/// The image width of the frames being rendered (smaller than MaxWidth() for a nested timeline)
+		int max_width() { return canvas_width > 0 ? canvas_width : render_width.load(); };
+
+		/// The image height of the frames being rendered (smaller than MaxHeight() for a nested timeline)
+		int max_height() { return canvas_height > 0 ? canvas_height : render_height.load(); };
+
+		/// @brief Calculate the image size to render the frames of this timeline at, for the size they are drawn at
+		/// (the aspect ratio of a full size frame, covering the drawn size), or an empty size for full size frames
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		QSize canvas_size(int width, int height);
+
+		/// Determine if a cached frame is smaller than the frames rendered at a canvas size (see canvas_size)
+		bool is_smaller_than_canvas(std::shared_ptr<Frame> frame, QSize canvas);
+
+		/// @brief Get a cached frame for a canvas size (see canvas_size), or NULL if it needs to be rendered. A frame of
+		/// this timeline's size can be a frame rendered before the size changed (see size_caches), or a downscale of a
+		/// larger cached frame.
+		std::shared_ptr<Frame> get_cached_frame(int64_t frame_number, QSize canvas);
+
+		/// Add a rendered frame to the final cache (keeping a cached frame of another size in its size cache)
+		void add_final_frame(std::shared_ptr<Frame> frame);
+
+		/// Get the cache of the frames rendered at an image size (creating it, if needed), or NULL
+		std::shared_ptr<CacheMemory> size_cache(QSize size, bool create);
+
+		/// Remove the frames of the other render sizes (all frames, or a range of frames)
+		void clear_size_caches(int64_t start = 1, int64_t end = -1);
+
+		/// Record the frames changed by an edit (for the timelines this timeline is nested in)
+		void record_edit(int64_t first, int64_t last);
+
+		/// Get the timeline which is the reader of a clip (directly, or mapped by a FrameMapper), or NULL
+		static Timeline* nested_timeline(Clip* clip);
+
+		/// Update the list of nested timelines (and keep the edit generations of the clips which are still nested)
+		void update_nested_timelines();
+
+		/// Remove the cached frames of the clips whose nested timelines were edited
+		void check_nested_edits();
+
+		/// Skip the frames of a batch after the requested frame (an edit or a visible frame request is waiting)
+		bool skip_read_ahead() { return pending_edits > 0 || HasVisibleRequests(); };
+
+		/// Composite a new layer of video (the audio of each layer is mixed by add_layer_audio and mix_layer_audio)
+		/// @param composite_bands Number of horizontal bands to composite the layer image in parallel (1 = single pass)
+		/// @param is_hidden Skip the image of this layer (it is covered by another layer)
+		void add_layer(const std::shared_ptr<Frame>& new_frame, const std::shared_ptr<Frame>& source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, int composite_bands, bool is_hidden);
+
+		/// Get the transform of a clip's image (from the drawn image's pixels, see LayerPlacement::source_rect, to the
+		/// timeline frame), which moves, scales, rotates, and shears it
+		/// @param transformed Is the transform not the identity
+		QTransform layer_transform(const LayerPlacement& placement, const ClipProperties& properties, bool& transformed);
+
+		/// Get the size and position of a clip's image (of a size) on the timeline frame, based on its scale type, gravity, crop, and location
+		LayerPlacement place_layer(Clip* source_clip, const ClipProperties& properties, QSize image_size, int64_t frame_number);
+
+		/// @brief Composite the native planes of the clips of a frame (see Settings::YUV_COMPOSITING) into the planes of
+		/// the timeline frame, whose image is only converted to RGB if it is needed (it is deferred)
+		/// @returns False (and composites nothing) if a layer can't be composited in its planes, i.e. if it is rotated,
+		/// its image was changed by an effect, or its planes are not a format supported by openshot::PlaneCompositor
+		bool composite_planes(const std::shared_ptr<Frame>& new_frame, const FramePlan& frame_plan, const std::vector<std::shared_ptr<Frame> >& layer_frames, QColor background, int composite_bands);
+
+		/// @brief Composite the layers of a frame with the openshot::GpuCompositor (see Settings::GPU_COMPOSITING). The
+		/// layers which are not fetched yet are fetched with their point-wise effects as GPU kernels (when all of their
+		/// effects have one, and they have no waveform or timeline effects).
+		/// @returns False (and composites nothing) if a layer draws its frame number, or has image geometry or a placed
+		/// image, or if the GPU fails. The layers fetched with GPU kernels are then removed from layer_frames (so they are
+		/// fetched again, with their effects).
+		bool composite_gpu(const std::shared_ptr<Frame>& new_frame, const FramePlan& frame_plan, std::vector<std::shared_ptr<Frame> >& layer_frames, QColor background);
+
+		/// @brief Composite an image which is only scaled and moved (and cropped) onto an opaque timeline image, with the
+		/// scaling kernels of its pixel format (see PixelKernels::LerpRows). The image is interpolated bilinearly, like
+		/// QPainter's smooth transform, but its edges are not antialiased.
+		/// @param source_rect The part of the source image to draw
+		/// @param x The left edge of the drawn image (in timeline pixels)
+		/// @param y The top edge of the drawn image
+		/// @param width_scale The number of timeline pixels of each source pixel (horizontally)
+		/// @param height_scale The number of timeline pixels of each source pixel (vertically)
+		/// @param alpha The opacity of the drawn image (0 to 1)
+		/// @param composite_bands Number of horizontal bands to composite in parallel
+		void composite_scaled(const std::shared_ptr<QImage>& new_image, const std::shared_ptr<QImage>& source_image, QRect source_rect, float x, float y, float width_scale, float height_scale, float alpha, int composite_bands);
+
+		/// Can an image be composited onto a timeline image by composite_scaled (do both have the same supported pixel layout)
+		bool can_composite_scaled(const std::shared_ptr<QImage>& new_image, const std::shared_ptr<QImage>& source_image);
+
+		/// Add the audio of a layer (with its volume) to the sources mixed into each channel of a timeline frame
+		/// @param channel_sources The sources of each channel of the timeline frame
+		void add_layer_audio(std::vector<std::vector<AudioMixSource> >& channel_sources, const std::shared_ptr<Frame>& new_frame, const std::shared_ptr<Frame>& source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, float max_volume);
+
+		/// Mix the audio of all layers into each channel of a timeline frame (in a single pass per channel)
+		void mix_layer_audio(const std::shared_ptr<Frame>& new_frame, const std::vector<std::vector<AudioMixSource> >& channel_sources);
+
+		/// Apply the waveform and timeline effects to a clip's frame (if any), or only a range of the effects
+		/// @param first_effect The index of the first effect to apply (the waveform is only added from the first effect)
+		/// @param last_effect One past the index of the last effect to apply (-1 = all remaining effects)
+		std::shared_ptr<Frame> apply_layer_effects(std::shared_ptr<Frame> source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, bool is_top_clip, int first_effect = 0, int last_effect = -1);
+
+		/// @brief Get a frame (the body of GetFrame)
+		/// @param is_region_render The frame is rendered for a region (it is not tracked by the access pattern, and not
+		/// looked up in the region cache)
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		/// @param batch_size The number of frames to render (from the requested frame), instead of the batch of the access
+		/// pattern (0 = the batch of the access pattern, which is then updated)
+		std::shared_ptr<Frame> get_frame(int64_t requested_frame, bool is_region_render, int width, int height, int batch_size = 0);
+
+		/// @brief Remove a range of frames from the final cache and the region cache (the regions render them again)
+		/// @param start The first frame number to remove
+		/// @param end The last frame number to remove
+		/// @param remove_audio Remove the mixed audio of the frames too (false for a change which only changes the images)
+		void remove_cached_frames(int64_t start, int64_t end, bool remove_audio = true);
+
+		/// Does a change of clip properties (the changed members of its JSON) change the clip's audio
+		static bool changes_clip_audio(const Json::Value& changed_value);
+
+		/// Clear the region cache (the regions render all their frames again)
+		void clear_region_cache();
+
+		/// Start the region render thread (if the timeline is open, and has a region cache and regions)
+		void start_region_render();
+
+		/// Stop the region render thread (and wait for the frame it is rendering)
+		void stop_region_render();
 
-		/// Process a new layer of video or audio
-		void add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, int64_t clip_frame_number, int64_t timeline_frame_number, bool is_top_clip, float max_volume);
+		/// Render the missing frames of the regions, whenever no frame was requested for Settings::REGION_RENDER_IDLE_MS
+		void region_render_loop();
+
+		/// Find the first frame of the regions which is not rendered (0 if all are rendered). Call with region_mutex held.
+		int64_t next_region_frame();
+
+		/// @brief Get the bounding rectangle of the pixels of an image which are not transparent (the whole image, unless
+		/// the image is premultiplied RGBA8888, ARGB32 or RGBA64). Only this rectangle of a layer is composited, so an animated title or lower third
+		/// only changes its own part of the frame.
+		QRect visible_rect(const std::shared_ptr<QImage>& image);
+
+		/// Determine if a layer is a static layer (a still image with constant keyframes, and no effects)
+		bool is_static_layer(const LayerPlan& layer, int64_t timeline_frame_number);
+
+		/// Count the static layers at the bottom of a frame (which are not hidden, see is_static_layer)
+		int count_static_layers(const FramePlan& frame_plan);
+
+		/// Determine if the static composite has the static layers (and background) of a frame. Call with static_mutex held.
+		bool is_same_static_composite(const FramePlan& frame_plan, int static_layers, bool has_background, QRgb background);
+
+		/// Keep a copy of the composite of the static layers of a frame (for the next frames)
+		void keep_static_composite(const FramePlan& frame_plan, int static_layers, bool has_background, QRgb background, const std::shared_ptr<QImage>& image);
+
+		/// Render a single timeline frame (using the prepared clip frames, or fetching them if empty)
+		std::shared_ptr<Frame> render_frame(const FramePlan& frame_plan, const std::vector<std::shared_ptr<Frame> >& source_frames, int composite_bands);
+
+		/// Render frames with overlapping stages (decode, effects, and composite)
+		/// @param requested_frame The frame which was requested (the frames after it are skipped, see skip_read_ahead)
+		void render_pipeline(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands, int64_t requested_frame);
+
+		/// Render frames as a graph of nodes (see GraphRendering), which decodes each reader frame once
+		/// @param requested_frame The frame which was requested (the frames after it are skipped, see skip_read_ahead)
+		void render_graph(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands, int64_t requested_frame);
+
+		/// Render frames, giving each batched effect (see EffectBase::IsBatched) the frames of the whole batch at once
+		void render_batched(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands);
+
+		/// Get the frame number of an effect at a timeline frame (returns false if the effect is not on this frame and layer)
+		bool get_effect_frame_number(EffectBase* effect, int64_t timeline_frame_number, int layer, int64_t& effect_frame_number);
 
 		/// Apply a FrameMapper to a clip which matches the settings of this timeline
 		void apply_mapper_to_clip(Clip* clip);
 
+		/// Build the render plan for a range of timeline frames (calculated once, before any frames are rendered)
+		///
+		/// @returns A list of openshot::FramePlan objects (one per frame)
+		/// @param nearby_clips The clips which intersect the requested range of frames
+		/// @param requested_frame The first frame number of the range
+		/// @param number_of_frames The number of frames to plan
+		std::vector<FramePlan> build_render_plan(const std::vector<Clip*>& nearby_clips, int64_t requested_frame, int number_of_frames);
+
+		/// Hash the inputs a frame is rendered from (see SetRenderCache), as a hex string
+		std::string render_key(const FramePlan& frame_plan);
+
+		/// Hash the JSON of a clip (with its reader and effects), and the size and modification time of its files
+		QByteArray clip_input_hash(Clip* clip);
+
+		/// @brief Set the render key of each planned frame, and take the frames found in the render cache out of
+		/// the plan (unless reuse is false, i.e. for batched effects, which need the frames of the whole batch)
+		void reuse_rendered_frames(std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& reused_frames, bool reuse);
+
 		/// Apply JSON Diffs to various objects contained in this timeline
 		void apply_json_to_clips(Json::Value change); ///<Apply JSON diff to clips
 		void apply_json_to_effects(Json::Value change); ///< Apply JSON diff to effects
 		void apply_json_to_effects(Json::Value change, EffectBase* existing_effect); ///<Apply JSON diff to a specific effect
 		void apply_json_to_timeline(Json::Value change); ///<Apply JSON diff to timeline properties
 
+		/// Find the frames changed by a JSON diff of keyframes (returns false if the diff changes more than keyframes)
+		bool changed_keyframe_frames(Json::Value old_value, Json::Value new_value, int64_t first_frame, int64_t last_frame, int64_t& changed_first, int64_t& changed_last);
+
+		/// Compare JSON values (numbers are compared by value, since a parsed number can have a different type)
+		bool same_json_value(const Json::Value& a, const Json::Value& b);
+
+		/// Remove the cached frames of a clip or effect's frame range (in clip or effect frames)
+		void remove_changed_frames(ClipBase* item, int64_t changed_first, int64_t changed_last, bool remove_audio = true);
+
 		/// Calculate time of a frame number, based on a framerate
 		double calculate_time(int64_t number, Fraction rate);
 
@@ -180,11 +508,21 @@ namespace openshot {
 		/// @param include Include or Exclude intersecting clips
 		std::vector<Clip*> find_intersecting_clips(int64_t requested_frame, int number_of_frames, bool include);
 
-		/// Get or generate a blank frame
-		std::shared_ptr<Frame> GetOrCreateFrame(Clip* clip, int64_t number);
+		/// Get or generate a blank frame (with the clip's image decoded at a size, if any, or only for its audio)
+		/// @param gpu_kernels The GPU kernels of the clip's effects, which are then not applied (see Clip::GetFrame), or NULL
+		std::shared_ptr<Frame> GetOrCreateFrame(Clip* clip, int64_t number, int width, int height, bool audio_only, std::vector<EffectBase::GpuKernel>* gpu_kernels = NULL);
 
-		/// Apply effects to the source frame (if any)
-		std::shared_ptr<Frame> apply_effects(std::shared_ptr<Frame> frame, int64_t timeline_frame_number, int layer);
+		/// Determine the size a clip's image is drawn at, if it is only scaled (and moved), so it can be decoded
+		/// at that size and composited without scaling (returns false when the image must be decoded at full size)
+		bool get_layer_draw_size(Clip* clip, const ClipProperties& properties, int64_t timeline_frame_number, int& width, int& height);
+
+		/// Apply effects to the source frame (if any), skipping pixels outside the visible region (if not null)
+		/// @param first_effect The index of the first effect to apply
+		/// @param last_effect One past the index of the last effect to apply (-1 = all remaining effects)
+		std::shared_ptr<Frame> apply_effects(std::shared_ptr<Frame> frame, int64_t timeline_frame_number, int layer, QRect visible_region = QRect(), int first_effect = 0, int last_effect = -1);
+
+		/// Get the part of a clip's image which is shown (as fractions of the image size), from its crop keyframes and gravity
+		QRectF clip_crop(Clip* source_clip, const ClipProperties& properties);
 
 		/// Compare 2 floating point numbers for equality
 		bool isEqual(double a, double b);
@@ -198,6 +536,32 @@ namespace openshot {
 		/// Update the list of 'opened' clips
 		void update_open_clips(Clip *clip, bool does_clip_intersect);
 
+		/// Determine if a clip's image is opaque and covers the entire timeline frame (hiding all layers below it)
+		bool is_opaque_full_frame(Clip* clip, const ClipProperties& properties, int64_t timeline_frame_number);
+
+		/// Rebuild the clip and effect interval indexes (if any clips or effects of this timeline have changed)
+		void update_clip_intervals();
+
+		/// @brief Insert, move, or remove the interval of a single clip in the clip interval index (instead of rebuilding it)
+		///
+		/// The clips must be sorted (i.e. by sort_clips) first. If the index was not up to date before the clip was added
+		/// or changed, it is rebuilt on the next frame request instead.
+		/// @param changes The number of clip_changes before the clip was added or changed
+		/// @param remove Remove the interval of the clip (it was removed from the timeline)
+		void update_clip_interval(Clip* clip, int64_t changes, bool remove);
+
+		/// Rebuild the index of timeline effects on each layer (called by update_clip_intervals)
+		void update_effect_intervals();
+
+		/// Find the timeline effects on a layer at a timeline frame (in the order they are applied)
+		std::vector<EffectInterval*> find_layer_effects(int64_t timeline_frame_number, int layer);
+
+		/// Update the detected access pattern with a newly requested frame number
+		void update_access_pattern(int64_t requested_frame);
+
+		/// Calculate how many frames to render for a cache miss (based on the access pattern)
+		int calculate_batch_size();
+
 	public:
 
 		/// @brief Default Constructor for the timeline (which sets the canvas width and height and FPS)
@@ -234,25 +598,154 @@ namespace openshot {
 		/// Return a list of clips on the timeline
 		std::list<Clip*> Clips() { return clips; };
 
+		/// Return the detected order in which frames are being requested (sequential, reverse, or random)
+		AccessPatternType AccessPattern() { return access_pattern; };
+
+		/// Return the number of frames rendered by the last cache miss (i.e. the read-ahead batch size)
+		int LastBatchSize() { return last_batch_size; };
+
+		/// Determine if frames are rendered with a staged pipeline (decode, effects, and composite overlapping)
+		bool PipelineRendering() { return pipeline_rendering; };
+
+		/// @brief Render frames with a staged pipeline, where decoding of later frames, effects, and compositing
+		/// of earlier frames run concurrently (useful to keep all cores busy during long exports)
+		void PipelineRendering(bool enabled) { pipeline_rendering = enabled; };
+
+		/// Determine if frames are rendered as a graph of decode, map, effect, and composite nodes
+		bool GraphRendering() { return graph_rendering; };
+
+		/// @brief Render each batch of frames as a graph of decode, map, effect, and composite nodes (see
+		/// openshot::RenderGraph), which run as soon as their inputs are ready. A reader frame used by several clip
+		/// frames (i.e. a slowed down clip) is only decoded once, and the clips of a frame are decoded in parallel
+		/// (each reader still decodes its frames in sequence). Batched effects (see EffectBase::IsBatched) still
+		/// render their batches together.
+		void GraphRendering(bool enabled) { graph_rendering = enabled; };
+
+		/// Get the NUMA node this timeline renders on (or -1, for the shared TaskPool)
+		int NumaNode() { return numa_node; };
+
+		/// @brief Render frames on the workers of a NUMA node (see TaskPool::ForNode()), so their images are
+		/// allocated in the memory of that node. Several timelines can render on the same node.
+		/// @param node The NUMA node (-1 for the shared TaskPool)
+		void NumaNode(int node) { numa_node = node; };
+
+		/// Get the cache of the rendered region frames (or NULL, if regions are not rendered)
+		CacheBase* RegionCache() { return region_cache; };
+
+		/// @brief Set the cache of the rendered region frames (i.e. an openshot::CacheDisk, so long regions fit). The
+		/// timeline doesn't delete it, and clears it when the timeline is closed.
+		/// @param cache The cache which holds the rendered region frames (NULL to stop rendering regions)
+		void RegionCache(CacheBase* cache);
+
+		/// @brief Render a region of the timeline in the background (i.e. the heavy parts of a project, between the in and
+		/// out points of the editor), whenever no frames are requested for Settings::REGION_RENDER_IDLE_MS. GetFrame()
+		/// then returns the rendered frames of the region cache, until an edit (see ApplyJsonDiff) changes them.
+		/// @param start The first frame number of the region
+		/// @param end The last frame number of the region
+		void AddRenderRegion(int64_t start, int64_t end);
+
+		/// Stop rendering all regions (the rendered frames stay in the region cache, until they are changed)
+		void ClearRenderRegions();
+
+		/// Return the number of region frames which are rendered (and in the region cache)
+		int64_t RenderedRegionFrames();
+
+		/// @brief Notify the timeline that its clips (or effects) have changed
+		///
+		/// The timeline keeps an index of clip and effect frame ranges, which is updated automatically by AddClip(),
+		/// RemoveClip(), AddEffect(), RemoveEffect(), ApplyJsonDiff(), and SetJson(), and when the position, layer,
+		/// start, or end of one of its clips or effects changes (i.e. by calling Clip::Position()). This method
+		/// refreshes the index for any other change.
+		void ClipsChanged() { clip_intervals_dirty = true; effect_intervals_dirty = true; };
+
 		/// Close the timeline reader (and any resources it was consuming)
 		void Close();
 
 		/// Return the list of effects on the timeline
 		std::list<EffectBase*> Effects() { return effects; };
 
+		/// Generate a JSON string of the timing counters of all effects (see EffectTimingJsonValue)
+		std::string EffectTimingJson();
+
+		/// Generate a JSON object of the timing counters of all effects: an "effects" array (for the timeline's
+		/// effects), and a "clips" array (for the effects of each clip with effects, see Clip::EffectTimingJsonValue)
+		Json::Value EffectTimingJsonValue();
+
+		/// Reset the timing counters of all effects (of the timeline and its clips)
+		void ResetEffectTiming();
+
+		/// @brief Find the clip whose frames pass through the timeline unchanged, for a range of frames (a single,
+		/// opaque, untransformed clip without effects, which fills the frames at its own size, and plays at normal
+		/// speed and full volume), or NULL if there is no such clip (i.e. to copy the range from the clip's file)
+		/// @param start The first frame number of the range
+		/// @param end The last frame number of the range
+		/// @param clip_start_frame Returns the clip's frame number of the first frame of the range
+		Clip* FindPassThroughClip(int64_t start, int64_t end, int64_t &clip_start_frame);
+
 		/// Get the cache object used by this reader
 		CacheBase* GetCache() { return final_cache; };
 
+		/// Get the cache of the mixed audio (the frames of GetAudioFrame(), which are kept when an edit only changes images)
+		CacheMemory* GetAudioCache() { return &audio_cache; };
+
 		/// Set the cache object used by this reader. You must now manage the lifecycle
 		/// of this cache object though (Timeline will not delete it for you).
 		void SetCache(CacheBase* new_cache);
 
+		/// Get the cache of the frames rendered in any session (see SetRenderCache), or NULL
+		CacheDisk* GetRenderCache() { return render_cache; };
+
+		/// @brief Set a disk cache which keeps the rendered frames across sessions (see CacheDisk::AddKeyed). Each
+		/// frame is keyed by a hash of its inputs (the library version, the settings which change rendered pixels, the
+		/// timeline's size, format, background, and effects, the JSON and frame number of each clip, and the size and modification time of the clips' files),
+		/// so a frame is only rendered again when its inputs change, by this session, another session, or another
+		/// machine using the same folder. Timeline will not delete the cache (and NULL disables it).
+		void SetRenderCache(CacheDisk* new_cache) { render_cache = new_cache; };
+
 		/// Get an openshot::Frame object for a specific frame number of this timeline.
 		///
 		/// @returns The requested frame (containing the image)
 		/// @param requested_frame The frame number that is requested.
 		std::shared_ptr<Frame> GetFrame(int64_t requested_frame);
 
+		/// @brief Get a frame, rendered at the size it will be drawn at, when this timeline is the reader of a clip of
+		/// another timeline (a nested timeline, or precomp). The clips of this timeline are then decoded at their
+		/// smaller size too. A cached frame can be larger, and a smaller cached frame is rendered again.
+		///
+		/// @returns The requested frame (with an image of the aspect ratio of the full size frames)
+		/// @param requested_frame The frame number that is requested.
+		/// @param width The width the image will be drawn at (0 = full size)
+		/// @param height The height the image will be drawn at (0 = full size)
+		std::shared_ptr<Frame> GetFrame(int64_t requested_frame, int width, int height);
+
+		/// Get a range of consecutive frames, rendered in batches of a frame per worker thread (instead of the batches
+		/// of the access pattern)
+		///
+		/// @returns The frames (in order)
+		/// @param start The first frame number
+		/// @param count The number of frames
+		std::vector<std::shared_ptr<Frame> > GetFrames(int64_t start, int64_t count);
+
+		/// Return the number of edits of this timeline (a timeline it is nested in removes the changed frames, when
+		/// the number changes)
+		int64_t EditGeneration() { return edit_generation; };
+
+		/// @brief Get the frames changed by the edits after an edit generation (see EditGeneration). All frames are
+		/// changed when the edits are too old to be recorded, or an edit changed the whole timeline.
+		/// @param since_generation The edit generation the frames were rendered at
+		/// @param first Returns the first changed frame number (larger than last, if no frames changed)
+		/// @param last Returns the last changed frame number
+		void ChangedFrames(int64_t since_generation, int64_t& first, int64_t& last);
+
+		/// Get an openshot::Frame object for a specific frame number of this timeline, for its audio only.
+		/// Only the audio of the clips is mixed (no images are composited, and no effects are applied),
+		/// and the frame is kept in the audio cache (see GetAudioCache()) until an edit changes its audio.
+		/// A frame already rendered by GetFrame() is returned as is.
+		///
+		/// @returns The requested frame (containing the mixed audio, with a blank image)
+		/// @param requested_frame The frame number that is requested.
+		std::shared_ptr<Frame> GetAudioFrame(int64_t requested_frame);
+
 		// Curves for the viewport
 		Keyframe viewport_scale; ///<Curve representing the scale of the viewport (0 to 100)
 		Keyframe viewport_x; ///<Curve representing the x coordinate for the viewport
@@ -267,16 +760,52 @@ namespace openshot {
 		/// Return the type name of the class
 		std::string Name() { return "Timeline"; };
 
+		/// Get the runtime metrics of this timeline as a JSON string: its render times and cache, the seeks and cache
+		/// of each clip's reader, and the process-wide openshot::Metrics (decode and encode rates, writer queue, etc...)
+		std::string Metrics();
+
+		/// Get the runtime metrics of this timeline as a JSON value (see Metrics())
+		Json::Value MetricsValue();
+
+		/// Send the runtime metrics of this timeline to the subscribers of the openshot::ZmqLogger (if logging is enabled)
+		void PublishMetrics();
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
 		Json::Value JsonValue(); ///< Generate Json::JsonValue for this object
 		void SetJsonValue(Json::Value root); ///< Load Json::JsonValue into this object
 
-		/// Set Max Image Size (used for performance optimization). Convenience function for setting
-		/// Settings::Instance()->MAX_WIDTH and Settings::Instance()->MAX_HEIGHT.
+		/// @brief Save a binary snapshot of the timeline (its clips, keyframes, and effects, see WriteBinaryJson),
+		/// which loads much faster than the JSON of a large project (i.e. when restarting a render worker)
+		/// @param path The path of the snapshot file
+		void SaveSnapshot(std::string path);
+
+		/// @brief Load a binary snapshot of the timeline (see SaveSnapshot). As with SetJson(), the readers of the
+		/// clips are only opened when the clips are rendered.
+		/// @param path The path of the snapshot file
+		void LoadSnapshot(std::string path);
+
+		/// Set Max Image Size (used for performance optimization). The readers of this timeline decode at this
+		/// size, independent of the other timelines (i.e. a preview and an export) and of Settings::MAX_WIDTH.
+		///
+		/// The frames cached at the previous size are kept, so switching a preview between two sizes (i.e. fit and
+		/// 100%) doesn't render the frames again. Frames cached at a larger size are downscaled for a smaller size.
 		void SetMaxSize(int width, int height);
 
+		/// Get the max image width of this timeline's frames (see SetMaxSize)
+		int MaxWidth() { return render_width; };
+
+		/// Get the max image height of this timeline's frames (see SetMaxSize)
+		int MaxHeight() { return render_height; };
+
+		/// Set the FFmpeg decoder speed options of this timeline's readers (see Settings::DECODE_SPEED), which a
+		/// preview raises while its playback falls behind. Other timelines (i.e. an export) decode exactly.
+		void DecodeSpeed(int speed) { decode_speed = std::max(speed, 0); };
+
+		/// Get the FFmpeg decoder speed options of this timeline's readers
+		int DecodeSpeed() { return decode_speed; };
+
 		/// @brief Apply a special formatted JSON object, which represents a change to the timeline (add, update, delete)
 		/// This is primarily designed to keep the timeline (and its child objects... such as clips and effects) in sync
 		/// with another application... such as OpenShot Video Editor (http://www.openshot.org).
@@ -0,0 +1,211 @@
+/**
+ * @file
+ * @brief Header file for Tracer class (performance trace spans, saved as Chrome trace JSON)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_TRACE_H
+#define OPENSHOT_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Json.h"
+
+namespace openshot {
+
+	/**
+	 * @brief A timed span of work, recorded by the openshot::Tracer
+	 */
+	struct TraceEvent {
+		const char *name; ///< The name of the span (a string literal)
+		const char *category; ///< The stage of the pipeline (decode, seek, mapping, clip, effects, composite, timeline, encode)
+		int64_t start; ///< Microseconds since the trace started
+		int64_t duration; ///< Microseconds the span took
+		int64_t frame; ///< The frame number the span worked on (or -1)
+		int thread; ///< The thread which recorded the span
+	};
+
+	/**
+	 * @brief This class collects the trace spans of the library, which show where the time of each frame goes
+	 *
+	 * Spans (decode, seek, mapping, effects, composite, encode, etc...) are recorded by openshot::TraceSpan,
+	 * into a buffer of each thread (so threads don't wait on each other), only while tracing is started.
+	 * Otherwise a span costs a single branch. The trace is saved in the Chrome trace event format, which
+	 * chrome://tracing and the Perfetto UI (https://ui.perfetto.dev) open.
+	 *
+	 * @code
+	 * openshot::Tracer::Instance()->Start();
+	 * timeline.GetFrame(1);
+	 * openshot::Tracer::Instance()->Stop();
+	 * openshot::Tracer::Instance()->Save("trace.json");
+	 * @endcode
+	 */
+	class Tracer {
+	private:
+		/// The spans recorded by a single thread
+		struct ThreadEvents {
+			std::mutex events_mutex; ///< Only contended while the trace is collected
+			std::vector<TraceEvent> events;
+			int thread;
+		};
+
+		std::mutex threads_mutex;
+		std::vector<std::shared_ptr<ThreadEvents> > threads; ///< The span buffer of each thread which recorded a span
+		std::atomic<int64_t> start_time; ///< The steady clock (in microseconds) when the trace started
+
+		/// Get the steady clock in microseconds
+		static int64_t clock_microseconds();
+
+		/// Constructor (private, because this is a singleton)
+		Tracer() : start_time(clock_microseconds()) { for (int index = 0; index < 8; index++) stage_times[index] = 0; };
+
+		/// Don't allow the user to copy or assign this instance
+		Tracer(Tracer const&) = delete;
+		Tracer & operator=(Tracer const&) = delete;
+
+		/// Private variable to keep track of singleton instance
+		static Tracer * m_pInstance;
+
+		/// Get the span buffer of the calling thread
+		ThreadEvents *thread_events();
+
+		/// Is tracing started (checked by each span before it records anything)
+		static std::atomic<bool> is_tracing;
+
+		/// Are the stage times summed (see StartStageTimes())
+		static std::atomic<bool> is_timing;
+
+		/// The microseconds summed for each stage (in the order of the categories of TraceEvent)
+		std::atomic<int64_t> stage_times[8];
+
+	public:
+		/// Create or get an instance of this tracer singleton (invoke the class with this method)
+		static Tracer * Instance();
+
+		/// Clear the recorded spans, and start recording
+		void Start();
+
+		/// Stop recording (the recorded spans are kept until the trace is started again)
+		void Stop();
+
+		/// Is tracing started
+		static bool IsTracing() { return is_tracing.load(std::memory_order_relaxed); }
+
+		/// Get the microseconds since the trace started
+		int64_t Now();
+
+		/// @brief Start summing the time of each stage (without recording the spans, so it can run during playback)
+		///
+		/// The times of each stage are summed over all threads (so a stage which runs on many threads can add up
+		/// to more than the elapsed time), and the spans nested in a span are counted in both stages.
+		void StartStageTimes();
+
+		/// Stop summing the time of each stage
+		void StopStageTimes();
+
+		/// Are the stage times summed
+		static bool IsTiming() { return is_timing.load(std::memory_order_relaxed); }
+
+		/// Add the microseconds of a span to its stage (see StartStageTimes())
+		void AddStageTime(const char *category, int64_t start);
+
+		/// Get the microseconds summed for a stage (i.e. "decode"), since StartStageTimes()
+		int64_t StageTime(std::string category);
+
+		/// @brief Record a span
+		/// @param name The name of the span (a string literal, which must outlive the trace)
+		/// @param category The stage of the pipeline (a string literal)
+		/// @param start The microseconds since the trace started, when the span began (see Now())
+		/// @param frame The frame number the span worked on (or -1)
+		void AddSpan(const char *name, const char *category, int64_t start, int64_t frame);
+
+		/// Get all recorded spans (sorted by their start)
+		std::vector<TraceEvent> Events();
+
+		/// Get the recorded spans as a Chrome trace JSON string
+		std::string Json();
+
+		/// Get the recorded spans as a Chrome trace JSON value
+		Json::Value JsonValue();
+
+		/// Get the time of each stage (category) of the recorded spans as a JSON string (see StageValue())
+		std::string StageJson();
+
+		/// @brief Get the time of each stage (category) of the recorded spans as a JSON value
+		///
+		/// Each stage has its number of spans, their total milliseconds, and their self milliseconds (without the
+		/// spans nested in them on the same thread, such as the decoding inside a clip). With
+		/// Settings::DETERMINISTIC_RENDER, every stage runs on the rendering thread, so the self times add up to the
+		/// time of the outermost spans.
+		Json::Value StageValue();
+
+		/// Save the recorded spans as a Chrome trace JSON file (for chrome://tracing or the Perfetto UI)
+		void Save(std::string path);
+	};
+
+	/**
+	 * @brief A scoped trace span, recorded by the openshot::Tracer when it goes out of scope (if tracing is started)
+	 *
+	 * @code
+	 * TraceSpan span("FFmpegReader::ReadStream", "decode", requested_frame);
+	 * @endcode
+	 */
+	class TraceSpan {
+	private:
+		const char *name;
+		const char *category;
+		int64_t frame;
+		int64_t start;
+		bool active;
+
+	public:
+		/// Start a span (the name and category must be string literals)
+		TraceSpan(const char *name, const char *category, int64_t frame = -1)
+			: name(name), category(category), frame(frame), start(0), active(Tracer::IsTracing() || Tracer::IsTiming())
+		{
+			if (active)
+				start = Tracer::Instance()->Now();
+		}
+
+		/// Record the span
+		~TraceSpan()
+		{
+			if (active && Tracer::IsTracing())
+				Tracer::Instance()->AddSpan(name, category, start, frame);
+			if (active && Tracer::IsTiming())
+				Tracer::Instance()->AddStageTime(category, start);
+		}
+	};
+
+}
+
+#endif
@@ -97,6 +97,9 @@ namespace openshot
 		/// @param reader The source reader to copy
 		void CopyReaderInfo(openshot::ReaderBase* reader);
 
+		/// Close the writer (and finish writing the file)
+		virtual void Close() = 0;
+
 		/// Determine if writer is open or closed
 		virtual bool IsOpen() = 0;
 
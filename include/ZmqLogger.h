@@ -32,6 +32,7 @@
 #define OPENSHOT_LOGGER_H
 
 
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -39,6 +40,7 @@
 #include <string>
 #include <sstream>
 #include <stdio.h>
+#include <thread>
 #include <time.h>
 #include <zmq.hpp>
 #include <unistd.h>
@@ -69,6 +71,35 @@ namespace openshot {
 		/// ZMQ Socket
 		zmq::socket_t *publisher;
 
+		/// A message waiting to be sent (and written to the log file)
+		struct LogMessage {
+			std::string text;
+			bool file_only; ///< Only written to the log file (not sent over the socket)
+			LogMessage *next;
+		};
+
+		/// Messages waiting for the sender thread (pushed without a lock by any thread, newest first)
+		std::atomic<LogMessage*> pending_messages;
+
+		/// Sends the pending messages in batches (so logging threads never wait on the socket or the disk)
+		std::thread sender_thread;
+		std::atomic<bool> sender_stop;
+
+		/// Send the pending messages in batches (until the logger is closed)
+		void sender_loop();
+
+		/// Push a message on the queue of pending messages (lock free)
+		void push_message(const std::string &message, bool file_only);
+
+		/// Send (and write) the messages which are still queued when the process exits
+		static void flush_at_exit();
+
+		/// Bind the publisher socket to the connection (when logging is enabled)
+		void bind_publisher();
+
+		/// Send (and write) the pending messages in order, flushing the log file once
+		void write_pending_messages();
+
 		/// Default constructor
 		ZmqLogger(){}; 						 // Don't allow user to create an instance of this singleton
 
@@ -89,35 +120,72 @@ namespace openshot {
 		/// Private variable to keep track of singleton instance
 		static ZmqLogger * m_pInstance;
 
+		/// Format and send debug information (only called when logging is enabled)
+		void append_debug_method(const char* method_name,
+					const char* arg1_name, float arg1_value,
+					const char* arg2_name, float arg2_value,
+					const char* arg3_name, float arg3_value,
+					const char* arg4_name, float arg4_value,
+					const char* arg5_name, float arg5_value,
+					const char* arg6_name, float arg6_value);
+
 	public:
 		/// Create or get an instance of this logger singleton (invoke the class with this method)
 		static ZmqLogger * Instance();
 
-		/// Append debug information
-		void AppendDebugMethod(std::string method_name,
-					std::string arg1_name="", float arg1_value=-1.0,
-					std::string arg2_name="", float arg2_value=-1.0,
-					std::string arg3_name="", float arg3_value=-1.0,
-					std::string arg4_name="", float arg4_value=-1.0,
-					std::string arg5_name="", float arg5_value=-1.0,
-					std::string arg6_name="", float arg6_value=-1.0);
+		/// Append debug information (inline, so a disabled logger costs a single branch, without copying any names)
+		void AppendDebugMethod(const char* method_name,
+					const char* arg1_name="", float arg1_value=-1.0,
+					const char* arg2_name="", float arg2_value=-1.0,
+					const char* arg3_name="", float arg3_value=-1.0,
+					const char* arg4_name="", float arg4_value=-1.0,
+					const char* arg5_name="", float arg5_value=-1.0,
+					const char* arg6_name="", float arg6_value=-1.0)
+		{
+			if (enabled)
+				append_debug_method(method_name, arg1_name, arg1_value, arg2_name, arg2_value, arg3_name, arg3_value,
+									arg4_name, arg4_value, arg5_name, arg5_value, arg6_name, arg6_value);
+		}
+
+		/// Append debug information, with a method name built at runtime (check IsEnabled() before building it in hot code)
+		void AppendDebugMethod(const std::string& method_name,
+					const char* arg1_name="", float arg1_value=-1.0,
+					const char* arg2_name="", float arg2_value=-1.0,
+					const char* arg3_name="", float arg3_value=-1.0,
+					const char* arg4_name="", float arg4_value=-1.0,
+					const char* arg5_name="", float arg5_value=-1.0,
+					const char* arg6_name="", float arg6_value=-1.0)
+		{
+			if (enabled)
+				append_debug_method(method_name.c_str(), arg1_name, arg1_value, arg2_name, arg2_value, arg3_name, arg3_value,
+									arg4_name, arg4_value, arg5_name, arg5_value, arg6_name, arg6_value);
+		}
+
+		/// Is logging enabled (to skip building debug messages which are not used)
+		bool IsEnabled() const { return enabled; }
 
 		/// Close logger (sockets and/or files)
 		void Close();
 
-		/// Set or change connection info for logger (i.e. tcp://*:5556)
+		/// Set or change connection info for logger (i.e. tcp://*:5556), which is bound when logging is enabled
 		void Connection(std::string new_connection);
 
-		/// Enable/Disable logging
-		void Enable(bool is_enabled) { enabled = is_enabled;};
+		/// Enable/Disable logging (the socket is bound, and the messages are sent by a background thread, when logging is first enabled)
+		void Enable(bool is_enabled);
+
+		/// Send (and write) all messages logged so far, before returning
+		void Flush();
 
 		/// Set or change the file path (optional)
 		void Path(std::string new_path);
 
-		/// Log message to all subscribers of this logger (if any)
+		/// Log message to all subscribers of this logger (if any), and the log file (queued without waiting)
 		void Log(std::string message);
 
-		/// Log message to a file (if path set)
+		/// @brief Log message to a file (if path set), after the queued messages (and flush it to disk, in case of a crash)
+		///
+		/// This never waits for the lock of the logger: when another thread holds it, the message is queued instead
+		/// (and written by the sender thread, or when the process exits).
 		void LogToFile(std::string message);
 	};
 
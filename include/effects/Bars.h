@@ -50,6 +50,9 @@ namespace openshot
 	 *
 	 * Adding bars around your video can be done for cinematic reasons, and creates a fun way to frame
 	 * in the focal point of a scene. The bars can be any color, and each side can be animated independently.
+	 *
+	 * The bars are kept as geometry of the frame (see Frame::FillImageRect()), so the timeline compositor
+	 * fills them, instead of this effect painting their pixels.
 	 */
 	class Bars : public EffectBase
 	{
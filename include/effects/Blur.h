@@ -66,10 +66,10 @@ namespace openshot
 		/// Init effect settings
 		void init_effect_details();
 
-		/// Internal blur methods (inspired and credited to http://blog.ivank.net/fastest-gaussian-blur.html)
-		int* initBoxes(float sigma, int n);
-		void boxBlurH(unsigned char *scl, unsigned char *tcl, int w, int h, int r);
-		void boxBlurT(unsigned char *scl, unsigned char *tcl, int w, int h, int r);
+		/// Internal blur methods (inspired and credited to http://blog.ivank.net/fastest-gaussian-blur.html),
+		/// which blur the rows (or columns) of RGBA pixels from a source image into a target image, in parallel
+		static void boxBlurH(const unsigned char *source, unsigned char *target, int w, int h, int bytes_per_line, int r);
+		static void boxBlurT(const unsigned char *source, unsigned char *target, int w, int h, int bytes_per_line, int r);
 
 
 	public:
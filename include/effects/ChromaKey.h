@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <memory>
 #include "../Color.h"
+#include "../PixelKernels.h"
 #include "../Exceptions.h"
 #include "../KeyFrame.h"
 
@@ -57,6 +58,9 @@ namespace openshot
 	private:
 		Color color;
 		Keyframe fuzz;
+		Keyframe softness;
+		Keyframe spill;
+		bool chroma_distance;
 
 		/// Init effect settings
 		void init_effect_details();
@@ -74,6 +78,16 @@ namespace openshot
 		/// @param fuzz The fuzz factor (or threshold)
 		ChromaKey(Color color, Keyframe fuzz);
 
+		/// Constructor with a soft edge and spill suppression, which optionally matches colors
+		/// by their chroma (CbCr) alone, so the brightness of the screen does not matter.
+		///
+		/// @param color The color to match
+		/// @param fuzz The fuzz factor (or threshold)
+		/// @param softness The width of the soft edge, above the fuzz distance (0 is a hard edge)
+		/// @param spill The amount of the key color to remove from the remaining pixels (0 to 1)
+		/// @param chroma_distance Match colors by their chroma distance, instead of the RGB distance
+		ChromaKey(Color color, Keyframe fuzz, Keyframe softness, Keyframe spill, bool chroma_distance=false);
+
 		/// @brief This method is required for all derived classes of EffectBase, and returns a
 		/// modified openshot::Frame object
 		///
@@ -85,6 +99,12 @@ namespace openshot
 		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
 		std::shared_ptr<Frame> GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number);
 
+		/// Get the point-wise kernel of this effect, for a frame number (see EffectBase::GetPixelKernel)
+		PixelKernel GetPixelKernel(int64_t frame_number);
+
+		/// Get the GPU kernel of this effect, for a frame number (see EffectBase::GetGpuKernel)
+		GpuKernel GetGpuKernel(int64_t frame_number);
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
@@ -50,6 +50,9 @@ namespace openshot
 	 *
 	 * Cropping images can be useful when wanting to remove a border around an image or video, and animating
 	 * the crop can create some very interesting effects.
+	 *
+	 * The crop is kept as geometry of the frame (see Frame::ClipImage()), so the timeline compositor skips
+	 * the cropped pixels, instead of this effect making them transparent.
 	 */
 	class Crop : public EffectBase
 	{
@@ -32,6 +32,7 @@
 #define OPENSHOT_DEINTERLACE_EFFECT_H
 
 #include "../EffectBase.h"
+#include "../FieldKernels.h"
 
 #include <cmath>
 #include <ctime>
@@ -58,6 +59,7 @@ namespace openshot
 	{
 	private:
 		bool isOdd;
+		bool interpolate; ///< Rebuild the removed lines with linear interpolation (instead of repeating lines)
 
 		/// Init effect settings
 		void init_effect_details();
@@ -68,7 +70,10 @@ namespace openshot
 		Deinterlace();
 
 		/// Default constructor
-		Deinterlace(bool isOdd);
+		///
+		/// @param isOdd Keep the odd lines (or the even lines)
+		/// @param interpolate Rebuild the removed lines with linear interpolation (or repeat the kept lines)
+		Deinterlace(bool isOdd, bool interpolate = false);
 
 		/// @brief This method is required for all derived classes of EffectBase, and returns a
 		/// modified openshot::Frame object
@@ -38,6 +38,7 @@
 #include <memory>
 #include "../Json.h"
 #include "../KeyFrame.h"
+#include "../PixelKernels.h"
 
 
 namespace openshot
@@ -78,6 +79,15 @@ namespace openshot
 		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
 		std::shared_ptr<Frame> GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number);
 
+		/// Get the point-wise kernel of this effect, for a frame number (see EffectBase::GetPixelKernel)
+		PixelKernel GetPixelKernel(int64_t frame_number);
+
+		/// Get the GPU kernel of this effect, for a frame number (see EffectBase::GetGpuKernel)
+		GpuKernel GetGpuKernel(int64_t frame_number);
+
+		/// The pixel kernel of this effect only changes colors (see EffectBase::IsColorKernel)
+		bool IsColorKernel() { return true; }
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
@@ -38,7 +38,11 @@
 #include <iostream>
 #include <omp.h>
 #include <stdio.h>
+#include <deque>
+#include <map>
 #include <memory>
+#include <vector>
+#include <QSize>
 #include "../Color.h"
 #include "../Exceptions.h"
 #include "../Json.h"
@@ -66,12 +70,20 @@ namespace openshot
 	{
 	private:
 		ReaderBase *reader;
-		std::shared_ptr<QImage> original_mask;
+		std::map<int64_t, std::shared_ptr<std::vector<unsigned char> > > cached_masks; ///< Gray values of the scaled mask frames (by frame number)
+		std::deque<int64_t> cached_mask_order; ///< Frame numbers of the cached masks (oldest first)
+		QSize cached_mask_size; ///< The size of the cached masks
 		bool needs_refresh;
 
+		/// The maximum number of scaled mask frames to keep
+		static const size_t max_cached_masks = 16;
+
 		/// Init effect settings
 		void init_effect_details();
 
+		/// Get the gray values of a mask frame, scaled to the frame size (scaled masks are cached)
+		std::shared_ptr<std::vector<unsigned char> > get_scaled_mask(int64_t frame_number, int width, int height);
+
 	public:
 		bool replace_image;		///< Replace the frame image with a grayscale image representing the mask. Great for debugging a mask.
 		Keyframe brightness;	///< Brightness keyframe to control the wipe / mask effect. A constant value here will prevent animation.
@@ -100,6 +112,10 @@ namespace openshot
 		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
 		std::shared_ptr<Frame> GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number);
 
+		/// Get a key of what this effect does to an image at a frame number (which includes the mask reader, and
+		/// the frame number of a video mask)
+		std::string OutputKey(int64_t frame_number);
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
@@ -114,7 +130,7 @@ namespace openshot
 		ReaderBase* Reader() { return reader; };
 
 		/// Set a new reader to be used by the mask effect (grayscale image)
-		void Reader(ReaderBase *new_reader) { reader = new_reader; };
+		void Reader(ReaderBase *new_reader) { reader = new_reader; needs_refresh = true; };
 	};
 
 }
@@ -36,6 +36,7 @@
 #include <cmath>
 #include <stdio.h>
 #include <memory>
+#include <vector>
 #include "../Json.h"
 #include "../KeyFrame.h"
 
@@ -53,10 +54,15 @@ namespace openshot
 	{
 	private:
 		//unsigned char *perm;
+		std::shared_ptr<std::vector<float> > cached_wave_offsets; ///< Pixel offset of each row of the last frame
+		std::vector<double> cached_wave_key; ///< Height, phase and keyframe values of the cached offsets
 
 		/// Init effect settings
 		void init_effect_details();
 
+		/// Get the pixel offsets of each row of the wave (the offsets of the last frame are reused, if nothing changed)
+		std::shared_ptr<std::vector<float> > get_wave_offsets(int height, double phase, double wavelength_value, double amplitude_value, double multiplier_value, double shift_x_value);
+
 	public:
 		Keyframe wavelength;	///< The length of the wave
 		Keyframe amplitude;		///< The height of the wave
@@ -87,6 +93,10 @@ namespace openshot
 		/// @param frame_number The frame number (starting at 1) of the effect on the timeline.
 		std::shared_ptr<Frame> GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number);
 
+		/// Get a key of what this effect does to an image at a frame number (which includes the frame number,
+		/// if the wave is moving)
+		std::string OutputKey(int64_t frame_number);
+
 		/// Get and Set JSON methods
 		std::string Json(); ///< Generate JSON string of this object
 		void SetJson(std::string value); ///< Load JSON string into this object
@@ -0,0 +1,506 @@
+/**
+ * @file
+ * @brief Source file for AudioAnalyzer class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/AudioAnalyzer.h"
+#include "../include/FFmpegReader.h"
+#include "../include/Settings.h"
+#include "../include/TaskPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+using namespace openshot;
+
+// The loudness of silence (the absolute gate of EBU R128)
+#define SILENT_LOUDNESS -70.0
+
+// The identifier and version of saved analyses
+#define ANALYSIS_MAGIC 0x4F534141
+#define ANALYSIS_VERSION 1
+
+// A biquad filter (transposed direct form II)
+struct Biquad {
+	double b0, b1, b2, a1, a2;
+	double z1, z2;
+
+	double Process(double x) {
+		double y = b0 * x + z1;
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		return y;
+	}
+};
+
+// The 2 stages of the K-weighting filter of ITU-R BS.1770 (a high shelf, and a high pass), for any sample rate
+static void k_weighting(int sample_rate, Biquad& shelf, Biquad& high_pass) {
+	double K = tan(M_PI * 1681.974450955533 / sample_rate);
+	double Q = 0.7071752369554196;
+	double Vh = pow(10.0, 3.999843853973347 / 20.0);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+	shelf.b1 = 2.0 * (K * K - Vh) / a0;
+	shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+	shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+	shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+	K = tan(M_PI * 38.13547087602444 / sample_rate);
+	Q = 0.5003270373238773;
+	a0 = 1.0 + K / Q + K * K;
+	high_pass.b0 = 1.0;
+	high_pass.b1 = -2.0;
+	high_pass.b2 = 1.0;
+	high_pass.a1 = 2.0 * (K * K - 1.0) / a0;
+	high_pass.a2 = (1.0 - K / Q + K * K) / a0;
+
+	shelf.z1 = shelf.z2 = high_pass.z1 = high_pass.z2 = 0.0;
+}
+
+// Convert a mean square power to a loudness (in LUFS)
+static double power_loudness(double power) {
+	if (power <= 0.0)
+		return SILENT_LOUDNESS;
+	return std::max(SILENT_LOUDNESS, -0.691 + 10.0 * log10(power));
+}
+
+// Gate the loudness of a list of blocks (the absolute gate, then a gate relative to the mean of the remaining blocks)
+static std::vector<double> gate_blocks(const std::vector<double>& powers, double relative_gate) {
+	double sum = 0.0;
+	int64_t count = 0;
+	for (double power : powers)
+		if (power_loudness(power) > SILENT_LOUDNESS) {
+			sum += power;
+			count++;
+		}
+	std::vector<double> gated;
+	if (count == 0)
+		return gated;
+
+	double threshold = power_loudness(sum / count) + relative_gate;
+	for (double power : powers)
+		if (power_loudness(power) > SILENT_LOUDNESS && power_loudness(power) > threshold)
+			gated.push_back(power);
+	return gated;
+}
+
+// Add the coarser levels of a peak pyramid (each combines 2 peaks of the previous level)
+static void build_pyramid(std::vector<std::vector<float> >& peaks, int channels) {
+	size_t peak_size = channels * 2;
+	peaks.resize(1);
+	while (peak_size > 0 && peaks.back().size() > peak_size) {
+		const std::vector<float>& previous = peaks.back();
+		size_t count = previous.size() / peak_size;
+		std::vector<float> level(((count + 1) / 2) * peak_size);
+		for (size_t peak = 0; peak < count; peak += 2)
+			for (size_t value = 0; value < peak_size; value += 2) {
+				float minimum = previous[peak * peak_size + value];
+				float maximum = previous[peak * peak_size + value + 1];
+				if (peak + 1 < count) {
+					minimum = std::min(minimum, previous[(peak + 1) * peak_size + value]);
+					maximum = std::max(maximum, previous[(peak + 1) * peak_size + value + 1]);
+				}
+				level[(peak / 2) * peak_size + value] = minimum;
+				level[(peak / 2) * peak_size + value + 1] = maximum;
+			}
+		peaks.push_back(level);
+	}
+}
+
+// The analysis of a chunk of a media file
+struct ChunkAnalysis {
+	int64_t first_sample; ///< The first sample of the chunk
+	int64_t end_sample; ///< The sample after the last sample of the chunk
+	std::vector<double> energy; ///< The weighted sum of the squared (K-weighted) samples of each 100 ms block (from the block of first_sample)
+	std::vector<float> peaks; ///< The minimum and maximum of each channel of each peak (from the peak of first_sample)
+	float peak; ///< The largest absolute sample
+};
+
+// Analyze a range of frames, with a reader of its own (the filters are warmed up on the frames before the range)
+static void analyze_chunk(std::string path, int64_t start_frame, int64_t end_frame, int64_t warmup_frames,
+		int sample_rate, int channels, Fraction fps, ChunkAnalysis& chunk) {
+	FFmpegReader reader(path);
+	reader.EnableStreams(false, true);
+	reader.Open();
+
+	std::vector<Biquad> shelves(channels);
+	std::vector<Biquad> high_passes(channels);
+	for (int channel = 0; channel < channels; channel++)
+		k_weighting(sample_rate, shelves[channel], high_passes[channel]);
+
+	// The surround channels of 5.1 audio are louder (and the LFE channel is left out)
+	std::vector<double> weights(channels, 1.0);
+	if (channels == 6) {
+		weights[3] = 0.0;
+		weights[4] = 1.41;
+		weights[5] = 1.41;
+	}
+
+	int64_t energy_block = sample_rate / 10;
+	int64_t first_frame = std::max(int64_t(1), start_frame - warmup_frames);
+	int64_t position = Frame::GetSamplesBeforeFrame(first_frame, fps, sample_rate, channels);
+	int64_t first_block = 0;
+	int64_t first_peak = 0;
+	chunk.first_sample = position;
+	chunk.peak = 0.0;
+
+	for (int64_t number = first_frame; number <= end_frame; number++) {
+		std::shared_ptr<Frame> frame = reader.GetFrame(number);
+		int count = frame->GetAudioSamplesCount();
+		int frame_channels = std::min(channels, frame->GetAudioChannelsCount());
+		bool measured = number >= start_frame;
+		if (number == start_frame) {
+			chunk.first_sample = position;
+			first_block = position / energy_block;
+			first_peak = position / AUDIO_PEAK_BLOCK;
+		}
+
+		if (measured && count > 0) {
+			chunk.energy.resize((position + count - 1) / energy_block - first_block + 1, 0.0);
+			size_t peak_values = ((position + count - 1) / AUDIO_PEAK_BLOCK - first_peak + 1) * channels * 2;
+			while (chunk.peaks.size() < peak_values) {
+				chunk.peaks.push_back(FLT_MAX);
+				chunk.peaks.push_back(-FLT_MAX);
+			}
+		}
+
+		for (int channel = 0; channel < frame_channels; channel++) {
+			const float *samples = frame->GetAudioSamples(channel);
+			Biquad& shelf = shelves[channel];
+			Biquad& high_pass = high_passes[channel];
+			for (int sample = 0; sample < count; sample++) {
+				double weighted = high_pass.Process(shelf.Process(samples[sample]));
+				if (!measured)
+					continue;
+
+				int64_t index = position + sample;
+				chunk.energy[index / energy_block - first_block] += weights[channel] * weighted * weighted;
+				float *peak = &chunk.peaks[((index / AUDIO_PEAK_BLOCK - first_peak) * channels + channel) * 2];
+				peak[0] = std::min(peak[0], samples[sample]);
+				peak[1] = std::max(peak[1], samples[sample]);
+				chunk.peak = std::max(chunk.peak, std::fabs(samples[sample]));
+			}
+		}
+		position += count;
+	}
+	chunk.end_sample = position;
+
+	reader.Close();
+}
+
+AudioAnalysis::AudioAnalysis() :
+		file_size(0), modified(0), sample_rate(0), channels(0), sample_count(0), integrated_loudness(SILENT_LOUDNESS),
+		loudness_range(0.0), max_momentary_loudness(SILENT_LOUDNESS), max_short_term_loudness(SILENT_LOUDNESS),
+		sample_peak(SILENT_LOUDNESS)
+{
+}
+
+// Get the number of peaks of a level of the pyramid
+int64_t AudioAnalysis::PeakCount(int level)
+{
+	if (channels <= 0 || level < 0 || level >= (int) peaks.size())
+		return 0;
+	return peaks[level].size() / (channels * 2);
+}
+
+// Get the peaks of a channel, for a number of columns of a waveform
+void AudioAnalysis::GetPeaks(int64_t start_sample, int64_t end_sample, int columns, int channel, std::vector<float>& minimums, std::vector<float>& maximums)
+{
+	minimums.assign(std::max(columns, 0), 0.0);
+	maximums.assign(std::max(columns, 0), 0.0);
+	if (columns <= 0 || channel < 0 || channel >= channels || peaks.empty() || end_sample <= start_sample)
+		return;
+
+	// Use the coarsest level whose peaks are no longer than a column
+	double column_samples = double(end_sample - start_sample) / columns;
+	int level = 0;
+	while (level + 1 < (int) peaks.size() && double(int64_t(AUDIO_PEAK_BLOCK) << (level + 1)) <= column_samples)
+		level++;
+	int64_t peak_samples = int64_t(AUDIO_PEAK_BLOCK) << level;
+	int64_t count = PeakCount(level);
+	const std::vector<float>& values = peaks[level];
+
+	for (int column = 0; column < columns; column++) {
+		int64_t first = int64_t(floor((start_sample + column * column_samples) / peak_samples));
+		int64_t last = int64_t(ceil((start_sample + (column + 1) * column_samples) / peak_samples)) - 1;
+		first = std::max(first, int64_t(0));
+		last = std::min(std::max(last, first), count - 1);
+		if (first > last)
+			continue;
+
+		float minimum = FLT_MAX;
+		float maximum = -FLT_MAX;
+		for (int64_t peak = first; peak <= last; peak++) {
+			minimum = std::min(minimum, values[(peak * channels + channel) * 2]);
+			maximum = std::max(maximum, values[(peak * channels + channel) * 2 + 1]);
+		}
+		minimums[column] = minimum;
+		maximums[column] = maximum;
+	}
+}
+
+// Get the gain which normalizes the integrated loudness
+double AudioAnalysis::NormalizationGain(double target_loudness, double max_peak)
+{
+	if (integrated_loudness <= SILENT_LOUDNESS)
+		return 1.0;
+
+	double gain = target_loudness - integrated_loudness;
+	if (sample_peak > SILENT_LOUDNESS && sample_peak + gain > max_peak)
+		gain = max_peak - sample_peak;
+	return pow(10.0, gain / 20.0);
+}
+
+// Save the analysis to a file (the finest level of peaks as 16-bit values, the other levels are built again)
+bool AudioAnalysis::Save(std::string file_path)
+{
+	QString path_name = QString::fromStdString(file_path);
+	QFile file(path_name + ".tmp");
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream << quint32(ANALYSIS_MAGIC) << qint32(ANALYSIS_VERSION) << QString::fromStdString(path) << qint64(file_size)
+		   << qint64(modified) << qint32(sample_rate) << qint32(channels) << qint64(sample_count) << integrated_loudness
+		   << loudness_range << max_momentary_loudness << max_short_term_loudness << sample_peak;
+	std::vector<float> empty;
+	const std::vector<float>& values = peaks.empty() ? empty : peaks[0];
+	stream << qint64(values.size());
+	for (float value : values)
+		stream << qint16(round(std::min(1.0f, std::max(-1.0f, value)) * 32767.0f));
+	bool saved = stream.status() == QDataStream::Ok;
+	file.close();
+
+	// Replace the previous analysis (only once this one is complete)
+	QFile::remove(path_name);
+	if (!saved || !file.rename(path_name)) {
+		file.remove();
+		return false;
+	}
+	return true;
+}
+
+// Load the analysis from a file
+bool AudioAnalysis::Load(std::string file_path)
+{
+	QFile file(QString::fromStdString(file_path));
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	quint32 magic;
+	qint32 version;
+	stream >> magic >> version;
+	if (magic != ANALYSIS_MAGIC || version != ANALYSIS_VERSION)
+		return false;
+
+	QString media_path;
+	qint64 size, time, samples, value_count;
+	qint32 rate, channel_count;
+	stream >> media_path >> size >> time >> rate >> channel_count >> samples >> integrated_loudness >> loudness_range
+		   >> max_momentary_loudness >> max_short_term_loudness >> sample_peak >> value_count;
+	if (stream.status() != QDataStream::Ok || channel_count < 0 || value_count < 0)
+		return false;
+	if (channel_count == 0 ? value_count != 0 : value_count % (channel_count * 2) != 0)
+		return false;
+
+	std::vector<float> values(value_count);
+	for (qint64 index = 0; index < value_count; index++) {
+		qint16 value;
+		stream >> value;
+		values[index] = value / 32767.0f;
+	}
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	path = media_path.toStdString();
+	file_size = size;
+	modified = time;
+	sample_rate = rate;
+	channels = channel_count;
+	sample_count = samples;
+	peaks.assign(1, values);
+	build_pyramid(peaks, channels);
+	return true;
+}
+
+// Get the loudness values as a Json::Value
+Json::Value AudioAnalysis::JsonValue()
+{
+	Json::Value root;
+	root["path"] = path;
+	root["sample_rate"] = sample_rate;
+	root["channels"] = channels;
+	root["sample_count"] = Json::Int64(sample_count);
+	root["integrated_loudness"] = integrated_loudness;
+	root["loudness_range"] = loudness_range;
+	root["max_momentary_loudness"] = max_momentary_loudness;
+	root["max_short_term_loudness"] = max_short_term_loudness;
+	root["sample_peak"] = sample_peak;
+	return root;
+}
+
+// Analyze the audio of a media file
+std::shared_ptr<AudioAnalysis> AudioAnalyzer::Analyze(std::string path)
+{
+	std::shared_ptr<AudioAnalysis> analysis = std::make_shared<AudioAnalysis>();
+	QFileInfo file_info(QString::fromStdString(path));
+	analysis->path = path;
+	analysis->file_size = file_info.size();
+	analysis->modified = file_info.lastModified().toMSecsSinceEpoch();
+
+	// Inspect the file (a file without audio has an empty analysis)
+	FFmpegReader probe(path);
+	probe.Open();
+	ReaderInfo info = probe.info;
+	probe.Close();
+	if (!info.has_audio || info.sample_rate <= 0 || info.channels <= 0 || info.video_length <= 0)
+		return analysis;
+	analysis->sample_rate = info.sample_rate;
+	analysis->channels = info.channels;
+
+	// Scan the chunks in parallel
+	int64_t chunk_frames = std::max(int64_t(1), int64_t(round(std::max(1, Settings::Instance()->AUDIO_ANALYSIS_CHUNK) * info.fps.ToDouble())));
+	int64_t chunk_count = (info.video_length + chunk_frames - 1) / chunk_frames;
+	int64_t warmup_frames = int64_t(ceil(info.fps.ToDouble() * 0.1));
+	std::vector<ChunkAnalysis> chunks(chunk_count);
+	TaskPool::Current()->ParallelFor(0, chunk_count, [&](int64_t index) {
+		int64_t start_frame = 1 + index * chunk_frames;
+		int64_t end_frame = std::min(info.video_length, start_frame + chunk_frames - 1);
+		analyze_chunk(path, start_frame, end_frame, warmup_frames, info.sample_rate, info.channels, info.fps, chunks[index]);
+	});
+
+	// Merge the chunks (the blocks at the edges of chunks are shared)
+	int channels = info.channels;
+	int64_t energy_block = info.sample_rate / 10;
+	for (const ChunkAnalysis& chunk : chunks)
+		analysis->sample_count = std::max(analysis->sample_count, chunk.end_sample);
+	std::vector<double> energy((analysis->sample_count + energy_block - 1) / energy_block, 0.0);
+	std::vector<float> peaks(((analysis->sample_count + AUDIO_PEAK_BLOCK - 1) / AUDIO_PEAK_BLOCK) * channels * 2, 0.0);
+	std::vector<bool> has_peak(peaks.size() / 2, false);
+	float sample_peak = 0.0;
+	for (const ChunkAnalysis& chunk : chunks) {
+		int64_t first_block = chunk.first_sample / energy_block;
+		for (size_t index = 0; index < chunk.energy.size() && first_block + index < energy.size(); index++)
+			energy[first_block + index] += chunk.energy[index];
+
+		int64_t first_value = (chunk.first_sample / AUDIO_PEAK_BLOCK) * channels * 2;
+		for (size_t index = 0; index + 1 < chunk.peaks.size() && first_value + index < peaks.size(); index += 2) {
+			size_t value = first_value + index;
+			if (chunk.peaks[index] > chunk.peaks[index + 1])
+				continue; // no samples
+			if (!has_peak[value / 2]) {
+				peaks[value] = chunk.peaks[index];
+				peaks[value + 1] = chunk.peaks[index + 1];
+				has_peak[value / 2] = true;
+			} else {
+				peaks[value] = std::min(peaks[value], chunk.peaks[index]);
+				peaks[value + 1] = std::max(peaks[value + 1], chunk.peaks[index + 1]);
+			}
+		}
+		sample_peak = std::max(sample_peak, chunk.peak);
+	}
+	analysis->peaks.assign(1, peaks);
+	build_pyramid(analysis->peaks, channels);
+	if (sample_peak > 0.0)
+		analysis->sample_peak = std::max(SILENT_LOUDNESS, 20.0 * log10(sample_peak));
+
+	// The mean power of each window of whole 100 ms blocks
+	int64_t blocks = analysis->sample_count / energy_block;
+	std::vector<double> sums(blocks + 1, 0.0);
+	for (int64_t block = 0; block < blocks; block++)
+		sums[block + 1] = sums[block] + energy[block];
+	std::vector<double> momentary, short_term;
+	for (int64_t block = 0; block + 4 <= blocks; block++)
+		momentary.push_back((sums[block + 4] - sums[block]) / (4 * energy_block));
+	for (int64_t block = 0; block + 30 <= blocks; block++)
+		short_term.push_back((sums[block + 30] - sums[block]) / (30 * energy_block));
+
+	// The integrated loudness (gated 400 ms blocks, overlapping by 75%)
+	std::vector<double> gated = gate_blocks(momentary, -10.0);
+	if (!gated.empty()) {
+		double sum = 0.0;
+		for (double power : gated)
+			sum += power;
+		analysis->integrated_loudness = power_loudness(sum / gated.size());
+	}
+	for (double power : momentary)
+		analysis->max_momentary_loudness = std::max(analysis->max_momentary_loudness, power_loudness(power));
+
+	// The loudness range (between the 10th and 95th percentile of the gated 3 second windows)
+	std::vector<double> gated_short_term = gate_blocks(short_term, -20.0);
+	if (!gated_short_term.empty()) {
+		std::sort(gated_short_term.begin(), gated_short_term.end());
+		size_t last = gated_short_term.size() - 1;
+		analysis->loudness_range = power_loudness(gated_short_term[size_t(round(last * 0.95))]) - power_loudness(gated_short_term[size_t(round(last * 0.10))]);
+	}
+	for (double power : short_term)
+		analysis->max_short_term_loudness = std::max(analysis->max_short_term_loudness, power_loudness(power));
+
+	return analysis;
+}
+
+// Get the file path of the saved analysis of a media file
+std::string AudioAnalyzer::AnalysisPath(std::string path)
+{
+	QString folder = QString::fromStdString(Settings::Instance()->AUDIO_ANALYSIS_PATH);
+	if (folder.isEmpty())
+		return "";
+
+	// Name the analysis after a hash of the full path of the media file
+	QString media_path = QFileInfo(QString::fromStdString(path)).absoluteFilePath();
+	QString hash = QCryptographicHash::hash(media_path.toUtf8(), QCryptographicHash::Md5).toHex();
+	return QDir(folder).filePath(hash + ".audio").toStdString();
+}
+
+// Get the saved analysis of a media file (if it is up to date), or a new analysis
+std::shared_ptr<AudioAnalysis> AudioAnalyzer::Get(std::string path)
+{
+	std::string analysis_path = AnalysisPath(path);
+	if (!analysis_path.empty()) {
+		std::shared_ptr<AudioAnalysis> saved = std::make_shared<AudioAnalysis>();
+		QFileInfo file_info(QString::fromStdString(path));
+		if (saved->Load(analysis_path) && saved->file_size == file_info.size() &&
+				saved->modified == file_info.lastModified().toMSecsSinceEpoch())
+			return saved;
+	}
+
+	std::shared_ptr<AudioAnalysis> analysis = Analyze(path);
+	if (!analysis_path.empty()) {
+		QDir().mkpath(QFileInfo(QString::fromStdString(analysis_path)).absolutePath());
+		analysis->Save(analysis_path);
+	}
+	return analysis;
+}
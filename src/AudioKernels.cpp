@@ -0,0 +1,298 @@
+/**
+ * @file
+ * @brief Source file for AudioKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/AudioKernels.h"
+#include "../include/Settings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	// x86 kernels are compiled for their own instruction set (so the library itself still runs on any x86 CPU)
+	#define OPENSHOT_X86_KERNELS
+	#define OPENSHOT_AVX2 __attribute__((target("avx2")))
+	#define OPENSHOT_SSE41 __attribute__((target("sse4.1")))
+	#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+	// NEON is always available on 64-bit ARM
+	#define OPENSHOT_NEON_KERNELS
+	#include <arm_neon.h>
+#endif
+
+using namespace openshot;
+
+namespace {
+	// Instruction sets of the kernels
+	enum KernelLevel {
+		KERNEL_SCALAR,
+		KERNEL_SSE41,
+		KERNEL_AVX2,
+		KERNEL_NEON
+	};
+
+	// Detect the best instruction set supported by this CPU
+	KernelLevel detect_kernel_level() {
+#if defined(OPENSHOT_X86_KERNELS)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return KERNEL_AVX2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return KERNEL_SSE41;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		return KERNEL_NEON;
+#endif
+		return KERNEL_SCALAR;
+	}
+
+	// Get the instruction set to run the kernels with (the CPU is only checked once)
+	KernelLevel kernel_level() {
+		static const KernelLevel detected_level = detect_kernel_level();
+		if (!Settings::Instance()->SIMD_EFFECTS)
+			return KERNEL_SCALAR;
+		return detected_level;
+	}
+
+	// The gain of each source, at the first sample (and the change of gain per sample)
+	struct GainRamp {
+		const float *samples;
+		float gain;
+		float step;
+	};
+
+	// Scalar kernel (also used for the samples left over by the vectorized kernels)
+	void mix_scalar(float *target, int first_sample, int sample_count, const GainRamp *ramps, int ramp_count) {
+		for (int sample = first_sample; sample < sample_count; sample++) {
+			float mix = 0.0f;
+			for (int ramp = 0; ramp < ramp_count; ramp++)
+				mix += ramps[ramp].samples[sample] * (ramps[ramp].gain + ramps[ramp].step * sample);
+			target[sample] += mix;
+		}
+	}
+
+	// The input samples and the 2 filters of a target sample
+	struct FilterTap {
+		const float *window;
+		const float *filter;
+		float blend;
+	};
+
+	// Find the input window and filter phase of a target sample
+	inline FilterTap filter_tap(int sample, const float *input, double position, double step, const float *filters, int phase_count, int tap_count) {
+		double sample_position = position + step * sample;
+		int64_t base = (int64_t) floor(sample_position);
+		double phase = (sample_position - base) * phase_count;
+		int filter_index = std::min((int) phase, phase_count - 1);
+		FilterTap tap = {input + base - tap_count / 2 + 1, filters + filter_index * tap_count, float(phase - filter_index)};
+		return tap;
+	}
+
+	// Scalar kernel
+	void filter_scalar(float *target, int sample_count, const float *input, double position, double step, const float *filters, int phase_count, int tap_count) {
+		for (int sample = 0; sample < sample_count; sample++) {
+			FilterTap tap = filter_tap(sample, input, position, step, filters, phase_count, tap_count);
+			float sum0 = 0.0f, sum1 = 0.0f;
+			for (int index = 0; index < tap_count; index++) {
+				sum0 += tap.window[index] * tap.filter[index];
+				sum1 += tap.window[index] * tap.filter[index + tap_count];
+			}
+			target[sample] = sum0 + (sum1 - sum0) * tap.blend;
+		}
+	}
+
+#if defined(OPENSHOT_X86_KERNELS)
+	OPENSHOT_AVX2 void filter_avx2(float *target, int sample_count, const float *input, double position, double step, const float *filters, int phase_count, int tap_count) {
+		for (int sample = 0; sample < sample_count; sample++) {
+			FilterTap tap = filter_tap(sample, input, position, step, filters, phase_count, tap_count);
+			__m256 sum0 = _mm256_setzero_ps();
+			__m256 sum1 = _mm256_setzero_ps();
+			for (int index = 0; index < tap_count; index += 8) {
+				__m256 window = _mm256_loadu_ps(tap.window + index);
+				sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(window, _mm256_loadu_ps(tap.filter + index)));
+				sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(window, _mm256_loadu_ps(tap.filter + tap_count + index)));
+			}
+			// Blend the 2 filters, and add the 8 lanes together
+			__m256 sum = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_sub_ps(sum1, sum0), _mm256_set1_ps(tap.blend)));
+			__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+			half = _mm_hadd_ps(half, half);
+			half = _mm_hadd_ps(half, half);
+			target[sample] = _mm_cvtss_f32(half);
+		}
+	}
+
+	OPENSHOT_SSE41 void filter_sse41(float *target, int sample_count, const float *input, double position, double step, const float *filters, int phase_count, int tap_count) {
+		for (int sample = 0; sample < sample_count; sample++) {
+			FilterTap tap = filter_tap(sample, input, position, step, filters, phase_count, tap_count);
+			__m128 sum0 = _mm_setzero_ps();
+			__m128 sum1 = _mm_setzero_ps();
+			for (int index = 0; index < tap_count; index += 4) {
+				__m128 window = _mm_loadu_ps(tap.window + index);
+				sum0 = _mm_add_ps(sum0, _mm_mul_ps(window, _mm_loadu_ps(tap.filter + index)));
+				sum1 = _mm_add_ps(sum1, _mm_mul_ps(window, _mm_loadu_ps(tap.filter + tap_count + index)));
+			}
+			__m128 sum = _mm_add_ps(sum0, _mm_mul_ps(_mm_sub_ps(sum1, sum0), _mm_set1_ps(tap.blend)));
+			sum = _mm_hadd_ps(sum, sum);
+			sum = _mm_hadd_ps(sum, sum);
+			target[sample] = _mm_cvtss_f32(sum);
+		}
+	}
+#elif defined(OPENSHOT_NEON_KERNELS)
+	void filter_neon(float *target, int sample_count, const float *input, double position, double step, const float *filters, int phase_count, int tap_count) {
+		for (int sample = 0; sample < sample_count; sample++) {
+			FilterTap tap = filter_tap(sample, input, position, step, filters, phase_count, tap_count);
+			float32x4_t sum0 = vdupq_n_f32(0.0f);
+			float32x4_t sum1 = vdupq_n_f32(0.0f);
+			for (int index = 0; index < tap_count; index += 4) {
+				float32x4_t window = vld1q_f32(tap.window + index);
+				sum0 = vmlaq_f32(sum0, window, vld1q_f32(tap.filter + index));
+				sum1 = vmlaq_f32(sum1, window, vld1q_f32(tap.filter + tap_count + index));
+			}
+			float32x4_t sum = vmlaq_n_f32(sum0, vsubq_f32(sum1, sum0), tap.blend);
+			target[sample] = vaddvq_f32(sum);
+		}
+	}
+#endif
+
+#if defined(OPENSHOT_X86_KERNELS)
+	OPENSHOT_AVX2 int mix_avx2(float *target, int sample_count, const GainRamp *ramps, int ramp_count) {
+		int sample = 0;
+		const __m256 offsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		for (; sample + 8 <= sample_count; sample += 8) {
+			__m256 position = _mm256_add_ps(_mm256_set1_ps((float) sample), offsets);
+			__m256 mix = _mm256_setzero_ps();
+			for (int ramp = 0; ramp < ramp_count; ramp++) {
+				__m256 gain = _mm256_add_ps(_mm256_set1_ps(ramps[ramp].gain), _mm256_mul_ps(_mm256_set1_ps(ramps[ramp].step), position));
+				mix = _mm256_add_ps(mix, _mm256_mul_ps(_mm256_loadu_ps(ramps[ramp].samples + sample), gain));
+			}
+			_mm256_storeu_ps(target + sample, _mm256_add_ps(_mm256_loadu_ps(target + sample), mix));
+		}
+		return sample;
+	}
+
+	OPENSHOT_SSE41 int mix_sse41(float *target, int sample_count, const GainRamp *ramps, int ramp_count) {
+		int sample = 0;
+		const __m128 offsets = _mm_setr_ps(0, 1, 2, 3);
+		for (; sample + 4 <= sample_count; sample += 4) {
+			__m128 position = _mm_add_ps(_mm_set1_ps((float) sample), offsets);
+			__m128 mix = _mm_setzero_ps();
+			for (int ramp = 0; ramp < ramp_count; ramp++) {
+				__m128 gain = _mm_add_ps(_mm_set1_ps(ramps[ramp].gain), _mm_mul_ps(_mm_set1_ps(ramps[ramp].step), position));
+				mix = _mm_add_ps(mix, _mm_mul_ps(_mm_loadu_ps(ramps[ramp].samples + sample), gain));
+			}
+			_mm_storeu_ps(target + sample, _mm_add_ps(_mm_loadu_ps(target + sample), mix));
+		}
+		return sample;
+	}
+#elif defined(OPENSHOT_NEON_KERNELS)
+	int mix_neon(float *target, int sample_count, const GainRamp *ramps, int ramp_count) {
+		int sample = 0;
+		const float offset_values[4] = {0, 1, 2, 3};
+		const float32x4_t offsets = vld1q_f32(offset_values);
+		for (; sample + 4 <= sample_count; sample += 4) {
+			float32x4_t position = vaddq_f32(vdupq_n_f32((float) sample), offsets);
+			float32x4_t mix = vdupq_n_f32(0.0f);
+			for (int ramp = 0; ramp < ramp_count; ramp++) {
+				float32x4_t gain = vaddq_f32(vdupq_n_f32(ramps[ramp].gain), vmulq_f32(vdupq_n_f32(ramps[ramp].step), position));
+				mix = vaddq_f32(mix, vmulq_f32(vld1q_f32(ramps[ramp].samples + sample), gain));
+			}
+			vst1q_f32(target + sample, vaddq_f32(vld1q_f32(target + sample), mix));
+		}
+		return sample;
+	}
+#endif
+}
+
+// Mix the samples of each source (multiplied by its gain ramp) into the target samples
+void AudioKernels::MixGainRamps(float *target, int sample_count, const AudioMixSource *sources, int source_count)
+{
+	if (!target || sample_count <= 0 || source_count <= 0)
+		return;
+
+	// The gain of each sample is calculated from its position (instead of adding the step to each sample)
+	std::vector<GainRamp> ramps;
+	ramps.reserve(source_count);
+	for (int source = 0; source < source_count; source++) {
+		if (!sources[source].samples)
+			continue;
+		GainRamp ramp = {sources[source].samples, sources[source].initial_gain, (sources[source].final_gain - sources[source].initial_gain) / sample_count};
+		ramps.push_back(ramp);
+	}
+	if (ramps.empty())
+		return;
+
+	int done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = mix_avx2(target, sample_count, ramps.data(), ramps.size());
+			break;
+		case KERNEL_SSE41:
+			done = mix_sse41(target, sample_count, ramps.data(), ramps.size());
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = mix_neon(target, sample_count, ramps.data(), ramps.size());
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Mix the remaining samples
+	mix_scalar(target, done, sample_count, ramps.data(), ramps.size());
+}
+
+// Filter the input samples at evenly spaced (fractional) positions, with a polyphase filter
+void AudioKernels::PolyphaseFilter(float *target, int sample_count, const float *input, double position, double step,
+								   const float *filters, int phase_count, int tap_count)
+{
+	if (!target || !input || !filters || sample_count <= 0 || phase_count <= 0 || tap_count <= 0)
+		return;
+
+	// The vectorized kernels need whole vectors of taps
+	KernelLevel level = (tap_count % 8 == 0) ? kernel_level() : KERNEL_SCALAR;
+	switch (level) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			filter_avx2(target, sample_count, input, position, step, filters, phase_count, tap_count);
+			return;
+		case KERNEL_SSE41:
+			filter_sse41(target, sample_count, input, position, step, filters, phase_count, tap_count);
+			return;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			filter_neon(target, sample_count, input, position, step, filters, phase_count, tap_count);
+			return;
+#endif
+		default:
+			filter_scalar(target, sample_count, input, position, step, filters, phase_count, tap_count);
+			return;
+	}
+}
@@ -30,217 +30,249 @@
 
 #include "../include/AudioReaderSource.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
 using namespace std;
 using namespace openshot;
 
 // Constructor that reads samples from a reader
 AudioReaderSource::AudioReaderSource(ReaderBase *audio_reader, int64_t starting_frame_number, int buffer_size)
 	: reader(audio_reader), frame_number(starting_frame_number), original_frame_number(starting_frame_number),
-	  size(buffer_size), position(0), frame_position(0), estimated_frame(0), speed(1) {
-
-	// Initialize an audio buffer (based on reader)
-	buffer = new juce::AudioSampleBuffer(reader->info.channels, size);
-
-	// initialize the audio samples to zero (silence)
-	buffer->clear();
+	  size(std::max(buffer_size, audio_reader->info.sample_rate)), ring(audio_reader->info.channels, std::max(buffer_size, audio_reader->info.sample_rate)),
+	  position(0), repeat(false), stream_position(0.0), estimated_frame(starting_frame_number), estimated_samples_per_frame(0), estimated_position(0), speed(1), stream_speed(1),
+	  is_prefetching(false), prefetch_stop(false), seek_frame(starting_frame_number), seek_generation(0), flushed_generation(0),
+	  flush_position(0), played_generation(0), underruns(0) {
+
+	// Allocate the resampling buffers (only once, so prefetching never allocates)
+	stream_history.resize(ring.Channels(), 0.0f);
+	stream_samples.resize(ring.Channels(), std::vector<float>(1024, 0.0f));
+	for (int channel = 0; channel < ring.Channels(); channel++)
+		stream_pointers.push_back(stream_samples[channel].data());
+
+	// Start prefetching samples (before the audio callback needs them)
+	StartPrefetch();
 }
 
 // Destructor
 AudioReaderSource::~AudioReaderSource()
 {
-	// Clear and delete the buffer
-	delete buffer;
-	buffer = NULL;
+	// Stop the prefetch thread
+	StopPrefetch();
 };
 
-// Get more samples from the reader
+// Get more samples from the reader (until the ring buffer is full, or a seek is requested)
 void AudioReaderSource::GetMoreSamplesFromReader()
 {
-	// Determine the amount of samples needed to fill up this buffer
-	int amount_needed = position; // replace these used samples
-	int amount_remaining = size - amount_needed; // these are unused samples, and need to be carried forward
-	if (!frame) {
-		// If no frame, load entire buffer
-		amount_needed = size;
-		amount_remaining = 0;
-	}
-
 	// Debug
-	ZmqLogger::Instance()->AppendDebugMethod("AudioReaderSource::GetMoreSamplesFromReader", "amount_needed", amount_needed, "amount_remaining", amount_remaining);
-
-	// Init estimated buffer equal to the current frame position (before getting more samples)
-	estimated_frame = frame_number;
+	ZmqLogger::Instance()->AppendDebugMethod("AudioReaderSource::GetMoreSamplesFromReader", "frame_number", frame_number, "stream_position", stream_position, "stream_speed", stream_speed, "ring.Space()", ring.Space());
+
+	// Each frame is played at the speed (in its direction), by stepping through its samples
+	int direction = (stream_speed < 0) ? -1 : 1;
+	double step = abs(stream_speed);
+	std::shared_ptr<Frame> current_frame = getFrame();
+	while (ring.Space() > 0 && stream_speed != 0 && flushed_generation == seek_generation) {
+
+		// Get the next frame (once all the samples of the current frame are resampled)
+		if (!current_frame) {
+			if (frame_number < 1 || frame_number > reader->info.video_length)
+				break;
+			// Get frame object (only its audio is played), and stop at a missing frame
+			if (reader->TryGetAudioFrame(frame_number, current_frame) != FRAME_OK)
+				break;
+			frame_number = frame_number + direction;
+
+			// Share the current frame (with the player)
+			const std::lock_guard<std::mutex> lock(frame_mutex);
+			frame = current_frame;
+		}
+		if (!current_frame)
+			break;
 
-	// Init new buffer
-	juce::AudioSampleBuffer *new_buffer = new juce::AudioSampleBuffer(reader->info.channels, size);
-	new_buffer->clear();
+		// Resample as many of its samples as fit into the ring buffer (linear interpolation, which
+		// copies the samples as is at normal speed). Sample -1 is the last sample of the previous frame.
+		juce::AudioSampleBuffer *samples = current_frame->GetAudioSampleBuffer();
+		const float* const* frame_samples = samples->getArrayOfReadPointers();
+		int number_of_samples = current_frame->GetAudioSamplesCount();
+		int channels = std::min(ring.Channels(), samples->getNumChannels());
+		int amount_to_copy = std::min(ring.Space(), int(stream_samples.front().size()));
+		int copied = 0;
+		while (copied < amount_to_copy && stream_position < number_of_samples - 1) {
+			int index = floor(stream_position);
+			float fraction = stream_position - index;
+			for (int channel = 0; channel < channels; channel++) {
+				const float *channel_samples = frame_samples[channel];
+				float previous = (index < 0) ? stream_history[channel] :
+								 channel_samples[(direction > 0) ? index : number_of_samples - 1 - index];
+				float next = channel_samples[(direction > 0) ? index + 1 : number_of_samples - 2 - index];
+				stream_samples[channel][copied] = previous + (next - previous) * fraction;
+			}
+			copied++;
+			stream_position += step;
+		}
+		ring.Write(stream_pointers.data(), channels, 0, copied);
+
+		// Continue with the next frame (once the position passes the last sample)
+		if (stream_position >= number_of_samples - 1) {
+			for (int channel = 0; channel < channels && number_of_samples > 0; channel++)
+				stream_history[channel] = frame_samples[channel][(direction > 0) ? number_of_samples - 1 : 0];
+			stream_position -= number_of_samples;
+			current_frame.reset();
+		}
+	}
+}
 
-	// Move the remaining samples into new buffer (if any)
-	if (amount_remaining > 0) {
-		for (int channel = 0; channel < buffer->getNumChannels(); channel++)
-		    new_buffer->addFrom(channel, 0, *buffer, channel, position, amount_remaining);
+// Start the prefetch thread (if not already running)
+void AudioReaderSource::StartPrefetch()
+{
+	if (is_prefetching)
+		return;
 
-		position = amount_remaining;
-	} else
-		// reset position to 0
-		position = 0;
+	prefetch_stop = false;
+	is_prefetching = true;
+	prefetch_thread = std::thread(&AudioReaderSource::prefetch_loop, this);
+}
 
-	// Loop through frames until buffer filled
-	while (amount_needed > 0 && speed == 1  && frame_number >= 1 && frame_number <= reader->info.video_length) {
+// Stop the prefetch thread (waiting for the frame it is getting, if any)
+void AudioReaderSource::StopPrefetch()
+{
+	if (!is_prefetching)
+		return;
 
-		// Get the next frame (if position is zero)
-		if (frame_position == 0) {
-			try {
-				// Get frame object
-				frame = reader->GetFrame(frame_number);
-				frame_number = frame_number + speed;
+	{
+		std::lock_guard<std::mutex> lock(prefetch_mutex);
+		prefetch_stop = true;
+	}
+	prefetch_condition.notify_all();
+	prefetch_thread.join();
+	is_prefetching = false;
+}
 
-			} catch (const ReaderClosed & e) {
-			break;
-			} catch (const TooManySeeks & e) {
-			break;
-			} catch (const OutOfBoundsFrame & e) {
-			break;
-			}
+// The main loop of the prefetch thread
+void AudioReaderSource::prefetch_loop()
+{
+	// Refill the ring buffer once a quarter of it is played (or on a seek)
+	int refill_size = std::max(size / 4, 1);
+	int64_t generation = flushed_generation;
+	while (true) {
+		{
+			// The audio callback doesn't wake this thread (so it never blocks), it is polled instead
+			std::unique_lock<std::mutex> lock(prefetch_mutex);
+			prefetch_condition.wait_for(lock, std::chrono::milliseconds(10), [this, generation, refill_size] {
+				return prefetch_stop || seek_generation != generation || (stream_speed != 0 && ring.Space() >= refill_size);
+			});
+			if (prefetch_stop)
+				break;
 		}
 
-		bool frame_completed = false;
-		int amount_to_copy = 0;
-		if (frame)
-			amount_to_copy = frame->GetAudioSamplesCount() - frame_position;
-		if (amount_to_copy > amount_needed) {
-			// Don't copy too many samples (we don't want to overflow the buffer)
-			amount_to_copy = amount_needed;
-			amount_needed = 0;
-		} else {
-			// Not enough to fill the buffer (so use the entire frame)
-			amount_needed -= amount_to_copy;
-			frame_completed = true;
+		// Restart from the frame of the latest seek (the samples written before it are dropped by the audio callback)
+		int64_t requested_generation = seek_generation;
+		if (requested_generation != generation) {
+			frame_number = seek_frame;
+			stream_speed = std::max(-4, std::min(4, speed.load()));
+			stream_position = 0.0;
+			{
+				const std::lock_guard<std::mutex> lock(frame_mutex);
+				frame.reset();
+			}
+			flush_position = ring.WritePosition();
+			flushed_generation = requested_generation;
+			generation = requested_generation;
 		}
 
-		// Load all of its samples into the buffer
-		if (frame)
-			for (int channel = 0; channel < new_buffer->getNumChannels(); channel++)
-				new_buffer->addFrom(channel, position, *frame->GetAudioSampleBuffer(), channel, frame_position, amount_to_copy);
-
-		// Adjust remaining samples
-		position += amount_to_copy;
-		if (frame_completed)
-			// Reset frame buffer position (which will load a new frame on the next loop)
-			frame_position = 0;
-		else
-			// Continue tracking the current frame's position
-			frame_position += amount_to_copy;
+		// Fill the ring buffer
+		if (stream_speed != 0 && reader && reader->IsOpen())
+			GetMoreSamplesFromReader();
 	}
-
-	// Delete old buffer
-	buffer->clear();
-	delete buffer;
-
-	// Replace buffer and reset position
-	buffer = new_buffer;
-	position = 0;
 }
 
-// Reverse an audio buffer
-juce::AudioSampleBuffer* AudioReaderSource::reverse_buffer(juce::AudioSampleBuffer* buffer)
+// Set the reader (and restart the prefetch thread)
+void AudioReaderSource::Reader(ReaderBase *audio_reader)
 {
-	int number_of_samples = buffer->getNumSamples();
-	int channels = buffer->getNumChannels();
-
-	// Debug
-	ZmqLogger::Instance()->AppendDebugMethod("AudioReaderSource::reverse_buffer", "number_of_samples", number_of_samples, "channels", channels);
+	StopPrefetch();
+	reader = audio_reader;
+	StartPrefetch();
+}
 
-	// Reverse array (create new buffer to hold the reversed version)
-	juce::AudioSampleBuffer *reversed = new juce::AudioSampleBuffer(channels, number_of_samples);
-	reversed->clear();
+// Set the speed (and continue playing from the estimated frame, at the new speed)
+void AudioReaderSource::setSpeed(int new_speed)
+{
+	new_speed = std::max(-4, std::min(4, new_speed));
+	if (new_speed == speed)
+		return;
+	speed = new_speed;
+	Seek(getEstimatedFrame());
+}
 
-	for (int channel = 0; channel < channels; channel++)
+// Seek to a specific frame (the prefetched samples are dropped)
+void AudioReaderSource::Seek(int64_t new_position)
+{
 	{
-		int n=0;
-		for (int s = number_of_samples - 1; s >= 0; s--, n++)
-			reversed->getWritePointer(channel)[n] = buffer->getWritePointer(channel)[s];
+		const std::lock_guard<std::mutex> lock(estimate_mutex);
+		estimated_frame = new_position;
+		estimated_position = position;
 	}
+	seek_frame = new_position;
+	seek_generation++;
+	prefetch_condition.notify_all();
+}
 
-	// Copy the samples back to the original array
-	buffer->clear();
-	// Loop through channels, and get audio samples
-	for (int channel = 0; channel < channels; channel++)
-		// Get the audio samples for this channel
-		buffer->addFrom(channel, 0, reversed->getReadPointer(channel), number_of_samples, 1.0f);
-
-	delete reversed;
-	reversed = NULL;
-
-	// return pointer or passed in object (so this method can be chained together)
-	return buffer;
+// Return the current frame object
+std::shared_ptr<Frame> AudioReaderSource::getFrame() const
+{
+	const std::lock_guard<std::mutex> lock(frame_mutex);
+	return frame;
 }
 
 // Get the next block of audio samples
 void AudioReaderSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
 {
-	int buffer_samples = buffer->getNumSamples();
-	int buffer_channels = buffer->getNumChannels();
-
 	if (info.numSamples > 0) {
-		int number_to_copy = 0;
-
-		// Do we need more samples?
-		if (speed == 1) {
-			// Only refill buffers if speed is normal
-			if ((reader && reader->IsOpen() && !frame) or
-				(reader && reader->IsOpen() && buffer_samples - position < info.numSamples))
-				// Refill buffer from reader
-				GetMoreSamplesFromReader();
-		} else {
-			// Fill buffer with silence and clear current frame
-			info.buffer->clear();
+		// Play silence while paused, or until the prefetch thread handles a seek
+		int64_t generation = seek_generation;
+		if (speed == 0 || flushed_generation != generation) {
+			info.buffer->clear(info.startSample, info.numSamples);
 			return;
 		}
 
-		// Determine how many samples to copy
-		if (position + info.numSamples <= buffer_samples)
-		{
-			// copy the full amount requested
-			number_to_copy = info.numSamples;
-		}
-		else if (position > buffer_samples)
-		{
-			// copy nothing
-			number_to_copy = 0;
-		}
-		else if (buffer_samples - position > 0)
-		{
-			// only copy what is left in the buffer
-			number_to_copy = buffer_samples - position;
-		}
-		else
-		{
-			// copy nothing
-			number_to_copy = 0;
+		// Drop the samples prefetched before the latest seek
+		if (played_generation != generation) {
+			ring.Discard(flush_position);
+			played_generation = generation;
 		}
 
+		// Copy the prefetched samples (without waiting for more, which would stall the audio device)
+		int number_to_copy = ring.Read(info.buffer->getArrayOfWritePointers(), info.buffer->getNumChannels(), info.startSample, info.numSamples);
+		for (int channel = std::min(ring.Channels(), info.buffer->getNumChannels()); channel < info.buffer->getNumChannels(); channel++)
+			info.buffer->clear(channel, info.startSample, number_to_copy);
+		if (number_to_copy < info.numSamples) {
+			info.buffer->clear(info.startSample + number_to_copy, info.numSamples - number_to_copy);
+			underruns++;
+		}
 
-		// Determine if any samples need to be copied
-		if (number_to_copy > 0)
-		{
-			// Debug
-			ZmqLogger::Instance()->AppendDebugMethod("AudioReaderSource::getNextAudioBlock", "number_to_copy", number_to_copy, "buffer_samples", buffer_samples, "buffer_channels", buffer_channels, "info.numSamples", info.numSamples, "speed", speed, "position", position);
-
-			// Loop through each channel and copy some samples
-			for (int channel = 0; channel < buffer_channels; channel++)
-				info.buffer->copyFrom(channel, info.startSample, *buffer, channel, position, number_to_copy);
+		const std::lock_guard<std::mutex> lock(estimate_mutex);
 
-			// Update the position of this audio source
-			position += number_to_copy;
-		}
+		// Update the position of this audio source
+		position += number_to_copy;
 
 		// Adjust estimate frame number (the estimated frame number that is being played)
-		estimated_samples_per_frame = Frame::GetSamplesPerFrame(estimated_frame, reader->info.fps, reader->info.sample_rate, buffer_channels);
-		estimated_frame += double(info.numSamples) / double(estimated_samples_per_frame);
+		estimated_samples_per_frame = Frame::GetSamplesPerFrame(estimated_frame, reader->info.fps, reader->info.sample_rate, reader->info.channels);
+		estimated_frame = estimated_frame + speed * double(number_to_copy) / double(estimated_samples_per_frame);
+		estimated_position = position;
 	}
 }
 
+// Get the frame position of a sample of this source (extrapolated from the estimated frame)
+double AudioReaderSource::getFrameAtPosition(double sample_position) const
+{
+	const std::lock_guard<std::mutex> lock(estimate_mutex);
+	if (estimated_samples_per_frame <= 0)
+		return estimated_frame;
+	return estimated_frame - speed * (estimated_position - sample_position) / double(estimated_samples_per_frame);
+}
+
 // Prepare to play this audio source
 void AudioReaderSource::prepareToPlay(int, double) { }
 
@@ -250,8 +282,9 @@ void AudioReaderSource::releaseResources() { }
 // Set the next read position of this source
 void AudioReaderSource::setNextReadPosition (juce::int64 newPosition)
 {
-	// set position (if the new position is in range)
-	if (newPosition >= 0 && newPosition < buffer->getNumSamples())
+	// set position (the prefetched samples are not dropped, see Seek)
+	const std::lock_guard<std::mutex> lock(estimate_mutex);
+	if (newPosition >= 0)
 		position = newPosition;
 }
 
@@ -285,10 +318,3 @@ void AudioReaderSource::setLooping (bool shouldLoop)
 	// Set the repeat flag
 	repeat = shouldLoop;
 }
-
-// Update the internal buffer used by this source
-void AudioReaderSource::setBuffer (juce::AudioSampleBuffer *audio_buffer)
-{
-	buffer = audio_buffer;
-	setNextReadPosition(0);
-}
@@ -30,45 +30,30 @@
 
 #include "../include/AudioResampler.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 using namespace std;
 using namespace openshot;
 
-// Default constructor, max frames to cache is 20 // resample_source(NULL), buffer_source(NULL), num_of_samples(0), new_num_of_samples(0), dest_ratio(0), source_ratio(0), resampled_buffer(NULL), isPrepared(false)
+// The longest filter (which is also the number of previous samples kept)
+static const int MAX_TAPS = 128;
+
+// Default constructor
 AudioResampler::AudioResampler()
+	: buffer(NULL), tap_count(0), phase_count(64), filter_ratio(0), num_of_samples(0), new_num_of_samples(0),
+	  dest_ratio(0), source_ratio(0)
 {
-	resample_source = NULL;
-	buffer_source = NULL;
-	num_of_samples = 0;
-	new_num_of_samples = 0;
-	dest_ratio = 0;
-	source_ratio = 0;
-	resampled_buffer = NULL;
-	isPrepared = false;
-
-	// Init buffer source
-	buffer_source = new AudioBufferSource(buffer);
-
-	// Init resampling source
-	resample_source = new juce::ResamplingAudioSource(buffer_source, false, 2);
-
 	// Init resampled buffer
 	resampled_buffer = new juce::AudioSampleBuffer(2, 1);
 	resampled_buffer->clear();
-
-	// Init callback buffer
-	resample_callback_buffer.buffer = resampled_buffer;
-	resample_callback_buffer.numSamples = 1;
-	resample_callback_buffer.startSample = 0;
 }
 
 // Descructor
 AudioResampler::~AudioResampler()
 {
 	// Clean up
-	if (buffer_source)
-		delete buffer_source;
-	if (resample_source)
-		delete resample_source;
 	if (resampled_buffer)
 		delete resampled_buffer;
 }
@@ -91,40 +76,85 @@ void AudioResampler::SetBuffer(juce::AudioSampleBuffer *new_buffer, double sampl
 // Sets the audio buffer and key settings
 void AudioResampler::SetBuffer(juce::AudioSampleBuffer *new_buffer, double ratio)
 {
-	// Update buffer & buffer source
+	// Update buffer
 	buffer = new_buffer;
-	buffer_source->setBuffer(buffer);
 
 	// Set the sample ratio (the ratio of sample rate change)
 	source_ratio = ratio;
 	dest_ratio = 1.0 / ratio;
 	num_of_samples = buffer->getNumSamples();
-	new_num_of_samples = round(num_of_samples * dest_ratio) - 1;
+	new_num_of_samples = std::max(0, int(round(num_of_samples * dest_ratio)) - 1);
 
-	// Set resample ratio
-	resample_source->setResamplingRatio(source_ratio);
+	// Resize buffer for the newly resampled data (without reallocating, when it is large enough)
+	resampled_buffer->setSize(buffer->getNumChannels(), new_num_of_samples, false, false, true);
+}
 
-	// Prepare to play resample source
-	if (!isPrepared)
+// Design the filter bank for a resampling ratio
+void AudioResampler::design_filters(double ratio)
+{
+	// Cut off below the lower of the 2 Nyquist frequencies (as a fraction of the input sample rate)
+	double cutoff = 0.5 * std::min(1.0, 1.0 / ratio) * 0.97;
+	tap_count = std::min(MAX_TAPS, std::max(32, int(ceil(32 * std::max(1.0, ratio) / 8.0)) * 8));
+	int half = tap_count / 2;
+
+	// Each phase is a Blackman windowed sinc, centered on its fraction (and normalized to unity gain)
+	filters.resize((phase_count + 1) * tap_count);
+	for (int phase = 0; phase <= phase_count; phase++)
 	{
-		// Prepare to play the audio sources (and set the # of samples per chunk to a little more than expected)
-		resample_source->prepareToPlay(num_of_samples + 10, 0);
-		isPrepared = true;
+		float *filter = &filters[phase * tap_count];
+		double fraction = double(phase) / phase_count;
+		double sum = 0.0;
+		for (int index = 0; index < tap_count; index++) {
+			double x = (index - half + 1) - fraction;
+			double sinc = (x == 0.0) ? 1.0 : sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+			double window = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2.0 * M_PI * x / half);
+			filter[index] = 2.0 * cutoff * sinc * window;
+			sum += filter[index];
+		}
+		for (int index = 0; index < tap_count; index++)
+			filter[index] /= sum;
 	}
-
-	// Resize buffer for the newly resampled data
-	resampled_buffer->setSize(buffer->getNumChannels(), new_num_of_samples, true, true, true);
-	resample_callback_buffer.numSamples = new_num_of_samples;
-	resample_callback_buffer.startSample = 0;
-	resample_callback_buffer.clearActiveBufferRegion();
+	filter_ratio = ratio;
 }
 
 // Get the resampled audio buffer
 juce::AudioSampleBuffer* AudioResampler::GetResampledBuffer()
 {
-	// Resample the current frame's audio buffer (into the temp callback buffer)
-	resample_source->getNextAudioBlock(resample_callback_buffer);
+	int channels = buffer->getNumChannels();
+
+	// Start with silence (for the first buffer, or when the number of channels changes)
+	if (int(input_samples.size()) != channels)
+		input_samples.assign(channels, std::vector<float>(MAX_TAPS, 0.0f));
+
+	// Design the filters (only when the ratio changes)
+	if (filter_ratio != source_ratio)
+		design_filters(source_ratio);
+
+	for (int channel = 0; channel < channels; channel++)
+	{
+		// Append the new samples to the previous samples
+		std::vector<float> &samples = input_samples[channel];
+		samples.resize(MAX_TAPS + num_of_samples);
+		memcpy(&samples[MAX_TAPS], buffer->getReadPointer(channel), num_of_samples * sizeof(float));
+
+		// The resampled samples span exactly the new samples (so the next buffer continues where this one ends).
+		// Each is delayed by half of the longest filter, so all its input samples are already known.
+		if (new_num_of_samples > 0)
+			AudioKernels::PolyphaseFilter(resampled_buffer->getWritePointer(channel), new_num_of_samples, samples.data(),
+										  MAX_TAPS / 2, double(num_of_samples) / new_num_of_samples,
+										  filters.data(), phase_count, tap_count);
+
+		// Keep the last samples (for the next buffer)
+		memmove(samples.data(), samples.data() + num_of_samples, MAX_TAPS * sizeof(float));
+		samples.resize(MAX_TAPS);
+	}
 
 	// Return buffer pointer to this newly resampled buffer
 	return resampled_buffer;
 }
+
+// Forget the samples of the previous buffers
+void AudioResampler::Reset()
+{
+	input_samples.clear();
+}
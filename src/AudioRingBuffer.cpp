@@ -0,0 +1,116 @@
+/**
+ * @file
+ * @brief Source file for AudioRingBuffer class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/AudioRingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace openshot;
+
+// Constructor
+AudioRingBuffer::AudioRingBuffer(int channels, int capacity)
+	: samples(std::max(channels, 0), std::vector<float>(std::max(capacity, 1), 0.0f)), capacity(std::max(capacity, 1)),
+	  write_position(0), read_position(0)
+{
+}
+
+// Get the number of samples which can be read
+int AudioRingBuffer::Available() const
+{
+	return write_position.load(std::memory_order_acquire) - read_position.load(std::memory_order_acquire);
+}
+
+// Get the number of samples which can be written
+int AudioRingBuffer::Space() const
+{
+	return capacity - Available();
+}
+
+// Write samples into the buffer (only called by the producer thread)
+int AudioRingBuffer::Write(const float* const* channel_samples, int channel_count, int offset, int sample_count)
+{
+	int64_t write = write_position.load(std::memory_order_relaxed);
+	int64_t read = read_position.load(std::memory_order_acquire);
+	int count = std::min(sample_count, int(capacity - (write - read)));
+	if (count <= 0)
+		return 0;
+
+	// Copy in (at most) 2 parts, when the samples wrap around the end of the buffer
+	int start = write % capacity;
+	int first = std::min(count, capacity - start);
+	for (int channel = 0; channel < int(samples.size()); channel++)
+	{
+		float *target = samples[channel].data();
+		if (channel < channel_count) {
+			memcpy(target + start, channel_samples[channel] + offset, first * sizeof(float));
+			memcpy(target, channel_samples[channel] + offset + first, (count - first) * sizeof(float));
+		} else {
+			memset(target + start, 0, first * sizeof(float));
+			memset(target, 0, (count - first) * sizeof(float));
+		}
+	}
+
+	// Publish the samples (after they are copied)
+	write_position.store(write + count, std::memory_order_release);
+	return count;
+}
+
+// Read samples from the buffer (only called by the consumer thread)
+int AudioRingBuffer::Read(float* const* channel_samples, int channel_count, int offset, int sample_count)
+{
+	int64_t read = read_position.load(std::memory_order_relaxed);
+	int64_t write = write_position.load(std::memory_order_acquire);
+	int count = std::min(sample_count, int(write - read));
+	if (count <= 0)
+		return 0;
+
+	// Copy out (at most) 2 parts, when the samples wrap around the end of the buffer
+	int start = read % capacity;
+	int first = std::min(count, capacity - start);
+	for (int channel = 0; channel < channel_count && channel < int(samples.size()); channel++)
+	{
+		const float *source = samples[channel].data();
+		memcpy(channel_samples[channel] + offset, source + start, first * sizeof(float));
+		memcpy(channel_samples[channel] + offset + first, source, (count - first) * sizeof(float));
+	}
+
+	// Release the space (after the samples are copied)
+	read_position.store(read + count, std::memory_order_release);
+	return count;
+}
+
+// Drop the samples before a write position (only called by the consumer thread)
+void AudioRingBuffer::Discard(int64_t position)
+{
+	int64_t read = read_position.load(std::memory_order_relaxed);
+	if (position > read)
+		read_position.store(std::min(position, write_position.load(std::memory_order_acquire)), std::memory_order_release);
+}
@@ -34,13 +34,15 @@ using namespace std;
 using namespace openshot;
 
 // Default constructor, no max frames
-CacheBase::CacheBase() : max_bytes(0) {
+CacheBase::CacheBase() : max_bytes(0), eviction_policy(EVICT_LEAST_RECENTLY_USED), playhead_position(1), playhead_direction(1),
+	memory_gauge(&Metrics::Instance()->GetMemory("cache.other")), tracked_bytes(0) {
 	// Init the critical section
 	cacheCriticalSection = new CriticalSection();
 };
 
 // Constructor that sets the max frames to cache
-CacheBase::CacheBase(int64_t max_bytes) : max_bytes(max_bytes) {
+CacheBase::CacheBase(int64_t max_bytes) : max_bytes(max_bytes), eviction_policy(EVICT_LEAST_RECENTLY_USED), playhead_position(1), playhead_direction(1),
+	memory_gauge(&Metrics::Instance()->GetMemory("cache.other")), tracked_bytes(0) {
 	// Init the critical section
 	cacheCriticalSection = new CriticalSection();
 };
@@ -53,6 +55,39 @@ void CacheBase::SetMaxBytesFromInfo(int64_t number_of_frames, int width, int hei
 	SetMaxBytes(bytes);
 }
 
+// Get the hits, misses, and evictions of this cache (and its hit rate) as JSON
+Json::Value CacheBase::MetricsValue() {
+	int64_t hits = hit_counter.Value();
+	int64_t misses = miss_counter.Value();
+
+	Json::Value root;
+	root["type"] = cache_type;
+	root["hits"] = Json::Int64(hits);
+	root["misses"] = Json::Int64(misses);
+	root["evictions"] = Json::Int64(eviction_counter.Value());
+	root["hit_rate"] = (hits + misses > 0) ? double(hits) / (hits + misses) : 0.0;
+	root["frames"] = Json::Int64(Count());
+	root["bytes"] = Json::Int64(GetBytes());
+	return root;
+}
+
+// Reset the hits, misses, and evictions of this cache
+void CacheBase::ResetMetrics() {
+	hit_counter.Reset();
+	miss_counter.Reset();
+	eviction_counter.Reset();
+}
+
+// Set which memory gauge the frames of this cache count towards
+void CacheBase::SetMemoryTag(std::string tag) {
+	MemoryGauge *gauge = &Metrics::Instance()->GetMemory(tag);
+
+	// Move the bytes already held to the new gauge
+	memory_gauge->Add(-tracked_bytes);
+	gauge->Add(tracked_bytes);
+	memory_gauge = gauge;
+}
+
 // Generate Json::JsonValue for this object
 Json::Value CacheBase::JsonValue() {
 
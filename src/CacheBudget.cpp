@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Source file for CacheBudget class (memory limit shared by all caches)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/CacheBudget.h"
+#include "../include/CacheMemory.h"
+#include "../include/Settings.h"
+
+using namespace std;
+using namespace openshot;
+
+// Global reference to cache budget
+CacheBudget *CacheBudget::m_pInstance = NULL;
+
+// Create or Get an instance of the cache budget singleton
+CacheBudget *CacheBudget::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of cache budget only once
+		m_pInstance = new CacheBudget();
+
+	return m_pInstance;
+}
+
+// Register a memory cache (called by the CacheMemory constructor)
+void CacheBudget::Register(CacheMemory* cache)
+{
+	std::lock_guard<std::recursive_mutex> lock(budget_mutex);
+	caches.push_back(cache);
+}
+
+// Unregister a memory cache (called by the CacheMemory destructor)
+void CacheBudget::Unregister(CacheMemory* cache)
+{
+	std::lock_guard<std::recursive_mutex> lock(budget_mutex);
+	caches.erase(std::remove(caches.begin(), caches.end(), cache), caches.end());
+}
+
+// Get the combined bytes of all registered memory caches
+int64_t CacheBudget::GetBytes()
+{
+	std::lock_guard<std::recursive_mutex> lock(budget_mutex);
+
+	int64_t total_bytes = 0;
+	for (size_t index = 0; index < caches.size(); index++)
+		total_bytes += caches[index]->GetBytes();
+	return total_bytes;
+}
+
+// Evict the least recently used frames (of all caches) until the combined size is under the limit
+void CacheBudget::Enforce()
+{
+	// No limit
+	int64_t limit = Settings::Instance()->CACHE_MEMORY_LIMIT;
+	if (limit <= 0)
+		return;
+
+	std::lock_guard<std::recursive_mutex> lock(budget_mutex);
+	int64_t total_bytes = GetBytes();
+
+	while (total_bytes > limit)
+	{
+		// Find the cache holding the least recently used frame
+		CacheMemory* oldest_cache = NULL;
+		int64_t oldest_use = -1;
+		for (size_t index = 0; index < caches.size(); index++) {
+			int64_t use = caches[index]->OldestUse();
+			if (use >= 0 && (oldest_use < 0 || use < oldest_use)) {
+				oldest_use = use;
+				oldest_cache = caches[index];
+			}
+		}
+
+		// Every cache is down to its minimum frames
+		if (!oldest_cache)
+			break;
+
+		int64_t cache_bytes = oldest_cache->GetBytes();
+		if (!oldest_cache->EvictOldest())
+			break;
+		total_bytes -= cache_bytes - oldest_cache->GetBytes();
+	}
+}
@@ -29,12 +29,32 @@
  */
 
 #include "../include/CacheDisk.h"
+#include <QUuid>
 
 using namespace std;
 using namespace openshot;
 
+// Header of a binary cached frame (followed by the image data, and then the planar audio data)
+struct CacheDiskFrameHeader {
+	char magic[4];			// "OSCF"
+	int32_t version;		// Version of this header
+	int32_t width;			// Image width (or 0 if no image)
+	int32_t height;			// Image height
+	int32_t bytes_per_line;	// Bytes per line of the image data
+	int32_t image_format;	// QImage::Format of the image data
+	int32_t sample_rate;	// Audio sample rate (or 0 if no audio)
+	int32_t channels;		// Number of audio channels
+	int32_t sample_count;	// Number of samples per channel
+	int32_t channel_layout;	// ChannelLayout of the audio
+	int64_t image_offset;	// Offset of the image data in the file
+	int64_t audio_offset;	// Offset of the audio data in the file
+};
+
+// Current version of the binary cached frame header
+#define CACHE_DISK_FRAME_VERSION 1
+
 // Default constructor, no max bytes
-CacheDisk::CacheDisk(std::string cache_path, std::string format, float quality, float scale) : CacheBase(0) {
+CacheDisk::CacheDisk(std::string cache_path, std::string format, float quality, float scale) : CacheBase(0), write_behind(false), writer_running(false), writer_busy(false), max_pending_frames(30) {
 	// Set cache type name
 	cache_type = "CacheDisk";
 	range_version = 0;
@@ -50,7 +70,7 @@ CacheDisk::CacheDisk(std::string cache_path, std::string format, float quality,
 };
 
 // Constructor that sets the max bytes to cache
-CacheDisk::CacheDisk(std::string cache_path, std::string format, float quality, float scale, int64_t max_bytes) : CacheBase(max_bytes) {
+CacheDisk::CacheDisk(std::string cache_path, std::string format, float quality, float scale, int64_t max_bytes) : CacheBase(max_bytes), write_behind(false), writer_running(false), writer_busy(false), max_pending_frames(30) {
 	// Set cache type name
 	cache_type = "CacheDisk";
 	range_version = 0;
@@ -104,8 +124,8 @@ void CacheDisk::CalculateRanges() {
 		range_version++;
 
 		std::vector<int64_t>::iterator itr_ordered;
-		int64_t starting_frame = *ordered_frame_numbers.begin();
-		int64_t ending_frame = *ordered_frame_numbers.begin();
+		int64_t starting_frame = ordered_frame_numbers.empty() ? 0 : *ordered_frame_numbers.begin();
+		int64_t ending_frame = starting_frame;
 
 		// Loop through all known frames (in sequential order)
 		for (itr_ordered = ordered_frame_numbers.begin(); itr_ordered != ordered_frame_numbers.end(); ++itr_ordered) {
@@ -132,21 +152,23 @@ void CacheDisk::CalculateRanges() {
 			ending_frame = frame_number;
 		}
 
-		// APPEND FINAL VALUE
-		Json::Value range;
-
-		// Add JSON object with start/end attributes
-		// Use strings, since int64_ts are supported in JSON
-		std::stringstream start_str;
-		start_str << starting_frame;
-		std::stringstream end_str;
-		end_str << ending_frame;
-		range["start"] = start_str.str();
-		range["end"] = end_str.str();
-		ranges.append(range);
+		// APPEND FINAL VALUE (if any frames are cached)
+		if (!ordered_frame_numbers.empty()) {
+			Json::Value range;
+
+			// Add JSON object with start/end attributes
+			// Use strings, since int64_ts are supported in JSON
+			std::stringstream start_str;
+			start_str << starting_frame;
+			std::stringstream end_str;
+			end_str << ending_frame;
+			range["start"] = start_str.str();
+			range["end"] = end_str.str();
+			ranges.append(range);
+		}
 
 		// Cache range JSON as string
-		json_ranges = ranges.toStyledString();
+		json_ranges = WriteJson(ranges);
 
 		// Reset needs_range_processing
 		needs_range_processing = false;
@@ -156,6 +178,9 @@ void CacheDisk::CalculateRanges() {
 // Default destructor
 CacheDisk::~CacheDisk()
 {
+	// Write staged frames, and stop writer thread
+	SetWriteBehind(false);
+
 	frames.clear();
 	frame_numbers.clear();
 	ordered_frame_numbers.clear();
@@ -168,6 +193,12 @@ CacheDisk::~CacheDisk()
 // Add a Frame to the cache
 void CacheDisk::Add(std::shared_ptr<Frame> frame)
 {
+	// Wait for room in the write-behind queue (without holding the cache lock)
+	if (write_behind) {
+		std::unique_lock<std::mutex> pending_lock(pending_mutex);
+		pending_condition.wait(pending_lock, [this] { return pending_queue.size() < max_pending_frames; });
+	}
+
 	// Create a scoped lock, to protect the cache from multiple threads
 	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
 	int64_t frame_number = frame->number;
@@ -185,42 +216,175 @@ void CacheDisk::Add(std::shared_ptr<Frame> frame)
 		ordered_frame_numbers.push_back(frame_number);
 		needs_range_processing = true;
 
-		// Save image to disk (if needed)
-		QString frame_path(path.path() + "/" + QString("%1.").arg(frame_number) + QString(image_format.c_str()).toLower());
-		frame->Save(frame_path.toStdString(), image_scale, image_format, image_quality);
-		if (frame_size_bytes == 0) {
-			// Get compressed size of frame image (to correctly apply max size against)
-			QFile image_file(frame_path);
-			frame_size_bytes = image_file.size();
+		if (write_behind) {
+			// Stage frame (it stays readable until the writer thread saves it)
+			std::lock_guard<std::mutex> pending_lock(pending_mutex);
+			pending_frames[frame_number] = frame;
+			pending_queue.push_back(frame_number);
+			pending_condition.notify_all();
+
+		} else {
+			// Save image and audio to disk
+			write_frame(frame);
+			update_frame_size(frame_number);
 		}
 
-		// Save audio data (if needed)
-		if (frame->has_audio_data) {
-			QString audio_path(path.path() + "/" + QString("%1").arg(frame_number) + ".audio");
-			QFile audio_file(audio_path);
+		// Clean up old frames
+		CleanUp();
+	}
+}
 
-			if (audio_file.open(QIODevice::WriteOnly)) {
-				QTextStream audio_stream(&audio_file);
-				audio_stream << frame->SampleRate() << endl;
-				audio_stream << frame->GetAudioChannelsCount() << endl;
-				audio_stream << frame->GetAudioSamplesCount() << endl;
-				audio_stream << frame->ChannelsLayout() << endl;
-
-				// Loop through all samples
-				for (int channel = 0; channel < frame->GetAudioChannelsCount(); channel++)
-				{
-					// Get audio for this channel
-					float *samples = frame->GetAudioSamples(channel);
-					for (int sample = 0; sample < frame->GetAudioSamplesCount(); sample++)
-						audio_stream << samples[sample] << endl;
-				}
+// Save a frame's image and audio data to disk
+void CacheDisk::write_frame(std::shared_ptr<Frame> frame)
+{
+	int64_t frame_number = frame->number;
 
+	// Save image to disk (if needed)
+	QString frame_path(path.path() + "/" + QString("%1.").arg(frame_number) + QString(image_format.c_str()).toLower());
+	if (is_binary_format())
+		save_binary(frame, frame_path, image_scale);
+	else
+		frame->Save(frame_path.toStdString(), image_scale, image_format, image_quality);
+
+	// Save audio data (if needed)
+	if (frame->has_audio_data && !is_binary_format()) {
+		QString audio_path(path.path() + "/" + QString("%1").arg(frame_number) + ".audio");
+		QFile audio_file(audio_path);
+
+		if (audio_file.open(QIODevice::WriteOnly)) {
+			QTextStream audio_stream(&audio_file);
+			audio_stream << frame->SampleRate() << endl;
+			audio_stream << frame->GetAudioChannelsCount() << endl;
+			audio_stream << frame->GetAudioSamplesCount() << endl;
+			audio_stream << frame->ChannelsLayout() << endl;
+
+			// Loop through all samples
+			for (int channel = 0; channel < frame->GetAudioChannelsCount(); channel++)
+			{
+				// Get audio for this channel
+				float *samples = frame->GetAudioSamples(channel);
+				for (int sample = 0; sample < frame->GetAudioSamplesCount(); sample++)
+					audio_stream << samples[sample] << endl;
 			}
 
 		}
 
-		// Clean up old frames
-		CleanUp();
+	}
+}
+
+// Get compressed size of frame image (to correctly apply max size against)
+void CacheDisk::update_frame_size(int64_t frame_number)
+{
+	if (frame_size_bytes == 0) {
+		QString frame_path(path.path() + "/" + QString("%1.").arg(frame_number) + QString(image_format.c_str()).toLower());
+		QFile image_file(frame_path);
+		frame_size_bytes = image_file.size();
+	}
+}
+
+// Remove a frame's image and audio files (if they exist)
+void CacheDisk::remove_files(int64_t frame_number)
+{
+	// Remove the image file (if it exists)
+	QString frame_path(path.path() + "/" + QString("%1.").arg(frame_number) + QString(image_format.c_str()).toLower());
+	QFile image_file(frame_path);
+	if (image_file.exists())
+		image_file.remove();
+
+	// Remove audio file (if it exists)
+	QString audio_path(path.path() + "/" + QString("%1").arg(frame_number) + ".audio");
+	QFile audio_file(audio_path);
+	if (audio_file.exists())
+		audio_file.remove();
+}
+
+// Enable or disable asynchronous writes
+void CacheDisk::SetWriteBehind(bool enabled, int max_pending)
+{
+	if (enabled && !write_behind) {
+		// Start writer thread
+		max_pending_frames = std::max(1, max_pending);
+		write_behind = true;
+		writer_running = true;
+		writer_thread = std::thread(&CacheDisk::writer_loop, this);
+
+	} else if (!enabled && write_behind) {
+		// Write all staged frames, and stop writer thread
+		{
+			std::lock_guard<std::mutex> pending_lock(pending_mutex);
+			writer_running = false;
+			pending_condition.notify_all();
+		}
+		writer_thread.join();
+		write_behind = false;
+	}
+}
+
+// Wait until all staged frames have been written to disk
+void CacheDisk::Flush()
+{
+	std::unique_lock<std::mutex> pending_lock(pending_mutex);
+	pending_condition.wait(pending_lock, [this] { return pending_queue.empty() && pending_frames.empty() && !writer_busy; });
+}
+
+// Write staged frames to disk (on the writer thread)
+void CacheDisk::writer_loop()
+{
+	while (true) {
+		// Wait for a staged frame
+		int64_t frame_number = 0;
+		std::shared_ptr<Frame> frame;
+		{
+			std::unique_lock<std::mutex> pending_lock(pending_mutex);
+			pending_condition.wait(pending_lock, [this] { return !pending_queue.empty() || !writer_running; });
+			if (pending_queue.empty())
+				// Stopped and nothing left to write
+				break;
+
+			// Staged frames stay in pending_frames (readable from GetFrame) until written
+			frame_number = pending_queue.front();
+			pending_queue.pop_front();
+			writer_busy = true;
+			std::map<int64_t, std::shared_ptr<Frame> >::iterator staged = pending_frames.find(frame_number);
+			if (staged != pending_frames.end())
+				frame = staged->second;
+			pending_condition.notify_all();
+		}
+
+		// Removed before it was written
+		if (!frame) {
+			std::lock_guard<std::mutex> pending_lock(pending_mutex);
+			writer_busy = false;
+			pending_condition.notify_all();
+			continue;
+		}
+
+		// Write frame (without holding any lock)
+		try {
+			write_frame(frame);
+		} catch (const std::exception& e) {
+			// The frame is re-rendered when missing from disk
+			ZmqLogger::Instance()->AppendDebugMethod("CacheDisk::writer_loop (failed to write frame)", "frame_number", frame_number);
+		}
+
+		{
+			// Create a scoped lock, to protect the cache from multiple threads
+			const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+			std::lock_guard<std::mutex> pending_lock(pending_mutex);
+
+			if (!frames.count(frame_number))
+				// Frame was removed (or cleared) while it was being written
+				remove_files(frame_number);
+			else
+				update_frame_size(frame_number);
+
+			// Unstage frame (unless it was removed and added again)
+			std::map<int64_t, std::shared_ptr<Frame> >::iterator staged = pending_frames.find(frame_number);
+			if (staged != pending_frames.end() && staged->second == frame)
+				pending_frames.erase(staged);
+			writer_busy = false;
+			pending_condition.notify_all();
+		}
 	}
 }
 
@@ -232,9 +396,26 @@ std::shared_ptr<Frame> CacheDisk::GetFrame(int64_t frame_number)
 
 	// Does frame exists in cache?
 	if (frames.count(frame_number)) {
+		// Is frame still waiting to be written
+		if (write_behind) {
+			std::lock_guard<std::mutex> pending_lock(pending_mutex);
+			std::map<int64_t, std::shared_ptr<Frame> >::iterator staged = pending_frames.find(frame_number);
+			if (staged != pending_frames.end()) {
+				hit_counter.Increment();
+				return staged->second;
+			}
+		}
+
 		// Does frame exist on disk
 		QString frame_path(path.path() + "/" + QString("%1.").arg(frame_number) + QString(image_format.c_str()).toLower());
-		if (path.exists(frame_path)) {
+		if (path.exists(frame_path) && is_binary_format()) {
+			// Load binary frame (pixels and audio)
+			hit_counter.Increment();
+			return load_binary(frame_number, frame_path);
+		}
+
+		else if (path.exists(frame_path)) {
+			hit_counter.Increment();
 
 			// Load image file
 			std::shared_ptr<QImage> image = std::shared_ptr<QImage>(new QImage());
@@ -291,9 +472,147 @@ std::shared_ptr<Frame> CacheDisk::GetFrame(int64_t frame_number)
 	}
 
 	// no Frame found
+	miss_counter.Increment();
 	return std::shared_ptr<Frame>();
 }
 
+// Is this cache using the binary frame format (instead of image files and text audio files)
+bool CacheDisk::is_binary_format()
+{
+	return QString(image_format.c_str()).toLower() == "raw";
+}
+
+// Save a frame's pixels and audio samples into a single binary file
+void CacheDisk::save_binary(std::shared_ptr<Frame> frame, QString frame_path, float scale)
+{
+	// Get image (scaled if needed)
+	std::shared_ptr<QImage> image;
+	if (frame->has_image_data) {
+		image = frame->GetImage();
+		if (abs(scale) > 1.001 || abs(scale) < 0.999)
+			image = std::shared_ptr<QImage>(new QImage(image->scaled(image->width() * scale, image->height() * scale, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
+	}
+
+	// Init header
+	CacheDiskFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "OSCF", 4);
+	header.version = CACHE_DISK_FRAME_VERSION;
+	if (image) {
+		header.width = image->width();
+		header.height = image->height();
+		header.bytes_per_line = image->bytesPerLine();
+		header.image_format = image->format();
+	}
+	if (frame->has_audio_data) {
+		header.sample_rate = frame->SampleRate();
+		header.channels = frame->GetAudioChannelsCount();
+		header.sample_count = frame->GetAudioSamplesCount();
+		header.channel_layout = frame->ChannelsLayout();
+	}
+	header.image_offset = sizeof(header);
+	header.audio_offset = header.image_offset + (int64_t) header.bytes_per_line * header.height;
+
+	QFile frame_file(frame_path);
+	if (!frame_file.open(QIODevice::WriteOnly))
+		throw InvalidFile("Could not write the cached frame.", frame_path.toStdString());
+
+	// Write header, image, and audio (one channel after another)
+	frame_file.write((const char*) &header, sizeof(header));
+	if (image)
+		frame_file.write((const char*) image->constBits(), (int64_t) header.bytes_per_line * header.height);
+	for (int channel = 0; channel < header.channels; channel++)
+		frame_file.write((const char*) frame->GetAudioSamples(channel), header.sample_count * sizeof(float));
+	frame_file.close();
+}
+
+// Load a frame from a binary file (which is memory-mapped while reading)
+std::shared_ptr<Frame> CacheDisk::load_binary(int64_t frame_number, QString frame_path)
+{
+	QFile frame_file(frame_path);
+	if (!frame_file.open(QIODevice::ReadOnly) || frame_file.size() < (qint64) sizeof(CacheDiskFrameHeader))
+		return std::shared_ptr<Frame>();
+
+	uchar *data = frame_file.map(0, frame_file.size());
+	if (!data)
+		return std::shared_ptr<Frame>();
+
+	// Verify header
+	CacheDiskFrameHeader header;
+	memcpy(&header, data, sizeof(header));
+	int64_t image_bytes = (int64_t) header.bytes_per_line * header.height;
+	int64_t audio_bytes = (int64_t) header.channels * header.sample_count * sizeof(float);
+	if (memcmp(header.magic, "OSCF", 4) != 0 || header.version != CACHE_DISK_FRAME_VERSION ||
+		header.image_offset + image_bytes > frame_file.size() || header.audio_offset + audio_bytes > frame_file.size()) {
+		frame_file.unmap(data);
+		return std::shared_ptr<Frame>();
+	}
+
+	// Create frame object
+	std::shared_ptr<Frame> frame(new Frame());
+	frame->number = frame_number;
+
+	// Copy image out of the mapped file
+	if (header.width > 0 && header.height > 0) {
+		QImage mapped_image(data + header.image_offset, header.width, header.height, header.bytes_per_line, (QImage::Format) header.image_format);
+		frame->AddImage(std::shared_ptr<QImage>(new QImage(mapped_image.copy())));
+	}
+
+	// Add audio (directly from the mapped file)
+	if (header.channels > 0 && header.sample_count > 0) {
+		frame->ResizeAudio(header.channels, header.sample_count, header.sample_rate, (ChannelLayout) header.channel_layout);
+		for (int channel = 0; channel < header.channels; channel++) {
+			const float *channel_samples = (const float*) (data + header.audio_offset + (int64_t) channel * header.sample_count * sizeof(float));
+			frame->AddAudio(true, channel, 0, channel_samples, header.sample_count, 1.0);
+		}
+	}
+
+	frame_file.unmap(data);
+
+	// return the Frame object
+	return frame;
+}
+
+// Get the path of the file of a keyed frame
+QString CacheDisk::keyed_frame_path(std::string key)
+{
+	return path.path() + "/" + QString::fromStdString(key) + ".frame";
+}
+
+// Add a frame keyed by a hash of its inputs (which other sessions using this folder can get)
+void CacheDisk::AddKeyed(std::string key, std::shared_ptr<Frame> frame)
+{
+	QString frame_path = keyed_frame_path(key);
+	if (QFile::exists(frame_path))
+		return;
+
+	// Another session could be writing the same frame (the first renamed file is kept)
+	QString temp_path = frame_path + "." + QUuid::createUuid().toString().mid(1, 36) + ".tmp";
+	try {
+		save_binary(frame, temp_path, 1.0);
+	} catch (const InvalidFile& e) {
+		// A folder which can't be written (i.e. read-only shared storage) only provides frames
+		QFile::remove(temp_path);
+		return;
+	}
+	if (!QFile::rename(temp_path, frame_path))
+		QFile::remove(temp_path);
+}
+
+// Get a keyed frame (or NULL if no frame was added with this key)
+std::shared_ptr<Frame> CacheDisk::GetKeyedFrame(std::string key, int64_t frame_number)
+{
+	QString frame_path = keyed_frame_path(key);
+	std::shared_ptr<Frame> frame;
+	if (QFile::exists(frame_path))
+		frame = load_binary(frame_number, frame_path);
+	if (frame)
+		hit_counter.Increment();
+	else
+		miss_counter.Increment();
+	return frame;
+}
+
 // Get the smallest frame number (or NULL shared_ptr if no frame is found)
 std::shared_ptr<Frame> CacheDisk::GetSmallestFrame()
 {
@@ -366,17 +685,15 @@ void CacheDisk::Remove(int64_t start_frame_number, int64_t end_frame_number)
 			// erase frame number
 			frames.erase(*itr_ordered);
 
-			// Remove the image file (if it exists)
-			QString frame_path(path.path() + "/" + QString("%1.").arg(*itr_ordered) + QString(image_format.c_str()).toLower());
-			QFile image_file(frame_path);
-			if (image_file.exists())
-				image_file.remove();
+			// Unstage frame (if it has not been written yet)
+			if (write_behind) {
+				std::lock_guard<std::mutex> pending_lock(pending_mutex);
+				pending_frames.erase(*itr_ordered);
+				pending_condition.notify_all();
+			}
 
-			// Remove audio file (if it exists)
-			QString audio_path(path.path() + "/" + QString("%1").arg(*itr_ordered) + ".audio");
-			QFile audio_file(audio_path);
-			if (audio_file.exists())
-				audio_file.remove();
+			// Remove the image and audio files (if they exist)
+			remove_files(*itr_ordered);
 
 			itr_ordered = ordered_frame_numbers.erase(itr_ordered);
 		} else
@@ -425,6 +742,11 @@ void CacheDisk::Clear()
 	ordered_frame_numbers.clear();
 	needs_range_processing = true;
 	frame_size_bytes = 0;
+	if (write_behind) {
+		std::lock_guard<std::mutex> pending_lock(pending_mutex);
+		pending_frames.clear();
+		pending_condition.notify_all();
+	}
 
 	// Delete cache directory, and recreate it
 	QString current_path = path.path();
@@ -460,6 +782,7 @@ void CacheDisk::CleanUp()
 
 			// Remove frame_number and frame
 			Remove(frame_to_remove);
+			eviction_counter.Increment();
 		}
 	}
 }
@@ -468,7 +791,7 @@ void CacheDisk::CleanUp()
 std::string CacheDisk::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -509,13 +832,7 @@ void CacheDisk::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-	               value.c_str() + value.size(), &root, &errors );
- 	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -28,33 +28,73 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+#include <QtCore/QHash>
 #include "../include/CacheMemory.h"
+#include "../include/Settings.h"
 
 using namespace std;
 using namespace openshot;
 
+namespace {
+	// Hash the pixels of an image (without the padding of its lines), seeded with its size and format
+	uint hash_image(const QImage& image) {
+		int line_bytes = image.width() * image.depth() / 8;
+		uint hash = qHash(image.width()) ^ qHash(image.height() * 31 + image.format());
+		for (int y = 0; y < image.height(); y++)
+			hash = qHashBits(image.constScanLine(y), line_bytes, hash);
+
+		// 0 means an image which is not hashed
+		return hash ? hash : 1;
+	}
+
+	// Are the pixels of two images the same
+	bool same_pixels(const QImage& image, const QImage& other) {
+		if (image.size() != other.size() || image.format() != other.format())
+			return false;
+		int line_bytes = image.width() * image.depth() / 8;
+		for (int y = 0; y < image.height(); y++)
+			if (memcmp(image.constScanLine(y), other.constScanLine(y), line_bytes) != 0)
+				return false;
+		return true;
+	}
+}
+
 // Default constructor, no max bytes
-CacheMemory::CacheMemory() : CacheBase(0) {
+CacheMemory::CacheMemory() : CacheBase(0), total_bytes(0), compress_images(false),
+	deduplicate_images(Settings::Instance()->CACHE_DEDUPLICATION) {
 	// Set cache type name
 	cache_type = "CacheMemory";
 	range_version = 0;
 	needs_range_processing = false;
+	json_ranges = Json::Value(Json::arrayValue);
+
+	// Share the process-wide memory limit with all other caches
+	CacheBudget::Instance()->Register(this);
 };
 
 // Constructor that sets the max bytes to cache
-CacheMemory::CacheMemory(int64_t max_bytes) : CacheBase(max_bytes) {
+CacheMemory::CacheMemory(int64_t max_bytes) : CacheBase(max_bytes), total_bytes(0), compress_images(false),
+	deduplicate_images(Settings::Instance()->CACHE_DEDUPLICATION) {
 	// Set cache type name
 	cache_type = "CacheMemory";
 	range_version = 0;
 	needs_range_processing = false;
+	json_ranges = Json::Value(Json::arrayValue);
+
+	// Share the process-wide memory limit with all other caches
+	CacheBudget::Instance()->Register(this);
 };
 
 // Default destructor
 CacheMemory::~CacheMemory()
 {
+	CacheBudget::Instance()->Unregister(this);
+
 	frames.clear();
 	frame_numbers.clear();
-	ordered_frame_numbers.clear();
+	frame_ranges.clear();
+	track_bytes(0);
 
 	// remove critical section
 	delete cacheCriticalSection;
@@ -68,146 +108,351 @@ void CacheMemory::CalculateRanges() {
 	if (needs_range_processing) {
 
 		// Create a scoped lock, to protect the cache from multiple threads
-		const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
-
-		// Sort ordered frame #s, and calculate JSON ranges
-		std::sort(ordered_frame_numbers.begin(), ordered_frame_numbers.end());
+		const ScopedWriteLock lock(cacheReadWriteLock);
 
 		// Clear existing JSON variable
-		Json::Value ranges = Json::Value(Json::arrayValue);
+		json_ranges = Json::Value(Json::arrayValue);
 
 		// Increment range version
 		range_version++;
 
-		std::vector<int64_t>::iterator itr_ordered;
-		int64_t starting_frame = *ordered_frame_numbers.begin();
-		int64_t ending_frame = *ordered_frame_numbers.begin();
-
-		// Loop through all known frames (in sequential order)
-		for (itr_ordered = ordered_frame_numbers.begin(); itr_ordered != ordered_frame_numbers.end(); ++itr_ordered) {
-			int64_t frame_number = *itr_ordered;
-			if (frame_number - ending_frame > 1) {
-				// End of range detected
-				Json::Value range;
-
-				// Add JSON object with start/end attributes
-				// Use strings, since int64_ts are supported in JSON
-				std::stringstream start_str;
-				start_str << starting_frame;
-				std::stringstream end_str;
-				end_str << ending_frame;
-				range["start"] = start_str.str();
-				range["end"] = end_str.str();
-				ranges.append(range);
-
-				// Set new starting range
-				starting_frame = frame_number;
-			}
+		// Ranges are already merged (and sorted), so just copy them
+		std::map<int64_t, int64_t>::iterator itr_range;
+		for (itr_range = frame_ranges.begin(); itr_range != frame_ranges.end(); ++itr_range) {
+			// Add JSON object with start/end attributes
+			// Use strings, since int64_ts are not supported in JSON
+			Json::Value range;
+			range["start"] = std::to_string(itr_range->first);
+			range["end"] = std::to_string(itr_range->second);
+			json_ranges.append(range);
+		}
 
-			// Set current frame as end of range, and keep looping
-			ending_frame = frame_number;
+		// Reset needs_range_processing
+		needs_range_processing = false;
+	}
+}
+
+// Add a frame number to the ranges of frames (merging with neighboring ranges)
+void CacheMemory::add_range(int64_t frame_number) {
+	int64_t start = frame_number;
+	int64_t end = frame_number;
+
+	// Merge with the range that ends just before this frame
+	std::map<int64_t, int64_t>::iterator next = frame_ranges.upper_bound(frame_number);
+	if (next != frame_ranges.begin()) {
+		std::map<int64_t, int64_t>::iterator previous = std::prev(next);
+		if (previous->second >= frame_number)
+			// Already part of a range
+			return;
+		if (previous->second == frame_number - 1) {
+			start = previous->first;
+			frame_ranges.erase(previous);
 		}
+	}
 
-		// APPEND FINAL VALUE
-		Json::Value range;
+	// Merge with the range that starts just after this frame
+	if (next != frame_ranges.end() && next->first == frame_number + 1) {
+		end = next->second;
+		frame_ranges.erase(next);
+	}
 
-		// Add JSON object with start/end attributes
-		// Use strings, since int64_ts are not supported in JSON
-		std::stringstream start_str;
-		start_str << starting_frame;
-		std::stringstream end_str;
-		end_str << ending_frame;
-		range["start"] = start_str.str();
-		range["end"] = end_str.str();
-		ranges.append(range);
+	frame_ranges[start] = end;
+	needs_range_processing = true;
+}
 
-		// Cache range JSON as string
-		json_ranges = ranges.toStyledString();
+// Remove a range of frame numbers from the ranges of frames (splitting ranges if needed)
+void CacheMemory::remove_range(int64_t start_frame_number, int64_t end_frame_number) {
+	// Find the first range which overlaps
+	std::map<int64_t, int64_t>::iterator itr_range = frame_ranges.upper_bound(start_frame_number);
+	if (itr_range != frame_ranges.begin() && std::prev(itr_range)->second >= start_frame_number)
+		--itr_range;
 
-		// Reset needs_range_processing
-		needs_range_processing = false;
+	while (itr_range != frame_ranges.end() && itr_range->first <= end_frame_number) {
+		int64_t start = itr_range->first;
+		int64_t end = itr_range->second;
+		itr_range = frame_ranges.erase(itr_range);
+
+		// Keep the parts of this range outside of the removed frames
+		if (start < start_frame_number)
+			frame_ranges[start] = start_frame_number - 1;
+		if (end > end_frame_number)
+			frame_ranges[end_frame_number + 1] = end;
+
+		needs_range_processing = true;
 	}
 }
 
 // Add a Frame to the cache
 void CacheMemory::Add(std::shared_ptr<Frame> frame)
 {
-	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	// Measure (and compress) the frame before locking the cache
 	int64_t frame_number = frame->number;
+	CacheEntry entry;
+	entry.frame = frame;
+	entry.bytes = frame->GetBytes();
+	entry.image_bytes = frame->GetImageBytes();
+	entry.image_data = (frame->has_image_data && !frame->IsImageDeferred()) ? frame->GetImage()->constBits() : NULL;
+	entry.image_hash = 0;
+	if (compress_images && frame->has_image_data)
+		compress_entry(frame, entry);
+	else if (deduplicate_images)
+		deduplicate_entry(frame, entry);
+
+	std::vector<std::shared_ptr<Frame> > evicted;
+	{
+		// Create a scoped lock, to protect the cache from multiple threads
+		const ScopedWriteLock lock(cacheReadWriteLock);
 
-	// Freshen frame if it already exists
-	if (frames.count(frame_number))
-		// Move frame to front of queue
-		MoveToFront(frame_number);
+		// Freshen frame if it already exists
+		if (frames.count(frame_number))
+			// Move frame to front of queue
+			MoveToFront(frame_number);
 
-	else
-	{
-		// Add frame to queue and map
-		frames[frame_number] = frame;
-		frame_numbers.push_front(frame_number);
-		ordered_frame_numbers.push_back(frame_number);
-		needs_range_processing = true;
+		else
+		{
+			// Add frame to queue and map
+			frame_numbers.push_front(frame_number);
+			entry.recent = frame_numbers.begin();
+			entry.last_used = CacheBudget::Instance()->NextUse();
+			total_bytes += entry.bytes;
+
+			// Only count an image buffer once (frames can share the same QImage data)
+			if (entry.image_data) {
+				entry.bytes -= entry.image_bytes;
+				if (image_buffers[entry.image_data]++ > 0)
+					total_bytes -= entry.image_bytes;
+			}
 
-		// Clean up old frames
-		CleanUp();
+			frames[frame_number] = entry;
+			add_range(frame_number);
+
+			// The next frame with the same image shares the image buffer of this frame
+			if (entry.image_hash && !image_hashes.count(entry.image_hash))
+				image_hashes[entry.image_hash] = frame_number;
+
+			// Clean up old frames
+			CleanUp();
+			track_bytes(total_bytes);
+			evicted.swap(evicted_frames);
+		}
 	}
+
+	// Pass evicted frames to the callback (without holding the cache lock)
+	if (eviction_callback)
+		for (size_t index = 0; index < evicted.size(); index++)
+			eviction_callback(evicted[index]);
+
+	// Keep all caches combined under the memory limit
+	CacheBudget::Instance()->Enforce();
 }
 
-// Get a frame from the cache (or NULL shared_ptr if no frame is found)
-std::shared_ptr<Frame> CacheMemory::GetFrame(int64_t frame_number)
+// Get when the least recently used frame was last used (or -1 if the cache only holds its minimum frames)
+int64_t CacheMemory::OldestUse()
+{
+	// Create a shared lock (lookups can run at the same time as other lookups)
+	const ScopedReadLock lock(cacheReadWriteLock);
+
+	if (frame_numbers.size() <= 20)
+		return -1;
+	return frames.find(next_eviction())->second.last_used;
+}
+
+// Evict the least recently used frame (unless the cache only holds its minimum frames), used by CacheBudget
+bool CacheMemory::EvictOldest()
+{
+	std::shared_ptr<Frame> evicted;
+	{
+		// Create a scoped lock, to protect the cache from multiple threads
+		const ScopedWriteLock lock(cacheReadWriteLock);
+
+		if (frame_numbers.size() <= 20)
+			return false;
+
+		// Remove the oldest frame
+		int64_t frame_number = next_eviction();
+		std::unordered_map<int64_t, CacheEntry>::iterator entry = frames.find(frame_number);
+		if (eviction_callback)
+			evicted = restore_entry(entry->second);
+		remove_entry(entry);
+		remove_range(frame_number, frame_number);
+		eviction_counter.Increment();
+	}
+
+	// Pass evicted frame to the callback (without holding the cache lock)
+	if (eviction_callback)
+		eviction_callback(evicted);
+	return true;
+}
+
+// Set a function to call with each frame evicted by CleanUp
+void CacheMemory::SetEvictionCallback(std::function<void(std::shared_ptr<openshot::Frame>)> callback)
 {
 	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	const ScopedWriteLock lock(cacheReadWriteLock);
+	eviction_callback = callback;
+}
 
+// Get a frame from the cache (or NULL shared_ptr if no frame is found)
+std::shared_ptr<Frame> CacheMemory::GetFrame(int64_t frame_number)
+{
 	// Does frame exists in cache?
-	if (frames.count(frame_number))
-		// return the Frame object
-		return frames[frame_number];
+	CacheEntry found;
+	{
+		// Create a shared lock (lookups can run at the same time as other lookups)
+		const ScopedReadLock lock(cacheReadWriteLock);
+
+		std::unordered_map<int64_t, CacheEntry>::iterator entry = frames.find(frame_number);
+		if (entry == frames.end()) {
+			// no Frame found
+			miss_counter.Increment();
+			return std::shared_ptr<Frame>();
+		}
+		hit_counter.Increment();
 
-	else
-		// no Frame found
-		return std::shared_ptr<Frame>();
+		if (entry->second.compressed_image.isEmpty())
+			// return the Frame object
+			return entry->second.frame;
+
+		// Copy entry (compressed data is shared, not copied), and decompress it without holding the lock
+		found = entry->second;
+	}
+
+	return restore_entry(found);
 }
 
-// Get the smallest frame number (or NULL shared_ptr if no frame is found)
-std::shared_ptr<Frame> CacheMemory::GetSmallestFrame()
+// Compress a frame's image into a cache entry (the entry keeps a copy of the frame with only its audio)
+void CacheMemory::compress_entry(std::shared_ptr<Frame> frame, CacheEntry& entry)
 {
-	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
-	std::shared_ptr<openshot::Frame> f;
+	std::shared_ptr<QImage> image = frame->GetImage();
+	entry.image_width = image->width();
+	entry.image_height = image->height();
+	entry.image_bytes_per_line = image->bytesPerLine();
+	entry.image_format = image->format();
+	entry.compressed_image = qCompress(image->constBits(), image->bytesPerLine() * image->height(), 1);
+
+	// Keep a copy of the frame without its image (audio is kept raw)
+	std::shared_ptr<Frame> audio_frame(new Frame(frame->number, image->width(), image->height(), "#000000", frame->GetAudioSamplesCount(), frame->GetAudioChannelsCount()));
+	audio_frame->SampleRate(frame->SampleRate());
+	audio_frame->ChannelsLayout(frame->ChannelsLayout());
+	audio_frame->SetPixelRatio(frame->GetPixelRatio().num, frame->GetPixelRatio().den);
+	if (frame->has_audio_data)
+		for (int channel = 0; channel < frame->GetAudioChannelsCount(); channel++)
+			audio_frame->AddAudio(true, channel, 0, frame->GetAudioSamples(channel), frame->GetAudioSamplesCount(), 1.0);
+
+	entry.frame = audio_frame;
+	entry.bytes = audio_frame->GetBytes() + entry.compressed_image.size();
+	entry.image_bytes = 0;
+	entry.image_data = NULL;
+}
 
-	// Loop through frame numbers
-	std::deque<int64_t>::iterator itr;
-	int64_t smallest_frame = -1;
-	for(itr = frame_numbers.begin(); itr != frame_numbers.end(); ++itr)
+// Share the image buffer of a cached frame with an identical image (if any) with a frame being added
+void CacheMemory::deduplicate_entry(std::shared_ptr<Frame> frame, CacheEntry& entry)
+{
+	// Native planes belong to the image buffer they were converted to, and a deferred image is not loaded to hash it
+	if (!frame->has_image_data || frame->IsImageDeferred() || frame->HasImageGeometry() || frame->GetPlanes())
+		return;
+	std::shared_ptr<QImage> image = frame->GetImage();
+	entry.image_hash = hash_image(*image);
+
+	// Find the cached frame with the same hash
+	std::shared_ptr<Frame> identical_frame;
 	{
-		if (*itr < smallest_frame || smallest_frame == -1)
-			smallest_frame = *itr;
+		const ScopedReadLock lock(cacheReadWriteLock);
+		std::unordered_map<uint, int64_t>::iterator hashed = image_hashes.find(entry.image_hash);
+		if (hashed != image_hashes.end())
+			identical_frame = frames.find(hashed->second)->second.frame;
 	}
+	if (!identical_frame || identical_frame == frame)
+		return;
 
-	// Return frame
-	f = GetFrame(smallest_frame);
+	// The cached image could have been changed since it was hashed (so the pixels are compared)
+	std::shared_ptr<QImage> identical_image = identical_frame->GetImage();
+	if (identical_image->constBits() == image->constBits() || !same_pixels(*identical_image, *image))
+		return;
 
-	return f;
+	// Both frames read the same (copy-on-write) buffer, which is counted once
+	frame->AddImage(std::make_shared<QImage>(*identical_image));
+	entry.image_data = identical_image->constBits();
+}
+
+// Get the cached frame of an entry (decompressing its image, if needed)
+std::shared_ptr<Frame> CacheMemory::restore_entry(const CacheEntry& entry)
+{
+	if (entry.compressed_image.isEmpty())
+		return entry.frame;
+
+	// Clone the audio frame, and add the decompressed image
+	std::shared_ptr<Frame> frame = entry.frame->ShallowClone();
+	QByteArray pixels = qUncompress(entry.compressed_image);
+	QImage pixels_image((const uchar*) pixels.constData(), entry.image_width, entry.image_height, entry.image_bytes_per_line, entry.image_format);
+	frame->AddImage(std::shared_ptr<QImage>(new QImage(pixels_image.copy())));
+	return frame;
+}
+
+// Get the smallest frame number (or NULL shared_ptr if no frame is found)
+std::shared_ptr<Frame> CacheMemory::GetSmallestFrame()
+{
+	// Create a shared lock (lookups can run at the same time as other lookups)
+	const ScopedReadLock lock(cacheReadWriteLock);
+
+	// The first range starts with the smallest frame
+	if (frame_ranges.empty())
+		return std::shared_ptr<Frame>();
+
+	return GetFrame(frame_ranges.begin()->first);
 }
 
 // Gets the maximum bytes value
 int64_t CacheMemory::GetBytes()
 {
-	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	// Create a shared lock (lookups can run at the same time as other lookups)
+	const ScopedReadLock lock(cacheReadWriteLock);
 
-	int64_t total_bytes = 0;
+	// Running total (updated as frames are added and removed)
+	return total_bytes;
+}
 
-	// Loop through frames, and calculate total bytes
-	std::deque<int64_t>::reverse_iterator itr;
-	for(itr = frame_numbers.rbegin(); itr != frame_numbers.rend(); ++itr)
-	{
-		total_bytes += frames[*itr]->GetBytes();
+// Get the next frame number to evict (depending on the eviction policy)
+int64_t CacheMemory::next_eviction()
+{
+	if (eviction_policy == EVICT_FAR_FROM_PLAYHEAD && !frame_ranges.empty()) {
+		// The farthest frames are the first and last cached frames. Frames behind the playhead
+		// count as twice as far (they are less likely to be needed again than frames ahead).
+		// The playhead is read once (the player's thread moves it while frames are added).
+		int64_t playhead = playhead_position;
+		int direction = playhead_direction;
+		int64_t first_frame = frame_ranges.begin()->first;
+		int64_t last_frame = frame_ranges.rbegin()->second;
+		int64_t first_distance = (playhead - first_frame) * (direction > 0 ? 2 : 1);
+		int64_t last_distance = (last_frame - playhead) * (direction < 0 ? 2 : 1);
+		return (first_distance >= last_distance) ? first_frame : last_frame;
 	}
 
-	return total_bytes;
+	// Least recently used frame
+	return frame_numbers.back();
+}
+
+// Remove a cached frame (and its size from the running total)
+void CacheMemory::remove_entry(std::unordered_map<int64_t, CacheEntry>::iterator entry)
+{
+	total_bytes -= entry->second.bytes;
+
+	// Remove the image buffer size, when no other cached frame shares it
+	if (entry->second.image_data && --image_buffers[entry->second.image_data] == 0) {
+		image_buffers.erase(entry->second.image_data);
+		total_bytes -= entry->second.image_bytes;
+	}
+
+	// Later frames with the same image start a new buffer
+	if (entry->second.image_hash) {
+		std::unordered_map<uint, int64_t>::iterator hashed = image_hashes.find(entry->second.image_hash);
+		if (hashed != image_hashes.end() && hashed->second == entry->first)
+			image_hashes.erase(hashed);
+	}
+
+	frame_numbers.erase(entry->second.recent);
+	frames.erase(entry);
+	track_bytes(total_bytes);
 }
 
 // Remove a specific frame
@@ -220,60 +465,37 @@ void CacheMemory::Remove(int64_t frame_number)
 void CacheMemory::Remove(int64_t start_frame_number, int64_t end_frame_number)
 {
 	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
-
-	// Loop through frame numbers
-	std::deque<int64_t>::iterator itr;
-	for(itr = frame_numbers.begin(); itr != frame_numbers.end();)
-	{
-		if (*itr >= start_frame_number && *itr <= end_frame_number)
-		{
-			// erase frame number
-			itr = frame_numbers.erase(itr);
-		}else
-			itr++;
+	const ScopedWriteLock lock(cacheReadWriteLock);
+
+	// Loop through the cached ranges which overlap this range
+	std::map<int64_t, int64_t>::iterator itr_range = frame_ranges.upper_bound(start_frame_number);
+	if (itr_range != frame_ranges.begin())
+		--itr_range;
+
+	for (; itr_range != frame_ranges.end() && itr_range->first <= end_frame_number; ++itr_range) {
+		// erase frames (and frame numbers)
+		int64_t start = std::max(itr_range->first, start_frame_number);
+		int64_t end = std::min(itr_range->second, end_frame_number);
+		for (int64_t frame_number = start; frame_number <= end; frame_number++)
+			remove_entry(frames.find(frame_number));
 	}
 
-	// Loop through ordered frame numbers
-	std::vector<int64_t>::iterator itr_ordered;
-	for(itr_ordered = ordered_frame_numbers.begin(); itr_ordered != ordered_frame_numbers.end();)
-	{
-		if (*itr_ordered >= start_frame_number && *itr_ordered <= end_frame_number)
-		{
-			// erase frame number
-			frames.erase(*itr_ordered);
-			itr_ordered = ordered_frame_numbers.erase(itr_ordered);
-		}else
-			itr_ordered++;
-	}
-
-	// Needs range processing (since cache has changed)
-	needs_range_processing = true;
+	// Update ranges (since cache has changed)
+	remove_range(start_frame_number, end_frame_number);
 }
 
 // Move frame to front of queue (so it lasts longer)
 void CacheMemory::MoveToFront(int64_t frame_number)
 {
 	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	const ScopedWriteLock lock(cacheReadWriteLock);
 
 	// Does frame exists in cache?
-	if (frames.count(frame_number))
-	{
-		// Loop through frame numbers
-		std::deque<int64_t>::iterator itr;
-		for(itr = frame_numbers.begin(); itr != frame_numbers.end(); ++itr)
-		{
-			if (*itr == frame_number)
-			{
-				// erase frame number
-				frame_numbers.erase(itr);
-
-				// add frame number to 'front' of queue
-				frame_numbers.push_front(frame_number);
-				break;
-			}
-		}
+	std::unordered_map<int64_t, CacheEntry>::iterator entry = frames.find(frame_number);
+	if (entry != frames.end()) {
+		// move frame number to 'front' of queue
+		frame_numbers.splice(frame_numbers.begin(), frame_numbers, entry->second.recent);
+		entry->second.last_used = CacheBudget::Instance()->NextUse();
 	}
 }
 
@@ -281,19 +503,23 @@ void CacheMemory::MoveToFront(int64_t frame_number)
 void CacheMemory::Clear()
 {
 	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	const ScopedWriteLock lock(cacheReadWriteLock);
 
 	frames.clear();
 	frame_numbers.clear();
-	ordered_frame_numbers.clear();
+	frame_ranges.clear();
+	image_buffers.clear();
+	image_hashes.clear();
+	total_bytes = 0;
+	track_bytes(0);
 	needs_range_processing = true;
 }
 
 // Count the frames in the queue
 int64_t CacheMemory::Count()
 {
-	// Create a scoped lock, to protect the cache from multiple threads
-	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+	// Create a shared lock (lookups can run at the same time as other lookups)
+	const ScopedReadLock lock(cacheReadWriteLock);
 
 	// Return the number of frames in the cache
 	return frames.size();
@@ -306,25 +532,37 @@ void CacheMemory::CleanUp()
 	if (max_bytes > 0)
 	{
 		// Create a scoped lock, to protect the cache from multiple threads
-		const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+		const ScopedWriteLock lock(cacheReadWriteLock);
 
-		while (GetBytes() > max_bytes && frame_numbers.size() > 20)
+		while (total_bytes > max_bytes && frame_numbers.size() > 20)
 		{
-			// Get the oldest frame number.
-			int64_t frame_to_remove = frame_numbers.back();
-
-			// Remove frame_number and frame
-			Remove(frame_to_remove);
+			// Remove the oldest frame (keeping it for the eviction callback)
+			int64_t frame_number = next_eviction();
+			std::unordered_map<int64_t, CacheEntry>::iterator entry = frames.find(frame_number);
+			if (eviction_callback)
+				evicted_frames.push_back(restore_entry(entry->second));
+			remove_entry(entry);
+			remove_range(frame_number, frame_number);
+			eviction_counter.Increment();
 		}
 	}
 }
 
 
+// Get the version of the range data (incremented each time the cached ranges change)
+int64_t CacheMemory::RangeVersion() {
+
+	// Process range data (if anything has changed)
+	CalculateRanges();
+
+	return range_version;
+}
+
 // Generate JSON string of this object
 std::string CacheMemory::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -341,18 +579,11 @@ Json::Value CacheMemory::JsonValue() {
 	range_version_str << range_version;
 	root["version"] = range_version_str.str();
 
-	// Parse and append range data (if any)
-	Json::Value ranges;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( json_ranges.c_str(),
-	                 json_ranges.c_str() + json_ranges.size(), &ranges, &errors );
-	delete reader;
-
-	if (success)
-		root["ranges"] = ranges;
+	// Append range data (copied, since it can be re-calculated by other threads)
+	{
+		const ScopedReadLock lock(cacheReadWriteLock);
+		root["ranges"] = json_ranges;
+	}
 
 	// return JsonValue
 	return root;
@@ -363,13 +594,7 @@ void CacheMemory::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 	if (!success)
 		// Raise exception
 		throw InvalidJSON("JSON could not be parsed (or is invalid)");
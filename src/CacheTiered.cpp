@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief Source file for CacheTiered class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/CacheTiered.h"
+
+using namespace std;
+using namespace openshot;
+
+// Constructor that sets the max bytes of each tier
+CacheTiered::CacheTiered(int64_t memory_bytes, std::string cache_path, std::string format, float quality, float scale, int64_t disk_bytes)
+	: CacheBase(memory_bytes + disk_bytes), memory_cache(memory_bytes), disk_cache(cache_path, format, quality, scale, disk_bytes) {
+	// Set cache type name
+	cache_type = "CacheTiered";
+	memory_cache.SetMemoryTag("cache.tiered");
+
+	// Demote frames evicted from memory to disk
+	memory_cache.SetEvictionCallback(std::bind(&CacheTiered::demote, this, std::placeholders::_1));
+};
+
+// Default destructor
+CacheTiered::~CacheTiered()
+{
+	// Stop demoting frames (the disk cache is destroyed with this object)
+	memory_cache.SetEvictionCallback(nullptr);
+
+	// remove critical section
+	delete cacheCriticalSection;
+	cacheCriticalSection = NULL;
+}
+
+// Demote a frame evicted from memory to disk
+void CacheTiered::demote(std::shared_ptr<Frame> frame)
+{
+	disk_cache.Add(frame);
+}
+
+// Add a Frame to the cache (in memory)
+void CacheTiered::Add(std::shared_ptr<Frame> frame)
+{
+	// Create a scoped lock, to protect the cache from multiple threads
+	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+
+	// Only keep one copy of each frame (the newest one, in memory)
+	disk_cache.Remove(frame->number);
+	memory_cache.Add(frame);
+}
+
+// Get a frame from the cache (frames found on disk are promoted back into memory)
+std::shared_ptr<Frame> CacheTiered::GetFrame(int64_t frame_number)
+{
+	// Check memory first (without locking both tiers)
+	std::shared_ptr<Frame> frame = memory_cache.GetFrame(frame_number);
+	if (frame) {
+		hit_counter.Increment();
+		return frame;
+	}
+
+	// Create a scoped lock, to protect the cache from multiple threads
+	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+
+	// Check disk, and promote frame back into memory
+	frame = disk_cache.GetFrame(frame_number);
+	if (frame) {
+		hit_counter.Increment();
+		disk_cache.Remove(frame_number);
+		memory_cache.Add(frame);
+	}
+	else
+		miss_counter.Increment();
+
+	return frame;
+}
+
+// Get the smallest frame number (in either tier)
+std::shared_ptr<Frame> CacheTiered::GetSmallestFrame()
+{
+	// Create a scoped lock, to protect the cache from multiple threads
+	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+
+	std::shared_ptr<Frame> memory_frame = memory_cache.GetSmallestFrame();
+	std::shared_ptr<Frame> disk_frame = disk_cache.GetSmallestFrame();
+	if (!disk_frame || (memory_frame && memory_frame->number <= disk_frame->number))
+		return memory_frame;
+	return disk_frame;
+}
+
+// Gets the bytes used by both tiers
+int64_t CacheTiered::GetBytes()
+{
+	return memory_cache.GetBytes() + disk_cache.GetBytes();
+}
+
+// Remove a specific frame (from both tiers)
+void CacheTiered::Remove(int64_t frame_number)
+{
+	Remove(frame_number, frame_number);
+}
+
+// Remove a range of frames (from both tiers)
+void CacheTiered::Remove(int64_t start_frame_number, int64_t end_frame_number)
+{
+	// Create a scoped lock, to protect the cache from multiple threads
+	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+
+	memory_cache.Remove(start_frame_number, end_frame_number);
+	disk_cache.Remove(start_frame_number, end_frame_number);
+}
+
+// Clear the cache of all frames (in both tiers)
+void CacheTiered::Clear()
+{
+	// Create a scoped lock, to protect the cache from multiple threads
+	const GenericScopedLock<CriticalSection> lock(*cacheCriticalSection);
+
+	memory_cache.Clear();
+	disk_cache.Clear();
+}
+
+// Count the frames in both tiers
+int64_t CacheTiered::Count()
+{
+	return memory_cache.Count() + disk_cache.Count();
+}
+
+// Get the hits, misses, and evictions of this cache, and of each tier
+Json::Value CacheTiered::MetricsValue()
+{
+	Json::Value root = CacheBase::MetricsValue();
+	root["memory"] = memory_cache.MetricsValue();
+	root["disk"] = disk_cache.MetricsValue();
+	return root;
+}
+
+// Reset the hits, misses, and evictions of this cache (and both tiers)
+void CacheTiered::ResetMetrics()
+{
+	CacheBase::ResetMetrics();
+	memory_cache.ResetMetrics();
+	disk_cache.ResetMetrics();
+}
+
+// Generate JSON string of this object
+std::string CacheTiered::Json() {
+
+	// Return formatted string
+	return WriteJson(JsonValue());
+}
+
+// Generate Json::JsonValue for this object
+Json::Value CacheTiered::JsonValue() {
+
+	// Create root json object
+	Json::Value root = CacheBase::JsonValue(); // get parent properties
+	root["type"] = cache_type;
+
+	// Get ranges of both tiers
+	Json::Value memory_root = memory_cache.JsonValue();
+	Json::Value disk_root = disk_cache.JsonValue();
+
+	// Version changes when either tier changes
+	int64_t version = std::stoll(memory_root["version"].asString()) + std::stoll(disk_root["version"].asString());
+	root["version"] = std::to_string(version);
+
+	// Merge ranges of both tiers (frames are only in one tier, but ranges can touch)
+	std::map<int64_t, int64_t> tier_ranges;
+	const Json::Value tier_roots[2] = { memory_root, disk_root };
+	for (int tier = 0; tier < 2; tier++) {
+		const Json::Value& ranges = tier_roots[tier]["ranges"];
+		for (Json::Value::ArrayIndex index = 0; ranges.isArray() && index < ranges.size(); index++)
+			tier_ranges[std::stoll(ranges[index]["start"].asString())] = std::stoll(ranges[index]["end"].asString());
+	}
+
+	Json::Value merged_ranges = Json::Value(Json::arrayValue);
+	std::map<int64_t, int64_t>::iterator itr_range;
+	for (itr_range = tier_ranges.begin(); itr_range != tier_ranges.end(); ++itr_range) {
+		if (merged_ranges.size() > 0 && std::stoll(merged_ranges[merged_ranges.size() - 1]["end"].asString()) + 1 >= itr_range->first) {
+			// Extend previous range
+			int64_t end = std::max(std::stoll(merged_ranges[merged_ranges.size() - 1]["end"].asString()), itr_range->second);
+			merged_ranges[merged_ranges.size() - 1]["end"] = std::to_string(end);
+		} else {
+			// Add JSON object with start/end attributes
+			// Use strings, since int64_ts are not supported in JSON
+			Json::Value range;
+			range["start"] = std::to_string(itr_range->first);
+			range["end"] = std::to_string(itr_range->second);
+			merged_ranges.append(range);
+		}
+	}
+	root["ranges"] = merged_ranges;
+
+	// return JsonValue
+	return root;
+}
+
+// Load JSON string into this object
+void CacheTiered::SetJson(std::string value) {
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	bool success = ParseJson(value, root);
+	if (!success)
+		// Raise exception
+		throw InvalidJSON("JSON could not be parsed (or is invalid)");
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("JSON is invalid (missing keys or invalid data types)");
+	}
+}
+
+// Load Json::JsonValue into this object
+void CacheTiered::SetJsonValue(Json::Value root) {
+
+	// Clear both tiers before we do anything
+	Clear();
+
+	// Set parent data
+	CacheBase::SetJsonValue(root);
+
+	if (!root["type"].isNull())
+		cache_type = root["type"].asString();
+}
@@ -33,23 +33,30 @@
 
 using namespace openshot;
 
+// Number of chunk readers kept open (the current chunk, the previous chunk, and the prefetched next chunk)
+static const size_t max_chunk_readers = 3;
+
 ChunkReader::ChunkReader(std::string path, ChunkVersion chunk_version)
-		: path(path), chunk_size(24 * 3), is_open(false), version(chunk_version), local_reader(NULL)
+		: path(path), chunk_size(24 * 3), is_open(false), prefetch_chunk(0), version(chunk_version)
 {
 	// Check if folder exists?
 	if (!does_folder_exist(path))
 		// Raise exception
 		throw InvalidFile("Chunk folder could not be opened.", path);
 
-	// Init previous location
-	previous_location.number = 0;
-	previous_location.frame = 0;
-
 	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
 	Open();
 	Close();
 }
 
+// Destructor
+ChunkReader::~ChunkReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+	Close();
+}
+
 // Check if folder path existing
 bool ChunkReader::does_folder_exist(std::string path)
 {
@@ -164,6 +171,15 @@ void ChunkReader::Close()
 	// Close all objects, if reader is 'open'
 	if (is_open)
 	{
+		// Wait for the prefetch (it may fail, if the next chunk is missing), and close the chunk readers
+		try {
+			prefetch_tasks.Wait();
+		}
+		catch (...) { }
+		prefetch_chunk = 0;
+		std::lock_guard<std::mutex> lock(readers_mutex);
+		chunk_readers.clear();
+
 		// Mark as "closed"
 		is_open = false;
 	}
@@ -192,61 +208,117 @@ std::string ChunkReader::get_chunk_path(int64_t chunk_number, std::string folder
 		return "";
 }
 
-// Get an openshot::Frame object for a specific frame number of this reader.
-std::shared_ptr<Frame> ChunkReader::GetFrame(int64_t requested_frame)
+// Open the reader of a chunk
+std::shared_ptr<ReaderBase> ChunkReader::open_chunk_reader(int64_t chunk_number)
 {
-	// Determine what chunk contains this frame
-	ChunkLocation location = find_chunk_frame(requested_frame);
-
-	// New Chunk (Close the old reader, and open the new one)
-	if (previous_location.number != location.number)
+	// Determine version of chunk
+	std::string folder_name = "";
+	switch (version)
 	{
-		// Determine version of chunk
-		std::string folder_name = "";
-		switch (version)
-		{
-		case THUMBNAIL:
-			folder_name = "thumb";
-			break;
-		case PREVIEW:
-			folder_name = "preview";
-			break;
-		case FINAL:
-			folder_name = "final";
-			break;
-		}
+	case THUMBNAIL:
+		folder_name = "thumb";
+		break;
+	case PREVIEW:
+		folder_name = "preview";
+		break;
+	case FINAL:
+		folder_name = "final";
+		break;
+	}
 
-		// Load path of chunk video
-		std::string chunk_video_path = get_chunk_path(location.number, folder_name, ".webm");
+	// Load path of chunk video
+	std::string chunk_video_path = get_chunk_path(chunk_number, folder_name, ".webm");
+	ZmqLogger::Instance()->AppendDebugMethod("ChunkReader::open_chunk_reader", "chunk_number", chunk_number);
 
-		// Close existing reader (if needed)
-		if (local_reader)
-		{
-			std::cout << "Close READER" << std::endl;
-			// Close and delete old reader
-			local_reader->Close();
-			delete local_reader;
+	// Load new FFmpegReader
+	std::shared_ptr<ReaderBase> reader(new FFmpegReader(chunk_video_path));
+	reader->Open();
+	return reader;
+}
+
+// Add an open chunk reader (and close the least recently used ones, if too many are open)
+void ChunkReader::add_chunk_reader(int64_t chunk_number, std::shared_ptr<ReaderBase> reader)
+{
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	chunk_readers.push_front(std::make_pair(chunk_number, reader));
+	while (chunk_readers.size() > max_chunk_readers)
+		chunk_readers.pop_back();
+}
+
+// Find an open chunk reader, and mark it as the most recently used
+std::shared_ptr<ReaderBase> ChunkReader::find_chunk_reader(int64_t chunk_number)
+{
+	std::lock_guard<std::mutex> lock(readers_mutex);
+	for (std::list<std::pair<int64_t, std::shared_ptr<ReaderBase> > >::iterator itr = chunk_readers.begin(); itr != chunk_readers.end(); ++itr)
+		if (itr->first == chunk_number) {
+			chunk_readers.splice(chunk_readers.begin(), chunk_readers, itr);
+			return chunk_readers.front().second;
 		}
+	return std::shared_ptr<ReaderBase>();
+}
+
+// Get the reader of a chunk (waiting for its prefetch, or opening it)
+std::shared_ptr<ReaderBase> ChunkReader::get_chunk_reader(int64_t chunk_number, int64_t requested_frame, int64_t chunk_frame)
+{
+	// Wait for the prefetch of this chunk (which may have failed, if the chunk is missing)
+	if (prefetch_chunk == chunk_number) {
+		try {
+			prefetch_tasks.Wait();
+		}
+		catch (...) { }
+		prefetch_chunk = 0;
+	}
 
+	std::shared_ptr<ReaderBase> reader = find_chunk_reader(chunk_number);
+	if (!reader) {
 		try
 		{
-			std::cout << "Load READER: " << chunk_video_path << std::endl;
-			// Load new FFmpegReader
-			local_reader = new FFmpegReader(chunk_video_path);
-			local_reader->Open(); // open reader
-
+			reader = open_chunk_reader(chunk_number);
 		} catch (const InvalidFile& e)
 		{
 			// Invalid Chunk (possibly it is not found)
-			throw ChunkNotFound(path, requested_frame, location.number, location.frame);
+			throw ChunkNotFound(path, requested_frame, chunk_number, chunk_frame);
 		}
+		add_chunk_reader(chunk_number, reader);
+	}
+	return reader;
+}
 
-		// Set the new location
-		previous_location = location;
+// Open the next chunk (and decode its first frame) in the background
+void ChunkReader::prefetch_chunk_reader(int64_t chunk_number)
+{
+	if (prefetch_chunk == chunk_number || find_chunk_reader(chunk_number))
+		return;
+
+	// Wait for the last prefetch to finish (so this chunk is not opened twice)
+	try {
+		prefetch_tasks.Wait();
 	}
+	catch (...) { }
+
+	prefetch_chunk = chunk_number;
+	prefetch_tasks.Run([this, chunk_number]() {
+		std::shared_ptr<ReaderBase> reader = open_chunk_reader(chunk_number);
+		reader->GetFrame(1);
+		add_chunk_reader(chunk_number, reader);
+	});
+}
+
+// Get an openshot::Frame object for a specific frame number of this reader.
+std::shared_ptr<Frame> ChunkReader::GetFrame(int64_t requested_frame)
+{
+	// Determine what chunk contains this frame
+	ChunkLocation location = find_chunk_frame(requested_frame);
+
+	// Get the reader of the chunk (kept open, or prefetched)
+	std::shared_ptr<ReaderBase> chunk_reader = get_chunk_reader(location.number, requested_frame, location.frame);
+
+	// Prefetch the next chunk, once the playhead passes the middle of this chunk
+	if (location.frame > chunk_size / 2)
+		prefetch_chunk_reader(location.number + 1);
 
 	// Get the frame (from the current reader)
-	last_frame = local_reader->GetFrame(location.frame);
+	last_frame = chunk_reader->GetFrame(location.frame);
 
 	// Update the frame number property
 	last_frame->number = requested_frame;
@@ -259,7 +331,7 @@ std::shared_ptr<Frame> ChunkReader::GetFrame(int64_t requested_frame)
 std::string ChunkReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -283,13 +355,7 @@ void ChunkReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-	                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 	if (!success)
 		// Raise exception
 		throw InvalidJSON("JSON could not be parsed (or is invalid)");
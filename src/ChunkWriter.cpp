@@ -33,7 +33,8 @@
 using namespace openshot;
 
 ChunkWriter::ChunkWriter(std::string path, ReaderBase *reader) :
-		local_reader(reader), path(path), chunk_size(24*3), chunk_count(1), frame_count(1), is_writing(false),
+		local_reader(reader), path(path), chunk_size(24*3), chunk_concurrency(1), chunk_count(1), frame_count(1), is_writing(false),
+		writer_thumb(NULL), writer_preview(NULL), writer_final(NULL),
 		default_extension(".webm"), default_vcodec("libvpx"), default_acodec("libvorbis"), last_frame_needed(false), is_open(false)
 {
 	// Change codecs to default
@@ -89,33 +90,18 @@ void ChunkWriter::WriteFrame(std::shared_ptr<Frame> frame)
 		// Save thumbnail of chunk start frame
 		frame->Save(get_chunk_path(chunk_count, "", ".jpeg"), 1.0);
 
-		// Create FFmpegWriter (FINAL quality)
-		create_folder(get_chunk_path(chunk_count, "final", ""));
-		writer_final = new FFmpegWriter(get_chunk_path(chunk_count, "final", default_extension));
-		writer_final->SetAudioOptions(true, default_acodec, info.sample_rate, info.channels, info.channel_layout, 128000);
-		writer_final->SetVideoOptions(true, default_vcodec, info.fps, info.width, info.height, info.pixel_ratio, false, false, info.video_bit_rate);
-
-		// Create FFmpegWriter (PREVIEW quality)
-		create_folder(get_chunk_path(chunk_count, "preview", ""));
-		writer_preview = new FFmpegWriter(get_chunk_path(chunk_count, "preview", default_extension));
-		writer_preview->SetAudioOptions(true, default_acodec, info.sample_rate, info.channels, info.channel_layout, 128000);
-		writer_preview->SetVideoOptions(true, default_vcodec, info.fps, info.width * 0.5, info.height * 0.5, info.pixel_ratio, false, false, info.video_bit_rate * 0.5);
-
-		// Create FFmpegWriter (LOW quality)
-		create_folder(get_chunk_path(chunk_count, "thumb", ""));
-		writer_thumb = new FFmpegWriter(get_chunk_path(chunk_count, "thumb", default_extension));
-		writer_thumb->SetAudioOptions(true, default_acodec, info.sample_rate, info.channels, info.channel_layout, 128000);
-		writer_thumb->SetVideoOptions(true, default_vcodec, info.fps, info.width * 0.25, info.height * 0.25, info.pixel_ratio, false, false, info.video_bit_rate * 0.25);
-
-		// Prepare Streams
-		writer_final->PrepareStreams();
-		writer_preview->PrepareStreams();
-		writer_thumb->PrepareStreams();
-
-		// Write header
-		writer_final->WriteHeader();
-		writer_preview->WriteHeader();
-		writer_thumb->WriteHeader();
+		// Create FFmpegWriters (FINAL, PREVIEW, and LOW quality)
+		writer_final = create_writer(chunk_count, "final", 1.0);
+		writer_preview = create_writer(chunk_count, "preview", 0.5);
+		writer_thumb = create_writer(chunk_count, "thumb", 0.25);
+
+		// Open the writers (which prepares their streams, and writes their headers). Frames are
+		// scaled in a cascade (final -> preview -> thumb), and encoded by all writers at once.
+		writer_renditions.ClearRenditions();
+		writer_renditions.AddRendition(writer_final);
+		writer_renditions.AddRendition(writer_preview);
+		writer_renditions.AddRendition(writer_thumb);
+		writer_renditions.Open();
 
 		// Keep track that a chunk is being written
 		is_writing = true;
@@ -129,16 +115,12 @@ void ChunkWriter::WriteFrame(std::shared_ptr<Frame> frame)
 		if (last_frame)
 		{
 			// Write the previous chunks LAST FRAME to the current chunk
-			writer_final->WriteFrame(last_frame);
-			writer_preview->WriteFrame(last_frame);
-			writer_thumb->WriteFrame(last_frame);
+			writer_renditions.WriteFrame(last_frame);
 		} else {
 			// Write the 1st frame (of the 1st chunk)... since no previous chunk is available
 			std::shared_ptr<Frame> blank_frame(new Frame(1, info.width, info.height, "#000000", info.sample_rate, info.channels));
 			blank_frame->AddColor(info.width, info.height, "#000000");
-			writer_final->WriteFrame(blank_frame);
-			writer_preview->WriteFrame(blank_frame);
-			writer_thumb->WriteFrame(blank_frame);
+			writer_renditions.WriteFrame(blank_frame);
 		}
 
 		// disable last frame
@@ -148,9 +130,7 @@ void ChunkWriter::WriteFrame(std::shared_ptr<Frame> frame)
 
 	//////////////////////////////////////////////////
 	// WRITE THE CURRENT FRAME TO THE CURRENT CHUNK
-	writer_final->WriteFrame(frame);
-	writer_preview->WriteFrame(frame);
-	writer_thumb->WriteFrame(frame);
+	writer_renditions.WriteFrame(frame);
 	//////////////////////////////////////////////////
 
 
@@ -165,20 +145,11 @@ void ChunkWriter::WriteFrame(std::shared_ptr<Frame> frame)
 		for (int z = 0; z<12; z++)
 		{
 			// Repeat frame
-			writer_final->WriteFrame(frame);
-			writer_preview->WriteFrame(frame);
-			writer_thumb->WriteFrame(frame);
+			writer_renditions.WriteFrame(frame);
 		}
 
-		// Write Footer
-		writer_final->WriteTrailer();
-		writer_preview->WriteTrailer();
-		writer_thumb->WriteTrailer();
-
-		// Close writer & reader
-		writer_final->Close();
-		writer_preview->Close();
-		writer_thumb->Close();
+		// Write Footer, and close writers
+		close_writers();
 
 		// Increment chunk count
 		chunk_count++;
@@ -195,32 +166,96 @@ void ChunkWriter::WriteFrame(std::shared_ptr<Frame> frame)
 }
 
 
+// Create the writer of a rendition of a chunk (scaled from the final size)
+FFmpegWriter *ChunkWriter::create_writer(int64_t chunk_number, std::string folder, double scale)
+{
+	create_folder(get_chunk_path(chunk_number, folder, ""));
+	FFmpegWriter *writer = new FFmpegWriter(get_chunk_path(chunk_number, folder, default_extension));
+	writer->SetAudioOptions(true, default_acodec, info.sample_rate, info.channels, info.channel_layout, 128000);
+	writer->SetVideoOptions(true, default_vcodec, info.fps, info.width * scale, info.height * scale, info.pixel_ratio, false, false, info.video_bit_rate * scale);
+	return writer;
+}
+
+// Encode a whole chunk with its own writers
+void ChunkWriter::write_chunk(ReaderBase* reader, int64_t chunk_number, int64_t start, int64_t end, std::shared_ptr<Frame> previous)
+{
+	std::shared_ptr<Frame> frame = reader->GetFrame(start);
+
+	// Save thumbnail of chunk start frame
+	frame->Save(get_chunk_path(chunk_number, "", ".jpeg"), 1.0);
+
+	std::unique_ptr<FFmpegWriter> final_writer(create_writer(chunk_number, "final", 1.0));
+	std::unique_ptr<FFmpegWriter> preview_writer(create_writer(chunk_number, "preview", 0.5));
+	std::unique_ptr<FFmpegWriter> thumb_writer(create_writer(chunk_number, "thumb", 0.25));
+	RenditionWriter renditions;
+	renditions.AddRendition(final_writer.get());
+	renditions.AddRendition(preview_writer.get());
+	renditions.AddRendition(thumb_writer.get());
+	renditions.Open();
+
+	// Start with the last frame of the previous chunk (or a blank frame, for the 1st chunk)
+	if (!previous) {
+		previous = std::make_shared<Frame>(1, info.width, info.height, "#000000", info.sample_rate, info.channels);
+		previous->AddColor(info.width, info.height, "#000000");
+	}
+	renditions.WriteFrame(previous);
+
+	// Write the frames of the chunk, and pad an additional 12 frames
+	for (int64_t number = start; number <= end; number++) {
+		if (number > start)
+			frame = reader->GetFrame(number);
+		renditions.WriteFrame(frame);
+	}
+	for (int z = 0; z < 12; z++)
+		renditions.WriteFrame(frame);
+
+	renditions.Close();
+}
+
 // Write a block of frames from a reader
 void ChunkWriter::WriteFrame(ReaderBase* reader, int64_t start, int64_t length)
 {
-	// Loop through each frame (and encoded it)
-	for (int64_t number = start; number <= length; number++)
-	{
-		// Get the frame
-		std::shared_ptr<Frame> f = reader->GetFrame(number);
+	int64_t number = start;
+
+	// Finish the chunk being written (one frame at a time)
+	while (chunk_concurrency > 1 && is_writing && number <= length)
+		WriteFrame(reader->GetFrame(number++));
+
+	// Encode the whole chunks at once (a few chunks at a time, each with its own writers)
+	if (chunk_concurrency > 1 && is_open) {
+		while (number + chunk_size - 1 <= length) {
+			TaskGroup chunk_tasks;
+			for (int chunk = 0; chunk < chunk_concurrency && number + chunk_size - 1 <= length; chunk++) {
+				std::shared_ptr<Frame> previous = (number > start) ? reader->GetFrame(number - 1) : last_frame;
+				int64_t chunk_number = chunk_count;
+				int64_t chunk_start = number;
+				chunk_tasks.Run([this, reader, chunk_number, chunk_start, previous]() {
+					write_chunk(reader, chunk_number, chunk_start, chunk_start + chunk_size - 1, previous);
+				});
+				chunk_count++;
+				frame_count += chunk_size;
+				number += chunk_size;
+			}
+			chunk_tasks.Wait();
+			last_frame = reader->GetFrame(number - 1);
+		}
+	}
 
-		// Encode frame
-		WriteFrame(f);
+	// Loop through the remaining frames, a batch at a time (and encode them)
+	while (number <= length)
+	{
+		int64_t count = std::min(int64_t(std::max(1, TaskPool::Current()->NumThreads())), length - number + 1);
+		std::vector<std::shared_ptr<Frame> > frames = reader->GetFrames(number, count);
+		for (size_t index = 0; index < frames.size(); index++)
+			WriteFrame(frames[index]);
+		number += count;
 	}
 }
 
 // Write a block of frames from the local cached reader
 void ChunkWriter::WriteFrame(int64_t start, int64_t length)
 {
-	// Loop through each frame (and encoded it)
-	for (int64_t number = start; number <= length; number++)
-	{
-		// Get the frame
-		std::shared_ptr<Frame> f = local_reader->GetFrame(number);
-
-		// Encode frame
-		WriteFrame(f);
-	}
+	WriteFrame(local_reader, start, length);
 }
 
 // Close the writer
@@ -237,20 +272,11 @@ void ChunkWriter::Close()
 		for (int z = 0; z<12; z++)
 		{
 			// Repeat frame
-			writer_final->WriteFrame(last_frame);
-			writer_preview->WriteFrame(last_frame);
-			writer_thumb->WriteFrame(last_frame);
+			writer_renditions.WriteFrame(last_frame);
 		}
 
-		// Write Footer
-		writer_final->WriteTrailer();
-		writer_preview->WriteTrailer();
-		writer_thumb->WriteTrailer();
-
-		// Close writer & reader
-		writer_final->Close();
-		writer_preview->Close();
-		writer_thumb->Close();
+		// Write Footer, and close writers
+		close_writers();
 
 		// Increment chunk count
 		chunk_count++;
@@ -270,6 +296,21 @@ void ChunkWriter::Close()
 	local_reader->Close();
 }
 
+// Write the trailers, and close (and delete) the writers of the current chunk
+void ChunkWriter::close_writers()
+{
+	// Close the writers at once (which writes their trailers)
+	writer_renditions.Close();
+	writer_renditions.ClearRenditions();
+
+	delete writer_final;
+	delete writer_preview;
+	delete writer_thumb;
+	writer_final = NULL;
+	writer_preview = NULL;
+	writer_thumb = NULL;
+}
+
 // write JSON meta data
 void ChunkWriter::write_json_meta_data()
 {
@@ -35,12 +35,31 @@
 	#include "../include/ImageReader.h"
 	#include "../include/TextReader.h"
 #endif
+#include "../include/ImageSequenceReader.h"
 #include "../include/QtImageReader.h"
+#include "../include/RawVideoReader.h"
 #include "../include/ChunkReader.h"
 #include "../include/DummyReader.h"
+#include "../include/SharedReader.h"
+#include "../include/GpuCompositor.h"
+#include "../include/Settings.h"
+#include "../include/Trace.h"
+
+#include <algorithm>
 
 using namespace openshot;
 
+// The most frames the audio block effects process ahead of the last processed frame, to keep their state
+// (a larger jump resets them)
+#define AUDIO_EFFECTS_MAX_GAP 32
+
+// Create the reader of a video file (a SharedReader, when Settings::SHARE_READERS is enabled)
+static ReaderBase *create_ffmpeg_reader(std::string path, bool inspect_reader) {
+	if (Settings::Instance()->SHARE_READERS)
+		return new SharedReader(path);
+	return new FFmpegReader(path, inspect_reader);
+}
+
 // Init default settings for a clip
 void Clip::init_settings()
 {
@@ -55,6 +74,9 @@ void Clip::init_settings()
 	display = FRAME_DISPLAY_NONE;
 	mixing = VOLUME_MIX_NONE;
 	waveform = false;
+	cached_effects_input_key = 0;
+	cache_version = 0;
+	audio_effects_next_frame = 0;
 	previous_properties = "";
 
 	// Init scale curves
@@ -104,6 +126,10 @@ void Clip::init_settings()
 	// Init audio and video overrides
 	has_audio = Keyframe(-1.0);
 	has_video = Keyframe(-1.0);
+
+	// Readers decode all of their streams (until the clip hints otherwise)
+	hinted_video = true;
+	hinted_audio = true;
 }
 
 // Init reader's rotation (if any)
@@ -168,7 +194,17 @@ Clip::Clip(std::string path) : resampler(NULL), audio_cache(NULL), reader(NULL),
 		try
 		{
 			// Open common video format
-			reader = new FFmpegReader(path);
+			reader = create_ffmpeg_reader(path, true);
+
+		} catch(...) { }
+	}
+
+	// Uncompressed YUV4MPEG2 video is mapped (instead of demuxed)
+	if (ext=="y4m")
+	{
+		try
+		{
+			reader = new RawVideoReader(path);
 
 		} catch(...) { }
 	}
@@ -185,7 +221,7 @@ Clip::Clip(std::string path) : resampler(NULL), audio_cache(NULL), reader(NULL),
 			try
 			{
 				// Try a video reader
-				reader = new FFmpegReader(path);
+				reader = create_ffmpeg_reader(path, true);
 
 			} catch(...) { }
 		}
@@ -226,6 +262,12 @@ void Clip::Reader(ReaderBase* new_reader)
 
 	// Init rotation (if any)
 	init_reader_rotation();
+
+	// Frames of the previous reader are no longer valid
+	ClearCache();
+
+	// Pass the stream hints on to the new reader (i.e. a FrameMapper, which forwards them to its source reader)
+	reader->EnableStreams(hinted_video, hinted_audio);
 }
 
 /// Get the current reader
@@ -243,6 +285,12 @@ void Clip::Open()
 {
 	if (reader)
 	{
+		// Hint the streams which are used (before the reader opens its decoders)
+		{
+			const GenericScopedLock<juce::CriticalSection> lock(getFrameCriticalSection);
+			update_stream_hints();
+		}
+
 		// Open the reader
 		reader->Open();
 
@@ -291,14 +339,89 @@ float Clip::End()
 		return end;
 }
 
+// Evaluate the keyframes which are read while compositing and mixing a frame of this clip
+ClipProperties Clip::EvaluateProperties(int64_t frame_number)
+{
+	ClipProperties properties;
+	properties.alpha = alpha.GetValue(frame_number);
+	properties.scale_x = scale_x.GetValue(frame_number);
+	properties.scale_y = scale_y.GetValue(frame_number);
+	properties.location_x = location_x.GetValue(frame_number);
+	properties.location_y = location_y.GetValue(frame_number);
+	properties.rotation = rotation.GetValue(frame_number);
+	properties.shear_x = shear_x.GetValue(frame_number);
+	properties.shear_y = shear_y.GetValue(frame_number);
+	properties.crop_x = crop_x.GetValue(frame_number);
+	properties.crop_y = crop_y.GetValue(frame_number);
+	properties.crop_width = crop_width.GetValue(frame_number);
+	properties.crop_height = crop_height.GetValue(frame_number);
+	properties.volume = volume.GetValue(frame_number);
+	properties.previous_volume = volume.GetValue(frame_number - 1);
+	properties.channel_filter = channel_filter.GetInt(frame_number);
+	properties.channel_mapping = channel_mapping.GetInt(frame_number);
+	properties.has_audio = has_audio.GetInt(frame_number);
+	properties.has_video = has_video.GetInt(frame_number);
+
+	// The waveform color is only needed when the waveform replaces the image
+	properties.wave_red = properties.wave_green = properties.wave_blue = properties.wave_alpha = 0;
+	if (waveform) {
+		properties.wave_red = wave_color.red.GetInt(frame_number);
+		properties.wave_green = wave_color.green.GetInt(frame_number);
+		properties.wave_blue = wave_color.blue.GetInt(frame_number);
+		properties.wave_alpha = wave_color.alpha.GetInt(frame_number);
+	}
+
+	return properties;
+}
+
 // Get an openshot::Frame object for a specific frame number of this reader.
 std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame)
 {
+	return GetFrame(requested_frame, 0, 0);
+}
+
+// Get an openshot::Frame object for a specific frame number of this clip (at the size it will be drawn at)
+std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame, int width, int height)
+{
+	return get_frame(requested_frame, width, height, false);
+}
+
+// Get an openshot::Frame object for a specific frame number of this clip (with its effects as GPU kernels, if possible)
+std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame, int width, int height, std::vector<EffectBase::GpuKernel>& gpu_kernels)
+{
+	gpu_kernels.clear();
+	return get_frame(requested_frame, width, height, false, &gpu_kernels);
+}
+
+// Get an openshot::Frame object for a specific frame number of this clip (for its audio only)
+std::shared_ptr<Frame> Clip::GetAudioFrame(int64_t requested_frame)
+{
+	return get_frame(requested_frame, 0, 0, true);
+}
+
+// Get a frame of this clip (with its image and effects, unless only its audio is needed)
+std::shared_ptr<Frame> Clip::get_frame(int64_t requested_frame, int width, int height, bool audio_only, std::vector<EffectBase::GpuKernel>* gpu_kernels)
+{
+	TraceSpan trace_span("Clip::GetFrame", "clip", requested_frame);
+	static MemoryGauge& clip_memory = Metrics::Instance()->GetMemory("images.clips");
+	ScopedMemoryTag memory_tag(clip_memory);
+
 	if (reader)
 	{
 		// Adjust out of bounds frame number
 		requested_frame = adjust_frame_number_minimum(requested_frame);
 
+		// Reuse the frame if it was already processed (e.g. by the timeline's in-order pass)
+		int64_t version = 0;
+		if (Settings::Instance()->CLIP_CACHE_SIZE > 0) {
+			std::shared_ptr<Frame> cached_frame = get_cached_frame(requested_frame, width, height, audio_only);
+			if (cached_frame)
+				return cached_frame;
+
+			const GenericScopedLock<juce::CriticalSection> lock(frameCacheSection);
+			version = cache_version;
+		}
+
 		// Adjust has_video and has_audio overrides
 		int enabled_audio = has_audio.GetInt(requested_frame);
 		if (enabled_audio == -1 && reader && reader->info.has_audio)
@@ -312,27 +435,25 @@ std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame)
 			enabled_video = 0;
 
 		// Is a time map detected
-		int64_t new_frame_number = requested_frame;
-		int64_t time_mapped_number = adjust_frame_number_minimum(time.GetLong(requested_frame));
-		if (time.GetLength() > 1)
-			new_frame_number = time_mapped_number;
+		int64_t new_frame_number = MappedFrameNumber(requested_frame);
 
 		// Now that we have re-mapped what frame number is needed, go and get the frame pointer
+		// (only a single thread can request frames from this clip's reader, other clips are not blocked)
 		std::shared_ptr<Frame> original_frame;
-		#pragma omp critical (Clip_GetFrame)
-		original_frame = GetOrCreateFrame(new_frame_number);
+		{
+			const GenericScopedLock<juce::CriticalSection> lock(getFrameCriticalSection);
+			update_stream_hints();
+			original_frame = GetOrCreateFrame(new_frame_number, width, height, audio_only);
+		}
 
 		// Create a new frame
 		std::shared_ptr<Frame> frame(new Frame(new_frame_number, 1, 1, "#000000", original_frame->GetAudioSamplesCount(), original_frame->GetAudioChannelsCount()));
-		#pragma omp critical (Clip_GetFrame)
-		{
-			frame->SampleRate(original_frame->SampleRate());
-			frame->ChannelsLayout(original_frame->ChannelsLayout());
-		}
+		frame->SampleRate(original_frame->SampleRate());
+		frame->ChannelsLayout(original_frame->ChannelsLayout());
 
-		// Copy the image from the odd field
-		if (enabled_video)
-			frame->AddImage(std::shared_ptr<QImage>(new QImage(*original_frame->GetImage())));
+		// Share the image (copy-on-write, so effects which draw on it detach their own copy)
+		if (enabled_video && !audio_only)
+			frame->ShareImage(original_frame);
 
 		// Loop through each channel, add audio
 		if (enabled_audio && reader->info.has_audio)
@@ -340,10 +461,19 @@ std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame)
 				frame->AddAudio(true, channel, 0, original_frame->GetAudioSamples(channel), original_frame->GetAudioSamplesCount(), 1.0);
 
 		// Get time mapped frame number (used to increase speed, change direction, etc...)
-		get_time_mapped_frame(frame, requested_frame);
+		get_time_mapped_frame(frame, original_frame, requested_frame, audio_only);
+
+		// Apply the audio block effects (in the order of the frames), and then the video effects (if any)
+		if (enabled_audio && reader->info.has_audio)
+			apply_audio_effects(frame, requested_frame);
+		// (the GPU kernels are run by the caller, so the frame is not processed, and it is not cached)
+		bool deferred_effects = !audio_only && gpu_kernels && get_gpu_kernels(frame, *gpu_kernels);
+		if (!audio_only && !deferred_effects)
+			apply_effects(frame);
 
-		// Apply effects to the frame (if any)
-		apply_effects(frame);
+		// Keep the processed frame (a copy is returned on each request, since callers draw on it)
+		if (Settings::Instance()->CLIP_CACHE_SIZE > 0 && !Settings::Instance()->SKIP_EFFECTS && !deferred_effects)
+			add_cached_frame(requested_frame, width, height, audio_only, version, frame->ShallowClone());
 
 		// Return processed 'frame'
 		return frame;
@@ -353,43 +483,90 @@ std::shared_ptr<Frame> Clip::GetFrame(int64_t requested_frame)
 		throw ReaderClosed("No Reader has been initialized for this Clip.  Call Reader(*reader) before calling this method.");
 }
 
-// Get file extension
-std::string Clip::get_file_extension(std::string path)
+// Hint the streams this clip uses to its reader
+void Clip::update_stream_hints()
 {
-	// return last part of path
-	return path.substr(path.find_last_of(".") + 1);
+	// A stream is unused when its override is off for the whole clip. A waveform replaces the image (it is
+	// drawn from the audio), so the video is unused too.
+	bool video = !waveform && !(has_video.GetCount() <= 1 && has_video.GetInt(1) == 0);
+	bool audio = !(has_audio.GetCount() <= 1 && has_audio.GetInt(1) == 0);
+	if (video == hinted_video && audio == hinted_audio)
+		return;
+
+	hinted_video = video;
+	hinted_audio = audio;
+	reader->EnableStreams(video, audio);
+
+	// The processed frames may be missing a stream which is now used
+	ClearCache();
+}
+
+// Find a processed frame of this clip (a copy, so the caller can change it), or NULL
+std::shared_ptr<Frame> Clip::get_cached_frame(int64_t number, int width, int height, bool audio_only)
+{
+	std::shared_ptr<Frame> cached_frame;
+	{
+		const GenericScopedLock<juce::CriticalSection> lock(frameCacheSection);
+		for (const CachedFrame &cached : cached_frames) {
+			if (cached.number == number && cached.width == width && cached.height == height &&
+				cached.audio_only == audio_only && cached.version == cache_version) {
+				cached_frame = cached.frame;
+				break;
+			}
+		}
+	}
+	if (!cached_frame)
+		return NULL;
+
+	// The clone shares the image and audio samples (copy-on-write)
+	return cached_frame->ShallowClone();
 }
 
-// Reverse an audio buffer
-void Clip::reverse_buffer(juce::AudioSampleBuffer* buffer)
+// Keep a processed frame of this clip (unless the clip has changed since it was requested)
+void Clip::add_cached_frame(int64_t number, int width, int height, bool audio_only, int64_t version, std::shared_ptr<Frame> frame)
 {
-	int number_of_samples = buffer->getNumSamples();
-	int channels = buffer->getNumChannels();
+	const GenericScopedLock<juce::CriticalSection> lock(frameCacheSection);
+	if (version != cache_version)
+		return;
 
-	// Reverse array (create new buffer to hold the reversed version)
-	juce::AudioSampleBuffer *reversed = new juce::AudioSampleBuffer(channels, number_of_samples);
-	reversed->clear();
+	// Remove the oldest frames first
+	CachedFrame cached = {number, width, height, audio_only, version, frame};
+	cached_frames.push_back(cached);
+	while (cached_frames.size() > (size_t) std::max(Settings::Instance()->CLIP_CACHE_SIZE, 0))
+		cached_frames.pop_front();
+}
 
-	for (int channel = 0; channel < channels; channel++)
+// Remove the processed frames kept by this clip
+void Clip::ClearCache()
+{
 	{
-		int n=0;
-		for (int s = number_of_samples - 1; s >= 0; s--, n++)
-			reversed->getWritePointer(channel)[n] = buffer->getWritePointer(channel)[s];
+		const GenericScopedLock<juce::CriticalSection> lock(frameCacheSection);
+		cached_frames.clear();
+		cache_version++;
 	}
 
-	// Copy the samples back to the original array
-	buffer->clear();
-	// Loop through channels, and get audio samples
-	for (int channel = 0; channel < channels; channel++)
-		// Get the audio samples for this channel
-		buffer->addFrom(channel, 0, reversed->getReadPointer(channel), number_of_samples, 1.0f);
+	// The audio effects start again (from the next requested frame)
+	const GenericScopedLock<juce::CriticalSection> lock(audioEffectsSection);
+	processed_audio.clear();
+	audio_effects_next_frame = 0;
+}
+
+// Get the version of the clip's state
+int64_t Clip::CacheVersion()
+{
+	const GenericScopedLock<juce::CriticalSection> lock(frameCacheSection);
+	return cache_version;
+}
 
-	delete reversed;
-	reversed = NULL;
+// Get file extension
+std::string Clip::get_file_extension(std::string path)
+{
+	// return last part of path
+	return path.substr(path.find_last_of(".") + 1);
 }
 
-// Adjust the audio and image of a time mapped frame
-void Clip::get_time_mapped_frame(std::shared_ptr<Frame> frame, int64_t frame_number)
+// Adjust the audio of a time mapped frame
+void Clip::get_time_mapped_frame(std::shared_ptr<Frame> frame, std::shared_ptr<Frame> original_frame, int64_t frame_number, bool audio_only)
 {
 	// Check for valid reader
 	if (!reader)
@@ -397,7 +574,7 @@ void Clip::get_time_mapped_frame(std::shared_ptr<Frame> frame, int64_t frame_num
 		throw ReaderClosed("No Reader has been initialized for this Clip.  Call Reader(*reader) before calling this method.");
 
 	// Check for a valid time map curve
-	if (time.GetLength() > 1)
+	if (time.GetLength() > 1 && reader->info.has_audio)
 	{
 		const GenericScopedLock<juce::CriticalSection> lock(getFrameCriticalSection);
 
@@ -409,192 +586,97 @@ void Clip::get_time_mapped_frame(std::shared_ptr<Frame> frame, int64_t frame_num
 		// Get new frame number
 		int new_frame_number = frame->number;
 
-		// Get delta (difference in previous Y value)
+		// Get delta (difference in previous Y value), and how many times this value is repeated
 		int delta = int(round(time.GetDelta(frame_number)));
+		Fraction repeat_fraction = time.GetRepeatFraction(frame_number);
+		bool is_reversed = !time.IsIncreasing(frame_number);
 
 		// Init audio vars
-		int sample_rate = reader->info.sample_rate;
 		int channels = reader->info.channels;
-		int number_of_samples = GetOrCreateFrame(new_frame_number)->GetAudioSamplesCount();
-
-		// Only resample audio if needed
-		if (reader->info.has_audio) {
-			// Determine if we are speeding up or slowing down
-			if (time.GetRepeatFraction(frame_number).den > 1) {
-				// SLOWING DOWN AUDIO
-				// Resample data, and return new buffer pointer
-				juce::AudioSampleBuffer *resampled_buffer = NULL;
-				int resampled_buffer_size = 0;
-
-				// SLOW DOWN audio (split audio)
-				samples = new juce::AudioSampleBuffer(channels, number_of_samples);
-				samples->clear();
-
-				// Loop through channels, and get audio samples
-				for (int channel = 0; channel < channels; channel++)
-					// Get the audio samples for this channel
-					samples->addFrom(channel, 0, GetOrCreateFrame(new_frame_number)->GetAudioSamples(channel),
-									 number_of_samples, 1.0f);
-
-				// Reverse the samples (if needed)
-				if (!time.IsIncreasing(frame_number))
-					reverse_buffer(samples);
-
-				// Resample audio to be X times slower (where X is the denominator of the repeat fraction)
-				resampler->SetBuffer(samples, 1.0 / time.GetRepeatFraction(frame_number).den);
-
-				// Resample the data (since it's the 1st slice)
-				resampled_buffer = resampler->GetResampledBuffer();
-
-				// Get the length of the resampled buffer (if one exists)
-				resampled_buffer_size = resampled_buffer->getNumSamples();
+		int number_of_samples = original_frame->GetAudioSamplesCount();
 
-				// Just take the samples we need for the requested frame
-				int start = (number_of_samples * (time.GetRepeatFraction(frame_number).num - 1));
-				if (start > 0)
-					start -= 1;
-				for (int channel = 0; channel < channels; channel++)
-					// Add new (slower) samples, to the frame object
-					frame->AddAudio(true, channel, 0, resampled_buffer->getReadPointer(channel, start),
-										number_of_samples, 1.0f);
-
-				// Clean up
-				resampled_buffer = NULL;
+		// Determine if we are speeding up or slowing down
+		if (repeat_fraction.den > 1) {
+			// SLOWING DOWN AUDIO (split the audio of the original frame)
+			samples = new juce::AudioSampleBuffer(channels, number_of_samples);
+			samples->clear();
+			for (int channel = 0; channel < channels && channel < original_frame->GetAudioChannelsCount(); channel++) {
+				samples->copyFrom(channel, 0, original_frame->GetAudioSamples(channel), number_of_samples);
 
+				// Reverse the samples (if needed)
+				if (is_reversed)
+					std::reverse(samples->getWritePointer(channel), samples->getWritePointer(channel) + number_of_samples);
 			}
-			else if (abs(delta) > 1 && abs(delta) < 100) {
-				int start = 0;
-				if (delta > 0) {
-					// SPEED UP (multiple frames of audio), as long as it's not more than X frames
-					int total_delta_samples = 0;
-					for (int delta_frame = new_frame_number - (delta - 1);
-						 delta_frame <= new_frame_number; delta_frame++)
-						total_delta_samples += Frame::GetSamplesPerFrame(delta_frame, reader->info.fps,
-																		 reader->info.sample_rate,
-																		 reader->info.channels);
-
-					// Allocate a new sample buffer for these delta frames
-					samples = new juce::AudioSampleBuffer(channels, total_delta_samples);
-					samples->clear();
-
-					// Loop through each frame in this delta
-					for (int delta_frame = new_frame_number - (delta - 1);
-						 delta_frame <= new_frame_number; delta_frame++) {
-						// buffer to hold detal samples
-						int number_of_delta_samples = GetOrCreateFrame(delta_frame)->GetAudioSamplesCount();
-						juce::AudioSampleBuffer *delta_samples = new juce::AudioSampleBuffer(channels,
-																					   number_of_delta_samples);
-						delta_samples->clear();
-
-						for (int channel = 0; channel < channels; channel++)
-							delta_samples->addFrom(channel, 0, GetOrCreateFrame(delta_frame)->GetAudioSamples(channel),
-												   number_of_delta_samples, 1.0f);
-
-						// Reverse the samples (if needed)
-						if (!time.IsIncreasing(frame_number))
-							reverse_buffer(delta_samples);
-
-						// Copy the samples to
-						for (int channel = 0; channel < channels; channel++)
-							// Get the audio samples for this channel
-							samples->addFrom(channel, start, delta_samples->getReadPointer(channel),
-											 number_of_delta_samples, 1.0f);
-
-						// Clean up
-						delete delta_samples;
-						delta_samples = NULL;
-
-						// Increment start position
-						start += number_of_delta_samples;
-					}
-				}
-				else {
-					// SPEED UP (multiple frames of audio), as long as it's not more than X frames
-					int total_delta_samples = 0;
-					for (int delta_frame = new_frame_number - (delta + 1);
-						 delta_frame >= new_frame_number; delta_frame--)
-						total_delta_samples += Frame::GetSamplesPerFrame(delta_frame, reader->info.fps,
-																		 reader->info.sample_rate,
-																		 reader->info.channels);
-
-					// Allocate a new sample buffer for these delta frames
-					samples = new juce::AudioSampleBuffer(channels, total_delta_samples);
-					samples->clear();
-
-					// Loop through each frame in this delta
-					for (int delta_frame = new_frame_number - (delta + 1);
-						 delta_frame >= new_frame_number; delta_frame--) {
-						// buffer to hold delta samples
-						int number_of_delta_samples = GetOrCreateFrame(delta_frame)->GetAudioSamplesCount();
-						juce::AudioSampleBuffer *delta_samples = new juce::AudioSampleBuffer(channels,
-																					   number_of_delta_samples);
-						delta_samples->clear();
-
-						for (int channel = 0; channel < channels; channel++)
-							delta_samples->addFrom(channel, 0, GetOrCreateFrame(delta_frame)->GetAudioSamples(channel),
-												   number_of_delta_samples, 1.0f);
-
-						// Reverse the samples (if needed)
-						if (!time.IsIncreasing(frame_number))
-							reverse_buffer(delta_samples);
-
-						// Copy the samples to
-						for (int channel = 0; channel < channels; channel++)
-							// Get the audio samples for this channel
-							samples->addFrom(channel, start, delta_samples->getReadPointer(channel),
-											 number_of_delta_samples, 1.0f);
-
-						// Clean up
-						delete delta_samples;
-						delta_samples = NULL;
-
-						// Increment start position
-						start += number_of_delta_samples;
-					}
-				}
-
-				// Resample audio to be X times faster (where X is the delta of the repeat fraction)
-				resampler->SetBuffer(samples, float(start) / float(number_of_samples));
-
-				// Resample data, and return new buffer pointer
-				juce::AudioSampleBuffer *buffer = resampler->GetResampledBuffer();
-				int resampled_buffer_size = buffer->getNumSamples();
 
-				// Add the newly resized audio samples to the current frame
-				for (int channel = 0; channel < channels; channel++)
-					// Add new (slower) samples, to the frame object
-					frame->AddAudio(true, channel, 0, buffer->getReadPointer(channel), number_of_samples, 1.0f);
-
-				// Clean up
-				buffer = NULL;
+			// Resample audio to be X times slower (where X is the denominator of the repeat fraction)
+			resampler->SetBuffer(samples, 1.0 / repeat_fraction.den);
+			juce::AudioSampleBuffer *resampled_buffer = resampler->GetResampledBuffer();
+
+			// Just take the samples we need for the requested frame
+			int start = (number_of_samples * (repeat_fraction.num - 1));
+			if (start > 0)
+				start -= 1;
+			for (int channel = 0; channel < channels; channel++)
+				// Add new (slower) samples, to the frame object
+				frame->AddAudio(true, channel, 0, resampled_buffer->getReadPointer(channel, start),
+									number_of_samples, 1.0f);
+		}
+		else if (abs(delta) > 1 && abs(delta) < 100) {
+			// SPEED UP (multiple frames of audio), as long as it's not more than X frames. Get each frame of the
+			// delta once (in the order they are played, ending with the original frame).
+			int direction = (delta > 0) ? 1 : -1;
+			std::vector<std::shared_ptr<Frame> > delta_frames;
+			int total_delta_samples = 0;
+			for (int index = abs(delta) - 1; index >= 0; index--) {
+				std::shared_ptr<Frame> delta_frame = (index == 0) ? original_frame :
+					GetOrCreateFrame(new_frame_number - direction * index, 0, 0, audio_only);
+				delta_frames.push_back(delta_frame);
+				total_delta_samples += delta_frame->GetAudioSamplesCount();
 			}
-			else {
-				// Use the samples on this frame (but maybe reverse them if needed)
-				samples = new juce::AudioSampleBuffer(channels, number_of_samples);
-				samples->clear();
-
-				// Loop through channels, and get audio samples
-				for (int channel = 0; channel < channels; channel++)
-					// Get the audio samples for this channel
-					samples->addFrom(channel, 0, frame->GetAudioSamples(channel), number_of_samples, 1.0f);
-
-				// reverse the samples
-				if (!time.IsIncreasing(frame_number))
-					reverse_buffer(samples);
-
-				// Add reversed samples to the frame object
-				for (int channel = 0; channel < channels; channel++)
-					frame->AddAudio(true, channel, 0, samples->getReadPointer(channel), number_of_samples, 1.0f);
-
 
+			// Copy the samples of each frame (reversed, if needed) after each other
+			samples = new juce::AudioSampleBuffer(channels, total_delta_samples);
+			samples->clear();
+			int start = 0;
+			for (int index = 0; index < delta_frames.size(); index++) {
+				int number_of_delta_samples = delta_frames[index]->GetAudioSamplesCount();
+				for (int channel = 0; channel < channels && channel < delta_frames[index]->GetAudioChannelsCount(); channel++) {
+					samples->copyFrom(channel, start, delta_frames[index]->GetAudioSamples(channel), number_of_delta_samples);
+					if (is_reversed)
+						std::reverse(samples->getWritePointer(channel, start), samples->getWritePointer(channel, start) + number_of_delta_samples);
+				}
+				start += number_of_delta_samples;
 			}
 
-			delete samples;
-			samples = NULL;
+			// Resample audio to be X times faster (where X is the delta of the repeat fraction)
+			resampler->SetBuffer(samples, float(start) / float(number_of_samples));
+			juce::AudioSampleBuffer *buffer = resampler->GetResampledBuffer();
+
+			// Add the newly resized audio samples to the current frame
+			for (int channel = 0; channel < channels; channel++)
+				// Add new (faster) samples, to the frame object
+				frame->AddAudio(true, channel, 0, buffer->getReadPointer(channel), number_of_samples, 1.0f);
 		}
+		else if (is_reversed) {
+			// Reverse the samples of this frame (which are a copy of the original frame's samples)
+			for (int channel = 0; channel < frame->GetAudioChannelsCount(); channel++)
+				std::reverse(frame->GetAudioSamples(channel), frame->GetAudioSamples(channel) + frame->GetAudioSamplesCount());
+		}
+
+		delete samples;
+		samples = NULL;
 	}
 }
 
+// Get the frame number of the reader which a frame of this clip is mapped from
+int64_t Clip::MappedFrameNumber(int64_t frame_number)
+{
+	frame_number = adjust_frame_number_minimum(frame_number);
+	if (time.GetLength() > 1)
+		return adjust_frame_number_minimum(time.GetLong(frame_number));
+	return frame_number;
+}
+
 // Adjust frame number minimum value
 int64_t Clip::adjust_frame_number_minimum(int64_t frame_number)
 {
@@ -607,31 +689,22 @@ int64_t Clip::adjust_frame_number_minimum(int64_t frame_number)
 }
 
 // Get or generate a blank frame
-std::shared_ptr<Frame> Clip::GetOrCreateFrame(int64_t number)
+std::shared_ptr<Frame> Clip::GetOrCreateFrame(int64_t number, int width, int height, bool audio_only)
 {
 	std::shared_ptr<Frame> new_frame;
 
 	// Init some basic properties about this frame
 	int samples_in_frame = Frame::GetSamplesPerFrame(number, reader->info.fps, reader->info.sample_rate, reader->info.channels);
 
-	try {
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Clip::GetOrCreateFrame (from reader)", "number", number, "samples_in_frame", samples_in_frame);
-
-		// Attempt to get a frame (but this could fail if a reader has just been closed)
-		new_frame = reader->GetFrame(number);
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Clip::GetOrCreateFrame (from reader)", "number", number, "samples_in_frame", samples_in_frame);
 
-		// Return real frame
-		if (new_frame)
-			return new_frame;
+	// Attempt to get a frame (but this could fail if a reader has just been closed)
+	FrameStatus status = audio_only ? reader->TryGetAudioFrame(number, new_frame) : reader->TryGetFrame(number, new_frame, width, height);
 
-	} catch (const ReaderClosed & e) {
-		// ...
-	} catch (const TooManySeeks & e) {
-		// ...
-	} catch (const OutOfBoundsFrame & e) {
-		// ...
-	}
+	// Return real frame
+	if (status == FRAME_OK && new_frame)
+		return new_frame;
 
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("Clip::GetOrCreateFrame (create blank)", "number", number, "samples_in_frame", samples_in_frame);
@@ -644,11 +717,37 @@ std::shared_ptr<Frame> Clip::GetOrCreateFrame(int64_t number)
 	return new_frame;
 }
 
+// Generate a JSON string of the timing counters of this clip's effects
+std::string Clip::EffectTimingJson() {
+
+	// Return formatted string
+	return WriteJson(EffectTimingJsonValue());
+}
+
+// Generate a JSON object of the timing counters of this clip's effects
+Json::Value Clip::EffectTimingJsonValue() {
+
+	Json::Value root;
+	root["id"] = Id();
+	root["effects"] = Json::Value(Json::arrayValue);
+	for (EffectBase *effect : effects)
+		root["effects"].append(effect->TimingJsonValue());
+
+	// return JsonValue
+	return root;
+}
+
+// Reset the timing counters of this clip's effects
+void Clip::ResetEffectTiming() {
+	for (EffectBase *effect : effects)
+		effect->ResetTiming();
+}
+
 // Generate JSON string of this object
 std::string Clip::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Get all properties for a specific frame
@@ -736,7 +835,7 @@ std::string Clip::PropertiesJSON(int64_t requested_frame) {
 
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
 
 // Generate Json::JsonValue for this object
@@ -802,13 +901,7 @@ void Clip::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -948,7 +1041,7 @@ void Clip::SetJsonValue(Json::Value root) {
 			if (type == "FFmpegReader") {
 
 				// Create new reader
-				reader = new FFmpegReader(root["reader"]["path"].asString(), false);
+				reader = create_ffmpeg_reader(root["reader"]["path"].asString(), false);
 				reader->SetJsonValue(root["reader"]);
 
 			} else if (type == "QtImageReader") {
@@ -957,6 +1050,18 @@ void Clip::SetJsonValue(Json::Value root) {
 				reader = new QtImageReader(root["reader"]["path"].asString(), false);
 				reader->SetJsonValue(root["reader"]);
 
+			} else if (type == "ImageSequenceReader") {
+
+				// Create new reader
+				reader = new ImageSequenceReader(root["reader"]["path"].asString(), Fraction(30, 1), false);
+				reader->SetJsonValue(root["reader"]);
+
+			} else if (type == "RawVideoReader") {
+
+				// Create new reader
+				reader = new RawVideoReader(root["reader"]["path"].asString(), false);
+				reader->SetJsonValue(root["reader"]);
+
 #ifdef USE_IMAGEMAGICK
 			} else if (type == "ImageReader") {
 
@@ -996,6 +1101,24 @@ void Clip::SetJsonValue(Json::Value root) {
 
 		}
 	}
+
+	// Bake the (possibly changed) keyframes
+	bake_keyframes();
+
+	// Frames processed with the previous properties are no longer valid
+	ClearCache();
+}
+
+// Bake the animated keyframes which are evaluated for every frame
+void Clip::bake_keyframes()
+{
+	Keyframe *keyframes[] = { &scale_x, &scale_y, &location_x, &location_y, &alpha, &rotation, &volume,
+							  &crop_width, &crop_height, &crop_x, &crop_y, &shear_x, &shear_y };
+	for (Keyframe *keyframe : keyframes)
+		keyframe->Bake();
+
+	// Time mapping also queries the repeat fraction, delta, and direction of every frame
+	time.BakeTimeMap();
 }
 
 // Sort effects by order
@@ -1013,17 +1136,145 @@ void Clip::AddEffect(EffectBase* effect)
 
 	// Sort effects
 	sort_effects();
+
+	// Frames processed without this effect are no longer valid
+	ClearCache();
 }
 
 // Remove an effect from the clip
 void Clip::RemoveEffect(EffectBase* effect)
 {
 	effects.remove(effect);
+
+	// Frames processed with this effect are no longer valid
+	ClearCache();
+}
+
+// Apply the audio block effects to the audio of a frame (in the order of the frames)
+void Clip::apply_audio_effects(std::shared_ptr<Frame> frame, int64_t requested_frame)
+{
+	std::vector<EffectBase*> audio_effects;
+	for (EffectBase *effect : effects)
+		if (effect->IsAudioBlockEffect())
+			audio_effects.push_back(effect);
+	if (audio_effects.empty())
+		return;
+
+	TraceSpan trace_span("Clip::apply_audio_effects", "effects", requested_frame);
+	const GenericScopedLock<juce::CriticalSection> lock(audioEffectsSection);
+
+	std::map<int64_t, std::vector<std::vector<float> > >::iterator processed = processed_audio.find(requested_frame);
+	if (processed == processed_audio.end()) {
+		// An earlier frame, or a frame far after the last one, resets the effects (i.e. after a seek)
+		if (audio_effects_next_frame == 0 || requested_frame < audio_effects_next_frame ||
+			requested_frame > audio_effects_next_frame + AUDIO_EFFECTS_MAX_GAP) {
+			for (EffectBase *effect : audio_effects)
+				effect->ResetAudio();
+			processed_audio.clear();
+			audio_effects_next_frame = requested_frame;
+		}
+
+		// Process the skipped frames first (i.e. frames rendered out of order), which are kept for their requests.
+		// A skipped frame found in the clip's cache isn't processed again, so the effects are reset instead.
+		while (audio_effects_next_frame < requested_frame) {
+			int64_t skipped_frame = audio_effects_next_frame;
+			get_frame(skipped_frame, 0, 0, true);
+			if (audio_effects_next_frame == skipped_frame) {
+				for (EffectBase *effect : audio_effects)
+					effect->ResetAudio();
+				audio_effects_next_frame = requested_frame;
+			}
+		}
+
+		// Process the frame's samples (in the order of the effects), and keep them
+		for (EffectBase *effect : audio_effects)
+			effect->ProcessAudio(frame, frame->number);
+
+		std::vector<std::vector<float> >& samples = processed_audio[requested_frame];
+		samples.resize(frame->GetAudioChannelsCount());
+		for (int channel = 0; channel < frame->GetAudioChannelsCount(); channel++) {
+			const float *channel_samples = frame->GetAudioSamples(channel);
+			samples[channel].assign(channel_samples, channel_samples + frame->GetAudioSamplesCount());
+		}
+		audio_effects_next_frame = requested_frame + 1;
+
+		// Only the recent frames are kept
+		while (!processed_audio.empty() && processed_audio.begin()->first < requested_frame - AUDIO_EFFECTS_MAX_GAP)
+			processed_audio.erase(processed_audio.begin());
+		return;
+	}
+
+	// A frame requested again gets the same samples
+	for (int channel = 0; channel < frame->GetAudioChannelsCount() && channel < processed->second.size(); channel++)
+		frame->AddAudio(true, channel, 0, processed->second[channel].data(),
+						std::min(frame->GetAudioSamplesCount(), int(processed->second[channel].size())), 1.0);
+}
+
+// Collect the GPU kernels of every video effect (or none, if an effect has no GPU kernel)
+bool Clip::get_gpu_kernels(std::shared_ptr<Frame> frame, std::vector<EffectBase::GpuKernel>& gpu_kernels)
+{
+	gpu_kernels.clear();
+	if (Settings::Instance()->SKIP_EFFECTS || !frame->has_image_data)
+		return false;
+
+	size_t parameters = 0;
+	for (EffectBase *effect : effects)
+	{
+		// Audio block effects are applied to the audio (see apply_audio_effects)
+		if (effect->IsAudioBlockEffect())
+			continue;
+
+		EffectBase::GpuKernel gpu_kernel = effect->GetGpuKernel(frame->number);
+		parameters += gpu_kernel.parameters.size();
+		if (gpu_kernel.source.empty() || gpu_kernels.size() == size_t(GpuCompositor::MaxKernels) || parameters > size_t(GpuCompositor::MaxParameters)) {
+			gpu_kernels.clear();
+			return false;
+		}
+		gpu_kernel.region = effect->RegionOfInterest(frame->number, QSize(frame->GetWidth(), frame->GetHeight()));
+		gpu_kernels.push_back(gpu_kernel);
+	}
+	return !gpu_kernels.empty();
 }
 
 // Apply effects to the source frame (if any)
 std::shared_ptr<Frame> Clip::apply_effects(std::shared_ptr<Frame> frame)
 {
+	TraceSpan trace_span("Clip::apply_effects", "effects", frame->number);
+	static MemoryGauge& effect_memory = Metrics::Instance()->GetMemory("images.effects");
+	ScopedMemoryTag memory_tag(effect_memory);
+
+	// Effects are skipped while the preview is lowering its quality
+	if (Settings::Instance()->SKIP_EFFECTS)
+		return frame;
+
+	// A still image is the same on every frame, so its effects only run again when one of their keys changes
+	qint64 input_key = 0;
+	std::string effects_key;
+	if (!effects.empty() && reader && reader->info.has_single_image && frame->has_image_data) {
+		input_key = frame->GetImage()->cacheKey();
+		for (EffectBase *effect : effects)
+			effects_key += effect->OutputKey(frame->number) + "\n";
+
+		std::shared_ptr<QImage> cached_image;
+		{
+			const GenericScopedLock<juce::CriticalSection> lock(effectsCacheSection);
+			if (cached_effects_image && input_key == cached_effects_input_key && effects_key == cached_effects_key)
+				cached_image = cached_effects_image;
+		}
+
+		// Share the cached output (copy-on-write, so drawing on this frame never changes the cache)
+		if (cached_image) {
+			frame->AddImage(std::shared_ptr<QImage>(new QImage(*cached_image)));
+			return frame;
+		}
+	}
+
+	// Consecutive point-wise effects (with the same region) are collected, and applied in a single pass
+	std::vector<EffectBase*> kernel_effects;
+	std::vector<EffectBase::PixelKernel> pixel_kernels;
+	std::vector<bool> color_kernels;
+	QRect kernel_region;
+
 	// Find Effects at this position and layer
 	std::list<EffectBase*>::iterator effect_itr;
 	for (effect_itr=effects.begin(); effect_itr != effects.end(); ++effect_itr)
@@ -1031,11 +1282,51 @@ std::shared_ptr<Frame> Clip::apply_effects(std::shared_ptr<Frame> frame)
 		// Get clip object from the iterator
 		EffectBase *effect = (*effect_itr);
 
+		// Audio block effects are applied to the audio (see apply_audio_effects)
+		if (effect->IsAudioBlockEffect())
+			continue;
+
+		// Collect point-wise effects
+		EffectBase::PixelKernel pixel_kernel = effect->GetPixelKernel(frame->number);
+		if (pixel_kernel) {
+			QRect effect_region = effect->RegionOfInterest(frame->number, QSize(frame->GetWidth(), frame->GetHeight()));
+			if (!pixel_kernels.empty() && effect_region != kernel_region) {
+				EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+			}
+			kernel_region = effect_region;
+			kernel_effects.push_back(effect);
+			pixel_kernels.push_back(pixel_kernel);
+			color_kernels.push_back(effect->IsColorKernel());
+			continue;
+		}
+
+		// Apply the collected point-wise effects first
+		EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+
+		// Effects expect RGBA8888 pixels
+		frame->ConvertImage(QImage::Format_RGBA8888);
+
 		// Apply the effect to this frame
-		frame = effect->GetFrame(frame, frame->number);
+		int64_t frame_number = frame->number;
+		frame = effect->ProcessFrame(std::move(frame), frame_number);
 
 	} // end effect loop
 
+	// Apply the remaining point-wise effects
+	EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+
+	// Convert back to the frame image format (if any effects were applied)
+	if (!effects.empty())
+		frame->ConvertImage(Frame::ImageFormat());
+
+	// Cache the output of a still image
+	if (input_key) {
+		const GenericScopedLock<juce::CriticalSection> lock(effectsCacheSection);
+		cached_effects_image = std::shared_ptr<QImage>(new QImage(*frame->GetImage()));
+		cached_effects_input_key = input_key;
+		cached_effects_key = effects_key;
+	}
+
 	// Return modified frame
 	return frame;
 }
@@ -32,6 +32,24 @@
 
 using namespace openshot;
 
+// Set the frame rate of the timeline this clip is on
+void ClipBase::FrameRate(Fraction fps) {
+	if (fps.num == frames_fps.num && fps.den == frames_fps.den)
+		return;
+	frames_fps = fps;
+	update_frames();
+}
+
+// Calculate the timeline frames of this clip (the same rounding the timeline has always used)
+void ClipBase::update_frames() {
+	if (frames_fps.num <= 0 || frames_fps.den <= 0)
+		return;
+	double fps = frames_fps.ToDouble();
+	position_frame = round(position * fps) + 1;
+	end_position_frame = round((position + (end - start)) * fps) + 1;
+	start_frame = (start * fps) + 1;
+}
+
 // Generate Json::JsonValue for this object
 Json::Value ClipBase::JsonValue() {
 
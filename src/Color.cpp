@@ -29,6 +29,7 @@
  */
 
 #include "../include/Color.h"
+#include <algorithm>
 
 using namespace openshot;
 
@@ -74,6 +75,17 @@ std::string Color::GetColorHex(int64_t frame_number) {
 	return QColor( r,g,b,a ).name().toStdString();
 }
 
+// Get the packed RGBA value of a color at a specific frame
+QRgb Color::GetRGBA(int64_t frame_number) {
+
+	int r = std::max(0, std::min(red.GetInt(frame_number), 255));
+	int g = std::max(0, std::min(green.GetInt(frame_number), 255));
+	int b = std::max(0, std::min(blue.GetInt(frame_number), 255));
+	int a = std::max(0, std::min(alpha.GetInt(frame_number), 255));
+
+	return qRgba(r, g, b, a);
+}
+
 // Get the distance between 2 RGB pairs (alpha is ignored)
 long Color::GetDistance(long R1, long G1, long B1, long R2, long G2, long B2)
 {
@@ -88,7 +100,7 @@ long Color::GetDistance(long R1, long G1, long B1, long R2, long G2, long B2)
 std::string Color::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -110,13 +122,7 @@ void Color::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-	                 value.c_str() + value.size(), &root, &errors );
-	 delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @brief Source file for ColorLUT class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/ColorLUT.h"
+
+using namespace openshot;
+
+// Constructor, which creates an identity LUT
+ColorLUT::ColorLUT(int lut_size) : size(lut_size)
+{
+	// Keep the size in range (a grid point can't be smaller than one color value)
+	if (size < 2)
+		size = 2;
+	else if (size > 256)
+		size = 256;
+
+	// Spread the grid points evenly over the 8-bit color values
+	grid_values.resize(size);
+	for (int point = 0; point < size; point++)
+		grid_values[point] = (point * 255 + (size - 1) / 2) / (size - 1);
+
+	// Find the grid cell (and the position in it) of each color value, with 8 bits of precision
+	for (int value = 0, cell = 0; value < 256; value++)
+	{
+		while (cell < size - 2 && value >= grid_values[cell + 1])
+			cell++;
+		int cell_width = grid_values[cell + 1] - grid_values[cell];
+		grid_index[value] = cell;
+		grid_weight[value] = ((value - grid_values[cell]) * 256 + cell_width / 2) / cell_width;
+	}
+
+	// Start with the grid colors themselves (an identity LUT)
+	Bake(std::vector<EffectBase::PixelKernel>());
+}
+
+// Bake pixel kernels (run in order) into this LUT
+void ColorLUT::Bake(const std::vector<EffectBase::PixelKernel>& kernels)
+{
+	// Create an RGBA8888 pixel for each grid point
+	int64_t point_count = (int64_t) size * size * size;
+	std::vector<uint8_t> grid_pixels(point_count * 4);
+	size_t byte_index = 0;
+	for (int blue = 0; blue < size; blue++)
+		for (int green = 0; green < size; green++)
+			for (int red = 0; red < size; red++, byte_index += 4)
+			{
+				grid_pixels[byte_index] = grid_values[red];
+				grid_pixels[byte_index + 1] = grid_values[green];
+				grid_pixels[byte_index + 2] = grid_values[blue];
+				grid_pixels[byte_index + 3] = 255;
+			}
+
+	// Run the kernels on the grid colors
+	for (const EffectBase::PixelKernel &kernel : kernels)
+		kernel(grid_pixels.data(), point_count);
+
+	// Spread the output colors into 16-bit lanes, so all 3 channels are interpolated with the same multiplications
+	table.resize(point_count);
+	for (int64_t point = 0; point < point_count; point++)
+		table[point] = (uint64_t) grid_pixels[point * 4] | ((uint64_t) grid_pixels[point * 4 + 1] << 16) |
+					   ((uint64_t) grid_pixels[point * 4 + 2] << 32);
+}
+
+// Apply this LUT to pixels (the alpha value is left alone)
+void ColorLUT::Apply(unsigned char *pixels, int64_t pixel_count) const
+{
+	// Offsets to the next grid point on each axis
+	const int steps[3] = { 1, size, size * size };
+	const int opposite_step = 1 + size + size * size;
+	const uint64_t *lut = table.data();
+
+	// The largest and smallest axis (0 is red, 1 is green, 2 is blue), for each order of the positions in a cell
+	// (bit 2 is red >= green, bit 1 is green >= blue, bit 0 is red >= blue)
+	static const int largest_axis[8] = { 2, 2, 1, 1, 2, 0, 0, 0 };
+	static const int smallest_axis[8] = { 0, 0, 0, 2, 1, 1, 2, 2 };
+
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4)
+	{
+		int R = pixels[byte_index];
+		int G = pixels[byte_index + 1];
+		int B = pixels[byte_index + 2];
+
+		// Get the grid cell, and the position in the cell
+		const uint64_t *corner = lut + grid_index[R] + grid_index[G] * steps[1] + grid_index[B] * steps[2];
+		int weights[3] = { grid_weight[R], grid_weight[G], grid_weight[B] };
+
+		// Pick the tetrahedron of the cell which contains this color: the path from the first corner steps
+		// along the axis with the largest position, then along the middle one, to the opposite corner
+		int order = ((weights[0] >= weights[1]) << 2) | ((weights[1] >= weights[2]) << 1) | (weights[0] >= weights[2]);
+		int largest = largest_axis[order];
+		int smallest = smallest_axis[order];
+		uint64_t w1 = weights[largest];
+		uint64_t w3 = weights[smallest];
+		uint64_t w2 = weights[0] + weights[1] + weights[2] - w1 - w3;
+
+		// Interpolate between the 4 corners of the tetrahedron. The weights add up to 256, so each 16-bit
+		// lane holds at most 255 * 256 + 128, and never carries into the next channel.
+		uint64_t color = corner[0] * (256 - w1) + corner[steps[largest]] * (w1 - w2) +
+						 corner[opposite_step - steps[smallest]] * (w2 - w3) + corner[opposite_step] * w3 +
+						 0x0000008000800080ULL;
+		pixels[byte_index] = (color >> 8) & 0xFF;
+		pixels[byte_index + 1] = (color >> 24) & 0xFF;
+		pixels[byte_index + 2] = (color >> 40) & 0xFF;
+	}
+}
@@ -48,7 +48,7 @@ Coordinate::Coordinate(double x, double y) :
 std::string Coordinate::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -73,13 +73,7 @@ void Coordinate::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
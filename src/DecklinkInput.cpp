@@ -53,12 +53,58 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include "../include/DecklinkInput.h"
 
 using namespace std;
 
+// Frames waiting in the queue of each capture worker
+#define CAPTURE_QUEUE_SIZE 2
+
+DeckLinkImageFrame::DeckLinkImageFrame(int width, int height)
+{
+	image = openshot::ImageBufferPool::CreateImage(width, height, QImage::Format_ARGB32);
+}
+
+BMDPixelFormat DeckLinkImageFrame::GetPixelFormat(void)
+{
+	// QImage::Format_ARGB32 is a native endian 32 bit integer per pixel
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	return bmdFormat8BitBGRA;
+#else
+	return bmdFormat8BitARGB;
+#endif
+}
+
+HRESULT DeckLinkImageFrame::GetBytes(void **buffer)
+{
+	*buffer = image->bits();
+	return S_OK;
+}
+
+bool DeckLinkCaptureQueue::Push(const Entry& entry)
+{
+	size_t current = tail.load(std::memory_order_relaxed);
+	size_t next = (current + 1) % entries.size();
+	if (next == head.load(std::memory_order_acquire))
+		return false;
+	entries[current] = entry;
+	tail.store(next, std::memory_order_release);
+	return true;
+}
+
+bool DeckLinkCaptureQueue::Pop(Entry& entry)
+{
+	size_t current = head.load(std::memory_order_relaxed);
+	if (current == tail.load(std::memory_order_acquire))
+		return false;
+	entry = entries[current];
+	head.store((current + 1) % entries.size(), std::memory_order_release);
+	return true;
+}
+
 DeckLinkInputDelegate::DeckLinkInputDelegate(pthread_cond_t* m_sleepCond, IDeckLinkOutput* m_deckLinkOutput, IDeckLinkVideoConversion* m_deckLinkConverter)
- : m_refCount(0), g_timecodeFormat(0), frameCount(0), final_frameCount(0)
+ : m_refCount(0), g_timecodeFormat(0), frameCount(0), stopping(false), published(0)
 {
 	sleepCond = m_sleepCond;
 	deckLinkOutput = m_deckLinkOutput;
@@ -68,10 +114,36 @@ DeckLinkInputDelegate::DeckLinkInputDelegate(pthread_cond_t* m_sleepCond, IDeckL
 	final_frames.SetMaxBytes(60 * 1920 * 1080 * 4 + (44100 * 2 * 4));
 
 	pthread_mutex_init(&m_mutex, NULL);
+
+	// Each worker has a queue, and converts one more frame while its queue is full
+	int worker_count = max(1, OPEN_MP_NUM_PROCESSORS);
+	max_in_flight = worker_count * (CAPTURE_QUEUE_SIZE + 1);
+
+	// A done flag is the number of its frame + 1 (so an old flag never matches a newer frame)
+	done_size = max_in_flight * 2;
+	done.reset(new std::atomic<unsigned long>[done_size]);
+	for (size_t index = 0; index < done_size; index++)
+		done[index].store(0);
+
+	for (int worker = 0; worker < worker_count; worker++)
+		queues.emplace_back(new DeckLinkCaptureQueue(CAPTURE_QUEUE_SIZE));
+	for (int worker = 0; worker < worker_count; worker++)
+		workers.emplace_back(&DeckLinkInputDelegate::worker_loop, this, queues[worker].get());
 }
 
 DeckLinkInputDelegate::~DeckLinkInputDelegate()
 {
+	// Stop the workers, and release the frames they didn't convert
+	stopping = true;
+	for (std::thread& worker : workers)
+		worker.join();
+	for (std::unique_ptr<DeckLinkCaptureQueue>& queue : queues)
+	{
+		DeckLinkCaptureQueue::Entry entry;
+		while (queue->Pop(entry))
+			entry.frame->Release();
+	}
+
 	pthread_mutex_destroy(&m_mutex);
 }
 
@@ -101,8 +173,9 @@ ULONG DeckLinkInputDelegate::Release(void)
 
 unsigned long DeckLinkInputDelegate::GetCurrentFrameNumber()
 {
-	if (final_frameCount > 0)
-		return final_frameCount - 1;
+	unsigned long count = published.load();
+	if (count > 0)
+		return count - 1;
 	else
 		return 0;
 }
@@ -117,22 +190,65 @@ std::shared_ptr<openshot::Frame> DeckLinkInputDelegate::GetFrame(int64_t request
 		usleep(500 * 1);
 	}
 
-	#pragma omp critical (blackmagic_input_queue)
+	if (final_frames.Exists(requested_frame))
+	{
+		// Get the frame and remove it from the cache
+		f = final_frames.GetFrame(requested_frame);
+		final_frames.Remove(requested_frame);
+	}
+	else
+	{
+		cout << "Can't find " << requested_frame << ", GetCurrentFrameNumber(): " << GetCurrentFrameNumber() << endl;
+		final_frames.Display();
+	}
+
+	return f;
+}
+
+void DeckLinkInputDelegate::finish_frame(unsigned long number)
+{
+	done[number % done_size].store(number + 1, std::memory_order_release);
+
+	// Publish the next frames, while they are done (any worker may publish the frames of the others)
+	unsigned long next = published.load(std::memory_order_acquire);
+	while (done[next % done_size].load(std::memory_order_acquire) == next + 1)
 	{
-		if (final_frames.Exists(requested_frame))
+		if (published.compare_exchange_weak(next, next + 1, std::memory_order_acq_rel))
+			next++;
+	}
+}
+
+void DeckLinkInputDelegate::worker_loop(DeckLinkCaptureQueue *queue)
+{
+	DeckLinkCaptureQueue::Entry entry;
+	while (!stopping)
+	{
+		if (!queue->Pop(entry))
 		{
-			// Get the frame and remove it from the cache
-			f = final_frames.GetFrame(requested_frame);
-			final_frames.Remove(requested_frame);
+			usleep(500 * 1);
+			continue;
 		}
-		else
+
+		// Convert the captured frame straight into the image of the openshot frame
+		int width = entry.frame->GetWidth();
+		int height = entry.frame->GetHeight();
+		DeckLinkImageFrame image_frame(width, height);
+		HRESULT res = deckLinkConverter->ConvertFrame(entry.frame, &image_frame);
+
+		// The SDK can reuse the captured frame now
+		entry.frame->Release();
+
+		if (res == S_OK)
 		{
-			cout << "Can't find " << requested_frame << ", GetCurrentFrameNumber(): " << GetCurrentFrameNumber() << endl;
-			final_frames.Display();
+			std::shared_ptr<openshot::Frame> f(new openshot::Frame(entry.number, width, height, "#000000", 2048, 2));
+			f->AddImage(image_frame.image);
+			final_frames.Add(f);
 		}
-	}
+		else
+			cout << "DeckLinkInputDelegate: Error converting frame " << entry.number << ", res:" << res << endl;
 
-	return f;
+		finish_frame(entry.number);
+	}
 }
 
 HRESULT DeckLinkInputDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame* videoFrame, IDeckLinkAudioInputPacket* audioFrame)
@@ -157,128 +273,26 @@ HRESULT DeckLinkInputDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame*
 				}
 			}
 
-//			fprintf(stderr, "Frame received (#%lu) [%s] - Size: %li bytes\n",
-//				frameCount,
-//				timecodeString != NULL ? timecodeString : "No timecode",
-//				videoFrame->GetRowBytes() * videoFrame->GetHeight());
-
 			if (timecodeString)
 				free((void*)timecodeString);
 
-			// Create a new copy of the YUV frame object
-			IDeckLinkMutableVideoFrame *m_yuvFrame = NULL;
-
-			int width = videoFrame->GetWidth();
-			int height = videoFrame->GetHeight();
-
-			HRESULT res = deckLinkOutput->CreateVideoFrame(
-									width,
-									height,
-									videoFrame->GetRowBytes(),
-									bmdFormat8BitYUV,
-									bmdFrameFlagDefault,
-									&m_yuvFrame);
-
-			// Copy pixel and audio to copied frame
-			void *frameBytesSource;
-			void *frameBytesDest;
-			videoFrame->GetBytes(&frameBytesSource);
-			m_yuvFrame->GetBytes(&frameBytesDest);
-			memcpy(frameBytesDest, frameBytesSource, videoFrame->GetRowBytes() * height);
-
-			// Add raw YUV frame to queue
-			raw_video_frames.push_back(m_yuvFrame);
-
-			// Process frames once we have a few (to take advantage of multiple threads)
-			int number_to_process = raw_video_frames.size();
-			if (number_to_process >= OPEN_MP_NUM_PROCESSORS)
+			// Queue the frame of the SDK for a worker (without copying it), unless too many frames are waiting
+			DeckLinkCaptureQueue::Entry entry = {videoFrame, frameCount};
+			bool queued = false;
+			if (frameCount - published.load(std::memory_order_acquire) < max_in_flight)
 			{
+				videoFrame->AddRef();
+				queued = queues[frameCount % queues.size()]->Push(entry);
+				if (!queued)
+					videoFrame->Release();
+			}
 
-//omp_set_num_threads(1);
-omp_set_nested(true);
-#pragma omp parallel
-{
-#pragma omp single
-{
-				// Temp frame counters (to keep the frames in order)
-				//frameCount = 0;
-
-				// Loop through each queued image frame
-				while (!raw_video_frames.empty())
-				{
-					// Get front frame (from the queue)
-					IDeckLinkMutableVideoFrame* frame = raw_video_frames.front();
-					raw_video_frames.pop_front();
-
-					// declare local variables (for OpenMP)
-					IDeckLinkOutput *copy_deckLinkOutput(deckLinkOutput);
-					IDeckLinkVideoConversion *copy_deckLinkConverter(deckLinkConverter);
-					unsigned long copy_frameCount(frameCount);
-
-					#pragma omp task firstprivate(copy_deckLinkOutput, copy_deckLinkConverter, frame, copy_frameCount)
-					{
-						// *********** CONVERT YUV source frame to RGB ************
-						void *frameBytes;
-						void *audioFrameBytes;
-
-						// Create a new RGB frame object
-						IDeckLinkMutableVideoFrame *m_rgbFrame = NULL;
-
-						int width = videoFrame->GetWidth();
-						int height = videoFrame->GetHeight();
-
-						HRESULT res = copy_deckLinkOutput->CreateVideoFrame(
-												width,
-												height,
-												width * 4,
-												bmdFormat8BitARGB,
-												bmdFrameFlagDefault,
-												&m_rgbFrame);
-
-						if(res != S_OK)
-							cout << "BMDOutputDelegate::StartRunning: Error creating RGB frame, res:" << res << endl;
-
-						// Create a RGB version of this YUV video frame
-						copy_deckLinkConverter->ConvertFrame(frame, m_rgbFrame);
-
-						// Get RGB Byte array
-						m_rgbFrame->GetBytes(&frameBytes);
-
-						// *********** CREATE OPENSHOT FRAME **********
-						std::shared_ptr<openshot::Frame> f(new openshot::Frame(copy_frameCount, width, height, "#000000", 2048, 2));
-
-						// Add Image data to openshot frame
-						// TODO: Fix Decklink support with QImage Upgrade
-						//f->AddImage(width, height, "ARGB", Magick::CharPixel, (uint8_t*)frameBytes);
-
-						#pragma omp critical (blackmagic_input_queue)
-						{
-							// Add processed frame to cache (to be recalled in order after the thread pool is done)
-							final_frames.Add(f);
-						}
-
-						// Release RGB data
-						if (m_rgbFrame)
-							m_rgbFrame->Release();
-						// Release RGB data
-						if (frame)
-							frame->Release();
-
-					} // end task
-
-					// Increment frame count
-					frameCount++;
-
-				} // end while
-
-} // omp single
-} // omp parallel
-
-				// Update final frameCount (since they are done processing now)
-				final_frameCount += number_to_process;
-
+			// Drop the frame (without a number, so the published frames stay in order, and nothing waits for it)
+			if (!queued)
+				fprintf(stderr, "Frame received (#%lu) - Dropped, the capture workers are behind\n", frameCount);
+			else
+				frameCount++;
 
-			} // if size > num processors
 		} // has video source
 	} // if videoFrame
 
@@ -289,6 +303,3 @@ HRESULT DeckLinkInputDelegate::VideoInputFormatChanged(BMDVideoInputFormatChange
 {
     return S_OK;
 }
-
-
-
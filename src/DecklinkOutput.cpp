@@ -53,12 +53,17 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include "../include/DecklinkOutput.h"
+#include "../include/Exceptions.h"
+#include "../include/PixelKernels.h"
+#include "../include/ZmqLogger.h"
 
 using namespace std;
 
 DeckLinkOutputDelegate::DeckLinkOutputDelegate(IDeckLinkDisplayMode *displayMode, IDeckLinkOutput* m_deckLinkOutput)
- : m_refCount(0), displayMode(displayMode), width(0), height(0)
+ : m_refCount(0), displayMode(displayMode), width(0), height(0), playout_reader(NULL), playout_start(0),
+   next_render(0), last_frame(NULL), late_frames(0), dropped_frames(0), playout_stopping(false)
 {
 	// reference to output device
 	deckLinkOutput = m_deckLinkOutput;
@@ -88,13 +93,32 @@ DeckLinkOutputDelegate::DeckLinkOutputDelegate(IDeckLinkDisplayMode *displayMode
 
 DeckLinkOutputDelegate::~DeckLinkOutputDelegate()
 {
-	cout << "DESTRUCTOR!!!" << endl;
+	StopPlayout();
 	pthread_mutex_destroy(&m_mutex);
 }
 
 /************************* DeckLink API Delegate Methods *****************************/
 HRESULT DeckLinkOutputDelegate::ScheduledFrameCompleted (IDeckLinkVideoFrame* completedFrame, BMDOutputFrameCompletionResult result)
 {
+	{
+		std::lock_guard<std::mutex> lock(playout_mutex);
+		if (playout_reader)
+		{
+			if (result == bmdOutputFrameDisplayedLate)
+				late_frames++;
+			else if (result == bmdOutputFrameDropped)
+				dropped_frames++;
+			if (result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped)
+				openshot::ZmqLogger::Instance()->AppendDebugMethod("DeckLinkOutputDelegate::ScheduledFrameCompleted (late or dropped by the device)", "result", result, "late_frames", late_frames, "dropped_frames", dropped_frames);
+
+			// The frame can be rendered again, and the next stream time needs a frame
+			release_playout_frame(completedFrame);
+			if (result != bmdOutputFrameFlushed && !playout_stopping)
+				schedule_playout_frame();
+			return S_OK;
+		}
+	}
+
 	//cout << "Scheduled Successfully!" << endl;
 
 	// When a video frame has been released by the API, schedule another video frame to be output
@@ -319,3 +343,235 @@ void DeckLinkOutputDelegate::WriteFrame(std::shared_ptr<openshot::Frame> frame)
 	} // if
 
 }
+
+// Start playing the frames of a reader
+void DeckLinkOutputDelegate::StartPlayout(openshot::ReaderBase *reader, int64_t start_frame, int preroll_frames)
+{
+	StopPlayout();
+	if (!reader->IsOpen())
+		throw openshot::ReaderClosed("The reader of the playout is closed.  Call Open() before playing it.", "");
+	preroll_frames = max(1, preroll_frames);
+	width = displayMode->GetWidth();
+	height = displayMode->GetHeight();
+
+	// Preallocate the frames (scheduled, rendering, and the last frame shown)
+	int worker_count = max(1, OPEN_MP_NUM_PROCESSORS);
+	std::vector<IDeckLinkMutableVideoFrame*> frames;
+	for (int index = 0; index < preroll_frames + worker_count + 2; index++)
+	{
+		IDeckLinkMutableVideoFrame *frame = NULL;
+		if (deckLinkOutput->CreateVideoFrame(width, height, width * 2, bmdFormat8BitYUV, bmdFrameFlagDefault, &frame) != S_OK)
+		{
+			for (IDeckLinkMutableVideoFrame *created : frames)
+				created->Release();
+			throw openshot::DecklinkError("Failed to create the video frames of the playout.");
+		}
+		frames.push_back(frame);
+	}
+
+	std::unique_lock<std::mutex> lock(playout_mutex);
+	playout_frames = frames;
+	free_frames = frames;
+	playout_reader = reader;
+	playout_start = start_frame;
+	next_render = start_frame;
+	m_totalFramesScheduled = 0;
+	last_frame = NULL;
+	late_frames = 0;
+	dropped_frames = 0;
+	playout_stopping = false;
+	for (int worker = 0; worker < worker_count; worker++)
+		playout_workers.emplace_back(&DeckLinkOutputDelegate::playout_loop, this);
+
+	// Wait for the preroll frames, and schedule them
+	playout_condition.wait(lock, [&] {
+		for (int index = 0; index < preroll_frames; index++)
+			if (!ready_frames.count(start_frame + index))
+				return false;
+		return true;
+	});
+	for (int index = 0; index < preroll_frames; index++)
+		schedule_playout_frame();
+
+	openshot::ZmqLogger::Instance()->AppendDebugMethod("DeckLinkOutputDelegate::StartPlayout", "start_frame", start_frame, "preroll_frames", preroll_frames, "worker_count", worker_count, "width", width, "height", height);
+	deckLinkOutput->StartScheduledPlayback(0, frameRateScale, 1.0);
+}
+
+// Stop playing the reader
+void DeckLinkOutputDelegate::StopPlayout()
+{
+	{
+		std::lock_guard<std::mutex> lock(playout_mutex);
+		if (!playout_reader)
+			return;
+		playout_stopping = true;
+	}
+	playout_condition.notify_all();
+
+	// Flush the scheduled frames, and wait for the workers to finish their frames
+	deckLinkOutput->StopScheduledPlayback(0, NULL, 0);
+	for (std::thread& worker : playout_workers)
+		worker.join();
+	playout_workers.clear();
+
+	std::lock_guard<std::mutex> lock(playout_mutex);
+	for (IDeckLinkMutableVideoFrame *frame : playout_frames)
+		frame->Release();
+	playout_frames.clear();
+	free_frames.clear();
+	ready_frames.clear();
+	scheduled_counts.clear();
+	last_frame = NULL;
+	playout_reader = NULL;
+}
+
+// Get the number of frames which weren't done in time
+unsigned long DeckLinkOutputDelegate::LateFrames()
+{
+	std::lock_guard<std::mutex> lock(playout_mutex);
+	return late_frames;
+}
+
+// Get the number of dropped frames
+unsigned long DeckLinkOutputDelegate::DroppedFrames()
+{
+	std::lock_guard<std::mutex> lock(playout_mutex);
+	return dropped_frames;
+}
+
+// Render and convert frames, in order, while there are free frames
+void DeckLinkOutputDelegate::playout_loop()
+{
+	while (true)
+	{
+		IDeckLinkMutableVideoFrame *output = NULL;
+		int64_t number = 0;
+		{
+			std::unique_lock<std::mutex> lock(playout_mutex);
+			playout_condition.wait(lock, [&] { return playout_stopping || !free_frames.empty(); });
+			if (playout_stopping)
+				return;
+			output = free_frames.back();
+			free_frames.pop_back();
+
+			// Skip the frames the output has already passed (they were late)
+			next_render = max(next_render, playout_start + (int64_t) m_totalFramesScheduled);
+			number = next_render++;
+		}
+
+		std::shared_ptr<openshot::Frame> frame;
+		try
+		{
+			frame = playout_reader->GetFrame(number);
+			convert_frame(frame, output);
+		}
+		catch (const openshot::BaseException&)
+		{
+			openshot::ZmqLogger::Instance()->AppendDebugMethod("DeckLinkOutputDelegate::playout_loop (failed to render a frame)", "number", number);
+			frame.reset();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(playout_mutex);
+			if (frame && !playout_stopping && number >= playout_start + (int64_t) m_totalFramesScheduled)
+				ready_frames[number] = output;
+			else
+			{
+				// Done too late (the output was already past it)
+				if (frame && !playout_stopping)
+				{
+					dropped_frames++;
+					openshot::ZmqLogger::Instance()->AppendDebugMethod("DeckLinkOutputDelegate::playout_loop (dropped)", "number", number, "dropped_frames", dropped_frames);
+				}
+				free_frames.push_back(output);
+			}
+		}
+		playout_condition.notify_all();
+	}
+}
+
+// Convert the image of a frame to UYVY
+void DeckLinkOutputDelegate::convert_frame(std::shared_ptr<openshot::Frame> frame, IDeckLinkMutableVideoFrame *output)
+{
+	std::shared_ptr<QImage> image = frame->GetImage();
+	if (image->width() != width || image->height() != height)
+		image = std::make_shared<QImage>(image->scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+
+	// ARGB32 is BGRA in memory on little endian (other formats are converted)
+	bool bgra = false;
+	switch (image->format())
+	{
+		case QImage::Format_RGBA8888:
+		case QImage::Format_RGBA8888_Premultiplied:
+		case QImage::Format_RGBX8888:
+			break;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+		case QImage::Format_RGB32:
+			bgra = true;
+			break;
+#endif
+		default:
+			image = std::make_shared<QImage>(image->convertToFormat(QImage::Format_RGBA8888));
+			break;
+	}
+
+	void *bytes;
+	output->GetBytes(&bytes);
+	long row_bytes = output->GetRowBytes();
+	bool bt709 = height > 576;
+	for (int row = 0; row < height; row++)
+		openshot::PixelKernels::RGBAToUYVY((uint8_t*)bytes + row * row_bytes, image->constScanLine(row), width, bgra, bt709);
+}
+
+// Schedule the frame of the next stream time (or the last frame again, if it isn't done)
+void DeckLinkOutputDelegate::schedule_playout_frame()
+{
+	int64_t number = playout_start + m_totalFramesScheduled;
+	std::map<int64_t, IDeckLinkMutableVideoFrame*>::iterator found = ready_frames.find(number);
+	if (found != ready_frames.end())
+	{
+		// The previous frame is free, once the device is done with it
+		IDeckLinkMutableVideoFrame *previous = last_frame;
+		last_frame = found->second;
+		ready_frames.erase(found);
+		if (previous && !scheduled_counts.count(previous))
+			free_frames.push_back(previous);
+	}
+	else
+	{
+		late_frames++;
+		openshot::ZmqLogger::Instance()->AppendDebugMethod("DeckLinkOutputDelegate::schedule_playout_frame (late)", "number", number, "late_frames", late_frames);
+	}
+
+	if (last_frame)
+	{
+		scheduled_counts[last_frame]++;
+		if (deckLinkOutput->ScheduleVideoFrame(last_frame, (m_totalFramesScheduled * frameRateDuration), frameRateDuration, frameRateScale) != S_OK)
+		{
+			cout << "ScheduleVideoFrame FAILED!!! " << m_totalFramesScheduled << endl;
+			release_playout_frame(last_frame);
+		}
+	}
+
+	// Update the timestamp (regardless of the frame's success)
+	m_totalFramesScheduled += 1;
+	playout_condition.notify_all();
+}
+
+// Return a frame to the pool, once the device is done with it (the last frame is kept, to be shown again)
+void DeckLinkOutputDelegate::release_playout_frame(IDeckLinkVideoFrame *frame)
+{
+	std::map<IDeckLinkVideoFrame*, int>::iterator found = scheduled_counts.find(frame);
+	if (found == scheduled_counts.end() || --found->second > 0)
+		return;
+	scheduled_counts.erase(found);
+
+	for (IDeckLinkMutableVideoFrame *pooled : playout_frames)
+		if (pooled == frame && pooled != last_frame)
+		{
+			free_frames.push_back(pooled);
+			playout_condition.notify_all();
+		}
+}
@@ -146,6 +146,9 @@ DecklinkReader::DecklinkReader(int device, int video_mode, int pixel_format, int
 // destructor
 DecklinkReader::~DecklinkReader()
 {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+
 	if (displayModeIterator != NULL)
 	{
 		displayModeIterator->Release();
@@ -249,7 +252,7 @@ std::shared_ptr<Frame> DecklinkReader::GetFrame(int64_t requested_frame)
 std::string DecklinkReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -268,13 +271,7 @@ void DecklinkReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -195,6 +195,9 @@ void DecklinkWriter::Close()
 	// Close all objects, if reader is 'open'
 	if (is_open)
 	{
+		// Stop playing a reader (if any)
+		delegate->StopPlayout();
+
 		// Stop the audio and video output streams immediately
 		deckLinkOutput->StopScheduledPlayback(0, NULL, 0);
 		deckLinkOutput->DisableAudioOutput();
@@ -252,3 +255,32 @@ void DecklinkWriter::WriteFrame(ReaderBase* reader, int start, int length)
 		WriteFrame(f);
 	}
 }
+
+// Play the frames of a reader (rendering them as they play)
+void DecklinkWriter::StartPlayout(ReaderBase* reader, int64_t start_frame, int preroll_frames)
+{
+	// Check for open writer (or throw exception)
+	if (!is_open)
+		throw WriterClosed("The DecklinkWriter is closed.  Call Open() before calling this method.");
+
+	delegate->StartPlayout(reader, start_frame, preroll_frames);
+}
+
+// Stop playing the reader
+void DecklinkWriter::StopPlayout()
+{
+	if (is_open)
+		delegate->StopPlayout();
+}
+
+// Get the number of late frames of the playout
+unsigned long DecklinkWriter::LateFrames()
+{
+	return is_open ? delegate->LateFrames() : 0;
+}
+
+// Get the number of dropped frames of the playout
+unsigned long DecklinkWriter::DroppedFrames()
+{
+	return is_open ? delegate->DroppedFrames() : 0;
+}
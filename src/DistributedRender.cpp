@@ -0,0 +1,300 @@
+/**
+ * @file
+ * @brief Source file for RenderCoordinator and RenderWorker classes
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+#include "../include/DistributedRender.h"
+
+using namespace openshot;
+
+// Number of times a failed segment is sent to a worker
+static const int max_attempts = 3;
+
+// Send the parts of a multi-part message
+static void send_parts(zmq::socket_t &socket, const std::vector<std::string> &parts) {
+	for (size_t index = 0; index < parts.size(); index++) {
+		zmq::message_t part(parts[index].size());
+		memcpy(part.data(), parts[index].data(), parts[index].size());
+		socket.send(part, (index + 1 < parts.size()) ? ZMQ_SNDMORE : 0);
+	}
+}
+
+// Receive all parts of a multi-part message
+static std::vector<std::string> receive_parts(zmq::socket_t &socket) {
+	std::vector<std::string> parts;
+	bool more = true;
+	while (more) {
+		zmq::message_t part;
+		socket.recv(&part);
+		parts.push_back(std::string((const char *) part.data(), part.size()));
+		more = part.more();
+	}
+	return parts;
+}
+
+// Read a whole file (returns false if it can't be read)
+static bool read_file(std::string path, std::string &data) {
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file.good())
+		return false;
+	std::stringstream contents;
+	contents << file.rdbuf();
+	data = contents.str();
+	return true;
+}
+
+RenderCoordinator::RenderCoordinator(ParallelExporter *exporter, std::string endpoint) :
+		exporter(exporter), endpoint(endpoint), timeout(600), segments_done(0)
+{
+}
+
+// Send each segment to a worker, wait for all segments to be returned, and concatenate them
+void RenderCoordinator::Export()
+{
+	std::string exporter_json = exporter->Json();
+	int segment_count = exporter->GetSegmentCount();
+
+	// Queue the segments (empty segments, if there are more segments than frames, are already done)
+	std::deque<int> queued;
+	std::vector<bool> finished(segment_count, false);
+	std::vector<int> attempts(segment_count, 0);
+	std::map<int, std::chrono::steady_clock::time_point> assigned; // The time each rendering segment was sent
+	segments_done = 0;
+	int remaining = 0;
+	for (int index = 0; index < segment_count; index++) {
+		if (exporter->GetSegmentEnd(index) >= exporter->GetSegmentStart(index)) {
+			queued.push_back(index);
+			remaining++;
+		}
+		else
+			finished[index] = true;
+	}
+
+	zmq::context_t context(1);
+	zmq::socket_t socket(context, ZMQ_ROUTER);
+	int linger = 0;
+	socket.setsockopt(ZMQ_LINGER, linger);
+	socket.bind(endpoint.c_str());
+
+	ZmqLogger::Instance()->AppendDebugMethod("RenderCoordinator::Export", "segment_count", segment_count, "remaining", remaining);
+
+	while (remaining > 0) {
+		// Send the segments of workers which did not answer in time to another worker
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (std::map<int, std::chrono::steady_clock::time_point>::iterator itr = assigned.begin(); itr != assigned.end();) {
+			if (now - itr->second > std::chrono::seconds(timeout)) {
+				ZmqLogger::Instance()->AppendDebugMethod("RenderCoordinator::Export (segment timed out)", "index", itr->first);
+				queued.push_back(itr->first);
+				itr = assigned.erase(itr);
+			}
+			else
+				++itr;
+		}
+
+		// Wait for a request (checking the timeouts every second)
+		zmq::pollitem_t items[] = { { (void *) socket, 0, ZMQ_POLLIN, 0 } };
+		if (zmq::poll(items, 1, 1000) <= 0 || !(items[0].revents & ZMQ_POLLIN))
+			continue;
+
+		// A request is [worker identity][empty][JSON header][segment file (with a result)]
+		std::vector<std::string> parts = receive_parts(socket);
+		Json::Value request;
+		if (parts.size() < 3 || !ParseJson(parts[2], request))
+			continue;
+		std::string type = request["type"].asString();
+		int index = request["index"].asInt();
+
+		if (type == "result" && parts.size() >= 4 && index >= 0 && index < segment_count) {
+			// Save the segment (a segment which was sent twice is only saved once)
+			if (!finished[index]) {
+				std::ofstream segment(exporter->GetSegmentPath(index).c_str(), std::ios::binary);
+				segment.write(parts[3].data(), parts[3].size());
+				segment.close();
+				if (!segment)
+					throw InvalidFile("The segment could not be saved.", exporter->GetSegmentPath(index));
+				finished[index] = true;
+				segments_done++;
+				remaining--;
+			}
+			assigned.erase(index);
+		}
+		else if (type == "error" && index >= 0 && index < segment_count && !finished[index]) {
+			// Send the segment to another worker (unless it failed too often)
+			ZmqLogger::Instance()->AppendDebugMethod("RenderCoordinator::Export (segment failed)", "index", index, "attempts", attempts[index]);
+			assigned.erase(index);
+			if (attempts[index] >= max_attempts)
+				throw InvalidFile("The segment could not be rendered: " + request["message"].asString(), exporter->GetSegmentPath(index));
+			queued.push_back(index);
+		}
+
+		// Answer with the next segment, or ask the worker to wait (segments are still rendering), or to stop
+		Json::Value reply;
+		while (!queued.empty() && finished[queued.front()])
+			queued.pop_front();
+		if (!queued.empty()) {
+			int next = queued.front();
+			queued.pop_front();
+			attempts[next]++;
+			assigned[next] = std::chrono::steady_clock::now();
+			reply["type"] = "segment";
+			reply["index"] = next;
+		}
+		else if (remaining > 0)
+			reply["type"] = "wait";
+		else
+			reply["type"] = "done";
+
+		std::vector<std::string> answer;
+		answer.push_back(parts[0]);
+		answer.push_back("");
+		answer.push_back(WriteJson(reply));
+		if (reply["type"].asString() == "segment")
+			answer.push_back(exporter_json);
+		send_parts(socket, answer);
+	}
+
+	// Tell the waiting workers (which ask again every second) to stop
+	std::chrono::steady_clock::time_point drain_end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	while (std::chrono::steady_clock::now() < drain_end) {
+		zmq::pollitem_t items[] = { { (void *) socket, 0, ZMQ_POLLIN, 0 } };
+		if (zmq::poll(items, 1, 100) <= 0 || !(items[0].revents & ZMQ_POLLIN))
+			continue;
+		std::vector<std::string> parts = receive_parts(socket);
+		Json::Value reply;
+		reply["type"] = "done";
+		std::vector<std::string> answer;
+		answer.push_back(parts[0]);
+		answer.push_back("");
+		answer.push_back(WriteJson(reply));
+		send_parts(socket, answer);
+	}
+
+	socket.close();
+	exporter->ExportAudio();
+	exporter->Concatenate();
+}
+
+RenderWorker::RenderWorker(std::string endpoint, std::string work_path) :
+		endpoint(endpoint), work_path(work_path), timeout(60)
+{
+}
+
+// Render segments until the coordinator has none left, or stops answering
+int RenderWorker::Run()
+{
+	zmq::context_t context(1);
+	zmq::socket_t socket(context, ZMQ_REQ);
+	int linger = 0;
+	socket.setsockopt(ZMQ_LINGER, linger);
+	socket.connect(endpoint.c_str());
+
+	// A unique name for the segment files of this worker (several workers can share a work folder)
+	std::stringstream worker_name;
+	worker_name << "worker-" << std::hex << std::random_device()();
+
+	int rendered = 0;
+	std::vector<std::string> request;
+	Json::Value header;
+	header["type"] = "ready";
+	request.push_back(WriteJson(header));
+	while (true) {
+		send_parts(socket, request);
+
+		// Wait for the answer (the coordinator is gone, if it does not answer)
+		zmq::pollitem_t items[] = { { (void *) socket, 0, ZMQ_POLLIN, 0 } };
+		if (zmq::poll(items, 1, timeout * 1000L) <= 0 || !(items[0].revents & ZMQ_POLLIN)) {
+			ZmqLogger::Instance()->AppendDebugMethod("RenderWorker::Run (the coordinator did not answer)", "rendered", rendered);
+			break;
+		}
+		std::vector<std::string> parts = receive_parts(socket);
+		Json::Value reply;
+		if (parts.empty() || !ParseJson(parts[0], reply) || reply["type"].asString() == "done")
+			break;
+
+		header = Json::Value();
+		request.clear();
+		if (reply["type"].asString() != "segment" || parts.size() < 2) {
+			// Every segment is rendering (on other workers), so ask again in a moment
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			header["type"] = "ready";
+			request.push_back(WriteJson(header));
+			continue;
+		}
+
+		// Render the segment into the work folder (instead of next to the coordinator's output file)
+		int index = reply["index"].asInt();
+		header["index"] = index;
+		try {
+			Json::Value exporter_root;
+			if (!ParseJson(parts[1], exporter_root))
+				throw InvalidJSON("JSON could not be parsed (or is invalid)");
+			std::string output_path = exporter_root["path"].asString();
+			size_t extension = output_path.find_last_of('.');
+			size_t separator = output_path.find_last_of("/\\");
+			std::string segment_path = work_path + "/" + worker_name.str();
+			if (extension != std::string::npos && (separator == std::string::npos || extension > separator))
+				segment_path += output_path.substr(extension);
+			exporter_root["path"] = segment_path;
+
+			ParallelExporter exporter;
+			exporter.SetJsonValue(exporter_root);
+			ZmqLogger::Instance()->AppendDebugMethod("RenderWorker::Run (render segment)", "index", index);
+			exporter.ExportSegment(index);
+
+			std::string data;
+			bool has_data = read_file(exporter.GetSegmentPath(index), data);
+			std::remove(exporter.GetSegmentPath(index).c_str());
+			if (!has_data)
+				throw InvalidFile("The segment could not be read.", exporter.GetSegmentPath(index));
+
+			header["type"] = "result";
+			request.push_back(WriteJson(header));
+			request.push_back(data);
+			rendered++;
+		}
+		catch (const std::exception& e) {
+			header["type"] = "error";
+			header["message"] = e.what();
+			request.clear();
+			request.push_back(WriteJson(header));
+		}
+	}
+
+	socket.close();
+	return rendered;
+}
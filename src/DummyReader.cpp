@@ -75,6 +75,8 @@ DummyReader::DummyReader(Fraction fps, int width, int height, int sample_rate, i
 }
 
 DummyReader::~DummyReader() {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
 }
 
 // Open image file
@@ -127,7 +129,7 @@ std::shared_ptr<Frame> DummyReader::GetFrame(int64_t requested_frame)
 std::string DummyReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -146,13 +148,7 @@ void DummyReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -29,6 +29,11 @@
  */
 
 #include "../include/EffectBase.h"
+#include "../include/ColorLUT.h"
+#include "../include/Settings.h"
+
+#include <algorithm>
+#include <chrono>
 
 using namespace openshot;
 
@@ -61,6 +66,170 @@ void EffectBase::DisplayInfo() {
 	std::cout << "----------------------------" << std::endl;
 }
 
+// Apply pixel kernels (in order) to the image of a frame, in a single pass over its pixels
+void EffectBase::ApplyPixelKernels(const std::shared_ptr<Frame>& frame, const std::vector<PixelKernel>& kernels, const std::vector<bool>& color_kernels, QRect region)
+{
+	if (kernels.empty())
+		return;
+
+	// Kernels expect RGBA8888 pixels
+	frame->ConvertImage(QImage::Format_RGBA8888);
+	std::shared_ptr<QImage> image = frame->GetImage();
+	if (!image)
+		return;
+
+	// Get the part of the image to process
+	QRect area = image->rect();
+	if (!region.isNull())
+		area &= region;
+	if (area.isEmpty())
+		return;
+
+	// Bake each run of consecutive color kernels into a LUT (if enabled). A single color kernel is
+	// cheaper to run directly than a LUT, so only runs of 2 or more kernels are baked.
+	std::vector<PixelKernel> pass_kernels;
+	int lut_size = Settings::Instance()->EFFECT_LUT_SIZE;
+	for (size_t index = 0; index < kernels.size(); index++)
+	{
+		size_t run_end = index;
+		while (lut_size > 0 && run_end < color_kernels.size() && run_end < kernels.size() && color_kernels[run_end])
+			run_end++;
+
+		if (run_end - index >= 2) {
+			std::shared_ptr<ColorLUT> lut = std::make_shared<ColorLUT>(lut_size);
+			lut->Bake(std::vector<PixelKernel>(kernels.begin() + index, kernels.begin() + run_end));
+			pass_kernels.push_back([lut](unsigned char *pixels, int64_t pixel_count) {
+				lut->Apply(pixels, pixel_count);
+			});
+			index = run_end - 1;
+		}
+		else
+			pass_kernels.push_back(kernels[index]);
+	}
+
+	// Limit the kernels to the region (which is either all rows, or a segment of each row)
+	unsigned char *pixels = (unsigned char *) image->bits();
+	int bytes_per_line = image->bytesPerLine();
+	bool contiguous = area.width() == image->width() && bytes_per_line == image->width() * 4;
+	int segments = contiguous ? 1 : area.height();
+	int64_t segment_pixels = contiguous ? (int64_t) area.width() * area.height() : area.width();
+
+	// Run every kernel on each tile of 4096 pixels (16 KB), while it is still in the cache
+	const int64_t tile_size = 4096;
+	for (int segment = 0; segment < segments; segment++)
+	{
+		unsigned char *segment_start = pixels + (size_t) (area.top() + segment) * bytes_per_line + area.left() * 4;
+		for (int64_t start = 0; start < segment_pixels; start += tile_size)
+		{
+			int64_t count = std::min(tile_size, segment_pixels - start);
+			for (const PixelKernel &kernel : pass_kernels)
+				kernel(segment_start + start * 4, count);
+		}
+	}
+}
+
+// Apply the collected pixel kernels of some effects, and then clear them
+void EffectBase::FlushPixelKernels(const std::shared_ptr<Frame>& frame, std::vector<EffectBase*>& effects, std::vector<PixelKernel>& kernels,
+								   std::vector<bool>& color_kernels, QRect region)
+{
+	if (kernels.empty())
+		return;
+
+	// Get the number of pixels the kernels run on
+	QRect area(0, 0, frame->GetWidth(), frame->GetHeight());
+	if (!region.isNull())
+		area &= region;
+	int64_t pixels = area.isEmpty() ? 0 : (int64_t) area.width() * area.height();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ApplyPixelKernels(frame, kernels, color_kernels, region);
+	int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	// Split the time of the pass between the effects
+	for (EffectBase *effect : effects)
+		effect->AddTiming(nanoseconds / (int64_t) effects.size(), pixels);
+
+	effects.clear();
+	kernels.clear();
+	color_kernels.clear();
+}
+
+// Apply this effect to a frame, and time it
+std::shared_ptr<Frame> EffectBase::ProcessFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
+{
+	// The frame is moved into GetFrame (so the reference count is not changed on the way)
+	int64_t pixels = (int64_t) frame->GetWidth() * frame->GetHeight();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::shared_ptr<Frame> processed_frame = GetFrame(std::move(frame), frame_number);
+	AddTiming(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), pixels);
+	return processed_frame;
+}
+
+// Apply this effect to a batch of consecutive frames, and time it
+void EffectBase::ProcessFrames(std::vector<std::shared_ptr<Frame> >& frames, int64_t first_frame_number)
+{
+	int64_t pixels = 0;
+	for (std::shared_ptr<Frame> frame : frames)
+		pixels += (int64_t) frame->GetWidth() * frame->GetHeight();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GetFrames(frames, first_frame_number);
+	AddTiming(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), pixels);
+}
+
+// Process the audio of a frame as a block, and time it
+void EffectBase::ProcessAudio(std::shared_ptr<Frame> frame, int64_t frame_number)
+{
+	int channel_count = frame->GetAudioChannelsCount();
+	int sample_count = frame->GetAudioSamplesCount();
+	if (channel_count <= 0)
+		return;
+
+	std::vector<float*> channels(channel_count);
+	for (int channel = 0; channel < channel_count; channel++)
+		channels[channel] = frame->GetAudioSamples(channel);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ProcessAudioBlock(channels.data(), channel_count, sample_count, frame->SampleRate(), frame_number);
+	AddTiming(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), 0);
+}
+
+// Modify a batch of consecutive frames (one frame at a time, by default)
+void EffectBase::GetFrames(std::vector<std::shared_ptr<Frame> >& frames, int64_t first_frame_number)
+{
+	for (size_t index = 0; index < frames.size(); index++)
+		frames[index] = GetFrame(frames[index], first_frame_number + index);
+}
+
+// Add a call to the timing counters of this effect
+void EffectBase::AddTiming(int64_t nanoseconds, int64_t pixels)
+{
+	timing.calls++;
+	timing.nanoseconds += nanoseconds;
+	timing.pixels += pixels;
+}
+
+// Reset the timing counters of this effect
+void EffectBase::ResetTiming()
+{
+	timing = EffectTimingStruct();
+}
+
+// Generate a JSON object of the timing counters
+Json::Value EffectBase::TimingJsonValue()
+{
+	int64_t calls = timing.calls;
+	int64_t nanoseconds = timing.nanoseconds;
+
+	Json::Value root;
+	root["id"] = Id();
+	root["class_name"] = info.class_name;
+	root["calls"] = Json::Int64(calls);
+	root["total_ms"] = nanoseconds / 1000000.0;
+	root["average_ms"] = calls > 0 ? nanoseconds / 1000000.0 / calls : 0.0;
+	root["pixels"] = Json::Int64(timing.pixels.load());
+	return root;
+}
+
 // Constrain a color value from 0 to 255
 int EffectBase::constrain(int color_value)
 {
@@ -73,11 +242,37 @@ int EffectBase::constrain(int color_value)
 	return color_value;
 }
 
+// Get a key of what this effect does to an image at a frame number (the values of all its properties)
+std::string EffectBase::OutputKey(int64_t frame_number)
+{
+	// Parse the properties at this frame
+	Json::Value properties;
+	ParseJson(PropertiesJSON(frame_number), properties);
+
+	// Collect the values (and skip the UI details, such as the closest keyframe point)
+	Json::Value values(Json::objectValue);
+	std::vector<std::string> names = properties.getMemberNames();
+	for (const std::string &name : names) {
+		const Json::Value &property = properties[name];
+		if (!property.isObject())
+			continue;
+		values[name] = property["value"];
+
+		// Color properties have red, green, and blue values
+		std::vector<std::string> channel_names = property.getMemberNames();
+		for (const std::string &channel_name : channel_names)
+			if (property[channel_name].isObject() && property[channel_name].isMember("value"))
+				values[name + "." + channel_name] = property[channel_name]["value"];
+	}
+
+	return WriteJson(info.class_name + values);
+}
+
 // Generate JSON string of this object
 std::string EffectBase::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -102,13 +297,7 @@ void EffectBase::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -28,89 +28,135 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include "../include/EffectInfo.h"
 
 
 using namespace openshot;
 
+namespace {
+	// A registered effect (and its info JSON, once it's generated)
+	struct RegisteredEffect {
+		EffectFactory factory;
+		Json::Value info;
+		bool has_info;
+	};
+
+	template<class T> EffectBase* create_effect() { return new T(); }
+
+	// The registry of effects (by class name, so the info JSON is in the order of the names)
+	struct EffectRegistry {
+		std::mutex mutex;
+		std::map<std::string, RegisteredEffect> effects;
+		Json::Value info; ///< The info JSON of all effects (null, until it's generated)
+
+		// Register the effects of libopenshot
+		EffectRegistry() {
+			add("Bars", create_effect<Bars>);
+			add("Blur", create_effect<Blur>);
+			add("Brightness", create_effect<Brightness>);
+			add("ChromaKey", create_effect<ChromaKey>);
+			add("Color Shift", create_effect<ColorShift>);
+			add("Crop", create_effect<Crop>);
+			add("Deinterlace", create_effect<Deinterlace>);
+			add("Hue", create_effect<Hue>);
+			add("Mask", create_effect<Mask>);
+			add("Negate", create_effect<Negate>);
+			add("Pixelate", create_effect<Pixelate>);
+			add("Saturation", create_effect<Saturation>);
+			add("Shift", create_effect<Shift>);
+			add("Wave", create_effect<Wave>);
+		}
+
+		void add(std::string class_name, EffectFactory factory) {
+			RegisteredEffect effect;
+			effect.factory = factory;
+			effect.has_info = false;
+			effects[class_name] = effect;
+			info = Json::Value();
+		}
+	};
+
+	// Get the registry (created the first time it's used)
+	EffectRegistry& registry() {
+		static EffectRegistry instance;
+		return instance;
+	}
+}
 
 // Generate JSON string of this object
 std::string EffectInfo::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Create a new effect instance
 EffectBase* EffectInfo::CreateEffect(std::string effect_type) {
-	// Init the matching effect object
-	if (effect_type == "Bars")
-		return new Bars();
-
-	if (effect_type == "Blur")
-		return new Blur();
-
-	else if (effect_type == "Brightness")
-		return new Brightness();
-
-	else if (effect_type == "ChromaKey")
-		return new ChromaKey();
-
-	else if (effect_type == "Color Shift")
-		return new ColorShift();
-
-	else if (effect_type == "Crop")
-		return new Crop();
-
-	else if (effect_type == "Deinterlace")
-		return new Deinterlace();
-
-	else if (effect_type == "Hue")
-		return new Hue();
-
-	else if (effect_type == "Mask")
-		return new Mask();
-
-	else if (effect_type == "Negate")
-		return new Negate();
-
-	else if (effect_type == "Pixelate")
-		return new Pixelate();
+	EffectFactory factory = NULL;
+	{
+		EffectRegistry& reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		std::map<std::string, RegisteredEffect>::iterator effect = reg.effects.find(effect_type);
+		if (effect != reg.effects.end())
+			factory = effect->second.factory;
+	}
+
+	// Init the matching effect object (outside of the lock, since an effect may use the registry)
+	return factory ? factory() : NULL;
+}
 
-	else if (effect_type == "Saturation")
-		return new Saturation();
+// Register an effect
+void EffectInfo::RegisterEffect(std::string class_name, EffectFactory factory) {
+	if (!factory)
+		return;
+	EffectRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	reg.add(class_name, factory);
+}
 
-	else if (effect_type == "Shift")
-		return new Shift();
+// Remove an effect from the registry
+bool EffectInfo::UnregisterEffect(std::string class_name) {
+	EffectRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	if (!reg.effects.erase(class_name))
+		return false;
+	reg.info = Json::Value();
+	return true;
+}
 
-	else if (effect_type == "Wave")
-		return new Wave();
-	return NULL;
+// Is an effect registered
+bool EffectInfo::IsRegistered(std::string class_name) {
+	EffectRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	return reg.effects.count(class_name) > 0;
 }
 
 // Generate Json::JsonValue for this object
 Json::Value EffectInfo::JsonValue() {
-
-	// Create root json object
-	Json::Value root;
-
-	// Append info JSON from each supported effect
-	root.append(Bars().JsonInfo());
-	root.append(Blur().JsonInfo());
-	root.append(Brightness().JsonInfo());
-	root.append(ChromaKey().JsonInfo());
-	root.append(ColorShift().JsonInfo());
-	root.append(Crop().JsonInfo());
-	root.append(Deinterlace().JsonInfo());
-	root.append(Hue().JsonInfo());
-	root.append(Mask().JsonInfo());
-	root.append(Negate().JsonInfo());
-	root.append(Pixelate().JsonInfo());
-	root.append(Saturation().JsonInfo());
-	root.append(Shift().JsonInfo());
-	root.append(Wave().JsonInfo());
+	EffectRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	if (reg.info.isNull()) {
+		// Create root json object
+		Json::Value root(Json::arrayValue);
+
+		// Append info JSON from each registered effect (an effect is only created the first time)
+		for (std::map<std::string, RegisteredEffect>::iterator effect = reg.effects.begin(); effect != reg.effects.end(); ++effect) {
+			if (!effect->second.has_info) {
+				std::unique_ptr<EffectBase> instance(effect->second.factory());
+				if (instance)
+					effect->second.info = instance->JsonInfo();
+				effect->second.has_info = true;
+			}
+			if (!effect->second.info.isNull())
+				root.append(effect->second.info);
+		}
+		reg.info = root;
+	}
 
 	// return JsonValue
-	return root;
-
+	return reg.info;
 }
@@ -0,0 +1,256 @@
+/**
+ * @file
+ * @brief Source file for FFmpegDecoderPool class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include "../include/FFmpegDecoderPool.h"
+#include "../include/Settings.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Global reference to decoder pool
+FFmpegDecoderPool *FFmpegDecoderPool::m_pInstance = NULL;
+
+// Create or Get an instance of the decoder pool singleton
+FFmpegDecoderPool *FFmpegDecoderPool::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of decoder pool only once
+		m_pInstance = new FFmpegDecoderPool();
+
+	return m_pInstance;
+}
+
+// Take a parked decoder for a media file (returns false if none matches)
+bool FFmpegDecoderPool::Acquire(std::string path, FFmpegDecoderContexts& contexts)
+{
+	int hardware_decoder = Settings::Instance()->HARDWARE_DECODER;
+
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		for (std::list<FFmpegDecoderContexts>::iterator itr = entries.begin(); itr != entries.end(); ++itr) {
+			// A hardware decoder is only reused if its GPU is still one of the GPUs to decode with
+			if (itr->path == path && itr->hardware_decoder == hardware_decoder &&
+				(itr->hardware_device < 0 || is_device_used(itr->hardware_device))) {
+				contexts = *itr;
+				entries.erase(itr);
+				found = true;
+				break;
+			}
+		}
+	}
+	if (!found)
+		return false;
+
+	// Rewind the demuxer to the start of the file
+	int64_t start = (contexts.format_ctx->start_time != AV_NOPTS_VALUE) ? contexts.format_ctx->start_time : 0;
+	if (avformat_seek_file(contexts.format_ctx, -1, INT64_MIN, start, start, 0) < 0) {
+		// Can't rewind this file, so it must be opened again
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegDecoderPool::Acquire (Rewind failed)");
+		Free(contexts);
+		return false;
+	}
+
+	// Drop any frames still buffered in the decoders
+	if (contexts.video_ctx)
+		avcodec_flush_buffers(contexts.video_ctx);
+	if (contexts.audio_ctx)
+		avcodec_flush_buffers(contexts.audio_ctx);
+
+	return true;
+}
+
+// Park the decoder of a closed reader (or free it, if the pool is disabled)
+void FFmpegDecoderPool::Release(FFmpegDecoderContexts contexts)
+{
+	std::list<FFmpegDecoderContexts> expired;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		entries.push_front(contexts);
+		expired = trim(std::max(Settings::Instance()->DECODER_POOL_SIZE, 0));
+	}
+
+	// Free expired decoders (outside the lock, since closing a hardware decoder can be slow)
+	for (std::list<FFmpegDecoderContexts>::iterator itr = expired.begin(); itr != expired.end(); ++itr)
+		Free(*itr);
+}
+
+// Free all parked decoders
+void FFmpegDecoderPool::Clear()
+{
+	std::list<FFmpegDecoderContexts> expired;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		expired = trim(0);
+	}
+	for (std::list<FFmpegDecoderContexts>::iterator itr = expired.begin(); itr != expired.end(); ++itr)
+		Free(*itr);
+}
+
+// Get the number of parked decoders
+int FFmpegDecoderPool::Count()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	return entries.size();
+}
+
+// Start a hardware decoding session (on the least loaded GPU, or the next GPU)
+int FFmpegDecoderPool::AcquireDevice()
+{
+	while (true) {
+		int device = pick_device();
+		if (device >= 0)
+			return device;
+
+		// Every GPU is at its session limit, so free the oldest parked hardware decoder (if any)
+		FFmpegDecoderContexts expired;
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			for (std::list<FFmpegDecoderContexts>::reverse_iterator itr = entries.rbegin(); itr != entries.rend(); ++itr) {
+				if (itr->hardware_device >= 0) {
+					expired = *itr;
+					entries.erase(std::next(itr).base());
+					break;
+				}
+			}
+		}
+		if (expired.hardware_device < 0) {
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegDecoderPool::AcquireDevice (No GPU has room for another session)", "HW_DE_DEVICE_SESSIONS", Settings::Instance()->HW_DE_DEVICE_SESSIONS);
+			return -1;
+		}
+		Free(expired);
+	}
+}
+
+// End a hardware decoding session
+void FFmpegDecoderPool::ReleaseDevice(int device)
+{
+	std::lock_guard<std::mutex> lock(device_mutex);
+	std::map<int, int>::iterator itr = device_sessions.find(device);
+	if (itr != device_sessions.end() && --itr->second <= 0)
+		device_sessions.erase(itr);
+}
+
+// Get the number of hardware decoding sessions of a GPU
+int FFmpegDecoderPool::DeviceSessions(int device)
+{
+	std::lock_guard<std::mutex> lock(device_mutex);
+	std::map<int, int>::iterator itr = device_sessions.find(device);
+	return (itr != device_sessions.end()) ? itr->second : 0;
+}
+
+// Pick the GPU for a new session (or -1, if every GPU is at its session limit)
+int FFmpegDecoderPool::pick_device()
+{
+	int first = Settings::Instance()->HW_DE_DEVICE_SET;
+	int count = std::max(Settings::Instance()->HW_DE_DEVICE_COUNT, 1);
+	int limit = Settings::Instance()->HW_DE_DEVICE_SESSIONS;
+	bool by_load = !Settings::Instance()->HW_DE_DEVICE_ROUND_ROBIN;
+
+	std::lock_guard<std::mutex> lock(device_mutex);
+	int picked = -1;
+	for (int offset = 0; offset < count; offset++) {
+		// Try the GPUs in turn (starting after the last picked GPU), so equally loaded GPUs are used round-robin
+		int device = first + (next_device + offset) % count;
+		int sessions = device_sessions.count(device) ? device_sessions[device] : 0;
+		if (limit > 0 && sessions >= limit)
+			continue;
+		if (picked < 0 || (by_load && sessions < device_sessions[picked]))
+			picked = device;
+		if (!by_load)
+			break;
+	}
+	if (picked < 0)
+		return -1;
+
+	device_sessions[picked]++;
+	next_device = (picked - first + 1) % count;
+	return picked;
+}
+
+// Is a GPU one of the GPUs to decode with
+bool FFmpegDecoderPool::is_device_used(int device)
+{
+	int first = Settings::Instance()->HW_DE_DEVICE_SET;
+	int count = std::max(Settings::Instance()->HW_DE_DEVICE_COUNT, 1);
+	return device >= first && device < first + count;
+}
+
+// Remove the oldest entries until the pool holds no more than a number of entries (and return them)
+std::list<FFmpegDecoderContexts> FFmpegDecoderPool::trim(size_t max_entries)
+{
+	std::list<FFmpegDecoderContexts> expired;
+	while (entries.size() > max_entries) {
+		expired.push_back(entries.back());
+		entries.pop_back();
+	}
+	return expired;
+}
+
+// Free the contexts of a decoder
+void FFmpegDecoderPool::Free(FFmpegDecoderContexts& contexts)
+{
+	if (contexts.video_ctx) {
+		avcodec_flush_buffers(contexts.video_ctx);
+		AV_FREE_CONTEXT(contexts.video_ctx);
+		contexts.video_ctx = NULL;
+	}
+#if IS_FFMPEG_3_2
+	if (contexts.hw_device_ctx) {
+		av_buffer_unref(&contexts.hw_device_ctx);
+		contexts.hw_device_ctx = NULL;
+	}
+#endif
+	if (contexts.hardware_device >= 0) {
+		Instance()->ReleaseDevice(contexts.hardware_device);
+		contexts.hardware_device = -1;
+	}
+	if (contexts.audio_ctx) {
+		avcodec_flush_buffers(contexts.audio_ctx);
+		AV_FREE_CONTEXT(contexts.audio_ctx);
+		contexts.audio_ctx = NULL;
+	}
+	if (contexts.format_ctx) {
+		avformat_close_input(&contexts.format_ctx);
+		av_freep(&contexts.format_ctx);
+		contexts.format_ctx = NULL;
+	}
+
+	// The custom I/O is freed after its demuxer (which doesn't free it)
+	if (contexts.io) {
+		delete contexts.io;
+		contexts.io = NULL;
+	}
+}
@@ -0,0 +1,435 @@
+/**
+ * @file
+ * @brief Source file for FFmpegIO class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#include "../include/FFmpegIO.h"
+#include "../include/Metrics.h"
+#include "../include/Settings.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Size of the buffer of the AVIOContext (the demuxer reads this much at a time)
+#define FFMPEG_IO_BUFFER_SIZE 65536
+
+// Move a file handle to a 64-bit offset
+static bool seek_file(FILE *handle, int64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(handle, offset, SEEK_SET) == 0;
+#else
+	return fseeko(handle, offset, SEEK_SET) == 0;
+#endif
+}
+
+// Is a file on a local file system (a mapped file on a network share can fault, if the file changes on the server)
+static bool is_local_file(const std::string& path) {
+#ifdef __linux__
+	struct statfs fs;
+	if (statfs(path.c_str(), &fs) != 0)
+		return false;
+	switch ((unsigned long) fs.f_type) {
+		case 0x6969UL:		// NFS
+		case 0x517BUL:		// SMB
+		case 0xFF534D42UL:	// CIFS
+		case 0xFE534D42UL:	// SMB2
+		case 0x65735546UL:	// FUSE (i.e. sshfs, object storage mounts)
+			return false;
+		default:
+			return true;
+	}
+#else
+	return true;
+#endif
+}
+
+// Global reference to block cache
+FFmpegBlockCache *FFmpegBlockCache::m_pInstance = NULL;
+
+// Create or Get an instance of the block cache singleton
+FFmpegBlockCache *FFmpegBlockCache::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of block cache only once
+		m_pInstance = new FFmpegBlockCache();
+
+	return m_pInstance;
+}
+
+// Get a block of a file (or NULL, if it isn't cached)
+FFmpegIOBlock FFmpegBlockCache::Get(const std::string& file_key, int64_t index)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	std::map<BlockKey, std::list<Entry>::iterator>::iterator found = lookup.find(BlockKey(file_key, index));
+	if (found == lookup.end())
+		return FFmpegIOBlock();
+
+	// Mark the block as the most recently used
+	entries.splice(entries.begin(), entries, found->second);
+	return found->second->block;
+}
+
+// Is a block of a file cached
+bool FFmpegBlockCache::Contains(const std::string& file_key, int64_t index)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return lookup.count(BlockKey(file_key, index)) > 0;
+}
+
+// Add a block of a file
+void FFmpegBlockCache::Add(const std::string& file_key, int64_t index, FFmpegIOBlock block)
+{
+	static MemoryGauge& block_memory = Metrics::Instance()->GetMemory("io.blocks");
+	if (!block)
+		return;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	BlockKey key(file_key, index);
+	if (lookup.count(key))
+		return;
+
+	Entry entry;
+	entry.key = key;
+	entry.block = block;
+	entries.push_front(entry);
+	lookup[key] = entries.begin();
+	total_bytes += block->size();
+	block_memory.Add(block->size());
+
+	// Drop the least recently used blocks (the newest block is always kept)
+	int64_t max_bytes = int64_t(std::max(Settings::Instance()->IO_CACHE_SIZE, 0)) * 1024 * 1024;
+	while (total_bytes > max_bytes && entries.size() > 1) {
+		Entry &oldest = entries.back();
+		total_bytes -= oldest.block->size();
+		block_memory.Add(-int64_t(oldest.block->size()));
+		lookup.erase(oldest.key);
+		entries.pop_back();
+	}
+}
+
+// Remove all blocks
+void FFmpegBlockCache::Clear()
+{
+	static MemoryGauge& block_memory = Metrics::Instance()->GetMemory("io.blocks");
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	block_memory.Add(-total_bytes);
+	entries.clear();
+	lookup.clear();
+	total_bytes = 0;
+}
+
+// Get the bytes of all cached blocks
+int64_t FFmpegBlockCache::Bytes()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return total_bytes;
+}
+
+// Create the custom I/O of a media file (or NULL)
+FFmpegIO *FFmpegIO::Create(std::string path)
+{
+	Settings *s = Settings::Instance();
+	if (s->IO_READ_AHEAD <= 0 && !s->IO_MMAP)
+		return NULL;
+
+	// Only regular files are read (URLs, devices, and pipes are opened by FFmpeg)
+#ifdef _WIN32
+	struct _stat64 file_stat;
+	if (_stat64(path.c_str(), &file_stat) != 0 || !(file_stat.st_mode & _S_IFREG))
+		return NULL;
+#else
+	struct stat file_stat;
+	if (stat(path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+		return NULL;
+#endif
+	if (file_stat.st_size <= 0)
+		return NULL;
+
+	std::string file_key = path + "|" + std::to_string((long long) file_stat.st_size) + "|" + std::to_string((long long) file_stat.st_mtime);
+	FFmpegIO *io = new FFmpegIO(path, file_stat.st_size, file_key);
+	if (!io->avio_ctx || (!io->file && !io->mapping)) {
+		delete io;
+		return NULL;
+	}
+	return io;
+}
+
+// Constructor
+FFmpegIO::FFmpegIO(std::string path, int64_t file_size, std::string file_key) :
+	path(path), file_key(file_key), file_size(file_size), position(0), avio_ctx(NULL), file(NULL),
+	mapping(NULL), page_size(4096), read_ahead_next(0), read_ahead_end(0), loading_block(-1), read_ahead_stop(false)
+{
+	Settings *s = Settings::Instance();
+	block_size = std::max(s->IO_BLOCK_SIZE, FFMPEG_IO_BUFFER_SIZE);
+	read_ahead = std::max(s->IO_READ_AHEAD, 0);
+
+	// Blocks of another size are cached separately
+	this->file_key += "|" + std::to_string((long long) block_size);
+
+	// Map a local file (or read it in blocks)
+	if (!s->IO_MMAP || !is_local_file(path) || !map_file()) {
+		file = fopen(path.c_str(), "rb");
+		if (!file)
+			return;
+
+		// The read-ahead thread has its own file handle, so it never moves the position of the demuxer's reads
+		if (read_ahead > 0 && !s->DETERMINISTIC_RENDER)
+			read_ahead_thread = std::thread(&FFmpegIO::read_ahead_loop, this);
+	}
+
+	unsigned char *buffer = (unsigned char *) av_malloc(FFMPEG_IO_BUFFER_SIZE);
+	if (buffer) {
+		avio_ctx = avio_alloc_context(buffer, FFMPEG_IO_BUFFER_SIZE, 0, this, &FFmpegIO::read_callback, NULL, &FFmpegIO::seek_callback);
+		if (!avio_ctx)
+			av_free(buffer);
+	}
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegIO::FFmpegIO", "file_size", file_size, "block_size", block_size, "read_ahead", read_ahead, "is_mapped", mapping != NULL);
+}
+
+// Destructor
+FFmpegIO::~FFmpegIO()
+{
+	// Stop reading ahead
+	if (read_ahead_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(read_ahead_mutex);
+			read_ahead_stop = true;
+		}
+		read_ahead_condition.notify_all();
+		read_ahead_thread.join();
+	}
+
+	if (avio_ctx) {
+		av_freep(&avio_ctx->buffer);
+#if LIBAVFORMAT_VERSION_MAJOR >= 58
+		avio_context_free(&avio_ctx);
+#else
+		av_freep(&avio_ctx);
+#endif
+	}
+	if (file)
+		fclose(file);
+#ifndef _WIN32
+	if (mapping)
+		munmap((void *) mapping, file_size);
+#endif
+}
+
+// Memory map the file
+bool FFmpegIO::map_file()
+{
+#ifdef _WIN32
+	return false;
+#else
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+	void *address = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if (address == MAP_FAILED)
+		return false;
+
+	mapping = (const uint8_t *) address;
+	page_size = std::max(long(sysconf(_SC_PAGESIZE)), 1L);
+	return true;
+#endif
+}
+
+// Read a block from a file handle
+FFmpegIOBlock FFmpegIO::read_block(FILE *handle, int64_t index)
+{
+	int64_t offset = index * block_size;
+	int64_t size = std::min(block_size, file_size - offset);
+	if (size <= 0 || !seek_file(handle, offset))
+		return FFmpegIOBlock();
+
+	std::shared_ptr<std::vector<uint8_t> > block = std::make_shared<std::vector<uint8_t> >(size);
+	if (fread(block->data(), 1, size, handle) != size_t(size))
+		return FFmpegIOBlock();
+	return block;
+}
+
+// Get a block from the cache (or read it), and read ahead of it
+FFmpegIOBlock FFmpegIO::get_block(int64_t index)
+{
+	static Counter& block_hits = Metrics::Instance()->GetCounter("io.block_hits");
+	static Counter& block_misses = Metrics::Instance()->GetCounter("io.block_misses");
+	FFmpegBlockCache *cache = FFmpegBlockCache::Instance();
+
+	FFmpegIOBlock block = cache->Get(file_key, index);
+	if (!block && read_ahead_thread.joinable()) {
+		// Wait for the block, if the read-ahead thread is reading it now
+		std::unique_lock<std::mutex> lock(read_ahead_mutex);
+		loaded_condition.wait(lock, [&] { return loading_block != index; });
+		lock.unlock();
+		block = cache->Get(file_key, index);
+	}
+	if (block)
+		block_hits.Increment();
+	else {
+		block_misses.Increment();
+		block = read_block(file, index);
+		cache->Add(file_key, index, block);
+	}
+
+	// Read ahead of this block (a block outside of the previous window restarts the window, i.e. after a seek)
+	if (read_ahead_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(read_ahead_mutex);
+			int64_t block_count = (file_size + block_size - 1) / block_size;
+			if (index + 1 < read_ahead_next - read_ahead || index >= read_ahead_next)
+				read_ahead_next = index + 1;
+			read_ahead_end = std::min(block_count, index + 1 + read_ahead);
+		}
+		read_ahead_condition.notify_one();
+	}
+	return block;
+}
+
+// Read the blocks after the last read (on the background thread)
+void FFmpegIO::read_ahead_loop()
+{
+	static Counter& read_ahead_blocks = Metrics::Instance()->GetCounter("io.read_ahead_blocks");
+	FFmpegBlockCache *cache = FFmpegBlockCache::Instance();
+	FILE *handle = fopen(path.c_str(), "rb");
+	if (!handle)
+		return;
+
+	while (true) {
+		int64_t index = 0;
+		{
+			std::unique_lock<std::mutex> lock(read_ahead_mutex);
+			read_ahead_condition.wait(lock, [&] { return read_ahead_stop || read_ahead_next < read_ahead_end; });
+			if (read_ahead_stop)
+				break;
+			index = read_ahead_next++;
+			loading_block = index;
+		}
+
+		if (!cache->Contains(file_key, index)) {
+			cache->Add(file_key, index, read_block(handle, index));
+			read_ahead_blocks.Increment();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(read_ahead_mutex);
+			loading_block = -1;
+		}
+		loaded_condition.notify_all();
+	}
+	fclose(handle);
+}
+
+// Copy the bytes at the current position (and advance it)
+int FFmpegIO::read(uint8_t *buffer, int size)
+{
+	if (position >= file_size)
+		return AVERROR_EOF;
+	size = int(std::min(int64_t(size), file_size - position));
+
+	if (mapping) {
+		memcpy(buffer, mapping + position, size);
+
+		// Ask the kernel to read the next blocks in the background
+#ifndef _WIN32
+		if (read_ahead > 0) {
+			int64_t start = ((position + size) / page_size) * page_size;
+			int64_t length = std::min(int64_t(read_ahead) * block_size, file_size - start);
+			if (length > 0)
+				madvise((void *) (mapping + start), length, MADV_WILLNEED);
+		}
+#endif
+		position += size;
+		return size;
+	}
+
+	int copied = 0;
+	while (copied < size) {
+		int64_t index = position / block_size;
+		FFmpegIOBlock block = get_block(index);
+		if (!block)
+			break;
+		int64_t offset = position - index * block_size;
+		int64_t count = std::min(int64_t(size - copied), int64_t(block->size()) - offset);
+		if (count <= 0)
+			break;
+		memcpy(buffer + copied, block->data() + offset, count);
+		copied += count;
+		position += count;
+	}
+	return (copied > 0) ? copied : AVERROR(EIO);
+}
+
+// Move the current position (or get the size of the file)
+int64_t FFmpegIO::seek(int64_t offset, int whence)
+{
+	whence &= ~AVSEEK_FORCE;
+	if (whence == AVSEEK_SIZE)
+		return file_size;
+
+	int64_t target = -1;
+	if (whence == SEEK_SET)
+		target = offset;
+	else if (whence == SEEK_CUR)
+		target = position + offset;
+	else if (whence == SEEK_END)
+		target = file_size + offset;
+	if (target < 0)
+		return AVERROR(EINVAL);
+
+	position = target;
+	return position;
+}
+
+// The read callback of the AVIOContext
+int FFmpegIO::read_callback(void *opaque, uint8_t *buffer, int size)
+{
+	return static_cast<FFmpegIO *>(opaque)->read(buffer, size);
+}
+
+// The seek callback of the AVIOContext
+int64_t FFmpegIO::seek_callback(void *opaque, int64_t offset, int whence)
+{
+	return static_cast<FFmpegIO *>(opaque)->seek(offset, whence);
+}
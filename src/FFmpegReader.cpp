@@ -32,6 +32,19 @@
  */
 
 #include "../include/FFmpegReader.h"
+#include "../include/FFmpegDecoderPool.h"
+#include "../include/FFmpegScaler.h"
+#include "../include/ProxyManager.h"
+#include "../include/Trace.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 
 #define ENABLE_VAAPI 0
 
@@ -77,19 +90,82 @@ typedef struct VAAPIDecodeContext {
 
 using namespace openshot;
 
+// Is the calling thread inside the ReadStream critical section (so Close() doesn't wait for the reverse decode,
+// which may be waiting for that section)
+static thread_local bool is_reading_stream = false;
+
+// Marks the calling thread as inside the ReadStream critical section, while it exists
+struct ScopedReadStream {
+	bool previous;
+	ScopedReadStream() : previous(is_reading_stream) { is_reading_stream = true; }
+	~ScopedReadStream() { is_reading_stream = previous; }
+};
+
+// Sets a flag of the reader while it exists (and restores it, even if Open() or Close() throws)
+struct ScopedFlag {
+	bool &flag;
+	bool previous;
+	ScopedFlag(bool &flag, bool value) : flag(flag), previous(flag) { flag = value; }
+	~ScopedFlag() { flag = previous; }
+};
+
 int hw_de_on = 0;
 #if IS_FFMPEG_3_2
 	AVPixelFormat hw_de_av_pix_fmt_global = AV_PIX_FMT_NONE;
 	AVHWDeviceType hw_de_av_device_type_global = AV_HWDEVICE_TYPE_NONE;
 #endif
 
+// Free a decoded AVFrame (which owned the native planes of a frame)
+static void free_planes_frame(void *planes_frame) {
+	AVFrame *decoded_frame = (AVFrame *) planes_frame;
+	if (!decoded_frame->buf[0])
+		av_freep(&decoded_frame->data[0]);
+	AV_FREE_FRAME(&decoded_frame);
+}
+
+// Wrap a decoded AVFrame as the native planes of a frame (the planes own the AVFrame, and free it with the frame)
+static std::shared_ptr<FramePlanes> wrap_planes_frame(AVFrame *decoded_frame, PixelFormat pix_fmt, int width, int height) {
+	std::shared_ptr<FramePlanes> planes = std::make_shared<FramePlanes>();
+	planes->width = width;
+	planes->height = height;
+	planes->pixel_format = pix_fmt;
+	for (int plane = 0; plane < 4; plane++) {
+		planes->data[plane] = decoded_frame->data[plane];
+		planes->linesize[plane] = decoded_frame->linesize[plane];
+	}
+	planes->owner = std::shared_ptr<void>(decoded_frame, &free_planes_frame);
+	return planes;
+}
+
+// Convert (and resize) decoded planes to a RGB image, whose pixels are stored in a pooled buffer (or NULL, if it fails)
+static std::shared_ptr<QImage> convert_planes_image(const uint8_t *const src_data[], const int src_linesize[], int src_width, int src_height, int src_format,
+													 int width, int height, int dst_format, QImage::Format image_format, int flags) {
+	int bytes_per_line = width * (QImage::toPixelFormat(image_format).bitsPerPixel() / 8);
+	uint8_t *buffer = ImageBufferPool::Instance()->Acquire(bytes_per_line * height);
+	if (!buffer)
+		return std::shared_ptr<QImage>();
+
+	uint8_t *dst_data[4] = {buffer, NULL, NULL, NULL};
+	int dst_linesize[4] = {bytes_per_line, 0, 0, 0};
+	FFmpegScaler::Scale(src_data, src_linesize, src_width, src_height, src_format, dst_data, dst_linesize, width, height, dst_format, flags);
+
+	return std::make_shared<QImage>(buffer, width, height, bytes_per_line, image_format,
+									(QImageCleanupFunction) &ImageBufferPool::CleanUp, (void *) buffer);
+}
+
 FFmpegReader::FFmpegReader(std::string path)
 		: last_frame(0), is_seeking(0), seeking_pts(0), seeking_frame(0), seek_count(0),
 		  audio_pts_offset(99999), video_pts_offset(99999), path(path), is_video_seek(true), check_interlace(false),
 		  check_fps(false), enable_seek(true), is_open(false), seek_audio_frame_found(0), seek_video_frame_found(0),
 		  prev_samples(0), prev_pts(0), pts_total(0), pts_counter(0), is_duration_known(false), largest_frame_processed(0),
 		  current_video_frame(0), has_missing_frames(false), num_packets_since_video_frame(0), num_checks_since_final(0),
-		  packet(NULL) {
+		  packet(NULL), io(NULL), is_keyframe_index_built(false), is_probe_cached(false), reuse_decoder(true),
+		  is_demuxing(false), demux_stop(false), demux_finished(false), demux_status(0), max_queued_packets(0),
+		  audio_resample_ctx(NULL), frame_status(1024),
+		  reverse_last_frame(0), reverse_steps(0), reverse_start(0), reverse_generation(0), is_reverse_prefetching(false), decode_speed(0),
+		  video_enabled(true), audio_enabled(true),
+		  is_thumbnail_mode(false), thumbnail_lowres(0), thumbnail_keyframe_pts(-1),
+		  proxy_reader(NULL), proxy_failed(false), enable_proxy(true) {
 
 	// Initialize FFMpeg, and register all formats and codecs
 	AV_REGISTER_ALL
@@ -97,12 +173,16 @@ FFmpegReader::FFmpegReader(std::string path)
 
 	// Init cache
 	working_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * info.fps.ToDouble() * 2, info.width, info.height, info.sample_rate, info.channels);
-	missing_frames.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
 	final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+	working_cache.SetMemoryTag("cache.reader_working");
+	final_cache.SetMemoryTag("cache.reader_final");
 
-	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
-	Open();
-	Close();
+	// Open and Close the reader, to populate its attributes (such as height, width, etc...), unless
+	// they are found in the probe cache
+	if (!LoadProbeInfo()) {
+		Open();
+		Close();
+	}
 }
 
 FFmpegReader::FFmpegReader(std::string path, bool inspect_reader)
@@ -111,7 +191,13 @@ FFmpegReader::FFmpegReader(std::string path, bool inspect_reader)
 		  check_fps(false), enable_seek(true), is_open(false), seek_audio_frame_found(0), seek_video_frame_found(0),
 		  prev_samples(0), prev_pts(0), pts_total(0), pts_counter(0), is_duration_known(false), largest_frame_processed(0),
 		  current_video_frame(0), has_missing_frames(false), num_packets_since_video_frame(0), num_checks_since_final(0),
-		  packet(NULL) {
+		  packet(NULL), io(NULL), is_keyframe_index_built(false), is_probe_cached(false), reuse_decoder(true),
+		  is_demuxing(false), demux_stop(false), demux_finished(false), demux_status(0), max_queued_packets(0),
+		  audio_resample_ctx(NULL), frame_status(1024),
+		  reverse_last_frame(0), reverse_steps(0), reverse_start(0), reverse_generation(0), is_reverse_prefetching(false), decode_speed(0),
+		  video_enabled(true), audio_enabled(true),
+		  is_thumbnail_mode(false), thumbnail_lowres(0), thumbnail_keyframe_pts(-1),
+		  proxy_reader(NULL), proxy_failed(false), enable_proxy(true) {
 
 	// Initialize FFMpeg, and register all formats and codecs
 	AV_REGISTER_ALL
@@ -119,20 +205,27 @@ FFmpegReader::FFmpegReader(std::string path, bool inspect_reader)
 
 	// Init cache
 	working_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * info.fps.ToDouble() * 2, info.width, info.height, info.sample_rate, info.channels);
-	missing_frames.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
 	final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+	working_cache.SetMemoryTag("cache.reader_working");
+	final_cache.SetMemoryTag("cache.reader_final");
 
 	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
-	if (inspect_reader) {
+	if (inspect_reader && !LoadProbeInfo()) {
 		Open();
 		Close();
 	}
 }
 
 FFmpegReader::~FFmpegReader() {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+
 	if (is_open)
 		// Auto close reader if not already done
 		Close();
+
+	// Wait for the background decode of a reverse playback (if any)
+	stop_reverse_playback();
 }
 
 // This struct holds the associated video frame and starting sample # for an audio packet.
@@ -153,6 +246,35 @@ bool AudioLocation::is_near(AudioLocation location, int samples_per_frame, int64
 	return false;
 }
 
+// Constructor for the ring, which tracks up to <b>size</b> consecutive frames
+FrameStatusRing::FrameStatusRing(size_t size) : slots(std::max(size, (size_t) 1)) {
+	Clear();
+}
+
+// Get the status of a frame (or NULL, if the frame is not tracked)
+FrameStatus *FrameStatusRing::Find(int64_t number) {
+	if (number < 1)
+		return NULL;
+	FrameStatus &status = slots[number % slots.size()];
+	return (status.number == number) ? &status : NULL;
+}
+
+// Get the status of a frame, and start tracking it (if needed) in place of any older frame in its slot
+FrameStatus &FrameStatusRing::Track(int64_t number) {
+	FrameStatus &status = slots[std::max(number, (int64_t) 0) % slots.size()];
+	if (status.number != number) {
+		status = FrameStatus();
+		status.number = number;
+	}
+	return status;
+}
+
+// Forget all frames
+void FrameStatusRing::Clear() {
+	for (size_t index = 0; index < slots.size(); index++)
+		slots[index] = FrameStatus();
+}
+
 #if IS_FFMPEG_3_2
 
 // Get hardware pix format
@@ -236,15 +358,36 @@ int FFmpegReader::IsHardwareDecodeSupported(int codecid)
 void FFmpegReader::Open() {
 	// Open reader if not already open
 	if (!is_open) {
+		// Use the probe cache (if any), which skips the FPS check of a previously inspected file
+		if (!is_probe_cached && !check_fps)
+			LoadProbeInfo();
+
 		// Initialize format context
 		pFormatCtx = NULL;
 		{
-			hw_de_on = (openshot::Settings::Instance()->HARDWARE_DECODER == 0 ? 0 : 1);
+			hw_de_on = (openshot::Settings::Instance()->HARDWARE_DECODER == 0 || is_thumbnail_mode ? 0 : 1);
+		}
+
+		// Reuse a warm decoder for this file (if one was parked by a closed reader)
+		if (open_pooled_decoder()) {
+			finish_open();
+			return;
+		}
+
+		// Read the file with the custom I/O (if enabled), so the demuxer rarely waits for slow storage
+		io = FFmpegIO::Create(path);
+		if (io) {
+			pFormatCtx = avformat_alloc_context();
+			pFormatCtx->pb = io->Context();
+			pFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
 		}
 
 		// Open video file
-		if (avformat_open_input(&pFormatCtx, path.c_str(), NULL, NULL) != 0)
+		if (avformat_open_input(&pFormatCtx, path.c_str(), NULL, NULL) != 0) {
+			delete io;
+			io = NULL;
 			throw InvalidFile("File could not be opened.", path);
+		}
 
 		// Retrieve stream information
 		if (avformat_find_stream_info(pFormatCtx, NULL) < 0)
@@ -299,22 +442,35 @@ void FFmpegReader::Open() {
 					throw InvalidCodec("A valid video codec could not be found for this file.", path);
 				}
 
+				// Thumbnail mode only decodes keyframes (one at a time, at a reduced size if the codec supports it)
+				if (is_thumbnail_mode) {
+					pCodecCtx->skip_frame = AVDISCARD_NONKEY;
+					pCodecCtx->thread_type = FF_THREAD_SLICE;
+					pCodecCtx->lowres = std::min(thumbnail_lowres, (int) pCodec->max_lowres);
+				}
+
 				// Init options
 				av_dict_set(&opts, "strict", "experimental", 0);
 #if IS_FFMPEG_3_2
+				// Start a session on the GPU with room for it (or decode in software, when every GPU is full)
+				if (hw_de_on && hw_de_supported && hw_de_device < 0) {
+					hw_de_device = FFmpegDecoderPool::Instance()->AcquireDevice();
+					if (hw_de_device < 0)
+						hw_de_supported = 0;
+				}
 				if (hw_de_on && hw_de_supported) {
 					// Open Hardware Acceleration
 					int i_decoder_hw = 0;
 					char adapter[256];
 					char *adapter_ptr = NULL;
 					int adapter_num;
-					adapter_num = openshot::Settings::Instance()->HW_DE_DEVICE_SET;
+					adapter_num = hw_de_device;
 					fprintf(stderr, "Hardware decoding device number: %d\n", adapter_num);
 
 					// Set hardware pix format (callback)
 					pCodecCtx->get_format = get_hw_dec_format;
 
-					if (adapter_num < 3 && adapter_num >=0) {
+					if (adapter_num >=0) {
 #if defined(__linux__)
 						snprintf(adapter,sizeof(adapter),"/dev/dri/renderD%d", adapter_num+128);
 						adapter_ptr = adapter;
@@ -325,6 +481,8 @@ void FFmpegReader::Open() {
 									break;
 								case 2:
 									hw_de_av_device_type = AV_HWDEVICE_TYPE_CUDA;
+									// CUDA devices are selected by their index (not a render node)
+									snprintf(adapter,sizeof(adapter),"%d", adapter_num);
 									break;
 								case 6:
 									hw_de_av_device_type = AV_HWDEVICE_TYPE_VDPAU;
@@ -338,7 +496,9 @@ void FFmpegReader::Open() {
 							}
 
 #elif defined(_WIN32)
-						adapter_ptr = NULL;
+						// The adapters are selected by their index
+						snprintf(adapter,sizeof(adapter),"%d", adapter_num);
+						adapter_ptr = adapter;
 						i_decoder_hw = openshot::Settings::Instance()->HARDWARE_DECODER;
 						switch (i_decoder_hw) {
 							case 2:
@@ -379,7 +539,7 @@ void FFmpegReader::Open() {
 
 					// Check if it is there and writable
 #if defined(__linux__)
-					if( adapter_ptr != NULL && access( adapter_ptr, W_OK ) == 0 ) {
+					if( adapter_ptr != NULL && (hw_de_av_device_type == AV_HWDEVICE_TYPE_CUDA || access( adapter_ptr, W_OK ) == 0) ) {
 #elif defined(_WIN32)
 					if( adapter_ptr != NULL ) {
 #elif defined(__APPLE__)
@@ -427,6 +587,8 @@ void FFmpegReader::Open() {
 						*/
 					}
 					else {
+						  FFmpegDecoderPool::Instance()->ReleaseDevice(hw_de_device);
+						  hw_de_device = -1;
 						  throw InvalidCodec("Hardware device create failed.", path);
 					}
 				}
@@ -460,6 +622,8 @@ void FFmpegReader::Open() {
 								av_buffer_unref(&hw_device_ctx);
 								hw_device_ctx = NULL;
 							}
+							FFmpegDecoderPool::Instance()->ReleaseDevice(hw_de_device);
+							hw_de_device = -1;
 						}
 						else {
 							// All is just peachy
@@ -491,6 +655,8 @@ void FFmpegReader::Open() {
 								av_buffer_unref(&hw_device_ctx);
 								hw_device_ctx = NULL;
 							}
+							FFmpegDecoderPool::Instance()->ReleaseDevice(hw_de_device);
+							hw_de_device = -1;
 						}
 						else {
 							ZmqLogger::Instance()->AppendDebugMethod("\nDecode hardware acceleration is used\n", "Max Width :", max_w, "Max Height :", max_h, "Frame width :", pCodecCtx->coded_width, "Frame height :", pCodecCtx->coded_height);
@@ -549,83 +715,254 @@ void FFmpegReader::Open() {
 			UpdateAudioInfo();
 		}
 
-		// Add format metadata (if any)
-		AVDictionaryEntry *tag = NULL;
-		while ((tag = av_dict_get(pFormatCtx->metadata, "", tag, AV_DICT_IGNORE_SUFFIX))) {
-			QString str_key = tag->key;
-			QString str_value = tag->value;
-			info.metadata[str_key.toStdString()] = str_value.trimmed().toStdString();
+		finish_open();
+	}
+}
+
+// Reuse a warm decoder parked by a closed reader of the same file (returns false if none is parked)
+bool FFmpegReader::open_pooled_decoder() {
+	FFmpegDecoderContexts pooled;
+	if (!reuse_decoder || is_thumbnail_mode || !FFmpegDecoderPool::Instance()->Acquire(path, pooled))
+		return false;
+
+	pFormatCtx = pooled.format_ctx;
+	io = pooled.io;
+	pCodecCtx = pooled.video_ctx;
+	aCodecCtx = pooled.audio_ctx;
+#if IS_FFMPEG_3_2
+	hw_device_ctx = pooled.hw_device_ctx;
+#endif
+	hw_de_supported = pooled.hw_de_supported;
+	hw_de_device = pooled.hardware_device;
+	videoStream = pooled.video_stream;
+	audioStream = pooled.audio_stream;
+
+	// Update the File Info struct with the details of each stream (the codecs are already open)
+	if (videoStream != -1) {
+		info.video_stream_index = videoStream;
+		pStream = pFormatCtx->streams[videoStream];
+		UpdateVideoInfo();
+	}
+	if (audioStream != -1) {
+		info.audio_stream_index = audioStream;
+		aStream = pFormatCtx->streams[audioStream];
+		UpdateAudioInfo();
+	}
+	return true;
+}
+
+// Finish opening the reader (once the decoders are open)
+void FFmpegReader::finish_open() {
+	// Index the video keyframes (only on the first open of this file)
+	if (info.has_video && !is_keyframe_index_built && Settings::Instance()->KEYFRAME_INDEX)
+		BuildKeyframeIndex();
+
+	// Add format metadata (if any)
+	AVDictionaryEntry *tag = NULL;
+	while ((tag = av_dict_get(pFormatCtx->metadata, "", tag, AV_DICT_IGNORE_SUFFIX))) {
+		QString str_key = tag->key;
+		QString str_value = tag->value;
+		info.metadata[str_key.toStdString()] = str_value.trimmed().toStdString();
+	}
+
+	// Init previous audio location to zero
+	previous_packet_location.frame = -1;
+	previous_packet_location.sample_start = 0;
+
+	// Adjust cache size based on size of frame and audio
+	working_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * info.fps.ToDouble() * 2, info.width, info.height, info.sample_rate, info.channels);
+	final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+
+	// Mark as "open"
+	is_open = true;
+
+	// Save the inspected attributes (if not already cached)
+	if (!is_probe_cached)
+		SaveProbeInfo();
+
+	// Skip the packets of a disabled stream (after the keyframe index is built from the video packets)
+	apply_stream_discard();
+
+	// A pooled decoder may have the speed options of another reader
+	set_decoder_speed_options();
+}
+
+// Hint which streams are used, so the packets of an unused stream are discarded (and never decoded)
+void FFmpegReader::EnableStreams(bool video, bool audio) {
+	// Frames are numbered from the timestamps of a stream, so at least one stream is always decoded
+	if (!video && !audio) {
+		video = true;
+		audio = true;
+	}
+
+#pragma omp critical (ReadStream)
+	{
+		ScopedReadStream reading;
+		if (video != video_enabled || audio != audio_enabled) {
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::EnableStreams", "video", video, "audio", audio, "is_open", is_open);
+
+			// A stream which is enabled again has missed the packets already read, so the file is re-opened
+			// (which also clears the frames decoded without that stream)
+			bool reopen = is_open && ((video && !video_enabled) || (audio && !audio_enabled));
+			video_enabled = video;
+			audio_enabled = audio;
+
+			if (reopen) {
+				// The reversed frames are missing the stream too
+				reset_reverse_playback();
+
+				bool has_audio_override = info.has_audio;
+				bool has_video_override = info.has_video;
+				Close();
+				Open();
+
+				// Update overrides (since closing and re-opening might update these)
+				info.has_audio = has_audio_override;
+				info.has_video = has_video_override;
+			}
+			else if (is_open)
+				apply_stream_discard();
 		}
+	}
+}
+
+// Set the discard flag of each stream
+void FFmpegReader::apply_stream_discard() {
+	if (!is_open)
+		return;
+	if (videoStream != -1)
+		pFormatCtx->streams[videoStream]->discard = video_enabled ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+	if (audioStream != -1)
+		pFormatCtx->streams[audioStream]->discard = audio_enabled ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+}
 
-		// Init previous audio location to zero
-		previous_packet_location.frame = -1;
-		previous_packet_location.sample_start = 0;
+// Use the decoder speed options of a render
+void FFmpegReader::apply_decode_speed(int speed) {
+	speed = std::max(speed, 0);
+	if (speed == decode_speed)
+		return;
 
-		// Adjust cache size based on size of frame and audio
-		working_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * info.fps.ToDouble() * 2, info.width, info.height, info.sample_rate, info.channels);
-		missing_frames.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
-		final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::apply_decode_speed", "speed", speed, "decode_speed", decode_speed);
+	bool is_more_exact = speed < decode_speed;
+	decode_speed = speed;
+	set_decoder_speed_options();
 
-		// Mark as "open"
-		is_open = true;
+	// The frames decoded faster are decoded again
+	if (is_more_exact) {
+		final_cache.Clear();
+		reset_reverse_playback();
 	}
 }
 
+// Set the speed options of the video decoder
+void FFmpegReader::set_decoder_speed_options() {
+	if (!is_open || videoStream == -1 || !pCodecCtx)
+		return;
+
+	// The decoder reads these options for each frame (so they change without re-opening it)
+	int speed = decode_speed;
+	pCodecCtx->skip_loop_filter = (speed >= 1) ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+	pCodecCtx->skip_frame = (speed >= 2) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+#if (LIBAVCODEC_VERSION_MAJOR >= 57)
+	int fast_flag = AV_CODEC_FLAG2_FAST;
+#else
+	int fast_flag = CODEC_FLAG2_FAST;
+#endif
+	if (speed >= 2)
+		pCodecCtx->flags2 |= fast_flag;
+	else
+		pCodecCtx->flags2 &= ~fast_flag;
+}
+
 void FFmpegReader::Close() {
 	// Close all objects, if reader is 'open'
 	if (is_open) {
+		// Wait for the background decode of a reverse playback (unless this thread is decoding, i.e. a seek
+		// re-opens the file, and the background decode may be waiting for the decoder)
+		if (!is_reading_stream)
+			stop_reverse_playback();
+
 		// Mark as "closed"
 		is_open = false;
 
 		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::Close");
 
+		// Wait for any video packets still being processed
+		try {
+			video_tasks.Wait();
+		}
+		catch (...) {
+			// Ignore errors from unfinished packets (the reader is closing)
+		}
+
+		// Stop reading packets ahead
+		StopDemux();
+
 		if (packet) {
 			// Remove previous packet before getting next one
 			RemoveAVPacket(packet);
 			packet = NULL;
 		}
 
-		// Close the codec
-		if (info.has_video) {
-			avcodec_flush_buffers(pCodecCtx);
-			AV_FREE_CONTEXT(pCodecCtx);
+		// A parked demuxer reads all of its streams again (the next reader has its own stream hints)
+		for (unsigned int index = 0; index < pFormatCtx->nb_streams; index++)
+			pFormatCtx->streams[index]->discard = AVDISCARD_DEFAULT;
+
+		// Park the demuxer and codecs in the decoder pool (which frees them, if the pool is full or disabled).
+		// NOTE: The streams found by Open() are used, since info.has_audio / has_video can be overridden.
+		FFmpegDecoderContexts contexts;
+		contexts.path = path;
+		contexts.hardware_decoder = openshot::Settings::Instance()->HARDWARE_DECODER;
+		contexts.hardware_device = hw_de_device;
+		hw_de_device = -1;
+		contexts.format_ctx = pFormatCtx;
+		contexts.io = io;
+		contexts.video_ctx = (videoStream != -1) ? pCodecCtx : NULL;
+		contexts.audio_ctx = (audioStream != -1) ? aCodecCtx : NULL;
 #if IS_FFMPEG_3_2
-			if (hw_de_on) {
-				if (hw_device_ctx) {
-					av_buffer_unref(&hw_device_ctx);
-					hw_device_ctx = NULL;
-				}
-			}
+		contexts.hw_device_ctx = (videoStream != -1) ? hw_device_ctx : NULL;
+		hw_device_ctx = NULL;
 #endif
+		contexts.hw_de_supported = hw_de_supported;
+		contexts.video_stream = videoStream;
+		contexts.audio_stream = audioStream;
+		if (reuse_decoder && enable_seek && !is_thumbnail_mode)
+			FFmpegDecoderPool::Instance()->Release(contexts);
+		else
+			FFmpegDecoderPool::Free(contexts);
+		pFormatCtx = NULL;
+		io = NULL;
+		pCodecCtx = NULL;
+		aCodecCtx = NULL;
+
+		// Free the audio fast path's resample context
+		if (audio_resample_ctx) {
+			SWR_CLOSE(audio_resample_ctx);
+			SWR_FREE(&audio_resample_ctx);
+			audio_resample_ctx = NULL;
 		}
-		if (info.has_audio) {
-			avcodec_flush_buffers(aCodecCtx);
-			AV_FREE_CONTEXT(aCodecCtx);
+
+		// Close the proxy (it is opened again when needed)
+		{
+			std::lock_guard<std::mutex> lock(proxy_mutex);
+			if (proxy_reader) {
+				delete proxy_reader;
+				proxy_reader = NULL;
+			}
 		}
 
 		// Clear final cache
 		final_cache.Clear();
 		working_cache.Clear();
-		missing_frames.Clear();
 
 		// Clear processed lists
 		{
 			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
-			processed_video_frames.clear();
-			processed_audio_frames.clear();
 			processing_video_frames.clear();
 			processing_audio_frames.clear();
-			missing_audio_frames.clear();
-			missing_video_frames.clear();
-			missing_audio_frames_source.clear();
-			missing_video_frames_source.clear();
-			checked_frames.clear();
+			frame_status.Clear();
 		}
 
-		// Close the video file
-		avformat_close_input(&pFormatCtx);
-		av_freep(&pFormatCtx);
-
 		// Reset some variables
 		last_frame = 0;
 		largest_frame_processed = 0;
@@ -805,10 +1142,32 @@ void FFmpegReader::UpdateVideoInfo() {
 
 
 std::shared_ptr<Frame> FFmpegReader::GetFrame(int64_t requested_frame) {
+	return GetFrame(requested_frame, 0, 0);
+}
+
+std::shared_ptr<Frame> FFmpegReader::GetFrame(int64_t requested_frame, int width, int height) {
 	// Check for open reader (or throw exception)
 	if (!is_open)
 		throw ReaderClosed("The FFmpegReader is closed.  Call Open() before calling this method.", path);
 
+	// Read the low resolution proxy instead (while the preview is small enough)
+	std::shared_ptr<Frame> proxy_frame = GetProxyFrame(requested_frame, width, height);
+	if (proxy_frame)
+		return proxy_frame;
+
+	// Decode frames at the requested size (only smaller than the video, since sws_scale can't add detail)
+	if (width <= 0 || height <= 0 || width >= info.width || height >= info.height) {
+		width = 0;
+		height = 0;
+	}
+	{
+		// Drop a cached frame which is smaller than requested, so it is decoded again (at the larger size)
+		std::shared_ptr<Frame> cached_frame = (width > 0) ? final_cache.GetFrame(requested_frame) : std::shared_ptr<Frame>();
+		if (cached_frame && info.has_video && cached_frame->has_image_data &&
+			(cached_frame->GetWidth() < width || cached_frame->GetHeight() < height))
+			final_cache.Remove(requested_frame);
+	}
+
 	// Adjust for a requested frame that is too small or too large
 	if (requested_frame < 1)
 		requested_frame = 1;
@@ -821,8 +1180,23 @@ std::shared_ptr<Frame> FFmpegReader::GetFrame(int64_t requested_frame) {
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetFrame", "requested_frame", requested_frame, "last_frame", last_frame);
 
+	// Decode with the speed options of this render (an export decodes exactly, even if a preview was decoding faster)
+	int speed = RenderContext::Current().decode_speed;
+	if (speed != decode_speed && decode_video()) {
+#pragma omp critical (ReadStream)
+		{
+			ScopedReadStream reading;
+			apply_decode_speed(speed);
+		}
+	}
+
+	// Serve a reverse playback from the decoded GOPs (if the frames are requested backwards)
+	std::shared_ptr<Frame> frame = GetReverseFrame(requested_frame, width, height);
+	if (frame)
+		return frame;
+
 	// Check the cache for this frame
-	std::shared_ptr<Frame> frame = final_cache.GetFrame(requested_frame);
+	frame = final_cache.GetFrame(requested_frame);
 	if (frame) {
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetFrame", "returned cached frame", requested_frame);
@@ -832,51 +1206,317 @@ std::shared_ptr<Frame> FFmpegReader::GetFrame(int64_t requested_frame) {
 	} else {
 #pragma omp critical (ReadStream)
 		{
-			// Check the cache a 2nd time (due to a potential previous lock)
-			frame = final_cache.GetFrame(requested_frame);
-			if (frame) {
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetFrame", "returned cached frame on 2nd look", requested_frame);
+			ScopedReadStream reading;
+			frame = read_frame(requested_frame, width, height);
+		} //omp critical
+		return frame;
+	}
+}
 
-				// Return the cached frame
-			} else {
-				// Frame is not in cache
-				// Reset seek count
-				seek_count = 0;
-
-				// Check for first frame (always need to get frame 1 before other frames, to correctly calculate offsets)
-				if (last_frame == 0 && requested_frame != 1)
-					// Get first frame
-					ReadStream(1);
-
-				// Are we within X frames of the requested frame?
-				int64_t diff = requested_frame - last_frame;
-				if (diff >= 1 && diff <= 20) {
-					// Continue walking the stream
-					frame = ReadStream(requested_frame);
-				} else {
-					// Greater than 30 frames away, or backwards, we need to seek to the nearest key frame
-					if (enable_seek)
-						// Only seek if enabled
-						Seek(requested_frame);
-
-					else if (!enable_seek && diff < 0) {
-						// Start over, since we can't seek, and the requested frame is smaller than our position
-						Close();
-						Open();
-					}
+// Get a range of consecutive frames, decoded in a single pass of the stream
+std::vector<std::shared_ptr<Frame> > FFmpegReader::GetFrames(int64_t start, int64_t count) {
+	// Check for open reader (or throw exception)
+	if (!is_open)
+		throw ReaderClosed("The FFmpegReader is closed.  Call Open() before calling this method.", path);
 
-					// Then continue walking the stream
-					frame = ReadStream(requested_frame);
-				}
-			}
-		} //omp critical
+	// A preview read from the proxy is read a frame at a time (by the proxy)
+	if (count <= 1 || get_proxy())
+		return ReaderBase::GetFrames(start, count);
+
+	// The first frame is read as usual (which applies the decode speed, and the full size of the frames)
+	std::vector<std::shared_ptr<Frame> > frames;
+	frames.reserve(count);
+	frames.push_back(GetFrame(start));
+
+	// The other frames are read while holding the stream, so the stream is walked once (from the first frame)
+#pragma omp critical (ReadStream)
+	{
+		ScopedReadStream reading;
+		for (int64_t number = start + 1; number < start + count; number++) {
+			int64_t frame_number = std::max(number, int64_t(1));
+			if (is_duration_known)
+				frame_number = std::min(frame_number, info.video_length);
+			frames.push_back(read_frame(frame_number, 0, 0));
+		}
+	} //omp critical
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetFrames", "start", start, "count", count, "last_frame", last_frame);
+	return frames;
+}
+
+// Get a frame from the cache, or by walking (or seeking) the stream
+std::shared_ptr<Frame> FFmpegReader::read_frame(int64_t requested_frame, int width, int height) {
+	// Check the cache a 2nd time (due to a potential previous lock)
+	std::shared_ptr<Frame> frame = final_cache.GetFrame(requested_frame);
+	if (frame) {
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetFrame", "returned cached frame on 2nd look", requested_frame);
+
+		// Return the cached frame
 		return frame;
 	}
+
+	// Frame is not in cache
+	// Reset seek count
+	seek_count = 0;
+
+	// Thumbnail mode returns the nearest keyframe (without walking the stream)
+	if (is_thumbnail_mode && info.has_video)
+		return ReadThumbnail(requested_frame);
+
+	// Check for first frame (always need to get frame 1 before other frames, to correctly calculate offsets)
+	if (last_frame == 0 && requested_frame != 1)
+		// Get first frame
+		ReadStream(1, width, height);
+
+	// Are we within X frames of the requested frame?
+	int64_t diff = requested_frame - last_frame;
+	if (diff >= 1 && diff <= 20) {
+		// Continue walking the stream
+		return ReadStream(requested_frame, width, height);
+	}
+
+	// Greater than 30 frames away, or backwards, we need to seek to the nearest key frame
+	if (enable_seek)
+		// Only seek if enabled
+		Seek(requested_frame);
+
+	else if (!enable_seek && diff < 0) {
+		// Start over, since we can't seek, and the requested frame is smaller than our position
+		Close();
+		Open();
+	}
+
+	// Then continue walking the stream
+	return ReadStream(requested_frame, width, height);
+}
+
+// Get a frame of a reverse playback (or NULL, if the frames aren't requested backwards)
+std::shared_ptr<Frame> FFmpegReader::GetReverseFrame(int64_t requested_frame, int width, int height) {
+	int max_frames = Settings::Instance()->REVERSE_DECODE_FRAMES;
+	if (max_frames < 2 || !decode_video() || info.has_single_image || is_thumbnail_mode)
+		return std::shared_ptr<Frame>();
+	int64_t window = max_frames / 2;
+
+	std::shared_ptr<Frame> frame;
+	int64_t generation = 0;
+	{
+		std::lock_guard<std::mutex> lock(reverse_mutex);
+
+		// A request a few frames before the previous request continues a reverse playback (a faster reverse
+		// shuttle skips frames), and any other request ends it (a repeated request changes nothing)
+		int64_t step = reverse_last_frame - requested_frame;
+		if (step >= 1 && step <= 4)
+			reverse_steps++;
+		else if (step != 0) {
+			reverse_steps = 0;
+			if (!reverse_frames.empty() || reverse_start > 0) {
+				reverse_frames.clear();
+				reverse_start = 0;
+				reverse_generation++;
+			}
+		}
+		reverse_last_frame = requested_frame;
+		if (reverse_steps < 2)
+			return std::shared_ptr<Frame>();
+
+		// The frames after the requested frame have been played
+		reverse_frames.erase(reverse_frames.upper_bound(requested_frame), reverse_frames.end());
+		frame = find_reverse_frame(requested_frame, width, height);
+		generation = reverse_generation;
+	}
+
+	if (!frame) {
+		// Decode the frames before the requested frame (back to the keyframe of its GOP, if it fits the buffer),
+		// unless the background decode added the frame while this thread was waiting for the decoder
+		int64_t start = reverse_range_start(requested_frame, window);
+		bool is_decoded = false;
+#pragma omp critical (ReadStream)
+		{
+			ScopedReadStream reading;
+			{
+				std::lock_guard<std::mutex> lock(reverse_mutex);
+				is_decoded = find_reverse_frame(requested_frame, width, height) != NULL;
+			}
+			if (!is_decoded)
+				decode_reverse_range(start, requested_frame, generation, width, height);
+		}
+
+		std::lock_guard<std::mutex> lock(reverse_mutex);
+		frame = find_reverse_frame(requested_frame, width, height);
+		if (!frame)
+			return std::shared_ptr<Frame>();
+		if (!is_decoded)
+			reverse_start = start;
+	}
+
+	// Decode the next earlier GOP in the background, once the playback reaches the earliest decoded GOP
+	std::lock_guard<std::mutex> lock(reverse_mutex);
+	if (!is_reverse_prefetching && reverse_start > 1 && requested_frame - reverse_start < window &&
+		!Settings::Instance()->DETERMINISTIC_RENDER) {
+		int64_t end = reverse_start - 1;
+		int64_t start = reverse_range_start(end, window);
+		reverse_start = start;
+		is_reverse_prefetching = true;
+		if (reverse_thread.joinable())
+			reverse_thread.join();
+		reverse_thread = std::thread(&FFmpegReader::reverse_prefetch, this, start, end, generation, RenderContext::Current(), width, height);
+	}
+	return frame;
+}
+
+// Find a frame in the reverse buffer (with caller holding reverse_mutex), which is at least the requested size
+std::shared_ptr<Frame> FFmpegReader::find_reverse_frame(int64_t requested_frame, int width, int height) {
+	std::map<int64_t, std::shared_ptr<Frame> >::iterator found = reverse_frames.find(requested_frame);
+	if (found == reverse_frames.end())
+		return std::shared_ptr<Frame>();
+	if (width > 0 && found->second->has_image_data &&
+		(found->second->GetWidth() < width || found->second->GetHeight() < height))
+		return std::shared_ptr<Frame>();
+	return found->second;
+}
+
+// The first frame of the range decoded for a reverse playback, which ends at a frame
+int64_t FFmpegReader::reverse_range_start(int64_t end_frame, int64_t window) {
+	int64_t start = std::max(int64_t(1), end_frame - window + 1);
+
+	// Start the range at the keyframe of the GOP (when the GOP fits the window), so each GOP is decoded once
+	int64_t keyframe_pts = GetKeyframePTS(ConvertFrameToVideoPTS(end_frame - 1));
+	if (keyframe_pts >= 0 && video_pts_offset != 99999) {
+		int64_t keyframe = round(double(keyframe_pts + video_pts_offset) * info.video_timebase.ToDouble() * info.fps.ToDouble()) + 1;
+		if (keyframe > start && keyframe <= end_frame)
+			start = keyframe;
+	}
+	return start;
+}
+
+// Decode a range of frames into the reverse buffer (with the caller inside the ReadStream critical section)
+void FFmpegReader::decode_reverse_range(int64_t start, int64_t end, int64_t generation, int width, int height) {
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::decode_reverse_range", "start", start, "end", end);
+	int max_frames = std::max(Settings::Instance()->REVERSE_DECODE_FRAMES, 2);
+
+	// The frames are added once the range is decoded (unless the reverse playback ended meanwhile)
+	std::vector<std::shared_ptr<Frame> > frames;
+	for (int64_t number = start; number <= end && is_open; number++) {
+		{
+			std::lock_guard<std::mutex> lock(reverse_mutex);
+			if (generation != reverse_generation)
+				return;
+		}
+		std::shared_ptr<Frame> frame = read_frame(number, width, height);
+		if (frame)
+			frames.push_back(frame);
+	}
+
+	std::lock_guard<std::mutex> lock(reverse_mutex);
+	if (generation != reverse_generation)
+		return;
+	for (std::vector<std::shared_ptr<Frame> >::iterator itr = frames.begin(); itr != frames.end(); ++itr)
+		if ((*itr)->number <= reverse_last_frame)
+			reverse_frames[(*itr)->number] = *itr;
+
+	// Keep the frames nearest to the playback (the earliest frames are decoded again, if needed)
+	while (reverse_frames.size() > size_t(max_frames))
+		reverse_frames.erase(reverse_frames.begin());
+}
+
+// Decode an earlier range of a reverse playback (on the reverse thread)
+void FFmpegReader::reverse_prefetch(int64_t start, int64_t end, int64_t generation, RenderContext context, int width, int height) {
+	// Decode at the size of the playback's render
+	ScopedRenderContext render_context(context);
+
+#pragma omp critical (ReadStream)
+	{
+		ScopedReadStream reading;
+		try {
+			if (is_open)
+				decode_reverse_range(start, end, generation, width, height);
+		}
+		catch (...) {
+			// The frames are decoded again when they are requested
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::reverse_prefetch (failed)", "start", start, "end", end);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(reverse_mutex);
+	is_reverse_prefetching = false;
+}
+
+// End a reverse playback (a background decode still running skips the rest of its range)
+void FFmpegReader::reset_reverse_playback() {
+	std::lock_guard<std::mutex> lock(reverse_mutex);
+	reverse_frames.clear();
+	reverse_start = 0;
+	reverse_steps = 0;
+	reverse_last_frame = 0;
+	reverse_generation++;
+}
+
+// End a reverse playback, and wait for its background decode
+void FFmpegReader::stop_reverse_playback() {
+	reset_reverse_playback();
+	if (reverse_thread.joinable())
+		reverse_thread.join();
+}
+
+// Get the proxy of this file, when it is read instead of the original (or NULL)
+FFmpegReader *FFmpegReader::get_proxy() {
+	// Proxies are only read for small previews of videos (exports render at their full size)
+	Settings *s = Settings::Instance();
+	int max_height = RenderContext::Current().max_height;
+	if (!enable_proxy || s->PROXY_PATH.empty() || max_height <= 0 || max_height > s->PROXY_HEIGHT ||
+		!decode_video() || info.has_single_image || info.height <= s->PROXY_HEIGHT || is_thumbnail_mode)
+		return NULL;
+
+	FFmpegReader *proxy = NULL;
+	{
+		std::lock_guard<std::mutex> lock(proxy_mutex);
+		if (!proxy_reader && !proxy_failed) {
+			if (ProxyManager::Instance()->IsGenerating(path) || !ProxyManager::Instance()->HasProxy(path)) {
+				// Read the original until the proxy is generated (in the background)
+				ProxyManager::Instance()->Generate(path);
+				return NULL;
+			}
+
+			// Open the proxy (which must have the same frames as the original)
+			try {
+				proxy_reader = new FFmpegReader(ProxyManager::ProxyPath(path));
+				proxy_reader->enable_proxy = false;
+				proxy_reader->Open();
+				if (proxy_reader->info.fps.ToDouble() != info.fps.ToDouble() || std::abs(proxy_reader->info.video_length - info.video_length) > 1)
+					throw InvalidFile("The proxy does not match the original.", path);
+				ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetProxyFrame (Opened proxy)", "width", proxy_reader->info.width, "height", proxy_reader->info.height);
+			}
+			catch (const std::exception& e) {
+				ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetProxyFrame (Invalid proxy: " + std::string(e.what()) + ")");
+				delete proxy_reader;
+				proxy_reader = NULL;
+				proxy_failed = true;
+			}
+		}
+		proxy = proxy_reader;
+	}
+	return proxy;
+}
+
+// Get a frame from the proxy of this file (or NULL, if the original is read)
+std::shared_ptr<Frame> FFmpegReader::GetProxyFrame(int64_t requested_frame, int width, int height) {
+	FFmpegReader *proxy = get_proxy();
+	if (!proxy)
+		return std::shared_ptr<Frame>();
+
+	// The proxy has the same frame numbers (the last frame of the original is kept, if the proxy is a frame short)
+	return proxy->GetFrame(std::min(requested_frame, proxy->info.video_length), width, height);
 }
 
 // Read the stream until we find the requested Frame
-std::shared_ptr<Frame> FFmpegReader::ReadStream(int64_t requested_frame) {
+std::shared_ptr<Frame> FFmpegReader::ReadStream(int64_t requested_frame, int width, int height) {
+	TraceSpan trace_span("FFmpegReader::ReadStream", "decode", requested_frame);
+
+	// Audio-only files skip the video-oriented bookkeeping below
+	if (!decode_video() && decode_audio() && openshot::Settings::Instance()->AUDIO_FAST_PATH)
+		return ReadAudioStream(requested_frame);
+
 	// Allocate video frame
 	bool end_of_stream = false;
 	bool check_seek = false;
@@ -888,143 +1528,133 @@ std::shared_ptr<Frame> FFmpegReader::ReadStream(int64_t requested_frame) {
 	int minimum_packets = OPEN_MP_NUM_PROCESSORS;
 	int max_packets = 4096;
 
-	// Set the number of threads in OpenMP
-	omp_set_num_threads(OPEN_MP_NUM_PROCESSORS);
-	// Allow nested OpenMP sections
-	omp_set_nested(true);
-
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadStream", "requested_frame", requested_frame, "OPEN_MP_NUM_PROCESSORS", OPEN_MP_NUM_PROCESSORS);
 
-#pragma omp parallel
-	{
-#pragma omp single
-		{
-			// Loop through the stream until the correct frame is found
-			while (true) {
-				// Get the next packet into a local variable called packet
-				packet_error = GetNextPacket();
+	// Loop through the stream until the correct frame is found
+	while (true) {
+		// Get the next packet into a local variable called packet
+		packet_error = GetNextPacket();
 
-				int processing_video_frames_size = 0;
-				int processing_audio_frames_size = 0;
-				{
-					const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
-					processing_video_frames_size = processing_video_frames.size();
-					processing_audio_frames_size = processing_audio_frames.size();
-				}
+		int processing_video_frames_size = 0;
+		int processing_audio_frames_size = 0;
+		{
+			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
+			processing_video_frames_size = processing_video_frames.size();
+			processing_audio_frames_size = processing_audio_frames.size();
+		}
 
-				// Wait if too many frames are being processed
-				while (processing_video_frames_size + processing_audio_frames_size >= minimum_packets) {
-					usleep(2500);
-					const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
-					processing_video_frames_size = processing_video_frames.size();
-					processing_audio_frames_size = processing_audio_frames.size();
-				}
+		// Wait if too many frames are being processed
+		while (processing_video_frames_size + processing_audio_frames_size >= minimum_packets) {
+			usleep(2500);
+			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
+			processing_video_frames_size = processing_video_frames.size();
+			processing_audio_frames_size = processing_audio_frames.size();
+		}
 
-				// Get the next packet (if any)
-				if (packet_error < 0) {
-					// Break loop when no more packets found
-					end_of_stream = true;
-					break;
-				}
+		// Get the next packet (if any)
+		if (packet_error < 0) {
+			// Break loop when no more packets found
+			end_of_stream = true;
+			break;
+		}
 
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadStream (GetNextPacket)", "requested_frame", requested_frame, "processing_video_frames_size", processing_video_frames_size, "processing_audio_frames_size", processing_audio_frames_size, "minimum_packets", minimum_packets, "packets_processed", packets_processed, "is_seeking", is_seeking);
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadStream (GetNextPacket)", "requested_frame", requested_frame, "processing_video_frames_size", processing_video_frames_size, "processing_audio_frames_size", processing_audio_frames_size, "minimum_packets", minimum_packets, "packets_processed", packets_processed, "is_seeking", is_seeking);
 
-				// Video packet
-				if (info.has_video && packet->stream_index == videoStream) {
-					// Reset this counter, since we have a video packet
-					num_packets_since_video_frame = 0;
+		// Video packet
+		if (decode_video() && packet->stream_index == videoStream) {
+			// Reset this counter, since we have a video packet
+			num_packets_since_video_frame = 0;
 
-					// Check the status of a seek (if any)
-					if (is_seeking)
+			// Check the status of a seek (if any)
+			if (is_seeking)
 #pragma omp critical (openshot_seek)
-						check_seek = CheckSeek(true);
-					else
-						check_seek = false;
-
-					if (check_seek) {
-						// Jump to the next iteration of this loop
-						continue;
-					}
+				check_seek = CheckSeek(true);
+			else
+				check_seek = false;
 
-					// Packet may become NULL on Close inside Seek if CheckSeek returns false
-					if (!packet)
-						// Jump to the next iteration of this loop
-						continue;
+			if (check_seek) {
+				// Jump to the next iteration of this loop
+				continue;
+			}
 
-					// Get the AVFrame from the current packet
-					frame_finished = GetAVFrame();
+			// Packet may become NULL on Close inside Seek if CheckSeek returns false
+			if (!packet)
+				// Jump to the next iteration of this loop
+				continue;
 
-					// Check if the AVFrame is finished and set it
-					if (frame_finished) {
-						// Update PTS / Frame Offset (if any)
-						UpdatePTSOffset(true);
+			// Get the AVFrame from the current packet
+			frame_finished = GetAVFrame();
 
-						// Process Video Packet
-						ProcessVideoPacket(requested_frame);
+			// Check if the AVFrame is finished and set it
+			if (frame_finished) {
+				// Update PTS / Frame Offset (if any)
+				UpdatePTSOffset(true);
 
-						if (openshot::Settings::Instance()->WAIT_FOR_VIDEO_PROCESSING_TASK) {
-							// Wait on each OMP task to complete before moving on to the next one. This slows
-							// down processing considerably, but might be more stable on some systems.
-#pragma omp taskwait
-						}
-					}
+				// Process Video Packet
+				ProcessVideoPacket(requested_frame, width, height);
 
+				if (openshot::Settings::Instance()->WAIT_FOR_VIDEO_PROCESSING_TASK) {
+					// Wait on each task to complete before moving on to the next one. This slows
+					// down processing considerably, but might be more stable on some systems.
+					video_tasks.Wait();
 				}
-				// Audio packet
-				else if (info.has_audio && packet->stream_index == audioStream) {
-					// Increment this (to track # of packets since the last video packet)
-					num_packets_since_video_frame++;
+			}
 
-					// Check the status of a seek (if any)
-					if (is_seeking)
-#pragma omp critical (openshot_seek)
-						check_seek = CheckSeek(false);
-					else
-						check_seek = false;
+		}
+		// Audio packet
+		else if (decode_audio() && packet->stream_index == audioStream) {
+			// Increment this (to track # of packets since the last video packet)
+			num_packets_since_video_frame++;
 
-					if (check_seek) {
-						// Jump to the next iteration of this loop
-						continue;
-					}
+			// Check the status of a seek (if any)
+			if (is_seeking)
+#pragma omp critical (openshot_seek)
+				check_seek = CheckSeek(false);
+			else
+				check_seek = false;
 
-					// Packet may become NULL on Close inside Seek if CheckSeek returns false
-					if (!packet)
-						// Jump to the next iteration of this loop
-						continue;
+			if (check_seek) {
+				// Jump to the next iteration of this loop
+				continue;
+			}
 
-					// Update PTS / Frame Offset (if any)
-					UpdatePTSOffset(false);
+			// Packet may become NULL on Close inside Seek if CheckSeek returns false
+			if (!packet)
+				// Jump to the next iteration of this loop
+				continue;
 
-					// Determine related video frame and starting sample # from audio PTS
-					AudioLocation location = GetAudioPTSLocation(packet->pts);
+			// Update PTS / Frame Offset (if any)
+			UpdatePTSOffset(false);
 
-					// Process Audio Packet
-					ProcessAudioPacket(requested_frame, location.frame, location.sample_start);
-				}
+			// Determine related video frame and starting sample # from audio PTS
+			AudioLocation location = GetAudioPTSLocation(packet->pts);
 
-				// Check if working frames are 'finished'
-				if (!is_seeking) {
-					// Check for final frames
-					CheckWorkingFrames(false, requested_frame);
-				}
+			// Process Audio Packet
+			ProcessAudioPacket(requested_frame, location.frame, location.sample_start);
+		}
 
-				// Check if requested 'final' frame is available
-				bool is_cache_found = (final_cache.GetFrame(requested_frame) != NULL);
+		// Check if working frames are 'finished'
+		if (!is_seeking) {
+			// Check for final frames
+			CheckWorkingFrames(false, requested_frame);
+		}
 
-				// Increment frames processed
-				packets_processed++;
+		// Check if requested 'final' frame is available
+		bool is_cache_found = (final_cache.GetFrame(requested_frame) != NULL);
 
-				// Break once the frame is found
-				if ((is_cache_found && packets_processed >= minimum_packets) || packets_processed > max_packets)
-					break;
+		// Increment frames processed
+		packets_processed++;
 
-			} // end while
+		// Break once the frame is found
+		if ((is_cache_found && packets_processed >= minimum_packets) || packets_processed > max_packets)
+			break;
 
-		} // end omp single
+	} // end while
 
-	} // end omp parallel
+	// Wait for all video packets to finish processing
+	video_tasks.Wait();
 
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadStream (Completed)", "packets_processed", packets_processed, "end_of_stream", end_of_stream, "largest_frame_processed", largest_frame_processed, "Working Cache Count", working_cache.Count());
@@ -1056,10 +1686,310 @@ std::shared_ptr<Frame> FFmpegReader::ReadStream(int64_t requested_frame) {
 
 }
 
+// Read an audio-only stream until we find the requested Frame. Decoded samples are sliced directly into
+// frames, which are final as soon as they are full (no processing or missing frame tracking is needed).
+std::shared_ptr<Frame> FFmpegReader::ReadAudioStream(int64_t requested_frame) {
+	bool end_of_stream = false;
+	AVFrame *audio_frame = AV_ALLOCATE_FRAME();
+	AV_RESET_FRAME(audio_frame);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadAudioStream", "requested_frame", requested_frame, "last_frame", last_frame);
+
+	// Loop through the stream until the requested frame is final
+	while (!final_cache.GetFrame(requested_frame)) {
+		// Get the next packet (if any)
+		if (GetNextPacket() < 0) {
+			// Break loop when no more packets found
+			end_of_stream = true;
+			break;
+		}
+
+		// Skip packets of other streams
+		if (packet->stream_index != audioStream)
+			continue;
+
+		// Check the status of a seek (if any)
+		if (is_seeking) {
+			bool check_seek = false;
+#pragma omp critical (openshot_seek)
+			check_seek = CheckSeek(false);
+
+			// Packet may become NULL on Close inside Seek if CheckSeek returns false
+			if (check_seek || !packet)
+				continue;
+		}
+
+		// Determine the frame and starting sample # of this packet
+		UpdatePTSOffset(false);
+		AudioLocation location = GetAudioPTSLocation(packet->pts);
+
+		// Track 1st audio packet after a seek
+		if (is_seeking && !seek_audio_frame_found)
+			seek_audio_frame_found = location.frame;
+
+		// All frames before this packet are complete
+		FinishAudioFrames(requested_frame, location.frame);
+
+		// Are we close enough to decode the packet?
+		if (location.frame < (requested_frame - 20)) {
+			// Don't snap the next packet to this one (since its samples were not counted)
+			previous_packet_location.frame = -1;
+			continue;
+		}
+
+		// Decode the packet, and add its samples to frames
+#if IS_FFMPEG_3_2
+		if (avcodec_send_packet(aCodecCtx, packet) >= 0) {
+			while (avcodec_receive_frame(aCodecCtx, audio_frame) >= 0) {
+				AddAudioSamples(audio_frame, location);
+				av_frame_unref(audio_frame);
+			}
+		}
+#else
+		int frame_finished = 0;
+		if (avcodec_decode_audio4(aCodecCtx, audio_frame, &frame_finished, packet) >= 0 && frame_finished)
+			AddAudioSamples(audio_frame, location);
+#endif
+
+		// The next packet should start where this one ended
+		previous_packet_location = location;
+	}
+
+	// Free audio frame
+	AV_FREE_FRAME(&audio_frame);
+
+	// End of stream? Mark the last (partial) frames as final
+	if (end_of_stream)
+		FinishAudioFrames(requested_frame, largest_frame_processed + 1);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadAudioStream (Completed)", "requested_frame", requested_frame, "end_of_stream", end_of_stream, "largest_frame_processed", largest_frame_processed, "Working Cache Count", working_cache.Count());
+
+	// Return requested frame (if found)
+	std::shared_ptr<Frame> frame = final_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// Return the largest processed frame (assuming it was the last in the file)
+	frame = final_cache.GetFrame(largest_frame_processed);
+	if (frame)
+		return frame;
+
+	// The largest processed frame is no longer in cache, return a blank frame
+	std::shared_ptr<Frame> f = CreateFrame(largest_frame_processed);
+	f->AddColor(info.width, info.height, "#000");
+	return f;
+}
+
+// Add the samples of a decoded audio frame to the frames starting at a location (and advance the location)
+void FFmpegReader::AddAudioSamples(AVFrame *audio_frame, AudioLocation &location) {
+	// Setup the resample context once (decoded samples are converted to planar floats, like frames store them)
+	if (!audio_resample_ctx) {
+		audio_resample_ctx = SWR_ALLOC();
+		av_opt_set_int(audio_resample_ctx, "in_channel_layout", AV_GET_CODEC_ATTRIBUTES(aStream, aCodecCtx)->channel_layout, 0);
+		av_opt_set_int(audio_resample_ctx, "out_channel_layout", AV_GET_CODEC_ATTRIBUTES(aStream, aCodecCtx)->channel_layout, 0);
+		av_opt_set_int(audio_resample_ctx, "in_sample_fmt", AV_GET_SAMPLE_FORMAT(aStream, aCodecCtx), 0);
+		av_opt_set_int(audio_resample_ctx, "out_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
+		av_opt_set_int(audio_resample_ctx, "in_sample_rate", info.sample_rate, 0);
+		av_opt_set_int(audio_resample_ctx, "out_sample_rate", info.sample_rate, 0);
+		av_opt_set_int(audio_resample_ctx, "in_channels", info.channels, 0);
+		av_opt_set_int(audio_resample_ctx, "out_channels", info.channels, 0);
+		SWR_INIT(audio_resample_ctx);
+	}
+
+	// Convert audio samples
+	AVFrame *audio_converted = AV_ALLOCATE_FRAME();
+	AV_RESET_FRAME(audio_converted);
+	av_samples_alloc(audio_converted->data, audio_converted->linesize, info.channels, audio_frame->nb_samples, AV_SAMPLE_FMT_FLTP, 0);
+	int nb_samples = SWR_CONVERT(audio_resample_ctx, audio_converted->data, audio_converted->linesize[0], audio_frame->nb_samples,
+								 audio_frame->data, audio_frame->linesize[0], audio_frame->nb_samples);
+
+	// Slice the samples into frames
+	int position = 0;
+	while (position < nb_samples) {
+		// Get Samples per frame (for this frame number)
+		int samples_per_frame = Frame::GetSamplesPerFrame(location.frame, info.fps, info.sample_rate, info.channels);
+
+		// Calculate # of samples to add to this frame
+		int samples = std::min(samples_per_frame - location.sample_start, nb_samples - position);
+		if (samples > 0) {
+			// Add samples for each channel to the frame. Reduce the volume to 98% (like ProcessAudioPacket)
+			std::shared_ptr<Frame> f = CreateFrame(location.frame);
+			for (int channel = 0; channel < info.channels && channel < AV_NUM_DATA_POINTERS; channel++)
+				f->AddAudio(true, channel, location.sample_start, ((float *) audio_converted->data[channel]) + position, samples, 0.98f);
+
+			position += samples;
+			location.sample_start += samples;
+		}
+
+		// Move a full frame to the final cache
+		if (location.sample_start >= samples_per_frame) {
+			FinishAudioFrames(location.frame, location.frame + 1);
+			location.frame++;
+			location.sample_start = 0;
+		}
+	}
+
+	// Free AVFrames
+	av_free(audio_converted->data[0]);
+	AV_FREE_FRAME(&audio_converted);
+}
+
+// Move the audio frames before end_frame to the final cache (adding silent frames for gaps in the audio)
+void FFmpegReader::FinishAudioFrames(int64_t requested_frame, int64_t end_frame) {
+	while (true) {
+		// Get the front frame of working cache
+		std::shared_ptr<Frame> f(working_cache.GetSmallestFrame());
+		if (!f || f->number >= end_frame)
+			break;
+
+		// Move frame to final cache (unless it was partially filled in by a seek)
+		working_cache.Remove(f->number);
+		if (!IsPartialFrame(f->number)) {
+			final_cache.Add(f);
+			last_frame = f->number;
+		}
+	}
+
+	// Add silent frames for any gap in the audio (from the requested frame on)
+	for (int64_t number = std::max(last_frame + 1, requested_frame); number < end_frame; number++) {
+		if (IsPartialFrame(number) || final_cache.GetFrame(number))
+			continue;
+		final_cache.Add(CreateFrame(number));
+		working_cache.Remove(number);
+		last_frame = number;
+	}
+}
+
+// Decode the nearest keyframe at or before the requested frame (thumbnail mode)
+std::shared_ptr<Frame> FFmpegReader::ReadThumbnail(int64_t requested_frame) {
+	// Get the timestamp of the requested frame (the PTS offset is unknown, since frame 1 is never read)
+	int64_t seek_pts = round(double(requested_frame - 1) / info.fps.ToDouble() / info.video_timebase.ToDouble());
+	if (pStream->start_time != AV_NOPTS_VALUE)
+		seek_pts += pStream->start_time;
+
+	// Find the keyframe at or before this timestamp (if indexed)
+	int64_t keyframe_pts = GetKeyframePTS(seek_pts);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadThumbnail", "requested_frame", requested_frame, "seek_pts", seek_pts, "keyframe_pts", keyframe_pts, "thumbnail_keyframe_pts", thumbnail_keyframe_pts);
+
+	// Decode the keyframe (unless it was the last keyframe decoded)
+	if (!thumbnail_image || keyframe_pts < 0 || keyframe_pts != thumbnail_keyframe_pts) {
+		thumbnail_image.reset();
+		thumbnail_keyframe_pts = -1;
+
+		// Stop reading packets ahead, and seek to the keyframe
+		StopDemux();
+		if (av_seek_frame(pFormatCtx, videoStream, (keyframe_pts >= 0) ? keyframe_pts : seek_pts, AVSEEK_FLAG_BACKWARD) < 0)
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ReadThumbnail (seek failed)", "requested_frame", requested_frame, "seek_pts", seek_pts);
+		avcodec_flush_buffers(pCodecCtx);
+
+		// Decode the 1st keyframe packet (only keyframes are decoded, since skip_frame = AVDISCARD_NONKEY)
+		AVFrame *decoded_frame = AV_ALLOCATE_FRAME();
+		AV_RESET_FRAME(decoded_frame);
+		bool frame_finished = false;
+		int64_t decoded_pts = -1;
+		for (int packets = 0; !frame_finished && packets < 4096 && GetNextPacket() >= 0; packets++) {
+			if (packet->stream_index != videoStream || !(packet->flags & AV_PKT_FLAG_KEY))
+				continue;
+			decoded_pts = packet->pts;
+
+#if IS_FFMPEG_3_2
+			// Send the packet, and drain the decoder (so the frame is returned without waiting for more packets)
+			if (avcodec_send_packet(pCodecCtx, packet) >= 0) {
+				avcodec_send_packet(pCodecCtx, NULL);
+				frame_finished = (avcodec_receive_frame(pCodecCtx, decoded_frame) >= 0);
+			}
+			avcodec_flush_buffers(pCodecCtx);
+#else
+			int got_frame = 0;
+			avcodec_decode_video2(pCodecCtx, decoded_frame, &got_frame, packet);
+			frame_finished = got_frame;
+#endif
+		}
+
+		if (frame_finished) {
+			// Convert the image to RGBA (at the decoded size, which is reduced by the lowres factor)
+			int width = decoded_frame->width;
+			int height = decoded_frame->height;
+			uint8_t *buffer = ImageBufferPool::Instance()->Acquire(width * height * 4);
+			if (buffer) {
+				uint8_t *dst_data[4] = {buffer, NULL, NULL, NULL};
+				int dst_linesize[4] = {width * 4, 0, 0, 0};
+				FFmpegScaler::Scale(decoded_frame->data, decoded_frame->linesize, width, height, decoded_frame->format,
+									dst_data, dst_linesize, width, height, PIX_FMT_RGBA, SWS_FAST_BILINEAR);
+				thumbnail_image = std::make_shared<QImage>(buffer, width, height, width * 4, QImage::Format_RGBA8888,
+														   (QImageCleanupFunction) &ImageBufferPool::CleanUp, (void *) buffer);
+				thumbnail_keyframe_pts = (keyframe_pts >= 0) ? keyframe_pts : decoded_pts;
+			}
+		}
+
+		// Free decoded frame
+		AV_FREE_FRAME(&decoded_frame);
+	}
+
+	// Create the frame (with silent audio), which shares the keyframe image
+	std::shared_ptr<Frame> f = std::make_shared<Frame>(requested_frame, info.width, info.height, "#000000", Frame::GetSamplesPerFrame(requested_frame, info.fps, info.sample_rate, info.channels), info.channels);
+	f->SetPixelRatio(info.pixel_ratio.num, info.pixel_ratio.den);
+	f->ChannelsLayout(info.channel_layout);
+	f->SampleRate(info.sample_rate);
+	if (thumbnail_image)
+		f->AddImage(std::make_shared<QImage>(*thumbnail_image));
+	else
+		f->AddColor(info.width, info.height, "#000");
+
+	// Add to final cache
+	final_cache.Add(f);
+	return f;
+}
+
+// Enable or disable the thumbnail mode
+void FFmpegReader::ThumbnailMode(bool enabled, int lowres) {
+	bool was_open = is_open;
+	if (was_open)
+		Close();
+
+	is_thumbnail_mode = enabled;
+	thumbnail_lowres = std::max(lowres, 0);
+	thumbnail_keyframe_pts = -1;
+	thumbnail_image.reset();
+
+	if (was_open)
+		Open();
+}
+
 // Get the next packet (if any)
 int FFmpegReader::GetNextPacket() {
 	int found_packet = 0;
 	AVPacket *next_packet;
+
+	// Take the next packet read by the demux thread (if enabled, and not rendering deterministically)
+	if ((Settings::Instance()->PACKET_QUEUE_SIZE > 0 && !Settings::Instance()->DETERMINISTIC_RENDER) || is_demuxing) {
+		StartDemux();
+
+		std::unique_lock<std::mutex> lock(demux_mutex);
+		demux_condition.wait(lock, [this] { return !packet_queue.empty() || demux_finished; });
+		next_packet = NULL;
+		if (!packet_queue.empty()) {
+			next_packet = packet_queue.front();
+			packet_queue.pop_front();
+			demux_condition.notify_all();
+		} else {
+			found_packet = demux_status;
+		}
+		lock.unlock();
+
+		if (packet) {
+			// Remove previous packet before getting next one
+			RemoveAVPacket(packet);
+			packet = NULL;
+		}
+		packet = next_packet;
+		return found_packet;
+	}
+
 #pragma omp critical(getnextpacket)
 	{
 		next_packet = new AVPacket();
@@ -1083,6 +2013,68 @@ int FFmpegReader::GetNextPacket() {
 	return found_packet;
 }
 
+// Start the demux thread (if not already running)
+void FFmpegReader::StartDemux() {
+	if (is_demuxing)
+		return;
+
+	max_queued_packets = std::max(Settings::Instance()->PACKET_QUEUE_SIZE, 1);
+	demux_stop = false;
+	demux_finished = false;
+	demux_status = 0;
+	is_demuxing = true;
+	demux_thread = std::thread(&FFmpegReader::demux_loop, this);
+}
+
+// Stop the demux thread, and free any packets it has queued (before seeking or closing)
+void FFmpegReader::StopDemux() {
+	if (!is_demuxing)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(demux_mutex);
+		demux_stop = true;
+	}
+	demux_condition.notify_all();
+	demux_thread.join();
+
+	// Free unread packets
+	while (!packet_queue.empty()) {
+		RemoveAVPacket(packet_queue.front());
+		packet_queue.pop_front();
+	}
+	is_demuxing = false;
+}
+
+// The main loop of the demux thread
+void FFmpegReader::demux_loop() {
+	while (true) {
+		// Wait for room in the queue
+		{
+			std::unique_lock<std::mutex> lock(demux_mutex);
+			demux_condition.wait(lock, [this] { return demux_stop || packet_queue.size() < max_queued_packets; });
+			if (demux_stop)
+				break;
+		}
+
+		// Read the next packet (outside the lock, so the decoder can keep taking packets)
+		AVPacket *next_packet = new AVPacket();
+		int status = av_read_frame(pFormatCtx, next_packet);
+
+		std::lock_guard<std::mutex> lock(demux_mutex);
+		if (status < 0) {
+			// End of file (or error)
+			delete next_packet;
+			demux_status = status;
+			demux_finished = true;
+			demux_condition.notify_all();
+			break;
+		}
+		packet_queue.push_back(next_packet);
+		demux_condition.notify_all();
+	}
+}
+
 // Get an AVFrame (if any)
 bool FFmpegReader::GetAVFrame() {
 	int frameFinished = -1;
@@ -1122,6 +2114,35 @@ bool FFmpegReader::GetAVFrame() {
 				if (ret != 0) {
 					ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetAVFrame (invalid return frame received)");
 				}
+				if (hw_de_on && hw_de_supported && openshot::Settings::Instance()->HW_DE_ZERO_COPY &&
+					next_frame2->format == hw_de_av_pix_fmt) {
+					// Map the decoded surface into memory (or download it in its native format, if it can't be
+					// mapped), and let sws_scale convert it directly, instead of copying the whole image twice.
+					if (frameFinished == 0) {
+						AVFrame *sw_frame = AV_ALLOCATE_FRAME();
+						sw_frame->format = AV_PIX_FMT_NONE;
+						int err = -1;
+#if (LIBAVUTIL_VERSION_MAJOR >= 56)
+						err = av_hwframe_map(sw_frame, next_frame2, AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_DIRECT);
+#endif
+						if (err < 0) {
+							av_frame_unref(sw_frame);
+							sw_frame->format = AV_PIX_FMT_NONE;
+							if (av_hwframe_transfer_data(sw_frame, next_frame2, 0) < 0) {
+								ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetAVFrame (Failed to transfer data to output frame)");
+								AV_FREE_FRAME(&sw_frame);
+							}
+						}
+						if (sw_frame) {
+							av_frame_copy_props(sw_frame, next_frame2);
+							AV_FREE_FRAME(&pFrame);
+							pFrame = sw_frame;
+							frameFinished = 1;
+						}
+					}
+					av_frame_unref(next_frame2);
+					continue;
+				}
 				if (hw_de_on && hw_de_supported) {
 					int err;
 					if (next_frame2->format == hw_de_av_pix_fmt) {
@@ -1132,6 +2153,10 @@ bool FFmpegReader::GetAVFrame() {
 						if ((err = av_frame_copy_props(next_frame,next_frame2)) < 0) {
 							ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetAVFrame (Failed to copy props to output frame)");
 						}
+					} else {
+						// The decoder fell back to software for this frame (which is copied as it is)
+						av_frame_unref(next_frame);
+						av_frame_ref(next_frame, next_frame2);
 					}
 				}
 				else
@@ -1186,7 +2211,7 @@ bool FFmpegReader::CheckSeek(bool is_video) {
 			return false;
 
 		// Check for both streams
-		if ((info.has_video && !seek_video_frame_found) || (info.has_audio && !seek_audio_frame_found))
+		if ((decode_video() && !seek_video_frame_found) || (decode_audio() && !seek_audio_frame_found))
 			return false;
 
 		// Determine max seeked frame
@@ -1200,6 +2225,7 @@ bool FFmpegReader::CheckSeek(bool is_video) {
 			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckSeek (Too far, seek again)", "is_video_seek", is_video_seek, "max_seeked_frame", max_seeked_frame, "seeking_frame", seeking_frame, "seeking_pts", seeking_pts, "seek_video_frame_found", seek_video_frame_found, "seek_audio_frame_found", seek_audio_frame_found);
 
 			// Seek again... to the nearest Keyframe
+			seek_retry_counter.Increment();
 			Seek(seeking_frame - (10 * seek_count * seek_count));
 		} else {
 			// SEEK WORKED
@@ -1217,7 +2243,11 @@ bool FFmpegReader::CheckSeek(bool is_video) {
 }
 
 // Process a video packet
-void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
+void FFmpegReader::ProcessVideoPacket(int64_t requested_frame, int request_width, int request_height) {
+	TraceSpan trace_span("FFmpegReader::ProcessVideoPacket", "decode", requested_frame);
+	static MemoryGauge& decoder_memory = Metrics::Instance()->GetMemory("images.decoder");
+	ScopedMemoryTag memory_tag(decoder_memory);
+
 	// Calculate current frame #
 	int64_t current_frame = ConvertVideoPTStoFrame(GetVideoPTS());
 
@@ -1240,6 +2270,10 @@ void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ProcessVideoPacket (Before)", "requested_frame", requested_frame, "current_frame", current_frame);
 
+	// Count the decoded frames (for the decode rate of all readers)
+	static Counter& decoded_frames = Metrics::Instance()->GetCounter("decoder.video_frames");
+	decoded_frames.Increment();
+
 	// Init some things local (for OpenMP)
 	PixelFormat pix_fmt = AV_GET_CODEC_PIXEL_FORMAT(pStream, pCodecCtx);
 	int height = info.height;
@@ -1248,31 +2282,27 @@ void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
 	AVFrame *my_frame = pFrame;
 	pFrame = NULL;
 
+	// Frames mapped from a hardware surface keep their native pixel format (i.e. NV12)
+	if (my_frame && my_frame->buf[0] && my_frame->format != AV_PIX_FMT_NONE)
+		pix_fmt = (PixelFormat) my_frame->format;
+
 	// Add video frame to list of processing video frames
 	const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 	processing_video_frames[current_frame] = current_frame;
 
-#pragma omp task firstprivate(current_frame, my_frame, height, width, video_length, pix_fmt)
+	// Convert the frame on the shared task pool (at the size and quality of the render which requested it)
+	RenderContext render_context = RenderContext::Current();
+	video_tasks.Run([this, requested_frame, current_frame, my_frame, height, width, video_length, pix_fmt, request_width, request_height, render_context]() mutable
 	{
-		// Create variables for a RGB Frame (since most videos are not in RGB, we must convert it)
-		AVFrame *pFrameRGB = NULL;
-		int numBytes;
-		uint8_t *buffer = NULL;
-
-		// Allocate an AVFrame structure
-		pFrameRGB = AV_ALLOCATE_FRAME();
-		if (pFrameRGB == NULL)
-			throw OutOfBoundsFrame("Convert Image Broke!", current_frame, video_length);
-
 		// Determine the max size of this source image (based on the timeline's size, the scaling mode,
 		// and the scaling keyframes). This is a performance improvement, to keep the images as small as possible,
 		// without losing quality. NOTE: We cannot go smaller than the timeline itself, or the add_layer timeline
 		// method will scale it back to timeline size before scaling it smaller again. This needs to be fixed in
 		// the future.
-		int max_width = openshot::Settings::Instance()->MAX_WIDTH;
+		int max_width = render_context.max_width;
 		if (max_width <= 0)
 			max_width = info.width;
-		int max_height = openshot::Settings::Instance()->MAX_HEIGHT;
+		int max_height = render_context.max_height;
 		if (max_height <= 0)
 			max_height = info.height;
 
@@ -1311,7 +2341,12 @@ void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
 
 		// Determine if image needs to be scaled (for performance reasons)
 		int original_height = height;
-		if (max_width != 0 && max_height != 0 && max_width < width && max_height < height) {
+		if (request_width > 0 && request_height > 0) {
+			// Scale straight to the size requested by the caller (i.e. the size the timeline draws it at)
+			width = request_width;
+			height = request_height;
+		}
+		else if (max_width != 0 && max_height != 0 && max_width < width && max_height < height) {
 			// Override width and height (but maintain aspect ratio)
 			float ratio = float(width) / float(height);
 			int possible_width = round(max_height * ratio);
@@ -1328,31 +2363,70 @@ void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
 			}
 		}
 
-		// Determine required buffer size and allocate buffer
-		numBytes = AV_GET_IMAGE_SIZE(PIX_FMT_RGBA, width, height);
-
-#pragma omp critical (video_buffer)
-		buffer = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
-
-		// Copy picture data from one AVFrame (or AVPicture) to another one.
-		AV_COPY_PICTURE_DATA(pFrameRGB, buffer, PIX_FMT_RGBA, width, height);
+		// Determine the output pixel format. Premultiplied frames use native ARGB32 (which needs no conversion
+		// when the source has no alpha channel, since opaque pixels are the same premultiplied or not)
+		PixelFormat output_pix_fmt = PIX_FMT_RGBA;
+		QImage::Format output_image_format = QImage::Format_RGBA8888;
+		if (Frame::ImageFormat() == QImage::Format_ARGB32_Premultiplied) {
+			const AVPixFmtDescriptor *source_pix_desc = av_pix_fmt_desc_get(pix_fmt);
+			output_pix_fmt = PIX_FMT_RGB32;
+			if (source_pix_desc && !(source_pix_desc->flags & AV_PIX_FMT_FLAG_ALPHA))
+				output_image_format = QImage::Format_ARGB32_Premultiplied;
+			else
+				output_image_format = QImage::Format_ARGB32;
+		}
+#ifdef USE_RGBA64_IMAGES
+		if (Frame::ImageFormat() == QImage::Format_RGBA64) {
+			// 16 bits per channel (so 10-bit and 12-bit sources are not truncated)
+			output_pix_fmt = AV_PIX_FMT_RGBA64;
+			output_image_format = QImage::Format_RGBA64;
+		}
+#endif
 
 		int scale_mode = SWS_FAST_BILINEAR;
-		if (openshot::Settings::Instance()->HIGH_QUALITY_SCALING) {
+		if (render_context.high_quality_scaling) {
 			scale_mode = SWS_BICUBIC;
 		}
-		SwsContext *img_convert_ctx = sws_getContext(info.width, info.height, AV_GET_CODEC_PIXEL_FORMAT(pStream, pCodecCtx), width,
-															  height, PIX_FMT_RGBA, scale_mode, NULL, NULL, NULL);
-
-		// Resize / Convert to RGB
-		sws_scale(img_convert_ctx, my_frame->data, my_frame->linesize, 0,
-				  original_height, pFrameRGB->data, pFrameRGB->linesize);
 
 		// Create or get the existing frame object
 		std::shared_ptr<Frame> f = CreateFrame(current_frame);
+		bool keep_planes = openshot::Settings::Instance()->NATIVE_FRAME_PLANES || openshot::Settings::Instance()->YUV_COMPOSITING;
+
+		if (openshot::Settings::Instance()->LAZY_FRAME_IMAGES && my_frame && !my_frame->buf[0]) {
+			// Defer the conversion to RGB until the image is first needed (the decoded planes are kept until then),
+			// so audio-only consumers, hidden layers, and writers which encode the native planes never pay for it
+			std::shared_ptr<FramePlanes> source_planes = wrap_planes_frame(my_frame, pix_fmt, info.width, info.height);
+			my_frame = NULL;
+			f->SetImageLoader(width, height, [source_planes, original_height, width, height, output_pix_fmt, output_image_format, scale_mode, keep_planes](Frame *frame)
+			{
+				std::shared_ptr<QImage> image = convert_planes_image(source_planes->data, source_planes->linesize, source_planes->width, original_height,
+																	 source_planes->pixel_format, width, height, output_pix_fmt, output_image_format, scale_mode);
+				frame->AddImage(image);
+				if (keep_planes)
+					frame->AddPlanes(source_planes);
+			}, keep_planes ? source_planes : std::shared_ptr<FramePlanes>());
 
-		// Add Image data to frame
-		f->AddImage(width, height, 4, QImage::Format_RGBA8888, buffer);
+		} else {
+			// Resize / Convert to RGB (the image owns a pooled buffer, and returns it to the pool when it is freed)
+			std::shared_ptr<QImage> image = convert_planes_image(my_frame->data, my_frame->linesize, info.width, original_height,
+																 pix_fmt, width, height, output_pix_fmt, output_image_format, scale_mode);
+
+			// Release a mapped hardware surface as soon as it is converted, so the decoder can reuse it
+			if (my_frame->buf[0]) {
+				RemoveAVFrame(my_frame);
+				my_frame = NULL;
+			}
+			if (!image)
+				throw OutOfBoundsFrame("Convert Image Broke!", current_frame, video_length);
+			f->AddImage(image);
+
+			// Keep the decoded planes with the frame (so a writer can encode them directly, if the image is unchanged).
+			// Mapped hardware surfaces are not kept (released above), since cached frames would hold on to the decoder's surfaces.
+			if (keep_planes && my_frame) {
+				f->AddPlanes(wrap_planes_frame(my_frame, pix_fmt, info.width, info.height));
+				my_frame = NULL;
+			}
+		}
 
 		// Update working cache
 		working_cache.Add(f);
@@ -1361,25 +2435,20 @@ void FFmpegReader::ProcessVideoPacket(int64_t requested_frame) {
 #pragma omp critical (video_buffer)
 		last_video_frame = f;
 
-		// Free the RGB image
-		av_free(buffer);
-		AV_FREE_FRAME(&pFrameRGB);
-
 		// Remove frame and packet
 		RemoveAVFrame(my_frame);
-		sws_freeContext(img_convert_ctx);
 
 		// Remove video frame from list of processing video frames
 		{
 			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 			processing_video_frames.erase(current_frame);
-			processed_video_frames[current_frame] = current_frame;
+			frame_status.Track(current_frame).is_video_processed = true;
 		}
 
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ProcessVideoPacket (After)", "requested_frame", requested_frame, "current_frame", current_frame, "f->number", f->number);
 
-	} // end omp task
+	}); // end task
 
 }
 
@@ -1664,7 +2733,7 @@ void FFmpegReader::ProcessAudioPacket(int64_t requested_frame, int64_t target_fr
 			// Check and see if this frame is also being processed by another thread
 			if (processing_audio_frames.count(f) == 0)
 				// No other thread is processing it. Mark the audio as processed (final)
-				processed_audio_frames[f] = f;
+				frame_status.Track(f).is_audio_processed = true;
 		}
 
 		if (target_frame == starting_frame_number) {
@@ -1684,6 +2753,8 @@ void FFmpegReader::ProcessAudioPacket(int64_t requested_frame, int64_t target_fr
 
 // Seek to a specific frame.  This is not always frame accurate, it's more of an estimation on many codecs.
 void FFmpegReader::Seek(int64_t requested_frame) {
+	TraceSpan trace_span("FFmpegReader::Seek", "seek", requested_frame);
+
 	// Adjust for a requested frame that is too small or too large
 	if (requested_frame < 1)
 		requested_frame = 1;
@@ -1709,22 +2780,18 @@ void FFmpegReader::Seek(int64_t requested_frame) {
 		processing_audio_frames_size = processing_audio_frames.size();
 	}
 
+	// Stop reading packets ahead (the demuxer is about to move)
+	StopDemux();
+
 	// Clear working cache (since we are seeking to another location in the file)
 	working_cache.Clear();
-	missing_frames.Clear();
 
 	// Clear processed lists
 	{
 		const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 		processing_audio_frames.clear();
 		processing_video_frames.clear();
-		processed_video_frames.clear();
-		processed_audio_frames.clear();
-		missing_audio_frames.clear();
-		missing_video_frames.clear();
-		missing_audio_frames_source.clear();
-		missing_video_frames_source.clear();
-		checked_frames.clear();
+		frame_status.Clear();
 	}
 
 	// Reset the last frame variable
@@ -1739,13 +2806,18 @@ void FFmpegReader::Seek(int64_t requested_frame) {
 
 	// Increment seek count
 	seek_count++;
+	seek_counter.Increment();
 
 	// If seeking near frame 1, we need to close and re-open the file (this is more reliable than seeking)
 	int buffer_amount = std::max(OPEN_MP_NUM_PROCESSORS, 8);
 	if (requested_frame - buffer_amount < 20) {
-		// Close and re-open file (basically seeking to frame 1)
-		Close();
-		Open();
+		// Close and re-open file (basically seeking to frame 1). A warm decoder is not reused,
+		// since it would only be rewound with a seek.
+		{
+			ScopedFlag no_pooled_decoder(reuse_decoder, false);
+			Close();
+			Open();
+		}
 
 		// Update overrides (since closing and re-opening might update these)
 		info.has_audio = has_audio_override;
@@ -1767,8 +2839,14 @@ void FFmpegReader::Seek(int64_t requested_frame) {
 		int64_t seek_target = 0;
 
 		// Seek video stream (if any)
-		if (!seek_worked && info.has_video) {
+		if (!seek_worked && decode_video()) {
 			seek_target = ConvertFrameToVideoPTS(requested_frame - buffer_amount);
+
+			// Seek to the exact timestamp of the preceding keyframe (if indexed), so the
+			// first decoded frame is before the requested frame and no re-seek is needed
+			int64_t keyframe_target = GetKeyframePTS(seek_target);
+			if (keyframe_target >= 0)
+				seek_target = keyframe_target;
 			if (av_seek_frame(pFormatCtx, info.video_stream_index, seek_target, AVSEEK_FLAG_BACKWARD) < 0) {
 				fprintf(stderr, "%s: error while seeking video stream\n", pFormatCtx->AV_FILENAME);
 			} else {
@@ -1779,7 +2857,7 @@ void FFmpegReader::Seek(int64_t requested_frame) {
 		}
 
 		// Seek audio stream (if not already seeked... and if an audio stream is found)
-		if (!seek_worked && info.has_audio) {
+		if (!seek_worked && decode_audio()) {
 			seek_target = ConvertFrameToAudioPTS(requested_frame - buffer_amount);
 			if (av_seek_frame(pFormatCtx, info.audio_stream_index, seek_target, AVSEEK_FLAG_BACKWARD) < 0) {
 				fprintf(stderr, "%s: error while seeking audio stream\n", pFormatCtx->AV_FILENAME);
@@ -1905,10 +2983,11 @@ int64_t FFmpegReader::ConvertVideoPTStoFrame(int64_t pts) {
 		// if we are missing a video frame.
 		const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 		while (current_video_frame < frame) {
-			if (!missing_video_frames.count(current_video_frame)) {
+			FrameStatus &status = frame_status.Track(current_video_frame);
+			if (!status.missing_video_source) {
 				ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::ConvertVideoPTStoFrame (tracking missing frame)", "current_video_frame", current_video_frame, "previous_video_frame", previous_video_frame);
-				missing_video_frames.insert(std::pair<int64_t, int64_t>(current_video_frame, previous_video_frame));
-				missing_video_frames_source.insert(std::pair<int64_t, int64_t>(previous_video_frame, current_video_frame));
+				status.missing_video_source = previous_video_frame;
+				frame_status.Track(previous_video_frame).missing_video_dependents++;
 			}
 
 			// Mark this reader as containing missing frames
@@ -1998,9 +3077,10 @@ AudioLocation FFmpegReader::GetAudioPTSLocation(int64_t pts) {
 
 			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 			for (int64_t audio_frame = previous_packet_location.frame; audio_frame < location.frame; audio_frame++) {
-				if (!missing_audio_frames.count(audio_frame)) {
+				FrameStatus &status = frame_status.Track(audio_frame);
+				if (!status.is_missing_audio) {
 					ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::GetAudioPTSLocation (tracking missing frame)", "missing_audio_frame", audio_frame, "previous_audio_frame", previous_packet_location.frame, "new location frame", location.frame);
-					missing_audio_frames.insert(std::pair<int64_t, int64_t>(audio_frame, previous_packet_location.frame - 1));
+					status.is_missing_audio = true;
 				}
 			}
 		}
@@ -2051,8 +3131,8 @@ bool FFmpegReader::IsPartialFrame(int64_t requested_frame) {
 	if (seek_video_frame_found > max_seeked_frame) {
 		max_seeked_frame = seek_video_frame_found;
 	}
-	if ((info.has_audio && seek_audio_frame_found && max_seeked_frame >= requested_frame) ||
-		(info.has_video && seek_video_frame_found && max_seeked_frame >= requested_frame)) {
+	if ((decode_audio() && seek_audio_frame_found && max_seeked_frame >= requested_frame) ||
+		(decode_video() && seek_video_frame_found && max_seeked_frame >= requested_frame)) {
 		seek_trash = true;
 	}
 
@@ -2064,48 +3144,51 @@ bool FFmpegReader::CheckMissingFrame(int64_t requested_frame) {
 	// Lock
 	const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
 
-	// Increment check count for this frame (or init to 1)
-	++checked_frames[requested_frame];
+	// Increment check count for this frame
+	FrameStatus &status = frame_status.Track(requested_frame);
+	++status.checked_count;
 
 	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckMissingFrame", "requested_frame", requested_frame, "has_missing_frames", has_missing_frames, "missing_video_frames.size()", missing_video_frames.size(), "checked_count", checked_frames[requested_frame]);
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckMissingFrame", "requested_frame", requested_frame, "has_missing_frames", has_missing_frames, "missing_video_source", status.missing_video_source, "checked_count", status.checked_count);
 
 	// Missing frames (sometimes frame #'s are skipped due to invalid or missing timestamps)
-	std::map<int64_t, int64_t>::iterator itr;
 	bool found_missing_frame = false;
 
 	// Special MP3 Handling (ignore more than 1 video frame)
-	if (info.has_audio and info.has_video) {
+	if (decode_audio() and decode_video()) {
 		AVCodecID aCodecId = AV_FIND_DECODER_CODEC_ID(aStream);
 		AVCodecID vCodecId = AV_FIND_DECODER_CODEC_ID(pStream);
 		// If MP3 with single video frame, handle this special case by copying the previously
 		// decoded image to the new frame. Otherwise, it will spend a huge amount of
 		// CPU time looking for missing images for all the audio-only frames.
-		if (checked_frames[requested_frame] > 8 && !missing_video_frames.count(requested_frame) &&
-			!processing_audio_frames.count(requested_frame) && processed_audio_frames.count(requested_frame) &&
-			last_frame && last_video_frame->has_image_data && aCodecId == AV_CODEC_ID_MP3 && (vCodecId == AV_CODEC_ID_MJPEGB || vCodecId == AV_CODEC_ID_MJPEG)) {
-			missing_video_frames.insert(std::pair<int64_t, int64_t>(requested_frame, last_video_frame->number));
-			missing_video_frames_source.insert(std::pair<int64_t, int64_t>(last_video_frame->number, requested_frame));
-			missing_frames.Add(last_video_frame);
+		if (status.checked_count > 8 && !status.missing_video_source &&
+			!processing_audio_frames.count(requested_frame) && status.is_audio_processed &&
+			last_frame && last_video_frame && last_video_frame->has_image_data && aCodecId == AV_CODEC_ID_MP3 && (vCodecId == AV_CODEC_ID_MJPEGB || vCodecId == AV_CODEC_ID_MJPEG)) {
+			// The image is copied from last_video_frame (which is kept by this reader)
+			status.missing_video_source = last_video_frame->number;
 		}
 	}
 
 	// Check if requested video frame is a missing
-	if (missing_video_frames.count(requested_frame)) {
-		int64_t missing_source_frame = missing_video_frames.find(requested_frame)->second;
-
-		// Increment missing source frame check count (or init to 1)
-		++checked_frames[missing_source_frame];
-
-		// Get the previous frame of this missing frame (if it's available in missing cache)
-		std::shared_ptr<Frame> parent_frame = missing_frames.GetFrame(missing_source_frame);
+	if (status.missing_video_source && !status.is_video_processed) {
+		int64_t missing_source_frame = status.missing_video_source;
+
+		// Get the previous frame of this missing frame (if it's still available)
+		std::shared_ptr<Frame> parent_frame;
+		FrameStatus *source_status = frame_status.Find(missing_source_frame);
+		if (source_status) {
+			// Increment missing source frame check count
+			++source_status->checked_count;
+			parent_frame = source_status->source_frame;
+		}
 		if (parent_frame == NULL) {
 			parent_frame = final_cache.GetFrame(missing_source_frame);
-			if (parent_frame != NULL) {
-				// Add missing final frame to missing cache
-				missing_frames.Add(parent_frame);
-			}
+			if (parent_frame != NULL && source_status && source_status->missing_video_dependents > 0)
+				// Keep the final frame (for the other frames which depend on it)
+				source_status->source_frame = parent_frame;
 		}
+		if (parent_frame == NULL && last_video_frame && last_video_frame->number == missing_source_frame)
+			parent_frame = last_video_frame;
 
 		// Create blank missing frame
 		std::shared_ptr<Frame> missing_frame = CreateFrame(requested_frame);
@@ -2118,17 +3201,19 @@ bool FFmpegReader::CheckMissingFrame(int64_t requested_frame) {
 			// Debug output
 			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckMissingFrame (AddImage from Previous Video Frame)", "requested_frame", requested_frame, "missing_frame->number", missing_frame->number, "missing_source_frame", missing_source_frame);
 
-			// Add this frame to the processed map (since it's already done)
-			std::shared_ptr<QImage> parent_image = parent_frame->GetImage();
-			if (parent_image) {
-				missing_frame->AddImage(std::shared_ptr<QImage>(new QImage(*parent_image)));
-				processed_video_frames[missing_frame->number] = missing_frame->number;
-			}
+			// Share the previous image (copy-on-write, and still deferred if the previous image is),
+			// and mark this frame as processed (since it's already done)
+			missing_frame->ShareImage(parent_frame);
+			status.is_video_processed = true;
+
+			// Release the previous frame, once no other missing frames depend on it
+			if (source_status && --source_status->missing_video_dependents <= 0)
+				source_status->source_frame.reset();
 		}
 	}
 
 	// Check if requested audio frame is a missing
-	if (missing_audio_frames.count(requested_frame)) {
+	if (status.is_missing_audio && !status.is_audio_processed) {
 
 		// Create blank missing frame
 		std::shared_ptr<Frame> missing_frame = CreateFrame(requested_frame);
@@ -2139,9 +3224,9 @@ bool FFmpegReader::CheckMissingFrame(int64_t requested_frame) {
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckMissingFrame (Add Silence for Missing Audio Frame)", "requested_frame", requested_frame, "missing_frame->number", missing_frame->number, "samples_per_frame", samples_per_frame);
 
-		// Add this frame to the processed map (since it's already done)
+		// Mark this frame as processed (since it's already done)
 		missing_frame->AddAudioSilence(samples_per_frame);
-		processed_audio_frames[missing_frame->number] = missing_frame->number;
+		status.is_audio_processed = true;
 	}
 
 	return found_missing_frame;
@@ -2175,19 +3260,18 @@ void FFmpegReader::CheckWorkingFrames(bool end_of_stream, int64_t requested_fram
 
 		// Init # of times this frame has been checked so far
 		int checked_count = 0;
-		int checked_frames_size = 0;
 
 		bool is_video_ready = false;
 		bool is_audio_ready = false;
 		{ // limit scope of next few lines
 			const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
-			is_video_ready = processed_video_frames.count(f->number);
-			is_audio_ready = processed_audio_frames.count(f->number);
+			FrameStatus &status = frame_status.Track(f->number);
+			is_video_ready = status.is_video_processed;
+			is_audio_ready = status.is_audio_processed;
 
 			// Get check count for this frame
-			checked_frames_size = checked_frames.size();
 			if (!checked_count_tripped || f->number >= requested_frame)
-				checked_count = checked_frames[f->number];
+				checked_count = status.checked_count;
 			else
 				// Force checked count over the limit
 				checked_count = max_checked_count;
@@ -2198,31 +3282,31 @@ void FFmpegReader::CheckWorkingFrames(bool end_of_stream, int64_t requested_fram
 		bool is_seek_trash = IsPartialFrame(f->number);
 
 		// Adjust for available streams
-		if (!info.has_video) is_video_ready = true;
-		if (!info.has_audio) is_audio_ready = true;
+		if (!decode_video()) is_video_ready = true;
+		if (!decode_audio()) is_audio_ready = true;
 
 		// Make final any frames that get stuck (for whatever reason)
 		if (checked_count >= max_checked_count && (!is_video_ready || !is_audio_ready)) {
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames (exceeded checked_count)", "requested_frame", requested_frame, "frame_number", f->number, "is_video_ready", is_video_ready, "is_audio_ready", is_audio_ready, "checked_count", checked_count, "checked_frames_size", checked_frames_size);
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames (exceeded checked_count)", "requested_frame", requested_frame, "frame_number", f->number, "is_video_ready", is_video_ready, "is_audio_ready", is_audio_ready, "checked_count", checked_count);
 
 			// Trigger checked count tripped mode (clear out all frames before requested frame)
 			checked_count_tripped = true;
 
-			if (info.has_video && !is_video_ready && last_video_frame) {
+			if (decode_video() && !is_video_ready && last_video_frame) {
 				// Copy image from last frame
-				f->AddImage(std::shared_ptr<QImage>(new QImage(*last_video_frame->GetImage())));
+				f->ShareImage(last_video_frame);
 				is_video_ready = true;
 			}
 
-			if (info.has_audio && !is_audio_ready) {
+			if (decode_audio() && !is_audio_ready) {
 				// Mark audio as processed, and indicate the frame has audio data
 				is_audio_ready = true;
 			}
 		}
 
 		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames", "requested_frame", requested_frame, "frame_number", f->number, "is_video_ready", is_video_ready, "is_audio_ready", is_audio_ready, "checked_count", checked_count, "checked_frames_size", checked_frames_size);
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames", "requested_frame", requested_frame, "frame_number", f->number, "is_video_ready", is_video_ready, "is_audio_ready", is_audio_ready, "checked_count", checked_count);
 
 		// Check if working frame is final
 		if ((!end_of_stream && is_video_ready && is_audio_ready) || end_of_stream || is_seek_trash) {
@@ -2231,9 +3315,9 @@ void FFmpegReader::CheckWorkingFrames(bool end_of_stream, int64_t requested_fram
 
 			if (!is_seek_trash) {
 				// Add missing image (if needed - sometimes end_of_stream causes frames with only audio)
-				if (info.has_video && !is_video_ready && last_video_frame)
+				if (decode_video() && !is_video_ready && last_video_frame)
 					// Copy image from last frame
-					f->AddImage(std::shared_ptr<QImage>(new QImage(*last_video_frame->GetImage())));
+					f->ShareImage(last_video_frame);
 
 				// Reset counter since last 'final' frame
 				num_checks_since_final = 0;
@@ -2241,17 +3325,18 @@ void FFmpegReader::CheckWorkingFrames(bool end_of_stream, int64_t requested_fram
 				// Move frame to final cache
 				final_cache.Add(f);
 
-				// Add to missing cache (if another frame depends on it)
+				// Keep this frame (if missing frames depend on it)
 				{
 					const GenericScopedLock <CriticalSection> lock(processingCriticalSection);
-					if (missing_video_frames_source.count(f->number)) {
+					FrameStatus &status = frame_status.Track(f->number);
+					if (status.missing_video_dependents > 0) {
 						// Debug output
-						ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames (add frame to missing cache)", "f->number", f->number, "is_seek_trash", is_seek_trash, "Missing Cache Count", missing_frames.Count(), "Working Cache Count", working_cache.Count(), "Final Cache Count", final_cache.Count());
-						missing_frames.Add(f);
+						ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::CheckWorkingFrames (keep frame for missing frames)", "f->number", f->number, "is_seek_trash", is_seek_trash, "missing_video_dependents", status.missing_video_dependents, "Working Cache Count", working_cache.Count(), "Final Cache Count", final_cache.Count());
+						status.source_frame = f;
 					}
 
-					// Remove from 'checked' count
-					checked_frames.erase(f->number);
+					// Reset 'checked' count
+					status.checked_count = 0;
 				}
 
 				// Remove frame from working cache
@@ -2272,6 +3357,220 @@ void FFmpegReader::CheckWorkingFrames(bool end_of_stream, int64_t requested_fram
 	}
 }
 
+// Build the keyframe index from the container's seek index (or by scanning the video packets)
+void FFmpegReader::BuildKeyframeIndex() {
+	// Only build the index once per reader (it survives Close / Open, which happen on seek)
+	is_keyframe_index_built = true;
+	keyframe_index.clear();
+
+	// Most containers (MP4, MOV, MKV, etc...) already list every keyframe in their seek index
+#if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100))
+	int entry_count = avformat_index_get_entries_count(pStream);
+	for (int e = 0; e < entry_count; e++) {
+		const AVIndexEntry *entry = avformat_index_get_entry(pStream, e);
+		if (entry && (entry->flags & AVINDEX_KEYFRAME))
+			keyframe_index.push_back(entry->timestamp);
+	}
+#else
+	for (int e = 0; e < pStream->nb_index_entries; e++) {
+		if (pStream->index_entries[e].flags & AVINDEX_KEYFRAME)
+			keyframe_index.push_back(pStream->index_entries[e].timestamp);
+	}
+#endif
+
+	// A container index with a single entry is just the start of the file, and is of no use for seeking
+	bool is_scanned = false;
+	if (keyframe_index.size() <= 1) {
+		keyframe_index.clear();
+
+		// Use the index saved beside the media file (if any)
+		if (!LoadKeyframeIndex() && pFormatCtx->pb && (pFormatCtx->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+			// Scan the video packets of the file with a separate format context, so the demuxer
+			// used for decoding is not moved.
+			AVFormatContext *scanCtx = NULL;
+			if (avformat_open_input(&scanCtx, path.c_str(), NULL, NULL) == 0) {
+				if (avformat_find_stream_info(scanCtx, NULL) >= 0) {
+					AVPacket scan_packet;
+					av_init_packet(&scan_packet);
+					scan_packet.data = NULL;
+					scan_packet.size = 0;
+					while (av_read_frame(scanCtx, &scan_packet) >= 0) {
+						if (scan_packet.stream_index == videoStream && (scan_packet.flags & AV_PKT_FLAG_KEY)) {
+							// Index the presentation time of the keyframe (or its decoding time, if it has none)
+							if (scan_packet.pts != AV_NOPTS_VALUE)
+								keyframe_index.push_back(scan_packet.pts);
+							else if (scan_packet.dts != AV_NOPTS_VALUE)
+								keyframe_index.push_back(scan_packet.dts);
+						}
+						AV_FREE_PACKET(&scan_packet);
+					}
+					is_scanned = true;
+				}
+				avformat_close_input(&scanCtx);
+			}
+		}
+	}
+
+	// Sort and remove duplicate timestamps
+	std::sort(keyframe_index.begin(), keyframe_index.end());
+	keyframe_index.erase(std::unique(keyframe_index.begin(), keyframe_index.end()), keyframe_index.end());
+
+	// Save scanned indexes (since they are expensive to build)
+	if (is_scanned && Settings::Instance()->PERSIST_KEYFRAME_INDEX)
+		SaveKeyframeIndex();
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::BuildKeyframeIndex", "keyframes", keyframe_index.size(), "is_scanned", is_scanned);
+}
+
+// Load a keyframe index saved beside the media file (if it matches the file's size and date)
+bool FFmpegReader::LoadKeyframeIndex() {
+	if (!Settings::Instance()->PERSIST_KEYFRAME_INDEX)
+		return false;
+
+	QFileInfo media_info(QString::fromStdString(path));
+	QFile index_file(QString::fromStdString(path) + ".keyframes");
+	if (!media_info.exists() || !index_file.open(QIODevice::ReadOnly))
+		return false;
+
+	// Verify the header (an index of a modified file is ignored)
+	QDataStream stream(&index_file);
+	quint32 magic = 0, version = 0;
+	qint64 file_size = 0, modified = 0, count = 0;
+	stream >> magic >> version >> file_size >> modified >> count;
+	if (magic != 0x4F534B49 || version != 1 || file_size != media_info.size() ||
+		modified != media_info.lastModified().toMSecsSinceEpoch() || count <= 0)
+		return false;
+
+	std::vector<int64_t> loaded;
+	loaded.reserve(count);
+	for (qint64 k = 0; k < count && stream.status() == QDataStream::Ok; k++) {
+		qint64 timestamp = 0;
+		stream >> timestamp;
+		loaded.push_back(timestamp);
+	}
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	keyframe_index.swap(loaded);
+	return true;
+}
+
+// Save the keyframe index beside the media file, so it can be reused the next time the file is opened
+void FFmpegReader::SaveKeyframeIndex() {
+	QFileInfo media_info(QString::fromStdString(path));
+	QFile index_file(QString::fromStdString(path) + ".keyframes");
+	if (keyframe_index.empty() || !media_info.exists() || !index_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		// Not fatal (i.e. read-only media folder), the index is just rebuilt next time
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::SaveKeyframeIndex (Failed)", "keyframes", keyframe_index.size());
+		return;
+	}
+
+	QDataStream stream(&index_file);
+	stream << quint32(0x4F534B49) << quint32(1) << qint64(media_info.size())
+		   << qint64(media_info.lastModified().toMSecsSinceEpoch()) << qint64(keyframe_index.size());
+	for (int64_t timestamp : keyframe_index)
+		stream << qint64(timestamp);
+}
+
+// Get the probe cache file used for this media file (or an empty string if the cache is disabled)
+QString FFmpegReader::GetProbeInfoPath() {
+	QString cache_folder = QString::fromStdString(Settings::Instance()->PROBE_CACHE_PATH);
+	if (cache_folder.isEmpty())
+		return QString();
+
+	// Name the cache file after a hash of the full path of the media file
+	QString media_path = QFileInfo(QString::fromStdString(path)).absoluteFilePath();
+	QString hash = QCryptographicHash::hash(media_path.toUtf8(), QCryptographicHash::Md5).toHex();
+	return QDir(cache_folder).filePath(hash + ".json");
+}
+
+// Load the info struct of this file from the probe cache (if it matches the file's size and date)
+bool FFmpegReader::LoadProbeInfo() {
+	QString cache_path = GetProbeInfoPath();
+	QFileInfo media_info(QString::fromStdString(path));
+	if (cache_path.isEmpty() || !media_info.exists())
+		return false;
+
+	QFile cache_file(cache_path);
+	if (!cache_file.open(QIODevice::ReadOnly))
+		return false;
+	QByteArray contents = cache_file.readAll();
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	Json::CharReaderBuilder rbuilder;
+	Json::CharReader* reader(rbuilder.newCharReader());
+	std::string errors;
+	bool success = reader->parse(contents.constData(), contents.constData() + contents.size(), &root, &errors);
+	delete reader;
+
+	// Ignore invalid entries (and entries for a file which has been modified)
+	if (!success || !root.isObject() || root["path"].asString() != media_info.absoluteFilePath().toStdString() ||
+		root["file_size"].asString() != std::to_string(media_info.size()) ||
+		root["modified"].asString() != std::to_string(media_info.lastModified().toMSecsSinceEpoch()) ||
+		!root["info"].isObject())
+		return false;
+
+	try {
+		ReaderBase::SetJsonValue(root["info"]);
+	}
+	catch (const std::exception& e) {
+		return false;
+	}
+	check_fps = root["check_fps"].asBool();
+	is_duration_known = root["is_duration_known"].asBool();
+	is_probe_cached = true;
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::LoadProbeInfo", "check_fps", check_fps, "is_duration_known", is_duration_known);
+	return true;
+}
+
+// Save the info struct of this file to the probe cache, so reopening it skips inspection
+void FFmpegReader::SaveProbeInfo() {
+	QString cache_path = GetProbeInfoPath();
+	QFileInfo media_info(QString::fromStdString(path));
+	if (cache_path.isEmpty() || !media_info.exists())
+		return;
+
+	Json::Value root;
+	root["path"] = media_info.absoluteFilePath().toStdString();
+	root["file_size"] = std::to_string(media_info.size());
+	root["modified"] = std::to_string(media_info.lastModified().toMSecsSinceEpoch());
+	root["check_fps"] = check_fps;
+	root["is_duration_known"] = is_duration_known;
+	root["info"] = ReaderBase::JsonValue();
+
+	// Write to a temporary file and rename it, so other readers never see a partial entry
+	QDir().mkpath(QFileInfo(cache_path).absolutePath());
+	QString temp_path = cache_path + ".tmp";
+	QFile cache_file(temp_path);
+	if (!cache_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		// Not fatal, the file is just inspected again next time
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegReader::SaveProbeInfo (Failed)");
+		return;
+	}
+	std::string contents = WriteJson(root);
+	cache_file.write(contents.c_str(), contents.size());
+	cache_file.close();
+	QFile::remove(cache_path);
+	QFile::rename(temp_path, cache_path);
+	is_probe_cached = true;
+}
+
+// Get the timestamp of the nearest keyframe at or before a video timestamp (or -1 if unknown)
+int64_t FFmpegReader::GetKeyframePTS(int64_t pts) {
+	if (keyframe_index.empty())
+		return -1;
+
+	// Find the first keyframe after this timestamp, and step back one
+	std::vector<int64_t>::iterator itr = std::upper_bound(keyframe_index.begin(), keyframe_index.end(), pts);
+	if (itr == keyframe_index.begin())
+		return keyframe_index.front();
+	return *(--itr);
+}
+
 // Check for the correct frames per second (FPS) value by scanning the 1st few seconds of video packets.
 void FFmpegReader::CheckFPS() {
 	check_fps = true;
@@ -2376,10 +3675,15 @@ void FFmpegReader::RemoveAVFrame(AVFrame *remove_frame) {
 		// Free memory
 #pragma omp critical (packet_cache)
 		{
-			av_freep(&remove_frame->data[0]);
+			if (remove_frame->buf[0]) {
+				// Reference counted frames (i.e. mapped hardware surfaces) release their buffers when freed
+				AV_FREE_FRAME(&remove_frame);
+			} else {
+				av_freep(&remove_frame->data[0]);
 #ifndef WIN32
-			AV_FREE_FRAME(&remove_frame);
+				AV_FREE_FRAME(&remove_frame);
 #endif
+			}
 		}
 	}
 }
@@ -2427,7 +3731,7 @@ int64_t FFmpegReader::GetSmallestAudioFrame() {
 std::string FFmpegReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -2476,12 +3780,18 @@ void FFmpegReader::SetJsonValue(Json::Value root) {
 	ReaderBase::SetJsonValue(root);
 
 	// Set data from Json (if key is found)
-	if (!root["path"].isNull())
+	if (!root["path"].isNull() && root["path"].asString() != path) {
 		path = root["path"].asString();
+		is_probe_cached = false;
+	}
 
-	// Re-Open path, and re-init everything (if needed)
+	// Re-Open path, and re-init everything (if needed). The decoder is not parked, since
+	// the path may have changed.
 	if (is_open) {
-		Close();
+		{
+			ScopedFlag no_pooled_decoder(reuse_decoder, false);
+			Close();
+		}
 		Open();
 	}
 }
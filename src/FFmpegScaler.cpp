@@ -0,0 +1,163 @@
+/**
+ * @file
+ * @brief Source file for FFmpegScaler class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <list>
+#include "../include/FFmpegScaler.h"
+#include "../include/Settings.h"
+#include "../include/TaskPool.h"
+
+using namespace openshot;
+
+// Minimum rows of each slice (smaller slices cost more to schedule than they save)
+#define MIN_SLICE_ROWS 256
+
+// Scaling contexts cached by each thread (a context can't be used by 2 threads at once)
+struct ScaleContextCache {
+	struct Entry {
+		int src_width, src_height, src_format, dst_width, dst_height, dst_format, flags, threads;
+		SwsContext *context;
+	};
+	std::list<Entry> entries; // most recently used first
+
+	~ScaleContextCache() {
+		for (std::list<Entry>::iterator itr = entries.begin(); itr != entries.end(); ++itr)
+			sws_freeContext(itr->context);
+	}
+};
+
+// Get a scaling context of the calling thread (sws_getContext is expensive, so contexts are reused)
+SwsContext *FFmpegScaler::Context(int src_width, int src_height, int src_format, int dst_width, int dst_height,
+								  int dst_format, int flags, int threads) {
+	static thread_local ScaleContextCache cache;
+	for (std::list<ScaleContextCache::Entry>::iterator itr = cache.entries.begin(); itr != cache.entries.end(); ++itr) {
+		if (itr->src_width == src_width && itr->src_height == src_height && itr->src_format == src_format &&
+			itr->dst_width == dst_width && itr->dst_height == dst_height && itr->dst_format == dst_format &&
+			itr->flags == flags && itr->threads == threads) {
+			// Move to front (most recently used)
+			cache.entries.splice(cache.entries.begin(), cache.entries, itr);
+			return cache.entries.front().context;
+		}
+	}
+
+	// Create a new context (and forget the least recently used one, if too many)
+	ScaleContextCache::Entry entry = {src_width, src_height, src_format, dst_width, dst_height, dst_format, flags, threads, NULL};
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+	if (threads > 1) {
+		// Let libswscale split the image over its own slice threads
+		entry.context = sws_alloc_context();
+		av_opt_set_int(entry.context, "srcw", src_width, 0);
+		av_opt_set_int(entry.context, "srch", src_height, 0);
+		av_opt_set_int(entry.context, "src_format", src_format, 0);
+		av_opt_set_int(entry.context, "dstw", dst_width, 0);
+		av_opt_set_int(entry.context, "dsth", dst_height, 0);
+		av_opt_set_int(entry.context, "dst_format", dst_format, 0);
+		av_opt_set_int(entry.context, "sws_flags", flags, 0);
+		av_opt_set_int(entry.context, "threads", threads, 0);
+		if (sws_init_context(entry.context, NULL, NULL) < 0) {
+			sws_freeContext(entry.context);
+			entry.context = NULL;
+		}
+	}
+#endif
+	if (!entry.context)
+		entry.context = sws_getContext(src_width, src_height, (AVPixelFormat) src_format, dst_width, dst_height,
+									   (AVPixelFormat) dst_format, flags, NULL, NULL, NULL);
+	cache.entries.push_front(entry);
+	if (cache.entries.size() > 8) {
+		sws_freeContext(cache.entries.back().context);
+		cache.entries.pop_back();
+	}
+	return entry.context;
+}
+
+// Get the number of slices an image is converted in
+int FFmpegScaler::NumSlices(int src_width, int src_height, int src_format, int dst_width, int dst_height, int dst_format) {
+	int slices = std::min(Settings::Instance()->SCALE_THREADS, src_height / MIN_SLICE_ROWS);
+	if (slices <= 1)
+		return 1;
+
+	// A resized image is only split by the slice threads of libswscale
+	if (src_width != dst_width || src_height != dst_height) {
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+		return slices;
+#else
+		return 1;
+#endif
+	}
+
+	// The rows of a palette, hardware, or bitstream image can't be split
+	const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get((AVPixelFormat) src_format);
+	const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get((AVPixelFormat) dst_format);
+	int unsplittable = AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM;
+	if (!src_desc || !dst_desc || (src_desc->flags & unsplittable) || (dst_desc->flags & unsplittable))
+		return 1;
+
+	return slices;
+}
+
+// Convert (and resize) an image (in parallel slices, when it is large enough)
+void FFmpegScaler::Scale(const uint8_t *const src_data[], const int src_linesize[], int src_width, int src_height, int src_format,
+						 uint8_t *const dst_data[], const int dst_linesize[], int dst_width, int dst_height, int dst_format, int flags) {
+	int slices = NumSlices(src_width, src_height, src_format, dst_width, dst_height, dst_format);
+	bool is_resized = (src_width != dst_width || src_height != dst_height);
+	if (slices <= 1 || is_resized) {
+		SwsContext *context = Context(src_width, src_height, src_format, dst_width, dst_height, dst_format, flags, slices);
+		sws_scale(context, src_data, src_linesize, 0, src_height, dst_data, dst_linesize);
+		return;
+	}
+
+	// Each slice starts on a row shared by the chroma planes (of both formats)
+	const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get((AVPixelFormat) src_format);
+	const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get((AVPixelFormat) dst_format);
+	int align = 1 << std::max(src_desc->log2_chroma_h, dst_desc->log2_chroma_h);
+	int slice_rows = ((src_height + slices - 1) / slices + align - 1) / align * align;
+
+	TaskPool::Current()->ParallelFor(0, slices, [&](int64_t slice) {
+		int first_row = slice * slice_rows;
+		if (first_row >= src_height)
+			return;
+		int rows = std::min(slice_rows, src_height - first_row);
+
+		// Point at the first row of the slice, in each plane (the chroma planes have fewer rows)
+		const uint8_t *slice_src[4] = {NULL, NULL, NULL, NULL};
+		uint8_t *slice_dst[4] = {NULL, NULL, NULL, NULL};
+		for (int plane = 0; plane < 4; plane++) {
+			if (src_data[plane])
+				slice_src[plane] = src_data[plane] + (int64_t) (first_row >> ((plane == 1 || plane == 2) ? src_desc->log2_chroma_h : 0)) * src_linesize[plane];
+			if (dst_data[plane])
+				slice_dst[plane] = dst_data[plane] + (int64_t) (first_row >> ((plane == 1 || plane == 2) ? dst_desc->log2_chroma_h : 0)) * dst_linesize[plane];
+		}
+
+		// Convert the slice as an image of its own
+		SwsContext *context = Context(src_width, rows, src_format, dst_width, rows, dst_format, flags);
+		sws_scale(context, slice_src, src_linesize, 0, rows, slice_dst, dst_linesize);
+	});
+}
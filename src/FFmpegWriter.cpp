@@ -32,6 +32,9 @@
  */
 
 #include "../include/FFmpegWriter.h"
+#include "../include/Trace.h"
+#include "../include/FFmpegScaler.h"
+#include "../include/SharedReader.h"
 
 using namespace openshot;
 
@@ -44,15 +47,20 @@ using namespace openshot;
 // Multiplexer parameters temporary storage
 AVDictionary *mux_dict = NULL;
 
+// Number of frames after a smart render range which can be decoded before the frame following the range (i.e. B-frames)
+#define MAX_REORDERED_FRAMES 16
+
 #if IS_FFMPEG_3_2
 int hw_en_on = 1;					// Is set in UI
 int hw_en_supported = 0;	// Is set by FFmpegWriter
 AVPixelFormat hw_en_av_pix_fmt = AV_PIX_FMT_NONE;
 AVHWDeviceType hw_en_av_device_type = AV_HWDEVICE_TYPE_VAAPI;
 static AVBufferRef *hw_device_ctx = NULL;
-AVFrame *hw_frame = NULL;
 
-static int set_hwframe_ctx(AVCodecContext *ctx, AVBufferRef *hw_device_ctx, int64_t width, int64_t height)
+// Number of surfaces the hardware encoder can hold on to (in addition to each batch of uploaded frames)
+#define HW_EN_SURFACES_IN_FLIGHT 20
+
+static int set_hwframe_ctx(AVCodecContext *ctx, AVBufferRef *hw_device_ctx, int64_t width, int64_t height, int pool_size)
 {
 	AVBufferRef *hw_frames_ref;
 	AVHWFramesContext *frames_ctx = NULL;
@@ -67,7 +75,7 @@ static int set_hwframe_ctx(AVCodecContext *ctx, AVBufferRef *hw_device_ctx, int6
 	frames_ctx->sw_format = AV_PIX_FMT_NV12;
 	frames_ctx->width     = width;
 	frames_ctx->height    = height;
-	frames_ctx->initial_pool_size = 20;
+	frames_ctx->initial_pool_size = pool_size;
 	if ((err = av_hwframe_ctx_init(hw_frames_ref)) < 0) {
 		fprintf(stderr, "Failed to initialize HW frame context."
 			"Error code: %s\n",av_err2str(err));
@@ -84,12 +92,14 @@ static int set_hwframe_ctx(AVCodecContext *ctx, AVBufferRef *hw_device_ctx, int6
 #endif
 
 FFmpegWriter::FFmpegWriter(std::string path) :
-		path(path), fmt(NULL), oc(NULL), audio_st(NULL), video_st(NULL), audio_pts(0), video_pts(0), samples(NULL),
+		path(path), fmt(NULL), oc(NULL), audio_st(NULL), video_st(NULL), audio_pts(0), video_pts(0),
 		audio_outbuf(NULL), audio_outbuf_size(0), audio_input_frame_size(0), audio_input_position(0),
 		initial_audio_input_frame_size(0), img_convert_ctx(NULL), cache_size(8), num_of_rescalers(32),
 		rescaler_position(0), video_codec(NULL), audio_codec(NULL), is_writing(false), write_video_count(0), write_audio_count(0),
-		original_sample_rate(0), original_channels(0), avr(NULL), avr_planar(NULL), is_open(false), prepare_streams(false),
-		write_header(false), write_trailer(false), audio_encoder_buffer_size(0), audio_encoder_buffer(NULL) {
+		original_sample_rate(0), original_channels(0), avr(NULL), audio_fifo(NULL), audio_resample_data(NULL), audio_resample_capacity(0), audio_encode_frame(NULL), is_open(false), prepare_streams(false),
+		write_header(false), write_trailer(false), audio_encoder_buffer_size(0), audio_encoder_buffer(NULL),
+		is_writer_running(false), writer_stop(false), segment_format(SEGMENT_NONE), segment_seconds(0.0), segment_playlist_size(0), smart_render(false),
+		last_image_key(0), last_image_position(-1), is_last_image_in_batch(false) {
 
 	// Disable audio & video (so they can be independently enabled)
 	info.has_audio = false;
@@ -102,6 +112,17 @@ FFmpegWriter::FFmpegWriter(std::string path) :
 	auto_detect_format();
 }
 
+FFmpegWriter::~FFmpegWriter() {
+	// Stop the writer thread, and finish encoding audio (if the writer was never closed)
+	try {
+		stop_writer();
+		audio_tasks.Wait();
+	}
+	catch (...) {
+		// Ignore errors of unfinished frames (the writer is being destroyed)
+	}
+}
+
 // Open the writer
 void FFmpegWriter::Open() {
 	if (!is_open) {
@@ -330,6 +351,10 @@ void FFmpegWriter::SetOption(StreamType stream, std::string name, std::string va
 	} else
 		throw NoStreamsFound("The stream was not found. Be sure to call PrepareStreams() first.", path);
 
+	// Keep the video options (for the writers of re-encoded smart render ranges)
+	if (stream == VIDEO_STREAM)
+		video_options.push_back(std::make_pair(name, value));
+
 	// Init AVOption
 	const AVOption *option = NULL;
 
@@ -341,7 +366,7 @@ void FFmpegWriter::SetOption(StreamType stream, std::string name, std::string va
 	// Was option found?
 	if (option || (name == "g" || name == "qmin" || name == "qmax" || name == "max_b_frames" || name == "mb_decision" ||
 				   name == "level" || name == "profile" || name == "slices" || name == "rc_min_rate" || name == "rc_max_rate" ||
-				   name == "rc_buffer_size" || name == "crf" || name == "cqp")) {
+				   name == "rc_buffer_size" || name == "crf" || name == "cqp" || name == "pix_fmt")) {
 		// Check for specific named options
 		if (name == "g")
 			// Set gop_size
@@ -387,6 +412,13 @@ void FFmpegWriter::SetOption(StreamType stream, std::string name, std::string va
 			// Buffer size
 			convert >> c->rc_buffer_size;
 
+		else if (name == "pix_fmt") {
+			// Pixel format of the encoded video (i.e. yuv420p10le, for 10-bit delivery)
+			AVPixelFormat pix_fmt = av_get_pix_fmt(value.c_str());
+			if (pix_fmt != AV_PIX_FMT_NONE)
+				c->pix_fmt = (PixelFormat) pix_fmt;
+		}
+
 		else if (name == "cqp") {
 			// encode quality and special settings like lossless
 			// This might be better in an extra methods as more options
@@ -528,6 +560,37 @@ void FFmpegWriter::SetOption(StreamType stream, std::string name, std::string va
 
 }
 
+// Write the output as segments (fragmented MP4, HLS, or DASH)
+void FFmpegWriter::SetSegmentOptions(SegmentFormat format, double segment_seconds, int playlist_size) {
+	if (prepare_streams)
+		throw InvalidOptions("Segment options must be set before the streams are prepared.", path);
+	if (format != SEGMENT_NONE && segment_seconds <= 0.0)
+		throw InvalidOptions("The segment duration must be greater than 0 seconds.", path);
+
+	// HLS and DASH have their own muxers (which write the segments and the playlist)
+	AVOutputFormat *segment_fmt = NULL;
+	if (format == SEGMENT_HLS)
+		segment_fmt = av_guess_format("hls", NULL, NULL);
+	else if (format == SEGMENT_DASH)
+		segment_fmt = av_guess_format("dash", NULL, NULL);
+	else if (format == SEGMENT_FRAGMENTED_MP4)
+		segment_fmt = av_guess_format("mp4", NULL, NULL);
+	else
+		segment_fmt = av_guess_format(NULL, path.c_str(), NULL);
+	if (!segment_fmt)
+		throw InvalidFormat("This version of FFmpeg can not write this segment format.", path);
+
+	// Use the segment muxer
+	fmt = segment_fmt;
+	oc->oformat = fmt;
+
+	this->segment_format = format;
+	this->segment_seconds = segment_seconds;
+	segment_playlist_size = std::max(0, playlist_size);
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::SetSegmentOptions", "format", format, "segment_seconds", segment_seconds, "playlist_size", playlist_size);
+}
+
 /// Determine if codec name is valid
 bool FFmpegWriter::IsValidCodec(std::string codec_name) {
 	// Initialize FFMpeg, and register all formats and codecs
@@ -582,6 +645,37 @@ void FFmpegWriter::WriteHeader() {
 	if (is_mp4 || is_mov)
 		av_dict_copy(&dict, mux_dict, 0);
 
+	// Set segment options (if any), and flush each packet as soon as it is muxed
+	if (segment_format != SEGMENT_NONE) {
+		std::stringstream segment_str;
+		segment_str << segment_seconds;
+		std::stringstream playlist_size_str;
+		playlist_size_str << segment_playlist_size;
+
+		if (segment_format == SEGMENT_FRAGMENTED_MP4) {
+			// Start a new fragment at each keyframe (with an empty 'moov' box, so playback can start right away)
+			av_dict_set(&dict, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+		} else if (segment_format == SEGMENT_HLS) {
+			av_dict_set(&dict, "hls_time", segment_str.str().c_str(), 0);
+			av_dict_set(&dict, "hls_list_size", playlist_size_str.str().c_str(), 0);
+			if (segment_playlist_size > 0)
+				// Rolling playlist (and remove the segments which leave it)
+				av_dict_set(&dict, "hls_flags", "independent_segments+delete_segments", 0);
+			else {
+				// Growing playlist (which keeps every segment)
+				av_dict_set(&dict, "hls_flags", "independent_segments", 0);
+				av_dict_set(&dict, "hls_playlist_type", "event", 0);
+			}
+		} else if (segment_format == SEGMENT_DASH) {
+			av_dict_set(&dict, "seg_duration", segment_str.str().c_str(), 0);
+			av_dict_set(&dict, "window_size", playlist_size_str.str().c_str(), 0);
+			av_dict_set(&dict, "use_template", "1", 0);
+			av_dict_set(&dict, "use_timeline", "1", 0);
+			av_dict_set(&dict, "streaming", "1", 0);
+		}
+		oc->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+	}
+
 	// Write the stream header
 	if (avformat_write_header(oc, &dict) != 0) {
 		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::WriteHeader (avformat_write_header)");
@@ -598,6 +692,12 @@ void FFmpegWriter::WriteHeader() {
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::WriteHeader");
 }
 
+// The memory gauge of the frames waiting to be encoded (by all writers)
+static MemoryGauge &spool_memory() {
+	static MemoryGauge &gauge = Metrics::Instance()->GetMemory("writer.spool");
+	return gauge;
+}
+
 // Add a frame to the queue waiting to be encoded.
 void FFmpegWriter::WriteFrame(std::shared_ptr<Frame> frame) {
 	// Check for open reader (or throw exception)
@@ -612,19 +712,23 @@ void FFmpegWriter::WriteFrame(std::shared_ptr<Frame> frame) {
 	if (info.has_audio && audio_st)
 		spooled_audio_frames.push_back(frame);
 
-	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::WriteFrame", "frame->number", frame->number, "spooled_video_frames.size()", spooled_video_frames.size(), "spooled_audio_frames.size()", spooled_audio_frames.size(), "cache_size", cache_size, "is_writing", is_writing);
+	// Count the memory of the spooled frame (until its batch is encoded)
+	if ((info.has_video && video_st) || (info.has_audio && audio_st)) {
+		int64_t bytes = frame->GetBytes();
+		spooled_bytes.Increment(bytes);
+		spool_memory().Add(bytes);
+	}
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::WriteFrame", "frame->number", frame->number, "spooled_video_frames.size()", spooled_video_frames.size(), "spooled_audio_frames.size()", spooled_audio_frames.size(), "cache_size", cache_size, "is_writing", is_writing.load());
 
 	// Write the frames once it reaches the correct cache size
 	if (spooled_video_frames.size() == cache_size || spooled_audio_frames.size() == cache_size) {
-		// Is writer currently writing?
-		if (!is_writing)
+		if ((openshot::Settings::Instance()->WRITER_QUEUE_SIZE > 0 && !openshot::Settings::Instance()->DETERMINISTIC_RENDER) || is_writer_running)
+			// Encode the frames on the writer thread (while the caller renders the next frames)
+			queue_spooled_frames();
+		else
 			// Write frames to video file
 			write_queued_frames();
-
-		else {
-			// Write frames to video file
-			write_queued_frames();
-		}
 	}
 
 	// Keep track of the last frame added
@@ -633,10 +737,9 @@ void FFmpegWriter::WriteFrame(std::shared_ptr<Frame> frame) {
 
 // Write all frames in the queue to the video file.
 void FFmpegWriter::write_queued_frames() {
-	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_queued_frames", "spooled_video_frames.size()", spooled_video_frames.size(), "spooled_audio_frames.size()", spooled_audio_frames.size());
+	TraceSpan trace_span("FFmpegWriter::write_queued_frames", "encode");
 
-	// Flip writing flag
-	is_writing = true;
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_queued_frames", "spooled_video_frames.size()", spooled_video_frames.size(), "spooled_audio_frames.size()", spooled_audio_frames.size());
 
 	// Transfer spool to queue
 	queued_video_frames = spooled_video_frames;
@@ -646,93 +749,202 @@ void FFmpegWriter::write_queued_frames() {
 	spooled_video_frames.clear();
 	spooled_audio_frames.clear();
 
-	// Set the number of threads in OpenMP
-	omp_set_num_threads(OPEN_MP_NUM_PROCESSORS);
-	// Allow nested OpenMP sections
-	omp_set_nested(true);
+	// Encode the queued frames
+	encode_queued_frames();
+}
 
-	// Create blank exception
-	bool has_error_encoding_video = false;
+// Hand the spooled frames to the writer thread (waiting while too many batches are queued)
+void FFmpegWriter::queue_spooled_frames() {
+	std::unique_lock<std::mutex> lock(writer_mutex);
+
+	// Start the writer thread (if needed)
+	if (!is_writer_running) {
+		is_writer_running = true;
+		writer_stop = false;
+		writer_thread = std::thread(&FFmpegWriter::writer_loop, this);
+	}
 
-#pragma omp parallel
+	// Wait while the writer is too far behind (so the caller can't spool frames faster than they are encoded)
+	size_t max_batches = std::max(openshot::Settings::Instance()->WRITER_QUEUE_SIZE, 1);
+	writer_condition.wait(lock, [this, max_batches] { return writer_batches.size() < max_batches || writer_error; });
+
+	// Raise errors of the writer thread (on the caller's thread)
+	if (writer_error) {
+		std::exception_ptr error = writer_error;
+		writer_error = std::exception_ptr();
+		lock.unlock();
+		std::rethrow_exception(error);
+	}
+
+	// Queue the batch
+	writer_batches.push_back(FrameBatch(spooled_video_frames, spooled_audio_frames));
+	spooled_video_frames.clear();
+	spooled_audio_frames.clear();
+	writer_condition.notify_all();
+	Metrics::Instance()->SetGauge("encoder.queued_batches", writer_batches.size());
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::queue_spooled_frames", "writer_batches.size()", writer_batches.size(), "max_batches", max_batches);
+}
+
+// Wait for the writer thread to write all queued batches, and stop it (rethrowing any error)
+void FFmpegWriter::stop_writer() {
+	std::exception_ptr error;
 	{
-#pragma omp single
-		{
-			// Process all audio frames (in a separate thread)
-			if (info.has_audio && audio_st && !queued_audio_frames.empty())
-				write_audio_packets(false);
+		std::unique_lock<std::mutex> lock(writer_mutex);
+		if (!is_writer_running)
+			return;
 
-			// Loop through each queued image frame
-			while (!queued_video_frames.empty()) {
-				// Get front frame (from the queue)
-				std::shared_ptr<Frame> frame = queued_video_frames.front();
+		// Ask the thread to exit (once its batches are written)
+		writer_stop = true;
+		writer_condition.notify_all();
+	}
+	writer_thread.join();
 
-				// Add to processed queue
-				processed_frames.push_back(frame);
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		is_writer_running = false;
+		writer_stop = false;
+		writer_batches.clear();
+		error = writer_error;
+		writer_error = std::exception_ptr();
+	}
 
-				// Encode and add the frame to the output file
-				if (info.has_video && video_st)
-					process_video_packet(frame);
+	// Raise errors of the writer thread (on the caller's thread)
+	if (error)
+		std::rethrow_exception(error);
+}
 
-				// Remove front item
-				queued_video_frames.pop_front();
+// The main loop of the writer thread
+void FFmpegWriter::writer_loop() {
+	while (true) {
+		std::unique_lock<std::mutex> lock(writer_mutex);
+		writer_condition.wait(lock, [this] { return !writer_batches.empty() || writer_stop; });
+		if (writer_batches.empty())
+			// Stopped (and all batches are written)
+			break;
 
-			} // end while
-		} // end omp single
+		// Take the oldest batch
+		queued_video_frames = writer_batches.front().first;
+		queued_audio_frames = writer_batches.front().second;
+		writer_batches.pop_front();
+		Metrics::Instance()->SetGauge("encoder.queued_batches", writer_batches.size());
+		writer_condition.notify_all();
+		lock.unlock();
+
+		// Convert and encode the batch (after an error, the remaining batches are dropped)
+		std::exception_ptr error;
+		try {
+			encode_queued_frames();
+		}
+		catch (...) {
+			error = std::current_exception();
+			queued_video_frames.clear();
+			queued_audio_frames.clear();
+		}
 
-#pragma omp single
-		{
-			// Loop back through the frames (in order), and write them to the video file
-			while (!processed_frames.empty()) {
-				// Get front frame (from the queue)
-				std::shared_ptr<Frame> frame = processed_frames.front();
-
-				if (info.has_video && video_st) {
-					// Add to deallocate queue (so we can remove the AVFrames when we are done)
-					deallocate_frames.push_back(frame);
-
-					// Does this frame's AVFrame still exist
-					if (av_frames.count(frame)) {
-						// Get AVFrame
-						AVFrame *frame_final = av_frames[frame];
-
-						// Write frame to video file
-						bool success = write_video_packet(frame, frame_final);
-						if (!success)
-							has_error_encoding_video = true;
-					}
-				}
+		lock.lock();
+		if (error) {
+			if (!writer_error)
+				writer_error = error;
+			writer_batches.clear();
+		}
+		writer_condition.notify_all();
+	}
+}
 
-				// Remove front item
-				processed_frames.pop_front();
-			}
+// Encode the frames moved to the queues (queued_video_frames and queued_audio_frames)
+void FFmpegWriter::encode_queued_frames() {
+	TraceSpan trace_span("FFmpegWriter::encode_queued_frames", "encode");
 
-			// Loop through, and deallocate AVFrames
-			while (!deallocate_frames.empty()) {
-				// Get front frame (from the queue)
-				std::shared_ptr<Frame> frame = deallocate_frames.front();
+	// Count the encoded frames (for the encode rate of all writers)
+	static Counter& encoded_frames = Metrics::Instance()->GetCounter("encoder.video_frames");
+	encoded_frames.Increment(queued_video_frames.size());
 
-				// Does this frame's AVFrame still exist
-				if (av_frames.count(frame)) {
-					// Get AVFrame
-					AVFrame *av_frame = av_frames[frame];
+	// Get the memory of the batch (each frame is in both queues, when there is audio and video)
+	int64_t batch_bytes = 0;
+	std::deque<std::shared_ptr<Frame> > &batch_frames = queued_video_frames.empty() ? queued_audio_frames : queued_video_frames;
+	for (std::shared_ptr<Frame> frame : batch_frames)
+		batch_bytes += frame->GetBytes();
 
-					// Deallocate AVPicture and AVFrame
-					av_freep(&(av_frame->data[0]));
-					AV_FREE_FRAME(&av_frame);
-					av_frames.erase(frame);
-				}
+	// Flip writing flag
+	is_writing = true;
 
-				// Remove front item
-				deallocate_frames.pop_front();
-			}
+	// Create blank exception
+	bool has_error_encoding_video = false;
+
+	// Process all audio frames (in a separate thread)
+	if (info.has_audio && audio_st && !queued_audio_frames.empty())
+		write_audio_packets(false);
+
+	// Get a converted frame for each position in the batch
+	if (info.has_video && video_st) {
+		allocate_video_frame_ring(queued_video_frames.size());
+		video_frame_slots.assign(queued_video_frames.size(), NULL);
+		video_frame_repeats.assign(queued_video_frames.size(), -1);
+		is_last_image_in_batch = false;
+	}
+
+	// Loop through each queued image frame
+	int position = 0;
+	while (!queued_video_frames.empty()) {
+		// Get front frame (from the queue)
+		std::shared_ptr<Frame> frame = queued_video_frames.front();
+
+		// Add to processed queue
+		processed_frames.push_back(frame);
+
+		// Encode and add the frame to the output file
+		if (info.has_video && video_st)
+			process_video_packet(frame, position);
+
+		// Remove front item
+		queued_video_frames.pop_front();
+		position++;
+
+	} // end while
+
+	// Wait for all audio packets and video frames to finish converting
+	encoding_tasks.Wait();
+
+	// Repeated images are encoded from the frame converted for their first position
+	for (int slot = 0; slot < video_frame_repeats.size(); slot++)
+		if (video_frame_repeats[slot] >= 0)
+			video_frame_slots[slot] = video_frame_slots[video_frame_repeats[slot]];
+
+	// Loop back through the frames (in order), and write them to the video file
+	position = 0;
+	while (!processed_frames.empty()) {
+		// Get front frame (from the queue)
+		std::shared_ptr<Frame> frame = processed_frames.front();
+
+		// Was this frame converted
+		if (info.has_video && video_st && position < video_frame_slots.size() && video_frame_slots[position]) {
+			// Write frame to video file
+			bool success = write_video_packet(frame, video_frame_slots[position]);
+			if (!success)
+				has_error_encoding_video = true;
+		}
+
+		// Remove front item
+		processed_frames.pop_front();
+		position++;
+	}
 
-			// Done writing
-			is_writing = false;
+	// Release the hardware surfaces back to their pool (the ring frames are reused by the next batch)
+	for (int slot = 0; slot < video_frame_slots.size(); slot++) {
+		AVFrame *av_frame = video_frame_slots[slot];
+		if (av_frame && av_frame->buf[0] && video_frame_repeats[slot] < 0)
+			AV_FREE_FRAME(&av_frame);
+	}
+	video_frame_slots.clear();
+	video_frame_repeats.clear();
 
-		} // end omp single
+	// The frames of the batch are no longer spooled
+	spooled_bytes.Increment(-batch_bytes);
+	spool_memory().Add(-batch_bytes);
 
-	} // end omp parallel
+	// Done writing
+	is_writing = false;
 
 	// Raise exception from main thread
 	if (has_error_encoding_video)
@@ -743,24 +955,330 @@ void FFmpegWriter::write_queued_frames() {
 void FFmpegWriter::WriteFrame(ReaderBase *reader, int64_t start, int64_t length) {
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::WriteFrame (from Reader)", "start", start, "length", length);
 
-	// Loop through each frame (and encoded it)
-	for (int64_t number = start; number <= length; number++) {
-		// Get the frame
-		std::shared_ptr<Frame> f = reader->GetFrame(number);
+	// Copy the frames from the source file (if they are unchanged)
+	if (smart_render && smart_render_frames(reader, start, length))
+		return;
+
+	// Encode the frames only for their audio, when no video is written
+	if (!info.has_video) {
+		for (int64_t number = start; number <= length; number++)
+			WriteFrame(reader->GetAudioFrame(number));
+		return;
+	}
+
+	// Get the frames a batch at a time (which a reader can read faster than a frame at a time), and encode them
+	int64_t batch_size = std::max(1, cache_size);
+	for (int64_t number = start; number <= length; number += batch_size) {
+		int64_t count = std::min(batch_size, length - number + 1);
+		std::vector<std::shared_ptr<Frame> > frames = reader->GetFrames(number, count);
+		for (size_t index = 0; index < frames.size(); index++)
+			WriteFrame(frames[index]);
+	}
+}
+
+// Get the file path of a temporary file beside a file (with the same extension, so it has the same container)
+static std::string smart_render_range_path(std::string path, std::string name) {
+	size_t extension = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+		return path + "." + name;
+	return path.substr(0, extension) + "." + name + path.substr(extension);
+}
+
+// Find the file a block of frames can be copied from (the FFmpegReader of a timeline's single pass-through clip)
+FFmpegReader *FFmpegWriter::find_smart_render_source(ReaderBase *reader, int64_t start, int64_t end, int64_t &source_start) {
+	Timeline *timeline = dynamic_cast<Timeline *>(reader);
+	if (!timeline)
+		return NULL;
+	Clip *clip = timeline->FindPassThroughClip(start, end, source_start);
+	if (!clip)
+		return NULL;
+
+	// Look through a frame mapper which does not change the frame rate or audio
+	ReaderBase *source = clip->Reader();
+	FrameMapper *mapper = dynamic_cast<FrameMapper *>(source);
+	if (mapper) {
+		source = mapper->Reader();
+		if (!source || source->info.fps.num != mapper->info.fps.num || source->info.fps.den != mapper->info.fps.den ||
+			source->info.sample_rate != mapper->info.sample_rate || source->info.channels != mapper->info.channels)
+			return NULL;
+	}
+
+	// The timeline must not change the frame rate either
+	if (!source || source->info.fps.num != timeline->info.fps.num || source->info.fps.den != timeline->info.fps.den)
+		return NULL;
+	SharedReader *shared = dynamic_cast<SharedReader *>(source);
+	if (shared)
+		return shared->Reader();
+	return dynamic_cast<FFmpegReader *>(source);
+}
+
+// Write a block of frames by copying the packets of the source file (returns false if the frames can't be copied)
+bool FFmpegWriter::smart_render_frames(ReaderBase *reader, int64_t start, int64_t end) {
+	// Only the first block of frames written to a regular file can be copied
+	if (!is_open || !info.has_video || !video_st || write_video_count > 0 || !spooled_video_frames.empty() ||
+		segment_format != SEGMENT_NONE || end < start)
+		return false;
+	int64_t source_start = 0;
+	FFmpegReader *source = find_smart_render_source(reader, start, end, source_start);
+	if (!source || source->info.fps.num != info.fps.num || source->info.fps.den != info.fps.den)
+		return false;
+	int64_t source_end = source_start + (end - start);
+	std::string source_path = source->Path();
+
+	// The source file must have the same container (so the packets are stored the same way)
+	AVOutputFormat *source_format = av_guess_format(NULL, source_path.c_str(), NULL);
+	if (!source_format || strcmp(source_format->name, oc->oformat->name) != 0)
+		return false;
+
+	// Open the source file (with its own demuxer, so the reader is not moved)
+	AVFormatContext *input = NULL;
+	if (avformat_open_input(&input, source_path.c_str(), NULL, NULL) != 0)
+		return false;
+	if (avformat_find_stream_info(input, NULL) < 0) {
+		avformat_close_input(&input);
+		return false;
+	}
+	int video_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	int audio_index = info.has_audio ? av_find_best_stream(input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0) : -1;
+
+	// The streams must have the same codecs and codec parameters as this file's streams
+	bool is_compatible = video_index >= 0 && (!info.has_audio || (audio_st && audio_index >= 0));
+	if (is_compatible) {
+		AVCodecContext *video_context = AV_GET_CODEC_PAR_CONTEXT(video_st, video_codec);
+		AVStream *source_video = input->streams[video_index];
+		is_compatible = AV_FIND_DECODER_CODEC_ID(source_video) == video_context->codec_id &&
+						AV_GET_CODEC_ATTRIBUTES(source_video, source_video->codec)->width == video_context->width &&
+						AV_GET_CODEC_ATTRIBUTES(source_video, source_video->codec)->height == video_context->height &&
+						AV_GET_CODEC_PIXEL_FORMAT(source_video, source_video->codec) == video_context->pix_fmt &&
+						AV_GET_CODEC_ATTRIBUTES(source_video, source_video->codec)->extradata_size == video_context->extradata_size &&
+						(video_context->extradata_size == 0 ||
+						 memcmp(AV_GET_CODEC_ATTRIBUTES(source_video, source_video->codec)->extradata, video_context->extradata, video_context->extradata_size) == 0);
+	}
+	if (is_compatible && info.has_audio) {
+		AVCodecContext *audio_context = AV_GET_CODEC_PAR_CONTEXT(audio_st, audio_codec);
+		AVStream *source_audio = input->streams[audio_index];
+		is_compatible = AV_FIND_DECODER_CODEC_ID(source_audio) == audio_context->codec_id &&
+						AV_GET_CODEC_ATTRIBUTES(source_audio, source_audio->codec)->sample_rate == audio_context->sample_rate &&
+						AV_GET_CODEC_ATTRIBUTES(source_audio, source_audio->codec)->channels == audio_context->channels &&
+						AV_GET_CODEC_ATTRIBUTES(source_audio, source_audio->codec)->extradata_size == audio_context->extradata_size &&
+						(audio_context->extradata_size == 0 ||
+						 memcmp(AV_GET_CODEC_ATTRIBUTES(source_audio, source_audio->codec)->extradata, audio_context->extradata, audio_context->extradata_size) == 0);
+	}
+	if (!is_compatible) {
+		avformat_close_input(&input);
+		return false;
+	}
+
+	// The timestamps of the first frame (and the frame after the last frame) of the range
+	AVStream *source_video = input->streams[video_index];
+	AVRational frame_duration = {info.fps.den, info.fps.num};
+	int64_t video_start_time = source_video->start_time != AV_NOPTS_VALUE ? source_video->start_time : 0;
+	int64_t video_base = video_start_time + av_rescale_q(source_start - 1, frame_duration, source_video->time_base);
+	double frames_per_tick = av_q2d(source_video->time_base) * info.fps.ToDouble();
+
+	// Find the keyframes of the range (only closed GOPs can be copied, since the frames before a keyframe of an open
+	// GOP are decoded after it, and reference the previous GOP)
+	std::vector<int64_t> keyframes;
+	int64_t last_frame = 0;
+	int64_t keyframe_pts = AV_NOPTS_VALUE;
+	bool is_open_gop = false;
+	bool is_eof = true;
+	AVPacket pkt;
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+	av_seek_frame(input, video_index, video_base, AVSEEK_FLAG_BACKWARD);
+	while (av_read_frame(input, &pkt) >= 0) {
+		if (pkt.stream_index == video_index && pkt.pts != AV_NOPTS_VALUE) {
+			int64_t frame = round((pkt.pts - video_start_time) * frames_per_tick) + 1;
+			if (pkt.flags & AV_PKT_FLAG_KEY) {
+				keyframe_pts = pkt.pts;
+				if (frame >= source_start && frame <= source_end + 1)
+					keyframes.push_back(frame);
+			} else if (keyframe_pts != AV_NOPTS_VALUE && pkt.pts < keyframe_pts && frame >= source_start)
+				is_open_gop = true;
+			last_frame = std::max(last_frame, frame);
+
+			// Stop after the frames which can be decoded after the frame following the range
+			if (frame > source_end + 1 + MAX_REORDERED_FRAMES) {
+				is_eof = false;
+				AV_FREE_PACKET(&pkt);
+				break;
+			}
+		}
+		AV_FREE_PACKET(&pkt);
+	}
+
+	// Copy from the first keyframe, to the last keyframe (or the end of the file)
+	if (is_eof && last_frame <= source_end)
+		keyframes.push_back(last_frame + 1);
+	if (is_open_gop || keyframes.size() < 2 || keyframes.front() > source_end || (is_eof && last_frame < source_end)) {
+		avformat_close_input(&input);
+		return false;
+	}
+	int64_t copy_start = keyframes.front();
+	int64_t copy_end = keyframes.back();
+
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::smart_render_frames", "source_start", source_start, "source_end", source_end, "copy_start", copy_start, "copy_end", copy_end);
+
+	// Re-encode the frames before the first keyframe
+	int64_t last_video_dts = AV_NOPTS_VALUE;
+	int64_t last_audio_dts = AV_NOPTS_VALUE;
+	try {
+		if (copy_start > source_start)
+			write_smart_render_range(reader, start, start + (copy_start - source_start) - 1, 0, last_video_dts);
+
+		// Copy the packets of the keyframes between (and all audio packets of the range)
+		AVStream *source_audio = audio_index >= 0 ? input->streams[audio_index] : NULL;
+		int64_t video_output_base = av_rescale_q(copy_start - source_start + 1, frame_duration, video_st->time_base);
+		int64_t video_copy_base = video_base + av_rescale_q(copy_start - source_start, frame_duration, source_video->time_base);
+		int64_t audio_base = source_audio ? av_rescale_q(video_base, source_video->time_base, source_audio->time_base) : 0;
+		int64_t audio_end = source_audio ? av_rescale_q(video_base + av_rescale_q(source_end - source_start + 1, frame_duration, source_video->time_base),
+														source_video->time_base, source_audio->time_base) : 0;
+		int64_t audio_output_base = audio_st ? av_rescale_q(1, frame_duration, audio_st->time_base) : 0;
+		bool is_video_done = false;
+		bool is_audio_done = !source_audio;
+		av_seek_frame(input, video_index, video_base, AVSEEK_FLAG_BACKWARD);
+		while ((!is_video_done || !is_audio_done) && av_read_frame(input, &pkt) >= 0) {
+			if (pkt.stream_index == video_index && pkt.pts != AV_NOPTS_VALUE && !is_video_done) {
+				int64_t frame = round((pkt.pts - video_start_time) * frames_per_tick) + 1;
+				if (frame >= copy_end && (pkt.flags & AV_PKT_FLAG_KEY))
+					is_video_done = true;
+				else if (frame >= copy_start && frame < copy_end) {
+					write_copied_packet(&pkt, source_video->time_base, video_copy_base, video_st, video_output_base, last_video_dts);
+					continue;
+				}
+			} else if (source_audio && pkt.stream_index == audio_index && pkt.pts != AV_NOPTS_VALUE && !is_audio_done) {
+				if (pkt.pts >= audio_end)
+					is_audio_done = true;
+				else if (pkt.pts >= audio_base) {
+					write_copied_packet(&pkt, source_audio->time_base, audio_base, audio_st, audio_output_base, last_audio_dts);
+					continue;
+				}
+			}
+			AV_FREE_PACKET(&pkt);
+		}
+		avformat_close_input(&input);
+
+		// Re-encode the frames from the last keyframe
+		if (copy_end <= source_end)
+			write_smart_render_range(reader, start + (copy_end - source_start), end, copy_end - source_start, last_video_dts);
+	}
+	catch (...) {
+		if (input)
+			avformat_close_input(&input);
+		throw;
+	}
+
+	// Continue the timestamps of any frames written after the copied frames
+	int64_t frames = end - start + 1;
+	AVCodecContext *video_context = AV_GET_CODEC_PAR_CONTEXT(video_st, video_codec);
+	write_video_count += av_rescale_q(frames, frame_duration, video_context->time_base);
+	if (info.has_audio && audio_st) {
+		AVCodecContext *audio_context = AV_GET_CODEC_PAR_CONTEXT(audio_st, audio_codec);
+		write_audio_count += av_rescale_q(frames, frame_duration, audio_context->time_base);
+	}
+
+	return true;
+}
+
+// Re-encode a range of frames into a temporary file, and copy its packets into this file
+void FFmpegWriter::write_smart_render_range(ReaderBase *reader, int64_t start, int64_t end, int64_t frame_offset, int64_t &last_dts) {
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_smart_render_range", "start", start, "end", end, "frame_offset", frame_offset);
 
-		// Encode frame
-		WriteFrame(f);
+	// Encode the frames with a new encoder (with the same video options as this file)
+	std::string range_path = smart_render_range_path(path, "smart-render");
+	{
+		FFmpegWriter range_writer(range_path);
+		range_writer.SetVideoOptions(true, info.vcodec, info.fps, info.width, info.height, info.pixel_ratio,
+									 info.interlaced_frame, info.top_field_first, info.video_bit_rate);
+		range_writer.PrepareStreams();
+		for (size_t index = 0; index < video_options.size(); index++)
+			range_writer.SetOption(VIDEO_STREAM, video_options[index].first, video_options[index].second);
+		range_writer.Open();
+		range_writer.WriteFrame(reader, start, end);
+		range_writer.Close();
+	}
+
+	// Copy the encoded packets (from the first frame of the file, to the frame offset of this file)
+	AVFormatContext *input = NULL;
+	if (avformat_open_input(&input, range_path.c_str(), NULL, NULL) != 0)
+		throw InvalidFile("Could not open the re-encoded frames.", range_path);
+	int stream_index = -1;
+	if (avformat_find_stream_info(input, NULL) >= 0)
+		stream_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (stream_index < 0) {
+		avformat_close_input(&input);
+		std::remove(range_path.c_str());
+		throw NoStreamsFound("No video stream found in the re-encoded frames.", range_path);
+	}
+	AVStream *range_stream = input->streams[stream_index];
+	int64_t input_base = range_stream->start_time != AV_NOPTS_VALUE ? range_stream->start_time : 0;
+	int64_t output_base = av_rescale_q(frame_offset + 1, (AVRational) {info.fps.den, info.fps.num}, video_st->time_base);
+
+	AVPacket pkt;
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+	while (av_read_frame(input, &pkt) >= 0) {
+		if (pkt.stream_index == stream_index)
+			write_copied_packet(&pkt, range_stream->time_base, input_base, video_st, output_base, last_dts);
+		else
+			AV_FREE_PACKET(&pkt);
 	}
+	avformat_close_input(&input);
+	std::remove(range_path.c_str());
+}
+
+// Write a copied packet (moving its timestamps from a base timestamp of the input stream to a base timestamp of the output stream)
+void FFmpegWriter::write_copied_packet(AVPacket *pkt, AVRational input_time_base, int64_t input_base, AVStream *output_stream, int64_t output_base, int64_t &last_dts) {
+	pkt->stream_index = output_stream->index;
+	if (pkt->pts != AV_NOPTS_VALUE)
+		pkt->pts = av_rescale_q(pkt->pts - input_base, input_time_base, output_stream->time_base) + output_base;
+	if (pkt->dts != AV_NOPTS_VALUE)
+		pkt->dts = av_rescale_q(pkt->dts - input_base, input_time_base, output_stream->time_base) + output_base;
+	if (pkt->duration > 0)
+		pkt->duration = av_rescale_q(pkt->duration, input_time_base, output_stream->time_base);
+	pkt->pos = -1;
+
+	// Decode timestamps must increase (where the re-encoded and copied packets meet, the re-encoded packets can start
+	// with negative decode timestamps, for B-frames)
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		if (last_dts != AV_NOPTS_VALUE && pkt->dts <= last_dts) {
+			pkt->dts = last_dts + 1;
+			if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+				// Overlaps the previous packets (i.e. audio encoder priming)
+				AV_FREE_PACKET(pkt);
+				return;
+			}
+		}
+		last_dts = pkt->dts;
+	}
+
+	int error_code = 0;
+	{
+		std::lock_guard<std::mutex> lock(mux_mutex);
+		error_code = av_interleaved_write_frame(oc, pkt);
+	}
+	if (error_code < 0)
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_copied_packet ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
+	AV_FREE_PACKET(pkt);
 }
 
 // Write the file trailer (after all frames are written)
 void FFmpegWriter::WriteTrailer() {
+	// Wait for the writer thread to write its queued frames (if any)
+	stop_writer();
+
 	// Write any remaining queued frames to video file
 	write_queued_frames();
 
 	// Process final audio frame (if any)
-	if (info.has_audio && audio_st)
+	if (info.has_audio && audio_st) {
 		write_audio_packets(true);
+		audio_tasks.Wait();
+	}
 
 	// Flush encoders (who sometimes hold on to frames)
 	flush_encoders();
@@ -910,7 +1428,19 @@ void FFmpegWriter::flush_encoders() {
 			/* encode the image */
 			int got_packet = 0;
 #if IS_FFMPEG_3_2
-			avcodec_send_frame(audio_codec, NULL);
+			// Drain the packets the encoder is still holding on to
+			error_code = avcodec_send_frame(audio_codec, NULL);
+			while (error_code >= 0) {
+				error_code = avcodec_receive_packet(audio_codec, &pkt);
+				if (error_code == AVERROR(EAGAIN) || error_code == AVERROR_EOF) {
+					error_code = 0;
+					break;
+				}
+				if (error_code >= 0) {
+					write_encoded_audio_packet(&pkt);
+					AV_FREE_PACKET(&pkt);
+				}
+			}
 			got_packet = 0;
 #else
 			error_code = avcodec_encode_audio2(audio_codec, &pkt, NULL, &got_packet);
@@ -971,10 +1501,8 @@ void FFmpegWriter::close_video(AVFormatContext *oc, AVStream *st)
 void FFmpegWriter::close_audio(AVFormatContext *oc, AVStream *st)
 {
 	// Clear buffers
-	delete[] samples;
 	delete[] audio_outbuf;
 	delete[] audio_encoder_buffer;
-	samples = NULL;
 	audio_outbuf = NULL;
 	audio_encoder_buffer = NULL;
 
@@ -985,11 +1513,18 @@ void FFmpegWriter::close_audio(AVFormatContext *oc, AVStream *st)
 		avr = NULL;
 	}
 
-	if (avr_planar) {
-		SWR_CLOSE(avr_planar);
-		SWR_FREE(&avr_planar);
-		avr_planar = NULL;
+	// Deallocate the audio FIFO and reusable buffers
+	if (audio_fifo) {
+		av_audio_fifo_free(audio_fifo);
+		audio_fifo = NULL;
+	}
+	if (audio_resample_data) {
+		av_freep(&audio_resample_data[0]);
+		av_freep(&audio_resample_data);
+		audio_resample_capacity = 0;
 	}
+	if (audio_encode_frame)
+		AV_FREE_FRAME(&audio_encode_frame);
 }
 
 // Close the writer
@@ -1008,6 +1543,9 @@ void FFmpegWriter::Close() {
 	if (image_rescalers.size() > 0)
 		RemoveScalers();
 
+	// Deallocate the converted frames
+	free_video_frame_ring();
+
 	if (!(fmt->flags & AVFMT_NOFILE)) {
 		/* close the output file */
 		avio_close(oc->pb);
@@ -1017,6 +1555,10 @@ void FFmpegWriter::Close() {
 	write_video_count = 0;
 	write_audio_count = 0;
 
+	// Remove the memory of any frames which were never encoded (i.e. after an error)
+	spool_memory().Add(-spooled_bytes.Value());
+	spooled_bytes.Reset();
+
 	// Free the context which frees the streams too
 	avformat_free_context(oc);
 	oc = NULL;
@@ -1030,16 +1572,37 @@ void FFmpegWriter::Close() {
 	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::Close");
 }
 
-// Add an AVFrame to the cache
-void FFmpegWriter::add_avframe(std::shared_ptr<Frame> frame, AVFrame *av_frame) {
-	// Add AVFrame to map (if it does not already exist)
-	if (!av_frames.count(frame)) {
-		// Add av_frame
-		av_frames[frame] = av_frame;
-	} else {
-		// Do not add, and deallocate this AVFrame
+// Allocate the ring of converted frames (if it has fewer frames than the batch size)
+void FFmpegWriter::allocate_video_frame_ring(int batch_size) {
+	// Determine the pixel format of the converted frames
+#if IS_FFMPEG_3_2
+	PixelFormat final_pix_fmt = (PixelFormat)(video_st->codecpar->format);
+	if (hw_en_on && hw_en_supported)
+		final_pix_fmt = AV_PIX_FMT_NV12;
+#else
+	PixelFormat final_pix_fmt = video_codec->pix_fmt;
+#endif
+
+	// Add frames (the ring only grows, i.e. when the cache size grows)
+	while (video_frame_ring.size() < batch_size) {
+		int bytes_final = 0;
+		video_frame_ring.push_back(allocate_avframe(final_pix_fmt, info.width, info.height, &bytes_final, NULL));
+	}
+}
+
+// Deallocate the ring of converted frames
+void FFmpegWriter::free_video_frame_ring() {
+	for (int index = 0; index < video_frame_ring.size(); index++) {
+		AVFrame *av_frame = video_frame_ring[index];
+		av_freep(&(av_frame->data[0]));
 		AV_FREE_FRAME(&av_frame);
 	}
+	video_frame_ring.clear();
+
+	// The last converted image is gone with its ring frame
+	last_image_key = 0;
+	last_planes.reset();
+	last_image_position = -1;
 }
 
 // Add an audio output stream
@@ -1209,6 +1772,9 @@ AVStream *FFmpegWriter::add_video_stream() {
 	st->time_base.den = info.video_timebase.den;
 
 	c->gop_size = 12; /* TODO: add this to "info"... emit one intra frame every twelve frames at most */
+	if (segment_format != SEGMENT_NONE)
+		// Segments start at keyframes (so emit one keyframe per segment)
+		c->gop_size = std::max(1, (int) round(segment_seconds * info.fps.ToDouble()));
 	c->max_b_frames = 10;
 	if (c->codec_id == AV_CODEC_ID_MPEG2VIDEO)
 		/* just for testing, we also add B frames */
@@ -1269,7 +1835,7 @@ void FFmpegWriter::open_audio(AVFormatContext *oc, AVStream *st) {
 	AV_GET_CODEC_FROM_STREAM(st, audio_codec)
 
 	// Set number of threads equal to number of processors (not to exceed 16)
-	audio_codec->thread_count = std::min(FF_NUM_PROCESSORS, 16);
+	audio_codec->thread_count = std::min(FF_ENCODE_NUM_PROCESSORS, 16);
 
 	// Find the audio encoder
 	codec = avcodec_find_encoder_by_name(info.acodec.c_str());
@@ -1315,8 +1881,18 @@ void FFmpegWriter::open_audio(AVFormatContext *oc, AVStream *st) {
 	// Set the initial frame size (since it might change during resampling)
 	initial_audio_input_frame_size = audio_input_frame_size;
 
-	// Allocate array for samples
-	samples = new int16_t[AVCODEC_MAX_AUDIO_FRAME_SIZE];
+	// Allocate the FIFO of resampled samples, and the reusable frame sent to the encoder
+	audio_fifo = av_audio_fifo_alloc(audio_codec->sample_fmt, info.channels, audio_input_frame_size * 2);
+	audio_encode_frame = AV_ALLOCATE_FRAME();
+	if (!audio_fifo || !audio_encode_frame)
+		throw OutOfMemory("Could not allocate the audio encoding buffers.", path);
+	audio_encode_frame->nb_samples = audio_input_frame_size;
+	audio_encode_frame->format = audio_codec->sample_fmt;
+	audio_encode_frame->channel_layout = info.channel_layout;
+	audio_encode_frame->channels = info.channels;
+	audio_encode_frame->sample_rate = info.sample_rate;
+	if (av_frame_get_buffer(audio_encode_frame, 0) < 0)
+		throw OutOfMemory("Could not allocate the audio encoding frame.", path);
 
 	// Set audio output buffer (used to store the encoded audio)
 	audio_outbuf_size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
@@ -1340,7 +1916,7 @@ void FFmpegWriter::open_video(AVFormatContext *oc, AVStream *st) {
 	AV_GET_CODEC_FROM_STREAM(st, video_codec)
 
 	// Set number of threads equal to number of processors (not to exceed 16)
-	video_codec->thread_count = std::min(FF_NUM_PROCESSORS, 16);
+	video_codec->thread_count = std::min(FF_ENCODE_NUM_PROCESSORS, 16);
 
 #if IS_FFMPEG_3_2
 	if (hw_en_on && hw_en_supported) {
@@ -1444,9 +2020,10 @@ void FFmpegWriter::open_video(AVFormatContext *oc, AVStream *st) {
 				break;
 		}
 
-		// set hw_frames_ctx for encoder's AVCodecContext
+		// set hw_frames_ctx for encoder's AVCodecContext (with a surface for each frame of a batch, which are
+		// uploaded while converting them, and for the frames the encoder keeps in flight)
 		int err;
-		if ((err = set_hwframe_ctx(video_codec, hw_device_ctx, info.width, info.height)) < 0) {
+		if ((err = set_hwframe_ctx(video_codec, hw_device_ctx, info.width, info.height, cache_size + HW_EN_SURFACES_IN_FLIGHT)) < 0) {
 				ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::open_video (set_hwframe_ctx) ERROR faled to set hwframe context",
 					"width", info.width, "height", info.height, av_err2str(err), -1);
 		}
@@ -1472,362 +2049,175 @@ void FFmpegWriter::open_video(AVFormatContext *oc, AVStream *st) {
 
 // write all queued frames' audio to the video file
 void FFmpegWriter::write_audio_packets(bool is_final) {
-#pragma omp task firstprivate(is_final)
-	{
-		// Init audio buffers / variables
-		int total_frame_samples = 0;
-		int frame_position = 0;
-		int channels_in_frame = 0;
-		int sample_rate_in_frame = 0;
-		int samples_in_frame = 0;
-		ChannelLayout channel_layout_in_frame = LAYOUT_MONO; // default channel layout
-
-		// Create a new array (to hold all S16 audio samples, for the current queued frames
-		int16_t *all_queued_samples = (int16_t *) av_malloc((sizeof(int16_t) * (queued_audio_frames.size() * AVCODEC_MAX_AUDIO_FRAME_SIZE)));
-		int16_t *all_resampled_samples = NULL;
-		int16_t *final_samples_planar = NULL;
-		int16_t *final_samples = NULL;
-
-		// Loop through each queued audio frame
-		while (!queued_audio_frames.empty()) {
-			// Get front frame (from the queue)
-			std::shared_ptr<Frame> frame = queued_audio_frames.front();
-
-			// Get the audio details from this frame
-			sample_rate_in_frame = frame->SampleRate();
-			samples_in_frame = frame->GetAudioSamplesCount();
-			channels_in_frame = frame->GetAudioChannelsCount();
-			channel_layout_in_frame = frame->ChannelsLayout();
-
-
-			// Get audio sample array
-			float *frame_samples_float = NULL;
-			// Get samples interleaved together (c1 c2 c1 c2 c1 c2)
-			frame_samples_float = frame->GetInterleavedAudioSamples(sample_rate_in_frame, NULL, &samples_in_frame);
-
-
-			// Calculate total samples
-			total_frame_samples = samples_in_frame * channels_in_frame;
-
-			// Translate audio sample values back to 16 bit integers
-			for (int s = 0; s < total_frame_samples; s++, frame_position++)
-				// Translate sample value and copy into buffer
-				all_queued_samples[frame_position] = int(frame_samples_float[s] * (1 << 15));
-
-
-			// Deallocate float array
-			delete[] frame_samples_float;
-
-			// Remove front item
-			queued_audio_frames.pop_front();
-
-		} // end while
-
+	// Wait for the previous audio (since the samples are resampled & encoded in order)
+	audio_tasks.Wait();
 
-		// Update total samples (since we've combined all queued frames)
-		total_frame_samples = frame_position;
-		int remaining_frame_samples = total_frame_samples;
-		int samples_position = 0;
+	// Take the queued audio frames (so the next frames can be queued while these are encoded)
+	std::deque<std::shared_ptr<Frame> > audio_frames;
+	audio_frames.swap(queued_audio_frames);
 
+	ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets", "is_final", is_final, "audio_frames.size()", audio_frames.size(), "audio_input_frame_size", audio_input_frame_size);
 
-		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets", "is_final", is_final, "total_frame_samples", total_frame_samples, "channel_layout_in_frame", channel_layout_in_frame, "channels_in_frame", channels_in_frame, "samples_in_frame", samples_in_frame, "LAYOUT_MONO", LAYOUT_MONO);
+	// Resample and encode the audio on its own task (in parallel with converting and encoding the video)
+	audio_tasks.Run([this, audio_frames, is_final]()
+	{
+		// Resample each frame's audio into the FIFO (in a single pass)
+		for (int index = 0; index < audio_frames.size(); index++)
+			resample_audio_frame(audio_frames[index]);
 
-		// Keep track of the original sample format
-		AVSampleFormat output_sample_fmt = audio_codec->sample_fmt;
+		// Encode each full frame of samples (and the remaining samples, if final)
+		encode_audio_fifo(is_final);
 
-		AVFrame *audio_frame = NULL;
-		if (!is_final) {
-			// Create input frame (and allocate arrays)
-			audio_frame = AV_ALLOCATE_FRAME();
-			AV_RESET_FRAME(audio_frame);
-			audio_frame->nb_samples = total_frame_samples / channels_in_frame;
+	}); // end task
+}
 
-			// Fill input frame with sample data
-			avcodec_fill_audio_frame(audio_frame, channels_in_frame, AV_SAMPLE_FMT_S16, (uint8_t *) all_queued_samples,
-									 audio_encoder_buffer_size, 0);
+// Resample a frame's audio into the audio FIFO (in the encoder's sample format)
+void FFmpegWriter::resample_audio_frame(std::shared_ptr<Frame> frame) {
+	// Get the audio details from this frame
+	int sample_rate_in_frame = frame->SampleRate();
+	int samples_in_frame = frame->GetAudioSamplesCount();
+	int channels_in_frame = frame->GetAudioChannelsCount();
+	ChannelLayout channel_layout_in_frame = frame->ChannelsLayout();
+	if (samples_in_frame <= 0 || channels_in_frame <= 0)
+		return;
 
-			// Do not convert audio to planar format (yet). We need to keep everything interleaved at this point.
-			switch (audio_codec->sample_fmt) {
-				case AV_SAMPLE_FMT_FLTP: {
-					output_sample_fmt = AV_SAMPLE_FMT_FLT;
-					break;
-				}
-				case AV_SAMPLE_FMT_S32P: {
-					output_sample_fmt = AV_SAMPLE_FMT_S32;
-					break;
-				}
-				case AV_SAMPLE_FMT_S16P: {
-					output_sample_fmt = AV_SAMPLE_FMT_S16;
-					break;
-				}
-				case AV_SAMPLE_FMT_U8P: {
-					output_sample_fmt = AV_SAMPLE_FMT_U8;
-					break;
-				}
-			}
+	// setup resample context (from the frame's planar float samples, straight to the encoder's sample format)
+	if (!avr) {
+		avr = SWR_ALLOC();
+		av_opt_set_int(avr, "in_channel_layout", channel_layout_in_frame, 0);
+		av_opt_set_int(avr, "out_channel_layout", info.channel_layout, 0);
+		av_opt_set_int(avr, "in_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
+		av_opt_set_int(avr, "out_sample_fmt", audio_codec->sample_fmt, 0);
+		av_opt_set_int(avr, "in_sample_rate", sample_rate_in_frame, 0);
+		av_opt_set_int(avr, "out_sample_rate", info.sample_rate, 0);
+		av_opt_set_int(avr, "in_channels", channels_in_frame, 0);
+		av_opt_set_int(avr, "out_channels", info.channels, 0);
+		SWR_INIT(avr);
+	}
 
-			// Update total samples & input frame size (due to bigger or smaller data types)
-			total_frame_samples *= (float(info.sample_rate) / sample_rate_in_frame); // adjust for different byte sizes
-			total_frame_samples *= (float(info.channels) / channels_in_frame); // adjust for different # of channels
-
-			// Set remaining samples
-			remaining_frame_samples = total_frame_samples;
-
-			// Create output frame (and allocate arrays)
-			AVFrame *audio_converted = AV_ALLOCATE_FRAME();
-			AV_RESET_FRAME(audio_converted);
-			audio_converted->nb_samples = total_frame_samples / channels_in_frame;
-			av_samples_alloc(audio_converted->data, audio_converted->linesize, info.channels, audio_converted->nb_samples, output_sample_fmt, 0);
-
-			ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets (1st resampling)", "in_sample_fmt", AV_SAMPLE_FMT_S16, "out_sample_fmt", output_sample_fmt, "in_sample_rate", sample_rate_in_frame, "out_sample_rate", info.sample_rate, "in_channels", channels_in_frame, "out_channels", info.channels);
-
-			// setup resample context
-			if (!avr) {
-				avr = SWR_ALLOC();
-				av_opt_set_int(avr, "in_channel_layout", channel_layout_in_frame, 0);
-				av_opt_set_int(avr, "out_channel_layout", info.channel_layout, 0);
-				av_opt_set_int(avr, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-				av_opt_set_int(avr, "out_sample_fmt", output_sample_fmt, 0); // planar not allowed here
-				av_opt_set_int(avr, "in_sample_rate", sample_rate_in_frame, 0);
-				av_opt_set_int(avr, "out_sample_rate", info.sample_rate, 0);
-				av_opt_set_int(avr, "in_channels", channels_in_frame, 0);
-				av_opt_set_int(avr, "out_channels", info.channels, 0);
-				SWR_INIT(avr);
-			}
-			int nb_samples = 0;
-
-			// Convert audio samples
-			nb_samples = SWR_CONVERT(avr,    // audio resample context
-									 audio_converted->data,           // output data pointers
-									 audio_converted->linesize[0],    // output plane size, in bytes. (0 if unknown)
-									 audio_converted->nb_samples,     // maximum number of samples that the output buffer can hold
-									 audio_frame->data,               // input data pointers
-									 audio_frame->linesize[0],        // input plane size, in bytes (0 if unknown)
-									 audio_frame->nb_samples);        // number of input samples to convert
-
-			// Create a new array (to hold all resampled S16 audio samples)
-			all_resampled_samples = (int16_t *) av_malloc(
-					sizeof(int16_t) * nb_samples * info.channels * (av_get_bytes_per_sample(output_sample_fmt) / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16)));
-
-			// Copy audio samples over original samples
-			memcpy(all_resampled_samples, audio_converted->data[0], nb_samples * info.channels * av_get_bytes_per_sample(output_sample_fmt));
-
-			// Remove converted audio
-			av_freep(&(audio_frame->data[0]));
-			AV_FREE_FRAME(&audio_frame);
-			av_freep(&audio_converted->data[0]);
-			AV_FREE_FRAME(&audio_converted);
-			all_queued_samples = NULL; // this array cleared with above call
-
-			ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets (Successfully completed 1st resampling)", "nb_samples", nb_samples, "remaining_frame_samples", remaining_frame_samples);
+	// Grow the reusable output buffer (if needed), with room for the resampler's delayed samples
+	int max_samples = (int) av_rescale_rnd(samples_in_frame, info.sample_rate, sample_rate_in_frame, AV_ROUND_UP) + 256;
+	if (max_samples > audio_resample_capacity) {
+		if (audio_resample_data) {
+			av_freep(&audio_resample_data[0]);
+			av_freep(&audio_resample_data);
 		}
+		if (av_samples_alloc_array_and_samples(&audio_resample_data, NULL, info.channels, max_samples, audio_codec->sample_fmt, 0) < 0)
+			throw OutOfMemory("Could not allocate the audio resampling buffer.", path);
+		audio_resample_capacity = max_samples;
+	}
 
-		// Loop until no more samples
-		while (remaining_frame_samples > 0 || is_final) {
-			// Get remaining samples needed for this packet
-			int remaining_packet_samples = (audio_input_frame_size * info.channels) - audio_input_position;
-
-			// Determine how many samples we need
-			int diff = 0;
-			if (remaining_frame_samples >= remaining_packet_samples)
-				diff = remaining_packet_samples;
-			else if (remaining_frame_samples < remaining_packet_samples)
-				diff = remaining_frame_samples;
-
-			// Copy frame samples into the packet samples array
-			if (!is_final)
-				//TODO: Make this more sane
-				memcpy(samples + (audio_input_position * (av_get_bytes_per_sample(output_sample_fmt) / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16))),
-					   all_resampled_samples + samples_position, diff * av_get_bytes_per_sample(output_sample_fmt));
-
-			// Increment counters
-			audio_input_position += diff;
-			samples_position += diff * (av_get_bytes_per_sample(output_sample_fmt) / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16));
-			remaining_frame_samples -= diff;
-			remaining_packet_samples -= diff;
-
-			// Do we have enough samples to proceed?
-			if (audio_input_position < (audio_input_frame_size * info.channels) && !is_final)
-				// Not enough samples to encode... so wait until the next frame
-				break;
-
-			// Convert to planar (if needed by audio codec)
-			AVFrame *frame_final = AV_ALLOCATE_FRAME();
-			AV_RESET_FRAME(frame_final);
-			if (av_sample_fmt_is_planar(audio_codec->sample_fmt)) {
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets (2nd resampling for Planar formats)", "in_sample_fmt", output_sample_fmt, "out_sample_fmt", audio_codec->sample_fmt, "in_sample_rate", info.sample_rate, "out_sample_rate", info.sample_rate, "in_channels", info.channels, "out_channels", info.channels);
-
-				// setup resample context
-				if (!avr_planar) {
-					avr_planar = SWR_ALLOC();
-					av_opt_set_int(avr_planar, "in_channel_layout", info.channel_layout, 0);
-					av_opt_set_int(avr_planar, "out_channel_layout", info.channel_layout, 0);
-					av_opt_set_int(avr_planar, "in_sample_fmt", output_sample_fmt, 0);
-					av_opt_set_int(avr_planar, "out_sample_fmt", audio_codec->sample_fmt, 0); // planar not allowed here
-					av_opt_set_int(avr_planar, "in_sample_rate", info.sample_rate, 0);
-					av_opt_set_int(avr_planar, "out_sample_rate", info.sample_rate, 0);
-					av_opt_set_int(avr_planar, "in_channels", info.channels, 0);
-					av_opt_set_int(avr_planar, "out_channels", info.channels, 0);
-					SWR_INIT(avr_planar);
-				}
-
-				// Create input frame (and allocate arrays)
-				audio_frame = AV_ALLOCATE_FRAME();
-				AV_RESET_FRAME(audio_frame);
-				audio_frame->nb_samples = audio_input_position / info.channels;
-
-				// Create a new array
-				final_samples_planar = (int16_t *) av_malloc(
-						sizeof(int16_t) * audio_frame->nb_samples * info.channels * (av_get_bytes_per_sample(output_sample_fmt) / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16)));
-
-				// Copy audio into buffer for frame
-				memcpy(final_samples_planar, samples, audio_frame->nb_samples * info.channels * av_get_bytes_per_sample(output_sample_fmt));
-
-				// Fill input frame with sample data
-				avcodec_fill_audio_frame(audio_frame, info.channels, output_sample_fmt, (uint8_t *) final_samples_planar,
-										 audio_encoder_buffer_size, 0);
-
-				// Create output frame (and allocate arrays)
-				frame_final->nb_samples = audio_input_frame_size;
-				av_samples_alloc(frame_final->data, frame_final->linesize, info.channels, frame_final->nb_samples, audio_codec->sample_fmt, 0);
-
-				// Convert audio samples
-				int nb_samples = SWR_CONVERT(avr_planar,    // audio resample context
-											 frame_final->data,           // output data pointers
-											 frame_final->linesize[0],    // output plane size, in bytes. (0 if unknown)
-											 frame_final->nb_samples,     // maximum number of samples that the output buffer can hold
-											 audio_frame->data,           // input data pointers
-											 audio_frame->linesize[0],    // input plane size, in bytes (0 if unknown)
-											 audio_frame->nb_samples);    // number of input samples to convert
-
-				// Copy audio samples over original samples
-				if (nb_samples > 0)
-					memcpy(samples, frame_final->data[0], nb_samples * av_get_bytes_per_sample(audio_codec->sample_fmt) * info.channels);
-
-				// deallocate AVFrame
-				av_freep(&(audio_frame->data[0]));
-				AV_FREE_FRAME(&audio_frame);
-				all_queued_samples = NULL; // this array cleared with above call
-
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets (Successfully completed 2nd resampling for Planar formats)", "nb_samples", nb_samples);
-
-			} else {
-				// Create a new array
-				final_samples = (int16_t *) av_malloc(
-						sizeof(int16_t) * audio_input_position * (av_get_bytes_per_sample(audio_codec->sample_fmt) / av_get_bytes_per_sample(AV_SAMPLE_FMT_S16)));
-
-				// Copy audio into buffer for frame
-				memcpy(final_samples, samples, audio_input_position * av_get_bytes_per_sample(audio_codec->sample_fmt));
-
-				// Init the nb_samples property
-				frame_final->nb_samples = audio_input_frame_size;
-
-				// Fill the final_frame AVFrame with audio (non planar)
-				avcodec_fill_audio_frame(frame_final, audio_codec->channels, audio_codec->sample_fmt, (uint8_t *) final_samples,
-										 audio_encoder_buffer_size, 0);
-			}
+	// Point at each channel of the frame's (planar float) samples
+	std::vector<const uint8_t *> frame_data(channels_in_frame);
+	for (int channel = 0; channel < channels_in_frame; channel++)
+		frame_data[channel] = (const uint8_t *) frame->GetAudioSamples(channel);
+
+	// Convert audio samples
+	int nb_samples = SWR_CONVERT(avr,                        // audio resample context
+								 audio_resample_data,        // output data pointers
+								 0,                          // output plane size, in bytes. (0 if unknown)
+								 audio_resample_capacity,    // maximum number of samples that the output buffer can hold
+								 frame_data.data(),          // input data pointers
+								 0,                          // input plane size, in bytes (0 if unknown)
+								 samples_in_frame);          // number of input samples to convert
+
+	// Add the resampled samples to the FIFO
+	if (nb_samples > 0)
+		av_audio_fifo_write(audio_fifo, (void **) audio_resample_data, nb_samples);
+}
 
-			// Increment PTS (in samples)
-			write_audio_count += FFMIN(audio_input_frame_size, audio_input_position);
-			frame_final->pts = write_audio_count; // Set the AVFrame's PTS
+// Encode the full frames of samples in the audio FIFO (and the remaining samples, if final)
+void FFmpegWriter::encode_audio_fifo(bool is_final) {
+	// Flush the resampler's delayed samples into the FIFO
+	if (is_final && avr && audio_resample_data) {
+		int nb_samples = SWR_CONVERT(avr, audio_resample_data, 0, audio_resample_capacity, NULL, 0, 0);
+		if (nb_samples > 0)
+			av_audio_fifo_write(audio_fifo, (void **) audio_resample_data, nb_samples);
+	}
 
-			// Init the packet
-			AVPacket pkt;
-			av_init_packet(&pkt);
-			pkt.data = audio_encoder_buffer;
-			pkt.size = audio_encoder_buffer_size;
+	// Loop until there are not enough samples for a full frame (or no samples left, if final)
+	while (av_audio_fifo_size(audio_fifo) >= audio_input_frame_size || (is_final && av_audio_fifo_size(audio_fifo) > 0)) {
+		// Make sure the encoder is not using the reusable frame anymore (or give it a new buffer)
+		AVFrame *frame_final = audio_encode_frame;
+		frame_final->nb_samples = audio_input_frame_size;
+		if (av_frame_make_writable(frame_final) < 0)
+			throw OutOfMemory("Could not allocate the audio encoding frame.", path);
+
+		// Read the next frame of samples
+		int nb_samples = av_audio_fifo_read(audio_fifo, (void **) frame_final->data, audio_input_frame_size);
+		if (nb_samples < audio_input_frame_size) {
+			if (audio_codec->frame_size > 1)
+				// Codecs with a fixed frame size get the last frame padded with silence
+				av_samples_set_silence(frame_final->data, nb_samples, audio_input_frame_size - nb_samples, info.channels, audio_codec->sample_fmt);
+			else
+				frame_final->nb_samples = nb_samples;
+		}
 
-			// Set the packet's PTS prior to encoding
-			pkt.pts = pkt.dts = write_audio_count;
+		// Increment PTS (in samples)
+		write_audio_count += nb_samples;
+		frame_final->pts = write_audio_count; // Set the AVFrame's PTS
 
-			/* encode the audio samples */
-			int got_packet_ptr = 0;
+		// Init the packet
+		AVPacket pkt;
+		av_init_packet(&pkt);
+		pkt.data = NULL;
+		pkt.size = 0;
 
 #if IS_FFMPEG_3_2
-			// Encode audio (latest version of FFmpeg)
-			int error_code;
-			int ret = 0;
-			int frame_finished = 0;
-			error_code = ret =  avcodec_send_frame(audio_codec, frame_final);
-			if (ret < 0 && ret !=  AVERROR(EINVAL) && ret != AVERROR_EOF) {
-				avcodec_send_frame(audio_codec, NULL);
-			}
-			else {
-				if (ret >= 0)
-					pkt.size = 0;
-				ret =  avcodec_receive_packet(audio_codec, &pkt);
-				if (ret >= 0)
-					frame_finished = 1;
-				if(ret == AVERROR(EINVAL) || ret == AVERROR_EOF) {
-					avcodec_flush_buffers(audio_codec);
-					ret = 0;
-				}
-				if (ret >= 0) {
-					ret = frame_finished;
-				}
+		// Encode audio (latest version of FFmpeg), and write every packet the encoder has finished
+		int error_code = avcodec_send_frame(audio_codec, frame_final);
+		while (error_code >= 0) {
+			error_code = avcodec_receive_packet(audio_codec, &pkt);
+			if (error_code == AVERROR(EAGAIN) || error_code == AVERROR_EOF) {
+				error_code = 0;
+				break;
 			}
-			if (!pkt.data && !frame_finished)
-			{
-				ret = -1;
+			if (error_code >= 0) {
+				write_encoded_audio_packet(&pkt);
+				AV_FREE_PACKET(&pkt);
 			}
-			got_packet_ptr = ret;
+		}
 #else
-			// Encode audio (older versions of FFmpeg)
-			int error_code = avcodec_encode_audio2(audio_codec, &pkt, frame_final, &got_packet_ptr);
-#endif
-			/* if zero size, it means the image was buffered */
-			if (error_code == 0 && got_packet_ptr) {
-
-				// Since the PTS can change during encoding, set the value again.  This seems like a huge hack,
-				// but it fixes lots of PTS related issues when I do this.
-				pkt.pts = pkt.dts = write_audio_count;
-
-				// Scale the PTS to the audio stream timebase (which is sometimes different than the codec's timebase)
-				if (pkt.pts != AV_NOPTS_VALUE)
-					pkt.pts = av_rescale_q(pkt.pts, audio_codec->time_base, audio_st->time_base);
-				if (pkt.dts != AV_NOPTS_VALUE)
-					pkt.dts = av_rescale_q(pkt.dts, audio_codec->time_base, audio_st->time_base);
-				if (pkt.duration > 0)
-					pkt.duration = av_rescale_q(pkt.duration, audio_codec->time_base, audio_st->time_base);
-
-				// set stream
-				pkt.stream_index = audio_st->index;
-				pkt.flags |= AV_PKT_FLAG_KEY;
-
-				/* write the compressed frame in the media file */
-				int error_code = av_interleaved_write_frame(oc, &pkt);
-				if (error_code < 0) {
-					ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
-				}
-			}
-
-			if (error_code < 0) {
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
-			}
-
-			// deallocate AVFrame
-			av_freep(&(frame_final->data[0]));
-			AV_FREE_FRAME(&frame_final);
-
-			// deallocate memory for packet
-			AV_FREE_PACKET(&pkt);
-
-			// Reset position
-			audio_input_position = 0;
-			is_final = false;
+		// Encode audio (older versions of FFmpeg)
+		pkt.data = audio_encoder_buffer;
+		pkt.size = audio_encoder_buffer_size;
+		int got_packet_ptr = 0;
+		int error_code = avcodec_encode_audio2(audio_codec, &pkt, frame_final, &got_packet_ptr);
+		if (error_code == 0 && got_packet_ptr) {
+			// Since the PTS can change during encoding, set the value again.  This seems like a huge hack,
+			// but it fixes lots of PTS related issues when I do this.
+			pkt.pts = pkt.dts = write_audio_count;
+			write_encoded_audio_packet(&pkt);
 		}
+		AV_FREE_PACKET(&pkt);
+#endif
 
-		// Delete arrays (if needed)
-		if (all_resampled_samples) {
-			av_freep(&all_resampled_samples);
-			all_resampled_samples = NULL;
-		}
-		if (all_queued_samples) {
-			av_freep(&all_queued_samples);
-			all_queued_samples = NULL;
+		if (error_code < 0) {
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
 		}
+	}
+}
 
-	} // end task
+// Write an encoded audio packet to the audio file
+void FFmpegWriter::write_encoded_audio_packet(AVPacket *pkt) {
+	// Scale the PTS to the audio stream timebase (which is sometimes different than the codec's timebase)
+	if (pkt->pts != AV_NOPTS_VALUE)
+		pkt->pts = av_rescale_q(pkt->pts, audio_codec->time_base, audio_st->time_base);
+	if (pkt->dts != AV_NOPTS_VALUE)
+		pkt->dts = av_rescale_q(pkt->dts, audio_codec->time_base, audio_st->time_base);
+	if (pkt->duration > 0)
+		pkt->duration = av_rescale_q(pkt->duration, audio_codec->time_base, audio_st->time_base);
+
+	// set stream
+	pkt->stream_index = audio_st->index;
+	pkt->flags |= AV_PKT_FLAG_KEY;
+
+	/* write the compressed frame in the media file (video packets are written from another thread) */
+	const std::lock_guard<std::mutex> lock(mux_mutex);
+	int error_code = av_interleaved_write_frame(oc, pkt);
+	if (error_code < 0) {
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_audio_packets ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
+	}
 }
 
 // Allocate an AVFrame object
@@ -1859,7 +2249,7 @@ AVFrame *FFmpegWriter::allocate_avframe(PixelFormat pix_fmt, int width, int heig
 }
 
 // process video frame
-void FFmpegWriter::process_video_packet(std::shared_ptr<Frame> frame) {
+void FFmpegWriter::process_video_packet(std::shared_ptr<Frame> frame, int position) {
 	// Determine the height & width of the source image
 	int source_image_width = frame->GetWidth();
 	int source_image_height = frame->GetHeight();
@@ -1868,6 +2258,20 @@ void FFmpegWriter::process_video_packet(std::shared_ptr<Frame> frame) {
 	if (source_image_height == 1 && source_image_width == 1)
 		return;
 
+	// Copy the frame's native planes (if its image is unchanged since it was decoded, and the planes already
+	// have the final pixel format & size), instead of converting the RGBA image back
+	std::shared_ptr<FramePlanes> planes;
+#if IS_FFMPEG_3_2
+	planes = frame->GetPlanes();
+	PixelFormat ring_pix_fmt = (PixelFormat) video_frame_ring[position]->format;
+	if (planes && (planes->pixel_format != ring_pix_fmt || planes->width != info.width || planes->height != info.height))
+		planes.reset();
+#endif
+
+	// Skip the conversion of an image which was just converted
+	if (reuse_video_frame(frame, position, (bool) planes))
+		return;
+
 	// Init rescalers (if not initialized yet)
 	if (image_rescalers.size() == 0)
 		InitScalers(source_image_width, source_image_height);
@@ -1878,48 +2282,131 @@ void FFmpegWriter::process_video_packet(std::shared_ptr<Frame> frame) {
 	if (rescaler_position == num_of_rescalers)
 		rescaler_position = 0;
 
-#pragma omp task firstprivate(frame, scaler, source_image_width, source_image_height)
+	// Convert frame on the shared task pool
+	encoding_tasks.Run([this, frame, planes, position, scaler, source_image_width, source_image_height]()
 	{
-		// Allocate an RGB frame & final output frame
-		int bytes_source = 0;
-		int bytes_final = 0;
-		AVFrame *frame_source = NULL;
-		const uchar *pixels = NULL;
+		// Get the preallocated final output frame (of this position in the batch)
+		AVFrame *frame_final = video_frame_ring[position];
+		PixelFormat final_pix_fmt = (PixelFormat) frame_final->format;
+		int bytes_final = AV_GET_IMAGE_SIZE(final_pix_fmt, info.width, info.height);
 
-		// Get a list of pixels from source image
-		pixels = frame->GetPixels();
-
-		// Init AVFrame for source image & final (converted image)
-		frame_source = allocate_avframe(PIX_FMT_RGBA, source_image_width, source_image_height, &bytes_source, (uint8_t *) pixels);
 #if IS_FFMPEG_3_2
-		AVFrame *frame_final;
-		if (hw_en_on && hw_en_supported) {
-			frame_final = allocate_avframe(AV_PIX_FMT_NV12, info.width, info.height, &bytes_final, NULL);
-		} else {
-			frame_final = allocate_avframe((AVPixelFormat)(video_st->codecpar->format), info.width, info.height, &bytes_final, NULL);
+		if (planes) {
+			ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::process_video_packet (Native planes)", "frame->number", frame->number, "bytes_final", bytes_final);
+			av_image_copy(frame_final->data, frame_final->linesize, (const uint8_t **) planes->data, planes->linesize,
+						  final_pix_fmt, info.width, info.height);
+			AVFrame *surface = NULL;
+			if (hw_en_on && hw_en_supported)
+				surface = upload_hw_frame(frame_final);
+
+			// Use the (uploaded) frame at this position in the batch
+			video_frame_slots[position] = surface ? surface : frame_final;
+			return;
 		}
-#else
-		AVFrame *frame_final = allocate_avframe(video_codec->pix_fmt, info.width, info.height, &bytes_final, NULL);
 #endif
 
-		// Fill with data
-		AV_COPY_PICTURE_DATA(frame_source, (uint8_t *) pixels, PIX_FMT_RGBA, source_image_width, source_image_height);
-		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::process_video_packet", "frame->number", frame->number, "bytes_source", bytes_source, "bytes_final", bytes_final);
+		// Get a list of pixels from source image (converted to the format of the scalers, i.e. RGBA if the frame is premultiplied ARGB32)
+		QImage source_image = *frame->GetImage();
+		if (source_image.format() != scaler_image_format())
+			source_image = source_image.convertToFormat(scaler_image_format());
+
+		// Point at the source image's pixels (no RGB frame needs to be allocated)
+		const uint8_t *source_data[4] = { (const uint8_t *) source_image.constBits(), NULL, NULL, NULL };
+		int source_linesize[4] = { source_image.bytesPerLine(), 0, 0, 0 };
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::process_video_packet", "frame->number", frame->number, "bytes_source", source_image.byteCount(), "bytes_final", bytes_final);
+
+		// Resize & convert pixel format (a large image is split into slices, converted in parallel)
+		PixelFormat source_pix_fmt = PIX_FMT_RGBA;
+#ifdef USE_RGBA64_IMAGES
+		if (scaler_image_format() == QImage::Format_RGBA64)
+			source_pix_fmt = AV_PIX_FMT_RGBA64;
+#endif
+		if (FFmpegScaler::NumSlices(source_image_width, source_image_height, source_pix_fmt, info.width, info.height, final_pix_fmt) > 1) {
+			int scale_mode = openshot::Settings::Instance()->HIGH_QUALITY_SCALING ? SWS_BICUBIC : SWS_FAST_BILINEAR;
+			FFmpegScaler::Scale(source_data, source_linesize, source_image_width, source_image_height, source_pix_fmt,
+								frame_final->data, frame_final->linesize, info.width, info.height, final_pix_fmt, scale_mode);
+		}
+		else
+			sws_scale(scaler, source_data, source_linesize, 0,
+					  source_image_height, frame_final->data, frame_final->linesize);
 
-		// Resize & convert pixel format
-		sws_scale(scaler, frame_source->data, frame_source->linesize, 0,
-				  source_image_height, frame_final->data, frame_final->linesize);
+		// Upload the frame to the hardware encoder (while other frames are still converting)
+		AVFrame *surface = NULL;
+#if IS_FFMPEG_3_2
+		if (hw_en_on && hw_en_supported)
+			surface = upload_hw_frame(frame_final);
+#endif
+
+		// Use the resized (and uploaded) frame at this position in the batch
+		video_frame_slots[position] = surface ? surface : frame_final;
+
+	}); // end task
+
+}
 
-		// Add resized AVFrame to av_frames map
-#pragma omp critical (av_frames_section)
-		add_avframe(frame, frame_final);
+// Reuse the last converted frame for a frame with the same image
+bool FFmpegWriter::reuse_video_frame(std::shared_ptr<Frame> frame, int position, bool use_planes) {
+	// Identify the image by its planes, or by its cache key (which changes with any write to its pixels). A deferred
+	// image (or image geometry) is not loaded here, since that would load it on this thread instead of the task pool.
+	std::shared_ptr<FramePlanes> planes;
+	qint64 image_key = 0;
+	if (use_planes)
+		planes = frame->GetPlanes();
+	else if (!frame->IsImageDeferred() && !frame->HasImageGeometry())
+		image_key = frame->GetImage()->cacheKey();
+
+	bool is_same = (planes && planes == last_planes) || (image_key != 0 && image_key == last_image_key);
+	if (is_same && is_last_image_in_batch) {
+		// Encode the frame converted by this batch (once it is converted)
+		video_frame_repeats[position] = last_image_position;
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::reuse_video_frame (Repeated image)", "frame->number", frame->number, "position", position, "last_image_position", last_image_position);
+		return true;
+	}
+
+	if (is_same && last_image_position >= position) {
+		// The frame converted by the previous batch is still in the ring (since only earlier positions are being
+		// converted), so it is copied now, before a conversion of this batch reuses its ring frame
+		AVFrame *frame_final = video_frame_ring[position];
+		if (last_image_position != position)
+			av_image_copy(frame_final->data, frame_final->linesize, (const uint8_t **) video_frame_ring[last_image_position]->data,
+						  video_frame_ring[last_image_position]->linesize, (PixelFormat) frame_final->format, info.width, info.height);
+		AVFrame *surface = NULL;
+#if IS_FFMPEG_3_2
+		if (hw_en_on && hw_en_supported)
+			surface = upload_hw_frame(frame_final);
+#endif
+		video_frame_slots[position] = surface ? surface : frame_final;
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::reuse_video_frame (Repeated image of previous batch)", "frame->number", frame->number, "position", position, "last_image_position", last_image_position);
+	}
 
-		// Deallocate memory
-		AV_FREE_FRAME(&frame_source);
+	// Later frames with the same image reuse this position
+	last_planes = planes;
+	last_image_key = image_key;
+	last_image_position = position;
+	is_last_image_in_batch = true;
+	return video_frame_slots[position] != NULL;
+}
 
-	} // end task
+#if IS_FFMPEG_3_2
+// Upload a converted frame to a surface of the hardware encoder's pool
+AVFrame *FFmpegWriter::upload_hw_frame(AVFrame *frame_final) {
+	if (!video_codec->hw_frames_ctx)
+		return NULL;
+
+	// Get a surface from the pool (which returns to the pool when the frame and the encoder release it)
+	AVFrame *surface = AV_ALLOCATE_FRAME();
+	if (!surface || av_hwframe_get_buffer(video_codec->hw_frames_ctx, surface, 0) < 0 ||
+		av_hwframe_transfer_data(surface, frame_final, 0) < 0) {
+		// Upload the frame when it is written instead (i.e. if the pool is out of surfaces)
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::upload_hw_frame (Failed to upload frame to surface)", "cache_size", cache_size);
+		AV_FREE_FRAME(&surface);
+		return NULL;
+	}
+	av_frame_copy_props(surface, frame_final);
 
+	return surface;
 }
+#endif
 
 // write video frame
 bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *frame_final) {
@@ -1943,7 +2430,11 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 		pkt.pts = write_video_count;
 
 		/* write the compressed frame in the media file */
-		int error_code = av_interleaved_write_frame(oc, &pkt);
+		int error_code = 0;
+		{
+			const std::lock_guard<std::mutex> lock(mux_mutex);
+			error_code = av_interleaved_write_frame(oc, &pkt);
+		}
 		if (error_code < 0) {
 			ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_video_packet ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
 			return false;
@@ -1971,7 +2462,9 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 		// Assign the initial AVFrame PTS from the frame counter
 		frame_final->pts = write_video_count;
 #if IS_FFMPEG_3_2
-		if (hw_en_on && hw_en_supported) {
+		// Frames are normally uploaded to the hardware encoder while converting them (see upload_hw_frame)
+		AVFrame *hw_frame = NULL;
+		if (hw_en_on && hw_en_supported && !frame_final->hw_frames_ctx) {
 			if (!(hw_frame = av_frame_alloc())) {
 				fprintf(stderr, "Error code: av_hwframe_alloc\n");
 			}
@@ -1996,7 +2489,7 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 		int frameFinished = 0;
 		int ret;
 
-		if (hw_en_on && hw_en_supported) {
+		if (hw_frame) {
 			ret = avcodec_send_frame(video_codec, hw_frame); //hw_frame!!!
 		} else {
 			ret = avcodec_send_frame(video_codec, frame_final);
@@ -2017,10 +2510,23 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 				ret = avcodec_receive_packet(video_codec, &pkt);
 
 				if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-					avcodec_flush_buffers(video_codec);
+					// Hardware encoders keep several surfaces in flight (so only flush software encoders)
+					if (!(hw_en_on && hw_en_supported))
+						avcodec_flush_buffers(video_codec);
 					got_packet_ptr = 0;
 					break;
 				}
+				if (ret == 0 && hw_en_on && hw_en_supported) {
+					// Write every packet the hardware encoder has finished (and keep receiving)
+					bool is_written = write_encoded_video_packet(&pkt);
+					AV_FREE_PACKET(&pkt);
+					if (!is_written) {
+						if (hw_frame)
+							av_frame_free(&hw_frame);
+						return false;
+					}
+					continue;
+				}
 				if (ret == 0) {
 					got_packet_ptr = 1;
 					break;
@@ -2065,21 +2571,9 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 			// but it fixes lots of PTS related issues when I do this.
 			//pkt.pts = pkt.dts = write_video_count;
 
-			// set the timestamp
-			if (pkt.pts != AV_NOPTS_VALUE)
-				pkt.pts = av_rescale_q(pkt.pts, video_codec->time_base, video_st->time_base);
-			if (pkt.dts != AV_NOPTS_VALUE)
-				pkt.dts = av_rescale_q(pkt.dts, video_codec->time_base, video_st->time_base);
-			if (pkt.duration > 0)
-				pkt.duration = av_rescale_q(pkt.duration, video_codec->time_base, video_st->time_base);
-			pkt.stream_index = video_st->index;
-
 			/* write the compressed frame in the media file */
-			int error_code = av_interleaved_write_frame(oc, &pkt);
-			if (error_code < 0) {
-				ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_video_packet ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
+			if (!write_encoded_video_packet(&pkt))
 				return false;
-			}
 		}
 
 		// Deallocate memory (if needed)
@@ -2089,12 +2583,8 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 		// Deallocate packet
 		AV_FREE_PACKET(&pkt);
 #if IS_FFMPEG_3_2
-		if (hw_en_on && hw_en_supported) {
-			if (hw_frame) {
-				av_frame_free(&hw_frame);
-				hw_frame = NULL;
-			}
-		}
+		if (hw_frame)
+			av_frame_free(&hw_frame);
 #endif
 	}
 
@@ -2102,12 +2592,42 @@ bool FFmpegWriter::write_video_packet(std::shared_ptr<Frame> frame, AVFrame *fra
 	return true;
 }
 
+// write an encoded video packet to the video file
+bool FFmpegWriter::write_encoded_video_packet(AVPacket *pkt) {
+	// set the timestamp
+	if (pkt->pts != AV_NOPTS_VALUE)
+		pkt->pts = av_rescale_q(pkt->pts, video_codec->time_base, video_st->time_base);
+	if (pkt->dts != AV_NOPTS_VALUE)
+		pkt->dts = av_rescale_q(pkt->dts, video_codec->time_base, video_st->time_base);
+	if (pkt->duration > 0)
+		pkt->duration = av_rescale_q(pkt->duration, video_codec->time_base, video_st->time_base);
+	pkt->stream_index = video_st->index;
+
+	/* write the compressed frame in the media file (audio packets are written from another thread) */
+	const std::lock_guard<std::mutex> lock(mux_mutex);
+	int error_code = av_interleaved_write_frame(oc, pkt);
+	if (error_code < 0) {
+		ZmqLogger::Instance()->AppendDebugMethod("FFmpegWriter::write_video_packet ERROR [" + (std::string) av_err2str(error_code) + "]", "error_code", error_code);
+		return false;
+	}
+	return true;
+}
+
 // Output the ffmpeg info about this format, streams, and codecs (i.e. dump format)
 void FFmpegWriter::OutputStreamInfo() {
 	// output debug info
 	av_dump_format(oc, 0, path.c_str(), 1);
 }
 
+// Get the image format the frame images are converted to, before scaling (RGBA, or RGBA64 for high bit depth images)
+QImage::Format FFmpegWriter::scaler_image_format() {
+#ifdef USE_RGBA64_IMAGES
+	if (Frame::ImageFormat() == QImage::Format_RGBA64)
+		return QImage::Format_RGBA64;
+#endif
+	return QImage::Format_RGBA8888;
+}
+
 // Init a collection of software rescalers (thread safe)
 void FFmpegWriter::InitScalers(int source_width, int source_height) {
 	int scale_mode = SWS_FAST_BILINEAR;
@@ -2115,16 +2635,23 @@ void FFmpegWriter::InitScalers(int source_width, int source_height) {
 		scale_mode = SWS_BICUBIC;
 	}
 
+	// The frame images are converted to RGBA (or RGBA64, for high bit depth images) before scaling
+	PixelFormat scaler_pix_fmt = PIX_FMT_RGBA;
+#ifdef USE_RGBA64_IMAGES
+	if (scaler_image_format() == QImage::Format_RGBA64)
+		scaler_pix_fmt = AV_PIX_FMT_RGBA64;
+#endif
+
 	// Init software rescalers vector (many of them, one for each thread)
 	for (int x = 0; x < num_of_rescalers; x++) {
 		// Init the software scaler from FFMpeg
 #if IS_FFMPEG_3_2
 		if (hw_en_on && hw_en_supported) {
-			img_convert_ctx = sws_getContext(source_width, source_height, PIX_FMT_RGBA, info.width, info.height, AV_PIX_FMT_NV12, scale_mode, NULL, NULL, NULL);
+			img_convert_ctx = sws_getContext(source_width, source_height, scaler_pix_fmt, info.width, info.height, AV_PIX_FMT_NV12, scale_mode, NULL, NULL, NULL);
 		} else
 #endif
 		{
-			img_convert_ctx = sws_getContext(source_width, source_height, PIX_FMT_RGBA, info.width, info.height, AV_GET_CODEC_PIXEL_FORMAT(video_st, video_st->codec), scale_mode,
+			img_convert_ctx = sws_getContext(source_width, source_height, scaler_pix_fmt, info.width, info.height, AV_GET_CODEC_PIXEL_FORMAT(video_st, video_st->codec), scale_mode,
 											 NULL, NULL, NULL);
 		}
 
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Source file for FieldKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/FieldKernels.h"
+#include "../include/TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+using namespace openshot;
+
+namespace {
+	// Images smaller than this (in bytes) are processed on the calling thread
+	const int64_t parallel_bytes = 4 * 1024 * 1024;
+
+	// Call a function for each band of rows (in parallel, for large images)
+	void for_each_band(int height, int row_bytes, std::function<void(int, int)> body) {
+		int bands = 1;
+		if ((int64_t) height * row_bytes >= parallel_bytes)
+			bands = std::min(height / 16, TaskPool::Current()->NumThreads());
+		if (bands <= 1) {
+			body(0, height);
+			return;
+		}
+
+		int band_height = (height + bands - 1) / bands;
+		TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+		{
+			int first_row = band * band_height;
+			int last_row = std::min(height, first_row + band_height);
+			if (first_row < last_row)
+				body(first_row, last_row);
+		});
+	}
+
+	// Average 2 rows of bytes (rounding up, like the pavgb / vrhadd instructions this loop compiles to)
+	void average_rows(unsigned char * __restrict target, const unsigned char * __restrict above, const unsigned char * __restrict below, int row_bytes) {
+		for (int index = 0; index < row_bytes; index++)
+			target[index] = (unsigned char) ((above[index] + below[index] + 1) >> 1);
+	}
+}
+
+// Copy the rows of one field from an image into another image
+void FieldKernels::Weave(unsigned char *target, int target_bytes_per_line, const unsigned char *source, int source_bytes_per_line, int height, int row_bytes, bool odd)
+{
+	int field = odd ? 1 : 0;
+	for_each_band(height, row_bytes, [&](int first_row, int last_row)
+	{
+		for (int row = first_row + ((first_row + field) & 1); row < last_row; row += 2)
+			memcpy(target + (size_t) row * target_bytes_per_line, source + (size_t) row * source_bytes_per_line, row_bytes);
+	});
+}
+
+// Rebuild the rows of the other field from one field of an image (in place)
+void FieldKernels::Deinterlace(unsigned char *pixels, int bytes_per_line, int height, int row_bytes, bool odd, bool interpolate)
+{
+	int field = odd ? 1 : 0;
+
+	// Not enough rows for both fields
+	if (height < 2)
+		return;
+
+	// The last row of the field (which the rows past it repeat)
+	int last_field_row = ((height - 1 - field) & ~1) + field;
+
+	for_each_band(height, row_bytes, [&](int first_row, int last_row)
+	{
+		// Only the rows of the other field are written (and only the rows of the field are read)
+		for (int row = first_row + ((first_row + field + 1) & 1); row < last_row; row += 2) {
+			unsigned char *target = pixels + (size_t) row * bytes_per_line;
+			int above = row - 1;
+			int below = std::min(row + 1, last_field_row);
+			if (above < 0)
+				above = below;
+
+			if (interpolate)
+				average_rows(target, pixels + (size_t) above * bytes_per_line, pixels + (size_t) below * bytes_per_line, row_bytes);
+			else
+				// Repeat the field row at the top of each pair of rows (the first row of the odd field
+				// is repeated above it)
+				memcpy(target, pixels + (size_t) (odd ? std::min(row + 1, last_field_row) : row - 1) * bytes_per_line, row_bytes);
+		}
+	});
+}
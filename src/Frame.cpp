@@ -29,6 +29,12 @@
  */
 
 #include "../include/Frame.h"
+#include "../include/FieldKernels.h"
+#include "../include/PixelLayout.h"
+#include "../include/Settings.h"
+
+#include <cmath>
+#include <cstdio>
 
 using namespace std;
 using namespace openshot;
@@ -36,52 +42,40 @@ using namespace openshot;
 // Constructor - blank frame (300x200 blank image, 48kHz audio silence)
 Frame::Frame() : number(1), pixel_ratio(1,1), channels(2), width(1), height(1), color("#000000"),
 		channel_layout(LAYOUT_STEREO), sample_rate(44100), qbuffer(NULL), has_audio_data(false), has_image_data(false),
-		max_audio_sample(0)
+		max_audio_sample(0), planes_image_key(0), has_geometry(false)
 {
-	// Init the image magic and audio buffer
-	audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(channels, 0));
-
-	// initialize the audio samples to zero (silence)
-	audio->clear();
+	// Init the audio buffer (with silence)
+	allocate_audio(channels, 0, false);
 };
 
 // Constructor - image only (48kHz audio silence)
 Frame::Frame(int64_t number, int width, int height, std::string color)
 	: number(number), pixel_ratio(1,1), channels(2), width(width), height(height), color(color),
 	  channel_layout(LAYOUT_STEREO), sample_rate(44100), qbuffer(NULL), has_audio_data(false), has_image_data(false),
-	  max_audio_sample(0)
+	  max_audio_sample(0), planes_image_key(0), has_geometry(false)
 {
-	// Init the image magic and audio buffer
-	audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(channels, 0));
-
-	// initialize the audio samples to zero (silence)
-	audio->clear();
+	// Init the audio buffer (with silence)
+	allocate_audio(channels, 0, false);
 };
 
 // Constructor - audio only (300x200 blank image)
 Frame::Frame(int64_t number, int samples, int channels) :
 		number(number), pixel_ratio(1,1), channels(channels), width(1), height(1), color("#000000"),
 		channel_layout(LAYOUT_STEREO), sample_rate(44100), qbuffer(NULL), has_audio_data(false), has_image_data(false),
-		max_audio_sample(0)
+		max_audio_sample(0), planes_image_key(0), has_geometry(false)
 {
-	// Init the image magic and audio buffer
-	audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(channels, samples));
-
-	// initialize the audio samples to zero (silence)
-	audio->clear();
+	// Init the audio buffer (with silence)
+	allocate_audio(channels, samples, false);
 };
 
 // Constructor - image & audio
 Frame::Frame(int64_t number, int width, int height, std::string color, int samples, int channels)
 	: number(number), pixel_ratio(1,1), channels(channels), width(width), height(height), color(color),
 	  channel_layout(LAYOUT_STEREO), sample_rate(44100), qbuffer(NULL), has_audio_data(false), has_image_data(false),
-	  max_audio_sample(0)
+	  max_audio_sample(0), planes_image_key(0), has_geometry(false)
 {
-	// Init the image magic and audio buffer
-	audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(channels, samples));
-
-	// initialize the audio samples to zero (silence)
-	audio->clear();
+	// Init the audio buffer (with silence)
+	allocate_audio(channels, samples, false);
 };
 
 
@@ -92,6 +86,12 @@ Frame::Frame ( const Frame &other )
 	DeepCopy(other);
 }
 
+// Move constructor
+Frame::Frame ( Frame &&other ) : qbuffer(NULL)
+{
+	move_frame(other);
+}
+
 // Assignment operator
 Frame& Frame::operator= (const Frame& other)
 {
@@ -101,26 +101,110 @@ Frame& Frame::operator= (const Frame& other)
 	return *this;
 }
 
+// Move assignment operator
+Frame& Frame::operator= (Frame&& other)
+{
+	if (this != &other)
+		move_frame(other);
+
+	return *this;
+}
+
 // Copy data and pointers from another Frame instance
 void Frame::DeepCopy(const Frame& other)
+{
+	copy_frame(other, false);
+}
+
+// Create a copy of this frame, which shares its image and audio samples
+std::shared_ptr<Frame> Frame::ShallowClone()
+{
+	std::shared_ptr<Frame> clone(new Frame());
+	clone->copy_frame(*this, true);
+	return clone;
+}
+
+// Copy the data and pointers of another frame (sharing its audio samples, or copying them)
+void Frame::copy_frame(const Frame& other, bool share_audio)
 {
 	number = other.number;
 	channels = other.channels;
 	width = other.width;
 	height = other.height;
 	channel_layout = other.channel_layout;
-	has_audio_data = other.has_image_data;
+	has_audio_data = other.has_audio_data;
 	has_image_data = other.has_image_data;
 	sample_rate = other.sample_rate;
+	max_audio_sample = other.max_audio_sample;
 	pixel_ratio = Fraction(other.pixel_ratio.num, other.pixel_ratio.den);
 	color = other.color;
 
 	if (other.image)
 		image = std::shared_ptr<QImage>(new QImage(*(other.image)));
-	if (other.audio)
-		audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(*(other.audio)));
+	image_loader = other.image_loader;
+	deferred_planes = other.deferred_planes;
+	placed_image = other.placed_image;
+	placed_offset = other.placed_offset;
+	geometry_clip = other.geometry_clip;
+	geometry_fills = other.geometry_fills;
+	has_geometry = other.has_geometry;
+	if (other.audio && share_audio) {
+		// Share the samples (the other frame's lock is held, so a frame changing its samples sees they are shared)
+		const GenericScopedLock<juce::CriticalSection> lock(const_cast<Frame&>(other).addingAudioSection);
+		audio = other.audio;
+		audio_block = other.audio_block;
+	}
+	else if (other.audio) {
+		// Copy the samples (a JUCE copy of a buffer would refer to the other frame's pooled block)
+		audio.reset();
+		allocate_audio(other.audio->getNumChannels(), other.audio->getNumSamples(), false);
+		for (int channel = 0; channel < audio->getNumChannels(); channel++)
+			audio->copyFrom(channel, 0, *other.audio, channel, 0, audio->getNumSamples());
+	}
 	if (other.wave_image)
 		wave_image = std::shared_ptr<QImage>(new QImage(*(other.wave_image)));
+
+	// The copied image shares its data (and cache key) with the other image, until either one changes
+	planes = other.planes;
+	planes_image_key = other.planes_image_key;
+}
+
+// Take the data and pointers of another frame
+void Frame::move_frame(Frame& other)
+{
+	number = other.number;
+	channels = other.channels;
+	width = other.width;
+	height = other.height;
+	channel_layout = other.channel_layout;
+	has_audio_data = other.has_audio_data;
+	has_image_data = other.has_image_data;
+	sample_rate = other.sample_rate;
+	max_audio_sample = other.max_audio_sample;
+	pixel_ratio = other.pixel_ratio;
+	color = std::move(other.color);
+
+	image = std::move(other.image);
+	wave_image = std::move(other.wave_image);
+	image_loader = std::move(other.image_loader);
+	deferred_planes = std::move(other.deferred_planes);
+	placed_image = std::move(other.placed_image);
+	placed_offset = other.placed_offset;
+	geometry_clip = other.geometry_clip;
+	geometry_fills = std::move(other.geometry_fills);
+	has_geometry = other.has_geometry;
+	audio = std::move(other.audio);
+	audio_block = std::move(other.audio_block);
+	planes = std::move(other.planes);
+	planes_image_key = other.planes_image_key;
+	previewApp = std::move(other.previewApp);
+
+	// The other frame is left empty (without an image or audio)
+	other.image_loader = std::function<void(Frame*)>();
+	other.has_audio_data = false;
+	other.has_image_data = false;
+	other.has_geometry = false;
+	other.max_audio_sample = 0;
 }
 
 // Destructor
@@ -128,6 +212,8 @@ Frame::~Frame() {
 	// Clear all pointers
 	image.reset();
 	audio.reset();
+	audio_block.reset();
+	planes.reset();
 }
 
 // Display the frame image to the screen (primarily used for debugging reasons)
@@ -177,82 +263,57 @@ std::shared_ptr<QImage> Frame::GetWaveform(int width, int height, int Red, int G
 	// Clear any existing waveform image
 	ClearWaveform();
 
-	// Init a list of lines
-	QVector<QPointF> lines;
-	QVector<QPointF> labels;
-
 	// Calculate width of an image based on the # of samples
-	int total_samples = GetAudioSamplesCount();
+	int total_samples = std::min((int) GetAudioSamplesCount(), audio->getNumSamples());
 	if (total_samples > 0)
 	{
-		// If samples are present...
-		int new_height = 200 * audio->getNumChannels();
-		int height_padding = 20 * (audio->getNumChannels() - 1);
+		// If samples are present... each channel is 200 rows tall (with padding between the channels), and
+		// each sample is a column (before scaling to the requested size)
+		int channels = audio->getNumChannels();
+		int new_height = 200 * channels;
+		int height_padding = 20 * (channels - 1);
 		int total_height = new_height + height_padding;
-		int total_width = 0;
-
-		// Loop through each audio channel
-		int Y = 100;
-		for (int channel = 0; channel < audio->getNumChannels(); channel++)
-		{
-			int X = 0;
-
-			// Get audio for this channel
-			const float *samples = audio->getReadPointer(channel);
-
-			for (int sample = 0; sample < GetAudioSamplesCount(); sample++, X++)
-			{
-				// Sample value (scaled to -100 to 100)
-				float value = samples[sample] * 100;
-
-				// Append a line segment for each sample
-				if (value != 0.0) {
-					// LINE
-					lines.push_back(QPointF(X,Y));
-					lines.push_back(QPointF(X,Y-value));
-				}
-				else {
-					// DOT
-					lines.push_back(QPointF(X,Y));
-					lines.push_back(QPointF(X,Y));
-				}
-			}
-
-			// Add Channel Label Coordinate
-			labels.push_back(QPointF(5, Y - 5));
-
-			// Increment Y
-			Y += (200 + height_padding);
-			total_width = X;
+		int total_width = total_samples;
+		if (width <= 0 || height <= 0) {
+			width = total_width;
+			height = total_height;
 		}
 
-		// Create blank image
-		wave_image = std::shared_ptr<QImage>(new QImage(total_width, total_height, QImage::Format_RGBA8888));
+		// Create blank image (at the requested size)
+		wave_image = std::shared_ptr<QImage>(new QImage(width, height, QImage::Format_RGBA8888));
 		wave_image->fill(QColor(0,0,0,0));
 
-		// Load QPainter with wave_image device
-		QPainter painter(wave_image.get());
+		// The pen color (drawn over the transparent image)
+		unsigned char color[4] = {(unsigned char) std::max(0, std::min(255, Red)), (unsigned char) std::max(0, std::min(255, Green)),
+								  (unsigned char) std::max(0, std::min(255, Blue)), (unsigned char) std::max(0, std::min(255, Alpha))};
+		unsigned char *pixels = wave_image->bits();
+		int bytes_per_line = wave_image->bytesPerLine();
+		double row_scale = double(height) / total_height;
 
-		// Set pen color
-		painter.setPen(QColor(Red, Green, Blue, Alpha));
-
-		// Draw the waveform
-		painter.drawLines(lines);
-		painter.end();
+		// Draw the peaks of the samples in each column (from the center line of each channel to the
+		// lowest and highest sample), instead of a line per sample which is then scaled
+		for (int channel = 0; channel < channels; channel++)
+		{
+			const float *samples = audio->getReadPointer(channel);
+			int Y = 100 + channel * (200 + height_padding);
+			for (int X = 0; X < width; X++)
+			{
+				// Find the peaks of the samples of this column (sample value scaled to -100 to 100)
+				int first_sample = int64_t(X) * total_samples / width;
+				int last_sample = std::max(first_sample + 1, int(int64_t(X + 1) * total_samples / width));
+				float lowest = 0.0;
+				float highest = 0.0;
+				for (int sample = first_sample; sample < last_sample; sample++) {
+					lowest = std::min(lowest, samples[sample]);
+					highest = std::max(highest, samples[sample]);
+				}
 
-		// Loop through the channels labels (and draw the text)
-		// TODO: Configure Fonts in Qt5 correctly, so the drawText method does not crash
-//		painter.setFont(QFont(QString("Arial"), 16, 1, false));
-//		for (int channel = 0; channel < labels.size(); channel++) {
-//			stringstream label;
-//			label << "Channel " << channel;
-//		    painter.drawText(labels.at(channel), QString::fromStdString(label.str()));
-//		}
-
-		// Resize Image (if requested)
-		if (width != total_width || height != total_height) {
-			QImage scaled_wave_image = wave_image->scaled(width, height, Qt::IgnoreAspectRatio, Qt::FastTransformation);
-			wave_image = std::shared_ptr<QImage>(new QImage(scaled_wave_image));
+				// Fill the rows between the peaks (a single dot for silence)
+				int top_row = std::max(0, std::min(height - 1, int(floor((Y - highest * 100) * row_scale))));
+				int bottom_row = std::max(0, std::min(height - 1, int(floor((Y - lowest * 100) * row_scale))));
+				for (int row = top_row; row <= bottom_row; row++)
+					memcpy(pixels + row * bytes_per_line + X * 4, color, 4);
+			}
 		}
 	}
 	else
@@ -332,6 +393,10 @@ float Frame::GetAudioSample(int channel, int sample, int magnitude_range)
 // Get an array of sample data
 float* Frame::GetAudioSamples(int channel)
 {
+	// The samples can be changed through the pointer (so they are no longer shared)
+	const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
+	detach_audio();
+
 	// return JUCE audio data for this channel
 	return audio->getWritePointer(channel);
 }
@@ -427,6 +492,85 @@ float* Frame::GetInterleavedAudioSamples(int new_sample_rate, AudioResampler* re
 	return output;
 }
 
+// Get a read-only (planar) view of the audio samples, without copying them
+AudioSamplesView Frame::GetAudioView()
+{
+	AudioSamplesView view;
+	view.channels = audio->getArrayOfReadPointers();
+	view.channel_count = audio->getNumChannels();
+	view.sample_count = std::min((int) GetAudioSamplesCount(), audio->getNumSamples());
+	return view;
+}
+
+// Copy the audio samples (all channels interleaved together) into a buffer owned by the caller
+void Frame::InterleaveAudioSamples(float* output)
+{
+	AudioSamplesView view = GetAudioView();
+	for (int channel = 0; channel < view.channel_count; channel++) {
+		const float *samples = view.Channel(channel);
+		float *position = output + channel;
+		for (int sample = 0; sample < view.sample_count; sample++, position += view.channel_count)
+			*position = samples[sample];
+	}
+}
+
+// Allocate pooled (contiguous and aligned) planar storage for the audio samples
+void Frame::allocate_audio(int new_channels, int new_samples, bool keep_existing)
+{
+	new_channels = std::max(new_channels, 0);
+	new_samples = std::max(new_samples, 0);
+
+	// Each channel starts on a 64 byte boundary (16 floats)
+	int stride = ((new_samples + 15) / 16) * 16;
+	size_t block_size = size_t(new_channels) * stride * sizeof(float);
+	uint8_t *buffer = block_size > 0 ? ImageBufferPool::Instance()->Acquire(block_size) : NULL;
+
+	if (!buffer) {
+		// Fall back to a JUCE allocated buffer (i.e. for an empty buffer)
+		if (audio && keep_existing && audio->getNumChannels() == new_channels && audio->getNumSamples() == new_samples)
+			return;
+		if (audio && keep_existing && audio.use_count() > 1) {
+			std::shared_ptr<juce::AudioSampleBuffer> shared_audio = audio;
+			audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(new_channels, new_samples));
+			audio->clear();
+			for (int channel = 0; channel < std::min(new_channels, shared_audio->getNumChannels()); channel++)
+				audio->copyFrom(channel, 0, *shared_audio, channel, 0, std::min(new_samples, shared_audio->getNumSamples()));
+		}
+		else if (audio && keep_existing)
+			audio->setSize(new_channels, new_samples, true, true, false);
+		else
+			audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(new_channels, new_samples));
+		if (!keep_existing)
+			audio->clear();
+		audio_block.reset();
+		return;
+	}
+
+	// Copy the existing samples (and silence the rest)
+	std::vector<float*> channel_pointers(new_channels);
+	for (int channel = 0; channel < new_channels; channel++) {
+		float *samples = ((float *) buffer) + channel * stride;
+		int copied = 0;
+		if (keep_existing && audio && channel < audio->getNumChannels()) {
+			copied = std::min(new_samples, audio->getNumSamples());
+			memcpy(samples, audio->getReadPointer(channel), copied * sizeof(float));
+		}
+		memset(samples + copied, 0, (stride - copied) * sizeof(float));
+		channel_pointers[channel] = samples;
+	}
+
+	// The JUCE buffer refers to the pooled block (which is returned to the pool when the frame no longer needs it)
+	audio = std::shared_ptr<juce::AudioSampleBuffer>(new juce::AudioSampleBuffer(&channel_pointers[0], new_channels, new_samples));
+	audio_block = std::shared_ptr<uint8_t>(buffer, [](uint8_t *block) { ImageBufferPool::Instance()->Release(block); });
+}
+
+// Copy the samples of the audio, if they are shared with a clone
+void Frame::detach_audio()
+{
+	if (audio && audio.use_count() > 1)
+		allocate_audio(audio->getNumChannels(), audio->getNumSamples(), true);
+}
+
 // Get number of audio channels
 int Frame::GetAudioChannelsCount()
 {
@@ -446,28 +590,42 @@ int Frame::GetAudioSamplesCount()
 
 juce::AudioSampleBuffer *Frame::GetAudioSampleBuffer()
 {
+	const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
+	detach_audio();
     return audio.get();
 }
 
-// Get the size in bytes of this frame (rough estimate)
+// Get the size in bytes of this frame (image, waveform image, and audio buffers)
 int64_t Frame::GetBytes()
 {
-	int64_t total_bytes = 0;
-	if (image)
-		total_bytes += (width * height * sizeof(char) * 4);
+	int64_t total_bytes = GetImageBytes();
+	if (wave_image)
+		total_bytes += (int64_t) wave_image->bytesPerLine() * wave_image->height();
 	if (audio) {
-		// approximate audio size (sample rate / 24 fps)
-		total_bytes += (sample_rate / 24.0) * sizeof(float);
+		// actual size of the audio buffer (all channels)
+		total_bytes += (int64_t) audio->getNumChannels() * audio->getNumSamples() * sizeof(float);
 	}
 
 	// return size of this frame
 	return total_bytes;
 }
 
+// Get the size in bytes of this frame's image buffer (including row padding)
+int64_t Frame::GetImageBytes()
+{
+	// A deferred image is counted at its size (without loading it)
+	if (IsImageDeferred())
+		return (int64_t) width * height * (QImage::toPixelFormat(ImageFormat()).bitsPerPixel() / 8);
+	if (!image)
+		return 0;
+	return (int64_t) image->bytesPerLine() * image->height();
+}
+
 // Get pixel data (as packets)
 const unsigned char* Frame::GetPixels()
 {
 	// Check for blank image
+	load_image();
 	if (!image)
 		// Fill with black
 		AddColor(width, height, color);
@@ -480,23 +638,38 @@ const unsigned char* Frame::GetPixels()
 const unsigned char* Frame::GetPixels(int row)
 {
 	// Return array of pixel packets
+	load_image();
 	return image->constScanLine(row);
 }
 
 // Check a specific pixel color value (returns True/False)
 bool Frame::CheckPixel(int row, int col, int red, int green, int blue, int alpha, int threshold) {
 	int col_pos = col * 4; // Find column array position
+	load_image();
 	if (!image || row < 0 || row >= (height - 1) ||
 		col_pos < 0 || col_pos >= (width - 1) ) {
 		// invalid row / col
 		return false;
 	}
+	// Get pixel color (as RGBA values)
+	int pixel[4];
+	if (image->format() == QImage::Format_RGBA8888) {
+		const unsigned char* pixels = GetPixels(row);
+		for (int channel = 0; channel < 4; channel++)
+			pixel[channel] = pixels[col_pos + channel];
+	} else {
+		QColor pixel_color = image->pixelColor(col, row);
+		pixel[0] = pixel_color.red();
+		pixel[1] = pixel_color.green();
+		pixel[2] = pixel_color.blue();
+		pixel[3] = pixel_color.alpha();
+	}
+
 	// Check pixel color
-	const unsigned char* pixels = GetPixels(row);
-	if (pixels[col_pos + 0] >= (red - threshold) && pixels[col_pos + 0] <= (red + threshold) &&
-		pixels[col_pos + 1] >= (green - threshold) && pixels[col_pos + 1] <= (green + threshold) &&
-		pixels[col_pos + 2] >= (blue - threshold) && pixels[col_pos + 2] <= (blue + threshold) &&
-		pixels[col_pos + 3] >= (alpha - threshold) && pixels[col_pos + 3] <= (alpha + threshold)) {
+	if (pixel[0] >= (red - threshold) && pixel[0] <= (red + threshold) &&
+		pixel[1] >= (green - threshold) && pixel[1] <= (green + threshold) &&
+		pixel[2] >= (blue - threshold) && pixel[2] <= (blue + threshold) &&
+		pixel[3] >= (alpha - threshold) && pixel[3] <= (alpha + threshold)) {
 		// Pixel color matches successfully
 		return true;
 	} else {
@@ -521,27 +694,30 @@ void Frame::SetFrameNumber(int64_t new_number)
 // Calculate the # of samples per video frame (for a specific frame number and frame rate)
 int Frame::GetSamplesPerFrame(int64_t number, Fraction fps, int sample_rate, int channels)
 {
-	// Get the total # of samples for the previous frame, and the current frame (rounded)
-	double fps_rate = fps.Reciprocal().ToDouble();
-
-	// Determine previous samples total, and make sure it's evenly divisible by the # of channels
-	double previous_samples = (sample_rate * fps_rate) * (number - 1);
-	double previous_samples_remainder = fmod(previous_samples, (double)channels); // subtract the remainder to the total (to make it evenly divisible)
-	previous_samples -= previous_samples_remainder;
-
-	// Determine the current samples total, and make sure it's evenly divisible by the # of channels
-	double total_samples = (sample_rate * fps_rate) * number;
-	double total_samples_remainder = fmod(total_samples, (double)channels); // subtract the remainder to the total (to make it evenly divisible)
-	total_samples -= total_samples_remainder;
-
-	// Subtract the previous frame's total samples with this frame's total samples.  Not all sample rates can
-	// be evenly divided into frames, so each frame can have have different # of samples.
-	int samples_per_frame = round(total_samples - previous_samples);
+	// Not all sample rates can be evenly divided into frames, so each frame can have have different # of samples
+	int64_t samples_per_frame = GetSamplesBeforeFrame(number + 1, fps, sample_rate, channels) - GetSamplesBeforeFrame(number, fps, sample_rate, channels);
 	if (samples_per_frame < 0)
 		samples_per_frame = 0;
 	return samples_per_frame;
 }
 
+// Calculate the total # of samples before a video frame
+int64_t Frame::GetSamplesBeforeFrame(int64_t number, Fraction fps, int sample_rate, int channels)
+{
+	if (fps.num <= 0 || fps.den <= 0 || sample_rate <= 0)
+		return 0;
+	if (channels < 1)
+		channels = 1;
+
+	// The exact total is sample_rate * (number - 1) / fps, rounded down to a multiple of the channels
+	int64_t samples = int64_t(sample_rate) * fps.den * (number - 1);
+	int64_t divisor = int64_t(fps.num) * channels;
+	int64_t multiples = samples / divisor;
+	if (samples % divisor < 0)
+		multiples--;
+	return multiples * channels;
+}
+
 // Calculate the # of samples per video frame (for the current frame number)
 int Frame::GetSamplesPerFrame(Fraction fps, int sample_rate, int channels)
 {
@@ -728,21 +904,45 @@ int Frame::constrain(int color_value)
 	return color_value;
 }
 
+// Add (or replace) pixel data to the frame (based on a packed RGBA color)
+void Frame::AddColor(int new_width, int new_height, QRgb new_color)
+{
+	// Set color (as an HTML color code, which includes the alpha only if the color is not opaque)
+	char color_code[10];
+	if (qAlpha(new_color) == 255)
+		snprintf(color_code, sizeof(color_code), "#%02x%02x%02x", qRed(new_color), qGreen(new_color), qBlue(new_color));
+	else
+		snprintf(color_code, sizeof(color_code), "#%02x%02x%02x%02x", qAlpha(new_color), qRed(new_color), qGreen(new_color), qBlue(new_color));
+	color = color_code;
+
+	// Create new image object (from a pooled buffer), and fill with pixel data
+	cancel_image_loader();
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	image = ImageBufferPool::CreateImage(new_width, new_height, ImageFormat());
+
+	// Fill with solid color
+	image->fill(QColor::fromRgba(new_color));
+
+	// Update height and width
+	width = image->width();
+	height = image->height();
+	has_image_data = true;
+}
+
 // Add (or replace) pixel data to the frame (based on a solid color)
 void Frame::AddColor(int new_width, int new_height, std::string new_color)
 {
 	// Set color
 	color = new_color;
 
-	// Create new image object, and fill with pixel data
+	// Create new image object (from a pooled buffer), and fill with pixel data
+	cancel_image_loader();
 	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
-	#pragma omp critical (AddImage)
-	{
-		image = std::shared_ptr<QImage>(new QImage(new_width, new_height, QImage::Format_RGBA8888));
+	image = ImageBufferPool::CreateImage(new_width, new_height, ImageFormat());
+
+	// Fill with solid color
+	image->fill(QColor(QString::fromStdString(color)));
 
-		// Fill with solid color
-		image->fill(QColor(QString::fromStdString(color)));
-	}
 	// Update height and width
 	width = image->width();
 	height = image->height();
@@ -752,28 +952,28 @@ void Frame::AddColor(int new_width, int new_height, std::string new_color)
 // Add (or replace) pixel data to the frame
 void Frame::AddImage(int new_width, int new_height, int bytes_per_pixel, QImage::Format type, const unsigned char *pixels_)
 {
-	// Create new buffer
+	// Create new image object (from a pooled buffer)
+	cancel_image_loader();
 	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
-	int buffer_size = new_width * new_height * bytes_per_pixel;
-	qbuffer = new unsigned char[buffer_size]();
-
-	// Copy buffer data
-	memcpy((unsigned char*)qbuffer, pixels_, buffer_size);
+	int bytes_per_line = new_width * bytes_per_pixel;
+	image = ImageBufferPool::CreateImage(new_width, new_height, type);
 
-	// Create new image object, and fill with pixel data
-	#pragma omp critical (AddImage)
-	{
-		image = std::shared_ptr<QImage>(new QImage(qbuffer, new_width, new_height, new_width * bytes_per_pixel, type, (QImageCleanupFunction) &openshot::Frame::cleanUpBuffer, (void*) qbuffer));
+	// Copy buffer data (line by line, if the image's lines are padded)
+	if (image->bytesPerLine() == bytes_per_line)
+		memcpy(image->bits(), pixels_, bytes_per_line * new_height);
+	else
+		for (int row = 0; row < new_height; row++)
+			memcpy(image->scanLine(row), pixels_ + row * bytes_per_line, bytes_per_line);
+	qbuffer = image->constBits();
 
-		// Always convert to RGBA8888 (if different)
-		if (image->format() != QImage::Format_RGBA8888)
-			*image  = image->convertToFormat(QImage::Format_RGBA8888);
+	// Always convert to the frame image format (if different)
+	if (image->format() != ImageFormat())
+		*image  = image->convertToFormat(ImageFormat());
 
-			// Update height and width
-		width = image->width();
-		height = image->height();
-		has_image_data = true;
-	}
+	// Update height and width
+	width = image->width();
+	height = image->height();
+	has_image_data = true;
 }
 
 // Add (or replace) pixel data to the frame
@@ -784,20 +984,18 @@ void Frame::AddImage(std::shared_ptr<QImage> new_image)
 		return;
 
 	// assign image data
+	cancel_image_loader();
 	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
-	#pragma omp critical (AddImage)
-	{
-		image = new_image;
+	image = new_image;
 
-		// Always convert to RGBA8888 (if different)
-		if (image->format() != QImage::Format_RGBA8888)
-			*image = image->convertToFormat(QImage::Format_RGBA8888);
+	// Always convert to the frame image format (if different)
+	if (image->format() != ImageFormat())
+		*image = image->convertToFormat(ImageFormat());
 
-		// Update height and width
-		width = image->width();
-		height = image->height();
-		has_image_data = true;
-	}
+	// Update height and width
+	width = image->width();
+	height = image->height();
+	has_image_data = true;
 }
 
 // Add (or replace) pixel data to the frame (for only the odd or even lines)
@@ -808,53 +1006,252 @@ void Frame::AddImage(std::shared_ptr<QImage> new_image, bool only_odd_lines)
 		return;
 
 	// Check for blank source image
+	load_image();
 	if (!image) {
 		// Replace the blank source image
 		AddImage(new_image);
 
 	} else {
 
+		// Get the frame's image
+		const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+
 		// Ignore image of different sizes or formats
-		bool ret=false;
-		#pragma omp critical (AddImage)
-		if (image == new_image || image->size() != image->size() || image->format() != image->format())
-			ret=true;
-		if (ret)
+		if (image == new_image || image->size() != new_image->size() || image->format() != new_image->format())
 			return;
 
-		// Get the frame's image
-		const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
-		#pragma omp critical (AddImage)
-		{
-			const unsigned char *pixels = image->constBits();
-			const unsigned char *new_pixels = new_image->constBits();
+		// Writing the lines detaches the image (if its pixels are shared with another frame)
+		unsigned char *pixels = image->bits();
+		const unsigned char *new_pixels = new_image->constBits();
+		planes.reset();
 
-			// Loop through the scanlines of the image (even or odd)
-			int start = 0;
-			if (only_odd_lines)
-				start = 1;
+		// Copy the scanlines of the field (even or odd)
+		FieldKernels::Weave(pixels, image->bytesPerLine(), new_pixels, new_image->bytesPerLine(), image->height(), std::min(image->bytesPerLine(), new_image->bytesPerLine()), only_odd_lines);
 
-			for (int row = start; row < image->height(); row += 2) {
-				memcpy((unsigned char *) pixels, new_pixels + (row * image->bytesPerLine()), image->bytesPerLine());
-				new_pixels += image->bytesPerLine();
-			}
+		// Update height and width
+		width = image->width();
+		height = image->height();
+		has_image_data = true;
+	}
+}
+
+// Add the native image planes (i.e. YUV) the current image was decoded from
+void Frame::AddPlanes(std::shared_ptr<FramePlanes> new_planes)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (!image || !new_planes) {
+		planes.reset();
+		return;
+	}
+
+	// Any change to the image's pixels (or a new image) changes its cache key
+	planes = new_planes;
+	planes_image_key = image->cacheKey();
+}
 
-			// Update height and width
-			width = image->width();
-			height = image->height();
-			has_image_data = true;
+// Share the image (and native planes) of another frame, without copying its pixels
+void Frame::ShareImage(const std::shared_ptr<Frame>& source_frame)
+{
+	if (!source_frame)
+		return;
+
+	// Keep a deferred image deferred (until this frame's image is needed), and share its placed image (if any)
+	if (source_frame->IsImageDeferred()) {
+		std::shared_ptr<QImage> source_placed;
+		QPoint source_offset;
+		bool is_placed = source_frame->GetPlacedImage(source_placed, source_offset);
+		SetImageLoader(source_frame->GetWidth(), source_frame->GetHeight(),
+					   [source_frame](Frame *frame) { frame->ShareImage(source_frame); }, source_frame->GetPlanes());
+		if (is_placed) {
+			const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+			placed_image = source_placed;
+			placed_offset = source_offset;
 		}
+		return;
+	}
+
+	// Each frame needs its own QImage object (sharing the pixels), so a write detaches only that frame's copy
+	std::shared_ptr<QImage> source_image = source_frame->GetImage();
+	std::shared_ptr<FramePlanes> source_planes = source_frame->GetPlanes();
+	AddImage(std::shared_ptr<QImage>(new QImage(*source_image)));
+	AddPlanes(source_planes);
+}
+
+// Is the frame's image buffer shared with another frame (i.e. not yet detached by a write)
+bool Frame::IsImageShared()
+{
+	load_image();
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	return image && !image->isDetached();
+}
+
+// Defer the image of this frame, until it is first needed
+void Frame::SetImageLoader(int new_width, int new_height, std::function<void(Frame*)> loader, std::shared_ptr<FramePlanes> new_planes)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	const GenericScopedLock<juce::CriticalSection> image_lock(addingImageSection);
+	image.reset();
+	planes.reset();
+	image_loader = loader;
+	deferred_planes = new_planes;
+	placed_image.reset();
+	width = new_width;
+	height = new_height;
+	has_image_data = true;
+}
+
+// Is the image deferred (i.e. its loader has not been called yet)
+bool Frame::IsImageDeferred()
+{
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	return (bool) image_loader;
+}
+
+// Add an image which covers only a part of the frame
+void Frame::AddPlacedImage(int new_width, int new_height, std::shared_ptr<QImage> new_image, QPoint offset)
+{
+	// The full size image is only painted if a consumer needs its pixels
+	SetImageLoader(new_width, new_height, [new_image, offset](Frame *frame) {
+		std::shared_ptr<QImage> full_image(new QImage(frame->GetWidth(), frame->GetHeight(), new_image->format()));
+		full_image->fill(Qt::transparent);
+		QPainter painter(full_image.get());
+		painter.setCompositionMode(QPainter::CompositionMode_Source);
+		painter.drawImage(offset, *new_image);
+		painter.end();
+		frame->AddImage(full_image);
+	});
+
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	placed_image = new_image;
+	placed_offset = offset;
+}
+
+// Get the placed image, until the full size image is created
+bool Frame::GetPlacedImage(std::shared_ptr<QImage> &new_image, QPoint &offset)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	if (!image_loader || !placed_image)
+		return false;
+	new_image = placed_image;
+	offset = placed_offset;
+	return true;
+}
+
+// Run the deferred image loader (if any), the first time the image is needed
+void Frame::load_image()
+{
+	// Other threads which need the image wait for the loader to finish
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	if (image_loader) {
+		std::function<void(Frame*)> loader = image_loader;
+		image_loader = nullptr;
+		deferred_planes.reset();
+		placed_image.reset();
+		loader(this);
+	}
+
+	// The pixels are needed, so paint the image geometry (if any)
+	apply_image_geometry();
+}
+
+// Forget the deferred image loader (since a new image replaces it)
+void Frame::cancel_image_loader()
+{
+	const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+	image_loader = nullptr;
+	deferred_planes.reset();
+	placed_image.reset();
+}
+
+// Make the image transparent outside of a rectangle (without a pass over its pixels)
+void Frame::ClipImage(QRect rect)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (!has_geometry)
+		geometry_clip = QRect(0, 0, width, height);
+	geometry_clip &= rect;
+
+	// Fills outside of the new clip are transparent too
+	std::vector<std::pair<QRect, QColor> > clipped_fills;
+	for (size_t index = 0; index < geometry_fills.size(); index++) {
+		QRect fill_rect = geometry_fills[index].first & geometry_clip;
+		if (!fill_rect.isEmpty())
+			clipped_fills.push_back(std::make_pair(fill_rect, geometry_fills[index].second));
 	}
+	geometry_fills.swap(clipped_fills);
+	has_geometry = true;
 }
 
+// Replace a rectangle of the image by a color (without a pass over its pixels)
+void Frame::FillImageRect(QRect rect, QColor fill_color)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (!has_geometry)
+		geometry_clip = QRect(0, 0, width, height);
+
+	// Only the visible part of the rectangle is filled
+	QRect fill_rect = rect & geometry_clip;
+	if (!fill_rect.isEmpty())
+		geometry_fills.push_back(std::make_pair(fill_rect, fill_color));
+	has_geometry = true;
+}
+
+// Does the frame have image geometry which is not applied to its pixels
+bool Frame::HasImageGeometry()
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	return has_geometry;
+}
+
+// Remove the image geometry from the frame, without painting it
+bool Frame::TakeImageGeometry(QRect &clip_rect, std::vector<std::pair<QRect, QColor> > &fills)
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	clip_rect = has_geometry ? geometry_clip : QRect(0, 0, width, height);
+	fills = geometry_fills;
+	bool had_geometry = has_geometry;
+	geometry_clip = QRect();
+	geometry_fills.clear();
+	has_geometry = false;
+	return had_geometry;
+}
+
+// Paint the image geometry (if any) into the image's pixels
+void Frame::apply_image_geometry()
+{
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (!has_geometry || !image)
+		return;
+
+	// Clear the pixels outside of the clip, and replace the filled rectangles (ignoring the alpha of the colors)
+	QPainter painter(image.get());
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	QRect image_rect = image->rect();
+	QRect clip = geometry_clip & image_rect;
+	if (clip.isEmpty())
+		painter.fillRect(image_rect, Qt::transparent);
+	else if (clip != image_rect) {
+		painter.fillRect(QRect(0, 0, image_rect.width(), clip.top()), Qt::transparent);
+		painter.fillRect(QRect(0, clip.bottom() + 1, image_rect.width(), image_rect.height() - clip.bottom() - 1), Qt::transparent);
+		painter.fillRect(QRect(0, clip.top(), clip.left(), clip.height()), Qt::transparent);
+		painter.fillRect(QRect(clip.right() + 1, clip.top(), image_rect.width() - clip.right() - 1, clip.height()), Qt::transparent);
+	}
+	for (size_t index = 0; index < geometry_fills.size(); index++)
+		painter.fillRect(geometry_fills[index].first, geometry_fills[index].second);
+	painter.end();
+
+	geometry_clip = QRect();
+	geometry_fills.clear();
+	has_geometry = false;
+}
 
 // Resize audio container to hold more (or less) samples and channels
 void Frame::ResizeAudio(int channels, int length, int rate, ChannelLayout layout)
 {
     const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
 
-    // Resize JUCE audio buffer
-	audio->setSize(channels, length, true, true, false);
+    // Resize audio buffer
+	allocate_audio(channels, length, true);
 	channel_layout = layout;
 	sample_rate = rate;
 
@@ -865,18 +1262,20 @@ void Frame::ResizeAudio(int channels, int length, int rate, ChannelLayout layout
 // Add audio samples to a specific channel
 void Frame::AddAudio(bool replaceSamples, int destChannel, int destStartSample, const float* source, int numSamples, float gainToApplyToSource = 1.0f) {
 	const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
-	#pragma omp critical (adding_audio)
-    {
+	{
 		// Clamp starting sample to 0
 		int destStartSampleAdjusted = max(destStartSample, 0);
 
+		// Copy shared samples (before changing them)
+		detach_audio();
+
 		// Extend audio container to hold more (or less) samples and channels.. if needed
 		int new_length = destStartSampleAdjusted + numSamples;
 		int new_channel_length = audio->getNumChannels();
 		if (destChannel >= new_channel_length)
 			new_channel_length = destChannel + 1;
 		if (new_length > audio->getNumSamples() || new_channel_length > audio->getNumChannels())
-			audio->setSize(new_channel_length, new_length, true, true, false);
+			allocate_audio(new_channel_length, new_length, true);
 
 		// Clear the range of samples first (if needed)
 		if (replaceSamples)
@@ -892,40 +1291,147 @@ void Frame::AddAudio(bool replaceSamples, int destChannel, int destStartSample,
 	}
 }
 
+// Mix the samples of several sources (each with a gain ramp) into a channel, in a single pass
+void Frame::MixAudio(int destChannel, const AudioMixSource* sources, int source_count, int numSamples)
+{
+	if (destChannel < 0 || numSamples <= 0 || source_count <= 0)
+		return;
+
+	const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
+
+	// Copy shared samples (before changing them)
+	detach_audio();
+
+	// Extend audio container to hold more samples and channels.. if needed
+	int new_channel_length = std::max(audio->getNumChannels(), destChannel + 1);
+	if (numSamples > audio->getNumSamples() || new_channel_length > audio->getNumChannels())
+		allocate_audio(new_channel_length, std::max(numSamples, audio->getNumSamples()), true);
+
+	// Add the samples of all sources to the frame's audio buffer
+	AudioKernels::MixGainRamps(audio->getWritePointer(destChannel), numSamples, sources, source_count);
+	has_audio_data = true;
+
+	// Calculate max audio sample added
+	if (numSamples > max_audio_sample)
+		max_audio_sample = numSamples;
+}
+
 // Apply gain ramp (i.e. fading volume)
 void Frame::ApplyGainRamp(int destChannel, int destStartSample, int numSamples, float initial_gain = 0.0f, float final_gain = 1.0f)
 {
     const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
 
-    // Apply gain ramp
+    // Apply gain ramp (to a copy of shared samples)
+	detach_audio();
 	audio->applyGainRamp(destChannel, destStartSample, numSamples, initial_gain, final_gain);
 }
 
 // Get pointer to Magick++ image object
 std::shared_ptr<QImage> Frame::GetImage()
 {
-	// Check for blank image
-	if (!image)
-		// Fill with black
+	// Load a deferred image (or check for blank image)
+	load_image();
+	if (!image) {
+		// Fill with black (and paint the image geometry, if any)
 		AddColor(width, height, color);
+		apply_image_geometry();
+	}
 
 	return image;
 }
 
+// Get the native image planes (if the image is unchanged since they were added)
+std::shared_ptr<FramePlanes> Frame::GetPlanes()
+{
+	// The planes of a deferred image are returned without loading it (since the image will be converted from them)
+	{
+		const GenericScopedLock<juce::CriticalSection> lock(loadingImageSection);
+		const GenericScopedLock<juce::CriticalSection> image_lock(addingImageSection);
+
+		// Image geometry (which is not painted yet) changes the image
+		if (has_geometry)
+			return std::shared_ptr<FramePlanes>();
+		if (image_loader)
+			return deferred_planes;
+	}
+
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (!planes || !image || image->cacheKey() != planes_image_key)
+		return std::shared_ptr<FramePlanes>();
+
+	return planes;
+}
+
+// Get the QImage format of frame images
+QImage::Format Frame::ImageFormat()
+{
+#ifdef USE_RGBA64_IMAGES
+	if (Settings::Instance()->HIGH_BIT_DEPTH_IMAGES)
+		return QImage::Format_RGBA64;
+#endif
+	if (Settings::Instance()->PREMULTIPLIED_IMAGES)
+		return QImage::Format_ARGB32_Premultiplied;
+	else
+		return QImage::Format_RGBA8888;
+}
+
+// Convert the frame's image to a specific QImage format (if different)
+void Frame::ConvertImage(QImage::Format format)
+{
+	load_image();
+	const GenericScopedLock<juce::CriticalSection> lock(addingImageSection);
+	if (image && image->format() != format)
+		image = std::shared_ptr<QImage>(new QImage(image->convertToFormat(format)));
+}
+
 #ifdef USE_IMAGEMAGICK
+// The channel order of ARGB32 pixels in memory (as ImageMagick names them)
+static const char *ARGB32_MAGICK_MAP = (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) ? "BGRA" : "ARGB";
+
+// Are all pixels of an ARGB32 image opaque (so its premultiplied colors are also its straight colors)
+static bool is_opaque(const QImage &image) {
+	for (int row = 0; row < image.height(); row++) {
+		const uint8_t *pixels = image.constScanLine(row);
+		for (int column = 0; column < image.width(); column++)
+			if (pixels[column * 4 + ARGB32PremultipliedPixels::alpha] != 255)
+				return false;
+	}
+	return true;
+}
+
 // Get pointer to ImageMagick image object
 std::shared_ptr<Magick::Image> Frame::GetMagickImage()
 {
 	// Check for blank image
+	load_image();
 	if (!image)
 		// Fill with black
 		AddColor(width, height, "#000000");
 
-	// Get the pixels from the frame image
-	const QRgb *tmpBits = (const QRgb*)image->constBits();
+	// Read the pixels in the layout of the frame image (ImageMagick copies them into its own pixels), unless
+	// ImageMagick can't read it (premultiplied colors of transparent pixels, or padded lines)
+	QImage source_image = *image;
+	QImage::Format format = source_image.format();
+	std::string map;
+	Magick::StorageType storage = Magick::CharPixel;
+	if (format == QImage::Format_RGBA8888)
+		map = "RGBA";
+#ifdef USE_RGBA64_IMAGES
+	else if (format == QImage::Format_RGBA64) {
+		map = "RGBA";
+		storage = Magick::ShortPixel;
+	}
+#endif
+	else if (format == QImage::Format_ARGB32 || (format == QImage::Format_ARGB32_Premultiplied && is_opaque(source_image)))
+		map = ARGB32_MAGICK_MAP;
+	if (map.empty() || source_image.bytesPerLine() != source_image.width() * source_image.depth() / 8) {
+		source_image = source_image.convertToFormat(QImage::Format_RGBA8888);
+		map = "RGBA";
+		storage = Magick::CharPixel;
+	}
 
 	// Create new image object, and fill with pixel data
-	std::shared_ptr<Magick::Image> magick_image = std::shared_ptr<Magick::Image>(new Magick::Image(image->width(), image->height(),"RGBA", Magick::CharPixel, tmpBits));
+	std::shared_ptr<Magick::Image> magick_image = std::shared_ptr<Magick::Image>(new Magick::Image(source_image.width(), source_image.height(), map, storage, source_image.constBits()));
 
 	// Give image a transparent background color
 	magick_image->backgroundColor(Magick::Color("none"));
@@ -934,32 +1440,44 @@ std::shared_ptr<Magick::Image> Frame::GetMagickImage()
 
 	return magick_image;
 }
-#endif
 
-#ifdef USE_IMAGEMAGICK
-// Get pointer to QImage of frame
-void Frame::AddMagickImage(std::shared_ptr<Magick::Image> new_image)
+// Get the pixels of an ImageMagick image, in the frame image format
+std::shared_ptr<QImage> Frame::MagickToImage(std::shared_ptr<Magick::Image> magick_image)
 {
-	const int BPP = 4;
-	const std::size_t bufferSize = new_image->columns() * new_image->rows() * BPP;
-
-	/// Use realloc for fast memory allocation.
-	/// TODO: consider locking the buffer for mt safety
-	//qbuffer = reinterpret_cast<unsigned char*>(realloc(qbuffer, bufferSize));
-	qbuffer = new unsigned char[bufferSize]();
-	unsigned char *buffer = (unsigned char*)qbuffer;
+	int image_width = magick_image->columns();
+	int image_height = magick_image->rows();
+	QImage::Format format = ImageFormat();
+
+	// Export the pixels in the channel order (and depth) of the frame image format
+	QImage::Format export_format = QImage::Format_RGBA8888;
+	std::string map = "RGBA";
+	Magick::StorageType storage = Magick::CharPixel;
+#ifdef USE_RGBA64_IMAGES
+	if (format == QImage::Format_RGBA64) {
+		export_format = format;
+		storage = Magick::ShortPixel;
+	}
+#endif
+	if (format == QImage::Format_ARGB32_Premultiplied) {
+		// The pixels of an image without alpha are the same premultiplied
+		export_format = MAGICK_IMAGE_HAS_ALPHA(magick_image) ? QImage::Format_ARGB32 : format;
+		map = ARGB32_MAGICK_MAP;
+	}
 
-	MagickCore::ExceptionInfo exception;
-	// TODO: Actually do something, if we get an exception here
-	MagickCore::ExportImagePixels(new_image->constImage(), 0, 0, new_image->columns(), new_image->rows(), "RGBA", Magick::CharPixel, buffer, &exception);
+	// Use a pooled buffer (recycled by the next images of the same size)
+	std::shared_ptr<QImage> new_image = ImageBufferPool::CreateImage(image_width, image_height, export_format);
+	magick_image->write(0, 0, image_width, image_height, map, storage, new_image->bits());
 
-	// Create QImage of frame data
-	image = std::shared_ptr<QImage>(new QImage(qbuffer, width, height, width * BPP, QImage::Format_RGBA8888, (QImageCleanupFunction) &cleanUpBuffer, (void*) qbuffer));
+	// Premultiply the colors (if needed)
+	if (new_image->format() != format)
+		*new_image = new_image->convertToFormat(format);
+	return new_image;
+}
 
-	// Update height and width
-	width = image->width();
-	height = image->height();
-	has_image_data = true;
+// Add (or replace) pixel data to the frame from an ImageMagick image
+void Frame::AddMagickImage(std::shared_ptr<Magick::Image> new_image)
+{
+	AddImage(MagickToImage(new_image));
 }
 #endif
 
@@ -1050,8 +1568,7 @@ void Frame::AddAudioSilence(int numSamples)
     const GenericScopedLock<juce::CriticalSection> lock(addingAudioSection);
 
     // Resize audio container
-	audio->setSize(channels, numSamples, false, true, false);
-	audio->clear();
+	allocate_audio(channels, numSamples, false);
 	has_audio_data = true;
 
 	// Calculate max audio sample added
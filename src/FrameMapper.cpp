@@ -29,12 +29,16 @@
  */
 
 #include "../include/FrameMapper.h"
+#include "../include/Trace.h"
 
 using namespace std;
 using namespace openshot;
 
 FrameMapper::FrameMapper(ReaderBase *reader, Fraction target, PulldownType target_pulldown, int target_sample_rate, int target_channels, ChannelLayout target_channel_layout) :
-		reader(reader), target(target), pulldown(target_pulldown), is_dirty(true), avr(NULL)
+		reader(reader), target(target), pulldown(target_pulldown), is_dirty(true), avr(NULL), target_width(0), target_height(0), last_requested_frame(0), video_enabled(true), audio_enabled(true),
+		audio_stream(NULL), audio_stream_sample_rate(0), audio_stream_channels(0), audio_stream_frame(0), audio_stream_source_frame(0), audio_stream_source_sample(0),
+		pattern_mapping(false), pattern_difference(0.0), pattern_field_interval(0), pattern_frame_interval(0), pattern_frames(0), pattern_periods(0),
+		first_field_toggle(true), linear_increment(1.0), mapped_length(0)
 {
 	// Set the original frame rate from the reader
 	original = Fraction(reader->info.fps.num, reader->info.fps.den);
@@ -57,13 +61,18 @@ FrameMapper::FrameMapper(ReaderBase *reader, Fraction target, PulldownType targe
 
 	// Adjust cache size based on size of frame and audio
 	final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+	final_cache.SetMemoryTag("cache.frame_mapper");
 }
 
 // Destructor
 FrameMapper::~FrameMapper() {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+
 	if (is_open)
 		// Auto Close if not already
 		Close();
+	reset_audio_stream();
 
 	reader = NULL;
 }
@@ -93,10 +102,97 @@ void FrameMapper::AddField(Field field)
 	field_toggle = (field_toggle ? false : true);
 }
 
+// The pull-down technique of the field pattern (interpolated frames are mapped to whole frames, like PULLDOWN_NONE)
+PulldownType FrameMapper::pattern_pulldown()
+{
+	if (pulldown == PULLDOWN_BLEND || pulldown == PULLDOWN_MOTION)
+		return PULLDOWN_NONE;
+	return pulldown;
+}
+
+// Add the fields for a range of original fields (using the pull-down technique), and return the next original field
+int64_t FrameMapper::add_pattern_fields(int64_t first_field, int64_t last_field, int64_t &frame)
+{
+	PulldownType pulldown = pattern_pulldown();
+	float difference = pattern_difference;
+	int field_interval = pattern_field_interval;
+	int frame_interval = pattern_frame_interval;
+
+	// Loop through the fields in the original video file
+	int64_t field = first_field;
+	for (; field <= last_field; field++)
+	{
+
+		if (difference == 0) // Same frame rate, NO pull-down or special techniques required
+		{
+			// Add fields
+			AddField(frame);
+		}
+		else if (difference > 0) // Need to ADD fake fields & frames, because original video has too few frames
+		{
+			// Add current field
+			AddField(frame);
+
+			if (pulldown == PULLDOWN_CLASSIC && field % field_interval == 0)
+			{
+				// Add extra field for each 'field interval
+				AddField(frame);
+			}
+			else if (pulldown == PULLDOWN_ADVANCED && field % field_interval == 0 && field % frame_interval != 0)
+			{
+				// Add both extra fields in the middle 'together' (i.e. 2:3:3:2 technique)
+				AddField(frame); // add field for current frame
+
+				if (frame + 1 <= info.video_length)
+					// add field for next frame (if the next frame exists)
+					AddField(Field(frame + 1, field_toggle));
+			}
+			else if (pulldown == PULLDOWN_NONE && field % frame_interval == 0)
+			{
+				// No pull-down technique needed, just repeat this frame
+				AddField(frame);
+				AddField(frame);
+			}
+		}
+		else if (difference < 0) // Need to SKIP fake fields & frames, because we want to return to the original film frame rate
+		{
+
+			if (pulldown == PULLDOWN_CLASSIC && field % field_interval == 0)
+			{
+				// skip current field and toggle the odd/even flag
+				field_toggle = (field_toggle ? false : true);
+			}
+			else if (pulldown == PULLDOWN_ADVANCED && field % field_interval == 0 && field % frame_interval != 0)
+			{
+				// skip this field, plus the next field
+				field++;
+			}
+			else if (pulldown == PULLDOWN_NONE && frame % field_interval == 0)
+			{
+				// skip this field, plus the next one
+				field++;
+			}
+			else
+			{
+				// No skipping needed, so add the field
+				AddField(frame);
+			}
+		}
+
+		// increment frame number (if field is divisible by 2)
+		if (field % 2 == 0 && field > 0)
+			frame++;
+	}
+
+	return field;
+}
+
 // Use the original and target frame rates and a pull-down technique to create
 // a mapping between the original fields and frames or a video to a new frame rate.
 // This might repeat or skip fields and frames of the original video, depending on
-// whether the frame rate is increasing or decreasing.
+// whether the frame rate is increasing or decreasing. Only a single period of the
+// field pattern (and the end of the video) is kept, and each frame is mapped from it
+// on demand (see GetMappedFrame), so long videos do not need a table of every frame.
 void FrameMapper::Init()
 {
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::Init (Calculate frame mappings)");
@@ -106,9 +202,13 @@ void FrameMapper::Init()
 		// Skip initialization
 		return;
 
-	// Clear the fields & frames lists
+	// Clear the fields & mapping
 	fields.clear();
-	frames.clear();
+	pattern.clear();
+	tail.clear();
+	pattern_frames = 0;
+	pattern_periods = 0;
+	mapped_length = 0;
 
 	// Mark as not dirty
 	is_dirty = false;
@@ -116,95 +216,71 @@ void FrameMapper::Init()
 	// Clear cache
 	final_cache.Clear();
 
+	// The first field continues the odd / even flag (from the previous mapping)
+	first_field_toggle = field_toggle;
+
 	// Some framerates are handled special, and some use a generic Keyframe curve to
 	// map the framerates. These are the special framerates:
-	if ((fabs(original.ToFloat() - 24.0) < 1e-7 || fabs(original.ToFloat() - 25.0) < 1e-7 || fabs(original.ToFloat() - 30.0) < 1e-7) &&
-		(fabs(target.ToFloat() - 24.0) < 1e-7 || fabs(target.ToFloat() - 25.0) < 1e-7 || fabs(target.ToFloat() - 30.0) < 1e-7)) {
+	pattern_mapping = (fabs(original.ToFloat() - 24.0) < 1e-7 || fabs(original.ToFloat() - 25.0) < 1e-7 || fabs(original.ToFloat() - 30.0) < 1e-7) &&
+					  (fabs(target.ToFloat() - 24.0) < 1e-7 || fabs(target.ToFloat() - 25.0) < 1e-7 || fabs(target.ToFloat() - 30.0) < 1e-7);
+	if (pattern_mapping) {
 
 		// Get the difference (in frames) between the original and target frame rates
-		float difference = target.ToInt() - original.ToInt();
+		pattern_difference = target.ToInt() - original.ToInt();
 
 		// Find the number (i.e. interval) of fields that need to be skipped or repeated
-		int field_interval = 0;
-		int frame_interval = 0;
+		pattern_field_interval = 0;
+		pattern_frame_interval = 0;
 
-		if (difference != 0)
+		if (pattern_difference != 0)
 		{
-			field_interval = round(fabs(original.ToInt() / difference));
+			pattern_field_interval = round(fabs(original.ToInt() / pattern_difference));
 
 			// Get frame interval (2 fields per frame)
-			frame_interval = field_interval * 2.0f;
+			pattern_frame_interval = pattern_field_interval * 2.0f;
 		}
 
-
 		// Calculate # of fields to map
-		int64_t frame = 1;
 		int64_t number_of_fields = reader->info.video_length * 2;
 
-		// Loop through all fields in the original video file
-		for (int64_t field = 1; field <= number_of_fields; field++)
+		// Find the period of the field pattern: a multiple of the frame interval, which ends on a whole frame, with the
+		// odd / even flag back where it started (so every period is the first one, shifted by a number of frames)
+		int64_t period_fields = 0;
+		int64_t base_fields = (pattern_difference == 0) ? 2 : pattern_frame_interval;
+		for (int64_t length = base_fields; length <= base_fields * 8 && length <= number_of_fields; length *= 2)
 		{
-
-			if (difference == 0) // Same frame rate, NO pull-down or special techniques required
-			{
-				// Add fields
-				AddField(frame);
+			fields.clear();
+			field_toggle = first_field_toggle;
+			int64_t frame = 1;
+			int64_t next_field = add_pattern_fields(1, length, frame);
+			int64_t frames_advanced = frame - 1;
+			if (next_field == length + 1 && field_toggle == first_field_toggle && fields.size() % 2 == 0 && !fields.empty() &&
+				(pattern_pulldown() != PULLDOWN_NONE || pattern_difference >= 0 || frames_advanced % pattern_field_interval == 0)) {
+				period_fields = length;
+				pattern = fields;
+				pattern_frames = frames_advanced;
+				break;
 			}
-			else if (difference > 0) // Need to ADD fake fields & frames, because original video has too few frames
-			{
-				// Add current field
-				AddField(frame);
-
-				if (pulldown == PULLDOWN_CLASSIC && field % field_interval == 0)
-				{
-					// Add extra field for each 'field interval
-					AddField(frame);
-				}
-				else if (pulldown == PULLDOWN_ADVANCED && field % field_interval == 0 && field % frame_interval != 0)
-				{
-					// Add both extra fields in the middle 'together' (i.e. 2:3:3:2 technique)
-					AddField(frame); // add field for current frame
+		}
 
-					if (frame + 1 <= info.video_length)
-						// add field for next frame (if the next frame exists)
-						AddField(Field(frame + 1, field_toggle));
-				}
-				else if (pulldown == PULLDOWN_NONE && field % frame_interval == 0)
-				{
-					// No pull-down technique needed, just repeat this frame
-					AddField(frame);
-					AddField(frame);
-				}
-			}
-			else if (difference < 0) // Need to SKIP fake fields & frames, because we want to return to the original film frame rate
-			{
+		// Every full period repeats the pattern, except near the end of the video, where the advanced
+		// pull-down stops adding fields of the next frame (so those periods are part of the tail)
+		if (period_fields > 0) {
+			pattern_periods = number_of_fields / period_fields;
+			if (pattern_pulldown() == PULLDOWN_ADVANCED && pattern_difference > 0)
+				pattern_periods = std::min(pattern_periods, std::max(int64_t(0), (info.video_length - 2) / pattern_frames));
+		}
 
-				if (pulldown == PULLDOWN_CLASSIC && field % field_interval == 0)
-				{
-					// skip current field and toggle the odd/even flag
-					field_toggle = (field_toggle ? false : true);
-				}
-				else if (pulldown == PULLDOWN_ADVANCED && field % field_interval == 0 && field % frame_interval != 0)
-				{
-					// skip this field, plus the next field
-					field++;
-				}
-				else if (pulldown == PULLDOWN_NONE && frame % field_interval == 0)
-				{
-					// skip this field, plus the next one
-					field++;
-				}
-				else
-				{
-					// No skipping needed, so add the field
-					AddField(frame);
-				}
-			}
+		// Add the fields of the tail (which leaves the odd / even flag where the full mapping would)
+		fields.clear();
+		field_toggle = first_field_toggle;
+		int64_t frame = 1 + pattern_periods * pattern_frames;
+		add_pattern_fields(1 + pattern_periods * period_fields, number_of_fields, frame);
+		tail = fields;
+		fields.clear();
 
-			// increment frame number (if field is divisible by 2)
-			if (field % 2 == 0 && field > 0)
-				frame++;
-		}
+		// Combine the fields into frames
+		mapped_length = (pattern_periods * int64_t(pattern.size()) + int64_t(tail.size())) / 2;
 
 	} else {
 		// Map the remaining framerates using a linear algorithm
@@ -212,107 +288,56 @@ void FrameMapper::Init()
 		int64_t new_length = reader->info.video_length * rate_diff;
 
 		// Calculate the value difference
-		double value_increment = (reader->info.video_length + 1) / (double) (new_length);
-
-		// Loop through curve, and build list of frames
-		double original_frame_num = 1.0f;
-		for (int64_t frame_num = 1; frame_num <= new_length; frame_num++)
-		{
-			// Add 2 fields per frame
-			AddField(round(original_frame_num));
-			AddField(round(original_frame_num));
+		linear_increment = (reader->info.video_length + 1) / (double) (new_length);
 
-			// Increment original frame number
-			original_frame_num += value_increment;
-		}
+		// 2 fields per frame
+		mapped_length = std::max(int64_t(0), new_length);
 	}
 
-	// Loop through the target frames again (combining fields into frames)
-	Field Odd(0, true);		// temp field used to track the ODD field
-	Field Even(0, true);	// temp field used to track the EVEN field
-
-	// Variables used to remap audio samples
-	int64_t start_samples_frame = 1;
-	int start_samples_position = 0;
-
-	for (int64_t field = 1; field <= fields.size(); field++)
-	{
-		// Get the current field
-		Field f = fields[field - 1];
-
-		// Is field divisible by 2?
-		if (field % 2 == 0 && field > 0)
-		{
-			// New frame number
-			int64_t frame_number = field / 2;
-
-			// Set the bottom frame
-			if (f.isOdd)
-				Odd = f;
-			else
-				Even = f;
-
-			// Determine the range of samples (from the original rate). Resampling happens in real-time when
-			// calling the GetFrame() method. So this method only needs to redistribute the original samples with
-			// the original sample rate.
-			int64_t end_samples_frame = start_samples_frame;
-			int end_samples_position = start_samples_position;
-			int remaining_samples = Frame::GetSamplesPerFrame(frame_number, target, reader->info.sample_rate, reader->info.channels);
-
-			while (remaining_samples > 0)
-			{
-				// get original samples
-				int original_samples = Frame::GetSamplesPerFrame(end_samples_frame, original, reader->info.sample_rate, reader->info.channels) - end_samples_position;
-
-				// Enough samples
-				if (original_samples >= remaining_samples)
-				{
-					// Take all that we need, and break loop
-					end_samples_position += remaining_samples - 1;
-					remaining_samples = 0;
-				} else
-				{
-					// Not enough samples (take them all, and keep looping)
-					end_samples_frame += 1; // next frame
-					end_samples_position = 0; // next frame, starting on 1st sample
-					remaining_samples -= original_samples; // reduce the remaining amount
-				}
-			}
-
-
-
-			// Create the sample mapping struct
-			SampleRange Samples = {start_samples_frame, start_samples_position, end_samples_frame, end_samples_position, Frame::GetSamplesPerFrame(frame_number, target, reader->info.sample_rate, reader->info.channels)};
+	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::Init (Done)", "mapped_length", mapped_length, "pattern.size()", pattern.size(), "pattern_frames", pattern_frames, "pattern_periods", pattern_periods, "tail.size()", tail.size());
+}
 
-			// Reset the audio variables
-			start_samples_frame = end_samples_frame;
-			start_samples_position = end_samples_position + 1;
-			if (start_samples_position >= Frame::GetSamplesPerFrame(start_samples_frame, original, reader->info.sample_rate, reader->info.channels))
-			{
-				start_samples_frame += 1; // increment the frame (since we need to wrap onto the next one)
-				start_samples_position = 0; // reset to 0, since we wrapped
-			}
+// Get a field of the mapping (0 = the first field of target frame 1)
+Field FrameMapper::mapped_field(int64_t index)
+{
+	if (!pattern_mapping) {
+		// Linear mapping (2 fields per frame, toggling the odd / even flag)
+		bool is_odd = (index % 2 == 0) ? first_field_toggle : !first_field_toggle;
+		return Field(round(1.0 + (index / 2) * linear_increment), is_odd);
+	}
 
-			// Create a frame and ADD it to the frames collection
-			MappedFrame frame = {Odd, Even, Samples};
-			frames.push_back(frame);
-		}
-		else
-		{
-			// Set the top field
-			if (f.isOdd)
-				Odd = f;
-			else
-				Even = f;
-		}
+	// Repeating periods of the pattern (shifted by the frames of each period)
+	int64_t pattern_fields = pattern_periods * int64_t(pattern.size());
+	if (index < pattern_fields) {
+		Field field = pattern[index % pattern.size()];
+		field.Frame += (index / pattern.size()) * pattern_frames;
+		return field;
 	}
 
-	// Clear the internal fields list (no longer needed)
-	fields.clear();
+	// The tail of the mapping
+	return tail[index - pattern_fields];
+}
+
+// Find the original frame (and the sample of that frame) which contains a sample
+void FrameMapper::find_original_sample(int64_t sample, int64_t &frame_number, int &sample_position)
+{
+	int sample_rate = reader->info.sample_rate;
+	int channels = reader->info.channels;
+
+	// Estimate the frame (from the frame rate), and then correct for the rounding of each frame's samples
+	frame_number = int64_t(sample * original.ToDouble() / sample_rate) + 1;
+	while (frame_number > 1 && Frame::GetSamplesBeforeFrame(frame_number, original, sample_rate, channels) > sample)
+		frame_number--;
+	while (Frame::GetSamplesBeforeFrame(frame_number + 1, original, sample_rate, channels) <= sample)
+		frame_number++;
+	sample_position = sample - Frame::GetSamplesBeforeFrame(frame_number, original, sample_rate, channels);
 }
 
 MappedFrame FrameMapper::GetMappedFrame(int64_t TargetFrameNumber)
 {
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+
 	// Check if mappings are dirty (and need to be recalculated)
 	if (is_dirty)
 		// Recalculate mappings
@@ -333,19 +358,60 @@ MappedFrame FrameMapper::GetMappedFrame(int64_t TargetFrameNumber)
 	}
 
 	// Check if frame number is valid
-	if(TargetFrameNumber < 1 || frames.size() == 0)
+	if(TargetFrameNumber < 1 || mapped_length == 0)
 		// frame too small, return error
-		throw OutOfBoundsFrame("An invalid frame was requested.", TargetFrameNumber, frames.size());
+		throw OutOfBoundsFrame("An invalid frame was requested.", TargetFrameNumber, mapped_length);
 
-	else if (TargetFrameNumber > frames.size())
+	else if (TargetFrameNumber > mapped_length)
 		// frame too large, set to end frame
-		TargetFrameNumber = frames.size();
+		TargetFrameNumber = mapped_length;
+
+	// The top and bottom fields of this frame
+	MappedFrame frame;
+	Field top = mapped_field(TargetFrameNumber * 2 - 2);
+	Field bottom = mapped_field(TargetFrameNumber * 2 - 1);
+	if (top.isOdd) frame.Odd = top; else frame.Even = top;
+	if (bottom.isOdd) frame.Odd = bottom; else frame.Even = bottom;
+
+	// When both fields have the same flag (i.e. after a skipped field), the other lines continue from the last earlier field
+	// with that flag. The pattern always has both flags, so this never needs to search through more than a period.
+	if (top.isOdd == bottom.isOdd) {
+		int64_t max_search = 2 * int64_t(pattern.size() + tail.size()) + 2;
+		frame.Odd = bottom.isOdd ? bottom : Field(0, true);
+		frame.Even = bottom.isOdd ? Field(0, true) : bottom;
+		for (int64_t index = TargetFrameNumber * 2 - 3; index >= 0 && index >= TargetFrameNumber * 2 - 3 - max_search; index--) {
+			Field field = mapped_field(index);
+			if (field.isOdd != bottom.isOdd) {
+				if (field.isOdd) frame.Odd = field; else frame.Even = field;
+				break;
+			}
+		}
+	}
+
+	// Determine the range of samples (from the original rate). Resampling happens in real-time when
+	// calling the GetFrame() method. So this method only needs to redistribute the original samples with
+	// the original sample rate.
+	int sample_rate = reader->info.sample_rate;
+	int channels = reader->info.channels;
+	int total_samples = Frame::GetSamplesPerFrame(TargetFrameNumber, target, sample_rate, channels);
+	if (sample_rate > 0 && channels > 0 && total_samples > 0) {
+		int64_t first_sample = Frame::GetSamplesBeforeFrame(TargetFrameNumber, target, sample_rate, channels);
+		find_original_sample(first_sample, frame.Samples.frame_start, frame.Samples.sample_start);
+		find_original_sample(first_sample + total_samples - 1, frame.Samples.frame_end, frame.Samples.sample_end);
+	} else {
+		// No audio samples (each frame maps to the same original frame number)
+		frame.Samples.frame_start = TargetFrameNumber;
+		frame.Samples.frame_end = TargetFrameNumber;
+		frame.Samples.sample_start = 0;
+		frame.Samples.sample_end = 0;
+	}
+	frame.Samples.total = total_samples;
 
 	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetMappedFrame", "TargetFrameNumber", TargetFrameNumber, "frames.size()", frames.size(), "frames[...].Odd", frames[TargetFrameNumber - 1].Odd.Frame, "frames[...].Even", frames[TargetFrameNumber - 1].Even.Frame);
+	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetMappedFrame", "TargetFrameNumber", TargetFrameNumber, "mapped_length", mapped_length, "frame.Odd", frame.Odd.Frame, "frame.Even", frame.Even.Frame);
 
 	// Return frame
-	return frames[TargetFrameNumber - 1];
+	return frame;
 }
 
 // Get or generate a blank frame
@@ -356,24 +422,19 @@ std::shared_ptr<Frame> FrameMapper::GetOrCreateFrame(int64_t number)
 	// Init some basic properties about this frame (keep sample rate and # channels the same as the original reader for now)
 	int samples_in_frame = Frame::GetSamplesPerFrame(number, target, reader->info.sample_rate, reader->info.channels);
 
-	try {
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetOrCreateFrame (from reader)", "number", number, "samples_in_frame", samples_in_frame);
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetOrCreateFrame (from reader)", "number", number, "samples_in_frame", samples_in_frame);
 
-		// Attempt to get a frame (but this could fail if a reader has just been closed)
-		new_frame = reader->GetFrame(number);
+	// Use a source frame read by GetFrames (at its full size)
+	std::map<int64_t, std::shared_ptr<Frame> >::iterator batch_frame = batch_frames.find(number);
+	if (batch_frame != batch_frames.end() && target_width <= 0 && target_height <= 0)
+		return batch_frame->second;
 
+	// Attempt to get a frame (but this could fail if a reader has just been closed)
+	if (reader->TryGetFrame(number, new_frame, target_width, target_height) == FRAME_OK)
 		// Return real frame
 		return new_frame;
 
-	} catch (const ReaderClosed & e) {
-		// ...
-	} catch (const TooManySeeks & e) {
-		// ...
-	} catch (const OutOfBoundsFrame & e) {
-		// ...
-	}
-
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetOrCreateFrame (create blank)", "number", number, "samples_in_frame", samples_in_frame);
 
@@ -388,12 +449,71 @@ std::shared_ptr<Frame> FrameMapper::GetOrCreateFrame(int64_t number)
 // Get an openshot::Frame object for a specific frame number of this reader.
 std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame)
 {
-	// Check final cache, and just return the frame (if it's available)
+	return GetFrame(requested_frame, 0, 0);
+}
+
+// Get a range of consecutive frames (with the source frames of the range read in a single call)
+std::vector<std::shared_ptr<Frame> > FrameMapper::GetFrames(int64_t start, int64_t count)
+{
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+
+	// Check if mappings are dirty (and need to be recalculated)
+	if (is_dirty)
+		// Recalculate mappings
+		Init();
+
+	if (count <= 1 || !reader || mapped_length == 0 || info.has_single_image)
+		return ReaderBase::GetFrames(start, count);
+
+	// Find the source frames of the range (including the 2nd frames which are blended into a frame)
+	int64_t first_frame = std::max(int64_t(1), std::min(start, mapped_length));
+	int64_t last_frame = std::max(int64_t(1), std::min(start + count - 1, mapped_length));
+	MappedFrame first_mapped = GetMappedFrame(first_frame);
+	MappedFrame last_mapped = GetMappedFrame(last_frame);
+	int64_t first_source = std::max(int64_t(1), std::min(first_mapped.Odd.Frame, first_mapped.Even.Frame));
+	int64_t last_source = std::max(last_mapped.Odd.Frame, last_mapped.Even.Frame) + 1;
+	if (reader->info.video_length > 0)
+		last_source = std::min(last_source, reader->info.video_length);
+
+	// Read the source frames, and map the frames from them
+	std::vector<std::shared_ptr<Frame> > source_frames = reader->GetFrames(first_source, last_source - first_source + 1);
+	for (size_t index = 0; index < source_frames.size(); index++)
+		batch_frames[first_source + index] = source_frames[index];
+
+	std::vector<std::shared_ptr<Frame> > frames;
+	try {
+		for (int64_t number = start; number < start + count; number++)
+			frames.push_back(GetFrame(number));
+	}
+	catch (...) {
+		batch_frames.clear();
+		throw;
+	}
+	batch_frames.clear();
+	return frames;
+}
+
+// Get a frame, with the original frames requested from the source reader at the size they will be drawn at
+std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame, int width, int height)
+{
+	TraceSpan trace_span("FrameMapper::GetFrame", "mapping", requested_frame);
+	static MemoryGauge& mapper_memory = Metrics::Instance()->GetMemory("images.frame_mapper");
+	ScopedMemoryTag memory_tag(mapper_memory);
+
+	// Check final cache, and just return the frame (if it's available, and not smaller than requested)
 	std::shared_ptr<Frame> final_frame = final_cache.GetFrame(requested_frame);
+	if (final_frame && width > 0 && final_frame->has_image_data &&
+		(final_frame->GetWidth() < width || final_frame->GetHeight() < height)) {
+		final_cache.Remove(requested_frame);
+		final_frame.reset();
+	}
 	if (final_frame) return final_frame;
 
 	// Create a scoped lock, allowing only a single thread to run the following code at one time
 	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+	target_width = width;
+	target_height = height;
 
 	// Check if mappings are dirty (and need to be recalculated)
 	if (is_dirty)
@@ -404,16 +524,32 @@ std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame)
 	final_frame = final_cache.GetFrame(requested_frame);
 	if (final_frame) return final_frame;
 
-	// Minimum number of frames to process (for performance reasons)
-	// Dialing this down to 1 for now, as it seems to improve performance, and reduce export crashes
-	int minimum_frames = 1;
+	// Number of frames to process (a batch is only mapped when frames are requested in order)
+	int minimum_frames = calculate_batch_size(requested_frame);
+	last_requested_frame = requested_frame;
 
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetFrame (Loop through frames)", "requested_frame", requested_frame, "minimum_frames", minimum_frames);
 
+	// The source frames are requested (and the audio is resampled) in order, on this thread. The fields of each
+	// frame are woven after the loop, in parallel, and the frames are only cached once they are complete.
+	std::vector<std::shared_ptr<Frame> > mapped_frames;
+	std::vector<std::pair<std::shared_ptr<Frame>, std::shared_ptr<Frame> > > weave_frames;
+
+	// Frames whose images are interpolated (from the image of the frame, to the image of a 2nd frame)
+	struct InterpolatedFrame {
+		std::shared_ptr<Frame> frame;
+		std::shared_ptr<Frame> second_frame;
+		float weight;
+	};
+	std::vector<InterpolatedFrame> interpolated_frames;
+
 	// Loop through all requested frames
 	for (int64_t frame_number = requested_frame; frame_number < requested_frame + minimum_frames; frame_number++)
 	{
+		// Stop at the first frame which is already mapped (so the audio is resampled in order)
+		if (frame_number > requested_frame && final_cache.GetFrame(frame_number))
+			break;
 
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::GetFrame (inside omp for loop)", "frame_number", frame_number, "minimum_frames", minimum_frames, "requested_frame", requested_frame);
@@ -444,8 +580,8 @@ std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame)
 			mapped_frame->number == frame_number &&// in some conditions (e.g. end of stream)
 			info.fps.num == reader->info.fps.num &&
 			info.fps.den == reader->info.fps.den) {
-				// Add original frame to cache, and skip the rest (for performance reasons)
-				final_cache.Add(mapped_frame);
+				// Use the original frame, and skip the rest (for performance reasons)
+				mapped_frames.push_back(mapped_frame);
 				continue;
 		}
 
@@ -455,18 +591,36 @@ std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame)
 		frame->ChannelsLayout(mapped_frame->ChannelsLayout());
 
 
-		// Copy the image from the odd field
-		std::shared_ptr<Frame> odd_frame;
-		odd_frame = GetOrCreateFrame(mapped.Odd.Frame);
+		if (pulldown == PULLDOWN_BLEND || pulldown == PULLDOWN_MOTION) {
+			// The point in time of this frame, between the 2 nearest original frames
+			double position = 1.0 + (frame_number - 1) * original.ToDouble() / target.ToDouble();
+			int64_t first_number = std::max(int64_t(1), std::min(reader->info.video_length, int64_t(floor(position))));
+			int64_t second_number = (first_number < reader->info.video_length) ? first_number + 1 : first_number;
+			float weight = position - first_number;
+
+			// Copy the image of the first frame (and interpolate the image after the loop, unless it is almost the first frame)
+			std::shared_ptr<Frame> first_frame = GetOrCreateFrame(first_number);
+			if (first_frame)
+				frame->ShareImage(first_frame);
+			if (first_frame && second_number != first_number && weight > 1.0f / 512) {
+				InterpolatedFrame interpolated = {frame, GetOrCreateFrame(second_number), weight};
+				interpolated_frames.push_back(interpolated);
+			}
 
-		if (odd_frame)
-			frame->AddImage(std::shared_ptr<QImage>(new QImage(*odd_frame->GetImage())), true);
-		if (mapped.Odd.Frame != mapped.Even.Frame) {
-			// Add even lines (if different than the previous image)
-			std::shared_ptr<Frame> even_frame;
-			even_frame = GetOrCreateFrame(mapped.Even.Frame);
-			if (even_frame)
-				frame->AddImage(std::shared_ptr<QImage>(new QImage(*even_frame->GetImage())), false);
+		} else {
+			// Copy the image from the odd field
+			std::shared_ptr<Frame> odd_frame;
+			odd_frame = GetOrCreateFrame(mapped.Odd.Frame);
+
+			if (odd_frame)
+				frame->ShareImage(odd_frame);
+			if (mapped.Odd.Frame != mapped.Even.Frame) {
+				// Add even lines (if different than the previous image)
+				std::shared_ptr<Frame> even_frame;
+				even_frame = GetOrCreateFrame(mapped.Even.Frame);
+				if (even_frame)
+					weave_frames.push_back(std::make_pair(frame, even_frame));
+			}
 		}
 
 		// Resample audio on frame (if needed)
@@ -478,113 +632,117 @@ std::shared_ptr<Frame> FrameMapper::GetFrame(int64_t requested_frame)
 			// Resample audio and correct # of channels if needed
 			need_resampling = true;
 
-		// create a copy of mapped.Samples that will be used by copy loop
-		SampleRange copy_samples = mapped.Samples;
-
 		if (need_resampling)
+			// Resample the audio (from the stream of source audio) and correct # of channels
+			stream_mapped_audio(frame, mapped);
+		else
 		{
-			// Resampling needed, modify copy of SampleRange object that
-			// includes some additional input samples on first iteration,
-			// and continues the offset to ensure that the sample rate
-			// converter isn't input limited.
-			const int EXTRA_INPUT_SAMPLES = 20;
-
-			// Extend end sample count by an additional EXTRA_INPUT_SAMPLES samples
-			copy_samples.sample_end += EXTRA_INPUT_SAMPLES;
-			int samples_per_end_frame =
-				Frame::GetSamplesPerFrame(copy_samples.frame_end, original,
-										  reader->info.sample_rate, reader->info.channels);
-			if (copy_samples.sample_end >= samples_per_end_frame)
+			// Copy the samples
+			int samples_copied = 0;
+			int64_t starting_frame = mapped.Samples.frame_start;
+			while (info.has_audio && samples_copied < mapped.Samples.total)
 			{
-				// check for wrapping
-				copy_samples.frame_end++;
-				copy_samples.sample_end -= samples_per_end_frame;
-			}
-			copy_samples.total += EXTRA_INPUT_SAMPLES;
-
-			if (avr) {
-				// Sample rate conversion has been allocated on this clip, so
-				// this is not the first iteration. Extend start position by
-				// EXTRA_INPUT_SAMPLES to keep step with previous frame
-				copy_samples.sample_start += EXTRA_INPUT_SAMPLES;
-				int samples_per_start_frame =
-					Frame::GetSamplesPerFrame(copy_samples.frame_start, original,
-											  reader->info.sample_rate, reader->info.channels);
-				if (copy_samples.sample_start >= samples_per_start_frame)
+				// Init number of samples to copy this iteration
+				int remaining_samples = mapped.Samples.total - samples_copied;
+				int number_to_copy = 0;
+
+				// number of original samples on this frame
+				std::shared_ptr<Frame> original_frame = GetOrCreateFrame(starting_frame);
+				int original_samples = original_frame->GetAudioSamplesCount();
+
+				// Loop through each channel
+				for (int channel = 0; channel < channels_in_frame; channel++)
 				{
-					// check for wrapping
-					copy_samples.frame_start++;
-					copy_samples.sample_start -= samples_per_start_frame;
+					if (starting_frame == mapped.Samples.frame_start)
+					{
+						// Starting frame (take the ending samples)
+						number_to_copy = original_samples - mapped.Samples.sample_start;
+						if (number_to_copy > remaining_samples)
+							number_to_copy = remaining_samples;
+
+						// Add samples to new frame
+						frame->AddAudio(true, channel, samples_copied, original_frame->GetAudioSamples(channel) + mapped.Samples.sample_start, number_to_copy, 1.0);
+					}
+					else if (starting_frame > mapped.Samples.frame_start && starting_frame < mapped.Samples.frame_end)
+					{
+						// Middle frame (take all samples)
+						number_to_copy = original_samples;
+						if (number_to_copy > remaining_samples)
+							number_to_copy = remaining_samples;
+
+						// Add samples to new frame
+						frame->AddAudio(true, channel, samples_copied, original_frame->GetAudioSamples(channel), number_to_copy, 1.0);
+					}
+					else
+					{
+						// Ending frame (take the beginning samples)
+						number_to_copy = mapped.Samples.sample_end + 1;
+						if (number_to_copy > remaining_samples)
+							number_to_copy = remaining_samples;
+
+						// Add samples to new frame
+						frame->AddAudio(false, channel, samples_copied, original_frame->GetAudioSamples(channel), number_to_copy, 1.0);
+					}
 				}
-				copy_samples.total -= EXTRA_INPUT_SAMPLES;
+
+				// increment frame
+				samples_copied += number_to_copy;
+				starting_frame++;
 			}
 		}
 
-		// Copy the samples
-		int samples_copied = 0;
-		int64_t starting_frame = copy_samples.frame_start;
-		while (info.has_audio && samples_copied < copy_samples.total)
-		{
-			// Init number of samples to copy this iteration
-			int remaining_samples = copy_samples.total - samples_copied;
-			int number_to_copy = 0;
-
-			// number of original samples on this frame
-			std::shared_ptr<Frame> original_frame = GetOrCreateFrame(starting_frame);
-			int original_samples = original_frame->GetAudioSamplesCount();
+		mapped_frames.push_back(frame);
 
-			// Loop through each channel
-			for (int channel = 0; channel < channels_in_frame; channel++)
-			{
-				if (starting_frame == copy_samples.frame_start)
-				{
-					// Starting frame (take the ending samples)
-					number_to_copy = original_samples - copy_samples.sample_start;
-					if (number_to_copy > remaining_samples)
-						number_to_copy = remaining_samples;
-
-					// Add samples to new frame
-					frame->AddAudio(true, channel, samples_copied, original_frame->GetAudioSamples(channel) + copy_samples.sample_start, number_to_copy, 1.0);
-				}
-				else if (starting_frame > copy_samples.frame_start && starting_frame < copy_samples.frame_end)
-				{
-					// Middle frame (take all samples)
-					number_to_copy = original_samples;
-					if (number_to_copy > remaining_samples)
-						number_to_copy = remaining_samples;
+	} // for loop
 
-					// Add samples to new frame
-					frame->AddAudio(true, channel, samples_copied, original_frame->GetAudioSamples(channel), number_to_copy, 1.0);
-				}
-				else
-				{
-					// Ending frame (take the beginning samples)
-					number_to_copy = copy_samples.sample_end + 1;
-					if (number_to_copy > remaining_samples)
-						number_to_copy = remaining_samples;
+	// Add the even lines of each frame (if different than the odd lines), or interpolate its image, which decodes both images
+	TaskPool::Current()->ParallelFor(0, weave_frames.size() + interpolated_frames.size(), [&](int64_t job_index)
+	{
+		if (job_index < (int64_t) weave_frames.size()) {
+			std::shared_ptr<Frame> frame = weave_frames[job_index].first;
+			std::shared_ptr<Frame> even_frame = weave_frames[job_index].second;
+			frame->AddImage(std::shared_ptr<QImage>(new QImage(*even_frame->GetImage())), false);
+			return;
+		}
 
-					// Add samples to new frame
-					frame->AddAudio(false, channel, samples_copied, original_frame->GetAudioSamples(channel), number_to_copy, 1.0);
-				}
-			}
+		const InterpolatedFrame &interpolated = interpolated_frames[job_index - weave_frames.size()];
+		std::shared_ptr<QImage> first_image = interpolated.frame->GetImage();
+		std::shared_ptr<QImage> second_image = interpolated.second_frame->GetImage();
+		if (!first_image || !second_image || first_image->size() != second_image->size() ||
+			first_image->format() != second_image->format() || first_image->depth() != 32)
+			return;
+
+		std::shared_ptr<QImage> image(new QImage(first_image->size(), first_image->format()));
+		if (pulldown == PULLDOWN_MOTION)
+			InterpolationKernels::MotionBlend(image->bits(), image->bytesPerLine(), first_image->constBits(), first_image->bytesPerLine(),
+											  second_image->constBits(), second_image->bytesPerLine(), image->width(), image->height(), interpolated.weight);
+		else
+			InterpolationKernels::Blend(image->bits(), image->bytesPerLine(), first_image->constBits(), first_image->bytesPerLine(),
+										second_image->constBits(), second_image->bytesPerLine(), image->width(), image->height(), interpolated.weight);
+		interpolated.frame->AddImage(image);
+	});
 
-			// increment frame
-			samples_copied += number_to_copy;
-			starting_frame++;
-		}
+	// Add frames to final cache
+	for (size_t index = 0; index < mapped_frames.size(); index++)
+		final_cache.Add(mapped_frames[index]);
 
-		// Resample audio on frame (if needed)
-		if (need_resampling)
-			// Resample audio and correct # of channels if needed
-			ResampleMappedAudio(frame, mapped.Odd.Frame);
+	// Return processed openshot::Frame (the first frame of the batch)
+	return mapped_frames.front();
+}
 
-		// Add frame to final cache
-		final_cache.Add(frame);
+// Number of frames to map for a cache miss (more than 1 only when frames are requested in order)
+int FrameMapper::calculate_batch_size(int64_t requested_frame)
+{
+	// Random access (seeking) only needs the requested frame
+	if (requested_frame != last_requested_frame + 1)
+		return 1;
 
-	} // for loop
+	// One frame per worker thread (leaving room in the final cache for the frames already returned)
+	int batch_size = std::max(1, std::min(TaskPool::Current()->NumThreads(), OPEN_MP_NUM_PROCESSORS));
 
-	// Return processed openshot::Frame
-	return final_cache.GetFrame(requested_frame);
+	// Never map past the last frame
+	int64_t remaining_frames = mapped_length - requested_frame + 1;
+	return int(std::max(int64_t(1), std::min(int64_t(batch_size), remaining_frames)));
 }
 
 void FrameMapper::PrintMapping()
@@ -610,9 +768,9 @@ void FrameMapper::PrintMapping()
 	}
 
 	// Loop through frame mappings
-	for (float map = 1; map <= frames.size(); map++)
+	for (int64_t map = 1; map <= mapped_length; map++)
 	{
-		MappedFrame frame = frames[map - 1];
+		MappedFrame frame = GetMappedFrame(map);
 		cout << "Target frame #: " << map << " mapped to original frame #:\t(" << frame.Odd.Frame << " odd, " << frame.Even.Frame << " even)" << endl;
 		cout << "  - Audio samples mapped to frame " << frame.Samples.frame_start << ":" << frame.Samples.sample_start << " to frame " << frame.Samples.frame_end << ":" << frame.Samples.sample_end << endl;
 	}
@@ -641,6 +799,23 @@ void FrameMapper::Open()
 	}
 }
 
+// Forward the stream hint to the source reader
+void FrameMapper::EnableStreams(bool video, bool audio)
+{
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+	if (video == video_enabled && audio == audio_enabled)
+		return;
+	video_enabled = video;
+	audio_enabled = audio;
+
+	if (reader)
+		reader->EnableStreams(video, audio);
+
+	// The mapped frames may be missing a stream which is now used
+	final_cache.Clear();
+	reset_audio_stream();
+}
+
 // Close the internal reader
 void FrameMapper::Close()
 {
@@ -654,9 +829,11 @@ void FrameMapper::Close()
 		// Close internal reader
 		reader->Close();
 
-		// Clear the fields & frames lists
+		// Clear the mapping
 		fields.clear();
-		frames.clear();
+		pattern.clear();
+		tail.clear();
+		mapped_length = 0;
 
 		// Mark as dirty
 		is_dirty = true;
@@ -670,15 +847,24 @@ void FrameMapper::Close()
 			SWR_FREE(&avr);
 			avr = NULL;
 		}
+		reset_audio_stream();
 	}
 }
 
 
+// Get the metrics of this mapper's cache, and of the mapped reader
+Json::Value FrameMapper::MetricsValue() {
+	Json::Value root = ReaderBase::MetricsValue();
+	if (reader)
+		root["reader"] = reader->MetricsValue();
+	return root;
+}
+
 // Generate JSON string of this object
 std::string FrameMapper::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -697,13 +883,7 @@ void FrameMapper::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -740,6 +920,11 @@ void FrameMapper::ChangeMapping(Fraction target_fps, PulldownType target_pulldow
 {
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::ChangeMapping", "target_fps.num", target_fps.num, "target_fps.den", target_fps.den, "target_pulldown", target_pulldown, "target_sample_rate", target_sample_rate, "target_channels", target_channels, "target_channel_layout", target_channel_layout);
 
+	// The same mapping keeps its mapped frames (i.e. when a clip is updated on the timeline)
+	if (target.num == target_fps.num && target.den == target_fps.den && pulldown == target_pulldown && info.sample_rate == target_sample_rate &&
+		info.channels == target_channels && info.channel_layout == target_channel_layout)
+		return;
+
 	// Mark as dirty
 	is_dirty = true;
 
@@ -767,6 +952,109 @@ void FrameMapper::ChangeMapping(Fraction target_fps, PulldownType target_pulldow
 		SWR_FREE(&avr);
 		avr = NULL;
 	}
+	reset_audio_stream();
+}
+
+// Free the audio stream (so the next frame restarts it, i.e. after a seek)
+void FrameMapper::reset_audio_stream()
+{
+	if (audio_stream) {
+		SWR_CLOSE(audio_stream);
+		SWR_FREE(&audio_stream);
+		audio_stream = NULL;
+	}
+	audio_stream_samples.clear();
+	audio_stream_frame = 0;
+}
+
+// Feed the samples of a source frame (starting at a sample) to the audio stream
+void FrameMapper::feed_audio_stream(std::shared_ptr<Frame> source_frame, int start_sample)
+{
+	AudioSamplesView view = source_frame->GetAudioView();
+	int sample_rate_in_frame = source_frame->SampleRate();
+	int input_samples = std::max(0, view.sample_count - start_sample);
+	if (view.channel_count <= 0 || sample_rate_in_frame <= 0)
+		return;
+
+	// The resampling context is set up for the first source frame (and again, if the source audio format changes)
+	if (audio_stream && (audio_stream_sample_rate != sample_rate_in_frame || audio_stream_channels != view.channel_count)) {
+		SWR_CLOSE(audio_stream);
+		SWR_FREE(&audio_stream);
+		audio_stream = NULL;
+	}
+	if (!audio_stream) {
+		audio_stream = SWR_ALLOC();
+		av_opt_set_int(audio_stream,  "in_channel_layout", source_frame->ChannelsLayout(), 0);
+		av_opt_set_int(audio_stream, "out_channel_layout", info.channel_layout, 0);
+		av_opt_set_int(audio_stream,  "in_sample_fmt",     AV_SAMPLE_FMT_FLTP, 0);
+		av_opt_set_int(audio_stream, "out_sample_fmt",     AV_SAMPLE_FMT_FLTP, 0);
+		av_opt_set_int(audio_stream,  "in_sample_rate",    sample_rate_in_frame, 0);
+		av_opt_set_int(audio_stream, "out_sample_rate",    info.sample_rate, 0);
+		av_opt_set_int(audio_stream,  "in_channels",       view.channel_count, 0);
+		av_opt_set_int(audio_stream, "out_channels",       info.channels, 0);
+		SWR_INIT(audio_stream);
+		audio_stream_sample_rate = sample_rate_in_frame;
+		audio_stream_channels = view.channel_count;
+		audio_stream_samples.resize(info.channels);
+	}
+
+	// Input planes (the samples of each channel are not copied)
+	std::vector<const float*> input(view.channel_count);
+	for (int channel = 0; channel < view.channel_count; channel++)
+		input[channel] = view.Channel(channel) + std::min(start_sample, view.sample_count);
+
+	// Output planes (any samples which do not fit remain buffered in the resampler, for the next call)
+	int output_capacity = int(int64_t(input_samples) * info.sample_rate / sample_rate_in_frame) + 256;
+	std::vector<std::vector<float> > converted(info.channels, std::vector<float>(output_capacity));
+	std::vector<float*> output(info.channels);
+	for (int channel = 0; channel < info.channels; channel++)
+		output[channel] = converted[channel].data();
+
+	// Convert audio samples
+	int nb_samples = SWR_CONVERT(audio_stream, (uint8_t **) output.data(), output_capacity * sizeof(float), output_capacity,
+								 input.data(), input_samples * sizeof(float), input_samples);
+
+	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::feed_audio_stream", "source_frame->number", source_frame->number, "start_sample", start_sample, "input_samples", input_samples, "nb_samples", nb_samples);
+
+	// Queue the resampled samples
+	for (int channel = 0; nb_samples > 0 && channel < info.channels; channel++)
+		audio_stream_samples[channel].insert(audio_stream_samples[channel].end(), converted[channel].begin(), converted[channel].begin() + nb_samples);
+}
+
+// Add the exact number of resampled samples a target frame needs, from the audio stream
+void FrameMapper::stream_mapped_audio(std::shared_ptr<Frame> frame, const MappedFrame &mapped)
+{
+	int samples_needed = Frame::GetSamplesPerFrame(frame->number, target, info.sample_rate, info.channels);
+
+	// Restart the stream at the first sample of this frame, unless it continues from the previous frame
+	if (!audio_stream || frame->number != audio_stream_frame) {
+		reset_audio_stream();
+		audio_stream_source_frame = mapped.Samples.frame_start;
+		audio_stream_source_sample = mapped.Samples.sample_start;
+	}
+
+	// Feed each source frame (only once, in order) until enough samples are resampled. A source frame without
+	// any audio produces no samples, so the number of source frames fed is limited (and the rest is silence).
+	int max_source_frames = int(mapped.Samples.frame_end - mapped.Samples.frame_start) + 4;
+	for (int fed = 0; fed < max_source_frames && (audio_stream_samples.empty() || int(audio_stream_samples[0].size()) < samples_needed); fed++) {
+		feed_audio_stream(GetOrCreateFrame(audio_stream_source_frame), audio_stream_source_sample);
+		audio_stream_source_frame++;
+		audio_stream_source_sample = 0;
+	}
+	audio_stream_samples.resize(info.channels);
+
+	// Move the samples from the stream to the frame
+	frame->ResizeAudio(info.channels, samples_needed, info.sample_rate, info.channel_layout);
+	for (int channel = 0; channel < info.channels; channel++) {
+		std::vector<float> &samples = audio_stream_samples[channel];
+		int available = std::min(samples_needed, int(samples.size()));
+		frame->AddAudio(true, channel, 0, samples.data(), available, 1.0f);
+		samples.erase(samples.begin(), samples.begin() + available);
+	}
+	frame->SampleRate(info.sample_rate);
+	frame->ChannelsLayout(info.channel_layout);
+
+	audio_stream_frame = frame->number + 1;
 }
 
 // Resample audio and map channels (if needed)
@@ -786,10 +1074,9 @@ void FrameMapper::ResampleMappedAudio(std::shared_ptr<Frame> frame, int64_t orig
 
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::ResampleMappedAudio", "frame->number", frame->number, "original_frame_number", original_frame_number, "channels_in_frame", channels_in_frame, "samples_in_frame", samples_in_frame, "sample_rate_in_frame", sample_rate_in_frame);
 
-	// Get audio sample array
-	float* frame_samples_float = NULL;
-	// Get samples interleaved together (c1 c2 c1 c2 c1 c2)
-	frame_samples_float = frame->GetInterleavedAudioSamples(sample_rate_in_frame, NULL, &samples_in_frame);
+	// Get a view of the audio samples (without copying them)
+	AudioSamplesView frame_view = frame->GetAudioView();
+	samples_in_frame = frame_view.sample_count;
 
 	// Calculate total samples
 	total_frame_samples = samples_in_frame * channels_in_frame;
@@ -797,15 +1084,13 @@ void FrameMapper::ResampleMappedAudio(std::shared_ptr<Frame> frame, int64_t orig
 	// Create a new array (to hold all S16 audio samples for the current queued frames)
  	int16_t* frame_samples = (int16_t*) av_malloc(sizeof(int16_t)*total_frame_samples);
 
-	// Translate audio sample values back to 16 bit integers
-	for (int s = 0; s < total_frame_samples; s++)
-		// Translate sample value and copy into buffer
-		frame_samples[s] = int(frame_samples_float[s] * (1 << 15));
-
-
-	// Deallocate float array
-	delete[] frame_samples_float;
-	frame_samples_float = NULL;
+	// Translate audio sample values back to 16 bit integers (interleaved together: c1 c2 c1 c2 c1 c2)
+	for (int channel = 0; channel < channels_in_frame; channel++) {
+		const float *channel_samples = frame_view.Channel(channel);
+		for (int s = 0; s < samples_in_frame; s++)
+			// Translate sample value and copy into buffer
+			frame_samples[s * channels_in_frame + channel] = int(channel_samples[s] * (1 << 15));
+	}
 
 	ZmqLogger::Instance()->AppendDebugMethod("FrameMapper::ResampleMappedAudio (got sample data from frame)", "frame->number", frame->number, "total_frame_samples", total_frame_samples, "target channels", info.channels, "channels_in_frame", channels_in_frame, "target sample_rate", info.sample_rate, "samples_in_frame", samples_in_frame);
 
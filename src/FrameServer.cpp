@@ -0,0 +1,334 @@
+/**
+ * @file
+ * @brief Source file for FrameServer class (publishes rendered frames in shared memory)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <zmq.hpp>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "../include/FrameServer.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Send a JSON message
+static void send_json(zmq::socket_t &socket, const Json::Value &message) {
+	std::string text = WriteJson(message);
+	zmq::message_t part(text.size());
+	memcpy(part.data(), text.data(), text.size());
+	socket.send(part);
+}
+
+FrameServer::FrameServer(ReaderBase *reader, std::string name, int slot_count) :
+		reader(reader), name(name), slot_count(std::max(slot_count, 1)), width(0), height(0), memory_size(0),
+		memory(NULL), published(0), notifier(NULL), stop_requested(false)
+{
+	// POSIX shared memory names start with a slash
+	if (this->name.empty() || this->name[0] != '/')
+		this->name = "/" + this->name;
+}
+
+FrameServer::~FrameServer()
+{
+	Close();
+}
+
+// Get the header of a slot
+FrameServerSlot* FrameServer::slot(int index)
+{
+	return (FrameServerSlot*) (memory + HeaderSize + index * header()->slot_size);
+}
+
+// Create the shared memory (and open the reader, if it is closed)
+void FrameServer::Open()
+{
+	if (memory)
+		return;
+	if (!reader->IsOpen())
+		reader->Open();
+
+	width = reader->info.width;
+	height = reader->info.height;
+	if (width <= 0 || height <= 0)
+		throw InvalidOptions("The reader has no image size, so its frames can't be served.", name);
+
+	// Each slot is aligned to 64 bytes (so a slot never shares a cache line with another slot)
+	size_t bytes_per_line = width * 4;
+	size_t slot_size = (SlotHeaderSize + bytes_per_line * height + 63) / 64 * 64;
+	memory_size = HeaderSize + slot_size * slot_count;
+
+#ifdef _WIN32
+	throw InvalidOptions("Frame servers need POSIX shared memory, which is not available on Windows.", name);
+#else
+	// Only create a new object (never map the memory of another server), which only this user can read
+	int descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (descriptor < 0 && errno == EEXIST)
+		throw InvalidFile("The shared memory already exists (another frame server is using the name, or a "
+						  "server crashed without removing it).", name);
+	if (descriptor < 0)
+		throw InvalidFile("The shared memory could not be created.", name);
+	if (ftruncate(descriptor, memory_size) != 0) {
+		close(descriptor);
+		shm_unlink(name.c_str());
+		throw InvalidFile("The shared memory could not be resized.", name);
+	}
+	void *address = mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	if (address == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		throw InvalidFile("The shared memory could not be mapped.", name);
+	}
+	memory = (unsigned char *) address;
+#endif
+
+	// Initialize the layout
+	memset(memory, 0, HeaderSize);
+	FrameServerHeader *layout = new (memory) FrameServerHeader();
+	memcpy(layout->magic, "OSFRAME1", 8);
+	layout->slot_count = slot_count;
+	layout->width = width;
+	layout->height = height;
+	layout->bytes_per_line = bytes_per_line;
+	layout->slot_size = slot_size;
+	layout->published = 0;
+	for (int index = 0; index < slot_count; index++) {
+		FrameServerSlot *ring_slot = new (memory + HeaderSize + index * slot_size) FrameServerSlot();
+		ring_slot->sequence = 0;
+		ring_slot->frame_number = 0;
+	}
+	frame_slots.clear();
+	published = 0;
+
+	ZmqLogger::Instance()->AppendDebugMethod("FrameServer::Open", "width", width, "height", height, "slot_count", slot_count, "memory_size", memory_size);
+}
+
+// Unmap and remove the shared memory
+void FrameServer::Close()
+{
+	if (!memory)
+		return;
+#ifndef _WIN32
+	munmap(memory, memory_size);
+	shm_unlink(name.c_str());
+#endif
+	memory = NULL;
+	frame_slots.clear();
+}
+
+// Write a frame into the next slot (and notify the consumers)
+int FrameServer::publish_frame(std::shared_ptr<Frame> frame)
+{
+	int index = published % slot_count;
+	FrameServerSlot *ring_slot = slot(index);
+	frame_slots.erase(ring_slot->frame_number);
+
+	// Consumers skip the slot while it is written (its sequence is odd)
+	ring_slot->sequence.store(2 * published + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	ring_slot->frame_number = frame->number;
+
+	// The pixels are RGBA (not premultiplied), at the size of the reader
+	QImage image = *frame->GetImage();
+	if (image.width() != width || image.height() != height)
+		image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	if (image.format() != QImage::Format_RGBA8888)
+		image = image.convertToFormat(QImage::Format_RGBA8888);
+	unsigned char *pixels = (unsigned char *) ring_slot + SlotHeaderSize;
+	size_t bytes_per_line = width * 4;
+	for (int y = 0; y < height; y++)
+		memcpy(pixels + y * bytes_per_line, image.constScanLine(y), bytes_per_line);
+
+	ring_slot->sequence.store(2 * (published + 1), std::memory_order_release);
+	published++;
+	header()->published.store(published, std::memory_order_release);
+	frame_slots[frame->number] = index;
+
+	// Notify the consumers (while serving)
+	if (notifier) {
+		Json::Value notification;
+		notification["type"] = "frame";
+		notification["frame"] = Json::Int64(frame->number);
+		notification["slot"] = index;
+		notification["sequence"] = Json::UInt64(2 * published);
+		send_json(*notifier, notification);
+	}
+	return index;
+}
+
+// Publish a frame (unless it is still in the ring buffer)
+int FrameServer::Publish(int64_t frame_number)
+{
+	if (!memory)
+		throw WriterClosed("The FrameServer is closed. Call Open() before calling this method.", name);
+
+	std::map<int64_t, int>::iterator existing = frame_slots.find(frame_number);
+	if (existing != frame_slots.end())
+		return existing->second;
+
+	ZmqLogger::Instance()->AppendDebugMethod("FrameServer::Publish", "frame_number", frame_number, "published", published);
+	return publish_frame(reader->GetFrame(frame_number));
+}
+
+// Publish a batch of frames (rendered together)
+std::vector<int> FrameServer::PublishFrames(int64_t start, int64_t count)
+{
+	if (!memory)
+		throw WriterClosed("The FrameServer is closed. Call Open() before calling this method.", name);
+	if (count > slot_count)
+		throw InvalidOptions("A batch of frames can't be larger than the ring buffer.", name);
+
+	// Only render the frames which are not in the ring buffer
+	int64_t first_missing = -1, last_missing = -1;
+	for (int64_t number = start; number < start + count; number++)
+		if (!frame_slots.count(number)) {
+			if (first_missing < 0)
+				first_missing = number;
+			last_missing = number;
+		}
+
+	ZmqLogger::Instance()->AppendDebugMethod("FrameServer::PublishFrames", "start", start, "count", count, "first_missing", first_missing, "last_missing", last_missing);
+
+	if (first_missing >= 0) {
+		std::vector<std::shared_ptr<Frame> > frames = reader->GetFrames(first_missing, last_missing - first_missing + 1);
+		for (size_t index = 0; index < frames.size(); index++)
+			if (!frame_slots.count(frames[index]->number))
+				publish_frame(frames[index]);
+	}
+
+	std::vector<int> slots;
+	for (int64_t number = start; number < start + count; number++)
+		slots.push_back(frame_slots.count(number) ? frame_slots[number] : -1);
+	return slots;
+}
+
+// Get the name and the layout of the shared memory
+Json::Value FrameServer::InfoJson()
+{
+	Json::Value root;
+	root["type"] = "info";
+	root["name"] = name;
+	root["slot_count"] = slot_count;
+	root["width"] = width;
+	root["height"] = height;
+	root["bytes_per_line"] = width * 4;
+	root["header_size"] = Json::UInt64(HeaderSize);
+	root["slot_header_size"] = Json::UInt64(SlotHeaderSize);
+	root["slot_size"] = memory ? Json::UInt64(header()->slot_size) : Json::UInt64(0);
+	root["published"] = Json::UInt64(published);
+	root["fps"]["num"] = reader->info.fps.num;
+	root["fps"]["den"] = reader->info.fps.den;
+	root["video_length"] = Json::Int64(reader->info.video_length);
+	return root;
+}
+
+// Answer a request of a consumer
+Json::Value FrameServer::answer(const Json::Value& request)
+{
+	std::string type = request["type"].asString();
+	Json::Value reply;
+	try {
+		if (type == "info")
+			reply = InfoJson();
+		else if (type == "frame") {
+			int64_t number = request["frame"].asInt64();
+			reply["type"] = "frame";
+			reply["frame"] = Json::Int64(number);
+			reply["slot"] = Publish(number);
+			reply["sequence"] = Json::UInt64(slot(reply["slot"].asInt())->sequence.load());
+		}
+		else if (type == "frames") {
+			int64_t start = request["start"].asInt64();
+			std::vector<int> slots = PublishFrames(start, request["count"].asInt64());
+			reply["type"] = "frames";
+			reply["start"] = Json::Int64(start);
+			reply["slots"] = Json::Value(Json::arrayValue);
+			for (size_t index = 0; index < slots.size(); index++)
+				reply["slots"].append(slots[index]);
+		}
+		else if (type == "stop") {
+			stop_requested = true;
+			reply["type"] = "stop";
+		}
+		else {
+			reply["type"] = "error";
+			reply["message"] = "Unknown request type: " + type;
+		}
+	} catch (const std::exception &e) {
+		reply = Json::Value();
+		reply["type"] = "error";
+		reply["message"] = e.what();
+	}
+	return reply;
+}
+
+// Answer the requests of consumers, until a stop request
+void FrameServer::Serve(std::string control_endpoint, std::string notify_endpoint)
+{
+	if (!memory)
+		throw WriterClosed("The FrameServer is closed. Call Open() before calling this method.", name);
+
+	zmq::context_t context(1);
+	zmq::socket_t control(context, ZMQ_REP);
+	zmq::socket_t notify(context, ZMQ_PUB);
+	int linger = 0;
+	control.setsockopt(ZMQ_LINGER, linger);
+	notify.setsockopt(ZMQ_LINGER, linger);
+	control.bind(control_endpoint.c_str());
+	notify.bind(notify_endpoint.c_str());
+	notifier = &notify;
+	stop_requested = false;
+
+	ZmqLogger::Instance()->AppendDebugMethod("FrameServer::Serve", "slot_count", slot_count, "width", width, "height", height);
+
+	while (!stop_requested) {
+		// Wait for a request (checking for Stop() every 100 ms)
+		zmq::pollitem_t items[] = { { (void *) control, 0, ZMQ_POLLIN, 0 } };
+		if (zmq::poll(items, 1, 100) <= 0 || !(items[0].revents & ZMQ_POLLIN))
+			continue;
+
+		zmq::message_t message;
+		control.recv(&message);
+		Json::Value request;
+		if (!ParseJson(std::string((const char *) message.data(), message.size()), request)) {
+			Json::Value reply;
+			reply["type"] = "error";
+			reply["message"] = "The request is not valid JSON";
+			send_json(control, reply);
+		}
+		else
+			send_json(control, answer(request));
+	}
+	notifier = NULL;
+}
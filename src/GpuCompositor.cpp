@@ -0,0 +1,393 @@
+/**
+ * @file
+ * @brief Source file for GpuCompositor class (compositing of timeline layers, and their point-wise effects, on the GPU)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <future>
+#include <sstream>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtGui/QGenericMatrix>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLExtraFunctions>
+#include <QtGui/QOpenGLShaderProgram>
+#include <QtGui/QSurfaceFormat>
+#include <QtGui/QVector4D>
+#include "../include/GpuCompositor.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+namespace openshot {
+
+	// The thread which owns the context (and runs the jobs)
+	class GpuThread : public QThread {
+	public:
+		GpuThread(GpuCompositor *compositor) : compositor(compositor) {}
+
+	protected:
+		void run() override { compositor->run_jobs(); }
+
+	private:
+		GpuCompositor *compositor;
+	};
+
+}
+
+// The first lines of every program (each invocation processes one pixel)
+static const char *program_header =
+	"#version 430\n"
+	"layout(local_size_x = 16, local_size_y = 16) in;\n";
+
+// Fill the composite with the background color
+static const char *fill_source =
+	"layout(rgba8, binding = 0) uniform writeonly image2D canvas;\n"
+	"uniform vec4 background;\n"
+	"void main() {\n"
+	"	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n"
+	"	if (pixel.x < imageSize(canvas).x && pixel.y < imageSize(canvas).y)\n"
+	"		imageStore(canvas, pixel, background);\n"
+	"}\n";
+
+// Draw a layer onto the composite (premultiplied), sampling its image bilinearly through the inverse transform
+static const char *composite_source =
+	"layout(rgba8, binding = 0) uniform image2D canvas;\n"
+	"layout(rgba8, binding = 1) uniform readonly image2D source;\n"
+	"uniform mat3 inverse_transform;\n"
+	"uniform ivec4 draw_rect;\n"
+	"uniform ivec2 offset;\n"
+	"uniform ivec2 size;\n"
+	"uniform float alpha;\n"
+	"vec4 texel(ivec2 position) {\n"
+	"	vec4 color = imageLoad(source, clamp(position, draw_rect.xy, draw_rect.zw - 1));\n"
+	"	return vec4(color.rgb * color.a, color.a);\n"
+	"}\n"
+	"void main() {\n"
+	"	ivec2 local = ivec2(gl_GlobalInvocationID.xy);\n"
+	"	if (local.x >= size.x || local.y >= size.y)\n"
+	"		return;\n"
+	"	ivec2 pixel = offset + local;\n"
+	"	vec3 mapped = inverse_transform * vec3(vec2(pixel) + 0.5, 1.0);\n"
+	"	vec2 position = mapped.xy / mapped.z;\n"
+	"	if (any(lessThan(position, vec2(draw_rect.xy))) || any(greaterThanEqual(position, vec2(draw_rect.zw))))\n"
+	"		return;\n"
+	"	vec2 texel_position = position - 0.5;\n"
+	"	ivec2 base = ivec2(floor(texel_position));\n"
+	"	vec2 fraction = texel_position - vec2(base);\n"
+	"	vec4 color = mix(mix(texel(base), texel(base + ivec2(1, 0)), fraction.x),\n"
+	"					 mix(texel(base + ivec2(0, 1)), texel(base + ivec2(1, 1)), fraction.x), fraction.y) * alpha;\n"
+	"	vec4 target = imageLoad(canvas, pixel);\n"
+	"	imageStore(canvas, pixel, color + target * (1.0 - color.a));\n"
+	"}\n";
+
+// The start of a program which runs GPU kernels on the image of a layer (see EffectBase::GpuKernel)
+static const char *kernel_header =
+	"layout(rgba8, binding = 0) uniform image2D source;\n"
+	"uniform float parameters[64];\n"
+	"uniform ivec4 regions[16];\n"
+	"float clamp_color(float value) { return clamp(trunc(value), 0.0, 255.0); }\n"
+	"vec3 clamp_color(vec3 value) { return clamp(trunc(value), 0.0, 255.0); }\n"
+	"bool inside(ivec2 pixel, ivec4 region) {\n"
+	"	return pixel.x >= region.x && pixel.y >= region.y && pixel.x < region.z && pixel.y < region.w;\n"
+	"}\n"
+	"void main() {\n"
+	"	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n"
+	"	if (pixel.x >= imageSize(source).x || pixel.y >= imageSize(source).y)\n"
+	"		return;\n"
+	"	vec4 color = floor(imageLoad(source, pixel) * 255.0 + 0.5);\n";
+
+// The number of work groups which cover a number of pixels
+static int work_groups(int pixels)
+{
+	return (pixels + 15) / 16;
+}
+
+// Global reference to the compositor
+GpuCompositor *GpuCompositor::m_pInstance = NULL;
+
+// Create or Get an instance of the compositor singleton
+GpuCompositor *GpuCompositor::Instance()
+{
+	static std::once_flag created;
+	std::call_once(created, []() { m_pInstance = new GpuCompositor(); });
+	return m_pInstance;
+}
+
+// Constructor
+GpuCompositor::GpuCompositor()
+	: initialized(false), available(false), surface(NULL), context(NULL), thread(NULL), canvas_texture(0),
+	  source_texture(0), read_framebuffer(0)
+{
+}
+
+// Create the OpenGL context (once), on the GUI thread of a QGuiApplication
+bool GpuCompositor::Initialize()
+{
+	std::lock_guard<std::mutex> lock(init_mutex);
+	if (initialized)
+		return available;
+
+	// Offscreen surfaces are only created on the GUI thread (a later call from it can still create the context)
+	QCoreApplication *application = QCoreApplication::instance();
+	if (!qobject_cast<QGuiApplication*>(application) || QThread::currentThread() != application->thread()) {
+		ZmqLogger::Instance()->AppendDebugMethod("GpuCompositor::Initialize (not on the GUI thread of a QGuiApplication)");
+		return false;
+	}
+	initialized = true;
+
+	QSurfaceFormat format;
+	format.setVersion(4, 3);
+	format.setProfile(QSurfaceFormat::CoreProfile);
+	surface = new QOffscreenSurface();
+	surface->setFormat(format);
+	surface->create();
+	context = new QOpenGLContext();
+	context->setFormat(format);
+	if (!surface->isValid() || !context->create() || context->format().version() < qMakePair(4, 3)) {
+		ZmqLogger::Instance()->AppendDebugMethod("GpuCompositor::Initialize (no OpenGL 4.3 context)", "major", context->format().majorVersion(), "minor", context->format().minorVersion());
+		delete context;
+		delete surface;
+		context = NULL;
+		surface = NULL;
+		return false;
+	}
+
+	// The GPU thread owns the context, and checks that the programs compile
+	thread = new GpuThread(this);
+	context->moveToThread(thread);
+	thread->start();
+	available = run_job([this]() {
+		return program(fill_source) != NULL && program(composite_source) != NULL;
+	});
+
+	ZmqLogger::Instance()->AppendDebugMethod("GpuCompositor::Initialize", "available", available);
+	return available;
+}
+
+// Determine if frames can be composited
+bool GpuCompositor::IsAvailable()
+{
+	std::lock_guard<std::mutex> lock(init_mutex);
+	return available;
+}
+
+// Run the jobs (on the GPU thread, with the context current)
+void GpuCompositor::run_jobs()
+{
+	context->makeCurrent(surface);
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			jobs_changed.wait(lock, [this]() { return !jobs.empty(); });
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+// Run a job on the GPU thread, and wait for its result
+bool GpuCompositor::run_job(std::function<bool()> job)
+{
+	std::shared_ptr<std::packaged_task<bool()> > task = std::make_shared<std::packaged_task<bool()> >(job);
+	std::future<bool> result = task->get_future();
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		jobs.push_back([task]() { (*task)(); });
+	}
+	jobs_changed.notify_one();
+	return result.get();
+}
+
+// Get a compiled compute program (compiling it the first time)
+QOpenGLShaderProgram* GpuCompositor::program(const std::string& source)
+{
+	std::map<std::string, QOpenGLShaderProgram*>::iterator existing = programs.find(source);
+	if (existing != programs.end())
+		return existing->second;
+
+	// A program which fails is remembered too (so it is not compiled again)
+	QOpenGLShaderProgram *new_program = new QOpenGLShaderProgram();
+	if (!new_program->addShaderFromSourceCode(QOpenGLShader::Compute, QByteArray(program_header) + source.c_str()) || !new_program->link()) {
+		ZmqLogger::Instance()->Log("GpuCompositor: a program failed to compile\n" + new_program->log().toStdString() + "\n");
+		delete new_program;
+		new_program = NULL;
+	}
+	programs[source] = new_program;
+	return new_program;
+}
+
+// Get the program which runs a list of GPU kernels
+QOpenGLShaderProgram* GpuCompositor::kernel_program(const std::vector<EffectBase::GpuKernel>& kernels)
+{
+	// Each kernel reads its own parameters (with P), and only changes the pixels in its region
+	std::stringstream source;
+	source << kernel_header;
+	int first_parameter = 0;
+	for (size_t index = 0; index < kernels.size(); index++) {
+		source << "#define P(index) parameters[" << first_parameter << " + (index)]\n";
+		source << "	if (inside(pixel, regions[" << index << "])) {\n" << kernels[index].source << "\n	}\n";
+		source << "#undef P\n";
+		first_parameter += kernels[index].parameters.size();
+	}
+	source << "	imageStore(source, pixel, color / 255.0);\n}\n";
+	return program(source.str());
+}
+
+// Create a RGBA8 texture (replacing the texture, if it has a different size)
+void GpuCompositor::resize_texture(unsigned int& texture, QSize& texture_size, QSize size)
+{
+	QOpenGLExtraFunctions *gl = context->extraFunctions();
+	if (texture && texture_size == size)
+		return;
+	if (texture)
+		gl->glDeleteTextures(1, &texture);
+	gl->glGenTextures(1, &texture);
+	gl->glBindTexture(GL_TEXTURE_2D, texture);
+	gl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size.width(), size.height());
+	texture_size = size;
+}
+
+// Composite the layers (on the GPU thread)
+bool GpuCompositor::composite(int width, int height, QColor background, const std::vector<GpuLayer>& layers, QImage& result)
+{
+	QOpenGLExtraFunctions *gl = context->extraFunctions();
+	QOpenGLShaderProgram *fill_program = program(fill_source);
+	QOpenGLShaderProgram *composite_program = program(composite_source);
+	if (!fill_program || !composite_program)
+		return false;
+
+	// Fill the composite with the background
+	resize_texture(canvas_texture, canvas_size, QSize(width, height));
+	gl->glBindImageTexture(0, canvas_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+	fill_program->bind();
+	fill_program->setUniformValue("background", QVector4D(background.redF(), background.greenF(), background.blueF(), 1.0f));
+	gl->glDispatchCompute(work_groups(width), work_groups(height), 1);
+	gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	for (const GpuLayer& layer : layers)
+	{
+		// Skip the layers which are not drawn (i.e. scaled to nothing, or outside of the composite)
+		bool invertible = false;
+		QTransform inverse = layer.transform.inverted(&invertible);
+		QRect draw_rect = layer.draw_rect & layer.image->rect();
+		QRect target_rect = layer.transform.mapRect(QRectF(draw_rect)).toAlignedRect() & QRect(0, 0, width, height);
+		if (!invertible || draw_rect.isEmpty() || target_rect.isEmpty() || layer.alpha <= 0.0)
+			continue;
+
+		// Upload the image (as straight RGBA8888, the same pixels the CPU kernels change)
+		QImage converted;
+		const QImage *image = layer.image.get();
+		if (image->format() != QImage::Format_RGBA8888) {
+			converted = image->convertToFormat(QImage::Format_RGBA8888);
+			image = &converted;
+		}
+		resize_texture(source_texture, source_size, image->size());
+		gl->glBindTexture(GL_TEXTURE_2D, source_texture);
+		gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, image->bytesPerLine() / 4);
+		gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width(), image->height(), GL_RGBA, GL_UNSIGNED_BYTE, image->constBits());
+		gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		// Run the kernels on the uploaded image (in a single pass)
+		if (!layer.kernels.empty()) {
+			std::vector<float> parameters;
+			std::vector<int> regions;
+			for (const EffectBase::GpuKernel& kernel : layer.kernels) {
+				parameters.insert(parameters.end(), kernel.parameters.begin(), kernel.parameters.end());
+				QRect region = kernel.region.isNull() ? image->rect() : kernel.region;
+				regions.insert(regions.end(), {region.left(), region.top(), region.right() + 1, region.bottom() + 1});
+			}
+			if (layer.kernels.size() > size_t(MaxKernels) || parameters.size() > size_t(MaxParameters))
+				return false;
+			QOpenGLShaderProgram *layer_program = kernel_program(layer.kernels);
+			if (!layer_program)
+				return false;
+
+			gl->glBindImageTexture(0, source_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+			layer_program->bind();
+			if (!parameters.empty())
+				layer_program->setUniformValueArray("parameters", parameters.data(), parameters.size(), 1);
+			gl->glUniform4iv(layer_program->uniformLocation("regions"), layer.kernels.size(), regions.data());
+			gl->glDispatchCompute(work_groups(image->width()), work_groups(image->height()), 1);
+			gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+
+		// Draw the image onto the composite (only the pixels it covers)
+		float matrix_values[] = {float(inverse.m11()), float(inverse.m21()), float(inverse.m31()),
+								 float(inverse.m12()), float(inverse.m22()), float(inverse.m32()),
+								 float(inverse.m13()), float(inverse.m23()), float(inverse.m33())};
+		gl->glBindImageTexture(0, canvas_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+		gl->glBindImageTexture(1, source_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA8);
+		composite_program->bind();
+		composite_program->setUniformValue("inverse_transform", QMatrix3x3(matrix_values));
+		gl->glUniform4i(composite_program->uniformLocation("draw_rect"), draw_rect.left(), draw_rect.top(), draw_rect.right() + 1, draw_rect.bottom() + 1);
+		gl->glUniform2i(composite_program->uniformLocation("offset"), target_rect.x(), target_rect.y());
+		gl->glUniform2i(composite_program->uniformLocation("size"), target_rect.width(), target_rect.height());
+		composite_program->setUniformValue("alpha", std::min(layer.alpha, 1.0f));
+		gl->glDispatchCompute(work_groups(target_rect.width()), work_groups(target_rect.height()), 1);
+		gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	// Download the composite (once)
+	if (!read_framebuffer)
+		gl->glGenFramebuffers(1, &read_framebuffer);
+	gl->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+	gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+	gl->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, canvas_texture, 0);
+	result = QImage(width, height, QImage::Format_RGBA8888_Premultiplied);
+	gl->glPixelStorei(GL_PACK_ROW_LENGTH, result.bytesPerLine() / 4);
+	gl->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, result.bits());
+	gl->glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	return gl->glGetError() == GL_NO_ERROR;
+}
+
+// Composite layers onto a background, and download the composite
+std::shared_ptr<QImage> GpuCompositor::Composite(int width, int height, QColor background, const std::vector<GpuLayer>& layers, QImage::Format format)
+{
+	if (!IsAvailable() || width <= 0 || height <= 0)
+		return std::shared_ptr<QImage>();
+
+	// The GPU thread composites one frame at a time (the render threads wait for it)
+	QImage result;
+	bool success = run_job([this, width, height, background, &layers, &result]() {
+		return composite(width, height, background, layers, result);
+	});
+	if (!success) {
+		ZmqLogger::Instance()->AppendDebugMethod("GpuCompositor::Composite (failed)", "width", width, "height", height, "layers", layers.size());
+		return std::shared_ptr<QImage>();
+	}
+
+	// Convert the composite to the format of frames (from premultiplied RGBA8888)
+	if (format != result.format())
+		result = result.convertToFormat(format);
+	return std::make_shared<QImage>(result);
+}
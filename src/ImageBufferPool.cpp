@@ -0,0 +1,176 @@
+/**
+ * @file
+ * @brief Source file for ImageBufferPool class (recycled image buffers)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "../include/ImageBufferPool.h"
+#include "../include/FFmpegUtilities.h"
+#include "../include/Metrics.h"
+#include "../include/Settings.h"
+#include "../include/TaskPool.h"
+
+using namespace openshot;
+
+// Global reference to the pool
+ImageBufferPool *ImageBufferPool::m_pInstance = NULL;
+
+// Size of each page (the granularity of the buckets)
+static const size_t page_size = 4096;
+
+// Create or get an instance of this pool singleton
+ImageBufferPool *ImageBufferPool::Instance()
+{
+	static std::once_flag created;
+	std::call_once(created, []() { m_pInstance = new ImageBufferPool(); });
+	return m_pInstance;
+}
+
+// Constructor
+ImageBufferPool::ImageBufferPool() : free_bytes(0) {
+}
+
+// Get the bucket size of a buffer (rounded up to a whole page)
+size_t ImageBufferPool::bucket_size(size_t size) {
+	return ((size + page_size - 1) / page_size) * page_size;
+}
+
+// The memory gauge of buffers acquired outside of any ScopedMemoryTag
+static MemoryGauge &untagged_memory() {
+	static MemoryGauge &gauge = Metrics::Instance()->GetMemory("images.other");
+	return gauge;
+}
+
+// The memory gauge of the free buffers
+static MemoryGauge &free_memory() {
+	static MemoryGauge &gauge = Metrics::Instance()->GetMemory("images.pool_free");
+	return gauge;
+}
+
+// Get the memory gauge slot in the header of a buffer (after its bucket size)
+static MemoryGauge **buffer_gauge(uint8_t *block) {
+	return (MemoryGauge **) (block + sizeof(size_t));
+}
+
+// Get the NUMA node slot in the header of a buffer (after its memory gauge)
+static int *buffer_node(uint8_t *block) {
+	return (int *) (block + sizeof(size_t) + sizeof(MemoryGauge *));
+}
+
+// Get a buffer of at least this many bytes (recycled, if one of the same bucket and NUMA node is free)
+uint8_t *ImageBufferPool::Acquire(size_t size) {
+	size_t bucket = bucket_size(size);
+	int node = TaskPool::ThreadNode();
+
+	// Charge the buffer to the subsystem of this thread (see ScopedMemoryTag)
+	MemoryGauge *gauge = ScopedMemoryTag::Current();
+	if (!gauge)
+		gauge = &untagged_memory();
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		std::map<std::pair<int, size_t>, std::vector<uint8_t*> >::iterator itr = free_buffers.find(std::make_pair(node, bucket));
+		if (itr != free_buffers.end() && !itr->second.empty()) {
+			uint8_t *buffer = itr->second.back();
+			itr->second.pop_back();
+			free_bytes -= bucket;
+			free_memory().Add(-(int64_t) bucket);
+			*buffer_gauge(buffer - header_size) = gauge;
+			gauge->Add(bucket);
+			return buffer;
+		}
+	}
+	static Counter& allocations = Metrics::Instance()->GetCounter("images.allocations");
+	uint8_t *block = (uint8_t *) av_malloc(bucket + header_size);
+	if (!block)
+		return NULL;
+	allocations.Increment();
+	*((size_t *) block) = bucket;
+	*buffer_gauge(block) = gauge;
+	*buffer_node(block) = node;
+	gauge->Add(bucket);
+	return block + header_size;
+}
+
+// Return a buffer to the pool (or free it, if the pool is full)
+void ImageBufferPool::Release(uint8_t *buffer) {
+	if (!buffer)
+		return;
+	uint8_t *block = buffer - header_size;
+	size_t bucket = *((size_t *) block);
+	(*buffer_gauge(block))->Add(-(int64_t) bucket);
+	size_t max_bytes = (size_t) std::max(0, Settings::Instance()->IMAGE_POOL_SIZE) * 1024 * 1024;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		if (free_bytes + bucket <= max_bytes) {
+			free_buffers[std::make_pair(*buffer_node(block), bucket)].push_back(buffer);
+			free_bytes += bucket;
+			free_memory().Add(bucket);
+			return;
+		}
+	}
+	av_free(block);
+}
+
+// Free all buffers waiting in the pool
+void ImageBufferPool::Clear() {
+	std::map<std::pair<int, size_t>, std::vector<uint8_t*> > buffers;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		buffers.swap(free_buffers);
+		free_memory().Add(-(int64_t) free_bytes);
+		free_bytes = 0;
+	}
+	for (std::map<std::pair<int, size_t>, std::vector<uint8_t*> >::iterator itr = buffers.begin(); itr != buffers.end(); ++itr)
+		for (size_t index = 0; index < itr->second.size(); index++)
+			av_free(itr->second[index] - header_size);
+}
+
+// Get the total size of all free buffers waiting in the pool
+size_t ImageBufferPool::FreeBytes() {
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	return free_bytes;
+}
+
+// Create an (uninitialized) image, whose pixels are stored in a pooled buffer
+std::shared_ptr<QImage> ImageBufferPool::CreateImage(int width, int height, QImage::Format format) {
+	int depth = QImage::toPixelFormat(format).bitsPerPixel();
+	int bytes_per_line = ((width * depth + 31) / 32) * 4;
+	uint8_t *buffer = (width > 0 && height > 0) ? Instance()->Acquire((size_t) bytes_per_line * height) : NULL;
+
+	// Fall back to a regular image (i.e. for an empty image, or if the buffer could not be allocated)
+	if (!buffer)
+		return std::make_shared<QImage>(width, height, format);
+
+	return std::make_shared<QImage>(buffer, width, height, bytes_per_line, format,
+									(QImageCleanupFunction) &ImageBufferPool::CleanUp, (void *) buffer);
+}
+
+// QImage cleanup function, which returns the image's buffer to the pool
+void ImageBufferPool::CleanUp(void *info) {
+	Instance()->Release((uint8_t *) info);
+}
@@ -51,6 +51,12 @@ ImageReader::ImageReader(std::string path, bool inspect_reader) : path(path), is
 	}
 }
 
+ImageReader::~ImageReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+}
+
 // Open image file
 void ImageReader::Open()
 {
@@ -66,6 +72,9 @@ void ImageReader::Open()
 			// Give image a transparent background color
 			image->backgroundColor(Magick::Color("none"));
 			MAGICK_IMAGE_ALPHA(image, true);
+
+			// Convert the pixels once (for all frames)
+			cached_image = Frame::MagickToImage(image);
 		}
 		catch (const Magick::Exception& e) {
 			// raise exception
@@ -115,6 +124,7 @@ void ImageReader::Close()
 
 		// Delete the image
 		image.reset();
+		cached_image.reset();
 	}
 }
 
@@ -128,8 +138,8 @@ std::shared_ptr<Frame> ImageReader::GetFrame(int64_t requested_frame)
 	// Create or get frame object
 	std::shared_ptr<Frame> image_frame(new Frame(requested_frame, image->size().width(), image->size().height(), "#000000", 0, 2));
 
-	// Add Image data to frame
-	image_frame->AddMagickImage(image);
+	// Add Image data to frame (each frame gets its own QImage, which shares the pixels until it is changed)
+	image_frame->AddImage(std::make_shared<QImage>(*cached_image));
 
 	// return frame object
 	return image_frame;
@@ -139,7 +149,7 @@ std::shared_ptr<Frame> ImageReader::GetFrame(int64_t requested_frame)
 std::string ImageReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -159,13 +169,7 @@ void ImageReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
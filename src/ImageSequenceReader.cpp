@@ -0,0 +1,399 @@
+/**
+ * @file
+ * @brief Source file for ImageSequenceReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/ImageSequenceReader.h"
+#include "../include/Clip.h"
+#include "../include/TaskPool.h"
+#include <algorithm>
+#include <utility>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QString>
+#include <QtGui/QImage>
+#include <QtGui/QImageReader>
+
+using namespace openshot;
+
+ImageSequenceReader::ImageSequenceReader(std::string path, Fraction fps) : path(path), files_size(0), cached_width(0), cached_height(0), is_open(false)
+{
+	info.fps = fps;
+
+	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
+	Open();
+	Close();
+}
+
+ImageSequenceReader::ImageSequenceReader(std::string path, Fraction fps, bool inspect_reader) : path(path), files_size(0), cached_width(0), cached_height(0), is_open(false)
+{
+	info.fps = fps;
+
+	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
+	if (inspect_reader) {
+		Open();
+		Close();
+	}
+}
+
+ImageSequenceReader::~ImageSequenceReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+	Close();
+}
+
+// List the image files of the sequence
+void ImageSequenceReader::index_files()
+{
+	// The files are only listed once (re-opening the reader, or changing its max size, doesn't list them again)
+	if (indexed_path == path && !files.empty())
+		return;
+	files.clear();
+	files_size = 0;
+
+	QFileInfo path_info(QString::fromStdString(path));
+	if (path_info.isDir()) {
+		// Every image file in the directory (sorted by name)
+		QStringList filters;
+		for (const QByteArray &format : QImageReader::supportedImageFormats())
+			filters << "*." + QString::fromLatin1(format);
+		for (const QFileInfo &entry : QDir(path_info.filePath()).entryInfoList(filters, QDir::Files, QDir::Name)) {
+			files.push_back(entry.filePath().toStdString());
+			files_size += entry.size();
+		}
+	}
+	else {
+		// Split the file name into the text before and after the frame number (i.e. "frame_%04d.png" or "frame_0001.png")
+		QString name = path_info.fileName();
+		QRegularExpressionMatch match = QRegularExpression("^(.*)%0?\\d*d(.*)$").match(name);
+		if (!match.hasMatch())
+			match = QRegularExpression("^(.*\\D)?\\d+(\\D*)$").match(name);
+		if (!match.hasMatch())
+			return;
+		QString prefix = match.captured(1);
+		QString suffix = match.captured(2);
+
+		// The files with the same name, and any frame number (sorted by the number)
+		std::vector<std::pair<qulonglong, QFileInfo> > numbered;
+		QRegularExpression digits("^\\d+$");
+		for (const QFileInfo &entry : path_info.dir().entryInfoList(QStringList(prefix + "*" + suffix), QDir::Files, QDir::Name)) {
+			QString entry_name = entry.fileName();
+			if (!entry_name.startsWith(prefix) || !entry_name.endsWith(suffix) || entry_name.size() <= prefix.size() + suffix.size())
+				continue;
+			QString number = entry_name.mid(prefix.size(), entry_name.size() - prefix.size() - suffix.size());
+			if (digits.match(number).hasMatch())
+				numbered.push_back(std::make_pair(number.toULongLong(), entry));
+		}
+		std::stable_sort(numbered.begin(), numbered.end(), [](const std::pair<qulonglong, QFileInfo> &a, const std::pair<qulonglong, QFileInfo> &b) {
+			return a.first < b.first;
+		});
+		for (const std::pair<qulonglong, QFileInfo> &entry : numbered) {
+			files.push_back(entry.second.filePath().toStdString());
+			files_size += entry.second.size();
+		}
+	}
+
+	indexed_path = path;
+}
+
+// Open image sequence
+void ImageSequenceReader::Open()
+{
+	// Open reader if not already open
+	if (!is_open)
+	{
+		// List the image files
+		index_files();
+		if (files.empty())
+			throw InvalidFile("No image files were found for the sequence.", path);
+
+		// Get the size of the sequence from its first image (without decoding it, if the format allows)
+		QImageReader first_image(QString::fromStdString(files.front()));
+		QSize size = first_image.size();
+		if (!size.isValid()) {
+			QImage image;
+			if (!image.load(QString::fromStdString(files.front())))
+				throw InvalidFile("File could not be opened.", files.front());
+			size = image.size();
+		}
+
+		// Update image properties
+		info.has_audio = false;
+		info.has_video = true;
+		info.has_single_image = false;
+		info.file_size = files_size;
+		info.vcodec = "QImage";
+		info.width = size.width();
+		info.height = size.height();
+		info.pixel_ratio.num = 1;
+		info.pixel_ratio.den = 1;
+		if (info.fps.num <= 0 || info.fps.den <= 0) {
+			info.fps.num = 30;
+			info.fps.den = 1;
+		}
+		info.video_timebase.num = info.fps.den;
+		info.video_timebase.den = info.fps.num;
+		info.video_length = files.size();
+		info.duration = info.video_length / info.fps.ToDouble();
+
+		// Calculate the DAR (display aspect ratio)
+		Fraction display_size(info.width * info.pixel_ratio.num, info.height * info.pixel_ratio.den);
+
+		// Reduce size fraction
+		display_size.Reduce();
+
+		// Set the ratio based on the reduced fraction
+		info.display_ratio.num = display_size.num;
+		info.display_ratio.den = display_size.den;
+
+		// Hold two batches of read ahead frames (so the frames of the last batch aren't evicted by the next one)
+		final_cache.SetMaxBytesFromInfo(2 * std::max(1, TaskPool::Current()->NumThreads()), info.width, info.height, info.sample_rate, info.channels);
+		cached_width = 0;
+		cached_height = 0;
+
+		// Mark as "open"
+		is_open = true;
+	}
+}
+
+// Close image sequence
+void ImageSequenceReader::Close()
+{
+	// Close all objects, if reader is 'open'
+	if (is_open)
+	{
+		// Mark as "closed"
+		is_open = false;
+
+		// Clear the decoded frames
+		final_cache.Clear();
+
+		info.vcodec = "";
+		info.acodec = "";
+	}
+}
+
+// Determine the max size of the images
+void ImageSequenceReader::max_size(int &max_width, int &max_height)
+{
+	// The images can't be smaller than the timeline (see QtImageReader::GetFrame)
+	RenderContext render_context = RenderContext::Current();
+	max_width = render_context.max_width;
+	if (max_width <= 0)
+		max_width = info.width;
+	max_height = render_context.max_height;
+	if (max_height <= 0)
+		max_height = info.height;
+
+	Clip* parent = (Clip*) GetClip();
+	if (parent) {
+		if (parent->scale == SCALE_FIT || parent->scale == SCALE_STRETCH) {
+			// Best fit or Stretch scaling (based on max timeline size * scaling keyframes)
+			float max_scale_x = parent->scale_x.GetMaxPoint().co.Y;
+			float max_scale_y = parent->scale_y.GetMaxPoint().co.Y;
+			max_width = std::max(float(max_width), max_width * max_scale_x);
+			max_height = std::max(float(max_height), max_height * max_scale_y);
+
+		} else if (parent->scale == SCALE_CROP) {
+			// Cropping scale mode (based on max timeline size * cropped size * scaling keyframes)
+			float max_scale_x = parent->scale_x.GetMaxPoint().co.Y;
+			float max_scale_y = parent->scale_y.GetMaxPoint().co.Y;
+			QSize width_size(max_width * max_scale_x,
+							 round(max_width / (float(info.width) / float(info.height))));
+			QSize height_size(round(max_height / (float(info.height) / float(info.width))),
+							  max_height * max_scale_y);
+			// respect aspect ratio
+			if (width_size.width() >= max_width && width_size.height() >= max_height) {
+				max_width = std::max(max_width, width_size.width());
+				max_height = std::max(max_height, width_size.height());
+			}
+			else {
+				max_width = std::max(max_width, height_size.width());
+				max_height = std::max(max_height, height_size.height());
+			}
+
+		} else {
+			// No scaling, use original image size (slower)
+			max_width = info.width;
+			max_height = info.height;
+		}
+	}
+}
+
+// Decode the image of a frame
+std::shared_ptr<Frame> ImageSequenceReader::read_frame(int64_t number, int max_width, int max_height)
+{
+	// Decode larger images at the max size (formats such as JPEG decode faster at a smaller size)
+	QImageReader image_reader(QString::fromStdString(files[number - 1]));
+	QSize size = image_reader.size();
+	if (size.isValid() && (size.width() > max_width || size.height() > max_height)) {
+		size.scale(max_width, max_height, Qt::KeepAspectRatio);
+		image_reader.setScaledSize(size);
+	}
+	std::shared_ptr<QImage> image(new QImage(image_reader.read()));
+	if (image->isNull())
+		return std::shared_ptr<Frame>();
+
+	// Scale images whose size wasn't known before decoding them
+	if (image->width() > max_width || image->height() > max_height)
+		image = std::shared_ptr<QImage>(new QImage(image->scaled(max_width, max_height, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
+	if (image->format() != QImage::Format_RGBA8888)
+		image = std::shared_ptr<QImage>(new QImage(image->convertToFormat(QImage::Format_RGBA8888)));
+
+	// Create a frame with the image
+	std::shared_ptr<Frame> image_frame(new Frame(number, image->width(), image->height(), "#000000", Frame::GetSamplesPerFrame(number, info.fps, info.sample_rate, info.channels), info.channels));
+	image_frame->AddImage(image);
+	return image_frame;
+}
+
+// Get an openshot::Frame object for a specific frame number of this reader.
+std::shared_ptr<Frame> ImageSequenceReader::GetFrame(int64_t requested_frame)
+{
+	// Check for open reader (or throw exception)
+	if (!is_open)
+		throw ReaderClosed("The image sequence is closed.  Call Open() before calling this method.", path);
+
+	// Adjust for a requested frame that is too small or too large
+	if (requested_frame < 1)
+		requested_frame = 1;
+	if (requested_frame > info.video_length)
+		requested_frame = info.video_length;
+
+	// Determine the max size of the images (on the calling thread, which has the render context)
+	int max_width = 0;
+	int max_height = 0;
+	max_size(max_width, max_height);
+
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+
+	// Frames decoded at a different max size are decoded again
+	if (max_width != cached_width || max_height != cached_height) {
+		final_cache.Clear();
+		cached_width = max_width;
+		cached_height = max_height;
+	}
+
+	// Return a decoded (or read ahead) frame
+	std::shared_ptr<Frame> frame = final_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// Read ahead the next frames (up to one per thread, and stopping at the first frame which is already cached)
+	int64_t count = 1;
+	int64_t read_ahead = std::max(1, TaskPool::Current()->NumThreads());
+	while (count < read_ahead && requested_frame + count <= info.video_length && !final_cache.GetFrame(requested_frame + count))
+		count++;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ImageSequenceReader::GetFrame", "requested_frame", requested_frame, "count", count, "max_width", max_width, "max_height", max_height);
+
+	// Decode the frames in parallel
+	std::vector<std::shared_ptr<Frame> > frames(count);
+	TaskPool::Current()->ParallelFor(0, count, [&](int64_t index) {
+		frames[index] = read_frame(requested_frame + index, max_width, max_height);
+	});
+
+	// The frames read ahead which can't be decoded aren't cached (they throw once they are requested)
+	if (!frames[0])
+		throw InvalidFile("File could not be opened.", files[requested_frame - 1]);
+	for (int64_t index = 0; index < count; index++)
+		if (frames[index])
+			final_cache.Add(frames[index]);
+
+	return frames[0];
+}
+
+// Get the image file of a frame number
+std::string ImageSequenceReader::FramePath(int64_t frame_number)
+{
+	if (frame_number < 1 || frame_number > int64_t(files.size()))
+		return "";
+	return files[frame_number - 1];
+}
+
+// Generate JSON string of this object
+std::string ImageSequenceReader::Json() {
+
+	// Return formatted string
+	return WriteJson(JsonValue());
+}
+
+// Generate Json::JsonValue for this object
+Json::Value ImageSequenceReader::JsonValue() {
+
+	// Create root json object
+	Json::Value root = ReaderBase::JsonValue(); // get parent properties
+	root["type"] = "ImageSequenceReader";
+	root["path"] = path;
+
+	// return JsonValue
+	return root;
+}
+
+// Load JSON string into this object
+void ImageSequenceReader::SetJson(std::string value) {
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	bool success = ParseJson(value, root);
+
+	if (!success)
+		// Raise exception
+		throw InvalidJSON("JSON could not be parsed (or is invalid)");
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("JSON is invalid (missing keys or invalid data types)");
+	}
+}
+
+// Load Json::JsonValue into this object
+void ImageSequenceReader::SetJsonValue(Json::Value root) {
+
+	// Set parent data
+	ReaderBase::SetJsonValue(root);
+
+	// Set data from Json (if key is found)
+	if (!root["path"].isNull())
+		path = root["path"].asString();
+
+	// Re-Open path, and re-init everything (if needed)
+	if (is_open)
+	{
+		Close();
+		Open();
+	}
+}
@@ -0,0 +1,203 @@
+/**
+ * @file
+ * @brief Source file for ImageSequenceWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/ImageSequenceWriter.h"
+#include "../include/TaskPool.h"
+#include <algorithm>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QString>
+#include <QtGui/QImage>
+#include <QtGui/QImageWriter>
+
+using namespace openshot;
+
+ImageSequenceWriter::ImageSequenceWriter(std::string path) :
+		path(path), cache_size(0), is_open(false), image_quality(-1)
+{
+	// Disable audio & video (so they can be independently enabled)
+	info.has_audio = false;
+	info.has_video = true;
+}
+
+ImageSequenceWriter::~ImageSequenceWriter()
+{
+	// Write any queued frames (an error can't be thrown from the destructor)
+	try {
+		Close();
+	} catch (const std::exception& e) { }
+}
+
+// Set video export options
+void ImageSequenceWriter::SetVideoOptions(std::string format, Fraction fps, int width, int height, int quality)
+{
+	// Set frames per second (if provided)
+	info.fps.num = fps.num;
+	info.fps.den = fps.den;
+
+	// Set the image properties
+	image_quality = quality;
+	info.vcodec = format;
+
+	// Set the timebase (inverse of fps)
+	info.video_timebase.num = info.fps.den;
+	info.video_timebase.den = info.fps.num;
+
+	if (width >= 1)
+		info.width = width;
+	if (height >= 1)
+		info.height = height;
+
+	info.video_bit_rate = quality;
+
+	// Calculate the DAR (display aspect ratio)
+	Fraction size(info.width * info.pixel_ratio.num, info.height * info.pixel_ratio.den);
+
+	// Reduce size fraction
+	size.Reduce();
+
+	// Set the ratio based on the reduced fraction
+	info.display_ratio.num = size.num;
+	info.display_ratio.den = size.den;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ImageSequenceWriter::SetVideoOptions (" + format + ")", "width", width, "height", height, "size.num", size.num, "size.den", size.den, "fps.num", fps.num, "fps.den", fps.den);
+}
+
+// Get the path of the image file of a frame number
+std::string ImageSequenceWriter::FramePath(int64_t frame_number)
+{
+	QString pattern = QString::fromStdString(path);
+
+	// Replace the pattern of the frame number (i.e. %04d)
+	QRegularExpressionMatch match = QRegularExpression("%(0?)(\\d*)d").match(pattern);
+	if (match.hasMatch()) {
+		int digits = match.captured(2).isEmpty() ? 0 : match.captured(2).toInt();
+		QChar fill = match.captured(1).isEmpty() ? QChar(' ') : QChar('0');
+		return pattern.replace(match.capturedStart(), match.capturedLength(), QString("%1").arg(frame_number, digits, 10, fill)).toStdString();
+	}
+
+	// Add the frame number before the extension
+	int extension = pattern.lastIndexOf('.');
+	if (extension <= pattern.lastIndexOf('/'))
+		extension = pattern.size();
+	return pattern.insert(extension, QString("_%1").arg(frame_number, 4, 10, QChar('0'))).toStdString();
+}
+
+// Open the writer
+void ImageSequenceWriter::Open()
+{
+	if (is_open)
+		return;
+
+	// Use the format of the extension (if no format was set)
+	if (info.vcodec.empty())
+		info.vcodec = QFileInfo(QString::fromStdString(path)).suffix().toUpper().toStdString();
+	if (!QImageWriter::supportedImageFormats().contains(QByteArray(info.vcodec.c_str()).toLower()))
+		throw InvalidFormat("The image format " + info.vcodec + " can't be written.", path);
+
+	is_open = true;
+}
+
+// Encode the image of a frame, and write it to its file
+void ImageSequenceWriter::write_image(std::shared_ptr<Frame> frame)
+{
+	// The image is shared with the frame (it is only copied if it needs to be scaled)
+	QImage image = *frame->GetImage();
+
+	// Calculate correct DAR (display aspect ratio)
+	int new_width = info.width;
+	int new_height = info.height * frame->GetPixelRatio().Reciprocal().ToDouble();
+	if (new_width > 0 && new_height > 0 && (image.width() != new_width || image.height() != new_height))
+		image = image.scaled(new_width, new_height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	QImageWriter writer(QString::fromStdString(FramePath(frame->number)), QByteArray(info.vcodec.c_str()).toLower());
+	writer.setQuality(image_quality);
+	if (!writer.write(image))
+		throw ErrorEncodingVideo("The image of the frame could not be written (" + writer.errorString().toStdString() + ").", frame->number);
+}
+
+// Encode and write all queued frames
+void ImageSequenceWriter::write_queued_frames()
+{
+	if (queued_frames.empty())
+		return;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ImageSequenceWriter::write_queued_frames", "queued_frames.size()", queued_frames.size(), "first frame", queued_frames.front()->number);
+
+	// Take the queued frames (so they aren't written again, if a frame can't be written)
+	std::vector<std::shared_ptr<Frame> > frames;
+	frames.swap(queued_frames);
+
+	// Each frame is written to its own file, so they can be encoded in any order
+	TaskPool::Current()->ParallelFor(0, frames.size(), [&](int64_t index) {
+		write_image(frames[index]);
+	});
+}
+
+// Add a frame to the queue waiting to be encoded.
+void ImageSequenceWriter::WriteFrame(std::shared_ptr<Frame> frame)
+{
+	// Check for open writer (or throw exception)
+	if (!is_open)
+		throw WriterClosed("The ImageSequenceWriter is closed.  Call Open() before calling this method.", path);
+
+	// Write the queued frames, once there are enough to keep every thread busy
+	queued_frames.push_back(frame);
+	int queue_size = (cache_size > 0) ? cache_size : std::max(1, TaskPool::Current()->NumThreads());
+	if (int(queued_frames.size()) >= queue_size)
+		write_queued_frames();
+}
+
+// Write a block of frames from a reader
+void ImageSequenceWriter::WriteFrame(ReaderBase* reader, int64_t start, int64_t length)
+{
+	ZmqLogger::Instance()->AppendDebugMethod("ImageSequenceWriter::WriteFrame (from Reader)", "start", start, "length", length);
+
+	// Get the frames in batches (one batch is queued at a time)
+	int64_t batch_size = (cache_size > 0) ? cache_size : std::max(1, TaskPool::Current()->NumThreads());
+	for (int64_t number = start; number <= length; number += batch_size)
+	{
+		for (std::shared_ptr<Frame> f : reader->GetFrames(number, std::min(batch_size, length - number + 1)))
+			WriteFrame(f);
+	}
+}
+
+// Close the writer (after writing any queued frames)
+void ImageSequenceWriter::Close()
+{
+	if (!is_open)
+		return;
+
+	// Close writer (even if the last frames can't be written)
+	is_open = false;
+	write_queued_frames();
+
+	ZmqLogger::Instance()->AppendDebugMethod("ImageSequenceWriter::Close");
+}
@@ -112,10 +112,12 @@ void ImageWriter::WriteFrame(std::shared_ptr<Frame> frame)
 	int new_width = info.width;
 	int new_height = info.height * frame->GetPixelRatio().Reciprocal().ToDouble();
 
-	// Resize image
-	Magick::Geometry new_size(new_width, new_height);
-	new_size.aspect(true);
-	frame_image->resize(new_size);
+	// Resize image (unless it already has the size)
+	if (new_width != (int) frame_image->columns() || new_height != (int) frame_image->rows()) {
+		Magick::Geometry new_size(new_width, new_height);
+		new_size.aspect(true);
+		frame_image->resize(new_size);
+	}
 
 
 	// Put resized frame in vector (waiting to be written)
@@ -0,0 +1,264 @@
+/**
+ * @file
+ * @brief Source file for InterpolationKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/InterpolationKernels.h"
+#include "../include/TaskPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+using namespace openshot;
+
+namespace {
+	// Images smaller than this (in bytes) are processed on the calling thread
+	const int64_t parallel_bytes = 4 * 1024 * 1024;
+
+	// Motion is estimated on a luma image of a quarter of the width and height, in blocks of 8 x 8 luma pixels
+	// (32 x 32 pixels of the image), which can move up to 6 luma pixels (24 pixels) in each direction
+	const int luma_scale = 4;
+	const int block_size = 8;
+	const int search_range = 6;
+
+	// The cost of each luma pixel of motion (so flat areas, which match anywhere, stay still)
+	const int motion_penalty = 16;
+
+	// Call a function for each band of rows (in parallel, for large images)
+	void for_each_band(int height, int row_bytes, std::function<void(int, int)> body) {
+		int bands = 1;
+		if ((int64_t) height * row_bytes >= parallel_bytes)
+			bands = std::min(height / 16, TaskPool::Current()->NumThreads());
+		if (bands <= 1) {
+			body(0, height);
+			return;
+		}
+
+		int band_height = (height + bands - 1) / bands;
+		TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+		{
+			int first_row = band * band_height;
+			int last_row = std::min(height, first_row + band_height);
+			if (first_row < last_row)
+				body(first_row, last_row);
+		});
+	}
+
+	// Blend 2 rows of bytes (with 8 bit weights, which the compiler vectorizes)
+	void blend_row(unsigned char * __restrict target, const unsigned char * __restrict first, const unsigned char * __restrict second, int row_bytes, int second_weight) {
+		int first_weight = 256 - second_weight;
+		for (int index = 0; index < row_bytes; index++)
+			target[index] = (unsigned char) ((first[index] * first_weight + second[index] * second_weight + 128) >> 8);
+	}
+
+	// Average the luma (R + 2G + B, which does not depend on the byte order) of each 4 x 4 pixels
+	void make_luma(std::vector<unsigned char> &luma, const unsigned char *pixels, int bytes_per_line, int luma_width, int luma_height) {
+		luma.resize((size_t) luma_width * luma_height);
+		for (int luma_y = 0; luma_y < luma_height; luma_y++) {
+			for (int luma_x = 0; luma_x < luma_width; luma_x++) {
+				int sum = 0;
+				for (int y = 0; y < luma_scale; y++) {
+					const unsigned char *pixel = pixels + (size_t) (luma_y * luma_scale + y) * bytes_per_line + luma_x * luma_scale * 4;
+					for (int x = 0; x < luma_scale; x++, pixel += 4)
+						sum += pixel[0] + 2 * pixel[1] + pixel[2];
+				}
+				luma[(size_t) luma_y * luma_width + luma_x] = (unsigned char) (sum / (luma_scale * luma_scale * 4));
+			}
+		}
+	}
+
+	// The motion of a block (in luma pixels, from the first image to the second image)
+	struct BlockMotion {
+		int x;
+		int y;
+	};
+
+	// Sum of the absolute differences between a block of the first luma image, and the same block of the second luma image
+	// (each moved by an offset, and clamped to the edges)
+	int block_difference(const std::vector<unsigned char> &first, const std::vector<unsigned char> &second, int luma_width, int luma_height,
+						 int block_x, int block_y, int first_x, int first_y, int second_x, int second_y) {
+		int sum = 0;
+		int block_right = std::min(block_x + block_size, luma_width);
+		int block_bottom = std::min(block_y + block_size, luma_height);
+
+		// Blocks which stay inside the images do not need to be clamped
+		if (block_x + std::min(first_x, second_x) >= 0 && block_right + std::max(first_x, second_x) <= luma_width &&
+			block_y + std::min(first_y, second_y) >= 0 && block_bottom + std::max(first_y, second_y) <= luma_height) {
+			for (int y = block_y; y < block_bottom; y++) {
+				const unsigned char *first_row = &first[(size_t) (y + first_y) * luma_width + first_x];
+				const unsigned char *second_row = &second[(size_t) (y + second_y) * luma_width + second_x];
+				for (int x = block_x; x < block_right; x++)
+					sum += abs(first_row[x] - second_row[x]);
+			}
+			return sum;
+		}
+
+		for (int y = block_y; y < block_bottom; y++) {
+			const unsigned char *first_row = &first[(size_t) std::max(0, std::min(luma_height - 1, y + first_y)) * luma_width];
+			const unsigned char *second_row = &second[(size_t) std::max(0, std::min(luma_height - 1, y + second_y)) * luma_width];
+			for (int x = block_x; x < block_right; x++)
+				sum += abs(first_row[std::max(0, std::min(luma_width - 1, x + first_x))] - second_row[std::max(0, std::min(luma_width - 1, x + second_x))]);
+		}
+		return sum;
+	}
+
+	// Median of 3 x 3 values
+	int median9(int *values) {
+		std::nth_element(values, values + 4, values + 9);
+		return values[4];
+	}
+}
+
+// Blend 2 images (of the same size) into a target image
+void InterpolationKernels::Blend(unsigned char *target, int target_bytes_per_line, const unsigned char *first, int first_bytes_per_line,
+								 const unsigned char *second, int second_bytes_per_line, int width, int height, float weight)
+{
+	int second_weight = (int) round(std::max(0.0f, std::min(1.0f, weight)) * 256);
+	for_each_band(height, width * 4, [&](int first_row, int last_row)
+	{
+		for (int row = first_row; row < last_row; row++)
+			blend_row(target + (size_t) row * target_bytes_per_line, first + (size_t) row * first_bytes_per_line,
+					  second + (size_t) row * second_bytes_per_line, width * 4, second_weight);
+	});
+}
+
+// Create the motion compensated image between 2 images (of the same size)
+void InterpolationKernels::MotionBlend(unsigned char *target, int target_bytes_per_line, const unsigned char *first, int first_bytes_per_line,
+									   const unsigned char *second, int second_bytes_per_line, int width, int height, float weight)
+{
+	weight = std::max(0.0f, std::min(1.0f, weight));
+	int luma_width = width / luma_scale;
+	int luma_height = height / luma_scale;
+
+	// Images too small to estimate motion are blended
+	if (luma_width < block_size || luma_height < block_size) {
+		Blend(target, target_bytes_per_line, first, first_bytes_per_line, second, second_bytes_per_line, width, height, weight);
+		return;
+	}
+
+	// Quarter size luma images
+	std::vector<unsigned char> first_luma;
+	std::vector<unsigned char> second_luma;
+	make_luma(first_luma, first, first_bytes_per_line, luma_width, luma_height);
+	make_luma(second_luma, second, second_bytes_per_line, luma_width, luma_height);
+
+	// Search for the motion of each block, symmetrically around the new image: the first image is moved back by
+	// the weight of the motion, and the second image forward by the rest of it (so the new image has no holes)
+	int blocks_x = (luma_width + block_size - 1) / block_size;
+	int blocks_y = (luma_height + block_size - 1) / block_size;
+	std::vector<BlockMotion> motion((size_t) blocks_x * blocks_y);
+	TaskPool::Current()->ParallelFor(0, blocks_y, [&](int64_t block_row)
+	{
+		for (int block_column = 0; block_column < blocks_x; block_column++) {
+			BlockMotion best = {0, 0};
+			int best_cost = -1;
+			for (int motion_y = -search_range; motion_y <= search_range; motion_y++) {
+				for (int motion_x = -search_range; motion_x <= search_range; motion_x++) {
+					int first_x = -(int) lround(weight * motion_x);
+					int first_y = -(int) lround(weight * motion_y);
+					int cost = block_difference(first_luma, second_luma, luma_width, luma_height, block_column * block_size, block_row * block_size,
+												first_x, first_y, first_x + motion_x, first_y + motion_y);
+					cost += motion_penalty * (abs(motion_x) + abs(motion_y));
+					if (best_cost < 0 || cost < best_cost) {
+						best_cost = cost;
+						best.x = motion_x;
+						best.y = motion_y;
+					}
+				}
+			}
+			motion[(size_t) block_row * blocks_x + block_column] = best;
+		}
+	});
+
+	// Remove outliers (i.e. blocks which matched a repeating texture) with a median of the neighboring blocks
+	std::vector<BlockMotion> smooth_motion(motion.size());
+	for (int block_row = 0; block_row < blocks_y; block_row++) {
+		for (int block_column = 0; block_column < blocks_x; block_column++) {
+			int motion_x[9];
+			int motion_y[9];
+			int count = 0;
+			for (int y = -1; y <= 1; y++) {
+				for (int x = -1; x <= 1; x++, count++) {
+					const BlockMotion &neighbor = motion[(size_t) std::max(0, std::min(blocks_y - 1, block_row + y)) * blocks_x + std::max(0, std::min(blocks_x - 1, block_column + x))];
+					motion_x[count] = neighbor.x;
+					motion_y[count] = neighbor.y;
+				}
+			}
+			BlockMotion &smoothed = smooth_motion[(size_t) block_row * blocks_x + block_column];
+			smoothed.x = median9(motion_x);
+			smoothed.y = median9(motion_y);
+		}
+	}
+
+	// Blend the pixels each image moves to (with the motion interpolated between the centers of the blocks)
+	int second_weight = (int) round(weight * 256);
+	int first_weight = 256 - second_weight;
+	float block_pixels = block_size * luma_scale;
+	for_each_band(height, width * 4, [&](int first_row, int last_row)
+	{
+		for (int row = first_row; row < last_row; row++) {
+			float block_y = std::max(0.0f, std::min(blocks_y - 1.0f, row / block_pixels - 0.5f));
+			int block_top = std::min(blocks_y - 2, (int) block_y);
+			if (block_top < 0) block_top = 0;
+			int block_bottom = std::min(blocks_y - 1, block_top + 1);
+			float fraction_y = block_y - block_top;
+			unsigned char *target_pixel = target + (size_t) row * target_bytes_per_line;
+
+			for (int column = 0; column < width; column++, target_pixel += 4) {
+				float block_x = std::max(0.0f, std::min(blocks_x - 1.0f, column / block_pixels - 0.5f));
+				int block_left = std::min(blocks_x - 2, (int) block_x);
+				if (block_left < 0) block_left = 0;
+				int block_right = std::min(blocks_x - 1, block_left + 1);
+				float fraction_x = block_x - block_left;
+
+				// Bilinear motion (in pixels of the image)
+				const BlockMotion &top_left = smooth_motion[(size_t) block_top * blocks_x + block_left];
+				const BlockMotion &top_right = smooth_motion[(size_t) block_top * blocks_x + block_right];
+				const BlockMotion &bottom_left = smooth_motion[(size_t) block_bottom * blocks_x + block_left];
+				const BlockMotion &bottom_right = smooth_motion[(size_t) block_bottom * blocks_x + block_right];
+				float motion_x = ((top_left.x * (1.0f - fraction_x) + top_right.x * fraction_x) * (1.0f - fraction_y) +
+								  (bottom_left.x * (1.0f - fraction_x) + bottom_right.x * fraction_x) * fraction_y) * luma_scale;
+				float motion_y = ((top_left.y * (1.0f - fraction_x) + top_right.y * fraction_x) * (1.0f - fraction_y) +
+								  (bottom_left.y * (1.0f - fraction_x) + bottom_right.y * fraction_x) * fraction_y) * luma_scale;
+
+				// The pixel of each image which moves to this pixel
+				int first_x = std::max(0, std::min(width - 1, (int) lround(column - weight * motion_x)));
+				int first_y = std::max(0, std::min(height - 1, (int) lround(row - weight * motion_y)));
+				int second_x = std::max(0, std::min(width - 1, (int) lround(column + (1.0f - weight) * motion_x)));
+				int second_y = std::max(0, std::min(height - 1, (int) lround(row + (1.0f - weight) * motion_y)));
+				const unsigned char *first_pixel = first + (size_t) first_y * first_bytes_per_line + first_x * 4;
+				const unsigned char *second_pixel = second + (size_t) second_y * second_bytes_per_line + second_x * 4;
+				for (int channel = 0; channel < 4; channel++)
+					target_pixel[channel] = (unsigned char) ((first_pixel[channel] * first_weight + second_pixel[channel] * second_weight + 128) >> 8);
+			}
+		}
+	});
+}
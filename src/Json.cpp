@@ -0,0 +1,385 @@
+/**
+ * @file
+ * @brief Source file for JSON functions
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/Json.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// Parse a JSON string (with a reader shared by each thread)
+bool openshot::ParseJson(const std::string& value, Json::Value& root)
+{
+	// A reader is not thread safe, so each thread keeps its own (instead of allocating one per string)
+	static thread_local std::unique_ptr<Json::CharReader> reader;
+	if (!reader) {
+		Json::CharReaderBuilder rbuilder;
+		reader.reset(rbuilder.newCharReader());
+	}
+
+	std::string errors;
+	return reader->parse(value.c_str(), value.c_str() + value.size(), &root, &errors);
+}
+
+// Serialize a JSON value to a compact string
+std::string openshot::WriteJson(const Json::Value& root)
+{
+	// A writer is not thread safe, so each thread keeps its own (without indentation)
+	static thread_local std::unique_ptr<Json::StreamWriter> writer;
+	if (!writer) {
+		Json::StreamWriterBuilder wbuilder;
+		wbuilder["indentation"] = "";
+		writer.reset(wbuilder.newStreamWriter());
+	}
+
+	std::ostringstream output;
+	writer->write(root, &output);
+	return output.str();
+}
+
+namespace {
+
+	// Identifies binary JSON (and its version)
+	const char BINARY_JSON_MAGIC[] = { 'O', 'S', 'B', 'J', 1 };
+
+	// Types of binary JSON values
+	enum BinaryJsonTag { TAG_NULL, TAG_FALSE, TAG_TRUE, TAG_INT, TAG_UINT, TAG_REAL, TAG_STRING, TAG_ARRAY, TAG_OBJECT, TAG_KEYFRAME };
+
+	// Is a JSON value a coordinate (as written by Coordinate::JsonValue)
+	bool is_coordinate(const Json::Value& value)
+	{
+		return value.isObject() && value.size() == 2 && value["X"].type() == Json::realValue && value["Y"].type() == Json::realValue;
+	}
+
+	// Is a JSON value a keyframe (as written by Keyframe::JsonValue), which can be packed
+	bool is_keyframe(const Json::Value& value)
+	{
+		if (value.size() != 1 || !value["Points"].isArray())
+			return false;
+		for (const Json::Value& point : value["Points"]) {
+			if (!point.isObject() || !is_coordinate(point["co"]) || point["interpolation"].type() != Json::intValue)
+				return false;
+			bool is_bezier = point.size() == 5 && is_coordinate(point["handle_left"]) && is_coordinate(point["handle_right"]) &&
+							 point["handle_type"].type() == Json::intValue;
+			if (point.size() != 2 && !is_bezier)
+				return false;
+		}
+		return true;
+	}
+
+	// Serialize JSON values to binary
+	class BinaryJsonWriter
+	{
+	public:
+		std::string output;
+
+		void write_varint(uint64_t value)
+		{
+			while (value >= 0x80) {
+				output.push_back(char((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			output.push_back(char(value));
+		}
+
+		void write_double(double value)
+		{
+			// Little-endian, on any host
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			for (int byte = 0; byte < 8; byte++)
+				output.push_back(char((bits >> (8 * byte)) & 0xFF));
+		}
+
+		void write_string(const std::string& value)
+		{
+			write_varint(value.size());
+			output.append(value);
+		}
+
+		void write_key(const std::string& key)
+		{
+			// The first use of a key stores its name, and later uses its index (plus 1)
+			std::map<std::string, uint64_t>::iterator key_itr = keys.find(key);
+			if (key_itr != keys.end()) {
+				write_varint(key_itr->second + 1);
+				return;
+			}
+			uint64_t index = keys.size();
+			keys[key] = index;
+			write_varint(0);
+			write_string(key);
+		}
+
+		void write_value(const Json::Value& value)
+		{
+			switch (value.type()) {
+				case Json::nullValue:
+					output.push_back(TAG_NULL);
+					break;
+				case Json::booleanValue:
+					output.push_back(value.asBool() ? TAG_TRUE : TAG_FALSE);
+					break;
+				case Json::intValue: {
+					// Zigzag encoded (so small negative numbers are small)
+					int64_t number = value.asInt64();
+					output.push_back(TAG_INT);
+					write_varint((uint64_t(number) << 1) ^ uint64_t(number >> 63));
+					break;
+				}
+				case Json::uintValue:
+					output.push_back(TAG_UINT);
+					write_varint(value.asUInt64());
+					break;
+				case Json::realValue:
+					output.push_back(TAG_REAL);
+					write_double(value.asDouble());
+					break;
+				case Json::stringValue:
+					output.push_back(TAG_STRING);
+					write_string(value.asString());
+					break;
+				case Json::arrayValue:
+					output.push_back(TAG_ARRAY);
+					write_varint(value.size());
+					for (const Json::Value& item : value)
+						write_value(item);
+					break;
+				case Json::objectValue:
+					if (is_keyframe(value)) {
+						// Packed points (coordinates, interpolation, and the bezier handles)
+						output.push_back(TAG_KEYFRAME);
+						write_varint(value["Points"].size());
+						for (const Json::Value& point : value["Points"]) {
+							bool is_bezier = point.size() == 5;
+							output.push_back(is_bezier ? 1 : 0);
+							write_varint(point["interpolation"].asInt());
+							write_double(point["co"]["X"].asDouble());
+							write_double(point["co"]["Y"].asDouble());
+							if (is_bezier) {
+								write_double(point["handle_left"]["X"].asDouble());
+								write_double(point["handle_left"]["Y"].asDouble());
+								write_double(point["handle_right"]["X"].asDouble());
+								write_double(point["handle_right"]["Y"].asDouble());
+								write_varint(point["handle_type"].asInt());
+							}
+						}
+						break;
+					}
+					output.push_back(TAG_OBJECT);
+					write_varint(value.size());
+					for (const std::string& name : value.getMemberNames()) {
+						write_key(name);
+						write_value(value[name]);
+					}
+					break;
+			}
+		}
+
+	private:
+		std::map<std::string, uint64_t> keys;
+	};
+
+	// Parse binary JSON values (every read checks the end of the data)
+	class BinaryJsonReader
+	{
+	public:
+		BinaryJsonReader(const std::string& input, size_t position) : input(input), position(position) { }
+
+		bool read_varint(uint64_t& value)
+		{
+			value = 0;
+			for (int shift = 0; shift < 64 && position < input.size(); shift += 7) {
+				unsigned char byte = input[position++];
+				value |= uint64_t(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return true;
+			}
+			return false;
+		}
+
+		bool read_double(double& value)
+		{
+			if (input.size() - position < 8)
+				return false;
+			uint64_t bits = 0;
+			for (int byte = 0; byte < 8; byte++)
+				bits |= uint64_t((unsigned char) input[position++]) << (8 * byte);
+			memcpy(&value, &bits, sizeof(value));
+			return true;
+		}
+
+		bool read_string(std::string& value)
+		{
+			uint64_t length;
+			if (!read_varint(length) || input.size() - position < length)
+				return false;
+			value = input.substr(position, length);
+			position += length;
+			return true;
+		}
+
+		bool read_key(std::string& key)
+		{
+			uint64_t index;
+			if (!read_varint(index))
+				return false;
+			if (index == 0) {
+				if (!read_string(key))
+					return false;
+				keys.push_back(key);
+				return true;
+			}
+			if (index > keys.size())
+				return false;
+			key = keys[index - 1];
+			return true;
+		}
+
+		bool read_coordinate(Json::Value& coordinate)
+		{
+			double x, y;
+			if (!read_double(x) || !read_double(y))
+				return false;
+			coordinate["X"] = x;
+			coordinate["Y"] = y;
+			return true;
+		}
+
+		bool read_value(Json::Value& value)
+		{
+			if (position >= input.size())
+				return false;
+			uint64_t count;
+			switch (input[position++]) {
+				case TAG_NULL:
+					value = Json::Value();
+					return true;
+				case TAG_FALSE:
+					value = false;
+					return true;
+				case TAG_TRUE:
+					value = true;
+					return true;
+				case TAG_INT:
+					if (!read_varint(count))
+						return false;
+					value = Json::Int64((count >> 1) ^ (~(count & 1) + 1));
+					return true;
+				case TAG_UINT:
+					if (!read_varint(count))
+						return false;
+					value = Json::UInt64(count);
+					return true;
+				case TAG_REAL: {
+					double number;
+					if (!read_double(number))
+						return false;
+					value = number;
+					return true;
+				}
+				case TAG_STRING: {
+					std::string text;
+					if (!read_string(text))
+						return false;
+					value = text;
+					return true;
+				}
+				case TAG_ARRAY:
+					value = Json::Value(Json::arrayValue);
+					if (!read_varint(count))
+						return false;
+					for (uint64_t index = 0; index < count; index++)
+						if (!read_value(value.append(Json::Value())))
+							return false;
+					return true;
+				case TAG_OBJECT:
+					value = Json::Value(Json::objectValue);
+					if (!read_varint(count))
+						return false;
+					for (uint64_t index = 0; index < count; index++) {
+						std::string key;
+						if (!read_key(key) || !read_value(value[key]))
+							return false;
+					}
+					return true;
+				case TAG_KEYFRAME:
+					value = Json::Value(Json::objectValue);
+					value["Points"] = Json::Value(Json::arrayValue);
+					if (!read_varint(count))
+						return false;
+					for (uint64_t index = 0; index < count; index++) {
+						if (position >= input.size())
+							return false;
+						bool is_bezier = input[position++] != 0;
+						uint64_t interpolation;
+						Json::Value& point = value["Points"].append(Json::Value(Json::objectValue));
+						if (!read_varint(interpolation) || !read_coordinate(point["co"]))
+							return false;
+						if (is_bezier) {
+							uint64_t handle_type;
+							if (!read_coordinate(point["handle_left"]) || !read_coordinate(point["handle_right"]) || !read_varint(handle_type))
+								return false;
+							point["handle_type"] = int(handle_type);
+						}
+						point["interpolation"] = int(interpolation);
+					}
+					return true;
+			}
+			return false;
+		}
+
+	private:
+		const std::string& input;
+		size_t position;
+		std::vector<std::string> keys;
+	};
+
+}
+
+// Serialize a JSON value to a compact binary string
+std::string openshot::WriteBinaryJson(const Json::Value& root)
+{
+	BinaryJsonWriter writer;
+	writer.output.append(BINARY_JSON_MAGIC, sizeof(BINARY_JSON_MAGIC));
+	writer.write_value(root);
+	return writer.output;
+}
+
+// Parse a binary string (see WriteBinaryJson)
+bool openshot::ParseBinaryJson(const std::string& value, Json::Value& root)
+{
+	if (value.size() < sizeof(BINARY_JSON_MAGIC) || value.compare(0, sizeof(BINARY_JSON_MAGIC), BINARY_JSON_MAGIC, sizeof(BINARY_JSON_MAGIC)) != 0)
+		return false;
+	BinaryJsonReader reader(value, sizeof(BINARY_JSON_MAGIC));
+	return reader.read_value(root);
+}
@@ -48,31 +48,39 @@ namespace {
 		return left.co.Y + slope * (target - left.co.X);
 	}
 
-	double InterpolateBezierCurve(Point const & left, Point const & right, double const target, double const allowed_error) {
+	// Power basis coefficients of one dimension of a cubic bezier curve (evaluated with 3 multiply-adds)
+	void BezierPolynomial(double p0, double p1, double p2, double p3, double *c) {
+		c[0] = p0;
+		c[1] = 3 * (p1 - p0);
+		c[2] = 3 * (p2 - 2 * p1 + p0);
+		c[3] = p3 - 3 * p2 + 3 * p1 - p0;
+	}
+
+	double EvaluatePolynomial(double const *c, double t) {
+		return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+	}
+
+	// The polynomials of X(t) and Y(t) of the bezier curve between two points
+	void BezierCurve(Point const & left, Point const & right, double *X, double *Y) {
 		double const X_diff = right.co.X - left.co.X;
 		double const Y_diff = right.co.Y - left.co.Y;
 		Coordinate const p0 = left.co;
 		Coordinate const p1 = Coordinate(p0.X + left.handle_right.X * X_diff, p0.Y + left.handle_right.Y * Y_diff);
 		Coordinate const p2 = Coordinate(p0.X + right.handle_left.X * X_diff, p0.Y + right.handle_left.Y * Y_diff);
 		Coordinate const p3 = right.co;
+		BezierPolynomial(p0.X, p1.X, p2.X, p3.X, X);
+		BezierPolynomial(p0.Y, p1.Y, p2.Y, p3.Y, Y);
+	}
 
+	double SolveBezierCurve(double const *X, double const *Y, double const target, double const allowed_error) {
+		// Bisection for the t of the target X (only X is evaluated per step, and Y once at the end). The steps
+		// are limited, since curves with unusual handles can fold back and never reach the allowed error.
 		double t = 0.5;
 		double t_step = 0.25;
-		do {
-			// Bernstein polynoms
-			double B[4] = {1, 3, 3, 1};
-			double oneMinTExp = 1;
-			double tExp = 1;
-			for (int i = 0; i < 4; ++i, tExp *= t) {
-				B[i] *= tExp;
-			}
-			for (int i = 0; i < 4; ++i, oneMinTExp *= 1 - t) {
-				B[4 - i - 1] *= oneMinTExp;
-			}
-			double const x = p0.X * B[0] + p1.X * B[1] + p2.X * B[2] + p3.X * B[3];
-			double const y = p0.Y * B[0] + p1.Y * B[1] + p2.Y * B[2] + p3.Y * B[3];
+		for (int step = 0; step < 64; step++) {
+			double const x = EvaluatePolynomial(X, t);
 			if (abs(target - x) < allowed_error) {
-				return y;
+				break;
 			}
 			if (x > target) {
 				t -= t_step;
@@ -81,7 +89,14 @@ namespace {
 				t += t_step;
 			}
 			t_step /= 2;
-		} while (true);
+		}
+		return EvaluatePolynomial(Y, t);
+	}
+
+	double InterpolateBezierCurve(Point const & left, Point const & right, double const target, double const allowed_error) {
+		double X[4], Y[4];
+		BezierCurve(left, right, X, Y);
+		return SolveBezierCurve(X, Y, target, allowed_error);
 	}
 
 
@@ -144,6 +159,7 @@ void Keyframe::AddPoint(Point p) {
 		std::move_backward(begin(Points) + candidate_index, end(Points) - 1, end(Points));
 		Points[candidate_index] = p;
 	}
+	index_points();
 }
 
 // Add a new point on the key-frame, with some defaults set (BEZIER)
@@ -260,26 +276,149 @@ Point Keyframe::GetMaxPoint() const {
 
 // Get the value at a specific index
 double Keyframe::GetValue(int64_t index) const {
+	// Baked indexes are only a lookup
+	if (IsBaked(index)) {
+		return baked_values[index - baked_start];
+	}
+	return interpolate_value(index);
+}
+
+// Interpolate the value at a specific index (without the baked values)
+double Keyframe::interpolate_value(int64_t index) const {
 	if (Points.empty()) {
 		return 0;
 	}
-	std::vector<Point>::const_iterator candidate =
-		std::lower_bound(begin(Points), end(Points), static_cast<double>(index), IsPointBeforeX);
+	return value_at(find_point(index), index);
+}
 
-	if (candidate == end(Points)) {
+// Find the first point which is not before an index (in the X coordinates)
+size_t Keyframe::find_point(double index) const {
+	return std::lower_bound(begin(point_x), end(point_x), index) - begin(point_x);
+}
+
+// Interpolate the value at a specific index, from the first point which is not before the index
+double Keyframe::value_at(size_t candidate, int64_t index) const {
+	if (candidate == Points.size()) {
 		// index is behind last point
 		return Points.back().co.Y;
 	}
-	if (candidate == begin(Points)) {
+	if (candidate == 0) {
 		// index is at or before first point
 		return Points.front().co.Y;
 	}
-	if (candidate->co.X == index) {
+	if (point_x[candidate] == index) {
 		// index is directly on a point
-		return candidate->co.Y;
+		return Points[candidate].co.Y;
+	}
+	double value;
+	interpolate_segment(candidate - 1, index, 1, &value);
+	return value;
+}
+
+// Interpolate the values of consecutive indexes which are all inside of a segment
+void Keyframe::interpolate_segment(size_t segment, int64_t index, int64_t count, double *values) const {
+	Segment const & curve = segments[segment];
+	switch (curve.interpolation) {
+	case CONSTANT:
+		std::fill(values, values + count, curve.y[0]);
+		break;
+	case LINEAR: {
+		// A single multiply-add per index (without branches, so the loop can be vectorized)
+		double const left_x = curve.x[0];
+		double const left_y = curve.y[0];
+		double const slope = curve.y[1];
+		for (int64_t offset = 0; offset < count; offset++) {
+			values[offset] = left_y + slope * (static_cast<double>(index + offset) - left_x);
+		}
+		break;
+	}
+	case BEZIER:
+		for (int64_t offset = 0; offset < count; offset++) {
+			values[offset] = SolveBezierCurve(curve.x, curve.y, index + offset, 0.01);
+		}
+		break;
+	}
+}
+
+// Update the X coordinates and segments, and discard the baked values (after the points changed)
+void Keyframe::index_points() {
+	discard_baked_values();
+	point_x.resize(Points.size());
+	segments.resize(Points.empty() ? 0 : Points.size() - 1);
+	for (size_t index = 0; index < Points.size(); index++) {
+		point_x[index] = Points[index].co.X;
+	}
+	for (size_t index = 0; index < segments.size(); index++) {
+		Point const & left = Points[index];
+		Point const & right = Points[index + 1];
+		Segment & curve = segments[index];
+		curve.interpolation = right.interpolation;
+		if (right.interpolation == BEZIER) {
+			BezierCurve(left, right, curve.x, curve.y);
+		}
+		else {
+			// The same slope as InterpolateLinearCurve() (so the values do not change)
+			curve.x[0] = left.co.X;
+			curve.y[0] = left.co.Y;
+			curve.y[1] = (right.co.Y - left.co.Y) / (right.co.X - left.co.X);
+		}
+	}
+}
+
+// Get the value at a specific index, stepping from the segment of the previous index
+double Keyframe::Cursor::GetValue(int64_t index) {
+	std::vector<double> const & point_x = keyframe->point_x;
+	if (keyframe->IsBaked(index)) {
+		return keyframe->baked_values[index - keyframe->baked_start];
+	}
+	if (point_x.empty()) {
+		return 0;
+	}
+
+	// Search the first point which is not before the index (once), and then step to it from the previous one
+	if (!positioned || segment > point_x.size()) {
+		segment = keyframe->find_point(index);
+		positioned = true;
+	}
+	while (segment < point_x.size() && point_x[segment] < index) {
+		segment++;
+	}
+	while (segment > 0 && !(point_x[segment - 1] < index)) {
+		segment--;
+	}
+	return keyframe->value_at(segment, index);
+}
+
+// Get the values of consecutive indexes (with a search of the points per segment, not per index)
+void Keyframe::GetValues(int64_t start, int64_t count, double *values) const {
+	int64_t offset = 0;
+	while (offset < count) {
+		int64_t const index = start + offset;
+		if (IsBaked(index)) {
+			values[offset++] = baked_values[index - baked_start];
+			continue;
+		}
+		if (Points.empty()) {
+			std::fill(values + offset, values + count, 0.0);
+			return;
+		}
+		size_t const candidate = find_point(index);
+		if (candidate == Points.size()) {
+			// Every following index is behind the last point (and baked values are never past it)
+			std::fill(values + offset, values + count, Points.back().co.Y);
+			return;
+		}
+		if (candidate == 0 || point_x[candidate] == index) {
+			values[offset++] = value_at(candidate, index);
+			continue;
+		}
+
+		// The indexes before the right point of the segment are interpolated in one loop (the baked values
+		// of any of them are the same interpolated values)
+		int64_t const run = std::min(count - offset, static_cast<int64_t>(ceil(point_x[candidate])) - index);
+		interpolate_segment(candidate - 1, index, run, values + offset);
+		offset += run;
 	}
-	std::vector<Point>::const_iterator predecessor = candidate - 1;
-	return InterpolateBetween(*predecessor, *candidate, index, 0.01);
 }
 
 // Get the rounded INT value at a specific index
@@ -295,6 +434,9 @@ int64_t Keyframe::GetLong(int64_t index) const {
 // Get the direction of the curve at a specific index (increasing or decreasing)
 bool Keyframe::IsIncreasing(int index) const
 {
+	if (!baked_increasing.empty() && IsBaked(index)) {
+		return baked_increasing[index - baked_start];
+	}
 	if (index < 1 || (index + 1) >= GetLength()) {
 		return true;
 	}
@@ -318,11 +460,112 @@ bool Keyframe::IsIncreasing(int index) const
 	return false;
 }
 
+// Evaluate the curve once for each index from start to stop (inclusive)
+void Keyframe::Bake(int64_t start, int64_t stop) {
+	if (start > stop)
+		std::swap(start, stop);
+
+	// Interpolate the values first (so they are not looked up in the previous baked values)
+	std::vector<double> values;
+	values.reserve(stop - start + 1);
+	for (int64_t index = start; index <= stop; index++) {
+		values.push_back(interpolate_value(index));
+	}
+	discard_baked_values();
+	baked_values.swap(values);
+	baked_start = start;
+}
+
+// Bake the animated range of the curve (between its first and last points)
+bool Keyframe::Bake() {
+	// Values outside of the points are constant (and a single point is already a constant)
+	if (Points.size() < 2) {
+		return false;
+	}
+	int64_t const start = static_cast<int64_t>(ceil(Points.front().co.X));
+	int64_t const stop = static_cast<int64_t>(floor(Points.back().co.X));
+
+	// Limit the memory of very long curves (1M values is over 9 hours at 30 fps)
+	if (stop < start || stop - start >= (1 << 20)) {
+		return false;
+	}
+	Bake(start, stop);
+	return true;
+}
+
+// Bake the animated range of a time curve, with its repeat fractions, deltas, and directions
+bool Keyframe::BakeTimeMap() {
+	if (!Bake()) {
+		return false;
+	}
+
+	// The queries of the baked range (calculated before they are stored, so they are not looked up)
+	std::vector<Fraction> repeats;
+	std::vector<double> deltas;
+	std::vector<bool> increasing;
+	repeats.reserve(baked_values.size());
+	deltas.reserve(baked_values.size());
+	increasing.reserve(baked_values.size());
+	for (int64_t index = baked_start; index - baked_start < (int64_t) baked_values.size(); index++) {
+		repeats.push_back(GetRepeatFraction(index));
+		deltas.push_back(GetDelta(index));
+		increasing.push_back(IsIncreasing(index));
+	}
+	baked_repeats.swap(repeats);
+	baked_deltas.swap(deltas);
+	baked_increasing.swap(increasing);
+	return true;
+}
+
+// Get whether the value at an index is baked
+bool Keyframe::IsBaked(int64_t index) const {
+	return index >= baked_start && index - baked_start < (int64_t) baked_values.size();
+}
+
+// Discard the baked values (since the points changed)
+void Keyframe::discard_baked_values() {
+	std::vector<double>().swap(baked_values);
+	std::vector<Fraction>().swap(baked_repeats);
+	std::vector<double>().swap(baked_deltas);
+	std::vector<bool>().swap(baked_increasing);
+	baked_start = 0;
+}
+
+// Get whether the value is the same at every index from start to stop (inclusive)
+bool Keyframe::IsConstant(int64_t start, int64_t stop) const
+{
+	if (start > stop)
+		std::swap(start, stop);
+
+	// The first point at or after start (and the point before it, which the value at start is interpolated from)
+	std::vector<Point>::const_iterator first =
+		std::lower_bound(begin(Points), end(Points), static_cast<double>(start), IsPointBeforeX);
+	if (first == end(Points)) {
+		// start is behind last point (or there are no points)
+		return true;
+	}
+	if (first != begin(Points) && first->co.X > start)
+		--first;
+
+	// The first point at or after stop (the last point the range is interpolated from)
+	std::vector<Point>::const_iterator last =
+		std::lower_bound(first, end(Points), static_cast<double>(stop), IsPointBeforeX);
+	if (last == end(Points))
+		--last;
+
+	// Every segment between points with the same value is flat (for all interpolation types)
+	for (std::vector<Point>::const_iterator point = first; point != last; ++point)
+		if ((point + 1)->co.Y != first->co.Y)
+			return false;
+
+	return true;
+}
+
 // Generate JSON string of this object
 std::string Keyframe::Json() const {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -348,13 +591,7 @@ void Keyframe::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -376,6 +613,7 @@ void Keyframe::SetJson(std::string value) {
 void Keyframe::SetJsonValue(Json::Value root) {
 	// Clear existing points
 	Points.clear();
+	index_points();
 
 	if (!root["Points"].isNull())
 		// loop through points
@@ -397,6 +635,10 @@ void Keyframe::SetJsonValue(Json::Value root) {
 // Get the fraction that represents how many times this value is repeated in the curve
 // This is depreciated and will be removed soon.
 Fraction Keyframe::GetRepeatFraction(int64_t index) const {
+	if (!baked_repeats.empty() && IsBaked(index)) {
+		return baked_repeats[index - baked_start];
+	}
+
 	// Frame numbers (index) outside of the "defined" range of this
 	// keyframe result in a 1/1 default value.
 	if (index < 1 || (index + 1) >= GetLength()) {
@@ -406,10 +648,10 @@ Fraction Keyframe::GetRepeatFraction(int64_t index) const {
 
 	// First, get the value at the given frame and the closest point
 	// to the right.
-	int64_t const current_value = GetLong(index);
 	std::vector<Point>::const_iterator const candidate =
 		std::lower_bound(begin(Points), end(Points), static_cast<double>(index), IsPointBeforeX);
 	assert(candidate != end(Points)); // Due to the (index + 1) >= GetLength check above!
+	int64_t const current_value = IsBaked(index) ? GetLong(index) : long(round(value_at(candidate - begin(Points), index)));
 
 	// Calculate how many of the next values are going to be the same:
 	int64_t next_repeats = 0;
@@ -500,10 +742,17 @@ Fraction Keyframe::GetRepeatFraction(int64_t index) const {
 
 // Get the change in Y value (from the previous Y value)
 double Keyframe::GetDelta(int64_t index) const {
+	if (!baked_deltas.empty() && IsBaked(index)) {
+		return baked_deltas[index - baked_start];
+	}
 	if (index < 1) return 0;
 	if (index == 1 && ! Points.empty()) return Points[0].co.Y;
 	if (index >= GetLength()) return 0;
-	return GetLong(index) - GetLong(index - 1);
+
+	// Both values are usually in the same segment
+	Cursor cursor(*this);
+	int64_t const previous_value = cursor.GetLong(index - 1);
+	return cursor.GetLong(index) - previous_value;
 }
 
 // Get a point at a specific index
@@ -540,6 +789,7 @@ void Keyframe::RemovePoint(Point p) {
 		if (p.co.X == existing_point.co.X && p.co.Y == existing_point.co.Y) {
 			// Remove the matching point, and break out of loop
 			Points.erase(Points.begin() + x);
+			index_points();
 			return;
 		}
 	}
@@ -555,6 +805,7 @@ void Keyframe::RemovePoint(int64_t index) {
 	{
 		// Remove a specific point by index
 		Points.erase(Points.begin() + index);
+		index_points();
 	}
 	else
 		// Invalid index
@@ -601,6 +852,7 @@ void Keyframe::ScalePoints(double scale)
 		// Scale X value
 		Points[point_index].co.X = round(Points[point_index].co.X * scale);
 	}
+	index_points();
 }
 
 // Flip all the points in this openshot::Keyframe (useful for reversing an effect or transition, etc...)
@@ -612,4 +864,5 @@ void Keyframe::FlipPoints() {
 		// TODO: check that this has the desired effect even with
 		// regards to handles!
 	}
+	index_points();
 }
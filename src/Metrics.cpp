@@ -0,0 +1,238 @@
+/**
+ * @file
+ * @brief Source file for Metrics class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "../include/Metrics.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Add a measurement
+void Histogram::Observe(double value)
+{
+	// Find the bucket (each one is twice as large as the one before)
+	int bucket = 0;
+	if (value >= 1.0)
+		bucket = std::min(15, 1 + (int) std::floor(std::log2(value)));
+
+	std::lock_guard<std::mutex> lock(histogram_mutex);
+	if (count == 0 || value < minimum)
+		minimum = value;
+	if (count == 0 || value > maximum)
+		maximum = value;
+	count++;
+	sum += value;
+	buckets[bucket]++;
+}
+
+// Get the number of measurements
+int64_t Histogram::Count()
+{
+	std::lock_guard<std::mutex> lock(histogram_mutex);
+	return count;
+}
+
+// Get the mean of the measurements (or 0, without any measurements)
+double Histogram::Mean()
+{
+	std::lock_guard<std::mutex> lock(histogram_mutex);
+	return (count > 0) ? sum / count : 0.0;
+}
+
+// Remove all measurements
+void Histogram::Reset()
+{
+	std::lock_guard<std::mutex> lock(histogram_mutex);
+	count = 0;
+	sum = 0.0;
+	minimum = 0.0;
+	maximum = 0.0;
+	std::fill(buckets, buckets + 16, 0);
+}
+
+// Get the count, sum, mean, minimum, maximum, and buckets as JSON
+Json::Value Histogram::JsonValue()
+{
+	std::lock_guard<std::mutex> lock(histogram_mutex);
+	Json::Value root;
+	root["count"] = Json::Int64(count);
+	root["sum"] = sum;
+	root["mean"] = (count > 0) ? sum / count : 0.0;
+	root["min"] = minimum;
+	root["max"] = maximum;
+
+	// Each bucket is named after its upper bound
+	root["buckets"] = Json::Value(Json::objectValue);
+	for (int bucket = 0; bucket < 16; bucket++)
+		if (buckets[bucket] > 0)
+			root["buckets"][(bucket < 15) ? std::to_string(1 << bucket) : std::string("inf")] = Json::Int64(buckets[bucket]);
+	return root;
+}
+
+// Add bytes (or remove them), and raise the peak
+void MemoryGauge::Add(int64_t bytes)
+{
+	int64_t value = current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	int64_t highest = peak.load(std::memory_order_relaxed);
+	while (value > highest && !peak.compare_exchange_weak(highest, value, std::memory_order_relaxed)) {
+		// A failed exchange loads the newer peak into highest
+	}
+}
+
+// The gauge the pooled images of each thread are charged to
+static thread_local MemoryGauge *current_memory_tag = NULL;
+
+// Charge the images of this thread to a gauge
+ScopedMemoryTag::ScopedMemoryTag(MemoryGauge &gauge) : previous(current_memory_tag)
+{
+	current_memory_tag = &gauge;
+}
+
+// Charge the images of this thread to the previous gauge again
+ScopedMemoryTag::~ScopedMemoryTag()
+{
+	current_memory_tag = previous;
+}
+
+// Get the gauge the images of this thread are charged to
+MemoryGauge *ScopedMemoryTag::Current()
+{
+	return current_memory_tag;
+}
+
+// Global reference to metrics registry
+Metrics *Metrics::m_pInstance = NULL;
+
+// Create or Get an instance of the metrics registry singleton
+Metrics *Metrics::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of metrics registry only once
+		m_pInstance = new Metrics();
+
+	return m_pInstance;
+}
+
+// Get (or create) a counter (the reference stays valid)
+Counter & Metrics::GetCounter(std::string name)
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	return counters[name];
+}
+
+// Get (or create) a histogram (the reference stays valid)
+Histogram & Metrics::GetHistogram(std::string name)
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	return histograms[name];
+}
+
+// Set the current value of a gauge
+void Metrics::SetGauge(std::string name, double value)
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	gauges[name] = value;
+}
+
+// Get (or create) the memory gauge of a subsystem (the reference stays valid)
+MemoryGauge & Metrics::GetMemory(std::string name)
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	return memory[name];
+}
+
+// Get the current and peak bytes of each subsystem as JSON
+Json::Value Metrics::MemoryValue()
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	Json::Value root = Json::Value(Json::objectValue);
+	for (std::map<std::string, MemoryGauge>::iterator itr = memory.begin(); itr != memory.end(); ++itr) {
+		root[itr->first]["current"] = Json::Int64(itr->second.Current());
+		root[itr->first]["peak"] = Json::Int64(itr->second.Peak());
+	}
+	return root;
+}
+
+// Reset all counters, gauges, and histograms
+void Metrics::Reset()
+{
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	for (std::map<std::string, Counter>::iterator itr = counters.begin(); itr != counters.end(); ++itr)
+		itr->second.Reset();
+	for (std::map<std::string, Histogram>::iterator itr = histograms.begin(); itr != histograms.end(); ++itr)
+		itr->second.Reset();
+
+	// The memory is still held, so only the peaks are reset
+	for (std::map<std::string, MemoryGauge>::iterator itr = memory.begin(); itr != memory.end(); ++itr)
+		itr->second.ResetPeak();
+	gauges.clear();
+	reset_time = std::chrono::steady_clock::now();
+}
+
+// Get all metrics as a JSON string
+std::string Metrics::Json()
+{
+	return WriteJson(JsonValue());
+}
+
+// Get all metrics as a JSON value
+Json::Value Metrics::JsonValue()
+{
+	Json::Value memory_value = MemoryValue();
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reset_time).count();
+
+	Json::Value root;
+	root["seconds"] = seconds;
+	root["counters"] = Json::Value(Json::objectValue);
+	for (std::map<std::string, Counter>::iterator itr = counters.begin(); itr != counters.end(); ++itr) {
+		root["counters"][itr->first]["value"] = Json::Int64(itr->second.Value());
+		root["counters"][itr->first]["rate"] = (seconds > 0.0) ? itr->second.Value() / seconds : 0.0;
+	}
+	root["gauges"] = Json::Value(Json::objectValue);
+	for (std::map<std::string, double>::iterator itr = gauges.begin(); itr != gauges.end(); ++itr)
+		root["gauges"][itr->first] = itr->second;
+	root["histograms"] = Json::Value(Json::objectValue);
+	for (std::map<std::string, Histogram>::iterator itr = histograms.begin(); itr != histograms.end(); ++itr)
+		root["histograms"][itr->first] = itr->second.JsonValue();
+	root["memory"] = memory_value;
+	return root;
+}
+
+// Send all metrics to the subscribers of the logger (if logging is enabled)
+void Metrics::Publish()
+{
+	if (ZmqLogger::Instance()->IsEnabled())
+		ZmqLogger::Instance()->Log("Metrics " + Json() + "\n");
+}
@@ -0,0 +1,607 @@
+/**
+ * @file
+ * @brief Source file for ParallelExporter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/ParallelExporter.h"
+
+using namespace openshot;
+
+ParallelExporter::ParallelExporter() : range_start(1), range_end(1), segment_count(1)
+{
+	init_options();
+}
+
+ParallelExporter::ParallelExporter(Timeline* timeline, std::string path) :
+		path(path), timeline_root(timeline->JsonValue()), range_start(1), range_end(timeline->info.video_length),
+		segment_count(TaskPool::Current()->NumThreads())
+{
+	init_options();
+}
+
+// Init the writer options (no audio or video)
+void ParallelExporter::init_options()
+{
+	info.has_video = false;
+	info.has_audio = false;
+	info.width = 0;
+	info.height = 0;
+	info.fps = Fraction();
+	info.pixel_ratio = Fraction(1, 1);
+	info.interlaced_frame = false;
+	info.top_field_first = true;
+	info.video_bit_rate = 0;
+	info.sample_rate = 0;
+	info.channels = 0;
+	info.channel_layout = LAYOUT_STEREO;
+	info.audio_bit_rate = 0;
+}
+
+// Set audio export options
+void ParallelExporter::SetAudioOptions(bool has_audio, std::string codec, int sample_rate, int channels, ChannelLayout channel_layout, int bit_rate)
+{
+	info.has_audio = has_audio;
+	info.acodec = codec;
+	info.sample_rate = sample_rate;
+	info.channels = channels;
+	info.channel_layout = channel_layout;
+	info.audio_bit_rate = bit_rate;
+}
+
+// Set video export options
+void ParallelExporter::SetVideoOptions(bool has_video, std::string codec, Fraction fps, int width, int height, Fraction pixel_ratio, bool interlaced, bool top_field_first, int bit_rate)
+{
+	info.has_video = has_video;
+	info.vcodec = codec;
+	info.fps = fps;
+	info.width = width;
+	info.height = height;
+	info.pixel_ratio = pixel_ratio;
+	info.interlaced_frame = interlaced;
+	info.top_field_first = top_field_first;
+	info.video_bit_rate = bit_rate;
+}
+
+// Set a custom codec option of each segment's writer
+void ParallelExporter::SetOption(StreamType stream, std::string name, std::string value)
+{
+	options.push_back(std::make_pair(stream, std::make_pair(name, value)));
+}
+
+// Set the range of frames to export
+void ParallelExporter::SetFrameRange(int64_t start, int64_t end)
+{
+	if (start < 1 || end < start)
+		throw InvalidOptions("The frame range is invalid.", path);
+	range_start = start;
+	range_end = end;
+}
+
+// Set the number of segments to split the frame range into
+void ParallelExporter::SetSegmentCount(int count)
+{
+	if (count < 1)
+		throw InvalidOptions("At least one segment is required.", path);
+	segment_count = count;
+}
+
+// Get the first frame number of a segment
+int64_t ParallelExporter::GetSegmentStart(int index)
+{
+	int64_t frames = range_end - range_start + 1;
+	int64_t count = std::max(std::min(int64_t(segment_count), frames), int64_t(1));
+	return range_start + frames * std::min(int64_t(index), count) / count;
+}
+
+// Get the last frame number of a segment
+int64_t ParallelExporter::GetSegmentEnd(int index)
+{
+	return GetSegmentStart(index + 1) - 1;
+}
+
+// Get the file path of a segment (next to the output file, with the same extension)
+std::string ParallelExporter::GetSegmentPath(int index)
+{
+	std::stringstream segment_name;
+	segment_name << ".segment-" << std::setfill('0') << std::setw(4) << index;
+
+	size_t extension = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+		return path + segment_name.str();
+	return path.substr(0, extension) + segment_name.str() + path.substr(extension);
+}
+
+// Get the file path of the audio (rendered once for the whole range, next to the output file)
+std::string ParallelExporter::GetAudioPath()
+{
+	size_t extension = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+		return path + ".audio";
+	return path.substr(0, extension) + ".audio" + path.substr(extension);
+}
+
+// Render with a copy of the timeline (with its own clips and readers)
+void ParallelExporter::render_copy(std::function<void(Timeline&)> render)
+{
+	std::list<Clip*> clips;
+	std::list<EffectBase*> effects;
+	try {
+		Fraction fps(timeline_root["fps"]["num"].asInt(), timeline_root["fps"]["den"].asInt());
+		Timeline timeline(timeline_root["width"].asInt(), timeline_root["height"].asInt(), fps,
+						  timeline_root["sample_rate"].asInt(), timeline_root["channels"].asInt(),
+						  (ChannelLayout) timeline_root["channel_layout"].asInt());
+		timeline.SetJsonValue(timeline_root);
+		clips = timeline.Clips();
+		effects = timeline.Effects();
+		timeline.Open();
+		render(timeline);
+		timeline.Close();
+	}
+	catch (...) {
+		for (std::list<Clip*>::iterator clip_itr = clips.begin(); clip_itr != clips.end(); ++clip_itr)
+			delete *clip_itr;
+		for (std::list<EffectBase*>::iterator effect_itr = effects.begin(); effect_itr != effects.end(); ++effect_itr)
+			delete *effect_itr;
+		throw;
+	}
+
+	// Delete the clips and effects created by the timeline's JSON
+	for (std::list<Clip*>::iterator clip_itr = clips.begin(); clip_itr != clips.end(); ++clip_itr)
+		delete *clip_itr;
+	for (std::list<EffectBase*>::iterator effect_itr = effects.begin(); effect_itr != effects.end(); ++effect_itr)
+		delete *effect_itr;
+}
+
+// Render the video of a single segment into its own file
+void ParallelExporter::ExportSegment(int index)
+{
+	if (index < 0 || index >= segment_count)
+		throw InvalidOptions("The segment index is out of range.", path);
+
+	// Skip empty segments (if there are more segments than frames, or no video)
+	int64_t start = GetSegmentStart(index);
+	int64_t end = GetSegmentEnd(index);
+	if (end < start || !info.has_video)
+		return;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ParallelExporter::ExportSegment", "index", index, "start", start, "end", end);
+
+	render_copy([this, index, start, end](Timeline& timeline) {
+		// Create the segment's writer (a new encoder, so the segment starts with a keyframe)
+		FFmpegWriter writer(GetSegmentPath(index));
+		writer.SetVideoOptions(true, info.vcodec, info.fps, info.width, info.height, info.pixel_ratio,
+							   info.interlaced_frame, info.top_field_first, info.video_bit_rate);
+		writer.PrepareStreams();
+		for (size_t option = 0; option < options.size(); option++)
+			if (options[option].first == VIDEO_STREAM)
+				writer.SetOption(options[option].first, options[option].second.first, options[option].second.second);
+
+		// Write the segment's frames
+		writer.Open();
+		writer.WriteFrame(&timeline, start, end);
+		writer.Close();
+	});
+}
+
+// Render the audio of the whole range into its own file
+void ParallelExporter::ExportAudio()
+{
+	if (!info.has_audio)
+		return;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ParallelExporter::ExportAudio", "start", range_start, "end", range_end);
+
+	render_copy([this](Timeline& timeline) {
+		// A single encoder for the whole range (so the audio has no joints, since the last frame of an encoder is
+		// padded with silence)
+		FFmpegWriter writer(GetAudioPath());
+		writer.SetAudioOptions(true, info.acodec, info.sample_rate, info.channels, info.channel_layout, info.audio_bit_rate);
+		writer.PrepareStreams();
+		for (size_t option = 0; option < options.size(); option++)
+			if (options[option].first == AUDIO_STREAM)
+				writer.SetOption(options[option].first, options[option].second.first, options[option].second.second);
+
+		// Write the mixed audio of each frame (without compositing its images)
+		writer.Open();
+		for (int64_t frame = range_start; frame <= range_end; frame++)
+			writer.WriteFrame(timeline.GetAudioFrame(frame));
+		writer.Close();
+	});
+}
+
+// Render the video segments and the audio in parallel, and concatenate them
+void ParallelExporter::Export()
+{
+	// Each segment renders on its own thread (not a task of the TaskPool, since a segment's timeline waits on its
+	// own tasks of the pool)
+	std::vector<std::exception_ptr> errors(segment_count + 1);
+	std::vector<std::thread> threads;
+	for (int index = 0; index < segment_count; index++)
+		threads.push_back(std::thread([this, index, &errors]() {
+			try {
+				ExportSegment(index);
+			} catch (...) {
+				errors[index] = std::current_exception();
+			}
+		}));
+	threads.push_back(std::thread([this, &errors]() {
+		try {
+			ExportAudio();
+		} catch (...) {
+			errors[segment_count] = std::current_exception();
+		}
+	}));
+	for (size_t index = 0; index < threads.size(); index++)
+		threads[index].join();
+
+	// Re-throw the first error (if any)
+	for (size_t index = 0; index < errors.size(); index++)
+		if (errors[index])
+			std::rethrow_exception(errors[index]);
+
+	Concatenate();
+}
+
+// Open a rendered file (a segment, or the audio) to copy its packets
+static AVFormatContext *open_rendered_file(std::string file_path)
+{
+	AVFormatContext *input = NULL;
+	if (avformat_open_input(&input, file_path.c_str(), NULL, NULL) != 0)
+		throw InvalidFile("The rendered file could not be opened (was it exported?).", file_path);
+	if (avformat_find_stream_info(input, NULL) < 0) {
+		avformat_close_input(&input);
+		throw NoStreamsFound("No streams found in the rendered file.", file_path);
+	}
+	return input;
+}
+
+// Add a copy of each stream of a rendered file to the output
+static void copy_streams(AVFormatContext *output, AVFormatContext *input, std::string path)
+{
+	for (unsigned int stream = 0; stream < input->nb_streams; stream++) {
+		AVStream *in_stream = input->streams[stream];
+		AVStream *out_stream = avformat_new_stream(output, NULL);
+		if (!out_stream)
+			throw OutOfMemory("Could not allocate memory for the output stream.", path);
+#if IS_FFMPEG_3_2
+		avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+		out_stream->codecpar->codec_tag = 0;
+#else
+		avcodec_copy_context(out_stream->codec, in_stream->codec);
+		out_stream->codec->codec_tag = 0;
+		if (output->oformat->flags & AVFMT_GLOBALHEADER)
+			out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+#endif
+		out_stream->time_base = in_stream->time_base;
+	}
+}
+
+// Concatenate the rendered segments (and the audio) into the output file (without re-encoding them)
+void ParallelExporter::Concatenate(bool remove_segments)
+{
+	ZmqLogger::Instance()->AppendDebugMethod("ParallelExporter::Concatenate", "segment_count", segment_count, "has_video", info.has_video, "has_audio", info.has_audio);
+
+	AV_REGISTER_ALL
+
+	AVFormatContext *output = NULL;
+	avformat_alloc_output_context2(&output, NULL, NULL, path.c_str());
+	if (!output)
+		throw InvalidFormat("Could not deduce output format from file extension.", path);
+
+	AVFormatContext *input = NULL;
+	AVFormatContext *audio_input = NULL;
+	bool is_output_open = false;
+	std::vector<int64_t> last_dts;
+	unsigned int video_streams = 0;
+	AVRational frame_duration = {timeline_root["fps"]["den"].asInt(), timeline_root["fps"]["num"].asInt()};
+
+	// The next packet of the audio (read ahead, so the audio is interleaved with the video by time)
+	AVPacket audio_pkt;
+	av_init_packet(&audio_pkt);
+	audio_pkt.data = NULL;
+	audio_pkt.size = 0;
+	bool has_audio_pkt = false;
+
+	// Copy the audio packets which decode before a time (in seconds, from the first frame)
+	auto copy_audio = [&](double until) {
+		while (audio_input) {
+			if (!has_audio_pkt) {
+				if (av_read_frame(audio_input, &audio_pkt) < 0)
+					return;
+				has_audio_pkt = true;
+			}
+			AVStream *in_stream = audio_input->streams[audio_pkt.stream_index];
+			int64_t dts = (audio_pkt.dts != AV_NOPTS_VALUE) ? audio_pkt.dts : audio_pkt.pts;
+			if (dts != AV_NOPTS_VALUE && dts * av_q2d(in_stream->time_base) > until)
+				return;
+
+			audio_pkt.stream_index += video_streams;
+			av_packet_rescale_ts(&audio_pkt, in_stream->time_base, output->streams[audio_pkt.stream_index]->time_base);
+			audio_pkt.pos = -1;
+			int error_code = av_interleaved_write_frame(output, &audio_pkt);
+			AV_FREE_PACKET(&audio_pkt);
+			has_audio_pkt = false;
+			if (error_code < 0)
+				throw InvalidFile("Could not write a packet of the audio.", GetAudioPath());
+		}
+	};
+
+	try {
+		// Find the streams of the output (the video of the first segment, and the audio)
+		if (info.has_video) {
+			for (int index = 0; index < segment_count && !input; index++)
+				if (GetSegmentEnd(index) >= GetSegmentStart(index))
+					input = open_rendered_file(GetSegmentPath(index));
+			if (input) {
+				copy_streams(output, input, path);
+				video_streams = output->nb_streams;
+				avformat_close_input(&input);
+			}
+		}
+		if (info.has_audio) {
+			audio_input = open_rendered_file(GetAudioPath());
+			copy_streams(output, audio_input, path);
+		}
+
+		// Open the output file, and write its header
+		if (!(output->oformat->flags & AVFMT_NOFILE) && avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+			throw InvalidFile("Could not open or write file.", path);
+		is_output_open = true;
+		if (avformat_write_header(output, NULL) < 0)
+			throw InvalidFile("Could not write header to file.", path);
+		last_dts.assign(output->nb_streams, AV_NOPTS_VALUE);
+
+		for (int index = 0; index < segment_count && video_streams > 0; index++) {
+			int64_t start = GetSegmentStart(index);
+			if (GetSegmentEnd(index) < start)
+				// Empty segment (more segments than frames)
+				continue;
+
+			// Open the segment
+			std::string segment_path = GetSegmentPath(index);
+			input = open_rendered_file(segment_path);
+			if (input->nb_streams != video_streams)
+				throw InvalidFile("The streams of the segment do not match the first segment.", segment_path);
+
+			// Copy the packets, offset by the segment's start time (relative to the first frame)
+			AVPacket pkt;
+			av_init_packet(&pkt);
+			pkt.data = NULL;
+			pkt.size = 0;
+			while (av_read_frame(input, &pkt) >= 0) {
+				AVStream *in_stream = input->streams[pkt.stream_index];
+				AVStream *out_stream = output->streams[pkt.stream_index];
+				int64_t offset = av_rescale_q(start - range_start, frame_duration, out_stream->time_base);
+				av_packet_rescale_ts(&pkt, in_stream->time_base, out_stream->time_base);
+				if (pkt.pts != AV_NOPTS_VALUE)
+					pkt.pts += offset;
+				if (pkt.dts != AV_NOPTS_VALUE) {
+					pkt.dts += offset;
+					int64_t &stream_dts = last_dts[pkt.stream_index];
+					if (stream_dts != AV_NOPTS_VALUE && pkt.dts <= stream_dts) {
+						// The packet overlaps the end of the previous segment (i.e. the reordering delay of B-frames),
+						// so pull its decode time forward (or drop the packet, if that would decode it after it is
+						// presented)
+						pkt.dts = stream_dts + 1;
+						if (pkt.pts != AV_NOPTS_VALUE && pkt.pts < pkt.dts) {
+							AV_FREE_PACKET(&pkt);
+							continue;
+						}
+					}
+					stream_dts = pkt.dts;
+
+					// Interleave the audio which decodes before this packet
+					copy_audio(pkt.dts * av_q2d(out_stream->time_base));
+				}
+				pkt.pos = -1;
+
+				int error_code = av_interleaved_write_frame(output, &pkt);
+				AV_FREE_PACKET(&pkt);
+				if (error_code < 0)
+					throw InvalidFile("Could not write a packet of the segment.", segment_path);
+			}
+			avformat_close_input(&input);
+		}
+
+		// Copy the rest of the audio
+		copy_audio(std::numeric_limits<double>::infinity());
+		if (audio_input)
+			avformat_close_input(&audio_input);
+
+		av_write_trailer(output);
+	}
+	catch (...) {
+		if (has_audio_pkt)
+			AV_FREE_PACKET(&audio_pkt);
+		if (input)
+			avformat_close_input(&input);
+		if (audio_input)
+			avformat_close_input(&audio_input);
+		if (is_output_open && !(output->oformat->flags & AVFMT_NOFILE))
+			avio_close(output->pb);
+		avformat_free_context(output);
+		throw;
+	}
+
+	// Close the output file
+	if (is_output_open && !(output->oformat->flags & AVFMT_NOFILE))
+		avio_close(output->pb);
+	avformat_free_context(output);
+
+	// Delete the segment files (and the audio file)
+	if (remove_segments) {
+		for (int index = 0; index < segment_count; index++)
+			if (GetSegmentEnd(index) >= GetSegmentStart(index))
+				std::remove(GetSegmentPath(index).c_str());
+		if (info.has_audio)
+			std::remove(GetAudioPath().c_str());
+	}
+}
+
+// Generate JSON string of this object
+std::string ParallelExporter::Json() {
+
+	// Return formatted string
+	return WriteJson(JsonValue());
+}
+
+// Generate Json::JsonValue for this object
+Json::Value ParallelExporter::JsonValue() {
+
+	// Create root json object
+	Json::Value root;
+	root["type"] = "ParallelExporter";
+	root["path"] = path;
+	root["timeline"] = timeline_root;
+	root["start"] = Json::Int64(range_start);
+	root["end"] = Json::Int64(range_end);
+	root["segment_count"] = segment_count;
+
+	// Writer options
+	root["has_video"] = info.has_video;
+	root["vcodec"] = info.vcodec;
+	root["fps"] = Json::Value(Json::objectValue);
+	root["fps"]["num"] = info.fps.num;
+	root["fps"]["den"] = info.fps.den;
+	root["width"] = info.width;
+	root["height"] = info.height;
+	root["pixel_ratio"] = Json::Value(Json::objectValue);
+	root["pixel_ratio"]["num"] = info.pixel_ratio.num;
+	root["pixel_ratio"]["den"] = info.pixel_ratio.den;
+	root["interlaced_frame"] = info.interlaced_frame;
+	root["top_field_first"] = info.top_field_first;
+	root["video_bit_rate"] = info.video_bit_rate;
+	root["has_audio"] = info.has_audio;
+	root["acodec"] = info.acodec;
+	root["sample_rate"] = info.sample_rate;
+	root["channels"] = info.channels;
+	root["channel_layout"] = info.channel_layout;
+	root["audio_bit_rate"] = info.audio_bit_rate;
+
+	// Custom codec options
+	root["options"] = Json::Value(Json::arrayValue);
+	for (size_t index = 0; index < options.size(); index++) {
+		Json::Value option;
+		option["stream"] = options[index].first;
+		option["name"] = options[index].second.first;
+		option["value"] = options[index].second.second;
+		root["options"].append(option);
+	}
+
+	// return JsonValue
+	return root;
+}
+
+// Load JSON string into this object
+void ParallelExporter::SetJson(std::string value) {
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	bool success = ParseJson(value, root);
+
+	if (!success)
+		// Raise exception
+		throw InvalidJSON("JSON could not be parsed (or is invalid)");
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("JSON is invalid (missing keys or invalid data types)");
+	}
+}
+
+// Load Json::JsonValue into this object
+void ParallelExporter::SetJsonValue(Json::Value root) {
+
+	// Set data from Json (if key is found)
+	if (!root["path"].isNull())
+		path = root["path"].asString();
+	if (!root["timeline"].isNull())
+		timeline_root = root["timeline"];
+	if (!root["start"].isNull())
+		range_start = root["start"].asInt64();
+	if (!root["end"].isNull())
+		range_end = root["end"].asInt64();
+	if (!root["segment_count"].isNull())
+		segment_count = root["segment_count"].asInt();
+
+	if (!root["has_video"].isNull())
+		info.has_video = root["has_video"].asBool();
+	if (!root["vcodec"].isNull())
+		info.vcodec = root["vcodec"].asString();
+	if (!root["fps"].isNull() && root["fps"].isObject()) {
+		if (!root["fps"]["num"].isNull())
+			info.fps.num = root["fps"]["num"].asInt();
+		if (!root["fps"]["den"].isNull())
+			info.fps.den = root["fps"]["den"].asInt();
+	}
+	if (!root["width"].isNull())
+		info.width = root["width"].asInt();
+	if (!root["height"].isNull())
+		info.height = root["height"].asInt();
+	if (!root["pixel_ratio"].isNull() && root["pixel_ratio"].isObject()) {
+		if (!root["pixel_ratio"]["num"].isNull())
+			info.pixel_ratio.num = root["pixel_ratio"]["num"].asInt();
+		if (!root["pixel_ratio"]["den"].isNull())
+			info.pixel_ratio.den = root["pixel_ratio"]["den"].asInt();
+	}
+	if (!root["interlaced_frame"].isNull())
+		info.interlaced_frame = root["interlaced_frame"].asBool();
+	if (!root["top_field_first"].isNull())
+		info.top_field_first = root["top_field_first"].asBool();
+	if (!root["video_bit_rate"].isNull())
+		info.video_bit_rate = root["video_bit_rate"].asInt();
+	if (!root["has_audio"].isNull())
+		info.has_audio = root["has_audio"].asBool();
+	if (!root["acodec"].isNull())
+		info.acodec = root["acodec"].asString();
+	if (!root["sample_rate"].isNull())
+		info.sample_rate = root["sample_rate"].asInt();
+	if (!root["channels"].isNull())
+		info.channels = root["channels"].asInt();
+	if (!root["channel_layout"].isNull())
+		info.channel_layout = (ChannelLayout) root["channel_layout"].asInt();
+	if (!root["audio_bit_rate"].isNull())
+		info.audio_bit_rate = root["audio_bit_rate"].asInt();
+
+	if (!root["options"].isNull()) {
+		options.clear();
+		for (Json::Value::ArrayIndex index = 0; index < root["options"].size(); index++) {
+			Json::Value option = root["options"][index];
+			options.push_back(std::make_pair((StreamType) option["stream"].asInt(),
+											 std::make_pair(option["name"].asString(), option["value"].asString())));
+		}
+	}
+}
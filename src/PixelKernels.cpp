@@ -0,0 +1,1183 @@
+/**
+ * @file
+ * @brief Source file for PixelKernels class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/PixelKernels.h"
+#include "../include/Settings.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	// x86 kernels are compiled for their own instruction set (so the library itself still runs on any x86 CPU)
+	#define OPENSHOT_X86_KERNELS
+	#define OPENSHOT_AVX2 __attribute__((target("avx2")))
+	#define OPENSHOT_SSE41 __attribute__((target("sse4.1")))
+	#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+	// NEON is always available on 64-bit ARM
+	#define OPENSHOT_NEON_KERNELS
+	#include <arm_neon.h>
+#endif
+
+using namespace openshot;
+
+// Instruction sets of the kernels
+enum KernelLevel {
+	KERNEL_SCALAR,
+	KERNEL_SSE41,
+	KERNEL_AVX2,
+	KERNEL_NEON
+};
+
+// Detect the best instruction set supported by this CPU
+static KernelLevel detect_kernel_level() {
+#if defined(OPENSHOT_X86_KERNELS)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return KERNEL_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return KERNEL_SSE41;
+#elif defined(OPENSHOT_NEON_KERNELS)
+	return KERNEL_NEON;
+#endif
+	return KERNEL_SCALAR;
+}
+
+// Get the instruction set to run the kernels with (the CPU is only checked once)
+static KernelLevel kernel_level() {
+	static const KernelLevel detected_level = detect_kernel_level();
+	if (!Settings::Instance()->SIMD_EFFECTS)
+		return KERNEL_SCALAR;
+	return detected_level;
+}
+
+// Constrain a color value from 0 to 255
+static inline int clamp_color(int value) {
+	if (value < 0)
+		return 0;
+	else if (value > 255)
+		return 255;
+	return value;
+}
+
+// Scalar kernels (also used for the pixels left over by the vectorized kernels)
+static void brightness_scalar(unsigned char *pixels, int64_t pixel_count, float factor, float offset) {
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4) {
+		for (int channel = 0; channel < 3; channel++) {
+			// Adjust the contrast, and then the brightness
+			int value = clamp_color((int) ((factor * (pixels[byte_index + channel] - 128)) + 128));
+			pixels[byte_index + channel] = clamp_color((int) (value + offset));
+		}
+	}
+}
+
+static void saturation_scalar(unsigned char *pixels, int64_t pixel_count, float saturation) {
+	// Constants used for color saturation formula
+	const double pR = .299;
+	const double pG = .587;
+	const double pB = .114;
+
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4) {
+		int R = pixels[byte_index];
+		int G = pixels[byte_index + 1];
+		int B = pixels[byte_index + 2];
+
+		// Calculate the saturation multiplier
+		double p = sqrt((R * R * pR) + (G * G * pG) + (B * B * pB));
+
+		// Adjust the saturation
+		pixels[byte_index] = clamp_color((int) (p + (R - p) * saturation));
+		pixels[byte_index + 1] = clamp_color((int) (p + (G - p) * saturation));
+		pixels[byte_index + 2] = clamp_color((int) (p + (B - p) * saturation));
+	}
+}
+
+static void hue_scalar(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3]) {
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4) {
+		int R = pixels[byte_index];
+		int G = pixels[byte_index + 1];
+		int B = pixels[byte_index + 2];
+
+		// Multiply each color by the hue rotation matrix
+		for (int channel = 0; channel < 3; channel++)
+			pixels[byte_index + channel] = clamp_color((int) (R * matrix[channel][0] + G * matrix[channel][1] + B * matrix[channel][2]));
+	}
+}
+
+static void chroma_key_scalar(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int limit) {
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4) {
+		int R = pixels[byte_index];
+		int G = pixels[byte_index + 1];
+		int B = pixels[byte_index + 2];
+
+		// Squared distance between mask color and pixel color (see Color::GetDistance)
+		int rmean = (R + red) / 2;
+		int r = R - red;
+		int g = G - green;
+		int b = B - blue;
+		int distance = (((512 + rmean) * r * r) >> 8) + 4 * g * g + (((767 - rmean) * b * b) >> 8);
+
+		// Alpha out the pixel (if color similar)
+		if (distance < limit)
+			pixels[byte_index + 3] = 0;
+	}
+}
+
+// Divide a product of 2 color values by 255 (rounded)
+static inline int div255(int value) {
+	value += 128;
+	return (value + (value >> 8)) >> 8;
+}
+
+static void lerp_rows_scalar(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied) {
+	for (int64_t byte_index = 0; byte_index < pixel_count * 4; byte_index += 4) {
+		int alpha0 = premultiplied ? 255 : row0[byte_index + 3];
+		int alpha1 = premultiplied ? 255 : row1[byte_index + 3];
+		for (int channel = 0; channel < 4; channel++) {
+			int value0 = row0[byte_index + channel];
+			int value1 = row1[byte_index + channel];
+
+			// Premultiply the colors (the alpha is multiplied by 255, which keeps it)
+			if (channel < 3) {
+				value0 = div255(value0 * alpha0);
+				value1 = div255(value1 * alpha1);
+			}
+			target[byte_index + channel] = (value0 * (256 - weight) + value1 * weight + 128) >> 8;
+		}
+	}
+}
+
+static void resample_row_scalar(unsigned char *target, const unsigned char *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count) {
+	for (int64_t pixel = 0, byte_index = 0; pixel < pixel_count; pixel++, byte_index += 4) {
+		const unsigned char *left = row + indexes[pixel] * 4;
+		int weight = weights[pixel];
+		for (int channel = 0; channel < 4; channel++)
+			target[byte_index + channel] = (left[channel] * (256 - weight) + left[channel + 4] * weight + 128) >> 8;
+	}
+}
+
+static void blend_over_scalar(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity) {
+	for (int64_t byte_index = 0; byte_index < pixel_count * 4; byte_index += 4) {
+		int alpha = (source[byte_index + 3] * opacity + 128) >> 8;
+		for (int channel = 0; channel < 4; channel++) {
+			int value = (source[byte_index + channel] * opacity + 128) >> 8;
+			target[byte_index + channel] = std::min(255, value + div255(target[byte_index + channel] * (255 - alpha)));
+		}
+	}
+}
+
+// Scalar compositor kernels of any pixel format (the same calculations as the byte kernels above, in the range of
+// the format, with the alpha in its position)
+template<class Format>
+static void lerp_rows_format(typename Format::Channel *target, const typename Format::Channel *row0, const typename Format::Channel *row1, int64_t pixel_count, int weight) {
+	for (int64_t index = 0; index < pixel_count * 4; index += 4) {
+		uint32_t alpha0 = Format::premultiplied ? (uint32_t) Format::max : row0[index + Format::alpha];
+		uint32_t alpha1 = Format::premultiplied ? (uint32_t) Format::max : row1[index + Format::alpha];
+		for (int channel = 0; channel < 4; channel++) {
+			uint32_t value0 = row0[index + channel];
+			uint32_t value1 = row1[index + channel];
+			if (channel != Format::alpha) {
+				value0 = Format::DivMax(value0 * alpha0);
+				value1 = Format::DivMax(value1 * alpha1);
+			}
+			target[index + channel] = (value0 * (256 - weight) + value1 * weight + 128) >> 8;
+		}
+	}
+}
+
+template<class Format>
+static void resample_row_format(typename Format::Channel *target, const typename Format::Channel *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count) {
+	for (int64_t pixel = 0, index = 0; pixel < pixel_count; pixel++, index += 4) {
+		const typename Format::Channel *left = row + indexes[pixel] * 4;
+		uint32_t weight = weights[pixel];
+		for (int channel = 0; channel < 4; channel++)
+			target[index + channel] = (left[channel] * (256 - weight) + left[channel + 4] * weight + 128) >> 8;
+	}
+}
+
+template<class Format>
+static void blend_over_format(typename Format::Channel *target, const typename Format::Channel *source, int64_t pixel_count, int opacity) {
+	for (int64_t index = 0; index < pixel_count * 4; index += 4) {
+		uint32_t alpha = ((uint32_t) source[index + Format::alpha] * opacity + 128) >> 8;
+		for (int channel = 0; channel < 4; channel++) {
+			uint32_t value = ((uint32_t) source[index + channel] * opacity + 128) >> 8;
+			target[index + channel] = std::min((uint32_t) Format::max, value + Format::DivMax(target[index + channel] * (Format::max - alpha)));
+		}
+	}
+}
+
+// Fixed-point studio range YCbCr coefficients (times 256) of the red, green, and blue channels: Y, then Cb, then Cr
+static const int uyvy_coefficients_601[9] = {66, 129, 25, -38, -74, 112, 112, -94, -18};
+static const int uyvy_coefficients_709[9] = {47, 157, 16, -26, -86, 112, 112, -102, -10};
+
+// The chroma of each pair of pixels is calculated from their sums (so it is shifted by 1 more bit)
+static void rgba_to_uyvy_scalar(unsigned char *target, const unsigned char *source, int64_t pixel_count, bool bgra, const int *c) {
+	const int red = bgra ? 2 : 0;
+	const int blue = bgra ? 0 : 2;
+	for (int64_t pixel = 0; pixel < pixel_count; pixel += 2) {
+		const unsigned char *pixel0 = source + pixel * 4;
+		const unsigned char *pixel1 = (pixel + 1 < pixel_count) ? pixel0 + 4 : pixel0;
+		int R = pixel0[red] + pixel1[red];
+		int G = pixel0[1] + pixel1[1];
+		int B = pixel0[blue] + pixel1[blue];
+		target[0] = 128 + ((c[3] * R + c[4] * G + c[5] * B + 256) >> 9);
+		target[1] = 16 + ((c[0] * pixel0[red] + c[1] * pixel0[1] + c[2] * pixel0[blue] + 128) >> 8);
+		target[2] = 128 + ((c[6] * R + c[7] * G + c[8] * B + 256) >> 9);
+		target[3] = 16 + ((c[0] * pixel1[red] + c[1] * pixel1[1] + c[2] * pixel1[blue] + 128) >> 8);
+		target += 4;
+	}
+}
+
+#if defined(OPENSHOT_X86_KERNELS)
+
+// AVX2 kernels (8 pixels at a time)
+// Clamp 32-bit integers from 0 to 255
+OPENSHOT_AVX2 static inline __m256i clamp_color_avx2(__m256i value) {
+	return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+// Truncate floats to 32-bit integers (like the scalar casts), and clamp them from 0 to 255
+OPENSHOT_AVX2 static inline __m256i truncate_color_avx2(__m256 value) {
+	return clamp_color_avx2(_mm256_cvttps_epi32(value));
+}
+
+// Combine the new color channels with the alpha channel of the original pixels
+OPENSHOT_AVX2 static inline __m256i pack_color_avx2(__m256i px, __m256i R, __m256i G, __m256i B) {
+	__m256i result = _mm256_and_si256(px, _mm256_set1_epi32((int) 0xFF000000));
+	result = _mm256_or_si256(result, R);
+	result = _mm256_or_si256(result, _mm256_slli_epi32(G, 8));
+	return _mm256_or_si256(result, _mm256_slli_epi32(B, 16));
+}
+
+OPENSHOT_AVX2 static inline __m256i brightness_channel_avx2(__m256i channel, __m256 factor, __m256 offset) {
+	__m256 value = _mm256_cvtepi32_ps(_mm256_sub_epi32(channel, _mm256_set1_epi32(128)));
+	__m256i contrasted = truncate_color_avx2(_mm256_add_ps(_mm256_mul_ps(factor, value), _mm256_set1_ps(128.0f)));
+	return truncate_color_avx2(_mm256_add_ps(_mm256_cvtepi32_ps(contrasted), offset));
+}
+
+OPENSHOT_AVX2 static int64_t brightness_avx2(unsigned char *pixels, int64_t pixel_count, float factor, float offset) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256 factor_v = _mm256_set1_ps(factor);
+	const __m256 offset_v = _mm256_set1_ps(offset);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i *data = (__m256i *) (pixels + pixel * 4);
+		__m256i px = _mm256_loadu_si256(data);
+		__m256i R = brightness_channel_avx2(_mm256_and_si256(px, mask), factor_v, offset_v);
+		__m256i G = brightness_channel_avx2(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask), factor_v, offset_v);
+		__m256i B = brightness_channel_avx2(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask), factor_v, offset_v);
+		_mm256_storeu_si256(data, pack_color_avx2(px, R, G, B));
+	}
+	return pixel;
+}
+
+OPENSHOT_AVX2 static int64_t saturation_avx2(unsigned char *pixels, int64_t pixel_count, float saturation) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256 pR = _mm256_set1_ps(0.299f);
+	const __m256 pG = _mm256_set1_ps(0.587f);
+	const __m256 pB = _mm256_set1_ps(0.114f);
+	const __m256 saturation_v = _mm256_set1_ps(saturation);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i *data = (__m256i *) (pixels + pixel * 4);
+		__m256i px = _mm256_loadu_si256(data);
+		__m256 R = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+		__m256 G = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+		__m256 B = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+
+		// Calculate the saturation multiplier
+		__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(R, R), pR), _mm256_mul_ps(_mm256_mul_ps(G, G), pG));
+		p = _mm256_sqrt_ps(_mm256_add_ps(p, _mm256_mul_ps(_mm256_mul_ps(B, B), pB)));
+
+		__m256i newR = truncate_color_avx2(_mm256_add_ps(p, _mm256_mul_ps(_mm256_sub_ps(R, p), saturation_v)));
+		__m256i newG = truncate_color_avx2(_mm256_add_ps(p, _mm256_mul_ps(_mm256_sub_ps(G, p), saturation_v)));
+		__m256i newB = truncate_color_avx2(_mm256_add_ps(p, _mm256_mul_ps(_mm256_sub_ps(B, p), saturation_v)));
+		_mm256_storeu_si256(data, pack_color_avx2(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+OPENSHOT_AVX2 static inline __m256i hue_channel_avx2(__m256 R, __m256 G, __m256 B, const float row[3]) {
+	__m256 value = _mm256_add_ps(_mm256_mul_ps(R, _mm256_set1_ps(row[0])), _mm256_mul_ps(G, _mm256_set1_ps(row[1])));
+	return truncate_color_avx2(_mm256_add_ps(value, _mm256_mul_ps(B, _mm256_set1_ps(row[2]))));
+}
+
+OPENSHOT_AVX2 static int64_t hue_avx2(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3]) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i *data = (__m256i *) (pixels + pixel * 4);
+		__m256i px = _mm256_loadu_si256(data);
+		__m256 R = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+		__m256 G = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+		__m256 B = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+		__m256i newR = hue_channel_avx2(R, G, B, matrix[0]);
+		__m256i newG = hue_channel_avx2(R, G, B, matrix[1]);
+		__m256i newB = hue_channel_avx2(R, G, B, matrix[2]);
+		_mm256_storeu_si256(data, pack_color_avx2(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+OPENSHOT_AVX2 static int64_t chroma_key_avx2(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int limit) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256i alpha = _mm256_set1_epi32((int) 0xFF000000);
+	const __m256i red_v = _mm256_set1_epi32(red);
+	const __m256i green_v = _mm256_set1_epi32(green);
+	const __m256i blue_v = _mm256_set1_epi32(blue);
+	const __m256i limit_v = _mm256_set1_epi32(limit);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i *data = (__m256i *) (pixels + pixel * 4);
+		__m256i px = _mm256_loadu_si256(data);
+		__m256i R = _mm256_and_si256(px, mask);
+		__m256i G = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+		__m256i B = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+
+		// Squared distance between mask color and pixel color (see Color::GetDistance)
+		__m256i rmean = _mm256_srli_epi32(_mm256_add_epi32(R, red_v), 1);
+		__m256i r = _mm256_sub_epi32(R, red_v);
+		__m256i g = _mm256_sub_epi32(G, green_v);
+		__m256i b = _mm256_sub_epi32(B, blue_v);
+		__m256i distance = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_add_epi32(rmean, _mm256_set1_epi32(512)), _mm256_mullo_epi32(r, r)), 8);
+		distance = _mm256_add_epi32(distance, _mm256_slli_epi32(_mm256_mullo_epi32(g, g), 2));
+		distance = _mm256_add_epi32(distance, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_set1_epi32(767), rmean), _mm256_mullo_epi32(b, b)), 8));
+
+		// Alpha out the matched pixels
+		__m256i matched = _mm256_cmpgt_epi32(limit_v, distance);
+		_mm256_storeu_si256(data, _mm256_andnot_si256(_mm256_and_si256(matched, alpha), px));
+	}
+	return pixel;
+}
+
+// Divide 16-bit products of 2 color values by 255 (rounded)
+OPENSHOT_AVX2 static inline __m256i div255_avx2(__m256i value) {
+	value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+// Copy the alpha of each pixel (of 16-bit channels) to its color channels (and 255 to its alpha channel)
+OPENSHOT_AVX2 static inline __m256i alpha_multiplier_avx2(__m256i channels) {
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_blend_epi16(alpha, _mm256_set1_epi16(255), 0x88);
+}
+
+// Interpolate 16-bit channels (the weights add up to 256)
+OPENSHOT_AVX2 static inline __m256i lerp_channels_avx2(__m256i value0, __m256i value1, __m256i weight0, __m256i weight1) {
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(value0, weight0), _mm256_mullo_epi16(value1, weight1));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+}
+
+OPENSHOT_AVX2 static int64_t lerp_rows_avx2(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i weight0 = _mm256_set1_epi16(256 - weight);
+	const __m256i weight1 = _mm256_set1_epi16(weight);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i px0 = _mm256_loadu_si256((const __m256i *) (row0 + pixel * 4));
+		__m256i px1 = _mm256_loadu_si256((const __m256i *) (row1 + pixel * 4));
+		__m256i low0 = _mm256_unpacklo_epi8(px0, zero);
+		__m256i high0 = _mm256_unpackhi_epi8(px0, zero);
+		__m256i low1 = _mm256_unpacklo_epi8(px1, zero);
+		__m256i high1 = _mm256_unpackhi_epi8(px1, zero);
+		if (!premultiplied) {
+			low0 = div255_avx2(_mm256_mullo_epi16(low0, alpha_multiplier_avx2(low0)));
+			high0 = div255_avx2(_mm256_mullo_epi16(high0, alpha_multiplier_avx2(high0)));
+			low1 = div255_avx2(_mm256_mullo_epi16(low1, alpha_multiplier_avx2(low1)));
+			high1 = div255_avx2(_mm256_mullo_epi16(high1, alpha_multiplier_avx2(high1)));
+		}
+		__m256i low = lerp_channels_avx2(low0, low1, weight0, weight1);
+		__m256i high = lerp_channels_avx2(high0, high1, weight0, weight1);
+		_mm256_storeu_si256((__m256i *) (target + pixel * 4), _mm256_packus_epi16(low, high));
+	}
+	return pixel;
+}
+
+// Composite 16-bit premultiplied channels over opaque channels
+OPENSHOT_AVX2 static inline __m256i blend_channels_avx2(__m256i source, __m256i target, __m256i opacity) {
+	source = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(source, opacity), _mm256_set1_epi16(128)), 8);
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+	return _mm256_add_epi16(source, div255_avx2(_mm256_mullo_epi16(target, inverse)));
+}
+
+OPENSHOT_AVX2 static int64_t blend_over_avx2(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opacity_v = _mm256_set1_epi16(opacity);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m256i *data = (__m256i *) (target + pixel * 4);
+		__m256i src = _mm256_loadu_si256((const __m256i *) (source + pixel * 4));
+		__m256i dst = _mm256_loadu_si256(data);
+		__m256i low = blend_channels_avx2(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(dst, zero), opacity_v);
+		__m256i high = blend_channels_avx2(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(dst, zero), opacity_v);
+		_mm256_storeu_si256(data, _mm256_packus_epi16(low, high));
+	}
+	return pixel;
+}
+
+// SSE4.1 kernels (4 pixels at a time)
+// Clamp 32-bit integers from 0 to 255
+OPENSHOT_SSE41 static inline __m128i clamp_color_sse41(__m128i value) {
+	return _mm_min_epi32(_mm_max_epi32(value, _mm_setzero_si128()), _mm_set1_epi32(255));
+}
+
+// Truncate floats to 32-bit integers (like the scalar casts), and clamp them from 0 to 255
+OPENSHOT_SSE41 static inline __m128i truncate_color_sse41(__m128 value) {
+	return clamp_color_sse41(_mm_cvttps_epi32(value));
+}
+
+// Combine the new color channels with the alpha channel of the original pixels
+OPENSHOT_SSE41 static inline __m128i pack_color_sse41(__m128i px, __m128i R, __m128i G, __m128i B) {
+	__m128i result = _mm_and_si128(px, _mm_set1_epi32((int) 0xFF000000));
+	result = _mm_or_si128(result, R);
+	result = _mm_or_si128(result, _mm_slli_epi32(G, 8));
+	return _mm_or_si128(result, _mm_slli_epi32(B, 16));
+}
+
+OPENSHOT_SSE41 static inline __m128i brightness_channel_sse41(__m128i channel, __m128 factor, __m128 offset) {
+	__m128 value = _mm_cvtepi32_ps(_mm_sub_epi32(channel, _mm_set1_epi32(128)));
+	__m128i contrasted = truncate_color_sse41(_mm_add_ps(_mm_mul_ps(factor, value), _mm_set1_ps(128.0f)));
+	return truncate_color_sse41(_mm_add_ps(_mm_cvtepi32_ps(contrasted), offset));
+}
+
+OPENSHOT_SSE41 static int64_t brightness_sse41(unsigned char *pixels, int64_t pixel_count, float factor, float offset) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128 factor_v = _mm_set1_ps(factor);
+	const __m128 offset_v = _mm_set1_ps(offset);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i *data = (__m128i *) (pixels + pixel * 4);
+		__m128i px = _mm_loadu_si128(data);
+		__m128i R = brightness_channel_sse41(_mm_and_si128(px, mask), factor_v, offset_v);
+		__m128i G = brightness_channel_sse41(_mm_and_si128(_mm_srli_epi32(px, 8), mask), factor_v, offset_v);
+		__m128i B = brightness_channel_sse41(_mm_and_si128(_mm_srli_epi32(px, 16), mask), factor_v, offset_v);
+		_mm_storeu_si128(data, pack_color_sse41(px, R, G, B));
+	}
+	return pixel;
+}
+
+OPENSHOT_SSE41 static int64_t saturation_sse41(unsigned char *pixels, int64_t pixel_count, float saturation) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128 pR = _mm_set1_ps(0.299f);
+	const __m128 pG = _mm_set1_ps(0.587f);
+	const __m128 pB = _mm_set1_ps(0.114f);
+	const __m128 saturation_v = _mm_set1_ps(saturation);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i *data = (__m128i *) (pixels + pixel * 4);
+		__m128i px = _mm_loadu_si128(data);
+		__m128 R = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+		__m128 G = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		__m128 B = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+
+		// Calculate the saturation multiplier
+		__m128 p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(R, R), pR), _mm_mul_ps(_mm_mul_ps(G, G), pG));
+		p = _mm_sqrt_ps(_mm_add_ps(p, _mm_mul_ps(_mm_mul_ps(B, B), pB)));
+
+		__m128i newR = truncate_color_sse41(_mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(R, p), saturation_v)));
+		__m128i newG = truncate_color_sse41(_mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(G, p), saturation_v)));
+		__m128i newB = truncate_color_sse41(_mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(B, p), saturation_v)));
+		_mm_storeu_si128(data, pack_color_sse41(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+OPENSHOT_SSE41 static inline __m128i hue_channel_sse41(__m128 R, __m128 G, __m128 B, const float row[3]) {
+	__m128 value = _mm_add_ps(_mm_mul_ps(R, _mm_set1_ps(row[0])), _mm_mul_ps(G, _mm_set1_ps(row[1])));
+	return truncate_color_sse41(_mm_add_ps(value, _mm_mul_ps(B, _mm_set1_ps(row[2]))));
+}
+
+OPENSHOT_SSE41 static int64_t hue_sse41(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3]) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i *data = (__m128i *) (pixels + pixel * 4);
+		__m128i px = _mm_loadu_si128(data);
+		__m128 R = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+		__m128 G = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		__m128 B = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+		__m128i newR = hue_channel_sse41(R, G, B, matrix[0]);
+		__m128i newG = hue_channel_sse41(R, G, B, matrix[1]);
+		__m128i newB = hue_channel_sse41(R, G, B, matrix[2]);
+		_mm_storeu_si128(data, pack_color_sse41(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+OPENSHOT_SSE41 static int64_t chroma_key_sse41(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int limit) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+	const __m128i red_v = _mm_set1_epi32(red);
+	const __m128i green_v = _mm_set1_epi32(green);
+	const __m128i blue_v = _mm_set1_epi32(blue);
+	const __m128i limit_v = _mm_set1_epi32(limit);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i *data = (__m128i *) (pixels + pixel * 4);
+		__m128i px = _mm_loadu_si128(data);
+		__m128i R = _mm_and_si128(px, mask);
+		__m128i G = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+		__m128i B = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+
+		// Squared distance between mask color and pixel color (see Color::GetDistance)
+		__m128i rmean = _mm_srli_epi32(_mm_add_epi32(R, red_v), 1);
+		__m128i r = _mm_sub_epi32(R, red_v);
+		__m128i g = _mm_sub_epi32(G, green_v);
+		__m128i b = _mm_sub_epi32(B, blue_v);
+		__m128i distance = _mm_srai_epi32(_mm_mullo_epi32(_mm_add_epi32(rmean, _mm_set1_epi32(512)), _mm_mullo_epi32(r, r)), 8);
+		distance = _mm_add_epi32(distance, _mm_slli_epi32(_mm_mullo_epi32(g, g), 2));
+		distance = _mm_add_epi32(distance, _mm_srai_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_set1_epi32(767), rmean), _mm_mullo_epi32(b, b)), 8));
+
+		// Alpha out the matched pixels
+		__m128i matched = _mm_cmpgt_epi32(limit_v, distance);
+		_mm_storeu_si128(data, _mm_andnot_si128(_mm_and_si128(matched, alpha), px));
+	}
+	return pixel;
+}
+
+// Divide 16-bit products of 2 color values by 255 (rounded)
+OPENSHOT_SSE41 static inline __m128i div255_sse41(__m128i value) {
+	value = _mm_add_epi16(value, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+// Copy the alpha of each pixel (of 16-bit channels) to its color channels (and 255 to its alpha channel)
+OPENSHOT_SSE41 static inline __m128i alpha_multiplier_sse41(__m128i channels) {
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_blend_epi16(alpha, _mm_set1_epi16(255), 0x88);
+}
+
+// Interpolate 16-bit channels (the weights add up to 256)
+OPENSHOT_SSE41 static inline __m128i lerp_channels_sse41(__m128i value0, __m128i value1, __m128i weight0, __m128i weight1) {
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(value0, weight0), _mm_mullo_epi16(value1, weight1));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+}
+
+OPENSHOT_SSE41 static int64_t lerp_rows_sse41(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight0 = _mm_set1_epi16(256 - weight);
+	const __m128i weight1 = _mm_set1_epi16(weight);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i px0 = _mm_loadu_si128((const __m128i *) (row0 + pixel * 4));
+		__m128i px1 = _mm_loadu_si128((const __m128i *) (row1 + pixel * 4));
+		__m128i low0 = _mm_unpacklo_epi8(px0, zero);
+		__m128i high0 = _mm_unpackhi_epi8(px0, zero);
+		__m128i low1 = _mm_unpacklo_epi8(px1, zero);
+		__m128i high1 = _mm_unpackhi_epi8(px1, zero);
+		if (!premultiplied) {
+			low0 = div255_sse41(_mm_mullo_epi16(low0, alpha_multiplier_sse41(low0)));
+			high0 = div255_sse41(_mm_mullo_epi16(high0, alpha_multiplier_sse41(high0)));
+			low1 = div255_sse41(_mm_mullo_epi16(low1, alpha_multiplier_sse41(low1)));
+			high1 = div255_sse41(_mm_mullo_epi16(high1, alpha_multiplier_sse41(high1)));
+		}
+		__m128i low = lerp_channels_sse41(low0, low1, weight0, weight1);
+		__m128i high = lerp_channels_sse41(high0, high1, weight0, weight1);
+		_mm_storeu_si128((__m128i *) (target + pixel * 4), _mm_packus_epi16(low, high));
+	}
+	return pixel;
+}
+
+// Composite 16-bit premultiplied channels over opaque channels
+OPENSHOT_SSE41 static inline __m128i blend_channels_sse41(__m128i source, __m128i target, __m128i opacity) {
+	source = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(source, opacity), _mm_set1_epi16(128)), 8);
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+	return _mm_add_epi16(source, div255_sse41(_mm_mullo_epi16(target, inverse)));
+}
+
+OPENSHOT_SSE41 static int64_t blend_over_sse41(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opacity_v = _mm_set1_epi16(opacity);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		__m128i *data = (__m128i *) (target + pixel * 4);
+		__m128i src = _mm_loadu_si128((const __m128i *) (source + pixel * 4));
+		__m128i dst = _mm_loadu_si128(data);
+		__m128i low = blend_channels_sse41(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero), opacity_v);
+		__m128i high = blend_channels_sse41(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero), opacity_v);
+		_mm_storeu_si128(data, _mm_packus_epi16(low, high));
+	}
+	return pixel;
+}
+
+// Multiply the red, green, and blue channels by 3 coefficients (and add them)
+OPENSHOT_SSE41 static inline __m128i weigh_channels_sse41(__m128i R, __m128i G, __m128i B, const int *coefficients) {
+	__m128i value = _mm_add_epi32(_mm_mullo_epi32(R, _mm_set1_epi32(coefficients[0])), _mm_mullo_epi32(G, _mm_set1_epi32(coefficients[1])));
+	return _mm_add_epi32(value, _mm_mullo_epi32(B, _mm_set1_epi32(coefficients[2])));
+}
+
+// 8 pixels at a time (the chroma of each pair is calculated from their horizontal sums)
+OPENSHOT_SSE41 static int64_t rgba_to_uyvy_sse41(unsigned char *target, const unsigned char *source, int64_t pixel_count, bool bgra, const int *c) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i red_shift = _mm_cvtsi32_si128(bgra ? 16 : 0);
+	const __m128i blue_shift = _mm_cvtsi32_si128(bgra ? 0 : 16);
+
+	int64_t pixel = 0;
+	for (; pixel + 8 <= pixel_count; pixel += 8) {
+		__m128i px0 = _mm_loadu_si128((const __m128i *) (source + pixel * 4));
+		__m128i px1 = _mm_loadu_si128((const __m128i *) (source + pixel * 4 + 16));
+		__m128i R0 = _mm_and_si128(_mm_srl_epi32(px0, red_shift), mask);
+		__m128i G0 = _mm_and_si128(_mm_srli_epi32(px0, 8), mask);
+		__m128i B0 = _mm_and_si128(_mm_srl_epi32(px0, blue_shift), mask);
+		__m128i R1 = _mm_and_si128(_mm_srl_epi32(px1, red_shift), mask);
+		__m128i G1 = _mm_and_si128(_mm_srli_epi32(px1, 8), mask);
+		__m128i B1 = _mm_and_si128(_mm_srl_epi32(px1, blue_shift), mask);
+
+		__m128i Y0 = _mm_srai_epi32(_mm_add_epi32(weigh_channels_sse41(R0, G0, B0, c), _mm_set1_epi32(128)), 8);
+		__m128i Y1 = _mm_srai_epi32(_mm_add_epi32(weigh_channels_sse41(R1, G1, B1, c), _mm_set1_epi32(128)), 8);
+		__m128i Y = _mm_add_epi16(_mm_packs_epi32(Y0, Y1), _mm_set1_epi16(16));
+
+		__m128i R = _mm_hadd_epi32(R0, R1);
+		__m128i G = _mm_hadd_epi32(G0, G1);
+		__m128i B = _mm_hadd_epi32(B0, B1);
+		__m128i U = _mm_srai_epi32(_mm_add_epi32(weigh_channels_sse41(R, G, B, c + 3), _mm_set1_epi32(256)), 9);
+		__m128i V = _mm_srai_epi32(_mm_add_epi32(weigh_channels_sse41(R, G, B, c + 6), _mm_set1_epi32(256)), 9);
+		U = _mm_add_epi32(U, _mm_set1_epi32(128));
+		V = _mm_add_epi32(V, _mm_set1_epi32(128));
+
+		// Each pair is U, Y0, V, Y1 (the 16-bit lumas of the pair are the low and high half of a 32-bit lane)
+		__m128i result = _mm_or_si128(U, _mm_slli_epi32(_mm_and_si128(Y, _mm_set1_epi32(0xFFFF)), 8));
+		result = _mm_or_si128(result, _mm_slli_epi32(V, 16));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_srli_epi32(Y, 16), 24));
+		_mm_storeu_si128((__m128i *) (target + pixel * 2), result);
+	}
+	return pixel;
+}
+
+#elif defined(OPENSHOT_NEON_KERNELS)
+
+// NEON kernels (4 pixels at a time)
+// Truncate floats to 32-bit integers (like the scalar casts), and clamp them from 0 to 255
+static inline int32x4_t truncate_color_neon(float32x4_t value) {
+	return vminq_s32(vmaxq_s32(vcvtq_s32_f32(value), vdupq_n_s32(0)), vdupq_n_s32(255));
+}
+
+// Get the red channel, or another color channel (shifted by 8 for green, 16 for blue) of the pixels
+#define NEON_RED(px) vreinterpretq_s32_u32(vandq_u32(px, vdupq_n_u32(0xFF)))
+#define NEON_CHANNEL(px, shift) vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(px, shift), vdupq_n_u32(0xFF)))
+
+// Combine the new color channels with the alpha channel of the original pixels
+static inline uint32x4_t pack_color_neon(uint32x4_t px, int32x4_t R, int32x4_t G, int32x4_t B) {
+	uint32x4_t result = vandq_u32(px, vdupq_n_u32(0xFF000000));
+	result = vorrq_u32(result, vreinterpretq_u32_s32(R));
+	result = vorrq_u32(result, vshlq_n_u32(vreinterpretq_u32_s32(G), 8));
+	return vorrq_u32(result, vshlq_n_u32(vreinterpretq_u32_s32(B), 16));
+}
+
+static inline int32x4_t brightness_channel_neon(int32x4_t channel, float32x4_t factor, float32x4_t offset) {
+	float32x4_t value = vcvtq_f32_s32(vsubq_s32(channel, vdupq_n_s32(128)));
+	int32x4_t contrasted = truncate_color_neon(vaddq_f32(vmulq_f32(factor, value), vdupq_n_f32(128.0f)));
+	return truncate_color_neon(vaddq_f32(vcvtq_f32_s32(contrasted), offset));
+}
+
+static int64_t brightness_neon(unsigned char *pixels, int64_t pixel_count, float factor, float offset) {
+	const float32x4_t factor_v = vdupq_n_f32(factor);
+	const float32x4_t offset_v = vdupq_n_f32(offset);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint32_t *data = (uint32_t *) (pixels + pixel * 4);
+		uint32x4_t px = vld1q_u32(data);
+		int32x4_t R = brightness_channel_neon(NEON_RED(px), factor_v, offset_v);
+		int32x4_t G = brightness_channel_neon(NEON_CHANNEL(px, 8), factor_v, offset_v);
+		int32x4_t B = brightness_channel_neon(NEON_CHANNEL(px, 16), factor_v, offset_v);
+		vst1q_u32(data, pack_color_neon(px, R, G, B));
+	}
+	return pixel;
+}
+
+static int64_t saturation_neon(unsigned char *pixels, int64_t pixel_count, float saturation) {
+	const float32x4_t pR = vdupq_n_f32(0.299f);
+	const float32x4_t pG = vdupq_n_f32(0.587f);
+	const float32x4_t pB = vdupq_n_f32(0.114f);
+	const float32x4_t saturation_v = vdupq_n_f32(saturation);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint32_t *data = (uint32_t *) (pixels + pixel * 4);
+		uint32x4_t px = vld1q_u32(data);
+		float32x4_t R = vcvtq_f32_s32(NEON_RED(px));
+		float32x4_t G = vcvtq_f32_s32(NEON_CHANNEL(px, 8));
+		float32x4_t B = vcvtq_f32_s32(NEON_CHANNEL(px, 16));
+
+		// Calculate the saturation multiplier
+		float32x4_t p = vaddq_f32(vmulq_f32(vmulq_f32(R, R), pR), vmulq_f32(vmulq_f32(G, G), pG));
+		p = vsqrtq_f32(vaddq_f32(p, vmulq_f32(vmulq_f32(B, B), pB)));
+
+		int32x4_t newR = truncate_color_neon(vaddq_f32(p, vmulq_f32(vsubq_f32(R, p), saturation_v)));
+		int32x4_t newG = truncate_color_neon(vaddq_f32(p, vmulq_f32(vsubq_f32(G, p), saturation_v)));
+		int32x4_t newB = truncate_color_neon(vaddq_f32(p, vmulq_f32(vsubq_f32(B, p), saturation_v)));
+		vst1q_u32(data, pack_color_neon(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+static inline int32x4_t hue_channel_neon(float32x4_t R, float32x4_t G, float32x4_t B, const float row[3]) {
+	float32x4_t value = vaddq_f32(vmulq_n_f32(R, row[0]), vmulq_n_f32(G, row[1]));
+	return truncate_color_neon(vaddq_f32(value, vmulq_n_f32(B, row[2])));
+}
+
+static int64_t hue_neon(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3]) {
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint32_t *data = (uint32_t *) (pixels + pixel * 4);
+		uint32x4_t px = vld1q_u32(data);
+		float32x4_t R = vcvtq_f32_s32(NEON_RED(px));
+		float32x4_t G = vcvtq_f32_s32(NEON_CHANNEL(px, 8));
+		float32x4_t B = vcvtq_f32_s32(NEON_CHANNEL(px, 16));
+		int32x4_t newR = hue_channel_neon(R, G, B, matrix[0]);
+		int32x4_t newG = hue_channel_neon(R, G, B, matrix[1]);
+		int32x4_t newB = hue_channel_neon(R, G, B, matrix[2]);
+		vst1q_u32(data, pack_color_neon(px, newR, newG, newB));
+	}
+	return pixel;
+}
+
+static int64_t chroma_key_neon(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int limit) {
+	const uint32x4_t alpha = vdupq_n_u32(0xFF000000);
+	const int32x4_t red_v = vdupq_n_s32(red);
+	const int32x4_t green_v = vdupq_n_s32(green);
+	const int32x4_t blue_v = vdupq_n_s32(blue);
+	const int32x4_t limit_v = vdupq_n_s32(limit);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint32_t *data = (uint32_t *) (pixels + pixel * 4);
+		uint32x4_t px = vld1q_u32(data);
+		int32x4_t R = NEON_RED(px);
+		int32x4_t G = NEON_CHANNEL(px, 8);
+		int32x4_t B = NEON_CHANNEL(px, 16);
+
+		// Squared distance between mask color and pixel color (see Color::GetDistance)
+		int32x4_t rmean = vshrq_n_s32(vaddq_s32(R, red_v), 1);
+		int32x4_t r = vsubq_s32(R, red_v);
+		int32x4_t g = vsubq_s32(G, green_v);
+		int32x4_t b = vsubq_s32(B, blue_v);
+		int32x4_t distance = vshrq_n_s32(vmulq_s32(vaddq_s32(rmean, vdupq_n_s32(512)), vmulq_s32(r, r)), 8);
+		distance = vaddq_s32(distance, vshlq_n_s32(vmulq_s32(g, g), 2));
+		distance = vaddq_s32(distance, vshrq_n_s32(vmulq_s32(vsubq_s32(vdupq_n_s32(767), rmean), vmulq_s32(b, b)), 8));
+
+		// Alpha out the matched pixels
+		uint32x4_t matched = vcltq_s32(distance, limit_v);
+		vst1q_u32(data, vbicq_u32(px, vandq_u32(matched, alpha)));
+	}
+	return pixel;
+}
+
+// Copy the alpha of each pixel to its color channels (and 255 to its alpha channel)
+static inline uint8x16_t alpha_multiplier_neon(uint8x16_t px) {
+	static const uint8_t alpha_indexes[16] = {3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15};
+	static const uint8_t alpha_mask[16] = {0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255};
+	return vorrq_u8(vqtbl1q_u8(px, vld1q_u8(alpha_indexes)), vld1q_u8(alpha_mask));
+}
+
+// Multiply 2 sets of 8-bit values, and divide them by 255 (rounded)
+static inline uint8x16_t multiply_div255_neon(uint8x16_t value, uint8x16_t multiplier) {
+	uint16x8_t low = vmull_u8(vget_low_u8(value), vget_low_u8(multiplier));
+	uint16x8_t high = vmull_u8(vget_high_u8(value), vget_high_u8(multiplier));
+	return vcombine_u8(vraddhn_u16(low, vrshrq_n_u16(low, 8)), vraddhn_u16(high, vrshrq_n_u16(high, 8)));
+}
+
+static int64_t lerp_rows_neon(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied) {
+	const uint16x8_t weight0 = vdupq_n_u16(256 - weight);
+	const uint16x8_t weight1 = vdupq_n_u16(weight);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint8x16_t px0 = vld1q_u8(row0 + pixel * 4);
+		uint8x16_t px1 = vld1q_u8(row1 + pixel * 4);
+		if (!premultiplied) {
+			px0 = multiply_div255_neon(px0, alpha_multiplier_neon(px0));
+			px1 = multiply_div255_neon(px1, alpha_multiplier_neon(px1));
+		}
+		uint16x8_t low = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(px0)), weight0), vmovl_u8(vget_low_u8(px1)), weight1);
+		uint16x8_t high = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(px0)), weight0), vmovl_u8(vget_high_u8(px1)), weight1);
+		vst1q_u8(target + pixel * 4, vcombine_u8(vrshrn_n_u16(low, 8), vrshrn_n_u16(high, 8)));
+	}
+	return pixel;
+}
+
+static int64_t blend_over_neon(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity) {
+	static const uint8_t alpha_indexes[16] = {3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15};
+	const uint16x8_t opacity_v = vdupq_n_u16(opacity);
+
+	int64_t pixel = 0;
+	for (; pixel + 4 <= pixel_count; pixel += 4) {
+		uint8x16_t src = vld1q_u8(source + pixel * 4);
+		uint8x16_t dst = vld1q_u8(target + pixel * 4);
+
+		// Fade the source pixels, and composite them over the target pixels
+		src = vcombine_u8(vrshrn_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(src)), opacity_v), 8), vrshrn_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(src)), opacity_v), 8));
+		uint8x16_t inverse = vsubq_u8(vdupq_n_u8(255), vqtbl1q_u8(src, vld1q_u8(alpha_indexes)));
+		vst1q_u8(target + pixel * 4, vqaddq_u8(src, multiply_div255_neon(dst, inverse)));
+	}
+	return pixel;
+}
+
+#endif
+
+// Get the name of the instruction set the kernels currently use
+std::string PixelKernels::InstructionSet()
+{
+	switch (kernel_level()) {
+		case KERNEL_AVX2:
+			return "avx2";
+		case KERNEL_SSE41:
+			return "sse4.1";
+		case KERNEL_NEON:
+			return "neon";
+		default:
+			return "scalar";
+	}
+}
+
+// Adjust the contrast, and then the brightness of each pixel
+void PixelKernels::Brightness(unsigned char *pixels, int64_t pixel_count, float brightness, float contrast)
+{
+	// Calculate the contrast factor, and the brightness offset
+	float factor = (259 * (contrast + 255)) / (255 * (259 - contrast));
+	float offset = 255 * brightness;
+
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = brightness_avx2(pixels, pixel_count, factor, offset);
+			break;
+		case KERNEL_SSE41:
+			done = brightness_sse41(pixels, pixel_count, factor, offset);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = brightness_neon(pixels, pixel_count, factor, offset);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Adjust the remaining pixels
+	brightness_scalar(pixels + done * 4, pixel_count - done, factor, offset);
+}
+
+// Adjust the saturation of each pixel
+void PixelKernels::Saturation(unsigned char *pixels, int64_t pixel_count, float saturation)
+{
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = saturation_avx2(pixels, pixel_count, saturation);
+			break;
+		case KERNEL_SSE41:
+			done = saturation_sse41(pixels, pixel_count, saturation);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = saturation_neon(pixels, pixel_count, saturation);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Adjust the remaining pixels
+	saturation_scalar(pixels + done * 4, pixel_count - done, saturation);
+}
+
+// Multiply each pixel by a color rotation matrix
+void PixelKernels::Hue(unsigned char *pixels, int64_t pixel_count, const float matrix[3][3])
+{
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = hue_avx2(pixels, pixel_count, matrix);
+			break;
+		case KERNEL_SSE41:
+			done = hue_sse41(pixels, pixel_count, matrix);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = hue_neon(pixels, pixel_count, matrix);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Adjust the remaining pixels
+	hue_scalar(pixels + done * 4, pixel_count - done, matrix);
+}
+
+// Invert the color of each pixel (the alpha value is left alone)
+void PixelKernels::Negate(unsigned char *pixels, int64_t pixel_count)
+{
+	// This simple loop is vectorized by the compiler
+	for (int64_t byte_index = 0; byte_index < pixel_count * 4; byte_index += 4)
+	{
+		pixels[byte_index] = 255 - pixels[byte_index];
+		pixels[byte_index + 1] = 255 - pixels[byte_index + 1];
+		pixels[byte_index + 2] = 255 - pixels[byte_index + 2];
+	}
+}
+
+// Make each pixel transparent, if its color is close to the mask color
+void PixelKernels::ChromaKey(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, int threshold)
+{
+	// A distance is at most the threshold, when its square is below (threshold + 1)^2. Distances
+	// never exceed 1024 (for colors from 0 to 255), so the threshold is limited to avoid overflows.
+	red = clamp_color(red);
+	green = clamp_color(green);
+	blue = clamp_color(blue);
+	int limit = 0;
+	if (threshold >= 0)
+		limit = (std::min(threshold, 1023) + 1) * (std::min(threshold, 1023) + 1);
+
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = chroma_key_avx2(pixels, pixel_count, red, green, blue, limit);
+			break;
+		case KERNEL_SSE41:
+			done = chroma_key_sse41(pixels, pixel_count, red, green, blue, limit);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = chroma_key_neon(pixels, pixel_count, red, green, blue, limit);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Key the remaining pixels
+	chroma_key_scalar(pixels + done * 4, pixel_count - done, red, green, blue, limit);
+}
+
+// Key out each pixel by its distance from the mask color, with a soft edge and spill suppression (in a single pass)
+void PixelKernels::SoftChromaKey(unsigned char *pixels, int64_t pixel_count, int red, int green, int blue, bool chroma_distance, float threshold, float softness, float spill)
+{
+	red = clamp_color(red);
+	green = clamp_color(green);
+	blue = clamp_color(blue);
+	spill = std::max(0.0f, std::min(spill, 1.0f));
+
+	// Chroma (Cb, Cr) of the mask color (full range BT.601)
+	const float key_cb = -0.168736f * red - 0.331264f * green + 0.5f * blue;
+	const float key_cr = 0.5f * red - 0.418688f * green - 0.081312f * blue;
+
+	// Unit direction of the mask chroma (spill is the part of a pixel's chroma along this direction)
+	float key_length = std::sqrt(key_cb * key_cb + key_cr * key_cr);
+	float unit_cb = 0.0f;
+	float unit_cr = 0.0f;
+	if (key_length > 0.0f) {
+		unit_cb = key_cb / key_length;
+		unit_cr = key_cr / key_length;
+	} else
+		spill = 0.0f;
+
+	// Soft edge: the alpha ramps from 0 (at the threshold) up to 1 (at the threshold plus the softness)
+	const float ramp = softness > 0.0f ? 1.0f / softness : 0.0f;
+
+	for (int64_t byte_index = 0; byte_index < pixel_count * 4; byte_index += 4)
+	{
+		float R = pixels[byte_index];
+		float G = pixels[byte_index + 1];
+		float B = pixels[byte_index + 2];
+		float cb = -0.168736f * R - 0.331264f * G + 0.5f * B;
+		float cr = 0.5f * R - 0.418688f * G - 0.081312f * B;
+
+		// Distance between mask color and pixel color
+		float distance;
+		if (chroma_distance) {
+			// Distance in the CbCr plane (ignores the brightness, so shadows on the screen are keyed too)
+			distance = std::sqrt((cb - key_cb) * (cb - key_cb) + (cr - key_cr) * (cr - key_cr));
+		} else {
+			// Weighted RGB distance (see Color::GetDistance)
+			float rmean = (R + red) * 0.5f;
+			float r = R - red;
+			float g = G - green;
+			float b = B - blue;
+			distance = std::sqrt((512.0f + rmean) * r * r / 256.0f + 4.0f * g * g + (767.0f - rmean) * b * b / 256.0f);
+		}
+
+		// Scale the alpha (hard edge, when there is no softness)
+		float coverage;
+		if (ramp > 0.0f)
+			coverage = std::max(0.0f, std::min((distance - threshold) * ramp, 1.0f));
+		else
+			coverage = distance > threshold ? 1.0f : 0.0f;
+		pixels[byte_index + 3] = (unsigned char) (pixels[byte_index + 3] * coverage + 0.5f);
+
+		// Remove the mask chroma from the pixel (the brightness is kept)
+		float amount = spill * std::max(0.0f, cb * unit_cb + cr * unit_cr);
+		if (amount > 0.0f) {
+			float delta_cb = -amount * unit_cb;
+			float delta_cr = -amount * unit_cr;
+			pixels[byte_index] = clamp_color((int) std::floor(R + 1.402f * delta_cr + 0.5f));
+			pixels[byte_index + 1] = clamp_color((int) std::floor(G - 0.344136f * delta_cb - 0.714136f * delta_cr + 0.5f));
+			pixels[byte_index + 2] = clamp_color((int) std::floor(B + 1.772f * delta_cb + 0.5f));
+		}
+	}
+}
+
+// Interpolate between 2 rows of pixels, premultiplying their colors by their alpha
+void PixelKernels::LerpRows(unsigned char *target, const unsigned char *row0, const unsigned char *row1, int64_t pixel_count, int weight, bool premultiplied)
+{
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = lerp_rows_avx2(target, row0, row1, pixel_count, weight, premultiplied);
+			break;
+		case KERNEL_SSE41:
+			done = lerp_rows_sse41(target, row0, row1, pixel_count, weight, premultiplied);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = lerp_rows_neon(target, row0, row1, pixel_count, weight, premultiplied);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Interpolate the remaining pixels
+	lerp_rows_scalar(target + done * 4, row0 + done * 4, row1 + done * 4, pixel_count - done, weight, premultiplied);
+}
+
+// Resample a row of pixels, by interpolating 2 neighbouring pixels for each target pixel
+void PixelKernels::ResampleRow(unsigned char *target, const unsigned char *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count)
+{
+	resample_row_scalar(target, row, indexes, weights, pixel_count);
+}
+
+// Composite premultiplied pixels over opaque pixels, fading them by an opacity
+void PixelKernels::BlendOver(unsigned char *target, const unsigned char *source, int64_t pixel_count, int opacity)
+{
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+			done = blend_over_avx2(target, source, pixel_count, opacity);
+			break;
+		case KERNEL_SSE41:
+			done = blend_over_sse41(target, source, pixel_count, opacity);
+			break;
+#elif defined(OPENSHOT_NEON_KERNELS)
+		case KERNEL_NEON:
+			done = blend_over_neon(target, source, pixel_count, opacity);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Composite the remaining pixels
+	blend_over_scalar(target + done * 4, source + done * 4, pixel_count - done, opacity);
+}
+
+// Convert a row of pixels to UYVY
+void PixelKernels::RGBAToUYVY(unsigned char *target, const unsigned char *source, int64_t pixel_count, bool bgra, bool bt709)
+{
+	const int *coefficients = bt709 ? uyvy_coefficients_709 : uyvy_coefficients_601;
+	int64_t done = 0;
+	switch (kernel_level()) {
+#if defined(OPENSHOT_X86_KERNELS)
+		case KERNEL_AVX2:
+		case KERNEL_SSE41:
+			done = rgba_to_uyvy_sse41(target, source, pixel_count, bgra, coefficients);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	// Convert the remaining pixels
+	rgba_to_uyvy_scalar(target + done * 2, source + done * 4, pixel_count - done, bgra, coefficients);
+}
+
+// Interpolate between 2 rows of pixels of a pixel format
+template<class Format>
+void PixelKernels::LerpRows(typename Format::Channel *target, const typename Format::Channel *row0, const typename Format::Channel *row1, int64_t pixel_count, int weight)
+{
+	if (Format::IsByteRGBA())
+		LerpRows((unsigned char *) target, (const unsigned char *) row0, (const unsigned char *) row1, pixel_count, weight, Format::premultiplied);
+	else
+		lerp_rows_format<Format>(target, row0, row1, pixel_count, weight);
+}
+
+// Resample a row of pixels of a pixel format
+template<class Format>
+void PixelKernels::ResampleRow(typename Format::Channel *target, const typename Format::Channel *row, const int32_t *indexes, const uint16_t *weights, int64_t pixel_count)
+{
+	resample_row_format<Format>(target, row, indexes, weights, pixel_count);
+}
+
+// Composite premultiplied pixels of a pixel format over opaque pixels
+template<class Format>
+void PixelKernels::BlendOver(typename Format::Channel *target, const typename Format::Channel *source, int64_t pixel_count, int opacity)
+{
+	if (Format::IsByteRGBA())
+		BlendOver((unsigned char *) target, (const unsigned char *) source, pixel_count, opacity);
+	else
+		blend_over_format<Format>(target, source, pixel_count, opacity);
+}
+
+// Compile the compositor kernels for each pixel format
+#define OPENSHOT_FORMAT_KERNELS(Format) \
+	template void PixelKernels::LerpRows<Format>(Format::Channel *, const Format::Channel *, const Format::Channel *, int64_t, int); \
+	template void PixelKernels::ResampleRow<Format>(Format::Channel *, const Format::Channel *, const int32_t *, const uint16_t *, int64_t); \
+	template void PixelKernels::BlendOver<Format>(Format::Channel *, const Format::Channel *, int64_t, int);
+
+OPENSHOT_FORMAT_KERNELS(RGBA8888Pixels)
+OPENSHOT_FORMAT_KERNELS(RGBA8888PremultipliedPixels)
+OPENSHOT_FORMAT_KERNELS(ARGB32Pixels)
+OPENSHOT_FORMAT_KERNELS(ARGB32PremultipliedPixels)
+#ifdef USE_RGBA64_IMAGES
+OPENSHOT_FORMAT_KERNELS(RGBA64Pixels)
+OPENSHOT_FORMAT_KERNELS(RGBA64PremultipliedPixels)
+#endif
@@ -0,0 +1,294 @@
+/**
+ * @file
+ * @brief Source file for PlaneCompositor class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "../include/PlaneCompositor.h"
+#include "../include/FFmpegScaler.h"
+#include "../include/FFmpegUtilities.h"
+#include "../include/ImageBufferPool.h"
+#include "../include/TaskPool.h"
+
+using namespace openshot;
+
+namespace {
+	// The source samples of each target sample along one axis of a plane (only the target samples whose centers
+	// are inside the source are composited)
+	struct SampleAxis {
+		int first; // The first composited target sample
+		int count; // The number of composited target samples
+		std::vector<int> index; // The source sample before each target sample
+		std::vector<int> next; // The source sample after each target sample (clamped to the plane)
+		std::vector<int> weight; // The weight of the next source sample (0 to 256)
+	};
+
+	// Get the samples of a plane (along one axis) of a length of luma pixels, subsampled by a shift
+	int plane_length(int length, int shift) {
+		return (length + (1 << shift) - 1) >> shift;
+	}
+
+	// Map the samples of a target plane to a source plane (the positions and scale are in luma pixels)
+	SampleAxis sample_axis(int target_length, int target_shift, float position, float scale, float source_start,
+						   float source_end, int source_length, int source_shift) {
+		SampleAxis axis;
+		axis.first = 0;
+		axis.count = 0;
+		for (int sample = 0; sample < target_length; sample++) {
+			float luma = ((sample + 0.5f) * (1 << target_shift) - position) / scale + source_start;
+			if (luma < source_start || luma >= source_end) {
+				// The samples inside the source are contiguous
+				if (axis.count > 0)
+					break;
+				continue;
+			}
+			if (axis.count == 0)
+				axis.first = sample;
+
+			float source = std::max(0.0f, std::min(luma / (1 << source_shift) - 0.5f, float(source_length - 1)));
+			int index = int(source);
+			axis.index.push_back(index);
+			axis.next.push_back(std::min(index + 1, source_length - 1));
+			axis.weight.push_back(int((source - index) * 256.0f + 0.5f));
+			axis.count++;
+		}
+		return axis;
+	}
+
+	// Free the AVFrame which owns the planes of a composite
+	void free_planes_frame(void *planes_frame) {
+		AVFrame *frame = (AVFrame *) planes_frame;
+		AV_FREE_FRAME(&frame);
+	}
+}
+
+// Can planes of a pixel format be composited
+bool PlaneCompositor::IsSupported(int pixel_format)
+{
+	switch (pixel_format) {
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUV422P:
+		case AV_PIX_FMT_YUV444P:
+		case AV_PIX_FMT_YUVA420P:
+		case AV_PIX_FMT_YUVA422P:
+		case AV_PIX_FMT_YUVA444P:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Get the pixel format of a composite (without the alpha plane)
+int PlaneCompositor::CompositeFormat(int pixel_format)
+{
+	switch (pixel_format) {
+		case AV_PIX_FMT_YUVA420P:
+			return AV_PIX_FMT_YUV420P;
+		case AV_PIX_FMT_YUVA422P:
+			return AV_PIX_FMT_YUV422P;
+		case AV_PIX_FMT_YUVA444P:
+			return AV_PIX_FMT_YUV444P;
+		default:
+			return pixel_format;
+	}
+}
+
+// Create planes filled with a color (or NULL, if they can't be allocated)
+std::shared_ptr<FramePlanes> PlaneCompositor::CreatePlanes(int width, int height, int pixel_format, QColor color)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat) pixel_format);
+	if (!desc || !IsSupported(pixel_format) || width <= 0 || height <= 0)
+		return std::shared_ptr<FramePlanes>();
+
+	AVFrame *frame = AV_ALLOCATE_FRAME();
+	frame->format = pixel_format;
+	frame->width = width;
+	frame->height = height;
+	if (av_frame_get_buffer(frame, 32) < 0) {
+		AV_FREE_FRAME(&frame);
+		return std::shared_ptr<FramePlanes>();
+	}
+
+	std::shared_ptr<FramePlanes> planes = std::make_shared<FramePlanes>();
+	planes->width = width;
+	planes->height = height;
+	planes->pixel_format = pixel_format;
+	for (int plane = 0; plane < 4; plane++) {
+		planes->data[plane] = frame->data[plane];
+		planes->linesize[plane] = frame->linesize[plane];
+	}
+	planes->owner = std::shared_ptr<void>(frame, &free_planes_frame);
+
+	// Convert the color to studio range YUV (BT.601)
+	int red = color.red();
+	int green = color.green();
+	int blue = color.blue();
+	int values[4] = {
+		((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16,
+		((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128,
+		((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128,
+		color.alpha()
+	};
+	int plane_count = (desc->flags & AV_PIX_FMT_FLAG_ALPHA) ? 4 : 3;
+	for (int plane = 0; plane < plane_count; plane++) {
+		bool is_chroma = (plane == 1 || plane == 2);
+		int plane_width = plane_length(width, is_chroma ? desc->log2_chroma_w : 0);
+		int plane_height = plane_length(height, is_chroma ? desc->log2_chroma_h : 0);
+		for (int row = 0; row < plane_height; row++)
+			memset(planes->data[plane] + int64_t(row) * planes->linesize[plane], values[plane], plane_width);
+	}
+	return planes;
+}
+
+// Composite planes onto the planes of a composite
+void PlaneCompositor::Composite(std::shared_ptr<FramePlanes> target, std::shared_ptr<FramePlanes> source, QRectF source_rect,
+								float x, float y, float width_scale, float height_scale, float alpha, int bands)
+{
+	const AVPixFmtDescriptor *target_desc = av_pix_fmt_desc_get((AVPixelFormat) target->pixel_format);
+	const AVPixFmtDescriptor *source_desc = av_pix_fmt_desc_get((AVPixelFormat) source->pixel_format);
+	if (!target_desc || !source_desc || !IsSupported(source->pixel_format) || width_scale <= 0.0 || height_scale <= 0.0)
+		return;
+
+	int opacity = std::max(0, std::min(255, int(alpha * 255.0f + 0.5f)));
+	if (opacity == 0)
+		return;
+	bool has_alpha = source_desc->flags & AV_PIX_FMT_FLAG_ALPHA;
+
+	// The part of the source to composite (within its luma plane)
+	float source_left = std::max(0.0, source_rect.left());
+	float source_top = std::max(0.0, source_rect.top());
+	float source_right = std::min(double(source->width), source_rect.right());
+	float source_bottom = std::min(double(source->height), source_rect.bottom());
+	if (source_right <= source_left || source_bottom <= source_top)
+		return;
+
+	// Each plane is composited at its own size (the alpha plane is sampled at the position of each sample)
+	for (int plane = 0; plane < 3; plane++) {
+		bool is_chroma = (plane > 0);
+		int target_shift_x = is_chroma ? target_desc->log2_chroma_w : 0;
+		int target_shift_y = is_chroma ? target_desc->log2_chroma_h : 0;
+		int source_shift_x = is_chroma ? source_desc->log2_chroma_w : 0;
+		int source_shift_y = is_chroma ? source_desc->log2_chroma_h : 0;
+		int target_width = plane_length(target->width, target_shift_x);
+		int target_height = plane_length(target->height, target_shift_y);
+
+		SampleAxis columns = sample_axis(target_width, target_shift_x, x, width_scale, source_left, source_right,
+										 plane_length(source->width, source_shift_x), source_shift_x);
+		SampleAxis rows = sample_axis(target_height, target_shift_y, y, height_scale, source_top, source_bottom,
+									  plane_length(source->height, source_shift_y), source_shift_y);
+		if (columns.count == 0 || rows.count == 0)
+			continue;
+
+		SampleAxis alpha_columns;
+		SampleAxis alpha_rows;
+		if (has_alpha) {
+			alpha_columns = sample_axis(target_width, target_shift_x, x, width_scale, source_left, source_right, source->width, 0);
+			alpha_rows = sample_axis(target_height, target_shift_y, y, height_scale, source_top, source_bottom, source->height, 0);
+		}
+
+		int band_count = std::max(1, std::min(bands, rows.count));
+		int band_rows = (rows.count + band_count - 1) / band_count;
+		TaskPool::Current()->ParallelFor(0, band_count, [&](int64_t band)
+		{
+			int first_row = band * band_rows;
+			int last_row = std::min(rows.count, first_row + band_rows);
+			for (int row = first_row; row < last_row; row++) {
+				uint8_t *target_samples = target->data[plane] + int64_t(rows.first + row) * target->linesize[plane] + columns.first;
+				const uint8_t *row0 = source->data[plane] + int64_t(rows.index[row]) * source->linesize[plane];
+				const uint8_t *row1 = source->data[plane] + int64_t(rows.next[row]) * source->linesize[plane];
+				int row_weight = rows.weight[row];
+
+				const uint8_t *alpha0 = NULL;
+				const uint8_t *alpha1 = NULL;
+				int alpha_row_weight = 0;
+				if (has_alpha) {
+					alpha0 = source->data[3] + int64_t(alpha_rows.index[row]) * source->linesize[3];
+					alpha1 = source->data[3] + int64_t(alpha_rows.next[row]) * source->linesize[3];
+					alpha_row_weight = alpha_rows.weight[row];
+				}
+
+				for (int column = 0; column < columns.count; column++) {
+					int index = columns.index[column];
+					int next = columns.next[column];
+					int weight = columns.weight[column];
+					int top = row0[index] * (256 - weight) + row0[next] * weight;
+					int bottom = row1[index] * (256 - weight) + row1[next] * weight;
+					int value = (top * (256 - row_weight) + bottom * row_weight + 32768) >> 16;
+
+					int sample_alpha = opacity;
+					if (has_alpha) {
+						index = alpha_columns.index[column];
+						next = alpha_columns.next[column];
+						weight = alpha_columns.weight[column];
+						top = alpha0[index] * (256 - weight) + alpha0[next] * weight;
+						bottom = alpha1[index] * (256 - weight) + alpha1[next] * weight;
+						sample_alpha = (sample_alpha * ((top * (256 - alpha_row_weight) + bottom * alpha_row_weight + 32768) >> 16) + 127) / 255;
+					}
+
+					target_samples[column] = (value * sample_alpha + target_samples[column] * (255 - sample_alpha) + 127) / 255;
+				}
+			}
+		});
+	}
+}
+
+// Convert planes to an image (or NULL, if its buffer can't be allocated)
+std::shared_ptr<QImage> PlaneCompositor::ToImage(std::shared_ptr<FramePlanes> planes, QImage::Format format)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat) planes->pixel_format);
+	bool has_alpha = desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+
+	// The same output formats as FFmpegReader (opaque pixels are the same premultiplied or not)
+	int pixel_format = AV_PIX_FMT_RGBA;
+	QImage::Format image_format = QImage::Format_RGBA8888;
+	if (format == QImage::Format_ARGB32_Premultiplied) {
+		pixel_format = AV_PIX_FMT_RGB32;
+		image_format = has_alpha ? QImage::Format_ARGB32 : QImage::Format_ARGB32_Premultiplied;
+	}
+#ifdef USE_RGBA64_IMAGES
+	if (format == QImage::Format_RGBA64) {
+		pixel_format = AV_PIX_FMT_RGBA64;
+		image_format = QImage::Format_RGBA64;
+	}
+#endif
+
+	int bytes_per_line = planes->width * (QImage::toPixelFormat(image_format).bitsPerPixel() / 8);
+	uint8_t *buffer = ImageBufferPool::Instance()->Acquire(bytes_per_line * planes->height);
+	if (!buffer)
+		return std::shared_ptr<QImage>();
+
+	uint8_t *dst_data[4] = {buffer, NULL, NULL, NULL};
+	int dst_linesize[4] = {bytes_per_line, 0, 0, 0};
+	FFmpegScaler::Scale(planes->data, planes->linesize, planes->width, planes->height, planes->pixel_format,
+						dst_data, dst_linesize, planes->width, planes->height, pixel_format, SWS_FAST_BILINEAR);
+
+	return std::make_shared<QImage>(buffer, planes->width, planes->height, bytes_per_line, image_format,
+									(QImageCleanupFunction) &ImageBufferPool::CleanUp, (void *) buffer);
+}
@@ -0,0 +1,202 @@
+/**
+ * @file
+ * @brief Source file for ProxyManager class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include "../include/ProxyManager.h"
+#include "../include/FFmpegReader.h"
+#include "../include/FFmpegWriter.h"
+#include "../include/Settings.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Global reference to proxy manager
+ProxyManager *ProxyManager::m_pInstance = NULL;
+
+// Create or Get an instance of the proxy manager singleton
+ProxyManager *ProxyManager::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of proxy manager only once
+		m_pInstance = new ProxyManager();
+
+	return m_pInstance;
+}
+
+// Get the file path of the proxy of a media file (an empty string if proxies are disabled)
+std::string ProxyManager::ProxyPath(std::string path)
+{
+	QString proxy_folder = QString::fromStdString(Settings::Instance()->PROXY_PATH);
+	if (proxy_folder.isEmpty() || Settings::Instance()->PROXY_HEIGHT <= 0)
+		return "";
+
+	// Name the proxy after a hash of the full path of the media file (and the proxy height)
+	QString media_path = QFileInfo(QString::fromStdString(path)).absoluteFilePath();
+	QString hash = QCryptographicHash::hash(media_path.toUtf8(), QCryptographicHash::Md5).toHex();
+	return QDir(proxy_folder).filePath(hash + "_" + QString::number(Settings::Instance()->PROXY_HEIGHT) + ".mov").toStdString();
+}
+
+// Is there a complete proxy of a media file (which is newer than the file)
+bool ProxyManager::HasProxy(std::string path)
+{
+	std::string proxy_path = ProxyPath(path);
+	if (proxy_path.empty())
+		return false;
+
+	QFileInfo proxy_info(QString::fromStdString(proxy_path));
+	QFileInfo media_info(QString::fromStdString(path));
+	return proxy_info.exists() && media_info.exists() && proxy_info.lastModified() >= media_info.lastModified();
+}
+
+// Is the proxy of a media file queued (or being generated)
+bool ProxyManager::IsGenerating(std::string path)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return queued.count(path) > 0;
+}
+
+// Queue the generation of a media file's proxy (unless it exists, is queued, or failed)
+void ProxyManager::Generate(std::string path)
+{
+	if (ProxyPath(path).empty() || HasProxy(path))
+		return;
+
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	if (queued.count(path) || failed.count(path))
+		return;
+	queued.insert(path);
+	queue.push_back(path);
+
+	// Start the generator thread with the first proxy (it waits for more, instead of exiting)
+	if (!generator_thread.joinable()) {
+		generator_thread = std::thread(&ProxyManager::generator_loop, this);
+		generator_thread.detach();
+	}
+	queue_condition.notify_one();
+}
+
+// Wait until all queued proxies are generated
+void ProxyManager::Wait()
+{
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	idle_condition.wait(lock, [this] { return queue.empty() && !is_generating; });
+}
+
+// Generate the queued proxies (on the generator thread)
+void ProxyManager::generator_loop()
+{
+	while (true) {
+		std::string path;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_condition.wait(lock, [this] { return !queue.empty(); });
+			path = queue.front();
+			queue.pop_front();
+			is_generating = true;
+		}
+
+		bool success = true;
+		std::string proxy_path = ProxyPath(path);
+		if (!proxy_path.empty() && !HasProxy(path)) {
+			try {
+				write_proxy(path, proxy_path);
+			}
+			catch (const std::exception& e) {
+				// The original is read instead (and the proxy isn't tried again)
+				ZmqLogger::Instance()->AppendDebugMethod("ProxyManager::generator_loop (Failed: " + path + ", " + std::string(e.what()) + ")");
+				success = false;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			queued.erase(path);
+			if (!success)
+				failed.insert(path);
+			is_generating = false;
+		}
+		idle_condition.notify_all();
+	}
+}
+
+// Write the proxy of a media file (to a temporary file, which is renamed once it is complete)
+void ProxyManager::write_proxy(std::string path, std::string proxy_path)
+{
+	FFmpegReader reader(path);
+	reader.enable_proxy = false;
+	reader.Open();
+	if (!reader.info.has_video || reader.info.has_single_image || reader.info.height <= 0) {
+		// Only video files have proxies
+		reader.Close();
+		throw InvalidFile("Only video files can have a proxy.", path);
+	}
+
+	// Scale to the proxy height (never larger than the original), with an even width for the chroma planes
+	int height = std::min(Settings::Instance()->PROXY_HEIGHT, reader.info.height);
+	height -= height % 2;
+	int width = round(height * reader.info.width / double(reader.info.height));
+	width += width % 2;
+	int bit_rate = int(std::min(100000000.0, width * height * reader.info.fps.ToDouble() * 0.5));
+
+	ZmqLogger::Instance()->AppendDebugMethod("ProxyManager::write_proxy", "width", width, "height", height, "video_length", reader.info.video_length, "bit_rate", bit_rate);
+
+	// Write an intra-only copy (so every frame can be decoded without its neighbors), with uncompressed audio
+	QDir().mkpath(QFileInfo(QString::fromStdString(proxy_path)).absolutePath());
+	std::string temp_path = proxy_path.substr(0, proxy_path.size() - 4) + ".tmp.mov";
+	FFmpegWriter writer(temp_path);
+	writer.SetVideoOptions(true, "mjpeg", reader.info.fps, width, height, reader.info.pixel_ratio, false, false, bit_rate);
+	if (reader.info.has_audio)
+		writer.SetAudioOptions(true, "pcm_s16le", reader.info.sample_rate, reader.info.channels, reader.info.channel_layout, 0);
+	writer.Open();
+
+	// Frames are scaled while they are decoded
+	for (int64_t number = 1; number <= reader.info.video_length; number++)
+		writer.WriteFrame(reader.GetFrame(number, width, height));
+
+	writer.WriteTrailer();
+	writer.Close();
+	reader.Close();
+
+	// Readers only see the complete proxy
+	QFile::remove(QString::fromStdString(proxy_path));
+	if (!QFile::rename(QString::fromStdString(temp_path), QString::fromStdString(proxy_path))) {
+		QFile::remove(QString::fromStdString(temp_path));
+		throw InvalidFile("The proxy could not be saved.", proxy_path);
+	}
+}
@@ -90,11 +90,62 @@ namespace openshot
         audioDeviceManager.dispatchPendingMessages();
     }
 
+	// Constructor of a clock of a source
+	AudioClockSource::AudioClockSource(juce::PositionableAudioSource *played_source)
+	: source(played_source), block_end(-1), block_size(0), block_time(0.0), device_rate(0.0), latency(0)
+	{
+	}
+
+	// Prepare to play the source (and forget the blocks played before)
+	void AudioClockSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+	{
+		{
+			const std::lock_guard<std::mutex> lock(clock_mutex);
+			block_end = -1;
+			device_rate = sampleRate;
+		}
+		source->prepareToPlay(samplesPerBlockExpected, sampleRate);
+	}
+
+	// Release the resources of the source
+	void AudioClockSource::releaseResources()
+	{
+		source->releaseResources();
+	}
+
+	// Get the next block of the source (and record its position)
+	void AudioClockSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
+	{
+		source->getNextAudioBlock(info);
+
+		// Skip the record if the player is reading it (the next block is recorded instead)
+		std::unique_lock<std::mutex> lock(clock_mutex, std::try_to_lock);
+		if (lock.owns_lock()) {
+			block_end = source->getNextReadPosition();
+			block_size = info.numSamples;
+			block_time = juce::Time::getMillisecondCounterHiRes();
+		}
+	}
+
+	// Get the read position of the source being heard at this moment
+	double AudioClockSource::getHeardPosition()
+	{
+		const std::lock_guard<std::mutex> lock(clock_mutex);
+		if (block_end < 0 || device_rate <= 0.0)
+			return -1.0;
+
+		// The latest block is heard after the output latency, and the samples before it are heard until then
+		double block_start = double(block_end - block_size - latency);
+		double elapsed = (juce::Time::getMillisecondCounterHiRes() - block_time) * device_rate / 1000.0;
+		return block_start + std::max(0.0, std::min(elapsed, double(block_size)));
+	}
+
     // Constructor
     AudioPlaybackThread::AudioPlaybackThread()
 	: juce::Thread("audio-playback")
 	, player()
 	, transport()
+	, clock(&transport)
 	, mixer()
 	, source(NULL)
 	, sampleRate(0.0)
@@ -144,6 +195,17 @@ namespace openshot
 	return source ? source->getEstimatedFrame() : 0;
     }
 
+	// Get the frame position being heard at this moment (from the samples played by the audio device)
+	double AudioPlaybackThread::getPlaybackPosition()
+	{
+		double heard_position = clock.getHeardPosition();
+		if (!source || heard_position < 0.0)
+			return -1.0;
+
+		// The positions of the transport are resampled to the rate of the audio device
+		return source->getFrameAtPosition(heard_position * sampleRate / clock.getDeviceRate());
+	}
+
 	// Seek the audio thread
 	void AudioPlaybackThread::Seek(int64_t new_position)
 	{
@@ -173,6 +235,10 @@ namespace openshot
     			// Add callback
 				AudioDeviceManagerSingleton::Instance()->audioDeviceManager.addAudioCallback(&player);
 
+				// Get the output latency of the audio device (for the audio clock)
+				AudioIODevice *device = AudioDeviceManagerSingleton::Instance()->audioDeviceManager.getCurrentAudioDevice();
+				clock.latency = device ? device->getOutputLatencyInSamples() : 0;
+
     			// Create TimeSliceThread for audio buffering
 				time_thread.startThread();
 
@@ -187,7 +253,7 @@ namespace openshot
     			transport.setGain(1.0);
 
     			// Connect transport to mixer and player
-    			mixer.addInputSource(&transport, false);
+    			mixer.addInputSource(&clock, false);
     			player.setSource(&mixer);
 
     			// Start the transport
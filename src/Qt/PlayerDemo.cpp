@@ -130,6 +130,10 @@ void PlayerDemo::keyPressEvent(QKeyEvent *event)
 			player->Speed(0);
 		player->Seek(player->Position() + 1);
 	}
+	else if (event->key() == Qt::Key_S) {
+		// Show or hide the playback statistics
+		player->ShowStats(!player->StatsVisible());
+	}
 	else if (event->key() == Qt::Key_Escape) {
 		std::cout << "QUIT PLAYER" << std::endl;
 		QWidget *pWin = QApplication::activeWindow();
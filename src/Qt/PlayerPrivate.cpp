@@ -30,6 +30,12 @@
  */
 
 #include "../../include/Qt/PlayerPrivate.h"
+#include "../../include/Settings.h"
+#include "../../include/Timeline.h"
+#include "../../include/Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 namespace openshot
 {
@@ -40,6 +46,10 @@ namespace openshot
     , videoPlayback(new openshot::VideoPlaybackThread(rb))
     , videoCache(new openshot::VideoCacheThread())
     , speed(1), reader(NULL), last_video_position(1)
+    , average_render_time(0.0), lag_time(0.0), slow_frames(0), fast_frames(0)
+    , quality_level(0), original_max_width(0), original_max_height(0)
+    , show_stats(false), dropped_frames(0), stats_render_time(0.0), stats_frames(0), stats_sample_time(0.0)
+    , stats_decode_time(0), stats_composite_time(0)
     { }
 
     // Destructor
@@ -80,92 +90,280 @@ namespace openshot
 			// Experimental Pausing Code (if frame has not changed)
 			if ((speed == 0 && video_position == last_video_position) || (video_position > reader->info.video_length)) {
 				speed = 0;
+				lag_time = 0.0;
+
+				// Restore the full quality while paused
+				setQuality(0);
 				sleep(frame_time);
 				continue;
 			}
 
-			// Set the video frame on the video thread and render frame
-			videoPlayback->frame = frame;
-			videoPlayback->render.signal();
+			// Get the end time (to track how long a frame takes to render)
+			const Time t2 = Time::getCurrentTime();
 
-			// Keep track of the last displayed frame
-			last_video_position = video_position;
+			// Determine how many milliseconds it took to render the frame
+			int64_t render_time = t2.toMilliseconds() - t1.toMilliseconds();
 
-			// How many frames ahead or behind is the video thread?
-			int64_t video_frame_diff = 0;
+			// The position of the audio clock (with sub-frame precision), or -1 until the audio device plays samples
+			double audio_clock = -1.0;
 			if (reader->info.has_audio && reader->info.has_video) {
-				if (speed != 1)
-					// Set audio frame again (since we are not in normal speed, and not paused)
-					audioPlayback->Seek(video_position);
-
 				// Only calculate this if a reader contains both an audio and video thread
 				audio_position = audioPlayback->getCurrentFramePosition();
-				video_frame_diff = video_position - audio_position;
+
+				// The audio plays at the same speed (and direction), so only re-sync it if it drifts too far away
+				if (speed != 1 && abs(video_position - audio_position) > 2 * abs(speed)) {
+					audioPlayback->Seek(video_position);
+					audio_position = video_position;
+				}
+
+				// Present the frame at its timestamp (when the audio device plays its first sample)
+				audio_clock = waitForAudioClock(frame_time);
 			}
 
-			// Get the end time (to track how long a frame takes to render)
-			const Time t2 = Time::getCurrentTime();
+			// Set the video frame on the video thread and render frame
+			videoPlayback->frame = frame;
+			videoPlayback->render.signal();
 
-			// Determine how many milliseconds it took to render the frame
-			int64_t render_time = t2.toMilliseconds() - t1.toMilliseconds();
+			// Keep track of the last displayed frame
+			last_video_position = video_position;
 
 			// Calculate the amount of time to sleep (by subtracting the render time)
 			int sleep_time = int(frame_time - render_time);
 
-			// Debug
-			ZmqLogger::Instance()->AppendDebugMethod("PlayerPrivate::run (determine sleep)", "video_frame_diff", video_frame_diff, "video_position", video_position, "audio_position", audio_position, "speed", speed, "render_time", render_time, "sleep_time", sleep_time);
-
-			// Adjust drift (if more than a few frames off between audio and video)
-			if (video_frame_diff > 0 && reader->info.has_audio && reader->info.has_video)
-				// Since the audio and video threads are running independently, they will quickly get out of sync.
-				// To fix this, we calculate how far ahead or behind the video frame is, and adjust the amount of time
-				// the frame is displayed on the screen (i.e. the sleep time). If a frame is ahead of the audio,
-				// we sleep for longer. If a frame is behind the audio, we sleep less (or not at all), in order for
-				// the video to catch up.
-				sleep_time += (video_frame_diff * (1000.0 / reader->info.fps.ToDouble()));
-
+			if (audio_clock >= 0.0) {
+				// The next frame is presented by the audio clock (so there is no sleep), unless it is already late
+				sleep_time = 0;
+				lag_time = 0.0;
+				double frames_late = (speed < 0) ? video_position - audio_clock : audio_clock - video_position;
+
+				// Drop frame(s) to catch up to the audio (if more than 2 frames behind), instead of
+				// showing every late frame and falling further behind
+				if (frames_late > 2.0) {
+					dropped_frames += int64_t(frames_late);
+					video_position = (speed < 0) ? int64_t(ceil(audio_clock)) : int64_t(floor(audio_clock));
+					video_position = std::max(int64_t(1), std::min(video_position, reader->info.video_length));
+				}
+
+				// Debug
+				ZmqLogger::Instance()->AppendDebugMethod("PlayerPrivate::run (audio clock)", "frames_late", frames_late, "video_position", video_position, "audio_clock", audio_clock, "speed", speed, "render_time", render_time);
+			}
 
-			else if (video_frame_diff < -10 && reader->info.has_audio && reader->info.has_video) {
-				// Skip frame(s) to catch up to the audio (if more than 10 frames behind)
-				video_position += abs(video_frame_diff) / 2; // Seek forward 1/2 the difference
-				sleep_time = 0; // Don't sleep now... immediately go to next position
+			else {
+				// Debug
+				ZmqLogger::Instance()->AppendDebugMethod("PlayerPrivate::run (determine sleep)", "video_position", video_position, "audio_position", audio_position, "speed", speed, "render_time", render_time, "sleep_time", sleep_time);
+
+				// Without an audio clock, keep to the wall clock: frames which render too slowly add up, and whole frames are dropped to catch up
+				lag_time = std::max(0.0, lag_time - sleep_time);
+				if (lag_time >= frame_time) {
+					int64_t lagging_frames = int64_t(lag_time / frame_time);
+					dropped_frames += lagging_frames;
+					video_position += ((speed < 0) ? -1 : 1) * lagging_frames;
+					video_position = std::max(int64_t(1), std::min(video_position, reader->info.video_length));
+					lag_time -= lagging_frames * frame_time;
+				}
 			}
 
+			// Lower the preview quality while frames render too slowly (and raise it again once they are fast)
+			adaptQuality(frame_time, render_time);
+			updateStats(render_time);
+
 			// Sleep (leaving the video frame on the screen for the correct amount of time)
 			if (sleep_time > 0) usleep(sleep_time * 1000);
 
 		}
     }
 
+    // Wait until the audio clock reaches the current frame (for at most a second), and return the clock
+    double PlayerPrivate::waitForAudioClock(double frame_time)
+    {
+		double audio_clock = audioPlayback->getPlaybackPosition();
+		double waited_time = 0.0;
+		while (audio_clock >= 0.0 && speed != 0 && waited_time < 1000.0 && !threadShouldExit()) {
+			// Stop once the clock reaches the frame (in the direction of playback)
+			double frames_early = (speed < 0) ? audio_clock - video_position : video_position - audio_clock;
+			if (frames_early <= 0.0)
+				break;
+
+			// Sleep (at most a frame at a time, reading the clock again, since the audio device can drift)
+			double wait_time = std::min(frames_early, 1.0) * frame_time;
+			usleep(int64_t(wait_time * 1000.0));
+			waited_time += wait_time;
+			audio_clock = audioPlayback->getPlaybackPosition();
+		}
+		return audio_clock;
+    }
+
     // Get the next displayed frame (based on speed and direction)
     std::shared_ptr<openshot::Frame> PlayerPrivate::getFrame()
     {
-	try {
-		// Get the next frame (based on speed)
-		if (video_position + speed >= 1 && video_position + speed <= reader->info.video_length)
-			video_position = video_position + speed;
-
-		if (frame && frame->number == video_position && video_position == last_video_position) {
-			// return cached frame
-			return frame;
+	// Get the next frame (based on speed)
+	if (video_position + speed >= 1 && video_position + speed <= reader->info.video_length)
+		video_position = video_position + speed;
+
+	if (frame && frame->number == video_position && video_position == last_video_position) {
+		// return cached frame
+		return frame;
+	}
+
+	// Update cache on which frame was retrieved
+	videoCache->setCurrentFramePosition(video_position);
+
+	// return frame from reader (before any frames prefetched by the cache thread), or NULL if it is missing
+	std::shared_ptr<openshot::Frame> next_frame;
+	reader->RequestFrame(video_position, REQUEST_VISIBLE)->TryWait(next_frame);
+	return next_frame;
+    }
+
+    // Show or hide the playback statistics
+    void PlayerPrivate::showStats(bool visible)
+    {
+		if (visible == show_stats)
+			return;
+		show_stats = visible;
+
+		// The stages are only timed while the statistics are shown (each span reads the clock twice)
+		if (visible) {
+			Tracer::Instance()->StartStageTimes();
+			stats_frames = 0;
+			stats_sample_time = 0.0;
+			stats_decode_time = 0;
+			stats_composite_time = 0;
+		} else {
+			Tracer::Instance()->StopStageTimes();
+			videoPlayback->setOverlay(std::vector<std::string>());
 		}
-		else
+    }
+
+    // Update the playback statistics (after presenting a frame)
+    void PlayerPrivate::updateStats(int64_t render_time)
+    {
+		stats_render_time = (stats_render_time == 0.0) ? render_time : 0.9 * stats_render_time + 0.1 * render_time;
+		stats_frames++;
+
+		// Sample the stage times twice per second (the split is averaged over the frames presented since then)
+		double now = Time::getMillisecondCounterHiRes();
+		if (!show_stats || now - stats_sample_time < 500.0)
+			return;
+		Tracer *tracer = Tracer::Instance();
+		int64_t decode_time = tracer->StageTime("decode") + tracer->StageTime("seek");
+		int64_t composite_time = tracer->StageTime("effects") + tracer->StageTime("composite");
+		double decode_ms = (decode_time - stats_decode_time) / 1000.0 / stats_frames;
+		double composite_ms = (composite_time - stats_composite_time) / 1000.0 / stats_frames;
+		stats_decode_time = decode_time;
+		stats_composite_time = composite_time;
+		stats_frames = 0;
+		stats_sample_time = now;
+
+		// The frames prefetched ahead of the playhead (in the direction of playback)
+		int64_t cached_ahead = std::max(int64_t(0), (videoCache->position - video_position) * ((speed < 0) ? -1 : 1));
+		int64_t underruns = reader->info.has_audio ? audioPlayback->getUnderruns() : 0;
+
+		Json::Value root;
+		root["frame"] = Json::Int64(video_position);
+		root["render_ms"] = stats_render_time;
+		root["decode_ms"] = decode_ms;
+		root["composite_ms"] = composite_ms;
+		root["cached_ahead"] = Json::Int64(cached_ahead);
+		root["cache_target"] = videoCache->max_frames;
+		root["dropped_frames"] = Json::Int64(dropped_frames);
+		root["audio_underruns"] = Json::Int64(underruns);
+		root["quality_level"] = quality_level;
 		{
-			// Update cache on which frame was retrieved
-			videoCache->setCurrentFramePosition(video_position);
+			const std::lock_guard<std::mutex> lock(stats_mutex);
+			stats = root;
+		}
+
+		std::vector<std::string> lines(5);
+		char line[128];
+		snprintf(line, sizeof(line), "frame %lld  render %.1f ms", (long long) video_position, stats_render_time);
+		lines[0] = line;
+		snprintf(line, sizeof(line), "decode %.1f ms  composite %.1f ms", decode_ms, composite_ms);
+		lines[1] = line;
+		snprintf(line, sizeof(line), "cache %lld / %d frames ahead", (long long) cached_ahead, videoCache->max_frames);
+		lines[2] = line;
+		snprintf(line, sizeof(line), "dropped %lld  audio underruns %lld", (long long) dropped_frames, (long long) underruns);
+		lines[3] = line;
+		snprintf(line, sizeof(line), "quality level %d", quality_level);
+		lines[4] = line;
+		videoPlayback->setOverlay(lines);
+    }
 
-			// return frame from reader
-			return reader->GetFrame(video_position);
+    // Lower or raise the preview quality (based on how long frames take to render)
+    void PlayerPrivate::adaptQuality(double frame_time, int64_t render_time)
+    {
+		if (!Settings::Instance()->ADAPTIVE_PREVIEW) {
+			setQuality(0);
+			return;
 		}
 
-    } catch (const ReaderClosed & e) {
-        // ...
-    } catch (const TooManySeeks & e) {
-        // ...
-    } catch (const OutOfBoundsFrame & e) {
-        // ...
+		// Follow the render time (without reacting to a single slow frame)
+		average_render_time = (average_render_time == 0.0) ? render_time : 0.9 * average_render_time + 0.1 * render_time;
+
+		if (average_render_time > frame_time) {
+			slow_frames++;
+			fast_frames = 0;
+		} else if (average_render_time < 0.5 * frame_time) {
+			fast_frames++;
+			slow_frames = 0;
+		} else {
+			slow_frames = 0;
+			fast_frames = 0;
+		}
+
+		// Lower the quality quickly, and raise it slowly (so it doesn't flip back and forth)
+		if (slow_frames >= 12 && quality_level < 3) {
+			setQuality(quality_level + 1);
+			slow_frames = 0;
+			average_render_time = 0.0;
+		} else if (fast_frames >= 48 && quality_level > 0) {
+			setQuality(quality_level - 1);
+			fast_frames = 0;
+			average_render_time = 0.0;
+		}
     }
-    return std::shared_ptr<openshot::Frame>();
+
+    // Set the preview quality
+    void PlayerPrivate::setQuality(int level)
+    {
+		if (level == quality_level)
+			return;
+
+		// Remember the resolution to restore (a timeline renders at its own size, other readers at the global size)
+		Settings *s = Settings::Instance();
+		Timeline *timeline = dynamic_cast<Timeline*>(reader);
+		if (quality_level == 0) {
+			original_max_width = timeline ? timeline->MaxWidth() : s->MAX_WIDTH;
+			original_max_height = timeline ? timeline->MaxHeight() : s->MAX_HEIGHT;
+		}
+
+		// Scale the preview resolution (unless no maximum size was set)
+		double scale = (level == 0) ? 1.0 : (level == 1) ? 0.75 : 0.5;
+		int max_width = round(original_max_width * scale);
+		int max_height = round(original_max_height * scale);
+		if (original_max_width > 0 && original_max_height > 0) {
+			if (timeline)
+				timeline->SetMaxSize(max_width, max_height);
+			else {
+				s->MAX_WIDTH = max_width;
+				s->MAX_HEIGHT = max_height;
+			}
+		}
+		s->SKIP_EFFECTS = (level >= 3);
+
+		// Decode faster, with a softer picture (skip the loop filter, and then the non-reference frames)
+		int decode_speed = std::min(level, 2);
+		if (timeline)
+			timeline->DecodeSpeed(decode_speed);
+		else
+			s->DECODE_SPEED = decode_speed;
+
+		ZmqLogger::Instance()->AppendDebugMethod("PlayerPrivate::setQuality", "level", level, "quality_level", quality_level, "max_width", max_width, "max_height", max_height, "SKIP_EFFECTS", s->SKIP_EFFECTS, "decode_speed", decode_speed);
+
+		// Frames cached at a lower quality are rendered again
+		bool raised = level < quality_level;
+		quality_level = level;
+		if (raised && reader && reader->GetCache())
+			reader->GetCache()->Clear();
     }
 
     // Start video/audio playback
@@ -185,6 +383,9 @@ namespace openshot
         if (audioPlayback->isThreadRunning() && reader->info.has_audio) audioPlayback->stopThread(timeOutMilliseconds);
         if (videoCache->isThreadRunning() && reader->info.has_video) videoCache->stopThread(timeOutMilliseconds);
         if (videoPlayback->isThreadRunning() && reader->info.has_video) videoPlayback->stopThread(timeOutMilliseconds);
+
+        // Restore the full quality (the preview settings are shared)
+        setQuality(0);
     }
 
 }
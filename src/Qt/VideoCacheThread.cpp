@@ -30,12 +30,16 @@
 
 #include "../../include/Qt/VideoCacheThread.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace openshot
 {
 	// Constructor
 	VideoCacheThread::VideoCacheThread()
 	: Thread("video-cache"), speed(1), is_playing(false), position(1)
 	, reader(NULL), max_frames(OPEN_MP_NUM_PROCESSORS * 2), current_display_frame(1)
+	, min_frames(OPEN_MP_NUM_PROCESSORS * 2), render_time(0.0), seek_position(0)
     {
     }
 
@@ -57,12 +61,20 @@ namespace openshot
     void VideoCacheThread::setCurrentFramePosition(int64_t current_frame_number)
     {
     	current_display_frame = current_frame_number;
+
+    	// Let the cache keep the frames around the playhead
+    	if (reader && reader->GetCache())
+    		reader->GetCache()->SetPlayhead(current_frame_number, (speed < 0) ? -1 : 1);
     }
 
 	// Seek the reader to a particular frame number
 	void VideoCacheThread::Seek(int64_t new_position)
 	{
-		position = new_position;
+		// The cache thread restarts prefetching from here (before its next request), and the waiting
+		// prefetch requests are no longer needed
+		seek_position = new_position;
+		if (reader)
+			reader->CancelFrameRequests(REQUEST_PREFETCH);
 	}
 
 	// Play the video
@@ -77,6 +89,24 @@ namespace openshot
 		is_playing = false;
 	}
 
+	// Adapt the number of frames to prefetch to the render time
+	void VideoCacheThread::update_max_frames(double frame_time)
+	{
+		// Prefetch more frames when they render slower than they are displayed (up to 4 times as many), so
+		// the slower frames don't stall playback
+		double slowness = std::min(4.0, std::max(1.0, render_time / frame_time));
+		int frames = int(ceil(min_frames * slowness));
+
+		// Keep the prefetched frames within half of the reader's cache (which also keeps the frames behind the playhead)
+		CacheBase *cache = reader->GetCache();
+		if (cache && cache->GetMaxBytes() > 0) {
+			int64_t frame_bytes = int64_t(reader->info.width) * reader->info.height * 4 +
+								  int64_t(reader->info.sample_rate / reader->info.fps.ToDouble()) * reader->info.channels * 4;
+			frames = std::max(1, (int) std::min(int64_t(frames), cache->GetMaxBytes() / 2 / std::max(int64_t(1), frame_bytes)));
+		}
+		max_frames = frames;
+	}
+
     // Start the thread
     void VideoCacheThread::run()
     {
@@ -85,35 +115,48 @@ namespace openshot
 		// Calculate sleep time for frame rate
 		double frame_time = (1000.0 / reader->info.fps.ToDouble());
 
-	    // Cache frames before the other threads need them
-	    // Cache frames up to the max frames
-	    while (speed == 1 && (position - current_display_frame) < max_frames)
-	    {
-	    	// Only cache up till the max_frames amount... then sleep
-			try
-			{
-				if (reader) {
-					ZmqLogger::Instance()->AppendDebugMethod("VideoCacheThread::run (cache frame)", "position", position, "current_display_frame", current_display_frame, "max_frames", max_frames, "needed_frames", (position - current_display_frame));
-
-					// Force the frame to be generated
-					reader->GetFrame(position);
-				}
-
-			}
-			catch (const OutOfBoundsFrame & e)
-			{
-				// Ignore out of bounds frame exceptions
-			}
-
-			// Is cache position behind current display frame?
-			if (position < current_display_frame) {
-				// Jump ahead
-				position = current_display_frame;
-			}
-
-	    	// Increment frame number
-	    	position++;
-	    }
+		// Cache the frames which are displayed next, before the other threads need them (in the direction and at
+		// the speed of playback, i.e. every 2nd frame at 2x, and backwards when rewinding). The frames are requested
+		// in order, so the reader can render them in batches.
+		while (reader && speed != 0 && !threadShouldExit())
+		{
+			int step = speed;
+			int direction = (step < 0) ? -1 : 1;
+			int64_t playhead = current_display_frame;
+
+			// Restart after a seek (the frames prefetched for the previous position are stale), and when the
+			// playhead passes the prefetched frames (or the direction of playback changes)
+			int64_t new_position = seek_position.exchange(0);
+			if (new_position > 0)
+				position = playhead = new_position;
+			else if ((position - playhead) * direction < 0)
+				position = playhead;
+
+			// Only cache up till the max_frames amount (or the end of the reader)... then sleep
+			int64_t next_position = position + step;
+			if ((next_position - playhead) * direction > int64_t(max_frames) * abs(step) ||
+				next_position < 1 || next_position > reader->info.video_length)
+				break;
+
+			ZmqLogger::Instance()->AppendDebugMethod("VideoCacheThread::run (cache frame)", "next_position", next_position, "current_display_frame", current_display_frame, "max_frames", max_frames, "speed", step, "render_time", render_time);
+
+			// Force the frame to be generated (and measure how long it takes). A visible frame requested
+			// by the player is rendered first. A missing frame is skipped, and a closed reader stops prefetching.
+			const Time t1 = Time::getCurrentTime();
+			std::shared_ptr<Frame> prefetched_frame;
+			if (reader->RequestFrame(next_position, REQUEST_PREFETCH)->TryWait(prefetched_frame) == FRAME_READER_CLOSED)
+				break;
+			const Time t2 = Time::getCurrentTime();
+			double frame_render_time = t2.toMilliseconds() - t1.toMilliseconds();
+			render_time = (render_time == 0.0) ? frame_render_time : (render_time * 0.9 + frame_render_time * 0.1);
+
+			// Increment frame number
+			position = next_position;
+		}
+
+		// Adapt the number of frames to prefetch
+		if (reader)
+			update_max_frames(frame_time);
 
 		// Sleep for 1 frame length
 		usleep(frame_time * 1000);
@@ -54,6 +54,13 @@ namespace openshot
     		return 0;
     }
 
+    // Set the lines of text drawn over each frame
+    void VideoPlaybackThread::setOverlay(const std::vector<std::string> &lines)
+    {
+	const std::lock_guard<std::mutex> lock(overlay_mutex);
+	overlay = lines;
+    }
+
     // Start the thread
     void VideoPlaybackThread::run()
     {
@@ -66,8 +73,13 @@ namespace openshot
 			// Debug
 			ZmqLogger::Instance()->AppendDebugMethod("VideoPlaybackThread::run (before render)", "frame->number", frame->number, "need_render", need_render);
 
-			// Render the frame to the screen
-			renderer->paint(frame);
+			// Render the frame to the screen (with the overlay, if any)
+			std::vector<std::string> lines;
+			{
+				const std::lock_guard<std::mutex> lock(overlay_mutex);
+				lines = overlay;
+			}
+			renderer->paint(frame, lines);
 		}
 
 		// Signal to other threads that the rendered event has completed
@@ -0,0 +1,212 @@
+/**
+ * @file
+ * @brief Source file for VideoRenderGLWidget class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../include/Qt/VideoRenderGLWidget.h"
+#include <QtGui/QOpenGLContext>
+#include <cstring>
+
+// Draw the texture over a quad which covers the viewport
+static const char *vertex_shader =
+    "attribute highp vec2 position;\n"
+    "varying mediump vec2 tex_coord;\n"
+    "void main() {\n"
+    "    tex_coord = vec2(position.x + 1.0, 1.0 - position.y) * 0.5;\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+// Frames are drawn over black (so premultiplied colors are used as-is, and others are multiplied by their alpha)
+static const char *fragment_shader =
+    "uniform sampler2D frame;\n"
+    "uniform mediump float premultiplied;\n"
+    "varying mediump vec2 tex_coord;\n"
+    "void main() {\n"
+    "    mediump vec4 color = texture2D(frame, tex_coord);\n"
+    "    gl_FragColor = vec4(color.rgb * mix(color.a, 1.0, premultiplied), 1.0);\n"
+    "}\n";
+
+static const GLfloat quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+VideoRenderGLWidget::VideoRenderGLWidget(QWidget *parent)
+    : QOpenGLWidget(parent), renderer(new VideoRenderer(this)), upload_index(0)
+    , use_upload_buffers(false), texture(0), texture_ready(false), texture_premultiplied(true)
+{
+    setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
+
+    // init aspect ratio settings (default values)
+    aspect_ratio.num = 16;
+    aspect_ratio.den = 9;
+    pixel_ratio.num = 1;
+    pixel_ratio.den = 1;
+
+    upload_buffers[0] = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+    upload_buffers[1] = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+
+    connect(renderer, SIGNAL(present(const QImage &)), this, SLOT(present(const QImage &)));
+}
+
+VideoRenderGLWidget::~VideoRenderGLWidget()
+{
+    // Release the GL objects with their context
+    makeCurrent();
+    if (texture)
+        glDeleteTextures(1, &texture);
+    upload_buffers[0].destroy();
+    upload_buffers[1].destroy();
+    doneCurrent();
+}
+
+VideoRenderer *VideoRenderGLWidget::GetRenderer() const
+{
+    return renderer;
+}
+
+void VideoRenderGLWidget::SetAspectRatio(openshot::Fraction new_aspect_ratio, openshot::Fraction new_pixel_ratio)
+{
+	aspect_ratio = new_aspect_ratio;
+	pixel_ratio = new_pixel_ratio;
+}
+
+QRect VideoRenderGLWidget::centeredViewport(int width, int height)
+{
+	// calculate aspect ratio
+	float aspectRatio = aspect_ratio.ToFloat() * pixel_ratio.ToFloat();
+	int heightFromWidth = (int) (width / aspectRatio);
+	int widthFromHeight = (int) (height * aspectRatio);
+
+	if (heightFromWidth <= height) {
+		return QRect(0,(height - heightFromWidth) / 2, width, heightFromWidth);
+	} else {
+		return QRect((width - widthFromHeight) / 2.0, 0, widthFromHeight, height);
+	}
+}
+
+void VideoRenderGLWidget::initializeGL()
+{
+    initializeOpenGLFunctions();
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader);
+    program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader);
+    program.bindAttributeLocation("position", 0);
+    program.link();
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    texture_size = QSize();
+    texture_ready = false;
+
+    // Pixel buffer objects need desktop OpenGL 2.1 (or OpenGL ES 3), otherwise frames are uploaded directly
+    QSurfaceFormat format = context()->format();
+    use_upload_buffers = context()->isOpenGLES() ? format.majorVersion() >= 3 : (format.majorVersion() > 2 || (format.majorVersion() == 2 && format.minorVersion() >= 1));
+    if (use_upload_buffers)
+        use_upload_buffers = upload_buffers[0].create() && upload_buffers[1].create();
+}
+
+void VideoRenderGLWidget::upload()
+{
+    // Frames are usually RGBA8888 already (which is uploaded without converting)
+    if (image.format() != QImage::Format_RGBA8888 && image.format() != QImage::Format_RGBA8888_Premultiplied)
+        image = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Allocate the texture when the frame size changes
+    if (image.size() != texture_size) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        texture_size = image.size();
+    }
+
+    int bytes = image.bytesPerLine() * image.height();
+    bool uploaded = false;
+    if (use_upload_buffers) {
+        // Alternate between two buffers, so this copy doesn't wait for the previous frame's upload
+        QOpenGLBuffer &buffer = upload_buffers[upload_index];
+        upload_index = 1 - upload_index;
+
+        buffer.bind();
+        buffer.allocate(bytes); // orphan the old storage (instead of waiting on it)
+        void *mapped = buffer.map(QOpenGLBuffer::WriteOnly);
+        if (mapped) {
+            memcpy(mapped, image.constBits(), bytes);
+            buffer.unmap();
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(), GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            uploaded = true;
+        }
+        buffer.release();
+    }
+
+    if (!uploaded)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+
+    texture_premultiplied = image.format() == QImage::Format_RGBA8888_Premultiplied;
+    texture_ready = true;
+
+    // The image is no longer needed (so its frame can be released)
+    image = QImage();
+}
+
+void VideoRenderGLWidget::paintGL()
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (!image.isNull())
+        upload();
+    if (!texture_ready || !program.isLinked())
+        return;
+
+    // maintain aspect ratio (the GL viewport is in device pixels, from the bottom left)
+    qreal ratio = devicePixelRatioF();
+    QRect viewport = centeredViewport(width(), height());
+    glViewport(viewport.x() * ratio, (height() - viewport.y() - viewport.height()) * ratio, viewport.width() * ratio, viewport.height() * ratio);
+
+    // Scale the frame to the viewport on the GPU
+    program.bind();
+    program.setUniformValue("frame", 0);
+    program.setUniformValue("premultiplied", texture_premultiplied ? 1.0f : 0.0f);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, quad);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableVertexAttribArray(0);
+    program.release();
+}
+
+void VideoRenderGLWidget::present(const QImage &m)
+{
+    image = m;
+    update();
+}
@@ -31,6 +31,12 @@
  */
 
 #include "../include/QtHtmlReader.h"
+#include "../include/Clip.h"
+#include "../include/TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <QImage>
 #include <QPainter>
 #include <QTextDocument>
@@ -55,59 +61,170 @@ QtHtmlReader::QtHtmlReader(int width, int height, int x_offset, int y_offset, Gr
 	Close();
 }
 
-// Open reader
-void QtHtmlReader::Open()
+QtHtmlReader::~QtHtmlReader()
 {
-	// Open reader if not already open
-	if (!is_open)
-	{
-		// create image
-		image = std::shared_ptr<QImage>(new QImage(width, height, QImage::Format_RGBA8888));
-		image->fill(QColor(background_color.c_str()));
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+}
 
-		//start painting
-		QPainter painter;
-		if (!painter.begin(image.get())) {
-			return;
-		}
+// The number of sizes each reader keeps a rendered image of (i.e. for the preview and export sizes)
+#define MAX_HTML_RENDERS 4
+
+// The properties of a rendered HTML document (copied, so a render can outlive its reader)
+struct HtmlDocument {
+	int width;
+	int height;
+	int x_offset;
+	int y_offset;
+	std::string html;
+	std::string css;
+	std::string background_color;
+	GravityType gravity;
+};
+
+// Render an HTML document at a size (the layout is done at the document's width and height, and scaled)
+static std::shared_ptr<QImage> render_html(const HtmlDocument &document, int render_width, int render_height)
+{
+	// create image
+	std::shared_ptr<QImage> image(new QImage(render_width, render_height, QImage::Format_RGBA8888));
+	image->fill(QColor(document.background_color.c_str()));
+
+	//start painting
+	QPainter painter;
+	if (!painter.begin(image.get())) {
+		return image;
+	}
 
-		//set background
-		painter.setBackground(QBrush(background_color.c_str()));
+	//set background
+	painter.setBackground(QBrush(document.background_color.c_str()));
 
-		//draw text
-		QTextDocument text_document;
+	// scale the document to the size of the image
+	painter.scale(render_width / double(document.width), render_height / double(document.height));
 
-		//disable redo/undo stack as not needed
-		text_document.setUndoRedoEnabled(false);
+	//draw text
+	QTextDocument text_document;
 
-		//create the HTML/CSS document
-		text_document.setTextWidth(width);
-		text_document.setDefaultStyleSheet(css.c_str());
-		text_document.setHtml(html.c_str());
+	//disable redo/undo stack as not needed
+	text_document.setUndoRedoEnabled(false);
 
-		int td_height = text_document.documentLayout()->documentSize().height();
+	//create the HTML/CSS document
+	text_document.setTextWidth(document.width);
+	text_document.setDefaultStyleSheet(document.css.c_str());
+	text_document.setHtml(document.html.c_str());
 
- 		if (gravity == GRAVITY_TOP_LEFT || gravity == GRAVITY_TOP || gravity == GRAVITY_TOP_RIGHT) {
- 			painter.translate(x_offset, y_offset);
- 		} else if (gravity == GRAVITY_LEFT || gravity == GRAVITY_CENTER || gravity == GRAVITY_RIGHT) {
- 			painter.translate(x_offset, (height - td_height) / 2 + y_offset);
- 		} else if (gravity == GRAVITY_BOTTOM_LEFT || gravity == GRAVITY_BOTTOM_RIGHT || gravity == GRAVITY_BOTTOM) {
- 			painter.translate(x_offset, height - td_height + y_offset);
- 		}
+	int td_height = text_document.documentLayout()->documentSize().height();
+	GravityType gravity = document.gravity;
 
- 		if (gravity == GRAVITY_TOP_LEFT || gravity == GRAVITY_LEFT || gravity == GRAVITY_BOTTOM_LEFT) {
- 			text_document.setDefaultTextOption(QTextOption(Qt::AlignLeft));
- 		} else if (gravity == GRAVITY_CENTER || gravity == GRAVITY_TOP || gravity == GRAVITY_BOTTOM) {
- 			text_document.setDefaultTextOption(QTextOption(Qt::AlignHCenter));
- 		} else if (gravity == GRAVITY_TOP_RIGHT || gravity == GRAVITY_RIGHT|| gravity == GRAVITY_BOTTOM_RIGHT) {
- 			text_document.setDefaultTextOption(QTextOption(Qt::AlignRight));
- 		}
+	if (gravity == GRAVITY_TOP_LEFT || gravity == GRAVITY_TOP || gravity == GRAVITY_TOP_RIGHT) {
+		painter.translate(document.x_offset, document.y_offset);
+	} else if (gravity == GRAVITY_LEFT || gravity == GRAVITY_CENTER || gravity == GRAVITY_RIGHT) {
+		painter.translate(document.x_offset, (document.height - td_height) / 2 + document.y_offset);
+	} else if (gravity == GRAVITY_BOTTOM_LEFT || gravity == GRAVITY_BOTTOM_RIGHT || gravity == GRAVITY_BOTTOM) {
+		painter.translate(document.x_offset, document.height - td_height + document.y_offset);
+	}
 
- 		// Draw image
-		text_document.drawContents(&painter);
+	if (gravity == GRAVITY_TOP_LEFT || gravity == GRAVITY_LEFT || gravity == GRAVITY_BOTTOM_LEFT) {
+		text_document.setDefaultTextOption(QTextOption(Qt::AlignLeft));
+	} else if (gravity == GRAVITY_CENTER || gravity == GRAVITY_TOP || gravity == GRAVITY_BOTTOM) {
+		text_document.setDefaultTextOption(QTextOption(Qt::AlignHCenter));
+	} else if (gravity == GRAVITY_TOP_RIGHT || gravity == GRAVITY_RIGHT|| gravity == GRAVITY_BOTTOM_RIGHT) {
+		text_document.setDefaultTextOption(QTextOption(Qt::AlignRight));
+	}
+
+	// Draw image
+	text_document.drawContents(&painter);
+
+	painter.end();
+	return image;
+}
+
+// Determine the size to render the HTML at
+void QtHtmlReader::render_size(int &render_width, int &render_height)
+{
+	// The size the compositor draws the image at (see QtImageReader::GetFrame)
+	RenderContext render_context = RenderContext::Current();
+	int max_width = render_context.max_width;
+	if (max_width <= 0)
+		max_width = width;
+	int max_height = render_context.max_height;
+	if (max_height <= 0)
+		max_height = height;
+
+	Clip* parent = (Clip*) GetClip();
+	if (parent) {
+		float max_scale_x = parent->scale_x.GetMaxPoint().co.Y;
+		float max_scale_y = parent->scale_y.GetMaxPoint().co.Y;
+		if (parent->scale == SCALE_FIT || parent->scale == SCALE_STRETCH) {
+			// Best fit or Stretch scaling (based on max timeline size * scaling keyframes)
+			max_width = std::max(float(max_width), max_width * max_scale_x);
+			max_height = std::max(float(max_height), max_height * max_scale_y);
+		} else if (parent->scale == SCALE_CROP) {
+			// Cropping scale mode (the image must cover the larger of the two ratios)
+			float ratio = std::max(max_width * std::max(1.0f, max_scale_x) / float(width), max_height * std::max(1.0f, max_scale_y) / float(height));
+			max_width = round(width * ratio);
+			max_height = round(height * ratio);
+		} else {
+			// No scaling, use the full size
+			max_width = width;
+			max_height = height;
+		}
+	}
 
-		painter.end();
+	// Only render smaller than the document (larger images would just be blurry)
+	QSize size(width, height);
+	if (max_width < width || max_height < height)
+		size.scale(std::min(max_width, width), std::min(max_height, height), Qt::KeepAspectRatio);
+	render_width = std::max(1, size.width());
+	render_height = std::max(1, size.height());
+}
 
+// Get the image rendered at a size (or start rendering it)
+QtHtmlReader::HtmlRender QtHtmlReader::render(int render_width, int render_height)
+{
+	std::lock_guard<std::mutex> lock(render_mutex);
+
+	// Use the image of the same size (and move it to the front, so it is evicted last)
+	for (std::list<HtmlRender>::iterator itr = renders.begin(); itr != renders.end(); ++itr) {
+		if (itr->width == render_width && itr->height == render_height) {
+			renders.splice(renders.begin(), renders, itr);
+			return *itr;
+		}
+	}
+
+	// Render the document on a background thread (with a copy of its properties)
+	HtmlDocument document = { width, height, x_offset, y_offset, html, css, background_color, gravity };
+	std::shared_ptr<std::promise<std::shared_ptr<QImage> > > promise(new std::promise<std::shared_ptr<QImage> >());
+	HtmlRender new_render;
+	new_render.width = render_width;
+	new_render.height = render_height;
+	new_render.image = promise->get_future().share();
+
+	// The image is rendered by a worker, or by the first thread which needs it (whichever starts first)
+	std::shared_ptr<std::atomic<bool> > started(new std::atomic<bool>(false));
+	new_render.start = [promise, started, document, render_width, render_height]() {
+		if (started->exchange(true))
+			return;
+		try {
+			promise->set_value(render_html(document, render_width, render_height));
+		} catch (...) {
+			promise->set_exception(std::current_exception());
+		}
+	};
+	TaskPool::Current()->Submit(new_render.start);
+
+	// Add the render (and remove the least recently used size)
+	renders.push_front(new_render);
+	if (renders.size() > MAX_HTML_RENDERS)
+		renders.pop_back();
+	return new_render.image;
+}
+
+// Open reader
+void QtHtmlReader::Open()
+{
+	// Open reader if not already open
+	if (!is_open)
+	{
 		// Update image properties
 		info.has_audio = false;
 		info.has_video = true;
@@ -134,6 +251,12 @@ void QtHtmlReader::Open()
 		info.display_ratio.num = size.num;
 		info.display_ratio.den = size.den;
 
+		// Start rendering the HTML (so opening a project with many titles doesn't wait for them)
+		int render_width = 0;
+		int render_height = 0;
+		render_size(render_width, render_height);
+		render(render_width, render_height);
+
 		// Mark as "open"
 		is_open = true;
 	}
@@ -148,8 +271,11 @@ void QtHtmlReader::Close()
 		// Mark as "closed"
 		is_open = false;
 
-		// Delete the image
-		image.reset();
+		// Delete the rendered images (renders which aren't finished are dropped once they finish)
+		{
+			std::lock_guard<std::mutex> lock(render_mutex);
+			renders.clear();
+		}
 
 		info.vcodec = "";
 		info.acodec = "";
@@ -159,8 +285,18 @@ void QtHtmlReader::Close()
 // Get an openshot::Frame object for a specific frame number of this reader.
 std::shared_ptr<Frame> QtHtmlReader::GetFrame(int64_t requested_frame)
 {
-	if (image)
+	if (is_open)
 	{
+		// Get the image rendered at the size the compositor needs
+		int render_width = 0;
+		int render_height = 0;
+		render_size(render_width, render_height);
+		HtmlRender rendered = render(render_width, render_height);
+
+		// Render the image on this thread, unless a worker already started it (then wait for the worker)
+		rendered.start();
+		std::shared_ptr<QImage> image = rendered.image.get();
+
 		// Create or get frame object
 		std::shared_ptr<Frame> image_frame(new Frame(requested_frame, image->size().width(), image->size().height(), background_color, 0, 2));
 
@@ -183,7 +319,7 @@ std::shared_ptr<Frame> QtHtmlReader::GetFrame(int64_t requested_frame)
 std::string QtHtmlReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -210,13 +346,7 @@ void QtHtmlReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 	
 	if (!success)
 		// Raise exception
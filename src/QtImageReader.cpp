@@ -42,6 +42,9 @@
 	#include "ResvgQt.h"
 #endif
 
+// The number of scaled images of each reader (i.e. for the preview and export sizes)
+#define MAX_SCALED_IMAGES 4
+
 using namespace openshot;
 
 QtImageReader::QtImageReader(std::string path) : path{QString::fromStdString(path)}, is_open(false)
@@ -62,6 +65,8 @@ QtImageReader::QtImageReader(std::string path, bool inspect_reader) : path{QStri
 
 QtImageReader::~QtImageReader()
 {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
 }
 
 // Open image file
@@ -140,10 +145,6 @@ void QtImageReader::Open()
 		info.display_ratio.num = size.num;
 		info.display_ratio.den = size.den;
 
-		// Set current max size
-		max_size.setWidth(info.width);
-		max_size.setHeight(info.height);
-
 		// Mark as "open"
 		is_open = true;
 	}
@@ -158,8 +159,9 @@ void QtImageReader::Close()
 		// Mark as "closed"
 		is_open = false;
 
-		// Delete the image
+		// Delete the image (and its scaled images)
 		image.reset();
+		scaled_images.clear();
 
 		info.vcodec = "";
 		info.acodec = "";
@@ -181,10 +183,11 @@ std::shared_ptr<Frame> QtImageReader::GetFrame(int64_t requested_frame)
 	// without losing quality. NOTE: We cannot go smaller than the timeline itself, or the add_layer timeline
 	// method will scale it back to timeline size before scaling it smaller again. This needs to be fixed in
 	// the future.
-	int max_width = Settings::Instance()->MAX_WIDTH;
+	RenderContext render_context = RenderContext::Current();
+	int max_width = render_context.max_width;
 	if (max_width <= 0)
 		max_width = info.width;
-	int max_height = Settings::Instance()->MAX_HEIGHT;
+	int max_height = render_context.max_height;
 	if (max_height <= 0)
 		max_height = info.height;
 
@@ -223,7 +226,53 @@ std::shared_ptr<Frame> QtImageReader::GetFrame(int64_t requested_frame)
 	}
 
 	// Scale image smaller (or use a previous scaled image)
-	if (!cached_image || (max_size.width() != max_width || max_size.height() != max_height)) {
+	std::shared_ptr<QImage> cached_image = get_scaled_image(max_width, max_height);
+
+	// Create or get frame object
+	std::shared_ptr<Frame> image_frame(new Frame(requested_frame, cached_image->width(), cached_image->height(), "#000000", Frame::GetSamplesPerFrame(requested_frame, info.fps, info.sample_rate, info.channels), info.channels));
+
+	// Add Image data to frame
+	image_frame->AddImage(cached_image);
+
+	// return frame object
+	return image_frame;
+}
+
+// Get the image scaled to a max size (from the cache of scaled images, or a larger scaled image)
+std::shared_ptr<QImage> QtImageReader::get_scaled_image(int max_width, int max_height)
+{
+	QSize max_size(max_width, max_height);
+
+	// Use the image scaled to the same max size (and move it to the front, so it is evicted last)
+	for (std::list<ScaledImage>::iterator itr = scaled_images.begin(); itr != scaled_images.end(); ++itr) {
+		if (itr->max_size == max_size) {
+			scaled_images.splice(scaled_images.begin(), scaled_images, itr);
+			return itr->image;
+		}
+	}
+
+	// The size of the new scaled image
+	QSize size(info.width, info.height);
+	size.scale(max_size, Qt::KeepAspectRatio);
+
+	// Find the smallest scaled image which is at least as large
+	std::shared_ptr<QImage> larger_image;
+	for (const ScaledImage &level : scaled_images) {
+		if (level.image->width() >= size.width() && level.image->height() >= size.height() &&
+			(!larger_image || level.image->width() < larger_image->width()))
+			larger_image = level.image;
+	}
+
+	std::shared_ptr<QImage> cached_image;
+	if (larger_image && larger_image->size() == size) {
+		// Share the image of the same size (i.e. max sizes with the same width, but a different height)
+		cached_image = larger_image;
+
+	} else if (larger_image) {
+		// Scale down the larger image (much faster than scaling the original image, or rasterizing an SVG again)
+		cached_image = std::shared_ptr<QImage>(new QImage(larger_image->scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)));
+
+	} else {
 #if USE_RESVG == 1
 		// If defined and found in CMake, utilize the libresvg for parsing
 		// SVG files and rasterizing them to QImages.
@@ -260,27 +309,24 @@ std::shared_ptr<Frame> QtImageReader::GetFrame(int64_t requested_frame)
 		cached_image = std::shared_ptr<QImage>(new QImage(image->scaled(max_width, max_height, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
 		cached_image = std::shared_ptr<QImage>(new QImage(cached_image->convertToFormat(QImage::Format_RGBA8888)));
 #endif
-
-		// Set max size (to later determine if max_size is changed)
-		max_size.setWidth(max_width);
-		max_size.setHeight(max_height);
 	}
 
-	// Create or get frame object
-	std::shared_ptr<Frame> image_frame(new Frame(requested_frame, cached_image->width(), cached_image->height(), "#000000", Frame::GetSamplesPerFrame(requested_frame, info.fps, info.sample_rate, info.channels), info.channels));
-
-	// Add Image data to frame
-	image_frame->AddImage(cached_image);
+	// Add the scaled image to the cache (and remove the least recently used image)
+	ScaledImage level;
+	level.max_size = max_size;
+	level.image = cached_image;
+	scaled_images.push_front(level);
+	if (scaled_images.size() > MAX_SCALED_IMAGES)
+		scaled_images.pop_back();
 
-	// return frame object
-	return image_frame;
+	return cached_image;
 }
 
 // Generate JSON string of this object
 std::string QtImageReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -300,13 +346,7 @@ void QtImageReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -172,6 +172,25 @@ namespace openshot
     	threads_started = false;
     }
 
+    // Show or hide the playback statistics over the video
+    void QtPlayer::ShowStats(bool visible)
+    {
+    	p->showStats(visible);
+    }
+
+    // Are the playback statistics shown
+    bool QtPlayer::StatsVisible()
+    {
+    	return p->show_stats;
+    }
+
+    // Get the latest playback statistics as a JSON string
+    std::string QtPlayer::Stats()
+    {
+    	const std::lock_guard<std::mutex> lock(p->stats_mutex);
+    	return WriteJson(p->stats);
+    }
+
     // Set the reader object
     void QtPlayer::Reader(openshot::ReaderBase *new_reader)
     {
@@ -31,13 +31,17 @@
  */
 
 #include "../include/QtTextReader.h"
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <QFontMetrics>
 #include <QImage>
 #include <QPainter>
 
 using namespace openshot;
 
 /// Default constructor (blank text)
-QtTextReader::QtTextReader() : width(1024), height(768), x_offset(0), y_offset(0), text(""), font(QFont("Arial", 10)), text_color("#ffffff"), background_color("#000000"), is_open(false), gravity(GRAVITY_CENTER)
+QtTextReader::QtTextReader() : width(1024), height(768), x_offset(0), y_offset(0), text(""), font(QFont("Arial", 10)), text_color("#ffffff"), background_color("#000000"), is_placed(false), is_open(false), gravity(GRAVITY_CENTER)
 {
 	// Open and Close the reader, to populate it's attributes (such as height, width, etc...)
 	Open();
@@ -45,13 +49,19 @@ QtTextReader::QtTextReader() : width(1024), height(768), x_offset(0), y_offset(0
 }
 
 QtTextReader::QtTextReader(int width, int height, int x_offset, int y_offset, GravityType gravity, std::string text, QFont font, std::string text_color, std::string background_color)
-: width(width), height(height), x_offset(x_offset), y_offset(y_offset), text(text), font(font), text_color(text_color), background_color(background_color), is_open(false), gravity(gravity)
+: width(width), height(height), x_offset(x_offset), y_offset(y_offset), text(text), font(font), text_color(text_color), background_color(background_color), is_placed(false), is_open(false), gravity(gravity)
 {
 	// Open and Close the reader, to populate it's attributes (such as height, width, etc...)
 	Open();
 	Close();
 }
 
+QtTextReader::~QtTextReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+}
+
 void QtTextReader::SetTextBackgroundColor(std::string color) {
 	text_background_color = color;
 
@@ -60,70 +70,154 @@ void QtTextReader::SetTextBackgroundColor(std::string color) {
 	Close();
 }
 
-// Open reader
-void QtTextReader::Open()
+// A rendered title (the image, and its position in the frame)
+struct RenderedTitle {
+	std::string key;
+	std::shared_ptr<QImage> image;
+	QPoint offset;
+	bool is_placed;
+};
+
+// The recently rendered titles of all readers, most recently used first (so re-opening a reader, i.e. when
+// its properties are set, or when a timeline is opened again, doesn't render its text again)
+static std::mutex title_cache_mutex;
+static std::list<RenderedTitle> title_cache;
+static int64_t title_cache_bytes = 0;
+
+// The size of the cache of rendered titles (full frame titles, with a background, are large)
+#define MAX_TITLE_CACHE_BYTES (64 * 1024 * 1024)
+
+// Get a key of all properties of the rendered text
+std::string QtTextReader::title_key()
 {
-	// Open reader if not already open
-	if (!is_open)
+	std::stringstream key;
+	key << width << "x" << height << "+" << x_offset << "+" << y_offset << "|" << gravity << "|" << font.toString().toStdString()
+		<< "|" << text_color << "|" << background_color << "|" << text_background_color << "|" << text;
+	return key.str();
+}
+
+// Render the text into a new image
+void QtTextReader::render_title()
+{
+	// Set gravity (map between OpenShot and Qt)
+	int align_flag = 0;
+	switch (gravity)
 	{
-		// create image
-		image = std::shared_ptr<QImage>(new QImage(width, height, QImage::Format_RGBA8888));
-		image->fill(QColor(background_color.c_str()));
+	case GRAVITY_TOP_LEFT:
+		align_flag = Qt::AlignLeft | Qt::AlignTop;
+		break;
+	case GRAVITY_TOP:
+		align_flag = Qt::AlignHCenter | Qt::AlignTop;
+		break;
+	case GRAVITY_TOP_RIGHT:
+		align_flag = Qt::AlignRight | Qt::AlignTop;
+		break;
+	case GRAVITY_LEFT:
+		align_flag = Qt::AlignVCenter | Qt::AlignLeft;
+		break;
+	case GRAVITY_CENTER:
+		align_flag = Qt::AlignCenter;
+		break;
+	case GRAVITY_RIGHT:
+		align_flag = Qt::AlignVCenter | Qt::AlignRight;
+		break;
+	case GRAVITY_BOTTOM_LEFT:
+		align_flag = Qt::AlignLeft | Qt::AlignBottom;
+		break;
+	case GRAVITY_BOTTOM:
+		align_flag = Qt::AlignHCenter | Qt::AlignBottom;
+		break;
+	case GRAVITY_BOTTOM_RIGHT:
+		align_flag = Qt::AlignRight | Qt::AlignBottom;
+		break;
+	}
 
-		QPainter painter;
-		if (!painter.begin(image.get())) {
-			return;
-		}
+	// With a transparent background, only the bounding box of the text is rendered (with a margin for
+	// antialiasing, and glyphs which overhang their box, i.e. italics)
+	QRect frame_rect(0, 0, width, height);
+	QRect render_rect = frame_rect;
+	is_placed = QColor(background_color.c_str()).alpha() == 0;
+	if (is_placed) {
+		QImage measure_image(1, 1, QImage::Format_RGBA8888);
+		QPainter measure_painter(&measure_image);
+		measure_painter.setFont(font);
+		QRect text_rect = measure_painter.boundingRect(x_offset, y_offset, width, height, align_flag, text.c_str());
+		measure_painter.end();
+		int margin = 2 + QFontMetrics(font).height() / 4;
+		render_rect = text_rect.adjusted(-margin, -margin, margin, margin) & frame_rect;
+		if (render_rect.isEmpty())
+			render_rect = QRect(0, 0, 1, 1);
+	}
+	image_offset = render_rect.topLeft();
 
-		// set background
-		if (!text_background_color.empty()) {
-			painter.setBackgroundMode(Qt::OpaqueMode);
-			painter.setBackground(QBrush(text_background_color.c_str()));
-		}
+	// create image
+	image = std::shared_ptr<QImage>(new QImage(render_rect.size(), QImage::Format_RGBA8888));
+	image->fill(QColor(background_color.c_str()));
 
-		// set font color
-		painter.setPen(QPen(text_color.c_str()));
+	QPainter painter;
+	if (!painter.begin(image.get())) {
+		return;
+	}
 
-		// set font
-		painter.setFont(font);
+	// Draw the text at its position in the frame
+	painter.translate(-render_rect.topLeft());
 
-		// Set gravity (map between OpenShot and Qt)
-		int align_flag = 0;
-		switch (gravity)
-		{
-		case GRAVITY_TOP_LEFT:
-			align_flag = Qt::AlignLeft | Qt::AlignTop;
-			break;
-		case GRAVITY_TOP:
-			align_flag = Qt::AlignHCenter | Qt::AlignTop;
-			break;
-		case GRAVITY_TOP_RIGHT:
-			align_flag = Qt::AlignRight | Qt::AlignTop;
-			break;
-		case GRAVITY_LEFT:
-			align_flag = Qt::AlignVCenter | Qt::AlignLeft;
-			break;
-		case GRAVITY_CENTER:
-			align_flag = Qt::AlignCenter;
-			break;
-		case GRAVITY_RIGHT:
-			align_flag = Qt::AlignVCenter | Qt::AlignRight;
-			break;
-		case GRAVITY_BOTTOM_LEFT:
-			align_flag = Qt::AlignLeft | Qt::AlignBottom;
-			break;
-		case GRAVITY_BOTTOM:
-			align_flag = Qt::AlignHCenter | Qt::AlignBottom;
-			break;
-		case GRAVITY_BOTTOM_RIGHT:
-			align_flag = Qt::AlignRight | Qt::AlignBottom;
-			break;
-		}
+	// set background
+	if (!text_background_color.empty()) {
+		painter.setBackgroundMode(Qt::OpaqueMode);
+		painter.setBackground(QBrush(text_background_color.c_str()));
+	}
+
+	// set font color
+	painter.setPen(QPen(text_color.c_str()));
+
+	// set font
+	painter.setFont(font);
+
+	// Draw image
+	painter.drawText(x_offset, y_offset, width, height, align_flag, text.c_str());
 
-		// Draw image
-		painter.drawText(x_offset, y_offset, width, height, align_flag, text.c_str());
+	painter.end();
+}
 
-		painter.end();
+// Open reader
+void QtTextReader::Open()
+{
+	// Open reader if not already open
+	if (!is_open)
+	{
+		// Use a rendered title with the same properties (or render the text)
+		std::string key = title_key();
+		image.reset();
+		{
+			std::lock_guard<std::mutex> lock(title_cache_mutex);
+			for (std::list<RenderedTitle>::iterator itr = title_cache.begin(); itr != title_cache.end(); ++itr) {
+				if (itr->key == key) {
+					title_cache.splice(title_cache.begin(), title_cache, itr);
+					image = itr->image;
+					image_offset = itr->offset;
+					is_placed = itr->is_placed;
+					break;
+				}
+			}
+		}
+		if (!image) {
+			render_title();
+
+			// Add the title to the cache (and remove the least recently used titles)
+			RenderedTitle title;
+			title.key = key;
+			title.image = image;
+			title.offset = image_offset;
+			title.is_placed = is_placed;
+			std::lock_guard<std::mutex> lock(title_cache_mutex);
+			title_cache.push_front(title);
+			title_cache_bytes += image->byteCount();
+			while (title_cache.size() > 1 && title_cache_bytes > MAX_TITLE_CACHE_BYTES) {
+				title_cache_bytes -= title_cache.back().image->byteCount();
+				title_cache.pop_back();
+			}
+		}
 
 		// Update image properties
 		info.has_audio = false;
@@ -179,10 +273,13 @@ std::shared_ptr<Frame> QtTextReader::GetFrame(int64_t requested_frame)
 	if (image)
 	{
 		// Create or get frame object
-		std::shared_ptr<Frame> image_frame(new Frame(requested_frame, image->size().width(), image->size().height(), background_color, 0, 2));
+		std::shared_ptr<Frame> image_frame(new Frame(requested_frame, width, height, background_color, 0, 2));
 
-		// Add Image data to frame
-		image_frame->AddImage(image);
+		// Add Image data to frame (a title is placed in the frame, so the compositor only draws the text)
+		if (is_placed)
+			image_frame->AddPlacedImage(width, height, image, image_offset);
+		else
+			image_frame->AddImage(image);
 
 		// return frame object
 		return image_frame;
@@ -200,7 +297,7 @@ std::shared_ptr<Frame> QtTextReader::GetFrame(int64_t requested_frame)
 std::string QtTextReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -229,13 +326,7 @@ void QtTextReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
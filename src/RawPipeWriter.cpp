@@ -0,0 +1,307 @@
+/**
+ * @file
+ * @brief Source file for RawPipeWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/RawPipeWriter.h"
+
+using namespace openshot;
+
+RawPipeWriter::RawPipeWriter(std::string video_path, std::string audio_path) :
+		video_path(video_path), audio_path(audio_path), video_fd(-1), audio_fd(-1), is_fd_owned(true), is_open(false),
+		frame_headers(false), interleaved_audio(false), video_format(RAW_VIDEO_YUV420P), img_convert_ctx(NULL),
+		convert_width(0), convert_height(0)
+{
+	// Disable audio & video (so they can be independently enabled)
+	info.has_audio = false;
+	info.has_video = false;
+}
+
+RawPipeWriter::RawPipeWriter(int video_fd, int audio_fd) :
+		video_fd(video_fd), audio_fd(audio_fd < 0 ? video_fd : audio_fd), is_fd_owned(false), is_open(false),
+		frame_headers(false), interleaved_audio(false), video_format(RAW_VIDEO_YUV420P), img_convert_ctx(NULL),
+		convert_width(0), convert_height(0)
+{
+	// Disable audio & video (so they can be independently enabled)
+	info.has_audio = false;
+	info.has_video = false;
+}
+
+RawPipeWriter::~RawPipeWriter()
+{
+	Close();
+}
+
+// Set video options
+void RawPipeWriter::SetVideoOptions(bool has_video, RawVideoFormat format, Fraction fps, int width, int height)
+{
+	if (has_video && format == RAW_VIDEO_YUV420P && (width % 2 != 0 || height % 2 != 0))
+		throw InvalidOptions("The width and height of YUV 4:2:0 frames must be even.", video_path);
+
+	info.has_video = has_video;
+	video_format = format;
+	info.fps = fps;
+	info.video_timebase = fps.Reciprocal();
+	info.width = width;
+	info.height = height;
+	info.pixel_format = format == RAW_VIDEO_RGBA ? AV_PIX_FMT_RGBA : AV_PIX_FMT_YUV420P;
+	info.vcodec = "rawvideo";
+}
+
+// Set audio options
+void RawPipeWriter::SetAudioOptions(bool has_audio, int sample_rate, int channels, bool interleaved)
+{
+	info.has_audio = has_audio;
+	info.sample_rate = sample_rate;
+	info.channels = channels;
+	info.acodec = interleaved ? "pcm_f32le" : "pcm_f32le (planar)";
+	interleaved_audio = interleaved;
+}
+
+// Open the writer (and the files or named pipes)
+void RawPipeWriter::Open()
+{
+	if (is_open)
+		return;
+
+	if (is_fd_owned) {
+		// Open the files (or named pipes, which blocks until a consumer opens them)
+		video_fd = open(video_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (video_fd < 0)
+			throw InvalidFile("Could not open or write file.", video_path);
+		audio_fd = video_fd;
+		if (!audio_path.empty() && audio_path != video_path) {
+			audio_fd = open(audio_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (audio_fd < 0) {
+				close(video_fd);
+				video_fd = -1;
+				throw InvalidFile("Could not open or write file.", audio_path);
+			}
+		}
+	}
+
+	// Frames can only be told apart by their headers, if the audio and video share a descriptor
+	if (info.has_audio && info.has_video && audio_fd == video_fd)
+		frame_headers = true;
+
+	is_open = true;
+}
+
+// Add the rows of an image plane to a list of buffers
+void RawPipeWriter::add_plane(std::vector<struct iovec> &buffers, const uint8_t *data, int linesize, int row_size, int rows)
+{
+	struct iovec buffer;
+	if (linesize == row_size) {
+		// Contiguous rows
+		buffer.iov_base = (void *) data;
+		buffer.iov_len = size_t(row_size) * rows;
+		buffers.push_back(buffer);
+		return;
+	}
+	for (int row = 0; row < rows; row++) {
+		buffer.iov_base = (void *) (data + int64_t(row) * linesize);
+		buffer.iov_len = row_size;
+		buffers.push_back(buffer);
+	}
+}
+
+// Write all buffers to a descriptor (retrying partial writes)
+void RawPipeWriter::write_buffers(int fd, std::vector<struct iovec> &buffers)
+{
+	size_t index = 0;
+	while (index < buffers.size()) {
+		int count = std::min(int(buffers.size() - index), IOV_MAX);
+		ssize_t written = writev(fd, &buffers[index], count);
+		if (written < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			throw InvalidFile("Could not write frame (" + std::string(strerror(errno)) + ").", video_path);
+		}
+
+		// Skip the written buffers (and the written part of a partially written buffer)
+		while (written > 0 && index < buffers.size()) {
+			if (size_t(written) >= buffers[index].iov_len) {
+				written -= buffers[index].iov_len;
+				index++;
+			} else {
+				buffers[index].iov_base = (char *) buffers[index].iov_base + written;
+				buffers[index].iov_len -= written;
+				written = 0;
+			}
+		}
+		while (index < buffers.size() && buffers[index].iov_len == 0)
+			index++;
+	}
+}
+
+// Write a frame to the pipes
+void RawPipeWriter::WriteFrame(std::shared_ptr<Frame> frame)
+{
+	// Check for open writer (or throw exception)
+	if (!is_open)
+		throw WriterClosed("The RawPipeWriter is closed.  Call Open() before calling this method.", video_path);
+
+	std::vector<struct iovec> video_buffers;
+	std::vector<struct iovec> audio_buffers;
+	RawFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "OSRF", 4);
+	header.number = frame->number;
+
+	// Video (kept alive until the frame is written)
+	std::shared_ptr<QImage> image;
+	std::shared_ptr<FramePlanes> planes;
+	if (info.has_video) {
+		header.width = info.width;
+		header.height = info.height;
+		header.format = video_format;
+
+		if (video_format == RAW_VIDEO_YUV420P) {
+			// Write the decoded planes of an unchanged frame (if they already match)
+			planes = frame->GetPlanes();
+			if (planes && planes->pixel_format == AV_PIX_FMT_YUV420P && planes->width == info.width && planes->height == info.height) {
+				add_plane(video_buffers, planes->data[0], planes->linesize[0], info.width, info.height);
+				add_plane(video_buffers, planes->data[1], planes->linesize[1], info.width / 2, info.height / 2);
+				add_plane(video_buffers, planes->data[2], planes->linesize[2], info.width / 2, info.height / 2);
+			} else {
+				// Convert the image (with a reusable scaler and buffer)
+				image = frame->GetImage();
+				AVPixelFormat source_format = image->format() == QImage::Format_RGBA8888 ? AV_PIX_FMT_RGBA : AV_PIX_FMT_BGRA;
+				if (image->format() != QImage::Format_RGBA8888 && image->format() != QImage::Format_ARGB32 &&
+					image->format() != QImage::Format_ARGB32_Premultiplied) {
+					image = std::make_shared<QImage>(image->convertToFormat(QImage::Format_RGBA8888));
+					source_format = AV_PIX_FMT_RGBA;
+				}
+				if (!img_convert_ctx || convert_width != image->width() || convert_height != image->height()) {
+					if (img_convert_ctx)
+						sws_freeContext(img_convert_ctx);
+					img_convert_ctx = sws_getContext(image->width(), image->height(), source_format, info.width, info.height,
+													 AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+					convert_width = image->width();
+					convert_height = image->height();
+				}
+				yuv_buffer.resize(size_t(info.width) * info.height * 3 / 2);
+				uint8_t *yuv_data[4] = { &yuv_buffer[0], &yuv_buffer[0] + info.width * info.height,
+										 &yuv_buffer[0] + info.width * info.height * 5 / 4, NULL };
+				int yuv_linesize[4] = { info.width, info.width / 2, info.width / 2, 0 };
+				const uint8_t *source_data[4] = { (const uint8_t *) image->constBits(), NULL, NULL, NULL };
+				int source_linesize[4] = { image->bytesPerLine(), 0, 0, 0 };
+				sws_scale(img_convert_ctx, source_data, source_linesize, 0, image->height(), yuv_data, yuv_linesize);
+				add_plane(video_buffers, &yuv_buffer[0], info.width, info.width, info.height * 3 / 2);
+			}
+		} else {
+			// Write the image's pixels (converted and scaled only if needed)
+			image = frame->GetImage();
+			if (image->width() != info.width || image->height() != info.height)
+				image = std::make_shared<QImage>(image->scaled(info.width, info.height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+			if (image->format() != QImage::Format_RGBA8888)
+				image = std::make_shared<QImage>(image->convertToFormat(QImage::Format_RGBA8888));
+			add_plane(video_buffers, image->constBits(), image->bytesPerLine(), info.width * 4, info.height);
+		}
+		for (size_t index = 0; index < video_buffers.size(); index++)
+			header.video_size += video_buffers[index].iov_len;
+	}
+
+	// Audio (planar samples are written straight from the frame)
+	if (info.has_audio) {
+		int samples = frame->GetAudioSamplesCount();
+		int frame_channels = frame->GetAudioChannelsCount();
+		header.sample_rate = info.sample_rate;
+		header.channels = info.channels;
+		header.samples = samples;
+		header.audio_size = int32_t(sizeof(float)) * samples * info.channels;
+
+		if (interleaved_audio) {
+			audio_buffer.assign(size_t(samples) * info.channels, 0.0f);
+			for (int channel = 0; channel < info.channels && channel < frame_channels; channel++) {
+				float *channel_samples = frame->GetAudioSamples(channel);
+				for (int sample = 0; sample < samples; sample++)
+					audio_buffer[size_t(sample) * info.channels + channel] = channel_samples[sample];
+			}
+			struct iovec buffer = { audio_buffer.empty() ? NULL : &audio_buffer[0], audio_buffer.size() * sizeof(float) };
+			audio_buffers.push_back(buffer);
+		} else {
+			if (frame_channels < info.channels)
+				// Silence for missing channels
+				audio_buffer.assign(samples, 0.0f);
+			for (int channel = 0; channel < info.channels; channel++) {
+				float *channel_samples = channel < frame_channels ? frame->GetAudioSamples(channel) : &audio_buffer[0];
+				struct iovec buffer = { channel_samples, size_t(samples) * sizeof(float) };
+				audio_buffers.push_back(buffer);
+			}
+		}
+	}
+
+	// Write the header, video, and audio
+	if (frame_headers) {
+		struct iovec buffer = { &header, sizeof(header) };
+		video_buffers.insert(video_buffers.begin(), buffer);
+	}
+	if (audio_fd == video_fd) {
+		video_buffers.insert(video_buffers.end(), audio_buffers.begin(), audio_buffers.end());
+		write_buffers(video_fd, video_buffers);
+	} else {
+		write_buffers(video_fd, video_buffers);
+		write_buffers(audio_fd, audio_buffers);
+	}
+}
+
+// Write a block of frames from a reader
+void RawPipeWriter::WriteFrame(ReaderBase* reader, int64_t start, int64_t length)
+{
+	// Loop through each frame (and encoded it)
+	for (int64_t number = start; number <= length; number++)
+	{
+		// Get the frame
+		std::shared_ptr<Frame> f = reader->GetFrame(number);
+
+		// Encode frame
+		WriteFrame(f);
+	}
+}
+
+// Close the writer (and any descriptors it opened)
+void RawPipeWriter::Close()
+{
+	if (!is_open)
+		return;
+
+	if (is_fd_owned) {
+		if (audio_fd >= 0 && audio_fd != video_fd)
+			close(audio_fd);
+		if (video_fd >= 0)
+			close(video_fd);
+		video_fd = -1;
+		audio_fd = -1;
+	}
+	if (img_convert_ctx) {
+		sws_freeContext(img_convert_ctx);
+		img_convert_ctx = NULL;
+	}
+	is_open = false;
+}
@@ -0,0 +1,510 @@
+/**
+ * @file
+ * @brief Source file for RawVideoReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/RawVideoReader.h"
+#include "../include/FFmpegScaler.h"
+#include "../include/OpenMPUtilities.h"
+#include "../include/ZmqLogger.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace openshot;
+
+// Get the pixel format of a YUV4MPEG2 colorspace (the C tag, which is 4:2:0 if missing)
+static PixelFormat y4m_pixel_format(const std::string &colorspace) {
+	if (colorspace.empty() || colorspace.compare(0, 3, "420") == 0)
+		return (colorspace == "420p10") ? AV_PIX_FMT_YUV420P10LE : AV_PIX_FMT_YUV420P;
+	if (colorspace == "422")
+		return AV_PIX_FMT_YUV422P;
+	if (colorspace == "422p10")
+		return AV_PIX_FMT_YUV422P10LE;
+	if (colorspace == "444")
+		return AV_PIX_FMT_YUV444P;
+	if (colorspace == "444p10")
+		return AV_PIX_FMT_YUV444P10LE;
+	if (colorspace == "444alpha")
+		return AV_PIX_FMT_YUVA444P;
+	if (colorspace == "mono")
+		return AV_PIX_FMT_GRAY8;
+	return AV_PIX_FMT_NONE;
+}
+
+// Get the pixel format of a raw video format
+static PixelFormat raw_pixel_format(int format) {
+	return (format == RAW_VIDEO_RGBA) ? AV_PIX_FMT_RGBA : AV_PIX_FMT_YUV420P;
+}
+
+// Get the image format (and the pixel format it is converted to) of the frame images of planes. Planes with alpha
+// aren't premultiplied, so their images are straight ARGB32 when frame images are premultiplied.
+static QImage::Format image_format(int pixel_format, PixelFormat &image_pixel_format) {
+	QImage::Format format = Frame::ImageFormat();
+	image_pixel_format = AV_PIX_FMT_RGBA;
+	if (format == QImage::Format_ARGB32_Premultiplied) {
+		const AVPixFmtDescriptor *pixel_desc = av_pix_fmt_desc_get((PixelFormat) pixel_format);
+		image_pixel_format = PIX_FMT_RGB32;
+		if (pixel_desc && (pixel_desc->flags & AV_PIX_FMT_FLAG_ALPHA))
+			format = QImage::Format_ARGB32;
+	}
+#ifdef USE_RGBA64_IMAGES
+	if (format == QImage::Format_RGBA64)
+		image_pixel_format = AV_PIX_FMT_RGBA64;
+#endif
+	return format;
+}
+
+// Release the mapped file of an image (when the image is freed)
+static void release_mapping(void *info) {
+	delete (std::shared_ptr<void> *) info;
+}
+
+RawVideoReader::RawVideoReader(std::string path, bool inspect_reader) :
+		path(path), is_headerless(false), raw_format(RAW_VIDEO_YUV420P), raw_width(0), raw_height(0),
+		interleaved_audio(false), data(NULL), data_size(0), is_open(false)
+{
+	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
+	if (inspect_reader) {
+		Open();
+		Close();
+	}
+}
+
+RawVideoReader::RawVideoReader(std::string path, RawVideoFormat format, Fraction fps, int width, int height) :
+		path(path), is_headerless(true), raw_format(format), raw_width(width), raw_height(height),
+		interleaved_audio(false), data(NULL), data_size(0), is_open(false)
+{
+	info.fps = fps;
+
+	// Open and Close the reader, to populate its attributes (such as height, width, etc...)
+	Open();
+	Close();
+}
+
+RawVideoReader::~RawVideoReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+	Close();
+}
+
+// Index the frames of a YUV4MPEG2 file
+void RawVideoReader::index_y4m()
+{
+	// The header is a line of space separated tags (i.e. "YUV4MPEG2 W1920 H1080 F24:1 Ip A1:1 C420jpeg")
+	const uint8_t *line_end = (const uint8_t *) memchr(data, '\n', data_size);
+	if (!line_end)
+		throw InvalidFile("The YUV4MPEG2 header is incomplete.", path);
+	std::istringstream tags(std::string((const char *) data, line_end - data));
+	std::string tag;
+	std::string colorspace;
+	int width = 0;
+	int height = 0;
+	tags >> tag;
+	while (tags >> tag) {
+		char name = tag[0];
+		std::string value = tag.substr(1);
+		if (name == 'W')
+			width = atoi(value.c_str());
+		else if (name == 'H')
+			height = atoi(value.c_str());
+		else if (name == 'C')
+			colorspace = value;
+		else if (name == 'F' || name == 'A') {
+			int num = 0;
+			int den = 0;
+			if (sscanf(value.c_str(), "%d:%d", &num, &den) == 2 && num > 0 && den > 0) {
+				if (name == 'F')
+					info.fps = Fraction(num, den);
+				else
+					info.pixel_ratio = Fraction(num, den);
+			}
+		}
+		else if (name == 'I') {
+			info.interlaced_frame = (value == "t" || value == "b");
+			info.top_field_first = (value != "b");
+		}
+	}
+
+	PixelFormat pixel_format = y4m_pixel_format(colorspace);
+	if (width <= 0 || height <= 0 || pixel_format == AV_PIX_FMT_NONE)
+		throw InvalidFile("The YUV4MPEG2 size or colorspace is not supported.", path);
+
+	// Each frame is a "FRAME" line (which can have tags), followed by its planes
+	int64_t frame_size = AV_GET_IMAGE_SIZE(pixel_format, width, height);
+	int64_t offset = line_end - data + 1;
+	while (offset + 5 < data_size && memcmp(data + offset, "FRAME", 5) == 0) {
+		line_end = (const uint8_t *) memchr(data + offset, '\n', data_size - offset);
+		if (!line_end || (line_end - data) + 1 + frame_size > data_size)
+			break;
+		FrameEntry entry = { (line_end - data) + 1, -1, width, height, pixel_format, 0, 0, 0 };
+		frames.push_back(entry);
+		offset = entry.video_offset + frame_size;
+	}
+}
+
+// Index the frames of a file of openshot::RawFrameHeader frames
+void RawVideoReader::index_frame_headers()
+{
+	int64_t offset = 0;
+	RawFrameHeader header;
+	while (offset + (int64_t) sizeof(header) <= data_size) {
+		memcpy(&header, data + offset, sizeof(header));
+		if (memcmp(header.magic, "OSRF", 4) != 0)
+			break;
+
+		// A frame which is cut off (i.e. by a writer which crashed) ends the file
+		int64_t video_offset = offset + sizeof(header);
+		int64_t audio_offset = video_offset + header.video_size;
+		if (header.video_size < 0 || header.audio_size < 0 || audio_offset + header.audio_size > data_size)
+			break;
+		bool has_video = header.width > 0 && header.height > 0 &&
+						 header.video_size >= AV_GET_IMAGE_SIZE(raw_pixel_format(header.format), header.width, header.height);
+		bool has_audio = header.channels > 0 && header.samples > 0 &&
+						 header.audio_size >= (int64_t) sizeof(float) * header.samples * header.channels;
+		FrameEntry entry = { has_video ? video_offset : -1, has_audio ? audio_offset : -1, header.width, header.height,
+							 raw_pixel_format(header.format), header.sample_rate, header.channels, header.samples };
+		frames.push_back(entry);
+		offset = audio_offset + header.audio_size;
+	}
+	if (frames.empty())
+		throw InvalidFile("The file has no frame headers.", path);
+}
+
+// Index the frames of a headerless file
+void RawVideoReader::index_headerless()
+{
+	PixelFormat pixel_format = raw_pixel_format(raw_format);
+	if (raw_width <= 0 || raw_height <= 0)
+		throw InvalidOptions("The width and height of headerless frames are needed.", path);
+	int64_t frame_size = AV_GET_IMAGE_SIZE(pixel_format, raw_width, raw_height);
+	for (int64_t offset = 0; offset + frame_size <= data_size; offset += frame_size) {
+		FrameEntry entry = { offset, -1, raw_width, raw_height, pixel_format, 0, 0, 0 };
+		frames.push_back(entry);
+	}
+}
+
+// Open the file (mapping it, and indexing its frames)
+void RawVideoReader::Open()
+{
+	// Open reader if not already open
+	if (is_open)
+		return;
+
+#ifdef _WIN32
+	throw InvalidFile("Raw video files are memory-mapped with POSIX calls, which are not available on Windows.", path);
+#else
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		throw InvalidFile("File could not be opened.", path);
+	struct stat file_info;
+	if (fstat(descriptor, &file_info) != 0 || file_info.st_size <= 0) {
+		close(descriptor);
+		throw InvalidFile("File is empty.", path);
+	}
+	size_t size = file_info.st_size;
+	void *address = mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	if (address == MAP_FAILED)
+		throw InvalidFile("File could not be mapped.", path);
+	mapping = std::shared_ptr<void>(address, [size](void *address) { munmap(address, size); });
+	data = (const uint8_t *) address;
+	data_size = size;
+#endif
+
+	// Index the frames
+	frames.clear();
+	try {
+		if (is_headerless)
+			index_headerless();
+		else if (data_size >= 10 && memcmp(data, "YUV4MPEG2 ", 10) == 0)
+			index_y4m();
+		else
+			index_frame_headers();
+	} catch (...) {
+		mapping.reset();
+		data = NULL;
+		throw;
+	}
+	if (frames.empty()) {
+		mapping.reset();
+		data = NULL;
+		throw InvalidFile("The file has no complete frames.", path);
+	}
+
+	// Update the properties (from the first frame)
+	const FrameEntry &first = frames.front();
+	info.has_video = first.video_offset >= 0;
+	info.has_audio = first.audio_offset >= 0;
+	info.has_single_image = false;
+	info.file_size = data_size;
+	info.vcodec = "rawvideo";
+	info.width = first.width;
+	info.height = first.height;
+	info.pixel_format = first.pixel_format;
+	if (info.pixel_ratio.num <= 0 || info.pixel_ratio.den <= 0)
+		info.pixel_ratio = Fraction(1, 1);
+	if (info.fps.num <= 0 || info.fps.den <= 0)
+		info.fps = Fraction(30, 1);
+	info.video_timebase = info.fps.Reciprocal();
+	info.video_length = frames.size();
+	info.duration = info.video_length / info.fps.ToDouble();
+	if (info.has_audio) {
+		info.acodec = interleaved_audio ? "pcm_f32le" : "pcm_f32le (planar)";
+		info.sample_rate = first.sample_rate;
+		info.channels = first.channels;
+		info.channel_layout = (first.channels == 1) ? LAYOUT_MONO : LAYOUT_STEREO;
+		info.audio_timebase = Fraction(1, first.sample_rate);
+	}
+
+	// Calculate the DAR (display aspect ratio)
+	Fraction display_size(info.width * info.pixel_ratio.num, info.height * info.pixel_ratio.den);
+	display_size.Reduce();
+	info.display_ratio.num = display_size.num;
+	info.display_ratio.den = display_size.den;
+
+	// The frames are read from the page cache, so only the frames being used are kept
+	final_cache.SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+
+	ZmqLogger::Instance()->AppendDebugMethod("RawVideoReader::Open", "frames", frames.size(), "width", info.width, "height", info.height, "pixel_format", info.pixel_format);
+
+	// Mark as "open"
+	is_open = true;
+}
+
+// Close the file
+void RawVideoReader::Close()
+{
+	// Close all objects, if reader is 'open'
+	if (is_open)
+	{
+		// Mark as "closed"
+		is_open = false;
+
+		// The frames which point into the file keep it mapped
+		final_cache.Clear();
+		mapping.reset();
+		data = NULL;
+		data_size = 0;
+		frames.clear();
+
+		info.vcodec = "";
+		info.acodec = "";
+	}
+}
+
+// Ask the kernel to read ahead the pages of a frame
+void RawVideoReader::read_ahead(int64_t number)
+{
+#ifndef _WIN32
+	if (number < 1 || number > int64_t(frames.size()))
+		return;
+	const FrameEntry &entry = frames[number - 1];
+	int64_t start = (entry.video_offset >= 0) ? entry.video_offset : entry.audio_offset;
+	if (start < 0)
+		return;
+	int64_t end = (number < int64_t(frames.size())) ? std::max(frames[number].video_offset, frames[number].audio_offset) : data_size;
+	int64_t page_size = sysconf(_SC_PAGESIZE);
+	int64_t page_start = start / page_size * page_size;
+	madvise((void *) (data + page_start), std::max(int64_t(0), std::min(end, data_size) - page_start), MADV_WILLNEED);
+#endif
+}
+
+// Create a frame pointing into the mapped file
+std::shared_ptr<Frame> RawVideoReader::read_frame(int64_t number)
+{
+	const FrameEntry &entry = frames[number - 1];
+	int samples = (entry.audio_offset >= 0) ? entry.samples : Frame::GetSamplesPerFrame(number, info.fps, info.sample_rate, info.channels);
+	int channels = (entry.audio_offset >= 0) ? entry.channels : info.channels;
+	int width = (entry.video_offset >= 0) ? entry.width : 1;
+	int height = (entry.video_offset >= 0) ? entry.height : 1;
+	std::shared_ptr<Frame> frame(new Frame(number, width, height, "#000000", samples, channels));
+	frame->SampleRate((entry.audio_offset >= 0) ? entry.sample_rate : info.sample_rate);
+	frame->ChannelsLayout((channels == 1) ? LAYOUT_MONO : LAYOUT_STEREO);
+
+	if (entry.video_offset >= 0) {
+		// The planes point into the mapped file (and keep it mapped)
+		std::shared_ptr<FramePlanes> planes = std::make_shared<FramePlanes>();
+		planes->width = entry.width;
+		planes->height = entry.height;
+		planes->pixel_format = entry.pixel_format;
+		av_image_fill_arrays(planes->data, planes->linesize, data + entry.video_offset, (PixelFormat) entry.pixel_format, entry.width, entry.height, 1);
+		planes->owner = mapping;
+
+		if (entry.pixel_format == AV_PIX_FMT_RGBA && Frame::ImageFormat() == QImage::Format_RGBA8888) {
+			// Use the mapped pixels as the image (which a write copies first, since they are read-only)
+			frame->AddImage(std::make_shared<QImage>((const uchar *) planes->data[0], entry.width, entry.height, planes->linesize[0],
+													 QImage::Format_RGBA8888, &release_mapping, new std::shared_ptr<void>(mapping)));
+		}
+		else {
+			// Convert the planes when the image is first needed (the planes are encoded as is, without an image)
+			frame->SetImageLoader(entry.width, entry.height, [planes](Frame *frame)
+			{
+				PixelFormat image_pixel_format = AV_PIX_FMT_RGBA;
+				QImage::Format format = image_format(planes->pixel_format, image_pixel_format);
+				std::shared_ptr<QImage> image = std::make_shared<QImage>(planes->width, planes->height, format);
+				uint8_t *image_data[4] = { image->bits(), NULL, NULL, NULL };
+				int image_linesize[4] = { image->bytesPerLine(), 0, 0, 0 };
+				FFmpegScaler::Scale(planes->data, planes->linesize, planes->width, planes->height, planes->pixel_format,
+									image_data, image_linesize, planes->width, planes->height, image_pixel_format, SWS_FAST_BILINEAR);
+				frame->AddImage(image);
+				frame->AddPlanes(planes);
+			}, planes);
+		}
+	}
+
+	if (entry.audio_offset >= 0) {
+		// Copy the samples (which are planar, or interleaved)
+		const float *samples_data = (const float *) (data + entry.audio_offset);
+		std::vector<float> channel_samples(interleaved_audio ? entry.samples : 0);
+		for (int channel = 0; channel < entry.channels; channel++) {
+			const float *source = samples_data + (int64_t) channel * entry.samples;
+			if (interleaved_audio) {
+				for (int sample = 0; sample < entry.samples; sample++)
+					channel_samples[sample] = samples_data[(int64_t) sample * entry.channels + channel];
+				source = channel_samples.data();
+			}
+			frame->AddAudio(true, channel, 0, source, entry.samples, 1.0);
+		}
+	}
+
+	return frame;
+}
+
+// Get an openshot::Frame object for a specific frame number of this reader.
+std::shared_ptr<Frame> RawVideoReader::GetFrame(int64_t requested_frame)
+{
+	// Check for open reader (or throw exception)
+	if (!is_open)
+		throw ReaderClosed("The raw video file is closed.  Call Open() before calling this method.", path);
+
+	// Adjust for a requested frame that is too small or too large
+	if (requested_frame < 1)
+		requested_frame = 1;
+	if (requested_frame > info.video_length)
+		requested_frame = info.video_length;
+
+	// Return a recent frame (which may have converted its image already)
+	std::shared_ptr<Frame> frame = final_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+	frame = final_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// No decoding is needed (the next frame's pages are read while this frame is used)
+	frame = read_frame(requested_frame);
+	read_ahead(requested_frame + 1);
+	final_cache.Add(frame);
+	return frame;
+}
+
+// Generate JSON string of this object
+std::string RawVideoReader::Json() {
+
+	// Return formatted string
+	return WriteJson(JsonValue());
+}
+
+// Generate Json::JsonValue for this object
+Json::Value RawVideoReader::JsonValue() {
+
+	// Create root json object
+	Json::Value root = ReaderBase::JsonValue(); // get parent properties
+	root["type"] = "RawVideoReader";
+	root["path"] = path;
+	root["headerless"] = is_headerless;
+	root["raw_format"] = raw_format;
+	root["raw_width"] = raw_width;
+	root["raw_height"] = raw_height;
+	root["interleaved_audio"] = interleaved_audio;
+
+	// return JsonValue
+	return root;
+}
+
+// Load JSON string into this object
+void RawVideoReader::SetJson(std::string value) {
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	bool success = ParseJson(value, root);
+
+	if (!success)
+		// Raise exception
+		throw InvalidJSON("JSON could not be parsed (or is invalid)");
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("JSON is invalid (missing keys or invalid data types)");
+	}
+}
+
+// Load Json::JsonValue into this object
+void RawVideoReader::SetJsonValue(Json::Value root) {
+
+	// Set parent data
+	ReaderBase::SetJsonValue(root);
+
+	// Set data from Json (if key is found)
+	if (!root["path"].isNull())
+		path = root["path"].asString();
+	if (!root["headerless"].isNull())
+		is_headerless = root["headerless"].asBool();
+	if (!root["raw_format"].isNull())
+		raw_format = (RawVideoFormat) root["raw_format"].asInt();
+	if (!root["raw_width"].isNull())
+		raw_width = root["raw_width"].asInt();
+	if (!root["raw_height"].isNull())
+		raw_height = root["raw_height"].asInt();
+	if (!root["interleaved_audio"].isNull())
+		interleaved_audio = root["interleaved_audio"].asBool();
+
+	// Re-Open path, and re-init everything (if needed)
+	if (is_open)
+	{
+		Close();
+		Open();
+	}
+}
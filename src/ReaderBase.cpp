@@ -29,11 +29,44 @@
  */
 
 #include "../include/ReaderBase.h"
+#include "../include/Exceptions.h"
 
 using namespace openshot;
 
+// Constructor for an asynchronous frame request
+FrameRequest::FrameRequest(int64_t frame_number, FrameRequestPriority priority) :
+	cancelled(false), status(FRAME_OK), frame_number(frame_number), priority(priority)
+{
+	result = promise.get_future().share();
+}
+
+// Wait for the requested frame (and re-throw the exception of the reader, if any)
+std::shared_ptr<Frame> FrameRequest::Wait()
+{
+	std::shared_ptr<Frame> frame = result.get();
+
+	// Throw the errors which were returned as a status (see ReaderBase::TryGetFrame)
+	if (status == FRAME_READER_CLOSED)
+		throw ReaderClosed("The reader is closed.  Call Open() before requesting frames.");
+	if (status == FRAME_OUT_OF_BOUNDS)
+		throw OutOfBoundsFrame("An invalid frame was requested.", frame_number, 0);
+	if (status == FRAME_TOO_MANY_SEEKS)
+		throw TooManySeeks("Too many seeks attempted.");
+	return frame;
+}
+
+// Wait for the requested frame, without exceptions
+FrameStatus FrameRequest::TryWait(std::shared_ptr<Frame>& frame)
+{
+	result.wait();
+	frame.reset();
+	if (status == FRAME_OK)
+		frame = result.get();
+	return status;
+}
+
 /// Constructor for the base reader, where many things are initialized.
-ReaderBase::ReaderBase()
+ReaderBase::ReaderBase() : requests_running(false), visible_requests(0)
 {
 	// Initialize info struct
 	info.has_video = false;
@@ -113,6 +146,18 @@ void ReaderBase::DisplayInfo() {
 		std::cout << "--> " << it->first << ": " << it->second << std::endl;
 }
 
+// Get the seeks of this reader, and the hits, misses, and evictions of its cache
+Json::Value ReaderBase::MetricsValue() {
+	Json::Value root;
+	root["type"] = Name();
+	root["seeks"] = Json::Int64(seek_counter.Value());
+	root["seek_retries"] = Json::Int64(seek_retry_counter.Value());
+	CacheBase *cache = GetCache();
+	if (cache)
+		root["cache"] = cache->MetricsValue();
+	return root;
+}
+
 // Generate Json::JsonValue for this object
 Json::Value ReaderBase::JsonValue() {
 
@@ -251,6 +296,135 @@ void ReaderBase::SetJsonValue(Json::Value root) {
 	}
 }
 
+// Get a frame, with its image scaled to the size it will be drawn at (if this reader supports it)
+std::shared_ptr<openshot::Frame> ReaderBase::GetFrame(int64_t number, int width, int height) {
+	return GetFrame(number);
+}
+
+// Get a frame without exceptions
+FrameStatus ReaderBase::TryGetFrame(int64_t number, std::shared_ptr<Frame>& frame, int width, int height) {
+	return try_get_frame(number, frame, width, height, false);
+}
+
+// Get a frame for its audio only, without exceptions
+FrameStatus ReaderBase::TryGetAudioFrame(int64_t number, std::shared_ptr<Frame>& frame) {
+	return try_get_frame(number, frame, 0, 0, true);
+}
+
+// Get a frame, and catch the exceptions of a closed reader, an invalid frame, or a failed seek
+FrameStatus ReaderBase::try_get_frame(int64_t number, std::shared_ptr<Frame>& frame, int width, int height, bool audio_only) {
+	frame.reset();
+
+	// Check for a closed reader first (without throwing)
+	if (!IsOpen())
+		return FRAME_READER_CLOSED;
+
+	try {
+		frame = audio_only ? GetAudioFrame(number) : GetFrame(number, width, height);
+	} catch (const ReaderClosed & e) {
+		return FRAME_READER_CLOSED;
+	} catch (const TooManySeeks & e) {
+		return FRAME_TOO_MANY_SEEKS;
+	} catch (const OutOfBoundsFrame & e) {
+		return FRAME_OUT_OF_BOUNDS;
+	}
+	return FRAME_OK;
+}
+
+// Get a range of consecutive frames (a frame at a time)
+std::vector<std::shared_ptr<openshot::Frame> > ReaderBase::GetFrames(int64_t start, int64_t count) {
+	std::vector<std::shared_ptr<openshot::Frame> > frames;
+	for (int64_t number = start; number < start + count; number++)
+		frames.push_back(GetFrame(number));
+	return frames;
+}
+
+// Get a frame for its audio only (readers without an audio-only path return the full frame)
+std::shared_ptr<openshot::Frame> ReaderBase::GetAudioFrame(int64_t number) {
+	return GetFrame(number);
+}
+
+// Request a frame asynchronously
+std::shared_ptr<FrameRequest> ReaderBase::RequestFrame(int64_t number, FrameRequestPriority priority) {
+	std::shared_ptr<FrameRequest> request = std::make_shared<FrameRequest>(number, priority);
+
+	// Queue the request (and start rendering the queue, unless a task is already rendering it)
+	bool start_task = false;
+	{
+		std::lock_guard<std::mutex> lock(requests_mutex);
+		requests.push_back(request);
+		if (priority == REQUEST_VISIBLE)
+			visible_requests++;
+		start_task = !requests_running;
+		requests_running = true;
+	}
+	if (start_task)
+		request_tasks.Run([this]() { run_frame_requests(); });
+
+	return request;
+}
+
+// Render the waiting frame requests, one at a time (GetFrame renders the frames of a reader in parallel itself)
+void ReaderBase::run_frame_requests() {
+	while (true) {
+		// Take the oldest request of the highest priority
+		std::shared_ptr<FrameRequest> request;
+		{
+			std::lock_guard<std::mutex> lock(requests_mutex);
+			if (requests.empty()) {
+				requests_running = false;
+				return;
+			}
+			std::deque<std::shared_ptr<FrameRequest> >::iterator next_request = requests.begin();
+			for (std::deque<std::shared_ptr<FrameRequest> >::iterator request_itr = requests.begin(); request_itr != requests.end(); ++request_itr)
+				if ((*request_itr)->priority > (*next_request)->priority)
+					next_request = request_itr;
+			request = *next_request;
+			requests.erase(next_request);
+			if (request->priority == REQUEST_VISIBLE)
+				visible_requests--;
+		}
+
+		// Skip a cancelled request (with a NULL frame)
+		if (request->IsCancelled()) {
+			request->status = FRAME_CANCELLED;
+			request->promise.set_value(std::shared_ptr<Frame>());
+			continue;
+		}
+
+		// Render the frame (and pass any other exception on to the waiting thread)
+		try {
+			std::shared_ptr<Frame> frame;
+			request->status = try_get_frame(request->frame_number, frame, 0, 0, false);
+			request->promise.set_value(frame);
+		}
+		catch (...) {
+			request->promise.set_exception(std::current_exception());
+		}
+	}
+}
+
+// Cancel the waiting frame requests (up to a priority)
+void ReaderBase::CancelFrameRequests(FrameRequestPriority max_priority) {
+	std::lock_guard<std::mutex> lock(requests_mutex);
+	for (std::shared_ptr<FrameRequest>& request : requests)
+		if (request->priority <= max_priority)
+			request->Cancel();
+}
+
+// Cancel the waiting frame requests, and wait for the request which is being rendered
+void ReaderBase::FinishFrameRequests() {
+	CancelFrameRequests(REQUEST_VISIBLE);
+
+	// The requests catch the exceptions of GetFrame, so an error here is a failure of the request task itself
+	try {
+		request_tasks.Wait();
+	}
+	catch (const std::exception& e) {
+		ZmqLogger::Instance()->Log(std::string("ReaderBase::FinishFrameRequests: ") + e.what());
+	}
+}
+
 /// Parent clip object of this reader (which can be unparented and NULL)
 openshot::ClipBase* ReaderBase::GetClip() {
 	return parent;
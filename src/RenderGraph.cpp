@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @brief Source file for RenderGraph class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include "../include/RenderGraph.h"
+#include "../include/TaskPool.h"
+
+using namespace openshot;
+
+// Add a node (or get the node with the same key)
+size_t RenderGraph::AddNode(RenderNodeType type, const std::string& key, std::function<void()> work, bool& added)
+{
+	if (!key.empty()) {
+		std::map<std::string, size_t>::iterator existing = keyed_nodes.find(key);
+		if (existing != keyed_nodes.end()) {
+			added = false;
+			shared_nodes++;
+			return existing->second;
+		}
+		keyed_nodes[key] = nodes.size();
+	}
+
+	Node node;
+	node.type = type;
+	node.key = key;
+	node.work = work;
+	node.dependencies = 0;
+	nodes.push_back(node);
+	added = true;
+	return nodes.size() - 1;
+}
+
+// Make a node wait for another node
+void RenderGraph::AddDependency(size_t node, size_t dependency)
+{
+	// Dependencies on earlier nodes can't form a cycle
+	assert(dependency < node && node < nodes.size());
+	nodes[dependency].dependents.push_back(node);
+	nodes[node].dependencies++;
+}
+
+// Get the number of nodes of a type
+size_t RenderGraph::NumNodes(RenderNodeType type)
+{
+	size_t count = 0;
+	for (const Node& node : nodes)
+		if (node.type == type)
+			count++;
+	return count;
+}
+
+// Run every node (in dependency order), and wait for them to finish
+void RenderGraph::Run()
+{
+	if (has_run)
+		return;
+	has_run = true;
+
+	// The number of unfinished dependencies of each node (the last dependency to finish submits the node)
+	std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[nodes.size()]);
+	for (size_t index = 0; index < nodes.size(); index++)
+		remaining[index] = nodes[index].dependencies;
+
+	// A node submits its dependents to the same group, so waiting on the group waits for the whole graph (a node
+	// which throws never submits its dependents)
+	TaskGroup group;
+	std::function<void(size_t)> submit = [&](size_t index)
+	{
+		group.Run([&, index]()
+		{
+			nodes[index].work();
+			for (size_t dependent : nodes[index].dependents)
+				if (--remaining[dependent] == 0)
+					submit(dependent);
+		});
+	};
+	for (size_t index = 0; index < nodes.size(); index++)
+		if (nodes[index].dependencies == 0)
+			submit(index);
+	group.Wait();
+}
+
+// Get a JSON value which describes the graph
+Json::Value RenderGraph::JsonValue()
+{
+	Json::Value root;
+	root["nodes"] = Json::UInt64(nodes.size());
+	root["decode"] = Json::UInt64(NumNodes(RENDER_NODE_DECODE));
+	root["map"] = Json::UInt64(NumNodes(RENDER_NODE_MAP));
+	root["effect"] = Json::UInt64(NumNodes(RENDER_NODE_EFFECT));
+	root["composite"] = Json::UInt64(NumNodes(RENDER_NODE_COMPOSITE));
+	root["shared"] = Json::Int64(shared_nodes);
+	return root;
+}
@@ -29,6 +29,8 @@
  */
 
 #include "../include/RendererBase.h"
+#include <algorithm>
+#include <QtGui/QPainter>
 using namespace openshot;
 
 RendererBase::RendererBase()
@@ -44,3 +46,36 @@ void RendererBase::paint(const std::shared_ptr<Frame> & frame)
 	if (frame)
 		this->render(frame->GetImage());
 }
+
+void RendererBase::paint(const std::shared_ptr<Frame> & frame, const std::vector<std::string> & overlay)
+{
+	if (!frame)
+		return;
+	if (overlay.empty()) {
+		paint(frame);
+		return;
+	}
+
+	// Draw on a copy (the frame's pixels can be shared with the cache), with text sized to the image
+	std::shared_ptr<QImage> image(new QImage(frame->GetImage()->copy()));
+	QPainter painter(image.get());
+	QFont font("Monospace");
+	font.setStyleHint(QFont::TypeWriter);
+	font.setPixelSize(std::max(10, image->height() / 40));
+	painter.setFont(font);
+	QFontMetrics metrics(font);
+	int line_height = metrics.height();
+	int width = 0;
+	for (size_t index = 0; index < overlay.size(); index++)
+		width = std::max(width, metrics.boundingRect(QString::fromStdString(overlay[index])).width());
+
+	// A translucent box keeps the text readable over any video
+	int margin = line_height / 2;
+	painter.fillRect(QRect(margin, margin, width + 2 * margin, line_height * int(overlay.size()) + margin), QColor(0, 0, 0, 160));
+	painter.setPen(Qt::white);
+	for (size_t index = 0; index < overlay.size(); index++)
+		painter.drawText(2 * margin, margin + metrics.ascent() + margin / 2 + line_height * int(index), QString::fromStdString(overlay[index]));
+	painter.end();
+
+	this->render(image);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief Source file for RenditionWriter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/RenditionWriter.h"
+
+using namespace openshot;
+
+RenditionWriter::RenditionWriter() : is_open(false)
+{
+}
+
+// Add a rendition (sorted from the largest video size to the smallest)
+void RenditionWriter::AddRendition(WriterBase* writer)
+{
+	if (!writer)
+		return;
+
+	int64_t size = int64_t(writer->info.width) * writer->info.height;
+	std::vector<WriterBase*>::iterator itr = renditions.begin();
+	while (itr != renditions.end() && int64_t((*itr)->info.width) * (*itr)->info.height >= size)
+		++itr;
+	renditions.insert(itr, writer);
+
+	// The largest rendition describes this writer
+	info = renditions.front()->info;
+}
+
+// Remove all renditions (without closing them)
+void RenditionWriter::ClearRenditions()
+{
+	renditions.clear();
+}
+
+// Open the writer (and the writers of all renditions)
+void RenditionWriter::Open()
+{
+	if (!is_open) {
+		for (size_t index = 0; index < renditions.size(); index++)
+			renditions[index]->Open();
+		is_open = true;
+	}
+}
+
+// Write a frame to every rendition
+void RenditionWriter::WriteFrame(std::shared_ptr<Frame> frame)
+{
+	// Check for open writer (or throw exception)
+	if (!is_open)
+		throw WriterClosed("The RenditionWriter is closed.  Call Open() before calling this method.", "");
+
+	// Scale the image once for each rendition size, from the previous (larger) rendition's image
+	std::vector<std::shared_ptr<Frame> > frames(renditions.size(), frame);
+	std::shared_ptr<QImage> source_image = frame->has_image_data ? frame->GetImage() : std::shared_ptr<QImage>();
+	std::shared_ptr<QImage> previous_image = source_image;
+	for (size_t index = 0; index < renditions.size() && source_image; index++) {
+		int width = renditions[index]->info.width;
+		int height = renditions[index]->info.height;
+		if (!renditions[index]->info.has_video || width <= 0 || height <= 0 ||
+			(width == source_image->width() && height == source_image->height()))
+			// The source frame matches this rendition
+			continue;
+
+		if (index > 0 && frames[index - 1] != frame && width == previous_image->width() && height == previous_image->height()) {
+			// Same size as the previous rendition
+			frames[index] = frames[index - 1];
+			continue;
+		}
+
+		// Scale from the previous image (unless it is smaller than this rendition)
+		std::shared_ptr<QImage> base_image = previous_image;
+		if (base_image->width() < width || base_image->height() < height)
+			base_image = source_image;
+		std::shared_ptr<QImage> scaled_image = std::make_shared<QImage>(base_image->scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+
+		// Clone the frame (the image and audio are shared until they change), with the scaled image
+		std::shared_ptr<Frame> scaled_frame = frame->ShallowClone();
+		scaled_frame->AddImage(scaled_image);
+		frames[index] = scaled_frame;
+		previous_image = scaled_image;
+	}
+
+	// Encode the frame in every rendition at once
+	TaskGroup tasks;
+	for (size_t index = 0; index < renditions.size(); index++) {
+		WriterBase *writer = renditions[index];
+		std::shared_ptr<Frame> rendition_frame = frames[index];
+		tasks.Run([writer, rendition_frame]() {
+			writer->WriteFrame(rendition_frame);
+		});
+	}
+	tasks.Wait();
+}
+
+// Write a block of frames from a reader
+void RenditionWriter::WriteFrame(ReaderBase* reader, int64_t start, int64_t length)
+{
+	// Loop through each frame (and encoded it)
+	for (int64_t number = start; number <= length; number++)
+	{
+		// Get the frame
+		std::shared_ptr<Frame> f = reader->GetFrame(number);
+
+		// Encode frame
+		WriteFrame(f);
+	}
+}
+
+// Close the writer (and the writers of all renditions)
+void RenditionWriter::Close()
+{
+	if (is_open) {
+		// Flush and close the renditions at once
+		TaskGroup tasks;
+		for (size_t index = 0; index < renditions.size(); index++) {
+			WriterBase *writer = renditions[index];
+			tasks.Run([writer]() {
+				writer->Close();
+			});
+		}
+		tasks.Wait();
+		is_open = false;
+	}
+}
@@ -48,14 +48,103 @@ Settings *Settings::Instance()
 		m_pInstance->MAX_WIDTH = 0;
 		m_pInstance->MAX_HEIGHT = 0;
 		m_pInstance->WAIT_FOR_VIDEO_PROCESSING_TASK = false;
+		m_pInstance->TILE_COMPOSITING = false;
+		m_pInstance->PREMULTIPLIED_IMAGES = false;
+		m_pInstance->SKIP_OCCLUDED_LAYERS = true;
+		m_pInstance->ADAPTIVE_TIMELINE_BATCH = true;
+		m_pInstance->MAX_TIMELINE_BATCH = 0;
+		m_pInstance->CACHE_MEMORY_LIMIT = 0;
+		m_pInstance->CACHE_DEDUPLICATION = false;
+		m_pInstance->KEYFRAME_INDEX = false;
+		m_pInstance->PERSIST_KEYFRAME_INDEX = false;
+		m_pInstance->PROBE_CACHE_PATH = "";
+		m_pInstance->PROXY_PATH = "";
+		m_pInstance->PROXY_HEIGHT = 540;
+		m_pInstance->AUDIO_ANALYSIS_PATH = "";
+		m_pInstance->AUDIO_ANALYSIS_CHUNK = 60;
+		m_pInstance->DECODER_POOL_SIZE = 0;
+		m_pInstance->SHARE_READERS = false;
+		m_pInstance->SHARED_READER_STREAMS = 1;
+		m_pInstance->MAX_CONCURRENT_RENDERS = 0;
+		m_pInstance->PACKET_QUEUE_SIZE = 0;
+		m_pInstance->REVERSE_DECODE_FRAMES = 0;
+		m_pInstance->IO_READ_AHEAD = 0;
+		m_pInstance->IO_BLOCK_SIZE = 1048576;
+		m_pInstance->IO_CACHE_SIZE = 64;
+		m_pInstance->IO_MMAP = false;
+		m_pInstance->SCALE_ON_DECODE = false;
+		m_pInstance->AUDIO_FAST_PATH = false;
+		m_pInstance->WRITER_QUEUE_SIZE = 0;
+		m_pInstance->NATIVE_FRAME_PLANES = false;
+		m_pInstance->YUV_COMPOSITING = false;
+		m_pInstance->IMAGE_POOL_SIZE = 512;
+		m_pInstance->LAZY_FRAME_IMAGES = false;
+		m_pInstance->HIGH_BIT_DEPTH_IMAGES = false;
+		m_pInstance->SIMD_EFFECTS = true;
+		m_pInstance->SIMD_COMPOSITING = true;
+		m_pInstance->EFFECT_LUT_SIZE = 0;
+		m_pInstance->GPU_COMPOSITING = false;
+		m_pInstance->FRAME_RATE_INTERPOLATION = 0;
+		m_pInstance->CLIP_CACHE_SIZE = 0;
+		m_pInstance->ADAPTIVE_PREVIEW = false;
+		m_pInstance->SKIP_EFFECTS = false;
+		m_pInstance->DECODE_SPEED = 0;
+		m_pInstance->DETERMINISTIC_RENDER = false;
+		m_pInstance->REGION_RENDER_IDLE_MS = 500;
 		m_pInstance->OMP_THREADS = 12;
 		m_pInstance->FF_THREADS = 8;
+		m_pInstance->ENCODE_THREADS = 0;
+		m_pInstance->AUTOTUNE_THREADS = false;
+		m_pInstance->SCALE_THREADS = 0;
 		m_pInstance->DE_LIMIT_HEIGHT_MAX = 1100;
 		m_pInstance->DE_LIMIT_WIDTH_MAX = 1950;
 		m_pInstance->HW_DE_DEVICE_SET = 0;
+		m_pInstance->HW_DE_DEVICE_COUNT = 1;
+		m_pInstance->HW_DE_DEVICE_SESSIONS = 0;
+		m_pInstance->HW_DE_DEVICE_ROUND_ROBIN = false;
+		m_pInstance->HW_DE_ZERO_COPY = false;
 		m_pInstance->HW_EN_DEVICE_SET = 0;
 		m_pInstance->PLAYBACK_AUDIO_DEVICE_NAME = "";
 	}
 
 	return m_pInstance;
 }
+
+// The render context bound to each thread (if any)
+static thread_local RenderContext current_context;
+static thread_local bool has_current_context = false;
+
+// Get the context of the calling thread (or of the global Settings)
+RenderContext RenderContext::Current()
+{
+	if (has_current_context)
+		return current_context;
+	return Global();
+}
+
+// Get the context of the global Settings
+RenderContext RenderContext::Global()
+{
+	Settings *s = Settings::Instance();
+	RenderContext context;
+	context.max_width = s->MAX_WIDTH;
+	context.max_height = s->MAX_HEIGHT;
+	context.high_quality_scaling = s->HIGH_QUALITY_SCALING;
+	context.decode_speed = s->DECODE_SPEED;
+	return context;
+}
+
+// Bind a context to the calling thread
+ScopedRenderContext::ScopedRenderContext(const RenderContext &context) :
+	previous(current_context), had_previous(has_current_context)
+{
+	current_context = context;
+	has_current_context = true;
+}
+
+// Bind the previous context again
+ScopedRenderContext::~ScopedRenderContext()
+{
+	current_context = previous;
+	has_current_context = had_previous;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file
+ * @brief Source file for SharedReader class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/SharedReader.h"
+
+using namespace openshot;
+
+// Global reference to the registry
+ReaderRegistry *ReaderRegistry::m_pInstance = NULL;
+
+// Create or get an instance of this registry singleton
+ReaderRegistry *ReaderRegistry::Instance()
+{
+	static std::once_flag created;
+	std::call_once(created, []() { m_pInstance = new ReaderRegistry(); });
+	return m_pInstance;
+}
+
+// The most frames a stream walks forward to a requested frame, instead of seeking (see FFmpegReader::GetFrame)
+#define SHARED_STREAM_MAX_WALK 20
+
+// Get the shared streams of a media file
+std::shared_ptr<SharedStreams> ReaderRegistry::Acquire(std::string path)
+{
+	std::shared_ptr<SharedStreams> streams;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		streams = media[path].lock();
+		if (!streams) {
+			streams = std::make_shared<SharedStreams>();
+			media[path] = streams;
+
+			// Forget the paths whose streams were destroyed
+			for (std::map<std::string, std::weak_ptr<SharedStreams> >::iterator itr = media.begin(); itr != media.end();) {
+				if (itr->second.expired())
+					itr = media.erase(itr);
+				else
+					++itr;
+			}
+		}
+	}
+
+	// Inspect the file once (for its info), without the registry lock (so only the readers of this file wait for it)
+	std::lock_guard<std::mutex> open_lock(streams->open_mutex);
+	if (streams->readers.empty()) {
+		std::shared_ptr<FFmpegReader> first = std::make_shared<FFmpegReader>(path);
+		std::lock_guard<std::mutex> streams_lock(streams->streams_mutex);
+		streams->readers.push_back(first);
+		streams->last_frames.push_back(0);
+		streams->last_used.push_back(0);
+	}
+	return streams;
+}
+
+// Open the shared streams (unless another SharedReader already opened them)
+void ReaderRegistry::Open(std::shared_ptr<SharedStreams> streams)
+{
+	// Only the readers of this file wait for the decoder to open (not the readers of other files, or GetFrame)
+	std::lock_guard<std::mutex> lock(streams->open_mutex);
+	if (streams->open_count == 0) {
+		std::shared_ptr<FFmpegReader> first;
+		{
+			std::lock_guard<std::mutex> streams_lock(streams->streams_mutex);
+			first = streams->readers.front();
+		}
+		first->Open();
+	}
+	streams->open_count++;
+}
+
+// Close the shared streams (once every SharedReader which opened them has closed them)
+void ReaderRegistry::Close(std::shared_ptr<SharedStreams> streams)
+{
+	std::lock_guard<std::mutex> lock(streams->open_mutex);
+	if (streams->open_count == 0 || --streams->open_count > 0)
+		return;
+
+	// Only the first stream is kept (closed), for the info and JSON of the file. The other streams are released,
+	// and closed by their destructor once no GetFrame call is still decoding with them.
+	std::shared_ptr<FFmpegReader> first;
+	std::vector<std::shared_ptr<FFmpegReader> > released;
+	{
+		std::lock_guard<std::mutex> streams_lock(streams->streams_mutex);
+		first = streams->readers.front();
+		released.assign(streams->readers.begin() + 1, streams->readers.end());
+		streams->readers.resize(1);
+		streams->last_frames.assign(1, 0);
+		streams->last_used.assign(1, 0);
+		streams->generation++;
+	}
+	first->Close();
+}
+
+// Get the stream to decode a frame with
+std::shared_ptr<FFmpegReader> ReaderRegistry::Stream(std::shared_ptr<SharedStreams> streams, int64_t requested_frame)
+{
+	std::unique_lock<std::mutex> lock(streams->streams_mutex);
+	streams->requests++;
+
+	// The stream which walks the fewest frames forward to the requested frame (and the least recently used stream)
+	size_t stream = streams->readers.size();
+	size_t oldest = 0;
+	for (size_t index = 0; index < streams->readers.size(); index++) {
+		int64_t walk = requested_frame - streams->last_frames[index];
+		if (walk >= 0 && walk <= SHARED_STREAM_MAX_WALK && (stream == streams->readers.size() || walk < requested_frame - streams->last_frames[stream]))
+			stream = index;
+		if (streams->last_used[index] < streams->last_used[oldest])
+			oldest = index;
+	}
+
+	// Start another stream (or seek the least recently used one). The first stream takes the first request,
+	// wherever it is.
+	if (stream == streams->readers.size()) {
+		int stream_count = streams->readers.size() + streams->opening;
+		if (streams->last_frames.front() > 0 && stream_count < Settings::Instance()->SHARED_READER_STREAMS) {
+			// Open the new stream without the lock (so the other streams keep decoding meanwhile)
+			std::string path = streams->readers.front()->Path();
+			int64_t generation = streams->generation;
+			int64_t requests = streams->requests;
+			streams->opening++;
+			lock.unlock();
+
+			std::shared_ptr<FFmpegReader> reader;
+			try {
+				reader = std::make_shared<FFmpegReader>(path, false);
+				reader->Open();
+			} catch (...) {
+				lock.lock();
+				streams->opening--;
+				throw;
+			}
+
+			lock.lock();
+			streams->opening--;
+			// Keep the new stream (unless the streams were closed meanwhile, then it closes once this request is done)
+			if (streams->generation == generation) {
+				streams->readers.push_back(reader);
+				streams->last_frames.push_back(requested_frame);
+				streams->last_used.push_back(requests);
+			}
+			return reader;
+		}
+		else
+			stream = oldest;
+	}
+	streams->last_frames[stream] = requested_frame;
+	streams->last_used[stream] = streams->requests;
+	return streams->readers[stream];
+}
+
+// Get the number of media files with a shared reader
+int ReaderRegistry::Count()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	int count = 0;
+	for (std::map<std::string, std::weak_ptr<SharedStreams> >::iterator itr = media.begin(); itr != media.end(); ++itr)
+		if (!itr->second.expired())
+			count++;
+	return count;
+}
+
+// Constructor for SharedReader
+SharedReader::SharedReader(std::string path) : path(path), streams(ReaderRegistry::Instance()->Acquire(path)), is_open(false)
+{
+	// Copy the info of the shared reader
+	info = Reader()->info;
+}
+
+// Destructor
+SharedReader::~SharedReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+	Close();
+}
+
+// Open this reader (and the shared reader, unless it is already open)
+void SharedReader::Open()
+{
+	if (is_open)
+		return;
+	ReaderRegistry::Instance()->Open(streams);
+	info = Reader()->info;
+	is_open = true;
+}
+
+// Close this reader
+void SharedReader::Close()
+{
+	if (!is_open)
+		return;
+	is_open = false;
+	ReaderRegistry::Instance()->Close(streams);
+}
+
+// Get an openshot::Frame object for a specific frame number of the shared reader
+std::shared_ptr<Frame> SharedReader::GetFrame(int64_t requested_frame)
+{
+	// Check for open reader (or throw exception)
+	if (!is_open)
+		throw ReaderClosed("The SharedReader is closed.  Call Open() before calling this method.", path);
+
+	// Any timeline can read the shared frames (and draw them at any size), so they are decoded at the global size
+	ScopedRenderContext render_context(RenderContext::Global());
+
+	// A single stream decodes (and caches) every frame itself
+	if (Settings::Instance()->SHARED_READER_STREAMS <= 1 && Streams() == 1)
+		return Reader()->GetFrame(requested_frame);
+
+	// A frame decoded by any stream is shared
+	std::vector<std::shared_ptr<FFmpegReader> > readers;
+	{
+		std::lock_guard<std::mutex> lock(streams->streams_mutex);
+		readers = streams->readers;
+	}
+	for (std::shared_ptr<FFmpegReader>& reader : readers) {
+		std::shared_ptr<Frame> frame = reader->GetCache()->GetFrame(requested_frame);
+		if (frame)
+			return frame;
+	}
+	return ReaderRegistry::Instance()->Stream(streams, requested_frame)->GetFrame(requested_frame);
+}
+
+// Get the number of streams of the shared media file
+int SharedReader::Streams()
+{
+	std::lock_guard<std::mutex> lock(streams->streams_mutex);
+	return streams->readers.size();
+}
+
+// Get the metrics of the shared reader
+Json::Value SharedReader::MetricsValue()
+{
+	Json::Value root = Reader()->MetricsValue();
+	root["shared_by"] = (Json::Int64) streams.use_count() - 1;
+	root["streams"] = Streams();
+	return root;
+}
+
+// Generate JSON string of this object
+std::string SharedReader::Json() {
+
+	// Return formatted string
+	return WriteJson(JsonValue());
+}
+
+// Generate Json::JsonValue for this object
+Json::Value SharedReader::JsonValue() {
+
+	// The JSON of the shared reader (so projects can be opened without sharing readers)
+	return Reader()->JsonValue();
+}
+
+// Load JSON string into this object
+void SharedReader::SetJson(std::string value) {
+
+	// Parse JSON string into JSON objects
+	Json::Value root;
+	bool success = ParseJson(value, root);
+
+	if (!success)
+		// Raise exception
+		throw InvalidJSON("JSON could not be parsed (or is invalid)");
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("JSON is invalid (missing keys or invalid data types)");
+	}
+}
+
+// Load Json::JsonValue into this object
+void SharedReader::SetJsonValue(Json::Value root) {
+
+	// Switch to the shared reader of a new path (the other properties belong to the shared reader)
+	if (!root["path"].isNull() && root["path"].asString() != path) {
+		bool was_open = is_open;
+		Close();
+		path = root["path"].asString();
+		streams = ReaderRegistry::Instance()->Acquire(path);
+		info = Reader()->info;
+		if (was_open)
+			Open();
+	}
+}
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief Source file for StreamExporter class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/StreamExporter.h"
+
+using namespace openshot;
+
+StreamExporter::StreamExporter(Timeline *timeline, FFmpegWriter *writer) :
+		timeline(timeline), writer(writer), max_lead(2), real_time(true), stop_requested(false), frames_written(0)
+{
+}
+
+// Queue a JSON diff, which the render loop applies before its next frame
+void StreamExporter::QueueJsonDiff(std::string value)
+{
+	std::lock_guard<std::mutex> lock(edit_mutex);
+	queued_edits.push_back(std::make_pair(value, std::chrono::steady_clock::now()));
+}
+
+// Apply the queued edits (between frames, so an edit never waits for a render)
+size_t StreamExporter::apply_edits(std::chrono::steady_clock::time_point &oldest)
+{
+	std::deque<std::pair<std::string, std::chrono::steady_clock::time_point> > edits;
+	{
+		std::lock_guard<std::mutex> lock(edit_mutex);
+		edits.swap(queued_edits);
+	}
+
+	oldest = std::chrono::steady_clock::now();
+	for (size_t index = 0; index < edits.size(); index++) {
+		oldest = std::min(oldest, edits[index].second);
+		try {
+			timeline->ApplyJsonDiff(edits[index].first);
+		} catch (const std::exception &e) {
+			// A bad edit is skipped (the stream keeps going)
+			rejected_edits.Increment();
+			ZmqLogger::Instance()->AppendDebugMethod("StreamExporter::apply_edits (rejected)", "index", index, "rejected_edits", rejected_edits.Value());
+		}
+	}
+	return edits.size();
+}
+
+// Render and write the frames of the timeline in order, until Stop() is called (or a number of frames)
+void StreamExporter::Stream(int64_t start, int64_t count)
+{
+	if (!writer->IsOpen())
+		throw WriterClosed("The FFmpegWriter is closed. Call Open() before calling this method.", "StreamExporter");
+	if (!timeline->IsOpen())
+		timeline->Open();
+
+	// Encode each frame as soon as it is written (instead of queuing frames, which delays the output)
+	writer->SetCacheSize(1);
+
+	stop_requested = false;
+	double fps = timeline->info.fps.ToDouble();
+	std::chrono::steady_clock::time_point stream_start = std::chrono::steady_clock::now();
+
+	for (int64_t index = 0; !stop_requested && (count <= 0 || index < count); index++) {
+		int64_t frame_number = start + index;
+
+		// Wait until the frame is within the lead of its time (waking up to check for a stop request)
+		std::chrono::steady_clock::time_point deadline = stream_start + std::chrono::microseconds(int64_t(index * 1000000.0 / fps));
+		if (real_time) {
+			std::chrono::steady_clock::time_point render_at = deadline - std::chrono::microseconds(int64_t(max_lead * 1000000.0 / fps));
+			while (!stop_requested && std::chrono::steady_clock::now() < render_at)
+				std::this_thread::sleep_for(std::min(std::chrono::duration_cast<std::chrono::microseconds>(render_at - std::chrono::steady_clock::now()),
+													 std::chrono::microseconds(10000)));
+			if (stop_requested)
+				break;
+		}
+
+		// Apply the edits queued since the last frame, then render and write this frame
+		std::chrono::steady_clock::time_point edit_time;
+		bool edited = apply_edits(edit_time) > 0;
+		{
+			ScopedTimer timer(render_times);
+			writer->WriteFrame(timeline->GetFrame(frame_number));
+		}
+		frames_written++;
+
+		std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+		if (edited)
+			edit_latency.Observe(std::chrono::duration<double, std::milli>(written - edit_time).count());
+		if (real_time && written > deadline) {
+			late_frames.Increment();
+			ZmqLogger::Instance()->AppendDebugMethod("StreamExporter::Stream (late frame)", "frame_number", frame_number, "late_ms", std::chrono::duration<double, std::milli>(written - deadline).count(), "late_frames", late_frames.Value());
+		}
+	}
+
+	ZmqLogger::Instance()->AppendDebugMethod("StreamExporter::Stream (done)", "start", start, "frames_written", frames_written, "late_frames", late_frames.Value(), "rejected_edits", rejected_edits.Value());
+}
+
+// Get the runtime metrics of the stream
+Json::Value StreamExporter::MetricsValue()
+{
+	Json::Value root;
+	root["frames_written"] = Json::Int64(frames_written);
+	root["late_frames"] = Json::Int64(late_frames.Value());
+	root["rejected_edits"] = Json::Int64(rejected_edits.Value());
+	root["edit_latency"] = edit_latency.JsonValue();
+	root["render_time"] = render_times.JsonValue();
+	return root;
+}
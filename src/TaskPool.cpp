@@ -0,0 +1,499 @@
+/**
+ * @file
+ * @brief Source file for TaskPool class (shared worker threads)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "../include/TaskPool.h"
+#include "../include/Metrics.h"
+#include "../include/ThreadTuner.h"
+#include "../include/Settings.h"
+
+using namespace openshot;
+
+// The index of the worker running on this thread (-1 if not a pool thread), and the pool it belongs to
+static thread_local int current_worker = -1;
+static thread_local TaskPool *current_pool = NULL;
+
+// The pool bound to this thread by a ScopedTaskPool (NULL for TaskPool::Instance())
+static thread_local TaskPool *bound_pool = NULL;
+
+// The NUMA node this thread is pinned to (-1 if not pinned)
+static thread_local int current_node = -1;
+
+// Does this thread hold a slot of the RenderScheduler
+static thread_local bool holds_render_slot = false;
+
+// Get the CPUs of a NUMA node (empty if the node does not exist, or this platform is not supported)
+static std::vector<int> node_cpus(int node) {
+	std::vector<int> cpus;
+#ifdef __linux__
+	// The list is formatted like "0-15,32-47"
+	std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string range;
+	while (std::getline(cpulist, range, ',')) {
+		int first = -1, last = -1;
+		char dash = 0;
+		std::istringstream range_stream(range);
+		range_stream >> first;
+		if (range_stream >> dash >> last) {
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		else if (first >= 0)
+			cpus.push_back(first);
+	}
+#endif
+	return cpus;
+}
+
+// Default constructor
+TaskGroup::TaskGroup() : state(new GroupState()), pool(NULL) {
+}
+
+// Destructor (waits for any unfinished tasks)
+TaskGroup::~TaskGroup() {
+	try {
+		Wait();
+	}
+	catch (...) {
+		// Never throw from a destructor
+	}
+}
+
+// Submit a task to the shared TaskPool, as part of this group
+void TaskGroup::Run(std::function<void()> task) {
+	// Run the task right away (in order, on this thread) when rendering deterministically
+	if (Settings::Instance()->DETERMINISTIC_RENDER) {
+		try {
+			task();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(state->group_mutex);
+			if (!state->error)
+				state->error = std::current_exception();
+		}
+		return;
+	}
+
+	// The task renders with the context of this thread (i.e. the size of the timeline which submitted it)
+	RenderContext context = RenderContext::Current();
+	{
+		std::lock_guard<std::mutex> lock(state->group_mutex);
+		state->pending++;
+		state->tasks.push_back([task, context]() {
+			ScopedRenderContext render_context(context);
+			task();
+		});
+		if (!pool)
+			pool = TaskPool::Current();
+	}
+
+	// Wake a waiting thread (which runs the task, unless a worker takes it first)
+	state->group_done.notify_all();
+
+	// Each pool task runs the next task of this group (if the waiting thread hasn't run it already)
+	std::shared_ptr<GroupState> group_state = state;
+	pool->Submit([group_state]() { run_next(group_state); });
+}
+
+// Run the next task of a group which hasn't started yet
+bool TaskGroup::run_next(std::shared_ptr<GroupState> state) {
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(state->group_mutex);
+		if (state->tasks.empty())
+			return false;
+		task = std::move(state->tasks.front());
+		state->tasks.pop_front();
+	}
+
+	std::exception_ptr task_error;
+	try {
+		task();
+	}
+	catch (...) {
+		task_error = std::current_exception();
+	}
+
+	// Mark task as finished (and remember the first error)
+	std::lock_guard<std::mutex> lock(state->group_mutex);
+	if (task_error && !state->error)
+		state->error = task_error;
+	state->pending--;
+	if (state->pending == 0)
+		state->group_done.notify_all();
+	return true;
+}
+
+// Wait for all tasks in this group to finish
+void TaskGroup::Wait() {
+	while (true) {
+		// Help run the tasks of this group which haven't started (but never the tasks of other groups)
+		if (run_next(state))
+			continue;
+
+		// Sleep until this group finishes (or a running task submits another task to this group)
+		std::unique_lock<std::mutex> lock(state->group_mutex);
+		state->group_done.wait(lock, [this]() { return state->pending == 0 || !state->tasks.empty(); });
+		if (state->pending == 0)
+			break;
+	}
+
+	// Re-throw the first exception (if any)
+	std::exception_ptr group_error;
+	{
+		std::lock_guard<std::mutex> lock(state->group_mutex);
+		group_error = state->error;
+		state->error = nullptr;
+	}
+	if (group_error)
+		std::rethrow_exception(group_error);
+}
+
+// Global reference to task pool
+TaskPool *TaskPool::m_pInstance = NULL;
+
+// Create or Get an instance of the task pool singleton
+TaskPool *TaskPool::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance) {
+		// Measure the thread counts first (so the pool is sized by the measured composite threads)
+		if (Settings::Instance()->AUTOTUNE_THREADS)
+			ThreadTuner::Instance()->Tune();
+
+		// Size the pool like OpenMP (from Settings::OMP_THREADS, limited to the number of cores)
+		int num_threads = std::max(2, Settings::Instance()->OMP_THREADS);
+		int num_cores = std::thread::hardware_concurrency();
+		if (num_cores > 0)
+			num_threads = std::min(num_threads, num_cores);
+
+		// Create the actual instance of task pool only once
+		m_pInstance = new TaskPool(std::max(1, num_threads), -1);
+	}
+
+	return m_pInstance;
+}
+
+// Get the pool of the calling thread
+TaskPool *TaskPool::Current()
+{
+	if (current_pool)
+		return current_pool;
+	if (bound_pool)
+		return bound_pool;
+	return Instance();
+}
+
+// Create or get the pool whose workers are pinned to the CPUs of a NUMA node
+TaskPool *TaskPool::ForNode(int node)
+{
+	if (node < 0 || node >= NumNodes())
+		return Instance();
+
+	static std::mutex node_mutex;
+	static std::map<int, TaskPool*> node_pools;
+	std::lock_guard<std::mutex> lock(node_mutex);
+
+	TaskPool *&pool = node_pools[node];
+	if (!pool) {
+		// Size the pool like Instance(), limited to the cores of this node
+		int num_threads = std::max(2, Settings::Instance()->OMP_THREADS);
+		num_threads = std::min(num_threads, (int) node_cpus(node).size());
+		pool = new TaskPool(std::max(1, num_threads), node);
+	}
+	return pool;
+}
+
+// Get the number of NUMA nodes of this machine
+int TaskPool::NumNodes()
+{
+	// The nodes never change, so only count them once
+	static int num_nodes = []() {
+		int nodes = 0;
+		while (!node_cpus(nodes).empty())
+			nodes++;
+		return std::max(1, nodes);
+	}();
+	return num_nodes;
+}
+
+// Pin the calling thread to the CPUs of a NUMA node
+bool TaskPool::PinThreadToNode(int node)
+{
+#ifdef __linux__
+	std::vector<int> cpus = node_cpus(node);
+	if (cpus.empty())
+		return false;
+
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	for (size_t index = 0; index < cpus.size(); index++)
+		CPU_SET(cpus[index], &cpu_set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+		return false;
+
+	current_node = node;
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Get the NUMA node the calling thread is pinned to
+int TaskPool::ThreadNode()
+{
+	return current_node;
+}
+
+// Constructor
+TaskPool::TaskPool(int num_threads, int node) : queued(0), next_queue(0), stopping(false), node(node)
+{
+	// Create one queue per worker (before any worker starts)
+	for (int worker_index = 0; worker_index < num_threads; worker_index++)
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+
+	// Start workers
+	for (int worker_index = 0; worker_index < num_threads; worker_index++)
+		workers.push_back(std::thread(&TaskPool::worker_loop, this, worker_index));
+}
+
+// Destructor
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	// Wait for workers to exit
+	for (size_t worker_index = 0; worker_index < workers.size(); worker_index++)
+		if (workers[worker_index].joinable())
+			workers[worker_index].join();
+}
+
+// Get the number of worker threads in the pool
+int TaskPool::NumThreads()
+{
+	// Split work the same way on every machine, when rendering deterministically
+	if (Settings::Instance()->DETERMINISTIC_RENDER)
+		return std::max(1, Settings::Instance()->OMP_THREADS);
+	return workers.size();
+}
+
+// Submit a task to the pool
+void TaskPool::Submit(std::function<void()> task)
+{
+	// Tasks submitted from a worker stay on its own queue (others can steal them)
+	size_t queue_index = 0;
+	if (worker_index() >= 0)
+		queue_index = worker_index();
+	else {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		queue_index = next_queue % queues.size();
+		next_queue++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queues[queue_index]->queue_mutex);
+		queues[queue_index]->tasks.push_back(task);
+	}
+
+	// Wake an idle worker
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+// Take the next task
+bool TaskPool::pop_task(int worker_index, std::function<void()>& task)
+{
+	int num_queues = queues.size();
+
+	// Newest task from our own queue (most likely to still be in the CPU cache)
+	if (worker_index >= 0 && worker_index < num_queues) {
+		WorkerQueue& own = *queues[worker_index];
+		std::lock_guard<std::mutex> lock(own.queue_mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+		}
+	}
+
+	// Otherwise steal the oldest task from another queue
+	for (int offset = 1; !task && offset <= num_queues; offset++) {
+		WorkerQueue& other = *queues[(std::max(0, worker_index) + offset) % num_queues];
+		std::lock_guard<std::mutex> lock(other.queue_mutex);
+		if (!other.tasks.empty()) {
+			task = other.tasks.front();
+			other.tasks.pop_front();
+		}
+	}
+
+	if (task) {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+// Get the index of the calling thread in this pool's workers
+int TaskPool::worker_index()
+{
+	return (current_pool == this) ? current_worker : -1;
+}
+
+// The main loop of each worker thread
+void TaskPool::worker_loop(int worker_index)
+{
+	current_worker = worker_index;
+	current_pool = this;
+	if (node >= 0)
+		PinThreadToNode(node);
+
+	while (true) {
+		// Run tasks until all queues are empty
+		std::function<void()> task;
+		if (pop_task(worker_index, task)) {
+			task();
+			continue;
+		}
+
+		// Sleep until a task is submitted
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		wake.wait(lock, [this]() { return stopping || queued > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+// Call a function for each index in a range, in parallel
+void TaskPool::ParallelFor(int64_t begin, int64_t end, std::function<void(int64_t)> body)
+{
+	// Nothing to split (or rendering deterministically, so each index runs in order)
+	if (end - begin <= 1 || Settings::Instance()->DETERMINISTIC_RENDER) {
+		for (int64_t index = begin; index < end; index++)
+			body(index);
+		return;
+	}
+
+	// Submit one task per index (the calling thread helps while waiting)
+	TaskGroup group;
+	for (int64_t index = begin; index < end; index++)
+		group.Run([&body, index]() { body(index); });
+	group.Wait();
+}
+
+// Bind a pool to the calling thread
+ScopedTaskPool::ScopedTaskPool(TaskPool *pool) : previous(bound_pool)
+{
+	bound_pool = pool;
+}
+
+// Bind the previous pool again
+ScopedTaskPool::~ScopedTaskPool()
+{
+	bound_pool = previous;
+}
+
+// Global reference to render scheduler
+RenderScheduler *RenderScheduler::m_pInstance = NULL;
+
+// Create or get an instance of the render scheduler singleton
+RenderScheduler *RenderScheduler::Instance()
+{
+	static std::once_flag created;
+	std::call_once(created, []() { m_pInstance = new RenderScheduler(); });
+	return m_pInstance;
+}
+
+// Wait for a render slot
+bool RenderScheduler::Acquire()
+{
+	// Nested renders run inside the slot of their parent render
+	if (Settings::Instance()->MAX_CONCURRENT_RENDERS <= 0 || current_pool || holds_render_slot)
+		return false;
+
+	static Histogram& wait_times = Metrics::Instance()->GetHistogram("scheduler.wait_ms");
+	ScopedTimer wait_timer(wait_times);
+
+	// Wait until this ticket is served, and a slot is free (the limit can change while waiting)
+	std::unique_lock<std::mutex> lock(scheduler_mutex);
+	uint64_t ticket = next_ticket++;
+	turn.wait(lock, [this, ticket]() {
+		return ticket == serving && active < std::max(1, Settings::Instance()->MAX_CONCURRENT_RENDERS);
+	});
+	serving++;
+	active++;
+	holds_render_slot = true;
+
+	// The next ticket may also fit in a free slot
+	turn.notify_all();
+	return true;
+}
+
+// Release the slot of the calling thread
+void RenderScheduler::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		active--;
+		holds_render_slot = false;
+	}
+	turn.notify_all();
+}
+
+// Get the number of renders holding a slot
+int RenderScheduler::Active()
+{
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	return active;
+}
+
+// Get the number of renders waiting for a slot
+int RenderScheduler::Waiting()
+{
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	return next_ticket - serving;
+}
@@ -51,6 +51,12 @@ TextReader::TextReader(int width, int height, int x_offset, int y_offset, Gravit
 	Close();
 }
 
+TextReader::~TextReader()
+{
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+}
+
 void TextReader::SetTextBackgroundColor(std::string color) {
 	text_background_color = color;
 
@@ -118,6 +124,9 @@ void TextReader::Open()
 		// Draw image
 		image->draw(lines);
 
+		// Convert the pixels once (for all frames)
+		cached_image = Frame::MagickToImage(image);
+
 		// Update image properties
 		info.has_audio = false;
 		info.has_video = true;
@@ -168,11 +177,8 @@ std::shared_ptr<Frame> TextReader::GetFrame(int64_t requested_frame)
 		// Create or get frame object
 		std::shared_ptr<Frame> image_frame(new Frame(requested_frame, image->size().width(), image->size().height(), "#000000", 0, 2));
 
-		// Add Image data to frame
-		std::shared_ptr<Magick::Image> copy_image(new Magick::Image(*image.get()));
-		copy_image->modifyImage(); // actually copy the image data to this object
-		//TODO: Reimplement this with QImage
-		image_frame->AddMagickImage(copy_image);
+		// Add Image data to frame (each frame gets its own QImage, which shares the pixels until it is changed)
+		image_frame->AddImage(std::make_shared<QImage>(*cached_image));
 
 		// return frame object
 		return image_frame;
@@ -190,7 +196,7 @@ std::shared_ptr<Frame> TextReader::GetFrame(int64_t requested_frame)
 std::string TextReader::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -220,13 +226,7 @@ void TextReader::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -0,0 +1,315 @@
+/**
+ * @file
+ * @brief Source file for ThreadTuner class (measures the fastest thread counts of each stage)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include "../include/ThreadTuner.h"
+#include "../include/FFmpegUtilities.h"
+#include "../include/Settings.h"
+#include "../include/ZmqLogger.h"
+
+using namespace openshot;
+
+// Global reference to tuner
+ThreadTuner *ThreadTuner::m_pInstance = NULL;
+
+namespace {
+	// The size and length of the synthetic video (long enough to fill the frame threads of a codec)
+	const int video_width = 1280;
+	const int video_height = 720;
+	const int video_frames = 24;
+
+	// The number of 1080p images composited by each measurement
+	const int composite_count = 32;
+
+	// Get the seconds since a time point
+	double elapsed_seconds(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Get the thread counts to measure (1, 2, 4, ... less than the number of cores, and the number of cores)
+	std::vector<int> candidate_counts(int cores, int limit) {
+		std::vector<int> counts;
+		int most = std::max(1, std::min(cores, limit));
+		for (int count = 1; count < most; count *= 2)
+			counts.push_back(count);
+		counts.push_back(most);
+		return counts;
+	}
+
+	// Get the fewest threads within 5% of the best throughput
+	int fewest_fast_threads(const std::map<int, double>& throughput) {
+		double best = 0.0;
+		for (std::map<int, double>::const_iterator itr = throughput.begin(); itr != throughput.end(); ++itr)
+			best = std::max(best, itr->second);
+		for (std::map<int, double>::const_iterator itr = throughput.begin(); itr != throughput.end(); ++itr)
+			if (itr->second >= 0.95 * best)
+				return itr->first;
+		return 1;
+	}
+
+	// Get the throughput of each candidate as JSON (i.e. {"1": 40.2, "2": 75.9})
+	Json::Value throughput_json(const std::map<int, double>& throughput) {
+		Json::Value root;
+		for (std::map<int, double>::const_iterator itr = throughput.begin(); itr != throughput.end(); ++itr)
+			root[std::to_string(itr->first)] = itr->second;
+		return root;
+	}
+
+	// Composite 1080p images on a number of threads (each with its own target), and get the images per second
+	double measure_composite(int threads, const QImage& layer) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (int thread = 0; thread < threads; thread++)
+			workers.push_back(std::thread([thread, threads, &layer]() {
+				QImage target(layer.size(), QImage::Format_ARGB32_Premultiplied);
+				target.fill(Qt::black);
+				for (int index = thread; index < composite_count; index += threads) {
+					QPainter painter(&target);
+					painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+					painter.drawImage(QRectF(index % 8, 0, target.width() - 8, target.height()), layer);
+				}
+			}));
+		for (size_t index = 0; index < workers.size(); index++)
+			workers[index].join();
+		return composite_count / std::max(elapsed_seconds(start), 1e-6);
+	}
+
+#if IS_FFMPEG_3_2
+	// Fill a frame with moving noise (so the encoder has as much work as with real video)
+	void fill_frame(AVFrame *frame, int index) {
+		uint32_t seed = 12345;
+		for (int plane = 0; plane < 3; plane++) {
+			int width = (plane == 0) ? frame->width : frame->width / 2;
+			int height = (plane == 0) ? frame->height : frame->height / 2;
+			for (int y = 0; y < height; y++) {
+				uint8_t *row = frame->data[plane] + y * frame->linesize[plane];
+				for (int x = 0; x < width; x++) {
+					seed = seed * 1664525 + 1013904223;
+					row[x] = uint8_t(((x + index * 4) ^ y) + (seed >> 28));
+				}
+			}
+		}
+	}
+
+	// Encode the synthetic video with a number of threads (keeping the packets), and get the frames per second
+	double measure_encode(const AVCodec *codec, int threads, std::vector<std::vector<uint8_t> > *packets) {
+		AVCodecContext *context = avcodec_alloc_context3(codec);
+		context->width = video_width;
+		context->height = video_height;
+		context->time_base = AVRational{1, 30};
+		context->framerate = AVRational{30, 1};
+		context->pix_fmt = AV_PIX_FMT_YUV420P;
+		context->bit_rate = 4000000;
+		context->gop_size = 12;
+		context->thread_count = threads;
+		if (strcmp(codec->name, "libx264") == 0)
+			av_opt_set(context->priv_data, "preset", "veryfast", 0);
+		if (avcodec_open2(context, codec, NULL) < 0) {
+			avcodec_free_context(&context);
+			return 0.0;
+		}
+
+		AVFrame *frame = av_frame_alloc();
+		frame->format = AV_PIX_FMT_YUV420P;
+		frame->width = video_width;
+		frame->height = video_height;
+		av_frame_get_buffer(frame, 32);
+		AVPacket *packet = av_packet_alloc();
+		if (packets)
+			packets->clear();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int index = 0; index <= video_frames; index++) {
+			// The last pass flushes the encoder
+			if (index < video_frames) {
+				av_frame_make_writable(frame);
+				fill_frame(frame, index);
+				frame->pts = index;
+				avcodec_send_frame(context, frame);
+			}
+			else
+				avcodec_send_frame(context, NULL);
+			while (avcodec_receive_packet(context, packet) == 0) {
+				if (packets)
+					packets->push_back(std::vector<uint8_t>(packet->data, packet->data + packet->size));
+				av_packet_unref(packet);
+			}
+		}
+		double fps = video_frames / std::max(elapsed_seconds(start), 1e-6);
+
+		av_packet_free(&packet);
+		av_frame_free(&frame);
+		avcodec_free_context(&context);
+		return fps;
+	}
+
+	// Decode the encoded video with a number of threads, and get the frames per second
+	double measure_decode(const AVCodec *codec, int threads, const std::vector<std::vector<uint8_t> >& packets) {
+		AVCodecContext *context = avcodec_alloc_context3(codec);
+		context->thread_count = threads;
+		if (avcodec_open2(context, codec, NULL) < 0) {
+			avcodec_free_context(&context);
+			return 0.0;
+		}
+
+		AVFrame *frame = av_frame_alloc();
+		AVPacket *packet = av_packet_alloc();
+		int decoded = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t index = 0; index <= packets.size(); index++) {
+			// The last pass flushes the decoder
+			if (index < packets.size()) {
+				av_new_packet(packet, packets[index].size());
+				memcpy(packet->data, packets[index].data(), packets[index].size());
+				avcodec_send_packet(context, packet);
+				av_packet_unref(packet);
+			}
+			else
+				avcodec_send_packet(context, NULL);
+			while (avcodec_receive_frame(context, frame) == 0) {
+				decoded++;
+				av_frame_unref(frame);
+			}
+		}
+		double fps = decoded / std::max(elapsed_seconds(start), 1e-6);
+
+		av_packet_free(&packet);
+		av_frame_free(&frame);
+		avcodec_free_context(&context);
+		return fps;
+	}
+#endif
+}
+
+// Create or Get an instance of the tuner singleton
+ThreadTuner *ThreadTuner::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of tuner only once
+		m_pInstance = new ThreadTuner();
+
+	return m_pInstance;
+}
+
+// Measure each stage (only the first time), and set the thread counts of the settings
+void ThreadTuner::Tune()
+{
+	std::lock_guard<std::mutex> lock(tune_mutex);
+	if (tuned)
+		return;
+	tuned = true;
+
+	Settings *s = Settings::Instance();
+	int cores = std::max(1, (int) std::thread::hardware_concurrency());
+	results["cores"] = cores;
+
+	// A deterministic render uses fixed thread counts (so it is the same on every machine)
+	if (s->DETERMINISTIC_RENDER) {
+		results["skipped"] = "DETERMINISTIC_RENDER";
+		return;
+	}
+
+	// Compositing (each thread composites whole images, like the workers of the task pool)
+	QImage layer(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+	layer.fill(QColor(200, 120, 40, 128));
+	std::map<int, double> composite_fps;
+	std::vector<int> counts = candidate_counts(cores, cores);
+	for (size_t index = 0; index < counts.size(); index++)
+		composite_fps[counts[index]] = measure_composite(counts[index], layer);
+	int composite_threads = fewest_fast_threads(composite_fps);
+	results["composite_fps"] = throughput_json(composite_fps);
+
+	// Encoding and decoding (codecs use at most 16 threads)
+	int decode_threads = s->FF_THREADS;
+	int encode_threads = s->ENCODE_THREADS;
+#if IS_FFMPEG_3_2
+	const AVCodec *encoder = avcodec_find_encoder_by_name("libx264");
+	if (!encoder)
+		encoder = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+	const AVCodec *decoder = encoder ? avcodec_find_decoder(encoder->id) : NULL;
+	if (encoder && decoder) {
+		results["codec"] = encoder->name;
+		std::map<int, double> encode_fps;
+		std::map<int, double> decode_fps;
+		std::vector<std::vector<uint8_t> > packets;
+		counts = candidate_counts(cores, 16);
+		for (size_t index = 0; index < counts.size(); index++)
+			encode_fps[counts[index]] = measure_encode(encoder, counts[index], (index == 0) ? &packets : NULL);
+		for (size_t index = 0; index < counts.size() && !packets.empty(); index++)
+			decode_fps[counts[index]] = measure_decode(decoder, counts[index], packets);
+		encode_threads = fewest_fast_threads(encode_fps);
+		if (!packets.empty())
+			decode_threads = fewest_fast_threads(decode_fps);
+		results["encode_fps"] = throughput_json(encode_fps);
+		results["decode_fps"] = throughput_json(decode_fps);
+	}
+#endif
+
+	// Use the measured counts (or the current counts, limited to the number of cores, without an H.264 or MPEG-4 codec)
+	s->OMP_THREADS = std::max(2, composite_threads);
+	s->FF_THREADS = std::max(1, std::min(cores, decode_threads));
+	s->ENCODE_THREADS = std::max(1, std::min(cores, encode_threads > 0 ? encode_threads : decode_threads));
+	results["composite_threads"] = s->OMP_THREADS;
+	results["decode_threads"] = s->FF_THREADS;
+	results["encode_threads"] = s->ENCODE_THREADS;
+
+	ZmqLogger::Instance()->AppendDebugMethod("ThreadTuner::Tune", "cores", cores, "OMP_THREADS", s->OMP_THREADS, "FF_THREADS", s->FF_THREADS, "ENCODE_THREADS", s->ENCODE_THREADS);
+}
+
+// Have the thread counts been measured
+bool ThreadTuner::IsTuned()
+{
+	std::lock_guard<std::mutex> lock(tune_mutex);
+	return tuned;
+}
+
+// Get the chosen thread counts (and the measurements) as a JSON string
+std::string ThreadTuner::Json()
+{
+	return WriteJson(JsonValue());
+}
+
+// Get the chosen thread counts (and the measurements) as a JSON value
+Json::Value ThreadTuner::JsonValue()
+{
+	std::lock_guard<std::mutex> lock(tune_mutex);
+	Json::Value root = results;
+	root["tuned"] = tuned;
+	return root;
+}
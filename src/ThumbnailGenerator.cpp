@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief Source file for ThumbnailGenerator class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/ThumbnailGenerator.h"
+#include "../include/Exceptions.h"
+#include "../include/FFmpegReader.h"
+#include "../include/ImageSequenceWriter.h"
+#include "../include/TaskPool.h"
+#include <algorithm>
+#include <QtGui/QColor>
+#include <QtGui/QPainter>
+#include <QtGui/QTransform>
+
+using namespace openshot;
+
+ThumbnailGenerator::ThumbnailGenerator(int width, int height) :
+		width(width), height(height), background_color("#000000"), ignore_aspect(false), keyframes_only(true),
+		rotate(0.0), images_loaded(false)
+{
+}
+
+// Load and scale the mask and overlay images (once)
+void ThumbnailGenerator::load_images()
+{
+	if (images_loaded)
+		return;
+
+	mask.reset();
+	if (!mask_path.empty()) {
+		QImage mask_image;
+		if (!mask_image.load(QString::fromStdString(mask_path)))
+			throw InvalidFile("The mask image of the thumbnails could not be loaded.", mask_path);
+		mask_image = mask_image.convertToFormat(QImage::Format_RGBA8888).scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+		mask_image.invertPixels();
+
+		// Keep only the gray value of each pixel (which is subtracted from the alpha of the thumbnail)
+		mask = std::make_shared<std::vector<unsigned char> >(width * height);
+		for (int y = 0; y < height; y++) {
+			const unsigned char *pixels = mask_image.constScanLine(y);
+			for (int x = 0; x < width; x++)
+				(*mask)[y * width + x] = qGray(pixels[x * 4], pixels[x * 4 + 1], pixels[x * 4 + 2]);
+		}
+	}
+
+	overlay.reset();
+	if (!overlay_path.empty()) {
+		QImage overlay_image;
+		if (!overlay_image.load(QString::fromStdString(overlay_path)))
+			throw InvalidFile("The overlay image of the thumbnails could not be loaded.", overlay_path);
+		overlay = std::make_shared<QImage>(overlay_image.convertToFormat(QImage::Format_ARGB32_Premultiplied).scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+	}
+
+	images_loaded = true;
+}
+
+// Render the thumbnail of a frame (like Frame::Thumbnail, without saving it)
+std::shared_ptr<QImage> ThumbnailGenerator::render(std::shared_ptr<Frame> frame)
+{
+	std::shared_ptr<QImage> thumbnail = std::make_shared<QImage>(width, height, QImage::Format_RGBA8888);
+	thumbnail->fill(QColor(QString::fromStdString(background_color)));
+
+	// The size of the frame image on the thumbnail (correcting non-square pixels)
+	std::shared_ptr<QImage> image = frame->GetImage();
+	QSize display_size(image->width(), image->height() * frame->GetPixelRatio().Reciprocal().ToDouble());
+	QSize target_size = ignore_aspect ? QSize(width, height) : display_size.scaled(width, height, Qt::KeepAspectRatio);
+	target_size = target_size.expandedTo(QSize(1, 1));
+
+	// A large image is reduced quickly to twice the size first (so the smooth scaling only reads 4 pixels per pixel)
+	QImage scaled = *image;
+	if (scaled.width() > target_size.width() * 2 && scaled.height() > target_size.height() * 2)
+		scaled = scaled.scaled(target_size * 2, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+	scaled = scaled.scaled(target_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	QPainter painter(thumbnail.get());
+	painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::TextAntialiasing, true);
+	painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+	// Draw the image centered (and rotated around its center)
+	int x = (width - scaled.width()) / 2.0;
+	int y = (height - scaled.height()) / 2.0;
+	QTransform transform;
+	float origin_x = scaled.width() / 2.0;
+	float origin_y = scaled.height() / 2.0;
+	transform.translate(origin_x, origin_y);
+	transform.rotate(rotate);
+	transform.translate(-origin_x, -origin_y);
+	painter.setTransform(transform);
+	painter.drawImage(x, y, scaled);
+
+	if (overlay)
+		painter.drawImage(0, 0, *overlay);
+	painter.end();
+
+	// Subtract the mask from the alpha of each pixel
+	if (mask) {
+		for (int row = 0; row < height; row++) {
+			unsigned char *pixels = thumbnail->scanLine(row);
+			const unsigned char *gray = mask->data() + row * width;
+			for (int column = 0; column < width; column++)
+				pixels[column * 4 + 3] = std::max(0, pixels[column * 4 + 3] - gray[column]);
+		}
+	}
+
+	return thumbnail;
+}
+
+// Generate the thumbnails of a list of frames
+std::vector<std::shared_ptr<QImage> > ThumbnailGenerator::Generate(ReaderBase* reader, std::vector<int64_t> frame_numbers)
+{
+	load_images();
+
+	// Read each frame once, in order
+	std::vector<int64_t> numbers(frame_numbers);
+	std::sort(numbers.begin(), numbers.end());
+	numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+
+	// Only decode keyframes (at the smallest size which is still larger than the thumbnails)
+	FFmpegReader *ffmpeg_reader = dynamic_cast<FFmpegReader*>(reader);
+	bool thumbnail_mode = keyframes_only && ffmpeg_reader && !ffmpeg_reader->IsThumbnailMode();
+	if (thumbnail_mode) {
+		int lowres = 0;
+		while (lowres < 3 && (reader->info.width >> (lowres + 1)) >= width && (reader->info.height >> (lowres + 1)) >= height)
+			lowres++;
+		ffmpeg_reader->ThumbnailMode(true, lowres);
+	}
+
+	// Render each thumbnail on the task pool, while the next frame is read
+	std::vector<std::shared_ptr<QImage> > thumbnails(numbers.size());
+	try {
+		TaskGroup group;
+		for (size_t index = 0; index < numbers.size(); index++) {
+			std::shared_ptr<Frame> frame = reader->GetFrame(numbers[index]);
+			group.Run([this, &thumbnails, index, frame]() { thumbnails[index] = render(frame); });
+		}
+		group.Wait();
+	} catch (...) {
+		if (thumbnail_mode)
+			ffmpeg_reader->ThumbnailMode(false);
+		throw;
+	}
+	if (thumbnail_mode)
+		ffmpeg_reader->ThumbnailMode(false);
+
+	// Return the thumbnails in the order of the frame numbers
+	std::vector<std::shared_ptr<QImage> > results;
+	for (int64_t number : frame_numbers)
+		results.push_back(thumbnails[std::lower_bound(numbers.begin(), numbers.end(), number) - numbers.begin()]);
+	return results;
+}
+
+// Generate a sprite sheet of the thumbnails of a list of frames
+std::shared_ptr<QImage> ThumbnailGenerator::SpriteSheet(ReaderBase* reader, std::vector<int64_t> frame_numbers, int columns)
+{
+	std::vector<std::shared_ptr<QImage> > thumbnails = Generate(reader, frame_numbers);
+	int count = thumbnails.size();
+	if (count == 0)
+		return std::make_shared<QImage>();
+	columns = (columns <= 0) ? count : std::min(columns, count);
+	int rows = (count + columns - 1) / columns;
+
+	std::shared_ptr<QImage> sheet = std::make_shared<QImage>(columns * width, rows * height, QImage::Format_RGBA8888);
+	sheet->fill(Qt::transparent);
+	QPainter painter(sheet.get());
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	for (int index = 0; index < count; index++)
+		painter.drawImage((index % columns) * width, (index / columns) * height, *thumbnails[index]);
+	painter.end();
+
+	return sheet;
+}
+
+// Save a sprite sheet of the thumbnails of a list of frames
+void ThumbnailGenerator::SaveSpriteSheet(ReaderBase* reader, std::vector<int64_t> frame_numbers, std::string path, int columns, std::string format, int quality)
+{
+	std::shared_ptr<QImage> sheet = SpriteSheet(reader, frame_numbers, columns);
+	if (!sheet->save(QString::fromStdString(path), format.empty() ? NULL : format.c_str(), quality))
+		throw InvalidFile("The sprite sheet could not be saved.", path);
+}
+
+// Save the thumbnail of each frame as its own image file
+void ThumbnailGenerator::SaveThumbnails(ReaderBase* reader, std::vector<int64_t> frame_numbers, std::string path, std::string format, int quality)
+{
+	std::vector<std::shared_ptr<QImage> > thumbnails = Generate(reader, frame_numbers);
+
+	// The files are named like the images of an image sequence (and encoded in parallel)
+	ImageSequenceWriter sequence(path);
+	TaskPool::Current()->ParallelFor(0, thumbnails.size(), [&](int64_t index) {
+		// A repeated frame number is only saved once
+		if (std::find(frame_numbers.begin(), frame_numbers.begin() + index, frame_numbers[index]) != frame_numbers.begin() + index)
+			return;
+		std::string file_path = sequence.FramePath(frame_numbers[index]);
+		if (!thumbnails[index]->save(QString::fromStdString(file_path), format.empty() ? NULL : format.c_str(), quality))
+			throw InvalidFile("The thumbnail could not be saved.", file_path);
+	});
+}
@@ -29,12 +29,72 @@
  */
 
 #include "../include/Timeline.h"
+#include "../include/GpuCompositor.h"
+#include "../include/PixelKernels.h"
+#include "../include/PlaneCompositor.h"
+#include "../include/Trace.h"
+#include "OpenShotVersion.h"
+
+#include <sstream>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 
 using namespace openshot;
 
+// Build the max end frame of each subtree in an interval index (returns the max end frame of the range)
+template <typename Interval>
+static int64_t build_intervals(std::vector<Interval>& intervals, size_t lo, size_t hi)
+{
+	if (lo >= hi)
+		return INT64_MIN;
+
+	// The middle element is the root of this range
+	size_t mid = lo + (hi - lo) / 2;
+	Interval& node = intervals[mid];
+	node.max_end = std::max(node.end, std::max(build_intervals(intervals, lo, mid), build_intervals(intervals, mid + 1, hi)));
+
+	return node.max_end;
+}
+
+// Recursively search an interval index for the entries intersecting a range of frames
+template <typename Interval>
+static void query_intervals(std::vector<Interval>& intervals, size_t lo, size_t hi, int64_t min_frame, int64_t max_frame, std::vector<Interval*>& matches)
+{
+	if (lo >= hi)
+		return;
+
+	// The middle element is the root of this range
+	size_t mid = lo + (hi - lo) / 2;
+	Interval& node = intervals[mid];
+
+	// No entry in this subtree ends after the requested range starts
+	if (node.max_end < min_frame)
+		return;
+
+	// Search left subtree (which all start before this node)
+	query_intervals(intervals, lo, mid, min_frame, max_frame, matches);
+
+	// This node (and the entire right subtree) start after the requested range
+	if (node.start > max_frame)
+		return;
+
+	// Does this entry intersect the requested range
+	if (node.end >= min_frame)
+		matches.push_back(&node);
+
+	// Search right subtree
+	query_intervals(intervals, mid + 1, hi, min_frame, max_frame, matches);
+}
+
 // Default Constructor for the timeline (which sets the canvas width and height)
 Timeline::Timeline(int width, int height, Fraction fps, int sample_rate, int channels, ChannelLayout channel_layout) :
-		is_open(false), auto_map_clips(true), managed_cache(true)
+		is_open(false), auto_map_clips(true), clip_intervals_dirty(true), effect_intervals_dirty(true), clip_changes(std::make_shared<std::atomic<int64_t> >(0)),
+		effect_changes(std::make_shared<std::atomic<int64_t> >(0)), clip_intervals_changes(0), effect_intervals_changes(0), managed_cache(true), render_cache(NULL), input_hash_generation(-1),
+		last_requested_frame(0), access_pattern(ACCESS_RANDOM), access_streak(0), last_batch_size(0),
+		pipeline_rendering(false), graph_rendering(false), numa_node(-1), pending_edits(0), last_request_ms(0), region_cache(NULL),
+		region_generation(0), region_stop(false), render_width(0), render_height(0), decode_speed(0), canvas_width(0), canvas_height(0), edit_generation(0)
 {
 	// Create CrashHandler and Attach (incase of errors)
 	CrashHandler::Instance();
@@ -71,9 +131,17 @@ Timeline::Timeline(int width, int height, Fraction fps, int sample_rate, int cha
 	// Init cache
 	final_cache = new CacheMemory();
 	final_cache->SetMaxBytesFromInfo(OPEN_MP_NUM_PROCESSORS * 2, info.width, info.height, info.sample_rate, info.channels);
+	final_cache->SetMemoryTag("cache.timeline");
+
+	// Keep the mixed audio of about 30 seconds
+	audio_cache.SetMaxBytesFromInfo(30, 0, 0, info.sample_rate, info.channels);
+	audio_cache.SetMemoryTag("cache.timeline.audio");
 }
 
 Timeline::~Timeline() {
+	// Finish the frame requests (before the objects used by GetFrame are released)
+	FinishFrameRequests();
+
 	if (is_open)
 		// Auto Close if not already
 		Close();
@@ -104,33 +172,61 @@ void Timeline::AddClip(Clip* clip)
 		// Apply framemapper (or update existing framemapper)
 		apply_mapper_to_clip(clip);
 
-	// Add clip to list
+	// Add clip to list (and calculate its timeline frames, and count its changes)
+	int64_t changes = *clip_changes;
 	clips.push_back(clip);
+	clip->FrameRate(info.fps);
+	clip->ChangeCounter(clip_changes);
 
 	// Sort clips
 	sort_clips();
+
+	// Insert the clip into the clip interval index
+	update_clip_interval(clip, changes, false);
 }
 
 // Add an effect to the timeline
 void Timeline::AddEffect(EffectBase* effect)
 {
-	// Add effect to list
+	// Add effect to list (and calculate its timeline frames, and count its changes)
 	effects.push_back(effect);
+	effect->FrameRate(info.fps);
+	effect->ChangeCounter(effect_changes);
 
 	// Sort effects
 	sort_effects();
+
+	// Rebuild effect interval index (on next frame request)
+	effect_intervals_dirty = true;
 }
 
 // Remove an effect from the timeline
 void Timeline::RemoveEffect(EffectBase* effect)
 {
 	effects.remove(effect);
+	if (effect->ChangeCounter() == effect_changes)
+		effect->ChangeCounter(std::shared_ptr<std::atomic<int64_t> >());
+
+	// Rebuild effect interval index (on next frame request)
+	effect_intervals_dirty = true;
 }
 
 // Remove an openshot::Clip to the timeline
 void Timeline::RemoveClip(Clip* clip)
 {
+	// Close clip (if opened by this timeline), so it is no longer tracked
+	update_open_clips(clip, false);
+
 	clips.remove(clip);
+	if (clip->ChangeCounter() == clip_changes)
+		clip->ChangeCounter(std::shared_ptr<std::atomic<int64_t> >());
+	{
+		std::lock_guard<std::mutex> lock(nested_mutex);
+		nested_timelines.erase(clip);
+	}
+
+	// Remove the clip from the clip interval index
+	update_clip_interval(clip, *clip_changes, true);
 }
 
 // Apply a FrameMapper to a clip which matches the settings of this timeline
@@ -139,6 +235,13 @@ void Timeline::apply_mapper_to_clip(Clip* clip)
     // Get lock (prevent getting frames while this happens)
     const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
 
+	// Repeat or skip frames (unless the frames are interpolated)
+	PulldownType pulldown = PULLDOWN_NONE;
+	if (Settings::Instance()->FRAME_RATE_INTERPOLATION == 1)
+		pulldown = PULLDOWN_BLEND;
+	else if (Settings::Instance()->FRAME_RATE_INTERPOLATION == 2)
+		pulldown = PULLDOWN_MOTION;
+
 	// Determine type of reader
 	ReaderBase* clip_reader = NULL;
 	if (clip->Reader()->Name() == "FrameMapper")
@@ -149,14 +252,14 @@ void Timeline::apply_mapper_to_clip(Clip* clip)
 	} else {
 
 		// Create a new FrameMapper to wrap the current reader
-		FrameMapper* mapper = new FrameMapper(clip->Reader(), info.fps, PULLDOWN_NONE, info.sample_rate, info.channels, info.channel_layout);
+		FrameMapper* mapper = new FrameMapper(clip->Reader(), info.fps, pulldown, info.sample_rate, info.channels, info.channel_layout);
 		allocated_frame_mappers.insert(mapper);
 		clip_reader = (ReaderBase*) mapper;
 	}
 
 	// Update the mapping
 	FrameMapper* clip_mapped_reader = (FrameMapper*) clip_reader;
-	clip_mapped_reader->ChangeMapping(info.fps, PULLDOWN_NONE, info.sample_rate, info.channels, info.channel_layout);
+	clip_mapped_reader->ChangeMapping(info.fps, pulldown, info.sample_rate, info.channels, info.channel_layout);
 
 	// Update clip reader
 	clip->Reader(clip_reader);
@@ -190,50 +293,330 @@ double Timeline::calculate_time(int64_t number, Fraction rate)
 	return double(number - 1) / raw_fps;
 }
 
-// Apply effects to the source frame (if any)
-std::shared_ptr<Frame> Timeline::apply_effects(std::shared_ptr<Frame> frame, int64_t timeline_frame_number, int layer)
+// Build the render plan for a range of timeline frames
+std::vector<FramePlan> Timeline::build_render_plan(const std::vector<Clip*>& nearby_clips, int64_t requested_frame, int number_of_frames)
 {
-	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_effects", "frame->number", frame->number, "timeline_frame_number", timeline_frame_number, "layer", layer);
+	std::vector<FramePlan> plan;
+	plan.reserve(number_of_frames);
+
+	// Get the timeline frames of each clip only once (see ClipBase::FrameRate)
+	std::vector<int64_t> clip_start_positions(nearby_clips.size());
+	std::vector<int64_t> clip_end_positions(nearby_clips.size());
+	std::vector<int64_t> clip_start_frames(nearby_clips.size());
+	std::vector<bool> clip_has_audio(nearby_clips.size());
+	for (int clip_index = 0; clip_index < nearby_clips.size(); clip_index++)
+	{
+		Clip *clip = nearby_clips[clip_index];
+		clip_start_positions[clip_index] = clip->PositionFrame();
+		clip_end_positions[clip_index] = clip->EndPositionFrame();
+		clip_start_frames[clip_index] = clip->StartFrame();
+		clip_has_audio[clip_index] = clip->Reader() && clip->Reader()->info.has_audio;
+	}
 
-	// Find Effects at this position and layer
-	std::list<EffectBase*>::iterator effect_itr;
-	for (effect_itr=effects.begin(); effect_itr != effects.end(); ++effect_itr)
+	// Loop through all requested frames
+	for (int64_t frame_number = requested_frame; frame_number < requested_frame + number_of_frames; frame_number++)
 	{
-		// Get effect object from the iterator
-		EffectBase *effect = (*effect_itr);
+		FramePlan frame_plan;
+		frame_plan.frame_number = frame_number;
+		frame_plan.max_volume = 0.0;
 
-		// Does clip intersect the current requested time
-		long effect_start_position = round(effect->Position() * info.fps.ToDouble()) + 1;
-		long effect_end_position = round((effect->Position() + (effect->Duration())) * info.fps.ToDouble()) + 1;
+		// Track the latest starting clip of each layer (which is the "top" clip of that layer)
+		std::map<int, int64_t> top_start_positions;
+		std::vector<int64_t> layer_start_positions;
 
-		bool does_effect_intersect = (effect_start_position <= timeline_frame_number && effect_end_position >= timeline_frame_number && effect->Layer() == layer);
+		// Find Clips at this frame (nearby clips are already sorted by layer)
+		for (int clip_index = 0; clip_index < nearby_clips.size(); clip_index++)
+		{
+			Clip *clip = nearby_clips[clip_index];
+			bool does_clip_intersect = (clip_start_positions[clip_index] <= frame_number && clip_end_positions[clip_index] >= frame_number);
+			if (!does_clip_intersect)
+				continue;
 
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_effects (Does effect intersect)", "effect->Position()", effect->Position(), "does_effect_intersect", does_effect_intersect, "timeline_frame_number", timeline_frame_number, "layer", layer);
+			// Determine the frame needed for this clip (based on the position on the timeline)
+			LayerPlan layer;
+			layer.clip = clip;
+			layer.clip_frame_number = frame_number - clip_start_positions[clip_index] + clip_start_frames[clip_index];
+			layer.is_top_clip = true;
+			layer.is_hidden = false;
+			layer.draw_width = 0;
+			layer.draw_height = 0;
+			layer.properties = clip->EvaluateProperties(layer.clip_frame_number);
+			if (Settings::Instance()->SCALE_ON_DECODE)
+				get_layer_draw_size(clip, layer.properties, frame_number, layer.draw_width, layer.draw_height);
+			frame_plan.layers.push_back(layer);
+			layer_start_positions.push_back(clip_start_positions[clip_index]);
+
+			// Keep track of the latest starting clip on this layer
+			std::map<int, int64_t>::iterator top_itr = top_start_positions.find(clip->Layer());
+			if (top_itr == top_start_positions.end() || clip_start_positions[clip_index] > top_itr->second)
+				top_start_positions[clip->Layer()] = clip_start_positions[clip_index];
+
+			// Determine max volume of overlapping clips
+			if (clip_has_audio[clip_index] && layer.properties.has_audio != 0)
+				frame_plan.max_volume += layer.properties.volume;
+		}
 
-		// Clip is visible
-		if (does_effect_intersect)
+		// A clip is not the "top" clip if a later starting clip overlaps it on the same layer
+		for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
 		{
-			// Determine the frame needed for this clip (based on the position on the timeline)
-            long effect_start_frame = (effect->Start() * info.fps.ToDouble()) + 1;
-			long effect_frame_number = timeline_frame_number - effect_start_position + effect_start_frame;
+			LayerPlan& layer = frame_plan.layers[layer_index];
+			layer.is_top_clip = (layer_start_positions[layer_index] >= top_start_positions[layer.clip->Layer()]);
+		}
+
+		// Find the highest opaque, full frame clip (which hides all clips composited before it)
+		int covering_index = -1;
+		if (Settings::Instance()->SKIP_OCCLUDED_LAYERS)
+			for (int layer_index = frame_plan.layers.size() - 1; layer_index > 0 && covering_index == -1; layer_index--)
+				if (is_opaque_full_frame(frame_plan.layers[layer_index].clip, frame_plan.layers[layer_index].properties, frame_number))
+					covering_index = layer_index;
+
+		if (covering_index > 0) {
+			// Hidden clips are skipped entirely, unless they have audio to mix
+			std::vector<LayerPlan> visible_layers;
+			for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
+			{
+				LayerPlan& layer = frame_plan.layers[layer_index];
+				if (layer_index < covering_index) {
+					bool is_audible = layer.clip->Reader() && layer.clip->Reader()->info.has_audio &&
+									  layer.properties.has_audio != 0 &&
+									  (layer.properties.volume != 0.0 || layer.properties.previous_volume != 0.0);
+					if (!is_audible)
+						continue;
+					layer.is_hidden = true;
+				}
+				visible_layers.push_back(layer);
+			}
 
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_effects (Process Effect)", "effect_frame_number", effect_frame_number, "does_effect_intersect", does_effect_intersect);
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::build_render_plan (Skip occluded clips)", "frame_number", frame_number, "covering_index", covering_index, "frame_plan.layers.size()", frame_plan.layers.size(), "visible_layers.size()", visible_layers.size());
+
+			frame_plan.layers = visible_layers;
+		}
+
+		plan.push_back(frame_plan);
+	}
+
+	return plan;
+}
+
+namespace {
+	// Hash the size and modification time of the files of a reader (the paths in its JSON, and in the readers it wraps)
+	void hash_files(const Json::Value& root, QCryptographicHash& hash) {
+		if (root.isObject() && root["path"].isString()) {
+			QFileInfo file(QString::fromStdString(root["path"].asString()));
+			std::stringstream identity;
+			identity << file.size() << " " << file.lastModified().toMSecsSinceEpoch();
+			hash.addData(identity.str().c_str(), identity.str().size());
+		}
+		if (root.isObject() || root.isArray())
+			for (Json::Value::const_iterator member = root.begin(); member != root.end(); ++member)
+				hash_files(*member, hash);
+	}
+}
+
+// Hash the inputs a frame is rendered from (see SetRenderCache)
+std::string Timeline::render_key(const FramePlan& frame_plan)
+{
+	// The inputs are hashed again after each edit
+	if (input_hash_generation != edit_generation) {
+		clip_input_hashes.clear();
+		timeline_input_hash.clear();
+		input_hash_generation = edit_generation;
+	}
+
+	// The library version, the timeline's format, and the timeline's background and effects
+	if (timeline_input_hash.isEmpty()) {
+		std::stringstream inputs;
+		inputs << OPENSHOT_VERSION_FULL << " " << info.fps.num << "/" << info.fps.den << " " << info.sample_rate << " "
+			   << info.channels << " " << info.channel_layout << " " << info.pixel_ratio.num << "/" << info.pixel_ratio.den << " ";
+		Json::Value root;
+		root["viewport_scale"] = viewport_scale.JsonValue();
+		root["viewport_x"] = viewport_x.JsonValue();
+		root["viewport_y"] = viewport_y.JsonValue();
+		root["color"] = color.JsonValue();
+		root["effects"] = Json::Value(Json::arrayValue);
+		for (EffectBase *effect : effects)
+			root["effects"].append(effect->JsonValue());
+		inputs << WriteJson(root);
+		timeline_input_hash = QCryptographicHash::hash(QByteArray::fromStdString(inputs.str()), QCryptographicHash::Sha1);
+	}
+
+	// The settings which change rendered pixels (read for each frame, since they can change without an edit), the
+	// frame's size, and the frame and drawn size of each layer
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(timeline_input_hash);
+	Settings *s = Settings::Instance();
+	std::stringstream frame_inputs;
+	frame_inputs << s->HIGH_QUALITY_SCALING << s->PREMULTIPLIED_IMAGES << s->YUV_COMPOSITING << s->SKIP_EFFECTS
+				 << s->HIGH_BIT_DEPTH_IMAGES << s->SCALE_ON_DECODE << s->SIMD_EFFECTS << s->SIMD_COMPOSITING << " "
+				 << s->EFFECT_LUT_SIZE << " " << s->FRAME_RATE_INTERPOLATION << " " << RenderContext::Current().decode_speed << " "
+				 << s->HARDWARE_DECODER << " ";
+	frame_inputs << frame_plan.frame_number << " " << max_width() << "x" << max_height();
+	for (const LayerPlan& layer : frame_plan.layers)
+		frame_inputs << " " << layer.clip_frame_number << " " << layer.draw_width << "x" << layer.draw_height << " "
+					 << layer.is_top_clip << layer.is_hidden;
+	hash.addData(frame_inputs.str().c_str(), frame_inputs.str().size());
+	for (const LayerPlan& layer : frame_plan.layers)
+		hash.addData(clip_input_hash(layer.clip));
+	return hash.result().toHex().toStdString();
+}
+
+// Hash the JSON of a clip, and the size and modification time of its files
+QByteArray Timeline::clip_input_hash(Clip* clip)
+{
+	int64_t version = clip->CacheVersion();
+	std::map<Clip*, std::pair<int64_t, QByteArray> >::iterator hashed = clip_input_hashes.find(clip);
+	if (hashed != clip_input_hashes.end() && hashed->second.first == version)
+		return hashed->second.second;
+
+	Json::Value root = clip->JsonValue();
+	std::string json = WriteJson(root);
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(json.c_str(), json.size());
+	hash_files(root, hash);
+	clip_input_hashes[clip] = std::make_pair(version, hash.result());
+	return hash.result();
+}
 
-			// Apply the effect to this frame
-			frame = effect->GetFrame(frame, effect_frame_number);
+// Set the render key of each planned frame, and take the frames found in the render cache out of the plan
+void Timeline::reuse_rendered_frames(std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& reused_frames, bool reuse)
+{
+	std::vector<FramePlan> remaining_plan;
+	remaining_plan.reserve(render_plan.size());
+	for (FramePlan& frame_plan : render_plan) {
+		frame_plan.render_key = render_key(frame_plan);
+		std::shared_ptr<Frame> frame;
+		if (reuse)
+			frame = render_cache->GetKeyedFrame(frame_plan.render_key, frame_plan.frame_number);
+		if (frame)
+			reused_frames.push_back(frame);
+		else
+			remaining_plan.push_back(frame_plan);
+	}
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::reuse_rendered_frames", "render_plan.size()", render_plan.size(), "reused_frames.size()", reused_frames.size());
+	render_plan.swap(remaining_plan);
+}
+
+// Get the frame number of an effect at a timeline frame (returns false if the effect is not on this frame and layer)
+bool Timeline::get_effect_frame_number(EffectBase* effect, int64_t timeline_frame_number, int layer, int64_t& effect_frame_number)
+{
+	// Does clip intersect the current requested time
+	int64_t effect_start_position = effect->PositionFrame();
+	int64_t effect_end_position = effect->EndPositionFrame();
+
+	bool does_effect_intersect = (effect_start_position <= timeline_frame_number && effect_end_position >= timeline_frame_number && effect->Layer() == layer);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::get_effect_frame_number (Does effect intersect)", "effect->Position()", effect->Position(), "does_effect_intersect", does_effect_intersect, "timeline_frame_number", timeline_frame_number, "layer", layer);
+
+	// Determine the frame needed for this clip (based on the position on the timeline)
+	effect_frame_number = timeline_frame_number - effect_start_position + effect->StartFrame();
+	return does_effect_intersect;
+}
+
+// Apply effects to the source frame (if any)
+std::shared_ptr<Frame> Timeline::apply_effects(std::shared_ptr<Frame> frame, int64_t timeline_frame_number, int layer, QRect visible_region, int first_effect, int last_effect)
+{
+	TraceSpan trace_span("Timeline::apply_effects", "effects", timeline_frame_number);
+	static MemoryGauge& effect_memory = Metrics::Instance()->GetMemory("images.effects");
+	ScopedMemoryTag memory_tag(effect_memory);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_effects", "frame->number", frame->number, "timeline_frame_number", timeline_frame_number, "layer", layer, "first_effect", first_effect, "last_effect", last_effect);
+
+	// Effects are skipped while the preview is lowering its quality
+	if (Settings::Instance()->SKIP_EFFECTS)
+		return frame;
+
+	// Find Effects at this position and layer (in the range of effects)
+	std::vector<EffectBase*> active_effects;
+	std::vector<long> active_frame_numbers;
+	std::vector<EffectInterval*> layer_effects = find_layer_effects(timeline_frame_number, layer);
+	for (std::vector<EffectInterval*>::iterator effect_itr = layer_effects.begin(); effect_itr != layer_effects.end(); ++effect_itr)
+	{
+		int effect_index = (*effect_itr)->order;
+		if (effect_index < first_effect || (last_effect >= 0 && effect_index >= last_effect))
+			continue;
+
+		// Get effect object from the index
+		EffectBase *effect = (*effect_itr)->effect;
+		int64_t effect_frame_number;
+		if (get_effect_frame_number(effect, timeline_frame_number, layer, effect_frame_number))
+		{
+			active_effects.push_back(effect);
+			active_frame_numbers.push_back(effect_frame_number);
 		}
 
 	} // end effect loop
 
+	// Get the point-wise effects (if any)
+	std::vector<EffectBase::PixelKernel> active_kernels;
+	size_t last_spatial_effect = 0;
+	for (size_t index = 0; index < active_effects.size(); index++) {
+		active_kernels.push_back(active_effects[index]->GetPixelKernel(active_frame_numbers[index]));
+		if (!active_kernels.back())
+			last_spatial_effect = index;
+	}
+
+	// Consecutive point-wise effects (with the same region) are collected, and applied in a single pass
+	std::vector<EffectBase*> kernel_effects;
+	std::vector<EffectBase::PixelKernel> pixel_kernels;
+	std::vector<bool> color_kernels;
+	QRect kernel_region;
+
+	for (size_t index = 0; index < active_effects.size(); index++)
+	{
+		EffectBase *effect = active_effects[index];
+		long effect_frame_number = active_frame_numbers[index];
+
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_effects (Process Effect)", "effect_frame_number", effect_frame_number, "index", index);
+
+		// Get the region this effect changes. Pixels outside the visible region are never composited, once no
+		// later effect can move them (i.e. after the last effect which is not point-wise), so they can be skipped.
+		QRect effect_region = effect->RegionOfInterest(effect_frame_number, QSize(frame->GetWidth(), frame->GetHeight()));
+		if (!visible_region.isNull() && index >= last_spatial_effect)
+			effect_region &= visible_region;
+		if (effect_region.isEmpty())
+			continue;
+
+		// Collect point-wise effects
+		EffectBase::PixelKernel pixel_kernel = active_kernels[index];
+		if (pixel_kernel) {
+			if (!pixel_kernels.empty() && effect_region != kernel_region) {
+				EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+			}
+			kernel_region = effect_region;
+			kernel_effects.push_back(effect);
+			pixel_kernels.push_back(pixel_kernel);
+			color_kernels.push_back(effect->IsColorKernel());
+			continue;
+		}
+
+		// Apply the collected point-wise effects first
+		EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+
+		// Effects expect RGBA8888 pixels
+		frame->ConvertImage(QImage::Format_RGBA8888);
+
+		// Apply the effect to this frame
+		frame = effect->ProcessFrame(std::move(frame), effect_frame_number);
+	}
+
+	// Apply the remaining point-wise effects
+	EffectBase::FlushPixelKernels(frame, kernel_effects, pixel_kernels, color_kernels, kernel_region);
+
+	// Convert back to the frame image format (if any effects were applied)
+	frame->ConvertImage(Frame::ImageFormat());
+
 	// Return modified frame
 	return frame;
 }
 
 // Get or generate a blank frame
-std::shared_ptr<Frame> Timeline::GetOrCreateFrame(Clip* clip, int64_t number)
+std::shared_ptr<Frame> Timeline::GetOrCreateFrame(Clip* clip, int64_t number, int width, int height, bool audio_only, std::vector<EffectBase::GpuKernel>* gpu_kernels)
 {
 	std::shared_ptr<Frame> new_frame;
 
@@ -245,8 +628,13 @@ std::shared_ptr<Frame> Timeline::GetOrCreateFrame(Clip* clip, int64_t number)
 		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetOrCreateFrame (from reader)", "number", number, "samples_in_frame", samples_in_frame);
 
 		// Attempt to get a frame (but this could fail if a reader has just been closed)
-		#pragma omp critical (T_GetOtCreateFrame)
-		new_frame = std::shared_ptr<Frame>(clip->GetFrame(number));
+		// Each clip synchronizes access to its own reader, so other clips can be read in parallel
+		if (audio_only)
+			new_frame = std::shared_ptr<Frame>(clip->GetAudioFrame(number));
+		else if (gpu_kernels)
+			new_frame = std::shared_ptr<Frame>(clip->GetFrame(number, width, height, *gpu_kernels));
+		else
+			new_frame = std::shared_ptr<Frame>(clip->GetFrame(number, width, height));
 
 		// Return real frame
 		return new_frame;
@@ -262,188 +650,217 @@ std::shared_ptr<Frame> Timeline::GetOrCreateFrame(Clip* clip, int64_t number)
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetOrCreateFrame (create blank)", "number", number, "samples_in_frame", samples_in_frame);
 
-	// Create blank frame
-	new_frame = std::make_shared<Frame>(number, Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, "#000000", samples_in_frame, info.channels);
-	#pragma omp critical (T_GetOtCreateFrame)
-	{
-		new_frame->SampleRate(info.sample_rate);
-		new_frame->ChannelsLayout(info.channel_layout);
-	}
+	// Create blank frame (an audio only frame doesn't need a full size image)
+	if (audio_only)
+		new_frame = std::make_shared<Frame>(number, 1, 1, "#000000", samples_in_frame, info.channels);
+	else
+		new_frame = std::make_shared<Frame>(number, max_width(), max_height(), "#000000", samples_in_frame, info.channels);
+	new_frame->SampleRate(info.sample_rate);
+	new_frame->ChannelsLayout(info.channel_layout);
 	return new_frame;
 }
 
-// Process a new layer of video or audio
-void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, int64_t clip_frame_number, int64_t timeline_frame_number, bool is_top_clip, float max_volume)
+// Apply the waveform and timeline effects to a clip's frame (if any)
+std::shared_ptr<Frame> Timeline::apply_layer_effects(std::shared_ptr<Frame> source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, bool is_top_clip, int first_effect, int last_effect)
 {
-	// Get the clip's frame & image
-	std::shared_ptr<Frame> source_frame;
-	#pragma omp critical (T_addLayer)
-	source_frame = GetOrCreateFrame(source_clip, clip_frame_number);
-
 	// No frame found... so bail
 	if (!source_frame)
-		return;
+		return source_frame;
 
 	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer", "new_frame->number", new_frame->number, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::apply_layer_effects", "source_frame->number", source_frame->number, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
 
 	/* REPLACE IMAGE WITH WAVEFORM IMAGE (IF NEEDED) */
-	if (source_clip->Waveform())
+	if (source_clip->Waveform() && first_effect == 0)
 	{
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Generate Waveform Image)", "source_frame->number", source_frame->number, "source_clip->Waveform()", source_clip->Waveform(), "clip_frame_number", clip_frame_number);
 
-		// Get the color of the waveform
-		int red = source_clip->wave_color.red.GetInt(clip_frame_number);
-		int green = source_clip->wave_color.green.GetInt(clip_frame_number);
-		int blue = source_clip->wave_color.blue.GetInt(clip_frame_number);
-		int alpha = source_clip->wave_color.alpha.GetInt(clip_frame_number);
-
-		// Generate Waveform Dynamically (the size of the timeline)
+		// Generate Waveform Dynamically (the size of the timeline, in the color of the waveform)
 		std::shared_ptr<QImage> source_image;
-		#pragma omp critical (T_addLayer)
-		source_image = source_frame->GetWaveform(Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, red, green, blue, alpha);
+		source_image = source_frame->GetWaveform(max_width(), max_height(), properties.wave_red, properties.wave_green, properties.wave_blue, properties.wave_alpha);
 		source_frame->AddImage(std::shared_ptr<QImage>(source_image));
 	}
 
 	/* Apply effects to the source frame (if any). If multiple clips are overlapping, only process the
 	 * effects on the top clip. */
 	if (is_top_clip && source_frame) {
-		#pragma omp critical (T_addLayer)
-		source_frame = apply_effects(source_frame, timeline_frame_number, source_clip->Layer());
+		// Only the cropped part of the image is composited, so effects can skip the rest
+		QRectF crop = clip_crop(source_clip, properties);
+		int image_width = source_frame->GetWidth();
+		int image_height = source_frame->GetHeight();
+		QRect visible_region = QRectF(crop.x() * image_width, crop.y() * image_height, crop.width() * image_width, crop.height() * image_height).toAlignedRect();
+
+		// Keep a 1 pixel border, which smooth scaling can sample (and only skip pixels in the effects after the
+		// last batched effect, since a batched effect can move pixels)
+		visible_region.adjust(-1, -1, 1, 1);
+		visible_region &= QRect(0, 0, image_width, image_height);
+		if (last_effect >= 0)
+			visible_region = QRect();
+		source_frame = apply_effects(std::move(source_frame), timeline_frame_number, source_clip->Layer(), visible_region, first_effect, last_effect);
 	}
 
-	// Declare an image to hold the source frame's image
-	std::shared_ptr<QImage> source_image;
-
-	/* COPY AUDIO - with correct volume */
-	if (source_clip->Reader()->info.has_audio) {
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Copy Audio)", "source_clip->Reader()->info.has_audio", source_clip->Reader()->info.has_audio, "source_frame->GetAudioChannelsCount()", source_frame->GetAudioChannelsCount(), "info.channels", info.channels, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
-
-		if (source_frame->GetAudioChannelsCount() == info.channels && source_clip->has_audio.GetInt(clip_frame_number) != 0)
-			for (int channel = 0; channel < source_frame->GetAudioChannelsCount(); channel++)
-			{
-				// Get volume from previous frame and this frame
-				float previous_volume = source_clip->volume.GetValue(clip_frame_number - 1);
-				float volume = source_clip->volume.GetValue(clip_frame_number);
-				int channel_filter = source_clip->channel_filter.GetInt(clip_frame_number); // optional channel to filter (if not -1)
-				int channel_mapping = source_clip->channel_mapping.GetInt(clip_frame_number); // optional channel to map this channel to (if not -1)
-
-				// Apply volume mixing strategy
-				if (source_clip->mixing == VOLUME_MIX_AVERAGE && max_volume > 1.0) {
-					// Don't allow this clip to exceed 100% (divide volume equally between all overlapping clips with volume
-					previous_volume = previous_volume / max_volume;
-					volume = volume / max_volume;
-				}
-				else if (source_clip->mixing == VOLUME_MIX_REDUCE && max_volume > 1.0) {
-					// Reduce clip volume by a bit, hoping it will prevent exceeding 100% (but it is very possible it will)
-					previous_volume = previous_volume * 0.77;
-					volume = volume * 0.77;
-				}
-
-				// If channel filter enabled, check for correct channel (and skip non-matching channels)
-				if (channel_filter != -1 && channel_filter != channel)
-					continue; // skip to next channel
-
-				// If no volume on this frame or previous frame, do nothing
-				if (previous_volume == 0.0 && volume == 0.0)
-					continue; // skip to next channel
+	return source_frame;
+}
 
-				// If channel mapping disabled, just use the current channel
-				if (channel_mapping == -1)
-					channel_mapping = channel;
+// Get the part of a clip's image which is shown (as fractions of the image size), from its crop keyframes and gravity
+QRectF Timeline::clip_crop(Clip* source_clip, const ClipProperties& properties)
+{
+	float crop_x = properties.crop_x;
+	float crop_y = properties.crop_y;
+	float crop_w = properties.crop_width;
+	float crop_h = properties.crop_height;
+	switch(source_clip->crop_gravity)
+	{
+		case (GRAVITY_TOP):
+			crop_x += 0.5;
+			break;
+		case (GRAVITY_TOP_RIGHT):
+			crop_x += 1.0;
+			break;
+		case (GRAVITY_LEFT):
+			crop_y += 0.5;
+			break;
+		case (GRAVITY_CENTER):
+			crop_x += 0.5;
+			crop_y += 0.5;
+			break;
+		case (GRAVITY_RIGHT):
+			crop_x += 1.0;
+			crop_y += 0.5;
+			break;
+		case (GRAVITY_BOTTOM_LEFT):
+			crop_y += 1.0;
+			break;
+		case (GRAVITY_BOTTOM):
+			crop_x += 0.5;
+			crop_y += 1.0;
+			break;
+		case (GRAVITY_BOTTOM_RIGHT):
+			crop_x += 1.0;
+			crop_y += 1.0;
+			break;
+	}
 
-				// Apply ramp to source frame (if needed)
-				if (!isEqual(previous_volume, 1.0) || !isEqual(volume, 1.0))
-					source_frame->ApplyGainRamp(channel_mapping, 0, source_frame->GetAudioSamplesCount(), previous_volume, volume);
+	return QRectF(crop_x, crop_y, crop_w, crop_h);
+}
 
-				// TODO: Improve FrameMapper (or Timeline) to always get the correct number of samples per frame.
-				// Currently, the ResampleContext sometimes leaves behind a few samples for the next call, and the
-				// number of samples returned is variable... and does not match the number expected.
-				// This is a crude solution at best. =)
-				if (new_frame->GetAudioSamplesCount() != source_frame->GetAudioSamplesCount())
-					// Force timeline frame to match the source frame
-					#pragma omp critical (T_addLayer)
-					new_frame->ResizeAudio(info.channels, source_frame->GetAudioSamplesCount(), info.sample_rate, info.channel_layout);
+// Add the audio of a layer (with its volume) to the sources mixed into each channel of a timeline frame
+void Timeline::add_layer_audio(std::vector<std::vector<AudioMixSource> >& channel_sources, const std::shared_ptr<Frame>& new_frame, const std::shared_ptr<Frame>& source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, float max_volume)
+{
+	// No frame found... so bail
+	if (!source_frame || !source_clip->Reader()->info.has_audio)
+		return;
 
-				// Copy audio samples (and set initial volume).  Mix samples with existing audio samples.  The gains are added together, to
-				// be sure to set the gain's correctly, so the sum does not exceed 1.0 (of audio distortion will happen).
-				#pragma omp critical (T_addLayer)
-				new_frame->AddAudio(false, channel_mapping, 0, source_frame->GetAudioSamples(channel), source_frame->GetAudioSamplesCount(), 1.0);
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer_audio", "source_clip->Reader()->info.has_audio", source_clip->Reader()->info.has_audio, "source_frame->GetAudioChannelsCount()", source_frame->GetAudioChannelsCount(), "info.channels", info.channels, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
 
-			}
-		else
-			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (No Audio Copied - Wrong # of Channels)", "source_clip->Reader()->info.has_audio", source_clip->Reader()->info.has_audio, "source_frame->GetAudioChannelsCount()", source_frame->GetAudioChannelsCount(), "info.channels", info.channels, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
+	if (source_frame->GetAudioChannelsCount() != info.channels || properties.has_audio == 0) {
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer_audio (No Audio Copied - Wrong # of Channels)", "source_clip->Reader()->info.has_audio", source_clip->Reader()->info.has_audio, "source_frame->GetAudioChannelsCount()", source_frame->GetAudioChannelsCount(), "info.channels", info.channels, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
+		return;
+	}
 
+	// Get volume from previous frame and this frame
+	float previous_volume = properties.previous_volume;
+	float volume = properties.volume;
+	int channel_filter = properties.channel_filter; // optional channel to filter (if not -1)
+	int channel_mapping = properties.channel_mapping; // optional channel to map this channel to (if not -1)
+
+	// Apply volume mixing strategy
+	if (source_clip->mixing == VOLUME_MIX_AVERAGE && max_volume > 1.0) {
+		// Don't allow this clip to exceed 100% (divide volume equally between all overlapping clips with volume
+		previous_volume = previous_volume / max_volume;
+		volume = volume / max_volume;
+	}
+	else if (source_clip->mixing == VOLUME_MIX_REDUCE && max_volume > 1.0) {
+		// Reduce clip volume by a bit, hoping it will prevent exceeding 100% (but it is very possible it will)
+		previous_volume = previous_volume * 0.77;
+		volume = volume * 0.77;
 	}
 
-	// Skip out if only an audio frame
-	if (!source_clip->Waveform() && !source_clip->Reader()->info.has_video)
-		// Skip the rest of the image processing for performance reasons
+	// If no volume on this frame or previous frame, do nothing
+	if (previous_volume == 0.0 && volume == 0.0)
 		return;
 
-	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Get Source Image)", "source_frame->number", source_frame->number, "source_clip->Waveform()", source_clip->Waveform(), "clip_frame_number", clip_frame_number);
-
-	// Get actual frame image data
-	source_image = source_frame->GetImage();
+	// Clips mapped to the timeline's rate have the exact same samples per frame (see Frame::GetSamplesBeforeFrame),
+	// so this only resizes the timeline frame for a clip which is not mapped (see AutoMapClips)
+	if (new_frame->GetAudioSamplesCount() != source_frame->GetAudioSamplesCount())
+		// Force timeline frame to match the source frame
+		new_frame->ResizeAudio(info.channels, source_frame->GetAudioSamplesCount(), info.sample_rate, info.channel_layout);
 
-	/* ALPHA & OPACITY */
-	if (source_clip->alpha.GetValue(clip_frame_number) != 1.0)
+	channel_sources.resize(info.channels);
+	for (int channel = 0; channel < source_frame->GetAudioChannelsCount(); channel++)
 	{
-		float alpha = source_clip->alpha.GetValue(clip_frame_number);
-
-		// Get source image's pixels
-		unsigned char *pixels = (unsigned char *) source_image->bits();
-
-		// Loop through pixels
-		for (int pixel = 0, byte_index=0; pixel < source_image->width() * source_image->height(); pixel++, byte_index+=4)
-		{
-			// Get the alpha values from the pixel
-			int A = pixels[byte_index + 3];
+		// If channel filter enabled, check for correct channel (and skip non-matching channels)
+		if (channel_filter != -1 && channel_filter != channel)
+			continue; // skip to next channel
+
+		// If channel mapping disabled, just use the current channel
+		int target_channel = (channel_mapping == -1) ? channel : channel_mapping;
+		if (target_channel < 0 || target_channel >= info.channels)
+			continue;
+
+		// Mix the samples with the gain ramp (instead of applying the ramp to the clip's frame, which may be cached)
+		AudioMixSource source = {source_frame->GetAudioView().Channel(channel), source_frame->GetAudioSamplesCount(), previous_volume, volume};
+		channel_sources[target_channel].push_back(source);
+	}
+}
 
-			// Apply alpha to pixel
-			pixels[byte_index + 3] *= alpha;
+// Mix the audio of all layers into each channel of a timeline frame (in a single pass per channel)
+void Timeline::mix_layer_audio(const std::shared_ptr<Frame>& new_frame, const std::vector<std::vector<AudioMixSource> >& channel_sources)
+{
+	int samples_in_frame = new_frame->GetAudioSamplesCount();
+	for (int channel = 0; channel < channel_sources.size(); channel++)
+	{
+		// Sources with all the samples are mixed together (and any shorter source on its own)
+		std::vector<AudioMixSource> full_sources;
+		for (int index = 0; index < channel_sources[channel].size(); index++) {
+			const AudioMixSource &source = channel_sources[channel][index];
+			if (source.sample_count >= samples_in_frame)
+				full_sources.push_back(source);
+			else
+				new_frame->MixAudio(channel, &source, 1, source.sample_count);
 		}
-
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Set Alpha & Opacity)", "alpha", alpha, "source_frame->number", source_frame->number, "clip_frame_number", clip_frame_number);
+		new_frame->MixAudio(channel, full_sources.data(), full_sources.size(), samples_in_frame);
 	}
+}
 
+// Get the size and position of a clip's image on the timeline frame (before it is rotated and sheared)
+LayerPlacement Timeline::place_layer(Clip* source_clip, const ClipProperties& properties, QSize image_size, int64_t frame_number)
+{
 	/* RESIZE SOURCE IMAGE - based on scale type */
-	QSize source_size = source_image->size();
+	QSize source_size = image_size;
 	switch (source_clip->scale)
 	{
 		case (SCALE_FIT): {
 			// keep aspect ratio
-			source_size.scale(Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, Qt::KeepAspectRatio);
+			source_size.scale(max_width(), max_height(), Qt::KeepAspectRatio);
 
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Scale: SCALE_FIT)", "source_frame->number", source_frame->number, "source_width", source_size.width(), "source_height", source_size.height());
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::place_layer (Scale: SCALE_FIT)", "frame_number", frame_number, "source_width", source_size.width(), "source_height", source_size.height());
 			break;
 		}
 		case (SCALE_STRETCH): {
 			// ignore aspect ratio
-			source_size.scale(Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, Qt::IgnoreAspectRatio);
+			source_size.scale(max_width(), max_height(), Qt::IgnoreAspectRatio);
 
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Scale: SCALE_STRETCH)", "source_frame->number", source_frame->number, "source_width", source_size.width(), "source_height", source_size.height());
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::place_layer (Scale: SCALE_STRETCH)", "frame_number", frame_number, "source_width", source_size.width(), "source_height", source_size.height());
 			break;
 		}
 		case (SCALE_CROP): {
-			QSize width_size(Settings::Instance()->MAX_WIDTH, round(Settings::Instance()->MAX_WIDTH / (float(source_size.width()) / float(source_size.height()))));
-			QSize height_size(round(Settings::Instance()->MAX_HEIGHT / (float(source_size.height()) / float(source_size.width()))), Settings::Instance()->MAX_HEIGHT);
+			QSize width_size(max_width(), round(max_width() / (float(source_size.width()) / float(source_size.height()))));
+			QSize height_size(round(max_height() / (float(source_size.height()) / float(source_size.width()))), max_height());
 
 			// respect aspect ratio
-			if (width_size.width() >= Settings::Instance()->MAX_WIDTH && width_size.height() >= Settings::Instance()->MAX_HEIGHT)
+			if (width_size.width() >= max_width() && width_size.height() >= max_height())
 				source_size.scale(width_size.width(), width_size.height(), Qt::KeepAspectRatio);
 			else
 				source_size.scale(height_size.width(), height_size.height(), Qt::KeepAspectRatio);
 
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Scale: SCALE_CROP)", "source_frame->number", source_frame->number, "source_width", source_size.width(), "source_height", source_size.height());
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::place_layer (Scale: SCALE_CROP)", "frame_number", frame_number, "source_width", source_size.width(), "source_height", source_size.height());
 			break;
 		}
 		case (SCALE_NONE): {
@@ -452,49 +869,20 @@ void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, in
 			// (otherwise NONE scaling draws the frame image outside of the preview)
 			float source_width_ratio = source_size.width() / float(info.width);
 			float source_height_ratio = source_size.height() / float(info.height);
-			source_size.scale(Settings::Instance()->MAX_WIDTH * source_width_ratio, Settings::Instance()->MAX_HEIGHT * source_height_ratio, Qt::KeepAspectRatio);
+			source_size.scale(max_width() * source_width_ratio, max_height() * source_height_ratio, Qt::KeepAspectRatio);
 
 			// Debug output
-			ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Scale: SCALE_NONE)", "source_frame->number", source_frame->number, "source_width", source_size.width(), "source_height", source_size.height());
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::place_layer (Scale: SCALE_NONE)", "frame_number", frame_number, "source_width", source_size.width(), "source_height", source_size.height());
 			break;
 		}
 	}
 
-    float crop_x = source_clip->crop_x.GetValue(clip_frame_number);
-    float crop_y = source_clip->crop_y.GetValue(clip_frame_number);
-    float crop_w = source_clip->crop_width.GetValue(clip_frame_number);
-    float crop_h = source_clip->crop_height.GetValue(clip_frame_number);
-    switch(source_clip->crop_gravity)
-    {
-      case (GRAVITY_TOP):
-          crop_x += 0.5;
-          break;
-      case (GRAVITY_TOP_RIGHT):
-          crop_x += 1.0;
-          break;
-      case (GRAVITY_LEFT):
-          crop_y += 0.5;
-          break;
-      case (GRAVITY_CENTER):
-          crop_x += 0.5;
-          crop_y += 0.5;
-          break;
-      case (GRAVITY_RIGHT):
-          crop_x += 1.0;
-          crop_y += 0.5;
-          break;
-      case (GRAVITY_BOTTOM_LEFT):
-          crop_y += 1.0;
-          break;
-      case (GRAVITY_BOTTOM):
-          crop_x += 0.5;
-          crop_y += 1.0;
-          break;
-      case (GRAVITY_BOTTOM_RIGHT):
-          crop_x += 1.0;
-          crop_y += 1.0;
-          break;
-    }
+	// Get the cropped part of the source image
+	QRectF crop = clip_crop(source_clip, properties);
+	float crop_x = crop.x();
+	float crop_y = crop.y();
+	float crop_w = crop.width();
+	float crop_h = crop.height();
 
 
 	/* GRAVITY LOCATION - Initialize X & Y to the correct values (before applying location curves) */
@@ -502,63 +890,85 @@ void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, in
 	float y = 0.0; // top
 
 	// Adjust size for scale x and scale y
-	float sx = source_clip->scale_x.GetValue(clip_frame_number); // percentage X scale
-	float sy = source_clip->scale_y.GetValue(clip_frame_number); // percentage Y scale
+	float sx = properties.scale_x; // percentage X scale
+	float sy = properties.scale_y; // percentage Y scale
 	float scaled_source_width = source_size.width() * sx;
 	float scaled_source_height = source_size.height() * sy;
 
 	switch (source_clip->gravity)
 	{
 	case (GRAVITY_TOP):
-		x = (Settings::Instance()->MAX_WIDTH - scaled_source_width) / 2.0; // center
+		x = (max_width() - scaled_source_width) / 2.0; // center
 		break;
 	case (GRAVITY_TOP_RIGHT):
-		x = Settings::Instance()->MAX_WIDTH - scaled_source_width; // right
+		x = max_width() - scaled_source_width; // right
 		break;
 	case (GRAVITY_LEFT):
-		y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height) / 2.0; // center
+		y = (max_height() - scaled_source_height) / 2.0; // center
 		break;
 	case (GRAVITY_CENTER):
-		x = (Settings::Instance()->MAX_WIDTH - scaled_source_width) / 2.0; // center
-		y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height) / 2.0; // center
+		x = (max_width() - scaled_source_width) / 2.0; // center
+		y = (max_height() - scaled_source_height) / 2.0; // center
 		break;
 	case (GRAVITY_RIGHT):
-		x = Settings::Instance()->MAX_WIDTH - scaled_source_width; // right
-		y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height) / 2.0; // center
+		x = max_width() - scaled_source_width; // right
+		y = (max_height() - scaled_source_height) / 2.0; // center
 		break;
 	case (GRAVITY_BOTTOM_LEFT):
-        y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height); // bottom
+        y = (max_height() - scaled_source_height); // bottom
 		break;
 	case (GRAVITY_BOTTOM):
-		x = (Settings::Instance()->MAX_WIDTH - scaled_source_width) / 2.0; // center
-		y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height); // bottom
+		x = (max_width() - scaled_source_width) / 2.0; // center
+		y = (max_height() - scaled_source_height); // bottom
 		break;
 	case (GRAVITY_BOTTOM_RIGHT):
-		x = Settings::Instance()->MAX_WIDTH - scaled_source_width; // right
-		y = (Settings::Instance()->MAX_HEIGHT - scaled_source_height); // bottom
+		x = max_width() - scaled_source_width; // right
+		y = (max_height() - scaled_source_height); // bottom
 		break;
 	}
 
 	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Gravity)", "source_frame->number", source_frame->number, "source_clip->gravity", source_clip->gravity, "info.width", info.width, "scaled_source_width", scaled_source_width, "info.height", info.height, "scaled_source_height", scaled_source_height);
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::place_layer (Gravity)", "frame_number", frame_number, "source_clip->gravity", source_clip->gravity, "info.width", info.width, "scaled_source_width", scaled_source_width, "info.height", info.height, "scaled_source_height", scaled_source_height);
+
+	/* LOCATION, AND SCALE */
+	x += (max_width() * properties.location_x); // move in percentage of final width
+	y += (max_height() * properties.location_y); // move in percentage of final height
+
+	LayerPlacement placement;
+	placement.x = x;
+	placement.y = y;
+	placement.scaled_width = scaled_source_width;
+	placement.scaled_height = scaled_source_height;
+	placement.width_scale = (float(source_size.width()) / float(image_size.width())) * sx;
+	placement.height_scale = (float(source_size.height()) / float(image_size.height())) * sy;
+
+	// Images decoded at the size they are drawn at are composited without scaling (ignoring rounding)
+	if (fabs(scaled_source_width - image_size.width()) < 1.0 && fabs(scaled_source_height - image_size.height()) < 1.0) {
+		placement.width_scale = 1.0;
+		placement.height_scale = 1.0;
+	}
 
-	/* LOCATION, ROTATION, AND SCALE */
-	float r = source_clip->rotation.GetValue(clip_frame_number); // rotate in degrees
-	x += (Settings::Instance()->MAX_WIDTH * source_clip->location_x.GetValue(clip_frame_number)); // move in percentage of final width
-	y += (Settings::Instance()->MAX_HEIGHT * source_clip->location_y.GetValue(clip_frame_number)); // move in percentage of final height
-	float shear_x = source_clip->shear_x.GetValue(clip_frame_number);
-	float shear_y = source_clip->shear_y.GetValue(clip_frame_number);
+	// The cropped part of the source image
+	placement.source_rect = QRect(crop_x * image_size.width(), crop_y * image_size.height(), crop_w * image_size.width(), crop_h * image_size.height());
+	return placement;
+}
 
-	bool transformed = false;
-	QTransform transform;
+// Get the transform of a clip's image (which moves, scales, rotates, and shears it)
+QTransform Timeline::layer_transform(const LayerPlacement& placement, const ClipProperties& properties, bool& transformed)
+{
+	float x = placement.x;
+	float y = placement.y;
+	float r = properties.rotation; // rotate in degrees
+	float shear_x = properties.shear_x;
+	float shear_y = properties.shear_y;
 
-	// Transform source image (if needed)
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Build QTransform - if needed)", "source_frame->number", source_frame->number, "x", x, "y", y, "r", r, "sx", sx, "sy", sy);
+	transformed = false;
+	QTransform transform;
 
 	if (!isEqual(r, 0)) {
 		// ROTATE CLIP
-		float origin_x = x + (scaled_source_width / 2.0);
-		float origin_y = y + (scaled_source_height / 2.0);
+		float origin_x = x + (placement.scaled_width / 2.0);
+		float origin_y = y + (placement.scaled_height / 2.0);
 		transform.translate(origin_x, origin_y);
 		transform.rotate(r);
 		transform.translate(-origin_x,-origin_y);
@@ -572,11 +982,8 @@ void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, in
     }
 
 	// SCALE CLIP (if needed)
-	float source_width_scale = (float(source_size.width()) / float(source_image->width())) * sx;
-	float source_height_scale = (float(source_size.height()) / float(source_image->height())) * sy;
-
-	if (!isEqual(source_width_scale, 1.0) || !isEqual(source_height_scale, 1.0)) {
-		transform.scale(source_width_scale, source_height_scale);
+	if (!isEqual(placement.width_scale, 1.0) || !isEqual(placement.height_scale, 1.0)) {
+		transform.scale(placement.width_scale, placement.height_scale);
 		transformed = true;
 	}
 
@@ -586,28 +993,173 @@ void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, in
         transformed = true;
     }
 
+	return transform;
+}
+
+// Composite a new layer of video
+void Timeline::add_layer(const std::shared_ptr<Frame>& new_frame, const std::shared_ptr<Frame>& source_frame, Clip* source_clip, const ClipProperties& properties, int64_t clip_frame_number, int64_t timeline_frame_number, int composite_bands, bool is_hidden)
+{
+	TraceSpan trace_span("Timeline::add_layer", "composite", timeline_frame_number);
+	static MemoryGauge& timeline_memory = Metrics::Instance()->GetMemory("images.timeline");
+	ScopedMemoryTag memory_tag(timeline_memory);
+
+	// No frame found... so bail
+	if (!source_frame)
+		return;
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer", "new_frame->number", new_frame->number, "clip_frame_number", clip_frame_number, "timeline_frame_number", timeline_frame_number);
+
+	// Declare an image to hold the source frame's image
+	std::shared_ptr<QImage> source_image;
+
+	// Skip out if only an audio frame (or if the image is covered by a higher layer)
+	if ((!source_clip->Waveform() && !source_clip->Reader()->info.has_video) || is_hidden)
+		// Skip the rest of the image processing for performance reasons
+		return;
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Get Source Image)", "source_frame->number", source_frame->number, "source_clip->Waveform()", source_clip->Waveform(), "clip_frame_number", clip_frame_number);
+
+	// Take the image geometry (i.e. of the Crop and Bars effects), which is composited below (instead of painted into the pixels)
+	QRect geometry_clip;
+	std::vector<std::pair<QRect, QColor> > geometry_fills;
+	bool has_geometry = source_frame->TakeImageGeometry(geometry_clip, geometry_fills);
+
+	// A placed image (i.e. a title) only covers a part of the frame, and is drawn at its offset (so the image of the
+	// full frame is never created)
+	QPoint placed_offset;
+	bool is_placed = source_frame->GetPlacedImage(source_image, placed_offset);
+
+	// Get actual frame image data
+	if (!is_placed)
+		source_image = source_frame->GetImage();
+	QSize image_size = is_placed ? QSize(source_frame->GetWidth(), source_frame->GetHeight()) : source_image->size();
+
+	/* ALPHA & OPACITY - applied by the painter while compositing (instead of a separate pass over the source pixels) */
+	float alpha = properties.alpha;
+
+	/* SIZE AND LOCATION - based on scale type, gravity, and location curves */
+	LayerPlacement placement = place_layer(source_clip, properties, image_size, source_frame->number);
+	float x = placement.x;
+	float y = placement.y;
+	float source_width_scale = placement.width_scale;
+	float source_height_scale = placement.height_scale;
+
+	/* ROTATION, AND SHEAR */
+	float r = properties.rotation; // rotate in degrees
+	float shear_x = properties.shear_x;
+	float shear_y = properties.shear_y;
+
+	// Transform source image (if needed)
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Build QTransform - if needed)", "source_frame->number", source_frame->number, "x", x, "y", y, "r", r, "source_width_scale", source_width_scale, "source_height_scale", source_height_scale);
+
+	bool transformed = false;
+	QTransform transform = layer_transform(placement, properties, transformed);
+
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Transform: Composite Image Layer: Prepare)", "source_frame->number", source_frame->number, "new_frame->GetImage()->width()", new_frame->GetImage()->width(), "transformed", transformed);
 
+	// Get the part of the source image to draw (skipping the pixels outside of the geometry clip)
+	QRect source_rect = placement.source_rect;
+	QRect draw_rect = source_rect;
+
+	// Only the visible pixels are composited (keeping a transparent border, so the edges are interpolated the same)
+	QRect visible = visible_rect(source_image).translated(placed_offset);
+	if (visible.isEmpty())
+		draw_rect = QRect();
+	else if (visible != QRect(QPoint(0, 0), image_size))
+		draw_rect &= visible.adjusted(-2, -2, 2, 2);
+	if (is_placed)
+		draw_rect &= QRect(placed_offset, source_image->size());
+
+	QRegion fill_region;
+	if (has_geometry) {
+		draw_rect &= geometry_clip;
+
+		// The filled rectangles (in the coordinates of the drawn image) replace the image's pixels (and are
+		// faded with the image, by the painter's opacity)
+		for (size_t index = 0; index < geometry_fills.size(); index++) {
+			geometry_fills[index].first = geometry_fills[index].first.intersected(source_rect).translated(-source_rect.topLeft());
+			fill_region += geometry_fills[index].first;
+		}
+	}
+
+	// The part of the source image to draw (in the coordinates of a placed image)
+	QRect image_rect = draw_rect.translated(-placed_offset);
+
 	/* COMPOSITE SOURCE IMAGE (LAYER) ONTO FINAL IMAGE */
 	std::shared_ptr<QImage> new_image;
-	#pragma omp critical (T_addLayer)
-		new_image = new_frame->GetImage();
+	new_image = new_frame->GetImage();
+
+	// Images which are only scaled and moved (and cropped), by far the most common case, skip QPainter
+	bool scaled_only = Settings::Instance()->SIMD_COMPOSITING && !has_geometry && isEqual(r, 0) && isEqual(shear_x, 0) && isEqual(shear_y, 0) &&
+					   source_width_scale > 0.0 && source_height_scale > 0.0 && can_composite_scaled(new_image, source_image);
+	if (scaled_only) {
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Transform: Composite Image Layer: Scaled)", "source_frame->number", source_frame->number, "x", x, "y", y, "source_width_scale", source_width_scale, "source_height_scale", source_height_scale);
 
-	// Load timeline's new frame image into a QPainter
-	QPainter painter(new_image.get());
-	painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::TextAntialiasing, true);
+		float draw_x = x + (draw_rect.x() - source_rect.x()) * source_width_scale;
+		float draw_y = y + (draw_rect.y() - source_rect.y()) * source_height_scale;
+		composite_scaled(new_image, source_image, image_rect, draw_x, draw_y, source_width_scale, source_height_scale, alpha, composite_bands);
+	} else {
+		// Split the final image into horizontal bands (each band is composited by its own QPainter)
+		int image_height = new_image->height();
+		int bands = std::max(1, std::min(composite_bands, image_height));
+		int band_height = (image_height + bands - 1) / bands;
+		int bytes_per_line = new_image->bytesPerLine();
+
+		// Detach the image data once (before any band starts painting into it)
+		unsigned char *new_pixels = new_image->bits();
 
-	// Apply transform (translate, rotate, scale)... if any
-	if (transformed)
-		painter.setTransform(transform);
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Transform: Composite Image Layer: Bands)", "source_frame->number", source_frame->number, "bands", bands, "band_height", band_height);
 
-	// Composite a new layer onto the image
-    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    painter.drawImage(0, 0, *source_image, crop_x * source_image->width(), crop_y * source_image->height(), crop_w * source_image->width(), crop_h * source_image->height());
+		TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+		{
+			int band_y = band * band_height;
+			int band_rows = std::min(band_height, image_height - band_y);
+			if (band_rows <= 0)
+				return;
+
+			// Wrap this band's rows of the final image (no copy)
+			QImage band_image(new_pixels + (band_y * bytes_per_line), new_image->width(), band_rows, bytes_per_line, new_image->format());
+
+			// Load band into a QPainter
+			QPainter band_painter(&band_image);
+			band_painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::TextAntialiasing, true);
+
+			// Apply transform (translate, rotate, scale)... if any, and shift up to this band's origin
+			if (transformed || band_y > 0)
+				band_painter.setTransform(transform * QTransform::fromTranslate(0, -band_y));
+
+			// Composite a new layer onto the band (fading it by the clip's alpha)
+			band_painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+			if (alpha != 1.0)
+				band_painter.setOpacity(alpha);
+			if (!has_geometry && draw_rect == source_rect)
+				band_painter.drawImage(0, 0, *source_image, image_rect.x(), image_rect.y(), image_rect.width(), image_rect.height());
+			else if (!draw_rect.isEmpty()) {
+				// Draw the clipped image (except for the filled rectangles), and then fill the rectangles
+				if (!fill_region.isEmpty())
+					band_painter.setClipRegion(QRegion(draw_rect.translated(-source_rect.topLeft())) - fill_region);
+				band_painter.drawImage(draw_rect.x() - source_rect.x(), draw_rect.y() - source_rect.y(), *source_image, image_rect.x(), image_rect.y(), image_rect.width(), image_rect.height());
+				band_painter.setClipping(false);
+				for (size_t index = 0; index < geometry_fills.size(); index++)
+					band_painter.fillRect(geometry_fills[index].first, geometry_fills[index].second);
+			}
+			band_painter.end();
+		});
+	}
 
     // Draw frame #'s on top of image (if needed)
     if (source_clip->display != FRAME_DISPLAY_NONE) {
+        // Load timeline's new frame image into a QPainter
+        QPainter painter(new_image.get());
+        painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::TextAntialiasing, true);
+        if (transformed)
+            painter.setTransform(transform);
+
         std::stringstream frame_number_str;
         switch (source_clip->display)
         {
@@ -627,60 +1179,305 @@ void Timeline::add_layer(std::shared_ptr<Frame> new_frame, Clip* source_clip, in
         // Draw frame number on top of image
         painter.setPen(QColor("#ffffff"));
         painter.drawText(20, 20, QString(frame_number_str.str().c_str()));
+        painter.end();
     }
 
-    painter.end();
-
 	// Debug output
 	ZmqLogger::Instance()->AppendDebugMethod("Timeline::add_layer (Transform: Composite Image Layer: Completed)", "source_frame->number", source_frame->number, "new_frame->GetImage()->width()", new_frame->GetImage()->width(), "transformed", transformed);
 }
 
-// Update the list of 'opened' clips
-void Timeline::update_open_clips(Clip *clip, bool does_clip_intersect)
+// Composite the native planes of the clips of a frame (if every layer is only moved, scaled, and faded)
+bool Timeline::composite_planes(const std::shared_ptr<Frame>& new_frame, const FramePlan& frame_plan, const std::vector<std::shared_ptr<Frame> >& layer_frames, QColor background, int composite_bands)
 {
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_open_clips (before)", "does_clip_intersect", does_clip_intersect, "closing_clips.size()", closing_clips.size(), "open_clips.size()", open_clips.size());
-
-	// is clip already in list?
-	bool clip_found = open_clips.count(clip);
+	TraceSpan trace_span("Timeline::composite_planes", "composite", frame_plan.frame_number);
+
+	// Find the planes of each visible layer (the planes are only kept by a frame while its image is unchanged)
+	std::vector<std::shared_ptr<FramePlanes> > layer_planes(frame_plan.layers.size());
+	int pixel_format = -1;
+	for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		std::shared_ptr<Frame> source_frame = layer_frames[layer_index];
+		if (!source_frame || layer.is_hidden || (!layer.clip->Waveform() && !layer.clip->Reader()->info.has_video))
+			continue;
+		if (layer.clip->Waveform() || layer.clip->display != FRAME_DISPLAY_NONE ||
+			!isEqual(layer.properties.rotation, 0) || !isEqual(layer.properties.shear_x, 0) || !isEqual(layer.properties.shear_y, 0))
+			return false;
+
+		std::shared_ptr<QImage> placed_image;
+		QPoint placed_offset;
+		if (source_frame->HasImageGeometry() || source_frame->GetPlacedImage(placed_image, placed_offset))
+			return false;
+
+		std::shared_ptr<FramePlanes> planes = source_frame->GetPlanes();
+		if (!planes || !PlaneCompositor::IsSupported(planes->pixel_format) || source_frame->GetWidth() <= 0 || source_frame->GetHeight() <= 0)
+			return false;
+
+		// The composite has the (opaque) format of the first layer
+		if (pixel_format < 0)
+			pixel_format = PlaneCompositor::CompositeFormat(planes->pixel_format);
+		layer_planes[layer_index] = planes;
+	}
+	if (pixel_format < 0)
+		return false;
 
-	if (clip_found && !does_clip_intersect)
-	{
-		// Remove clip from 'opened' list, because it's closed now
-		open_clips.erase(clip);
+	std::shared_ptr<FramePlanes> new_planes = PlaneCompositor::CreatePlanes(max_width(), max_height(), pixel_format, background);
+	if (!new_planes)
+		return false;
 
-		// Close clip
-		clip->Close();
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::composite_planes", "frame_number", frame_plan.frame_number, "pixel_format", pixel_format, "frame_plan.layers.size()", frame_plan.layers.size());
+
+	for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+		std::shared_ptr<FramePlanes> planes = layer_planes[layer_index];
+		if (!planes)
+			continue;
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		std::shared_ptr<Frame> source_frame = layer_frames[layer_index];
+
+		// Place the layer at the size of its image, and then scale it to the size of its planes (i.e. an image
+		// decoded at a smaller size, see Settings::SCALE_ON_DECODE)
+		QSize image_size(source_frame->GetWidth(), source_frame->GetHeight());
+		LayerPlacement placement = place_layer(layer.clip, layer.properties, image_size, frame_plan.frame_number);
+		float plane_width_scale = float(planes->width) / float(image_size.width());
+		float plane_height_scale = float(planes->height) / float(image_size.height());
+		QRectF source_rect(placement.source_rect.x() * plane_width_scale, placement.source_rect.y() * plane_height_scale,
+						   placement.source_rect.width() * plane_width_scale, placement.source_rect.height() * plane_height_scale);
+
+		PlaneCompositor::Composite(new_planes, planes, source_rect, placement.x, placement.y, placement.width_scale / plane_width_scale,
+								   placement.height_scale / plane_height_scale, layer.properties.alpha, composite_bands);
 	}
-	else if (!clip_found && does_clip_intersect)
+
+	// The image is only converted from the planes if it is needed (an FFmpegWriter of the same pixel format encodes the planes)
+	new_frame->SetImageLoader(max_width(), max_height(), [new_planes](Frame *frame)
 	{
-		// Add clip to 'opened' list, because it's missing
-		open_clips[clip] = clip;
+		frame->AddImage(PlaneCompositor::ToImage(new_planes, Frame::ImageFormat()));
+		frame->AddPlanes(new_planes);
+	}, new_planes);
+	return true;
+}
 
-		try {
-			// Open the clip
-			clip->Open();
+// Composite the layers of a frame on the GPU (running the point-wise effects of the clips there too)
+bool Timeline::composite_gpu(const std::shared_ptr<Frame>& new_frame, const FramePlan& frame_plan, std::vector<std::shared_ptr<Frame> >& layer_frames, QColor background)
+{
+	TraceSpan trace_span("Timeline::composite_gpu", "composite", frame_plan.frame_number);
+
+	// The composite is 8-bit (so high bit depth frames are composited on the CPU), and frame numbers are drawn by QPainter
+	QImage::Format format = Frame::ImageFormat();
+	if (format != QImage::Format_RGBA8888 && format != QImage::Format_ARGB32_Premultiplied)
+		return false;
+	for (const LayerPlan& layer : frame_plan.layers)
+		if (layer.clip->display != FRAME_DISPLAY_NONE)
+			return false;
+
+	// Fetch the remaining layers, deferring the clip effects of the visible layers (which the waveform and timeline
+	// effects don't draw over) to the GPU
+	size_t first_fetched = layer_frames.size();
+	std::vector<std::vector<EffectBase::GpuKernel> > layer_kernels(frame_plan.layers.size());
+	bool has_kernels = false;
+	for (int layer_index = first_fetched; layer_index < frame_plan.layers.size(); layer_index++) {
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		bool defer_effects = !layer.is_hidden && !layer.clip->Waveform() && find_layer_effects(frame_plan.frame_number, layer.clip->Layer()).empty();
+		std::shared_ptr<Frame> source_frame = GetOrCreateFrame(layer.clip, layer.clip_frame_number, layer.draw_width, layer.draw_height, false, defer_effects ? &layer_kernels[layer_index] : NULL);
+		layer_frames.push_back(apply_layer_effects(source_frame, layer.clip, layer.properties, layer.clip_frame_number, frame_plan.frame_number, layer.is_top_clip));
+		has_kernels |= !layer_kernels[layer_index].empty();
+	}
 
-		} catch (const InvalidFile & e) {
-			// ...
+	// The layers fetched with GPU kernels are fetched again (with their effects) if the frame is composited on the CPU
+	bool supported = true;
+	std::vector<GpuLayer> gpu_layers;
+	for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		std::shared_ptr<Frame> source_frame = layer_frames[layer_index];
+		if (!source_frame || layer.is_hidden || (!layer.clip->Waveform() && !layer.clip->Reader()->info.has_video))
+			continue;
+
+		std::shared_ptr<QImage> placed_image;
+		QPoint placed_offset;
+		if (source_frame->HasImageGeometry() || source_frame->GetPlacedImage(placed_image, placed_offset)) {
+			supported = false;
+			break;
 		}
+
+		GpuLayer gpu_layer;
+		gpu_layer.image = source_frame->GetImage();
+		LayerPlacement placement = place_layer(layer.clip, layer.properties, gpu_layer.image->size(), frame_plan.frame_number);
+		bool transformed = false;
+		gpu_layer.draw_rect = placement.source_rect;
+		gpu_layer.transform = QTransform::fromTranslate(-placement.source_rect.x(), -placement.source_rect.y()) * layer_transform(placement, layer.properties, transformed);
+		gpu_layer.alpha = layer.properties.alpha;
+		gpu_layer.kernels = layer_kernels[layer_index];
+		gpu_layers.push_back(gpu_layer);
 	}
 
 	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_open_clips (after)", "does_clip_intersect", does_clip_intersect, "clip_found", clip_found, "closing_clips.size()", closing_clips.size(), "open_clips.size()", open_clips.size());
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::composite_gpu", "frame_number", frame_plan.frame_number, "frame_plan.layers.size()", frame_plan.layers.size(), "gpu_layers.size()", gpu_layers.size(), "has_kernels", has_kernels);
+
+	std::shared_ptr<QImage> image;
+	if (supported)
+		image = GpuCompositor::Instance()->Composite(max_width(), max_height(), background, gpu_layers, format);
+	if (!image) {
+		if (has_kernels)
+			layer_frames.resize(first_fetched);
+		return false;
+	}
+
+	new_frame->AddImage(image);
+	return true;
 }
 
-// Sort clips by position on the timeline
-void Timeline::sort_clips()
+// Can an image be composited onto a timeline image by composite_scaled
+bool Timeline::can_composite_scaled(const std::shared_ptr<QImage>& new_image, const std::shared_ptr<QImage>& source_image)
 {
-	// Debug output
-	ZmqLogger::Instance()->AppendDebugMethod("Timeline::SortClips", "clips.size()", clips.size());
-
-	// sort clips
-	clips.sort(CompareClips());
+	// Both images need the same pixel layout (either one can be premultiplied, since the timeline image is always opaque)
+	QImage::Format new_format = StraightPixelFormat(new_image->format());
+	return new_format == StraightPixelFormat(source_image->format()) && IsPixelFormat(new_format);
 }
 
-// Sort effects by position on the timeline
-void Timeline::sort_effects()
+namespace {
+	// Find the source pixel (and the weight of the next pixel) sampled by the center of a timeline pixel
+	void sample_position(double position, int size, int32_t &index, uint16_t &weight) {
+		index = 0;
+		weight = 0;
+		if (position >= size - 1)
+			index = size - 1;
+		else if (position > 0.0) {
+			index = (int32_t) position;
+			int rounded_weight = (int) round((position - index) * 256);
+			if (rounded_weight >= 256)
+				index++;
+			else
+				weight = rounded_weight;
+		}
+	}
+
+	// Composite the rows of a scaled image, with the kernels of the pixel format of the source image
+	struct ScaledComposite {
+		QImage *new_image;
+		const QImage *source_image;
+		QRect source_rect;
+		float y;
+		float height_scale;
+		int first_column;
+		int first_row;
+		int last_row;
+		int bands;
+		int opacity;
+		const std::vector<int32_t> *column_indexes;
+		const std::vector<uint16_t> *column_weights;
+
+		template<class Format> void operator()(Format) {
+			typedef typename Format::Channel Channel;
+			int columns = column_indexes->size();
+			int band_height = (last_row - first_row + bands - 1) / bands;
+			Channel *new_pixels = Format::Pixels(*new_image);
+			int64_t new_stride = Format::LineStride(*new_image);
+			const Channel *source_pixels = Format::Pixels(*source_image);
+			int64_t source_stride = Format::LineStride(*source_image);
+			int width = source_rect.width();
+
+			TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+			{
+				int band_first_row = first_row + band * band_height;
+				int band_last_row = std::min(last_row, band_first_row + band_height);
+
+				// The vertically scaled row (with its last pixel repeated, for the horizontal interpolation), and the horizontally scaled row
+				std::vector<Channel> scaled_row((width + 1) * 4);
+				std::vector<Channel> resampled_row(columns * 4);
+				for (int row = band_first_row; row < band_last_row; row++)
+				{
+					int32_t index;
+					uint16_t weight;
+					sample_position((row + 0.5 - y) / height_scale - 0.5, source_rect.height(), index, weight);
+					const Channel *row0 = source_pixels + (source_rect.y() + index) * source_stride + source_rect.x() * 4;
+					const Channel *row1 = weight ? row0 + source_stride : row0;
+
+					PixelKernels::LerpRows<Format>(scaled_row.data(), row0, row1, width, weight);
+					std::copy(&scaled_row[(width - 1) * 4], &scaled_row[width * 4], &scaled_row[width * 4]);
+					PixelKernels::ResampleRow<Format>(resampled_row.data(), scaled_row.data(), column_indexes->data(), column_weights->data(), columns);
+					PixelKernels::BlendOver<Format>(new_pixels + row * new_stride + first_column * 4, resampled_row.data(), columns, opacity);
+				}
+			});
+		}
+	};
+}
+
+// Composite an image which is only scaled and moved (and cropped) onto an opaque timeline image
+void Timeline::composite_scaled(const std::shared_ptr<QImage>& new_image, const std::shared_ptr<QImage>& source_image, QRect source_rect, float x, float y, float width_scale, float height_scale, float alpha, int composite_bands)
+{
+	source_rect &= source_image->rect();
+	int opacity = std::max(0, std::min(256, (int) round(alpha * 256)));
+	if (source_rect.isEmpty() || opacity == 0)
+		return;
+
+	// The timeline pixels whose centers are inside the drawn rectangle
+	int first_column = std::max(0, (int) ceil(x - 0.5));
+	int last_column = std::min(new_image->width(), (int) ceil(x + source_rect.width() * width_scale - 0.5));
+	int first_row = std::max(0, (int) ceil(y - 0.5));
+	int last_row = std::min(new_image->height(), (int) ceil(y + source_rect.height() * height_scale - 0.5));
+	if (first_column >= last_column || first_row >= last_row)
+		return;
+
+	// Sample each column once (the clamped edge pixels repeat the first and last pixel)
+	int columns = last_column - first_column;
+	std::vector<int32_t> column_indexes(columns);
+	std::vector<uint16_t> column_weights(columns);
+	for (int column = 0; column < columns; column++)
+		sample_position((first_column + column + 0.5 - x) / width_scale - 0.5, source_rect.width(), column_indexes[column], column_weights[column]);
+
+	// Split the rows into bands (each band is composited by its own thread), and pick the kernels of the
+	// pixel format once for the whole image
+	int bands = std::max(1, std::min(composite_bands, last_row - first_row));
+	ScaledComposite composite = {new_image.get(), source_image.get(), source_rect, y, height_scale, first_column, first_row, last_row,
+								 bands, opacity, &column_indexes, &column_weights};
+	DispatchPixelFormat(source_image->format(), composite);
+}
+
+// Update the list of 'opened' clips
+void Timeline::update_open_clips(Clip *clip, bool does_clip_intersect)
+{
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_open_clips (before)", "does_clip_intersect", does_clip_intersect, "closing_clips.size()", closing_clips.size(), "open_clips.size()", open_clips.size());
+
+	// is clip already in list?
+	bool clip_found = open_clips.count(clip);
+
+	if (clip_found && !does_clip_intersect)
+	{
+		// Remove clip from 'opened' list, because it's closed now
+		open_clips.erase(clip);
+
+		// Close clip
+		clip->Close();
+	}
+	else if (!clip_found && does_clip_intersect)
+	{
+		// Add clip to 'opened' list, because it's missing
+		open_clips[clip] = clip;
+
+		try {
+			// Open the clip
+			clip->Open();
+
+		} catch (const InvalidFile & e) {
+			// ...
+		}
+	}
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_open_clips (after)", "does_clip_intersect", does_clip_intersect, "clip_found", clip_found, "closing_clips.size()", closing_clips.size(), "open_clips.size()", open_clips.size());
+}
+
+// Sort clips by position on the timeline
+void Timeline::sort_clips()
+{
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::SortClips", "clips.size()", clips.size());
+
+	// sort clips
+	clips.sort(CompareClips());
+}
+
+// Sort effects by position on the timeline
+void Timeline::sort_effects()
 {
 	// sort clips
 	effects.sort(CompareEffects());
@@ -691,6 +1488,9 @@ void Timeline::Close()
 {
 	ZmqLogger::Instance()->AppendDebugMethod("Timeline::Close");
 
+	// Stop rendering regions (before the clips are closed)
+	stop_region_render();
+
 	// Close all open clips
 	std::list<Clip*>::iterator clip_itr;
 	for (clip_itr=clips.begin(); clip_itr != clips.end(); ++clip_itr)
@@ -702,17 +1502,33 @@ void Timeline::Close()
 		update_open_clips(clip, false);
 	}
 
+	// Clear the rendered regions (the timeline might change before it is opened again)
+	clear_region_cache();
+
 	// Mark timeline as closed
 	is_open = false;
 
 	// Clear cache
 	final_cache->Clear();
+	audio_cache.Clear();
+	clear_size_caches();
 }
 
 // Open the reader (and start consuming resources)
 void Timeline::Open()
 {
+	// The frame rate might have been changed since the clips were added
+	clip_intervals_dirty = true;
+	effect_intervals_dirty = true;
+
 	is_open = true;
+
+	// The GPU context is created on the GUI thread (see GpuCompositor::Initialize)
+	if (Settings::Instance()->GPU_COMPOSITING)
+		GpuCompositor::Instance()->Initialize();
+
+	// Render the regions in the background (if any)
+	start_region_render();
 }
 
 // Compare 2 floating point numbers for equality
@@ -721,17 +1537,87 @@ bool Timeline::isEqual(double a, double b)
 	return fabs(a - b) < 0.000001;
 }
 
+// Get the time of the steady clock (in milliseconds)
+static int64_t steady_milliseconds()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 // Get an openshot::Frame object for a specific frame number of this reader.
 std::shared_ptr<Frame> Timeline::GetFrame(int64_t requested_frame)
 {
+	// The regions are only rendered while no frames are requested
+	last_request_ms = steady_milliseconds();
+
+	return get_frame(requested_frame, false, 0, 0);
+}
+
+// Get an openshot::Frame object, rendered at the size it will be drawn at (i.e. by the clip of a nested timeline)
+std::shared_ptr<Frame> Timeline::GetFrame(int64_t requested_frame, int width, int height)
+{
+	last_request_ms = steady_milliseconds();
+
+	return get_frame(requested_frame, false, width, height);
+}
+
+// Get a range of consecutive frames (rendered in batches of a frame per worker thread)
+std::vector<std::shared_ptr<Frame> > Timeline::GetFrames(int64_t start, int64_t count)
+{
+	last_request_ms = steady_milliseconds();
+
+	std::vector<std::shared_ptr<Frame> > frames;
+	int batch_size = std::max(1, TaskPool::ForNode(numa_node)->NumThreads());
+	QSize canvas = canvas_size(0, 0);
+	int64_t number = start;
+	while (number < start + count) {
+		// Frames before the 1st frame are the 1st frame
+		if (number < 1) {
+			frames.push_back(GetFrame(number++));
+			continue;
+		}
+
+		// Render a batch (the requests are tracked in order, so a GetFrame() after the range continues the sequence)
+		int64_t batch_end = std::min(start + count, number + batch_size);
+		#pragma omp critical (T_GetFrame)
+		for (int64_t frame_number = number; frame_number < batch_end; frame_number++)
+			update_access_pattern(frame_number);
+		frames.push_back(get_frame(number, false, 0, 0, batch_end - number));
+
+		// The other frames of the batch are cached (unless a frame was skipped, or evicted)
+		for (int64_t frame_number = number + 1; frame_number < batch_end; frame_number++) {
+			std::shared_ptr<Frame> frame = get_cached_frame(frame_number, canvas);
+			if (!frame)
+				frame = get_frame(frame_number, false, 0, 0);
+			frames.push_back(frame);
+		}
+		number = batch_end;
+	}
+	return frames;
+}
+
+// Get an openshot::Frame object (the body of GetFrame, which is also used by the region render thread)
+std::shared_ptr<Frame> Timeline::get_frame(int64_t requested_frame, bool is_region_render, int width, int height, int batch_size)
+{
+	TraceSpan trace_span("Timeline::GetFrame", "timeline", requested_frame);
+	static MemoryGauge& timeline_memory = Metrics::Instance()->GetMemory("images.timeline");
+	ScopedMemoryTag memory_tag(timeline_memory);
+
 	// Adjust out of bounds frame number
 	if (requested_frame < 1)
 		requested_frame = 1;
 
-	// Check cache
+	// Remove the frames changed by the edits of nested timelines (if any)
+	check_nested_edits();
+
+	// Check cache (and track the order frames are requested in). A frame rendered smaller (for a nested timeline
+	// which is drawn smaller) is rendered again.
 	std::shared_ptr<Frame> frame;
-	#pragma omp critical (T_GetFrame)
-	frame = final_cache->GetFrame(requested_frame);
+	if (!is_region_render && batch_size <= 0) {
+		#pragma omp critical (T_GetFrame)
+		update_access_pattern(requested_frame);
+	}
+	QSize canvas = canvas_size(width, height);
+	frame = get_cached_frame(requested_frame, canvas);
 	if (frame) {
 		// Debug output
 		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Cached frame found)", "requested_frame", requested_frame);
@@ -741,6 +1627,34 @@ std::shared_ptr<Frame> Timeline::GetFrame(int64_t requested_frame)
 	}
 	else
 	{
+		// Check the rendered frames of the regions (see AddRenderRegion)
+		if (!is_region_render && region_cache) {
+			bool is_rendered = false;
+			{
+				std::lock_guard<std::mutex> region_lock(region_mutex);
+				is_rendered = region_frames.count(requested_frame) > 0;
+			}
+			if (is_rendered)
+				frame = region_cache->GetFrame(requested_frame);
+			if (frame) {
+				// Debug output
+				ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Rendered region frame found)", "requested_frame", requested_frame);
+
+				// Keep it in the final cache too (the region cache might be on disk)
+				add_final_frame(frame);
+				return frame;
+			}
+		}
+
+		// Measure the render time (including the wait for the lock)
+		ScopedTimer render_timer(render_times);
+
+		// Render on the workers of this timeline's NUMA node (if any)
+		ScopedTaskPool task_pool(TaskPool::ForNode(numa_node));
+
+		// Take turns with the other timelines of this process (see Settings::MAX_CONCURRENT_RENDERS)
+		ScopedRenderSlot render_slot;
+
 		// Create a scoped lock, allowing only a single thread to run the following code at one time
 		const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
 
@@ -749,8 +1663,7 @@ std::shared_ptr<Frame> Timeline::GetFrame(int64_t requested_frame)
 			throw ReaderClosed("The Timeline is closed.  Call Open() before calling this method.");
 
 		// Check cache again (due to locking)
-		#pragma omp critical (T_GetFrame)
-		frame = final_cache->GetFrame(requested_frame);
+		frame = get_cached_frame(requested_frame, canvas);
 		if (frame) {
 			// Debug output
 			ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Cached frame found on 2nd look)", "requested_frame", requested_frame);
@@ -759,208 +1672,1164 @@ std::shared_ptr<Frame> Timeline::GetFrame(int64_t requested_frame)
 			return frame;
 		}
 
+		// Render the frames at the requested size (or the size of this timeline), which the readers decode at
+		canvas_width = canvas.isEmpty() ? render_width.load() : canvas.width();
+		canvas_height = canvas.isEmpty() ? render_height.load() : canvas.height();
+		RenderContext context;
+		context.max_width = canvas_width;
+		context.max_height = canvas_height;
+		context.high_quality_scaling = Settings::Instance()->HIGH_QUALITY_SCALING;
+		context.decode_speed = std::max(decode_speed.load(), RenderContext::Current().decode_speed);
+		ScopedRenderContext render_context(context);
+
 		// Minimum number of frames to process (for performance reasons)
-		int minimum_frames = OPEN_MP_NUM_PROCESSORS;
+		int minimum_frames = 0;
+		AccessPatternType batch_pattern = ACCESS_RANDOM;
+		#pragma omp critical (T_GetFrame)
+		{
+			minimum_frames = calculate_batch_size();
+			batch_pattern = access_pattern;
+			last_batch_size = minimum_frames;
+		}
+		if (batch_size > 0) {
+			// A range of frames (see GetFrames)
+			minimum_frames = batch_size;
+			batch_pattern = ACCESS_SEQUENTIAL;
+		}
+
+		// Reverse access renders the frames leading up to the requested frame
+		int64_t batch_start = requested_frame;
+		if (batch_pattern == ACCESS_REVERSE) {
+			batch_start = std::max(int64_t(1), requested_frame - minimum_frames + 1);
+			minimum_frames = requested_frame - batch_start + 1;
+		}
+
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Batch size)", "requested_frame", requested_frame, "access_pattern", batch_pattern, "batch_start", batch_start, "minimum_frames", minimum_frames);
 
 		// Get a list of clips that intersect with the requested section of timeline
 		// This also opens the readers for intersecting clips, and marks non-intersecting clips as 'needs closing'
 		std::vector<Clip*> nearby_clips;
 		#pragma omp critical (T_GetFrame)
-		nearby_clips = find_intersecting_clips(requested_frame, minimum_frames, true);
+		nearby_clips = find_intersecting_clips(batch_start, minimum_frames, true);
+
+		// Calculate which clips need to be composited on each frame (only once for the entire batch)
+		std::vector<FramePlan> render_plan = build_render_plan(nearby_clips, batch_start, minimum_frames);
+
+		// Batched effects (see EffectBase::GetFrames) need the effects of the whole batch applied together
+		bool batched_rendering = false;
+		for (EffectBase *effect : effects)
+			batched_rendering |= effect->IsBatched();
 
-		omp_set_num_threads(OPEN_MP_NUM_PROCESSORS);
-		// Allow nested OpenMP sections
-		omp_set_nested(true);
+		// Reuse the frames rendered from the same inputs (in any session), and only render the others
+		std::vector<std::shared_ptr<Frame> > reused_frames;
+		if (render_cache)
+			reuse_rendered_frames(render_plan, reused_frames, !batched_rendering);
+
+		// Split each frame's compositing into bands, using the cores not already busy with other frames
+		int composite_bands = 1;
+		if (Settings::Instance()->TILE_COMPOSITING && !render_plan.empty())
+			composite_bands = std::max(1, TaskPool::Current()->NumThreads() / (int) render_plan.size());
 
 		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame", "requested_frame", requested_frame, "minimum_frames", minimum_frames, "OPEN_MP_NUM_PROCESSORS", OPEN_MP_NUM_PROCESSORS);
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame", "requested_frame", requested_frame, "minimum_frames", minimum_frames, "TaskPool::Current()->NumThreads()", TaskPool::Current()->NumThreads());
 
 		// GENERATE CACHE FOR CLIPS (IN FRAME # SEQUENCE)
-		// Determine all clip frames, and request them in order (to keep resampled audio in sequence)
-		for (int64_t frame_number = requested_frame; frame_number < requested_frame + minimum_frames; frame_number++)
+		// Determine all clip frames, and request them in order (to keep resampled audio in sequence).
+		// The render pipeline (and the graph, and batched rendering) decodes clip frames in sequence itself.
+		for (int plan_index = 0; !pipeline_rendering && !graph_rendering && !batched_rendering && plan_index < render_plan.size(); plan_index++)
 		{
+			// Stop reading ahead when an edit (or a visible frame) is waiting
+			FramePlan& frame_plan = render_plan[plan_index];
+			if (skip_read_ahead() && frame_plan.frame_number > requested_frame)
+				break;
+
 			// Loop through clips
-			for (int clip_index = 0; clip_index < nearby_clips.size(); clip_index++)
+			for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
+				// Cache clip object
+				frame_plan.layers[layer_index].clip->GetFrame(frame_plan.layers[layer_index].clip_frame_number, frame_plan.layers[layer_index].draw_width, frame_plan.layers[layer_index].draw_height);
+		}
+
+		// Render all requested frames (in parallel, on the shared task pool)
+		std::vector<std::shared_ptr<Frame> > new_frames(render_plan.size());
+		if (batched_rendering)
+			render_batched(render_plan, new_frames, composite_bands);
+		else if (graph_rendering)
+			render_graph(render_plan, new_frames, composite_bands, requested_frame);
+		else if (pipeline_rendering)
+			render_pipeline(render_plan, new_frames, composite_bands, requested_frame);
+		else
+			TaskPool::Current()->ParallelFor(0, render_plan.size(), [&](int64_t plan_index)
 			{
-				// Get clip object from the iterator
-				Clip *clip = nearby_clips[clip_index];
-                long clip_start_position = round(clip->Position() * info.fps.ToDouble()) + 1;
-                long clip_end_position = round((clip->Position() + clip->Duration()) * info.fps.ToDouble()) + 1;
+				// Skip the read-ahead frames which have not started when an edit (or a visible frame) is waiting
+				if (skip_read_ahead() && render_plan[plan_index].frame_number > requested_frame)
+					return;
+				new_frames[plan_index] = render_frame(render_plan[plan_index], std::vector<std::shared_ptr<Frame> >(), composite_bands);
+			});
+
+		// Add final frames to cache (in order)
+		for (int plan_index = 0; plan_index < new_frames.size(); plan_index++)
+		{
+			// Skipped frame (see skip_read_ahead)
+			if (!new_frames[plan_index])
+				continue;
 
-				bool does_clip_intersect = (clip_start_position <= frame_number && clip_end_position >= frame_number);
-				if (does_clip_intersect)
-				{
-					// Get clip frame #
-                    long clip_start_frame = (clip->Start() * info.fps.ToDouble()) + 1;
-					long clip_frame_number = frame_number - clip_start_position + clip_start_frame;
-					// Cache clip object
-					clip->GetFrame(clip_frame_number);
-				}
+			// Set frame # on mapped frame
+			new_frames[plan_index]->SetFrameNumber(render_plan[plan_index].frame_number);
+
+			// Add final frame to cache (and keep it for the other sessions)
+			add_final_frame(new_frames[plan_index]);
+			if (render_cache && !render_plan[plan_index].render_key.empty())
+				render_cache->AddKeyed(render_plan[plan_index].render_key, new_frames[plan_index]);
+		}
+		for (size_t reused_index = 0; reused_index < reused_frames.size(); reused_index++)
+			add_final_frame(reused_frames[reused_index]);
+
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (end parallel region)", "requested_frame", requested_frame, "new_frames.size()", new_frames.size());
+
+		// Return frame (or blank frame)
+		return final_cache->GetFrame(requested_frame);
+	}
+}
+
+// Get an openshot::Frame object for a specific frame number of this reader (for its audio only)
+std::shared_ptr<Frame> Timeline::GetAudioFrame(int64_t requested_frame)
+{
+	// Adjust out of bounds frame number
+	if (requested_frame < 1)
+		requested_frame = 1;
+
+	// Remove the frames changed by the edits of nested timelines (if any)
+	check_nested_edits();
+
+	// A rendered frame already contains the mixed audio
+	// (audio requests are not tracked, so they don't change the batching of rendered frames)
+	std::shared_ptr<Frame> frame = final_cache->GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// The audio mixed before (and not changed since, even if the images were)
+	frame = audio_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+
+	// Another thread may have mixed the frame while this thread waited
+	frame = audio_cache.GetFrame(requested_frame);
+	if (frame)
+		return frame;
+
+	// Check for open reader (or throw exception)
+	if (!is_open)
+		throw ReaderClosed("The Timeline is closed.  Call Open() before calling this method.");
+
+	// Get a list of clips that intersect with the requested frame (and the clips to mix)
+	std::vector<Clip*> nearby_clips;
+	#pragma omp critical (T_GetFrame)
+	nearby_clips = find_intersecting_clips(requested_frame, 1, true);
+	std::vector<FramePlan> render_plan = build_render_plan(nearby_clips, requested_frame, 1);
+	const FramePlan& frame_plan = render_plan.front();
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetAudioFrame", "requested_frame", requested_frame, "frame_plan.layers.size()", frame_plan.layers.size());
+
+	// Create a frame of silence (with a blank image)
+	int samples_in_frame = Frame::GetSamplesPerFrame(requested_frame, info.fps, info.sample_rate, info.channels);
+	std::shared_ptr<Frame> new_frame(std::make_shared<Frame>(requested_frame, 1, 1, "#000000", samples_in_frame, info.channels));
+	new_frame->AddAudioSilence(samples_in_frame);
+	new_frame->SampleRate(info.sample_rate);
+	new_frame->ChannelsLayout(info.channel_layout);
+
+	// Mix the audio of each clip (in layer order, the same as a rendered frame)
+	std::vector<std::vector<AudioMixSource> > channel_sources;
+	std::vector<std::shared_ptr<Frame> > mixed_frames;
+	for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
+	{
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		std::shared_ptr<Frame> source_frame = GetOrCreateFrame(layer.clip, layer.clip_frame_number, 0, 0, true);
+		add_layer_audio(channel_sources, new_frame, source_frame, layer.clip, layer.properties, layer.clip_frame_number, requested_frame, frame_plan.max_volume);
+		mixed_frames.push_back(source_frame);
+	}
+	mix_layer_audio(new_frame, channel_sources);
+	audio_cache.Add(new_frame);
+
+	return new_frame;
+}
+
+// Render a single timeline frame (composite all clips in the frame's plan)
+std::shared_ptr<Frame> Timeline::render_frame(const FramePlan& frame_plan, const std::vector<std::shared_ptr<Frame> >& source_frames, int composite_bands)
+{
+	int64_t frame_number = frame_plan.frame_number;
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_frame", "frame_number", frame_number, "source_frames.size()", source_frames.size());
+
+	// Init some basic properties about this frame
+	int samples_in_frame = Frame::GetSamplesPerFrame(frame_number, info.fps, info.sample_rate, info.channels);
+
+	// Create blank frame (which will become the requested frame)
+	std::shared_ptr<Frame> new_frame(std::make_shared<Frame>(frame_number, max_width(), max_height(), "#000000", samples_in_frame, info.channels));
+	new_frame->AddAudioSilence(samples_in_frame);
+	new_frame->SampleRate(info.sample_rate);
+	new_frame->ChannelsLayout(info.channel_layout);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_frame (Adding solid color)", "frame_number", frame_number, "info.width", info.width, "info.height", info.height);
+
+	// Add Background Color to 1st layer (if animated or not black)
+	bool has_background = (color.red.GetCount() > 1 || color.green.GetCount() > 1 || color.blue.GetCount() > 1) ||
+		(color.red.GetValue(frame_number) != 0.0 || color.green.GetValue(frame_number) != 0.0 || color.blue.GetValue(frame_number) != 0.0);
+	if (has_background) {
+		// The background is opaque (its alpha curve is ignored)
+		QRgb background = color.GetRGBA(frame_number);
+		new_frame->AddColor(max_width(), max_height(), qRgb(qRed(background), qGreen(background), qBlue(background)));
+	}
+
+	// A single opaque, full frame clip on a black background can pass its image straight through
+	bool pass_through = !has_background && frame_plan.layers.size() == 1 && !frame_plan.layers[0].is_hidden &&
+						frame_plan.layers[0].clip->display == FRAME_DISPLAY_NONE &&
+						is_opaque_full_frame(frame_plan.layers[0].clip, frame_plan.layers[0].properties, frame_number);
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_frame (Loop through clips)", "frame_number", frame_number, "clips.size()", clips.size(), "frame_plan.layers.size()", frame_plan.layers.size());
+
+	// With YUV compositing, the clips' frames are fetched first, since their planes are only composited if every
+	// layer can be (otherwise they are composited as images below)
+	QRgb background = has_background ? color.GetRGBA(frame_number) : 0;
+	std::vector<std::shared_ptr<Frame> > layer_frames(source_frames);
+	if (Settings::Instance()->YUV_COMPOSITING && !pass_through) {
+		for (int layer_index = layer_frames.size(); layer_index < frame_plan.layers.size(); layer_index++) {
+			const LayerPlan& layer = frame_plan.layers[layer_index];
+			layer_frames.push_back(apply_layer_effects(GetOrCreateFrame(layer.clip, layer.clip_frame_number, layer.draw_width, layer.draw_height, false), layer.clip, layer.properties, layer.clip_frame_number, frame_number, layer.is_top_clip));
+		}
+
+		if (composite_planes(new_frame, frame_plan, layer_frames, QColor(qRed(background), qGreen(background), qBlue(background)), composite_bands)) {
+			std::vector<std::vector<AudioMixSource> > channel_sources;
+			for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+				const LayerPlan& layer = frame_plan.layers[layer_index];
+				add_layer_audio(channel_sources, new_frame, layer_frames[layer_index], layer.clip, layer.properties, layer.clip_frame_number, frame_number, frame_plan.max_volume);
 			}
+			mix_layer_audio(new_frame, channel_sources);
+			return new_frame;
 		}
+	}
 
-		#pragma omp parallel
+	// With GPU compositing, the clips' frames are fetched first too (with their point-wise effects as GPU kernels)
+	if (Settings::Instance()->GPU_COMPOSITING && !pass_through && GpuCompositor::Instance()->IsAvailable()) {
+		if (composite_gpu(new_frame, frame_plan, layer_frames, QColor(qRed(background), qGreen(background), qBlue(background)))) {
+			std::vector<std::vector<AudioMixSource> > channel_sources;
+			for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+				const LayerPlan& layer = frame_plan.layers[layer_index];
+				add_layer_audio(channel_sources, new_frame, layer_frames[layer_index], layer.clip, layer.properties, layer.clip_frame_number, frame_number, frame_plan.max_volume);
+			}
+			mix_layer_audio(new_frame, channel_sources);
+			return new_frame;
+		}
+	}
+
+	// The static layers at the bottom (still images, without effects or animation) are only composited when they
+	// change. The other frames start from their composite (sharing its pixels, until the upper layers are drawn).
+	int static_layers = pass_through ? 0 : count_static_layers(frame_plan);
+	int first_layer = 0;
+	if (static_layers > 0) {
+		std::shared_ptr<QImage> static_image;
 		{
-			// Loop through all requested frames
-			#pragma omp for ordered firstprivate(nearby_clips, requested_frame, minimum_frames) schedule(static,1)
-			for (int64_t frame_number = requested_frame; frame_number < requested_frame + minimum_frames; frame_number++)
+			std::lock_guard<std::mutex> static_lock(static_mutex);
+			if (is_same_static_composite(frame_plan, static_layers, has_background, background))
+				static_image = static_composite.image;
+		}
+		if (static_image) {
+			new_frame->AddImage(std::make_shared<QImage>(*static_image));
+			first_layer = static_layers;
+			static_layer_hits.Increment();
+		}
+	}
+
+	// The audio of each layer is mixed into the timeline frame after the loop (all layers of a channel in a single pass)
+	std::vector<std::vector<AudioMixSource> > channel_sources;
+	std::vector<std::shared_ptr<Frame> > mixed_frames;
+
+	// Composite the planned clips (lowest layer to top layer). The static layers have no audio.
+	for (int layer_index = first_layer; layer_index < frame_plan.layers.size(); layer_index++)
+	{
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+
+		// Debug output
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_frame (Calculate clip's frame #)", "clip->Position()", layer.clip->Position(), "clip->Start()", layer.clip->Start(), "info.fps.ToFloat()", info.fps.ToFloat(), "clip_frame_number", layer.clip_frame_number);
+
+		// Get the clip's frame (and apply effects), unless already done by the render pipeline
+		std::shared_ptr<Frame> source_frame;
+		if (layer_index < layer_frames.size())
+			source_frame = layer_frames[layer_index];
+		else
+			source_frame = apply_layer_effects(GetOrCreateFrame(layer.clip, layer.clip_frame_number, layer.draw_width, layer.draw_height, false), layer.clip, layer.properties, layer.clip_frame_number, frame_number, layer.is_top_clip);
+
+		// Add the clip's audio to the mix (and keep the clip's frame, until its samples are mixed)
+		add_layer_audio(channel_sources, new_frame, source_frame, layer.clip, layer.properties, layer.clip_frame_number, frame_number, frame_plan.max_volume);
+		mixed_frames.push_back(source_frame);
+
+		// Pass-through (if the clip's image is already the size of the timeline frame)
+		if (pass_through && source_frame && source_frame->GetWidth() == max_width() &&
+			source_frame->GetHeight() == max_height()) {
+			// Debug output
+			ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_frame (Pass-through clip image)", "frame_number", frame_number, "clip_frame_number", layer.clip_frame_number);
+
+			// Share the clip's image data (copy-on-write) instead of compositing it
+			new_frame->ShareImage(source_frame);
+			continue;
+		}
+
+		// Add clip's frame as layer
+		add_layer(new_frame, source_frame, layer.clip, layer.properties, layer.clip_frame_number, frame_number, composite_bands, layer.is_hidden);
+
+		// Keep the composite of the static layers (for the next frames)
+		if (layer_index + 1 == static_layers)
+			keep_static_composite(frame_plan, static_layers, has_background, background, new_frame->GetImage());
+
+	} // end clip loop
+
+	// Mix the audio of all layers
+	mix_layer_audio(new_frame, channel_sources);
+
+	return new_frame;
+}
+
+// Render frames with overlapping stages (decode, effects, and composite)
+void Timeline::render_pipeline(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands, int64_t requested_frame)
+{
+	// Limit how far decoding can run ahead of compositing (bounded queue between stages)
+	int max_frames_in_flight = std::max(2, TaskPool::Current()->NumThreads());
+	int frames_in_flight = 0;
+	std::mutex flight_mutex;
+	std::condition_variable frame_done;
+	auto finish_frame = [&frames_in_flight, &flight_mutex, &frame_done]() {
+		std::lock_guard<std::mutex> lock(flight_mutex);
+		frames_in_flight--;
+		frame_done.notify_all();
+	};
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_pipeline", "render_plan.size()", render_plan.size(), "max_frames_in_flight", max_frames_in_flight, "composite_bands", composite_bands);
+
+	// The effect tasks submit the composite tasks, so the composite group is declared first (and destroyed last,
+	// which waits for any composite tasks still running when an exception leaves this function)
+	TaskGroup composite_tasks;
+	TaskGroup effect_tasks;
+	for (int plan_index = 0; plan_index < render_plan.size(); plan_index++)
+	{
+		const FramePlan& frame_plan = render_plan[plan_index];
+
+		// Stop decoding read-ahead frames when an edit (or a visible frame) is waiting
+		if (skip_read_ahead() && frame_plan.frame_number > requested_frame)
+			break;
+
+		// Wait for room in the pipeline (running the stages' tasks which haven't started, then sleeping until a
+		// frame finishes)
+		while (true) {
 			{
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (processing frame)", "frame_number", frame_number, "omp_get_thread_num()", omp_get_thread_num());
+				std::lock_guard<std::mutex> lock(flight_mutex);
+				if (frames_in_flight < max_frames_in_flight)
+					break;
+			}
+			if (composite_tasks.RunPendingTask() || effect_tasks.RunPendingTask())
+				continue;
+			std::unique_lock<std::mutex> lock(flight_mutex);
+			frame_done.wait(lock, [&frames_in_flight, max_frames_in_flight]() { return frames_in_flight < max_frames_in_flight; });
+		}
 
-				// Init some basic properties about this frame
-				int samples_in_frame = Frame::GetSamplesPerFrame(frame_number, info.fps, info.sample_rate, info.channels);
+		/* DECODE STAGE - on this thread, in frame # sequence (to keep resampled audio in sequence) */
+		std::vector<std::shared_ptr<Frame> > source_frames;
+		for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
+			source_frames.push_back(GetOrCreateFrame(frame_plan.layers[layer_index].clip, frame_plan.layers[layer_index].clip_frame_number, frame_plan.layers[layer_index].draw_width, frame_plan.layers[layer_index].draw_height, false));
+		{
+			std::lock_guard<std::mutex> lock(flight_mutex);
+			frames_in_flight++;
+		}
 
-				// Create blank frame (which will become the requested frame)
-				std::shared_ptr<Frame> new_frame(std::make_shared<Frame>(frame_number, Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, "#000000", samples_in_frame, info.channels));
-				#pragma omp critical (T_GetFrame)
-				{
-					new_frame->AddAudioSilence(samples_in_frame);
-					new_frame->SampleRate(info.sample_rate);
-					new_frame->ChannelsLayout(info.channel_layout);
+		/* EFFECTS STAGE */
+		effect_tasks.Run([this, &frame_plan, &new_frames, &finish_frame, &composite_tasks, plan_index, source_frames, composite_bands]() mutable
+		{
+			try {
+				for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+					const LayerPlan& layer = frame_plan.layers[layer_index];
+					source_frames[layer_index] = apply_layer_effects(std::move(source_frames[layer_index]), layer.clip, layer.properties, layer.clip_frame_number, frame_plan.frame_number, layer.is_top_clip);
 				}
+			}
+			catch (...) {
+				finish_frame();
+				throw;
+			}
 
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Adding solid color)", "frame_number", frame_number, "info.width", info.width, "info.height", info.height);
+			/* COMPOSITE STAGE */
+			composite_tasks.Run([this, &frame_plan, &new_frames, &finish_frame, plan_index, source_frames, composite_bands]()
+			{
+				try {
+					new_frames[plan_index] = render_frame(frame_plan, source_frames, composite_bands);
+				}
+				catch (...) {
+					finish_frame();
+					throw;
+				}
+				finish_frame();
+			});
+		});
+	}
 
-				// Add Background Color to 1st layer (if animated or not black)
-				if ((color.red.GetCount() > 1 || color.green.GetCount() > 1 || color.blue.GetCount() > 1) ||
-					(color.red.GetValue(frame_number) != 0.0 || color.green.GetValue(frame_number) != 0.0 || color.blue.GetValue(frame_number) != 0.0))
-				new_frame->AddColor(Settings::Instance()->MAX_WIDTH, Settings::Instance()->MAX_HEIGHT, color.GetColorHex(frame_number));
+	// Wait for the last frames to finish all stages
+	effect_tasks.Wait();
+	composite_tasks.Wait();
+}
 
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Loop through clips)", "frame_number", frame_number, "clips.size()", clips.size(), "nearby_clips.size()", nearby_clips.size());
+// Render frames as a graph of decode, map, effect, and composite nodes
+void Timeline::render_graph(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands, int64_t requested_frame)
+{
+	RenderGraph graph;
+
+	// The frame of each decode and map node (by node index). The graph is built before any node runs, and has at
+	// most a decode, map, and effect node per layer, and a composite node per frame.
+	size_t max_nodes = render_plan.size();
+	for (const FramePlan& frame_plan : render_plan)
+		max_nodes += 3 * frame_plan.layers.size();
+	std::vector<std::shared_ptr<Frame> > node_frames(max_nodes);
+	std::vector<std::vector<std::shared_ptr<Frame> > > layer_frames(render_plan.size());
+
+	// The last decode node of each reader, and the last map node of each clip. Each reader decodes its frames in
+	// sequence, and each clip maps its frames in sequence (to keep resampled audio, and audio effects, in sequence).
+	std::map<ReaderBase*, size_t> last_decode;
+	std::map<Clip*, size_t> last_map;
+
+	for (int plan_index = 0; plan_index < render_plan.size(); plan_index++)
+	{
+		const FramePlan& frame_plan = render_plan[plan_index];
 
-				// Find Clips near this time
-				for (int clip_index = 0; clip_index < nearby_clips.size(); clip_index++)
+		// Don't add the read-ahead frames when an edit (or a visible frame) is waiting
+		if (skip_read_ahead() && frame_plan.frame_number > requested_frame)
+			break;
+
+		bool added = false;
+		layer_frames[plan_index].resize(frame_plan.layers.size());
+		std::vector<size_t> effect_nodes;
+		for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++)
+		{
+			const LayerPlan& layer = frame_plan.layers[layer_index];
+			ReaderBase *reader = layer.clip->Reader();
+
+			/* DECODE NODE - shared by the clip frames mapped from the same reader frame (i.e. a slowed down clip, or
+			 * clips of the same reader). Its frame is held until the batch is rendered. */
+			size_t decode_node = 0;
+			bool has_decode_node = false;
+			if (reader) {
+				int64_t reader_frame_number = layer.clip->MappedFrameNumber(layer.clip_frame_number);
+				std::stringstream decode_key;
+				decode_key << "decode " << reader << " " << reader_frame_number << " " << layer.draw_width << "x" << layer.draw_height;
+				size_t next_node = graph.NumNodes();
+				decode_node = graph.AddNode(RENDER_NODE_DECODE, decode_key.str(), [&layer, &node_frames, reader, reader_frame_number, next_node]()
 				{
-					// Get clip object from the iterator
-					Clip *clip = nearby_clips[clip_index];
-                    long clip_start_position = round(clip->Position() * info.fps.ToDouble()) + 1;
-                    long clip_end_position = round((clip->Position() + clip->Duration()) * info.fps.ToDouble()) + 1;
-
-                    bool does_clip_intersect = (clip_start_position <= frame_number && clip_end_position >= frame_number);
-
-					// Debug output
-					ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Does clip intersect)", "frame_number", frame_number, "clip->Position()", clip->Position(), "clip->Duration()", clip->Duration(), "does_clip_intersect", does_clip_intersect);
-
-					// Clip is visible
-					if (does_clip_intersect)
-					{
-						// Determine if clip is "top" clip on this layer (only happens when multiple clips are overlapping)
-						bool is_top_clip = true;
-						float max_volume = 0.0;
-						for (int top_clip_index = 0; top_clip_index < nearby_clips.size(); top_clip_index++)
-						{
-							Clip *nearby_clip = nearby_clips[top_clip_index];
-                            long nearby_clip_start_position = round(nearby_clip->Position() * info.fps.ToDouble()) + 1;
-                            long nearby_clip_end_position = round((nearby_clip->Position() + nearby_clip->Duration()) * info.fps.ToDouble()) + 1;
-							long nearby_clip_start_frame = (nearby_clip->Start() * info.fps.ToDouble()) + 1;
-							long nearby_clip_frame_number = frame_number - nearby_clip_start_position + nearby_clip_start_frame;
-
-							// Determine if top clip
-							if (clip->Id() != nearby_clip->Id() && clip->Layer() == nearby_clip->Layer() &&
-                                    nearby_clip_start_position <= frame_number && nearby_clip_end_position >= frame_number &&
-                                    nearby_clip_start_position > clip_start_position && is_top_clip == true) {
-								is_top_clip = false;
-							}
-
-							// Determine max volume of overlapping clips
-							if (nearby_clip->Reader() && nearby_clip->Reader()->info.has_audio &&
-									nearby_clip->has_audio.GetInt(nearby_clip_frame_number) != 0 &&
-									nearby_clip_start_position <= frame_number && nearby_clip_end_position >= frame_number) {
-									max_volume += nearby_clip->volume.GetValue(nearby_clip_frame_number);
-							}
-						}
+					reader->TryGetFrame(reader_frame_number, node_frames[next_node], layer.draw_width, layer.draw_height);
+				}, added);
+				if (added) {
+					std::map<ReaderBase*, size_t>::iterator previous = last_decode.find(reader);
+					if (previous != last_decode.end())
+						graph.AddDependency(decode_node, previous->second);
+					last_decode[reader] = decode_node;
+				}
+				else
+					graph_shared_nodes.Increment();
+				has_decode_node = true;
+			}
+
+			/* MAP NODE - the clip's frame (its reader gets the decoded frame from its cache) */
+			std::stringstream map_key;
+			map_key << "map " << layer.clip << " " << layer.clip_frame_number << " " << layer.draw_width << "x" << layer.draw_height;
+			size_t next_node = graph.NumNodes();
+			size_t map_node = graph.AddNode(RENDER_NODE_MAP, map_key.str(), [this, &layer, &node_frames, next_node]()
+			{
+				node_frames[next_node] = GetOrCreateFrame(layer.clip, layer.clip_frame_number, layer.draw_width, layer.draw_height, false);
+			}, added);
+			if (added) {
+				if (has_decode_node)
+					graph.AddDependency(map_node, decode_node);
+				std::map<Clip*, size_t>::iterator previous = last_map.find(layer.clip);
+				if (previous != last_map.end())
+					graph.AddDependency(map_node, previous->second);
+				last_map[layer.clip] = map_node;
+			}
+
+			/* EFFECT NODE - the timeline effects depend on the timeline frame, so they are never shared */
+			size_t effect_node = graph.AddNode(RENDER_NODE_EFFECT, "", [this, &frame_plan, &layer, &node_frames, &layer_frames, map_node, plan_index, layer_index]()
+			{
+				layer_frames[plan_index][layer_index] = apply_layer_effects(node_frames[map_node], layer.clip, layer.properties, layer.clip_frame_number, frame_plan.frame_number, layer.is_top_clip);
+			}, added);
+			graph.AddDependency(effect_node, map_node);
+			effect_nodes.push_back(effect_node);
+		}
+
+		/* COMPOSITE NODE - once the effects of every layer are applied (the audio of the layers is mixed too) */
+		size_t composite_node = graph.AddNode(RENDER_NODE_COMPOSITE, "", [this, &frame_plan, &layer_frames, &new_frames, plan_index, composite_bands]()
+		{
+			new_frames[plan_index] = render_frame(frame_plan, layer_frames[plan_index], composite_bands);
+			layer_frames[plan_index].clear();
+		}, added);
+		for (size_t effect_node : effect_nodes)
+			graph.AddDependency(composite_node, effect_node);
+	}
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_graph", "render_plan.size()", render_plan.size(), "graph.NumNodes()", graph.NumNodes(), "graph.SharedNodes()", graph.SharedNodes(), "composite_bands", composite_bands);
+
+	// Run the nodes (the decode and map nodes of different clips, and the effects and composites of different frames, in parallel)
+	graph.Run();
+}
+
+// Render frames, giving each batched effect the frames of the whole batch at once
+void Timeline::render_batched(const std::vector<FramePlan>& render_plan, std::vector<std::shared_ptr<Frame> >& new_frames, int composite_bands)
+{
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::render_batched", "render_plan.size()", render_plan.size(), "composite_bands", composite_bands);
+
+	// Decode the clip frames (in frame # sequence, to keep resampled audio in sequence)
+	std::vector<std::vector<std::shared_ptr<Frame> > > source_frames(render_plan.size());
+	for (int plan_index = 0; plan_index < render_plan.size(); plan_index++)
+		for (const LayerPlan& layer : render_plan[plan_index].layers)
+			source_frames[plan_index].push_back(GetOrCreateFrame(layer.clip, layer.clip_frame_number, layer.draw_width, layer.draw_height, false));
+
+	// The batched effects split the effects into stages
+	std::vector<EffectBase*> effect_list(effects.begin(), effects.end());
+	int first_effect = 0;
+	while (true)
+	{
+		int last_effect = -1;
+		for (int effect_index = first_effect; effect_index < effect_list.size() && last_effect < 0; effect_index++)
+			if (effect_list[effect_index]->IsBatched())
+				last_effect = effect_index;
+
+		// Apply the effects before the batched effect to each frame (in parallel)
+		TaskPool::Current()->ParallelFor(0, render_plan.size(), [&](int64_t plan_index)
+		{
+			const FramePlan& frame_plan = render_plan[plan_index];
+			for (int layer_index = 0; layer_index < frame_plan.layers.size(); layer_index++) {
+				const LayerPlan& layer = frame_plan.layers[layer_index];
+				source_frames[plan_index][layer_index] = apply_layer_effects(std::move(source_frames[plan_index][layer_index]), layer.clip, layer.properties, layer.clip_frame_number, frame_plan.frame_number, layer.is_top_clip, first_effect, last_effect);
+			}
+		});
+		if (last_effect < 0)
+			break;
+
+		// Apply the batched effect to each run of consecutive frames it is on (the top clip of its layer)
+		EffectBase *effect = effect_list[last_effect];
+		std::vector<std::shared_ptr<Frame> > run;
+		std::vector<std::pair<int, int> > run_indexes;
+		int64_t run_first_frame_number = 0;
+		for (int plan_index = 0; plan_index <= render_plan.size(); plan_index++)
+		{
+			// Find the top clip's frame on the effect's layer
+			int64_t effect_frame_number = 0;
+			int top_layer_index = -1;
+			if (plan_index < render_plan.size() && get_effect_frame_number(effect, render_plan[plan_index].frame_number, effect->Layer(), effect_frame_number))
+				for (int layer_index = 0; layer_index < render_plan[plan_index].layers.size(); layer_index++) {
+					const LayerPlan& layer = render_plan[plan_index].layers[layer_index];
+					if (layer.is_top_clip && layer.clip->Layer() == effect->Layer() && source_frames[plan_index][layer_index])
+						top_layer_index = layer_index;
+				}
+
+			// Extend the run (or apply the effect to the finished run)
+			if (top_layer_index >= 0 && (run.empty() || effect_frame_number == run_first_frame_number + (int64_t) run.size())) {
+				if (run.empty())
+					run_first_frame_number = effect_frame_number;
+				std::shared_ptr<Frame> frame = source_frames[plan_index][top_layer_index];
+				frame->ConvertImage(QImage::Format_RGBA8888);
+				run.push_back(frame);
+				run_indexes.push_back(std::make_pair(plan_index, top_layer_index));
+				continue;
+			}
+			if (!run.empty()) {
+				effect->ProcessFrames(run, run_first_frame_number);
+				for (int run_index = 0; run_index < run.size(); run_index++)
+					source_frames[run_indexes[run_index].first][run_indexes[run_index].second] = run[run_index];
+				run.clear();
+				run_indexes.clear();
+				plan_index--; // start a new run at this frame
+			}
+		}
+
+		first_effect = last_effect + 1;
+	}
+
+	// Composite the frames (in parallel)
+	TaskPool::Current()->ParallelFor(0, render_plan.size(), [&](int64_t plan_index)
+	{
+		new_frames[plan_index] = render_frame(render_plan[plan_index], source_frames[plan_index], composite_bands);
+	});
+}
+
+// Determine the size a clip's image is drawn at, if it is only scaled (and moved)
+bool Timeline::get_layer_draw_size(Clip* clip, const ClipProperties& properties, int64_t timeline_frame_number, int& width, int& height)
+{
+	width = 0;
+	height = 0;
+
+	ReaderBase *reader = clip->Reader();
+	if (!reader || !reader->info.has_video || clip->Waveform() || reader->info.width <= 0 || reader->info.height <= 0)
+		return false;
+
+	// Clip effects and timeline effects (on this layer) can depend on the size of the image
+	if (!clip->Effects().empty())
+		return false;
+	if (!find_layer_effects(timeline_frame_number, clip->Layer()).empty())
+		return false;
+
+	// Clip must not be rotated, sheared, or cropped
+	if (!isEqual(properties.rotation, 0.0) ||
+		!isEqual(properties.shear_x, 0.0) || !isEqual(properties.shear_y, 0.0) ||
+		clip->crop_gravity != GRAVITY_TOP_LEFT ||
+		!isEqual(properties.crop_x, 0.0) || !isEqual(properties.crop_y, 0.0) ||
+		!isEqual(properties.crop_width, 1.0) || !isEqual(properties.crop_height, 1.0))
+		return false;
+
+	// Size of the image on the timeline frame (the same as add_layer)
+	QSize draw_size(reader->info.width, reader->info.height);
+	switch (clip->scale)
+	{
+		case (SCALE_FIT):
+			draw_size.scale(max_width(), max_height(), Qt::KeepAspectRatio);
+			break;
+		case (SCALE_STRETCH):
+			draw_size.scale(max_width(), max_height(), Qt::IgnoreAspectRatio);
+			break;
+		default:
+			return false;
+	}
+	width = round(draw_size.width() * properties.scale_x);
+	height = round(draw_size.height() * properties.scale_y);
+
+	// Only smaller images are worth decoding at a different size
+	if (width <= 0 || height <= 0 || width >= reader->info.width || height >= reader->info.height) {
+		width = 0;
+		height = 0;
+		return false;
+	}
+	return true;
+}
+
+namespace {
+	// Get the bounding rectangle of the pixels of a premultiplied image which are not 0 (the Pixel type holds a whole pixel)
+	template<typename Pixel>
+	QRect find_visible_rect(const QImage &image) {
+		// Find the first and last rows with a visible pixel, and then the first and last columns (an opaque
+		// image stops at its first pixels)
+		int width = image.width();
+		int height = image.height();
+		auto is_transparent_row = [&](int row) {
+			const Pixel *pixels = (const Pixel*) image.constScanLine(row);
+			for (int column = 0; column < width; column++)
+				if (pixels[column])
+					return false;
+			return true;
+		};
+		int top = 0;
+		while (top < height && is_transparent_row(top))
+			top++;
+		QRect rect;
+		if (top < height) {
+			int bottom = height - 1;
+			while (bottom > top && is_transparent_row(bottom))
+				bottom--;
+			int left = width;
+			int right = -1;
+			for (int row = top; row <= bottom; row++) {
+				const Pixel *pixels = (const Pixel*) image.constScanLine(row);
+				for (int column = 0; column < left; column++)
+					if (pixels[column]) {
+						left = column;
+						break;
+					}
+				for (int column = width - 1; column > right; column--)
+					if (pixels[column]) {
+						right = column;
+						break;
+					}
+			}
+			rect = QRect(QPoint(left, top), QPoint(right, bottom));
+		}
+		return rect;
+	}
+}
+
+// Get the bounding rectangle of the pixels of an image which are not transparent
+QRect Timeline::visible_rect(const std::shared_ptr<QImage>& image)
+{
+	// A transparent premultiplied pixel is 0 (in any byte order)
+	QImage::Format format = image->format();
+	if (!IsPixelFormat(format) || StraightPixelFormat(format) == format)
+		return image->rect();
+
+	// The same images are composited on many frames (i.e. still images)
+	qint64 key = image->cacheKey();
+	{
+		std::lock_guard<std::mutex> lock(visible_rects_mutex);
+		std::map<qint64, QRect>::iterator itr = visible_rects.find(key);
+		if (itr != visible_rects.end())
+			return itr->second;
+	}
+
+	QRect rect = (image->depth() == 64) ? find_visible_rect<uint64_t>(*image) : find_visible_rect<uint32_t>(*image);
+
+	std::lock_guard<std::mutex> lock(visible_rects_mutex);
+	if (visible_rects.size() >= 256)
+		visible_rects.clear();
+	visible_rects[key] = rect;
+	return rect;
+}
+
+// Determine if a layer is a static layer (a still image with constant keyframes, and no effects)
+bool Timeline::is_static_layer(const LayerPlan& layer, int64_t timeline_frame_number)
+{
+	Clip *clip = layer.clip;
+	ReaderBase *reader = clip->Reader();
+	if (!reader || !reader->info.has_single_image || reader->info.has_audio || clip->Waveform() ||
+		clip->display != FRAME_DISPLAY_NONE || !clip->Effects().empty())
+		return false;
+
+	// The keyframes of the image must not be animated
+	const Keyframe* keyframes[] = { &clip->alpha, &clip->scale_x, &clip->scale_y, &clip->location_x, &clip->location_y,
+									&clip->rotation, &clip->shear_x, &clip->shear_y, &clip->crop_x, &clip->crop_y,
+									&clip->crop_width, &clip->crop_height, &clip->has_video };
+	for (const Keyframe* keyframe : keyframes)
+		if (keyframe->GetCount() > 1)
+			return false;
+
+	// Timeline effects on this layer change the image
+	return find_layer_effects(timeline_frame_number, clip->Layer()).empty();
+}
+
+// Count the static layers at the bottom of a frame
+int Timeline::count_static_layers(const FramePlan& frame_plan)
+{
+	int static_layers = 0;
+	for (const LayerPlan& layer : frame_plan.layers) {
+		if (layer.is_hidden || !is_static_layer(layer, frame_plan.frame_number))
+			break;
+		static_layers++;
+	}
+	return static_layers;
+}
+
+// Determine if the static composite has the static layers (and background) of a frame
+bool Timeline::is_same_static_composite(const FramePlan& frame_plan, int static_layers, bool has_background, QRgb background)
+{
+	const StaticComposite& composite = static_composite;
+	if (!composite.image || composite.image->width() != max_width() || composite.image->height() != max_height() ||
+		composite.has_background != has_background || composite.background != background ||
+		composite.layers.size() != static_layers)
+		return false;
+
+	for (int layer_index = 0; layer_index < static_layers; layer_index++) {
+		const LayerPlan& layer = frame_plan.layers[layer_index];
+		const LayerPlan& cached = composite.layers[layer_index];
+		const ClipProperties& a = layer.properties;
+		const ClipProperties& b = cached.properties;
+		if (layer.clip != cached.clip || layer.clip->CacheVersion() != composite.versions[layer_index] ||
+			layer.draw_width != cached.draw_width || layer.draw_height != cached.draw_height ||
+			a.alpha != b.alpha || a.scale_x != b.scale_x || a.scale_y != b.scale_y ||
+			a.location_x != b.location_x || a.location_y != b.location_y || a.rotation != b.rotation ||
+			a.shear_x != b.shear_x || a.shear_y != b.shear_y || a.crop_x != b.crop_x || a.crop_y != b.crop_y ||
+			a.crop_width != b.crop_width || a.crop_height != b.crop_height || a.has_video != b.has_video)
+			return false;
+	}
+	return true;
+}
+
+// Keep a copy of the composite of the static layers of a frame
+void Timeline::keep_static_composite(const FramePlan& frame_plan, int static_layers, bool has_background, QRgb background, const std::shared_ptr<QImage>& image)
+{
+	std::lock_guard<std::mutex> static_lock(static_mutex);
+	if (is_same_static_composite(frame_plan, static_layers, has_background, background))
+		return;
+
+	// Copy the pixels (the upper layers are drawn on the frame's image next)
+	static_composite.layers.assign(frame_plan.layers.begin(), frame_plan.layers.begin() + static_layers);
+	static_composite.versions.clear();
+	for (int layer_index = 0; layer_index < static_layers; layer_index++)
+		static_composite.versions.push_back(frame_plan.layers[layer_index].clip->CacheVersion());
+	static_composite.has_background = has_background;
+	static_composite.background = background;
+	static_composite.image = std::make_shared<QImage>(image->copy());
+}
+
+// Determine if a clip's image is opaque and covers the entire timeline frame
+bool Timeline::is_opaque_full_frame(Clip* clip, const ClipProperties& properties, int64_t timeline_frame_number)
+{
+	ReaderBase *reader = clip->Reader();
+	if (!reader || !reader->info.has_video || clip->Waveform() || properties.has_video == 0)
+		return false;
+
+	// Clip effects and timeline effects (on this layer) can change the image (and its alpha)
+	if (!clip->Effects().empty())
+		return false;
+	if (!find_layer_effects(timeline_frame_number, clip->Layer()).empty())
+		return false;
+
+	// Image must not have an alpha channel (only known for pixel formats detected by FFmpeg)
+	if (reader->info.pixel_format < 0)
+		return false;
+	const AVPixFmtDescriptor *pixel_format = av_pix_fmt_desc_get((AVPixelFormat) reader->info.pixel_format);
+	if (!pixel_format || (pixel_format->flags & AV_PIX_FMT_FLAG_ALPHA))
+		return false;
+
+	// Clip must be fully opaque and untransformed
+	if (properties.alpha != 1.0 ||
+		!isEqual(properties.scale_x, 1.0) || !isEqual(properties.scale_y, 1.0) ||
+		!isEqual(properties.location_x, 0.0) || !isEqual(properties.location_y, 0.0) ||
+		!isEqual(properties.rotation, 0.0) ||
+		!isEqual(properties.shear_x, 0.0) || !isEqual(properties.shear_y, 0.0))
+		return false;
+
+	// Clip must not be cropped
+	if (clip->crop_gravity != GRAVITY_TOP_LEFT ||
+		!isEqual(properties.crop_x, 0.0) || !isEqual(properties.crop_y, 0.0) ||
+		!isEqual(properties.crop_width, 1.0) || !isEqual(properties.crop_height, 1.0))
+		return false;
+
+	// Scaled image must cover the entire frame
+	switch (clip->scale)
+	{
+		case (SCALE_STRETCH):
+		case (SCALE_CROP):
+			return true;
+		case (SCALE_FIT):
+			// Only if the aspect ratio matches the timeline
+			return int64_t(reader->info.width) * info.height == int64_t(reader->info.height) * info.width;
+		default:
+			return false;
+	}
+}
+
+// Update the detected access pattern with a newly requested frame number
+void Timeline::update_access_pattern(int64_t requested_frame)
+{
+	// Compare with the previously requested frame
+	int64_t delta = requested_frame - last_requested_frame;
+
+	if (delta == 0)
+		// Same frame requested again (no change)
+		return;
+	else if (delta == 1) {
+		// Next frame requested
+		if (access_pattern == ACCESS_SEQUENTIAL)
+			access_streak++;
+		else {
+			access_pattern = ACCESS_SEQUENTIAL;
+			access_streak = 1;
+		}
+	}
+	else if (delta == -1) {
+		// Previous frame requested
+		if (access_pattern == ACCESS_REVERSE)
+			access_streak++;
+		else {
+			access_pattern = ACCESS_REVERSE;
+			access_streak = 1;
+		}
+	}
+	else {
+		// Jumped to a new frame (seek)
+		access_pattern = ACCESS_RANDOM;
+		access_streak = 0;
+	}
+
+	last_requested_frame = requested_frame;
+}
+
+// Calculate how many frames to render for a cache miss (based on the access pattern)
+int Timeline::calculate_batch_size()
+{
+	// Fixed batch size (if not adaptive)
+	if (!Settings::Instance()->ADAPTIVE_TIMELINE_BATCH)
+		return Settings::Instance()->TILE_COMPOSITING ? 1 : OPEN_MP_NUM_PROCESSORS;
+
+	// Random access (seeking) only needs the requested frame
+	if (access_pattern == ACCESS_RANDOM)
+		return 1;
+
+	// Largest batch allowed
+	int max_batch = Settings::Instance()->MAX_TIMELINE_BATCH;
+	if (max_batch <= 0)
+		max_batch = OPEN_MP_NUM_PROCESSORS * 2;
+
+	// Never render more frames than the final cache can hold (or the requested frame would be evicted)
+	int64_t frame_bytes = int64_t(info.width) * info.height * 4 + (info.sample_rate * info.channels * 4);
+	if (final_cache->GetMaxBytes() > 0 && frame_bytes > 0)
+		max_batch = std::min(int64_t(max_batch), std::max(int64_t(1), final_cache->GetMaxBytes() / frame_bytes));
+
+	// Grow the batch as the streak of ordered requests gets longer
+	int batch_size = OPEN_MP_NUM_PROCESSORS;
+	if (access_streak > OPEN_MP_NUM_PROCESSORS)
+		batch_size = max_batch;
+
+	return std::max(1, std::min(batch_size, max_batch));
+}
+
+// Find the clip whose frames pass through the timeline unchanged, for a range of frames (or NULL)
+Clip* Timeline::FindPassThroughClip(int64_t start, int64_t end, int64_t &clip_start_frame)
+{
+	if (end < start)
+		return NULL;
+
+	// A background color is composited under the clip
+	if (color.red.GetCount() > 1 || color.green.GetCount() > 1 || color.blue.GetCount() > 1 ||
+		color.red.GetValue(start) != 0.0 || color.green.GetValue(start) != 0.0 || color.blue.GetValue(start) != 0.0)
+		return NULL;
+
+	// Only a single clip can be on the timeline during the range (and it must cover the entire range)
+	std::vector<Clip*> nearby_clips = find_intersecting_clips(start, end - start + 1, true);
+	if (nearby_clips.size() != 1)
+		return NULL;
+	Clip *clip = nearby_clips[0];
+	int64_t clip_start_position = clip->PositionFrame();
+	int64_t clip_end_position = clip->EndPositionFrame();
+	if (clip_start_position > start || clip_end_position < end)
+		return NULL;
+
+	// The clip must play at normal speed and full volume (on all channels), without a frame number overlay
+	if (clip->time.GetCount() > 1 || clip->display != FRAME_DISPLAY_NONE ||
+		clip->volume.GetCount() > 1 || !isEqual(clip->volume.GetValue(start), 1.0) ||
+		clip->channel_filter.GetCount() > 1 || clip->channel_filter.GetInt(start) != -1 ||
+		clip->has_audio.GetCount() > 1 || clip->has_audio.GetInt(start) == 0)
+		return NULL;
+
+	// The clip's images must already be the size of the timeline (so they are not scaled)
+	ReaderBase *reader = clip->Reader();
+	if (!reader || reader->info.width != info.width || reader->info.height != info.height)
+		return NULL;
+
+	// Every frame must be opaque and untransformed
+	int64_t clip_frame_offset = clip->StartFrame() - clip_start_position;
+	for (int64_t frame_number = start; frame_number <= end; frame_number++)
+		if (!is_opaque_full_frame(clip, clip->EvaluateProperties(frame_number + clip_frame_offset), frame_number))
+			return NULL;
+
+	clip_start_frame = start + clip_frame_offset;
+	return clip;
+}
+
+// Find intersecting clips (or non intersecting clips)
+std::vector<Clip*> Timeline::find_intersecting_clips(int64_t requested_frame, int number_of_frames, bool include)
+{
+	// Find matching clips
+	std::vector<Clip*> matching_clips;
+
+	// Calculate time of frame
+	int64_t min_requested_frame = requested_frame;
+	int64_t max_requested_frame = requested_frame + (number_of_frames - 1);
+
+	// Re-Sort Clips and rebuild index (only if they changed)
+	update_clip_intervals();
+
+	// Search the index for clips at this time
+	std::vector<ClipInterval*> matches;
+	if (!clip_intervals.empty())
+		query_intervals(clip_intervals, 0, clip_intervals.size(), min_requested_frame, max_requested_frame, matches);
+
+	// Return matches in the same order as the sorted clips (lowest layer to top layer)
+	std::sort(matches.begin(), matches.end(), [](ClipInterval* lhs, ClipInterval* rhs) { return lhs->order < rhs->order; });
+
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::find_intersecting_clips", "requested_frame", requested_frame, "min_requested_frame", min_requested_frame, "max_requested_frame", max_requested_frame, "clips.size()", clips.size(), "matches.size()", matches.size());
+
+	// Close any opened clips which are no longer intersecting
+	std::set<Clip*> intersecting_clips;
+	std::vector<ClipInterval*>::iterator match_itr;
+	for (match_itr = matches.begin(); match_itr != matches.end(); ++match_itr)
+		intersecting_clips.insert((*match_itr)->clip);
+
+	std::vector<Clip*> clips_to_close;
+	std::map<Clip*, Clip*>::iterator open_itr;
+	for (open_itr = open_clips.begin(); open_itr != open_clips.end(); ++open_itr)
+		if (!intersecting_clips.count(open_itr->first))
+			clips_to_close.push_back(open_itr->first);
+
+	for (int index = 0; index < clips_to_close.size(); index++) {
+		#pragma omp critical (reader_lock)
+		update_open_clips(clips_to_close[index], false);
+	}
+
+	// Open intersecting clips (if needed)
+	for (match_itr = matches.begin(); match_itr != matches.end(); ++match_itr)
+	{
+		Clip *clip = (*match_itr)->clip;
 
-						// Determine the frame needed for this clip (based on the position on the timeline)
-                        long clip_start_frame = (clip->Start() * info.fps.ToDouble()) + 1;
-						long clip_frame_number = frame_number - clip_start_position + clip_start_frame;
+		// Open this clip (if not already opened)
+		#pragma omp critical (reader_lock)
+		update_open_clips(clip, true);
 
-						// Debug output
-						ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Calculate clip's frame #)", "clip->Position()", clip->Position(), "clip->Start()", clip->Start(), "info.fps.ToFloat()", info.fps.ToFloat(), "clip_frame_number", clip_frame_number);
+		// Add the intersecting clip
+		if (include)
+			matching_clips.push_back(clip);
+	}
 
-						// Add clip's frame as layer
-						add_layer(new_frame, clip, clip_frame_number, frame_number, is_top_clip, max_volume);
+	if (!include) {
+		// Add the non-intersecting clips
+		std::list<Clip*>::iterator clip_itr;
+		for (clip_itr=clips.begin(); clip_itr != clips.end(); ++clip_itr)
+			if (!intersecting_clips.count(*clip_itr))
+				matching_clips.push_back(*clip_itr);
+	}
 
-					} else
-						// Debug output
-						ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (clip does not intersect)", "frame_number", frame_number, "does_clip_intersect", does_clip_intersect);
+	// return list
+	return matching_clips;
+}
 
-				} // end clip loop
+// Rebuild the clip interval index (if any clips have changed)
+void Timeline::update_clip_intervals()
+{
+	// A clip or effect of this timeline might have moved (directly, i.e. by Clip::Position())
+	int64_t changes = *clip_changes;
+	int64_t current_effect_changes = *effect_changes;
+	bool clips_changed = clip_intervals_dirty || changes != clip_intervals_changes;
+	bool effects_changed = effect_intervals_dirty || current_effect_changes != effect_intervals_changes;
+	if (!clips_changed && !effects_changed)
+		return;
 
-				// Debug output
-				ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (Add frame to cache)", "frame_number", frame_number, "info.width", info.width, "info.height", info.height);
+	if (clips_changed) {
+		// Re-Sort Clips (since they likely changed)
+		sort_clips();
 
-				// Set frame # on mapped frame
-				#pragma omp ordered
-				{
-					new_frame->SetFrameNumber(frame_number);
+		// Find the clips of nested timelines (their edits remove the cached frames of the clips)
+		update_nested_timelines();
 
-					// Add final frame to cache
-					final_cache->Add(new_frame);
-				}
+		// Calculate the frame range of each clip
+		clip_intervals.clear();
+		clip_intervals.reserve(clips.size());
 
-			} // end frame loop
-		} // end parallel
+		size_t order = 0;
+		std::list<Clip*>::iterator clip_itr;
+		for (clip_itr=clips.begin(); clip_itr != clips.end(); ++clip_itr, order++)
+		{
+			// Get clip object from the iterator
+			Clip *clip = (*clip_itr);
+
+			ClipInterval interval;
+			clip->FrameRate(info.fps);
+			interval.start = clip->PositionFrame();
+			interval.end = clip->EndPositionFrame();
+			interval.max_end = interval.end;
+			interval.order = order;
+			interval.clip = clip;
+			clip_intervals.push_back(interval);
+		}
 
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::GetFrame (end parallel region)", "requested_frame", requested_frame, "omp_get_thread_num()", omp_get_thread_num());
+		// Sort by starting frame, and calculate the max end frame of each subtree
+		std::stable_sort(clip_intervals.begin(), clip_intervals.end(), CompareClipIntervals());
+		build_intervals(clip_intervals, 0, clip_intervals.size());
 
-		// Return frame (or blank frame)
-		return final_cache->GetFrame(requested_frame);
+		clip_intervals_dirty = false;
+		clip_intervals_changes = changes;
 	}
-}
 
+	// Timeline effects might have moved too
+	if (effects_changed) {
+		update_effect_intervals();
+		effect_intervals_dirty = false;
+		effect_intervals_changes = current_effect_changes;
+	}
 
-// Find intersecting clips (or non intersecting clips)
-std::vector<Clip*> Timeline::find_intersecting_clips(int64_t requested_frame, int number_of_frames, bool include)
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_clip_intervals", "clip_intervals.size()", clip_intervals.size(), "effects.size()", effects.size(), "clips_changed", clips_changed, "effects_changed", effects_changed);
+}
+
+// Insert, move, or remove the interval of a single clip (instead of rebuilding the index)
+void Timeline::update_clip_interval(Clip* clip, int64_t changes, bool remove)
 {
-	// Find matching clips
-	std::vector<Clip*> matching_clips;
+	// The index is only updated if it was up to date before this clip changed (otherwise it is rebuilt)
+	if (clip_intervals_dirty || changes != clip_intervals_changes) {
+		clip_intervals_dirty = true;
+		return;
+	}
 
-	// Calculate time of frame
-	float min_requested_frame = requested_frame;
-	float max_requested_frame = requested_frame + (number_of_frames - 1);
+	// Remove the previous interval of the clip (if any)
+	clip_intervals.erase(std::remove_if(clip_intervals.begin(), clip_intervals.end(),
+										[clip](const ClipInterval& interval) { return interval.clip == clip; }), clip_intervals.end());
+
+	// Insert its new interval (after the intervals which start at the same frame)
+	if (!remove) {
+		ClipInterval interval;
+		clip->FrameRate(info.fps);
+		interval.start = clip->PositionFrame();
+		interval.end = clip->EndPositionFrame();
+		interval.max_end = interval.end;
+		interval.order = 0;
+		interval.clip = clip;
+		clip_intervals.insert(std::upper_bound(clip_intervals.begin(), clip_intervals.end(), interval, CompareClipIntervals()), interval);
+	}
 
-	// Re-Sort Clips (since they likely changed)
-	sort_clips();
+	// Number the intervals in the order of the sorted clips (which moves the clips above an inserted or removed clip)
+	std::map<Clip*, size_t> clip_orders;
+	size_t order = 0;
+	for (Clip *sorted_clip : clips)
+		clip_orders[sorted_clip] = order++;
+	for (ClipInterval& interval : clip_intervals)
+		interval.order = clip_orders[interval.clip];
 
-	// Find Clips at this time
-	std::list<Clip*>::iterator clip_itr;
-	for (clip_itr=clips.begin(); clip_itr != clips.end(); ++clip_itr)
-	{
-		// Get clip object from the iterator
-		Clip *clip = (*clip_itr);
+	// Calculate the max end frame of each subtree
+	build_intervals(clip_intervals, 0, clip_intervals.size());
 
-		// Does clip intersect the current requested time
-		long clip_start_position = round(clip->Position() * info.fps.ToDouble()) + 1;
-		long clip_end_position = round((clip->Position() + clip->Duration()) * info.fps.ToDouble()) + 1;
+	// A clip of a nested timeline is tracked for its edits (a removed clip is no longer tracked by RemoveClip)
+	if (!remove && nested_timeline(clip))
+		update_nested_timelines();
 
-		bool does_clip_intersect =
-                (clip_start_position <= min_requested_frame || clip_start_position <= max_requested_frame) &&
-                (clip_end_position >= min_requested_frame || clip_end_position >= max_requested_frame);
+	// Debug output
+	ZmqLogger::Instance()->AppendDebugMethod("Timeline::update_clip_interval", "clip_intervals.size()", clip_intervals.size(), "remove", remove);
 
-		// Debug output
-		ZmqLogger::Instance()->AppendDebugMethod("Timeline::find_intersecting_clips (Is clip near or intersecting)", "requested_frame", requested_frame, "min_requested_frame", min_requested_frame, "max_requested_frame", max_requested_frame, "clip->Position()", clip->Position(), "does_clip_intersect", does_clip_intersect);
+	clip_intervals_changes = *clip_changes;
+}
 
-		// Open (or schedule for closing) this clip, based on if it's intersecting or not
-		#pragma omp critical (reader_lock)
-		update_open_clips(clip, does_clip_intersect);
+// Rebuild the index of timeline effects on each layer
+void Timeline::update_effect_intervals()
+{
+	// Re-Sort Effects (the order they are applied)
+	sort_effects();
 
-		// Clip is visible
-		if (does_clip_intersect && include)
-			// Add the intersecting clip
-			matching_clips.push_back(clip);
+	// Calculate the frame range of each effect (on its layer)
+	effect_intervals.clear();
+	size_t order = 0;
+	for (std::list<EffectBase*>::iterator effect_itr = effects.begin(); effect_itr != effects.end(); ++effect_itr, order++)
+	{
+		EffectBase *effect = (*effect_itr);
 
-		else if (!does_clip_intersect && !include)
-			// Add the non-intersecting clip
-			matching_clips.push_back(clip);
+		EffectInterval interval;
+		effect->FrameRate(info.fps);
+		interval.start = effect->PositionFrame();
+		interval.end = effect->EndPositionFrame();
+		interval.max_end = interval.end;
+		interval.order = order;
+		interval.effect = effect;
+		effect_intervals[effect->Layer()].push_back(interval);
+	}
 
-	} // end clip loop
+	// Sort each layer by starting frame, and calculate the max end frame of each subtree
+	std::map<int, std::vector<EffectInterval> >::iterator layer_itr;
+	for (layer_itr = effect_intervals.begin(); layer_itr != effect_intervals.end(); ++layer_itr) {
+		std::vector<EffectInterval>& intervals = layer_itr->second;
+		std::stable_sort(intervals.begin(), intervals.end(),
+						 [](const EffectInterval& lhs, const EffectInterval& rhs) { return lhs.start < rhs.start; });
+		build_intervals(intervals, 0, intervals.size());
+	}
+}
 
-	// return list
-	return matching_clips;
+// Find the timeline effects on a layer at a timeline frame (in the order they are applied)
+std::vector<EffectInterval*> Timeline::find_layer_effects(int64_t timeline_frame_number, int layer)
+{
+	std::vector<EffectInterval*> matches;
+	std::map<int, std::vector<EffectInterval> >::iterator layer_itr = effect_intervals.find(layer);
+	if (layer_itr == effect_intervals.end())
+		return matches;
+
+	query_intervals(layer_itr->second, 0, layer_itr->second.size(), timeline_frame_number, timeline_frame_number, matches);
+	std::sort(matches.begin(), matches.end(), [](EffectInterval* lhs, EffectInterval* rhs) { return lhs->order < rhs->order; });
+	return matches;
 }
 
 // Set the cache object used by this reader
@@ -972,15 +2841,92 @@ void Timeline::SetCache(CacheBase* new_cache) {
 		managed_cache = false;
 	}
 
-	// Set new cache
+	// Set new cache (the frames of the other sizes belong to the previous cache)
 	final_cache = new_cache;
+	clear_size_caches();
+	if (final_cache)
+		final_cache->SetMemoryTag("cache.timeline");
+}
+
+// Generate a JSON string of the timing counters of all effects
+std::string Timeline::EffectTimingJson() {
+
+	// Return formatted string
+	return WriteJson(EffectTimingJsonValue());
+}
+
+// Generate a JSON object of the timing counters of all effects
+Json::Value Timeline::EffectTimingJsonValue() {
+
+	// Add array of timeline effects
+	Json::Value root;
+	root["effects"] = Json::Value(Json::arrayValue);
+	for (EffectBase *effect : effects)
+		root["effects"].append(effect->TimingJsonValue());
+
+	// Add array of clips (with effects)
+	root["clips"] = Json::Value(Json::arrayValue);
+	for (Clip *clip : clips)
+		if (!clip->Effects().empty())
+			root["clips"].append(clip->EffectTimingJsonValue());
+
+	// return JsonValue
+	return root;
+}
+
+// Reset the timing counters of all effects
+void Timeline::ResetEffectTiming() {
+	for (EffectBase *effect : effects)
+		effect->ResetTiming();
+	for (Clip *clip : clips)
+		clip->ResetEffectTiming();
+}
+
+// Get the runtime metrics of this timeline as a JSON string
+std::string Timeline::Metrics() {
+	return WriteJson(MetricsValue());
+}
+
+// Get the runtime metrics of this timeline as a JSON value
+Json::Value Timeline::MetricsValue() {
+	Json::Value root = ReaderBase::MetricsValue();
+	root["render_time"] = render_times.JsonValue();
+	root["static_layer_hits"] = Json::Int64(static_layer_hits.Value());
+	root["graph_shared_nodes"] = Json::Int64(graph_shared_nodes.Value());
+
+	// The readers of the clips (their seeks, and the hits and misses of their caches)
+	root["clips"] = Json::Value(Json::arrayValue);
+	{
+		const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+		for (std::list<Clip*>::iterator clip_itr = clips.begin(); clip_itr != clips.end(); ++clip_itr) {
+			Json::Value clip_metrics;
+			clip_metrics["id"] = (*clip_itr)->Id();
+			try {
+				clip_metrics["reader"] = (*clip_itr)->Reader()->MetricsValue();
+			}
+			catch (const ReaderClosed & e) {
+				// This clip has no reader
+			}
+			root["clips"].append(clip_metrics);
+		}
+	}
+
+	// The process-wide counters (i.e. decode and encode rates)
+	root["global"] = openshot::Metrics::Instance()->JsonValue();
+	return root;
+}
+
+// Send the runtime metrics of this timeline to the subscribers of the logger (if logging is enabled)
+void Timeline::PublishMetrics() {
+	if (ZmqLogger::Instance()->IsEnabled())
+		ZmqLogger::Instance()->Log("Timeline::Metrics " + Metrics() + "\n");
 }
 
 // Generate JSON string of this object
 std::string Timeline::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -1030,13 +2976,7 @@ void Timeline::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -1065,8 +3005,15 @@ void Timeline::SetJsonValue(Json::Value root) {
 	ReaderBase::SetJsonValue(root);
 
 	if (!root["clips"].isNull()) {
-		// Clear existing clips
+		// Clear existing clips (and the timelines this timeline is nested in render all its frames again). The index
+		// is rebuilt once, after all clips are added.
 		clips.clear();
+		clip_intervals_dirty = true;
+		{
+			std::lock_guard<std::mutex> lock(nested_mutex);
+			nested_timelines.clear();
+		}
+		record_edit(1, std::numeric_limits<int64_t>::max());
 
 		// loop through clips
 		for (int x = 0; x < root["clips"].size(); x++) {
@@ -1116,26 +3063,73 @@ void Timeline::SetJsonValue(Json::Value root) {
 		info.video_length = info.fps.ToFloat() * info.duration;
 	}
 
+	// Rebuild the interval indexes (on next frame request)
+	clip_intervals_dirty = true;
+	effect_intervals_dirty = true;
+
 	// Re-open if needed
 	if (was_open)
 		Open();
 }
 
+// Save a binary snapshot of the timeline
+void Timeline::SaveSnapshot(std::string path) {
+
+	// Write to a temporary file and rename it, so a loading worker never sees a partial snapshot
+	std::string contents = WriteBinaryJson(JsonValue());
+	QString snapshot_path = QString::fromStdString(path);
+	QFile snapshot_file(snapshot_path + ".tmp");
+	if (!snapshot_file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+		snapshot_file.write(contents.c_str(), contents.size()) != (qint64) contents.size())
+		throw InvalidFile("Timeline snapshot could not be written.", path);
+	snapshot_file.close();
+	QFile::remove(snapshot_path);
+	QFile::rename(snapshot_path + ".tmp", snapshot_path);
+}
+
+// Load a binary snapshot of the timeline
+void Timeline::LoadSnapshot(std::string path) {
+
+	// Get lock (prevent getting frames while this happens)
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+
+	// Read the snapshot file
+	QFile snapshot_file(QString::fromStdString(path));
+	if (!snapshot_file.open(QIODevice::ReadOnly))
+		throw InvalidFile("Timeline snapshot could not be opened.", path);
+	QByteArray contents = snapshot_file.readAll();
+	snapshot_file.close();
+
+	// Parse binary snapshot into JSON objects
+	Json::Value root;
+	if (!ParseBinaryJson(std::string(contents.constData(), contents.size()), root))
+		// Raise exception
+		throw InvalidJSON("Timeline snapshot could not be parsed (or is invalid)", path);
+
+	try
+	{
+		// Set all values that match
+		SetJsonValue(root);
+	}
+	catch (const std::exception& e)
+	{
+		// Error parsing JSON (or missing keys)
+		throw InvalidJSON("Timeline snapshot is invalid (missing keys or invalid data types)", path);
+	}
+}
+
 // Apply a special formatted JSON object, which represents a change to the timeline (insert, update, delete)
 void Timeline::ApplyJsonDiff(std::string value) {
 
-    // Get lock (prevent getting frames while this happens)
-    const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+	// Get lock (prevent getting frames while this happens). A render which is in progress skips the rest of its
+	// read-ahead frames while this edit waits, so the edit only waits for the requested frame.
+	pending_edits++;
+	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
+	pending_edits--;
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success || !root.isArray())
 		// Raise exception
@@ -1154,13 +3148,18 @@ void Timeline::ApplyJsonDiff(std::string value) {
 				// Apply to CLIPS
 				apply_json_to_clips(change);
 
-			else if (root_key == "effects")
-				// Apply to EFFECTS
+			else if (root_key == "effects") {
+				// Apply to EFFECTS (which might change the order they are applied in, so their index is rebuilt)
 				apply_json_to_effects(change);
+				effect_intervals_dirty = true;
+			}
 
-			else
-				// Apply to TIMELINE
+			else {
+				// Apply to TIMELINE (a new frame rate moves the timeline frames of every clip and effect)
 				apply_json_to_timeline(change);
+				if (root_key == "fps")
+					ClipsChanged();
+			}
 
 		}
 	}
@@ -1228,13 +3227,31 @@ void Timeline::apply_json_to_clips(Json::Value change) {
 					// Get effect object from the iterator
 					EffectBase *e = (*effect_itr);
 					if (e->Id() == effect_id) {
+						// Find the frames which an update of only the effect's keyframes changes (in clip frames)
+						double fps = info.fps.ToDouble();
+						int64_t first_frame = existing_clip->StartFrame();
+						int64_t last_frame = ((existing_clip->Start() + existing_clip->Duration()) * fps) + 1;
+						int64_t changed_first = last_frame + 1;
+						int64_t changed_last = first_frame - 1;
+						if (change_type == "update" && changed_keyframe_frames(e->JsonValue(), change["value"], first_frame, last_frame, changed_first, changed_last)) {
+							// Update the effect, and remove only the changed frames from the cache
+							e->SetJsonValue(change["value"]);
+							existing_clip->ClearCache();
+							remove_changed_frames(existing_clip, changed_first, changed_last, false);
+							return; // effect found, don't update clip
+						}
+
 						// Apply the change to the effect directly
 						apply_json_to_effects(change, e);
 
-						// Calculate start and end frames that this impacts, and remove those frames from the cache
-                        int64_t new_starting_frame = (existing_clip->Position() * info.fps.ToDouble()) + 1;
-                        int64_t new_ending_frame = ((existing_clip->Position() + existing_clip->Duration()) * info.fps.ToDouble()) + 1;
-                        final_cache->Remove(new_starting_frame - 8, new_ending_frame + 8);
+						// Frames the clip processed with the previous effect are no longer valid
+						existing_clip->ClearCache();
+
+						// Calculate start and end frames that this impacts, and remove those frames from the cache (effects
+						// don't change the mixed audio)
+                        int64_t new_starting_frame = existing_clip->PositionFrame();
+                        int64_t new_ending_frame = existing_clip->EndPositionFrame();
+                        remove_cached_frames(new_starting_frame - 8, new_ending_frame + 8, false);
 
 						return; // effect found, don't update clip
 					}
@@ -1243,11 +3260,12 @@ void Timeline::apply_json_to_clips(Json::Value change) {
 		}
 	}
 
-	// Calculate start and end frames that this impacts, and remove those frames from the cache
-	if (!change["value"].isArray() && !change["value"]["position"].isNull()) {
+	// Calculate start and end frames that this impacts, and remove those frames from the cache (an update
+	// removes the frames it changes below)
+	if (change_type != "update" && !change["value"].isArray() && !change["value"]["position"].isNull()) {
 		int64_t new_starting_frame = (change["value"]["position"].asDouble() * info.fps.ToDouble()) + 1;
 		int64_t new_ending_frame = ((change["value"]["position"].asDouble() + change["value"]["end"].asDouble() - change["value"]["start"].asDouble()) * info.fps.ToDouble()) + 1;
-		final_cache->Remove(new_starting_frame - 8, new_ending_frame + 8);
+		remove_cached_frames(new_starting_frame - 8, new_ending_frame + 8);
 	}
 
 	// Determine type of change operation
@@ -1263,23 +3281,65 @@ void Timeline::apply_json_to_clips(Json::Value change) {
 
 	} else if (change_type == "update") {
 
-		// Update existing clip
+		// Update existing clip (and move its interval in the index, if the update moves it)
 		if (existing_clip) {
+			int64_t changes = *clip_changes;
+
+			// Only apply the properties which changed (so an unchanged reader and effects keep their cached frames)
+			Json::Value old_value = existing_clip->JsonValue();
+			if (existing_clip->Reader() && existing_clip->Reader()->Name() == "FrameMapper")
+				old_value["reader"] = ((FrameMapper*) existing_clip->Reader())->Reader()->JsonValue();
+			Json::Value new_value = change["value"];
+			if (new_value.isObject())
+				for (const std::string& name : change["value"].getMemberNames())
+					if (same_json_value(old_value[name], new_value[name]))
+						new_value.removeMember(name);
+
+			// Find the frames which an update of only keyframes changes (in clip frames). The time keyframe
+			// maps different frames, so it changes all of them.
+			double fps = info.fps.ToDouble();
+			int64_t first_frame = existing_clip->StartFrame();
+			int64_t last_frame = ((existing_clip->Start() + existing_clip->Duration()) * fps) + 1;
+			int64_t changed_first = last_frame + 1;
+			int64_t changed_last = first_frame - 1;
+			bool changes_audio = changes_clip_audio(new_value);
+			if (!new_value.isMember("time") && changed_keyframe_frames(old_value, new_value, first_frame, last_frame, changed_first, changed_last)) {
+
+				// Update clip properties from JSON, and remove only the changed frames from the cache
+				existing_clip->SetJsonValue(new_value);
+				remove_changed_frames(existing_clip, changed_first, changed_last, changes_audio);
+
+			} else {
+
+				// Calculate start and end frames that this impacts, and remove those frames from the cache
+				int64_t old_starting_frame = existing_clip->PositionFrame();
+				int64_t old_ending_frame = existing_clip->EndPositionFrame();
+				remove_cached_frames(old_starting_frame - 8, old_ending_frame + 8, changes_audio);
+
+				// Remove cache on clip's Reader (if found)
+				if (existing_clip->Reader() && existing_clip->Reader()->GetCache())
+					existing_clip->Reader()->GetCache()->Remove(old_starting_frame - 8, old_ending_frame + 8);
+
+				// Update clip properties from JSON
+				existing_clip->SetJsonValue(new_value);
+
+				// Apply framemapper (or update existing framemapper)
+				apply_mapper_to_clip(existing_clip);
+
+				// Remove the frames of the new position from the cache
+				int64_t new_starting_frame = existing_clip->PositionFrame();
+				int64_t new_ending_frame = existing_clip->EndPositionFrame();
+				remove_cached_frames(new_starting_frame - 8, new_ending_frame + 8, changes_audio);
+			}
 
-			// Calculate start and end frames that this impacts, and remove those frames from the cache
-			int64_t old_starting_frame = (existing_clip->Position() * info.fps.ToDouble()) + 1;
-			int64_t old_ending_frame = ((existing_clip->Position() + existing_clip->Duration()) * info.fps.ToDouble()) + 1;
-			final_cache->Remove(old_starting_frame - 8, old_ending_frame + 8);
-
-            // Remove cache on clip's Reader (if found)
-            if (existing_clip->Reader() && existing_clip->Reader()->GetCache())
-                existing_clip->Reader()->GetCache()->Remove(old_starting_frame - 8, old_ending_frame + 8);
-
-			// Update clip properties from JSON
-			existing_clip->SetJsonValue(change["value"]);
+			if (*clip_changes != changes) {
+				sort_clips();
+				update_clip_interval(existing_clip, changes, false);
+			}
 
-			// Apply framemapper (or update existing framemapper)
-			apply_mapper_to_clip(existing_clip);
+			// A new reader might nest a timeline (or no longer nest one)
+			if (new_value.isMember("reader"))
+				update_nested_timelines();
 		}
 
 	} else if (change_type == "delete") {
@@ -1288,9 +3348,9 @@ void Timeline::apply_json_to_clips(Json::Value change) {
 		if (existing_clip) {
 
 			// Calculate start and end frames that this impacts, and remove those frames from the cache
-			int64_t old_starting_frame = (existing_clip->Position() * info.fps.ToDouble()) + 1;
-			int64_t old_ending_frame = ((existing_clip->Position() + existing_clip->Duration()) * info.fps.ToDouble()) + 1;
-			final_cache->Remove(old_starting_frame - 8, old_ending_frame + 8);
+			int64_t old_starting_frame = existing_clip->PositionFrame();
+			int64_t old_ending_frame = existing_clip->EndPositionFrame();
+			remove_cached_frames(old_starting_frame - 8, old_ending_frame + 8);
 
 			// Remove clip from timeline
 			RemoveClip(existing_clip);
@@ -1347,11 +3407,27 @@ void Timeline::apply_json_to_effects(Json::Value change, EffectBase* existing_ef
 	// Get key and type of change
 	std::string change_type = change["type"].asString();
 
-	// Calculate start and end frames that this impacts, and remove those frames from the cache
+	// Find the frames which an update of only keyframes changes (in effect frames)
+	if (change_type == "update" && existing_effect) {
+		double fps = info.fps.ToDouble();
+		int64_t first_frame = existing_effect->StartFrame();
+		int64_t last_frame = ((existing_effect->Start() + existing_effect->Duration()) * fps) + 1;
+		int64_t changed_first = last_frame + 1;
+		int64_t changed_last = first_frame - 1;
+		if (changed_keyframe_frames(existing_effect->JsonValue(), change["value"], first_frame, last_frame, changed_first, changed_last)) {
+			// Update effect properties from JSON, and remove only the changed frames from the cache
+			existing_effect->SetJsonValue(change["value"]);
+			remove_changed_frames(existing_effect, changed_first, changed_last, false);
+			return;
+		}
+	}
+
+	// Calculate start and end frames that this impacts, and remove those frames from the cache (but not their
+	// mixed audio, which effects don't change)
 	if (!change["value"].isArray() && !change["value"]["position"].isNull()) {
 		int64_t new_starting_frame = (change["value"]["position"].asDouble() * info.fps.ToDouble()) + 1;
 		int64_t new_ending_frame = ((change["value"]["position"].asDouble() + change["value"]["end"].asDouble() - change["value"]["start"].asDouble()) * info.fps.ToDouble()) + 1;
-		final_cache->Remove(new_starting_frame - 8, new_ending_frame + 8);
+		remove_cached_frames(new_starting_frame - 8, new_ending_frame + 8, false);
 	}
 
 	// Determine type of change operation
@@ -1379,9 +3455,9 @@ void Timeline::apply_json_to_effects(Json::Value change, EffectBase* existing_ef
 		if (existing_effect) {
 
 			// Calculate start and end frames that this impacts, and remove those frames from the cache
-			int64_t old_starting_frame = (existing_effect->Position() * info.fps.ToDouble()) + 1;
-			int64_t old_ending_frame = ((existing_effect->Position() + existing_effect->Duration()) * info.fps.ToDouble()) + 1;
-			final_cache->Remove(old_starting_frame - 8, old_ending_frame + 8);
+			int64_t old_starting_frame = existing_effect->PositionFrame();
+			int64_t old_ending_frame = existing_effect->EndPositionFrame();
+			remove_cached_frames(old_starting_frame - 8, old_ending_frame + 8, false);
 
 			// Update effect properties from JSON
 			existing_effect->SetJsonValue(change["value"]);
@@ -1393,9 +3469,9 @@ void Timeline::apply_json_to_effects(Json::Value change, EffectBase* existing_ef
 		if (existing_effect) {
 
 			// Calculate start and end frames that this impacts, and remove those frames from the cache
-			int64_t old_starting_frame = (existing_effect->Position() * info.fps.ToDouble()) + 1;
-			int64_t old_ending_frame = ((existing_effect->Position() + existing_effect->Duration()) * info.fps.ToDouble()) + 1;
-			final_cache->Remove(old_starting_frame - 8, old_ending_frame + 8);
+			int64_t old_starting_frame = existing_effect->PositionFrame();
+			int64_t old_ending_frame = existing_effect->EndPositionFrame();
+			remove_cached_frames(old_starting_frame - 8, old_ending_frame + 8, false);
 
 			// Remove effect from timeline
 			RemoveEffect(existing_effect);
@@ -1404,6 +3480,94 @@ void Timeline::apply_json_to_effects(Json::Value change, EffectBase* existing_ef
 	}
 }
 
+// Find the frames changed by a JSON diff of keyframes (returns false if the diff changes more than keyframes)
+bool Timeline::changed_keyframe_frames(Json::Value old_value, Json::Value new_value, int64_t first_frame, int64_t last_frame, int64_t& changed_first, int64_t& changed_last)
+{
+	// Unchanged values don't change any frames
+	if (same_json_value(old_value, new_value))
+		return true;
+
+	// Any other change (such as a new position or reader) changes more than keyframes
+	if (!old_value.isObject() || !new_value.isObject())
+		return false;
+
+	if (new_value.isMember("Points")) {
+		if (!old_value.isMember("Points"))
+			return false;
+
+		// Compare the values of the previous and changed keyframe on each frame
+		Keyframe old_keyframe;
+		Keyframe new_keyframe;
+		old_keyframe.SetJsonValue(old_value);
+		new_keyframe.SetJsonValue(new_value);
+		for (int64_t frame = first_frame; frame <= last_frame; frame++)
+			if (old_keyframe.GetValue(frame) != new_keyframe.GetValue(frame)) {
+				changed_first = std::min(changed_first, frame);
+				changed_last = std::max(changed_last, frame);
+			}
+		return true;
+	}
+
+	// Compare each changed member (such as the keyframes of a color)
+	for (const std::string& name : new_value.getMemberNames())
+		if (!changed_keyframe_frames(old_value[name], new_value[name], first_frame, last_frame, changed_first, changed_last))
+			return false;
+	return true;
+}
+
+// Compare JSON values (numbers are compared by value, since a parsed number can have a different type)
+bool Timeline::same_json_value(const Json::Value& a, const Json::Value& b)
+{
+	if (a.isNumeric() && b.isNumeric())
+		return a.asDouble() == b.asDouble();
+
+	if (a.isArray() && b.isArray()) {
+		if (a.size() != b.size())
+			return false;
+		for (Json::ArrayIndex index = 0; index < a.size(); index++)
+			if (!same_json_value(a[index], b[index]))
+				return false;
+		return true;
+	}
+
+	if (a.isObject() && b.isObject()) {
+		if (a.size() != b.size())
+			return false;
+		for (const std::string& name : a.getMemberNames())
+			if (!b.isMember(name) || !same_json_value(a[name], b[name]))
+				return false;
+		return true;
+	}
+
+	return a == b;
+}
+
+// Remove the cached frames of a clip or effect's frame range (in clip or effect frames)
+void Timeline::remove_changed_frames(ClipBase* item, int64_t changed_first, int64_t changed_last, bool remove_audio)
+{
+	if (changed_first > changed_last)
+		return;
+
+	// Offset to the timeline frames of the clip or effect
+	int64_t offset = item->PositionFrame() - item->StartFrame();
+	remove_cached_frames(changed_first + offset - 8, changed_last + offset + 8, remove_audio);
+}
+
+// Does a change of clip properties change the clip's audio (the other properties only change its image)
+bool Timeline::changes_clip_audio(const Json::Value& changed_value)
+{
+	if (!changed_value.isObject())
+		return true;
+
+	// The properties mixed by add_layer_audio (and the properties which map the timeline's frames to the clip's)
+	static const char *audio_members[] = { "volume", "has_audio", "channel_filter", "channel_mapping", "mixing", "time",
+										   "position", "start", "end", "layer", "reader" };
+	for (const char *name : audio_members)
+		if (changed_value.isMember(name))
+			return true;
+	return false;
+}
+
 // Apply JSON diff to timeline properties
 void Timeline::apply_json_to_timeline(Json::Value change) {
 
@@ -1414,17 +3578,27 @@ void Timeline::apply_json_to_timeline(Json::Value change) {
 	if (change["key"].size() >= 2)
 		sub_key = change["key"][(uint)1].asString();
 
-	// Clear entire cache
+	// Clear entire cache (and the rendered regions). The background, viewport, and size only change the images.
 	final_cache->Clear();
+	if (root_key != "color" && root_key.find("viewport_") != 0 && root_key != "width" && root_key != "height" &&
+		root_key != "display_ratio" && root_key != "pixel_ratio")
+		audio_cache.Clear();
+	clear_size_caches();
+	clear_region_cache();
+	record_edit(1, std::numeric_limits<int64_t>::max());
 
 	// Determine type of change operation
 	if (change_type == "insert" || change_type == "update") {
 
 		// INSERT / UPDATE
 		// Check for valid property
-		if (root_key == "color")
-			// Set color
+		if (root_key == "color") {
+			// Set color (and bake its animated channels, since the background is evaluated for every frame)
 			color.SetJsonValue(change["value"]);
+			color.red.Bake();
+			color.green.Bake();
+			color.blue.Bake();
+		}
 		else if (root_key == "viewport_scale")
 			// Set viewport scale
 			viewport_scale.SetJsonValue(change["value"]);
@@ -1529,8 +3703,16 @@ void Timeline::ClearAllCache() {
 	// Get lock (prevent getting frames while this happens)
 	const GenericScopedLock<CriticalSection> lock(getFrameCriticalSection);
 
-    // Clear primary cache
+    // Clear primary cache (and the rendered regions). The timelines this timeline is nested in render it again.
     final_cache->Clear();
+    audio_cache.Clear();
+    clear_size_caches();
+    clear_region_cache();
+    record_edit(1, std::numeric_limits<int64_t>::max());
+    {
+        std::lock_guard<std::mutex> static_lock(static_mutex);
+        static_composite.image.reset();
+    }
 
     // Loop through all clips
     std::list<Clip*>::iterator clip_itr;
@@ -1539,7 +3721,8 @@ void Timeline::ClearAllCache() {
         // Get clip object from the iterator
         Clip *clip = (*clip_itr);
 
-        // Clear cache on clip
+        // Clear cache on clip (and its processed frames)
+        clip->ClearCache();
         clip->Reader()->GetCache()->Clear();
 
         // Clear nested Reader (if any)
@@ -1552,8 +3735,365 @@ void Timeline::ClearAllCache() {
     }
 }
 
-// Set Max Image Size (used for performance optimization). Convenience function for setting
-// Settings::Instance()->MAX_WIDTH and Settings::Instance()->MAX_HEIGHT.
+// Set the cache of the rendered region frames
+void Timeline::RegionCache(CacheBase* cache) {
+	// Stop rendering into the previous cache
+	stop_region_render();
+	{
+		std::lock_guard<std::mutex> region_lock(region_mutex);
+		region_cache = cache;
+		region_frames.clear();
+		region_generation++;
+	}
+
+	start_region_render();
+}
+
+// Render a region of the timeline in the background
+void Timeline::AddRenderRegion(int64_t start, int64_t end) {
+	if (end < start)
+		std::swap(start, end);
+	{
+		std::lock_guard<std::mutex> region_lock(region_mutex);
+		render_regions.push_back(std::make_pair(std::max(int64_t(1), start), end));
+	}
+	region_condition.notify_all();
+
+	start_region_render();
+}
+
+// Stop rendering all regions
+void Timeline::ClearRenderRegions() {
+	std::lock_guard<std::mutex> region_lock(region_mutex);
+	render_regions.clear();
+}
+
+// Return the number of region frames which are rendered
+int64_t Timeline::RenderedRegionFrames() {
+	std::lock_guard<std::mutex> region_lock(region_mutex);
+	return region_frames.size();
+}
+
+// Remove a range of frames from the final cache and the region cache
+void Timeline::remove_cached_frames(int64_t start, int64_t end, bool remove_audio) {
+	final_cache->Remove(start, end);
+	if (remove_audio)
+		audio_cache.Remove(start, end);
+	clear_size_caches(start, end);
+	record_edit(start, end);
+	if (!region_cache || end < start)
+		return;
+	{
+		std::lock_guard<std::mutex> region_lock(region_mutex);
+		region_cache->Remove(start, end);
+		region_frames.erase(region_frames.lower_bound(start), region_frames.upper_bound(end));
+		region_generation++;
+	}
+
+	// Render the removed frames again
+	region_condition.notify_all();
+}
+
+// Clear the region cache
+void Timeline::clear_region_cache() {
+	if (!region_cache)
+		return;
+	{
+		std::lock_guard<std::mutex> region_lock(region_mutex);
+		region_cache->Clear();
+		region_frames.clear();
+		region_generation++;
+	}
+	region_condition.notify_all();
+}
+
+// Start the region render thread
+void Timeline::start_region_render() {
+	std::lock_guard<std::mutex> region_lock(region_mutex);
+	if (!is_open || !region_cache || render_regions.empty() || region_thread.joinable())
+		return;
+
+	region_stop = false;
+	region_thread = std::thread(&Timeline::region_render_loop, this);
+}
+
+// Stop the region render thread
+void Timeline::stop_region_render() {
+	{
+		std::lock_guard<std::mutex> region_lock(region_mutex);
+		region_stop = true;
+	}
+	region_condition.notify_all();
+
+	if (region_thread.joinable())
+		region_thread.join();
+}
+
+// Find the first frame of the regions which is not rendered
+int64_t Timeline::next_region_frame() {
+	if (!region_cache)
+		return 0;
+	for (const std::pair<int64_t, int64_t>& region : render_regions)
+		for (int64_t frame_number = region.first; frame_number <= region.second; frame_number++)
+			if (region_frames.count(frame_number) == 0)
+				return frame_number;
+	return 0;
+}
+
+// Render the missing frames of the regions (on the region render thread)
+void Timeline::region_render_loop() {
+	std::unique_lock<std::mutex> region_lock(region_mutex);
+	while (!region_stop) {
+		// Wait for a missing frame, and for the player to be idle (no frames requested, and no edits waiting)
+		int64_t frame_number = next_region_frame();
+		int64_t wait_ms = Settings::Instance()->REGION_RENDER_IDLE_MS - (steady_milliseconds() - last_request_ms);
+		if (frame_number == 0 || wait_ms > 0 || skip_read_ahead()) {
+			wait_ms = (frame_number == 0) ? 1000 : std::max(int64_t(10), wait_ms);
+			region_condition.wait_for(region_lock, std::chrono::milliseconds(wait_ms));
+			continue;
+		}
+		int64_t generation = region_generation;
+		region_lock.unlock();
+
+		// Render the frame, unless another frame is being rendered (or the timeline is being edited). This thread
+		// never waits for the frame lock, so it can be stopped while the lock is held (i.e. by SetJsonValue).
+		bool is_rendered = false;
+		std::shared_ptr<Frame> frame;
+		{
+			ScopedRenderSlot render_slot;
+			if (getFrameCriticalSection.tryEnter()) {
+				is_rendered = true;
+				try {
+					frame = get_frame(frame_number, true, 0, 0);
+				}
+				catch (const std::exception& e) {
+					ZmqLogger::Instance()->AppendDebugMethod("Timeline::region_render_loop (Failed to render frame)", "frame_number", frame_number);
+				}
+				getFrameCriticalSection.exit();
+			}
+		}
+
+		region_lock.lock();
+		if (!is_rendered) {
+			region_condition.wait_for(region_lock, std::chrono::milliseconds(10));
+			continue;
+		}
+
+		// Discard the frame if it was changed while it was rendered (a frame which failed is not rendered again,
+		// GetFrame renders it when it is requested)
+		if (generation == region_generation && region_cache) {
+			if (frame)
+				region_cache->Add(frame);
+			region_frames.insert(frame_number);
+		}
+	}
+}
+
+// Calculate the image size to render the frames at, for the size they are drawn at
+QSize Timeline::canvas_size(int width, int height) {
+	if (width <= 0 || height <= 0)
+		return QSize();
+
+	// Keep the aspect ratio of a full size frame (so the clips are laid out the same), covering the drawn size
+	QSize full_size(render_width, render_height);
+	QSize size = full_size;
+	size.scale(width, height, Qt::KeepAspectRatioByExpanding);
+
+	// Only smaller frames are rendered at a different size
+	if (size.width() >= full_size.width() || size.height() >= full_size.height())
+		return QSize();
+	return size;
+}
+
+// Determine if a cached frame is smaller than the frames rendered at a canvas size
+bool Timeline::is_smaller_than_canvas(std::shared_ptr<Frame> frame, QSize canvas) {
+	if (!frame->has_image_data)
+		return false;
+	if (canvas.isEmpty())
+		canvas = QSize(render_width, render_height);
+	return frame->GetWidth() < canvas.width() || frame->GetHeight() < canvas.height();
+}
+
+// Get a cached frame for a canvas size (or NULL if it needs to be rendered)
+std::shared_ptr<Frame> Timeline::get_cached_frame(int64_t frame_number, QSize canvas) {
+	std::shared_ptr<Frame> frame = final_cache->GetFrame(frame_number);
+
+	// A larger frame is drawn smaller by the timeline this timeline is nested in (so it is not scaled here)
+	QSize size(render_width, render_height);
+	if (!canvas.isEmpty() || size.isEmpty())
+		return (frame && is_smaller_than_canvas(frame, canvas)) ? std::shared_ptr<Frame>() : frame;
+	if (frame && (!frame->has_image_data || (frame->GetWidth() == size.width() && frame->GetHeight() == size.height())))
+		return frame;
+
+	// The frame rendered at this size before the size changed (or a downscale of a larger frame made earlier)
+	std::shared_ptr<CacheMemory> cache = size_cache(size, false);
+	std::shared_ptr<Frame> sized_frame;
+	if (cache)
+		sized_frame = cache->GetFrame(frame_number);
+	if (sized_frame || !frame || is_smaller_than_canvas(frame, canvas))
+		return sized_frame;
+
+	// Downscale the larger frame (sharing its audio), and keep it for the next request
+	sized_frame = frame->ShallowClone();
+	sized_frame->AddImage(std::make_shared<QImage>(frame->GetImage()->scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)));
+	size_cache(size, true)->Add(sized_frame);
+	return sized_frame;
+}
+
+// Add a rendered frame to the final cache (keeping a cached frame of another size in its size cache)
+void Timeline::add_final_frame(std::shared_ptr<Frame> frame) {
+	std::shared_ptr<Frame> cached_frame = final_cache->GetFrame(frame->number);
+	if (cached_frame && cached_frame->has_image_data && frame->has_image_data &&
+		(cached_frame->GetWidth() != frame->GetWidth() || cached_frame->GetHeight() != frame->GetHeight())) {
+		size_cache(QSize(cached_frame->GetWidth(), cached_frame->GetHeight()), true)->Add(cached_frame);
+		final_cache->Remove(frame->number);
+	}
+	final_cache->Add(frame);
+}
+
+// Get the cache of the frames rendered at an image size (creating it, if needed)
+std::shared_ptr<CacheMemory> Timeline::size_cache(QSize size, bool create) {
+	std::lock_guard<std::mutex> lock(size_caches_mutex);
+	std::pair<int, int> key(size.width(), size.height());
+	std::map<std::pair<int, int>, std::shared_ptr<CacheMemory> >::iterator cache = size_caches.find(key);
+	if (cache != size_caches.end()) {
+		size_cache_order.remove(key);
+		size_cache_order.push_front(key);
+		return cache->second;
+	}
+	if (!create)
+		return std::shared_ptr<CacheMemory>();
+
+	// Keep the frames of the 3 most recently used other sizes (each limited like the final cache)
+	while (size_caches.size() >= 3) {
+		size_caches.erase(size_cache_order.back());
+		size_cache_order.pop_back();
+	}
+	std::shared_ptr<CacheMemory> new_cache = std::make_shared<CacheMemory>(final_cache->GetMaxBytes());
+	new_cache->SetMemoryTag("cache.timeline");
+	size_caches[key] = new_cache;
+	size_cache_order.push_front(key);
+	return new_cache;
+}
+
+// Remove the frames of the other render sizes (all frames, or a range of frames)
+void Timeline::clear_size_caches(int64_t start, int64_t end) {
+	std::lock_guard<std::mutex> lock(size_caches_mutex);
+	if (end < start) {
+		size_caches.clear();
+		size_cache_order.clear();
+		return;
+	}
+	std::map<std::pair<int, int>, std::shared_ptr<CacheMemory> >::iterator cache;
+	for (cache = size_caches.begin(); cache != size_caches.end(); ++cache)
+		cache->second->Remove(start, end);
+}
+
+// Record the frames changed by an edit
+void Timeline::record_edit(int64_t first, int64_t last) {
+	std::lock_guard<std::mutex> lock(edits_mutex);
+	edit_ranges[++edit_generation] = std::make_pair(std::max(int64_t(1), first), last);
+
+	// Only the recent edits are kept (a timeline which missed older edits removes all the frames of this one)
+	while (edit_ranges.size() > 64)
+		edit_ranges.erase(edit_ranges.begin());
+}
+
+// Get the frames changed by the edits after an edit generation
+void Timeline::ChangedFrames(int64_t since_generation, int64_t& first, int64_t& last) {
+	std::lock_guard<std::mutex> lock(edits_mutex);
+	first = 1;
+	last = 0;
+	if (since_generation >= edit_generation)
+		return;
+
+	// The edits before the recorded edits are unknown (so all frames changed)
+	if (edit_ranges.empty() || edit_ranges.begin()->first > since_generation + 1) {
+		last = std::numeric_limits<int64_t>::max();
+		return;
+	}
+
+	first = std::numeric_limits<int64_t>::max();
+	for (std::map<int64_t, std::pair<int64_t, int64_t> >::iterator itr = edit_ranges.upper_bound(since_generation); itr != edit_ranges.end(); ++itr) {
+		first = std::min(first, itr->second.first);
+		last = std::max(last, itr->second.second);
+	}
+}
+
+// Get the timeline which is the reader of a clip
+Timeline* Timeline::nested_timeline(Clip* clip) {
+	ReaderBase *reader = NULL;
+	try {
+		reader = clip->Reader();
+	} catch (const ReaderClosed & e) {
+		// The clip has no reader
+		return NULL;
+	}
+	if (reader->Name() == "FrameMapper")
+		reader = ((FrameMapper*) reader)->Reader();
+	if (reader && reader->Name() == "Timeline")
+		return (Timeline*) reader;
+	return NULL;
+}
+
+// Update the list of nested timelines
+void Timeline::update_nested_timelines() {
+	std::lock_guard<std::mutex> lock(nested_mutex);
+	std::map<Clip*, std::pair<Timeline*, int64_t> > updated_timelines;
+	for (Clip *clip : clips) {
+		Timeline *timeline = nested_timeline(clip);
+		if (!timeline)
+			continue;
+
+		// A clip which was already nesting this timeline keeps the edit generation of its cached frames
+		std::map<Clip*, std::pair<Timeline*, int64_t> >::iterator existing = nested_timelines.find(clip);
+		if (existing != nested_timelines.end() && existing->second.first == timeline)
+			updated_timelines[clip] = existing->second;
+		else
+			updated_timelines[clip] = std::make_pair(timeline, timeline->EditGeneration());
+	}
+	nested_timelines.swap(updated_timelines);
+}
+
+// Remove the cached frames of the clips whose nested timelines were edited
+void Timeline::check_nested_edits() {
+	std::lock_guard<std::mutex> lock(nested_mutex);
+	for (std::map<Clip*, std::pair<Timeline*, int64_t> >::iterator itr = nested_timelines.begin(); itr != nested_timelines.end(); ++itr) {
+		Clip *clip = itr->first;
+		Timeline *timeline = itr->second.first;
+		int64_t generation = timeline->EditGeneration();
+		if (generation == itr->second.second)
+			continue;
+
+		int64_t changed_first = 0;
+		int64_t changed_last = 0;
+		timeline->ChangedFrames(itr->second.second, changed_first, changed_last);
+		itr->second.second = generation;
+		if (changed_first > changed_last)
+			continue;
+
+		// Map the changed frames of the nested timeline to the clip's frames (all of them, if the clip is time
+		// mapped, or the whole nested timeline changed)
+		double fps = info.fps.ToDouble();
+		int64_t clip_first = clip->StartFrame();
+		int64_t clip_last = ((clip->Start() + clip->Duration()) * fps) + 1;
+		if (clip->time.GetCount() <= 1 && changed_last < std::numeric_limits<int64_t>::max()) {
+			double rate = fps / timeline->info.fps.ToDouble();
+			clip_first = std::max(clip_first, (int64_t) floor((changed_first - 1) * rate) + 1);
+			clip_last = std::min(clip_last, (int64_t) ceil(changed_last * rate) + 1);
+		}
+
+		ZmqLogger::Instance()->AppendDebugMethod("Timeline::check_nested_edits", "changed_first", changed_first, "changed_last", changed_last, "clip_first", clip_first, "clip_last", clip_last);
+
+		// Remove the changed frames of the clip (and its frame mapper), and of this timeline
+		clip->ClearCache();
+		if (clip->Reader()->Name() == "FrameMapper")
+			clip->Reader()->GetCache()->Remove(clip_first - 1, clip_last + 1);
+		remove_changed_frames(clip, clip_first, clip_last);
+	}
+}
+
+// Set Max Image Size (used for performance optimization), which the readers of this timeline decode at
 void Timeline::SetMaxSize(int width, int height) {
 	// Maintain aspect ratio regardless of what size is passed in
 	QSize display_ratio_size = QSize(info.display_ratio.num * info.pixel_ratio.ToFloat(), info.display_ratio.den * info.pixel_ratio.ToFloat());
@@ -1562,7 +4102,7 @@ void Timeline::SetMaxSize(int width, int height) {
 	// Scale QSize up to proposed size
 	display_ratio_size.scale(proposed_size, Qt::KeepAspectRatio);
 
-	// Set max size
-	Settings::Instance()->MAX_WIDTH = display_ratio_size.width();
-	Settings::Instance()->MAX_HEIGHT = display_ratio_size.height();
+	// Set max size (of this timeline only)
+	render_width = display_ratio_size.width();
+	render_height = display_ratio_size.height();
 }
@@ -0,0 +1,278 @@
+/**
+ * @file
+ * @brief Source file for Tracer class
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <QFile>
+#include "../include/Trace.h"
+#include "../include/Exceptions.h"
+
+using namespace openshot;
+
+// Global reference to tracer
+Tracer *Tracer::m_pInstance = NULL;
+
+// Tracing is stopped until Start() is called
+std::atomic<bool> Tracer::is_tracing(false);
+
+// The stage times are not summed until StartStageTimes() is called
+std::atomic<bool> Tracer::is_timing(false);
+
+// The stages of the pipeline (the categories of the spans)
+static const char *stage_names[8] = { "decode", "seek", "mapping", "clip", "effects", "composite", "timeline", "encode" };
+
+// Get the index of a stage (or -1, for an unknown category)
+static int stage_index(const char *category)
+{
+	for (int index = 0; index < 8; index++)
+		if (strcmp(category, stage_names[index]) == 0)
+			return index;
+	return -1;
+}
+
+// Create or Get an instance of the tracer singleton
+Tracer *Tracer::Instance()
+{
+	static std::mutex instance_mutex;
+	std::lock_guard<std::mutex> lock(instance_mutex);
+
+	if (!m_pInstance)
+		// Create the actual instance of tracer only once
+		m_pInstance = new Tracer();
+
+	return m_pInstance;
+}
+
+// Clear the recorded spans, and start recording
+void Tracer::Start()
+{
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		for (size_t index = 0; index < threads.size(); index++) {
+			std::lock_guard<std::mutex> events_lock(threads[index]->events_mutex);
+			threads[index]->events.clear();
+		}
+		start_time = clock_microseconds();
+	}
+	is_tracing = true;
+}
+
+// Stop recording (the recorded spans are kept until the trace is started again)
+void Tracer::Stop()
+{
+	is_tracing = false;
+}
+
+// Start summing the time of each stage
+void Tracer::StartStageTimes()
+{
+	for (int index = 0; index < 8; index++)
+		stage_times[index] = 0;
+	is_timing = true;
+}
+
+// Stop summing the time of each stage
+void Tracer::StopStageTimes()
+{
+	is_timing = false;
+}
+
+// Add the microseconds of a span to its stage
+void Tracer::AddStageTime(const char *category, int64_t start)
+{
+	int index = stage_index(category);
+	if (index >= 0)
+		stage_times[index].fetch_add(Now() - start, std::memory_order_relaxed);
+}
+
+// Get the microseconds summed for a stage
+int64_t Tracer::StageTime(std::string category)
+{
+	int index = stage_index(category.c_str());
+	return (index >= 0) ? stage_times[index].load(std::memory_order_relaxed) : 0;
+}
+
+// Get the steady clock in microseconds
+int64_t Tracer::clock_microseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Get the microseconds since the trace started
+int64_t Tracer::Now()
+{
+	return clock_microseconds() - start_time.load(std::memory_order_relaxed);
+}
+
+// Get the span buffer of the calling thread
+Tracer::ThreadEvents *Tracer::thread_events()
+{
+	// Each thread registers its buffer once (the tracer keeps it, after the thread exits)
+	thread_local std::shared_ptr<ThreadEvents> events;
+	if (!events) {
+		events = std::make_shared<ThreadEvents>();
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		events->thread = threads.size() + 1;
+		threads.push_back(events);
+	}
+	return events.get();
+}
+
+// Record a span
+void Tracer::AddSpan(const char *name, const char *category, int64_t start, int64_t frame)
+{
+	TraceEvent event;
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.duration = Now() - start;
+	event.frame = frame;
+
+	ThreadEvents *buffer = thread_events();
+	event.thread = buffer->thread;
+	std::lock_guard<std::mutex> lock(buffer->events_mutex);
+	buffer->events.push_back(event);
+}
+
+// Get all recorded spans (sorted by their start)
+std::vector<TraceEvent> Tracer::Events()
+{
+	std::vector<TraceEvent> all_events;
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		for (size_t index = 0; index < threads.size(); index++) {
+			std::lock_guard<std::mutex> events_lock(threads[index]->events_mutex);
+			all_events.insert(all_events.end(), threads[index]->events.begin(), threads[index]->events.end());
+		}
+	}
+	std::stable_sort(all_events.begin(), all_events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+	return all_events;
+}
+
+// Get the recorded spans as a Chrome trace JSON string
+std::string Tracer::Json()
+{
+	return WriteJson(JsonValue());
+}
+
+// Get the recorded spans as a Chrome trace JSON value
+Json::Value Tracer::JsonValue()
+{
+	Json::Value root;
+	root["displayTimeUnit"] = "ms";
+	root["traceEvents"] = Json::Value(Json::arrayValue);
+
+	// Complete ("X") events, with the frame number of each span
+	std::vector<TraceEvent> events = Events();
+	for (size_t index = 0; index < events.size(); index++) {
+		Json::Value event;
+		event["name"] = events[index].name;
+		event["cat"] = events[index].category;
+		event["ph"] = "X";
+		event["ts"] = Json::Int64(events[index].start);
+		event["dur"] = Json::Int64(events[index].duration);
+		event["pid"] = 1;
+		event["tid"] = events[index].thread;
+		if (events[index].frame >= 0)
+			event["args"]["frame"] = Json::Int64(events[index].frame);
+		root["traceEvents"].append(event);
+	}
+	return root;
+}
+
+// Get the time of each stage of the recorded spans as a JSON string
+std::string Tracer::StageJson()
+{
+	return WriteJson(StageValue());
+}
+
+// Get the time of each stage of the recorded spans as a JSON value
+Json::Value Tracer::StageValue()
+{
+	// Sort the spans of each thread by their start (and a parent before the children which start with it)
+	std::vector<TraceEvent> events = Events();
+	std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+		if (a.thread != b.thread)
+			return a.thread < b.thread;
+		if (a.start != b.start)
+			return a.start < b.start;
+		return a.duration > b.duration;
+	});
+
+	// The self time of a span is its duration, minus the spans nested in it (on the same thread)
+	std::vector<int64_t> self_times(events.size());
+	std::vector<size_t> open_spans;
+	for (size_t index = 0; index < events.size(); index++) {
+		const TraceEvent& event = events[index];
+		self_times[index] = event.duration;
+		while (!open_spans.empty()) {
+			const TraceEvent& parent = events[open_spans.back()];
+			if (parent.thread == event.thread && event.start >= parent.start && event.start + event.duration <= parent.start + parent.duration)
+				break;
+			open_spans.pop_back();
+		}
+		if (!open_spans.empty())
+			self_times[open_spans.back()] -= event.duration;
+		open_spans.push_back(index);
+	}
+
+	// Add up the spans of each stage
+	std::map<std::string, int64_t> counts;
+	std::map<std::string, int64_t> total_times;
+	std::map<std::string, int64_t> stage_self_times;
+	for (size_t index = 0; index < events.size(); index++) {
+		std::string category = events[index].category;
+		counts[category]++;
+		total_times[category] += events[index].duration;
+		stage_self_times[category] += std::max(int64_t(0), self_times[index]);
+	}
+
+	Json::Value root = Json::Value(Json::objectValue);
+	for (std::map<std::string, int64_t>::iterator itr = counts.begin(); itr != counts.end(); ++itr) {
+		root[itr->first]["count"] = Json::Int64(itr->second);
+		root[itr->first]["total_ms"] = total_times[itr->first] / 1000.0;
+		root[itr->first]["self_ms"] = stage_self_times[itr->first] / 1000.0;
+	}
+	return root;
+}
+
+// Save the recorded spans as a Chrome trace JSON file
+void Tracer::Save(std::string path)
+{
+	QFile file(QString::fromStdString(path));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		throw InvalidFile("The trace file could not be opened.", path);
+
+	std::string contents = Json();
+	if (file.write(contents.c_str(), contents.size()) != (qint64) contents.size())
+		throw InvalidFile("The trace file could not be written.", path);
+	file.close();
+}
@@ -29,6 +29,7 @@
  */
 
 #include "../include/ZmqLogger.h"
+#include <chrono>
 
 #if USE_RESVG == 1
 	#include "ResvgQt.h"
@@ -53,12 +54,19 @@ ZmqLogger *ZmqLogger::Instance()
 		m_pInstance->publisher = NULL;
 		m_pInstance->connection = "";
 
-		// Default connection
-		m_pInstance->Connection("tcp://*:5556");
-
 		// Init enabled to False (force user to call Enable())
 		m_pInstance->enabled = false;
 
+		// Default connection (the socket is bound once logging is enabled)
+		m_pInstance->Connection("tcp://*:5556");
+
+		// No messages are queued (and the sender thread is started by Enable())
+		m_pInstance->pending_messages = NULL;
+		m_pInstance->sender_stop = false;
+
+		// Write the queued messages when the process exits (i.e. the stack trace of the crash handler)
+		atexit(ZmqLogger::flush_at_exit);
+
 		#if USE_RESVG == 1
 			// Init resvg logging (if needed)
 			// This can only happen 1 time or it will crash
@@ -83,6 +91,14 @@ void ZmqLogger::Connection(string new_connection)
 		// Set new connection
 		connection = new_connection;
 
+	// Bind the new connection now, if logging is enabled (otherwise Enable() binds it)
+	if (publisher != NULL || enabled)
+		bind_publisher();
+}
+
+// Bind the publisher socket to the connection (the caller holds loggerCriticalSection)
+void ZmqLogger::bind_publisher()
+{
 	if (context == NULL) {
 		// Create ZMQ Context
 		context = new zmq::context_t(1);
@@ -117,29 +133,131 @@ void ZmqLogger::Log(string message)
 		// Don't do anything
 		return;
 
-	// Create a scoped lock, allowing only a single thread to run the following code at one time
-	const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
-
-	// Send message over socket (ZeroMQ)
-	zmq::message_t reply (message.length());
-	memcpy (reply.data(), message.c_str(), message.length());
-	publisher->send(reply);
+	// Push the message on the queue (without a lock, so logging never waits for the socket or the disk)
+	push_message(message, false);
+}
 
-	// Write to log file (if opened, and force it to write to disk in case of a crash)
-	if (log_file.is_open())
-		log_file << message << std::flush;
+// Push a message on the queue of pending messages (lock free)
+void ZmqLogger::push_message(const string &message, bool file_only)
+{
+	LogMessage *log_message = new LogMessage();
+	log_message->text = message;
+	log_message->file_only = file_only;
+	log_message->next = pending_messages.load(std::memory_order_relaxed);
+	while (!pending_messages.compare_exchange_weak(log_message->next, log_message, std::memory_order_release, std::memory_order_relaxed));
 }
 
 // Log message to a file (if path set)
 void ZmqLogger::LogToFile(string message)
 {
+	// This is used by the crash handler, so it never waits for the lock (the sender thread can be stopped mid-batch)
+	const GenericScopedTryLock<CriticalSection> lock(loggerCriticalSection);
+	if (!lock.isLocked()) {
+		// Queue the message instead (it is written by the sender thread, or when the process exits)
+		push_message(message, true);
+		return;
+	}
+
+	// Write the queued messages first
+	write_pending_messages();
+
 	// Write to log file (if opened, and force it to write to disk in case of a crash)
 	if (log_file.is_open())
 		log_file << message << std::flush;
 }
 
+// Enable/Disable logging
+void ZmqLogger::Enable(bool is_enabled)
+{
+	const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
+
+	// Bind the socket the first time logging is enabled (so a disabled logger never opens a socket)
+	if (is_enabled && publisher == NULL)
+		bind_publisher();
+	enabled = is_enabled;
+
+	// Start sending messages in the background
+	if (enabled && !sender_thread.joinable()) {
+		sender_stop = false;
+		sender_thread = std::thread(&ZmqLogger::sender_loop, this);
+	}
+}
+
+// Send (and write) all messages logged so far, before returning
+void ZmqLogger::Flush()
+{
+	const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
+	write_pending_messages();
+}
+
+// Send (and write) the messages which are still queued when the process exits
+void ZmqLogger::flush_at_exit()
+{
+	if (m_pInstance)
+		m_pInstance->Flush();
+}
+
+// Send the pending messages in batches (until the logger is closed)
+void ZmqLogger::sender_loop()
+{
+	while (!sender_stop) {
+		if (pending_messages.load(std::memory_order_acquire)) {
+			const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
+			write_pending_messages();
+		}
+		else
+			// Collect a batch of messages
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	// Send the last messages
+	Flush();
+}
+
+// Send (and write) the pending messages in order, flushing the log file once (the caller holds loggerCriticalSection)
+void ZmqLogger::write_pending_messages()
+{
+	// Take all queued messages, and reverse them (they are pushed newest first)
+	LogMessage *batch = pending_messages.exchange(NULL, std::memory_order_acquire);
+	LogMessage *ordered = NULL;
+	while (batch) {
+		LogMessage *next = batch->next;
+		batch->next = ordered;
+		ordered = batch;
+		batch = next;
+	}
+
+	bool written = false;
+	while (ordered) {
+		LogMessage *next = ordered->next;
+
+		// Send message over socket (ZeroMQ)
+		if (publisher != NULL && !ordered->file_only) {
+			zmq::message_t reply (ordered->text.length());
+			memcpy (reply.data(), ordered->text.c_str(), ordered->text.length());
+			publisher->send(reply);
+		}
+
+		// Write to log file (if opened)
+		if (log_file.is_open()) {
+			log_file << ordered->text;
+			written = true;
+		}
+
+		delete ordered;
+		ordered = next;
+	}
+
+	// Force the batch to disk (in case of a crash)
+	if (written)
+		log_file << std::flush;
+}
+
 void ZmqLogger::Path(string new_path)
 {
+	// Create a scoped lock (the sender thread writes to the file)
+	const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
+
 	// Update path
 	file_path = new_path;
 
@@ -163,6 +281,18 @@ void ZmqLogger::Close()
 	// Disable logger as it no longer needed
 	enabled = false;
 
+	// Stop the sender thread (after it sends the queued messages)
+	if (sender_thread.joinable()) {
+		sender_stop = true;
+		sender_thread.join();
+	}
+
+	// Create a scoped lock, allowing only a single thread to run the following code at one time
+	const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
+
+	// Write the messages queued since the sender thread stopped (i.e. by LogToFile)
+	write_pending_messages();
+
 	// Close file (if already open)
 	if (log_file.is_open())
 		log_file.close();
@@ -176,43 +306,37 @@ void ZmqLogger::Close()
 }
 
 // Append debug information
-void ZmqLogger::AppendDebugMethod(string method_name,
-				  string arg1_name, float arg1_value,
-				  string arg2_name, float arg2_value,
-				  string arg3_name, float arg3_value,
-				  string arg4_name, float arg4_value,
-				  string arg5_name, float arg5_value,
-				  string arg6_name, float arg6_value)
+void ZmqLogger::append_debug_method(const char* method_name,
+				  const char* arg1_name, float arg1_value,
+				  const char* arg2_name, float arg2_value,
+				  const char* arg3_name, float arg3_value,
+				  const char* arg4_name, float arg4_value,
+				  const char* arg5_name, float arg5_value,
+				  const char* arg6_name, float arg6_value)
 {
-	if (!enabled)
-		// Don't do anything
-		return;
-
 	{
-		// Create a scoped lock, allowing only a single thread to run the following code at one time
-		const GenericScopedLock<CriticalSection> lock(loggerCriticalSection);
-
+		// Format the message on the logging thread (it is queued, and sent by the sender thread)
 		stringstream message;
 		message << fixed << setprecision(4);
 		message << method_name << " (";
 
 		// Add attributes to method JSON
-		if (arg1_name.length() > 0)
+		if (arg1_name && arg1_name[0])
 			message << arg1_name << "=" << arg1_value;
 
-		if (arg2_name.length() > 0)
+		if (arg2_name && arg2_name[0])
 			message << ", " << arg2_name << "=" << arg2_value;
 
-		if (arg3_name.length() > 0)
+		if (arg3_name && arg3_name[0])
 			message << ", " << arg3_name << "=" << arg3_value;
 
-		if (arg4_name.length() > 0)
+		if (arg4_name && arg4_name[0])
 			message << ", " << arg4_name << "=" << arg4_value;
 
-		if (arg5_name.length() > 0)
+		if (arg5_name && arg5_name[0])
 			message << ", " << arg5_name << "=" << arg5_value;
 
-		if (arg6_name.length() > 0)
+		if (arg6_name && arg6_name[0])
 			message << ", " << arg6_name << "=" << arg6_value;
 
 		// Output to standard output
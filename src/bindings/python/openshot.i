@@ -64,6 +64,7 @@
 #include "../../../include/CacheBase.h"
 #include "../../../include/CacheDisk.h"
 #include "../../../include/CacheMemory.h"
+#include "../../../include/CacheTiered.h"
 #include "../../../include/ChannelLayouts.h"
 #include "../../../include/ChunkReader.h"
 #include "../../../include/ChunkWriter.h"
@@ -82,6 +83,8 @@
 #include "../../../include/Fraction.h"
 #include "../../../include/Frame.h"
 #include "../../../include/FrameMapper.h"
+#include "../../../include/ImageSequenceReader.h"
+#include "../../../include/ImageSequenceWriter.h"
 #include "../../../include/PlayerBase.h"
 #include "../../../include/Point.h"
 #include "../../../include/Profiles.h"
@@ -90,11 +93,25 @@
 #include "../../../include/QtPlayer.h"
 #include "../../../include/QtTextReader.h"
 #include "../../../include/KeyFrame.h"
+#include "../../../include/Metrics.h"
 #include "../../../include/RendererBase.h"
+#include "../../../include/RawPipeWriter.h"
+#include "../../../include/RawVideoReader.h"
+#include "../../../include/RenditionWriter.h"
 #include "../../../include/Settings.h"
+#include "../../../include/SharedReader.h"
+#include "../../../include/ThumbnailGenerator.h"
 #include "../../../include/Timeline.h"
+#include "../../../include/Trace.h"
+#include "../../../include/ParallelExporter.h"
+#include "../../../include/StreamExporter.h"
+#include "../../../include/DistributedRender.h"
+#include "../../../include/FrameServer.h"
+#include "../../../include/ThreadTuner.h"
+#include "../../../include/ProxyManager.h"
 #include "../../../include/ZmqLogger.h"
 #include "../../../include/AudioDeviceInfo.h"
+#include "../../../include/AudioAnalyzer.h"
 
 %}
 
@@ -165,12 +182,202 @@
 	}
 }
 
+/* Export the pixels and audio samples of frames (through the Python buffer protocol), without copying them */
+%{
+	#include <cstring>
+	#include <stdexcept>
+
+	/* A buffer exporter, which keeps the owner of the buffer alive (i.e. a shallow clone of a frame) */
+	struct FrameBufferObject {
+		PyObject_HEAD
+		std::shared_ptr<void> *owner;
+		void *data;
+		const char *format;
+		Py_ssize_t itemsize;
+		int ndim;
+		Py_ssize_t shape[4];
+		Py_ssize_t strides[4];
+		bool readonly;
+	};
+
+	static int FrameBuffer_getbuffer(PyObject *exporter, Py_buffer *view, int flags) {
+		FrameBufferObject *self = (FrameBufferObject*) exporter;
+		view->obj = NULL;
+		if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE && self->readonly) {
+			PyErr_SetString(PyExc_BufferError, "The buffer of a frame is read-only (since it can be shared with other frames)");
+			return -1;
+		}
+
+		// A buffer with row padding (or planar channels) can only be exported with strides
+		Py_ssize_t length = self->itemsize;
+		Py_ssize_t contiguous_stride = self->itemsize;
+		bool contiguous = true;
+		for (int axis = self->ndim - 1; axis >= 0; axis--) {
+			contiguous = contiguous && self->strides[axis] == contiguous_stride;
+			contiguous_stride *= self->shape[axis];
+			length *= self->shape[axis];
+		}
+		if (!contiguous && (flags & PyBUF_STRIDES) != PyBUF_STRIDES) {
+			PyErr_SetString(PyExc_BufferError, "The buffer of a frame is not contiguous (request it with strides)");
+			return -1;
+		}
+
+		view->obj = exporter;
+		Py_INCREF(exporter);
+		view->buf = self->data;
+		view->len = length;
+		view->readonly = self->readonly ? 1 : 0;
+		view->itemsize = self->itemsize;
+		view->format = (flags & PyBUF_FORMAT) ? (char*) self->format : NULL;
+		view->ndim = self->ndim;
+		view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+		view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+		view->suboffsets = NULL;
+		view->internal = NULL;
+		return 0;
+	}
+
+	static void FrameBuffer_dealloc(PyObject *exporter) {
+		delete ((FrameBufferObject*) exporter)->owner;
+		Py_TYPE(exporter)->tp_free(exporter);
+	}
+
+	/* The type of the buffer exporters (created once) */
+	static PyTypeObject *FrameBuffer_type() {
+		static PyBufferProcs buffer_procs = { FrameBuffer_getbuffer, NULL };
+		static PyTypeObject type = { PyVarObject_HEAD_INIT(NULL, 0) };
+		if (!type.tp_name) {
+			type.tp_name = "openshot.FrameBuffer";
+			type.tp_doc = "The pixels or audio samples of an openshot.Frame (see memoryview)";
+			type.tp_basicsize = sizeof(FrameBufferObject);
+			type.tp_flags = Py_TPFLAGS_DEFAULT;
+			type.tp_dealloc = FrameBuffer_dealloc;
+			type.tp_as_buffer = &buffer_procs;
+			if (PyType_Ready(&type) < 0) {
+				type.tp_name = NULL;
+				return NULL;
+			}
+		}
+		return &type;
+	}
+
+	/* Create a memoryview of a buffer (kept alive by its owner, until the last view of it is released) */
+	static PyObject *FrameBuffer_view(std::shared_ptr<void> owner, void *data, bool readonly, const char *format,
+									  Py_ssize_t itemsize, int ndim, const Py_ssize_t *shape, const Py_ssize_t *strides) {
+		PyTypeObject *type = FrameBuffer_type();
+		if (!type)
+			return NULL;
+		FrameBufferObject *exporter = PyObject_New(FrameBufferObject, type);
+		if (!exporter)
+			return NULL;
+		exporter->owner = new std::shared_ptr<void>(owner);
+		exporter->data = data;
+		exporter->readonly = readonly;
+		exporter->format = format;
+		exporter->itemsize = itemsize;
+		exporter->ndim = ndim;
+		for (int axis = 0; axis < ndim; axis++) {
+			exporter->shape[axis] = shape[axis];
+			exporter->strides[axis] = strides[axis];
+		}
+		PyObject *view = PyMemoryView_FromObject((PyObject*) exporter);
+		Py_DECREF(exporter);
+		return view;
+	}
+
+	/* The size of each channel of a frame image (RGBA64 images have 16-bit channels) */
+	static Py_ssize_t FrameBuffer_channel_size(const QImage& image) {
+		return (image.depth() == 64) ? 2 : 1;
+	}
+%}
+
+%extend openshot::Frame {
+	/* Get the pixels (height x width x 4 channels, in the order of Frame.ImageFormat()), as a read-only memoryview */
+	PyObject* GetPixelBuffer() {
+		// Apply any deferred image first (so the clone doesn't load it again), and keep the pixels alive in a clone
+		$self->GetImage();
+		std::shared_ptr<openshot::Frame> clone = $self->ShallowClone();
+		std::shared_ptr<QImage> image = clone->GetImage();
+		if (!image)
+			throw std::runtime_error("The frame has no image");
+		Py_ssize_t channel_size = FrameBuffer_channel_size(*image);
+		Py_ssize_t shape[3] = { image->height(), image->width(), 4 };
+		Py_ssize_t strides[3] = { image->bytesPerLine(), 4 * channel_size, channel_size };
+		return FrameBuffer_view(clone, (void*) image->constBits(), true, (channel_size == 2) ? "H" : "B",
+								channel_size, 3, shape, strides);
+	}
+
+	/* Get the audio samples (channels x samples, as 32-bit floats), as a read-only memoryview */
+	PyObject* GetAudioBuffer() {
+		// The clone shares the samples (which are copied by the first change of this frame)
+		std::shared_ptr<openshot::Frame> clone = $self->ShallowClone();
+		openshot::AudioSamplesView samples = clone->GetAudioView();
+		if (samples.channel_count < 1)
+			throw std::runtime_error("The frame has no audio channels");
+		Py_ssize_t channel_stride = (samples.channel_count > 1) ? (samples.channels[1] - samples.channels[0]) * Py_ssize_t(sizeof(float)) : samples.sample_count * Py_ssize_t(sizeof(float));
+		for (int channel = 1; channel < samples.channel_count; channel++)
+			if ((samples.channels[channel] - samples.channels[channel - 1]) * Py_ssize_t(sizeof(float)) != channel_stride)
+				throw std::runtime_error("The audio channels of the frame are not evenly spaced");
+		Py_ssize_t shape[2] = { samples.channel_count, samples.sample_count };
+		Py_ssize_t strides[2] = { channel_stride, Py_ssize_t(sizeof(float)) };
+		return FrameBuffer_view(clone, (void*) samples.channels[0], true, "f", sizeof(float), 2, shape, strides);
+	}
+
+%pythoncode %{
+	def GetPixelArray(self):
+		"""Get the pixels as a read-only numpy array (height x width x 4), sharing the memory of the frame"""
+		import numpy
+		return numpy.asarray(self.GetPixelBuffer())
+
+	def GetAudioArray(self):
+		"""Get the audio samples as a read-only numpy array (channels x samples), sharing the memory of the frame"""
+		import numpy
+		return numpy.asarray(self.GetAudioBuffer())
+%}
+}
+
+%extend openshot::ReaderBase {
+	/* Get a batch of frames (i.e. rendered in one batch by a timeline), with their pixels copied into one
+	   contiguous memoryview (count x height x width x 4). All the frames must have the same image size. */
+	PyObject* GetFramesBuffer(int64_t start, int64_t count) {
+		std::vector<std::shared_ptr<openshot::Frame> > frames = $self->GetFrames(start, count);
+		if (frames.empty())
+			throw std::runtime_error("No frames were read");
+
+		std::shared_ptr<QImage> first_image = frames.front()->GetImage();
+		Py_ssize_t channel_size = FrameBuffer_channel_size(*first_image);
+		Py_ssize_t row_size = first_image->width() * 4 * channel_size;
+		Py_ssize_t frame_size = row_size * first_image->height();
+		std::shared_ptr<std::vector<unsigned char> > pixels = std::make_shared<std::vector<unsigned char> >(frame_size * frames.size());
+		for (size_t index = 0; index < frames.size(); index++) {
+			std::shared_ptr<QImage> image = frames[index]->GetImage();
+			if (image->size() != first_image->size() || image->depth() != first_image->depth())
+				throw std::runtime_error("The frames have different image sizes");
+			unsigned char *output = pixels->data() + index * frame_size;
+			for (int y = 0; y < image->height(); y++)
+				memcpy(output + y * row_size, image->constScanLine(y), row_size);
+		}
+
+		Py_ssize_t shape[4] = { Py_ssize_t(frames.size()), first_image->height(), first_image->width(), 4 };
+		Py_ssize_t strides[4] = { frame_size, row_size, 4 * channel_size, channel_size };
+		return FrameBuffer_view(pixels, pixels->data(), false, (channel_size == 2) ? "H" : "B", channel_size, 4, shape, strides);
+	}
+
+%pythoncode %{
+	def GetFramesArray(self, start, count):
+		"""Get a batch of frames as one contiguous numpy array (count x height x width x 4)"""
+		import numpy
+		return numpy.asarray(self.GetFramesBuffer(start, count))
+%}
+}
+
 %include "OpenShotVersion.h"
 %include "../../../include/ReaderBase.h"
 %include "../../../include/WriterBase.h"
 %include "../../../include/CacheBase.h"
 %include "../../../include/CacheDisk.h"
 %include "../../../include/CacheMemory.h"
+%include "../../../include/CacheTiered.h"
 %include "../../../include/ChannelLayouts.h"
 %include "../../../include/ChunkReader.h"
 %include "../../../include/ChunkWriter.h"
@@ -193,6 +400,8 @@
 %include "../../../include/Fraction.h"
 %include "../../../include/Frame.h"
 %include "../../../include/FrameMapper.h"
+%include "../../../include/ImageSequenceReader.h"
+%include "../../../include/ImageSequenceWriter.h"
 %include "../../../include/PlayerBase.h"
 %include "../../../include/Point.h"
 %include "../../../include/Profiles.h"
@@ -201,11 +410,30 @@
 %include "../../../include/QtPlayer.h"
 %include "../../../include/QtTextReader.h"
 %include "../../../include/KeyFrame.h"
+%include "../../../include/Metrics.h"
 %include "../../../include/RendererBase.h"
+%include "../../../include/RawPipeWriter.h"
+%include "../../../include/RawVideoReader.h"
+%include "../../../include/RenditionWriter.h"
 %include "../../../include/Settings.h"
+/* The streams of a shared media file are internal to SharedReader (and hold a mutex) */
+%ignore openshot::SharedStreams;
+%include "../../../include/SharedReader.h"
+%include "../../../include/ThumbnailGenerator.h"
 %include "../../../include/Timeline.h"
+%include "../../../include/Trace.h"
+%include "../../../include/ParallelExporter.h"
+%include "../../../include/StreamExporter.h"
+%include "../../../include/DistributedRender.h"
+/* The shared memory layout is for consumers in other processes (which read it with FrameServer.InfoJson()) */
+%ignore openshot::FrameServerHeader;
+%ignore openshot::FrameServerSlot;
+%include "../../../include/FrameServer.h"
+%include "../../../include/ThreadTuner.h"
+%include "../../../include/ProxyManager.h"
 %include "../../../include/ZmqLogger.h"
 %include "../../../include/AudioDeviceInfo.h"
+%include "../../../include/AudioAnalyzer.h"
 
 #ifdef USE_IMAGEMAGICK
 	%include "../../../include/ImageReader.h"
@@ -239,3 +467,6 @@
 %template(MappedFrameVector) std::vector<openshot::MappedFrame>;
 %template(MappedMetadata) std::map<std::string, std::string>;
 %template(AudioDeviceInfoVector) std::vector<openshot::AudioDeviceInfo>;
+%template(FrameNumberVector) std::vector<int64_t>;
+%template(IntVector) std::vector<int>;
+%template(FloatVector) std::vector<float>;
@@ -42,6 +42,7 @@
 %include "std_list.i"
 %include "std_vector.i"
 %include "std_map.i"
+%include <stdint.i>
 
 /* Unhandled STL Exception Handling */
 %include <std_except.i>
@@ -75,6 +76,7 @@ namespace std {
 #include "../../../include/CacheBase.h"
 #include "../../../include/CacheDisk.h"
 #include "../../../include/CacheMemory.h"
+#include "../../../include/CacheTiered.h"
 #include "../../../include/ChannelLayouts.h"
 #include "../../../include/ChunkReader.h"
 #include "../../../include/ChunkWriter.h"
@@ -93,6 +95,8 @@ namespace std {
 #include "../../../include/Fraction.h"
 #include "../../../include/Frame.h"
 #include "../../../include/FrameMapper.h"
+#include "../../../include/ImageSequenceReader.h"
+#include "../../../include/ImageSequenceWriter.h"
 #include "../../../include/PlayerBase.h"
 #include "../../../include/Point.h"
 #include "../../../include/Profiles.h"
@@ -101,11 +105,25 @@ namespace std {
 #include "../../../include/QtPlayer.h"
 #include "../../../include/QtTextReader.h"
 #include "../../../include/KeyFrame.h"
+#include "../../../include/Metrics.h"
 #include "../../../include/RendererBase.h"
+#include "../../../include/RawPipeWriter.h"
+#include "../../../include/RawVideoReader.h"
+#include "../../../include/RenditionWriter.h"
 #include "../../../include/Settings.h"
+#include "../../../include/SharedReader.h"
+#include "../../../include/ThumbnailGenerator.h"
 #include "../../../include/Timeline.h"
+#include "../../../include/Trace.h"
+#include "../../../include/ParallelExporter.h"
+#include "../../../include/StreamExporter.h"
+#include "../../../include/DistributedRender.h"
+#include "../../../include/FrameServer.h"
+#include "../../../include/ThreadTuner.h"
+#include "../../../include/ProxyManager.h"
 #include "../../../include/ZmqLogger.h"
 #include "../../../include/AudioDeviceInfo.h"
+#include "../../../include/AudioAnalyzer.h"
 
 /* Move FFmpeg's RSHIFT to FF_RSHIFT, if present */
 #ifdef RSHIFT
@@ -139,6 +157,7 @@ namespace std {
 %include "../../../include/CacheBase.h"
 %include "../../../include/CacheDisk.h"
 %include "../../../include/CacheMemory.h"
+%include "../../../include/CacheTiered.h"
 %include "../../../include/ChannelLayouts.h"
 %include "../../../include/ChunkReader.h"
 %include "../../../include/ChunkWriter.h"
@@ -182,6 +201,8 @@ namespace std {
 %include "../../../include/Fraction.h"
 %include "../../../include/Frame.h"
 %include "../../../include/FrameMapper.h"
+%include "../../../include/ImageSequenceReader.h"
+%include "../../../include/ImageSequenceWriter.h"
 %include "../../../include/PlayerBase.h"
 %include "../../../include/Point.h"
 %include "../../../include/Profiles.h"
@@ -190,11 +211,30 @@ namespace std {
 %include "../../../include/QtPlayer.h"
 %include "../../../include/QtTextReader.h"
 %include "../../../include/KeyFrame.h"
+%include "../../../include/Metrics.h"
 %include "../../../include/RendererBase.h"
+%include "../../../include/RawPipeWriter.h"
+%include "../../../include/RawVideoReader.h"
+%include "../../../include/RenditionWriter.h"
 %include "../../../include/Settings.h"
+/* The streams of a shared media file are internal to SharedReader (and hold a mutex) */
+%ignore openshot::SharedStreams;
+%include "../../../include/SharedReader.h"
+%include "../../../include/ThumbnailGenerator.h"
 %include "../../../include/Timeline.h"
+%include "../../../include/Trace.h"
+%include "../../../include/ParallelExporter.h"
+%include "../../../include/StreamExporter.h"
+%include "../../../include/DistributedRender.h"
+/* The shared memory layout is for consumers in other processes (which read it with FrameServer.InfoJson()) */
+%ignore openshot::FrameServerHeader;
+%ignore openshot::FrameServerSlot;
+%include "../../../include/FrameServer.h"
+%include "../../../include/ThreadTuner.h"
+%include "../../../include/ProxyManager.h"
 %include "../../../include/ZmqLogger.h"
 %include "../../../include/AudioDeviceInfo.h"
+%include "../../../include/AudioAnalyzer.h"
 
 #ifdef USE_IMAGEMAGICK
 	%include "../../../include/ImageReader.h"
@@ -229,3 +269,6 @@ namespace std {
 %template(MappedFrameVector) std::vector<openshot::MappedFrame>;
 %template(MappedMetadata) std::map<std::string, std::string>;
 %template(AudioDeviceInfoVector) std::vector<openshot::AudioDeviceInfo>;
+%template(FrameNumberVector) std::vector<int64_t>;
+%template(IntVector) std::vector<int>;
+%template(FloatVector) std::vector<float>;
@@ -64,12 +64,9 @@ void Bars::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Bars::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get the frame's image
-	std::shared_ptr<QImage> frame_image = frame->GetImage();
-
-	// Get bar color (and create small color image)
-	std::shared_ptr<QImage> tempColor = std::shared_ptr<QImage>(new QImage(frame_image->width(), 1, QImage::Format_RGBA8888));
-	tempColor->fill(QColor(QString::fromStdString(color.GetColorHex(frame_number))));
+	// Get bar color (the bars are opaque)
+	QRgb packed_color = color.GetRGBA(frame_number);
+	QColor bar_color(qRed(packed_color), qGreen(packed_color), qBlue(packed_color));
 
 	// Get current keyframe values
 	double left_value = left.GetValue(frame_number);
@@ -77,37 +74,25 @@ std::shared_ptr<Frame> Bars::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 	double right_value = right.GetValue(frame_number);
 	double bottom_value = bottom.GetValue(frame_number);
 
-	// Get pixel array pointer
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	unsigned char *color_pixels = (unsigned char *) tempColor->bits();
-
-	// Get pixels sizes of all bars
-	int top_bar_height = top_value * frame_image->height();
-	int bottom_bar_height = bottom_value * frame_image->height();
-	int left_bar_width = left_value * frame_image->width();
-	int right_bar_width = right_value * frame_image->width();
-
-	// Loop through rows
-	for (int row = 0; row < frame_image->height(); row++) {
-
-		// Top & Bottom Bar
-		if ((top_bar_height > 0.0 && row <= top_bar_height) || (bottom_bar_height > 0.0 && row >= frame_image->height() - bottom_bar_height)) {
-			memcpy(&pixels[row * frame_image->width() * 4], color_pixels, sizeof(char) * frame_image->width() * 4);
-		} else {
-			// Left Bar
-			if (left_bar_width > 0.0) {
-				memcpy(&pixels[row * frame_image->width() * 4], color_pixels, sizeof(char) * left_bar_width * 4);
-			}
-
-			// Right Bar
-			if (right_bar_width > 0.0) {
-				memcpy(&pixels[((row * frame_image->width()) + (frame_image->width() - right_bar_width)) * 4], color_pixels, sizeof(char) * right_bar_width * 4);
-			}
-		}
-	}
-
-	// Cleanup colors and arrays
-	tempColor.reset();
+	// Get pixels sizes of all bars (the top bar includes the row below its height)
+	int width = frame->GetWidth();
+	int height = frame->GetHeight();
+	int top_bar_height = top_value * height;
+	int bottom_bar_height = bottom_value * height;
+	int left_bar_width = left_value * width;
+	int right_bar_width = right_value * width;
+	int top_edge = (top_bar_height > 0) ? top_bar_height + 1 : 0;
+	int bottom_edge = (bottom_bar_height > 0) ? height - bottom_bar_height : height;
+
+	// The bars are kept as geometry of the frame (so the compositor fills them, without a pass over the pixels)
+	if (top_edge > 0)
+		frame->FillImageRect(QRect(0, 0, width, top_edge), bar_color);
+	if (bottom_edge < height)
+		frame->FillImageRect(QRect(0, bottom_edge, width, height - bottom_edge), bar_color);
+	if (left_bar_width > 0)
+		frame->FillImageRect(QRect(0, top_edge, left_bar_width, bottom_edge - top_edge), bar_color);
+	if (right_bar_width > 0)
+		frame->FillImageRect(QRect(width - right_bar_width, top_edge, right_bar_width, bottom_edge - top_edge), bar_color);
 
 	// return the modified frame
 	return frame;
@@ -117,7 +102,7 @@ std::shared_ptr<Frame> Bars::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 std::string Bars::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -141,13 +126,7 @@ void Bars::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -207,5 +186,5 @@ std::string Bars::PropertiesJSON(int64_t requested_frame) {
 	root["bottom"] = add_property_json("Bottom Size", bottom.GetValue(requested_frame), "float", "", &bottom, 0.0, 0.5, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
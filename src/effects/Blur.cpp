@@ -29,6 +29,12 @@
  */
 
 #include "../../include/effects/Blur.h"
+#include "../../include/ImageBufferPool.h"
+#include "../../include/TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 using namespace openshot;
 
@@ -67,195 +73,137 @@ std::shared_ptr<Frame> Blur::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 {
 	// Get the frame's image
 	std::shared_ptr<QImage> frame_image = frame->GetImage();
+	if (!frame_image)
+		return frame;
 
 	// Get the current blur radius
 	int horizontal_radius_value = horizontal_radius.GetValue(frame_number);
 	int vertical_radius_value = vertical_radius.GetValue(frame_number);
-	float sigma_value = sigma.GetValue(frame_number);
 	int iteration_value = iterations.GetInt(frame_number);
 
+	// Nothing to blur
+	if (iteration_value <= 0 || (horizontal_radius_value <= 0 && vertical_radius_value <= 0))
+		return frame;
 
-	// Declare arrays for each color channel
-	unsigned char *red = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *green = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *blue = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *alpha = new unsigned char[frame_image->width() * frame_image->height()]();
-	// Create empty target RGBA arrays (for the results of our blur)
-	unsigned char *blur_red = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *blur_green = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *blur_blue = new unsigned char[frame_image->width() * frame_image->height()]();
-	unsigned char *blur_alpha = new unsigned char[frame_image->width() * frame_image->height()]();
-
-	// Loop through pixels and split RGBA channels into separate arrays
+	int width = frame_image->width();
+	int height = frame_image->height();
+	int bytes_per_line = frame_image->bytesPerLine();
 	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGBA values from each pixel
-		unsigned char R = pixels[byte_index];
-		unsigned char G = pixels[byte_index + 1];
-		unsigned char B = pixels[byte_index + 2];
-		unsigned char A = pixels[byte_index + 3];
-
-		// Split channels into their own arrays
-		red[pixel] = R;
-		green[pixel] = G;
-		blue[pixel] = B;
-		alpha[pixel] = A;
-	}
 
-	// Init target RGBA arrays
-	for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blur_red[i] = red[i];
-	for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blur_green[i] = green[i];
-	for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blur_blue[i] = blue[i];
-	for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blur_alpha[i] = alpha[i];
+	// A single scratch image (recycled from the image buffer pool) holds the result of each pass
+	size_t scratch_size = (size_t) bytes_per_line * height;
+	unsigned char *scratch = ImageBufferPool::Instance()->Acquire(scratch_size);
+	std::vector<unsigned char> fallback_scratch;
+	if (!scratch) {
+		fallback_scratch.resize(scratch_size);
+		scratch = fallback_scratch.data();
+	}
 
 	// Loop through each iteration
 	for (int iteration = 0; iteration < iteration_value; iteration++)
 	{
-		// HORIZONTAL BLUR (if any)
-		if (horizontal_radius_value > 0.0) {
-			// Init boxes for computing blur
-			int *bxs = initBoxes(sigma_value, horizontal_radius_value);
-
-			// Apply horizontal blur to target RGBA channels
-			boxBlurH(red, blur_red, frame_image->width(), frame_image->height(), horizontal_radius_value);
-			boxBlurH(green, blur_green, frame_image->width(), frame_image->height(), horizontal_radius_value);
-			boxBlurH(blue, blur_blue, frame_image->width(), frame_image->height(), horizontal_radius_value);
-			boxBlurH(alpha, blur_alpha, frame_image->width(), frame_image->height(), horizontal_radius_value);
-
-			// Remove boxes
-			delete[] bxs;
-
-			// Copy blur_<chan> back to <chan> for vertical blur or next iteration
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) red[i] = blur_red[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) green[i] = blur_green[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blue[i] = blur_blue[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) alpha[i] = blur_alpha[i];
+		if (horizontal_radius_value > 0 && vertical_radius_value > 0) {
+			// Blur the rows into the scratch image, and the columns back into the frame's image
+			boxBlurH(pixels, scratch, width, height, bytes_per_line, horizontal_radius_value);
+			boxBlurT(scratch, pixels, width, height, bytes_per_line, vertical_radius_value);
 		}
-
-		// VERTICAL BLUR (if any)
-		if (vertical_radius_value > 0.0) {
-			// Init boxes for computing blur
-			int *bxs = initBoxes(sigma_value, vertical_radius_value);
-
-			// Apply vertical blur to target RGBA channels
-			boxBlurT(red, blur_red, frame_image->width(), frame_image->height(), vertical_radius_value);
-			boxBlurT(green, blur_green, frame_image->width(), frame_image->height(), vertical_radius_value);
-			boxBlurT(blue, blur_blue, frame_image->width(), frame_image->height(), vertical_radius_value);
-			boxBlurT(alpha, blur_alpha, frame_image->width(), frame_image->height(), vertical_radius_value);
-
-			// Remove boxes
-			delete[] bxs;
-
-			// Copy blur_<chan> back to <chan> for vertical blur or next iteration
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) red[i] = blur_red[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) green[i] = blur_green[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) blue[i] = blur_blue[i];
-			for (int i = 0; i < (frame_image->width() * frame_image->height()); i++) alpha[i] = blur_alpha[i];
+		else {
+			// HORIZONTAL or VERTICAL BLUR (into the scratch image, and copied back)
+			if (horizontal_radius_value > 0)
+				boxBlurH(pixels, scratch, width, height, bytes_per_line, horizontal_radius_value);
+			else
+				boxBlurT(pixels, scratch, width, height, bytes_per_line, vertical_radius_value);
+			memcpy(pixels, scratch, scratch_size);
 		}
 	}
 
-	// Copy RGBA channels back to original image
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGB values from the pixel
-		unsigned char R = blur_red[pixel];
-		unsigned char G = blur_green[pixel];
-		unsigned char B = blur_blue[pixel];
-		unsigned char A = blur_alpha[pixel];
-
-		// Split channels into their own arrays
-		pixels[byte_index] = R;
-		pixels[byte_index + 1] = G;
-		pixels[byte_index + 2] = B;
-		pixels[byte_index + 3] = A;
-	}
-
-	// Delete channel arrays
-	delete[] red;
-	delete[] green;
-	delete[] blue;
-	delete[] alpha;
-	delete[] blur_red;
-	delete[] blur_green;
-	delete[] blur_blue;
-	delete[] blur_alpha;
+	// Return the scratch image to the pool
+	if (fallback_scratch.empty())
+		ImageBufferPool::Instance()->Release(scratch);
 
 	// return the modified frame
 	return frame;
 }
 
 // Credit: http://blog.ivank.net/fastest-gaussian-blur.html (MIT License)
-int* Blur::initBoxes(float sigma, int n)  // standard deviation, number of boxes
-{
-	float wIdeal = sqrt((12.0 * sigma * sigma / n) + 1.0);  // Ideal averaging filter width
-	int wl = floor(wIdeal);
-	if (wl % 2 == 0) wl--;
-	int wu = wl + 2;
-
-	float mIdeal = (12.0 * sigma * sigma - n * wl * wl - 4 * n * wl - 3 * n) / (-4.0 * wl - 4);
-	int m = round(mIdeal);
-
-	int *sizes = new int[n]();
-	for (int i = 0; i < n; i++) sizes[i] = i < m ? wl : wu;
-	return sizes;
-}
-
-// Credit: http://blog.ivank.net/fastest-gaussian-blur.html (MIT License)
-void Blur::boxBlurH(unsigned char *scl, unsigned char *tcl, int w, int h, int r) {
-	float iarr = 1.0 / (r + r + 1);
-	for (int i = 0; i < h; i++) {
-		int ti = i * w, li = ti, ri = ti + r;
-		int fv = scl[ti], lv = scl[ti + w - 1], val = (r + 1) * fv;
-		for (int j = 0; j < r; j++) val += scl[ti + j];
-		for (int j = 0; j <= r; j++) {
-			val += scl[ri++] - fv;
-			tcl[ti++] = round(val * iarr);
-		}
-		for (int j = r + 1; j < w - r; j++) {
-			val += scl[ri++] - scl[li++];
-			tcl[ti++] = round(val * iarr);
-		}
-		for (int j = w - r; j < w; j++) {
-			val += lv - scl[li++];
-			tcl[ti++] = round(val * iarr);
+// Blur each row of RGBA pixels with a sliding box (edge pixels are repeated past the edges)
+void Blur::boxBlurH(const unsigned char *source, unsigned char *target, int w, int h, int bytes_per_line, int r) {
+	// Rounded division by the box size, as a fixed point multiplication
+	const int box = r + r + 1;
+	const uint64_t scale = ((uint64_t(1) << 40) + box - 1) / box;
+
+	// Split the rows into bands (one task each)
+	int bands = std::min(h, TaskPool::Current()->NumThreads() * 4);
+	int band_height = (h + bands - 1) / bands;
+	TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+	{
+		int last_row = std::min(h, (int) (band + 1) * band_height);
+		for (int y = band * band_height; y < last_row; y++) {
+			const unsigned char *src = source + (size_t) y * bytes_per_line;
+			unsigned char *dst = target + (size_t) y * bytes_per_line;
+
+			// Sum the box around the first pixel
+			int val[4];
+			for (int c = 0; c < 4; c++) {
+				val[c] = (r + 1) * src[c];
+				for (int j = 1; j <= r; j++)
+					val[c] += src[std::min(j, w - 1) * 4 + c];
+			}
+
+			// Slide the box along the row
+			for (int x = 0; x < w; x++) {
+				const unsigned char *add = src + std::min(x + r + 1, w - 1) * 4;
+				const unsigned char *remove = src + std::max(x - r, 0) * 4;
+				for (int c = 0; c < 4; c++) {
+					dst[x * 4 + c] = ((val[c] + r) * scale) >> 40;
+					val[c] += add[c] - remove[c];
+				}
+			}
 		}
-	}
+	});
 }
 
-void Blur::boxBlurT(unsigned char *scl, unsigned char *tcl, int w, int h, int r) {
-	float iarr = 1.0 / (r + r + 1);
-	for (int i = 0; i < w; i++) {
-		int ti = i, li = ti, ri = ti + r * w;
-		int fv = scl[ti], lv = scl[ti + w * (h - 1)], val = (r + 1) * fv;
-		for (int j = 0; j < r; j++) val += scl[ti + j * w];
-		for (int j = 0; j <= r; j++) {
-			val += scl[ri] - fv;
-			tcl[ti] = round(val * iarr);
-			ri += w;
-			ti += w;
-		}
-		for (int j = r + 1; j < h - r; j++) {
-			val += scl[ri] - scl[li];
-			tcl[ti] = round(val * iarr);
-			li += w;
-			ri += w;
-			ti += w;
+// Blur each column of RGBA pixels with a sliding box (edge pixels are repeated past the edges)
+void Blur::boxBlurT(const unsigned char *source, unsigned char *target, int w, int h, int bytes_per_line, int r) {
+	// Rounded division by the box size, as a fixed point multiplication
+	const int box = r + r + 1;
+	const uint64_t scale = ((uint64_t(1) << 40) + box - 1) / box;
+
+	// Split the columns into strips of 64 pixels (one task each), which slide down the rows
+	// together, so each step reads a few contiguous runs of memory
+	const int strip_width = 64;
+	int strips = (w + strip_width - 1) / strip_width;
+	TaskPool::Current()->ParallelFor(0, strips, [&](int64_t strip)
+	{
+		int first_byte = strip * strip_width * 4;
+		int strip_bytes = std::min(strip_width, w - (int) strip * strip_width) * 4;
+		int val[strip_width * 4];
+
+		// Sum the box around the pixels of the first row
+		for (int i = 0; i < strip_bytes; i++) {
+			val[i] = (r + 1) * source[first_byte + i];
+			for (int j = 1; j <= r; j++)
+				val[i] += source[(size_t) std::min(j, h - 1) * bytes_per_line + first_byte + i];
 		}
-		for (int j = h - r; j < h; j++) {
-			val += lv - scl[li];
-			tcl[ti] = round(val * iarr);
-			li += w;
-			ti += w;
+
+		// Slide the boxes down the columns
+		for (int y = 0; y < h; y++) {
+			unsigned char *dst = target + (size_t) y * bytes_per_line + first_byte;
+			const unsigned char *add = source + (size_t) std::min(y + r + 1, h - 1) * bytes_per_line + first_byte;
+			const unsigned char *remove = source + (size_t) std::max(y - r, 0) * bytes_per_line + first_byte;
+			for (int i = 0; i < strip_bytes; i++) {
+				dst[i] = ((val[i] + r) * scale) >> 40;
+				val[i] += add[i] - remove[i];
+			}
 		}
-	}
+	});
 }
 
 // Generate JSON string of this object
 std::string Blur::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -278,13 +226,7 @@ void Blur::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -338,5 +280,5 @@ std::string Blur::PropertiesJSON(int64_t requested_frame) {
 	root["iterations"] = add_property_json("Iterations", iterations.GetValue(requested_frame), "float", "", &iterations, 0, 100, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -63,55 +63,45 @@ void Brightness::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Brightness::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get the frame's image
-	std::shared_ptr<QImage> frame_image = frame->GetImage();
+	// Adjust the contrast and brightness of all pixels
+	ApplyPixelKernels(frame, std::vector<PixelKernel>(1, GetPixelKernel(frame_number)));
 
+	// return the modified frame
+	return frame;
+}
+
+// Get the point-wise kernel of this effect (for the keyframe values of a frame)
+EffectBase::PixelKernel Brightness::GetPixelKernel(int64_t frame_number)
+{
 	// Get keyframe values for this frame
 	float brightness_value = brightness.GetValue(frame_number);
 	float contrast_value = contrast.GetValue(frame_number);
 
-	// Loop through pixels
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGB values from the pixel
-		int R = pixels[byte_index];
-		int G = pixels[byte_index + 1];
-		int B = pixels[byte_index + 2];
-		int A = pixels[byte_index + 3];
-
-		// Adjust the contrast
-		float factor = (259 * (contrast_value + 255)) / (255 * (259 - contrast_value));
-		R = constrain((factor * (R - 128)) + 128);
-		G = constrain((factor * (G - 128)) + 128);
-		B = constrain((factor * (B - 128)) + 128);
-
-		// Adjust the brightness
-		R += (255 * brightness_value);
-		G += (255 * brightness_value);
-		B += (255 * brightness_value);
-
-		// Constrain the value from 0 to 255
-		R = constrain(R);
-		G = constrain(G);
-		B = constrain(B);
-
-		// Set all pixels to new value
-		pixels[byte_index] = R;
-		pixels[byte_index + 1] = G;
-		pixels[byte_index + 2] = B;
-		pixels[byte_index + 3] = A; // leave the alpha value alone
-	}
+	return [brightness_value, contrast_value](unsigned char *pixels, int64_t pixel_count) {
+		PixelKernels::Brightness(pixels, pixel_count, brightness_value, contrast_value);
+	};
+}
 
-	// return the modified frame
-	return frame;
+// Get the GPU kernel of this effect (the same transform as its pixel kernel)
+EffectBase::GpuKernel Brightness::GetGpuKernel(int64_t frame_number)
+{
+	// Calculate the contrast factor, and the brightness offset (see PixelKernels::Brightness)
+	float brightness_value = brightness.GetValue(frame_number);
+	float contrast_value = contrast.GetValue(frame_number);
+	float factor = (259 * (contrast_value + 255)) / (255 * (259 - contrast_value));
+	float offset = 255 * brightness_value;
+
+	GpuKernel kernel;
+	kernel.source = "color.rgb = clamp_color(clamp_color(P(0) * (color.rgb - 128.0) + 128.0) + P(1));";
+	kernel.parameters = {factor, offset};
+	return kernel;
 }
 
 // Generate JSON string of this object
 std::string Brightness::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -132,13 +122,7 @@ void Brightness::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -186,5 +170,5 @@ std::string Brightness::PropertiesJSON(int64_t requested_frame) {
 	root["contrast"] = add_property_json("Contrast", contrast.GetValue(requested_frame), "float", "", &contrast, 0.0, 100.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -29,11 +29,12 @@
  */
 
 #include "../../include/effects/ChromaKey.h"
+#include <algorithm>
 
 using namespace openshot;
 
 /// Blank constructor, useful when using Json to load the effect properties
-ChromaKey::ChromaKey() : fuzz(5.0) {
+ChromaKey::ChromaKey() : fuzz(5.0), softness(0.0), spill(0.0), chroma_distance(false) {
 	// Init default color
 	color = Color();
 
@@ -44,7 +45,15 @@ ChromaKey::ChromaKey() : fuzz(5.0) {
 // Default constructor, which takes an openshot::Color object and a 'fuzz' factor, which
 // is used to determine how similar colored pixels are matched. The higher the fuzz, the
 // more colors are matched.
-ChromaKey::ChromaKey(Color color, Keyframe fuzz) : color(color), fuzz(fuzz)
+ChromaKey::ChromaKey(Color color, Keyframe fuzz) : color(color), fuzz(fuzz), softness(0.0), spill(0.0), chroma_distance(false)
+{
+	// Init effect properties
+	init_effect_details();
+}
+
+// Constructor with a soft edge and spill suppression (and the chroma or RGB distance)
+ChromaKey::ChromaKey(Color color, Keyframe fuzz, Keyframe softness, Keyframe spill, bool chroma_distance) :
+	color(color), fuzz(fuzz), softness(softness), spill(spill), chroma_distance(chroma_distance)
 {
 	// Init effect properties
 	init_effect_details();
@@ -67,44 +76,70 @@ void ChromaKey::init_effect_details()
 // This method is required for all derived classes of EffectBase, and returns a
 // modified openshot::Frame object
 std::shared_ptr<Frame> ChromaKey::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
+{
+	// Alpha out all pixels with a similar color (within the fuzz distance)
+	ApplyPixelKernels(frame, std::vector<PixelKernel>(1, GetPixelKernel(frame_number)));
+
+	// return the modified frame
+	return frame;
+}
+
+// Get the point-wise kernel of this effect (for the keyframe values of a frame)
+EffectBase::PixelKernel ChromaKey::GetPixelKernel(int64_t frame_number)
 {
 	// Determine the current HSL (Hue, Saturation, Lightness) for the Chrome
 	int threshold = fuzz.GetInt(frame_number);
-	long mask_R = color.red.GetInt(frame_number);
-	long mask_G = color.green.GetInt(frame_number);
-	long mask_B = color.blue.GetInt(frame_number);
-
-	// Get source image's pixels
-	std::shared_ptr<QImage> image = frame->GetImage();
-	unsigned char *pixels = (unsigned char *) image->bits();
+	int mask_R = color.red.GetInt(frame_number);
+	int mask_G = color.green.GetInt(frame_number);
+	int mask_B = color.blue.GetInt(frame_number);
+	float edge = softness.GetValue(frame_number);
+	float spill_amount = spill.GetValue(frame_number);
+	bool use_chroma = chroma_distance;
+
+	// A hard RGB key (without spill suppression) uses the integer kernel
+	if (!use_chroma && edge <= 0.0 && spill_amount <= 0.0)
+		return [mask_R, mask_G, mask_B, threshold](unsigned char *pixels, int64_t pixel_count) {
+			PixelKernels::ChromaKey(pixels, pixel_count, mask_R, mask_G, mask_B, threshold);
+		};
+
+	// Soft edge and spill suppression (in a single pass)
+	return [mask_R, mask_G, mask_B, use_chroma, threshold, edge, spill_amount](unsigned char *pixels, int64_t pixel_count) {
+		PixelKernels::SoftChromaKey(pixels, pixel_count, mask_R, mask_G, mask_B, use_chroma, threshold, edge, spill_amount);
+	};
+}
 
-	// Loop through pixels
-	for (int pixel = 0, byte_index=0; pixel < image->width() * image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGB values from the pixel
-		unsigned char R = pixels[byte_index];
-		unsigned char G = pixels[byte_index + 1];
-		unsigned char B = pixels[byte_index + 2];
-		unsigned char A = pixels[byte_index + 3];
-
-		// Get distance between mask color and pixel color
-		long distance = Color::GetDistance((long)R, (long)G, (long)B, mask_R, mask_G, mask_B);
-
-		// Alpha out the pixel (if color similar)
-		if (distance <= threshold)
-			// MATCHED - Make pixel transparent
-			pixels[byte_index + 3] = 0;
-	}
+// Get the GPU kernel of this effect (only for a hard RGB key, the soft key is applied on the CPU)
+EffectBase::GpuKernel ChromaKey::GetGpuKernel(int64_t frame_number)
+{
+	GpuKernel kernel;
+	if (chroma_distance || softness.GetValue(frame_number) > 0.0 || spill.GetValue(frame_number) > 0.0)
+		return kernel;
 
-	// return the modified frame
-	return frame;
+	// The mask color, and the limit of the squared distance (see PixelKernels::ChromaKey)
+	int threshold = fuzz.GetInt(frame_number);
+	int limit = 0;
+	if (threshold >= 0)
+		limit = (std::min(threshold, 1023) + 1) * (std::min(threshold, 1023) + 1);
+	float mask_R = std::max(0, std::min(255, color.red.GetInt(frame_number)));
+	float mask_G = std::max(0, std::min(255, color.green.GetInt(frame_number)));
+	float mask_B = std::max(0, std::min(255, color.blue.GetInt(frame_number)));
+
+	kernel.source = "ivec3 pixel_color = ivec3(color.rgb);"
+					"ivec3 mask = ivec3(P(0), P(1), P(2));"
+					"int rmean = (pixel_color.r + mask.r) / 2;"
+					"ivec3 difference = pixel_color - mask;"
+					"int key_distance = (((512 + rmean) * difference.r * difference.r) >> 8) + 4 * difference.g * difference.g +"
+					"               (((767 - rmean) * difference.b * difference.b) >> 8);"
+					"if (key_distance < int(P(3))) color.a = 0.0;";
+	kernel.parameters = {mask_R, mask_G, mask_B, (float) limit};
+	return kernel;
 }
 
 // Generate JSON string of this object
 std::string ChromaKey::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -115,6 +150,9 @@ Json::Value ChromaKey::JsonValue() {
 	root["type"] = info.class_name;
 	root["color"] = color.JsonValue();
 	root["fuzz"] = fuzz.JsonValue();
+	root["softness"] = softness.JsonValue();
+	root["spill"] = spill.JsonValue();
+	root["chroma_distance"] = chroma_distance;
 
 	// return JsonValue
 	return root;
@@ -125,13 +163,7 @@ void ChromaKey::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -160,6 +192,12 @@ void ChromaKey::SetJsonValue(Json::Value root) {
 		color.SetJsonValue(root["color"]);
 	if (!root["fuzz"].isNull())
 		fuzz.SetJsonValue(root["fuzz"]);
+	if (!root["softness"].isNull())
+		softness.SetJsonValue(root["softness"]);
+	if (!root["spill"].isNull())
+		spill.SetJsonValue(root["spill"]);
+	if (!root["chroma_distance"].isNull())
+		chroma_distance = root["chroma_distance"].asBool();
 }
 
 // Get all properties for a specific frame
@@ -180,7 +218,14 @@ std::string ChromaKey::PropertiesJSON(int64_t requested_frame) {
 	root["color"]["blue"] = add_property_json("Blue", color.blue.GetValue(requested_frame), "float", "", &color.blue, 0, 255, false, requested_frame);
 	root["color"]["green"] = add_property_json("Green", color.green.GetValue(requested_frame), "float", "", &color.green, 0, 255, false, requested_frame);
 	root["fuzz"] = add_property_json("Fuzz", fuzz.GetValue(requested_frame), "float", "", &fuzz, 0, 25, false, requested_frame);
+	root["softness"] = add_property_json("Softness", softness.GetValue(requested_frame), "float", "", &softness, 0, 100, false, requested_frame);
+	root["spill"] = add_property_json("Spill Suppression", spill.GetValue(requested_frame), "float", "", &spill, 0, 1, false, requested_frame);
+	root["chroma_distance"] = add_property_json("Match Chroma Only", chroma_distance, "bool", "", NULL, 0, 1, false, requested_frame);
+
+	// Add Match Chroma Only choices (dropdown style)
+	root["chroma_distance"]["choices"].append(add_property_choice_json("Yes", true, chroma_distance));
+	root["chroma_distance"]["choices"].append(add_property_choice_json("No", false, chroma_distance));
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -64,50 +64,24 @@ void Crop::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Crop::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get the frame's image
-	std::shared_ptr<QImage> frame_image = frame->GetImage();
-
-	// Get transparent color (and create small transparent image)
-	std::shared_ptr<QImage> tempColor = std::shared_ptr<QImage>(new QImage(frame_image->width(), 1, QImage::Format_RGBA8888));
-	tempColor->fill(QColor(QString::fromStdString("transparent")));
-
 	// Get current keyframe values
 	double left_value = left.GetValue(frame_number);
 	double top_value = top.GetValue(frame_number);
 	double right_value = right.GetValue(frame_number);
 	double bottom_value = bottom.GetValue(frame_number);
 
-	// Get pixel array pointers
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	unsigned char *color_pixels = (unsigned char *) tempColor->bits();
-
-	// Get pixels sizes of all crop sides
-	int top_bar_height = top_value * frame_image->height();
-	int bottom_bar_height = bottom_value * frame_image->height();
-	int left_bar_width = left_value * frame_image->width();
-	int right_bar_width = right_value * frame_image->width();
-
-	// Loop through rows
-	for (int row = 0; row < frame_image->height(); row++) {
-
-		// Top & Bottom Crop
-		if ((top_bar_height > 0.0 && row <= top_bar_height) || (bottom_bar_height > 0.0 && row >= frame_image->height() - bottom_bar_height)) {
-			memcpy(&pixels[row * frame_image->width() * 4], color_pixels, sizeof(char) * frame_image->width() * 4);
-		} else {
-			// Left Crop
-			if (left_bar_width > 0.0) {
-				memcpy(&pixels[row * frame_image->width() * 4], color_pixels, sizeof(char) * left_bar_width * 4);
-			}
-
-			// Right Crop
-			if (right_bar_width > 0.0) {
-				memcpy(&pixels[((row * frame_image->width()) + (frame_image->width() - right_bar_width)) * 4], color_pixels, sizeof(char) * right_bar_width * 4);
-			}
-		}
-	}
+	// Get pixels sizes of all crop sides (the top crop includes the row below its height)
+	int width = frame->GetWidth();
+	int height = frame->GetHeight();
+	int top_bar_height = top_value * height;
+	int bottom_bar_height = bottom_value * height;
+	int left_bar_width = left_value * width;
+	int right_bar_width = right_value * width;
+	int top_edge = (top_bar_height > 0) ? top_bar_height + 1 : 0;
+	int bottom_edge = (bottom_bar_height > 0) ? height - bottom_bar_height : height;
 
-	// Cleanup colors and arrays
-	tempColor.reset();
+	// The crop is kept as geometry of the frame (so the compositor skips the cropped pixels, without a pass over them)
+	frame->ClipImage(QRect(left_bar_width, top_edge, width - left_bar_width - right_bar_width, bottom_edge - top_edge));
 
 	// return the modified frame
 	return frame;
@@ -117,7 +91,7 @@ std::shared_ptr<Frame> Crop::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 std::string Crop::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -140,13 +114,7 @@ void Crop::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-	                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -200,5 +168,5 @@ std::string Crop::PropertiesJSON(int64_t requested_frame) {
 	root["bottom"] = add_property_json("Bottom Size", bottom.GetValue(requested_frame), "float", "", &bottom, 0.0, 1.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -33,14 +33,14 @@
 using namespace openshot;
 
 /// Blank constructor, useful when using Json to load the effect properties
-Deinterlace::Deinterlace() : isOdd(true)
+Deinterlace::Deinterlace() : isOdd(true), interpolate(false)
 {
 	// Init effect properties
 	init_effect_details();
 }
 
 // Default constructor
-Deinterlace::Deinterlace(bool UseOddLines) : isOdd(UseOddLines)
+Deinterlace::Deinterlace(bool UseOddLines, bool interpolate) : isOdd(UseOddLines), interpolate(interpolate)
 {
 	// Init effect properties
 	init_effect_details();
@@ -64,32 +64,11 @@ void Deinterlace::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Deinterlace::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get original size of frame's image
-	int original_width = frame->GetImage()->width();
-	int original_height = frame->GetImage()->height();
-
 	// Get the frame's image
 	std::shared_ptr<QImage> image = frame->GetImage();
-	const unsigned char* pixels = image->bits();
-
-	// Create a smaller, new image
-	QImage deinterlaced_image(image->width(), image->height() / 2, QImage::Format_RGBA8888);
-	const unsigned char* deinterlaced_pixels = deinterlaced_image.bits();
-
-	// Loop through the scanlines of the image (even or odd)
-	int start = 0;
-	if (isOdd)
-		start = 1;
-	for (int row = start; row < image->height(); row += 2) {
-		memcpy((unsigned char*)deinterlaced_pixels, pixels + (row * image->bytesPerLine()), image->bytesPerLine());
-		deinterlaced_pixels += image->bytesPerLine();
-	}
-
-	// Resize deinterlaced image back to original size, and update frame's image
-	image = std::shared_ptr<QImage>(new QImage(deinterlaced_image.scaled(original_width, original_height, Qt::IgnoreAspectRatio, Qt::FastTransformation)));
 
-	// Update image on frame
-	frame->AddImage(image);
+	// Replace the lines of the other field (in place)
+	FieldKernels::Deinterlace(image->bits(), image->bytesPerLine(), image->height(), image->width() * 4, isOdd, interpolate);
 
 	// return the modified frame
 	return frame;
@@ -99,7 +78,7 @@ std::shared_ptr<Frame> Deinterlace::GetFrame(std::shared_ptr<Frame> frame, int64
 std::string Deinterlace::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -109,6 +88,7 @@ Json::Value Deinterlace::JsonValue() {
 	Json::Value root = EffectBase::JsonValue(); // get parent properties
 	root["type"] = info.class_name;
 	root["isOdd"] = isOdd;
+	root["interpolate"] = interpolate;
 
 	// return JsonValue
 	return root;
@@ -119,13 +99,7 @@ void Deinterlace::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -152,6 +126,8 @@ void Deinterlace::SetJsonValue(Json::Value root) {
 	// Set data from Json (if key is found)
 	if (!root["isOdd"].isNull())
 		isOdd = root["isOdd"].asBool();
+	if (!root["interpolate"].isNull())
+		interpolate = root["interpolate"].asBool();
 }
 
 // Get all properties for a specific frame
@@ -170,7 +146,12 @@ std::string Deinterlace::PropertiesJSON(int64_t requested_frame) {
 	// Add Is Odd Frame choices (dropdown style)
 	root["isOdd"]["choices"].append(add_property_choice_json("Yes", true, isOdd));
 	root["isOdd"]["choices"].append(add_property_choice_json("No", false, isOdd));
+	root["interpolate"] = add_property_json("Interpolate Lines", interpolate, "bool", "", NULL, 0, 1, false, requested_frame);
+
+	// Add Interpolate Lines choices (dropdown style)
+	root["interpolate"]["choices"].append(add_property_choice_json("Yes", true, interpolate));
+	root["interpolate"]["choices"].append(add_property_choice_json("No", false, interpolate));
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
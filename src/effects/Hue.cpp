@@ -63,50 +63,60 @@ void Hue::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Hue::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get the frame's image
-	std::shared_ptr<QImage> frame_image = frame->GetImage();
+	// Multiply all pixels by the hue rotation matrix
+	ApplyPixelKernels(frame, std::vector<PixelKernel>(1, GetPixelKernel(frame_number)));
 
-	// Get the current hue percentage shift amount, and convert to degrees
-	double degrees = 360.0 * hue.GetValue(frame_number);
+	// return the modified frame
+	return frame;
+}
+
+// Calculate a rotation matrix for the RGB colorspace (based on the hue shift keyframe value of a frame)
+static void hue_matrix(double hue_value, float matrix[3][3])
+{
+	// Convert the hue percentage shift amount to degrees
+	double degrees = 360.0 * hue_value;
 	float cosA = cos(degrees*3.14159265f/180);
 	float sinA = sin(degrees*3.14159265f/180);
 
-	// Calculate a rotation matrix for the RGB colorspace (based on the current hue shift keyframe value)
-	float matrix[3][3] = {{cosA + (1.0f - cosA) / 3.0f, 1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA, 1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA},
-						  {1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA, cosA + 1.0f/3.0f*(1.0f - cosA), 1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA},
-						  {1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA, 1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA, cosA + 1.0f/3.0f * (1.0f - cosA)}};
+	float rotation[3][3] = {{cosA + (1.0f - cosA) / 3.0f, 1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA, 1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA},
+							{1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA, cosA + 1.0f/3.0f*(1.0f - cosA), 1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA},
+							{1.0f/3.0f * (1.0f - cosA) - sqrtf(1.0f/3.0f) * sinA, 1.0f/3.0f * (1.0f - cosA) + sqrtf(1.0f/3.0f) * sinA, cosA + 1.0f/3.0f * (1.0f - cosA)}};
+	for (int row = 0; row < 3; row++)
+		for (int column = 0; column < 3; column++)
+			matrix[row][column] = rotation[row][column];
+}
 
-	// Loop through pixels
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGB values from the pixel
-		int R = pixels[byte_index];
-		int G = pixels[byte_index + 1];
-		int B = pixels[byte_index + 2];
-		int A = pixels[byte_index + 3];
-
-		// Multiply each color by the hue rotation matrix
-		float rx = constrain(R * matrix[0][0] + G * matrix[0][1] + B * matrix[0][2]);
-		float gx = constrain(R * matrix[1][0] + G * matrix[1][1] + B * matrix[1][2]);
-		float bx = constrain(R * matrix[2][0] + G * matrix[2][1] + B * matrix[2][2]);
-
-		// Set all pixels to new value
-		pixels[byte_index] = rx;
-		pixels[byte_index + 1] = gx;
-		pixels[byte_index + 2] = bx;
-		pixels[byte_index + 3] = A; // leave the alpha value alone
-	}
+// Get the point-wise kernel of this effect (for the keyframe values of a frame)
+EffectBase::PixelKernel Hue::GetPixelKernel(int64_t frame_number)
+{
+	float matrix[3][3];
+	hue_matrix(hue.GetValue(frame_number), matrix);
 
-	// return the modified frame
-	return frame;
+	return [matrix](unsigned char *pixels, int64_t pixel_count) {
+		PixelKernels::Hue(pixels, pixel_count, matrix);
+	};
+}
+
+// Get the GPU kernel of this effect (the same transform as its pixel kernel)
+EffectBase::GpuKernel Hue::GetGpuKernel(int64_t frame_number)
+{
+	float matrix[3][3];
+	hue_matrix(hue.GetValue(frame_number), matrix);
+
+	GpuKernel kernel;
+	kernel.source = "vec3 rgb = color.rgb;"
+					"color.r = clamp_color(dot(vec3(P(0), P(1), P(2)), rgb));"
+					"color.g = clamp_color(dot(vec3(P(3), P(4), P(5)), rgb));"
+					"color.b = clamp_color(dot(vec3(P(6), P(7), P(8)), rgb));";
+	kernel.parameters.assign(&matrix[0][0], &matrix[0][0] + 9);
+	return kernel;
 }
 
 // Generate JSON string of this object
 std::string Hue::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -126,13 +136,7 @@ void Hue::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -177,5 +181,5 @@ std::string Hue::PropertiesJSON(int64_t requested_frame) {
 	root["hue"] = add_property_json("Hue", hue.GetValue(requested_frame), "float", "", &hue, 0.0, 1.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
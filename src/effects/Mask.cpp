@@ -29,18 +29,53 @@
  */
 
 #include "../../include/effects/Mask.h"
+#include "../../include/PixelLayout.h"
+#include <algorithm>
 
 using namespace openshot;
 
+namespace {
+	// Apply the adjusted gray values of a mask to an image (in the pixel format of the image)
+	struct ApplyMask {
+		QImage *image;
+		const unsigned char *mask_gray;
+		const unsigned char *adjusted_gray;
+		bool replace_image;
+
+		template<class Format> void operator()(Format) {
+			typename Format::Channel *pixels = Format::Pixels(*image);
+			int64_t stride = Format::LineStride(*image);
+			int width = image->width();
+			for (int row = 0; row < image->height(); row++) {
+				typename Format::Channel *line = pixels + row * stride;
+				const unsigned char *gray = mask_gray + (int64_t) row * width;
+				if (replace_image) {
+					// Replace frame pixels with gray value
+					for (int column = 0; column < width; column++) {
+						int gray_value = Format::FromByte(adjusted_gray[gray[column]]);
+						Format::SetColor(line + column * 4, gray_value, gray_value, gray_value);
+					}
+				} else {
+					// Set alpha channel
+					for (int column = 0; column < width; column++) {
+						typename Format::Channel *pixel = line + column * 4;
+						Format::SetAlpha(pixel, std::max(0, (int) pixel[Format::alpha] - (int) Format::FromByte(adjusted_gray[gray[column]])));
+					}
+				}
+			}
+		}
+	};
+}
+
 /// Blank constructor, useful when using Json to load the effect properties
-Mask::Mask() : reader(NULL), replace_image(false), needs_refresh(true) {
+Mask::Mask() : reader(NULL), needs_refresh(true), replace_image(false) {
 	// Init effect properties
 	init_effect_details();
 }
 
 // Default constructor
 Mask::Mask(ReaderBase *mask_reader, Keyframe mask_brightness, Keyframe mask_contrast) :
-		reader(mask_reader), brightness(mask_brightness), contrast(mask_contrast), replace_image(false), needs_refresh(true)
+		reader(mask_reader), needs_refresh(true), replace_image(false), brightness(mask_brightness), contrast(mask_contrast)
 {
 	// Init effect properties
 	init_effect_details();
@@ -77,83 +112,117 @@ std::shared_ptr<Frame> Mask::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 	if (!reader)
 		return frame;
 
-	// Get mask image (if missing or different size than frame image)
-	#pragma omp critical (open_mask_reader)
+	// Get the gray values of the mask (scaled to the frame size)
+	std::shared_ptr<std::vector<unsigned char> > mask = get_scaled_mask(frame_number, frame_image->width(), frame_image->height());
+
+	// The contrast and brightness are the same for every pixel, so adjust each possible gray value once
+	double contrast_value = (contrast.GetValue(frame_number));
+	double brightness_value = (brightness.GetValue(frame_number));
+	float factor = (259 * (contrast_value + 255)) / (255 * (259 - contrast_value));
+	unsigned char adjusted_gray[256];
+	for (int gray = 0; gray < 256; gray++)
 	{
-		if (!original_mask || !reader->info.has_single_image || needs_refresh ||
-			(original_mask && original_mask->size() != frame_image->size())) {
+		// Adjust the contrast
+		int gray_value = constrain((factor * (gray - 128)) + 128);
 
-			// Only get mask if needed
-			std::shared_ptr<QImage> mask_without_sizing = std::shared_ptr<QImage>(
-					new QImage(*reader->GetFrame(frame_number)->GetImage()));
+		// Adjust the brightness
+		gray_value += (255 * brightness_value);
 
-			// Resize mask image to match frame size
-			original_mask = std::shared_ptr<QImage>(new QImage(
-					mask_without_sizing->scaled(frame_image->width(), frame_image->height(), Qt::IgnoreAspectRatio,
-												Qt::SmoothTransformation)));
-		}
+		// Constrain the value from 0 to 255
+		adjusted_gray[gray] = constrain(gray_value);
 	}
 
-	// Refresh no longer needed
-	needs_refresh = false;
+	// Loop through mask pixels, and apply the adjusted gray value to frame alpha channel (or color), with the
+	// loop of the frame's pixel format
+	ApplyMask apply_mask = {frame_image.get(), mask->data(), adjusted_gray, replace_image};
+	if (!DispatchPixelFormat(frame_image->format(), apply_mask)) {
+		frame->ConvertImage(QImage::Format_RGBA8888);
+		apply_mask.image = frame->GetImage().get();
+		apply_mask(RGBA8888Pixels());
+	}
 
-	// Get pixel arrays
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	unsigned char *mask_pixels = (unsigned char *) original_mask->bits();
+	// return the modified frame
+	return frame;
+}
 
-	int R = 0;
-	int G = 0;
-	int B = 0;
-	int A = 0;
-	int gray_value = 0;
-	float factor = 0.0;
-	double contrast_value = (contrast.GetValue(frame_number));
-	double brightness_value = (brightness.GetValue(frame_number));
+// Get a key of what this effect does to an image at a frame number
+std::string Mask::OutputKey(int64_t frame_number)
+{
+	// The mask image changes with the reader (and with the frame number, unless it is a single image)
+	std::string key = EffectBase::OutputKey(frame_number);
+	key += std::to_string((uintptr_t) reader);
+	if (reader && !reader->info.has_single_image)
+		key += "/" + std::to_string(frame_number);
+	return key;
+}
+
+// Get the gray values of a mask frame, scaled to the frame size (scaled masks are cached)
+std::shared_ptr<std::vector<unsigned char> > Mask::get_scaled_mask(int64_t frame_number, int width, int height) {
+	std::shared_ptr<std::vector<unsigned char> > mask;
+	QImage mask_without_sizing;
+
+	// A single image mask is the same for every frame
+	int64_t mask_number = reader->info.has_single_image ? 0 : frame_number;
 
-	// Loop through mask pixels, and apply average gray value to frame alpha channel
-	for (int pixel = 0, byte_index=0; pixel < original_mask->width() * original_mask->height(); pixel++, byte_index+=4)
+	#pragma omp critical (open_mask_reader)
 	{
-		// Get the RGB values from the pixel
-		R = mask_pixels[byte_index];
-		G = mask_pixels[byte_index + 1];
-		B = mask_pixels[byte_index + 2];
+		// Drop the cached masks (if the reader or the frame size has changed)
+		if (needs_refresh || cached_mask_size != QSize(width, height)) {
+			cached_masks.clear();
+			cached_mask_order.clear();
+			cached_mask_size = QSize(width, height);
+			needs_refresh = false;
+		}
 
-		// Get the average luminosity
-		gray_value = qGray(R, G, B);
+		// Look for the scaled mask, or get the mask image (if missing)
+		std::map<int64_t, std::shared_ptr<std::vector<unsigned char> > >::iterator itr = cached_masks.find(mask_number);
+		if (itr != cached_masks.end())
+			mask = itr->second;
+		else
+			mask_without_sizing = *reader->GetFrame(frame_number)->GetImage();
+	}
 
-		// Adjust the contrast
-		factor = (259 * (contrast_value + 255)) / (255 * (259 - contrast_value));
-		gray_value = constrain((factor * (gray_value - 128)) + 128);
+	if (mask)
+		return mask;
 
-		// Adjust the brightness
-		gray_value += (255 * brightness_value);
+	// Resize mask image to match frame size (outside of the lock, so mask frames are scaled in parallel)
+	QImage scaled_mask = mask_without_sizing;
+	if (scaled_mask.width() != width || scaled_mask.height() != height)
+		scaled_mask = scaled_mask.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	if (scaled_mask.format() != QImage::Format_RGBA8888)
+		scaled_mask = scaled_mask.convertToFormat(QImage::Format_RGBA8888);
 
-		// Constrain the value from 0 to 255
-		gray_value = constrain(gray_value);
-
-		// Set the alpha channel to the gray value
-		if (replace_image) {
-			// Replace frame pixels with gray value
-			pixels[byte_index + 0] = gray_value;
-			pixels[byte_index + 1] = gray_value;
-			pixels[byte_index + 2] = gray_value;
-		} else {
-			// Set alpha channel
-			A = pixels[byte_index + 3];
-			pixels[byte_index + 3] = constrain(A - gray_value);
-		}
+	// Keep only the average luminosity of each pixel
+	mask = std::make_shared<std::vector<unsigned char> >((size_t) width * height);
+	unsigned char *mask_gray = mask->data();
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char *mask_pixels = scaled_mask.constScanLine(y);
+		for (int x = 0; x < width; x++)
+			mask_gray[(size_t) y * width + x] = qGray(mask_pixels[x * 4], mask_pixels[x * 4 + 1], mask_pixels[x * 4 + 2]);
+	}
 
+	// Cache the scaled mask (dropping the oldest ones)
+	#pragma omp critical (open_mask_reader)
+	{
+		if (!needs_refresh && cached_mask_size == QSize(width, height) && cached_masks.find(mask_number) == cached_masks.end()) {
+			cached_masks[mask_number] = mask;
+			cached_mask_order.push_back(mask_number);
+			while (cached_mask_order.size() > max_cached_masks) {
+				cached_masks.erase(cached_mask_order.front());
+				cached_mask_order.pop_front();
+			}
+		}
 	}
 
-	// return the modified frame
-	return frame;
+	return mask;
 }
 
 // Generate JSON string of this object
 std::string Mask::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -179,13 +248,7 @@ void Mask::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -297,5 +360,5 @@ std::string Mask::PropertiesJSON(int64_t requested_frame) {
 		root["reader"] = add_property_json("Source", 0.0, "reader", "{}", NULL, 0, 1, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -57,11 +57,27 @@ std::shared_ptr<Frame> Negate::GetFrame(std::shared_ptr<Frame> frame, int64_t fr
 	return frame;
 }
 
+// Get the point-wise kernel of this effect (for the keyframe values of a frame)
+EffectBase::PixelKernel Negate::GetPixelKernel(int64_t frame_number)
+{
+	return [](unsigned char *pixels, int64_t pixel_count) {
+		PixelKernels::Negate(pixels, pixel_count);
+	};
+}
+
+// Get the GPU kernel of this effect (the same transform as its pixel kernel)
+EffectBase::GpuKernel Negate::GetGpuKernel(int64_t frame_number)
+{
+	GpuKernel kernel;
+	kernel.source = "color.rgb = 255.0 - color.rgb;";
+	return kernel;
+}
+
 // Generate JSON string of this object
 std::string Negate::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -80,13 +96,7 @@ void Negate::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -125,5 +135,5 @@ std::string Negate::PropertiesJSON(int64_t requested_frame) {
 	root["duration"] = add_property_json("Duration", Duration(), "float", "", NULL, 0, 30 * 60 * 60 * 48, true, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -29,6 +29,10 @@
  */
 
 #include "../../include/effects/Pixelate.h"
+#include "../../include/TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
 
 using namespace openshot;
 
@@ -60,6 +64,24 @@ void Pixelate::init_effect_details()
 	info.has_video = true;
 }
 
+// Get the region of the image this effect changes (the area inside the margins)
+QRect Pixelate::RegionOfInterest(int64_t frame_number, QSize image_size)
+{
+	// Nothing is pixelated at full pixelization
+	if (std::min(fabs(pixelization.GetValue(frame_number)), 1.0) >= 1.0)
+		return QRect();
+
+	// Get pixels sizes of all margins
+	int top_bar_height = top.GetValue(frame_number) * image_size.height();
+	int bottom_bar_height = bottom.GetValue(frame_number) * image_size.height();
+	int left_bar_width = left.GetValue(frame_number) * image_size.width();
+	int right_bar_width = right.GetValue(frame_number) * image_size.width();
+
+	// The bottom row (at the bottom margin) is included
+	QRect region(left_bar_width, top_bar_height, image_size.width() - left_bar_width - right_bar_width, image_size.height() - bottom_bar_height - top_bar_height + 1);
+	return region & QRect(QPoint(0, 0), image_size);
+}
+
 // This method is required for all derived classes of EffectBase, and returns a
 // modified openshot::Frame object
 std::shared_ptr<Frame> Pixelate::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
@@ -69,40 +91,49 @@ std::shared_ptr<Frame> Pixelate::GetFrame(std::shared_ptr<Frame> frame, int64_t
 
 	// Get current keyframe values
 	double pixelization_value = 1.0 - std::min(fabs(pixelization.GetValue(frame_number)), 1.0);
-	double left_value = left.GetValue(frame_number);
-	double top_value = top.GetValue(frame_number);
-	double right_value = right.GetValue(frame_number);
-	double bottom_value = bottom.GetValue(frame_number);
 
-	if (pixelization_value > 0.0) {
-		// Resize frame image smaller (based on pixelization value)
-		std::shared_ptr<QImage> smaller_frame_image = std::shared_ptr<QImage>(new QImage(frame_image->scaledToWidth(std::max(frame_image->width() * pixelization_value, 2.0), Qt::SmoothTransformation)));
+	// Get the area inside the margins (only this area is pixelated)
+	QRect area = RegionOfInterest(frame_number, frame_image->size());
 
-		// Resize image back to original size (with no smoothing to create pixelated image)
-		std::shared_ptr<QImage> pixelated_image = std::shared_ptr<QImage>(new QImage(smaller_frame_image->scaledToWidth(frame_image->width(), Qt::FastTransformation).convertToFormat(QImage::Format_RGBA8888)));
+	if (pixelization_value > 0.0 && !area.isEmpty()) {
+		// Get the number of blocks (as if the area was resized smaller, based on the pixelization value)
+		int blocks_x = std::min(area.width(), (int) std::max(area.width() * pixelization_value, 2.0));
+		int blocks_y = std::min(area.height(), std::max(1, (int) round(area.height() * double(blocks_x) / area.width())));
 
 		// Get pixel array pointer
 		unsigned char *pixels = (unsigned char *) frame_image->bits();
-		unsigned char *pixelated_pixels = (unsigned char *) pixelated_image->bits();
-
-		// Get pixels sizes of all margins
-		int top_bar_height = top_value * frame_image->height();
-		int bottom_bar_height = bottom_value * frame_image->height();
-		int left_bar_width = left_value * frame_image->width();
-		int right_bar_width = right_value * frame_image->width();
-
-		// Loop through rows
-		for (int row = 0; row < frame_image->height(); row++) {
-
-			// Copy pixelated pixels into original frame image (where needed)
-			if ((row >= top_bar_height) && (row <= frame_image->height() - bottom_bar_height)) {
-				memcpy(&pixels[(row * frame_image->width() + left_bar_width) * 4], &pixelated_pixels[(row * frame_image->width() + left_bar_width) * 4], sizeof(char) * (frame_image->width() - left_bar_width - right_bar_width) * 4);
+		int bytes_per_line = frame_image->bytesPerLine();
+
+		// Fill each block with its average color (each row of blocks is a task)
+		TaskPool::Current()->ParallelFor(0, blocks_y, [&](int64_t block_y)
+		{
+			int first_row = area.top() + (int) (block_y * area.height() / blocks_y);
+			int last_row = area.top() + (int) ((block_y + 1) * area.height() / blocks_y);
+			for (int block_x = 0; block_x < blocks_x; block_x++) {
+				int first_column = area.left() + (int) ((int64_t) block_x * area.width() / blocks_x);
+				int last_column = area.left() + (int) ((int64_t) (block_x + 1) * area.width() / blocks_x);
+
+				// Sum the block
+				uint64_t sum[4] = { 0, 0, 0, 0 };
+				for (int row = first_row; row < last_row; row++) {
+					const unsigned char *block_pixels = pixels + (size_t) row * bytes_per_line;
+					for (int column = first_column; column < last_column; column++)
+						for (int c = 0; c < 4; c++)
+							sum[c] += block_pixels[column * 4 + c];
+				}
+
+				// Fill the block with the (rounded) average
+				uint64_t count = (uint64_t) (last_row - first_row) * (last_column - first_column);
+				unsigned char average[4];
+				for (int c = 0; c < 4; c++)
+					average[c] = (unsigned char) ((sum[c] + count / 2) / count);
+				for (int row = first_row; row < last_row; row++) {
+					unsigned char *block_pixels = pixels + (size_t) row * bytes_per_line;
+					for (int column = first_column; column < last_column; column++)
+						memcpy(block_pixels + column * 4, average, 4);
+				}
 			}
-		}
-
-		// Cleanup temp images
-		smaller_frame_image.reset();
-		pixelated_image.reset();
+		});
 	}
 
 	// return the modified frame
@@ -113,7 +144,7 @@ std::shared_ptr<Frame> Pixelate::GetFrame(std::shared_ptr<Frame> frame, int64_t
 std::string Pixelate::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -137,13 +168,7 @@ void Pixelate::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -200,5 +225,5 @@ std::string Pixelate::PropertiesJSON(int64_t requested_frame) {
 	root["bottom"] = add_property_json("Bottom Margin", bottom.GetValue(requested_frame), "float", "", &bottom, 0.0, 1.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
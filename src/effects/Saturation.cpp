@@ -63,61 +63,39 @@ void Saturation::init_effect_details()
 // modified openshot::Frame object
 std::shared_ptr<Frame> Saturation::GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number)
 {
-	// Get the frame's image
-	std::shared_ptr<QImage> frame_image = frame->GetImage();
+	// Adjust the saturation of all pixels
+	ApplyPixelKernels(frame, std::vector<PixelKernel>(1, GetPixelKernel(frame_number)));
 
-	if (!frame_image)
-		return frame;
+	// return the modified frame
+	return frame;
+}
 
+// Get the point-wise kernel of this effect (for the keyframe values of a frame)
+EffectBase::PixelKernel Saturation::GetPixelKernel(int64_t frame_number)
+{
 	// Get keyframe values for this frame
 	float saturation_value = saturation.GetValue(frame_number);
 
-	// Constants used for color saturation formula
-	double pR = .299;
-	double pG = .587;
-	double pB = .114;
-
-	// Loop through pixels
-	unsigned char *pixels = (unsigned char *) frame_image->bits();
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
-	{
-		// Get the RGB values from the pixel
-		int R = pixels[byte_index];
-		int G = pixels[byte_index + 1];
-		int B = pixels[byte_index + 2];
-		int A = pixels[byte_index + 3];
-
-		// Calculate the saturation multiplier
-		double p = sqrt( (R * R * pR) +
-						 (G * G * pG) +
-						 (B * B * pB) );
-
-		// Adjust the saturation
-		R = p + (R - p) * saturation_value;
-		G = p + (G - p) * saturation_value;
-		B = p + (B - p) * saturation_value;
-
-		// Constrain the value from 0 to 255
-		R = constrain(R);
-		G = constrain(G);
-		B = constrain(B);
-
-		// Set all pixels to new value
-		pixels[byte_index] = R;
-		pixels[byte_index + 1] = G;
-		pixels[byte_index + 2] = B;
-		pixels[byte_index + 3] = A; // leave the alpha value alone
-	}
+	return [saturation_value](unsigned char *pixels, int64_t pixel_count) {
+		PixelKernels::Saturation(pixels, pixel_count, saturation_value);
+	};
+}
 
-	// return the modified frame
-	return frame;
+// Get the GPU kernel of this effect (the same transform as its pixel kernel)
+EffectBase::GpuKernel Saturation::GetGpuKernel(int64_t frame_number)
+{
+	GpuKernel kernel;
+	kernel.source = "float p = sqrt(dot(color.rgb * color.rgb, vec3(0.299, 0.587, 0.114)));"
+					"color.rgb = clamp_color(p + (color.rgb - p) * P(0));";
+	kernel.parameters = {(float) saturation.GetValue(frame_number)};
+	return kernel;
 }
 
 // Generate JSON string of this object
 std::string Saturation::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -137,13 +115,7 @@ void Saturation::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -188,5 +160,5 @@ std::string Saturation::PropertiesJSON(int64_t requested_frame) {
 	root["saturation"] = add_property_json("Saturation", saturation.GetValue(requested_frame), "float", "", &saturation, 0.0, 4.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -29,6 +29,12 @@
  */
 
 #include "../../include/effects/Shift.h"
+#include "../../include/ImageBufferPool.h"
+#include "../../include/TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 using namespace openshot;
 
@@ -73,60 +79,50 @@ std::shared_ptr<Frame> Shift::GetFrame(std::shared_ptr<Frame> frame, int64_t fra
 	double y_shift = y.GetValue(frame_number);
 	double y_shift_limit = fmod(abs(y_shift), 1.0);
 
-	// Declare temp arrays to hold pixels while we move things around
-	unsigned char *temp_row = new unsigned char[frame_image->width() * 4]();
-
-	// X-SHIFT
-	// Loop through rows
-	for (int row = 0; row < frame_image->height(); row++) {
-		// Copy current row's pixels
-		int starting_row_pixel = row * frame_image->width();
-		memcpy(temp_row, &pixels[starting_row_pixel * 4], sizeof(char) * frame_image->width() * 4);
-
-		// Replace current row with left part of the pixels
-		if (x_shift > 0.0) {
-			// Move left side to the right
-			int relative_pixel_start = (int)round(frame_image->width() * x_shift_limit);
-			memcpy(&pixels[(starting_row_pixel + relative_pixel_start) * 4], &temp_row[0], sizeof(char) * (frame_image->width() - relative_pixel_start) * 4);
-
-			// Move right side to the left
-			memcpy(&pixels[starting_row_pixel * 4], &temp_row[(frame_image->width() - relative_pixel_start) * 4], sizeof(char) * relative_pixel_start * 4);
-		} else if (x_shift < 0.0) {
-			// Move right side to the left
-			int relative_pixel_start = (int)round(frame_image->width() * x_shift_limit);
-			memcpy(&pixels[starting_row_pixel * 4], &temp_row[relative_pixel_start * 4], sizeof(char) * (frame_image->width() - relative_pixel_start) * 4);
-
-			// Move left side to the right
-			memcpy(&pixels[(starting_row_pixel + (frame_image->width() - relative_pixel_start)) * 4], &temp_row[0], sizeof(char) * relative_pixel_start * 4);
-		}
+	int width = frame_image->width();
+	int height = frame_image->height();
+	int bytes_per_line = frame_image->bytesPerLine();
+	if (width == 0 || height == 0 || (x_shift == 0.0 && y_shift == 0.0))
+		return frame;
+
+	// Get the number of pixels to move right, and rows to move down (pixels moved past an edge wrap around)
+	int pixels_right = ((int)round(width * x_shift_limit)) % width;
+	if (x_shift < 0.0)
+		pixels_right = (width - pixels_right) % width;
+	int rows_down = ((int)round(height * y_shift_limit)) % height;
+	if (y_shift < 0.0)
+		rows_down = (height - rows_down) % height;
+
+	// Make temp copy of pixels before we start moving them (recycled from the image buffer pool)
+	size_t temp_size = (size_t) bytes_per_line * height;
+	unsigned char *temp_image = ImageBufferPool::Instance()->Acquire(temp_size);
+	std::vector<unsigned char> fallback_temp;
+	if (!temp_image) {
+		fallback_temp.resize(temp_size);
+		temp_image = fallback_temp.data();
 	}
+	memcpy(temp_image, pixels, temp_size);
 
-	// Make temp copy of pixels for Y-SHIFT
-	unsigned char *temp_image = new unsigned char[frame_image->width() * frame_image->height() * 4]();
-	memcpy(temp_image, pixels, sizeof(char) * frame_image->width() * frame_image->height() * 4);
-
-	// Y-SHIFT
-	// Replace current row with left part of the pixels
-	if (y_shift > 0.0) {
-		// Move top side to bottom
-		int relative_pixel_start = frame_image->width() * (int)round(frame_image->height() * y_shift_limit);
-		memcpy(&pixels[relative_pixel_start * 4], temp_image, sizeof(char) * ((frame_image->width() * frame_image->height()) - relative_pixel_start) * 4);
-
-		// Move bottom side to top
-		memcpy(pixels, &temp_image[((frame_image->width() * frame_image->height()) - relative_pixel_start) * 4], sizeof(char) * relative_pixel_start * 4);
-
-	} else if (y_shift < 0.0) {
-		// Move bottom side to top
-		int relative_pixel_start = frame_image->width() * (int)round(frame_image->height() * y_shift_limit);
-		memcpy(pixels, &temp_image[relative_pixel_start * 4], sizeof(char) * ((frame_image->width() * frame_image->height()) - relative_pixel_start) * 4);
-
-		// Move left side to the right
-		memcpy(&pixels[((frame_image->width() * frame_image->height()) - relative_pixel_start) * 4], temp_image, sizeof(char) * relative_pixel_start * 4);
-	}
+	// Split the rows into bands (one task each)
+	int bands = std::min(height, TaskPool::Current()->NumThreads() * 4);
+	int band_height = (height + bands - 1) / bands;
+	TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
+	{
+		int last_row = std::min(height, (int) (band + 1) * band_height);
+		for (int row = band * band_height; row < last_row; row++) {
+			// Copy each row from its source row (X-SHIFT and Y-SHIFT at once)
+			const unsigned char *source = temp_image + (size_t) ((row - rows_down + height) % height) * bytes_per_line;
+			unsigned char *target = pixels + (size_t) row * bytes_per_line;
+
+			// Move left side to the right, and right side to the left
+			memcpy(target + pixels_right * 4, source, sizeof(char) * (width - pixels_right) * 4);
+			memcpy(target, source + (width - pixels_right) * 4, sizeof(char) * pixels_right * 4);
+		}
+	});
 
-	// Delete arrays
-	delete[] temp_row;
-	delete[] temp_image;
+	// Return the temp copy to the pool
+	if (fallback_temp.empty())
+		ImageBufferPool::Instance()->Release(temp_image);
 
 	// return the modified frame
 	return frame;
@@ -136,7 +132,7 @@ std::shared_ptr<Frame> Shift::GetFrame(std::shared_ptr<Frame> frame, int64_t fra
 std::string Shift::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -157,13 +153,7 @@ void Shift::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -211,5 +201,5 @@ std::string Shift::PropertiesJSON(int64_t requested_frame) {
 	root["y"] = add_property_json("Y Shift", y.GetValue(requested_frame), "float", "", &y, -1, 1, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
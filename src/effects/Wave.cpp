@@ -29,6 +29,11 @@
  */
 
 #include "../../include/effects/Wave.h"
+#include "../../include/ImageBufferPool.h"
+#include "../../include/TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
 
 using namespace openshot;
 
@@ -70,10 +75,21 @@ std::shared_ptr<Frame> Wave::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 
 	// Get pixels for frame image
 	unsigned char *pixels = (unsigned char *) frame_image->bits();
-
-	// Make temp copy of pixels before we start changing them
-	unsigned char *temp_image = new unsigned char[frame_image->width() * frame_image->height() * 4]();
-	memcpy(temp_image, pixels, sizeof(char) * frame_image->width() * frame_image->height() * 4);
+	int width = frame_image->width();
+	int height = frame_image->height();
+	int64_t pixel_count = (int64_t) width * height;
+	if (pixel_count == 0)
+		return frame;
+
+	// Make temp copy of pixels before we start changing them (recycled from the image buffer pool)
+	size_t temp_size = (size_t) pixel_count * 4;
+	unsigned char *temp_image = ImageBufferPool::Instance()->Acquire(temp_size);
+	std::vector<unsigned char> fallback_temp;
+	if (!temp_image) {
+		fallback_temp.resize(temp_size);
+		temp_image = fallback_temp.data();
+	}
+	memcpy(temp_image, pixels, temp_size);
 
 	// Get current keyframe values
 	double time = frame_number;//abs(((frame_number + 255) % 510) - 255);
@@ -83,40 +99,89 @@ std::shared_ptr<Frame> Wave::GetFrame(std::shared_ptr<Frame> frame, int64_t fram
 	double shift_x_value = shift_x.GetValue(frame_number);
 	double speed_y_value = speed_y.GetValue(frame_number);
 
-	// Loop through pixels
-	for (int pixel = 0, byte_index=0; pixel < frame_image->width() * frame_image->height(); pixel++, byte_index+=4)
+	// Get the pixel offset of each row (which only changes with the keyframe values, and the time if the wave moves)
+	std::shared_ptr<std::vector<float> > wave_offsets = get_wave_offsets(height, time * speed_y_value, wavelength_value, amplitude_value, multiplier_value, shift_x_value);
+	const float *row_offsets = wave_offsets->data();
+
+	// Split the rows into bands (one task each)
+	int bands = std::min(height, TaskPool::Current()->NumThreads() * 4);
+	int band_height = (height + bands - 1) / bands;
+	TaskPool::Current()->ParallelFor(0, bands, [&](int64_t band)
 	{
-		// Calculate X and Y pixel coordinates
-		int Y = pixel / frame_image->width();
+		int last_row = std::min(height, (int) (band + 1) * band_height);
+		for (int Y = band * band_height; Y < last_row; Y++) {
+			// Each row is shifted by a whole number of pixels (rounded), so it is copied from a single span of
+			// source pixels (which can start in the previous row, or end in the next row)
+			int64_t row_start = (int64_t) Y * width;
+			int64_t source_start = row_start + (int64_t) floor(row_offsets[Y] + 0.5);
+			unsigned char *target = pixels + row_start * 4;
+
+			// Pixels before the first source pixel (or after the last one) repeat it
+			int x = 0;
+			for (; x < width && source_start + x < 0; x++)
+				memcpy(target + x * 4, temp_image, 4);
+			int copy_end = (int) std::max((int64_t) x, std::min((int64_t) width, pixel_count - source_start));
+			if (copy_end > x)
+				memcpy(target + x * 4, temp_image + (source_start + x) * 4, (size_t) (copy_end - x) * 4);
+			for (x = copy_end; x < width; x++)
+				memcpy(target + x * 4, temp_image + (pixel_count - 1) * 4, 4);
+		}
+	});
+
+	// Return the temp copy to the pool
+	if (fallback_temp.empty())
+		ImageBufferPool::Instance()->Release(temp_image);
 
-		// Calculate wave pixel offsets
-		float noiseVal = (100 + Y * 0.001) * multiplier_value; // Time and time multiplier (to make the wave move)
-		float noiseAmp = noiseVal * amplitude_value; // Apply amplitude / height of the wave
-		float waveformVal = sin((Y * wavelength_value) + (time * speed_y_value)); // Waveform algorithm on y-axis
-		float waveVal = (waveformVal + shift_x_value) * noiseAmp; // Shifts pixels on the x-axis
+	// return the modified frame
+	return frame;
+}
 
-		int source_X = round(pixel + waveVal) * 4;
-		if (source_X < 0)
-			source_X = 0;
-		if (source_X > frame_image->width() * frame_image->height() * 4 * sizeof(char))
-			source_X = (frame_image->width() * frame_image->height() * 4 * sizeof(char)) - (sizeof(char) * 4);
+// Get a key of what this effect does to an image at a frame number
+std::string Wave::OutputKey(int64_t frame_number)
+{
+	// The wave moves with the frame number (unless the speed is 0)
+	std::string key = EffectBase::OutputKey(frame_number);
+	if (speed_y.GetValue(frame_number) != 0.0)
+		key += std::to_string(frame_number);
+	return key;
+}
 
-		// Calculate source array location, and target array location, and copy the 4 color values
-		memcpy(&pixels[byte_index], &temp_image[source_X], sizeof(char) * 4);
+// Get the pixel offsets of each row of the wave (the offsets of the last frame are reused, if nothing changed)
+std::shared_ptr<std::vector<float> > Wave::get_wave_offsets(int height, double phase, double wavelength_value, double amplitude_value, double multiplier_value, double shift_x_value)
+{
+	std::vector<double> key = { (double) height, phase, wavelength_value, amplitude_value, multiplier_value, shift_x_value };
+	std::shared_ptr<std::vector<float> > wave_offsets;
+	#pragma omp critical (wave_offsets)
+	{
+		if (cached_wave_offsets && key == cached_wave_key)
+			wave_offsets = cached_wave_offsets;
 	}
+	if (wave_offsets)
+		return wave_offsets;
 
-	// Delete arrays
-	delete[] temp_image;
+	wave_offsets = std::make_shared<std::vector<float> >(height);
+	for (int Y = 0; Y < height; Y++)
+	{
+		// Calculate wave pixel offsets
+		float noiseVal = (100 + Y * 0.001) * multiplier_value; // Time and time multiplier (to make the wave move)
+		float noiseAmp = noiseVal * amplitude_value; // Apply amplitude / height of the wave
+		float waveformVal = sin((Y * wavelength_value) + phase); // Waveform algorithm on y-axis
+		(*wave_offsets)[Y] = (waveformVal + shift_x_value) * noiseAmp; // Shifts pixels on the x-axis
+	}
 
-	// return the modified frame
-	return frame;
+	#pragma omp critical (wave_offsets)
+	{
+		cached_wave_offsets = wave_offsets;
+		cached_wave_key = key;
+	}
+	return wave_offsets;
 }
 
 // Generate JSON string of this object
 std::string Wave::Json() {
 
 	// Return formatted string
-	return JsonValue().toStyledString();
+	return WriteJson(JsonValue());
 }
 
 // Generate Json::JsonValue for this object
@@ -140,13 +205,7 @@ void Wave::SetJson(std::string value) {
 
 	// Parse JSON string into JSON objects
 	Json::Value root;
-	Json::CharReaderBuilder rbuilder;
-	Json::CharReader* reader(rbuilder.newCharReader());
-
-	std::string errors;
-	bool success = reader->parse( value.c_str(),
-                 value.c_str() + value.size(), &root, &errors );
-	delete reader;
+	bool success = ParseJson(value, root);
 
 	if (!success)
 		// Raise exception
@@ -203,5 +262,5 @@ std::string Wave::PropertiesJSON(int64_t requested_frame) {
 	root["speed_y"] = add_property_json("Vertical speed", speed_y.GetValue(requested_frame), "float", "", &speed_y, 0.0, 300.0, false, requested_frame);
 
 	// Return formatted string
-	return root.toStyledString();
+	return WriteJson(root);
 }
@@ -0,0 +1,372 @@
+/**
+ * @file
+ * @brief Source file for Benchmark Executable (benchmarks of the rendering pipeline of libopenshot)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <QDir>
+#include "../../include/OpenShot.h"
+
+using namespace openshot;
+
+// Usage: openshot-benchmark [--output results.json] [--filter name] [--repeat N]
+//
+// Each benchmark runs N times (3 by default), and the median run is used for its rate. The results are
+// written as JSON (to stdout, unless --output is used), and a summary is printed to stderr. The random
+// numbers of each benchmark use a fixed seed, so every run does the same work.
+
+// Measures the time of the timed sections of a benchmark (the setup of a benchmark is not timed)
+class Stopwatch {
+private:
+	std::chrono::steady_clock::time_point start;
+	double total;
+
+public:
+	Stopwatch() : total(0.0) { }
+	void Start() { start = std::chrono::steady_clock::now(); }
+	void Stop() { total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+	double Seconds() const { return total; }
+};
+
+// A benchmark returns the number of units it processed (i.e. frames, operations, or megapixels)
+struct Benchmark {
+	std::string name;
+	std::string unit;
+	std::function<double(Stopwatch&)> run;
+};
+
+// Path of the bundled media (and of the temporary files)
+static std::string media_path(std::string name) {
+	return std::string(TEST_MEDIA_PATH) + name;
+}
+
+static std::string temp_path(std::string name) {
+	return QDir::tempPath().toStdString() + "/" + name;
+}
+
+// Create a frame with a copy of an image
+static std::shared_ptr<Frame> copy_frame(int64_t number, const QImage& image) {
+	std::shared_ptr<Frame> frame(new Frame(number, image.width(), image.height(), "#000000"));
+	frame->AddImage(std::make_shared<QImage>(image.copy()));
+	return frame;
+}
+
+// A 1280x720 image from the bundled media
+static QImage load_image(std::string name) {
+	QImage image(QString::fromStdString(media_path(name)));
+	return image.scaled(1280, 720, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+}
+
+// Read the first frames of a video, in order
+static int64_t reader_sequential(Stopwatch& watch) {
+	FFmpegReader r(media_path("sintel_trailer-720p.mp4"));
+	r.Open();
+	int64_t frames = std::min(int64_t(240), r.info.video_length);
+
+	watch.Start();
+	for (int64_t frame = 1; frame <= frames; frame++)
+		r.GetFrame(frame);
+	watch.Stop();
+
+	r.Close();
+	return frames;
+}
+
+// Read frames at random positions of a video (each one needs a seek)
+static int64_t reader_random_seek(Stopwatch& watch) {
+	FFmpegReader r(media_path("sintel_trailer-720p.mp4"));
+	r.Open();
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int64_t> positions(1, r.info.video_length);
+	int64_t frames = 40;
+
+	watch.Start();
+	for (int64_t frame = 0; frame < frames; frame++)
+		r.GetFrame(positions(random));
+	watch.Stop();
+
+	r.Close();
+	return frames;
+}
+
+// Render a timeline with a number of translucent layers (of images, so only the compositing is measured)
+static int64_t timeline_layers(Stopwatch& watch, int layers) {
+	Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	std::vector<std::unique_ptr<QtImageReader> > readers;
+	std::vector<std::unique_ptr<Clip> > clips;
+	for (int layer = 0; layer < layers; layer++) {
+		readers.emplace_back(new QtImageReader(media_path((layer % 2 == 0) ? "front.png" : "back.png")));
+		clips.emplace_back(new Clip(readers.back().get()));
+		clips.back()->Layer(layer);
+		clips.back()->End(10.0);
+		clips.back()->alpha = Keyframe(0.5);
+		t.AddClip(clips.back().get());
+	}
+	t.Open();
+	int64_t frames = 60;
+
+	watch.Start();
+	for (int64_t frame = 1; frame <= frames; frame++)
+		t.GetFrame(frame);
+	watch.Stop();
+
+	t.Close();
+	return frames;
+}
+
+// Apply an effect to 1280x720 frames (the rate is in megapixels per second)
+static double effect_cost(Stopwatch& watch, std::string class_name) {
+	QImage image = load_image("front.png");
+	QtImageReader mask_reader(media_path("mask.png"));
+	std::unique_ptr<EffectBase> effect(EffectInfo().CreateEffect(class_name));
+	if (class_name == "Mask")
+		effect.reset(new Mask(&mask_reader, Keyframe(0.5), Keyframe(1.0)));
+	int64_t frames = 30;
+
+	for (int64_t frame = 1; frame <= frames; frame++) {
+		std::shared_ptr<Frame> f = copy_frame(frame, image);
+		watch.Start();
+		effect->GetFrame(f, frame);
+		watch.Stop();
+	}
+
+	mask_reader.Close();
+	return frames * image.width() * image.height() / 1000000.0;
+}
+
+// Add frames to a cache, and then get each of them
+static int64_t cache_ops(Stopwatch& watch, CacheBase& cache) {
+	QImage image = load_image("front.png");
+	int64_t frames = 60;
+	std::vector<std::shared_ptr<Frame> > source;
+	for (int64_t frame = 1; frame <= frames; frame++) {
+		source.push_back(copy_frame(frame, image));
+		source.back()->ResizeAudio(2, 1470, 44100, LAYOUT_STEREO);
+		source.back()->AddAudioSilence(1470);
+	}
+
+	watch.Start();
+	for (int64_t frame = 0; frame < frames; frame++)
+		cache.Add(source[frame]);
+	for (int64_t frame = 1; frame <= frames; frame++)
+		cache.GetFrame(frame);
+	watch.Stop();
+
+	cache.Clear();
+	return frames * 2;
+}
+
+// A keyframe with many bezier curves
+static Keyframe benchmark_keyframe() {
+	Keyframe k;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<double> values(-100.0, 100.0);
+	for (int64_t point = 0; point < 200; point++)
+		k.AddPoint(1 + point * 50, values(random), BEZIER);
+	return k;
+}
+
+// Get the values of a keyframe at random indexes
+static int64_t keyframe_random(Stopwatch& watch) {
+	Keyframe k = benchmark_keyframe();
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int64_t> indexes(1, 10000);
+	std::vector<int64_t> index_order;
+	for (int64_t value = 0; value < 1000000; value++)
+		index_order.push_back(indexes(random));
+	double total = 0.0;
+
+	watch.Start();
+	for (int64_t index : index_order)
+		total += k.GetValue(index);
+	watch.Stop();
+
+	// Use the total, so the loop is not optimized away
+	if (total == 0.123)
+		std::cerr << total;
+	return (int64_t) index_order.size();
+}
+
+// Get the values of a keyframe in order (with a cursor, like an effect rendering a clip)
+static int64_t keyframe_sequential(Stopwatch& watch) {
+	Keyframe k = benchmark_keyframe();
+	Keyframe::Cursor cursor(k);
+	int64_t indexes = 1000000;
+	double total = 0.0;
+
+	watch.Start();
+	for (int64_t index = 1; index <= indexes; index++)
+		total += cursor.GetValue((index - 1) % 10000 + 1);
+	watch.Stop();
+
+	if (total == 0.123)
+		std::cerr << total;
+	return indexes;
+}
+
+// Encode 1280x720 frames (with the MPEG-4 encoder, which is part of every FFmpeg build)
+static int64_t writer_encode(Stopwatch& watch) {
+	QImage image = load_image("front.png");
+	std::string path = temp_path("openshot-benchmark.mp4");
+	FFmpegWriter w(path);
+	w.SetVideoOptions(true, "mpeg4", Fraction(30, 1), 1280, 720, Fraction(1, 1), false, false, 3000000);
+	w.Open();
+	int64_t frames = 120;
+	std::vector<std::shared_ptr<Frame> > source;
+	for (int64_t frame = 1; frame <= frames; frame++)
+		source.push_back(copy_frame(frame, image));
+
+	watch.Start();
+	for (int64_t frame = 0; frame < frames; frame++)
+		w.WriteFrame(source[frame]);
+	w.Close();
+	watch.Stop();
+
+	std::remove(path.c_str());
+	return frames;
+}
+
+// The list of benchmarks
+static std::vector<Benchmark> benchmarks() {
+	std::vector<Benchmark> list;
+	list.push_back({"reader.sequential", "frames", reader_sequential});
+	list.push_back({"reader.random_seek", "frames", reader_random_seek});
+
+	int layer_counts[] = {1, 4, 8};
+	for (int layers : layer_counts)
+		list.push_back({"timeline.layers_" + std::to_string(layers), "frames",
+						[layers](Stopwatch& watch) { return timeline_layers(watch, layers); }});
+
+	Json::Value effects = EffectInfo::JsonValue();
+	for (unsigned int index = 0; index < effects.size(); index++) {
+		std::string class_name = effects[index]["class_name"].asString();
+		if (!effects[index]["has_video"].asBool())
+			continue;
+		list.push_back({"effect." + class_name, "megapixels",
+						[class_name](Stopwatch& watch) { return effect_cost(watch, class_name); }});
+	}
+
+	list.push_back({"cache.memory", "ops", [](Stopwatch& watch) {
+		CacheMemory cache;
+		return cache_ops(watch, cache);
+	}});
+	list.push_back({"cache.disk", "ops", [](Stopwatch& watch) {
+		CacheDisk cache("", "RAW", 1.0, 1.0);
+		return cache_ops(watch, cache);
+	}});
+
+	list.push_back({"keyframe.get_value", "ops", keyframe_random});
+	list.push_back({"keyframe.cursor", "ops", keyframe_sequential});
+	list.push_back({"writer.encode", "frames", writer_encode});
+	return list;
+}
+
+int main(int argc, char* argv[]) {
+	std::string output_path;
+	std::string filter;
+	int repeats = 3;
+	for (int arg = 1; arg < argc; arg++) {
+		std::string option = argv[arg];
+		if (option == "--output" && arg + 1 < argc)
+			output_path = argv[++arg];
+		else if (option == "--filter" && arg + 1 < argc)
+			filter = argv[++arg];
+		else if (option == "--repeat" && arg + 1 < argc)
+			repeats = std::max(1, atoi(argv[++arg]));
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--output results.json] [--filter name] [--repeat N]" << std::endl;
+			return 1;
+		}
+	}
+
+	// Decode in software (so the results do not depend on the GPU)
+	Settings::Instance()->HARDWARE_DECODER = 0;
+
+	Json::Value root;
+	root["version"] = OPENSHOT_VERSION_FULL;
+	root["repeats"] = repeats;
+	root["hardware_threads"] = std::thread::hardware_concurrency();
+	root["omp_threads"] = Settings::Instance()->OMP_THREADS;
+	root["ff_threads"] = Settings::Instance()->FF_THREADS;
+	root["benchmarks"] = Json::Value(Json::arrayValue);
+
+	std::vector<Benchmark> list = benchmarks();
+	for (Benchmark& benchmark : list) {
+		if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+			continue;
+
+		Json::Value result;
+		result["name"] = benchmark.name;
+		result["unit"] = benchmark.unit;
+		try {
+			// Run the benchmark a few times (the median run is used, since the first run also warms up the caches)
+			std::vector<double> seconds;
+			double units = 0.0;
+			for (int repeat = 0; repeat < repeats; repeat++) {
+				Stopwatch watch;
+				units = benchmark.run(watch);
+				seconds.push_back(watch.Seconds());
+				result["seconds"].append(watch.Seconds());
+			}
+			std::sort(seconds.begin(), seconds.end());
+			double median = seconds[seconds.size() / 2];
+
+			result["units"] = units;
+			result["best_seconds"] = seconds.front();
+			result["median_seconds"] = median;
+			result["rate"] = (median > 0.0) ? units / median : 0.0;
+			result["ms_per_unit"] = (units > 0.0) ? median * 1000.0 / units : 0.0;
+			std::cerr << benchmark.name << ": " << result["rate"].asDouble() << " " << benchmark.unit << "/s" << std::endl;
+		}
+		catch (const BaseException& e) {
+			// Record the error, and keep going (i.e. an encoder missing from this FFmpeg build)
+			result["error"] = e.what();
+			std::cerr << benchmark.name << ": " << e.what() << std::endl;
+		}
+		root["benchmarks"].append(result);
+	}
+
+	// Write the results
+	if (output_path.empty())
+		std::cout << root.toStyledString();
+	else {
+		std::ofstream output(output_path.c_str());
+		output << root.toStyledString();
+	}
+	return 0;
+}
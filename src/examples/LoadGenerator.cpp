@@ -0,0 +1,247 @@
+/**
+ * @file
+ * @brief Source file for Load Generator Executable (renders generated timelines, to test how rendering scales)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include "../../include/OpenShot.h"
+
+using namespace openshot;
+
+// Usage: openshot-load-generator [--option value]...
+//
+// Generates a timeline of DummyReader clips (each one a solid color), spread over a number of layers, with
+// effects and animated properties. A range of frames is rendered, and the throughput, render times and peak
+// memory are written as JSON (with the time of each stage, and the metrics of the timeline). The options are
+// listed in the defaults below.
+// The same seed always generates the same timeline, and --save writes the generated project JSON, so a slow
+// project can be opened in OpenShot.
+
+// Get the peak memory use of this process (in bytes)
+static int64_t peak_memory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return -1;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return int64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Animate a property of a clip, with a number of random bezier points over the length of the clip
+static void animate(Keyframe& property, int points, int64_t frames, double minimum, double maximum, std::mt19937& random) {
+	if (points <= 0)
+		return;
+	std::uniform_real_distribution<double> values(minimum, maximum);
+	property = Keyframe();
+	for (int point = 0; point < points; point++) {
+		double x = (points > 1) ? 1.0 + double(point) * (frames - 1) / (points - 1) : 1.0;
+		property.AddPoint(round(x), values(random), BEZIER);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	// The options (and their defaults)
+	std::map<std::string, double> options;
+	options["clips"] = 20; // Number of clips
+	options["layers"] = 4; // Number of layers (the clips are spread over the layers)
+	options["duration"] = 10; // Length of the timeline (in seconds)
+	options["overlap"] = 0.25; // How much of each clip overlaps the next clip on its layer (0 to 0.9)
+	options["effects"] = 1; // Number of effects on each clip
+	options["keyframes"] = 10; // Number of points of each animated property (0 for no animation)
+	options["width"] = 1280;
+	options["height"] = 720;
+	options["fps"] = 30;
+	options["start"] = 1; // First frame to render
+	options["end"] = 90; // Last frame to render
+	options["seed"] = 1; // Seed of the random colors, effects, and curves
+	options["deterministic"] = 0; // Render deterministically (see Settings::DETERMINISTIC_RENDER), to compare builds
+	std::string output_path;
+	std::string save_path;
+
+	for (int arg = 1; arg < argc; arg += 2) {
+		std::string option = argv[arg];
+		if (option.size() > 2 && option.substr(0, 2) == "--" && arg + 1 < argc) {
+			option = option.substr(2);
+			if (option == "output")
+				output_path = argv[arg + 1];
+			else if (option == "save")
+				save_path = argv[arg + 1];
+			else if (options.count(option))
+				options[option] = atof(argv[arg + 1]);
+			else
+				option.clear();
+		}
+		else
+			option.clear();
+
+		if (option.empty()) {
+			std::cerr << "Usage: " << argv[0] << " [--output results.json] [--save project.osp]";
+			for (std::map<std::string, double>::iterator itr = options.begin(); itr != options.end(); ++itr)
+				std::cerr << " [--" << itr->first << " " << itr->second << "]";
+			std::cerr << std::endl;
+			return 1;
+		}
+	}
+
+	int clip_count = std::max(0, int(options["clips"]));
+	int layer_count = std::max(1, int(options["layers"]));
+	double overlap = std::min(0.9, std::max(0.0, options["overlap"]));
+	int effect_count = std::max(0, int(options["effects"]));
+	int keyframe_count = std::max(0, int(options["keyframes"]));
+	int width = int(options["width"]);
+	int height = int(options["height"]);
+	Fraction fps(int(options["fps"]), 1);
+	int64_t start = std::max(int64_t(1), int64_t(options["start"]));
+	int64_t end = std::max(start, int64_t(options["end"]));
+	std::mt19937 random(unsigned(options["seed"]));
+	Settings::Instance()->DETERMINISTIC_RENDER = options["deterministic"] != 0;
+
+	// The effects to choose from (the Mask effect is skipped, since it needs the image of a mask)
+	std::vector<std::string> effect_types;
+	Json::Value effect_info = EffectInfo::JsonValue();
+	for (unsigned int index = 0; index < effect_info.size(); index++)
+		if (effect_info[index]["has_video"].asBool() && effect_info[index]["class_name"].asString() != "Mask")
+			effect_types.push_back(effect_info[index]["class_name"].asString());
+
+	// Generate the clips (these are declared before the timeline, so they are deleted after it)
+	std::vector<std::unique_ptr<DummyReader> > readers;
+	std::vector<std::unique_ptr<EffectBase> > effects;
+	std::vector<std::unique_ptr<Clip> > clips;
+	Timeline t(width, height, fps, 44100, 2, LAYOUT_STEREO);
+
+	// Each layer is filled with clips, which overlap the next clip on their layer
+	int clips_per_layer = (clip_count + layer_count - 1) / std::max(1, layer_count);
+	double clip_length = options["duration"] / (1.0 + std::max(0, clips_per_layer - 1) * (1.0 - overlap));
+	int64_t clip_frames = std::max(int64_t(1), int64_t(round(clip_length * fps.ToDouble())));
+	std::uniform_int_distribution<int> channel(0, 255);
+	std::uniform_int_distribution<size_t> effect_type(0, effect_types.empty() ? 0 : effect_types.size() - 1);
+
+	for (int index = 0; index < clip_count; index++) {
+		int layer = index % layer_count;
+		int slot = index / layer_count;
+
+		// A reader of a solid color (the reader returns the same frame for every frame number)
+		readers.emplace_back(new DummyReader(fps, width, height, 44100, 2, clip_length));
+		readers.back()->Open();
+		char color[8];
+		snprintf(color, sizeof(color), "#%02x%02x%02x", channel(random), channel(random), channel(random));
+		readers.back()->GetFrame(1)->AddColor(width, height, color);
+
+		clips.emplace_back(new Clip(readers.back().get()));
+		Clip *clip = clips.back().get();
+		clip->Id("clip" + std::to_string(index));
+		clip->Layer(layer);
+		clip->Position(slot * clip_length * (1.0 - overlap));
+		clip->End(clip_length);
+
+		// Animate the position, size, rotation and opacity of the clip
+		animate(clip->location_x, keyframe_count, clip_frames, -0.5, 0.5, random);
+		animate(clip->location_y, keyframe_count, clip_frames, -0.5, 0.5, random);
+		animate(clip->scale_x, keyframe_count, clip_frames, 0.25, 1.0, random);
+		animate(clip->scale_y, keyframe_count, clip_frames, 0.25, 1.0, random);
+		animate(clip->rotation, keyframe_count, clip_frames, 0.0, 360.0, random);
+		animate(clip->alpha, keyframe_count, clip_frames, 0.5, 1.0, random);
+
+		for (int effect = 0; effect < effect_count && !effect_types.empty(); effect++) {
+			effects.emplace_back(EffectInfo().CreateEffect(effect_types[effect_type(random)]));
+			clip->AddEffect(effects.back().get());
+		}
+		t.AddClip(clip);
+	}
+
+	// Save the generated project
+	if (!save_path.empty()) {
+		std::ofstream project(save_path.c_str());
+		project << t.Json();
+	}
+
+	// Render the frames (and time each one, and each stage)
+	t.Open();
+	Tracer::Instance()->Start();
+	std::vector<double> render_times;
+	std::chrono::steady_clock::time_point render_start = std::chrono::steady_clock::now();
+	for (int64_t frame = start; frame <= end; frame++) {
+		std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+		t.GetFrame(frame);
+		render_times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+	Tracer::Instance()->Stop();
+
+	// Report the throughput
+	Json::Value root;
+	for (std::map<std::string, double>::iterator itr = options.begin(); itr != options.end(); ++itr)
+		root["options"][itr->first] = itr->second;
+	root["frames"] = Json::Int64(render_times.size());
+	root["seconds"] = seconds;
+	root["fps"] = (seconds > 0.0) ? render_times.size() / seconds : 0.0;
+	root["realtime"] = (seconds > 0.0) ? render_times.size() / seconds / fps.ToDouble() : 0.0;
+	std::sort(render_times.begin(), render_times.end());
+	root["render_ms"]["median"] = render_times[render_times.size() / 2];
+	root["render_ms"]["p95"] = render_times[std::min(render_times.size() - 1, render_times.size() * 95 / 100)];
+	root["render_ms"]["max"] = render_times.back();
+	root["peak_memory"] = Json::Int64(peak_memory());
+	root["stages"] = Tracer::Instance()->StageValue();
+	root["metrics"] = t.MetricsValue();
+	t.Close();
+
+	std::cerr << render_times.size() << " frames, " << root["fps"].asDouble() << " fps, peak memory "
+			  << root["peak_memory"].asInt64() / (1024 * 1024) << " MB" << std::endl;
+	if (output_path.empty())
+		std::cout << root.toStyledString();
+	else {
+		std::ofstream output(output_path.c_str());
+		output << root.toStyledString();
+	}
+	return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Source file for Render Worker Executable (renders the segments sent by a RenderCoordinator)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <string>
+#include "../../include/OpenShot.h"
+
+using namespace openshot;
+
+// Usage: openshot-render-worker <coordinator endpoint> [work folder]
+//
+// Connects to a RenderCoordinator (i.e. tcp://coordinator:5570), and renders the segments it sends until the
+// export is finished. Run one worker per render node (each worker renders on all cores of its node).
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <coordinator endpoint> [work folder]" << std::endl;
+		return 1;
+	}
+	std::string work_path = (argc > 2) ? argv[2] : ".";
+
+	RenderWorker worker(argv[1], work_path);
+	int rendered = worker.Run();
+	std::cerr << rendered << " segments rendered" << std::endl;
+	return 0;
+}
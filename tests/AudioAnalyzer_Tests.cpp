@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::AudioAnalyzer
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+
+using namespace std;
+using namespace openshot;
+
+TEST(AudioAnalyzer_Chunks)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+
+	// Analyze the whole file at once, and in chunks of 10 seconds
+	Settings::Instance()->AUDIO_ANALYSIS_CHUNK = 1000;
+	std::shared_ptr<AudioAnalysis> whole = AudioAnalyzer::Analyze(path.str());
+	Settings::Instance()->AUDIO_ANALYSIS_CHUNK = 10;
+	std::shared_ptr<AudioAnalysis> chunked = AudioAnalyzer::Analyze(path.str());
+	Settings::Instance()->AUDIO_ANALYSIS_CHUNK = 60;
+
+	CHECK_EQUAL(48000, whole->sample_rate);
+	CHECK_EQUAL(2, whole->channels);
+	CHECK(whole->sample_count > 0);
+	CHECK_EQUAL(whole->sample_count, chunked->sample_count);
+	CHECK(whole->integrated_loudness > -70.0);
+	CHECK(whole->integrated_loudness < 0.0);
+	CHECK_CLOSE(whole->integrated_loudness, chunked->integrated_loudness, 0.1);
+	CHECK_CLOSE(whole->sample_peak, chunked->sample_peak, 0.01);
+
+	// The pyramid ends with a single peak (the peak of the whole file)
+	CHECK_EQUAL(1, chunked->PeakCount(chunked->peaks.size() - 1));
+	std::vector<float> minimums, maximums;
+	chunked->GetPeaks(0, chunked->sample_count, 100, 0, minimums, maximums);
+	CHECK_EQUAL(100, (int) maximums.size());
+	for (int column = 0; column < 100; column++) {
+		CHECK(minimums[column] <= maximums[column]);
+		CHECK(maximums[column] <= 1.0);
+	}
+}
+
+TEST(AudioAnalyzer_Save_Load)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	QDir folder(QDir::temp().filePath("libopenshot-audio-analysis"));
+	folder.removeRecursively();
+	Settings::Instance()->AUDIO_ANALYSIS_PATH = folder.path().toStdString();
+
+	// The first analysis is saved, and loaded the next time
+	std::shared_ptr<AudioAnalysis> analysis = AudioAnalyzer::Get(path.str());
+	CHECK(QFileInfo(QString::fromStdString(AudioAnalyzer::AnalysisPath(path.str()))).exists());
+	std::shared_ptr<AudioAnalysis> loaded = AudioAnalyzer::Get(path.str());
+	CHECK_EQUAL(analysis->sample_count, loaded->sample_count);
+	CHECK_EQUAL((int) analysis->peaks.size(), (int) loaded->peaks.size());
+	CHECK_CLOSE(analysis->integrated_loudness, loaded->integrated_loudness, 0.0001);
+	CHECK_CLOSE(analysis->peaks[0][1], loaded->peaks[0][1], 0.0001);
+
+	// The gain which normalizes the file to -23 LUFS (or less, so the peaks stay below -1 dBFS)
+	double gain = 20.0 * log10(loaded->NormalizationGain(-23.0));
+	CHECK(loaded->integrated_loudness + gain <= -23.0 + 0.01);
+	CHECK(loaded->sample_peak + gain <= -1.0 + 0.01);
+
+	Settings::Instance()->AUDIO_ANALYSIS_PATH = "";
+	folder.removeRecursively();
+}
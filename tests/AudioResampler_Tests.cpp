@@ -0,0 +1,173 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::AudioResampler (and the polyphase filter kernels)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include "ScopedSetting.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace openshot;
+
+TEST(AudioResampler_Polyphase_Filter_Kernels)
+{
+	// Random input samples and filter banks (with and without whole vectors of taps)
+	srand(7);
+	vector<float> input(4096);
+	for (float &sample : input)
+		sample = float(rand()) / RAND_MAX * 2.0f - 1.0f;
+
+	const int phase_count = 32;
+	const int tap_counts[] = { 8, 12, 32, 40, 128 };
+	const double steps[] = { 0.5, 0.91875, 1.0, 1.088435, 2.0, 3.0 };
+	// Sample counts which are not multiples of the vector widths (and leave a tail)
+	const int sample_counts[] = { 1, 3, 5, 7, 13, 101, 1000 };
+
+	for (int tap_count : tap_counts)
+	{
+		vector<float> filters((phase_count + 1) * tap_count);
+		for (float &tap : filters)
+			tap = float(rand()) / RAND_MAX - 0.5f;
+
+		for (double step : steps)
+			for (int sample_count : sample_counts)
+			{
+				// Filter with the vectorized kernels, and with the scalar kernel
+				double position = 64.25;
+				vector<float> simd_samples(sample_count, 0.0f);
+				AudioKernels::PolyphaseFilter(simd_samples.data(), sample_count, input.data(), position, step,
+											  filters.data(), phase_count, tap_count);
+
+				vector<float> scalar_samples(sample_count, 0.0f);
+				{
+					ScopedSetting<bool> simd_effects(Settings::Instance()->SIMD_EFFECTS, false);
+					AudioKernels::PolyphaseFilter(scalar_samples.data(), sample_count, input.data(), position, step,
+												  filters.data(), phase_count, tap_count);
+				}
+
+				// Check that every sample matches (within the rounding of a different order of additions)
+				float max_difference = 0.0f;
+				for (int sample = 0; sample < sample_count; sample++)
+					max_difference = std::max(max_difference, fabs(simd_samples[sample] - scalar_samples[sample]));
+				CHECK(max_difference < 1e-4f);
+
+				// Check the last sample (the tail of the vectorized kernels) against a direct dot product
+				double sample_position = position + step * (sample_count - 1);
+				int64_t base = (int64_t) floor(sample_position);
+				double phase = (sample_position - base) * phase_count;
+				int filter_index = std::min((int) phase, phase_count - 1);
+				const float *window = input.data() + base - tap_count / 2 + 1;
+				const float *filter = filters.data() + filter_index * tap_count;
+				double sum0 = 0.0, sum1 = 0.0;
+				for (int index = 0; index < tap_count; index++) {
+					sum0 += window[index] * filter[index];
+					sum1 += window[index] * filter[index + tap_count];
+				}
+				double expected = sum0 + (sum1 - sum0) * (phase - filter_index);
+				CHECK_CLOSE(expected, simd_samples[sample_count - 1], 1e-4);
+			}
+	}
+}
+
+TEST(AudioResampler_Sine)
+{
+	const double sample_rates[][2] = { {44100, 48000}, {48000, 44100}, {44100, 22050}, {22050, 44100} };
+	const int channel_counts[] = { 1, 2, 6 };
+	// Block sizes which don't divide evenly by the ratios (or the vector widths)
+	const int block_sizes[] = { 1024, 735, 97 };
+
+	for (const auto &rates : sample_rates)
+		for (int channels : channel_counts)
+			for (int block_size : block_sizes)
+			{
+				AudioResampler resampler;
+				juce::AudioSampleBuffer buffer(channels, block_size);
+				int64_t input_position = 0;
+				float max_error = 0.0f;
+
+				for (int block = 0; block < 12; block++)
+				{
+					// A different sine on each channel (so mixed up channels are detected)
+					for (int channel = 0; channel < channels; channel++)
+						for (int sample = 0; sample < block_size; sample++)
+							buffer.setSample(channel, sample,
+											 sin(2.0 * M_PI * 440.0 * (channel + 1) * (input_position + sample) / rates[0]));
+
+					resampler.SetBuffer(&buffer, rates[0], rates[1]);
+					juce::AudioSampleBuffer *resampled = resampler.GetResampledBuffer();
+					int resampled_samples = resampled->getNumSamples();
+					CHECK_EQUAL(channels, resampled->getNumChannels());
+					CHECK_EQUAL(max(0, int(round(block_size * rates[1] / rates[0])) - 1), resampled_samples);
+
+					// The resampled samples span the new block (delayed by 64 input samples), so each block
+					// continues exactly where the previous one ended
+					double step = double(block_size) / resampled_samples;
+					for (int channel = 0; channel < channels; channel++)
+						for (int sample = 0; sample < resampled_samples; sample++)
+						{
+							double position = input_position - 64 + sample * step;
+							// Skip the silence before the first samples (and the filter's ramp up)
+							if (position < 128)
+								continue;
+							double expected = sin(2.0 * M_PI * 440.0 * (channel + 1) * position / rates[0]);
+							max_error = std::max(max_error, float(fabs(resampled->getSample(channel, sample) - expected)));
+						}
+					input_position += block_size;
+				}
+
+				// Check the samples of the resampled sine
+				CHECK(max_error < 1e-3f);
+			}
+}
+
+TEST(AudioResampler_Reset)
+{
+	AudioResampler resampler;
+	juce::AudioSampleBuffer buffer(2, 512);
+
+	// Resample a loud block, then forget it
+	for (int channel = 0; channel < 2; channel++)
+		for (int sample = 0; sample < 512; sample++)
+			buffer.setSample(channel, sample, 1.0f);
+	resampler.SetBuffer(&buffer, 44100, 48000);
+	resampler.GetResampledBuffer();
+	resampler.Reset();
+
+	// A silent block after a reset is silent (nothing is left of the previous block)
+	buffer.clear();
+	resampler.SetBuffer(&buffer, 44100, 48000);
+	juce::AudioSampleBuffer *resampled = resampler.GetResampledBuffer();
+	CHECK_EQUAL(556, resampled->getNumSamples());
+	CHECK_EQUAL(0.0f, resampled->getMagnitude(0, resampled->getNumSamples()));
+}
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::AudioRingBuffer
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace openshot;
+
+TEST(AudioRingBuffer_Empty_And_Full)
+{
+	AudioRingBuffer ring(2, 8);
+	CHECK_EQUAL(2, ring.Channels());
+	CHECK_EQUAL(8, ring.Capacity());
+	CHECK_EQUAL(0, ring.Available());
+	CHECK_EQUAL(8, ring.Space());
+
+	// Nothing can be read from an empty ring
+	float left[10] = { 0 };
+	float right[10] = { 0 };
+	float *output[2] = { left, right };
+	CHECK_EQUAL(0, ring.Read(output, 2, 0, 4));
+
+	// Only the space of the ring is written
+	float input_left[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	float input_right[10] = { -1, -2, -3, -4, -5, -6, -7, -8, -9, -10 };
+	const float *input[2] = { input_left, input_right };
+	CHECK_EQUAL(8, ring.Write(input, 2, 0, 10));
+	CHECK_EQUAL(8, ring.Available());
+	CHECK_EQUAL(0, ring.Space());
+	CHECK_EQUAL(8, ring.WritePosition());
+
+	// Nothing can be written to a full ring
+	CHECK_EQUAL(0, ring.Write(input, 2, 8, 2));
+
+	// Only the available samples are read (at an offset)
+	CHECK_EQUAL(8, ring.Read(output, 2, 2, 10));
+	CHECK_EQUAL(0, ring.Available());
+	CHECK_EQUAL(0.0f, left[1]);
+	for (int index = 0; index < 8; index++) {
+		CHECK_EQUAL(input_left[index], left[index + 2]);
+		CHECK_EQUAL(input_right[index], right[index + 2]);
+	}
+}
+
+TEST(AudioRingBuffer_Wrap_Around)
+{
+	AudioRingBuffer ring(1, 5);
+	float input_samples[7] = { 1, 2, 3, 4, 5, 6, 7 };
+	const float *input[1] = { input_samples };
+	float output_samples[7] = { 0 };
+	float *output[1] = { output_samples };
+
+	// Move the positions near the end of the buffer
+	CHECK_EQUAL(3, ring.Write(input, 1, 0, 3));
+	CHECK_EQUAL(3, ring.Read(output, 1, 0, 3));
+
+	// Write and read samples which wrap around the end of the buffer (several times)
+	for (int pass = 0; pass < 4; pass++) {
+		CHECK_EQUAL(4, ring.Write(input, 1, 3, 4));
+		CHECK_EQUAL(4, ring.Available());
+		CHECK_EQUAL(4, ring.Read(output, 1, 0, 7));
+		CHECK_EQUAL(4.0f, output_samples[0]);
+		CHECK_EQUAL(5.0f, output_samples[1]);
+		CHECK_EQUAL(6.0f, output_samples[2]);
+		CHECK_EQUAL(7.0f, output_samples[3]);
+	}
+	CHECK_EQUAL(19, ring.WritePosition());
+}
+
+TEST(AudioRingBuffer_Missing_Channels_And_Discard)
+{
+	AudioRingBuffer ring(2, 16);
+	float input_samples[4] = { 1, 2, 3, 4 };
+	const float *input[1] = { input_samples };
+
+	// A missing channel is written as silence
+	CHECK_EQUAL(4, ring.Write(input, 1, 0, 4));
+	float left[4] = { 0 };
+	float right[4] = { 9, 9, 9, 9 };
+	float *output[2] = { left, right };
+	CHECK_EQUAL(2, ring.Read(output, 2, 0, 2));
+	CHECK_EQUAL(2.0f, left[1]);
+	CHECK_EQUAL(0.0f, right[1]);
+
+	// Discard drops the samples before a write position (but never past the written samples)
+	int64_t position = ring.WritePosition();
+	CHECK_EQUAL(4, ring.Write(input, 1, 0, 4));
+	ring.Discard(position);
+	CHECK_EQUAL(4, ring.Available());
+	ring.Discard(position + 100);
+	CHECK_EQUAL(0, ring.Available());
+	CHECK_EQUAL(16, ring.Space());
+}
+
+TEST(AudioRingBuffer_Producer_Consumer)
+{
+	// A small ring, so the producer and consumer fill and drain it many times (in blocks which don't divide it)
+	const int sample_count = 200000;
+	AudioRingBuffer ring(2, 1000);
+
+	std::thread producer([&ring, sample_count]() {
+		std::vector<float> left(37);
+		std::vector<float> right(37);
+		const float *input[2] = { left.data(), right.data() };
+		int written = 0;
+		while (written < sample_count) {
+			int count = std::min(int(left.size()), sample_count - written);
+			for (int index = 0; index < count; index++) {
+				left[index] = written + index;
+				right[index] = -(written + index);
+			}
+			int block_written = 0;
+			while (block_written < count) {
+				int result = ring.Write(input, 2, block_written, count - block_written);
+				if (result == 0)
+					std::this_thread::yield();
+				block_written += result;
+			}
+			written += count;
+		}
+	});
+
+	// The consumer reads every sample once, in order
+	std::vector<float> left(53);
+	std::vector<float> right(53);
+	float *output[2] = { left.data(), right.data() };
+	int read = 0;
+	int mismatches = 0;
+	while (read < sample_count) {
+		int count = ring.Read(output, 2, 0, left.size());
+		if (count == 0)
+			std::this_thread::yield();
+		for (int index = 0; index < count; index++)
+			if (left[index] != float(read + index) || right[index] != -float(read + index))
+				mismatches++;
+		read += count;
+	}
+	producer.join();
+
+	CHECK_EQUAL(0, mismatches);
+	CHECK_EQUAL(sample_count, read);
+	CHECK_EQUAL(0, ring.Available());
+	CHECK_EQUAL(sample_count, ring.WritePosition());
+}
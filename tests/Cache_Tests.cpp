@@ -33,6 +33,7 @@
 #define DONT_SET_USING_JUCE_NAMESPACE 1
 #include "../include/OpenShot.h"
 #include "../include/Json.h"
+#include "ScopedSetting.h"
 
 using namespace openshot;
 
@@ -304,6 +305,178 @@ TEST(Cache_Multiple_Remove)
 	CHECK_EQUAL(0, c.Count());
 }
 
+TEST(Cache_Least_Recently_Used)
+{
+	// Create memory cache object
+	CacheMemory c;
+
+	// Add frames to the cache
+	for (int i = 1; i <= 30; i++)
+	{
+		std::shared_ptr<Frame> f(new Frame(i, 320, 240, "#000000", 500, 2));
+		c.Add(f);
+	}
+
+	// Running byte total should match the cached frames
+	int64_t frame_bytes = c.GetFrame(1)->GetBytes();
+	CHECK_EQUAL(30 * frame_bytes, c.GetBytes());
+
+	// Freshen the oldest frame, and limit the cache to 25 frames
+	c.Add(c.GetFrame(1));
+	c.SetMaxBytes(25 * frame_bytes);
+	c.Add(std::shared_ptr<Frame>(new Frame(31, 320, 240, "#000000", 500, 2)));
+
+	// Least recently used frames (2 through 7) should be evicted
+	CHECK_EQUAL(25, c.Count());
+	CHECK_EQUAL(25 * frame_bytes, c.GetBytes());
+	CHECK(c.GetFrame(1) != NULL);
+	CHECK(c.GetFrame(7) == NULL);
+	CHECK(c.GetFrame(8) != NULL);
+	CHECK_EQUAL(1, c.GetSmallestFrame()->number);
+
+	// Removing frames should also update the byte total
+	c.Remove(8, 12);
+	CHECK_EQUAL(20, c.Count());
+	CHECK_EQUAL(20 * frame_bytes, c.GetBytes());
+}
+
+TEST(Cache_Shared_Image_Bytes)
+{
+	// Create memory cache object
+	CacheMemory c;
+
+	// Frame size includes the image buffer and every audio channel
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "#000000", 500, 6));
+	f1->AddColor(320, 240, "Blue");
+	int64_t image_bytes = f1->GetImage()->bytesPerLine() * 240;
+	int64_t audio_bytes = 6 * 500 * sizeof(float);
+	CHECK_EQUAL(image_bytes, f1->GetImageBytes());
+	CHECK_EQUAL(image_bytes + audio_bytes, f1->GetBytes());
+	c.Add(f1);
+
+	// Frames sharing the same image buffer only count it once
+	std::shared_ptr<Frame> f2(new Frame(2, 320, 240, "#000000", 500, 6));
+	f2->AddImage(std::shared_ptr<QImage>(new QImage(*f1->GetImage())));
+	c.Add(f2);
+	CHECK_EQUAL(image_bytes + 2 * audio_bytes, c.GetBytes());
+
+	// Buffer is counted until the last frame sharing it is removed
+	c.Remove(1);
+	CHECK_EQUAL(image_bytes + audio_bytes, c.GetBytes());
+	c.Remove(2);
+	CHECK_EQUAL(0, c.GetBytes());
+}
+
+TEST(Cache_Deduplicate_Images)
+{
+	CacheMemory c;
+	c.SetDeduplicateImages(true);
+
+	// Frames with identical images (in separate buffers)
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "#000000", 500, 2));
+	f1->AddColor(320, 240, "Blue");
+	std::shared_ptr<Frame> f2(new Frame(2, 320, 240, "#000000", 500, 2));
+	f2->AddColor(320, 240, "Blue");
+	std::shared_ptr<Frame> f3(new Frame(3, 320, 240, "#000000", 500, 2));
+	f3->AddColor(320, 240, "Red");
+	int64_t image_bytes = f1->GetImageBytes();
+	int64_t audio_bytes = 2 * 500 * sizeof(float);
+	CHECK(f1->GetImage()->constBits() != f2->GetImage()->constBits());
+
+	// The identical images share one buffer (which is counted once)
+	c.Add(f1);
+	c.Add(f2);
+	c.Add(f3);
+	CHECK(c.GetFrame(1)->GetImage()->constBits() == c.GetFrame(2)->GetImage()->constBits());
+	CHECK(c.GetFrame(1)->GetImage()->constBits() != c.GetFrame(3)->GetImage()->constBits());
+	CHECK_EQUAL(2 * image_bytes + 3 * audio_bytes, c.GetBytes());
+
+	// Writing to a shared image detaches a private copy
+	c.GetFrame(2)->GetImage()->setPixel(0, 0, qRgb(0, 255, 0));
+	CHECK_EQUAL(QColor("Blue").rgba(), c.GetFrame(1)->GetImage()->pixel(0, 0));
+
+	// The shared buffer is counted until the last frame sharing it is removed
+	c.Remove(1);
+	CHECK_EQUAL(2 * image_bytes + 2 * audio_bytes, c.GetBytes());
+}
+
+TEST(Cache_Global_Memory_Limit)
+{
+	// Limit all memory caches combined to 50 frames
+	int64_t frame_bytes = Frame(1, 320, 240, "#000000", 500, 2).GetBytes();
+	ScopedSetting<int64_t> memory_limit(Settings::Instance()->CACHE_MEMORY_LIMIT, 50 * frame_bytes);
+
+	// Fill two caches (which have no limit of their own)
+	CacheMemory c1;
+	CacheMemory c2;
+	for (int i = 1; i <= 30; i++)
+		c1.Add(std::shared_ptr<Frame>(new Frame(i, 320, 240, "#000000", 500, 2)));
+	for (int i = 1; i <= 30; i++)
+		c2.Add(std::shared_ptr<Frame>(new Frame(i, 320, 240, "#000000", 500, 2)));
+
+	// Least recently used frames of all caches are evicted first
+	CHECK_EQUAL(20, c1.Count());
+	CHECK_EQUAL(30, c2.Count());
+	CHECK(c1.GetFrame(10) == NULL);
+	CHECK(c1.GetFrame(11) != NULL);
+	CHECK(CacheBudget::Instance()->GetBytes() <= 50 * frame_bytes);
+}
+
+TEST(Cache_Playhead_Eviction)
+{
+	// Create memory cache object, which keeps the frames around the playhead
+	CacheMemory c;
+	c.SetEvictionPolicy(EVICT_FAR_FROM_PLAYHEAD);
+	CHECK_EQUAL(EVICT_FAR_FROM_PLAYHEAD, c.GetEvictionPolicy());
+
+	// Add frames to the cache
+	for (int i = 1; i <= 40; i++)
+		c.Add(std::shared_ptr<Frame>(new Frame(i, 320, 240, "#000000", 500, 2)));
+
+	// Seek back to frame 10 (playing forward), and limit the cache to 25 frames
+	int64_t frame_bytes = c.GetFrame(1)->GetBytes();
+	c.SetPlayhead(10, 1);
+	c.SetMaxBytes(25 * frame_bytes);
+	c.Add(std::shared_ptr<Frame>(new Frame(41, 320, 240, "#000000", 500, 2)));
+
+	// Frames far ahead of the playhead are evicted (instead of the least recently used frames)
+	CHECK_EQUAL(25, c.Count());
+	CHECK(c.GetFrame(1) == NULL);
+	CHECK(c.GetFrame(2) != NULL);
+	CHECK(c.GetFrame(26) != NULL);
+	CHECK(c.GetFrame(27) == NULL);
+	CHECK(c.GetFrame(41) == NULL);
+}
+
+TEST(Cache_Compressed_Images)
+{
+	// Create memory cache object, which compresses frame images
+	CacheMemory c;
+	c.SetCompressImages(true);
+
+	// Add a frame with picture and audio data
+	std::shared_ptr<Frame> f(new Frame(1, 1280, 720, "#000000", 500, 2));
+	f->AddColor(1280, 720, "Blue");
+	float samples[500];
+	for (int s = 0; s < 500; s++)
+		samples[s] = s / 1000.0;
+	f->AddAudio(true, 0, 0, samples, 500, 1.0);
+	c.Add(f);
+
+	// Compressed frame uses much less memory than the raw image
+	CHECK(c.GetBytes() < f->GetImageBytes() / 4);
+
+	// Decompressed frame matches the original frame
+	std::shared_ptr<Frame> cached = c.GetFrame(1);
+	CHECK(cached != f);
+	CHECK_EQUAL(1280, cached->GetWidth());
+	CHECK_EQUAL(720, cached->GetHeight());
+	CHECK(cached->CheckPixel(100, 100, 0, 0, 255, 255, 0));
+	CHECK_EQUAL(2, cached->GetAudioChannelsCount());
+	CHECK_EQUAL(500, cached->GetAudioSamplesCount());
+	CHECK_CLOSE(0.25, cached->GetAudioSamples(0)[250], 0.00001);
+}
+
 TEST(CacheDisk_Set_Max_Bytes)
 {
 	// Create cache object (using platform /temp/ directory)
@@ -355,6 +528,116 @@ TEST(CacheDisk_Set_Max_Bytes)
 	path.removeRecursively();
 }
 
+TEST(CacheDisk_Binary_Format)
+{
+	// Create cache object, using the binary frame format (using platform /temp/ directory)
+	CacheDisk c("", "RAW", 1.0, 0.25);
+
+	// Add a frame with picture and audio data
+	std::shared_ptr<Frame> f(new Frame());
+	f->number = 1;
+	f->AddColor(1280, 720, "Blue");
+	f->ResizeAudio(2, 500, 44100, LAYOUT_STEREO);
+	f->AddAudioSilence(500);
+	float samples[500];
+	for (int s = 0; s < 500; s++)
+		samples[s] = s / 1000.0;
+	f->AddAudio(true, 1, 0, samples, 500, 1.0);
+	c.Add(f);
+
+	// Read frame from disk cache
+	std::shared_ptr<Frame> cached = c.GetFrame(1);
+	CHECK_EQUAL(320, cached->GetWidth());
+	CHECK_EQUAL(180, cached->GetHeight());
+	CHECK(cached->CheckPixel(10, 10, 0, 0, 255, 255, 0));
+	CHECK_EQUAL(2, cached->GetAudioChannelsCount());
+	CHECK_EQUAL(500, cached->GetAudioSamplesCount());
+	CHECK_EQUAL(LAYOUT_STEREO, cached->ChannelsLayout());
+	CHECK_EQUAL(44100, cached->SampleRate());
+	CHECK_CLOSE(0.0, cached->GetAudioSamples(0)[250], 0.00001);
+	CHECK_CLOSE(0.25, cached->GetAudioSamples(1)[250], 0.00001);
+
+	// Delete cache directory
+	c.Clear();
+	QDir path = QDir::tempPath() + QString("/preview-cache/");
+	path.removeRecursively();
+}
+
+TEST(CacheDisk_Write_Behind)
+{
+	// Create cache object, which writes frames on a background thread (using platform /temp/ directory)
+	CacheDisk c("", "PPM", 1.0, 0.25);
+	c.SetWriteBehind(true, 4);
+
+	// Add frames to disk cache
+	for (int i = 1; i <= 10; i++)
+	{
+		std::shared_ptr<Frame> f(new Frame(i, 1280, 720, "Blue", 500, 2));
+		c.Add(f);
+	}
+	CHECK_EQUAL(10, c.Count());
+
+	// Remove a frame (which might not be written yet)
+	c.Remove(5);
+
+	// Wait for frames to be written, and read them back from disk
+	c.Flush();
+	CHECK_EQUAL(9, c.Count());
+	CHECK(c.GetFrame(5) == NULL);
+	std::shared_ptr<Frame> f = c.GetFrame(10);
+	CHECK_EQUAL(320, f->GetWidth());
+	CHECK_EQUAL(180, f->GetHeight());
+	CHECK_EQUAL(2, f->GetAudioChannelsCount());
+	CHECK_EQUAL(500, f->GetAudioSamplesCount());
+	CHECK(!QFile(QDir::tempPath() + QString("/preview-cache/5.ppm")).exists());
+
+	// Delete cache directory
+	c.SetWriteBehind(false);
+	c.Clear();
+	QDir path = QDir::tempPath() + QString("/preview-cache/");
+	path.removeRecursively();
+}
+
+TEST(CacheTiered_Demote_And_Promote)
+{
+	// Create a tiered cache, which holds 25 frames in memory (and unlimited frames on disk)
+	int64_t frame_bytes = Frame(1, 320, 240, "#000000", 500, 2).GetBytes();
+	std::string cache_path = (QDir::tempPath() + QString("/tiered-cache/")).toStdString();
+	CacheTiered c(25 * frame_bytes, cache_path, "RAW", 1.0, 1.0, 0);
+
+	// Add frames to the cache
+	for (int i = 1; i <= 30; i++)
+	{
+		std::shared_ptr<Frame> f(new Frame(i, 320, 240, "#000000", 500, 2));
+		c.Add(f);
+	}
+
+	// Oldest frames are demoted to disk (instead of dropped)
+	CHECK_EQUAL(30, c.Count());
+	CHECK_EQUAL(25, c.GetMemoryCache()->Count());
+	CHECK_EQUAL(5, c.GetDiskCache()->Count());
+	CHECK_EQUAL(1, c.JsonValue()["ranges"].size());
+
+	// Disk hits are promoted back into memory
+	std::shared_ptr<Frame> f = c.GetFrame(1);
+	CHECK_EQUAL(1, f->number);
+	CHECK_EQUAL(320, f->GetWidth());
+	CHECK(c.GetMemoryCache()->GetFrame(1) != NULL);
+	CHECK(c.GetDiskCache()->GetFrame(1) == NULL);
+	CHECK_EQUAL(30, c.Count());
+	CHECK_EQUAL(1, c.GetSmallestFrame()->number);
+
+	// Remove frames from both tiers
+	c.Remove(1, 10);
+	CHECK_EQUAL(20, c.Count());
+	CHECK(c.GetFrame(5) == NULL);
+
+	// Delete cache directory
+	c.Clear();
+	QDir path = QString::fromStdString(cache_path);
+	path.removeRecursively();
+}
+
 TEST(CacheDisk_Multiple_Remove)
 {
 	// Create cache object (using platform /temp/ directory)
@@ -462,4 +745,199 @@ TEST(CacheMemory_JSON)
 	CHECK_EQUAL(1, c.JsonValue()["ranges"].size());
 	CHECK_EQUAL("5", c.JsonValue()["version"].asString());
 
+	// Remove a frame from the middle (splitting the range)
+	c.Remove(3);
+	Json::Value ranges = c.JsonValue()["ranges"];
+	CHECK_EQUAL(2, ranges.size());
+	CHECK_EQUAL("1", ranges[0]["start"].asString());
+	CHECK_EQUAL("2", ranges[0]["end"].asString());
+	CHECK_EQUAL("4", ranges[1]["start"].asString());
+	CHECK_EQUAL("5", ranges[1]["end"].asString());
+	CHECK_EQUAL(6, c.RangeVersion());
+
+	// Range version only changes when the cache changes
+	CHECK_EQUAL(6, c.RangeVersion());
+	c.Remove(4, 10);
+	CHECK_EQUAL(1, c.JsonValue()["ranges"].size());
+	CHECK_EQUAL(7, c.RangeVersion());
+	CHECK_EQUAL(2, c.Count());
+
+}
+
+TEST(Cache_Metrics)
+{
+	// Create cache object (too small for all the frames)
+	CacheMemory c(250 * 1024);
+
+	// Add 30 frames (only 20 are kept)
+	for (int i = 30; i > 0; i--)
+	{
+		std::shared_ptr<Frame> f(new Frame(i, 320, 240, "#000000"));
+		f->AddColor(320, 240, "#000000");
+		c.Add(f);
+	}
+
+	// Look up 2 cached frames and 1 evicted frame
+	CHECK(c.GetFrame(1) != NULL);
+	CHECK(c.GetFrame(2) != NULL);
+	CHECK(c.GetFrame(30) == NULL);
+
+	Json::Value metrics = c.MetricsValue();
+	CHECK_EQUAL("CacheMemory", metrics["type"].asString());
+	CHECK_EQUAL(2, metrics["hits"].asInt());
+	CHECK_EQUAL(1, metrics["misses"].asInt());
+	CHECK_EQUAL(10, metrics["evictions"].asInt());
+	CHECK_EQUAL(20, metrics["frames"].asInt());
+	CHECK_CLOSE(2.0 / 3.0, metrics["hit_rate"].asDouble(), 0.0001);
+
+	// Reset the counters (the cached frames are kept)
+	c.ResetMetrics();
+	metrics = c.MetricsValue();
+	CHECK_EQUAL(0, metrics["hits"].asInt());
+	CHECK_EQUAL(0, metrics["misses"].asInt());
+	CHECK_EQUAL(0, metrics["evictions"].asInt());
+	CHECK_EQUAL(20, metrics["frames"].asInt());
+}
+
+TEST(Cache_Memory_Tags)
+{
+	MemoryGauge &cache_memory = Metrics::Instance()->GetMemory("cache.test");
+	MemoryGauge &image_memory = Metrics::Instance()->GetMemory("images.test");
+
+	// The frames of a cache count towards its memory gauge
+	CacheMemory c;
+	c.SetMemoryTag("cache.test");
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "#000000"));
+	f1->AddColor(320, 240, "#000000");
+	c.Add(f1);
+	CHECK_EQUAL(c.GetBytes(), cache_memory.Current());
+	CHECK(cache_memory.Current() > 0);
+	int64_t peak = cache_memory.Peak();
+
+	c.Clear();
+	CHECK_EQUAL(0, cache_memory.Current());
+	CHECK_EQUAL(peak, cache_memory.Peak());
+	cache_memory.ResetPeak();
+	CHECK_EQUAL(0, cache_memory.Peak());
+
+	// Pooled images are charged to the tag of the thread which created them (until they are freed)
+	{
+		std::shared_ptr<QImage> image;
+		{
+			ScopedMemoryTag memory_tag(image_memory);
+			CHECK_EQUAL(&image_memory, ScopedMemoryTag::Current());
+			image = ImageBufferPool::CreateImage(320, 240, QImage::Format_RGBA8888_Premultiplied);
+		}
+		CHECK(ScopedMemoryTag::Current() != &image_memory);
+		CHECK(image_memory.Current() >= 320 * 240 * 4);
+	}
+	CHECK_EQUAL(0, image_memory.Current());
+
+	// The gauges are reported by the metrics registry
+	Json::Value memory = Metrics::Instance()->MemoryValue();
+	CHECK(memory["images.test"]["peak"].asInt64() >= 320 * 240 * 4);
+}
+
+TEST(Frame_Image_Buffer_Pool)
+{
+	ImageBufferPool *pool = ImageBufferPool::Instance();
+	pool->Clear();
+	CHECK_EQUAL(0, pool->FreeBytes());
+
+	// Create a frame (whose image uses a pooled buffer)
+	std::shared_ptr<Frame> f1(new Frame(1, 1280, 720, "Blue", 500, 2));
+	const unsigned char *pixels = f1->GetImage()->constBits();
+	CHECK_EQUAL(0, pool->FreeBytes());
+
+	// Releasing the frame returns the buffer to the pool
+	f1.reset();
+	CHECK(pool->FreeBytes() >= 1280 * 720 * 4);
+
+	// The next frame of the same size recycles the buffer
+	std::shared_ptr<Frame> f2(new Frame(2, 1280, 720, "Red", 500, 2));
+	CHECK(f2->GetImage()->constBits() == pixels);
+	CHECK_EQUAL(0, pool->FreeBytes());
+	CHECK_EQUAL(QColor("Red").rgba(), f2->GetImage()->pixel(10, 10));
+}
+
+TEST(Frame_Share_Image)
+{
+	// Share the image of a frame (without copying its pixels)
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "Blue", 500, 2));
+	std::shared_ptr<Frame> f2(new Frame(1, 1, 1, "#000000", 500, 2));
+	f2->ShareImage(f1);
+	CHECK(f1->GetImage()->constBits() == f2->GetImage()->constBits());
+	CHECK(f1->IsImageShared());
+	CHECK(f2->IsImageShared());
+	CHECK_EQUAL(320, f2->GetWidth());
+
+	// Writing to the shared image detaches a private copy (leaving the other frame unchanged)
+	f2->GetImage()->fill(QColor("Red"));
+	CHECK(f1->GetImage()->constBits() != f2->GetImage()->constBits());
+	CHECK(!f1->IsImageShared());
+	CHECK(!f2->IsImageShared());
+	CHECK_EQUAL(QColor("Blue").rgba(), f1->GetImage()->pixel(10, 10));
+	CHECK_EQUAL(QColor("Red").rgba(), f2->GetImage()->pixel(10, 10));
+}
+
+TEST(Frame_Audio_View)
+{
+	// Add audio samples to a frame
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "Blue", 500, 2));
+	float left[500], right[500];
+	for (int sample = 0; sample < 500; sample++) {
+		left[sample] = sample / 1000.0;
+		right[sample] = -sample / 1000.0;
+	}
+	f1->AddAudio(true, 0, 0, left, 500, 1.0);
+	f1->AddAudio(true, 1, 0, right, 500, 1.0);
+
+	// The channels are stored in one contiguous block (each channel aligned to 64 bytes)
+	AudioSamplesView view = f1->GetAudioView();
+	CHECK_EQUAL(2, view.channel_count);
+	CHECK_EQUAL(500, view.sample_count);
+	CHECK_EQUAL(0, ((uintptr_t) view.Channel(0)) % 64);
+	CHECK_EQUAL(0, ((uintptr_t) view.Channel(1)) % 64);
+	CHECK_EQUAL(512, view.Channel(1) - view.Channel(0));
+	CHECK(view.Channel(0) == f1->GetAudioSamples(0));
+	CHECK_CLOSE(0.25, view.Interleaved(500), 0.0001);
+	CHECK_CLOSE(-0.25, view.Interleaved(501), 0.0001);
+
+	// Interleave the samples into a buffer owned by the caller
+	std::vector<float> interleaved(1000);
+	f1->InterleaveAudioSamples(&interleaved[0]);
+	CHECK_CLOSE(0.499, interleaved[998], 0.0001);
+	CHECK_CLOSE(-0.499, interleaved[999], 0.0001);
+
+	// Copies of a frame have their own samples
+	Frame f2(*f1);
+	CHECK(f2.GetAudioSamples(0) != f1->GetAudioSamples(0));
+	CHECK_CLOSE(0.25, f2.GetAudioSamples(0)[250], 0.0001);
+}
+
+TEST(Frame_Shallow_Clone)
+{
+	std::shared_ptr<Frame> f1(new Frame(1, 320, 240, "Blue", 500, 2));
+	float samples[500];
+	for (int sample = 0; sample < 500; sample++)
+		samples[sample] = sample / 1000.0;
+	f1->AddAudio(true, 0, 0, samples, 500, 1.0);
+
+	// A clone reads the same image and samples
+	std::shared_ptr<Frame> f2 = f1->ShallowClone();
+	CHECK(f1->GetImage()->constBits() == f2->GetImage()->constBits());
+	CHECK(f1->GetAudioView().Channel(0) == f2->GetAudioView().Channel(0));
+
+	// Changing the samples of the clone copies them first (leaving the other frame unchanged)
+	f2->ApplyGainRamp(0, 0, 500, 0.0, 0.0);
+	CHECK(f1->GetAudioView().Channel(0) != f2->GetAudioView().Channel(0));
+	CHECK_CLOSE(0.25, f1->GetAudioView().Channel(0)[250], 0.0001);
+	CHECK_CLOSE(0.0, f2->GetAudioView().Channel(0)[250], 0.0001);
+
+	// Moving a frame takes its image and samples
+	const uchar *bits = f1->GetImage()->constBits();
+	Frame f3(std::move(*f1));
+	CHECK(f3.GetImage()->constBits() == bits);
+	CHECK_EQUAL(320, f3.GetWidth());
+	CHECK_CLOSE(0.25, f3.GetAudioView().Channel(0)[250], 0.0001);
 }
@@ -96,6 +96,34 @@ TEST(Clip_Basic_Gettings_and_Setters)
 	CHECK_CLOSE(10.5f, c1.End(), 0.00001);
 }
 
+TEST(Clip_Timeline_Frames)
+{
+	// A clip on a 30 fps timeline, from 5 seconds, with its first 3.5 seconds trimmed
+	Clip c1;
+	c1.Position(5.0);
+	c1.Start(3.5);
+	c1.End(10.5);
+	c1.FrameRate(Fraction(30, 1));
+	CHECK_EQUAL(151, c1.PositionFrame());
+	CHECK_EQUAL(361, c1.EndPositionFrame());
+	CHECK_EQUAL(106, c1.StartFrame());
+
+	// The frames are kept up to date when the clip changes (or the frame rate)
+	c1.Position(1.0);
+	c1.End(4.5);
+	CHECK_EQUAL(31, c1.PositionFrame());
+	CHECK_EQUAL(61, c1.EndPositionFrame());
+	c1.FrameRate(Fraction(24, 1));
+	CHECK_EQUAL(25, c1.PositionFrame());
+	CHECK_EQUAL(49, c1.EndPositionFrame());
+	CHECK_EQUAL(85, c1.StartFrame());
+
+	// A long timeline (9 hours at 29.97 fps)
+	c1.FrameRate(Fraction(30000, 1001));
+	c1.Position(32400.0);
+	CHECK_EQUAL(971030, c1.PositionFrame());
+}
+
 TEST(Clip_Properties)
 {
 	// Create a empty clip
@@ -264,3 +292,629 @@ TEST(Clip_Effects)
 	// Check the # of Effects
 	CHECK_EQUAL(2, c10.Effects().size());
 }
+
+TEST(Clip_Effect_Kernels)
+{
+	// Create a gradient image (with an odd width, so the kernels also process leftover pixels)
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(37, 23, QImage::Format_RGBA8888);
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < image->width(); x++)
+			image->setPixel(x, y, qRgba((x * 7) % 256, (y * 11) % 256, (x * y) % 256, 255));
+
+	// Effects with per-pixel kernels
+	Brightness brightness(Keyframe(0.2), Keyframe(30.0));
+	Saturation saturation(Keyframe(1.8));
+	Hue hue(Keyframe(0.3));
+	ChromaKey chroma_key(Color(70, 80, 90, 255), Keyframe(120.0));
+	EffectBase *effects[] = { &brightness, &saturation, &hue, &chroma_key };
+
+	for (EffectBase *effect : effects)
+	{
+		// Apply the effect with the vectorized kernels, and with the scalar loops
+		std::shared_ptr<Frame> simd_frame = std::make_shared<Frame>(1, 37, 23, "#000000");
+		simd_frame->AddImage(std::make_shared<QImage>(image->copy()));
+		Settings::Instance()->SIMD_EFFECTS = true;
+		effect->GetFrame(simd_frame, 1);
+
+		std::shared_ptr<Frame> scalar_frame = std::make_shared<Frame>(1, 37, 23, "#000000");
+		scalar_frame->AddImage(std::make_shared<QImage>(image->copy()));
+		Settings::Instance()->SIMD_EFFECTS = false;
+		effect->GetFrame(scalar_frame, 1);
+		Settings::Instance()->SIMD_EFFECTS = true;
+
+		// Check that every channel matches (within rounding)
+		const unsigned char *simd_pixels = simd_frame->GetImage()->constBits();
+		const unsigned char *scalar_pixels = scalar_frame->GetImage()->constBits();
+		int max_difference = 0;
+		for (int byte_index = 0; byte_index < 37 * 23 * 4; byte_index++)
+			max_difference = std::max(max_difference, abs(simd_pixels[byte_index] - scalar_pixels[byte_index]));
+		CHECK(max_difference <= 1);
+	}
+}
+
+TEST(Clip_Fused_Effects)
+{
+	// Create a gradient image (larger than one tile of pixels)
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(101, 67, QImage::Format_RGBA8888);
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < image->width(); x++)
+			image->setPixel(x, y, qRgba((x * 5) % 256, (y * 3) % 256, (x + y) % 256, 255));
+
+	// Point-wise effects have pixel kernels (and spatial effects don't)
+	Brightness brightness(Keyframe(-0.1), Keyframe(15.0));
+	Saturation saturation(Keyframe(0.6));
+	Hue hue(Keyframe(0.7));
+	Negate negate;
+	Blur blur;
+	CHECK(blur.GetPixelKernel(1) == nullptr);
+	EffectBase *effects[] = { &brightness, &saturation, &hue, &negate };
+
+	// Apply the effects one at a time
+	std::shared_ptr<Frame> single_frame = std::make_shared<Frame>(1, 101, 67, "#000000");
+	single_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	std::vector<EffectBase::PixelKernel> kernels;
+	for (EffectBase *effect : effects)
+	{
+		single_frame = effect->GetFrame(single_frame, 1);
+		kernels.push_back(effect->GetPixelKernel(1));
+		CHECK(kernels.back() != nullptr);
+	}
+
+	// Apply the fused effects
+	std::shared_ptr<Frame> fused_frame = std::make_shared<Frame>(1, 101, 67, "#000000");
+	fused_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	EffectBase::ApplyPixelKernels(fused_frame, kernels);
+
+	// Check that the images match
+	std::shared_ptr<QImage> single_image = single_frame->GetImage();
+	std::shared_ptr<QImage> fused_image = fused_frame->GetImage();
+	CHECK(single_image->convertToFormat(QImage::Format_RGBA8888) == fused_image->convertToFormat(QImage::Format_RGBA8888));
+}
+
+TEST(Clip_Color_LUT)
+{
+	// Create a gradient image
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(64, 48, QImage::Format_RGBA8888);
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < image->width(); x++)
+			image->setPixel(x, y, qRgba(x * 4, y * 5, (x * y) % 256, 200));
+
+	// An identity LUT leaves the pixels alone
+	ColorLUT identity(17);
+	QImage identity_image = image->copy();
+	identity.Apply(identity_image.bits(), 64 * 48);
+	CHECK(identity_image == *image);
+
+	// Color effects (and their exact kernels)
+	Brightness brightness(Keyframe(0.1), Keyframe(20.0));
+	Saturation saturation(Keyframe(1.4));
+	Hue hue(Keyframe(0.2));
+	Negate negate;
+	CHECK(brightness.IsColorKernel());
+	CHECK(negate.IsColorKernel());
+	CHECK(!ChromaKey().IsColorKernel());
+	std::vector<EffectBase::PixelKernel> kernels;
+	std::vector<bool> color_kernels;
+	EffectBase *effects[] = { &brightness, &saturation, &hue, &negate };
+	for (EffectBase *effect : effects)
+	{
+		kernels.push_back(effect->GetPixelKernel(1));
+		color_kernels.push_back(effect->IsColorKernel());
+	}
+
+	std::shared_ptr<Frame> exact_frame = std::make_shared<Frame>(1, 64, 48, "#000000");
+	exact_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	EffectBase::ApplyPixelKernels(exact_frame, kernels, color_kernels);
+
+	// Bake the effects into a LUT
+	Settings::Instance()->EFFECT_LUT_SIZE = 33;
+	std::shared_ptr<Frame> lut_frame = std::make_shared<Frame>(1, 64, 48, "#000000");
+	lut_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	EffectBase::ApplyPixelKernels(lut_frame, kernels, color_kernels);
+	Settings::Instance()->EFFECT_LUT_SIZE = 0;
+
+	// Check that the interpolated colors are close, and the alpha values are untouched
+	const unsigned char *exact_pixels = exact_frame->GetImage()->constBits();
+	const unsigned char *lut_pixels = lut_frame->GetImage()->constBits();
+	int max_difference = 0;
+	for (int byte_index = 0; byte_index < 64 * 48 * 4; byte_index += 4)
+	{
+		for (int channel = 0; channel < 3; channel++)
+			max_difference = std::max(max_difference, abs(exact_pixels[byte_index + channel] - lut_pixels[byte_index + channel]));
+		CHECK_EQUAL(200, (int) lut_pixels[byte_index + 3]);
+	}
+	CHECK(max_difference <= 8);
+}
+
+TEST(Clip_Effect_Region)
+{
+	// Create a gray image
+	std::shared_ptr<Frame> frame = std::make_shared<Frame>(1, 80, 60, "#000000");
+	frame->AddImage(std::make_shared<QImage>(80, 60, QImage::Format_RGBA8888));
+	frame->GetImage()->fill(qRgba(100, 100, 100, 255));
+
+	// Pixelate only changes the area inside its margins
+	Pixelate pixelate(Keyframe(0.5), Keyframe(0.25), Keyframe(0.5), Keyframe(0.0), Keyframe(0.0));
+	CHECK(pixelate.RegionOfInterest(1, QSize(80, 60)) == QRect(20, 30, 60, 30));
+	pixelate.pixelization = Keyframe(1.0);
+	CHECK(pixelate.RegionOfInterest(1, QSize(80, 60)).isEmpty());
+
+	// Pixel kernels only change pixels inside their region
+	Negate negate;
+	EffectBase::ApplyPixelKernels(frame, std::vector<EffectBase::PixelKernel>(1, negate.GetPixelKernel(1)), std::vector<bool>(), QRect(10, 5, 30, 20));
+	std::shared_ptr<QImage> image = frame->GetImage();
+	CHECK_EQUAL(155, qRed(image->pixel(10, 5)));
+	CHECK_EQUAL(155, qRed(image->pixel(39, 24)));
+	CHECK_EQUAL(100, qRed(image->pixel(9, 5)));
+	CHECK_EQUAL(100, qRed(image->pixel(40, 24)));
+	CHECK_EQUAL(100, qRed(image->pixel(10, 25)));
+}
+
+TEST(Clip_Still_Image_Effects)
+{
+	// Create a clip of a still image
+	DummyReader r(Fraction(30, 1), 64, 48, 44100, 2, 5.0);
+	r.info.has_single_image = true;
+	Clip c(&r);
+	c.Open();
+
+	// A wave which doesn't move does the same thing on every frame
+	Wave wave(Keyframe(0.06), Keyframe(0.3), Keyframe(0.2), Keyframe(0.0), Keyframe(0.0));
+	c.AddEffect(&wave);
+	std::shared_ptr<Frame> f1 = c.GetFrame(1);
+	std::shared_ptr<Frame> f2 = c.GetFrame(2);
+	CHECK(*f1->GetImage() == *f2->GetImage());
+	CHECK_EQUAL(f1->GetImage()->cacheKey(), f2->GetImage()->cacheKey());
+
+	// A moving wave is processed on every frame
+	wave.speed_y = Keyframe(1.0);
+	std::shared_ptr<Frame> f3 = c.GetFrame(3);
+	std::shared_ptr<Frame> f4 = c.GetFrame(4);
+	CHECK(f3->GetImage()->cacheKey() != f1->GetImage()->cacheKey());
+	CHECK(f4->GetImage()->cacheKey() != f3->GetImage()->cacheKey());
+}
+
+TEST(Clip_Deinterlace_Effect)
+{
+	// Create an image with gray even rows, and white odd rows
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(16, 6, QImage::Format_RGBA8888);
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < image->width(); x++)
+			image->setPixel(x, y, (y % 2) ? qRgba(255, 255, 255, 255) : qRgba(y * 20, y * 20, y * 20, 255));
+
+	// Keep the even rows, and repeat them
+	Deinterlace bob(false);
+	std::shared_ptr<Frame> bob_frame = std::make_shared<Frame>(1, 16, 6, "#000000");
+	bob_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	bob_frame = bob.GetFrame(bob_frame, 1);
+	CHECK_EQUAL(40, qRed(bob_frame->GetImage()->pixel(3, 3)));
+	CHECK_EQUAL(80, qRed(bob_frame->GetImage()->pixel(3, 5)));
+
+	// Keep the even rows, and interpolate the odd rows
+	Deinterlace linear(false, true);
+	std::shared_ptr<Frame> linear_frame = std::make_shared<Frame>(1, 16, 6, "#000000");
+	linear_frame->AddImage(std::make_shared<QImage>(image->copy()));
+	linear_frame = linear.GetFrame(linear_frame, 1);
+	CHECK_EQUAL(20, qRed(linear_frame->GetImage()->pixel(3, 1)));
+	CHECK_EQUAL(60, qRed(linear_frame->GetImage()->pixel(3, 3)));
+	CHECK_EQUAL(80, qRed(linear_frame->GetImage()->pixel(3, 5)));
+	CHECK_EQUAL(40, qRed(linear_frame->GetImage()->pixel(3, 2)));
+}
+
+TEST(Clip_Shift_Effect)
+{
+	// Create a gradient image
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(40, 20, QImage::Format_RGBA8888);
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < image->width(); x++)
+			image->setPixel(x, y, qRgba(x * 5, y * 10, 0, 255));
+
+	// Move the image right by 10 pixels, and up by 5 rows (wrapping around the edges)
+	Shift shift(Keyframe(0.25), Keyframe(-0.25));
+	std::shared_ptr<Frame> frame = std::make_shared<Frame>(1, 40, 20, "#000000");
+	frame->AddImage(std::make_shared<QImage>(image->copy()));
+	frame = shift.GetFrame(frame, 1);
+	std::shared_ptr<QImage> shifted = frame->GetImage();
+	for (int y = 0; y < shifted->height(); y++)
+		for (int x = 0; x < shifted->width(); x++)
+			CHECK_EQUAL(image->pixel((x + 30) % 40, (y + 5) % 20), shifted->pixel(x, y));
+}
+
+TEST(Clip_Effect_Timing)
+{
+	// Create a clip with a point-wise effect, and a spatial effect
+	DummyReader r(Fraction(30, 1), 64, 48, 44100, 2, 5.0);
+	Clip c(&r);
+	c.Open();
+	Negate negate;
+	Blur blur(Keyframe(2.0), Keyframe(2.0), Keyframe(3.0), Keyframe(1.0));
+	c.AddEffect(&negate);
+	c.AddEffect(&blur);
+
+	// Each frame adds a call to both effects
+	c.GetFrame(1);
+	c.GetFrame(2);
+	Json::Value timing = c.EffectTimingJsonValue();
+	CHECK_EQUAL(2, (int) timing["effects"].size());
+	for (const Json::Value &effect_timing : timing["effects"]) {
+		CHECK_EQUAL(2, effect_timing["calls"].asInt());
+		CHECK_EQUAL(2 * 64 * 48, effect_timing["pixels"].asInt());
+		CHECK(effect_timing["total_ms"].asDouble() >= 0.0);
+	}
+
+	// Reset the counters
+	c.ResetEffectTiming();
+	CHECK_EQUAL(0, c.EffectTimingJsonValue()["effects"][0]["calls"].asInt());
+}
+
+TEST(Clip_Effect_Batch)
+{
+	// Create a batch of frames
+	std::vector<std::shared_ptr<Frame> > frames;
+	for (int index = 0; index < 3; index++) {
+		frames.push_back(std::make_shared<Frame>(index + 1, 8, 4, "#000000"));
+		frames.back()->AddColor(8, 4, "#204060");
+	}
+
+	// The default batch method applies the effect to each frame (and effects aren't batched by default)
+	Negate negate;
+	CHECK_EQUAL(false, negate.IsBatched());
+	negate.ProcessFrames(frames, 10);
+	for (std::shared_ptr<Frame> frame : frames)
+		CHECK_EQUAL(255 - 0x20, qRed(frame->GetImage()->pixel(3, 2)));
+	CHECK_EQUAL(1, negate.TimingJsonValue()["calls"].asInt());
+	CHECK_EQUAL(3 * 8 * 4, negate.TimingJsonValue()["pixels"].asInt());
+}
+
+TEST(Clip_ChromaKey_Soft_Effect)
+{
+	// Pixels at different chroma distances from a green screen
+	std::shared_ptr<Frame> frame = std::make_shared<Frame>(1, 4, 1, "#000000");
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(4, 1, QImage::Format_RGBA8888);
+	image->setPixel(0, 0, qRgba(0, 255, 0, 255));
+	image->setPixel(1, 0, qRgba(60, 200, 60, 255));
+	image->setPixel(2, 0, qRgba(120, 160, 120, 255));
+	image->setPixel(3, 0, qRgba(200, 150, 120, 255));
+	frame->AddImage(image);
+
+	// Key by chroma, with a soft edge and full spill suppression
+	ChromaKey chroma_key(Color(0, 255, 0, 255), Keyframe(40.0), Keyframe(40.0), Keyframe(1.0), true);
+	chroma_key.GetFrame(frame, 1);
+	std::shared_ptr<QImage> keyed = frame->GetImage();
+
+	// The key color is transparent, and the soft edge is partially transparent
+	CHECK_EQUAL(0, qAlpha(keyed->pixel(0, 0)));
+	CHECK_CLOSE(136, qAlpha(keyed->pixel(1, 0)), 2);
+	CHECK_EQUAL(255, qAlpha(keyed->pixel(2, 0)));
+	CHECK_EQUAL(255, qAlpha(keyed->pixel(3, 0)));
+
+	// The green spill of a greenish grey is removed (keeping its brightness)
+	CHECK_CLOSE(143, qRed(keyed->pixel(2, 0)), 1);
+	CHECK_CLOSE(143, qGreen(keyed->pixel(2, 0)), 1);
+	CHECK_CLOSE(143, qBlue(keyed->pixel(2, 0)), 1);
+
+	// The soft edge and spill suppression are saved in the JSON
+	ChromaKey loaded;
+	loaded.SetJson(chroma_key.Json());
+	CHECK_EQUAL(true, loaded.JsonValue()["chroma_distance"].asBool());
+	CHECK_CLOSE(40.0, loaded.JsonValue()["softness"]["Points"][0]["co"]["Y"].asDouble(), 0.001);
+	CHECK_CLOSE(1.0, loaded.JsonValue()["spill"]["Points"][0]["co"]["Y"].asDouble(), 0.001);
+}
+
+TEST(Clip_Crop_Bars_Geometry)
+{
+	// Create a frame (with a deferred geometry, instead of painted pixels)
+	std::shared_ptr<Frame> frame = std::make_shared<Frame>(1, 20, 10, "#000000");
+	frame->AddColor(20, 10, "#ff0000");
+
+	Crop crop(Keyframe(0.25), Keyframe(0.0), Keyframe(0.0), Keyframe(0.2));
+	crop.GetFrame(frame, 1);
+	Bars bars(Color("#0000ff"), Keyframe(0.0), Keyframe(0.2), Keyframe(0.0), Keyframe(0.0));
+	bars.GetFrame(frame, 1);
+	CHECK_EQUAL(true, frame->HasImageGeometry());
+
+	// A compositor takes the geometry (the clip, and the bars inside of it)
+	std::shared_ptr<Frame> composited = std::make_shared<Frame>(*frame);
+	QRect clip_rect;
+	std::vector<std::pair<QRect, QColor> > fills;
+	CHECK_EQUAL(true, composited->TakeImageGeometry(clip_rect, fills));
+	CHECK(clip_rect == QRect(5, 0, 15, 8));
+	CHECK_EQUAL(1, (int) fills.size());
+	CHECK(fills[0].first == QRect(5, 0, 15, 3));
+	CHECK_EQUAL(false, composited->HasImageGeometry());
+	CHECK_EQUAL(255, qRed(composited->GetImage()->pixel(0, 0)));
+
+	// Any other consumer gets the painted pixels
+	std::shared_ptr<QImage> image = frame->GetImage();
+	CHECK_EQUAL(false, frame->HasImageGeometry());
+	CHECK_EQUAL(0, qAlpha(image->pixel(4, 5)));
+	CHECK_EQUAL(0, qAlpha(image->pixel(10, 8)));
+	CHECK_EQUAL(255, qBlue(image->pixel(10, 2)));
+	CHECK_EQUAL(255, qRed(image->pixel(10, 5)));
+	CHECK_EQUAL(255, qAlpha(image->pixel(10, 5)));
+}
+
+TEST(Clip_Time_Mapped_Audio)
+{
+	// Play the audio backwards (each frame of the reader is only requested once)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "piano.wav";
+	FFmpegReader r(path.str());
+	r.Open();
+	Clip c(&r);
+	c.time.AddPoint(1, 100, LINEAR);
+	c.time.AddPoint(100, 1, LINEAR);
+	c.Open();
+
+	// The samples of the mapped frame are reversed
+	std::shared_ptr<Frame> reversed = c.GetFrame(10);
+	std::shared_ptr<Frame> original = r.GetFrame(c.time.GetLong(10));
+	int sample_count = original->GetAudioSamplesCount();
+	CHECK_EQUAL(sample_count, reversed->GetAudioSamplesCount());
+	for (int channel = 0; channel < original->GetAudioChannelsCount(); channel++)
+		for (int sample = 0; sample < sample_count; sample += 37)
+			CHECK_CLOSE(original->GetAudioSamples(channel)[sample_count - 1 - sample], reversed->GetAudioSamples(channel)[sample], 0.00001);
+
+	c.Close();
+	r.Close();
+}
+
+TEST(Clip_Disabled_Streams)
+{
+	// A clip with its video turned off only decodes the audio of the file
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	Clip c(&r);
+	c.has_video = Keyframe(0.0);
+	c.Open();
+
+	std::shared_ptr<Frame> f = c.GetFrame(100);
+	CHECK(f->GetAudioSamplesCount() > 0);
+	CHECK_EQUAL(false, r.GetFrame(100)->has_image_data);
+
+	// Turning the video on again decodes the image
+	c.has_video = Keyframe(1.0);
+	f = c.GetFrame(100);
+	CHECK_EQUAL(true, r.GetFrame(100)->has_image_data);
+	CHECK(f->GetAudioSamplesCount() > 0);
+
+	c.Close();
+}
+
+TEST(Clip_Frame_Cache)
+{
+	// Keep the processed frames of the clip
+	Settings::Instance()->CLIP_CACHE_SIZE = 4;
+	DummyReader r(Fraction(30, 1), 64, 48, 44100, 2, 5.0);
+	Clip c(&r);
+	c.Open();
+	Negate negate;
+	c.AddEffect(&negate);
+
+	// A frame requested again is not processed again (and drawing on it doesn't change the kept frame)
+	std::shared_ptr<Frame> first = c.GetFrame(1);
+	first->GetImage()->fill(QColor(10, 20, 30, 255));
+	std::shared_ptr<Frame> second = c.GetFrame(1);
+	CHECK_EQUAL(1, negate.TimingJsonValue()["calls"].asInt());
+	CHECK_EQUAL(255, qRed(second->GetImage()->pixel(3, 2)));
+
+	// Other frames, and frames of a changed clip, are processed
+	c.GetFrame(2);
+	CHECK_EQUAL(2, negate.TimingJsonValue()["calls"].asInt());
+	c.RemoveEffect(&negate);
+	c.AddEffect(&negate);
+	c.GetFrame(1);
+	CHECK_EQUAL(3, negate.TimingJsonValue()["calls"].asInt());
+
+	// Only the most recent frames are kept
+	for (int64_t frame_number = 2; frame_number <= 6; frame_number++)
+		c.GetFrame(frame_number);
+	c.GetFrame(1);
+	CHECK_EQUAL(9, negate.TimingJsonValue()["calls"].asInt());
+
+	Settings::Instance()->CLIP_CACHE_SIZE = 0;
+	c.Close();
+}
+
+TEST(Clip_Evaluate_Properties)
+{
+	// Animate a few keyframes of a clip
+	Clip c;
+	c.alpha.AddPoint(1, 1.0);
+	c.alpha.AddPoint(11, 0.0);
+	c.volume.AddPoint(1, 0.0);
+	c.volume.AddPoint(11, 1.0);
+	c.location_x = Keyframe(0.25);
+
+	// The snapshot matches the keyframes at that frame
+	ClipProperties properties = c.EvaluateProperties(6);
+	CHECK_CLOSE(c.alpha.GetValue(6), properties.alpha, 0.0001);
+	CHECK_CLOSE(c.volume.GetValue(6), properties.volume, 0.0001);
+	CHECK_CLOSE(c.volume.GetValue(5), properties.previous_volume, 0.0001);
+	CHECK_CLOSE(0.25, properties.location_x, 0.0001);
+	CHECK_CLOSE(1.0, properties.scale_x, 0.0001);
+	CHECK_EQUAL(-1, properties.channel_filter);
+	CHECK_EQUAL(-1, properties.has_audio);
+}
+
+TEST(Clip_Blur_Effect)
+{
+	// Create an image with a white left half, and a black right half
+	std::shared_ptr<QImage> image = std::make_shared<QImage>(40, 30, QImage::Format_RGBA8888);
+	image->fill(QColor(0, 0, 0, 255));
+	for (int y = 0; y < image->height(); y++)
+		for (int x = 0; x < 20; x++)
+			image->setPixel(x, y, qRgba(255, 255, 255, 255));
+
+	std::shared_ptr<Frame> f = std::make_shared<Frame>(1, 40, 30, "#000000");
+	f->AddImage(std::make_shared<QImage>(image->convertToFormat(QImage::Format_RGBA8888)));
+	f->ConvertImage(QImage::Format_RGBA8888);
+
+	// Blur the horizontal edge (3 iterations of a box with a radius of 2)
+	Blur blur(Keyframe(2.0), Keyframe(2.0), Keyframe(3.0), Keyframe(3.0));
+	f = blur.GetFrame(f, 1);
+
+	// The edge is smoothed (and symmetric), the flat areas are untouched, and every row is the same
+	const unsigned char *pixels = f->GetImage()->constBits();
+	int bytes_per_line = f->GetImage()->bytesPerLine();
+	CHECK_EQUAL(255, (int) pixels[0]);
+	CHECK_EQUAL(0, (int) pixels[39 * 4]);
+	CHECK((int) pixels[18 * 4] > (int) pixels[19 * 4]);
+	CHECK((int) pixels[19 * 4] > 128 && (int) pixels[20 * 4] < 128);
+	CHECK_EQUAL(255, (int) pixels[19 * 4] + (int) pixels[20 * 4]);
+	CHECK_EQUAL(255, (int) pixels[19 * 4 + 3]);
+	for (int y = 1; y < 30; y++)
+		CHECK_EQUAL(0, memcmp(pixels, pixels + y * bytes_per_line, 40 * 4));
+}
+
+// An effect which isn't part of libopenshot (registered by the test)
+static EffectBase* create_custom_effect() { return new Negate(); }
+
+TEST(Clip_Effect_Registry)
+{
+	// The effects of libopenshot are registered by their class name
+	unsigned int effect_count = EffectInfo::JsonValue().size();
+	CHECK_EQUAL(14, effect_count);
+	CHECK(EffectInfo::IsRegistered("Color Shift"));
+	std::unique_ptr<EffectBase> color_shift(EffectInfo::CreateEffect("Color Shift"));
+	CHECK(color_shift != nullptr);
+	CHECK(EffectInfo::CreateEffect("Unknown") == NULL);
+
+	// Register another effect, and load it from the JSON of a clip
+	EffectInfo::RegisterEffect("Custom", create_custom_effect);
+	CHECK(EffectInfo::IsRegistered("Custom"));
+	CHECK_EQUAL(effect_count + 1, EffectInfo::JsonValue().size());
+
+	Clip c;
+	c.SetJson("{\"effects\": [{\"type\": \"Custom\", \"id\": \"custom1\"}]}");
+	CHECK_EQUAL(1, c.Effects().size());
+	delete c.Effects().front();
+
+	// Remove it again
+	CHECK(EffectInfo::UnregisterEffect("Custom"));
+	CHECK(!EffectInfo::UnregisterEffect("Custom"));
+	CHECK_EQUAL(effect_count, EffectInfo::JsonValue().size());
+}
+
+// Get the channel size of a pixel format (to check which format DispatchPixelFormat picks)
+struct ChannelBits {
+	int bits;
+	bool premultiplied;
+	template<class Format> void operator()(Format) { bits = Format::bits; premultiplied = Format::premultiplied; }
+};
+
+TEST(Clip_Pixel_Formats)
+{
+	// The channels of each format are found in their positions
+	QImage argb(2, 1, QImage::Format_ARGB32);
+	argb.setPixel(0, 0, qRgba(10, 20, 30, 40));
+	const uint8_t *argb_pixels = ARGB32Pixels::Pixels(argb);
+	CHECK_EQUAL(10, argb_pixels[ARGB32Pixels::red]);
+	CHECK_EQUAL(20, argb_pixels[ARGB32Pixels::green]);
+	CHECK_EQUAL(30, argb_pixels[ARGB32Pixels::blue]);
+	CHECK_EQUAL(40, argb_pixels[ARGB32Pixels::alpha]);
+
+	// Lowering the alpha of a premultiplied pixel scales its colors
+	uint8_t pixel[4] = {100, 50, 0, 200};
+	RGBA8888PremultipliedPixels::SetAlpha(pixel, 100);
+	CHECK_EQUAL(50, pixel[0]);
+	CHECK_EQUAL(25, pixel[1]);
+	CHECK_EQUAL(100, pixel[3]);
+
+	ChannelBits channel_bits = {0, false};
+	CHECK(DispatchPixelFormat(QImage::Format_RGBA8888_Premultiplied, channel_bits));
+	CHECK_EQUAL(8, channel_bits.bits);
+	CHECK(channel_bits.premultiplied);
+	CHECK(!DispatchPixelFormat(QImage::Format_RGB888, channel_bits));
+
+#ifdef USE_RGBA64_IMAGES
+	CHECK(DispatchPixelFormat(QImage::Format_RGBA64, channel_bits));
+	CHECK_EQUAL(16, channel_bits.bits);
+
+	// The 16 bit compositor kernels match the 8 bit kernels (scaled to 16 bits)
+	const int pixel_count = 5;
+	uint8_t row0[pixel_count * 4], row1[pixel_count * 4], target[pixel_count * 4];
+	uint16_t row0_16[pixel_count * 4], row1_16[pixel_count * 4], target_16[pixel_count * 4];
+	for (int index = 0; index < pixel_count * 4; index++) {
+		row0[index] = (index * 37) % 256;
+		row1[index] = (index * 91 + 17) % 256;
+		target[index] = (index % 4 == 3) ? 255 : (index * 53) % 256;
+		row0_16[index] = RGBA64Pixels::FromByte(row0[index]);
+		row1_16[index] = RGBA64Pixels::FromByte(row1[index]);
+		target_16[index] = RGBA64Pixels::FromByte(target[index]);
+	}
+	uint8_t lerped[pixel_count * 4];
+	uint16_t lerped_16[pixel_count * 4];
+	PixelKernels::LerpRows<RGBA8888Pixels>(lerped, row0, row1, pixel_count, 96);
+	PixelKernels::LerpRows<RGBA64Pixels>(lerped_16, row0_16, row1_16, pixel_count, 96);
+	PixelKernels::BlendOver<RGBA8888Pixels>(target, lerped, pixel_count, 200);
+	PixelKernels::BlendOver<RGBA64Pixels>(target_16, lerped_16, pixel_count, 200);
+	for (int index = 0; index < pixel_count * 4; index++) {
+		CHECK_CLOSE(lerped[index], RGBA64Pixels::ToByte(lerped_16[index]), 1);
+		CHECK_CLOSE(target[index], RGBA64Pixels::ToByte(target_16[index]), 2);
+	}
+#endif
+}
+
+// An audio block effect which replaces each sample with its position since the effect was reset
+class SamplePosition : public EffectBase {
+public:
+	int64_t position;
+	int resets;
+
+	SamplePosition() : position(0), resets(0) {
+		InitEffectInfo();
+		info.class_name = "SamplePosition";
+		info.has_audio = true;
+	}
+	bool IsAudioBlockEffect() { return true; }
+	void ProcessAudioBlock(float* const* channels, int channel_count, int sample_count, int sample_rate, int64_t frame_number) {
+		for (int sample = 0; sample < sample_count; sample++, position++)
+			for (int channel = 0; channel < channel_count; channel++)
+				channels[channel][sample] = float(position);
+	}
+	void ResetAudio() { position = 0; resets++; }
+	std::shared_ptr<Frame> GetFrame(std::shared_ptr<Frame> frame, int64_t frame_number) { ProcessAudio(frame, frame_number); return frame; }
+	std::string Json() { return JsonValue().toStyledString(); }
+	void SetJson(std::string value) {}
+	Json::Value JsonValue() { return EffectBase::JsonValue(); }
+	void SetJsonValue(Json::Value root) { EffectBase::SetJsonValue(root); }
+	std::string PropertiesJSON(int64_t requested_frame) { return "{}"; }
+};
+
+TEST(Clip_Audio_Block_Effects)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "piano.wav";
+	FFmpegReader r(path.str());
+	Clip c(&r);
+	c.Open();
+	SamplePosition effect;
+	c.AddEffect(&effect);
+
+	// The blocks of consecutive frames follow each other
+	std::shared_ptr<Frame> f1 = c.GetFrame(1);
+	std::shared_ptr<Frame> f2 = c.GetFrame(2);
+	CHECK_EQUAL(1, effect.resets);
+	CHECK_EQUAL(0.0, f1->GetAudioSamples(0)[0]);
+	CHECK_EQUAL(float(f1->GetAudioSamplesCount()), f2->GetAudioSamples(0)[0]);
+
+	// A frame requested again gets the same samples, and the skipped frames are processed first
+	CHECK_EQUAL(float(f1->GetAudioSamplesCount()), c.GetAudioFrame(2)->GetAudioSamples(0)[0]);
+	std::shared_ptr<Frame> f5 = c.GetFrame(5);
+	int64_t samples = 0;
+	for (int64_t frame_number = 1; frame_number < 5; frame_number++)
+		samples += c.GetAudioFrame(frame_number)->GetAudioSamplesCount();
+	CHECK_EQUAL(float(samples), f5->GetAudioSamples(0)[0]);
+	CHECK_EQUAL(1, effect.resets);
+
+	// Seeking resets the effect
+	std::shared_ptr<Frame> f100 = c.GetFrame(100);
+	CHECK_EQUAL(2, effect.resets);
+	CHECK_EQUAL(0.0, f100->GetAudioSamples(0)[0]);
+	CHECK_EQUAL(6, effect.TimingJsonValue()["calls"].asInt());
+
+	c.Close();
+	r.Close();
+}
@@ -126,3 +126,23 @@ TEST(Color_RGBA_Constructor)
 	CHECK_EQUAL("#4586db", c1.GetColorHex(1));
 	CHECK_EQUAL(128, c1.alpha.GetInt(1));
 }
+
+TEST(Color_RGBA_Value)
+{
+	// Color
+	openshot::Color c(69, 134, 219, 128);
+	c.red.AddPoint(100, 300);
+
+	CHECK_EQUAL(qRgba(69, 134, 219, 128), c.GetRGBA(1));
+	CHECK_EQUAL(255, qRed(c.GetRGBA(100)));
+
+	// A frame filled with a packed color
+	Frame f(1, 4, 2, "#000000");
+	f.AddColor(4, 2, c.GetRGBA(1));
+	QColor pixel = f.GetImage()->pixelColor(1, 1);
+	// (premultiplied frame images round the channels of transparent colors)
+	CHECK_CLOSE(69, pixel.red(), 1);
+	CHECK_CLOSE(134, pixel.green(), 1);
+	CHECK_CLOSE(219, pixel.blue(), 1);
+	CHECK_EQUAL(128, pixel.alpha());
+}
@@ -32,6 +32,10 @@
 // Prevent name clashes with juce::UnitTest
 #define DONT_SET_USING_JUCE_NAMESPACE 1
 #include "../include/OpenShot.h"
+#include "ScopedSetting.h"
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace openshot;
@@ -186,6 +190,627 @@ TEST(FFmpegReader_Seek)
 
 }
 
+TEST(FFmpegReader_Keyframe_Index)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	std::shared_ptr<Frame> f;
+	{
+		// Enable the keyframe index, and create a reader
+		ScopedSetting<bool> keyframe_index(Settings::Instance()->KEYFRAME_INDEX, true);
+		FFmpegReader r(path.str());
+		r.Open();
+
+		// The keyframes of the file are indexed on open
+		CHECK(r.GetKeyframeCount() > 1);
+
+		// Seek forward and backward (each lands on an indexed keyframe)
+		f = r.GetFrame(900);
+		CHECK_EQUAL(900, f->number);
+		f = r.GetFrame(450);
+		CHECK_EQUAL(450, f->number);
+
+		// Close reader
+		r.Close();
+	}
+
+	// The keyframe index is off by default
+	FFmpegReader r2(path.str());
+	r2.Open();
+	CHECK_EQUAL(0, r2.GetKeyframeCount());
+
+	// Seeking still works (by estimation)
+	f = r2.GetFrame(450);
+	CHECK_EQUAL(450, f->number);
+	r2.Close();
+}
+
+TEST(FFmpegReader_Probe_Cache)
+{
+	// Enable the probe cache
+	QDir cache_folder(QDir::tempPath() + "/openshot-probe-test");
+	cache_folder.removeRecursively();
+	Settings::Instance()->PROBE_CACHE_PATH = cache_folder.absolutePath().toStdString();
+
+	// Inspect a file (which saves its info to the cache)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	CHECK_EQUAL(1, (int) cache_folder.entryList(QStringList() << "*.json", QDir::Files).size());
+
+	// A second reader loads the same info from the cache
+	FFmpegReader r2(path.str());
+	CHECK_EQUAL(r.info.video_length, r2.info.video_length);
+	CHECK_EQUAL(r.info.fps.num, r2.info.fps.num);
+	CHECK_EQUAL(r.info.fps.den, r2.info.fps.den);
+	CHECK_EQUAL(r.info.width, r2.info.width);
+	CHECK_EQUAL(r.info.sample_rate, r2.info.sample_rate);
+	CHECK_EQUAL(r.info.vcodec, r2.info.vcodec);
+
+	// And can still be opened and decoded
+	r2.Open();
+	std::shared_ptr<Frame> f = r2.GetFrame(10);
+	CHECK_EQUAL(10, f->number);
+	r2.Close();
+
+	// Reset settings
+	Settings::Instance()->PROBE_CACHE_PATH = "";
+	cache_folder.removeRecursively();
+}
+
+TEST(FFmpegReader_Decoder_Pool)
+{
+	// Enable the decoder pool
+	Settings::Instance()->DECODER_POOL_SIZE = 2;
+	FFmpegDecoderPool::Instance()->Clear();
+
+	// Create a reader (closing it parks its decoder)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	CHECK_EQUAL(1, FFmpegDecoderPool::Instance()->Count());
+
+	// Opening the file again reuses the parked decoder (rewound to the start)
+	r.Open();
+	CHECK_EQUAL(0, FFmpegDecoderPool::Instance()->Count());
+	std::shared_ptr<Frame> f = r.GetFrame(1);
+	CHECK_EQUAL(1, f->number);
+	f = r.GetFrame(500);
+	CHECK_EQUAL(500, f->number);
+	r.Close();
+	CHECK_EQUAL(1, FFmpegDecoderPool::Instance()->Count());
+
+	// Other readers of the same file share the pool
+	FFmpegReader r2(path.str());
+	r2.Open();
+	f = r2.GetFrame(2);
+	CHECK_EQUAL(2, f->number);
+	r2.Close();
+	CHECK_EQUAL(1, FFmpegDecoderPool::Instance()->Count());
+
+	// Disabling the pool frees parked decoders as they are released
+	Settings::Instance()->DECODER_POOL_SIZE = 0;
+	FFmpegDecoderPool::Instance()->Clear();
+	r.Open();
+	r.Close();
+	CHECK_EQUAL(0, FFmpegDecoderPool::Instance()->Count());
+}
+
+TEST(FFmpegReader_Hardware_Devices)
+{
+	// Spread the hardware decoders over 3 GPUs, with up to 2 sessions each
+	Settings::Instance()->HW_DE_DEVICE_SET = 1;
+	Settings::Instance()->HW_DE_DEVICE_COUNT = 3;
+	Settings::Instance()->HW_DE_DEVICE_SESSIONS = 2;
+	FFmpegDecoderPool::Instance()->Clear();
+
+	// Each session goes to the GPU with the fewest sessions
+	CHECK_EQUAL(1, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(2, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(3, FFmpegDecoderPool::Instance()->AcquireDevice());
+	FFmpegDecoderPool::Instance()->ReleaseDevice(2);
+	CHECK_EQUAL(2, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(3, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(1, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(2, FFmpegDecoderPool::Instance()->AcquireDevice());
+
+	// Every GPU is full (so the next reader decodes in software)
+	CHECK_EQUAL(-1, FFmpegDecoderPool::Instance()->AcquireDevice());
+	CHECK_EQUAL(2, FFmpegDecoderPool::Instance()->DeviceSessions(1));
+	CHECK_EQUAL(0, FFmpegDecoderPool::Instance()->DeviceSessions(0));
+	for (int device = 1; device <= 3; device++) {
+		FFmpegDecoderPool::Instance()->ReleaseDevice(device);
+		FFmpegDecoderPool::Instance()->ReleaseDevice(device);
+		CHECK_EQUAL(0, FFmpegDecoderPool::Instance()->DeviceSessions(device));
+	}
+
+	// A software decoder has no GPU
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	CHECK_EQUAL(-1, r.HardwareDevice());
+
+	Settings::Instance()->HW_DE_DEVICE_SET = 0;
+	Settings::Instance()->HW_DE_DEVICE_COUNT = 1;
+	Settings::Instance()->HW_DE_DEVICE_SESSIONS = 0;
+}
+
+TEST(FFmpegReader_Zero_Copy_Software_Decode)
+{
+	// Decode a frame in software
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	ScopedSetting<int> hardware_decoder(Settings::Instance()->HARDWARE_DECODER, 0);
+	FFmpegReader r1(path.str());
+	r1.Open();
+	std::shared_ptr<Frame> f1 = r1.GetFrame(24);
+
+	// Frames which are not on a hardware surface are converted as usual with the zero-copy path enabled
+	ScopedSetting<bool> zero_copy(Settings::Instance()->HW_DE_ZERO_COPY, true);
+	FFmpegReader r2(path.str());
+	r2.Open();
+	std::shared_ptr<Frame> f2 = r2.GetFrame(24);
+	CHECK_EQUAL(24, f2->number);
+	CHECK_EQUAL(f1->GetWidth(), f2->GetWidth());
+	CHECK_EQUAL(f1->GetHeight(), f2->GetHeight());
+	CHECK(*f1->GetImage() == *f2->GetImage());
+	CHECK(*r1.GetFrame(25)->GetImage() == *r2.GetFrame(25)->GetImage());
+
+	// Close readers
+	r1.Close();
+	r2.Close();
+}
+
+TEST(FFmpegReader_Scale_Threads)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	std::shared_ptr<QImage> expected = r.GetFrame(50)->GetImage();
+	r.Close();
+
+	// Convert the frames in 2 slices (of 360 rows)
+	Settings::Instance()->SCALE_THREADS = 2;
+	r.Open();
+	std::shared_ptr<QImage> image = r.GetFrame(50)->GetImage();
+	CHECK_EQUAL(expected->height(), image->height());
+	CHECK_EQUAL(expected->pixel(640, 100), image->pixel(640, 100));
+	CHECK_EQUAL(expected->pixel(640, 600), image->pixel(640, 600));
+	r.Close();
+	Settings::Instance()->SCALE_THREADS = 0;
+}
+
+TEST(FFmpegReader_GetFrames)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Read a range of frames in a single pass of the stream
+	std::vector<std::shared_ptr<Frame> > frames = r.GetFrames(100, 30);
+	CHECK_EQUAL(30, frames.size());
+	for (int index = 0; index < 30; index++)
+		CHECK_EQUAL(100 + index, frames[index]->number);
+
+	// The frames match the frames read one at a time
+	FFmpegReader r2(path.str());
+	r2.Open();
+	CHECK(*frames[0]->GetImage() == *r2.GetFrame(100)->GetImage());
+	CHECK(*frames[29]->GetImage() == *r2.GetFrame(129)->GetImage());
+
+	r.Close();
+	r2.Close();
+}
+
+TEST(FFmpegReader_Demux_Thread)
+{
+	// Read packets ahead on a demux thread
+	Settings::Instance()->PACKET_QUEUE_SIZE = 32;
+
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Sequential frames, and seeks (which restart the demux thread)
+	std::shared_ptr<Frame> f = r.GetFrame(1);
+	CHECK_EQUAL(1, f->number);
+	f = r.GetFrame(2);
+	CHECK_EQUAL(2, f->number);
+	f = r.GetFrame(300);
+	CHECK_EQUAL(300, f->number);
+	f = r.GetFrame(301);
+	CHECK_EQUAL(301, f->number);
+	f = r.GetFrame(100);
+	CHECK_EQUAL(100, f->number);
+	CHECK_EQUAL(true, f->has_audio_data);
+
+	// Close reader (which stops the demux thread)
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->PACKET_QUEUE_SIZE = 0;
+}
+
+TEST(FFmpegReader_Reverse_Playback)
+{
+	// Read some frames forwards
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader forward(path.str());
+	forward.Open();
+	std::map<int64_t, int> expected;
+	for (int64_t number = 60; number <= 120; number++)
+		expected[number] = qGray(forward.GetFrame(number)->GetImage()->pixel(640, 360));
+	forward.Close();
+
+	// Play the same frames backwards (each GOP is decoded once, instead of a seek for each frame)
+	Settings::Instance()->REVERSE_DECODE_FRAMES = 48;
+	FFmpegReader r(path.str());
+	r.Open();
+	for (int64_t number = 120; number >= 60; number--) {
+		std::shared_ptr<Frame> f = r.GetFrame(number);
+		CHECK_EQUAL(number, f->number);
+		CHECK_EQUAL(expected[number], qGray(f->GetImage()->pixel(640, 360)));
+	}
+	CHECK(r.MetricsValue()["seeks"].asInt() < 20);
+
+	// Playing forwards again ends the reverse playback
+	std::shared_ptr<Frame> f = r.GetFrame(61);
+	CHECK_EQUAL(61, f->number);
+	CHECK_EQUAL(expected[61], qGray(f->GetImage()->pixel(640, 360)));
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->REVERSE_DECODE_FRAMES = 0;
+}
+
+TEST(FFmpegReader_Decode_Speed)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	int expected = qGray(r.GetFrame(50)->GetImage()->pixel(640, 360));
+
+	// A preview which falls behind decodes faster (with a softer picture)
+	{
+		RenderContext context = RenderContext::Global();
+		context.decode_speed = 2;
+		ScopedRenderContext render_context(context);
+		std::shared_ptr<Frame> f = r.GetFrame(51);
+		CHECK_EQUAL(51, f->number);
+	}
+
+	// An exact render decodes the frames again
+	std::shared_ptr<Frame> f = r.GetFrame(50);
+	CHECK_EQUAL(50, f->number);
+	CHECK_EQUAL(expected, qGray(f->GetImage()->pixel(640, 360)));
+	r.Close();
+}
+
+TEST(FFmpegReader_Custom_IO)
+{
+	// Read a frame with FFmpeg's file I/O
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	std::shared_ptr<Frame> expected = r.GetFrame(300);
+	const unsigned char* expected_pixels = expected->GetPixels(360);
+	r.Close();
+
+	// Read the same frame in blocks (with read-ahead), which are shared with other readers of the file
+	Settings::Instance()->IO_READ_AHEAD = 4;
+	Settings::Instance()->IO_BLOCK_SIZE = 262144;
+	FFmpegBlockCache::Instance()->Clear();
+	FFmpegReader r2(path.str());
+	r2.Open();
+	std::shared_ptr<Frame> f = r2.GetFrame(300);
+	CHECK_EQUAL(300, f->number);
+	CHECK(FFmpegBlockCache::Instance()->Bytes() > 0);
+	const unsigned char* pixels = f->GetPixels(360);
+	for (int index = 0; index < 1280 * 4; index += 97)
+		CHECK_EQUAL((int)expected_pixels[index], (int)pixels[index]);
+	r2.Close();
+
+	// Memory map the file instead
+	Settings::Instance()->IO_MMAP = true;
+	FFmpegReader r3(path.str());
+	r3.Open();
+	f = r3.GetFrame(300);
+	pixels = f->GetPixels(360);
+	for (int index = 0; index < 1280 * 4; index += 97)
+		CHECK_EQUAL((int)expected_pixels[index], (int)pixels[index]);
+	r3.Close();
+
+	// Reset settings
+	Settings::Instance()->IO_READ_AHEAD = 0;
+	Settings::Instance()->IO_BLOCK_SIZE = 1048576;
+	Settings::Instance()->IO_MMAP = false;
+	FFmpegBlockCache::Instance()->Clear();
+}
+
+TEST(FFmpegReader_Scale_On_Decode)
+{
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Request a frame at the size it is drawn at
+	std::shared_ptr<Frame> f = r.GetFrame(10, 320, 136);
+	CHECK_EQUAL(10, f->number);
+	CHECK_EQUAL(320, f->GetImage()->width());
+	CHECK_EQUAL(136, f->GetImage()->height());
+
+	// A larger request decodes the frame again
+	f = r.GetFrame(10, 640, 272);
+	CHECK_EQUAL(10, f->number);
+	CHECK_EQUAL(640, f->GetImage()->width());
+	CHECK_EQUAL(272, f->GetImage()->height());
+
+	// A smaller request can use the cached (larger) frame
+	f = r.GetFrame(10, 320, 136);
+	CHECK_EQUAL(640, f->GetImage()->width());
+
+	// Close reader
+	r.Close();
+}
+
+TEST(FFmpegReader_Audio_Fast_Path)
+{
+	// Slice audio-only files directly into frames
+	Settings::Instance()->AUDIO_FAST_PATH = true;
+
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "piano.wav";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Get frame 1 (which should match the regular decoding of this file)
+	std::shared_ptr<Frame> f = r.GetFrame(1);
+	float *samples = f->GetAudioSamples(0);
+	CHECK_EQUAL(2, f->GetAudioChannelsCount());
+	CHECK_CLOSE(0.0f, samples[200], 0.00001);
+	CHECK_CLOSE(0.160781f, samples[230], 0.00001);
+	CHECK_CLOSE(-0.06125f, samples[300], 0.00001);
+
+	// Sequential frames, and seeks
+	f = r.GetFrame(2);
+	CHECK_EQUAL(2, f->number);
+	f = r.GetFrame(100);
+	CHECK_EQUAL(100, f->number);
+	CHECK_EQUAL(true, f->has_audio_data);
+	f = r.GetFrame(10);
+	CHECK_EQUAL(10, f->number);
+
+	// Close reader
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->AUDIO_FAST_PATH = false;
+}
+
+TEST(FFmpegReader_Frame_Status_Ring)
+{
+	// Track up to 8 frames
+	FrameStatusRing ring(8);
+	CHECK(ring.Find(3) == NULL);
+
+	// Track a frame
+	ring.Track(3).is_video_processed = true;
+	CHECK(ring.Find(3) != NULL);
+	CHECK_EQUAL(true, ring.Find(3)->is_video_processed);
+	CHECK_EQUAL(false, ring.Find(3)->is_audio_processed);
+
+	// A newer frame in the same slot replaces the older frame
+	ring.Track(11).checked_count = 2;
+	CHECK(ring.Find(3) == NULL);
+	CHECK_EQUAL(2, ring.Find(11)->checked_count);
+	CHECK_EQUAL(false, ring.Find(11)->is_video_processed);
+
+	// Forget all frames
+	ring.Clear();
+	CHECK(ring.Find(11) == NULL);
+}
+
+TEST(FFmpegReader_Thumbnail_Mode)
+{
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Only decode keyframes
+	r.ThumbnailMode(true);
+	CHECK_EQUAL(true, r.IsOpen());
+
+	// Any frame returns the image of its nearest keyframe (in any order)
+	std::shared_ptr<Frame> f = r.GetFrame(500);
+	CHECK_EQUAL(500, f->number);
+	CHECK_EQUAL(true, f->has_image_data);
+	CHECK(f->GetImage()->width() <= r.info.width);
+	f = r.GetFrame(20);
+	CHECK_EQUAL(20, f->number);
+	CHECK_EQUAL(true, f->has_image_data);
+	f = r.GetFrame(21);
+	CHECK_EQUAL(21, f->number);
+
+	// Back to regular decoding
+	r.ThumbnailMode(false);
+	f = r.GetFrame(10);
+	CHECK_EQUAL(10, f->number);
+	CHECK_EQUAL(true, f->has_image_data);
+
+	// Close reader
+	r.Close();
+}
+
+TEST(FFmpegReader_Thumbnail_Generator)
+{
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Thumbnails are returned in the order of the frame numbers (a repeated frame is only read once)
+	ThumbnailGenerator g(64, 36);
+	std::vector<int64_t> frames;
+	frames.push_back(300);
+	frames.push_back(1);
+	frames.push_back(300);
+	std::vector<std::shared_ptr<QImage> > thumbnails = g.Generate(&r, frames);
+	CHECK_EQUAL(3, (int) thumbnails.size());
+	CHECK_EQUAL(64, thumbnails[0]->width());
+	CHECK_EQUAL(36, thumbnails[0]->height());
+	CHECK(thumbnails[0] == thumbnails[2]);
+
+	// The reader is back to regular decoding
+	CHECK_EQUAL(false, r.IsThumbnailMode());
+
+	// A sprite sheet of 2 rows
+	std::shared_ptr<QImage> sheet = g.SpriteSheet(&r, frames, 2);
+	CHECK_EQUAL(128, sheet->width());
+	CHECK_EQUAL(72, sheet->height());
+
+	// Close reader
+	r.Close();
+}
+
+TEST(FFmpegReader_Native_Frame_Planes)
+{
+	// Keep the decoded YUV planes with each frame
+	Settings::Instance()->NATIVE_FRAME_PLANES = true;
+
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Get the planes of a frame (at the decoded size)
+	std::shared_ptr<Frame> f = r.GetFrame(24);
+	std::shared_ptr<FramePlanes> planes = f->GetPlanes();
+	CHECK(planes != NULL);
+	CHECK_EQUAL(1280, planes->width);
+	CHECK_EQUAL(720, planes->height);
+
+	// A copy of the frame shares the planes (until its image changes)
+	Frame copied_frame(*f);
+	CHECK(copied_frame.GetPlanes() == planes);
+	copied_frame.GetImage()->fill(Qt::red);
+	CHECK(copied_frame.GetPlanes() == NULL);
+	CHECK(f->GetPlanes() == planes);
+
+	// A new image drops the planes
+	f->AddImage(std::make_shared<QImage>(f->GetWidth(), f->GetHeight(), Frame::ImageFormat()));
+	CHECK(f->GetPlanes() == NULL);
+
+	// Close reader
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->NATIVE_FRAME_PLANES = false;
+}
+
+TEST(FFmpegReader_Lazy_Frame_Images)
+{
+	// Get a frame's image (converted to RGB while decoding)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r1(path.str());
+	r1.Open();
+	std::shared_ptr<Frame> f1 = r1.GetFrame(24);
+	CHECK(!f1->IsImageDeferred());
+
+	// Defer converting the decoded frames to RGB
+	Settings::Instance()->LAZY_FRAME_IMAGES = true;
+	FFmpegReader r2(path.str());
+	r2.Open();
+	std::shared_ptr<Frame> f2 = r2.GetFrame(24);
+	CHECK(f2->IsImageDeferred());
+	CHECK_EQUAL(f1->GetWidth(), f2->GetWidth());
+	CHECK_EQUAL(f1->GetHeight(), f2->GetHeight());
+	CHECK_EQUAL(f1->GetAudioSamplesCount(), f2->GetAudioSamplesCount());
+
+	// A frame sharing the image keeps it deferred
+	std::shared_ptr<Frame> f3(new Frame(24, 1, 1, "#000000", 0, 2));
+	f3->ShareImage(f2);
+	CHECK(f3->IsImageDeferred());
+
+	// The image is converted when it is first needed (and matches the image converted while decoding)
+	CHECK_EQUAL(f1->GetImage()->width(), f3->GetImage()->width());
+	CHECK(!f3->IsImageDeferred());
+	CHECK(!f2->IsImageDeferred());
+	CHECK(*f1->GetImage() == *f2->GetImage());
+
+	// Close readers
+	r1.Close();
+	r2.Close();
+
+	// Reset settings
+	Settings::Instance()->LAZY_FRAME_IMAGES = false;
+}
+
+TEST(FFmpegReader_Proxy)
+{
+	// Write a short video to make a proxy of
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	FFmpegWriter w("proxy-source.webm");
+	w.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 188000);
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 1280, 720, Fraction(1,1), false, false, 30000000);
+	w.Open();
+	w.WriteFrame(&r, 1, 30);
+	w.Close();
+	r.Close();
+
+	// Generate its proxy (in the background)
+	Settings::Instance()->PROXY_PATH = "proxies";
+	Settings::Instance()->PROXY_HEIGHT = 360;
+	ProxyManager::Instance()->Generate("proxy-source.webm");
+	ProxyManager::Instance()->Wait();
+	CHECK_EQUAL(true, ProxyManager::Instance()->HasProxy("proxy-source.webm"));
+	CHECK_EQUAL(false, ProxyManager::Instance()->IsGenerating("proxy-source.webm"));
+
+	// Exports read the original
+	FFmpegReader source("proxy-source.webm");
+	source.Open();
+	Settings::Instance()->MAX_WIDTH = 1280;
+	Settings::Instance()->MAX_HEIGHT = 720;
+	std::shared_ptr<Frame> f = source.GetFrame(10);
+	CHECK_EQUAL(10, f->number);
+	CHECK_EQUAL(720, f->GetHeight());
+
+	// Small previews read the proxy (with the same frames and audio)
+	Settings::Instance()->MAX_WIDTH = 640;
+	Settings::Instance()->MAX_HEIGHT = 360;
+	std::shared_ptr<Frame> proxy_frame = source.GetFrame(12);
+	CHECK_EQUAL(12, proxy_frame->number);
+	CHECK_EQUAL(640, proxy_frame->GetWidth());
+	CHECK_EQUAL(360, proxy_frame->GetHeight());
+	CHECK_EQUAL(2, proxy_frame->GetAudioChannelsCount());
+
+	// Close reader
+	source.Close();
+
+	// Reset settings
+	Settings::Instance()->PROXY_PATH = "";
+	Settings::Instance()->PROXY_HEIGHT = 540;
+	Settings::Instance()->MAX_WIDTH = 0;
+	Settings::Instance()->MAX_HEIGHT = 0;
+}
+
 TEST(FFmpegReader_Multiple_Open_and_Close)
 {
 	// Create a reader
@@ -221,3 +846,103 @@ TEST(FFmpegReader_Multiple_Open_and_Close)
 	// Close reader
 	r.Close();
 }
+
+TEST(FFmpegReader_Shared_Reader)
+{
+	// Two readers of the same file share one FFmpegReader (and its cache)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	SharedReader r1(path.str());
+	SharedReader r2(path.str());
+	CHECK(r1.Reader() == r2.Reader());
+	CHECK(r1.GetCache() == r2.GetCache());
+	CHECK_EQUAL(1280, r2.info.width);
+	CHECK_EQUAL("FFmpegReader", r1.JsonValue()["type"].asString());
+
+	// The shared reader stays open until both readers are closed
+	r1.Open();
+	r2.Open();
+	CHECK_EQUAL(10, r1.GetFrame(10)->number);
+	CHECK(r2.GetCache()->GetFrame(10) != NULL);
+	CHECK_EQUAL(10, r2.GetFrame(10)->number);
+	r1.Close();
+	CHECK(r2.Reader()->IsOpen());
+	CHECK_THROW(r1.GetFrame(10), ReaderClosed);
+	r2.Close();
+	CHECK(!r2.Reader()->IsOpen());
+
+	// Clips share readers when enabled
+	Settings::Instance()->SHARE_READERS = true;
+	Clip c1(path.str());
+	Clip c2(path.str());
+	Settings::Instance()->SHARE_READERS = false;
+	CHECK_EQUAL("SharedReader", c1.Reader()->Name());
+	CHECK(((SharedReader *) c1.Reader())->Reader() == r1.Reader());
+	CHECK(((SharedReader *) c2.Reader())->Reader() == r1.Reader());
+}
+
+TEST(FFmpegReader_Shared_Reader_Streams)
+{
+	// Two readers which read far apart parts of the same file
+	Settings::Instance()->SHARED_READER_STREAMS = 2;
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	SharedReader r1(path.str());
+	SharedReader r2(path.str());
+	r1.Open();
+	r2.Open();
+
+	// The far away frame starts a second stream, and the nearby frames walk the first stream
+	CHECK_EQUAL(10, r1.GetFrame(10)->number);
+	CHECK_EQUAL(1, r1.Streams());
+	CHECK_EQUAL(500, r2.GetFrame(500)->number);
+	CHECK_EQUAL(2, r2.Streams());
+	CHECK_EQUAL(12, r1.GetFrame(12)->number);
+	CHECK_EQUAL(501, r2.GetFrame(501)->number);
+	CHECK_EQUAL(2, r1.MetricsValue()["streams"].asInt());
+
+	// The frames of either stream are shared
+	CHECK_EQUAL(500, r1.GetFrame(500)->number);
+	CHECK_EQUAL(10, r2.GetFrame(10)->number);
+	CHECK_EQUAL(2, r1.Streams());
+
+	// Closing the last reader closes the streams (and only keeps the first)
+	r1.Close();
+	r2.Close();
+	CHECK_EQUAL(1, r1.Streams());
+	CHECK(!r1.Reader()->IsOpen());
+	Settings::Instance()->SHARED_READER_STREAMS = 1;
+}
+
+TEST(FFmpegReader_Shared_Reader_Concurrent_Streams)
+{
+	// Readers on several threads which read far apart parts of the same file (so the streams open concurrently)
+	ScopedSetting<int> shared_streams(Settings::Instance()->SHARED_READER_STREAMS, 3);
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	SharedReader first(path.str());
+	first.Open();
+	CHECK_EQUAL(1, first.GetFrame(1)->number);
+
+	std::atomic<int> mismatches(0);
+	std::vector<std::thread> threads;
+	for (int index = 0; index < 4; index++)
+		threads.push_back(std::thread([&path, &mismatches, index]() {
+			SharedReader r(path.str());
+			r.Open();
+			for (int64_t frame = 100 + index * 200; frame < 100 + index * 200 + 5; frame++)
+				if (r.GetFrame(frame)->number != frame)
+					mismatches++;
+			r.Close();
+		}));
+	for (std::thread &thread : threads)
+		thread.join();
+
+	// Every frame was decoded, without opening more streams than allowed
+	CHECK_EQUAL(0, mismatches.load());
+	CHECK(first.Streams() <= 3);
+
+	// Closing the last reader only keeps the first stream
+	first.Close();
+	CHECK_EQUAL(1, first.Streams());
+}
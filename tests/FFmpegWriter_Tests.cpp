@@ -32,6 +32,8 @@
 // Prevent name clashes with juce::UnitTest
 #define DONT_SET_USING_JUCE_NAMESPACE 1
 #include "../include/OpenShot.h"
+#include <fstream>
+#include <thread>
 
 using namespace std;
 using namespace openshot;
@@ -82,3 +84,484 @@ TEST(FFmpegWriter_Test_Webm)
 	CHECK_CLOSE(23, (int)pixels[pixel_index + 2], 5);
 	CHECK_CLOSE(255, (int)pixels[pixel_index + 3], 5);
 }
+
+TEST(FFmpegWriter_Writer_Thread)
+{
+	// Encode batches of frames on a background thread
+	Settings::Instance()->WRITER_QUEUE_SIZE = 2;
+
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	/* WRITER ---------------- */
+	FFmpegWriter w("output2.webm");
+
+	// Set options
+	w.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 188000);
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 1280, 720, Fraction(1,1), false, false, 30000000);
+
+	// Open writer
+	w.Open();
+
+	// Write some frames (which are encoded while the next frames are read)
+	w.WriteFrame(&r, 24, 50);
+
+	// Close writer (which waits for the writer thread) & reader
+	w.Close();
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->WRITER_QUEUE_SIZE = 0;
+
+	FFmpegReader r1("output2.webm");
+	r1.Open();
+
+	// Verify various settings on new video
+	CHECK_EQUAL(2, r1.GetFrame(1)->GetAudioChannelsCount());
+	CHECK_EQUAL(24, r1.info.fps.num);
+	CHECK_EQUAL(1, r1.info.fps.den);
+
+	// Get a specific frame
+	std::shared_ptr<Frame> f = r1.GetFrame(8);
+
+	// Get the image data for row 500
+	const unsigned char* pixels = f->GetPixels(500);
+	int pixel_index = 112 * 4; // pixel 112 (4 bytes per pixel)
+
+	// Check image properties on scanline 10, pixel 112
+	CHECK_CLOSE(23, (int)pixels[pixel_index], 5);
+	CHECK_CLOSE(255, (int)pixels[pixel_index + 3], 5);
+}
+
+TEST(FFmpegWriter_Rendition_Writer)
+{
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	/* WRITERS ---------------- */
+	FFmpegWriter w1("output3-720p.webm");
+	w1.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 188000);
+	w1.SetVideoOptions(true, "libvpx", Fraction(24,1), 1280, 720, Fraction(1,1), false, false, 30000000);
+
+	FFmpegWriter w2("output3-360p.webm");
+	w2.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	w2.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 8000000);
+
+	// Add the renditions (smallest first, which are sorted by size)
+	RenditionWriter w;
+	w.AddRendition(&w2);
+	w.AddRendition(&w1);
+	CHECK_EQUAL(2, w.GetRenditionCount());
+	CHECK_EQUAL(1280, w.info.width);
+	CHECK_EQUAL(720, w.info.height);
+
+	// Open, write some frames to both renditions, and close
+	w.Open();
+	w.WriteFrame(&r, 24, 50);
+	w.Close();
+	r.Close();
+
+	// Verify the size of each rendition
+	FFmpegReader r1("output3-720p.webm");
+	r1.Open();
+	CHECK_EQUAL(1280, r1.info.width);
+	CHECK_EQUAL(720, r1.info.height);
+	CHECK_EQUAL(1280, r1.GetFrame(8)->GetWidth());
+	r1.Close();
+
+	FFmpegReader r2("output3-360p.webm");
+	r2.Open();
+	CHECK_EQUAL(640, r2.info.width);
+	CHECK_EQUAL(360, r2.info.height);
+	CHECK_EQUAL(640, r2.GetFrame(8)->GetWidth());
+	r2.Close();
+}
+
+TEST(FFmpegWriter_HLS_Segments)
+{
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	/* WRITER ---------------- */
+	FFmpegWriter w("output4.m3u8");
+
+	// Set options (1 second segments, and keep all segments in the playlist)
+	w.SetAudioOptions(true, "mp2", 44100, 2, LAYOUT_STEREO, 128000);
+	w.SetVideoOptions(true, "mpeg2video", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	w.SetSegmentOptions(SEGMENT_HLS, 1.0, 0);
+
+	// Write 3 seconds of frames
+	w.Open();
+	w.WriteFrame(&r, 1, 72);
+	w.Close();
+	r.Close();
+
+	// Count the segments in the playlist
+	ifstream playlist("output4.m3u8");
+	CHECK(playlist.good());
+	string line;
+	int segments = 0;
+	bool has_end = false;
+	while (getline(playlist, line)) {
+		if (line.find("#EXTINF") == 0)
+			segments++;
+		if (line.find("#EXT-X-ENDLIST") == 0)
+			has_end = true;
+	}
+	CHECK(segments >= 2);
+	CHECK_EQUAL(true, has_end);
+}
+
+TEST(FFmpegWriter_Audio_Resampling)
+{
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "piano.wav";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	/* WRITER ---------------- */
+	FFmpegWriter w("output5.wav");
+
+	// Set options (PCM has no fixed frame size)
+	w.SetAudioOptions(true, "pcm_s16le", r.info.sample_rate, 2, LAYOUT_STEREO, 0);
+
+	// Write some frames
+	w.Open();
+	w.WriteFrame(&r, 1, 30);
+	w.Close();
+
+	FFmpegReader r1("output5.wav");
+	r1.Open();
+
+	// Verify the audio settings, and compare a few samples with the original
+	CHECK_EQUAL(2, r1.info.channels);
+	CHECK_EQUAL(r.info.sample_rate, r1.info.sample_rate);
+	float *samples = r1.GetFrame(1)->GetAudioSamples(0);
+	float *original_samples = r.GetFrame(1)->GetAudioSamples(0);
+	CHECK_CLOSE(original_samples[230], samples[230], 0.001);
+	CHECK_CLOSE(original_samples[300], samples[300], 0.001);
+
+	r1.Close();
+	r.Close();
+}
+
+TEST(FFmpegWriter_Parallel_Export)
+{
+	// Timeline with a single clip
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Timeline t(640, 360, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	Clip c(path.str());
+	t.AddClip(&c);
+
+	// Export 2 seconds of frames as 3 segments
+	ParallelExporter e(&t, "output6.webm");
+	e.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	e.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	e.SetFrameRange(1, 48);
+	e.SetSegmentCount(3);
+	CHECK_EQUAL(1, e.GetSegmentStart(0));
+	CHECK_EQUAL(16, e.GetSegmentEnd(0));
+	CHECK_EQUAL(48, e.GetSegmentEnd(2));
+	CHECK_EQUAL("output6.segment-0001.webm", e.GetSegmentPath(1));
+	e.Export();
+
+	// The segment files are removed once they are concatenated
+	ifstream segment(e.GetSegmentPath(0).c_str());
+	CHECK_EQUAL(false, segment.good());
+
+	// Verify the concatenated file
+	FFmpegReader r("output6.webm");
+	r.Open();
+	CHECK_EQUAL(true, r.info.has_video);
+	CHECK_EQUAL(true, r.info.has_audio);
+	CHECK_CLOSE(2.0, r.info.duration, 0.2);
+	CHECK_EQUAL(640, r.GetFrame(40)->GetWidth());
+	r.Close();
+}
+
+TEST(FFmpegWriter_Parallel_Export_Audio_Joints)
+{
+	// Timeline with a single audio clip
+	stringstream path;
+	path << TEST_MEDIA_PATH << "piano.wav";
+	Timeline t(640, 360, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	Clip c(path.str());
+	t.AddClip(&c);
+	t.Open();
+
+	// Export 2 seconds of frames as 3 segments (with lossless audio, so the samples can be compared)
+	ParallelExporter e(&t, "output13.mkv");
+	e.SetAudioOptions(true, "pcm_s16le", 44100, 2, LAYOUT_STEREO, 0);
+	e.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	e.SetFrameRange(1, 48);
+	e.SetSegmentCount(3);
+	e.Export();
+
+	// The audio is continuous at each joint (frames 16 and 17, and 32 and 33): no gap of silence, and no skipped samples
+	FFmpegReader r("output13.mkv");
+	r.Open();
+	CHECK_EQUAL(true, r.info.has_audio);
+	int64_t joint_frames[] = {16, 17, 32, 33};
+	for (int joint = 0; joint < 4; joint++) {
+		std::shared_ptr<Frame> exported = r.GetFrame(joint_frames[joint]);
+		std::shared_ptr<Frame> original = t.GetFrame(joint_frames[joint]);
+		int sample_count = std::min(exported->GetAudioSamplesCount(), original->GetAudioSamplesCount());
+		CHECK(sample_count > 1000);
+		float *exported_samples = exported->GetAudioSamples(0);
+		float *original_samples = original->GetAudioSamples(0);
+		for (int sample = 0; sample < sample_count; sample += 97)
+			CHECK_CLOSE(original_samples[sample], exported_samples[sample], 0.001);
+		CHECK_CLOSE(original_samples[sample_count - 1], exported_samples[sample_count - 1], 0.001);
+	}
+	r.Close();
+	t.Close();
+}
+
+TEST(FFmpegWriter_Distributed_Export)
+{
+	// Timeline with a single clip
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Timeline t(640, 360, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	Clip c(path.str());
+	t.AddClip(&c);
+
+	// Export 2 seconds of frames as 3 segments
+	ParallelExporter e(&t, "output8.webm");
+	e.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	e.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	e.SetFrameRange(1, 48);
+	e.SetSegmentCount(3);
+
+	// Two workers render the segments (and stop once the coordinator has none left)
+	std::atomic<int> rendered(0);
+	std::thread worker1([&rendered]() { RenderWorker w("tcp://127.0.0.1:5571", "."); rendered += w.Run(); });
+	std::thread worker2([&rendered]() { RenderWorker w("tcp://127.0.0.1:5571", "."); rendered += w.Run(); });
+	RenderCoordinator coordinator(&e, "tcp://127.0.0.1:5571");
+	coordinator.Export();
+	worker1.join();
+	worker2.join();
+	CHECK_EQUAL(3, coordinator.SegmentsDone());
+	CHECK_EQUAL(3, rendered.load());
+
+	// Verify the concatenated file
+	FFmpegReader r("output8.webm");
+	r.Open();
+	CHECK_EQUAL(true, r.info.has_video);
+	CHECK_EQUAL(true, r.info.has_audio);
+	CHECK_CLOSE(2.0, r.info.duration, 0.2);
+	r.Close();
+}
+
+TEST(FFmpegWriter_Stream_Export)
+{
+	// Timeline with a 1 second image clip
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip c(path.str());
+	c.Id("CLIP1");
+	c.Layer(1);
+	c.Position(0.0);
+	c.End(1.0);
+	Timeline t(640, 360, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&c);
+
+	FFmpegWriter w("output12.webm");
+	w.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	w.Open();
+
+	// Extend the clip (as a live edit), and queue an edit which can't be applied
+	Json::Value clip_json = c.JsonValue();
+	clip_json.removeMember("reader");
+	clip_json["end"] = 2.0;
+	Json::Value clip_key;
+	clip_key["id"] = "CLIP1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"] = clip_json;
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+
+	StreamExporter e(&t, &w);
+	e.SetRealTime(false);
+	e.QueueJsonDiff(changes.toStyledString());
+	e.QueueJsonDiff("not json");
+
+	// Stream 2 seconds of frames (as fast as they render)
+	e.Stream(1, 48);
+	w.Close();
+	t.Close();
+
+	CHECK_EQUAL(48, e.FramesWritten());
+	CHECK_CLOSE(2.0, c.End(), 0.0001);
+	Json::Value metrics = e.MetricsValue();
+	CHECK_EQUAL(1, metrics["rejected_edits"].asInt());
+	CHECK_EQUAL(1, metrics["edit_latency"]["count"].asInt());
+	CHECK_EQUAL(48, metrics["render_time"]["count"].asInt());
+
+	// Verify the streamed file
+	FFmpegReader r("output12.webm");
+	r.Open();
+	CHECK_EQUAL(true, r.info.has_video);
+	CHECK_CLOSE(2.0, r.info.duration, 0.2);
+	r.Close();
+}
+
+TEST(FFmpegWriter_Smart_Render)
+{
+	// Write a source file
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	FFmpegWriter w("output7.webm");
+	w.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	w.Open();
+	w.WriteFrame(&r, 1, 72);
+	w.Close();
+	r.Close();
+
+	// Trim the source file (with the same options), copying its keyframes
+	Timeline t(640, 360, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	Clip c("output7.webm");
+	t.AddClip(&c);
+	t.Open();
+	int64_t clip_start_frame = 0;
+	CHECK_EQUAL(&c, t.FindPassThroughClip(5, 60, clip_start_frame));
+	CHECK_EQUAL(5, clip_start_frame);
+
+	FFmpegWriter w1("output8.webm");
+	w1.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 128000);
+	w1.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 2000000);
+	w1.SetSmartRender(true);
+	w1.Open();
+	w1.WriteFrame(&t, 5, 60);
+	w1.Close();
+	t.Close();
+
+	// Verify the trimmed file
+	FFmpegReader r1("output8.webm");
+	r1.Open();
+	CHECK_EQUAL(true, r1.info.has_video);
+	CHECK_EQUAL(true, r1.info.has_audio);
+	CHECK_CLOSE(56.0 / 24.0, r1.info.duration, 0.2);
+	CHECK_EQUAL(640, r1.GetFrame(30)->GetWidth());
+	r1.Close();
+}
+
+TEST(FFmpegWriter_Raw_Pipe_Writer)
+{
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Write YUV frames and planar audio to a single file (with frame headers)
+	RawPipeWriter w("output9.raw");
+	w.SetVideoOptions(true, RAW_VIDEO_YUV420P, r.info.fps, 640, 360);
+	w.SetAudioOptions(true, r.info.sample_rate, 2, false);
+	w.Open();
+	w.WriteFrame(&r, 1, 3);
+	w.Close();
+	r.Close();
+
+	// Read the first frame back
+	ifstream raw("output9.raw", ios::binary);
+	RawFrameHeader header;
+	raw.read((char *) &header, sizeof(header));
+	CHECK_EQUAL(string("OSRF"), string(header.magic, 4));
+	CHECK_EQUAL(1, header.number);
+	CHECK_EQUAL(640, header.width);
+	CHECK_EQUAL(360, header.height);
+	CHECK_EQUAL(640 * 360 * 3 / 2, header.video_size);
+	CHECK_EQUAL(2, header.channels);
+	CHECK_EQUAL(int(sizeof(float)) * header.samples * 2, header.audio_size);
+
+	// The next frame follows the video and audio of the first frame
+	raw.seekg(header.video_size + header.audio_size, ios::cur);
+	raw.read((char *) &header, sizeof(header));
+	CHECK_EQUAL(2, header.number);
+}
+
+TEST(FFmpegWriter_Repeated_Images)
+{
+	// A still image (shared by every frame, i.e. a title card), in batches of 4 frames
+	std::shared_ptr<Frame> still(new Frame(1, 640, 360, "#ff0000"));
+	FFmpegWriter w("output11.webm");
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 640, 360, Fraction(1,1), false, false, 3000000);
+	w.SetCacheSize(4);
+	w.Open();
+	for (int64_t number = 1; number <= 10; number++) {
+		std::shared_ptr<Frame> f(new Frame(number, 640, 360, "#000000"));
+		f->ShareImage(still);
+		w.WriteFrame(f);
+	}
+
+	// A different image after the repeated images
+	w.WriteFrame(std::make_shared<Frame>(11, 640, 360, "#0000ff"));
+	w.Close();
+
+	// Every repeated frame is encoded (once converted), and the next image is converted again
+	FFmpegReader r("output11.webm");
+	r.Open();
+	for (int64_t number = 1; number <= 10; number += 3) {
+		const unsigned char* pixels = r.GetFrame(number)->GetPixels(180);
+		CHECK_CLOSE(255, (int)pixels[320 * 4], 10);
+		CHECK_CLOSE(0, (int)pixels[320 * 4 + 2], 10);
+	}
+	const unsigned char* pixels = r.GetFrame(11)->GetPixels(180);
+	CHECK_CLOSE(0, (int)pixels[320 * 4], 10);
+	CHECK_CLOSE(255, (int)pixels[320 * 4 + 2], 10);
+	r.Close();
+}
+
+#ifdef USE_RGBA64_IMAGES
+TEST(FFmpegWriter_High_Bit_Depth_Images)
+{
+	// Decode, composite, and encode frames with 16 bits per channel
+	Settings::Instance()->HIGH_BIT_DEPTH_IMAGES = true;
+
+	// Reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+	CHECK_EQUAL(QImage::Format_RGBA64, r.GetFrame(24)->GetImage()->format());
+
+	// Writer
+	FFmpegWriter w("output10.webm");
+	w.SetAudioOptions(true, "libvorbis", 44100, 2, LAYOUT_STEREO, 188000);
+	w.SetVideoOptions(true, "libvpx", Fraction(24,1), 1280, 720, Fraction(1,1), false, false, 30000000);
+	w.Open();
+	w.WriteFrame(&r, 24, 30);
+	w.Close();
+	r.Close();
+
+	// Reset settings
+	Settings::Instance()->HIGH_BIT_DEPTH_IMAGES = false;
+
+	// The encoded frames match the source (decoded as 8-bit RGBA)
+	FFmpegReader r1("output10.webm");
+	r1.Open();
+	CHECK_EQUAL(QImage::Format_RGBA8888, r1.GetFrame(1)->GetImage()->format());
+	CHECK_EQUAL(1280, r1.GetFrame(1)->GetWidth());
+	CHECK_EQUAL(true, r1.info.has_video);
+	r1.Close();
+}
+#endif
@@ -181,6 +181,38 @@ TEST(FrameMapper_30_fps_to_24_fps_Pulldown_None)
 	CHECK_EQUAL(6, frame5.Even.Frame);
 }
 
+TEST(FrameMapper_Long_Mapping)
+{
+	// Create a reader (10 hours long)
+	DummyReader r(Fraction(24, 1), 720, 480, 48000, 2, 36000.0);
+
+	// Create mapping between 24 fps and 30 fps (frames are mapped on demand, from a single period of the pull-down pattern)
+	FrameMapper mapping(&r, Fraction(30, 1), PULLDOWN_CLASSIC, 48000, 2, LAYOUT_STEREO);
+
+	// The pattern repeats every 5 frames (4 original frames)
+	for (int64_t frame_number = 1; frame_number <= 1080000 - 5; frame_number += 99991) {
+		MappedFrame frame = mapping.GetMappedFrame(frame_number);
+		MappedFrame next_period = mapping.GetMappedFrame(frame_number + 5);
+		CHECK_EQUAL(frame.Odd.Frame + 4, next_period.Odd.Frame);
+		CHECK_EQUAL(frame.Even.Frame + 4, next_period.Even.Frame);
+
+		// The audio samples of each frame continue from the previous frame
+		MappedFrame next = mapping.GetMappedFrame(frame_number + 1);
+		CHECK_EQUAL(1600, frame.Samples.total);
+		if (frame.Samples.sample_end + 1 == 2000) {
+			CHECK_EQUAL(frame.Samples.frame_end + 1, next.Samples.frame_start);
+			CHECK_EQUAL(0, next.Samples.sample_start);
+		} else {
+			CHECK_EQUAL(frame.Samples.frame_end, next.Samples.frame_start);
+			CHECK_EQUAL(frame.Samples.sample_end + 1, next.Samples.sample_start);
+		}
+	}
+
+	// The last frame maps near the end of the original video
+	MappedFrame last = mapping.GetMappedFrame(1080000);
+	CHECK_EQUAL(864000, last.Odd.Frame);
+}
+
 TEST(FrameMapper_resample_audio_48000_to_41000)
 {
 	// Create a reader: 24 fps, 2 channels, 48000 sample rate
@@ -210,3 +242,144 @@ TEST(FrameMapper_resample_audio_48000_to_41000)
 	// Close mapper
 	map.Close();
 }
+
+TEST(FrameMapper_Batch_Sequential_Frames)
+{
+	// Create a reader: 24 fps
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+
+	// Map to 30 fps (with classic pulldown, so some frames are woven from 2 fields)
+	FrameMapper map(&r, Fraction(30,1), PULLDOWN_CLASSIC, 44100, 2, LAYOUT_STEREO);
+	map.Open();
+
+	// Request frames in order (which maps a batch of frames, after the first ordered request)
+	for (int64_t frame_number = 1; frame_number <= 10; frame_number++) {
+		std::shared_ptr<Frame> f = map.GetFrame(frame_number);
+		CHECK_EQUAL(frame_number, f->number);
+		CHECK_EQUAL(1470, f->GetAudioSamplesCount());
+	}
+
+	// Compare the images with frames mapped one at a time (out of order)
+	FFmpegReader r2(path.str());
+	FrameMapper single(&r2, Fraction(30,1), PULLDOWN_CLASSIC, 44100, 2, LAYOUT_STEREO);
+	single.Open();
+	for (int64_t frame_number = 10; frame_number >= 1; frame_number -= 3) {
+		std::shared_ptr<QImage> batched = map.GetFrame(frame_number)->GetImage();
+		std::shared_ptr<QImage> expected = single.GetFrame(frame_number)->GetImage();
+		CHECK(*batched == *expected);
+	}
+
+	map.Close();
+	single.Close();
+}
+
+TEST(FrameMapper_GetFrames)
+{
+	// Create a reader: 24 fps
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+
+	// Map a range of frames to 30 fps (the source frames are read in a single call)
+	FrameMapper map(&r, Fraction(30,1), PULLDOWN_CLASSIC, 44100, 2, LAYOUT_STEREO);
+	map.Open();
+	std::vector<std::shared_ptr<Frame> > frames = map.GetFrames(20, 12);
+	CHECK_EQUAL(12, frames.size());
+
+	// Compare the images with frames mapped one at a time
+	FFmpegReader r2(path.str());
+	FrameMapper single(&r2, Fraction(30,1), PULLDOWN_CLASSIC, 44100, 2, LAYOUT_STEREO);
+	single.Open();
+	for (int index = 0; index < 12; index++) {
+		CHECK_EQUAL(20 + index, frames[index]->number);
+		CHECK(*frames[index]->GetImage() == *single.GetFrame(20 + index)->GetImage());
+	}
+
+	map.Close();
+	single.Close();
+}
+
+TEST(FrameMapper_resample_audio_stream)
+{
+	// Create a reader: 24 fps, 2 channels, 48000 sample rate
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+
+	// Map to 30 fps, 44100 sample rate (which resamples the audio as a stream, when frames are requested in order)
+	FrameMapper map(&r, Fraction(30,1), PULLDOWN_NONE, 44100, 2, LAYOUT_STEREO);
+	map.Open();
+
+	// Every frame gets the exact number of samples (so the audio does not drift)
+	for (int64_t frame_number = 1; frame_number <= 20; frame_number++)
+		CHECK_EQUAL(1470, map.GetFrame(frame_number)->GetAudioSamplesCount());
+
+	// Seeking restarts the stream
+	CHECK_EQUAL(1470, map.GetFrame(100)->GetAudioSamplesCount());
+	CHECK_EQUAL(1470, map.GetFrame(101)->GetAudioSamplesCount());
+	CHECK_EQUAL(44100, map.GetFrame(101)->SampleRate());
+
+	// Close mapper
+	map.Close();
+}
+
+TEST(FrameMapper_Interpolate_Frames)
+{
+	// Create a reader: 24 fps
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	FFmpegReader r(path.str());
+	r.Open();
+
+	// Map to 30 fps, blending the nearest frames
+	FrameMapper blend(&r, Fraction(30,1), PULLDOWN_BLEND, 48000, 2, LAYOUT_STEREO);
+	blend.Open();
+
+	// Frame 2 is 80% of the way from original frame 1 to original frame 2
+	std::shared_ptr<QImage> first = r.GetFrame(1)->GetImage();
+	std::shared_ptr<QImage> second = r.GetFrame(2)->GetImage();
+	std::shared_ptr<QImage> blended = blend.GetFrame(2)->GetImage();
+	CHECK_EQUAL(first->width(), blended->width());
+	CHECK_EQUAL(first->height(), blended->height());
+	for (int y = 0; y < blended->height(); y += 97) {
+		const unsigned char *first_row = first->constScanLine(y);
+		const unsigned char *second_row = second->constScanLine(y);
+		const unsigned char *blended_row = blended->constScanLine(y);
+		for (int x = 0; x < blended->width() * 4; x += 131)
+			CHECK_CLOSE(first_row[x] * 0.2 + second_row[x] * 0.8, blended_row[x], 1.0);
+	}
+
+	// Frame 6 lines up with original frame 5 (so it is not interpolated)
+	CHECK(*blend.GetFrame(6)->GetImage() == *r.GetFrame(5)->GetImage());
+
+	// Motion compensated frames are the size of the original frames
+	FrameMapper motion(&r, Fraction(30,1), PULLDOWN_MOTION, 48000, 2, LAYOUT_STEREO);
+	std::shared_ptr<QImage> interpolated = motion.GetFrame(3)->GetImage();
+	CHECK_EQUAL(first->width(), interpolated->width());
+	CHECK_EQUAL(first->height(), interpolated->height());
+
+	blend.Close();
+}
+
+TEST(FrameMapper_Samples_Per_Frame)
+{
+	// 48000 Hz stereo at 29.97 fps repeats every 5 frames (8008 samples)
+	Fraction ntsc(30000, 1001);
+	int cadence[] = {1600, 1602, 1602, 1602, 1602, 1600, 1602};
+	for (int index = 0; index < 7; index++)
+		CHECK_EQUAL(cadence[index], Frame::GetSamplesPerFrame(index + 1, ntsc, 48000, 2));
+	CHECK_EQUAL(8008, Frame::GetSamplesBeforeFrame(6, ntsc, 48000, 2));
+
+	// The frames always add up to the exact total (even after 10 hours)
+	CHECK_EQUAL(1727999872, Frame::GetSamplesBeforeFrame(1078922, ntsc, 48000, 2));
+	int64_t total = Frame::GetSamplesBeforeFrame(1000000, ntsc, 48000, 2);
+	for (int64_t frame = 1000000; frame < 1000100; frame++)
+		total += Frame::GetSamplesPerFrame(frame, ntsc, 48000, 2);
+	CHECK_EQUAL(Frame::GetSamplesBeforeFrame(1000100, ntsc, 48000, 2), total);
+
+	// Evenly divided rates
+	CHECK_EQUAL(1470, Frame::GetSamplesPerFrame(12345, Fraction(30, 1), 44100, 2));
+	CHECK_EQUAL(0, Frame::GetSamplesPerFrame(1, Fraction(30, 1), 0, 2));
+}
@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::ImageSequenceReader
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include <QtCore/QDir>
+#include <QtGui/QImage>
+
+using namespace std;
+using namespace openshot;
+
+// Write a sequence of solid color images (frame_1.png to frame_<count>.png, and a file which isn't part of it)
+static QString write_sequence(int count)
+{
+	QDir path = QDir::tempPath() + QString("/image-sequence/");
+	path.removeRecursively();
+	path.mkpath(".");
+	for (int number = 1; number <= count; number++) {
+		QImage image(320, 180, QImage::Format_RGBA8888);
+		image.fill(QColor(number * 20, 0, 0));
+		image.save(path.filePath(QString("frame_%1.png").arg(number)));
+	}
+	QImage(16, 16, QImage::Format_RGBA8888).save(path.filePath("thumbnail.png"));
+	return path.path();
+}
+
+TEST(ImageSequenceReader_Pattern)
+{
+	QString path = write_sequence(12);
+
+	// Any file of the sequence finds the other numbered files (sorted by number, not by name)
+	ImageSequenceReader r((path + "/frame_1.png").toStdString(), Fraction(24, 1));
+	r.Open();
+
+	CHECK_EQUAL(12, r.info.video_length);
+	CHECK_EQUAL(320, r.info.width);
+	CHECK_EQUAL(180, r.info.height);
+	CHECK_EQUAL(24, r.info.fps.num);
+	CHECK_CLOSE(0.5, r.info.duration, 0.001);
+	CHECK_EQUAL((path + "/frame_10.png").toStdString(), r.FramePath(10));
+
+	// Each frame has the image at the same position of the sequence (and the following frames are read ahead)
+	std::shared_ptr<Frame> f = r.GetFrame(10);
+	CHECK_EQUAL(10, f->number);
+	CHECK_EQUAL(200, (int) f->GetPixels(0)[0]);
+	CHECK_EQUAL(40, (int) r.GetFrame(2)->GetPixels(0)[0]);
+
+	// Frames past the end of the sequence are the last frame
+	CHECK_EQUAL(240, (int) r.GetFrame(20)->GetPixels(0)[0]);
+
+	// Larger images are scaled down to the max size
+	Settings::Instance()->MAX_WIDTH = 160;
+	Settings::Instance()->MAX_HEIGHT = 90;
+	f = r.GetFrame(3);
+	CHECK_EQUAL(160, f->GetWidth());
+	CHECK_EQUAL(90, f->GetHeight());
+	Settings::Instance()->MAX_WIDTH = 0;
+	Settings::Instance()->MAX_HEIGHT = 0;
+	CHECK_EQUAL(320, r.GetFrame(3)->GetWidth());
+
+	r.Close();
+
+	// A directory has every image in it
+	ImageSequenceReader d(path.toStdString());
+	CHECK_EQUAL(13, d.info.video_length);
+
+	QDir(path).removeRecursively();
+}
@@ -32,6 +32,8 @@
 // Prevent name clashes with juce::UnitTest
 #define DONT_SET_USING_JUCE_NAMESPACE 1
 #include "../include/OpenShot.h"
+#include "ScopedSetting.h"
+#include <QtCore/QDir>
 
 using namespace std;
 using namespace openshot;
@@ -82,4 +84,76 @@ TEST(ImageWriter_Test_Gif)
 	CHECK_CLOSE(11, (int)pixels[pixel_index + 2], 5);
 	CHECK_CLOSE(255, (int)pixels[pixel_index + 3], 5);
 }
+
+TEST(ImageWriter_Magick_Pixel_Formats)
+{
+	// Each frame image format goes to ImageMagick (and back) with the same colors
+	bool premultiplied[] = { false, true };
+	for (bool premultiplied_images : premultiplied)
+	{
+		ScopedSetting<bool> image_format(Settings::Instance()->PREMULTIPLIED_IMAGES, premultiplied_images);
+		Frame f(1, 8, 4, "#4080c0");
+		std::shared_ptr<Magick::Image> magick_image = f.GetMagickImage();
+		CHECK_EQUAL(8, (int) magick_image->columns());
+		CHECK_EQUAL(4, (int) magick_image->rows());
+
+		std::shared_ptr<QImage> image = Frame::MagickToImage(magick_image);
+		CHECK_EQUAL(Frame::ImageFormat(), image->format());
+		QColor color = image->pixelColor(3, 2);
+		CHECK_EQUAL(0x40, color.red());
+		CHECK_EQUAL(0x80, color.green());
+		CHECK_EQUAL(0xc0, color.blue());
+		CHECK_EQUAL(255, color.alpha());
+
+		// A transparent image is converted from (and to) premultiplied pixels
+		QImage transparent(8, 4, QImage::Format_RGBA8888);
+		transparent.fill(QColor(200, 100, 50, 128));
+		f.AddImage(std::make_shared<QImage>(transparent));
+		f.AddMagickImage(f.GetMagickImage());
+		color = f.GetImage()->pixelColor(0, 0);
+		CHECK_CLOSE(200, color.red(), 2);
+		CHECK_CLOSE(100, color.green(), 2);
+		CHECK_CLOSE(50, color.blue(), 2);
+		CHECK_CLOSE(128, color.alpha(), 1);
+	}
+}
 #endif
+
+TEST(ImageSequenceWriter_PNG)
+{
+	QDir path = QDir::tempPath() + QString("/image-sequence-writer/");
+	path.removeRecursively();
+	path.mkpath(".");
+
+	// Writer (with fewer queued frames than frames, so a batch is written before closing)
+	ImageSequenceWriter w(path.filePath("frame_%04d.png").toStdString());
+	w.SetVideoOptions("", Fraction(24, 1), 160, 90, -1);
+	w.SetCacheSize(3);
+	w.Open();
+	CHECK_EQUAL("PNG", w.info.vcodec);
+	CHECK_EQUAL(path.filePath("frame_0007.png").toStdString(), w.FramePath(7));
+
+	// Write frames of different colors (which are larger than the writer, so they are scaled)
+	const char* colors[] = { "#ff0000", "#00ff00", "#0000ff", "#ffffff", "#000000" };
+	for (int number = 1; number <= 5; number++)
+		w.WriteFrame(std::make_shared<Frame>(number, 320, 180, colors[number - 1]));
+	CHECK(QFile(path.filePath("frame_0003.png")).exists());
+	CHECK(!QFile(path.filePath("frame_0005.png")).exists());
+	w.Close();
+
+	// Read the sequence back
+	ImageSequenceReader r(path.filePath("frame_0001.png").toStdString(), Fraction(24, 1));
+	r.Open();
+	CHECK_EQUAL(5, r.info.video_length);
+	CHECK_EQUAL(160, r.info.width);
+	CHECK_EQUAL(90, r.info.height);
+
+	const unsigned char* pixels = r.GetFrame(2)->GetPixels(45);
+	CHECK_EQUAL(0, (int) pixels[0]);
+	CHECK_EQUAL(255, (int) pixels[1]);
+	CHECK_EQUAL(0, (int) pixels[2]);
+	CHECK_EQUAL(255, (int) r.GetFrame(4)->GetPixels(0)[2]);
+	r.Close();
+
+	path.removeRecursively();
+}
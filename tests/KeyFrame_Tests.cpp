@@ -147,6 +147,140 @@ TEST(Keyframe_GetValue_For_Bezier_Curve_5_Points_25_Percent_Handle)
 	CHECK_EQUAL(201, kf.GetLength());
 }
 
+TEST(Keyframe_GetValue_For_Bezier_Curve_Benchmark)
+{
+	// Create a keyframe curve with 5 points
+	Keyframe kf;
+	kf.AddPoint(openshot::Point(Coordinate(1, 1), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(50, 4), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(100, 10), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(150, 0), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(200, 3), BEZIER));
+
+	// Evaluate every frame of the curve many times (like the animated properties of many clips)
+	double total = 0.0;
+	{
+		UNITTEST_TIME_CONSTRAINT(2000);
+		for (int repeat = 0; repeat < 1000; repeat++)
+			for (int64_t index = 1; index <= 200; index++)
+				total += kf.GetValue(index);
+	}
+	CHECK(total > 0.0);
+
+	// Handles which fold the curve back still return a value (within the range of the curve)
+	openshot::Point folded(Coordinate(100, 10), BEZIER);
+	folded.handle_left = Coordinate(-2.0, 1.0);
+	Keyframe folded_kf;
+	folded_kf.AddPoint(openshot::Point(Coordinate(1, 1), BEZIER));
+	folded_kf.AddPoint(folded);
+	for (int64_t index = 1; index <= 100; index++) {
+		double value = folded_kf.GetValue(index);
+		CHECK(value >= 0.9 && value <= 10.1);
+	}
+}
+
+TEST(Keyframe_Bake)
+{
+	// Create a keyframe curve with 3 points
+	Keyframe kf;
+	kf.AddPoint(openshot::Point(Coordinate(1, 1), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(25, 8), LINEAR));
+	kf.AddPoint(openshot::Point(Coordinate(50, 2), BEZIER));
+	Keyframe unbaked = kf;
+
+	// Bake the animated range (and the baked values match the interpolated ones)
+	CHECK_EQUAL(true, kf.Bake());
+	CHECK_EQUAL(true, kf.IsBaked(1));
+	CHECK_EQUAL(true, kf.IsBaked(50));
+	CHECK_EQUAL(false, kf.IsBaked(51));
+	for (int64_t index = -2; index <= 55; index++) {
+		CHECK_EQUAL(unbaked.GetValue(index), kf.GetValue(index));
+		CHECK_EQUAL(unbaked.GetInt(index), kf.GetInt(index));
+	}
+
+	// Changing the points discards the baked values
+	kf.AddPoint(openshot::Point(Coordinate(10, 20), LINEAR));
+	CHECK_EQUAL(false, kf.IsBaked(10));
+	CHECK_CLOSE(20.0, kf.GetValue(10), 0.0001);
+
+	// A constant curve is not baked
+	Keyframe constant(5.0);
+	CHECK_EQUAL(false, constant.Bake());
+	CHECK_EQUAL(false, constant.IsBaked(1));
+}
+
+TEST(Keyframe_BakeTimeMap)
+{
+	// Create a speed ramped time curve (slow, fast, and reversed)
+	Keyframe time;
+	time.AddPoint(1, 1);
+	time.AddPoint(100, 50, LINEAR);
+	time.AddPoint(200, 300, BEZIER);
+	time.AddPoint(300, 280, BEZIER);
+	Keyframe unbaked = time;
+
+	// The baked repeat fractions, deltas, and directions match the calculated ones
+	CHECK_EQUAL(true, time.BakeTimeMap());
+	for (int64_t index = -2; index <= 305; index++) {
+		CHECK_EQUAL(unbaked.GetRepeatFraction(index).num, time.GetRepeatFraction(index).num);
+		CHECK_EQUAL(unbaked.GetRepeatFraction(index).den, time.GetRepeatFraction(index).den);
+		CHECK_EQUAL(unbaked.GetDelta(index), time.GetDelta(index));
+		CHECK_EQUAL(unbaked.IsIncreasing(index), time.IsIncreasing(index));
+	}
+}
+
+TEST(Keyframe_Cursor)
+{
+	// Create a keyframe curve with mixed interpolations
+	Keyframe kf;
+	kf.AddPoint(openshot::Point(Coordinate(1, 1), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(25, 8), LINEAR));
+	kf.AddPoint(openshot::Point(Coordinate(50, 2), CONSTANT));
+	kf.AddPoint(openshot::Point(Coordinate(90, 3), BEZIER));
+
+	// A cursor returns the same values, for increasing, decreasing, and jumping indexes
+	Keyframe::Cursor cursor(kf);
+	for (int64_t index = -2; index <= 95; index++)
+		CHECK_EQUAL(kf.GetValue(index), cursor.GetValue(index));
+	for (int64_t index = 95; index >= -2; index--)
+		CHECK_EQUAL(kf.GetLong(index), cursor.GetLong(index));
+	CHECK_EQUAL(kf.GetValue(70), cursor.GetValue(70));
+	CHECK_EQUAL(kf.GetValue(3), cursor.GetValue(3));
+
+	// Evaluate a span of frames
+	double values[100];
+	kf.GetValues(-4, 100, values);
+	for (int64_t offset = 0; offset < 100; offset++)
+		CHECK_EQUAL(kf.GetValue(offset - 4), values[offset]);
+}
+
+TEST(Keyframe_GetValues_After_Changing_Points)
+{
+	// Points between frames, and a partly baked curve
+	Keyframe kf;
+	kf.AddPoint(openshot::Point(Coordinate(1, 10), LINEAR));
+	kf.AddPoint(openshot::Point(Coordinate(20.5, 4), BEZIER));
+	kf.AddPoint(openshot::Point(Coordinate(40, 7), LINEAR));
+	kf.Bake(10, 15);
+
+	// Inserting, moving, and removing points updates the segments the spans are evaluated with
+	double values[60];
+	for (int change = 0; change < 4; change++) {
+		if (change == 1)
+			kf.AddPoint(openshot::Point(Coordinate(30, -2), CONSTANT));
+		else if (change == 2)
+			kf.UpdatePoint(0, openshot::Point(Coordinate(5, 1), LINEAR));
+		else if (change == 3)
+			kf.RemovePoint(openshot::Point(Coordinate(20.5, 4)));
+
+		kf.GetValues(-5, 60, values);
+		for (int64_t offset = 0; offset < 60; offset++)
+			CHECK_EQUAL(kf.GetValue(offset - 5), values[offset]);
+	}
+	CHECK_EQUAL(1.0, values[0]);
+	CHECK_EQUAL(7.0, values[59]);
+}
+
 TEST(Keyframe_GetValue_For_Linear_Curve_3_Points)
 {
 	// Create a keyframe curve with 2 points
@@ -426,6 +560,25 @@ TEST(Keyframe_Constant_Interpolation_First_Segment)
 	CHECK_EQUAL(100, kf.GetInt(4));
 }
 
+TEST(Keyframe_IsConstant)
+{
+	Keyframe kf;
+	kf.AddPoint(Point(Coordinate(1, 10), LINEAR));
+	kf.AddPoint(Point(Coordinate(20, 10), BEZIER));
+	kf.AddPoint(Point(Coordinate(40, 30), LINEAR));
+	kf.AddPoint(Point(Coordinate(60, 30), CONSTANT));
+
+	CHECK_EQUAL(true, kf.IsConstant(-5, 20));
+	CHECK_EQUAL(true, kf.IsConstant(20, 5));
+	CHECK_EQUAL(false, kf.IsConstant(15, 21));
+	CHECK_EQUAL(false, kf.IsConstant(21, 22));
+	CHECK_EQUAL(true, kf.IsConstant(40, 100));
+	CHECK_EQUAL(true, kf.IsConstant(45, 50));
+	CHECK_EQUAL(true, kf.IsConstant(7, 7));
+	CHECK_EQUAL(true, Keyframe().IsConstant(1, 100));
+	CHECK_EQUAL(true, Keyframe(5.0).IsConstant(1, 100));
+}
+
 TEST(Keyframe_isIncreasing)
 {
 	// Which cases need to be tested to keep same behaviour as
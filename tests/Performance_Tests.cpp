@@ -0,0 +1,266 @@
+/**
+ * @file
+ * @brief Source file for performance tests (timed scenarios, compared with stored baselines)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include "../include/Json.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace openshot;
+
+// The scenarios of this suite only run with "openshot-test --performance" (see tests.cpp). Each scenario runs
+// PERFORMANCE_RUNS times, and its best run is compared with its baseline (in performance_baselines_path, see
+// tests.cpp): a scenario fails if its frames per second drop, or its allocations per frame or peak memory grow,
+// by more than the tolerance of the baselines, and it fails if it has no baseline. With --update-baselines, the
+// measurements are stored as the new baselines (which depend on the machine, so record them on the machine which
+// runs the comparison).
+#define PERFORMANCE_RUNS 3
+
+extern bool update_performance_baselines;
+extern std::string performance_baselines_path;
+
+// The measurements of a run of a scenario
+class Measurement {
+private:
+	std::chrono::steady_clock::time_point start;
+	int64_t start_bytes;
+
+	// The bytes held by each subsystem (now, or at their peak since the last Metrics::Reset())
+	static int64_t tracked_bytes(std::string field) {
+		Json::Value memory = Metrics::Instance()->MemoryValue();
+		int64_t bytes = 0;
+		for (Json::Value::const_iterator itr = memory.begin(); itr != memory.end(); ++itr)
+			if (itr.key().asString() != "images.pool_free")
+				bytes += (*itr)[field].asInt64();
+		return bytes;
+	}
+
+public:
+	int64_t frames;
+	double seconds;
+	int64_t allocations;
+	int64_t peak_bytes;
+
+	Measurement() : start_bytes(0), frames(0), seconds(0.0), allocations(0), peak_bytes(0) {}
+
+	// Start measuring (after the setup of a scenario), without recycled buffers from earlier scenarios
+	void Start() {
+		ImageBufferPool::Instance()->Clear();
+		Metrics::Instance()->Reset();
+		start_bytes = tracked_bytes("current");
+		start = std::chrono::steady_clock::now();
+	}
+
+	// Stop measuring, after a number of frames
+	void Stop(int64_t frame_count) {
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		frames = frame_count;
+		allocations = Metrics::Instance()->GetCounter("images.allocations").Value();
+		peak_bytes = tracked_bytes("peak") - start_bytes;
+	}
+
+	double FramesPerSecond() const { return (seconds > 0.0) ? frames / seconds : 0.0; }
+	double AllocationsPerFrame() const { return (frames > 0) ? double(allocations) / frames : 0.0; }
+	double PeakMegabytes() const { return peak_bytes / (1024.0 * 1024.0); }
+};
+
+// Run a scenario a few times, and keep the best of each measurement
+static Measurement measure(std::function<void(Measurement&)> scenario) {
+	Measurement best;
+	for (int run = 0; run < PERFORMANCE_RUNS; run++) {
+		Measurement measurement;
+		scenario(measurement);
+		if (run == 0 || measurement.FramesPerSecond() > best.FramesPerSecond()) {
+			best.frames = measurement.frames;
+			best.seconds = measurement.seconds;
+		}
+		best.allocations = (run == 0) ? measurement.allocations : std::min(best.allocations, measurement.allocations);
+		best.peak_bytes = (run == 0) ? measurement.peak_bytes : std::min(best.peak_bytes, measurement.peak_bytes);
+	}
+	return best;
+}
+
+// Compare the measurements of a scenario with its baseline (or store them, with --update-baselines)
+static bool within_baseline(std::string scenario, const Measurement& measurement) {
+	Json::Value baselines;
+	{
+		ifstream file(performance_baselines_path);
+		stringstream contents;
+		contents << file.rdbuf();
+		if (!ParseJson(contents.str(), baselines) || !baselines.isObject())
+			baselines = Json::Value(Json::objectValue);
+	}
+	double tolerance = baselines.get("tolerance", 0.2).asDouble();
+
+	cout << "Performance: " << scenario << ": " << measurement.FramesPerSecond() << " fps, "
+		 << measurement.AllocationsPerFrame() << " allocations per frame, " << measurement.PeakMegabytes() << " MB peak" << endl;
+
+	if (update_performance_baselines) {
+		Json::Value& baseline = baselines["scenarios"][scenario];
+		baseline["fps"] = measurement.FramesPerSecond();
+		baseline["allocations_per_frame"] = measurement.AllocationsPerFrame();
+		baseline["peak_mb"] = measurement.PeakMegabytes();
+		baselines["tolerance"] = tolerance;
+		ofstream file(performance_baselines_path);
+		file << baselines.toStyledString();
+		if (!file) {
+			cerr << "Performance: the baselines could not be written to " << performance_baselines_path << endl;
+			return false;
+		}
+		return true;
+	}
+
+	// A scenario without a baseline is not compared with anything, so it fails (instead of silently passing)
+	if (!baselines["scenarios"].isMember(scenario)) {
+		cerr << "Performance: " << scenario << " has no baseline in " << performance_baselines_path << " (run 'make os_perf_baselines', or pass a file with --baselines)" << endl;
+		return false;
+	}
+
+	// Allocations and memory are allowed a small absolute margin too, so a baseline of nothing is not flaky
+	const Json::Value& baseline = baselines["scenarios"][scenario];
+	bool passed = true;
+	if (measurement.FramesPerSecond() < baseline["fps"].asDouble() * (1.0 - tolerance)) {
+		cerr << "Performance: " << scenario << " regressed to " << measurement.FramesPerSecond() << " fps (baseline " << baseline["fps"].asDouble() << ")" << endl;
+		passed = false;
+	}
+	if (measurement.AllocationsPerFrame() > baseline["allocations_per_frame"].asDouble() * (1.0 + tolerance) + 0.5) {
+		cerr << "Performance: " << scenario << " regressed to " << measurement.AllocationsPerFrame() << " allocations per frame (baseline " << baseline["allocations_per_frame"].asDouble() << ")" << endl;
+		passed = false;
+	}
+	if (measurement.PeakMegabytes() > baseline["peak_mb"].asDouble() * (1.0 + tolerance) + 4.0) {
+		cerr << "Performance: " << scenario << " regressed to " << measurement.PeakMegabytes() << " MB peak (baseline " << baseline["peak_mb"].asDouble() << ")" << endl;
+		passed = false;
+	}
+	return passed;
+}
+
+SUITE(Performance)
+{
+
+TEST(Performance_Timeline_Render)
+{
+	// Composite 4 translucent image layers (so only the compositing is measured)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Measurement measurement = measure([&](Measurement& m) {
+		Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+		std::vector<std::unique_ptr<Clip> > clips;
+		for (int layer = 0; layer < 4; layer++) {
+			clips.emplace_back(new Clip(path.str()));
+			clips.back()->Layer(layer);
+			clips.back()->End(10.0);
+			clips.back()->alpha = Keyframe(0.5);
+			t.AddClip(clips.back().get());
+		}
+		t.Open();
+
+		m.Start();
+		for (int64_t frame = 1; frame <= 60; frame++)
+			t.GetFrame(frame);
+		m.Stop(60);
+		t.Close();
+	});
+	CHECK(within_baseline("timeline_render", measurement));
+}
+
+TEST(Performance_Cache_Frames)
+{
+	// Add 720p frames to a cache which holds about half of them, and get them back
+	Measurement measurement = measure([&](Measurement& m) {
+		CacheMemory c(1280 * 720 * 4 * 50);
+
+		m.Start();
+		for (int64_t frame = 1; frame <= 100; frame++) {
+			std::shared_ptr<Frame> f = std::make_shared<Frame>(frame, 1280, 720, "#000000");
+			f->AddColor(1280, 720, "#336699");
+			c.Add(f);
+		}
+		for (int64_t frame = 1; frame <= 100; frame++)
+			c.GetFrame(frame);
+		m.Stop(100);
+	});
+	CHECK(within_baseline("cache_frames", measurement));
+}
+
+TEST(Performance_FFmpegReader_Decode)
+{
+	// Decode the first 5 seconds of a 720p video, in order
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Measurement measurement = measure([&](Measurement& m) {
+		FFmpegReader r(path.str());
+		r.Open();
+
+		m.Start();
+		for (int64_t frame = 1; frame <= 120; frame++)
+			r.GetFrame(frame);
+		m.Stop(120);
+		r.Close();
+	});
+	CHECK(within_baseline("reader_decode", measurement));
+}
+
+TEST(Performance_FFmpegWriter_Export)
+{
+	// Export 3 seconds of a timeline (with the MPEG-4 encoder, which is part of every FFmpeg build)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Measurement measurement = measure([&](Measurement& m) {
+		Timeline t(1280, 720, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+		Clip c(path.str());
+		t.AddClip(&c);
+		t.Open();
+		FFmpegWriter w("output_performance.mp4");
+		w.SetAudioOptions(true, "mp2", 44100, 2, LAYOUT_STEREO, 128000);
+		w.SetVideoOptions(true, "mpeg4", Fraction(24, 1), 1280, 720, Fraction(1, 1), false, false, 3000000);
+		w.Open();
+
+		m.Start();
+		w.WriteFrame(&t, 1, 72);
+		w.Close();
+		m.Stop(72);
+		t.Close();
+	});
+	remove("output_performance.mp4");
+	CHECK(within_baseline("writer_export", measurement));
+}
+
+} // SUITE(Performance)
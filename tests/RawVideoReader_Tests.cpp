@@ -0,0 +1,107 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::RawVideoReader
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include <fstream>
+
+using namespace std;
+using namespace openshot;
+
+#ifndef _WIN32
+TEST(RawVideoReader_Y4M)
+{
+	// Write 5 frames of 4:2:0 YUV (a gray luma of 40 * number, and neutral chroma)
+	ofstream y4m("output.y4m", ios::binary);
+	y4m << "YUV4MPEG2 W64 H32 F24:1 Ip A1:1 C420jpeg\n";
+	for (int number = 1; number <= 5; number++) {
+		y4m << "FRAME\n";
+		y4m << string(64 * 32, char(40 * number)) << string(32 * 16 * 2, char(128));
+	}
+	y4m.close();
+
+	RawVideoReader r("output.y4m");
+	r.Open();
+	CHECK_EQUAL(5, r.info.video_length);
+	CHECK_EQUAL(64, r.info.width);
+	CHECK_EQUAL(32, r.info.height);
+	CHECK_EQUAL(24, r.info.fps.num);
+	CHECK_EQUAL(false, r.info.has_audio);
+
+	// The planes point into the file (in any order of frames), and the image is converted from them
+	std::shared_ptr<Frame> f = r.GetFrame(4);
+	std::shared_ptr<FramePlanes> planes = f->GetPlanes();
+	CHECK(planes != NULL);
+	CHECK_EQUAL(160, (int) planes->data[0][0]);
+	CHECK_EQUAL(AV_PIX_FMT_YUV420P, planes->pixel_format);
+	CHECK_CLOSE(40, (int) r.GetFrame(1)->GetPixels(10)[1], 25);
+	CHECK(r.GetFrame(5)->GetPixels(10)[1] > r.GetFrame(2)->GetPixels(10)[1]);
+
+	// The frames keep the file mapped after the reader is closed
+	r.Close();
+	CHECK_EQUAL(160, (int) planes->data[0][64 * 32 - 1]);
+}
+
+TEST(RawVideoReader_Frame_Headers)
+{
+	// Write RGBA frames (and planar audio) with frame headers
+	RawPipeWriter w("output.osrf");
+	w.SetVideoOptions(true, RAW_VIDEO_RGBA, Fraction(30, 1), 32, 16);
+	w.SetAudioOptions(true, 48000, 2, false);
+	w.SetFrameHeaders(true);
+	w.Open();
+	for (int number = 1; number <= 3; number++) {
+		std::shared_ptr<Frame> f(new Frame(number, 32, 16, "#000000", 1600, 2));
+		f->AddColor(32, 16, qRgb(number * 50, 0, 0));
+		f->SampleRate(48000);
+		std::vector<float> samples(1600, 0.25f * number);
+		f->AddAudio(true, 0, 0, samples.data(), 1600, 1.0);
+		w.WriteFrame(f);
+	}
+	w.Close();
+
+	RawVideoReader r("output.osrf");
+	r.Open();
+	CHECK_EQUAL(3, r.info.video_length);
+	CHECK_EQUAL(true, r.info.has_audio);
+	CHECK_EQUAL(48000, r.info.sample_rate);
+
+	// Each frame has its image and audio
+	std::shared_ptr<Frame> f = r.GetFrame(2);
+	CHECK_EQUAL(32, f->GetWidth());
+	CHECK_EQUAL(1600, f->GetAudioSamplesCount());
+	CHECK_CLOSE(0.5, f->GetAudioSamples(0)[100], 0.0001);
+	CHECK_CLOSE(0.0, f->GetAudioSamples(1)[100], 0.0001);
+	CHECK_EQUAL(150, qRed(f->GetImage()->pixel(5, 5)));
+	r.Close();
+}
+#endif
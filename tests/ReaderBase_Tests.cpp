@@ -28,6 +28,9 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "UnitTest++.h"
 // Prevent name clashes with juce::UnitTest
 #define DONT_SET_USING_JUCE_NAMESPACE 1
@@ -69,3 +72,153 @@ TEST(ReaderBase_Derived_Class)
 	CHECK_EQUAL(1, t1.info.fps.num);
 	CHECK_EQUAL(1, t1.info.fps.den);
 }
+
+TEST(ReaderBase_TryGetFrame)
+{
+	// A reader which has no frames after frame 10
+	class TestReader : public ReaderBase
+	{
+	public:
+		bool is_open;
+		TestReader() : is_open(false) { };
+		CacheBase* GetCache() { return NULL; };
+		std::shared_ptr<Frame> GetFrame(int64_t number) {
+			if (!is_open)
+				throw ReaderClosed("The TestReader is closed.");
+			if (number > 10)
+				throw OutOfBoundsFrame("An invalid frame was requested.", number, 10);
+			return std::make_shared<Frame>(number, 1, 1, "#000000");
+		}
+		void Close() { is_open = false; };
+		void Open() { is_open = true; };
+		string Json() { return ""; };
+		void SetJson(string value) { };
+		Json::Value JsonValue() { return Json::Value(); };
+		void SetJsonValue(Json::Value root) { };
+		bool IsOpen() { return is_open; };
+		string Name() { return "TestReader"; };
+	};
+
+	TestReader r;
+	std::shared_ptr<Frame> f;
+	CHECK_EQUAL(FRAME_READER_CLOSED, r.TryGetFrame(1, f));
+	CHECK(f == NULL);
+
+	r.Open();
+	CHECK_EQUAL(FRAME_OK, r.TryGetFrame(5, f));
+	CHECK_EQUAL(5, f->number);
+	CHECK_EQUAL(FRAME_OUT_OF_BOUNDS, r.TryGetAudioFrame(11, f));
+	CHECK(f == NULL);
+
+	// The status of a frame request (which Wait() throws)
+	CHECK_EQUAL(FRAME_OK, r.RequestFrame(2, REQUEST_VISIBLE)->TryWait(f));
+	CHECK_EQUAL(2, f->number);
+	CHECK_EQUAL(FRAME_OUT_OF_BOUNDS, r.RequestFrame(12, REQUEST_VISIBLE)->TryWait(f));
+	CHECK_THROW(r.RequestFrame(12, REQUEST_VISIBLE)->Wait(), OutOfBoundsFrame);
+	r.Close();
+	CHECK_THROW(r.RequestFrame(1, REQUEST_VISIBLE)->Wait(), ReaderClosed);
+}
+
+// A reader which blocks in GetFrame until its gate is opened (and fails to render frame 13)
+class RequestTestReader : public ReaderBase
+{
+public:
+	std::mutex gate_mutex;
+	std::condition_variable gate_changed;
+	bool gate_open;
+	std::vector<int64_t> rendered;
+
+	RequestTestReader() : gate_open(false) { };
+	~RequestTestReader() { FinishFrameRequests(); };
+	void OpenGate() {
+		std::lock_guard<std::mutex> lock(gate_mutex);
+		gate_open = true;
+		gate_changed.notify_all();
+	}
+	void WaitForRenders(size_t count) {
+		std::unique_lock<std::mutex> lock(gate_mutex);
+		gate_changed.wait(lock, [this, count]() { return rendered.size() >= count; });
+	}
+	CacheBase* GetCache() { return NULL; };
+	std::shared_ptr<Frame> GetFrame(int64_t number) {
+		{
+			std::unique_lock<std::mutex> lock(gate_mutex);
+			rendered.push_back(number);
+			gate_changed.notify_all();
+			gate_changed.wait(lock, [this]() { return gate_open; });
+		}
+		if (number == 13)
+			throw InvalidFile("Frame 13 can't be rendered.", "");
+		return std::make_shared<Frame>(number, 1, 1, "#000000");
+	}
+	void Close() { };
+	void Open() { };
+	string Json() { return ""; };
+	void SetJson(string value) { };
+	Json::Value JsonValue() { return Json::Value(); };
+	void SetJsonValue(Json::Value root) { };
+	bool IsOpen() { return true; };
+	string Name() { return "RequestTestReader"; };
+};
+
+TEST(ReaderBase_Frame_Request_Priority)
+{
+	RequestTestReader r;
+
+	// Block the request task on frame 1, while more requests are queued
+	std::shared_ptr<FrameRequest> first = r.RequestFrame(1, REQUEST_PREFETCH);
+	r.WaitForRenders(1);
+	std::shared_ptr<FrameRequest> prefetched = r.RequestFrame(2, REQUEST_PREFETCH);
+	std::shared_ptr<FrameRequest> cancelled = r.RequestFrame(3, REQUEST_PREFETCH);
+	std::shared_ptr<FrameRequest> visible = r.RequestFrame(4, REQUEST_VISIBLE);
+	CHECK(r.HasVisibleRequests());
+	cancelled->Cancel();
+	r.OpenGate();
+
+	// The visible frame is rendered before the prefetched frame (which was requested first)
+	CHECK_EQUAL(4, visible->Wait()->number);
+	CHECK_EQUAL(2, prefetched->Wait()->number);
+	CHECK_EQUAL(1, first->Wait()->number);
+	CHECK_EQUAL(3, (int) r.rendered.size());
+	CHECK_EQUAL(1, r.rendered[0]);
+	CHECK_EQUAL(4, r.rendered[1]);
+	CHECK_EQUAL(2, r.rendered[2]);
+
+	// The cancelled request is skipped (with a NULL frame)
+	std::shared_ptr<Frame> f;
+	CHECK(cancelled->Wait() == NULL);
+	CHECK_EQUAL(FRAME_CANCELLED, cancelled->TryWait(f));
+	CHECK(f == NULL);
+	CHECK_EQUAL(false, r.HasVisibleRequests());
+}
+
+TEST(ReaderBase_Frame_Request_Exception)
+{
+	RequestTestReader r;
+	r.OpenGate();
+
+	// The exception of GetFrame is re-thrown by Wait() (and the next requests still render)
+	CHECK_THROW(r.RequestFrame(13, REQUEST_VISIBLE)->Wait(), InvalidFile);
+	CHECK_EQUAL(14, r.RequestFrame(14, REQUEST_VISIBLE)->Wait()->number);
+	CHECK_EQUAL(false, r.HasVisibleRequests());
+}
+
+TEST(ReaderBase_Frame_Request_Destroyed_Reader)
+{
+	RequestTestReader *r = new RequestTestReader();
+
+	// Destroy the reader while a request is rendering, and more are waiting
+	std::shared_ptr<FrameRequest> rendering = r->RequestFrame(1, REQUEST_VISIBLE);
+	r->WaitForRenders(1);
+	std::shared_ptr<FrameRequest> waiting = r->RequestFrame(2, REQUEST_VISIBLE);
+	std::thread opener([r]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		r->OpenGate();
+	});
+	delete r;
+	opener.join();
+
+	// The rendering request finished, and the waiting request was cancelled (without calling GetFrame)
+	CHECK_EQUAL(1, rendering->Wait()->number);
+	CHECK(waiting->Wait() == NULL);
+}
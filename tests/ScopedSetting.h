@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief Header file for ScopedSetting template (changes a Settings value for the rest of a test)
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPENSHOT_TESTS_SCOPED_SETTING_H
+#define OPENSHOT_TESTS_SCOPED_SETTING_H
+
+/// @brief Changes a value of the global openshot::Settings, and restores the previous value when it goes out of scope
+///
+/// A failed CHECK doesn't end a test, and a thrown exception does, so a test which changes a setting restores it with
+/// a ScopedSetting (instead of at the end of the test), and the setting never leaks into the tests which follow.
+///
+/// @code
+/// ScopedSetting<bool> deterministic(Settings::Instance()->DETERMINISTIC_RENDER, true);
+/// @endcode
+template<class T>
+class ScopedSetting {
+private:
+	T &setting;
+	T previous;
+
+public:
+	/// Change a setting (until this is destroyed)
+	ScopedSetting(T &setting, T value) : setting(setting), previous(setting) { setting = value; }
+
+	/// Restore the previous value of the setting
+	~ScopedSetting() { setting = previous; }
+};
+
+#endif
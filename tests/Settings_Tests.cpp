@@ -62,3 +62,26 @@ TEST(Settings_Change_Settings)
 	CHECK_EQUAL(true, Settings::Instance()->HIGH_QUALITY_SCALING);
 	CHECK_EQUAL(true, Settings::Instance()->WAIT_FOR_VIDEO_PROCESSING_TASK);
 }
+
+TEST(Settings_Autotune_Threads)
+{
+	// Measure the thread counts (keeping the counts of the other tests)
+	Settings *s = Settings::Instance();
+	int omp_threads = s->OMP_THREADS;
+	int ff_threads = s->FF_THREADS;
+	int encode_threads = s->ENCODE_THREADS;
+	ThreadTuner::Instance()->Tune();
+	CHECK_EQUAL(true, ThreadTuner::Instance()->IsTuned());
+
+	// Each count is between 1 and the number of cores (at least 2 for compositing)
+	Json::Value results = ThreadTuner::Instance()->JsonValue();
+	int cores = results["cores"].asInt();
+	CHECK(s->OMP_THREADS >= 2 && s->OMP_THREADS <= std::max(2, cores));
+	CHECK(s->FF_THREADS >= 1 && s->FF_THREADS <= std::max(1, cores));
+	CHECK(s->ENCODE_THREADS >= 1 && s->ENCODE_THREADS <= std::max(1, cores));
+	CHECK_EQUAL(s->OMP_THREADS, results["composite_threads"].asInt());
+
+	s->OMP_THREADS = omp_threads;
+	s->FF_THREADS = ff_threads;
+	s->ENCODE_THREADS = encode_threads;
+}
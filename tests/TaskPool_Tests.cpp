@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @brief Unit tests for openshot::TaskPool and openshot::TaskGroup
+ * @author Jonathan Thomas <jonathan@openshot.org>
+ *
+ * @ref License
+ */
+
+/* LICENSE
+ *
+ * Copyright (c) 2008-2019 OpenShot Studios, LLC
+ * <http://www.openshotstudios.com/>. This file is part of
+ * OpenShot Library (libopenshot), an open-source project dedicated to
+ * delivering high quality video editing and animation solutions to the
+ * world. For more information visit <http://www.openshot.org/>.
+ *
+ * OpenShot Library (libopenshot) is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * OpenShot Library (libopenshot) is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UnitTest++.h"
+// Prevent name clashes with juce::UnitTest
+#define DONT_SET_USING_JUCE_NAMESPACE 1
+#include "../include/OpenShot.h"
+#include "ScopedSetting.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace openshot;
+
+TEST(TaskPool_Group_Wait)
+{
+	// Wait for all the tasks of a group
+	std::atomic<int> finished(0);
+	TaskGroup group;
+	for (int task = 0; task < 100; task++)
+		group.Run([&finished]() {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			finished++;
+		});
+	group.Wait();
+	CHECK_EQUAL(100, finished);
+
+	// A group can be used again after it is waited on
+	group.Run([&finished]() { finished++; });
+	group.Wait();
+	CHECK_EQUAL(101, finished);
+}
+
+TEST(TaskPool_Group_Exception)
+{
+	// The first exception of a task is thrown by Wait() (and the other tasks still finish)
+	std::atomic<int> finished(0);
+	TaskGroup group;
+	for (int task = 0; task < 10; task++)
+		group.Run([&finished, task]() {
+			if (task == 5)
+				throw std::runtime_error("task failed");
+			finished++;
+		});
+	CHECK_THROW(group.Wait(), std::runtime_error);
+	CHECK_EQUAL(9, finished);
+
+	// The exception is only thrown once
+	group.Wait();
+}
+
+TEST(TaskPool_Nested_Groups)
+{
+	// More outer tasks than workers, so every worker waits on an inner group (and runs its tasks)
+	int outer_count = TaskPool::Current()->NumThreads() * 2;
+	std::atomic<int> finished(0);
+	TaskGroup outer;
+	for (int outer_task = 0; outer_task < outer_count; outer_task++)
+		outer.Run([&finished]() {
+			TaskGroup inner;
+			for (int inner_task = 0; inner_task < 10; inner_task++)
+				inner.Run([&finished]() { finished++; });
+			inner.Wait();
+		});
+	outer.Wait();
+	CHECK_EQUAL(outer_count * 10, finished);
+}
+
+TEST(TaskPool_Wait_Runs_Only_Its_Own_Tasks)
+{
+	// Keep every worker busy
+	std::atomic<bool> release(false);
+	std::atomic<int> busy(0);
+	int num_workers = TaskPool::Current()->NumThreads();
+	TaskGroup busy_tasks;
+	for (int worker = 0; worker < num_workers; worker++)
+		busy_tasks.Run([&release, &busy]() {
+			busy++;
+			while (!release)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	while (busy < num_workers)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	// Queue the tasks of another group, which must not run on the waiting thread
+	std::thread::id waiting_thread = std::this_thread::get_id();
+	std::atomic<int> stolen(0);
+	TaskGroup other_tasks;
+	for (int task = 0; task < 10; task++)
+		other_tasks.Run([&stolen, waiting_thread]() {
+			if (std::this_thread::get_id() == waiting_thread)
+				stolen++;
+		});
+
+	// The waiting thread runs the tasks of its own group (since no worker is free)
+	std::atomic<int> finished(0);
+	TaskGroup group;
+	for (int task = 0; task < 10; task++)
+		group.Run([&finished]() { finished++; });
+	group.Wait();
+	CHECK_EQUAL(10, finished);
+	CHECK_EQUAL(0, stolen);
+
+	release = true;
+	busy_tasks.Wait();
+	other_tasks.Wait();
+	CHECK_EQUAL(0, stolen);
+}
+
+TEST(TaskPool_Deterministic_Render)
+{
+	ScopedSetting<bool> deterministic(Settings::Instance()->DETERMINISTIC_RENDER, true);
+
+	// Each task runs right away, in order, on the thread which submits it
+	std::vector<int> order;
+	std::thread::id submitting_thread = std::this_thread::get_id();
+	bool same_thread = true;
+	TaskGroup group;
+	for (int task = 0; task < 10; task++)
+		group.Run([&order, &same_thread, submitting_thread, task]() {
+			order.push_back(task);
+			same_thread = same_thread && (std::this_thread::get_id() == submitting_thread);
+		});
+	CHECK_EQUAL(10, (int) order.size());
+	for (int task = 0; task < 10; task++)
+		CHECK_EQUAL(task, order[task]);
+	CHECK_EQUAL(true, same_thread);
+
+	// Exceptions are still thrown by Wait() (not by Run())
+	group.Run([]() { throw std::runtime_error("task failed"); });
+	CHECK_THROW(group.Wait(), std::runtime_error);
+
+	// Work is split by Settings::OMP_THREADS (the same on every machine)
+	ScopedSetting<int> threads(Settings::Instance()->OMP_THREADS, 3);
+	CHECK_EQUAL(3, TaskPool::Current()->NumThreads());
+}
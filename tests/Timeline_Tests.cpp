@@ -32,6 +32,13 @@
 // Prevent name clashes with juce::UnitTest
 #define DONT_SET_USING_JUCE_NAMESPACE 1
 #include "../include/OpenShot.h"
+#include "ScopedSetting.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace openshot;
@@ -443,3 +450,1429 @@ TEST(Timeline_Effect_Blur)
 	// Close reader
 	t.Close();
 }
+
+TEST(Timeline_Intersecting_Clips)
+{
+	// Create a timeline
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+
+	// Add some clips (at different positions)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front.png";
+	Clip clip_first(path.str());
+	clip_first.Layer(0);
+	clip_first.Position(0.0);
+	clip_first.End(1.0);
+	t.AddClip(&clip_first);
+
+	Clip clip_second(path.str());
+	clip_second.Layer(1);
+	clip_second.Position(10.0);
+	clip_second.End(1.0);
+	t.AddClip(&clip_second);
+
+	// Open Timeline
+	t.Open();
+
+	// Only the first clip should be opened
+	t.GetFrame(1);
+	CHECK_EQUAL(true, clip_first.Reader()->IsOpen());
+	CHECK_EQUAL(false, clip_second.Reader()->IsOpen());
+
+	// Only the second clip should be opened
+	t.GetFrame(301);
+	CHECK_EQUAL(false, clip_first.Reader()->IsOpen());
+	CHECK_EQUAL(true, clip_second.Reader()->IsOpen());
+
+	// Move the first clip (directly), and notify the timeline
+	clip_first.Position(20.0);
+	t.ClipsChanged();
+	t.GetFrame(601);
+	CHECK_EQUAL(true, clip_first.Reader()->IsOpen());
+	CHECK_EQUAL(false, clip_second.Reader()->IsOpen());
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Clip_Interval_Updates)
+{
+	// Create a timeline
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front.png";
+	Clip clip_first(path.str());
+	clip_first.Id("CLIP1");
+	clip_first.Layer(0);
+	clip_first.Position(0.0);
+	clip_first.End(1.0);
+	t.AddClip(&clip_first);
+	t.Open();
+	t.GetFrame(1);
+	CHECK_EQUAL(true, clip_first.Reader()->IsOpen());
+
+	// A clip added to the open timeline is found (its interval is inserted into the index)
+	Clip clip_second(path.str());
+	clip_second.Layer(1);
+	clip_second.Position(10.0);
+	clip_second.End(1.0);
+	t.AddClip(&clip_second);
+	t.GetFrame(301);
+	CHECK_EQUAL(false, clip_first.Reader()->IsOpen());
+	CHECK_EQUAL(true, clip_second.Reader()->IsOpen());
+
+	// A clip which is moved directly is found at its new position (without calling ClipsChanged)
+	clip_first.Position(20.0);
+	t.GetFrame(601);
+	CHECK_EQUAL(true, clip_first.Reader()->IsOpen());
+	CHECK_EQUAL(false, clip_second.Reader()->IsOpen());
+
+	// A clip which is moved by a JSON diff is found at its new position
+	Json::Value clip_key;
+	clip_key["id"] = "CLIP1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"]["position"] = 30.0;
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+	t.ApplyJsonDiff(changes.toStyledString());
+	t.GetFrame(601);
+	CHECK_EQUAL(false, clip_first.Reader()->IsOpen());
+	t.GetFrame(901);
+	CHECK_EQUAL(true, clip_first.Reader()->IsOpen());
+
+	// A removed clip is no longer found (and its changes are no longer counted by the timeline)
+	t.RemoveClip(&clip_second);
+	CHECK(clip_second.ChangeCounter() == NULL);
+	t.ClearAllCache();
+	CHECK_EQUAL(0, t.GetFrame(301)->GetImage()->pixel(320, 240) & 0xffffff);
+
+	// A clip on another timeline (or on none) doesn't count its changes on this timeline
+	Clip clip_other(path.str());
+	CHECK(clip_other.ChangeCounter() == NULL);
+	{
+		Timeline other(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+		other.AddClip(&clip_other);
+		CHECK(clip_other.ChangeCounter() != NULL);
+		CHECK(clip_other.ChangeCounter() != clip_first.ChangeCounter());
+	}
+
+	// The clip can still change after its timeline is destroyed
+	clip_other.Position(5.0);
+
+	t.Close();
+}
+
+TEST(Timeline_Intersecting_Effects)
+{
+	// Create a timeline (after the effects, so they are deleted after it)
+	std::vector<std::unique_ptr<Negate> > effects;
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip(path.str());
+	clip.Layer(1);
+	clip.End(10.0);
+	t.AddClip(&clip);
+
+	// Many short effects on another layer, and a single effect on the clip's layer (frames 31 to 61)
+	for (int index = 0; index < 40; index++) {
+		effects.emplace_back(new Negate());
+		effects.back()->Layer(2);
+		effects.back()->Position(index * 0.25);
+		effects.back()->End(0.5);
+		t.AddEffect(effects.back().get());
+	}
+	Negate negate;
+	negate.Layer(1);
+	negate.Position(1.0);
+	negate.End(1.0);
+	t.AddEffect(&negate);
+
+	// Open Timeline
+	t.Open();
+
+	// Only the effect on the clip's layer changes the image
+	QRgb original = t.GetFrame(1)->GetImage()->pixel(320, 240);
+	QRgb negated = t.GetFrame(45)->GetImage()->pixel(320, 240);
+	CHECK_EQUAL(255 - qRed(original), qRed(negated));
+	CHECK_EQUAL(255 - qGreen(original), qGreen(negated));
+	CHECK_EQUAL(255 - qBlue(original), qBlue(negated));
+	CHECK_EQUAL(original, t.GetFrame(62)->GetImage()->pixel(320, 240));
+
+	// Move the effect (directly), and notify the timeline
+	negate.Position(3.0);
+	t.ClipsChanged();
+	t.ClearAllCache();
+	CHECK_EQUAL(original, t.GetFrame(45)->GetImage()->pixel(320, 240));
+	CHECK_EQUAL(negated, t.GetFrame(100)->GetImage()->pixel(320, 240));
+
+	// Remove the effect
+	t.RemoveEffect(&negate);
+	t.ClearAllCache();
+	CHECK_EQUAL(original, t.GetFrame(100)->GetImage()->pixel(320, 240));
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Moved_Clips)
+{
+	// Create a timeline
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip(path.str());
+	clip.Layer(1);
+	clip.Position(0.0);
+	clip.End(1.0);
+	t.AddClip(&clip);
+
+	// Open Timeline
+	t.Open();
+
+	// The clip is only drawn on its own frames
+	QRgb visible = t.GetFrame(1)->GetImage()->pixel(320, 240);
+	QRgb blank = t.GetFrame(301)->GetImage()->pixel(320, 240);
+	CHECK(visible != blank);
+
+	// Move the clip (directly, without notifying the timeline)
+	clip.Position(10.0);
+	t.ClearAllCache();
+	CHECK_EQUAL(blank, t.GetFrame(1)->GetImage()->pixel(320, 240));
+	CHECK_EQUAL(visible, t.GetFrame(301)->GetImage()->pixel(320, 240));
+
+	// Trim the end of the clip
+	clip.End(0.5);
+	t.ClearAllCache();
+	CHECK_EQUAL(visible, t.GetFrame(310)->GetImage()->pixel(320, 240));
+	CHECK_EQUAL(blank, t.GetFrame(325)->GetImage()->pixel(320, 240));
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Adaptive_Batch_Size)
+{
+	// Create a timeline (with no clips)
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.Open();
+
+	// Seeking only renders the requested frame
+	t.GetFrame(100);
+	CHECK_EQUAL(ACCESS_RANDOM, t.AccessPattern());
+	CHECK_EQUAL(1, t.LastBatchSize());
+
+	// Requesting the next frame switches to sequential read-ahead
+	t.GetFrame(101);
+	CHECK_EQUAL(ACCESS_SEQUENTIAL, t.AccessPattern());
+	CHECK_EQUAL(OPEN_MP_NUM_PROCESSORS, t.LastBatchSize());
+
+	// Stepping backwards renders the frames leading up to the requested frame
+	t.GetFrame(60);
+	t.GetFrame(59);
+	CHECK_EQUAL(ACCESS_REVERSE, t.AccessPattern());
+	CHECK(t.GetCache()->GetFrame(59 - t.LastBatchSize() + 1) != NULL);
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_GetFrames)
+{
+	// Create a timeline (with no clips)
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.Open();
+
+	// Render a range of frames (in batches)
+	std::vector<std::shared_ptr<Frame> > frames = t.GetFrames(200, 40);
+	CHECK_EQUAL(40, frames.size());
+	for (int index = 0; index < 40; index++)
+		CHECK_EQUAL(200 + index, frames[index]->number);
+
+	// The range is tracked as sequential access
+	CHECK_EQUAL(ACCESS_SEQUENTIAL, t.AccessPattern());
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Pipeline_Rendering)
+{
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "test.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(0);
+	clip_video.Position(0.0);
+
+	stringstream path_overlay;
+	path_overlay << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_overlay(path_overlay.str());
+	clip_overlay.Layer(1);
+	clip_overlay.Position(0.05); // Delay the overlay by 0.05 seconds
+	clip_overlay.End(0.5);	// Make the duration of the overlay 1/2 second
+
+	// Create a timeline (which renders with overlapping stages)
+	Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.PipelineRendering(true);
+	CHECK_EQUAL(true, t.PipelineRendering());
+
+	// Add clips
+	t.AddClip(&clip_video);
+	t.AddClip(&clip_overlay);
+
+	// Open Timeline
+	t.Open();
+
+	// Get the image data
+	int pixel_row = 200;
+	int pixel_index = 230 * 4; // pixel 230 (4 bytes per pixel)
+
+	// Same pixels as the regular render (see Timeline_Check_Two_Track_Video)
+	std::shared_ptr<Frame> f = t.GetFrame(1);
+	CHECK_CLOSE(21, (int)f->GetPixels(pixel_row)[pixel_index], 5);
+	CHECK_CLOSE(191, (int)f->GetPixels(pixel_row)[pixel_index + 1], 5);
+	CHECK_CLOSE(0, (int)f->GetPixels(pixel_row)[pixel_index + 2], 5);
+	CHECK_CLOSE(255, (int)f->GetPixels(pixel_row)[pixel_index + 3], 5);
+
+	// Frames rendered in the same batch are numbered and cached in order
+	for (int64_t frame_number = 2; frame_number <= 4; frame_number++) {
+		f = t.GetFrame(frame_number);
+		CHECK_EQUAL(frame_number, f->number);
+	}
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Graph_Rendering)
+{
+	// A quarter speed video (so consecutive clip frames show the same decoded frame), under an image
+	stringstream path;
+	path << TEST_MEDIA_PATH << "test.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(0);
+	clip_video.time.AddPoint(1, 1, LINEAR);
+	clip_video.time.AddPoint(121, 31, LINEAR);
+	Clip clip_graph_video(path.str());
+	clip_graph_video.Layer(0);
+	clip_graph_video.time.AddPoint(1, 1, LINEAR);
+	clip_graph_video.time.AddPoint(121, 31, LINEAR);
+
+	stringstream path_overlay;
+	path_overlay << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_overlay(path_overlay.str());
+	clip_overlay.Layer(1);
+	clip_overlay.End(0.5);
+	Clip clip_graph_overlay(path_overlay.str());
+	clip_graph_overlay.Layer(1);
+	clip_graph_overlay.End(0.5);
+
+	// The same clips, rendered regularly and as a graph
+	Timeline t(640, 360, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_video);
+	t.AddClip(&clip_overlay);
+	t.Open();
+	Timeline t_graph(640, 360, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t_graph.GraphRendering(true);
+	CHECK_EQUAL(true, t_graph.GraphRendering());
+	t_graph.AddClip(&clip_graph_video);
+	t_graph.AddClip(&clip_graph_overlay);
+	t_graph.Open();
+
+	// The frames are numbered, and have the same pixels
+	std::vector<std::shared_ptr<Frame> > frames = t.GetFrames(1, 8);
+	std::vector<std::shared_ptr<Frame> > graph_frames = t_graph.GetFrames(1, 8);
+	CHECK_EQUAL(frames.size(), graph_frames.size());
+	for (int index = 0; index < frames.size() && index < graph_frames.size(); index++) {
+		CHECK_EQUAL(index + 1, graph_frames[index]->number);
+		const unsigned char *pixels = frames[index]->GetPixels(100);
+		const unsigned char *graph_pixels = graph_frames[index]->GetPixels(100);
+		for (int byte = 0; byte < 640 * 4; byte += 37)
+			CHECK_EQUAL((int) pixels[byte], (int) graph_pixels[byte]);
+	}
+
+	// The slowed down frames of a batch share their decoded frames (a batch has a frame per worker thread)
+	if (TaskPool::Instance()->NumThreads() > 1)
+		CHECK(t_graph.MetricsValue()["graph_shared_nodes"].asInt64() > 0);
+
+	t.Close();
+	t_graph.Close();
+}
+
+TEST(Timeline_Render_Graph_Nodes)
+{
+	// Two decodes (one shared by both maps), which each composite waits for
+	RenderGraph graph;
+	std::mutex order_mutex;
+	std::vector<std::string> order;
+	auto node = [&](std::string name) {
+		return [&order, &order_mutex, name]() {
+			std::lock_guard<std::mutex> lock(order_mutex);
+			order.push_back(name);
+		};
+	};
+	bool added = false;
+	size_t decode_1 = graph.AddNode(RENDER_NODE_DECODE, "frame 1", node("decode 1"), added);
+	CHECK_EQUAL(true, added);
+	size_t decode_2 = graph.AddNode(RENDER_NODE_DECODE, "frame 2", node("decode 2"), added);
+	graph.AddDependency(decode_2, decode_1);
+	size_t map_1 = graph.AddNode(RENDER_NODE_MAP, "", node("map 1"), added);
+	graph.AddDependency(map_1, graph.AddNode(RENDER_NODE_DECODE, "frame 1", node("decode 1 again"), added));
+	CHECK_EQUAL(false, added);
+	size_t map_2 = graph.AddNode(RENDER_NODE_MAP, "", node("map 2"), added);
+	graph.AddDependency(map_2, decode_2);
+	size_t composite = graph.AddNode(RENDER_NODE_COMPOSITE, "", node("composite"), added);
+	graph.AddDependency(composite, map_1);
+	graph.AddDependency(composite, map_2);
+	CHECK_EQUAL(5, (int) graph.NumNodes());
+	CHECK_EQUAL(2, (int) graph.NumNodes(RENDER_NODE_DECODE));
+	CHECK_EQUAL(1, (int) graph.SharedNodes());
+
+	// Each node runs once, after the nodes it depends on
+	graph.Run();
+	CHECK_EQUAL(5, (int) order.size());
+	std::map<std::string, size_t> position;
+	for (size_t index = 0; index < order.size(); index++)
+		position[order[index]] = index;
+	CHECK(position["decode 1"] < position["decode 2"]);
+	CHECK(position["decode 1"] < position["map 1"]);
+	CHECK(position["decode 2"] < position["map 2"]);
+	CHECK(position["map 1"] < position["composite"]);
+	CHECK(position["map 2"] < position["composite"]);
+	CHECK_EQUAL(0, (int) position.count("decode 1 again"));
+
+	// A node which throws skips its dependents, and Run() re-throws
+	RenderGraph failing;
+	bool dependent_ran = false;
+	size_t failed = failing.AddNode(RENDER_NODE_DECODE, "", []() { throw OutOfBoundsFrame("Invalid frame", 0, 0); }, added);
+	failing.AddDependency(failing.AddNode(RENDER_NODE_MAP, "", [&dependent_ran]() { dependent_ran = true; }, added), failed);
+	CHECK_THROW(failing.Run(), OutOfBoundsFrame);
+	CHECK_EQUAL(false, dependent_ran);
+}
+
+TEST(Timeline_Occluded_Layers)
+{
+	// Image on the bottom layer (covered by the video)
+	stringstream path_overlay;
+	path_overlay << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_image(path_overlay.str());
+	clip_image.Layer(0);
+	clip_image.Position(0.0);
+	clip_image.End(0.5);
+
+	// Opaque, full frame video on the top layer
+	stringstream path;
+	path << TEST_MEDIA_PATH << "test.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(1);
+	clip_video.Position(0.0);
+
+	// Create a timeline
+	Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_image);
+	t.AddClip(&clip_video);
+	t.Open();
+
+	// Get the image data
+	int pixel_row = 200;
+	int pixel_index = 230 * 4; // pixel 230 (4 bytes per pixel)
+
+	// Only the video is visible (see Timeline_Check_Two_Track_Video)
+	std::shared_ptr<Frame> f = t.GetFrame(1);
+	CHECK_CLOSE(21, (int)f->GetPixels(pixel_row)[pixel_index], 5);
+	CHECK_CLOSE(191, (int)f->GetPixels(pixel_row)[pixel_index + 1], 5);
+	CHECK_CLOSE(0, (int)f->GetPixels(pixel_row)[pixel_index + 2], 5);
+	CHECK_CLOSE(255, (int)f->GetPixels(pixel_row)[pixel_index + 3], 5);
+
+	// Semi-transparent video shows the image below it
+	clip_video.alpha = Keyframe(0.5);
+	t.ClearAllCache();
+	f = t.GetFrame(1);
+	CHECK(abs(21 - (int)f->GetPixels(pixel_row)[pixel_index]) > 5 || abs(191 - (int)f->GetPixels(pixel_row)[pixel_index + 1]) > 5);
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Premultiplied_Images)
+{
+	// Carry premultiplied ARGB32 images through the timeline
+	ScopedSetting<bool> premultiplied_images(Settings::Instance()->PREMULTIPLIED_IMAGES, true);
+
+	// Create a reader
+	stringstream path;
+	path << TEST_MEDIA_PATH << "test.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(0);
+	clip_video.Position(0.0);
+
+	stringstream path_overlay;
+	path_overlay << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_overlay(path_overlay.str());
+	clip_overlay.Layer(1);
+	clip_overlay.Position(0.05); // Delay the overlay by 0.05 seconds
+	clip_overlay.End(0.5);	// Make the duration of the overlay 1/2 second
+
+	// Create a timeline
+	Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_video);
+	t.AddClip(&clip_overlay);
+	t.Open();
+
+	// Same colors as the RGBA8888 render (see Timeline_Check_Two_Track_Video)
+	std::shared_ptr<Frame> f = t.GetFrame(1);
+	CHECK_EQUAL(QImage::Format_ARGB32_Premultiplied, f->GetImage()->format());
+	CHECK_EQUAL(true, f->CheckPixel(200, 230, 21, 191, 0, 255, 5));
+
+	f = t.GetFrame(2);
+	CHECK_EQUAL(true, f->CheckPixel(200, 230, 176, 0, 186, 255, 5));
+
+	// Close reader
+	t.Close();
+}
+
+TEST(Timeline_Mix_Audio)
+{
+	// A clip at full volume
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Clip clip_full(path.str());
+	clip_full.Layer(0);
+	clip_full.Position(0.0);
+	clip_full.End(1.0);
+	Timeline t1(1280, 720, Fraction(24, 1), 48000, 2, LAYOUT_STEREO);
+	t1.AddClip(&clip_full);
+	t1.Open();
+
+	// The same clip twice, at half volume (all layers are mixed into each channel in a single pass)
+	Clip clip_half1(path.str());
+	clip_half1.Layer(0);
+	clip_half1.Position(0.0);
+	clip_half1.End(1.0);
+	clip_half1.volume = Keyframe(0.5);
+	Clip clip_half2(path.str());
+	clip_half2.Layer(1);
+	clip_half2.Position(0.0);
+	clip_half2.End(1.0);
+	clip_half2.volume = Keyframe(0.5);
+	Timeline t2(1280, 720, Fraction(24, 1), 48000, 2, LAYOUT_STEREO);
+	t2.AddClip(&clip_half1);
+	t2.AddClip(&clip_half2);
+	t2.Open();
+
+	for (int64_t frame_number = 10; frame_number <= 12; frame_number++) {
+		std::shared_ptr<Frame> full = t1.GetFrame(frame_number);
+		std::shared_ptr<Frame> mixed = t2.GetFrame(frame_number);
+		CHECK_EQUAL(full->GetAudioSamplesCount(), mixed->GetAudioSamplesCount());
+		for (int channel = 0; channel < 2; channel++)
+			for (int sample = 0; sample < full->GetAudioSamplesCount(); sample += 37)
+				CHECK_CLOSE(full->GetAudioSamples(channel)[sample], mixed->GetAudioSamples(channel)[sample], 0.0001);
+	}
+
+	t1.Close();
+	t2.Close();
+}
+
+TEST(Timeline_GetAudioFrame)
+{
+	// Two timelines with the same clips (one renders frames, the other only mixes their audio)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Clip clip_video1(path.str());
+	clip_video1.Layer(0);
+	clip_video1.Position(0.0);
+	clip_video1.End(1.0);
+	Clip clip_video2(path.str());
+	clip_video2.Layer(1);
+	clip_video2.Position(0.0);
+	clip_video2.Start(1.0);
+	clip_video2.End(2.0);
+	clip_video2.volume = Keyframe(0.5);
+	Timeline t1(1280, 720, Fraction(24, 1), 48000, 2, LAYOUT_STEREO);
+	t1.AddClip(&clip_video1);
+	t1.AddClip(&clip_video2);
+	t1.Open();
+
+	Clip clip_audio1(path.str());
+	clip_audio1.Layer(0);
+	clip_audio1.Position(0.0);
+	clip_audio1.End(1.0);
+	Clip clip_audio2(path.str());
+	clip_audio2.Layer(1);
+	clip_audio2.Position(0.0);
+	clip_audio2.Start(1.0);
+	clip_audio2.End(2.0);
+	clip_audio2.volume = Keyframe(0.5);
+	Timeline t2(1280, 720, Fraction(24, 1), 48000, 2, LAYOUT_STEREO);
+	t2.AddClip(&clip_audio1);
+	t2.AddClip(&clip_audio2);
+	t2.Open();
+
+	for (int64_t frame_number = 1; frame_number <= 5; frame_number++) {
+		std::shared_ptr<Frame> rendered = t1.GetFrame(frame_number);
+		std::shared_ptr<Frame> audio = t2.GetAudioFrame(frame_number);
+
+		// No image is composited
+		CHECK_EQUAL(1, audio->GetWidth());
+		CHECK_EQUAL(1, audio->GetHeight());
+
+		// But the audio is mixed the same way
+		CHECK_EQUAL(rendered->GetAudioSamplesCount(), audio->GetAudioSamplesCount());
+		for (int channel = 0; channel < 2; channel++)
+			for (int sample = 0; sample < rendered->GetAudioSamplesCount(); sample += 37)
+				CHECK_CLOSE(rendered->GetAudioSamples(channel)[sample], audio->GetAudioSamples(channel)[sample], 0.0001);
+	}
+
+	t1.Close();
+	t2.Close();
+}
+
+TEST(Timeline_Audio_Cache)
+{
+	// Mix (and cache) the audio of the first 10 frames
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Clip clip_video(path.str());
+	clip_video.Id("AUDIO1");
+	clip_video.Layer(0);
+	clip_video.Position(0.0);
+	clip_video.End(2.0);
+	Timeline t(1280, 720, Fraction(24, 1), 48000, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_video);
+	t.Open();
+	for (int64_t frame_number = 1; frame_number <= 10; frame_number++)
+		t.GetAudioFrame(frame_number);
+	CHECK(t.GetAudioCache()->GetFrame(5) != NULL);
+
+	// Change a keyframe of the image (which keeps the mixed audio), then the volume (which removes it)
+	Json::Value clip_key;
+	clip_key["id"] = "AUDIO1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"] = clip_video.JsonValue();
+	change["value"].removeMember("reader");
+	change["value"]["alpha"] = Keyframe(0.5).JsonValue();
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+	t.ApplyJsonDiff(changes.toStyledString());
+	CHECK(t.GetAudioCache()->GetFrame(5) != NULL);
+
+	changes[0]["value"]["volume"] = Keyframe(0.5).JsonValue();
+	t.ApplyJsonDiff(changes.toStyledString());
+	CHECK(t.GetAudioCache()->GetFrame(5) == NULL);
+
+	// The audio is mixed again (at the new volume)
+	CHECK(t.GetAudioFrame(5) != NULL);
+	CHECK(t.GetAudioCache()->GetFrame(5) != NULL);
+
+	t.Close();
+}
+
+TEST(Timeline_Scaled_Compositing)
+{
+	// Create a scaled, moved, and faded image clip (on a colored background)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_image(path.str());
+	clip_image.Layer(1);
+	clip_image.Position(0.0);
+	clip_image.End(10.0);
+	clip_image.scale_x = Keyframe(0.6);
+	clip_image.scale_y = Keyframe(0.45);
+	clip_image.location_x = Keyframe(0.1);
+	clip_image.location_y = Keyframe(-0.05);
+	clip_image.alpha = Keyframe(0.75);
+	Timeline t(1280, 720, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.color.red = Keyframe(40);
+	t.color.blue = Keyframe(90);
+	t.AddClip(&clip_image);
+	t.Open();
+
+	// Benchmark both compositors (each frame is rendered again)
+	std::vector<std::shared_ptr<Frame> > frames[2];
+	for (int compositor = 0; compositor < 2; compositor++) {
+		Settings::Instance()->SIMD_COMPOSITING = (compositor == 0);
+		UNITTEST_TIME_CONSTRAINT(10000);
+		for (int64_t frame_number = 1; frame_number <= 20; frame_number++)
+			frames[compositor].push_back(t.GetFrame(frame_number));
+		t.ClearAllCache();
+	}
+	Settings::Instance()->SIMD_COMPOSITING = true;
+
+	// The scaling kernels match QPainter's smooth transform (except for the antialiased edges)
+	std::shared_ptr<QImage> scaled = frames[0].front()->GetImage();
+	std::shared_ptr<QImage> painted = frames[1].front()->GetImage();
+	CHECK_EQUAL(painted->width(), scaled->width());
+	CHECK_EQUAL(painted->height(), scaled->height());
+	int64_t difference = 0;
+	int64_t channel_count = 0;
+	for (int row = 0; row < scaled->height(); row++) {
+		const unsigned char *scaled_pixels = scaled->constScanLine(row);
+		const unsigned char *painted_pixels = painted->constScanLine(row);
+		for (int channel = 0; channel < scaled->width() * 4; channel++, channel_count++)
+			difference += abs(scaled_pixels[channel] - painted_pixels[channel]);
+	}
+	CHECK(double(difference) / channel_count < 1.0);
+
+	t.Close();
+}
+
+TEST(Timeline_Json_Diff_Cache_Invalidation)
+{
+	// Create a timeline with an image clip
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_image(path.str());
+	clip_image.Id("CLIP1");
+	clip_image.Layer(1);
+	clip_image.Position(0.0);
+	clip_image.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_image);
+	t.Open();
+
+	// Render (and cache) the first second
+	for (int64_t frame_number = 1; frame_number <= 30; frame_number++)
+		t.GetFrame(frame_number);
+	CHECK(t.GetCache()->GetFrame(1) != NULL);
+	CHECK(t.GetCache()->GetFrame(30) != NULL);
+
+	// Fade out the clip after frame 20 (updating only the alpha keyframe)
+	Keyframe alpha(1.0);
+	alpha.AddPoint(20, 1.0);
+	alpha.AddPoint(25, 0.0);
+	Json::Value clip_json = clip_image.JsonValue();
+	clip_json.removeMember("reader");
+	clip_json["alpha"] = alpha.JsonValue();
+	Json::Value clip_key;
+	clip_key["id"] = "CLIP1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"] = clip_json;
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+	t.ApplyJsonDiff(changes.toStyledString());
+
+	// Only the frames near the changed keyframe values are removed (and the clip's mapped frames are kept)
+	CHECK(t.GetCache()->GetFrame(1) != NULL);
+	CHECK(t.GetCache()->GetFrame(12) != NULL);
+	CHECK(t.GetCache()->GetFrame(21) == NULL);
+	CHECK(t.GetCache()->GetFrame(30) == NULL);
+	CHECK(clip_image.Reader()->GetCache()->GetFrame(30) != NULL);
+
+	t.Close();
+}
+
+TEST(Timeline_Snapshot)
+{
+	// Create a timeline with animated clips and effects
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AutoMapClips(false);
+	std::vector<std::unique_ptr<DummyReader> > readers;
+	std::vector<std::unique_ptr<Clip> > clips;
+	Negate negate;
+	Blur blur(Keyframe(2.0), Keyframe(1.0), Keyframe(3.0), Keyframe(2.0));
+	for (int clip_index = 0; clip_index < 20; clip_index++) {
+		readers.emplace_back(new DummyReader(Fraction(30, 1), 640, 480, 44100, 2, 10.0));
+		clips.emplace_back(new Clip(readers.back().get()));
+		Clip *clip = clips.back().get();
+		clip->Id("CLIP" + std::to_string(clip_index));
+		clip->Layer(clip_index % 3);
+		clip->Position(clip_index * 2.5);
+		clip->End(5.0);
+		clip->alpha.AddPoint(1, 0.0);
+		clip->alpha.AddPoint(Point(Coordinate(30, 1.0), BEZIER));
+		clip->location_x.AddPoint(60, -0.5, LINEAR);
+		clip->AddEffect(&negate);
+		t.AddClip(clip);
+	}
+	t.AddEffect(&blur);
+
+	// Save a binary snapshot (which is smaller than the JSON)
+	std::string path = (QDir::tempPath() + QString("/timeline-snapshot.bin")).toStdString();
+	t.SaveSnapshot(path);
+	CHECK(QFile(QString::fromStdString(path)).size() < (qint64) t.Json().size());
+
+	// The snapshot loads the same timeline as the JSON
+	Timeline from_json(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	from_json.AutoMapClips(false);
+	from_json.SetJson(t.Json());
+	Timeline from_snapshot(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	from_snapshot.AutoMapClips(false);
+	from_snapshot.LoadSnapshot(path);
+	CHECK_EQUAL(20, (int) from_snapshot.Clips().size());
+	CHECK_EQUAL(from_json.Json(), from_snapshot.Json());
+
+	// A file which isn't a snapshot can't be loaded
+	QFile invalid_file(QString::fromStdString(path));
+	invalid_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+	invalid_file.write(t.Json().c_str());
+	invalid_file.close();
+	CHECK_THROW(from_snapshot.LoadSnapshot(path), InvalidJSON);
+	QFile::remove(QString::fromStdString(path));
+}
+
+TEST(Timeline_Trace)
+{
+	// Create a timeline with a clip
+	DummyReader r(Fraction(30, 1), 640, 480, 44100, 2, 5.0);
+	Clip c(&r);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&c);
+	t.Open();
+
+	// No spans are recorded until tracing is started
+	Tracer::Instance()->Start();
+	Tracer::Instance()->Stop();
+	t.GetFrame(1);
+	CHECK_EQUAL(0, (int) Tracer::Instance()->Events().size());
+
+	// Trace a frame
+	Tracer::Instance()->Start();
+	t.GetFrame(2);
+	Tracer::Instance()->Stop();
+	std::vector<TraceEvent> events = Tracer::Instance()->Events();
+	bool found_timeline = false;
+	bool found_clip = false;
+	for (size_t index = 0; index < events.size(); index++) {
+		if (std::string(events[index].name) == "Timeline::GetFrame" && events[index].frame == 2)
+			found_timeline = true;
+		if (std::string(events[index].category) == "clip")
+			found_clip = true;
+		CHECK(events[index].duration >= 0);
+	}
+	CHECK(found_timeline);
+	CHECK(found_clip);
+
+	// The trace is saved as Chrome trace events
+	Json::Value trace = Tracer::Instance()->JsonValue();
+	CHECK_EQUAL((int) events.size(), (int) trace["traceEvents"].size());
+	CHECK_EQUAL("X", trace["traceEvents"][0]["ph"].asString());
+
+	t.Close();
+}
+
+TEST(Timeline_Metrics)
+{
+	// Create a timeline with a clip
+	DummyReader r(Fraction(30, 1), 640, 480, 44100, 2, 5.0);
+	Clip c(&r);
+	c.Id("metrics");
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&c);
+	t.Open();
+
+	// Render 2 frames (and request the first one again, from the cache)
+	t.GetFrame(1);
+	t.GetFrame(2);
+	t.GetFrame(1);
+
+	Json::Value metrics = t.MetricsValue();
+	CHECK_EQUAL("Timeline", metrics["type"].asString());
+	CHECK(metrics["render_time"]["count"].asInt() >= 1);
+	CHECK(metrics["render_time"]["mean"].asDouble() >= 0.0);
+	CHECK(metrics["cache"]["hits"].asInt() >= 1);
+	CHECK_EQUAL(1, (int) metrics["clips"].size());
+	CHECK_EQUAL("metrics", metrics["clips"][0]["id"].asString());
+	CHECK(metrics["clips"][0]["reader"].isObject());
+	CHECK(metrics["global"]["counters"].isObject());
+	CHECK(!t.Metrics().empty());
+
+	t.Close();
+}
+
+TEST(Timeline_Deterministic_Render)
+{
+	Settings::Instance()->DETERMINISTIC_RENDER = true;
+
+	// Tasks run in order, on the calling thread
+	std::vector<int64_t> order;
+	std::vector<std::thread::id> threads;
+	TaskPool::Instance()->ParallelFor(0, 8, [&](int64_t index) {
+		order.push_back(index);
+		threads.push_back(std::this_thread::get_id());
+	});
+	CHECK_EQUAL(8, (int) order.size());
+	for (int index = 0; index < 8; index++) {
+		CHECK_EQUAL(index, order[index]);
+		CHECK(threads[index] == std::this_thread::get_id());
+	}
+	CHECK_EQUAL(std::max(1, Settings::Instance()->OMP_THREADS), TaskPool::Instance()->NumThreads());
+
+	// Render a frame, and get the time of each stage
+	DummyReader r(Fraction(30, 1), 640, 480, 44100, 2, 5.0);
+	Clip c(&r);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&c);
+	t.Open();
+	Tracer::Instance()->Start();
+	t.GetFrame(1);
+	Tracer::Instance()->Stop();
+	t.Close();
+	Settings::Instance()->DETERMINISTIC_RENDER = false;
+
+	Json::Value stages = Tracer::Instance()->StageValue();
+	CHECK(stages["timeline"]["count"].asInt() >= 1);
+	CHECK(stages["clip"]["count"].asInt() >= 1);
+	CHECK(stages["timeline"]["self_ms"].asDouble() <= stages["timeline"]["total_ms"].asDouble());
+
+	// The clip spans ran inside the timeline span (on this thread), so they are not part of its self time
+	CHECK(stages["timeline"]["self_ms"].asDouble() <= stages["timeline"]["total_ms"].asDouble() - stages["clip"]["total_ms"].asDouble() + 0.001);
+}
+
+TEST(Timeline_Numa_Node)
+{
+	// Node -1 (and nodes which don't exist) use the shared pool
+	CHECK(TaskPool::NumNodes() >= 1);
+	CHECK(TaskPool::ForNode(-1) == TaskPool::Instance());
+	CHECK(TaskPool::ForNode(TaskPool::NumNodes()) == TaskPool::Instance());
+	CHECK(TaskPool::Current() == TaskPool::Instance());
+
+	// Tasks submitted while a pool is bound run on that pool
+	TaskPool *pool = TaskPool::ForNode(0);
+	{
+		ScopedTaskPool bound(pool);
+		CHECK(TaskPool::Current() == pool);
+		std::atomic<int> wrong_pool(0);
+		TaskPool::Current()->ParallelFor(0, 8, [&](int64_t index) {
+			if (TaskPool::Current() != pool)
+				wrong_pool++;
+		});
+		CHECK_EQUAL(0, wrong_pool.load());
+	}
+	CHECK(TaskPool::Current() == TaskPool::Instance());
+
+	// Render the same frame on the shared pool, and on node 0
+	DummyReader r(Fraction(30, 1), 640, 480, 44100, 2, 5.0);
+	r.Open();
+	r.GetFrame(1)->AddColor(640, 480, "#205080");
+	Clip c(&r);
+	Blur blur(Keyframe(2.0), Keyframe(2.0), Keyframe(2.0), Keyframe(1.0));
+	c.AddEffect(&blur);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&c);
+	t.Open();
+	std::shared_ptr<QImage> shared_image = t.GetFrame(1)->GetImage();
+
+	t.NumaNode(0);
+	CHECK_EQUAL(0, t.NumaNode());
+	t.ClearAllCache();
+	std::shared_ptr<QImage> node_image = t.GetFrame(1)->GetImage();
+	CHECK(*shared_image == *node_image);
+	t.Close();
+}
+
+TEST(Timeline_Render_Region)
+{
+	// Create a timeline with an image clip, which renders its first second in the background
+	Settings::Instance()->REGION_RENDER_IDLE_MS = 0;
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_image(path.str());
+	clip_image.Id("CLIP1");
+	clip_image.Layer(1);
+	clip_image.Position(0.0);
+	clip_image.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_image);
+	CacheMemory region_cache;
+	t.RegionCache(&region_cache);
+	t.AddRenderRegion(1, 30);
+	t.Open();
+
+	for (int wait = 0; wait < 1000 && t.RenderedRegionFrames() < 30; wait++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK_EQUAL(30, t.RenderedRegionFrames());
+	std::shared_ptr<Frame> rendered_frame = region_cache.GetFrame(30);
+	CHECK(rendered_frame != NULL);
+
+	// The rendered frames are returned (even once they are no longer in the final cache)
+	t.GetCache()->Clear();
+	CHECK(t.GetFrame(30) == rendered_frame);
+
+	// Fade out the clip after frame 20, which renders the changed frames again
+	Keyframe alpha(1.0);
+	alpha.AddPoint(20, 1.0);
+	alpha.AddPoint(25, 0.0);
+	Json::Value clip_json = clip_image.JsonValue();
+	clip_json.removeMember("reader");
+	clip_json["alpha"] = alpha.JsonValue();
+	Json::Value clip_key;
+	clip_key["id"] = "CLIP1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"] = clip_json;
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+	t.ApplyJsonDiff(changes.toStyledString());
+
+	for (int wait = 0; wait < 1000 && (t.RenderedRegionFrames() < 30 || region_cache.GetFrame(30) == rendered_frame); wait++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK_EQUAL(30, t.RenderedRegionFrames());
+	CHECK(region_cache.GetFrame(30) != NULL);
+	CHECK(region_cache.GetFrame(30) != rendered_frame);
+
+	// Closing the timeline stops the render (and clears the region cache)
+	t.Close();
+	CHECK_EQUAL(0, t.RenderedRegionFrames());
+	CHECK_EQUAL(0, region_cache.Count());
+	Settings::Instance()->REGION_RENDER_IDLE_MS = 500;
+}
+
+TEST(Timeline_Nested_Timeline)
+{
+	// A nested timeline (with an image clip), drawn at a quarter of its size by a clip of another timeline
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip_image(path.str());
+	clip_image.Id("CLIP1");
+	clip_image.Layer(1);
+	clip_image.Position(0.0);
+	clip_image.End(10.0);
+	Timeline nested(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	nested.AddClip(&clip_image);
+
+	Clip clip_nested(&nested);
+	clip_nested.Layer(1);
+	clip_nested.Position(0.0);
+	clip_nested.End(10.0);
+	clip_nested.scale_x = Keyframe(0.25);
+	clip_nested.scale_y = Keyframe(0.25);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip_nested);
+	t.Open();
+
+	// The nested timeline renders its frames at the size they are drawn at
+	std::shared_ptr<Frame> first_frame = t.GetFrame(1);
+	std::shared_ptr<Frame> last_frame = t.GetFrame(30);
+	CHECK_EQUAL(640, first_frame->GetWidth());
+	CHECK(nested.GetCache()->GetFrame(1) != NULL);
+	CHECK_EQUAL(160, nested.GetCache()->GetFrame(1)->GetWidth());
+	CHECK_EQUAL(120, nested.GetCache()->GetFrame(1)->GetHeight());
+
+	// A full size frame of the nested timeline is rendered again
+	CHECK_EQUAL(640, nested.GetFrame(1)->GetWidth());
+	CHECK(t.GetFrame(1) == first_frame);
+
+	// Fade out the nested timeline's clip after frame 20, which only renders the changed frames again
+	CHECK_EQUAL(0, nested.EditGeneration());
+	Keyframe alpha(1.0);
+	alpha.AddPoint(20, 1.0);
+	alpha.AddPoint(25, 0.0);
+	Json::Value clip_json = clip_image.JsonValue();
+	clip_json.removeMember("reader");
+	clip_json["alpha"] = alpha.JsonValue();
+	Json::Value clip_key;
+	clip_key["id"] = "CLIP1";
+	Json::Value change;
+	change["type"] = "update";
+	change["key"].append("clips");
+	change["key"].append(clip_key);
+	change["value"] = clip_json;
+	Json::Value changes(Json::arrayValue);
+	changes.append(change);
+	nested.ApplyJsonDiff(changes.toStyledString());
+	CHECK(nested.EditGeneration() > 0);
+
+	int64_t changed_first = 0;
+	int64_t changed_last = 0;
+	nested.ChangedFrames(0, changed_first, changed_last);
+	CHECK(changed_first > 1);
+	CHECK(changed_last >= 30);
+	CHECK(t.GetFrame(1) == first_frame);
+	CHECK(t.GetFrame(30) != last_frame);
+
+	t.Close();
+}
+
+TEST(Timeline_Static_Layers)
+{
+	// A still image background, with a moving (and smaller) image on top of it
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip background(path.str());
+	background.Layer(1);
+	background.End(10.0);
+	Clip moving(path.str());
+	moving.Layer(2);
+	moving.End(10.0);
+	moving.scale_x = Keyframe(0.5);
+	moving.scale_y = Keyframe(0.5);
+	moving.location_x.AddPoint(1, -0.25);
+	moving.location_x.AddPoint(30, 0.25);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.color.blue = Keyframe(64.0);
+	t.AddClip(&background);
+	t.AddClip(&moving);
+	t.Open();
+
+	// The background is only composited once
+	for (int64_t frame_number = 1; frame_number <= 10; frame_number++)
+		t.GetFrame(frame_number);
+	CHECK(t.MetricsValue()["static_layer_hits"].asInt64() >= 1);
+	std::shared_ptr<QImage> reused_image = t.GetFrame(10)->GetImage();
+
+	// The frames are the same as when every layer is composited (the background is not static with 2 keyframe points)
+	background.alpha.AddPoint(300, 1.0);
+	t.ClearAllCache();
+	std::shared_ptr<QImage> composited_image = t.GetFrame(10)->GetImage();
+	CHECK(reused_image != composited_image);
+	CHECK(*reused_image == *composited_image);
+	t.Close();
+}
+
+TEST(Timeline_Visible_Rect_Compositing)
+{
+	// A lower third: a small opaque box, on a transparent full frame image
+	QImage lower_third(640, 480, QImage::Format_ARGB32_Premultiplied);
+	lower_third.fill(Qt::transparent);
+	QPainter painter(&lower_third);
+	painter.fillRect(50, 380, 200, 60, QColor(255, 0, 0));
+	painter.end();
+	std::string path = (QDir::tempPath() + QString("/timeline-lower-third.png")).toStdString();
+	CHECK(lower_third.save(QString::fromStdString(path)));
+
+	Clip clip_image(path);
+	clip_image.Layer(1);
+	clip_image.End(10.0);
+	clip_image.location_x.AddPoint(1, 0.0);
+	clip_image.location_x.AddPoint(30, 0.25);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.color.blue = Keyframe(255.0);
+	t.AddClip(&clip_image);
+	t.Open();
+
+	// Only the box is composited, with both compositors
+	for (int compositor = 0; compositor < 2; compositor++) {
+		Settings::Instance()->SIMD_COMPOSITING = (compositor == 0);
+		std::shared_ptr<QImage> image = t.GetFrame(1)->GetImage();
+		CHECK_EQUAL(qRgb(255, 0, 0), image->pixel(150, 410) | 0xff000000);
+		CHECK_EQUAL(qRgb(0, 0, 255), image->pixel(20, 20) | 0xff000000);
+		CHECK_EQUAL(qRgb(0, 0, 255), image->pixel(150, 470) | 0xff000000);
+
+		// The moved box (a quarter of the width to the right)
+		image = t.GetFrame(30)->GetImage();
+		CHECK_EQUAL(qRgb(255, 0, 0), image->pixel(310, 410) | 0xff000000);
+		CHECK_EQUAL(qRgb(0, 0, 255), image->pixel(150, 410) | 0xff000000);
+		t.ClearAllCache();
+	}
+	Settings::Instance()->SIMD_COMPOSITING = true;
+	t.Close();
+	QFile::remove(QString::fromStdString(path));
+}
+
+TEST(Timeline_Max_Size)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+
+	// A small preview, and a full size export (of the same project)
+	Clip preview_clip(path.str());
+	preview_clip.End(10.0);
+	Timeline preview(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	preview.AddClip(&preview_clip);
+	preview.SetMaxSize(320, 240);
+	preview.Open();
+
+	Clip export_clip(path.str());
+	export_clip.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&export_clip);
+	t.Open();
+
+	// Each timeline renders at its own size (and the global size is not changed)
+	CHECK_EQUAL(320, preview.MaxWidth());
+	CHECK_EQUAL(640, t.MaxWidth());
+	CHECK_EQUAL(0, Settings::Instance()->MAX_WIDTH);
+	CHECK_EQUAL(320, preview.GetFrame(1)->GetWidth());
+	CHECK_EQUAL(640, t.GetFrame(1)->GetWidth());
+	CHECK_EQUAL(240, preview.GetFrame(2)->GetHeight());
+	CHECK_EQUAL(480, t.GetFrame(2)->GetHeight());
+
+	// Outside of a render, readers use the global size
+	CHECK_EQUAL(0, RenderContext::Current().max_width);
+
+	preview.Close();
+	t.Close();
+}
+
+TEST(Timeline_Max_Size_Change)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip(path.str());
+	clip.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip);
+	t.SetMaxSize(320, 240);
+	t.Open();
+	std::shared_ptr<Frame> small_frame = t.GetFrame(1);
+	CHECK_EQUAL(320, small_frame->GetWidth());
+
+	// Changing the size renders the frames again (at the new size)
+	t.SetMaxSize(640, 480);
+	std::shared_ptr<Frame> large_frame = t.GetFrame(1);
+	CHECK_EQUAL(640, large_frame->GetWidth());
+
+	// Changing it back returns the frame rendered at that size (which was kept)
+	t.SetMaxSize(320, 240);
+	CHECK(t.GetFrame(1) == small_frame);
+
+	// A frame only rendered larger is downscaled (once)
+	t.SetMaxSize(640, 480);
+	CHECK_EQUAL(640, t.GetFrame(2)->GetWidth());
+	t.SetMaxSize(160, 120);
+	std::shared_ptr<Frame> scaled_frame = t.GetFrame(2);
+	CHECK_EQUAL(160, scaled_frame->GetWidth());
+	CHECK_EQUAL(120, scaled_frame->GetHeight());
+	CHECK(t.GetFrame(2) == scaled_frame);
+
+	// Edits remove the frames of every size
+	t.ClearAllCache();
+	t.SetMaxSize(320, 240);
+	CHECK(t.GetFrame(1) != small_frame);
+	CHECK_EQUAL(320, t.GetFrame(1)->GetWidth());
+
+	t.Close();
+}
+
+TEST(Timeline_Render_Cache)
+{
+	QString cache_path = QDir::tempPath() + QString("/render-cache-test/");
+	QDir(cache_path).removeRecursively();
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+
+	// Render the frames of a project in one session
+	std::shared_ptr<Frame> rendered;
+	{
+		CacheDisk render_cache(cache_path.toStdString(), "RAW", 1.0, 1.0);
+		Clip clip(path.str());
+		clip.End(10.0);
+		Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+		t.AddClip(&clip);
+		t.SetRenderCache(&render_cache);
+		t.Open();
+		rendered = t.GetFrame(1);
+		t.Close();
+		CHECK_EQUAL(0, render_cache.MetricsValue()["hits"].asInt());
+	}
+
+	// The same project in another session reuses the frames
+	CacheDisk render_cache(cache_path.toStdString(), "RAW", 1.0, 1.0);
+	Clip clip(path.str());
+	clip.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip);
+	t.SetRenderCache(&render_cache);
+	t.Open();
+	std::shared_ptr<Frame> reused = t.GetFrame(1);
+	CHECK(render_cache.MetricsValue()["hits"].asInt() > 0);
+	CHECK_EQUAL(0, render_cache.MetricsValue()["misses"].asInt());
+	CHECK_EQUAL(rendered->GetWidth(), reused->GetWidth());
+	CHECK_EQUAL(rendered->GetImage()->pixel(320, 240), reused->GetImage()->pixel(320, 240));
+
+	// A changed clip is rendered again
+	clip.alpha.AddPoint(1, 0.5);
+	t.ClearAllCache();
+	t.GetFrame(1);
+	CHECK(render_cache.MetricsValue()["misses"].asInt() > 0);
+
+	// A frame is rendered again when a setting which changes its pixels is changed (without an edit)
+	int misses = render_cache.MetricsValue()["misses"].asInt();
+	{
+		ScopedSetting<int> interpolation(Settings::Instance()->FRAME_RATE_INTERPOLATION, 1);
+		t.ClearAllCache();
+		t.GetFrame(1);
+		CHECK(render_cache.MetricsValue()["misses"].asInt() > misses);
+	}
+
+	t.Close();
+	render_cache.Clear();
+	QDir(cache_path).removeRecursively();
+}
+
+TEST(Timeline_YUV_Compositing)
+{
+	// Create a scaled, moved, and faded video clip (on a colored background)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(1);
+	clip_video.Position(0.0);
+	clip_video.End(10.0);
+	clip_video.scale_x = Keyframe(0.5);
+	clip_video.scale_y = Keyframe(0.5);
+	clip_video.location_x = Keyframe(0.1);
+	clip_video.alpha = Keyframe(0.75);
+	Timeline t(1280, 720, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	t.color.red = Keyframe(40);
+	t.color.blue = Keyframe(90);
+	t.AddClip(&clip_video);
+	t.Open();
+
+	// Composite the frame as RGBA, and in the decoded YUV planes
+	std::shared_ptr<QImage> painted = t.GetFrame(24)->GetImage();
+	t.ClearAllCache();
+	Settings::Instance()->YUV_COMPOSITING = true;
+	std::shared_ptr<Frame> f = t.GetFrame(24);
+	Settings::Instance()->YUV_COMPOSITING = false;
+
+	// The frame keeps the composited planes (its image is only converted when it is needed)
+	std::shared_ptr<FramePlanes> planes = f->GetPlanes();
+	CHECK(planes != NULL);
+	CHECK(f->IsImageDeferred());
+	CHECK_EQUAL(AV_PIX_FMT_YUV420P, planes->pixel_format);
+	CHECK_EQUAL(1280, planes->width);
+	CHECK_EQUAL(720, planes->height);
+
+	// Both composites are about the same (except for the rounding of the color conversions)
+	std::shared_ptr<QImage> composited = f->GetImage();
+	CHECK_EQUAL(painted->width(), composited->width());
+	CHECK_EQUAL(painted->height(), composited->height());
+	int64_t difference = 0;
+	int64_t channel_count = 0;
+	for (int row = 0; row < composited->height(); row++) {
+		const unsigned char *composited_pixels = composited->constScanLine(row);
+		const unsigned char *painted_pixels = painted->constScanLine(row);
+		for (int channel = 0; channel < composited->width() * 4; channel++, channel_count++)
+			difference += abs(composited_pixels[channel] - painted_pixels[channel]);
+	}
+	CHECK(double(difference) / channel_count < 3.0);
+
+	t.Close();
+}
+
+TEST(Timeline_GPU_Compositing)
+{
+	// The point-wise effects have GPU kernels (the other effects are applied on the CPU)
+	Brightness brightness(Keyframe(0.1), Keyframe(5.0));
+	Saturation saturation(Keyframe(1.5));
+	Hue hue(Keyframe(0.25));
+	Negate negate;
+	ChromaKey chroma_key(Color("#00ff00"), Keyframe(30.0));
+	Blur blur(Keyframe(3.0), Keyframe(3.0), Keyframe(3.0), Keyframe(3.0));
+	CHECK(!brightness.GetGpuKernel(1).source.empty());
+	CHECK_EQUAL(2, brightness.GetGpuKernel(1).parameters.size());
+	CHECK(!saturation.GetGpuKernel(1).source.empty());
+	CHECK(!hue.GetGpuKernel(1).source.empty());
+	CHECK(!negate.GetGpuKernel(1).source.empty());
+	CHECK(!chroma_key.GetGpuKernel(1).source.empty());
+	CHECK(blur.GetGpuKernel(1).source.empty());
+
+	// Create a rotated, scaled, and faded video clip with point-wise effects (on a colored background)
+	stringstream path;
+	path << TEST_MEDIA_PATH << "sintel_trailer-720p.mp4";
+	Clip clip_video(path.str());
+	clip_video.Layer(1);
+	clip_video.Position(0.0);
+	clip_video.End(10.0);
+	clip_video.scale_x = Keyframe(0.5);
+	clip_video.scale_y = Keyframe(0.5);
+	clip_video.rotation = Keyframe(15.0);
+	clip_video.alpha = Keyframe(0.75);
+	clip_video.AddEffect(&brightness);
+	clip_video.AddEffect(&negate);
+	Timeline t(1280, 720, Fraction(24, 1), 44100, 2, LAYOUT_STEREO);
+	t.color.red = Keyframe(40);
+	t.color.blue = Keyframe(90);
+	t.AddClip(&clip_video);
+	t.Open();
+	std::shared_ptr<QImage> painted = t.GetFrame(24)->GetImage();
+	t.Close();
+
+	// Composite the frame on the GPU (without a QGuiApplication, as in this test, it is composited on the CPU)
+	ScopedSetting<bool> gpu_compositing(Settings::Instance()->GPU_COMPOSITING, true);
+	t.ClearAllCache();
+	t.Open();
+	std::shared_ptr<QImage> composited = t.GetFrame(24)->GetImage();
+
+	// Both composites are about the same (except for the antialiased edges, and the rounding of the interpolation)
+	CHECK_EQUAL(painted->width(), composited->width());
+	CHECK_EQUAL(painted->height(), composited->height());
+	CHECK_EQUAL(painted->format(), composited->format());
+	int64_t difference = 0;
+	int64_t channel_count = 0;
+	for (int row = 0; row < composited->height(); row++) {
+		const unsigned char *composited_pixels = composited->constScanLine(row);
+		const unsigned char *painted_pixels = painted->constScanLine(row);
+		for (int channel = 0; channel < composited->width() * 4; channel++, channel_count++)
+			difference += abs(composited_pixels[channel] - painted_pixels[channel]);
+	}
+	if (GpuCompositor::Instance()->IsAvailable())
+		CHECK(double(difference) / channel_count < 2.0);
+	else
+		CHECK_EQUAL(0, difference);
+
+	t.Close();
+}
+
+#ifndef _WIN32
+TEST(Timeline_Frame_Server)
+{
+	stringstream path;
+	path << TEST_MEDIA_PATH << "front3.png";
+	Clip clip(path.str());
+	clip.End(10.0);
+	Timeline t(640, 480, Fraction(30, 1), 44100, 2, LAYOUT_STEREO);
+	t.AddClip(&clip);
+
+	FrameServer server(&t, "openshot-frame-server-test", 4);
+	server.Open();
+	CHECK_EQUAL("/openshot-frame-server-test", server.Name());
+
+	// A frame in the ring buffer is not rendered again
+	CHECK_EQUAL(0, server.Publish(1));
+	CHECK_EQUAL(0, server.Publish(1));
+	CHECK_EQUAL(1, (int) server.Published());
+	std::vector<int> slots = server.PublishFrames(1, 3);
+	CHECK_EQUAL(3, (int) slots.size());
+	CHECK_EQUAL(0, slots[0]);
+	CHECK_EQUAL(1, slots[1]);
+	CHECK_EQUAL(2, slots[2]);
+	CHECK_EQUAL(3, (int) server.Published());
+
+	// Read the frames from the shared memory (as another process would)
+	int descriptor = shm_open(server.Name().c_str(), O_RDONLY, 0);
+	CHECK(descriptor >= 0);
+	struct stat status;
+	fstat(descriptor, &status);
+	const unsigned char *memory = (const unsigned char *) mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	const FrameServerHeader *header = (const FrameServerHeader *) memory;
+	CHECK_EQUAL(0, memcmp(header->magic, "OSFRAME1", 8));
+	CHECK_EQUAL(640, (int) header->width);
+	CHECK_EQUAL(480, (int) header->height);
+	CHECK_EQUAL(3, (int) header->published.load());
+
+	const FrameServerSlot *slot = (const FrameServerSlot *) (memory + FrameServer::HeaderSize + 1 * header->slot_size);
+	CHECK_EQUAL(4, (int) slot->sequence.load());
+	CHECK_EQUAL(2, (int) slot->frame_number);
+	const unsigned char *pixel = (const unsigned char *) slot + FrameServer::SlotHeaderSize + 240 * header->bytes_per_line + 320 * 4;
+	QColor expected = t.GetFrame(2)->GetImage()->pixelColor(320, 240);
+	CHECK_EQUAL(expected.red(), (int) pixel[0]);
+	CHECK_EQUAL(expected.alpha(), (int) pixel[3]);
+
+	// The oldest slot is overwritten once the ring buffer wraps around
+	server.PublishFrames(4, 2);
+	CHECK_EQUAL(0, server.Publish(5));
+	CHECK_EQUAL(5, (int) ((const FrameServerSlot *) (memory + FrameServer::HeaderSize))->frame_number);
+
+	munmap((void *) memory, status.st_size);
+	server.Close();
+	t.Close();
+}
+#endif
@@ -28,21 +28,58 @@
  * along with OpenShot Library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
 #include <iostream>
+#include <string>
 #include "UnitTest++.h"
+#include "TestReporterStdout.h"
 
 using namespace std;
 using namespace UnitTest;
 
-int main()
+// Record the measurements of the performance tests as their new baselines (see Performance_Tests.cpp)
+bool update_performance_baselines = false;
+
+// The file of the baselines of the performance tests
+string performance_baselines_path = PERFORMANCE_BASELINES_PATH;
+
+// Selects the tests of the Performance suite (or all the other tests)
+struct PerformanceSuite {
+	bool performance;
+	PerformanceSuite(bool performance) : performance(performance) {}
+	bool operator()(const Test* const test) const {
+		return performance == (strcmp(test->m_details.suiteName, "Performance") == 0);
+	}
+};
+
+// Usage: openshot-test [--performance [--update-baselines] [--baselines <file>]]
+//
+// The performance tests are timed, so they only run with --performance (on an otherwise idle machine). Their
+// baselines are in the build directory, unless another file is passed with --baselines.
+int main(int argc, char* argv[])
 {
+	bool performance = false;
+	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "--performance") == 0)
+			performance = true;
+		else if (strcmp(argv[arg], "--update-baselines") == 0)
+			update_performance_baselines = true;
+		else if (strcmp(argv[arg], "--baselines") == 0 && arg + 1 < argc)
+			performance_baselines_path = argv[++arg];
+	}
+
 	int exit_code = 0;
 	cout << "----------------------------" << endl;
-	cout << "     RUNNING ALL TESTS" << endl;
+	if (performance)
+		cout << "  RUNNING PERFORMANCE TESTS" << endl;
+	else
+		cout << "     RUNNING ALL TESTS" << endl;
 	cout << "----------------------------" << endl;
 
-	// Run all unit tests
-	exit_code = RunAllTests();
+	// Run the unit tests (or the performance tests)
+	TestReporterStdout reporter;
+	TestRunner runner(reporter);
+	exit_code = runner.RunTestsIf(Test::GetTestList(), NULL, PerformanceSuite(performance), 0);
 
 	cout << "----------------------------" << endl;
 